@@ -18,6 +18,8 @@ than:
       with '-extended' and '-extended-only' too, to print subsets.
     - `-win`: signal that this is running in a Windows environment, and we
       should run the tests.
+    - `-perf`: run ONLY the perf tests, one at a time, and write what they
+      measured to a JSON file, `-perfout=<file>` (default perf-results.json).
     - `--coverage`: this generates a basic coverage report for the RPC
       interface.
 
@@ -36,6 +38,7 @@ import sys
 import subprocess
 import tempfile
 import re
+import json
 
 # to support out-of-source builds, we need to add both the source directory to the path, and the out-of-source directory
 # because tests_config is a generated file
@@ -74,6 +77,8 @@ showHelp = False  # if we need to print help
 p = re.compile("^--")
 p_parallel = re.compile('^-parallel=')
 run_parallel = 4
+p_perfout = re.compile('^-perfout=')
+perf_output = "perf-results.json"
 
 # some of the single-dash options applicable only to this runner script
 # are also allowed in double-dash format (but are not passed on to the
@@ -86,12 +91,14 @@ private_single_opts = ('-h',
                        '-extended-only',
                        '-only-extended',
                        '-force-enable',
+                       '-perf',
                        '-win')
 private_double_opts = ('--list',
                        '--extended',
                        '--extended-only',
                        '--only-extended',
                        '--force-enable',
+                       '--perf',
                        '--win')
 framework_opts = ('--tracerpc',
                   '--help',
@@ -103,7 +110,8 @@ framework_opts = ('--tracerpc',
                   '--coveragedir',
                   '--randomseed',
                   '--testbinary',
-                  '--refbinary')
+                  '--refbinary',
+                  '--perfdir')
 test_script_opts = ('--mineblock',
                     '--extensive')
 
@@ -131,6 +139,8 @@ for arg in sys.argv[1:]:
         double_opts.add(arg)
     elif p_parallel.match(arg):
         run_parallel = int(arg.split(sep='=', maxsplit=1)[1])
+    elif p_perfout.match(arg):
+        perf_output = arg.split(sep='=', maxsplit=1)[1]
 
     else:
         # this is for single-dash options only
@@ -190,6 +200,7 @@ testScripts = [ RpcTest(t) for t in [
     #'mempool_reorg',
     #'mempool_resurrect_test',
     #'mempool_spendcoinbase',
+    'mempool_persist',
     'mintingtest',
     'nodehandling',
     'proxy_test',
@@ -251,6 +262,14 @@ testScriptsExt = [ RpcTest(t) for t in [
     'maxuploadtarget',
 ] ]
 
+# Throughput and latency measurements rather than checks, run with -perf
+testScriptsPerf = [ RpcTest(t) for t in [
+    'perf_txaccept',
+    'perf_blockprop',
+    'perf_getblocktemplate',
+    'perf_reindex',
+] ]
+
 #Enable ZMQ tests
 if ENABLE_ZMQ == 1:
     testScripts.append(RpcTest('zmq_test'))
@@ -266,6 +285,8 @@ def show_wrapper_options():
           "                        run ONLY the extended tests")
     print("  -list / --list        only list test names")
     print("  -win / --win          signal running on Windows and run those tests")
+    print("  -perf / --perf        run ONLY the perf tests, one at a time, and write their results as JSON")
+    print("  -perfout=<file>       where -perf writes the results (default: perf-results.json)")
     print("  -f / -force-enable / --force-enable\n" + \
           "                        attempt to run disabled/skipped tests")
     print("  -h / -help / --help   print this help")
@@ -280,9 +301,13 @@ def runtests():
 
     force_enable = option_passed('force-enable') or '-f' in opts
     run_only_extended = option_passed('only-extended') or option_passed('extended-only')
+    run_perf = option_passed('perf')
 
     if option_passed('list'):
-        if run_only_extended:
+        if run_perf:
+            for t in testScriptsPerf:
+                print(t)
+        elif run_only_extended:
             for t in testScriptsExt:
                 print(t)
         else:
@@ -303,6 +328,13 @@ def runtests():
         run_extended = option_passed('extended') or run_only_extended
         cov_flag = coverage.flag if coverage else ''
         flags = " --srcdir %s/src %s %s" % (buildDir, cov_flag, passOn)
+        parallel = run_parallel
+        perf_dir = None
+        if run_perf:
+            # one at a time, tests running next to each other would measure each other
+            parallel = 1
+            perf_dir = tempfile.mkdtemp(prefix="perf")
+            flags += " --perfdir %s" % perf_dir
 
         # compile the list of tests to check
 
@@ -313,7 +345,7 @@ def runtests():
             for o in opts:
                 if not o.startswith('-'):
                     found = False
-                    for t in testScripts + testScriptsExt:
+                    for t in testScripts + testScriptsExt + testScriptsPerf:
                         t_rep = str(t).split(' ')
                         if (t_rep[0] == o or t_rep[0] == o + '.py') and len(t_rep) > 1:
                             # it is a test with args - check all args match what was passed, otherwise don't add this test
@@ -340,7 +372,9 @@ def runtests():
 
         # if no explicit tests specified, use the lists
         if not len(tests_to_run):
-            if run_only_extended:
+            if run_perf:
+                tests_to_run = testScriptsPerf
+            elif run_only_extended:
                 tests_to_run = testScriptsExt
             else:
                 tests_to_run += testScripts
@@ -363,7 +397,7 @@ def runtests():
                     trimmed_tests_to_run.append(t)
             tests_to_run = trimmed_tests_to_run
 
-        if len(tests_to_run) > 1 and run_parallel:
+        if len(tests_to_run) > 1 and parallel and not run_perf:
             # Populate cache
             subprocess.check_output([RPC_TESTS_DIR + 'create_cache.py'] + [flags]+
                                     (["--no-ipv6-rpc-listen"] if option_passed("no-ipv6-rpc-listen") else []))
@@ -372,7 +406,7 @@ def runtests():
         max_len_name = len(max(tests_to_run, key=len))
         time_sum = 0
         time0 = time.time()
-        job_queue = RPCTestHandler(run_parallel, tests_to_run, flags)
+        job_queue = RPCTestHandler(parallel, tests_to_run, flags)
         results = BOLD[1] + "%s | %s | %s\n\n" % ("TEST".ljust(max_len_name), "PASSED", "DURATION") + BOLD[0]
         all_passed = True
 
@@ -396,6 +430,9 @@ def runtests():
         print(results)
         print("\nRuntime: %s s" % (int(time.time() - time0)))
 
+        if perf_dir:
+            write_perf_results(perf_dir, perf_output)
+
         if coverage:
             coverage.report_rpc_coverage()
 
@@ -416,6 +453,19 @@ def runtests():
     else:
         print("No rpc tests to run. Wallet, utils, and bitcoind must all be enabled")
 
+def write_perf_results(perf_dir, output):
+    """ collect what the perf tests wrote to perf_dir into one file, sorted so that runs diff well """
+    results = {}
+    for filename in sorted(os.listdir(perf_dir)):
+        with open(os.path.join(perf_dir, filename), 'r') as f:
+            test = json.load(f)
+        results[test["test"]] = test["metrics"]
+    with open(output, 'w') as f:
+        json.dump({"time": int(time.time()), "tests": results}, f, indent=2, sort_keys=True)
+        f.write("\n")
+    shutil.rmtree(perf_dir)
+    print("Perf results of %d test(s) written to %s" % (len(results), output))
+
 class RPCTestHandler:
     """
     Trigger the testscrips passed in via the list.
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014-2015 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+import test_framework.loginit
+#
+# Test that the mempool is written to mempool.dat on shutdown and
+# reloaded on startup, unless -persistmempool=0 is given.
+#
+
+import time
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class MempoolPersistTest(BitcoinTestFramework):
+
+    def setup_network(self):
+        args = ["-debug=mempool"]
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, args))
+        self.is_network_split = False
+
+    def wait_for_mempool_size(self, node, size, timeout=30):
+        for i in range(timeout * 10):
+            if len(node.getrawmempool()) == size:
+                return
+            time.sleep(0.1)
+        assert_equal(len(node.getrawmempool()), size)
+
+    def run_test(self):
+        address = self.nodes[0].getnewaddress()
+        txids = [ self.nodes[0].sendtoaddress(address, 1) for i in range(5) ]
+        assert_equal(set(self.nodes[0].getrawmempool()), set(txids))
+
+        # Restart with defaults: the transactions must come back
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-debug=mempool"])
+        self.wait_for_mempool_size(self.nodes[0], len(txids))
+        assert_equal(set(self.nodes[0].getrawmempool()), set(txids))
+
+        # Restart with -persistmempool=0: nothing is loaded
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-debug=mempool", "-persistmempool=0"])
+        time.sleep(2)
+        assert_equal(len(self.nodes[0].getrawmempool()), 0)
+
+if __name__ == '__main__':
+    MempoolPersistTest().main()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Eccoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+import test_framework.loginit
+#
+# Perf: how long a block takes to reach every node of a line of nodes,
+# empty and full of transactions the nodes already have
+#
+import time
+import logging
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+from test_framework.perf import PerfResults, create_utxos, sign_spends, wait_until
+
+NUM_NODES = 4
+NUM_BLOCKS = 10
+TXS_PER_BLOCK = 200
+
+
+class BlockPropagationPerfTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        logging.info("Initializing test directory " + self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, NUM_NODES)
+
+    def setup_network(self):
+        # a line, every block crosses NUM_NODES - 1 hops to reach the last node
+        self.nodes = start_nodes(NUM_NODES, self.options.tmpdir)
+        for i in range(NUM_NODES - 1):
+            connect_nodes_bi(self.nodes, i, i + 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def propagate(self):
+        """Mines a block on the first node and returns how long it took to be the tip of every node"""
+        start = time.time()
+        tip = self.nodes[0].generate(1)[0]
+        arrived = []
+        for node in self.nodes[1:]:
+            wait_until(lambda: node.getbestblockhash() == tip)
+            arrived.append(time.time() - start)
+        return arrived
+
+    def run_test(self):
+        perf = PerfResults("blockprop", self.options.perfdir)
+        txs = sign_spends(self.nodes[0], create_utxos(self.nodes[0], NUM_BLOCKS * TXS_PER_BLOCK))
+        self.sync_all()
+
+        empty = [self.propagate() for _ in range(NUM_BLOCKS)]
+        perf.add_latencies("empty_all_nodes", [a[-1] for a in empty])
+        perf.add_latencies("empty_first_hop", [a[0] for a in empty])
+
+        full = []
+        for i in range(NUM_BLOCKS):
+            for tx in txs[i * TXS_PER_BLOCK:(i + 1) * TXS_PER_BLOCK]:
+                self.nodes[0].sendrawtransaction(tx)
+            sync_mempools(self.nodes, wait=0.1, verbose=0)
+            full.append(self.propagate())
+        perf.add_latencies("full_all_nodes", [a[-1] for a in full])
+        perf.add_latencies("full_first_hop", [a[0] for a in full])
+        perf.add("txs_per_block", TXS_PER_BLOCK, "tx")
+        perf.add("hops", NUM_NODES - 1, "hops")
+        perf.write()
+
+
+if __name__ == '__main__':
+    BlockPropagationPerfTest().main()
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Eccoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+import test_framework.loginit
+#
+# Perf: getblocktemplate latency with an empty and a full mempool, right
+# after the mempool changed and again with nothing new
+#
+import time
+import logging
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+from test_framework.perf import PerfResults, create_utxos, sign_spends
+
+NUM_TXS = 2000
+NUM_CALLS = 20
+
+
+class GetBlockTemplatePerfTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        logging.info("Initializing test directory " + self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        # getblocktemplate refuses to work without a peer
+        self.nodes = start_nodes(2, self.options.tmpdir, [["-maxmempool=300"], ["-maxmempool=300"]])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def time_calls(self, node, count, between=None):
+        times = []
+        for i in range(count):
+            if between:
+                between(i)
+            start = time.time()
+            node.getblocktemplate({})
+            times.append(time.time() - start)
+        return times
+
+    def run_test(self):
+        perf = PerfResults("getblocktemplate", self.options.perfdir)
+        node = self.nodes[0]
+        txs = sign_spends(node, create_utxos(node, NUM_TXS + NUM_CALLS))
+        self.sync_all()
+
+        perf.add_latencies("empty_mempool", self.time_calls(node, NUM_CALLS))
+        for tx in txs[:NUM_TXS]:
+            node.sendrawtransaction(tx)
+        perf.add("mempool_txs", node.getmempoolinfo()["size"], "tx")
+        # the first call after the mempool changed builds the template, the ones after it may reuse it
+        perf.add_latencies("full_mempool_changed",
+                           self.time_calls(node, NUM_CALLS, lambda i: node.sendrawtransaction(txs[NUM_TXS + i])))
+        perf.add_latencies("full_mempool_unchanged", self.time_calls(node, NUM_CALLS))
+        perf.write()
+
+
+if __name__ == '__main__':
+    GetBlockTemplatePerfTest().main()
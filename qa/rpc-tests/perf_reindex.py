@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Eccoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+import test_framework.loginit
+#
+# Perf: how fast -reindex rebuilds the block index and the chainstate of a
+# generated chain with transactions in its blocks
+#
+import time
+import logging
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+from test_framework.perf import PerfResults, create_utxos, sign_spends, wait_until
+
+NUM_BLOCKS = 200
+TXS_PER_BLOCK = 50
+
+
+class ReindexPerfTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        logging.info("Initializing test directory " + self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = [start_node(0, self.options.tmpdir)]
+        self.is_network_split = False
+
+    def run_test(self):
+        perf = PerfResults("reindex", self.options.perfdir)
+        node = self.nodes[0]
+        txs = sign_spends(node, create_utxos(node, NUM_BLOCKS * TXS_PER_BLOCK))
+        for i in range(NUM_BLOCKS):
+            for tx in txs[i * TXS_PER_BLOCK:(i + 1) * TXS_PER_BLOCK]:
+                node.sendrawtransaction(tx)
+            node.generate(1)
+        height = node.getblockcount()
+        tip = node.getbestblockhash()
+        stop_nodes(self.nodes)
+        wait_bitcoinds()
+
+        start = time.time()
+        self.nodes = [start_node(0, self.options.tmpdir, ["-reindex"], timewait=900)]
+        wait_until(lambda: self.nodes[0].getblockcount() == height, timeout=900, poll=0.1)
+        elapsed = time.time() - start
+        assert_equal(self.nodes[0].getbestblockhash(), tip)
+        perf.add("reindex_time", elapsed, "s")
+        perf.add("reindex_rate", height / elapsed, "blocks/s")
+        perf.add("blocks", height, "blocks")
+        perf.write()
+
+
+if __name__ == '__main__':
+    ReindexPerfTest().main()
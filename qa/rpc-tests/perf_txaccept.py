@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Eccoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+import test_framework.loginit
+#
+# Perf: how fast a node accepts transactions into its mempool and how long
+# relaying them to a peer takes
+#
+import time
+import logging
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+from test_framework.perf import PerfResults, create_utxos, sign_spends, wait_until
+
+NUM_TXS = 1000
+
+
+class TxAcceptPerfTest(BitcoinTestFramework):
+
+    def setup_chain(self):
+        logging.info("Initializing test directory " + self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, [["-maxmempool=300"], ["-maxmempool=300"]])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_test(self):
+        perf = PerfResults("txaccept", self.options.perfdir)
+        txs = sign_spends(self.nodes[0], create_utxos(self.nodes[0], NUM_TXS))
+        self.sync_all()
+
+        start = time.time()
+        for tx in txs:
+            self.nodes[0].sendrawtransaction(tx)
+        elapsed = time.time() - start
+        perf.add("accept_rate", len(txs) / elapsed, "tx/s")
+        perf.add("accept_latency_mean", elapsed * 1000 / len(txs), "ms")
+
+        relay = wait_until(lambda: self.nodes[1].getmempoolinfo()["size"] == len(txs))
+        perf.add("relay_complete", relay, "s")
+        perf.add("relay_rate", len(txs) / (elapsed + relay), "tx/s")
+        assert_equal(set(self.nodes[0].getrawmempool()), set(self.nodes[1].getrawmempool()))
+        perf.write()
+
+
+if __name__ == '__main__':
+    TxAcceptPerfTest().main()
@@ -274,6 +274,23 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(response_header_json_str)
         assert_equal(len(json_obj), 5) #now we should have 5 header objects
 
+        # the same headers by height, and the blocks from there on as they are on disk
+        bb_height = rpc_block_json['height']
+        response_range = http_get_call(url.hostname, url.port, '/rest/headersrange/'+str(bb_height)+'/5'+self.FORMAT_SEPARATOR+"json", True)
+        assert_equal(response_range.status, 200)
+        assert_equal(json.loads(response_range.read().decode('utf-8')), json_obj)
+        response_range = http_get_call(url.hostname, url.port, '/rest/headersrange/'+str(bb_height)+'/5'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response_range.status, 200)
+        assert_equal(response_range.read()[0:80], response_header_str)
+        response_range = http_get_call(url.hostname, url.port, '/rest/blockrange/'+str(bb_height)+'/1'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response_range.status, 200)
+        assert_equal(response_range.read(), response_str)
+        response_range = http_get_call(url.hostname, url.port, '/rest/blockrange/'+str(bb_height)+'/3'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response_range.status, 200)
+        assert_greater_than(len(response_range.read()), len(response_str))
+        response_range = http_get_call(url.hostname, url.port, '/rest/blockrange/'+str(bb_height)+'/0'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response_range.status, 400)
+
         # do tx test
         tx_hash = block_json_obj['tx'][0]['txid']
         json_string = http_get_call(url.hostname, url.port, '/rest/tx/'+tx_hash+self.FORMAT_SEPARATOR+"json")
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Eccoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""
+Measurements of the perf tests
+
+A perf test adds what it measured to a PerfResults and writes it at its end. With --perfdir the results go to
+<perfdir>/<test>.json, qa/pull-tester/rpc-tests.py -perf collects those into one file that CI can diff between
+builds. Without it they are only printed.
+
+>>> r = PerfResults("example")
+>>> r.add("accept_rate", 1234.5678, "tx/s")
+>>> r.metrics["accept_rate"]
+{'value': 1234.568, 'unit': 'tx/s'}
+>>> percentile([4, 1, 3, 2], 50)
+2
+>>> percentile([4, 1, 3, 2], 100)
+4
+"""
+
+import json
+import logging
+import math
+import os
+import time
+from contextlib import contextmanager
+from decimal import Decimal
+
+from .util import satoshi_round
+
+
+def percentile(values, p):
+    """The smallest of the values that p percent of them are at most"""
+    ordered = sorted(values)
+    return ordered[max(int(math.ceil(len(ordered) * p / 100.0)) - 1, 0)]
+
+
+class PerfResults(object):
+    def __init__(self, test, perfdir=None):
+        self.test = test
+        self.perfdir = perfdir
+        self.metrics = {}
+
+    def add(self, name, value, unit):
+        self.metrics[name] = {"value": round(value, 3), "unit": unit}
+        logging.info("perf %s: %s = %.3f %s" % (self.test, name, value, unit))
+
+    def add_latencies(self, name, seconds):
+        """Mean, median, 90th percentile and maximum of a list of durations in seconds, as milliseconds"""
+        ms = [s * 1000 for s in seconds]
+        self.add(name + "_mean", sum(ms) / len(ms), "ms")
+        self.add(name + "_p50", percentile(ms, 50), "ms")
+        self.add(name + "_p90", percentile(ms, 90), "ms")
+        self.add(name + "_max", max(ms), "ms")
+
+    @contextmanager
+    def timer(self, name):
+        """Adds the wall clock time of the block in seconds"""
+        start = time.time()
+        yield
+        self.add(name, time.time() - start, "s")
+
+    def write(self):
+        if not self.perfdir:
+            return
+        with open(os.path.join(self.perfdir, self.test + ".json"), "w") as f:
+            json.dump({"test": self.test, "metrics": self.metrics}, f, indent=2, sort_keys=True)
+
+
+def wait_until(predicate, timeout=300, poll=0.01):
+    """Polls predicate until it holds and returns how long that took in seconds"""
+    start = time.time()
+    while not predicate():
+        if time.time() - start > timeout:
+            raise AssertionError("timed out after %d s" % timeout)
+        time.sleep(poll)
+    return time.time() - start
+
+
+def create_utxos(node, count, amount=Decimal("0.5")):
+    """Mines a balance and splits it into count confirmed outputs of amount"""
+    node.generate(101)
+    addrs = {}
+    while len(addrs) < count:
+        addrs[node.getnewaddress()] = amount
+    # sendmany in chunks keeps each transaction well below the standard size
+    addrlist = list(addrs.items())
+    for i in range(0, len(addrlist), 200):
+        node.sendmany("", dict(addrlist[i:i + 200]))
+    while node.getmempoolinfo()["size"] > 0:
+        node.generate(1)
+    return [u for u in node.listunspent() if u["amount"] == amount][:count]
+
+
+def sign_spends(node, utxos, fee=Decimal("0.001")):
+    """One signed transaction for each of the outputs, paying back to the wallet of node"""
+    txs = []
+    addr = node.getnewaddress()
+    for u in utxos:
+        raw = node.createrawtransaction([{"txid": u["txid"], "vout": u["vout"]}],
+                                        {addr: satoshi_round(u["amount"] - fee)})
+        txs.append(node.signrawtransaction(raw)["hex"])
+    return txs
@@ -169,6 +169,8 @@ class BitcoinTestFramework(object):
         parser.add_option("--no-ipv6-rpc-listen", dest="no_ipv6_rpc_listen", default=False, action="store_true",
                           help="Switch off listening on the IPv6 ::1 localhost RPC port. "
                           "This is meant to deal with travis which is currently not supporting IPv6 sockets.")
+        parser.add_option("--perfdir", dest="perfdir", default=None,
+                          help="Perf tests write what they measured to <test>.json in this directory")
 
         self.add_options(parser)
         (self.options, self.args) = parser.parse_args(argsOverride)
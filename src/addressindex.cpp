@@ -0,0 +1,42 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "addressindex.h"
+
+#include "pubkey.h"
+#include "script/standard.h"
+
+bool GetAddressIndexHash(const CScript &scriptPubKey, uint8_t &nTypeOut, uint160 &hashOut)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+    if (const CKeyID *keyID = boost::get<CKeyID>(&dest))
+    {
+        nTypeOut = ADDRESS_PUBKEYHASH;
+        hashOut = *keyID;
+        return true;
+    }
+    if (const CScriptID *scriptID = boost::get<CScriptID>(&dest))
+    {
+        nTypeOut = ADDRESS_SCRIPTHASH;
+        hashOut = *scriptID;
+        return true;
+    }
+    return false;
+}
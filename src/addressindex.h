@@ -0,0 +1,257 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+class CTxOut;
+
+/** What the hash of an address in the address and spent indexes is the hash of */
+enum AddressIndexType : uint8_t
+{
+    ADDRESS_NONE = 0,
+    //! the key id of a pay to pubkey or pay to pubkey hash output
+    ADDRESS_PUBKEYHASH = 1,
+    ADDRESS_SCRIPTHASH = 2,
+};
+
+/** The type and hash of the address scriptPubKey pays to, false for scripts that pay to no single address */
+bool GetAddressIndexHash(const CScript &scriptPubKey, uint8_t &nTypeOut, uint160 &hashOut);
+
+/**
+ * An output paying to an address or an input spending one. The height is stored big endian so the entries of an
+ * address are in the order of the blocks.
+ */
+struct CAddressIndexKey
+{
+    uint8_t nType;
+    uint160 hashBytes;
+    int nBlockHeight;
+    uint256 txhash;
+    uint32_t nIndex;
+    bool fSpending;
+
+    CAddressIndexKey() : nType(ADDRESS_NONE), nBlockHeight(0), nIndex(0), fSpending(false) {}
+    CAddressIndexKey(uint8_t nTypeIn,
+        const uint160 &hashIn,
+        int nHeightIn,
+        const uint256 &txhashIn,
+        uint32_t nIndexIn,
+        bool fSpendingIn)
+        : nType(nTypeIn), hashBytes(hashIn), nBlockHeight(nHeightIn), txhash(txhashIn), nIndex(nIndexIn),
+          fSpending(fSpendingIn)
+    {
+    }
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        ser_writedata8(s, nType);
+        hashBytes.Serialize(s);
+        ser_writedata32be(s, nBlockHeight);
+        txhash.Serialize(s);
+        ser_writedata32(s, nIndex);
+        ser_writedata8(s, fSpending);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s)
+    {
+        nType = ser_readdata8(s);
+        hashBytes.Unserialize(s);
+        nBlockHeight = ser_readdata32be(s);
+        txhash.Unserialize(s);
+        nIndex = ser_readdata32(s);
+        fSpending = ser_readdata8(s) != 0;
+    }
+};
+
+/** The start of the CAddressIndexKey of an address, from nBlockHeight on if that is set */
+struct CAddressIndexIteratorKey
+{
+    uint8_t nType;
+    uint160 hashBytes;
+    int nBlockHeight;
+
+    CAddressIndexIteratorKey(uint8_t nTypeIn, const uint160 &hashIn, int nHeightIn = 0)
+        : nType(nTypeIn), hashBytes(hashIn), nBlockHeight(nHeightIn)
+    {
+    }
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        ser_writedata8(s, nType);
+        hashBytes.Serialize(s);
+        if (nBlockHeight > 0)
+            ser_writedata32be(s, nBlockHeight);
+    }
+};
+
+/** An unspent output of an address */
+struct CAddressUnspentKey
+{
+    uint8_t nType;
+    uint160 hashBytes;
+    uint256 txhash;
+    uint32_t nIndex;
+
+    CAddressUnspentKey() : nType(ADDRESS_NONE), nIndex(0) {}
+    CAddressUnspentKey(uint8_t nTypeIn, const uint160 &hashIn, const uint256 &txhashIn, uint32_t nIndexIn)
+        : nType(nTypeIn), hashBytes(hashIn), txhash(txhashIn), nIndex(nIndexIn)
+    {
+    }
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        ser_writedata8(s, nType);
+        hashBytes.Serialize(s);
+        txhash.Serialize(s);
+        ser_writedata32(s, nIndex);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s)
+    {
+        nType = ser_readdata8(s);
+        hashBytes.Unserialize(s);
+        txhash.Unserialize(s);
+        nIndex = ser_readdata32(s);
+    }
+};
+
+/** The start of the CAddressUnspentKey of an address */
+struct CAddressUnspentIteratorKey
+{
+    uint8_t nType;
+    uint160 hashBytes;
+
+    CAddressUnspentIteratorKey(uint8_t nTypeIn, const uint160 &hashIn) : nType(nTypeIn), hashBytes(hashIn) {}
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        ser_writedata8(s, nType);
+        hashBytes.Serialize(s);
+    }
+};
+
+struct CAddressUnspentValue
+{
+    CAmount nSatoshis;
+    CScript script;
+    int nBlockHeight;
+
+    CAddressUnspentValue() : nSatoshis(-1), nBlockHeight(0) {}
+    CAddressUnspentValue(CAmount nSatoshisIn, const CScript &scriptIn, int nHeightIn)
+        : nSatoshis(nSatoshisIn), script(scriptIn), nBlockHeight(nHeightIn)
+    {
+    }
+
+    //! a null value erases its key when the index is updated
+    bool IsNull() const { return nSatoshis == -1; }
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(nSatoshis);
+        READWRITE(*(CScriptBase *)(&script));
+        READWRITE(nBlockHeight);
+    }
+};
+
+/** An output that has been spent */
+struct CSpentIndexKey
+{
+    uint256 txid;
+    uint32_t nIndex;
+
+    CSpentIndexKey() : nIndex(0) {}
+    CSpentIndexKey(const uint256 &txidIn, uint32_t nIndexIn) : txid(txidIn), nIndex(nIndexIn) {}
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(txid);
+        READWRITE(nIndex);
+    }
+};
+
+/** The input that spent an output and what the output was */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    uint32_t nInputIndex;
+    int nBlockHeight;
+    CAmount nSatoshis;
+    uint8_t nAddressType;
+    uint160 addressHash;
+
+    CSpentIndexValue() : nInputIndex(0), nBlockHeight(0), nSatoshis(0), nAddressType(ADDRESS_NONE) {}
+    CSpentIndexValue(const uint256 &txidIn,
+        uint32_t nInputIndexIn,
+        int nHeightIn,
+        CAmount nSatoshisIn,
+        uint8_t nAddressTypeIn,
+        const uint160 &addressHashIn)
+        : txid(txidIn), nInputIndex(nInputIndexIn), nBlockHeight(nHeightIn), nSatoshis(nSatoshisIn),
+          nAddressType(nAddressTypeIn), addressHash(addressHashIn)
+    {
+    }
+
+    //! a null value erases its key when the index is updated
+    bool IsNull() const { return txid.IsNull(); }
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(txid);
+        READWRITE(nInputIndex);
+        READWRITE(nBlockHeight);
+        READWRITE(nSatoshis);
+        READWRITE(nAddressType);
+        READWRITE(addressHash);
+    }
+};
+
+/** What connecting or disconnecting a block changes in the address and spent indexes, written in one batch */
+struct CAddressIndexUpdate
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<CAddressIndexKey> vAddressIndexErase;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspent;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+
+    bool empty() const
+    {
+        return vAddressIndex.empty() && vAddressIndexErase.empty() && vAddressUnspent.empty() && vSpent.empty();
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -83,6 +83,10 @@ bool DecodeBase58(const char *psz, std::vector<unsigned char> &vch)
     return true;
 }
 
+//! 58^5, the base of the limbs EncodeBase58 converts into, the largest power of 58 below 2^32
+static const uint32_t BASE58_LIMB = 58 * 58 * 58 * 58 * 58;
+static const int BASE58_LIMB_DIGITS = 5;
+
 std::string EncodeBase58(const unsigned char *pbegin, const unsigned char *pend)
 {
     // Skip & count leading zeroes.
@@ -92,32 +96,54 @@ std::string EncodeBase58(const unsigned char *pbegin, const unsigned char *pend)
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
-    std::vector<unsigned char> b58((pend - pbegin) * 138 / 100 + 1); // log(256) / log(58), rounded up.
-    // Process the bytes.
+    // Convert to little-endian limbs of 5 base58 digits, taking the input 32 bits at a time: a limb times 2^32
+    // plus the carry fits in 64 bits. Only the limbs used so far are multiplied.
+    std::vector<uint32_t> limbs;
+    limbs.reserve((pend - pbegin) * 138 / 100 / BASE58_LIMB_DIGITS + 1); // log(256) / log(58), rounded up.
+    size_t nChunk = (pend - pbegin) % 4;
+    if (nChunk == 0)
+        nChunk = 4;
     while (pbegin != pend)
     {
-        int carry = *pbegin;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); it != b58.rend(); it++)
+        uint64_t carry = 0;
+        for (size_t i = 0; i < nChunk; i++)
+            carry = (carry << 8) | *pbegin++;
+        // Apply "limbs = limbs * 256^nChunk + chunk".
+        const int nShift = 8 * nChunk;
+        for (uint32_t &limb : limbs)
         {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
+            carry += (uint64_t)limb << nShift;
+            limb = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
         }
-        assert(carry == 0);
-        pbegin++;
+        while (carry > 0)
+        {
+            limbs.push_back(carry % BASE58_LIMB);
+            carry /= BASE58_LIMB;
+        }
+        nChunk = 4;
     }
-    // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin();
-    while (it != b58.end() && *it == 0)
-        it++;
-    // Translate the result into a string.
+    // Translate the result into a string, the most significant limb without its leading zeroes.
+    char digits[BASE58_LIMB_DIGITS];
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
+    str.reserve(zeroes + limbs.size() * BASE58_LIMB_DIGITS);
     str.assign(zeroes, '1');
-    while (it != b58.end())
-        str += pszBase58[*(it++)];
+    for (std::vector<uint32_t>::reverse_iterator it = limbs.rbegin(); it != limbs.rend(); it++)
+    {
+        uint32_t limb = *it;
+        for (int i = BASE58_LIMB_DIGITS - 1; i >= 0; i--)
+        {
+            digits[i] = pszBase58[limb % 58];
+            limb /= 58;
+        }
+        int nSkip = 0;
+        if (it == limbs.rbegin())
+        {
+            while (nSkip < BASE58_LIMB_DIGITS - 1 && digits[nSkip] == '1')
+                nSkip++;
+        }
+        str.append(digits + nSkip, BASE58_LIMB_DIGITS - nSkip);
+    }
     return str;
 }
 
@@ -130,7 +156,9 @@ bool DecodeBase58(const std::string &str, std::vector<unsigned char> &vchRet)
 std::string EncodeBase58Check(const std::vector<unsigned char> &vchIn)
 {
     // add 4-byte hash check to the end
-    std::vector<unsigned char> vch(vchIn);
+    std::vector<unsigned char> vch;
+    vch.reserve(vchIn.size() + 4);
+    vch.assign(vchIn.begin(), vchIn.end());
     uint256 hash = Hash(vch.begin(), vch.end());
     vch.insert(vch.end(), (unsigned char *)&hash, (unsigned char *)&hash + 4);
     return EncodeBase58(vch);
@@ -0,0 +1,52 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "base58.h"
+#include "bench.h"
+
+#include <vector>
+
+// The payload of an address: the version byte and a key hash.
+static std::vector<unsigned char> AddressPayload()
+{
+    std::vector<unsigned char> vch(21);
+    for (size_t i = 0; i < vch.size(); i++)
+        vch[i] = 0x21 + 7 * i;
+    return vch;
+}
+
+static void Base58Encode(benchmark::State &state)
+{
+    const std::vector<unsigned char> vch = AddressPayload();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            EncodeBase58(vch);
+    }
+}
+
+static void Base58CheckEncode(benchmark::State &state)
+{
+    const std::vector<unsigned char> vch = AddressPayload();
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            EncodeBase58Check(vch);
+    }
+}
+
+static void Base58Decode(benchmark::State &state)
+{
+    const std::string str = EncodeBase58Check(AddressPayload());
+    std::vector<unsigned char> vch;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            DecodeBase58Check(str, vch);
+    }
+}
+
+BENCHMARK(Base58Encode);
+BENCHMARK(Base58CheckEncode);
+BENCHMARK(Base58Decode);
@@ -4,13 +4,45 @@
 
 #include "bench.h"
 
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include <sys/time.h>
 
 using namespace benchmark;
 
 std::map<std::string, BenchFunction> BenchRunner::benchmarks;
 
+static std::atomic<uint64_t> nAllocations(0);
+
+// Count the allocations of everything in the binary, new[] and delete[] end up in
+// these by default. The sized delete is defined too, so what frees a counted
+// allocation is never ours on one path and the library's on another.
+void *operator new(size_t size)
+{
+    nAllocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, std::size_t size) noexcept
+{
+    free(p);
+}
+
+uint64_t benchmark::GetAllocationCount()
+{
+    return nAllocations.load(std::memory_order_relaxed);
+}
+
 static double gettimedouble(void) {
     struct timeval tv;
     gettimeofday(&tv, NULL);
@@ -25,7 +57,8 @@ BenchRunner::BenchRunner(std::string name, BenchFunction func)
 void
 BenchRunner::RunAll(double elapsedTimeForOne)
 {
-    std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+    std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << ","
+              << "ns/op" << "," << "allocs/op" << "\n";
 
     for (std::map<std::string,BenchFunction>::iterator it = benchmarks.begin();
          it != benchmarks.end(); ++it) {
@@ -41,6 +74,7 @@ bool State::KeepRunning()
     double now;
     if (count == 0) {
         beginTime = now = gettimedouble();
+        beginAllocations = GetAllocationCount();
     }
     else {
         // timeCheckCount is used to avoid calling gettime most of the time,
@@ -64,7 +98,9 @@ bool State::KeepRunning()
 
     // Output results
     double average = (now-beginTime)/count;
-    std::cout << name << "," << count << "," << minTime << "," << maxTime << "," << average << "\n";
+    double allocations = (double)(GetAllocationCount() - beginAllocations)/count;
+    std::cout << name << "," << count << "," << minTime << "," << maxTime << "," << average << ","
+              << average * 1e9 << "," << allocations << "\n";
 
     return false;
 }
@@ -5,7 +5,9 @@
 #ifndef BITCOIN_BENCH_BENCH_H
 #define BITCOIN_BENCH_BENCH_H
 
+#include <limits>
 #include <map>
+#include <stdint.h>
 #include <string>
 
 #include <boost/function.hpp>
@@ -43,8 +45,10 @@ namespace benchmark {
         double lastTime, minTime, maxTime;
         int64_t count;
         int64_t timeCheckCount;
+        uint64_t beginAllocations;
     public:
-        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0) {
+        State(std::string _name, double _maxElapsed)
+            : name(_name), maxElapsed(_maxElapsed), count(0), beginAllocations(0) {
             minTime = std::numeric_limits<double>::max();
             maxTime = std::numeric_limits<double>::min();
             timeCheckCount = 1;
@@ -52,6 +56,9 @@ namespace benchmark {
         bool KeepRunning();
     };
 
+    /** The number of operator new calls so far, in all threads */
+    uint64_t GetAllocationCount();
+
     typedef boost::function<void(State&)> BenchFunction;
 
     class BenchRunner
@@ -3,19 +3,34 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "replay.h"
 
+#include "args.h"
+#include "crypto/sha256.h"
+#include "init.h"
 #include "key.h"
 #include "main.h"
+#include "networks/netman.h"
 #include "util/util.h"
 
 int
 main(int argc, char** argv)
 {
+    SHA256AutoDetect();
     ECC_Start();
     SetupEnvironment();
+    gArgs.ParseParameters(argc, argv);
     g_logger->fPrintToDebugLog = false; // don't want to write to debug.log file
+    // the consensus code looks up its parameters through pnetMan
+    pnetMan = new CNetworkManager();
+    pnetMan->SetParams("LEGACY");
 
-    benchmark::BenchRunner::RunAll();
+    int nResult = 0;
+    if (gArgs.IsArgSet("-replay"))
+        nResult = RunReplay();
+    else
+        benchmark::BenchRunner::RunAll();
 
     ECC_Stop();
+    return nResult;
 }
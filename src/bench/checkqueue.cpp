@@ -0,0 +1,74 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+// Checks per block and per Add(), roughly a full block of two input transactions
+static const unsigned int BENCH_BLOCK_CHECKS = 4000;
+static const unsigned int BENCH_CHECKS_PER_TX = 2;
+
+// Stand-in for a CScriptCheck: a fixed amount of hashing, about the cost of a signature check
+// divided by ten so the queue overhead shows up.
+class CBenchCheck
+{
+    unsigned char data[32];
+
+public:
+    CBenchCheck() { memset(data, 0, sizeof(data)); }
+    bool operator()()
+    {
+        for (int i = 0; i < 20; i++)
+            CSHA256().Write(data, sizeof(data)).Finalize(data);
+        return true;
+    }
+    void swap(CBenchCheck &check) { std::swap(data, check.data); }
+};
+
+// Verify BENCH_BLOCK_CHECKS checks per iteration with nThreads threads including the master, the
+// way ConnectBlock does. Checks per second is BENCH_BLOCK_CHECKS divided by the time per iteration.
+static void CheckQueueBlock(benchmark::State &state, int nThreads, bool fSteal)
+{
+    CCheckQueue<CBenchCheck> queue(128, fSteal ? nThreads : 0);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread([&queue] { queue.Thread(); });
+    while (state.KeepRunning())
+    {
+        CCheckQueueControl<CBenchCheck> control(&queue);
+        for (unsigned int i = 0; i < BENCH_BLOCK_CHECKS; i += BENCH_CHECKS_PER_TX)
+        {
+            std::vector<CBenchCheck> vChecks(BENCH_CHECKS_PER_TX);
+            control.Add(vChecks);
+        }
+        assert(control.Wait());
+    }
+    queue.Stop();
+    threads.join_all();
+}
+
+static void CheckQueueShared1(benchmark::State &state) { CheckQueueBlock(state, 1, false); }
+static void CheckQueueShared2(benchmark::State &state) { CheckQueueBlock(state, 2, false); }
+static void CheckQueueShared4(benchmark::State &state) { CheckQueueBlock(state, 4, false); }
+static void CheckQueueShared8(benchmark::State &state) { CheckQueueBlock(state, 8, false); }
+static void CheckQueueShared16(benchmark::State &state) { CheckQueueBlock(state, 16, false); }
+static void CheckQueueSteal2(benchmark::State &state) { CheckQueueBlock(state, 2, true); }
+static void CheckQueueSteal4(benchmark::State &state) { CheckQueueBlock(state, 4, true); }
+static void CheckQueueSteal8(benchmark::State &state) { CheckQueueBlock(state, 8, true); }
+static void CheckQueueSteal16(benchmark::State &state) { CheckQueueBlock(state, 16, true); }
+
+BENCHMARK(CheckQueueShared1);
+BENCHMARK(CheckQueueShared2);
+BENCHMARK(CheckQueueShared4);
+BENCHMARK(CheckQueueShared8);
+BENCHMARK(CheckQueueShared16);
+BENCHMARK(CheckQueueSteal2);
+BENCHMARK(CheckQueueSteal4);
+BENCHMARK(CheckQueueSteal8);
+BENCHMARK(CheckQueueSteal16);
@@ -0,0 +1,151 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "bench.h"
+#include "coins.h"
+#include "script/script.h"
+#include "txdb.h"
+
+#include <deque>
+
+// The coins the benchmarks start from, about the size of the mainnet UTXO set
+static const uint32_t BENCH_COINS = 300000;
+// The inputs and outputs of a full block, every operation below works on this many coins
+static const uint32_t BENCH_BLOCK_COINS = 2000;
+
+static COutPoint BenchOutPoint(uint64_t n) { return COutPoint(ArithToUint256(arith_uint256(n)), n % 3); }
+static Coin BenchCoin(uint64_t n)
+{
+    CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n & 0xff) << OP_EQUALVERIFY
+                               << OP_CHECKSIG;
+    return Coin(CTxOut(1000 + n, script), 1000000 + n / 1000, false, false, 1500000000 + n);
+}
+
+static void FillCoins(CCoinsViewCache &cache, uint32_t nCoins)
+{
+    for (uint32_t i = 0; i < nCoins; i++)
+        cache.AddCoin(BenchOutPoint(i), BenchCoin(i), false);
+}
+
+// Add the outputs of a block to a view on top of the coins cache.
+static void CoinsCacheAddCoin(benchmark::State &state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    FillCoins(cache, BENCH_COINS);
+    uint64_t n = BENCH_COINS;
+    while (state.KeepRunning())
+    {
+        CCoinsViewCache view(&cache);
+        for (uint32_t i = 0; i < BENCH_BLOCK_COINS; i++, n++)
+            view.AddCoin(BenchOutPoint(n), BenchCoin(n), false);
+    }
+}
+
+// Look up the inputs of a block through a view on top of the coins cache, they are all in it.
+static void CoinsCacheAccessCoin(benchmark::State &state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    FillCoins(cache, BENCH_COINS);
+    uint64_t n = 0;
+    while (state.KeepRunning())
+    {
+        CCoinsViewCache view(&cache);
+        for (uint32_t i = 0; i < BENCH_BLOCK_COINS; i++, n += 7919)
+            assert(!view.AccessCoin(BenchOutPoint(n % BENCH_COINS)).IsSpent());
+    }
+}
+
+// Spend the inputs of a block in a view on top of the coins cache, the view is dropped as for a block
+// that fails to connect.
+static void CoinsCacheSpendCoin(benchmark::State &state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    FillCoins(cache, BENCH_COINS);
+    uint64_t n = 0;
+    while (state.KeepRunning())
+    {
+        CCoinsViewCache view(&cache);
+        for (uint32_t i = 0; i < BENCH_BLOCK_COINS; i++, n += 7919)
+            view.SpendCoin(BenchOutPoint(n % BENCH_COINS));
+    }
+}
+
+// Connect a block worth of coins to the coins cache: spend the oldest coins, add as many new ones and
+// write the view back with BatchWrite.
+static void CoinsCacheBatchWrite(benchmark::State &state)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    FillCoins(cache, BENCH_COINS);
+    uint64_t nOldest = 0;
+    uint64_t nNext = BENCH_COINS;
+    while (state.KeepRunning())
+    {
+        CCoinsViewCache view(&cache);
+        for (uint32_t i = 0; i < BENCH_BLOCK_COINS; i++)
+        {
+            view.SpendCoin(BenchOutPoint(nOldest++));
+            view.AddCoin(BenchOutPoint(nNext), BenchCoin(nNext), false);
+            nNext++;
+        }
+        view.Flush();
+    }
+}
+
+// Flush a block worth of spent and new coins from the coins cache to an in memory chainstate database.
+static void CoinsViewDBFlush(benchmark::State &state)
+{
+    CCoinsViewDB db(1 << 23, true);
+    {
+        CCoinsViewCache cache(&db);
+        FillCoins(cache, BENCH_COINS);
+        cache.Flush();
+    }
+    CCoinsViewCache cache(&db);
+    uint64_t nOldest = 0;
+    uint64_t nNext = BENCH_COINS;
+    while (state.KeepRunning())
+    {
+        for (uint32_t i = 0; i < BENCH_BLOCK_COINS; i++)
+        {
+            cache.SpendCoin(BenchOutPoint(nOldest++));
+            cache.AddCoin(BenchOutPoint(nNext), BenchCoin(nNext), false);
+            nNext++;
+        }
+        cache.Flush();
+    }
+}
+
+// Read the inputs of a block from an in memory chainstate database, as a cache that does not hold them does.
+static void CoinsViewDBAccessCoin(benchmark::State &state)
+{
+    CCoinsViewDB db(1 << 23, true);
+    {
+        CCoinsViewCache cache(&db);
+        FillCoins(cache, BENCH_COINS);
+        cache.Flush();
+    }
+    CCoinsViewCache cache(&db);
+    uint64_t n = 0;
+    while (state.KeepRunning())
+    {
+        for (uint32_t i = 0; i < BENCH_BLOCK_COINS; i++, n += 7919)
+        {
+            const COutPoint outpoint = BenchOutPoint(n % BENCH_COINS);
+            assert(!cache.AccessCoin(outpoint).IsSpent());
+            cache.Uncache(outpoint);
+        }
+    }
+}
+
+BENCHMARK(CoinsCacheAddCoin);
+BENCHMARK(CoinsCacheAccessCoin);
+BENCHMARK(CoinsCacheSpendCoin);
+BENCHMARK(CoinsCacheBatchWrite);
+BENCHMARK(CoinsViewDBFlush);
+BENCHMARK(CoinsViewDBAccessCoin);
@@ -0,0 +1,76 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "random.h"
+#include "uint256.h"
+#include "util/utilstrencodings.h"
+
+#include <vector>
+
+// A script of a typical output and a block of transactions, the way getblock and decoderawtransaction print them.
+static std::vector<unsigned char> RandomBytes(size_t nSize)
+{
+    FastRandomContext rng(true);
+    std::vector<unsigned char> vch(nSize);
+    for (unsigned char &ch : vch)
+        ch = rng.rand32();
+    return vch;
+}
+
+static void HexStrScript(benchmark::State &state)
+{
+    const std::vector<unsigned char> vch = RandomBytes(25);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            HexStr(vch);
+    }
+}
+
+static void HexStrBlock(benchmark::State &state)
+{
+    const std::vector<unsigned char> vch = RandomBytes(1000000);
+    while (state.KeepRunning())
+    {
+        HexStr(vch);
+    }
+}
+
+static void ParseHexBlock(benchmark::State &state)
+{
+    const std::string strHex = HexStr(RandomBytes(1000000));
+    while (state.KeepRunning())
+    {
+        ParseHex(strHex);
+    }
+}
+
+static void Uint256GetHex(benchmark::State &state)
+{
+    const std::vector<unsigned char> vch = RandomBytes(32);
+    const uint256 hash(vch);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            hash.GetHex();
+    }
+}
+
+static void Uint256SetHex(benchmark::State &state)
+{
+    const std::string strHex = uint256(RandomBytes(32)).GetHex();
+    uint256 hash;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            hash.SetHex(strHex);
+    }
+}
+
+BENCHMARK(HexStrScript);
+BENCHMARK(HexStrBlock);
+BENCHMARK(ParseHexBlock);
+BENCHMARK(Uint256GetHex);
+BENCHMARK(Uint256SetHex);
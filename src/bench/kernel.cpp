@@ -0,0 +1,81 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain/chainman.h"
+#include "init.h"
+#include "kernel.h"
+#include "main.h"
+#include "networks/netman.h"
+
+// Headers one block time apart with distinct stake modifiers, as the tip of the active chain. Built
+// once, both benchmarks walk the same chain.
+static const CBlockIndex *GetBenchChainTip()
+{
+    static const CBlockIndex *pindexTip = nullptr;
+    if (pindexTip)
+        return pindexTip;
+
+    CChainManager *pchainman = pnetMan->getChainActive();
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.nBits = 0x1e0fffff;
+    header.nTime = 1500000000;
+    CBlockIndex *pindex = nullptr;
+    for (int i = 0; i < 50; i++)
+    {
+        header.hashPrevBlock = pindex ? pindex->GetBlockHash() : uint256();
+        header.nTime += 45;
+        header.nNonce = i;
+        pindex = pchainman->AddToBlockIndex(header);
+        pindex->nStakeModifier = ArithToUint256(arith_uint256(0x1000 + i));
+        pindex->hashProofOfStake = ArithToUint256(arith_uint256(0x2000 + i));
+    }
+    LOCK(cs_main);
+    pchainman->chainActive.SetTip(pindex);
+    pchainman->PublishTip();
+    pindexTip = pindex;
+    return pindexTip;
+}
+
+// The modifier of a block after a proof of work block, hashed from the three blocks before it.
+static void StakeModifierCoinBase(benchmark::State &state)
+{
+    const CBlockIndex *pindexPrev = GetBenchChainTip();
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.SetNull();
+    tx.vout.resize(1);
+    uint256 nStakeModifier;
+    while (state.KeepRunning())
+    {
+        ComputeNextStakeModifier(pindexPrev, tx, nStakeModifier);
+    }
+}
+
+// Check a kernel past the reduction fork the way a staker tries one for every timestamp, the kernel
+// modifier comes from the cache after the first one.
+static void StakeKernelHash(benchmark::State &state)
+{
+    const CBlockIndex *pindexTip = GetBenchChainTip();
+    const CBlockIndex *pindexFrom = pindexTip->GetAncestor(10);
+    CTransaction txPrev;
+    txPrev.nTime = pindexFrom->nTime;
+    txPrev.vout.resize(2);
+    txPrev.vout[1].nValue = 10000 * COIN;
+    const COutPoint prevout(txPrev.GetHash(), 1);
+    const unsigned int nTargetBits =
+        UintToArith256(pnetMan->getActivePaymentNetwork()->GetConsensus().posLimit).GetCompact();
+    unsigned int nTimeTx = txPrev.nTime + pnetMan->getActivePaymentNetwork()->getStakeMinAge() + 86400;
+    uint256 hashProofOfStake;
+    while (state.KeepRunning())
+    {
+        CheckStakeKernelHash(1504351, pindexFrom->GetBlockHash(), pindexFrom->nTime, 81, txPrev, prevout,
+            nTimeTx, nTargetBits, hashProofOfStake);
+        nTimeTx++;
+    }
+}
+
+BENCHMARK(StakeModifierCoinBase);
+BENCHMARK(StakeKernelHash);
@@ -0,0 +1,224 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "rsm/recursive_shared_mutex.h"
+#include "sync.h"
+
+#include <atomic>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+// The lock primitives cs_mapBlockIndex and the mempool cs could be, side by side. Every case runs the same mix of
+// reads and writes on the measured thread and on the threads that compete with it. std::shared_mutex is C++17,
+// std::shared_timed_mutex is the C++14 one the tree can build.
+
+/** Shared and exclusive locking of Mutex, a mutex without shared ownership takes the exclusive lock for both */
+template <typename Mutex>
+struct LockOps
+{
+    static void LockShared(Mutex &mutex) { mutex.lock_shared(); }
+    static void UnlockShared(Mutex &mutex) { mutex.unlock_shared(); }
+};
+
+template <>
+struct LockOps<CCriticalSection>
+{
+    static void LockShared(CCriticalSection &mutex) { mutex.lock(); }
+    static void UnlockShared(CCriticalSection &mutex) { mutex.unlock(); }
+};
+
+/** nOps locks of mutex, every nWriteEvery-th one exclusive and the others shared */
+template <typename Mutex>
+static void LockMix(Mutex &mutex, volatile uint64_t &nValue, int nWriteEvery, int nOps)
+{
+    for (int i = 0; i < nOps; i++)
+    {
+        if (i % nWriteEvery == 0)
+        {
+            mutex.lock();
+            nValue = nValue + 1;
+            mutex.unlock();
+        }
+        else
+        {
+            LockOps<Mutex>::LockShared(mutex);
+            uint64_t nRead = nValue;
+            (void)nRead;
+            LockOps<Mutex>::UnlockShared(mutex);
+        }
+    }
+}
+
+/** Runs the mix on nThreads - 1 more threads for as long as it lives */
+template <typename Mutex>
+class CLockContention
+{
+private:
+    std::atomic<bool> fStop;
+    std::vector<std::thread> threads;
+
+public:
+    CLockContention(Mutex &mutex, volatile uint64_t &nValue, int nWriteEvery, int nThreads) : fStop(false)
+    {
+        for (int i = 1; i < nThreads; i++)
+        {
+            threads.emplace_back([this, &mutex, &nValue, nWriteEvery]() {
+                while (!fStop)
+                    LockMix(mutex, nValue, nWriteEvery, 100);
+            });
+        }
+    }
+    ~CLockContention()
+    {
+        fStop = true;
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+};
+
+// One write in nWriteEvery locks, on nThreads threads.
+template <typename Mutex, int nWriteEvery, int nThreads>
+static void LockReadWrite(benchmark::State &state)
+{
+    Mutex mutex;
+    volatile uint64_t nValue = 0;
+    CLockContention<Mutex> contention(mutex, nValue, nWriteEvery, nThreads);
+    while (state.KeepRunning())
+        LockMix(mutex, nValue, nWriteEvery, 1000);
+}
+
+// A shared lock taken again nDepth - 1 times by the functions the holder calls.
+template <typename Mutex, int nDepth>
+static void LockSharedDepth(benchmark::State &state)
+{
+    Mutex mutex;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            for (int j = 0; j < nDepth; j++)
+                LockOps<Mutex>::LockShared(mutex);
+            for (int j = 0; j < nDepth; j++)
+                LockOps<Mutex>::UnlockShared(mutex);
+        }
+    }
+}
+
+// The same for the exclusive lock.
+template <typename Mutex, int nDepth>
+static void LockExclusiveDepth(benchmark::State &state)
+{
+    Mutex mutex;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            for (int j = 0; j < nDepth; j++)
+                mutex.lock();
+            for (int j = 0; j < nDepth; j++)
+                mutex.unlock();
+        }
+    }
+}
+
+// A reader that finds it has to write, while nThreads - 1 threads only read. The recursive_shared_mutex keeps its
+// shared lock and is promoted, the others have to give it up and take the exclusive lock.
+template <int nThreads>
+static void RSMPromote(benchmark::State &state)
+{
+    recursive_shared_mutex mutex;
+    volatile uint64_t nValue = 0;
+    CLockContention<recursive_shared_mutex> contention(mutex, nValue, 1000000, nThreads);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            mutex.lock_shared();
+            if (mutex.try_promotion())
+            {
+                nValue = nValue + 1;
+                mutex.unlock();
+            }
+            mutex.unlock_shared();
+        }
+    }
+}
+
+template <typename Mutex, int nThreads>
+static void LockRelock(benchmark::State &state)
+{
+    Mutex mutex;
+    volatile uint64_t nValue = 0;
+    CLockContention<Mutex> contention(mutex, nValue, 1000000, nThreads);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            mutex.lock_shared();
+            mutex.unlock_shared();
+            mutex.lock();
+            nValue = nValue + 1;
+            mutex.unlock();
+        }
+    }
+}
+
+// One write in writes locks on threads threads, named like RSMReadWrite10x4
+#define LOCK_READ_WRITE_BENCH(name, type, writes, threads)                     \
+    static void name##ReadWrite##writes##x##threads(benchmark::State &state) \
+    {                                                                         \
+        LockReadWrite<type, writes, threads>(state);                          \
+    }                                                                         \
+    BENCHMARK(name##ReadWrite##writes##x##threads);
+
+#define LOCK_READ_WRITE_BENCHES(name, type)   \
+    LOCK_READ_WRITE_BENCH(name, type, 10, 1)  \
+    LOCK_READ_WRITE_BENCH(name, type, 10, 2)  \
+    LOCK_READ_WRITE_BENCH(name, type, 10, 4)  \
+    LOCK_READ_WRITE_BENCH(name, type, 10, 8)  \
+    LOCK_READ_WRITE_BENCH(name, type, 100, 1) \
+    LOCK_READ_WRITE_BENCH(name, type, 100, 2) \
+    LOCK_READ_WRITE_BENCH(name, type, 100, 4) \
+    LOCK_READ_WRITE_BENCH(name, type, 100, 8)
+
+LOCK_READ_WRITE_BENCHES(RSM, recursive_shared_mutex)
+LOCK_READ_WRITE_BENCHES(SharedCritSect, CSharedCriticalSection)
+LOCK_READ_WRITE_BENCHES(CritSect, CCriticalSection)
+LOCK_READ_WRITE_BENCHES(StdSharedMutex, std::shared_timed_mutex)
+
+// boost::shared_mutex and std::shared_timed_mutex are not recursive, only the recursive primitives are measured
+static void RSMLockSharedDepth1(benchmark::State &state) { LockSharedDepth<recursive_shared_mutex, 1>(state); }
+static void RSMLockSharedDepth2(benchmark::State &state) { LockSharedDepth<recursive_shared_mutex, 2>(state); }
+static void RSMLockSharedDepth4(benchmark::State &state) { LockSharedDepth<recursive_shared_mutex, 4>(state); }
+static void RSMLockDepth1(benchmark::State &state) { LockExclusiveDepth<recursive_shared_mutex, 1>(state); }
+static void RSMLockDepth2(benchmark::State &state) { LockExclusiveDepth<recursive_shared_mutex, 2>(state); }
+static void RSMLockDepth4(benchmark::State &state) { LockExclusiveDepth<recursive_shared_mutex, 4>(state); }
+static void CritSectLockDepth1(benchmark::State &state) { LockExclusiveDepth<CCriticalSection, 1>(state); }
+static void CritSectLockDepth2(benchmark::State &state) { LockExclusiveDepth<CCriticalSection, 2>(state); }
+static void CritSectLockDepth4(benchmark::State &state) { LockExclusiveDepth<CCriticalSection, 4>(state); }
+
+static void RSMPromote1(benchmark::State &state) { RSMPromote<1>(state); }
+static void RSMPromote4(benchmark::State &state) { RSMPromote<4>(state); }
+static void SharedCritSectRelock1(benchmark::State &state) { LockRelock<CSharedCriticalSection, 1>(state); }
+static void SharedCritSectRelock4(benchmark::State &state) { LockRelock<CSharedCriticalSection, 4>(state); }
+static void StdSharedMutexRelock1(benchmark::State &state) { LockRelock<std::shared_timed_mutex, 1>(state); }
+static void StdSharedMutexRelock4(benchmark::State &state) { LockRelock<std::shared_timed_mutex, 4>(state); }
+
+BENCHMARK(RSMLockSharedDepth1);
+BENCHMARK(RSMLockSharedDepth2);
+BENCHMARK(RSMLockSharedDepth4);
+BENCHMARK(RSMLockDepth1);
+BENCHMARK(RSMLockDepth2);
+BENCHMARK(RSMLockDepth4);
+BENCHMARK(CritSectLockDepth1);
+BENCHMARK(CritSectLockDepth2);
+BENCHMARK(CritSectLockDepth4);
+BENCHMARK(RSMPromote1);
+BENCHMARK(RSMPromote4);
+BENCHMARK(SharedCritSectRelock1);
+BENCHMARK(SharedCritSectRelock4);
+BENCHMARK(StdSharedMutexRelock1);
+BENCHMARK(StdSharedMutexRelock4);
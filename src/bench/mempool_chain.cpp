@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+#include "txmempool.h"
+
+#include <limits>
+#include <vector>
+
+static std::vector<CTransactionRef> MakeChain(size_t nLength)
+{
+    std::vector<CTransactionRef> vChain;
+    uint256 hashPrev;
+    hashPrev.SetHex("0x1");
+    for (size_t i = 0; i < nLength; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vin[0].prevout.hash = hashPrev;
+        tx.vin[0].prevout.n = 0;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1;
+        tx.vout[0].nValue = 1000 * COIN - i * 1000;
+        vChain.push_back(MakeTransactionRef(tx));
+        hashPrev = vChain.back()->GetHash();
+    }
+    return vChain;
+}
+
+static CTxMemPoolEntry MakeEntry(const CTransactionRef &tx)
+{
+    return CTxMemPoolEntry(tx, 1000, 0, 0, 1, false, 0, false, 1, LockPoints());
+}
+
+// Accept a chain of 200 dependent transactions one after the other, checking the limits the
+// way AcceptToMemoryPool does for each.
+static void MempoolLongChainAccept(benchmark::State &state)
+{
+    const std::vector<CTransactionRef> vChain = MakeChain(200);
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    while (state.KeepRunning())
+    {
+        CTxMemPool pool(CFeeRate(0));
+        WRITELOCK(pool.cs);
+        for (const CTransactionRef &tx : vChain)
+        {
+            CTxMemPoolEntry entry(MakeEntry(tx));
+            CTxMemPool::setEntries setAncestors;
+            std::string errString;
+            pool._CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, errString);
+            pool.addUnchecked(tx->GetHash(), entry, setAncestors, false);
+        }
+    }
+}
+
+// Offer children to a chain that is already at the default ancestor limit.
+static void MempoolLongChainReject(benchmark::State &state)
+{
+    const std::vector<CTransactionRef> vChain = MakeChain(DEFAULT_ANCESTOR_LIMIT + 1);
+    CTxMemPool pool(CFeeRate(0));
+    for (size_t i = 0; i < DEFAULT_ANCESTOR_LIMIT; i++)
+    {
+        pool.addUnchecked(vChain[i]->GetHash(), MakeEntry(vChain[i]), false);
+    }
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    CTxMemPoolEntry entry(MakeEntry(vChain.back()));
+    WRITELOCK(pool.cs);
+    while (state.KeepRunning())
+    {
+        CTxMemPool::setEntries setAncestors;
+        std::string errString;
+        assert(!pool._CalculateMemPoolAncestors(
+            entry, setAncestors, DEFAULT_ANCESTOR_LIMIT, nNoLimit, nNoLimit, nNoLimit, errString));
+    }
+}
+
+// Collect the ancestors of a child of a chain of 1000, as a pool accepting without limits walks them.
+static void MempoolDeepChainAncestors(benchmark::State &state)
+{
+    const std::vector<CTransactionRef> vChain = MakeChain(1001);
+    CTxMemPool pool(CFeeRate(0));
+    for (size_t i = 0; i + 1 < vChain.size(); i++)
+    {
+        pool.addUnchecked(vChain[i]->GetHash(), MakeEntry(vChain[i]), false);
+    }
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    CTxMemPoolEntry entry(MakeEntry(vChain.back()));
+    WRITELOCK(pool.cs);
+    while (state.KeepRunning())
+    {
+        CTxMemPool::setEntries setAncestors;
+        std::string errString;
+        pool._CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, errString);
+        assert(setAncestors.size() == vChain.size() - 1);
+    }
+}
+
+BENCHMARK(MempoolLongChainAccept);
+BENCHMARK(MempoolLongChainReject);
+BENCHMARK(MempoolDeepChainAncestors);
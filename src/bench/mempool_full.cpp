@@ -0,0 +1,95 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "bench.h"
+#include "main.h"
+#include "txmempool.h"
+
+#include <list>
+#include <vector>
+
+// About what a busy mainnet pool holds
+static const size_t BENCH_POOL_TXS = 5000;
+// The transactions of a full block
+static const size_t BENCH_BLOCK_TXS = 1000;
+
+// Independent one input, two output transactions paying different fees
+static std::vector<CTransactionRef> MakeTransactions(size_t nCount, uint64_t nFirst)
+{
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(nCount);
+    for (uint64_t n = nFirst; n < nFirst + nCount; n++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(n + 1)), 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2);
+        tx.vout.resize(2);
+        for (CTxOut &out : tx.vout)
+        {
+            out.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n & 0xff)
+                                         << OP_EQUALVERIFY << OP_CHECKSIG;
+            out.nValue = COIN;
+        }
+        vtx.push_back(MakeTransactionRef(tx));
+    }
+    return vtx;
+}
+
+static CTxMemPoolEntry MakeEntry(const CTransactionRef &tx, uint64_t n)
+{
+    return CTxMemPoolEntry(tx, 1000 + (n * 7919) % 100000, n, 0, 1, true, 2 * COIN, false, 1, LockPoints());
+}
+
+static void FillPool(CTxMemPool &pool, const std::vector<CTransactionRef> &vtx, uint64_t nFirst)
+{
+    for (size_t i = 0; i < vtx.size(); i++)
+        pool.addUnchecked(vtx[i]->GetHash(), MakeEntry(vtx[i], nFirst + i), false);
+}
+
+// Fill an empty pool the way transactions arrive, computing the ancestors of each.
+static void MempoolAddUnchecked(benchmark::State &state)
+{
+    const std::vector<CTransactionRef> vtx = MakeTransactions(BENCH_POOL_TXS, 0);
+    while (state.KeepRunning())
+    {
+        CTxMemPool pool(CFeeRate(0));
+        FillPool(pool, vtx, 0);
+    }
+}
+
+// A pool at its size limit that a block worth of new transactions arrive at, the cheapest are evicted.
+static void MempoolTrimToSize(benchmark::State &state)
+{
+    CTxMemPool pool(CFeeRate(0));
+    FillPool(pool, MakeTransactions(BENCH_POOL_TXS, 0), 0);
+    const size_t nLimit = pool.DynamicMemoryUsage();
+    uint64_t nNext = BENCH_POOL_TXS;
+    while (state.KeepRunning())
+    {
+        FillPool(pool, MakeTransactions(BENCH_BLOCK_TXS, nNext), nNext);
+        nNext += BENCH_BLOCK_TXS;
+        pool.TrimToSize(nLimit);
+    }
+}
+
+// Remove a block worth of transactions from a full pool, after adding them back to it.
+static void MempoolRemoveForBlock(benchmark::State &state)
+{
+    CTxMemPool pool(CFeeRate(0));
+    FillPool(pool, MakeTransactions(BENCH_POOL_TXS, 0), 0);
+    const std::vector<CTransactionRef> vtxBlock = MakeTransactions(BENCH_BLOCK_TXS, BENCH_POOL_TXS);
+    unsigned int nHeight = 1;
+    while (state.KeepRunning())
+    {
+        FillPool(pool, vtxBlock, BENCH_POOL_TXS);
+        std::list<CTransactionRef> conflicts;
+        pool.removeForBlock(vtxBlock, nHeight++, conflicts, false);
+    }
+}
+
+BENCHMARK(MempoolAddUnchecked);
+BENCHMARK(MempoolTrimToSize);
+BENCHMARK(MempoolRemoveForBlock);
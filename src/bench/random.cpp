@@ -0,0 +1,60 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "random.h"
+
+#include <boost/thread/thread.hpp>
+
+// The ranges of the hot callers: a sigcache or orphan pool eviction and a PoissonNextSend.
+static const uint64_t BENCH_RAND_RANGE = 100000;
+static const int BENCH_RAND_CALLS = 1000;
+
+static void RandOpenSSL(benchmark::State &state)
+{
+    uint64_t nSum = 0;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < BENCH_RAND_CALLS; i++)
+            nSum += GetRand(BENCH_RAND_RANGE) + GetRand(1ULL << 48);
+    }
+    assert(nSum != 0);
+}
+
+static void RandThreadFast(benchmark::State &state)
+{
+    uint64_t nSum = 0;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < BENCH_RAND_CALLS; i++)
+            nSum += GetFastRand(BENCH_RAND_RANGE) + GetFastRand(1ULL << 48);
+    }
+    assert(nSum != 0);
+}
+
+// The same calls from four threads at once, OpenSSL serializes them on its own lock.
+template <uint64_t (*Rand)(uint64_t)>
+static void RandParallel(benchmark::State &state)
+{
+    while (state.KeepRunning())
+    {
+        boost::thread_group threads;
+        for (int n = 0; n < 4; n++)
+            threads.create_thread([] {
+                uint64_t nSum = 0;
+                for (int i = 0; i < BENCH_RAND_CALLS; i++)
+                    nSum += Rand(BENCH_RAND_RANGE);
+                assert(nSum != 0);
+            });
+        threads.join_all();
+    }
+}
+
+static void RandOpenSSLParallel(benchmark::State &state) { RandParallel<GetRand>(state); }
+static void RandThreadFastParallel(benchmark::State &state) { RandParallel<GetFastRand>(state); }
+
+BENCHMARK(RandOpenSSL);
+BENCHMARK(RandThreadFast);
+BENCHMARK(RandOpenSSLParallel);
+BENCHMARK(RandThreadFastParallel);
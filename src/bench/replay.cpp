@@ -0,0 +1,223 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "replay.h"
+
+#include "args.h"
+#include "chain/chainman.h"
+#include "checkqueue.h"
+#include "fs.h"
+#include "init.h"
+#include "main.h"
+#include "net/net.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "random.h"
+#include "txdb.h"
+#include "util/util.h"
+#include "util/utiltime.h"
+#include "validationinterface.h"
+
+#include <iostream>
+#include <limits>
+
+#include <boost/thread.hpp>
+
+namespace
+{
+/** Where the replay was at one height */
+struct CReplaySnapshot
+{
+    int nHeight = -1;
+    int64_t nTime = 0;
+    CBlockConnectTimes times;
+    CDBStats coinsdb;
+};
+
+CReplaySnapshot TakeSnapshot(int nHeight)
+{
+    CReplaySnapshot snapshot;
+    snapshot.nHeight = nHeight;
+    snapshot.nTime = GetTimeMicros();
+    snapshot.times = GetBlockConnectTimes();
+    snapshot.coinsdb = pcoinsdbview->GetDBStats();
+    return snapshot;
+}
+
+/** Takes the snapshots at the heights of the range and stops the import at the end of it. The blocks are connected
+ *  on the thread that imports them, so nothing here needs a lock of its own. */
+class CReplayProgress : public CValidationInterface
+{
+public:
+    const int nFrom;
+    const int nTo;
+    CReplaySnapshot start;
+    CReplaySnapshot end;
+
+    CReplayProgress(int nFromIn, int nToIn) : nFrom(nFromIn), nTo(nToIn) {}
+    bool Started() const { return start.nHeight >= 0; }
+    bool Finished() const { return end.nHeight >= 0; }
+    void BlockConnected(const CBlockIndex *pindex) override
+    {
+        if (pindex->nHeight == nFrom - 1)
+            start = TakeSnapshot(pindex->nHeight);
+        if (pindex->nHeight == nTo && Started())
+        {
+            end = TakeSnapshot(pindex->nHeight);
+            shutdown_threads.store(true);
+        }
+        if (pindex->nHeight % 10000 == 0)
+            std::cerr << "Connected block " << pindex->nHeight << "\n";
+    }
+};
+
+void PrintStage(const std::string &strName, int64_t nMicros, int nBlocks)
+{
+    std::cout << strName << "," << nMicros * 0.000001 << "," << nMicros * 0.001 / nBlocks << "\n";
+}
+
+void PrintReport(const CReplaySnapshot &start, const CReplaySnapshot &end, int64_t nCopyMicros)
+{
+    const int nBlocks = end.nHeight - start.nHeight;
+    const double dElapsed = (end.nTime - start.nTime - nCopyMicros) * 0.000001;
+    const CBlockConnectTimes &a = start.times;
+    const CBlockConnectTimes &b = end.times;
+    std::cout << strprintf("Replayed blocks %d to %d: %d blocks in %.2fs, %.1f blocks/s\n", start.nHeight + 1,
+        end.nHeight, nBlocks, dElapsed, dElapsed > 0 ? nBlocks / dElapsed : 0);
+
+    std::cout << "Stage,seconds,ms/block\n";
+    PrintStage("Load block from disk", b.nReadFromDisk - a.nReadFromDisk, nBlocks);
+    PrintStage("Connect total", b.nConnectTotal - a.nConnectTotal, nBlocks);
+    PrintStage("  Sanity checks", b.nCheck - a.nCheck, nBlocks);
+    PrintStage("  Fork checks", b.nForks - a.nForks, nBlocks);
+    PrintStage("  Connect transactions", b.nConnect - a.nConnect, nBlocks);
+    PrintStage("  Verify inputs", b.nVerify - a.nVerify, nBlocks);
+    PrintStage("  Index writing", b.nIndex - a.nIndex, nBlocks);
+    PrintStage("  Callbacks", b.nCallbacks - a.nCallbacks, nBlocks);
+    PrintStage("Flush", b.nFlush - a.nFlush, nBlocks);
+    PrintStage("Writing chainstate", b.nChainState - a.nChainState, nBlocks);
+    PrintStage("Connect postprocess", b.nPostConnect - a.nPostConnect, nBlocks);
+    PrintStage("Connect block", b.nTotal - a.nTotal, nBlocks);
+
+    // every input the coins cache did not have is a read of the database
+    const uint64_t nInputs = b.nInputs - a.nInputs;
+    const uint64_t nReads = end.coinsdb.nReads - start.coinsdb.nReads;
+    const uint64_t nCacheHits = end.coinsdb.nCacheHits - start.coinsdb.nCacheHits;
+    const uint64_t nCacheLookups = nCacheHits + end.coinsdb.nCacheMisses - start.coinsdb.nCacheMisses;
+    std::cout << strprintf("Inputs verified: %u, chainstate reads: %u (%.3f per input)\n", nInputs, nReads,
+        nInputs ? (double)nReads / nInputs : 0);
+    std::cout << strprintf("Chainstate reads that found nothing: %u\n",
+        end.coinsdb.nReadMisses - start.coinsdb.nReadMisses);
+    std::cout << strprintf("Chainstate block cache hit rate: %.1f%% of %u lookups\n",
+        nCacheLookups ? 100.0 * nCacheHits / nCacheLookups : 0, nCacheLookups);
+}
+}
+
+int RunReplay()
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+    const fs::path pathSource = fs::system_complete(gArgs.GetArg("-replay", "")) / "blocks";
+    const int nFrom = std::max((int)gArgs.GetArg("-replayfrom", 1), 1);
+    const int nTo = (int)gArgs.GetArg("-replayto", std::numeric_limits<int>::max());
+    if (!fs::is_directory(pathSource) || nTo < nFrom)
+    {
+        std::cerr << "Usage: bench_bitcoin -replay=<dir with blocks/> [-replayfrom=<height>] [-replayto=<height>]\n";
+        return 1;
+    }
+
+    const fs::path pathTemp =
+        GetTempPath() / strprintf("eccoin_replay_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    fs::create_directories(pathTemp);
+    gArgs.ForceSetArg("-datadir", pathTemp.string());
+    ClearDatadirCache();
+    fs::create_directories(GetDataDir() / "blocks");
+
+    // the caches are split as the node splits them
+    int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
+    nTotalCache = std::max(nTotalCache, nMinDbCache << 20);
+    nTotalCache = std::min(nTotalCache, nMaxDbCache << 20);
+    const int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, (int64_t)1 << 21);
+    nTotalCache -= nBlockTreeDBCache;
+    const int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23));
+    nTotalCache -= nCoinDBCache;
+    nCoinCacheUsage = nTotalCache;
+
+    nScriptCheckThreads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += GetNumCores();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        threadGroup.create_thread(&ThreadScriptCheck);
+
+    // a reindex of the copied files, the genesis block comes from the first of them
+    fReindex = true;
+    g_connman = std::make_unique<CConnman>(GetRand(std::numeric_limits<uint64_t>::max()),
+        GetRand(std::numeric_limits<uint64_t>::max()));
+    CChainManager *pchainman = pnetMan->getChainActive();
+    pchainman->pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, true));
+    pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, true));
+    pchainman->pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+    pchainman->InitBlockIndex(chainparams);
+
+    std::cerr << strprintf("Replaying %s into %s with %d MiB of coins cache and %d script threads\n",
+        pathSource.string(), pathTemp.string(), nCoinCacheUsage >> 20, nScriptCheckThreads);
+    CReplayProgress progress(nFrom, nTo);
+    if (nFrom == 1)
+        progress.start = TakeSnapshot(0);
+    RegisterValidationInterface(&progress);
+
+    // Each file is copied before it is imported, so the undo files and the block files the import finishes
+    // off never touch the source. The copies are not part of the measured time.
+    int64_t nCopyMicros = 0;
+    for (int nFile = 0; !shutdown_threads.load(); nFile++)
+    {
+        CDiskBlockPos pos(nFile, 0);
+        const fs::path pathFile = pathSource / strprintf("blk%05u.dat", nFile);
+        if (!fs::exists(pathFile))
+            break;
+        const int64_t nCopyStart = GetTimeMicros();
+        fs::copy_file(pathFile, GetBlockPosFilename(pos, "blk"));
+        if (progress.Started())
+            nCopyMicros += GetTimeMicros() - nCopyStart;
+        FILE *file = OpenBlockFile(pos, true);
+        if (!file)
+            break;
+        pchainman->LoadExternalBlockFile(chainparams, file, &pos);
+    }
+
+    UnregisterValidationInterface(&progress);
+    int nTip;
+    {
+        LOCK(cs_main);
+        nTip = pchainman->chainActive.Height();
+    }
+    int nResult = 0;
+    if (!progress.Started())
+    {
+        std::cerr << strprintf("The blocks only reach height %d\n", nTip);
+        nResult = 1;
+    }
+    else
+    {
+        if (!progress.Finished())
+            progress.end = TakeSnapshot(nTip);
+        PrintReport(progress.start, progress.end, nCopyMicros);
+    }
+
+    shutdown_threads.store(true);
+    InterruptScriptCheck();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    pchainman->UnloadBlockIndex();
+    pchainman->pcoinsTip.reset();
+    pcoinsdbview.reset();
+    pchainman->pblocktree.reset();
+    g_connman.reset();
+    fs::remove_all(pathTemp);
+    return nResult;
+}
@@ -0,0 +1,18 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_REPLAY_H
+#define BITCOIN_BENCH_REPLAY_H
+
+/**
+ * bench_bitcoin -replay=<dir> [-replayfrom=<height>] [-replayto=<height>]
+ *
+ * Connect the blocks in the blk*.dat files of <dir>/blocks to a chainstate of their own in a temporary datadir, as
+ * -reindex does and without networking, and report the blocks per second, the time of each stage of connecting a
+ * block and how the chainstate database caches did between the two heights. Everything before -replayfrom is
+ * connected as well, it is not measured. -dbcache, -par and -assumevalid apply as they do for the node.
+ */
+int RunReplay();
+
+#endif // BITCOIN_BENCH_REPLAY_H
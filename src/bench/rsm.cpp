@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "rsm/fast_recursive_shared_mutex.h"
+#include "rsm/recursive_shared_mutex.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// One shared lock and unlock, the way a single mempool or block index read takes it.
+template <typename Mutex>
+static void LockShared(benchmark::State &state)
+{
+    Mutex mutex;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            mutex.lock_shared();
+            mutex.unlock_shared();
+        }
+    }
+}
+
+// A read that calls a function taking the same lock again.
+template <typename Mutex>
+static void LockSharedRecursive(benchmark::State &state)
+{
+    Mutex mutex;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            mutex.lock_shared();
+            mutex.lock_shared();
+            mutex.unlock_shared();
+            mutex.unlock_shared();
+        }
+    }
+}
+
+// Shared locks while three more threads take shared locks of the same mutex all the time.
+template <typename Mutex>
+static void LockSharedContended(benchmark::State &state)
+{
+    Mutex mutex;
+    std::atomic<bool> fStop(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; i++)
+    {
+        threads.emplace_back([&mutex, &fStop]() {
+            while (!fStop)
+            {
+                mutex.lock_shared();
+                mutex.unlock_shared();
+            }
+        });
+    }
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            mutex.lock_shared();
+            mutex.unlock_shared();
+        }
+    }
+    fStop = true;
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+static void RSMLockShared(benchmark::State &state) { LockShared<recursive_shared_mutex>(state); }
+static void FastRSMLockShared(benchmark::State &state) { LockShared<fast_recursive_shared_mutex>(state); }
+static void RSMLockSharedRecursive(benchmark::State &state) { LockSharedRecursive<recursive_shared_mutex>(state); }
+static void FastRSMLockSharedRecursive(benchmark::State &state)
+{
+    LockSharedRecursive<fast_recursive_shared_mutex>(state);
+}
+static void RSMLockSharedContended(benchmark::State &state) { LockSharedContended<recursive_shared_mutex>(state); }
+static void FastRSMLockSharedContended(benchmark::State &state)
+{
+    LockSharedContended<fast_recursive_shared_mutex>(state);
+}
+
+BENCHMARK(RSMLockShared);
+BENCHMARK(FastRSMLockShared);
+BENCHMARK(RSMLockSharedRecursive);
+BENCHMARK(FastRSMLockSharedRecursive);
+BENCHMARK(RSMLockSharedContended);
+BENCHMARK(FastRSMLockSharedContended);
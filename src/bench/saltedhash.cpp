@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "crypto/hash.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <unordered_map>
+#include <vector>
+
+// The hash of every lookup in the coins cache, an outpoint is a txid and an output index.
+static void SipHash24Outpoint(benchmark::State &state)
+{
+    const uint256 txid = GetRandHash();
+    uint64_t h = 0;
+    while (state.KeepRunning())
+    {
+        for (uint32_t n = 0; n < 1000; n++)
+            h ^= SipHashUint256Extra(1, 2, txid, n);
+    }
+    assert(h != 1);
+}
+
+static void SipHash13Outpoint(benchmark::State &state)
+{
+    const uint256 txid = GetRandHash();
+    uint64_t h = 0;
+    while (state.KeepRunning())
+    {
+        for (uint32_t n = 0; n < 1000; n++)
+            h ^= SipHash13Uint256Extra(1, 2, txid, n);
+    }
+    assert(h != 1);
+}
+
+// The hash of the transaction maps, of a txid alone.
+static void SipHash24Txid(benchmark::State &state)
+{
+    const uint256 txid = GetRandHash();
+    uint64_t h = 0;
+    while (state.KeepRunning())
+    {
+        for (uint64_t k = 0; k < 1000; k++)
+            h ^= SipHashUint256(k, 2, txid);
+    }
+    assert(h != 1);
+}
+
+static void SipHash13Txid(benchmark::State &state)
+{
+    const uint256 txid = GetRandHash();
+    uint64_t h = 0;
+    while (state.KeepRunning())
+    {
+        for (uint64_t k = 0; k < 1000; k++)
+            h ^= SipHash13Uint256(k, 2, txid);
+    }
+    assert(h != 1);
+}
+
+// Find the inputs of a block in a map of outpoints the size of a busy coins cache.
+static void OutpointMapFind(benchmark::State &state, bool fSipHash24)
+{
+    const bool fSaved = fSipHash24Maps;
+    fSipHash24Maps = fSipHash24;
+    std::unordered_map<COutPoint, int, SaltedOutpointHasher> map;
+    fSipHash24Maps = fSaved;
+    std::vector<COutPoint> vOutpoints;
+    for (int i = 0; i < 200000; i++)
+    {
+        vOutpoints.emplace_back(GetRandHash(), i % 4);
+        map.emplace(vOutpoints.back(), i);
+    }
+    size_t n = 0;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 2000; i++, n += 7919)
+            assert(map.count(vOutpoints[n % vOutpoints.size()]));
+    }
+}
+
+static void OutpointMapFindSipHash24(benchmark::State &state) { OutpointMapFind(state, true); }
+static void OutpointMapFindSipHash13(benchmark::State &state) { OutpointMapFind(state, false); }
+BENCHMARK(SipHash24Outpoint);
+BENCHMARK(SipHash13Outpoint);
+BENCHMARK(SipHash24Txid);
+BENCHMARK(SipHash13Txid);
+BENCHMARK(OutpointMapFindSipHash24);
+BENCHMARK(OutpointMapFindSipHash13);
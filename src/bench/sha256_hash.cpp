@@ -0,0 +1,86 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "chain/block.h"
+#include "consensus/merkle.h"
+#include "crypto/hash.h"
+#include "crypto/sha256.h"
+
+#include <vector>
+
+// Stream a megabyte through the single block transform.
+static void SHA256Stream(benchmark::State &state)
+{
+    std::vector<uint8_t> in(1000000, 0);
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    while (state.KeepRunning())
+    {
+        CSHA256().Write(in.data(), in.size()).Finalize(hash);
+    }
+}
+
+// Double hash a typical one input, two output transaction, the way its txid is computed.
+static void Hash256Tx(benchmark::State &state)
+{
+    std::vector<uint8_t> in(226, 0);
+    uint8_t hash[CHash256::OUTPUT_SIZE];
+    while (state.KeepRunning())
+    {
+        CHash256().Write(in.data(), in.size()).Finalize(hash);
+        in[0]++;
+    }
+}
+
+// Double hash one merkle level worth of 64 byte nodes with the multi-way transforms.
+static void SHA256D64_1024(benchmark::State &state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning())
+    {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
+// Check the merkle root of a block of nTx distinct transactions, the way CheckBlock does.
+static void BlockMerkleRootTxs(benchmark::State &state, size_t nTx)
+{
+    CBlock block;
+    block.vtx.reserve(nTx);
+    for (size_t i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.nLockTime = i;
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    while (state.KeepRunning())
+    {
+        bool mutated = false;
+        block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    }
+}
+
+// The root of 2000 leaves that are already hashed, ComputeMerkleRoot takes a copy of them each time.
+static void MerkleRootLeaves(benchmark::State &state)
+{
+    std::vector<uint256> leaves(2000);
+    for (size_t i = 0; i < leaves.size(); i++)
+        leaves[i] = ArithToUint256(arith_uint256(i));
+    while (state.KeepRunning())
+    {
+        bool mutated = false;
+        leaves[0] = ComputeMerkleRoot(leaves, &mutated);
+    }
+}
+
+static void BlockMerkleRoot1k(benchmark::State &state) { BlockMerkleRootTxs(state, 1000); }
+static void BlockMerkleRoot10k(benchmark::State &state) { BlockMerkleRootTxs(state, 10000); }
+
+BENCHMARK(SHA256Stream);
+BENCHMARK(Hash256Tx);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(BlockMerkleRoot1k);
+BENCHMARK(BlockMerkleRoot10k);
+BENCHMARK(MerkleRootLeaves);
@@ -0,0 +1,66 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "bench.h"
+#include "uint256.h"
+
+#include <univalue.h>
+
+// An object the shape of a verbose getrawmempool reply: a few thousand txids, each with a small object.
+static UniValue MempoolLikeEntry(int i)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKVEnd("size", 225 + i % 100);
+    entry.pushKVEnd("fee", UniValue(UniValue::VNUM, "0.00010000"));
+    entry.pushKVEnd("time", (int64_t)1550000000 + i);
+    entry.pushKVEnd("height", 2000000);
+    UniValue depends(UniValue::VARR);
+    depends.push_back(ArithToUint256(arith_uint256(i + 1)).GetHex());
+    entry.pushKVEnd("depends", std::move(depends));
+    return entry;
+}
+
+static UniValue BuildMempoolLike(bool fEnd)
+{
+    UniValue o(UniValue::VOBJ);
+    for (int i = 0; i < 2000; i++)
+    {
+        const std::string key = ArithToUint256(arith_uint256(i)).GetHex();
+        if (fEnd)
+            o.pushKVEnd(key, MempoolLikeEntry(i));
+        else
+            o.push_back(Pair(key, MempoolLikeEntry(i)));
+    }
+    return o;
+}
+
+static void UniValueBuildPushKV(benchmark::State &state)
+{
+    while (state.KeepRunning())
+    {
+        BuildMempoolLike(false);
+    }
+}
+
+static void UniValueBuildPushKVEnd(benchmark::State &state)
+{
+    while (state.KeepRunning())
+    {
+        BuildMempoolLike(true);
+    }
+}
+
+static void UniValueWrite(benchmark::State &state)
+{
+    const UniValue o = BuildMempoolLike(true);
+    while (state.KeepRunning())
+    {
+        o.write();
+    }
+}
+
+BENCHMARK(UniValueBuildPushKV);
+BENCHMARK(UniValueBuildPushKVEnd);
+BENCHMARK(UniValueWrite);
@@ -0,0 +1,44 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "random.h"
+#include "streams.h"
+
+#include <vector>
+
+// Obfuscate values the size of a coin and of a block index entry with a database key, the way CDBWrapper does.
+static void XorValues(benchmark::State &state, size_t nSize)
+{
+    FastRandomContext rng(true);
+    std::vector<uint8_t> key(8);
+    for (uint8_t &ch : key)
+        ch = rng.rand32();
+    CDataStream ds(SER_DISK, 0);
+    ds.resize(nSize);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            ds.Xor(key);
+    }
+}
+
+static void XorCoin(benchmark::State &state) { XorValues(state, 48); }
+static void XorBlockIndex(benchmark::State &state) { XorValues(state, 150); }
+
+// Stream a megabyte through it.
+static void XorStream(benchmark::State &state)
+{
+    std::vector<uint8_t> key = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef};
+    CDataStream ds(SER_DISK, 0);
+    ds.resize(1000000);
+    while (state.KeepRunning())
+    {
+        ds.Xor(key);
+    }
+}
+
+BENCHMARK(XorCoin);
+BENCHMARK(XorBlockIndex);
+BENCHMARK(XorStream);
@@ -0,0 +1,199 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockcompress.h"
+
+#include "chain/block.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "serialize.h"
+#include "streams.h"
+
+#include <algorithm>
+#include <string.h>
+
+bool fCompressBlocks = DEFAULT_COMPRESS_BLOCKS;
+
+//! the shortest match the format has
+static const size_t LZ4_MIN_MATCH = 4;
+//! the last bytes are always literals
+static const size_t LZ4_LAST_LITERALS = 5;
+//! the last match starts this far from the end at the latest
+static const size_t LZ4_MF_LIMIT = 12;
+static const size_t LZ4_MAX_OFFSET = 65535;
+static const int LZ4_HASH_LOG = 16;
+
+static inline uint32_t LZ4Hash(uint32_t nSequence) { return (nSequence * 2654435761U) >> (32 - LZ4_HASH_LOG); }
+static inline void LZ4WriteLength(std::vector<unsigned char> &out, size_t nLength)
+{
+    for (; nLength >= 255; nLength -= 255)
+        out.push_back(255);
+    out.push_back((unsigned char)nLength);
+}
+
+static void LZ4WriteSequence(std::vector<unsigned char> &out,
+    const uint8_t *pLiterals,
+    size_t nLiterals,
+    size_t nOffset,
+    size_t nMatch)
+{
+    const size_t nMatchCode = nMatch ? nMatch - LZ4_MIN_MATCH : 0;
+    out.push_back((unsigned char)((std::min<size_t>(nLiterals, 15) << 4) | std::min<size_t>(nMatchCode, 15)));
+    if (nLiterals >= 15)
+        LZ4WriteLength(out, nLiterals - 15);
+    out.insert(out.end(), pLiterals, pLiterals + nLiterals);
+    if (!nMatch)
+        return;
+    out.push_back((unsigned char)(nOffset & 0xff));
+    out.push_back((unsigned char)(nOffset >> 8));
+    if (nMatchCode >= 15)
+        LZ4WriteLength(out, nMatchCode - 15);
+}
+
+void LZ4CompressBlock(const uint8_t *src, size_t nSize, std::vector<unsigned char> &out)
+{
+    const uint8_t *anchor = src;
+    const uint8_t *const iend = src + nSize;
+    if (nSize > LZ4_MF_LIMIT)
+    {
+        // greedy, the last position each 4 bytes were seen at is the only match candidate
+        std::vector<uint32_t> vTable(1 << LZ4_HASH_LOG, UINT32_MAX);
+        const uint8_t *const mflimit = iend - LZ4_MF_LIMIT;
+        const uint8_t *const matchlimit = iend - LZ4_LAST_LITERALS;
+        const uint8_t *ip = src;
+        while (ip < mflimit)
+        {
+            const uint32_t nSequence = ReadLE32(ip);
+            uint32_t &nCandidate = vTable[LZ4Hash(nSequence)];
+            const uint8_t *ref = nCandidate == UINT32_MAX ? nullptr : src + nCandidate;
+            nCandidate = ip - src;
+            if (!ref || (size_t)(ip - ref) > LZ4_MAX_OFFSET || ReadLE32(ref) != nSequence)
+            {
+                ip++;
+                continue;
+            }
+            const uint8_t *pEnd = ip + LZ4_MIN_MATCH;
+            const uint8_t *pRef = ref + LZ4_MIN_MATCH;
+            while (pEnd < matchlimit && *pEnd == *pRef)
+            {
+                pEnd++;
+                pRef++;
+            }
+            LZ4WriteSequence(out, anchor, ip - anchor, ip - ref, pEnd - ip);
+            ip = pEnd;
+            anchor = ip;
+        }
+    }
+    LZ4WriteSequence(out, anchor, iend - anchor, 0, 0);
+}
+
+static inline bool LZ4ReadLength(const uint8_t *&ip, const uint8_t *iend, size_t &nLength)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= iend)
+            return false;
+        b = *ip++;
+        nLength += b;
+    } while (b == 255);
+    return true;
+}
+
+bool LZ4DecompressBlock(const uint8_t *src, size_t nSize, uint8_t *out, size_t nOutSize)
+{
+    const uint8_t *ip = src;
+    const uint8_t *const iend = src + nSize;
+    uint8_t *op = out;
+    uint8_t *const oend = out + nOutSize;
+    while (true)
+    {
+        if (ip >= iend)
+            return false;
+        const uint8_t token = *ip++;
+        size_t nLiterals = token >> 4;
+        if (nLiterals == 15 && !LZ4ReadLength(ip, iend, nLiterals))
+            return false;
+        if (nLiterals > (size_t)(iend - ip) || nLiterals > (size_t)(oend - op))
+            return false;
+        memcpy(op, ip, nLiterals);
+        op += nLiterals;
+        ip += nLiterals;
+        // the last sequence has no match
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        const size_t nOffset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (nOffset == 0 || nOffset > (size_t)(op - out))
+            return false;
+        size_t nMatch = token & 15;
+        if (nMatch == 15 && !LZ4ReadLength(ip, iend, nMatch))
+            return false;
+        nMatch += LZ4_MIN_MATCH;
+        if (nMatch > (size_t)(oend - op))
+            return false;
+        // a match may overlap what it writes
+        const uint8_t *pMatch = op - nOffset;
+        for (size_t i = 0; i < nMatch; i++)
+            op[i] = pMatch[i];
+        op += nMatch;
+    }
+    return op == oend;
+}
+
+void StoreBlockData(const CBlock &block, bool fCompress, std::vector<unsigned char> &data, uint32_t &nSizeField)
+{
+    data.clear();
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0) << block;
+    if (!fCompress)
+    {
+        nSizeField = data.size();
+        return;
+    }
+    std::vector<unsigned char> compressed(sizeof(uint32_t));
+    WriteLE32(compressed.data(), data.size());
+    compressed.reserve(data.size());
+    LZ4CompressBlock(data.data(), data.size(), compressed);
+    if (compressed.size() < data.size())
+    {
+        data.swap(compressed);
+        nSizeField = BLOCK_COMPRESSED_FLAG | data.size();
+        return;
+    }
+    nSizeField = data.size();
+}
+
+bool UncompressBlockData(const uint8_t *pdata, size_t nSize, std::string &strOut)
+{
+    if (nSize < sizeof(uint32_t))
+        return false;
+    const uint32_t nRawSize = ReadLE32(pdata);
+    if (nRawSize > MAX_SIZE)
+        return false;
+    const size_t nOffset = strOut.size();
+    strOut.resize(nOffset + nRawSize);
+    if (!LZ4DecompressBlock(pdata + sizeof(uint32_t), nSize - sizeof(uint32_t), (uint8_t *)&strOut[nOffset], nRawSize))
+    {
+        strOut.resize(nOffset);
+        return false;
+    }
+    return true;
+}
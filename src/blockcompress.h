@@ -0,0 +1,56 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_BLOCKCOMPRESS_H
+#define BITCOIN_BLOCKCOMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+
+/** -compressblocks default */
+static const bool DEFAULT_COMPRESS_BLOCKS = false;
+
+/**
+ * Set in the size that follows the message start of a blk file record when the block is stored compressed. The
+ * size is then the one of the stored data: the size of the serialized block as 4 bytes little endian and the
+ * block compressed in the LZ4 block format. Blocks are never larger than MAX_SIZE, so the bit is free.
+ */
+static const uint32_t BLOCK_COMPRESSED_FLAG = 0x80000000;
+
+/** Set from -compressblocks, blocks written to the blk files are compressed when that makes them smaller */
+extern bool fCompressBlocks;
+
+/** Append the LZ4 block format compression of the nSize bytes at src to out */
+void LZ4CompressBlock(const uint8_t *src, size_t nSize, std::vector<unsigned char> &out);
+/** Decompress the nSize bytes at src into exactly nOutSize bytes at out, false if they are not valid LZ4 */
+bool LZ4DecompressBlock(const uint8_t *src, size_t nSize, uint8_t *out, size_t nOutSize);
+
+/**
+ * The data of the blk file record of block, which follows its message start and size, and the size to write
+ * before it. Compressed with fCompress if that is smaller than the serialized block.
+ */
+void StoreBlockData(const CBlock &block, bool fCompress, std::vector<unsigned char> &data, uint32_t &nSizeField);
+
+/** Append the serialized block of the nSize bytes of compressed record data at pdata to strOut */
+bool UncompressBlockData(const uint8_t *pdata, size_t nSize, std::string &strOut);
+
+#endif // BITCOIN_BLOCKCOMPRESS_H
@@ -0,0 +1,211 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockfilemap.h"
+
+#include "blockcompress.h"
+#include "chain/block.h"
+#include "clientversion.h"
+#include "compat.h"
+#include "crypto/common.h"
+#include "crypto/hash.h"
+#include "main.h"
+#include "streams.h"
+#include "undo.h"
+
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+std::unique_ptr<CBlockFileMapper> g_blockfilemapper;
+
+CBlockFileMapper::CMapping::~CMapping()
+{
+#ifndef WIN32
+    munmap((void *)pbegin, nSize);
+#endif
+}
+
+CBlockFileMapper::CBlockFileMapper(size_t nMaxMappingsIn) : nMaxMappings(nMaxMappingsIn), nFirstOpenFile(0) {}
+void CBlockFileMapper::SetFirstOpenFile(int nFile) { nFirstOpenFile = nFile; }
+
+void CBlockFileMapper::Drop(int nFile)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    for (bool fUndo : {false, true})
+    {
+        auto it = mapMappings.find(FileKey(fUndo, nFile));
+        if (it != mapMappings.end())
+        {
+            listMappings.erase(it->second);
+            mapMappings.erase(it);
+        }
+    }
+}
+
+void CBlockFileMapper::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mapMappings.clear();
+    listMappings.clear();
+}
+
+std::shared_ptr<const CBlockFileMapper::CMapping> CBlockFileMapper::Map(bool fUndo, int nFile, uint64_t nEnd)
+{
+    if (nFile < 0 || nFile >= nFirstOpenFile || nMaxMappings == 0)
+        return nullptr;
+#ifdef WIN32
+    return nullptr;
+#else
+    const FileKey key(fUndo, nFile);
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = mapMappings.find(key);
+    if (it != mapMappings.end())
+    {
+        if (it->second->second->nSize >= nEnd)
+        {
+            listMappings.splice(listMappings.begin(), listMappings, it->second);
+            return listMappings.front().second;
+        }
+        // the file grew since it was mapped
+        listMappings.erase(it->second);
+        mapMappings.erase(it);
+    }
+
+    const fs::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), fUndo ? "rev" : "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size >= nEnd)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<const CMapping> mapping(new CMapping((const uint8_t *)p, st.st_size));
+    listMappings.emplace_front(key, mapping);
+    mapMappings[key] = listMappings.begin();
+    while (listMappings.size() > nMaxMappings)
+    {
+        mapMappings.erase(listMappings.back().first);
+        listMappings.pop_back();
+    }
+    return mapping;
+#endif
+}
+
+std::shared_ptr<const CBlockFileMapper::CMapping> CBlockFileMapper::MapRecord(bool fUndo,
+    const CDiskBlockPos &pos,
+    size_t nTrailer,
+    const uint8_t *&pdata,
+    unsigned int &nSize)
+{
+    // records are preceded by their size
+    if (pos.nPos < sizeof(uint32_t))
+        return nullptr;
+    std::shared_ptr<const CMapping> mapping = Map(fUndo, pos.nFile, pos.nPos);
+    if (!mapping)
+        return nullptr;
+    nSize = ReadLE32(mapping->pbegin + pos.nPos - sizeof(uint32_t));
+    const uint64_t nEnd = (uint64_t)pos.nPos + (nSize & ~BLOCK_COMPRESSED_FLAG) + nTrailer;
+    if (nEnd > mapping->nSize)
+    {
+        mapping = Map(fUndo, pos.nFile, nEnd);
+        if (!mapping)
+            return nullptr;
+    }
+    pdata = mapping->pbegin + pos.nPos;
+    return mapping;
+}
+
+bool CBlockFileMapper::ReadBlock(CBlock &block, const CDiskBlockPos &pos)
+{
+    const uint8_t *pdata;
+    unsigned int nSize;
+    std::shared_ptr<const CMapping> mapping = MapRecord(false, pos, 0, pdata, nSize);
+    if (!mapping)
+        return false;
+    try
+    {
+        if (nSize & BLOCK_COMPRESSED_FLAG)
+        {
+            std::string strRaw;
+            if (!UncompressBlockData(pdata, nSize & ~BLOCK_COMPRESSED_FLAG, strRaw))
+                return false;
+            CMemoryReader stream(SER_DISK, CLIENT_VERSION, (const uint8_t *)strRaw.data(),
+                (const uint8_t *)strRaw.data() + strRaw.size());
+            stream >> block;
+        }
+        else
+        {
+            CMemoryReader stream(SER_DISK, CLIENT_VERSION, pdata, pdata + nSize);
+            stream >> block;
+        }
+    }
+    catch (const std::exception &)
+    {
+        block.SetNull();
+        return false;
+    }
+    return true;
+}
+
+bool CBlockFileMapper::ReadRawBlock(std::string &strOut, const CDiskBlockPos &pos)
+{
+    const uint8_t *pdata;
+    unsigned int nSize;
+    std::shared_ptr<const CMapping> mapping = MapRecord(false, pos, 0, pdata, nSize);
+    if (!mapping)
+        return false;
+    if (nSize & BLOCK_COMPRESSED_FLAG)
+        return UncompressBlockData(pdata, nSize & ~BLOCK_COMPRESSED_FLAG, strOut);
+    strOut.append((const char *)pdata, nSize);
+    return true;
+}
+
+bool CBlockFileMapper::ReadUndo(CBlockUndo &blockundo, const CDiskBlockPos &pos, const uint256 &hashBlock)
+{
+    const uint8_t *pdata;
+    unsigned int nSize;
+    uint256 hashChecksum;
+    std::shared_ptr<const CMapping> mapping = MapRecord(true, pos, hashChecksum.size(), pdata, nSize);
+    if (!mapping || (nSize & BLOCK_COMPRESSED_FLAG))
+        return false;
+
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher.write((const char *)pdata, nSize);
+    memcpy(hashChecksum.begin(), pdata + nSize, hashChecksum.size());
+    if (hashChecksum != hasher.GetHash())
+        return false;
+    try
+    {
+        CMemoryReader stream(SER_DISK, CLIENT_VERSION, pdata, pdata + nSize);
+        stream >> blockundo;
+    }
+    catch (const std::exception &)
+    {
+        blockundo = CBlockUndo();
+        return false;
+    }
+    return true;
+}
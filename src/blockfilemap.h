@@ -0,0 +1,113 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "chain/blockindex.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+class CBlock;
+class CBlockUndo;
+
+/** Finished block and undo files kept mapped for reads, a whole file each. Only 64 bit builds have the address
+ *  space to spare. */
+static const unsigned int DEFAULT_BLOCKFILE_MAPPINGS = sizeof(void *) >= 8 ? 64 : 0;
+
+/**
+ * Reads blocks and undo data straight out of read only mappings of the blk/rev files, so random reads cost no
+ * open, seek and close each. The most recently used mappings are kept, the least recently used is unmapped
+ * once there are more.
+ *
+ * Only files before the one blocks are being written to are mapped, that one is still preallocated and gets
+ * truncated when it is finished. Undo data can still be appended to the rev file of a finished block file, a
+ * read past the end of its mapping maps it again at its new size.
+ *
+ * Anything that can not be read from a mapping reports false and the caller reads the file as it did before,
+ * errors are reported from there.
+ */
+class CBlockFileMapper
+{
+private:
+    /** A whole blk or rev file mapped read only */
+    struct CMapping
+    {
+        const uint8_t *pbegin;
+        size_t nSize;
+
+        CMapping(const uint8_t *pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+        ~CMapping();
+        CMapping(const CMapping &) = delete;
+        CMapping &operator=(const CMapping &) = delete;
+    };
+    //! undo file or block file, and its number
+    typedef std::pair<bool, int> FileKey;
+    typedef std::list<std::pair<FileKey, std::shared_ptr<const CMapping> > > MappingList;
+
+    const size_t nMaxMappings;
+    //! files from this one on are not mapped
+    std::atomic<int> nFirstOpenFile;
+
+    std::mutex cs;
+    //! most recently used first, readers hold their own reference so eviction never unmaps under them
+    MappingList listMappings;
+    std::map<FileKey, MappingList::iterator> mapMappings;
+
+    /** A mapping of the file at least nEnd bytes long */
+    std::shared_ptr<const CMapping> Map(bool fUndo, int nFile, uint64_t nEnd);
+    /**
+     * A mapping holding the record at pos and nTrailer bytes after it, pdata is set to the record and nSize to the
+     * size before it, with BLOCK_COMPRESSED_FLAG if it is a compressed block
+     */
+    std::shared_ptr<const CMapping> MapRecord(bool fUndo,
+        const CDiskBlockPos &pos,
+        size_t nTrailer,
+        const uint8_t *&pdata,
+        unsigned int &nSize);
+
+public:
+    explicit CBlockFileMapper(size_t nMaxMappingsIn = DEFAULT_BLOCKFILE_MAPPINGS);
+
+    /** Blocks are now written to nFile, the files before it are finished */
+    void SetFirstOpenFile(int nFile);
+    /** Unmap the blk and rev files of nFile, they are about to be deleted */
+    void Drop(int nFile);
+    /** Unmap everything, readers still holding a mapping keep it until they are done */
+    void Clear();
+
+    /** Read the block at pos as ReadBlockFromDisk would, false if the mapping could not give it */
+    bool ReadBlock(CBlock &block, const CDiskBlockPos &pos);
+    /** Append the block at pos to strOut as it is in the file, false if the mapping could not give it */
+    bool ReadRawBlock(std::string &strOut, const CDiskBlockPos &pos);
+    /** Read and check the undo data at pos as UndoReadFromDisk would, false if the mapping could not give it */
+    bool ReadUndo(CBlockUndo &blockundo, const CDiskBlockPos &pos, const uint256 &hashBlock);
+};
+
+/** Set when finished block files are read through mappings, they are read with fopen otherwise */
+extern std::unique_ptr<CBlockFileMapper> g_blockfilemapper;
+
+#endif // BITCOIN_BLOCKFILEMAP_H
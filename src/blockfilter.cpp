@@ -0,0 +1,324 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockfilter.h"
+
+#include "chain/block.h"
+#include "coins.h"
+#include "crypto/common.h"
+#include "crypto/hash.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+/** Writes bits to a vector, most significant bit first */
+class CBitWriter
+{
+private:
+    CVectorWriter &stream;
+    uint8_t nBuffer;
+    //! the number of bits of nBuffer in use
+    int nOffset;
+
+public:
+    explicit CBitWriter(CVectorWriter &streamIn) : stream(streamIn), nBuffer(0), nOffset(0) {}
+    ~CBitWriter() { Flush(); }
+    /** Write the nBits low bits of data, nBits is at most 64 */
+    void Write(uint64_t data, int nBits)
+    {
+        while (nBits > 0)
+        {
+            const int nChunk = std::min(8 - nOffset, nBits);
+            nBuffer |= (data << (64 - nBits)) >> (64 - 8 + nOffset);
+            nOffset += nChunk;
+            nBits -= nChunk;
+            if (nOffset == 8)
+                Flush();
+        }
+    }
+    /** Write out a partly filled byte, the rest of it is zero */
+    void Flush()
+    {
+        if (nOffset == 0)
+            return;
+        stream << nBuffer;
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
+/** Reads bits written by CBitWriter, throws std::ios_base::failure at the end of the data */
+class CBitReader
+{
+private:
+    CMemoryReader &stream;
+    uint8_t nBuffer;
+    //! the number of bits of nBuffer already read
+    int nOffset;
+
+public:
+    explicit CBitReader(CMemoryReader &streamIn) : stream(streamIn), nBuffer(0), nOffset(8) {}
+    /** Read nBits bits, at most 64 */
+    uint64_t Read(int nBits)
+    {
+        uint64_t data = 0;
+        while (nBits > 0)
+        {
+            if (nOffset == 8)
+            {
+                stream >> nBuffer;
+                nOffset = 0;
+            }
+            const int nChunk = std::min(8 - nOffset, nBits);
+            data <<= nChunk;
+            data |= (uint8_t)(nBuffer << nOffset) >> (8 - nChunk);
+            nOffset += nChunk;
+            nBits -= nChunk;
+        }
+        return data;
+    }
+};
+
+void GolombRiceEncode(CBitWriter &writer, uint8_t nP, uint64_t x)
+{
+    // the quotient in unary, ones ended by a zero, then the remainder in nP bits
+    uint64_t q = x >> nP;
+    while (q > 0)
+    {
+        const int nBits = q <= 64 ? (int)q : 64;
+        writer.Write(~0ULL, nBits);
+        q -= nBits;
+    }
+    writer.Write(0, 1);
+    writer.Write(x, nP);
+}
+
+uint64_t GolombRiceDecode(CBitReader &reader, uint8_t nP)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        q++;
+    const uint64_t r = reader.Read(nP);
+    return (q << nP) + r;
+}
+
+/** x * n >> 64, maps a uniform 64 bit hash into [0, n) without a division */
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * (unsigned __int128)n) >> 64);
+#else
+    const uint64_t nLowMask = 0xffffffff;
+    const uint64_t xHigh = x >> 32, xLow = x & nLowMask;
+    const uint64_t nHigh = n >> 32, nLow = n & nLowMask;
+    const uint64_t ac = xHigh * nHigh;
+    const uint64_t ad = xHigh * nLow;
+    const uint64_t bc = xLow * nHigh;
+    const uint64_t bd = xLow * nLow;
+    const uint64_t mid34 = (bd >> 32) + (bc & nLowMask) + (ad & nLowMask);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+}
+
+GCSFilter::GCSFilter(const Params &paramsIn) : params(paramsIn), nN(0), nF(0), vEncoded(1, 0) {}
+GCSFilter::GCSFilter(const Params &paramsIn, std::vector<unsigned char> vEncodedIn)
+    : params(paramsIn), vEncoded(std::move(vEncodedIn))
+{
+    CMemoryReader stream(SER_NETWORK, PROTOCOL_VERSION, vEncoded.data(), vEncoded.data() + vEncoded.size());
+    const uint64_t nElements = ReadCompactSize(stream);
+    if (nElements > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("N must be less than 2^32");
+    nN = (uint32_t)nElements;
+    nF = (uint64_t)nN * params.nM;
+
+    // decode all of it, so a filter that is stored or served is known to be valid
+    CBitReader reader(stream);
+    for (uint32_t i = 0; i < nN; i++)
+        GolombRiceDecode(reader, params.nP);
+    if (!stream.empty())
+        throw std::ios_base::failure("encoded filter contains excess data");
+}
+
+GCSFilter::GCSFilter(const Params &paramsIn, const ElementSet &elements) : params(paramsIn)
+{
+    if (elements.size() > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("N must be less than 2^32");
+    nN = (uint32_t)elements.size();
+    nF = (uint64_t)nN * params.nM;
+
+    CVectorWriter stream(SER_NETWORK, PROTOCOL_VERSION, vEncoded, 0);
+    WriteCompactSize(stream, nN);
+    if (elements.empty())
+        return;
+
+    CBitWriter writer(stream);
+    uint64_t nLast = 0;
+    for (uint64_t nValue : BuildHashedSet(elements))
+    {
+        GolombRiceEncode(writer, params.nP, nValue - nLast);
+        nLast = nValue;
+    }
+    writer.Flush();
+}
+
+uint64_t GCSFilter::HashToRange(const Element &element) const
+{
+    const uint64_t nHash =
+        CSipHasher(params.nSipHashK0, params.nSipHashK1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(nHash, nF);
+}
+
+std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet &elements) const
+{
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    for (const Element &element : elements)
+        vHashes.push_back(HashToRange(element));
+    std::sort(vHashes.begin(), vHashes.end());
+    return vHashes;
+}
+
+bool GCSFilter::MatchInternal(const uint64_t *pHashes, size_t nHashes) const
+{
+    CMemoryReader stream(SER_NETWORK, PROTOCOL_VERSION, vEncoded.data(), vEncoded.data() + vEncoded.size());
+    // skip N, it is known already
+    ReadCompactSize(stream);
+    CBitReader reader(stream);
+
+    // walk the filter and the queries side by side, both are sorted
+    uint64_t nValue = 0;
+    size_t nQuery = 0;
+    for (uint32_t i = 0; i < nN; i++)
+    {
+        nValue += GolombRiceDecode(reader, params.nP);
+        while (true)
+        {
+            if (nQuery == nHashes)
+                return false;
+            if (pHashes[nQuery] == nValue)
+                return true;
+            if (pHashes[nQuery] > nValue)
+                break;
+            nQuery++;
+        }
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Element &element) const
+{
+    const uint64_t nQuery = HashToRange(element);
+    return MatchInternal(&nQuery, 1);
+}
+
+bool GCSFilter::MatchAny(const ElementSet &elements) const
+{
+    const std::vector<uint64_t> vQueries = BuildHashedSet(elements);
+    return MatchInternal(vQueries.data(), vQueries.size());
+}
+
+const std::string &BlockFilterTypeName(BlockFilterType filterType)
+{
+    static const std::string strBasic = "basic";
+    static const std::string strUnknown = "";
+    return filterType == BASIC_FILTER ? strBasic : strUnknown;
+}
+
+bool BlockFilterTypeByName(const std::string &strName, BlockFilterType &filterType)
+{
+    if (strName != BlockFilterTypeName(BASIC_FILTER))
+        return false;
+    filterType = BASIC_FILTER;
+    return true;
+}
+
+static GCSFilter::ElementSet BasicFilterElements(const CBlock &block, const CBlockUndo &blockundo)
+{
+    GCSFilter::ElementSet elements;
+    for (const CTransactionRef &tx : block.vtx)
+    {
+        for (const CTxOut &out : tx->vout)
+        {
+            const CScript &script = out.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    for (const CTxUndo &txundo : blockundo.vtxundo)
+    {
+        for (const Coin &prevout : txundo.vprevout)
+        {
+            const CScript &script = prevout.out.scriptPubKey;
+            if (script.empty())
+                continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    return elements;
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const uint256 &hashBlockIn, std::vector<unsigned char> vEncoded)
+    : filterType(filterTypeIn), hashBlock(hashBlockIn)
+{
+    GCSFilter::Params params;
+    if (!BuildParams(params))
+        throw std::invalid_argument("unknown filter type");
+    filter = GCSFilter(params, std::move(vEncoded));
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const CBlock &block, const CBlockUndo &blockundo)
+    : filterType(filterTypeIn), hashBlock(block.GetHash())
+{
+    GCSFilter::Params params;
+    if (!BuildParams(params))
+        throw std::invalid_argument("unknown filter type");
+    filter = GCSFilter(params, BasicFilterElements(block, blockundo));
+}
+
+bool BlockFilter::BuildParams(GCSFilter::Params &params) const
+{
+    if (filterType != BASIC_FILTER)
+        return false;
+    // keyed on the first 16 bytes of the block hash
+    params.nSipHashK0 = ReadLE64(hashBlock.begin());
+    params.nSipHashK1 = ReadLE64(hashBlock.begin() + 8);
+    params.nP = BASIC_FILTER_P;
+    params.nM = BASIC_FILTER_M;
+    return true;
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char> &vEncoded = filter.GetEncoded();
+    return Hash(vEncoded.begin(), vEncoded.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256 &prevHeader) const
+{
+    const uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), prevHeader.begin(), prevHeader.end());
+}
@@ -0,0 +1,151 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-coded set as specified by BIP158: the elements are hashed into [0, N * M), sorted, and the differences
+ * between them are Golomb-Rice coded with parameter P. A query matches with a false positive rate of about 1 / M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params
+    {
+        uint64_t nSipHashK0;
+        uint64_t nSipHashK1;
+        //! the number of bits of the remainder of each difference
+        uint8_t nP;
+        //! the inverse of the false positive rate
+        uint32_t nM;
+
+        Params(uint64_t nK0 = 0, uint64_t nK1 = 0, uint8_t nPIn = 0, uint32_t nMIn = 1)
+            : nSipHashK0(nK0), nSipHashK1(nK1), nP(nPIn), nM(nMIn)
+        {
+        }
+    };
+
+private:
+    Params params;
+    //! the number of elements
+    uint32_t nN;
+    //! the size of the range the elements are hashed into
+    uint64_t nF;
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const Element &element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet &elements) const;
+    //! whether any of the sorted hashes is in the set
+    bool MatchInternal(const uint64_t *pHashes, size_t nHashes) const;
+
+public:
+    /** An empty filter */
+    explicit GCSFilter(const Params &paramsIn = Params());
+    /** A filter as it was encoded, throws std::ios_base::failure if it is not a valid encoding */
+    GCSFilter(const Params &paramsIn, std::vector<unsigned char> vEncodedIn);
+    /** The filter of elements */
+    GCSFilter(const Params &paramsIn, const ElementSet &elements);
+
+    uint32_t GetN() const { return nN; }
+    const Params &GetParams() const { return params; }
+    const std::vector<unsigned char> &GetEncoded() const { return vEncoded; }
+    /** Whether element may be in the set, false positives happen at about 1 / M */
+    bool Match(const Element &element) const;
+    /** Whether any of elements may be in the set, faster than checking each one */
+    bool MatchAny(const ElementSet &elements) const;
+};
+
+/** The BIP158 parameters of basic filters */
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+enum BlockFilterType : uint8_t
+{
+    BASIC_FILTER = 0,
+    INVALID_FILTER = 255,
+};
+
+/** The name of a filter type, "basic", and the type of a name, false for an unknown one */
+const std::string &BlockFilterTypeName(BlockFilterType filterType);
+bool BlockFilterTypeByName(const std::string &strName, BlockFilterType &filterType);
+
+/**
+ * The filter of a block. The basic filter holds every output script of the block and every script its inputs
+ * spend, except for empty and OP_RETURN ones, keyed on the block hash.
+ */
+class BlockFilter
+{
+private:
+    BlockFilterType filterType;
+    uint256 hashBlock;
+    GCSFilter filter;
+
+    bool BuildParams(GCSFilter::Params &params) const;
+
+public:
+    BlockFilter() : filterType(INVALID_FILTER) {}
+    /** A filter as it was encoded, throws std::ios_base::failure if it is not a valid encoding */
+    BlockFilter(BlockFilterType filterTypeIn, const uint256 &hashBlockIn, std::vector<unsigned char> vEncoded);
+    /** The filter of block, blockundo holds what its inputs spent */
+    BlockFilter(BlockFilterType filterTypeIn, const CBlock &block, const CBlockUndo &blockundo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256 &GetBlockHash() const { return hashBlock; }
+    const GCSFilter &GetFilter() const { return filter; }
+    const std::vector<unsigned char> &GetEncodedFilter() const { return filter.GetEncoded(); }
+    /** The double sha256 of the encoded filter */
+    uint256 GetHash() const;
+    /** The header of this filter in a chain of them: the hash of the filter hash and the previous header */
+    uint256 ComputeHeader(const uint256 &prevHeader) const;
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        s << (uint8_t)filterType << hashBlock << filter.GetEncoded();
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s)
+    {
+        uint8_t nType;
+        std::vector<unsigned char> vEncoded;
+        s >> nType >> hashBlock >> vEncoded;
+        filterType = (BlockFilterType)nType;
+        GCSFilter::Params params;
+        if (!BuildParams(params))
+            throw std::ios_base::failure("unknown filter type");
+        filter = GCSFilter(params, std::move(vEncoded));
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -0,0 +1,295 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockfilterindex.h"
+
+#include "chain/block.h"
+#include "chain/blockindex.h"
+#include "chain/chainman.h"
+#include "fs.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "undo.h"
+#include "util/util.h"
+
+#include <chrono>
+
+std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+//! the hash of the filter of a block and its header
+static const char DB_FILTER_HASH = 'h';
+//! the encoded filter of a block
+static const char DB_FILTER = 'f';
+//! the block the index continues after
+static const char DB_BEST_BLOCK = 'B';
+
+/** How many blocks the index logs its progress after while it catches up */
+static const int SYNC_LOG_INTERVAL = 10000;
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory, bool fWipe)
+    : filterType(filterTypeIn), pindexBest(nullptr), fSynced(false), fStop(true)
+{
+    const fs::path path = GetDataDir() / "indexes" / "blockfilter" / BlockFilterTypeName(filterType);
+    if (!fMemory)
+        fs::create_directories(path.parent_path());
+    db.reset(new CDBWrapper(path, nCacheSize, fMemory, fWipe));
+}
+
+CBlockFilterIndex::~CBlockFilterIndex() { Stop(); }
+void CBlockFilterIndex::Start()
+{
+    uint256 hashBest;
+    if (db->Read(DB_BEST_BLOCK, hashBest))
+        pindexBest = pnetMan->getChainActive()->LookupBlockIndex(hashBest);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = false;
+    }
+    RegisterValidationInterface(this);
+    thread = std::thread(&CBlockFilterIndex::ThreadSync, this);
+}
+
+void CBlockFilterIndex::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+        condWork.notify_all();
+        condProgress.notify_all();
+    }
+    if (thread.joinable())
+    {
+        UnregisterValidationInterface(this);
+        thread.join();
+    }
+}
+
+void CBlockFilterIndex::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    condWork.notify_all();
+}
+
+const CBlockIndex *CBlockFilterIndex::NextBlockToIndex()
+{
+    LOCK(cs_main);
+    const CChain &chain = pnetMan->getChainActive()->chainActive;
+    const CBlockIndex *pindex = pindexBest;
+    if (pindex == nullptr)
+        return chain.Genesis();
+    if (!chain.Contains(pindex))
+    {
+        // the blocks after the fork were disconnected, their entries stay but the new branch needs its own
+        pindex = chain.FindFork(pindex);
+        pindexBest = pindex;
+        if (pindex == nullptr)
+            return chain.Genesis();
+    }
+    return chain.Next(pindex);
+}
+
+bool CBlockFilterIndex::IndexBlock(const CBlockIndex *pindex)
+{
+    CDiskBlockPos blockPos;
+    CDiskBlockPos undoPos;
+    {
+        LOCK(cs_main);
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || (pindex->pprev && !(pindex->nStatus & BLOCK_HAVE_UNDO)))
+            return error("%s: block %s is not on disk", __func__, pindex->GetBlockHash().ToString());
+        blockPos = pindex->GetBlockPos();
+        undoPos = pindex->GetUndoPos();
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, blockPos, pnetMan->getActivePaymentNetwork()->GetConsensus()))
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    CBlockUndo blockundo;
+    uint256 prevHeader;
+    if (pindex->pprev)
+    {
+        if (!UndoReadFromDisk(blockundo, undoPos, pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        uint256 hashPrevFilter;
+        if (!ReadEntry(pindex->pprev->GetBlockHash(), hashPrevFilter, prevHeader))
+            return error("%s: the block before %s is not indexed", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    const BlockFilter filter(filterType, block, blockundo);
+    const uint256 hashFilter = filter.GetHash();
+    CDBBatch batch(*db);
+    batch.Write(std::make_pair(DB_FILTER, pindex->GetBlockHash()), filter.GetEncodedFilter());
+    batch.Write(std::make_pair(DB_FILTER_HASH, pindex->GetBlockHash()),
+        std::make_pair(hashFilter, filter.ComputeHeader(prevHeader)));
+    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+    if (!db->WriteBatch(batch))
+        return error("%s: failed to write the filter of block %s", __func__, pindex->GetBlockHash().ToString());
+    pindexBest = pindex;
+    return true;
+}
+
+void CBlockFilterIndex::ThreadSync()
+{
+    RenameThread("eccoin-blockfilter");
+    while (true)
+    {
+        const CBlockIndex *pindex = NextBlockToIndex();
+        std::unique_lock<std::mutex> lock(cs);
+        if (fStop)
+            break;
+        if (pindex == nullptr)
+        {
+            if (!fSynced)
+            {
+                fSynced = true;
+                LogPrintf("%s block filter index is synced at height %d\n", BlockFilterTypeName(filterType),
+                    pindexBest.load() ? pindexBest.load()->nHeight : -1);
+            }
+            condProgress.notify_all();
+            // a tip that moved before the wait is caught by the timeout
+            condWork.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+        lock.unlock();
+
+        if (!IndexBlock(pindex))
+        {
+            LogPrintf("%s block filter index stopped at height %d\n", BlockFilterTypeName(filterType),
+                pindex->nHeight - 1);
+            lock.lock();
+            break;
+        }
+        if (!fSynced && pindex->nHeight % SYNC_LOG_INTERVAL == 0)
+            LogPrintf("%s block filter index is at height %d\n", BlockFilterTypeName(filterType), pindex->nHeight);
+        lock.lock();
+        condProgress.notify_all();
+    }
+    // nothing waits for an index that is not running
+    fStop = true;
+    condProgress.notify_all();
+}
+
+bool CBlockFilterIndex::BlockUntilSyncedToCurrentChain()
+{
+    const CBlockIndex *pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+    }
+    if (pindexTip == nullptr)
+        return true;
+    std::unique_lock<std::mutex> lock(cs);
+    while (true)
+    {
+        const CBlockIndex *pindex = pindexBest;
+        if (pindex && pindex->GetAncestor(pindexTip->nHeight) == pindexTip)
+            return true;
+        if (fStop)
+            return false;
+        condWork.notify_all();
+        condProgress.wait_for(lock, std::chrono::milliseconds(100));
+    }
+}
+
+bool CBlockFilterIndex::ReadEntry(const uint256 &hashBlock, uint256 &hashFilter, uint256 &header) const
+{
+    std::pair<uint256, uint256> entry;
+    if (!db->Read(std::make_pair(DB_FILTER_HASH, hashBlock), entry))
+        return false;
+    hashFilter = entry.first;
+    header = entry.second;
+    return true;
+}
+
+bool CBlockFilterIndex::GetRangeHashes(int nStartHeight,
+    const CBlockIndex *pindexStop,
+    std::vector<uint256> &vHashes)
+{
+    if (nStartHeight < 0 || pindexStop == nullptr || nStartHeight > pindexStop->nHeight)
+        return false;
+    vHashes.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex *pindex = pindexStop;
+    for (size_t i = vHashes.size(); i-- > 0; pindex = pindex->pprev)
+        vHashes[i] = pindex->GetBlockHash();
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex *pindex, BlockFilter &filter) const
+{
+    std::vector<unsigned char> vEncoded;
+    if (!db->Read(std::make_pair(DB_FILTER, pindex->GetBlockHash()), vEncoded))
+        return false;
+    try
+    {
+        filter = BlockFilter(filterType, pindex->GetBlockHash(), std::move(vEncoded));
+    }
+    catch (const std::exception &e)
+    {
+        return error(
+            "%s: the filter of block %s is corrupt: %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex *pindex, uint256 &header) const
+{
+    uint256 hashFilter;
+    return ReadEntry(pindex->GetBlockHash(), hashFilter, header);
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight,
+    const CBlockIndex *pindexStop,
+    std::vector<BlockFilter> &vFilters) const
+{
+    std::vector<uint256> vBlockHashes;
+    if (!GetRangeHashes(nStartHeight, pindexStop, vBlockHashes))
+        return false;
+    vFilters.resize(vBlockHashes.size());
+    for (size_t i = 0; i < vBlockHashes.size(); i++)
+    {
+        std::vector<unsigned char> vEncoded;
+        if (!db->Read(std::make_pair(DB_FILTER, vBlockHashes[i]), vEncoded))
+            return false;
+        try
+        {
+            vFilters[i] = BlockFilter(filterType, vBlockHashes[i], std::move(vEncoded));
+        }
+        catch (const std::exception &e)
+        {
+            return error("%s: the filter of block %s is corrupt: %s", __func__, vBlockHashes[i].ToString(), e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight,
+    const CBlockIndex *pindexStop,
+    std::vector<uint256> &vHashes) const
+{
+    std::vector<uint256> vBlockHashes;
+    if (!GetRangeHashes(nStartHeight, pindexStop, vBlockHashes))
+        return false;
+    vHashes.resize(vBlockHashes.size());
+    for (size_t i = 0; i < vBlockHashes.size(); i++)
+    {
+        uint256 header;
+        if (!ReadEntry(vBlockHashes[i], vHashes[i], header))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_BLOCKFILTERINDEX_H
+#define BITCOIN_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "dbwrapper.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Whether to serve filters to peers and signal NODE_COMPACT_FILTERS, requires -blockfilterindex */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+/** The most filters a getcfilters may ask for */
+static const int MAX_GETCFILTERS_SIZE = 1000;
+/** The most filter hashes a getcfheaders may ask for */
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+/** The distance between the filter headers a cfcheckpt holds */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * The filters of the blocks of the active chain and the chain of their headers, in a database of their own under
+ * indexes/blockfilter/<type>. A thread of the index builds them from the block and undo files, catching up from
+ * where it stopped and then following the tip, so validation never waits for it.
+ *
+ * Entries are stored under the block hash. The header of a block only depends on the blocks before it, so the
+ * entries of blocks that were disconnected stay correct and a reorg only moves where the thread continues from.
+ */
+class CBlockFilterIndex : public CValidationInterface
+{
+private:
+    const BlockFilterType filterType;
+    std::unique_ptr<CDBWrapper> db;
+
+    //! the last block the index has the filter of, everything before it in its chain is indexed as well
+    std::atomic<const CBlockIndex *> pindexBest;
+    std::atomic<bool> fSynced;
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::condition_variable condProgress;
+    bool fStop;
+    std::thread thread;
+
+    void ThreadSync();
+    /** The next block of the active chain to index, nullptr when the index is at the tip */
+    const CBlockIndex *NextBlockToIndex();
+    bool IndexBlock(const CBlockIndex *pindex);
+    bool ReadEntry(const uint256 &hashBlock, uint256 &hashFilter, uint256 &header) const;
+    /** The hashes of the blocks from nStartHeight up to pindexStop, false if the range is not valid */
+    static bool GetRangeHashes(int nStartHeight, const CBlockIndex *pindexStop, std::vector<uint256> &vHashes);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) override;
+
+public:
+    CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CBlockFilterIndex();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    /** Continue from where the index stopped, the block index has to be loaded */
+    void Start();
+    void Stop();
+    /** Whether the index has caught up with the tip once */
+    bool IsSynced() const { return fSynced; }
+    /** Wait until the index has the tip of the active chain when this is called, false if it stopped first */
+    bool BlockUntilSyncedToCurrentChain();
+
+    bool LookupFilter(const CBlockIndex *pindex, BlockFilter &filter) const;
+    bool LookupFilterHeader(const CBlockIndex *pindex, uint256 &header) const;
+    /** The filters of the blocks from nStartHeight up to pindexStop, in the order of the chain */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex *pindexStop, std::vector<BlockFilter> &vFilters) const;
+    /** The filter hashes of the blocks from nStartHeight up to pindexStop, in the order of the chain */
+    bool LookupFilterHashRange(int nStartHeight,
+        const CBlockIndex *pindexStop,
+        std::vector<uint256> &vHashes) const;
+};
+
+/** Set while -blockfilterindex is on */
+extern std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_BLOCKFILTERINDEX_H
@@ -0,0 +1,438 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2009-2010 Satoshi Nakamoto
+ * Copyright (c) 2009-2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockassembler.h"
+
+#include "consensus/consensus.h"
+#include "main.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+CBlockAssembler blockAssembler;
+
+static const uint64_t nBlockMaxSize = MAX_BLOCK_SIZE - 1000;
+static const uint64_t nBlockPrioritySize = DEFTAUL_BLOCK_PRIORITY_SIZE;
+static const uint64_t nBlockMinSize = 0;
+//! packages in a row that may not fit before a block that is close to full is given up on
+static const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+
+CBlockAssembler::CBlockAssembler()
+    : nHeight(0), nLockTimeCutoff(0), nTransactionsUpdated(0), fFull(false), fValid(false), nBlockSize(0),
+      nBlockSigOps(0), nFees(0), nNotifications(0), fConnected(false)
+{
+}
+
+void CBlockAssembler::TransactionAdded(CTransactionRef ptx)
+{
+    LOCK(cs);
+    if (!fValid)
+        return;
+    vAdded.push_back(ptx);
+    nNotifications++;
+}
+
+void CBlockAssembler::TransactionRemoved(CTransactionRef ptx)
+{
+    LOCK(cs);
+    if (!fValid)
+        return;
+    setRemoved.insert(ptx->GetHash());
+    nNotifications++;
+}
+
+void CBlockAssembler::Append(CTxMemPool::txiter iter, CAmount nTxFees, unsigned int nTxSigOps)
+{
+    unsigned int nTxSize = iter->GetTxSize();
+    vtx.push_back(MakeTransactionRef(iter->GetTx()));
+    vTxFees.push_back(nTxFees);
+    vTxSigOps.push_back(nTxSigOps);
+    vTxSizes.push_back(nTxSize);
+    setSelected.insert(iter->GetTx().GetHash());
+    nBlockSize += nTxSize;
+    nBlockSigOps += nTxSigOps;
+    nFees += nTxFees;
+}
+
+void CBlockAssembler::SelectAll(const CBlockIndex *pindexPrev, int64_t nLockTimeCutoffIn)
+{
+    hashTip = pindexPrev->GetBlockHash();
+    nHeight = pindexPrev->nHeight + 1;
+    nLockTimeCutoff = nLockTimeCutoffIn;
+    nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    fFull = false;
+    fValid = true;
+    vtx.clear();
+    vTxFees.clear();
+    vTxSigOps.clear();
+    vTxSizes.clear();
+    setSelected.clear();
+    nBlockSize = 1000;
+    nBlockSigOps = 100;
+    nFees = 0;
+    vAdded.clear();
+    setRemoved.clear();
+    nNotifications = 0;
+
+    CTxMemPool::setEntries inBlock;
+    AddPriorityTxs(inBlock);
+    AddPackageTxs(inBlock);
+}
+
+bool CBlockAssembler::TestForBlock(CTxMemPool::txiter iter)
+{
+    if (nBlockSize + iter->GetTxSize() >= nBlockMaxSize || nBlockSigOps + iter->GetSigOpCount() >= MAX_BLOCK_SIGOPS)
+    {
+        fFull = true;
+        return false;
+    }
+    return IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff);
+}
+
+void CBlockAssembler::AddPriorityTxs(CTxMemPool::setEntries &inBlock)
+{
+    if (nBlockPrioritySize == 0)
+        return;
+
+    // This vector will be sorted into a priority queue:
+    std::vector<TxCoinAgePriority> vecPriority;
+    TxCoinAgePriorityCompare pricomparer;
+    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
+
+    vecPriority.reserve(mempool.mapTx.size());
+    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+    {
+        double dPriority = mi->GetPriority(nHeight);
+        CAmount dummy;
+        mempool._ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+
+    while (!vecPriority.empty())
+    {
+        CTxMemPool::txiter iter = vecPriority.front().second;
+        double actualPriority = vecPriority.front().first;
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+        vecPriority.pop_back();
+
+        // a child waits for its parents to be added
+        bool fOrphan = false;
+        for (auto parent : mempool.GetMemPoolParents(iter))
+        {
+            if (!inBlock.count(parent))
+            {
+                fOrphan = true;
+                break;
+            }
+        }
+        if (fOrphan)
+        {
+            waitPriMap.insert(std::make_pair(iter, actualPriority));
+            continue;
+        }
+
+        // the rest of the block goes by fee
+        if (nBlockSize + iter->GetTxSize() >= nBlockPrioritySize || !AllowFree(actualPriority))
+            break;
+        if (!TestForBlock(iter))
+            continue;
+
+        Append(iter, iter->GetFee(), iter->GetSigOpCount());
+        inBlock.insert(iter);
+
+        // Add transactions that depend on this one to the priority queue
+        for (auto child : mempool.GetMemPoolChildren(iter))
+        {
+            waitPriIter wpiter = waitPriMap.find(child);
+            if (wpiter != waitPriMap.end())
+            {
+                vecPriority.push_back(TxCoinAgePriority(wpiter->second, child));
+                std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                waitPriMap.erase(wpiter);
+            }
+        }
+    }
+}
+
+/** Take the transactions just added out of the ancestor state of their descendants */
+static void UpdatePackagesForAdded(const CTxMemPool::setEntries &alreadyAdded,
+    indexed_modified_transaction_set &mapModifiedTx)
+{
+    for (const CTxMemPool::txiter it : alreadyAdded)
+    {
+        CTxMemPool::setEntries descendants;
+        mempool._CalculateDescendants(it, descendants);
+        for (CTxMemPool::txiter desc : descendants)
+        {
+            if (alreadyAdded.count(desc))
+                continue;
+            modtxiter mit = mapModifiedTx.find(desc);
+            if (mit == mapModifiedTx.end())
+            {
+                CTxMemPoolModifiedEntry modEntry(desc);
+                modEntry.nSizeWithAncestors -= it->GetTxSize();
+                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
+                mapModifiedTx.insert(modEntry);
+            }
+            else
+            {
+                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+            }
+        }
+    }
+}
+
+/** Order a package so parents come before their children */
+static void SortForBlock(const CTxMemPool::setEntries &package, std::vector<CTxMemPool::txiter> &sortedEntries)
+{
+    sortedEntries.assign(package.begin(), package.end());
+    std::sort(sortedEntries.begin(), sortedEntries.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    });
+}
+
+void CBlockAssembler::AddPackageTxs(CTxMemPool::setEntries &inBlock)
+{
+    // mempool entries with ancestors in the block, they are picked from here with what is left of their packages
+    indexed_modified_transaction_set mapModifiedTx;
+    // entries of mapModifiedTx that were tried and did not go in, they are not tried again from mapTx
+    CTxMemPool::setEntries failedTx;
+    UpdatePackagesForAdded(inBlock, mapModifiedTx);
+
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi =
+        mempool.mapTx.get<ancestor_score>().begin();
+    CTxMemPool::txiter iter;
+    int64_t nConsecutiveFailed = 0;
+    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
+    {
+        // the entries of mapTx that are added, or whose package changed, are dealt with already
+        if (mi != mempool.mapTx.get<ancestor_score>().end())
+        {
+            CTxMemPool::txiter it = mempool.mapTx.project<0>(mi);
+            if (inBlock.count(it) || mapModifiedTx.count(it) || failedTx.count(it))
+            {
+                ++mi;
+                continue;
+            }
+        }
+
+        // take the best package of mapTx and mapModifiedTx
+        bool fUsingModified = false;
+        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
+        if (mi == mempool.mapTx.get<ancestor_score>().end())
+        {
+            iter = modit->iter;
+            fUsingModified = true;
+        }
+        else
+        {
+            iter = mempool.mapTx.project<0>(mi);
+            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
+                CompareTxMemPoolEntryByAncestorFee()(*modit, CTxMemPoolModifiedEntry(iter)))
+            {
+                iter = modit->iter;
+                fUsingModified = true;
+            }
+            else
+            {
+                ++mi;
+            }
+        }
+
+        const uint64_t nPackageSize = fUsingModified ? modit->nSizeWithAncestors : iter->GetSizeWithAncestors();
+        const CAmount nPackageFees = fUsingModified ? modit->nModFeesWithAncestors : iter->GetModFeesWithAncestors();
+        // everything that is left pays less
+        if (nPackageFees < ::minRelayTxFee.GetFee(nPackageSize) && nBlockSize >= nBlockMinSize)
+            return;
+
+        CTxMemPool::setEntries package;
+        bool fOk = nBlockSize + nPackageSize < nBlockMaxSize;
+        if (fOk)
+        {
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            mempool._CalculateMemPoolAncestors(*iter, package, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            for (CTxMemPool::setEntries::iterator it = package.begin(); it != package.end();)
+            {
+                if (inBlock.count(*it))
+                    it = package.erase(it);
+                else
+                    ++it;
+            }
+            package.insert(iter);
+
+            unsigned int nPackageSigOps = 0;
+            for (CTxMemPool::txiter it : package)
+            {
+                nPackageSigOps += it->GetSigOpCount();
+                fOk &= IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff);
+            }
+            if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS)
+            {
+                fOk = false;
+                fFull = true;
+            }
+        }
+        else
+        {
+            fFull = true;
+        }
+        if (!fOk)
+        {
+            if (fUsingModified)
+            {
+                mapModifiedTx.get<ancestor_score>().erase(modit);
+                failedTx.insert(iter);
+            }
+            // close to full, the few bytes left are not worth going through the rest of the mempool
+            if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 1000)
+                break;
+            continue;
+        }
+        nConsecutiveFailed = 0;
+
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(package, sortedEntries);
+        for (CTxMemPool::txiter it : sortedEntries)
+        {
+            Append(it, it->GetFee(), it->GetSigOpCount());
+            inBlock.insert(it);
+            mapModifiedTx.erase(it);
+        }
+        UpdatePackagesForAdded(package, mapModifiedTx);
+    }
+}
+
+bool CBlockAssembler::ApplyDelta()
+{
+    // every mempool change bumps the counter, a change we were not told about (clear,
+    // prioritisetransaction) means the delta is incomplete
+    if (mempool.GetTransactionsUpdated() != nTransactionsUpdated + nNotifications)
+        return false;
+    if (nNotifications == 0)
+        return true;
+
+    bool fRemovedSelected = false;
+    for (const uint256 &hash : setRemoved)
+    {
+        if (!setSelected.count(hash))
+            continue;
+        // space freed in a full block could go to something that was left out
+        if (fFull)
+            return false;
+        for (size_t i = 0; i < vtx.size(); i++)
+        {
+            if (vtx[i]->GetHash() != hash)
+                continue;
+            nBlockSize -= vTxSizes[i];
+            nBlockSigOps -= vTxSigOps[i];
+            nFees -= vTxFees[i];
+            vtx.erase(vtx.begin() + i);
+            vTxFees.erase(vTxFees.begin() + i);
+            vTxSigOps.erase(vTxSigOps.begin() + i);
+            vTxSizes.erase(vTxSizes.begin() + i);
+            break;
+        }
+        setSelected.erase(hash);
+        fRemovedSelected = true;
+    }
+    if (fRemovedSelected)
+    {
+        // the mempool removes descendants along with a transaction, so whatever is left
+        // must still be there for its parents to be in the block
+        for (const CTransactionRef &ptx : vtx)
+        {
+            if (mempool.mapTx.find(ptx->GetHash()) == mempool.mapTx.end())
+                return false;
+        }
+    }
+
+    for (const CTransactionRef &ptx : vAdded)
+    {
+        const uint256 hash = ptx->GetHash();
+        if (setRemoved.count(hash) || setSelected.count(hash))
+            continue;
+        CTxMemPool::txiter iter = mempool.mapTx.find(hash);
+        if (iter == mempool.mapTx.end())
+            return false;
+
+        // a parent that was left out could now go in as a package with it
+        for (auto parent : mempool.GetMemPoolParents(iter))
+        {
+            if (!setSelected.count(parent->GetTx().GetHash()))
+                return false;
+        }
+
+        // only a paying transaction that fits is certain to be picked by a full selection,
+        // free ones compete on priority and a full block on fees
+        unsigned int nTxSize = iter->GetTxSize();
+        unsigned int nTxSigOps = iter->GetSigOpCount();
+        if (fFull || iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) ||
+            nBlockSize + nTxSize >= nBlockMaxSize - 1000 || nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+        {
+            return false;
+        }
+
+        if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff))
+            continue;
+
+        Append(iter, iter->GetFee(), nTxSigOps);
+    }
+
+    nTransactionsUpdated += nNotifications;
+    nNotifications = 0;
+    vAdded.clear();
+    setRemoved.clear();
+    return true;
+}
+
+CAmount CBlockAssembler::AddTransactions(CBlockTemplate *pblocktemplate,
+    const CBlockIndex *pindexPrev,
+    int64_t nLockTimeCutoffIn)
+{
+    READLOCK(mempool.cs);
+    LOCK(cs);
+    if (!fConnected)
+    {
+        mempool.NotifyEntryAdded.connect([this](CTransactionRef ptx, uint64_t) { TransactionAdded(ptx); });
+        mempool.NotifyEntryRemoved.connect(
+            [this](CTransactionRef ptx, MemPoolRemovalReason, uint64_t) { TransactionRemoved(ptx); });
+        fConnected = true;
+    }
+
+    if (!fValid || hashTip != pindexPrev->GetBlockHash() || nLockTimeCutoff != nLockTimeCutoffIn || !ApplyDelta())
+    {
+        SelectAll(pindexPrev, nLockTimeCutoffIn);
+    }
+
+    CBlock *pblock = &pblocktemplate->block;
+    pblock->vtx.insert(pblock->vtx.end(), vtx.begin(), vtx.end());
+    pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), vTxFees.begin(), vTxFees.end());
+    pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), vTxSigOps.begin(), vTxSigOps.end());
+
+    nLastBlockTx = vtx.size();
+    nLastBlockSize = nBlockSize;
+    return nFees;
+}
@@ -0,0 +1,152 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2009-2010 Satoshi Nakamoto
+ * Copyright (c) 2009-2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_BLOCKASSEMBLER_H
+#define ECCOIN_BLOCKASSEMBLER_H
+
+#include "amount.h"
+#include "blockgeneration.h"
+#include "chain/blockindex.h"
+#include "chain/tx.h"
+#include "sync.h"
+#include "txmempool.h"
+#include "uint256.h"
+
+#include <set>
+#include <vector>
+
+/** A mempool transaction with ancestors in the block being assembled, its ancestor state
+ *  without them is the package that is left to add for it */
+struct CTxMemPoolModifiedEntry
+{
+    explicit CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
+        : iter(entry), nSizeWithAncestors(entry->GetSizeWithAncestors()),
+          nModFeesWithAncestors(entry->GetModFeesWithAncestors())
+    {
+    }
+
+    CAmount GetModifiedFee() const { return iter->GetModifiedFee(); }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    size_t GetTxSize() const { return iter->GetTxSize(); }
+    const CTransaction &GetTx() const { return iter->GetTx(); }
+
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+};
+
+struct modifiedentry_iter
+{
+    typedef CTxMemPool::txiter result_type;
+    result_type operator()(const CTxMemPoolModifiedEntry &entry) const { return entry.iter; }
+};
+
+typedef boost::multi_index_container<CTxMemPoolModifiedEntry,
+    boost::multi_index::indexed_by<
+        // sorted by the mempool entry
+        boost::multi_index::ordered_unique<modifiedentry_iter, CTxMemPool::CompareIteratorByHash>,
+        // sorted by fee rate with the remaining ancestors
+        boost::multi_index::ordered_non_unique<boost::multi_index::tag<ancestor_score>,
+            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
+            CompareTxMemPoolEntryByAncestorFee> > >
+    indexed_modified_transaction_set;
+
+typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
+typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator modtxscoreiter;
+
+struct update_for_parent_inclusion
+{
+    explicit update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
+    void operator()(CTxMemPoolModifiedEntry &e) const
+    {
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+    }
+
+private:
+    CTxMemPool::txiter iter;
+};
+
+/** Picks the mempool transactions that go into new blocks and keeps that selection between
+ *  templates. A full selection is only made for a new tip. Transactions added to or removed
+ *  from the mempool after that are applied to the kept selection as a delta, as long as the
+ *  result is what a full selection would pick, which holds while nothing was left out of the
+ *  block for lack of room. Anything else makes the next template start from scratch.
+ */
+class CBlockAssembler
+{
+private:
+    CCriticalSection cs;
+
+    //! the tip, block height and lock time cutoff the selection was made for
+    uint256 hashTip;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    //! the mempool update counter the selection and the pending delta account for
+    unsigned int nTransactionsUpdated;
+    //! set when a transaction was left out for lack of size or sigops
+    bool fFull;
+    bool fValid;
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    std::vector<unsigned int> vTxSizes;
+    std::set<uint256> setSelected;
+    uint64_t nBlockSize;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+
+    //! mempool changes since the selection was made
+    std::vector<CTransactionRef> vAdded;
+    std::set<uint256> setRemoved;
+    unsigned int nNotifications;
+    bool fConnected;
+
+    void TransactionAdded(CTransactionRef ptx);
+    void TransactionRemoved(CTransactionRef ptx);
+
+    /** Select from the whole mempool: the coin age priority space first, then the rest by package
+     *  feerate, a transaction together with the ancestors it needs that are not in the block yet
+     */
+    void SelectAll(const CBlockIndex *pindexPrev, int64_t nLockTimeCutoffIn);
+    void AddPriorityTxs(CTxMemPool::setEntries &inBlock);
+    void AddPackageTxs(CTxMemPool::setEntries &inBlock);
+    //! whether a transaction fits the block and is final, fFull is set if it does not fit
+    bool TestForBlock(CTxMemPool::txiter iter);
+    /** Apply the pending mempool delta, returns false if only a full selection gives the right result */
+    bool ApplyDelta();
+    void Append(CTxMemPool::txiter iter, CAmount nTxFees, unsigned int nTxSigOps);
+
+public:
+    CBlockAssembler();
+    CBlockAssembler(const CBlockAssembler &) = delete;
+    CBlockAssembler &operator=(const CBlockAssembler &) = delete;
+
+    /** Append the transactions selected for a block on pindexPrev to pblocktemplate and return
+     *  the fees they pay. Needs cs_main held.
+     */
+    CAmount AddTransactions(CBlockTemplate *pblocktemplate, const CBlockIndex *pindexPrev, int64_t nLockTimeCutoffIn);
+};
+
+extern CBlockAssembler blockAssembler;
+
+#endif // ECCOIN_BLOCKASSEMBLER_H
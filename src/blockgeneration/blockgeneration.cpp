@@ -18,6 +18,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "args.h"
 #include "blockgeneration.h"
 #include "compare.h"
 #include "consensus/merkle.h"
@@ -26,6 +27,16 @@
 #include "util/util.h"
 #include "wallet/wallet.h"
 
+void SetExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned int nExtraNonce)
+{
+    unsigned int nHeight = pindexPrev->nHeight + 1; // Height first in coinbase required for block.version=2
+    pblock->vtx[0]->vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
+    assert(pblock->vtx[0]->vin[0].scriptSig.size() <= 100);
+    pblock->vtx[0]->UpdateHash();
+
+    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+}
+
 void IncrementExtraNonce(CBlock *pblock, CBlockIndex *pindexPrev, unsigned int &nExtraNonce)
 {
     // Update nExtraNonce
@@ -36,11 +47,7 @@ void IncrementExtraNonce(CBlock *pblock, CBlockIndex *pindexPrev, unsigned int &
         hashPrevBlock = pblock->hashPrevBlock;
     }
     ++nExtraNonce;
-    unsigned int nHeight = pindexPrev->nHeight + 1; // Height first in coinbase required for block.version=2
-    pblock->vtx[0]->vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
-    assert(pblock->vtx[0]->vin[0].scriptSig.size() <= 100);
-
-    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    SetExtraNonce(pblock, pindexPrev, nExtraNonce);
 }
 
 int64_t UpdateTime(CBlockHeader *pblock, const Consensus::Params &consensusParams, const CBlockIndex *pindexPrev)
@@ -82,11 +89,21 @@ void ThreadMiner(void *parg, bool shutdownOnly)
     {
         return;
     }
+    int nThreads = (int)gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (nThreads < 0)
+    {
+        nThreads = GetNumCores();
+    }
+    if (nThreads == 0)
+    {
+        return;
+    }
     minerThreads = new thread_group(&shutdown_threads);
     CWallet *pwallet = (CWallet *)parg;
     try
     {
-        minerThreads->create_thread(&EccMiner, pwallet);
+        for (int i = 0; i < nThreads; i++)
+            minerThreads->create_thread(&EccMiner, pwallet, (unsigned int)i, (unsigned int)nThreads);
     }
     catch (std::exception &e)
     {
@@ -108,6 +125,7 @@ void ThreadMinter(void *parg, bool shutdownOnly)
     if (minterThreads != nullptr)
     {
         minterThreads->interrupt_all();
+        WakeMinter();
         delete minterThreads;
         minterThreads = nullptr;
         return;
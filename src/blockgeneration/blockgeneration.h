@@ -28,6 +28,8 @@
 static const bool DEFAULT_GENERATE = false;
 static const bool DEFAULT_PRINTPRIORITY = false;
 static const uint64_t DEFAULT_MIN_BLOCK_GEN_PEERS = 4;
+//! number of proof-of-work miner threads, -1 uses every core
+static const int DEFAULT_GENERATE_THREADS = 1;
 struct CBlockTemplate
 {
     CBlock block;
@@ -35,6 +37,8 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
 };
 
+/** Put nExtraNonce into the coinbase of pblock and update its merkle root */
+void SetExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, unsigned int nExtraNonce);
 void IncrementExtraNonce(CBlock *pblock, CBlockIndex *pindexPrev, unsigned int &nExtraNonce);
 
 int64_t UpdateTime(CBlockHeader *pblock, const Consensus::Params &consensusParams, const CBlockIndex *pindexPrev);
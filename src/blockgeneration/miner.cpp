@@ -20,11 +20,14 @@
 
 #include "miner.h"
 #include "args.h"
+#include "blockassembler.h"
 #include "blockgeneration.h"
 #include "compare.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "crypto/scrypt.h"
+#include "crypto/scrypt_nway.h"
 #include "init.h"
 #include "kernel.h"
 #include "net/net.h"
@@ -39,7 +42,9 @@
 #include "util/util.h"
 #include "util/utilmoneystr.h"
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <openssl/sha.h>
 #include <queue>
 
@@ -49,8 +54,8 @@ typedef boost::tuple<double, double, CTransaction *> TxPriority;
 
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
-double dHashesPerSec;
-int64_t nHPSTimerStart;
+std::atomic<double> dHashesPerSec(0);
+std::atomic<int64_t> nHPSTimerStart(0);
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -131,40 +136,16 @@ std::unique_ptr<CBlockTemplate> CreateNewPoWBlock(CWallet *pwallet, const CScrip
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-    uint64_t nBlockMaxSize = MAX_BLOCK_SIZE - 1000;
-    uint64_t nBlockPrioritySize = DEFTAUL_BLOCK_PRIORITY_SIZE;
-    uint64_t nBlockMinSize = 0;
-
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
-
     // ppcoin: if coinstake available add coinstake tx
     // Commented out unused variable assuming no side effect within GetAdjustedTime()
     // static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
     CBlockIndex *pindexPrev = pnetMan->getChainActive()->chainActive.Tip();
 
-
-    // This vector will be sorted into a priority queue:
-    std::vector<TxCoinAgePriority> vecPriority;
-    TxCoinAgePriorityCompare pricomparer;
-    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-    double actualPriority = -1;
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
-    CAmount nFees = 0;
-
     pblock->nBits = GetNextTargetRequired(pindexPrev, false);
     // Collect memory pool transactions into the block
     {
         LOCK(cs_main);
-        READLOCK(mempool.cs);
         CBlockIndex *_pindexPrev = pnetMan->getChainActive()->chainActive.Tip();
-        const int nHeight = _pindexPrev->nHeight + 1;
         pblock->nTime = GetAdjustedTime();
         const int64_t nMedianTimePast = _pindexPrev->GetMedianTimePast();
 
@@ -173,145 +154,7 @@ std::unique_ptr<CBlockTemplate> CreateNewPoWBlock(CWallet *pwallet, const CScrip
         int64_t nLockTimeCutoff =
             (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST) ? nMedianTimePast : pblock->GetBlockTime();
 
-        bool fPriorityBlock = nBlockPrioritySize > 0;
-        if (fPriorityBlock)
-        {
-            vecPriority.reserve(mempool.mapTx.size());
-            for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end();
-                 ++mi)
-            {
-                double dPriority = mi->GetPriority(nHeight);
-                CAmount dummy;
-                mempool._ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-            }
-            std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-        }
-
-        CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-        CTxMemPool::txiter iter;
-        while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
-        {
-            bool priorityTx = false;
-            if (fPriorityBlock && !vecPriority.empty())
-            { // add a tx from priority queue to fill the blockprioritysize
-                priorityTx = true;
-                iter = vecPriority.front().second;
-                actualPriority = vecPriority.front().first;
-                std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                vecPriority.pop_back();
-            }
-            else if (clearedTxs.empty())
-            { // add tx with next highest score
-                iter = mempool.mapTx.project<0>(mi);
-                mi++;
-            }
-            else
-            { // try to add a previously postponed child tx
-                iter = clearedTxs.top();
-                clearedTxs.pop();
-            }
-
-            if (inBlock.count(iter))
-                continue; // could have been added to the priorityBlock
-
-            const CTransaction &tx = iter->GetTx();
-
-            bool fOrphan = false;
-            for (auto parent : mempool.GetMemPoolParents(iter))
-            {
-                if (!inBlock.count(parent))
-                {
-                    fOrphan = true;
-                    break;
-                }
-            }
-            if (fOrphan)
-            {
-                if (priorityTx)
-                    waitPriMap.insert(std::make_pair(iter, actualPriority));
-                else
-                    waitSet.insert(iter);
-                continue;
-            }
-
-            unsigned int nTxSize = iter->GetTxSize();
-            if (fPriorityBlock && (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority)))
-            {
-                fPriorityBlock = false;
-                waitPriMap.clear();
-            }
-            if (!priorityTx &&
-                (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) && nBlockSize >= nBlockMinSize))
-            {
-                break;
-            }
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-            {
-                if (nBlockSize > nBlockMaxSize - 100 || lastFewTxs > 50)
-                {
-                    break;
-                }
-                // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                // to try to fill the remaining space.
-                if (nBlockSize > nBlockMaxSize - 1000)
-                {
-                    lastFewTxs++;
-                }
-                continue;
-            }
-
-            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
-                continue;
-
-            unsigned int nTxSigOps = iter->GetSigOpCount();
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-            {
-                if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2)
-                {
-                    break;
-                }
-                continue;
-            }
-
-            CAmount nTxFees = iter->GetFee();
-            // Added
-            pblock->vtx.push_back(MakeTransactionRef(tx));
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            inBlock.insert(iter);
-
-            // Add transactions that depend on this one to the priority queue
-            for (auto child : mempool.GetMemPoolChildren(iter))
-            {
-                if (fPriorityBlock)
-                {
-                    waitPriIter wpiter = waitPriMap.find(child);
-                    if (wpiter != waitPriMap.end())
-                    {
-                        vecPriority.push_back(TxCoinAgePriority(wpiter->second, child));
-                        std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                        waitPriMap.erase(wpiter);
-                    }
-                }
-                else
-                {
-                    if (waitSet.count(child))
-                    {
-                        clearedTxs.push(child);
-                        waitSet.erase(child);
-                    }
-                }
-            }
-        }
-
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
+        CAmount nFees = blockAssembler.AddTransactions(pblocktemplate.get(), _pindexPrev, nLockTimeCutoff);
 
         // Fill in header
         pblock->hashPrevBlock = _pindexPrev->GetBlockHash();
@@ -385,12 +228,12 @@ bool CheckWork(const CBlock *pblock, CWallet &wallet, boost::shared_ptr<CReserve
 
     // Found a solution
     {
-        CBlockIndex *ptip = pnetMan->getChainActive()->chainActive.Tip();
-        if (ptip == nullptr)
+        CChainTipRef tip = pnetMan->getChainActive()->GetPublishedTip();
+        if (tip->pindex == nullptr)
         {
             return false;
         }
-        if (pblock->hashPrevBlock != ptip->GetBlockHash())
+        if (pblock->hashPrevBlock != tip->hash)
         {
             return error("BMiner : generated block is stale");
         }
@@ -414,147 +257,268 @@ bool CheckWork(const CBlock *pblock, CWallet &wallet, boost::shared_ptr<CReserve
     return true;
 }
 
-void EccMiner(CWallet *pwallet)
+/** A block template shared by the miner threads. The first thread builds and publishes it,
+ *  every thread then mines its own copy with a distinct extra nonce, so the threads search
+ *  disjoint parts of the nonce space without coordinating per hash.
+ */
+struct CMinerWork
 {
-    void *scratchbuf = scrypt_buffer_alloc();
-    LogPrintf("CPUMiner started for proof-of-work\n");
-    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-    // Make this thread recognisable as the mining thread
-    RenameThread("ecc-miner");
-    // Each thread has its own key and counter
-
+    CBlockTemplate blocktemplate;
+    CBlockIndex *pindexPrev;
+    unsigned int nTransactionsUpdated;
+    int64_t nStart;
     boost::shared_ptr<CReserveScript> coinbaseScript;
-    GetMainSignals().ScriptForMining(coinbaseScript);
+};
+
+static std::mutex cs_minerWork;
+static std::shared_ptr<const CMinerWork> pminerWork;
+//! bumped every time a new template is published or the current one goes stale
+static std::atomic<uint64_t> nMinerWorkGeneration(0);
+//! set by any miner thread that finds the template stale, the first thread rebuilds it
+static std::atomic<bool> fMinerWorkStale(false);
+//! hashes done by all miner threads since nHPSTimerStart
+static std::atomic<uint64_t> nMinerHashes(0);
+//! serializes submitting solutions, which consumes the shared coinbase key
+static CCriticalSection cs_minerSubmit;
+
+//! nonces scanned between checks for a stale template
+static const uint32_t MINER_SCAN_NONCES = 4096;
+static const uint32_t MINER_MAX_NONCE = 0xffff0000;
+
+/** Scrypt nCount consecutive nonces of header starting at nNonceStart, batched over the
+ *  multi-buffer scrypt core. Returns true and sets nNonceFound to the first nonce whose
+ *  hash meets hashTarget.
+ */
+static bool ScanNonces(const CBlockHeader &header,
+    uint32_t nNonceStart,
+    uint32_t nCount,
+    const arith_uint256 &hashTarget,
+    uint32_t &nNonceFound)
+{
+    const size_t nLanes = std::min(std::max<size_t>(scrypt_batch_lanes(), 1), SCRYPT_MAX_LANES);
+    unsigned char inputs[SCRYPT_MAX_LANES][CBlockHeader::HASHED_SIZE];
+    const void *pinputs[SCRYPT_MAX_LANES];
+    uint256 hashes[SCRYPT_MAX_LANES];
+    for (size_t l = 0; l < nLanes; l++)
+    {
+        memcpy(inputs[l], &header.nVersion, CBlockHeader::HASHED_SIZE);
+        pinputs[l] = inputs[l];
+    }
+
+    for (uint32_t n = 0; n < nCount; n += nLanes)
+    {
+        const size_t nBatch = std::min<size_t>(nLanes, nCount - n);
+        // the nonce is the last field of the hashed header
+        for (size_t l = 0; l < nBatch; l++)
+            WriteLE32(inputs[l] + CBlockHeader::HASHED_SIZE - 4, nNonceStart + n + l);
+        scrypt_blockhash_batch(pinputs, hashes, nBatch);
+        for (size_t l = 0; l < nBatch; l++)
+        {
+            if (UintToArith256(hashes[l]) <= hashTarget)
+            {
+                nNonceFound = nNonceStart + n + l;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void MeterHashes(uint64_t nHashesDone)
+{
+    static CCriticalSection cs;
+    nMinerHashes += nHashesDone;
+    if (GetTimeMillis() - nHPSTimerStart > 4000)
+    {
+        LOCK(cs);
+        int64_t nNow = GetTimeMillis();
+        int64_t nStart = nHPSTimerStart.load();
+        if (nStart == 0)
+        {
+            nHPSTimerStart = nNow;
+            nMinerHashes = 0;
+        }
+        else if (nNow - nStart > 4000)
+        {
+            dHashesPerSec = 1000.0 * nMinerHashes.exchange(0) / (nNow - nStart);
+            nHPSTimerStart = nNow;
+        }
+    }
+}
 
-    // If the keypool is exhausted, no script is returned at all.  Catch this.
-    if (!coinbaseScript)
-        return;
+/** Flag the template of nGeneration as stale unless a newer one was published already */
+static void MarkMinerWorkStale(uint64_t nGeneration)
+{
+    std::lock_guard<std::mutex> lock(cs_minerWork);
+    if (nGeneration == nMinerWorkGeneration.load())
+        fMinerWorkStale = true;
+}
 
-    // throw an error if no script was provided
-    if (coinbaseScript->reserveScript.empty())
-        return;
+/** Build a fresh template for the miner threads. Returns false if no block could be
+ *  created, which only happens when the keypool ran out.
+ */
+static bool PublishMinerWork(CWallet *pwallet, boost::shared_ptr<CReserveScript> coinbaseScript)
+{
+    std::shared_ptr<CMinerWork> work = std::make_shared<CMinerWork>();
+    work->nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    work->pindexPrev = pnetMan->getChainActive()->chainActive.Tip();
+    work->nStart = GetTime();
+    work->coinbaseScript = coinbaseScript;
+    std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewPoWBlock(pwallet, coinbaseScript->reserveScript));
+    if (!pblocktemplate.get())
+    {
+        return false;
+    }
+    work->blocktemplate = *pblocktemplate;
+    LogPrintf("Running Miner with %u transactions in block (%u bytes)\n", work->blocktemplate.block.vtx.size(),
+        ::GetSerializeSize(work->blocktemplate.block, SER_NETWORK, PROTOCOL_VERSION));
+
+    std::lock_guard<std::mutex> lock(cs_minerWork);
+    pminerWork = work;
+    fMinerWorkStale = false;
+    nMinerWorkGeneration++;
+    return true;
+}
+
+/** Mine one copy of the shared template until it is solved, superseded or stale.
+ *  Thread nThread of nThreads uses the extra nonces nThread + 1, nThread + 1 + nThreads, ...
+ *  and moves to the next one whenever it exhausts the nonce range.
+ */
+static void MineWork(const CMinerWork &work, uint64_t nGeneration, unsigned int nThread, unsigned int nThreads)
+{
+    CBlock block(work.blocktemplate.block);
+    // the template's coinbase is shared with the other threads, give this thread its own
+    block.vtx[0] = std::make_shared<CTransaction>(*block.vtx[0]);
+    CBlockIndex *pindexPrev = work.pindexPrev;
+    unsigned int nExtraNonce = nThread + 1;
+    SetExtraNonce(&block, pindexPrev, nExtraNonce);
+    arith_uint256 hashTarget = arith_uint256(block.nBits);
+    uint32_t nNonce = 0;
 
-    unsigned int nExtraNonce = 0;
     while (true)
     {
+        uint32_t nNonceFound;
+        if (ScanNonces(block, nNonce, MINER_SCAN_NONCES, hashTarget, nNonceFound))
+        {
+            // Found a solution
+            block.nNonce = nNonceFound;
+            assert(UintToArith256(block.GetHash()) <= hashTarget);
+            LOCK(cs_minerSubmit);
+            if (nGeneration != nMinerWorkGeneration.load() || fMinerWorkStale.load())
+                return;
+            if (block.SignScryptBlock(*pwalletMain))
+            {
+                SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                CheckWork(&block, *pwalletMain, work.coinbaseScript);
+                SetThreadPriority(THREAD_PRIORITY_LOWEST);
+            }
+            MarkMinerWorkStale(nGeneration);
+            return;
+        }
+        MeterHashes(MINER_SCAN_NONCES);
+        nNonce += MINER_SCAN_NONCES;
+
+        // Check for stop or if block needs to be rebuilt
         if (shutdown_threads.load())
             return;
-        if (!g_connman)
+        if (nGeneration != nMinerWorkGeneration.load() || fMinerWorkStale.load())
+            return;
+        if ((mempool.GetTransactionsUpdated() != work.nTransactionsUpdated && GetTime() - work.nStart > 60) ||
+            pindexPrev != pnetMan->getChainActive()->GetPublishedTip()->pindex)
         {
-            MilliSleep(1000);
-            if (shutdown_threads.load())
-                return;
+            MarkMinerWorkStale(nGeneration);
+            return;
         }
-        while (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < DEFAULT_MIN_BLOCK_GEN_PEERS ||
-               pnetMan->getChainActive()->IsInitialBlockDownload() || pwallet->IsLocked())
+        if (nNonce >= MINER_MAX_NONCE)
         {
-            MilliSleep(1000);
-            if (shutdown_threads.load())
-                return;
+            nExtraNonce += nThreads;
+            SetExtraNonce(&block, pindexPrev, nExtraNonce);
+            nNonce = 0;
         }
-        //
-        // Create new block
-        //
-        unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex *pindexPrev = pnetMan->getChainActive()->chainActive.Tip();
-        std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewPoWBlock(pwallet, coinbaseScript->reserveScript));
-        if (!pblocktemplate.get())
+        // Update nTime every few seconds
+        block.nTime = std::max(pindexPrev->GetMedianTimePast() + 1, block.GetMaxTransactionTime());
+        block.nTime = std::max(block.GetBlockTime(), pindexPrev->GetBlockTime() - nMaxClockDrift);
+        UpdateTime(&block, pnetMan->getActivePaymentNetwork()->GetConsensus(), pindexPrev);
+        if (block.GetBlockTime() >= (int64_t)block.vtx[0]->nTime + nMaxClockDrift)
         {
-            LogPrintf(
-                "Error in Miner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
+            // need to update coinbase timestamp
+            MarkMinerWorkStale(nGeneration);
             return;
         }
-        CBlock *pblock = &pblocktemplate->block;
-        IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
-        LogPrintf("Running Miner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
-            ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
-        //
-        // Pre-build hash buffers
-        //
-        char pmidstatebuf[32 + 16];
-        char *pmidstate = alignup<16>(pmidstatebuf);
-        char pdatabuf[128 + 16];
-        char *pdata = alignup<16>(pdatabuf);
-        char phash1buf[64 + 16];
-        char *phash1 = alignup<16>(phash1buf);
-        FormatHashBuffers(pblock, pmidstate, pdata, phash1);
-        unsigned int &nBlockTime = *(unsigned int *)(pdata + 64 + 4);
-        unsigned int &nBlockNonce = *(unsigned int *)(pdata + 64 + 12);
-        //
-        // Search
-        //
-        int64_t nStart = GetTime();
-        arith_uint256 hashTarget = arith_uint256(pblock->nBits);
-        unsigned int max_nonce = 0xffff0000;
-        CBlockHeader res_header;
-        arith_uint256 result;
-        while (true)
-        {
-            unsigned int nHashesDone = 0;
-            unsigned int nNonceFound;
+    }
+}
 
-            nNonceFound = scanhash_scrypt(
-                (CBlockHeader *)&pblock->nVersion, scratchbuf, max_nonce, nHashesDone, UBEGIN(result), &res_header);
+void EccMiner(CWallet *pwallet, unsigned int nThread, unsigned int nThreads)
+{
+    LogPrintf("CPUMiner thread %u of %u started for proof-of-work\n", nThread + 1, nThreads);
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    // Make this thread recognisable as the mining thread
+    RenameThread("ecc-miner");
 
-            // Check if something found
-            if (nNonceFound != (unsigned int)-1)
+    // The first thread owns the coinbase key and builds the templates
+    boost::shared_ptr<CReserveScript> coinbaseScript;
+    if (nThread == 0)
+    {
+        GetMainSignals().ScriptForMining(coinbaseScript);
+
+        // If the keypool is exhausted, no script is returned at all.  Catch this.
+        if (!coinbaseScript)
+            return;
+
+        // throw an error if no script was provided
+        if (coinbaseScript->reserveScript.empty())
+            return;
+    }
+
+    uint64_t nGeneration = 0;
+    while (true)
+    {
+        if (shutdown_threads.load())
+            return;
+        // the first thread only gets back here when the template has to be rebuilt
+        if (nThread == 0)
+        {
+            if (!g_connman)
             {
-                if (result <= hashTarget)
-                {
-                    // Found a solution
-                    pblock->nNonce = nNonceFound;
-                    assert(result == UintToArith256(pblock->GetHash()));
-                    if (!pblock->SignScryptBlock(*pwalletMain))
-                    {
-                        break;
-                    }
-                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                    CheckWork(pblock, *pwalletMain, coinbaseScript);
-                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                    break;
-                }
+                MilliSleep(1000);
+                continue;
             }
-            // Meter hashes/sec
-            static int64_t nHashCounter;
-            if (nHPSTimerStart == 0)
+            while (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < DEFAULT_MIN_BLOCK_GEN_PEERS ||
+                   pnetMan->getChainActive()->GetPublishedTip()->fInitialBlockDownload || pwallet->IsLocked())
             {
-                nHPSTimerStart = GetTimeMillis();
-                nHashCounter = 0;
+                MilliSleep(1000);
+                if (shutdown_threads.load())
+                    return;
             }
-            else
-                nHashCounter += nHashesDone;
-            if (GetTimeMillis() - nHPSTimerStart > 4000)
+            //
+            // Create new block
+            //
+            if (!PublishMinerWork(pwallet, coinbaseScript))
             {
-                static CCriticalSection cs;
-                {
-                    LOCK(cs);
-                    if (GetTimeMillis() - nHPSTimerStart > 4000)
-                    {
-                        dHashesPerSec = 1000.0 * nHashCounter / (GetTimeMillis() - nHPSTimerStart);
-                        nHPSTimerStart = GetTimeMillis();
-                        nHashCounter = 0;
-                    }
-                }
-            }
-            // Check for stop or if block needs to be rebuilt
-            if (shutdown_threads.load())
+                LogPrintf(
+                    "Error in Miner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
                 return;
-            if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL))
-                break;
-            if (nBlockNonce >= 0xffff0000)
-                break;
-            if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
-                break;
-            if (pindexPrev != pnetMan->getChainActive()->chainActive.Tip())
-                break;
-            // Update nTime every few seconds
-            pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, pblock->GetMaxTransactionTime());
-            pblock->nTime = std::max(pblock->GetBlockTime(), pindexPrev->GetBlockTime() - nMaxClockDrift);
-            UpdateTime(pblock, pnetMan->getActivePaymentNetwork()->GetConsensus(), pindexPrev);
-            nBlockTime = ByteReverse(pblock->nTime);
-            if (pblock->GetBlockTime() >= (int64_t)pblock->vtx[0]->nTime + nMaxClockDrift)
-                break; // need to update coinbase timestamp
+            }
+        }
+
+        std::shared_ptr<const CMinerWork> work;
+        {
+            std::lock_guard<std::mutex> lock(cs_minerWork);
+            if (nGeneration != nMinerWorkGeneration.load() && !fMinerWorkStale.load())
+            {
+                work = pminerWork;
+                nGeneration = nMinerWorkGeneration.load();
+            }
+        }
+        if (!work)
+        {
+            // wait for the first thread to publish a template
+            MilliSleep(100);
+            continue;
         }
+        //
+        // Search
+        //
+        MineWork(*work, nGeneration, nThread, nThreads);
     }
-    scrypt_buffer_free(scratchbuf);
 }
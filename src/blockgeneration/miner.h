@@ -26,11 +26,16 @@
 #include "main.h"
 #include "wallet/wallet.h"
 
-extern double dHashesPerSec;
-extern int64_t nHPSTimerStart;
+#include <atomic>
+
+extern std::atomic<double> dHashesPerSec;
+extern std::atomic<int64_t> nHPSTimerStart;
 
 std::unique_ptr<CBlockTemplate> CreateNewPoWBlock(CWallet *pwallet, const CScript &scriptPubKeyIn);
 
-void EccMiner(CWallet *pwallet);
+/** Proof-of-work miner thread nThread of nThreads. The threads share one block template and
+ *  split the search space between them by extra nonce.
+ */
+void EccMiner(CWallet *pwallet, unsigned int nThread, unsigned int nThreads);
 
 #endif // ECCOIN_MINER_H
@@ -21,17 +21,70 @@
 #include "minter.h"
 
 #include "args.h"
+#include "blockassembler.h"
 #include "blockgeneration.h"
 #include "init.h"
 #include "processblock.h"
 #include "txmempool.h"
 #include "util/utilmoneystr.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <queue>
 
 extern CWallet *pwalletMain;
 int64_t nLastCoinStakeSearchInterval = 0;
 
+/** Lets the minter sleep until something it waits for may have changed: the chain tip, the
+ *  wallet's transactions, the wallet's lock state or the number of connected peers.
+ */
+class CMinterWakeup : public CValidationInterface
+{
+private:
+    std::mutex cs;
+    std::condition_variable cond;
+    //! bumped on every event, waiters sleep until it moves past the value they saw
+    uint64_t nEvents;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) override { Notify(); }
+    void SyncTransaction(const CTransactionRef &ptx, const CBlock *pblock, int txIdx) override { Notify(); }
+    //! one wake for a whole block
+    void SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock) override { Notify(); }
+public:
+    CMinterWakeup() : nEvents(0) {}
+    void Notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            nEvents++;
+        }
+        cond.notify_all();
+    }
+
+    uint64_t GetEvents()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        return nEvents;
+    }
+
+    /** Wait for an event newer than nEventsSeen, at most for timeout, and update nEventsSeen */
+    void Wait(uint64_t &nEventsSeen, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait_for(lock, timeout, [&]() { return nEvents != nEventsSeen || shutdown_threads.load(); });
+        nEventsSeen = nEvents;
+    }
+};
+
+static CMinterWakeup minterWakeup;
+
+//! upper bound on any minter sleep, for the conditions no event covers (the IBD check also depends on the clock)
+static const std::chrono::milliseconds MINTER_MAX_WAIT(10000);
+
+void WakeMinter() { minterWakeup.Notify(); }
+
 bool CheckStake(const CBlock *pblock, CWallet &wallet, boost::shared_ptr<CReserveScript> coinbaseScript)
 {
     //// debug print
@@ -48,12 +101,12 @@ bool CheckStake(const CBlock *pblock, CWallet &wallet, boost::shared_ptr<CReserv
 
     // Found a solution
     {
-        CBlockIndex *ptip = pnetMan->getChainActive()->chainActive.Tip();
-        if (ptip == nullptr)
+        CChainTipRef tip = pnetMan->getChainActive()->GetPublishedTip();
+        if (tip->pindex == nullptr)
         {
             return false;
         }
-        if (pblock->hashPrevBlock != ptip->GetBlockHash())
+        if (pblock->hashPrevBlock != tip->hash)
         {
             return error("BMiner : generated block is stale");
         }
@@ -99,40 +152,21 @@ std::unique_ptr<CBlockTemplate> CreateNewPoSBlock(CWallet *pwallet, const CScrip
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-    uint64_t nBlockMaxSize = MAX_BLOCK_SIZE - 1000;
-    uint64_t nBlockPrioritySize = DEFTAUL_BLOCK_PRIORITY_SIZE;
-    uint64_t nBlockMinSize = 0;
-
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
-
     // ppcoin: if coinstake available add coinstake tx
     static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // only initialized at startup
     CBlockIndex *pindexPrev = pnetMan->getChainActive()->chainActive.Tip();
 
-
-    // This vector will be sorted into a priority queue:
-    std::vector<TxCoinAgePriority> vecPriority;
-    TxCoinAgePriorityCompare pricomparer;
-    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-    double actualPriority = -1;
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
-    CAmount nFees = 0;
-
     pblock->nBits = GetNextTargetRequired(pindexPrev, true);
     int64_t nSearchTime = GetTime(); // search to current time
+    uint64_t nEventsSeen = minterWakeup.GetEvents();
+    bool fTipChanged = false;
     while (true)
     {
         CTransaction txCoinStake;
         nSearchTime = GetTime(); // update search time
-        if (nSearchTime > nLastCoinStakeSearchTime)
+        if (nSearchTime > nLastCoinStakeSearchTime || fTipChanged)
         {
+            fTipChanged = false;
             txCoinStake.nTime = nSearchTime;
             if (pwallet->CreateCoinStake(*pwallet, pblock->nBits, nSearchTime - nLastCoinStakeSearchTime, txCoinStake))
             {
@@ -149,17 +183,25 @@ std::unique_ptr<CBlockTemplate> CreateNewPoSBlock(CWallet *pwallet, const CScrip
             nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
             nLastCoinStakeSearchTime = nSearchTime;
         }
-        MilliSleep(50);
+        // A kernel can only change with the timestamp, so sleep until the next second unless an
+        // event comes in first. A new tip gives the search a new target and stake modifiers
+        int64_t nMillisToNextSecond = 1000 - GetTimeMillis() % 1000;
+        minterWakeup.Wait(nEventsSeen, std::chrono::milliseconds(nMillisToNextSecond));
         if (shutdown_threads.load())
             return nullptr;
+        CBlockIndex *pindexTip = pnetMan->getChainActive()->GetPublishedTip()->pindex;
+        if (pindexTip != pindexPrev)
+        {
+            pindexPrev = pindexTip;
+            pblock->nBits = GetNextTargetRequired(pindexPrev, true);
+            fTipChanged = true;
+        }
     }
 
     // Collect memory pool transactions into the block
     {
         LOCK(cs_main);
-        READLOCK(mempool.cs);
         CBlockIndex *_pindexPrev = pnetMan->getChainActive()->chainActive.Tip();
-        const int nHeight = _pindexPrev->nHeight + 1;
         pblock->nTime = GetAdjustedTime();
         const int64_t nMedianTimePast = _pindexPrev->GetMedianTimePast();
 
@@ -168,144 +210,7 @@ std::unique_ptr<CBlockTemplate> CreateNewPoSBlock(CWallet *pwallet, const CScrip
         int64_t nLockTimeCutoff =
             (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST) ? nMedianTimePast : pblock->GetBlockTime();
 
-        bool fPriorityBlock = nBlockPrioritySize > 0;
-        if (fPriorityBlock)
-        {
-            vecPriority.reserve(mempool.mapTx.size());
-            for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end();
-                 ++mi)
-            {
-                double dPriority = mi->GetPriority(nHeight);
-                CAmount dummy;
-                mempool._ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-            }
-            std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-        }
-
-        CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-        CTxMemPool::txiter iter;
-        while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
-        {
-            bool priorityTx = false;
-            if (fPriorityBlock && !vecPriority.empty())
-            { // add a tx from priority queue to fill the blockprioritysize
-                priorityTx = true;
-                iter = vecPriority.front().second;
-                actualPriority = vecPriority.front().first;
-                std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                vecPriority.pop_back();
-            }
-            else if (clearedTxs.empty())
-            { // add tx with next highest score
-                iter = mempool.mapTx.project<0>(mi);
-                mi++;
-            }
-            else
-            { // try to add a previously postponed child tx
-                iter = clearedTxs.top();
-                clearedTxs.pop();
-            }
-
-            if (inBlock.count(iter))
-                continue; // could have been added to the priorityBlock
-
-            const CTransaction &tx = iter->GetTx();
-
-            bool fOrphan = false;
-            for (auto parent : mempool.GetMemPoolParents(iter))
-            {
-                if (!inBlock.count(parent))
-                {
-                    fOrphan = true;
-                    break;
-                }
-            }
-            if (fOrphan)
-            {
-                if (priorityTx)
-                    waitPriMap.insert(std::make_pair(iter, actualPriority));
-                else
-                    waitSet.insert(iter);
-                continue;
-            }
-
-            unsigned int nTxSize = iter->GetTxSize();
-            if (fPriorityBlock && (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority)))
-            {
-                fPriorityBlock = false;
-                waitPriMap.clear();
-            }
-            if (!priorityTx &&
-                (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) && nBlockSize >= nBlockMinSize))
-            {
-                break;
-            }
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-            {
-                if (nBlockSize > nBlockMaxSize - 100 || lastFewTxs > 50)
-                {
-                    break;
-                }
-                // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                // to try to fill the remaining space.
-                if (nBlockSize > nBlockMaxSize - 1000)
-                {
-                    lastFewTxs++;
-                }
-                continue;
-            }
-
-            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
-                continue;
-
-            unsigned int nTxSigOps = iter->GetSigOpCount();
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-            {
-                if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2)
-                {
-                    break;
-                }
-                continue;
-            }
-
-            CAmount nTxFees = iter->GetFee();
-            // Added
-            pblock->vtx.push_back(MakeTransactionRef(tx));
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            inBlock.insert(iter);
-
-            // Add transactions that depend on this one to the priority queue
-            for (auto child : mempool.GetMemPoolChildren(iter))
-            {
-                if (fPriorityBlock)
-                {
-                    waitPriIter wpiter = waitPriMap.find(child);
-                    if (wpiter != waitPriMap.end())
-                    {
-                        vecPriority.push_back(TxCoinAgePriority(wpiter->second, child));
-                        std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                        waitPriMap.erase(wpiter);
-                    }
-                }
-                else
-                {
-                    if (waitSet.count(child))
-                    {
-                        clearedTxs.push(child);
-                        waitSet.erase(child);
-                    }
-                }
-            }
-        }
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
+        blockAssembler.AddTransactions(pblocktemplate.get(), _pindexPrev, nLockTimeCutoff);
 
         // Fill in header
         pblock->hashPrevBlock = _pindexPrev->GetBlockHash();
@@ -341,33 +246,42 @@ void EccMinter(CWallet *pwallet)
     if (coinbaseScript->reserveScript.empty())
         return;
 
+    RegisterValidationInterface(&minterWakeup);
+    boost::signals2::scoped_connection walletStatusConnection =
+        pwallet->NotifyStatusChanged.connect([](CCryptoKeyStore *) { minterWakeup.Notify(); });
+    boost::signals2::scoped_connection peerCountConnection =
+        GetNodeSignals().NumConnectionsChanged.connect([](size_t) { minterWakeup.Notify(); });
+
     unsigned int nExtraNonce = 0;
+    uint64_t nEventsSeen = minterWakeup.GetEvents();
     while (true)
     {
         if (shutdown_threads.load())
-            return;
+            break;
         if (!g_connman)
         {
-            MilliSleep(1000);
-            if (shutdown_threads.load())
-                return;
+            minterWakeup.Wait(nEventsSeen, MINTER_MAX_WAIT);
+            continue;
         }
-        while (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < DEFAULT_MIN_BLOCK_GEN_PEERS ||
-               pnetMan->getChainActive()->IsInitialBlockDownload() || pwallet->IsLocked())
+        if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < DEFAULT_MIN_BLOCK_GEN_PEERS ||
+            pnetMan->getChainActive()->GetPublishedTip()->fInitialBlockDownload || pwallet->IsLocked())
         {
-            MilliSleep(1000);
-            if (shutdown_threads.load())
-                return;
+            minterWakeup.Wait(nEventsSeen, MINTER_MAX_WAIT);
+            continue;
         }
-        CBlockIndex *pindexPrev = pnetMan->getChainActive()->chainActive.Tip();
         std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewPoSBlock(pwallet, coinbaseScript->reserveScript));
         if (!pblocktemplate.get())
         {
-            LogPrintf(
-                "Error in Miner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
-            return;
+            if (!shutdown_threads.load())
+                LogPrintf(
+                    "Error in Miner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
+            break;
         }
         CBlock *pblock = &pblocktemplate->block;
+        // the kernel search follows the tip, so take the parent from the template
+        CBlockIndex *pindexPrev = pnetMan->getChainActive()->LookupBlockIndex(pblock->hashPrevBlock);
+        if (!pindexPrev)
+            continue;
         IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
         if (!pblock->SignScryptBlock(*pwalletMain))
         {
@@ -377,7 +291,8 @@ void EccMinter(CWallet *pwallet)
         SetThreadPriority(THREAD_PRIORITY_NORMAL);
         CheckStake(pblock, *pwalletMain, coinbaseScript);
         SetThreadPriority(THREAD_PRIORITY_LOWEST);
-        MilliSleep(1000); // 1 second delay
-        continue;
+        // give the new block a moment, the tip update it causes ends the wait early
+        minterWakeup.Wait(nEventsSeen, std::chrono::milliseconds(1000));
     }
+    UnregisterValidationInterface(&minterWakeup);
 }
@@ -32,4 +32,7 @@ std::unique_ptr<CBlockTemplate> CreateNewPoSBlock(CWallet *pwallet, const CScrip
 
 void EccMinter(CWallet *pwallet);
 
+/** Wake the minter thread up so it notices shutdown_threads without waiting for its next event */
+void WakeMinter();
+
 #endif // ECCOIN_MINTER_H
@@ -0,0 +1,711 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockgeneration/stratum.h"
+
+#include "args.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "crypto/common.h"
+#include "init.h"
+#include "main.h"
+#include "net/netbase.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "random.h"
+#include "streams.h"
+#include "timedata.h"
+#include "txmempool.h"
+#include "util/util.h"
+#include "util/utilstrencodings.h"
+#include "validationinterface.h"
+#include "wallet/wallet.h"
+
+#include <deque>
+#include <map>
+#include <thread>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+arith_uint256 GetStratumShareTarget(double dDifficulty)
+{
+    arith_uint256 target;
+    target.SetCompact(0x1f00ffff);
+    // scaled up first for a fractional difficulty, the target has the room for it
+    const uint32_t nScale = 1 << 16;
+    target *= nScale;
+    target /= arith_uint256(std::max<uint64_t>(1, (uint64_t)(dDifficulty * nScale)));
+    return target;
+}
+
+bool CStratumJob::Init(const std::string &strIdIn, std::shared_ptr<const CBlockTemplate> blocktemplate, int nHeight)
+{
+    strId = strIdIn;
+    const CBlock &block = blocktemplate->block;
+    header = block.GetBlockHeader();
+
+    // the extranonces are the last push before the coinbase flags, the coinbase is serialized with two
+    // placeholders and the first byte that differs is where they start
+    CTransaction coinbase(*block.vtx[0]);
+    std::vector<unsigned char> vSerialized[2];
+    for (int i = 0; i < 2; i++)
+    {
+        const std::vector<unsigned char> vPlaceholder(STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE, i ? 0xff : 0);
+        coinbase.vin[0].scriptSig = (CScript() << nHeight << vPlaceholder) + COINBASE_FLAGS;
+        if (coinbase.vin[0].scriptSig.size() > 100)
+            return false;
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << coinbase;
+        vSerialized[i].assign(ss.begin(), ss.end());
+    }
+    const size_t nOffset =
+        std::mismatch(vSerialized[0].begin(), vSerialized[0].end(), vSerialized[1].begin()).first -
+        vSerialized[0].begin();
+    const size_t nEnd = nOffset + STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE;
+    if (nEnd > vSerialized[0].size())
+        return false;
+    vCoinbase1.assign(vSerialized[0].begin(), vSerialized[0].begin() + nOffset);
+    vCoinbase2.assign(vSerialized[0].begin() + nEnd, vSerialized[0].end());
+
+    vMerkleBranch = BlockMerkleBranch(block, 0);
+    pblocktemplate = blocktemplate;
+    return true;
+}
+
+UniValue CStratumJob::GetNotifyParams(bool fClean) const
+{
+    // the previous block hash goes out as eight words that miners byte swap each
+    std::string strPrevHash;
+    for (int i = 0; i < 8; i++)
+        strPrevHash += strprintf("%08x", ReadLE32(header.hashPrevBlock.begin() + 4 * i));
+    UniValue branch(UniValue::VARR);
+    for (const uint256 &hash : vMerkleBranch)
+        branch.push_back(HexStr(hash.begin(), hash.end()));
+
+    UniValue params(UniValue::VARR);
+    params.push_back(strId);
+    params.push_back(strPrevHash);
+    params.push_back(HexStr(vCoinbase1));
+    params.push_back(HexStr(vCoinbase2));
+    params.push_back(branch);
+    params.push_back(strprintf("%08x", (uint32_t)header.nVersion));
+    params.push_back(strprintf("%08x", header.nBits));
+    params.push_back(strprintf("%08x", header.nTime));
+    params.push_back(UniValue(fClean));
+    return params;
+}
+
+bool CStratumJob::GetShare(uint32_t nExtraNonce1,
+    const std::vector<unsigned char> &vExtraNonce2,
+    uint32_t nTime,
+    uint32_t nNonce,
+    CBlockHeader &shareHeader,
+    CTransactionRef &pcoinbase) const
+{
+    if (vExtraNonce2.size() != STRATUM_EXTRANONCE2_SIZE)
+        return false;
+    CDataStream ss((const char *)vCoinbase1.data(), (const char *)vCoinbase1.data() + vCoinbase1.size(), SER_NETWORK,
+        PROTOCOL_VERSION);
+    unsigned char vExtraNonce1[STRATUM_EXTRANONCE1_SIZE];
+    WriteBE32(vExtraNonce1, nExtraNonce1);
+    ss.write((const char *)vExtraNonce1, sizeof(vExtraNonce1));
+    ss.write((const char *)vExtraNonce2.data(), vExtraNonce2.size());
+    ss.write((const char *)vCoinbase2.data(), vCoinbase2.size());
+    try
+    {
+        std::shared_ptr<CTransaction> coinbase = std::make_shared<CTransaction>();
+        ss >> *coinbase;
+        pcoinbase = coinbase;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+
+    shareHeader = header;
+    shareHeader.hashMerkleRoot = ComputeMerkleRootFromBranch(pcoinbase->GetHash(), vMerkleBranch, 0);
+    shareHeader.nTime = nTime;
+    shareHeader.nNonce = nNonce;
+    return true;
+}
+
+CBlock CStratumJob::GetBlock(const CBlockHeader &shareHeader, const CTransactionRef &pcoinbase) const
+{
+    CBlock block(pblocktemplate->block);
+    block.vtx[0] = pcoinbase;
+    block.nTime = shareHeader.nTime;
+    block.nNonce = shareHeader.nNonce;
+    block.hashMerkleRoot = shareHeader.hashMerkleRoot;
+    return block;
+}
+
+/** The stratum error codes */
+enum StratumErrorCode
+{
+    STRATUM_ERROR_OTHER = 20,
+    STRATUM_ERROR_JOB_NOT_FOUND = 21,
+    STRATUM_ERROR_DUPLICATE = 22,
+    STRATUM_ERROR_LOW_DIFFICULTY = 23,
+    STRATUM_ERROR_UNAUTHORIZED = 24,
+    STRATUM_ERROR_NOT_SUBSCRIBED = 25,
+};
+
+struct CStratumError
+{
+    int nCode;
+    std::string strMessage;
+    CStratumError(int nCodeIn, const std::string &strMessageIn) : nCode(nCodeIn), strMessage(strMessageIn) {}
+};
+
+class CStratumServer;
+
+struct CStratumClient
+{
+    CStratumServer *server;
+    struct bufferevent *bev;
+    std::string strAddr;
+    std::string strWorker;
+    uint32_t nExtraNonce1 = 0;
+    bool fSubscribed = false;
+    bool fAuthorized = false;
+    uint64_t nAccepted = 0;
+    uint64_t nRejected = 0;
+};
+
+/** Serves the stratum clients on its own libevent loop. Everything but UpdatedBlockTip runs on the thread of the
+ *  loop, which only wakes the loop up, so the state needs no lock of its own.
+ */
+class CStratumServer : public CValidationInterface
+{
+public:
+    CStratumServer();
+    ~CStratumServer();
+
+    bool Start(const std::vector<CService> &vBind, double dDifficultyIn);
+    void Interrupt();
+    void Stop();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) override;
+
+private:
+    struct event_base *base;
+    std::vector<struct evconnlistener *> vListeners;
+    struct event *evNewWork;
+    struct event *evRefresh;
+    std::thread thread;
+
+    std::map<struct bufferevent *, std::unique_ptr<CStratumClient> > mapClients;
+    //! the jobs shares are taken for, the newest last
+    std::deque<std::shared_ptr<CStratumJob> > vJobs;
+    uint64_t nNextJobId;
+    uint32_t nNextExtraNonce1;
+    unsigned int nTransactionsUpdated;
+    int64_t nJobTime;
+    double dDifficulty;
+    arith_uint256 shareTarget;
+    boost::shared_ptr<CReserveScript> coinbaseScript;
+
+    static void AcceptCallback(struct evconnlistener *listener,
+        evutil_socket_t fd,
+        struct sockaddr *addr,
+        int socklen,
+        void *arg);
+    static void ReadCallback(struct bufferevent *bev, void *arg);
+    static void EventCallback(struct bufferevent *bev, short what, void *arg);
+    static void NewWorkCallback(evutil_socket_t fd, short what, void *arg);
+
+    void Disconnect(CStratumClient &client);
+    void Send(CStratumClient &client, const UniValue &msg);
+    void SendWork(CStratumClient &client, bool fClean);
+    void ProcessLine(CStratumClient &client, const std::string &strLine);
+    UniValue HandleRequest(CStratumClient &client, const std::string &strMethod, const UniValue &params);
+    UniValue HandleSubmit(CStratumClient &client, const UniValue &params);
+    /** Make a new job if the tip changed, or the mempool did and the current job is old enough, and push it */
+    void UpdateWork();
+    void SubmitBlock(const CStratumJob &job, const CBlockHeader &shareHeader, const CTransactionRef &pcoinbase);
+};
+
+CStratumServer::CStratumServer()
+    : base(nullptr), evNewWork(nullptr), evRefresh(nullptr), nNextJobId(1), nNextExtraNonce1(GetRand(1 << 30)),
+      nTransactionsUpdated(0), nJobTime(0), dDifficulty(DEFAULT_STRATUM_DIFFICULTY)
+{
+}
+
+CStratumServer::~CStratumServer() { Stop(); }
+
+bool CStratumServer::Start(const std::vector<CService> &vBind, double dDifficultyIn)
+{
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    base = event_base_new();
+    if (!base)
+        return error("stratum: Unable to create event_base");
+    dDifficulty = dDifficultyIn;
+    shareTarget = GetStratumShareTarget(dDifficulty);
+
+    for (const CService &addrBind : vBind)
+    {
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!addrBind.GetSockAddr((struct sockaddr *)&sockaddr, &len))
+            continue;
+        struct evconnlistener *listener = evconnlistener_new_bind(base, AcceptCallback, this,
+            LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC, -1, (struct sockaddr *)&sockaddr, len);
+        if (!listener)
+        {
+            LogPrintf("stratum: Binding to %s failed\n", addrBind.ToString());
+            continue;
+        }
+        LogPrintf("stratum: Listening on %s\n", addrBind.ToString());
+        vListeners.push_back(listener);
+    }
+    if (vListeners.empty())
+    {
+        Stop();
+        return error("stratum: Unable to bind to any address");
+    }
+
+    evNewWork = event_new(base, -1, 0, NewWorkCallback, this);
+    evRefresh = event_new(base, -1, EV_PERSIST, NewWorkCallback, this);
+    struct timeval tv = {1, 0};
+    event_add(evRefresh, &tv);
+    // the first job is made on the loop as well
+    event_active(evNewWork, 0, 0);
+
+    RegisterValidationInterface(this);
+    thread = std::thread([this] {
+        RenameThread("ecc-stratum");
+        event_base_dispatch(base);
+    });
+    return true;
+}
+
+void CStratumServer::Interrupt()
+{
+    if (base)
+        event_base_loopbreak(base);
+}
+
+void CStratumServer::Stop()
+{
+    if (!base)
+        return;
+    UnregisterValidationInterface(this);
+    if (thread.joinable())
+    {
+        event_base_loopbreak(base);
+        thread.join();
+    }
+    for (auto &item : mapClients)
+        bufferevent_free(item.first);
+    mapClients.clear();
+    for (struct evconnlistener *listener : vListeners)
+        evconnlistener_free(listener);
+    vListeners.clear();
+    if (evNewWork)
+        event_free(evNewWork);
+    if (evRefresh)
+        event_free(evRefresh);
+    evNewWork = evRefresh = nullptr;
+    event_base_free(base);
+    base = nullptr;
+    vJobs.clear();
+}
+
+void CStratumServer::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    // new work is made on the loop, which looks at the tip itself
+    event_active(evNewWork, 0, 0);
+}
+
+void CStratumServer::AcceptCallback(struct evconnlistener *listener,
+    evutil_socket_t fd,
+    struct sockaddr *addr,
+    int socklen,
+    void *arg)
+{
+    CStratumServer *self = (CStratumServer *)arg;
+    CService addrClient;
+    addrClient.SetSockAddr(addr);
+    if (self->mapClients.size() >= MAX_STRATUM_CLIENTS)
+    {
+        LogPrint(Logging::RPC, "stratum: Too many miners, refusing %s\n", addrClient.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+    struct bufferevent *bev = bufferevent_socket_new(self->base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev)
+    {
+        evutil_closesocket(fd);
+        return;
+    }
+    std::unique_ptr<CStratumClient> client(new CStratumClient());
+    client->server = self;
+    client->bev = bev;
+    client->strAddr = addrClient.ToString();
+    client->nExtraNonce1 = self->nNextExtraNonce1++;
+    bufferevent_setcb(bev, ReadCallback, nullptr, EventCallback, client.get());
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    LogPrint(Logging::RPC, "stratum: Miner connected from %s\n", client->strAddr);
+    self->mapClients[bev] = std::move(client);
+}
+
+void CStratumServer::ReadCallback(struct bufferevent *bev, void *arg)
+{
+    CStratumClient &client = *(CStratumClient *)arg;
+    CStratumServer *self = client.server;
+    struct evbuffer *input = bufferevent_get_input(bev);
+    size_t nRead = 0;
+    char *line;
+    while ((line = evbuffer_readln(input, &nRead, EVBUFFER_EOL_CRLF)) != nullptr)
+    {
+        std::string strLine(line, nRead);
+        free(line);
+        self->ProcessLine(client, strLine);
+        if (!self->mapClients.count(bev))
+            return;
+    }
+    if (evbuffer_get_length(input) > MAX_STRATUM_LINE)
+    {
+        LogPrint(Logging::RPC, "stratum: Request line too long from %s, disconnecting\n", client.strAddr);
+        self->Disconnect(client);
+    }
+}
+
+void CStratumServer::EventCallback(struct bufferevent *bev, short what, void *arg)
+{
+    CStratumClient &client = *(CStratumClient *)arg;
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+    {
+        LogPrint(Logging::RPC, "stratum: Miner %s disconnected, %u shares accepted and %u rejected\n",
+            client.strAddr, client.nAccepted, client.nRejected);
+        client.server->Disconnect(client);
+    }
+}
+
+void CStratumServer::NewWorkCallback(evutil_socket_t fd, short what, void *arg)
+{
+    CStratumServer *self = (CStratumServer *)arg;
+    try
+    {
+        self->UpdateWork();
+    }
+    catch (const std::exception &e)
+    {
+        LogPrintf("stratum: Making new work failed: %s\n", e.what());
+    }
+}
+
+void CStratumServer::Disconnect(CStratumClient &client)
+{
+    struct bufferevent *bev = client.bev;
+    bufferevent_free(bev);
+    mapClients.erase(bev);
+}
+
+void CStratumServer::Send(CStratumClient &client, const UniValue &msg)
+{
+    const std::string strMsg = msg.write() + "\n";
+    bufferevent_write(client.bev, strMsg.data(), strMsg.size());
+}
+
+void CStratumServer::SendWork(CStratumClient &client, bool fClean)
+{
+    if (vJobs.empty())
+        return;
+    UniValue notify(UniValue::VOBJ);
+    notify.push_back(Pair("id", NullUniValue));
+    notify.push_back(Pair("method", "mining.notify"));
+    notify.push_back(Pair("params", vJobs.back()->GetNotifyParams(fClean)));
+    Send(client, notify);
+}
+
+void CStratumServer::ProcessLine(CStratumClient &client, const std::string &strLine)
+{
+    if (strLine.empty())
+        return;
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject())
+    {
+        LogPrint(Logging::RPC, "stratum: Malformed request from %s, disconnecting\n", client.strAddr);
+        Disconnect(client);
+        return;
+    }
+    const UniValue &id = find_value(request, "id");
+    const UniValue &method = find_value(request, "method");
+    const UniValue &params = find_value(request, "params");
+
+    UniValue reply(UniValue::VOBJ);
+    reply.push_back(Pair("id", id));
+    try
+    {
+        if (!method.isStr())
+            throw CStratumError(STRATUM_ERROR_OTHER, "Method not found");
+        const UniValue result =
+            HandleRequest(client, method.get_str(), params.isArray() ? params : UniValue(UniValue::VARR));
+        reply.push_back(Pair("result", result));
+        reply.push_back(Pair("error", NullUniValue));
+    }
+    catch (const CStratumError &e)
+    {
+        UniValue error(UniValue::VARR);
+        error.push_back(e.nCode);
+        error.push_back(e.strMessage);
+        error.push_back(NullUniValue);
+        reply.push_back(Pair("result", NullUniValue));
+        reply.push_back(Pair("error", error));
+    }
+    catch (const std::exception &e)
+    {
+        LogPrint(Logging::RPC, "stratum: Bad request from %s: %s\n", client.strAddr, e.what());
+        UniValue error(UniValue::VARR);
+        error.push_back(STRATUM_ERROR_OTHER);
+        error.push_back(e.what());
+        error.push_back(NullUniValue);
+        reply.push_back(Pair("result", NullUniValue));
+        reply.push_back(Pair("error", error));
+    }
+    Send(client, reply);
+
+    // the work follows the answer to the subscription
+    if (method.isStr() && method.get_str() == "mining.subscribe" && client.fSubscribed)
+    {
+        UniValue difficulty(UniValue::VOBJ);
+        difficulty.push_back(Pair("id", NullUniValue));
+        difficulty.push_back(Pair("method", "mining.set_difficulty"));
+        UniValue diffParams(UniValue::VARR);
+        diffParams.push_back(dDifficulty);
+        difficulty.push_back(Pair("params", diffParams));
+        Send(client, difficulty);
+        SendWork(client, true);
+    }
+}
+
+UniValue CStratumServer::HandleRequest(CStratumClient &client, const std::string &strMethod, const UniValue &params)
+{
+    if (strMethod == "mining.subscribe")
+    {
+        const std::string strSubscription = strprintf("%08x", client.nExtraNonce1);
+        UniValue subscriptions(UniValue::VARR);
+        for (const char *pszMethod : {"mining.set_difficulty", "mining.notify"})
+        {
+            UniValue subscription(UniValue::VARR);
+            subscription.push_back(pszMethod);
+            subscription.push_back(strSubscription);
+            subscriptions.push_back(subscription);
+        }
+        client.fSubscribed = true;
+        UniValue result(UniValue::VARR);
+        result.push_back(subscriptions);
+        result.push_back(strprintf("%08x", client.nExtraNonce1));
+        result.push_back((int)STRATUM_EXTRANONCE2_SIZE);
+        return result;
+    }
+    if (strMethod == "mining.authorize")
+    {
+        // anyone who can connect may mine, the blocks pay to the wallet of the node
+        client.strWorker = params.size() > 0 && params[0].isStr() ? params[0].get_str() : "";
+        client.fAuthorized = true;
+        LogPrint(Logging::RPC, "stratum: Miner %s authorized as %s\n", client.strAddr, SanitizeString(client.strWorker));
+        return true;
+    }
+    if (strMethod == "mining.submit")
+    {
+        try
+        {
+            UniValue result = HandleSubmit(client, params);
+            client.nAccepted++;
+            return result;
+        }
+        catch (...)
+        {
+            client.nRejected++;
+            throw;
+        }
+    }
+    if (strMethod == "mining.extranonce.subscribe")
+        return false;
+    throw CStratumError(STRATUM_ERROR_OTHER, "Method not found");
+}
+
+UniValue CStratumServer::HandleSubmit(CStratumClient &client, const UniValue &params)
+{
+    if (!client.fSubscribed)
+        throw CStratumError(STRATUM_ERROR_NOT_SUBSCRIBED, "Not subscribed");
+    if (!client.fAuthorized)
+        throw CStratumError(STRATUM_ERROR_UNAUTHORIZED, "Unauthorized worker");
+    if (params.size() < 5)
+        throw CStratumError(STRATUM_ERROR_OTHER, "Missing parameters");
+    const std::string &strJobId = params[1].get_str();
+    const std::string &strExtraNonce2 = params[2].get_str();
+    const std::string &strTime = params[3].get_str();
+    const std::string &strNonce = params[4].get_str();
+    if (strExtraNonce2.size() != 2 * STRATUM_EXTRANONCE2_SIZE || !IsHex(strExtraNonce2) || strTime.size() != 8 ||
+        !IsHex(strTime) || strNonce.size() != 8 || !IsHex(strNonce))
+        throw CStratumError(STRATUM_ERROR_OTHER, "Malformed share");
+
+    std::shared_ptr<CStratumJob> job;
+    for (const std::shared_ptr<CStratumJob> &candidate : vJobs)
+    {
+        if (candidate->strId == strJobId)
+            job = candidate;
+    }
+    if (!job)
+        throw CStratumError(STRATUM_ERROR_JOB_NOT_FOUND, "Job not found");
+
+    const uint32_t nTime = ReadBE32(ParseHex(strTime).data());
+    const uint32_t nNonce = ReadBE32(ParseHex(strNonce).data());
+    CBlockHeader shareHeader;
+    CTransactionRef pcoinbase;
+    if (!job->GetShare(client.nExtraNonce1, ParseHex(strExtraNonce2), nTime, nNonce, shareHeader, pcoinbase))
+        throw CStratumError(STRATUM_ERROR_OTHER, "Malformed share");
+    // the same rule the built in miner keeps, a block may not be much newer than its coinbase
+    if (nTime < job->header.nTime || (int64_t)nTime >= (int64_t)pcoinbase->nTime + nMaxClockDrift)
+        throw CStratumError(STRATUM_ERROR_OTHER, "ntime out of range");
+
+    const uint256 hash = shareHeader.GetHash();
+    const arith_uint256 hashArith = UintToArith256(hash);
+    if (hashArith > shareTarget)
+        throw CStratumError(STRATUM_ERROR_LOW_DIFFICULTY, "Low difficulty share");
+    if (!job->setSubmitted.insert(hash).second)
+        throw CStratumError(STRATUM_ERROR_DUPLICATE, "Duplicate share");
+
+    arith_uint256 blockTarget;
+    blockTarget.SetCompact(shareHeader.nBits);
+    if (hashArith <= blockTarget)
+        SubmitBlock(*job, shareHeader, pcoinbase);
+    return true;
+}
+
+void CStratumServer::SubmitBlock(const CStratumJob &job,
+    const CBlockHeader &shareHeader,
+    const CTransactionRef &pcoinbase)
+{
+    CBlock block = job.GetBlock(shareHeader, pcoinbase);
+    LogPrintf("stratum: Block %s found by a miner\n", block.GetHash().ToString());
+    if (!block.SignScryptBlock(*pwalletMain))
+    {
+        LogPrintf("stratum: Signing block %s failed\n", block.GetHash().ToString());
+        return;
+    }
+    CValidationState state;
+    if (!ProcessNewBlock(state, pnetMan->getActivePaymentNetwork(), nullptr, &block, true, nullptr))
+    {
+        LogPrintf("stratum: Block %s not accepted: %s\n", block.GetHash().ToString(), FormatStateMessage(state));
+        return;
+    }
+    // the next blocks pay to a new key
+    if (coinbaseScript)
+        coinbaseScript->KeepScript();
+    coinbaseScript.reset();
+}
+
+void CStratumServer::UpdateWork()
+{
+    std::shared_ptr<CStratumJob> job = std::make_shared<CStratumJob>();
+    bool fClean = false;
+    int nHeight = 0;
+    {
+        LOCK(cs_main);
+        CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+        const unsigned int nUpdated = mempool.GetTransactionsUpdated();
+        fClean = vJobs.empty() || vJobs.back()->header.hashPrevBlock != pindexTip->GetBlockHash();
+        if (!fClean && (nUpdated == nTransactionsUpdated || GetTime() - nJobTime < STRATUM_REFRESH_INTERVAL))
+            return;
+        if (pnetMan->getChainActive()->IsInitialBlockDownload())
+            return;
+        if (!coinbaseScript)
+        {
+            GetMainSignals().ScriptForMining(coinbaseScript);
+            if (!coinbaseScript || coinbaseScript->reserveScript.empty())
+            {
+                LogPrintf("stratum: No coinbase script available, the keypool may have run out\n");
+                coinbaseScript.reset();
+                return;
+            }
+        }
+        std::shared_ptr<const CBlockTemplate> pblocktemplate =
+            CreateNewBlock(pwalletMain, coinbaseScript->reserveScript, false);
+        if (!pblocktemplate)
+            return;
+        nHeight = pindexTip->nHeight + 1;
+        if (!job->Init(strprintf("%x", nNextJobId++), pblocktemplate, nHeight))
+            return;
+        nTransactionsUpdated = nUpdated;
+    }
+    nJobTime = GetTime();
+
+    if (fClean)
+        vJobs.clear();
+    else if (vJobs.size() >= MAX_STRATUM_JOBS)
+        vJobs.pop_front();
+    vJobs.push_back(job);
+    LogPrint(Logging::RPC, "stratum: New job %s for height %d with %u transactions\n", job->strId, nHeight,
+        job->pblocktemplate->block.vtx.size());
+    for (auto &item : mapClients)
+    {
+        if (item.second->fSubscribed)
+            SendWork(*item.second, fClean);
+    }
+}
+
+static std::unique_ptr<CStratumServer> g_stratum;
+
+bool StartStratumServer()
+{
+    if (!gArgs.GetBoolArg("-stratum", DEFAULT_STRATUM))
+        return true;
+    if (!pwalletMain)
+        return error("stratum: The stratum server needs the wallet for the coinbase keys");
+
+    double dDifficulty = DEFAULT_STRATUM_DIFFICULTY;
+    if (gArgs.IsArgSet("-stratumdifficulty") &&
+        (!ParseDouble(gArgs.GetArg("-stratumdifficulty", ""), &dDifficulty) || dDifficulty <= 0))
+        return error("stratum: Invalid -stratumdifficulty '%s'", gArgs.GetArg("-stratumdifficulty", ""));
+
+    const int nPort = gArgs.GetArg("-stratumport", DEFAULT_STRATUM_PORT);
+    std::vector<CService> vBind;
+    if (gArgs.IsArgSet("-stratumbind"))
+    {
+        for (const std::string &strBind : gArgs.GetArgs("-stratumbind"))
+        {
+            CService addrBind;
+            if (!Lookup(strBind.c_str(), addrBind, nPort, false))
+                return error("stratum: Cannot resolve -stratumbind address '%s'", strBind);
+            vBind.push_back(addrBind);
+        }
+    }
+    else
+    {
+        // only miners on this machine unless told otherwise
+        vBind.push_back(LookupNumeric("127.0.0.1", nPort));
+        vBind.push_back(LookupNumeric("::1", nPort));
+    }
+
+    g_stratum.reset(new CStratumServer());
+    if (!g_stratum->Start(vBind, dDifficulty))
+    {
+        g_stratum.reset();
+        return false;
+    }
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (g_stratum)
+        g_stratum->Interrupt();
+}
+
+void StopStratumServer() { g_stratum.reset(); }
@@ -0,0 +1,85 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_STRATUM_H
+#define ECCOIN_STRATUM_H
+
+#include "arith_uint256.h"
+#include "blockgeneration.h"
+#include "chain/block.h"
+#include "threadgroup.h"
+#include "uint256.h"
+
+#include <univalue.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+/** -stratum default */
+static const bool DEFAULT_STRATUM = false;
+static const uint16_t DEFAULT_STRATUM_PORT = 3333;
+/** Share difficulty, 1 is a target of 0x0000ffff followed by zeros as scrypt miners count it */
+static const double DEFAULT_STRATUM_DIFFICULTY = 1.0;
+static const int MAX_STRATUM_CLIENTS = 64;
+/** A request line longer than this gets the miner disconnected */
+static const size_t MAX_STRATUM_LINE = 16 * 1024;
+/** Bytes of the extranonce the server sets per miner, and the one the miner rolls itself */
+static const size_t STRATUM_EXTRANONCE1_SIZE = 4;
+static const size_t STRATUM_EXTRANONCE2_SIZE = 4;
+/** Seconds between new jobs for the same tip when the mempool changed */
+static const int64_t STRATUM_REFRESH_INTERVAL = 10;
+/** Jobs of the current tip a share may still be submitted for */
+static const size_t MAX_STRATUM_JOBS = 16;
+
+/** A piece of work as handed out in mining.notify. The coinbase of the template is split around the extranonces
+ *  and the merkle branch of its position is kept, so a share costs one transaction deserialization, the merkle
+ *  branch and one scrypt hash however large the block.
+ */
+class CStratumJob
+{
+public:
+    std::string strId;
+    //! the template the job was made from, its coinbase still has the placeholder extranonce
+    std::shared_ptr<const CBlockTemplate> pblocktemplate;
+    //! the serialized coinbase before and after the extranonces
+    std::vector<unsigned char> vCoinbase1;
+    std::vector<unsigned char> vCoinbase2;
+    std::vector<uint256> vMerkleBranch;
+    //! the header with the merkle root and nonce left to the miner
+    CBlockHeader header;
+    //! the hashes of the shares accepted for the job
+    std::set<uint256> setSubmitted;
+
+    /** Make a job from blocktemplate for a block at nHeight, false if its coinbase does not leave room for the
+     *  extranonces
+     */
+    bool Init(const std::string &strIdIn, std::shared_ptr<const CBlockTemplate> blocktemplate, int nHeight);
+    //! the params of mining.notify
+    UniValue GetNotifyParams(bool fClean) const;
+    /** The header and coinbase a share with these values is for, false if vExtraNonce2 is not
+     *  STRATUM_EXTRANONCE2_SIZE bytes or the coinbase does not deserialize
+     */
+    bool GetShare(uint32_t nExtraNonce1,
+        const std::vector<unsigned char> &vExtraNonce2,
+        uint32_t nTime,
+        uint32_t nNonce,
+        CBlockHeader &shareHeader,
+        CTransactionRef &pcoinbase) const;
+    //! the complete block of a share
+    CBlock GetBlock(const CBlockHeader &shareHeader, const CTransactionRef &pcoinbase) const;
+};
+
+/** The hash a share of dDifficulty must not exceed */
+arith_uint256 GetStratumShareTarget(double dDifficulty);
+
+/** Start the stratum server if -stratum is set, which hands out work for blocks paying to the wallet, pushes new
+ *  work when the tip or the mempool changes and submits the blocks miners find. False if it could not bind.
+ */
+bool StartStratumServer();
+void InterruptStratumServer();
+void StopStratumServer();
+
+#endif // ECCOIN_STRATUM_H
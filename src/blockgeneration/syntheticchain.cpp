@@ -0,0 +1,171 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "syntheticchain.h"
+
+#include "chain/chainman.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "crypto/hash.h"
+#include "keystore.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "pow.h"
+#include "processblock.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "timedata.h"
+
+#include <deque>
+
+namespace
+{
+/** An output of the chain the key can spend */
+struct CSyntheticCoin
+{
+    COutPoint outpoint;
+    CAmount nValue;
+    CScript scriptPubKey;
+};
+
+/** Spends the coins into nOutputs outputs paying to scriptPubKey, signed with the key in keystore */
+CTransaction SpendCoins(const CBasicKeyStore &keystore,
+    const std::vector<CSyntheticCoin> &vCoins,
+    int nOutputs,
+    const CScript &scriptPubKey,
+    unsigned int nTime)
+{
+    CTransaction tx;
+    tx.nTime = nTime;
+    CAmount nValueIn = 0;
+    std::vector<CScript> vFromPubKeys;
+    for (const CSyntheticCoin &coin : vCoins)
+    {
+        tx.vin.push_back(CTxIn(coin.outpoint));
+        vFromPubKeys.push_back(coin.scriptPubKey);
+        nValueIn += coin.nValue;
+    }
+    // no fee, the blocks do not need one and the coinbases then stay at the plain subsidy
+    nOutputs = std::max<CAmount>(std::min<CAmount>(nOutputs, nValueIn), 1);
+    for (int i = 0; i < nOutputs; i++)
+        tx.vout.push_back(CTxOut(nValueIn / nOutputs + (i == 0 ? nValueIn % nOutputs : 0), scriptPubKey));
+    SignSignatures(keystore, vFromPubKeys, tx);
+    return tx;
+}
+
+void AddOutputs(const CTransaction &tx, size_t nFirst, std::deque<CSyntheticCoin> &coins)
+{
+    const uint256 hash = tx.GetHash();
+    for (size_t i = nFirst; i < tx.vout.size(); i++)
+        coins.push_back({COutPoint(hash, i), tx.vout[i].nValue, tx.vout[i].scriptPubKey});
+}
+}
+
+CKey SyntheticChainKey(uint64_t nSeed)
+{
+    CKey key;
+    for (uint32_t nTry = 0; !key.IsValid(); nTry++)
+    {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << std::string("eccoin synthetic chain") << nSeed << nTry;
+        const uint256 hash = ss.GetHash();
+        key.Set(hash.begin(), hash.end(), true);
+    }
+    return key;
+}
+
+bool GenerateSyntheticChain(const CSyntheticChainParams &params, CSyntheticChainResult &result, std::string &strError)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+    const Consensus::Params &consensus = chainparams.GetConsensus();
+    CChainManager *pchainman = pnetMan->getChainActive();
+
+    CBasicKeyStore keystore;
+    result.key = SyntheticChainKey(params.nSeed);
+    keystore.AddKeyPubKey(result.key, result.key.GetPubKey());
+    // block signatures need a coinbase that pays to the public key itself
+    const CScript scriptCoinbase = CScript() << ToByteVector(result.key.GetPubKey()) << OP_CHECKSIG;
+    const CScript scriptPayTo = GetScriptForDestination(result.key.GetPubKey().GetID());
+
+    std::deque<CSyntheticCoin> spendable;
+    std::deque<std::pair<int, CSyntheticCoin> > immature;
+    for (int nBlock = 0; nBlock < params.nBlocks; nBlock++)
+    {
+        const CBlockIndex *pindexPrev;
+        {
+            LOCK(cs_main);
+            pindexPrev = pchainman->chainActive.Tip();
+        }
+        const int nHeight = pindexPrev->nHeight + 1;
+        while (!immature.empty() && nHeight - immature.front().first >= COINBASE_MATURITY)
+        {
+            spendable.push_back(immature.front().second);
+            immature.pop_front();
+        }
+
+        // a block every target spacing after the tip, unless that is in the future
+        CBlock block;
+        block.nVersion = 4;
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nTime = pindexPrev->GetBlockTime() + consensus.nTargetSpacing;
+        if (block.GetBlockTime() > GetAdjustedTime())
+            block.nTime = pindexPrev->GetBlockTime() + 1;
+        block.nBits = GetNextTargetRequired(pindexPrev, false);
+
+        CTransaction coinbase;
+        coinbase.nTime = block.nTime;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+        coinbase.vout.push_back(
+            CTxOut(GetProofOfWorkReward(0, nHeight, pindexPrev->GetBlockHash()), scriptCoinbase));
+        block.vtx.push_back(MakeTransactionRef(coinbase));
+
+        std::deque<CSyntheticCoin> created;
+        size_t nBlockSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+        for (int nTx = 0; nTx < params.nTxsPerBlock && spendable.size() >= (size_t)params.nInputsPerTx;)
+        {
+            std::vector<CSyntheticCoin> vCoins(spendable.begin(), spendable.begin() + params.nInputsPerTx);
+            spendable.erase(spendable.begin(), spendable.begin() + params.nInputsPerTx);
+            for (int nLink = 0; nLink < params.nChainLength && nTx < params.nTxsPerBlock; nLink++, nTx++)
+            {
+                CTransaction tx = SpendCoins(keystore, vCoins, params.nOutputsPerTx, scriptPayTo, block.nTime);
+                nBlockSize += ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+                block.vtx.push_back(MakeTransactionRef(tx));
+                result.nTransactions++;
+                result.nInputs += tx.vin.size();
+                result.nOutputs += tx.vout.size();
+                // the next link spends the first output, the others wait for the next block
+                AddOutputs(tx, 1, created);
+                vCoins = {{COutPoint(tx.GetHash(), 0), tx.vout[0].nValue, scriptPayTo}};
+            }
+            created.push_back(vCoins[0]);
+            if (nBlockSize > MAX_BLOCK_SIZE * 9 / 10)
+                break;
+        }
+        spendable.insert(spendable.end(), created.begin(), created.end());
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+
+        while (!CheckProofOfWork(block.GetHash(), block.nBits, consensus))
+            block.nNonce++;
+        if (!block.SignScryptBlock(keystore))
+        {
+            strError = strprintf("could not sign block %d", nHeight);
+            return false;
+        }
+        CValidationState state;
+        if (!ProcessNewBlock(state, chainparams, nullptr, &block, true, nullptr) || !state.IsValid())
+        {
+            strError = strprintf("block %d not accepted: %s", nHeight, FormatStateMessage(state));
+            return false;
+        }
+        immature.push_back(std::make_pair(nHeight,
+            CSyntheticCoin{COutPoint(block.vtx[0]->GetHash(), 0), block.vtx[0]->vout[0].nValue, scriptCoinbase}));
+        result.nHeight = nHeight;
+        result.hashTip = block.GetHash();
+    }
+    result.nSpendable = spendable.size() + immature.size();
+    return true;
+}
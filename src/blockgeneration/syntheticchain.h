@@ -0,0 +1,52 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_SYNTHETICCHAIN_H
+#define ECCOIN_SYNTHETICCHAIN_H
+
+#include "amount.h"
+#include "key.h"
+#include "uint256.h"
+
+#include <string>
+
+/** The shape of a synthetic chain */
+struct CSyntheticChainParams
+{
+    int nBlocks = 0;
+    //! transactions per block, fewer while there are not enough mature outputs to spend
+    int nTxsPerBlock = 100;
+    int nInputsPerTx = 2;
+    int nOutputsPerTx = 2;
+    //! every transaction starts a chain of this many in its block, each spending an output of the one before
+    int nChainLength = 1;
+    //! the key every output pays to is derived from it
+    uint64_t nSeed = 0;
+};
+
+/** What a synthetic chain came to */
+struct CSyntheticChainResult
+{
+    int nHeight = 0;
+    uint256 hashTip;
+    uint64_t nTransactions = 0;
+    uint64_t nInputs = 0;
+    uint64_t nOutputs = 0;
+    //! outputs of the key the chain can still spend, the next call starts over from the coinbases
+    uint64_t nSpendable = 0;
+    CKey key;
+};
+
+/** The key of the chains of nSeed */
+CKey SyntheticChainKey(uint64_t nSeed);
+
+/**
+ * Regtest only. Mines params.nBlocks proof-of-work blocks on the tip without the wallet or the mempool, and hands
+ * them to ProcessNewBlock as they are, so the block files, the block index and the chainstate all come from the
+ * ordinary code. Coinbases pay to the key of the seed, the transactions spend what the chain paid to it, so the same
+ * seed and shape on the same tip give the same blocks. Returns false with strError set if a block was not accepted.
+ */
+bool GenerateSyntheticChain(const CSyntheticChainParams &params, CSyntheticChainResult &result, std::string &strError);
+
+#endif // ECCOIN_SYNTHETICCHAIN_H
@@ -0,0 +1,271 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockimport.h"
+
+#include "blockcompress.h"
+#include "chain/block.h"
+#include "clientversion.h"
+#include "coinsprefetch.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "streams.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <algorithm>
+#include <string.h>
+
+CBlockImporter::CBlockImporter(FILE *fileIn,
+    const CMessageHeader::MessageMagic &messageStartIn,
+    int nThreads,
+    size_t nMaxQueuedBytesIn)
+    : messageStart(messageStartIn), nMaxQueuedBytes(nMaxQueuedBytesIn),
+      blkdat(new CBufferedFile(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION)),
+      nRawBytes(0), nDecodedBytes(0), nNextSeq(0), nGeneration(0), fRewind(false), nRewindPos(0),
+      fReaderDone(false), nReaderDoneGeneration(0), nEndSeq(0), fStop(false)
+{
+    if (nThreads <= 0)
+        nThreads = GetNumCores() - 1;
+    nThreads = std::max(1, std::min(nThreads, MAX_BLOCKIMPORT_THREADS));
+    threadReader = std::thread(&CBlockImporter::ThreadReader, this);
+    for (int i = 0; i < nThreads; i++)
+        vThreadsDecode.emplace_back(&CBlockImporter::ThreadDecode, this);
+}
+
+CBlockImporter::~CBlockImporter() { Stop(); }
+
+void CBlockImporter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    condProduce.notify_all();
+    condConsume.notify_all();
+    if (threadReader.joinable())
+        threadReader.join();
+    for (std::thread &thread : vThreadsDecode)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+}
+
+void CBlockImporter::ThreadReader()
+{
+    RenameThread("bitcoin-importread");
+    uint64_t nRewind = blkdat->GetPos();
+    uint64_t nSeq = 0;
+    uint64_t nGen = 0;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (fStop)
+                break;
+            if (fRewind)
+            {
+                fRewind = false;
+                nGen = nGeneration;
+                nSeq = nNextSeq;
+                nRewind = nRewindPos;
+                if (!blkdat->Seek(nRewind))
+                    nRewind = (uint64_t)-1;
+            }
+        }
+
+        bool fEnd = nRewind == (uint64_t)-1 || blkdat->eof();
+        Record record;
+        if (!fEnd)
+        {
+            blkdat->SetPos(nRewind);
+            nRewind++; // start one byte further next time, in case of failure
+            blkdat->SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            bool fCompressed = false;
+            try
+            {
+                // locate a header
+                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                blkdat->FindByte(messageStart[0]);
+                nRewind = blkdat->GetPos() + 1;
+                *blkdat >> FLATDATA(buf);
+                if (memcmp(buf, std::begin(messageStart), CMessageHeader::MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                *blkdat >> nSize;
+                fCompressed = nSize & BLOCK_COMPRESSED_FLAG;
+                nSize &= ~BLOCK_COMPRESSED_FLAG;
+                if (nSize < (fCompressed ? sizeof(uint32_t) : 80) || nSize > MAX_BLOCK_SIZE)
+                    continue;
+            }
+            catch (const std::exception &)
+            {
+                // no valid block header found; don't complain
+                fEnd = true;
+            }
+            if (!fEnd)
+            {
+                try
+                {
+                    // read block
+                    record.nPos = blkdat->GetPos();
+                    record.nRewind = nRewind;
+                    record.fCompressed = fCompressed;
+                    blkdat->SetLimit(record.nPos + nSize);
+                    record.data.resize(nSize);
+                    blkdat->read(record.data.data(), nSize);
+                    nRewind = blkdat->GetPos();
+                }
+                catch (const std::exception &e)
+                {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                    continue;
+                }
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(cs);
+        if (fEnd)
+        {
+            fReaderDone = true;
+            nReaderDoneGeneration = nGen;
+            nEndSeq = nSeq;
+            condConsume.notify_all();
+            // a record that did not deserialize may still have the file scanned again
+            condProduce.wait(lock, [&]() { return fStop || fRewind; });
+            continue;
+        }
+        condProduce.wait(lock, [&]() {
+            return fStop || fRewind || nRawBytes == 0 || nRawBytes + record.data.size() <= nMaxQueuedBytes;
+        });
+        if (fStop || fRewind)
+            continue;
+        record.nSeq = nSeq++;
+        record.nGeneration = nGen;
+        nRawBytes += record.data.size();
+        queueRaw.push_back(std::move(record));
+        condProduce.notify_all();
+    }
+}
+
+void CBlockImporter::ThreadDecode()
+{
+    RenameThread("bitcoin-importdec");
+    while (true)
+    {
+        Record record;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condProduce.wait(lock, [&]() { return fStop || !queueRaw.empty(); });
+            if (fStop)
+                break;
+            record = std::move(queueRaw.front());
+            queueRaw.pop_front();
+            nRawBytes -= record.data.size();
+        }
+        // the reader may go on
+        condProduce.notify_all();
+
+        Decoded decoded;
+        decoded.nRewind = record.nRewind;
+        decoded.nBytes = record.data.size();
+        decoded.block.nPos = record.nPos;
+        try
+        {
+            const uint8_t *pbegin = (const uint8_t *)record.data.data();
+            const uint8_t *pend = pbegin + record.data.size();
+            std::string strRaw;
+            if (record.fCompressed)
+            {
+                if (!UncompressBlockData(pbegin, record.data.size(), strRaw))
+                    throw std::runtime_error("can not uncompress the block");
+                pbegin = (const uint8_t *)strRaw.data();
+                pend = pbegin + strRaw.size();
+            }
+            CMemoryReader stream(SER_DISK, CLIENT_VERSION, pbegin, pend);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            stream >> *pblock;
+            decoded.block.hash = pblock->GetHash();
+            decoded.block.pblock = pblock;
+            // the block waits for the ones before it, meanwhile its coins are read and the checks that do not
+            // depend on the chain are made here, ProcessNewBlock then finds it checked
+            if (g_coinsprefetcher)
+                g_coinsprefetcher->Add(*pblock);
+            CValidationState state;
+            CheckBlock(*pblock, state);
+        }
+        catch (const std::exception &e)
+        {
+            decoded.strError = e.what();
+        }
+
+        std::unique_lock<std::mutex> lock(cs);
+        // the record Next() waits for always gets in, so this can not deadlock
+        condProduce.wait(lock, [&]() {
+            return fStop || record.nGeneration != nGeneration || record.nSeq == nNextSeq ||
+                   nDecodedBytes + decoded.nBytes <= nMaxQueuedBytes;
+        });
+        if (fStop)
+            break;
+        if (record.nGeneration != nGeneration)
+            continue;
+        nDecodedBytes += decoded.nBytes;
+        mapDecoded.emplace(record.nSeq, std::move(decoded));
+        condConsume.notify_all();
+    }
+}
+
+bool CBlockImporter::Next(CImportedBlock &block)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    while (true)
+    {
+        condConsume.wait(lock, [&]() {
+            return fStop || mapDecoded.count(nNextSeq) ||
+                   (fReaderDone && nReaderDoneGeneration == nGeneration && nEndSeq == nNextSeq);
+        });
+        std::map<uint64_t, Decoded>::iterator it = mapDecoded.find(nNextSeq);
+        if (fStop || it == mapDecoded.end())
+            return false;
+        Decoded decoded = std::move(it->second);
+        mapDecoded.erase(it);
+        nDecodedBytes -= decoded.nBytes;
+        nNextSeq++;
+        condProduce.notify_all();
+        if (decoded.block.pblock)
+        {
+            block = std::move(decoded.block);
+            return true;
+        }
+
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, decoded.strError);
+        // scan again from just past the message start of the record, what was read after it is dropped
+        nGeneration++;
+        fRewind = true;
+        nRewindPos = decoded.nRewind;
+        fReaderDone = false;
+        queueRaw.clear();
+        nRawBytes = 0;
+        mapDecoded.clear();
+        nDecodedBytes = 0;
+        condProduce.notify_all();
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include "net/protocol.h"
+#include "uint256.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBufferedFile;
+
+/** Raw and deserialized blocks that may be waiting between the stages of an import, in bytes each */
+static const size_t DEFAULT_BLOCKIMPORT_QUEUE_BYTES = 32 * 1024 * 1024;
+/** Most threads deserializing blocks for one import */
+static const int MAX_BLOCKIMPORT_THREADS = 8;
+
+/** A block found in a block file */
+struct CImportedBlock
+{
+    std::shared_ptr<CBlock> pblock;
+    uint256 hash;
+    //! where the block starts in the file, past its message start and size
+    uint64_t nPos;
+
+    CImportedBlock() : nPos(0) {}
+};
+
+/**
+ * Reads the blocks of a blk file or bootstrap.dat for LoadExternalBlockFile. One thread reads the file
+ * sequentially and cuts it into records at the message starts, a few more deserialize and hash the records, and
+ * Next() hands the blocks to the caller in the order they are in the file. Both queues between the stages are
+ * bounded, the reader stops when the deserializers fall behind and they stop when the caller does.
+ *
+ * A record that does not deserialize has the file scanned again from just past its message start, so a block
+ * hidden in a torn record is still found, as it would be reading one block at a time.
+ */
+class CBlockImporter
+{
+private:
+    struct Record
+    {
+        uint64_t nSeq;
+        uint64_t nGeneration;
+        uint64_t nPos;
+        //! where to scan again from if the record does not deserialize
+        uint64_t nRewind;
+        //! data is a compressed block, see BLOCK_COMPRESSED_FLAG
+        bool fCompressed;
+        std::vector<char> data;
+    };
+    struct Decoded
+    {
+        uint64_t nRewind;
+        size_t nBytes;
+        CImportedBlock block;
+        std::string strError;
+    };
+
+    const CMessageHeader::MessageMagic messageStart;
+    const size_t nMaxQueuedBytes;
+    std::unique_ptr<CBufferedFile> blkdat;
+
+    std::mutex cs;
+    //! the reader and the deserializers wait on this one, the caller of Next() on the other
+    std::condition_variable condProduce;
+    std::condition_variable condConsume;
+    std::deque<Record> queueRaw;
+    size_t nRawBytes;
+    //! deserialized records by sequence number, waiting for the ones before them
+    std::map<uint64_t, Decoded> mapDecoded;
+    size_t nDecodedBytes;
+    //! the record Next() returns next
+    uint64_t nNextSeq;
+    //! bumped when the file is scanned again, records read before are dropped
+    uint64_t nGeneration;
+    bool fRewind;
+    uint64_t nRewindPos;
+    //! set by the reader at the end of the file, with the number of records it read
+    bool fReaderDone;
+    uint64_t nReaderDoneGeneration;
+    uint64_t nEndSeq;
+    bool fStop;
+
+    std::thread threadReader;
+    std::vector<std::thread> vThreadsDecode;
+
+    void ThreadReader();
+    void ThreadDecode();
+
+public:
+    /** Takes over fileIn and closes it once done, nThreads 0 picks a number from the cores there are */
+    CBlockImporter(FILE *fileIn,
+        const CMessageHeader::MessageMagic &messageStartIn,
+        int nThreads = 0,
+        size_t nMaxQueuedBytesIn = DEFAULT_BLOCKIMPORT_QUEUE_BYTES);
+    ~CBlockImporter();
+
+    /** The next block in the file, false at the end of it or once stopped */
+    bool Next(CImportedBlock &block);
+    /** Stop all threads, Next() returns false from now on */
+    void Stop();
+};
+
+#endif // BITCOIN_BLOCKIMPORT_H
@@ -0,0 +1,221 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockwriter.h"
+
+#include "chain/block.h"
+#include "clientversion.h"
+#include "crypto/hash.h"
+#include "main.h"
+#include "streams.h"
+#include "undo.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <map>
+
+std::unique_ptr<CBlockWriter> g_blockwriter;
+
+/** The message start and size that come before every record */
+static const unsigned int RECORD_HEADER_SIZE = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+
+CBlockWriter::CBlockWriter(size_t nMaxQueuedBytesIn)
+    : nMaxQueuedBytes(nMaxQueuedBytesIn), nQueuedBytes(0), nQueued(0), nDurable(0), fFailed(false), fStop(false),
+      fRunning(false)
+{
+}
+
+CBlockWriter::~CBlockWriter() { Stop(); }
+
+void CBlockWriter::Start()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (fRunning)
+        return;
+    fStop = false;
+    fRunning = true;
+    thread = std::thread(&CBlockWriter::ThreadWriter, this);
+}
+
+void CBlockWriter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    condWork.notify_all();
+    if (thread.joinable())
+        thread.join();
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fRunning = false;
+    }
+    condDone.notify_all();
+}
+
+void CBlockWriter::Enqueue(Record &&record)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    // A record larger than the whole queue still gets in once the queue is empty
+    condDone.wait(lock, [&]() { return nQueuedBytes == 0 || nQueuedBytes + record.data.size() <= nMaxQueuedBytes; });
+    nQueuedBytes += record.data.size();
+    setPending.emplace(record.fUndo, record.pos.nFile, record.pos.nPos);
+    queue.push_back(std::move(record));
+    nQueued++;
+    condWork.notify_one();
+}
+
+void CBlockWriter::WriteBlock(const std::vector<unsigned char> &data,
+    uint32_t nSizeField,
+    CDiskBlockPos &pos,
+    const CMessageHeader::MessageMagic &messageStart)
+{
+    Record record;
+    record.fUndo = false;
+    record.pos = pos;
+    record.data.reserve(RECORD_HEADER_SIZE + data.size());
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, record.data, 0);
+    writer << FLATDATA(messageStart) << nSizeField;
+    record.data.insert(record.data.end(), data.begin(), data.end());
+    pos.nPos += RECORD_HEADER_SIZE;
+    Enqueue(std::move(record));
+}
+
+void CBlockWriter::WriteUndo(const CBlockUndo &blockundo,
+    CDiskBlockPos &pos,
+    const uint256 &hashBlock,
+    const CMessageHeader::MessageMagic &messageStart)
+{
+    Record record;
+    record.fUndo = true;
+    record.pos = pos;
+    record.hashBlock = hashBlock;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, record.data, 0);
+    writer << FLATDATA(messageStart) << (unsigned int)::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION)
+           << blockundo;
+    pos.nPos += RECORD_HEADER_SIZE;
+    Enqueue(std::move(record));
+}
+
+void CBlockWriter::WaitForWrite(bool fUndo, const CDiskBlockPos &pos)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    condDone.wait(lock, [&]() {
+        auto it = setPending.lower_bound(std::make_tuple(fUndo, pos.nFile, 0u));
+        return it == setPending.end() || std::get<0>(*it) != fUndo || std::get<1>(*it) != pos.nFile ||
+               std::get<2>(*it) > pos.nPos;
+    });
+}
+
+bool CBlockWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    const uint64_t nTarget = nQueued;
+    condDone.wait(lock, [&]() { return nDurable >= nTarget || !fRunning; });
+    return !fFailed && nDurable >= nTarget;
+}
+
+bool CBlockWriter::WriteBatch(std::deque<Record> &batch)
+{
+    bool fOk = true;
+    std::map<std::pair<bool, int>, FILE *> mapFiles;
+    for (const Record &record : batch)
+    {
+        FILE *&file = mapFiles[std::make_pair(record.fUndo, record.pos.nFile)];
+        if (!file)
+        {
+            CDiskBlockPos posFile(record.pos.nFile, 0);
+            file = record.fUndo ? OpenUndoFile(posFile) : OpenBlockFile(posFile);
+        }
+        if (!file || fseek(file, record.pos.nPos, SEEK_SET) != 0 ||
+            fwrite(record.data.data(), 1, record.data.size(), file) != record.data.size())
+        {
+            LogPrintf("%s: failed to write %s data at %s\n", __func__, record.fUndo ? "undo" : "block",
+                record.pos.ToString());
+            fOk = false;
+            continue;
+        }
+        if (record.fUndo)
+        {
+            CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+            hasher << record.hashBlock;
+            hasher.write((const char *)record.data.data() + RECORD_HEADER_SIZE, record.data.size() - RECORD_HEADER_SIZE);
+            const uint256 hashChecksum = hasher.GetHash();
+            if (fwrite(hashChecksum.begin(), 1, hashChecksum.size(), file) != hashChecksum.size())
+            {
+                LogPrintf("%s: failed to write undo checksum at %s\n", __func__, record.pos.ToString());
+                fOk = false;
+            }
+        }
+    }
+    for (auto &item : mapFiles)
+    {
+        if (item.second && fflush(item.second) != 0)
+            fOk = false;
+    }
+
+    // Written, readers can go ahead while the sync runs
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        for (const Record &record : batch)
+            setPending.erase(std::make_tuple(record.fUndo, record.pos.nFile, record.pos.nPos));
+    }
+    condDone.notify_all();
+
+    for (auto &item : mapFiles)
+    {
+        if (item.second)
+        {
+            FileCommit(item.second);
+            fclose(item.second);
+        }
+    }
+    return fOk;
+}
+
+void CBlockWriter::ThreadWriter()
+{
+    RenameThread("bitcoin-blkwrite");
+    while (true)
+    {
+        std::deque<Record> batch;
+        uint64_t nBatchEnd;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWork.wait(lock, [&]() { return fStop || !queue.empty(); });
+            if (queue.empty())
+                break;
+            batch.swap(queue);
+            nQueuedBytes = 0;
+            nBatchEnd = nQueued;
+        }
+        // Producers may fill the queue again while this batch is written
+        condDone.notify_all();
+
+        const bool fOk = WriteBatch(batch);
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            nDurable = nBatchEnd;
+            if (!fOk)
+                fFailed = true;
+        }
+        condDone.notify_all();
+        if (!fOk)
+            AbortNode("Failed to write block or undo data");
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_BLOCKWRITER_H
+#define BITCOIN_BLOCKWRITER_H
+
+#include "chain/blockindex.h"
+#include "net/protocol.h"
+#include "uint256.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/** Block and undo data that may be waiting for the writer thread, in bytes */
+static const size_t DEFAULT_BLOCKWRITER_QUEUE_BYTES = 32 * 1024 * 1024;
+
+/**
+ * Writes block and undo records to the blk/rev files on a thread of its own, so the validation thread only
+ * serializes them and never waits for the disk unless the queue is full.
+ *
+ * Positions are still handed out synchronously by FindBlockPos/FindUndoPos, a record only has to be put where it
+ * was told to go. The writer takes everything queued at once and syncs each file it touched once for the whole
+ * batch, so fsyncs are shared by all the blocks that arrived while the last one ran.
+ *
+ * Records are readable from the files as soon as they are written, before they are durable: readers of a file
+ * call WaitForWrite first. Flush() waits until everything queued so far is durable, the block index must not be
+ * written referring to data that is not.
+ */
+class CBlockWriter
+{
+private:
+    struct Record
+    {
+        bool fUndo;
+        //! where the record starts, at its message start and size header
+        CDiskBlockPos pos;
+        std::vector<unsigned char> data;
+        //! undo records are followed by a checksum over the block hash and the undo data
+        uint256 hashBlock;
+    };
+
+    const size_t nMaxQueuedBytes;
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::condition_variable condDone;
+    std::deque<Record> queue;
+    size_t nQueuedBytes;
+    //! records queued or being written, readers of the same file before their end wait for them
+    std::set<std::tuple<bool, int, unsigned int> > setPending;
+    uint64_t nQueued;
+    uint64_t nDurable;
+    bool fFailed;
+    bool fStop;
+    bool fRunning;
+    std::thread thread;
+
+    void Enqueue(Record &&record);
+    bool WriteBatch(std::deque<Record> &batch);
+    void ThreadWriter();
+
+public:
+    explicit CBlockWriter(size_t nMaxQueuedBytesIn = DEFAULT_BLOCKWRITER_QUEUE_BYTES);
+    ~CBlockWriter();
+
+    void Start();
+    /** Write out everything still queued and stop the thread */
+    void Stop();
+
+    /** Queue a block record at pos, as WriteBlockToDisk would write it. pos is moved on to the block data. */
+    void WriteBlock(const std::vector<unsigned char> &data,
+        uint32_t nSizeField,
+        CDiskBlockPos &pos,
+        const CMessageHeader::MessageMagic &messageStart);
+    /** Queue an undo record at pos, as UndoWriteToDisk would write it. pos is moved on to the undo data. */
+    void WriteUndo(const CBlockUndo &blockundo,
+        CDiskBlockPos &pos,
+        const uint256 &hashBlock,
+        const CMessageHeader::MessageMagic &messageStart);
+
+    /** Wait until a read of the blk (or rev) file at pos can not overlap a record that is not written yet */
+    void WaitForWrite(bool fUndo, const CDiskBlockPos &pos);
+
+    /** Wait until everything queued so far is durable, false if anything failed to write */
+    bool Flush();
+};
+
+/** Set while the writer thread runs, block and undo data are written synchronously otherwise */
+extern std::unique_ptr<CBlockWriter> g_blockwriter;
+
+#endif // BITCOIN_BLOCKWRITER_H
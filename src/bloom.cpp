@@ -20,6 +20,7 @@
 #include "bloom.h"
 
 #include "chain/tx.h"
+#include "crypto/common.h"
 #include "crypto/hash.h"
 #include "random.h"
 #include "script/script.h"
@@ -28,6 +29,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
@@ -47,59 +49,81 @@ CBloomFilter::CBloomFilter(unsigned int nElements, double nFPRate, unsigned int
        */
       isFull(false), isEmpty(false),
       nHashFuncs(std::min((unsigned int)(vData.size() * 8 / nElements * LN2), MAX_HASH_FUNCS)), nTweak(nTweakIn),
-      nFlags(nFlagsIn)
+      nFlags(nFlagsIn), fDoubleHash(false)
 {
 }
 
 // Private constructor used by CRollingBloomFilter
 CBloomFilter::CBloomFilter(unsigned int nElements, double nFPRate, unsigned int nTweakIn)
     : vData((unsigned int)(-1 / LN2SQUARED * nElements * log(nFPRate)) / 8), isFull(false), isEmpty(true),
-      nHashFuncs((unsigned int)(vData.size() * 8 / nElements * LN2)), nTweak(nTweakIn), nFlags(BLOOM_UPDATE_NONE)
+      nHashFuncs((unsigned int)(vData.size() * 8 / nElements * LN2)), nTweak(nTweakIn), nFlags(BLOOM_UPDATE_NONE),
+      fDoubleHash(true)
 {
 }
 
-inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char> &vDataToHash) const
+//! The size of an outpoint as the network serializes it, the txid and the index as 32 bit little endian
+static const size_t OUTPOINT_SERIALIZED_SIZE = 36;
+
+static void SerializeOutPoint(const COutPoint &outpoint, unsigned char (&data)[OUTPOINT_SERIALIZED_SIZE])
+{
+    memcpy(data, outpoint.hash.begin(), 32);
+    WriteLE32(data + 32, outpoint.n);
+}
+
+inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const unsigned char *pData, size_t nSize) const
 {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (vData.size() * 8);
+    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, pData, nSize);
 }
 
-void CBloomFilter::insert(const std::vector<unsigned char> &vKey)
+void CBloomFilter::insert(const unsigned char *pData, size_t nSize)
 {
     if (isFull)
         return;
+    const unsigned int nBits = vData.size() * 8;
+    uint32_t nHash1 = 0;
+    uint32_t nHash2 = 0;
+    if (fDoubleHash)
+    {
+        nHash1 = Hash(0, pData, nSize);
+        nHash2 = Hash(1, pData, nSize) | 1;
+    }
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        const unsigned int nIndex = (fDoubleHash ? nHash1 + i * nHash2 : Hash(i, pData, nSize)) % nBits;
         // Sets bit nIndex of vData
         vData[nIndex >> 3] |= (1 << (7 & nIndex));
     }
     isEmpty = false;
 }
 
+void CBloomFilter::insert(const std::vector<unsigned char> &vKey) { insert(vKey.data(), vKey.size()); }
 void CBloomFilter::insert(const COutPoint &outpoint)
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    insert(data);
-}
-
-void CBloomFilter::insert(const uint256 &hash)
-{
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    insert(data);
+    unsigned char data[OUTPOINT_SERIALIZED_SIZE];
+    SerializeOutPoint(outpoint, data);
+    insert(data, sizeof(data));
 }
 
-bool CBloomFilter::contains(const std::vector<unsigned char> &vKey) const
+void CBloomFilter::insert(const uint256 &hash) { insert(hash.begin(), hash.size()); }
+bool CBloomFilter::contains(const unsigned char *pData, size_t nSize) const
 {
     if (isFull)
         return true;
     if (isEmpty)
         return false;
+    const unsigned int nBits = vData.size() * 8;
+    uint32_t nHash1 = 0;
+    uint32_t nHash2 = 0;
+    if (fDoubleHash)
+    {
+        nHash1 = Hash(0, pData, nSize);
+        nHash2 = Hash(1, pData, nSize) | 1;
+    }
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        // a BIP37 filter only hashes as far as the first clear bit, which is where most lookups stop
+        const unsigned int nIndex = (fDoubleHash ? nHash1 + i * nHash2 : Hash(i, pData, nSize)) % nBits;
         // Checks bit nIndex of vData
         if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
             return false;
@@ -107,20 +131,15 @@ bool CBloomFilter::contains(const std::vector<unsigned char> &vKey) const
     return true;
 }
 
+bool CBloomFilter::contains(const std::vector<unsigned char> &vKey) const { return contains(vKey.data(), vKey.size()); }
 bool CBloomFilter::contains(const COutPoint &outpoint) const
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    return contains(data);
-}
-
-bool CBloomFilter::contains(const uint256 &hash) const
-{
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    unsigned char data[OUTPOINT_SERIALIZED_SIZE];
+    SerializeOutPoint(outpoint, data);
+    return contains(data, sizeof(data));
 }
 
+bool CBloomFilter::contains(const uint256 &hash) const { return contains(hash.begin(), hash.size()); }
 void CBloomFilter::clear()
 {
     vData.assign(vData.size(), 0);
@@ -208,6 +227,25 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction &tx)
     return false;
 }
 
+unsigned int CBloomFilter::IsRelevantAndUpdate(const std::vector<CTransactionRef> &vtx, std::vector<bool> &vMatch)
+{
+    // a full or empty filter decides for all of them at once
+    if (isFull || isEmpty)
+    {
+        vMatch.assign(vtx.size(), isFull);
+        return isFull ? vtx.size() : 0;
+    }
+    vMatch.resize(vtx.size());
+    unsigned int nMatches = 0;
+    for (size_t i = 0; i < vtx.size(); i++)
+    {
+        vMatch[i] = IsRelevantAndUpdate(*vtx[i]);
+        if (vMatch[i])
+            nMatches++;
+    }
+    return nMatches;
+}
+
 void CBloomFilter::UpdateEmptyFull()
 {
     bool full = true;
@@ -22,12 +22,15 @@
 
 #include "serialize.h"
 
+#include <memory>
 #include <vector>
 
 class COutPoint;
 class CTransaction;
 class uint256;
 
+typedef std::shared_ptr<CTransaction> CTransactionRef;
+
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
 static const unsigned int MAX_HASH_FUNCS = 50;
@@ -65,8 +68,13 @@ private:
     unsigned int nHashFuncs;
     unsigned int nTweak;
     unsigned char nFlags;
+    //! derive the bit indexes from two hashes instead of one per hash function, only for filters that are never
+    //! sent to or received from a peer since it sets different bits than BIP37 does
+    bool fDoubleHash;
 
-    unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char> &vDataToHash) const;
+    unsigned int Hash(unsigned int nHashNum, const unsigned char *pData, size_t nSize) const;
+    void insert(const unsigned char *pData, size_t nSize);
+    bool contains(const unsigned char *pData, size_t nSize) const;
 
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(unsigned int nElements, double nFPRate, unsigned int nTweak);
@@ -83,7 +91,7 @@ public:
      * nFlags should be one of the BLOOM_UPDATE_* enums (not _MASK)
      */
     CBloomFilter(unsigned int nElements, double nFPRate, unsigned int nTweak, unsigned char nFlagsIn);
-    CBloomFilter() : isFull(true), isEmpty(false), nHashFuncs(0), nTweak(0), nFlags(0) {}
+    CBloomFilter() : isFull(true), isEmpty(false), nHashFuncs(0), nTweak(0), nFlags(0), fDoubleHash(false) {}
     ADD_SERIALIZE_METHODS
 
     template <typename Stream, typename Operation>
@@ -112,6 +120,11 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction &tx);
+    /**
+     * IsRelevantAndUpdate for each transaction of vtx in order, so outputs a transaction adds are matched by the
+     * ones after it. vMatch is set to which of them matched, returns how many did.
+     */
+    unsigned int IsRelevantAndUpdate(const std::vector<CTransactionRef> &vtx, std::vector<bool> &vMatch);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
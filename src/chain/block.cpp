@@ -31,16 +31,79 @@
 #include "util/util.h"
 #include "util/utilstrencodings.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+
+static_assert(offsetof(CBlockHeader, nNonce) + sizeof(uint32_t) == CBlockHeader::HASHED_SIZE,
+    "the hashed header fields must be contiguous");
+
 uint256 CBlockHeader::GetHash() const
 {
-    uint256 thash;
-    void *scratchbuff = scrypt_buffer_alloc();
+    std::shared_ptr<const CHashCache> cache = std::atomic_load(&hashCache);
+    if (cache && memcmp(cache->header, &nVersion, HASHED_SIZE) == 0)
+    {
+        return cache->hash;
+    }
+
+    // hash a snapshot of the header so the cached bytes and hash always belong together
+    std::shared_ptr<CHashCache> newCache = std::make_shared<CHashCache>();
+    memcpy(newCache->header, &nVersion, HASHED_SIZE);
+    scrypt_hash_mine(newCache->header, HASHED_SIZE, (uint32_t *)&(newCache->hash), scrypt_buffer_thread());
+    std::atomic_store(&hashCache, std::shared_ptr<const CHashCache>(newCache));
+
+    return newCache->hash;
+}
+
+void CBlockHeader::PrecomputeHashes(const CBlockHeader *headers, size_t count)
+{
+    std::vector<std::shared_ptr<CHashCache> > caches(count);
+    std::vector<const void *> inputs(count);
+    std::vector<uint256> hashes(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        caches[i] = std::make_shared<CHashCache>();
+        memcpy(caches[i]->header, &headers[i].nVersion, HASHED_SIZE);
+        inputs[i] = caches[i]->header;
+    }
+    scrypt_blockhash_batch(inputs.data(), hashes.data(), count);
+    for (size_t i = 0; i < count; i++)
+    {
+        caches[i]->hash = hashes[i];
+        std::atomic_store(&headers[i].hashCache, std::shared_ptr<const CHashCache>(caches[i]));
+    }
+}
+
+/** Fewer transactions than this per extra thread are hashed faster than the thread starts */
+static const size_t MIN_TX_HASHES_PER_THREAD = 250;
 
-    scrypt_hash_mine(((const void *)&(nVersion)), sizeof(CBlockHeader), ((uint32_t *)&(thash)), scratchbuff);
+void ForTransactionHashRanges(size_t nCount, const std::function<void(size_t, size_t)> &hashRange)
+{
+    const size_t nThreads =
+        std::min<size_t>(std::max(GetNumCores(), 1), std::max<size_t>(nCount / MIN_TX_HASHES_PER_THREAD, 1));
+    if (nThreads == 1)
+    {
+        hashRange(0, nCount);
+        return;
+    }
 
-    scrypt_buffer_free(scratchbuff);
+    // Every transaction is hashed by exactly one thread, this one takes the first range
+    const size_t nPerThread = (nCount + nThreads - 1) / nThreads;
+    std::vector<std::thread> vThreads;
+    for (size_t nStart = nPerThread; nStart < nCount; nStart += nPerThread)
+        vThreads.emplace_back(hashRange, nStart, std::min(nCount, nStart + nPerThread));
+    hashRange(0, nPerThread);
+    for (auto &thread : vThreads)
+        thread.join();
+}
 
-    return thash;
+void UpdateTransactionHashes(const std::vector<CTransactionRef> &vtx)
+{
+    ForTransactionHashRanges(vtx.size(), [&vtx](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++)
+            vtx[i]->UpdateHash();
+    });
 }
 
 std::string CBlock::ToString() const
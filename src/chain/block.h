@@ -26,6 +26,9 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <functional>
+#include <memory>
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -38,6 +41,8 @@ class CBlockHeader
 public:
     // header
     static const int CURRENT_VERSION = 4;
+    // number of bytes, starting at nVersion, that the block hash is computed over
+    static const size_t HASHED_SIZE = 80;
     int32_t nVersion;
     uint256 hashPrevBlock;
     uint256 hashMerkleRoot;
@@ -45,7 +50,33 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
+    /** The header bytes a hash was computed from together with that hash. Because the
+     *  bytes are kept, a cached hash is only reused while the header is unchanged, so
+     *  callers may keep mutating the public fields without invalidating it by hand.
+     */
+    struct CHashCache
+    {
+        unsigned char header[HASHED_SIZE];
+        uint256 hash;
+    };
+
+    // memory only, swapped atomically so concurrent GetHash calls on a shared block are safe
+    mutable std::shared_ptr<const CHashCache> hashCache;
+
     CBlockHeader() { SetNull(); }
+    CBlockHeader(const CBlockHeader &header) { *this = header; }
+    CBlockHeader &operator=(const CBlockHeader &header)
+    {
+        nVersion = header.nVersion;
+        hashPrevBlock = header.hashPrevBlock;
+        hashMerkleRoot = header.hashMerkleRoot;
+        nTime = header.nTime;
+        nBits = header.nBits;
+        nNonce = header.nNonce;
+        hashCache = std::atomic_load(&header.hashCache);
+        return *this;
+    }
+
     ADD_SERIALIZE_METHODS
 
     template <typename Stream, typename Operation>
@@ -68,10 +99,16 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        hashCache.reset();
     }
 
     bool IsNull() const { return (nBits == 0); }
+    /** Returns the scrypt hash of the header, reusing the cached one while the header is unchanged */
     uint256 GetHash() const;
+    /** Hash count headers with the multi-buffer scrypt and fill their hash caches, so later
+     *  GetHash calls on them return immediately
+     */
+    static void PrecomputeHashes(const CBlockHeader *headers, size_t count);
 
     int64_t GetBlockTime() const { return (int64_t)nTime; }
     // entropy bit for stake modifier if chosen by modifier
@@ -84,6 +121,18 @@ public:
 };
 
 
+/**
+ * Call hashRange(nBegin, nEnd) on ranges that cover [0, nCount) once, on a few threads when there are enough
+ * transactions to hash for it to be worth it.
+ */
+void ForTransactionHashRanges(size_t nCount, const std::function<void(size_t, size_t)> &hashRange);
+
+/**
+ * Compute the cached hashes of transactions deserialized with defer_hash, spread over a few threads when there
+ * are enough of them to be worth it.
+ */
+void UpdateTransactionHashes(const std::vector<CTransactionRef> &vtx);
+
 class CBlock : public CBlockHeader
 {
 public:
@@ -95,6 +144,8 @@ public:
 
     // memory only
     mutable bool fChecked;
+    // memory only, every vtx entry was deserialized with this block and its cached hash (GetId) can be trusted
+    bool fTxHashesCached;
 
     CBlock() { SetNull(); }
     CBlock(const CBlockHeader &header)
@@ -109,16 +160,45 @@ public:
     inline void SerializationOp(Stream &s, Operation ser_action)
     {
         READWRITE(*(CBlockHeader *)this);
-        READWRITE(vtx);
+        SerializeTransactions(s, ser_action);
         READWRITE(vchBlockSig);
     }
 
+    template <typename Stream>
+    void SerializeTransactions(Stream &s, CSerActionSerialize ser_action)
+    {
+        READWRITE(vtx);
+    }
+
+    /** Read vtx like the vector deserializer does, but hash the transactions in one batch at the end */
+    template <typename Stream>
+    void SerializeTransactions(Stream &s, CSerActionUnserialize)
+    {
+        fTxHashesCached = false;
+        vtx.clear();
+        unsigned int nSize = ReadCompactSize(s);
+        unsigned int i = 0;
+        unsigned int nMid = 0;
+        while (nMid < nSize)
+        {
+            nMid += 5000000 / sizeof(CTransactionRef);
+            if (nMid > nSize)
+                nMid = nSize;
+            vtx.reserve(nMid);
+            for (; i < nMid; i++)
+                vtx.push_back(std::make_shared<CTransaction>(deserialize, defer_hash, s));
+        }
+        UpdateTransactionHashes(vtx);
+        fTxHashesCached = true;
+    }
+
     void SetNull()
     {
         CBlockHeader::SetNull();
         vtx.clear();
         vchBlockSig.clear();
         fChecked = false;
+        fTxHashesCached = false;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -130,6 +210,7 @@ public:
         block.nTime = nTime;
         block.nBits = nBits;
         block.nNonce = nNonce;
+        block.hashCache = std::atomic_load(&hashCache);
         return block;
     }
 
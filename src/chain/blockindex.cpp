@@ -19,6 +19,9 @@
  */
 
 #include "blockindex.h"
+#include "crypto/hash.h"
+
+#include <algorithm>
 
 /** Turn the lowest '1' bit in the binary representation of a number into a '0'. */
 int static inline InvertLowestOne(int n) { return n & (n - 1); }
@@ -86,6 +89,86 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildTypeLinks()
+{
+    if (pprev && !pprev->fTypeLinks)
+        return;
+    pprevPoW = pprev ? (pprev->IsProofOfWork() ? pprev : pprev->pprevPoW) : nullptr;
+    pprevPoS = pprev ? (pprev->IsProofOfStake() ? pprev : pprev->pprevPoS) : nullptr;
+    fTypeLinks = true;
+}
+
+int64_t CBlockIndex::ComputeMedianTimePast() const
+{
+    int64_t pmedian[nMedianTimeSpan];
+    int64_t *pbegin = &pmedian[nMedianTimeSpan];
+    int64_t *pend = &pmedian[nMedianTimeSpan];
+
+    const CBlockIndex *pindex = this;
+    for (int i = 0; i < nMedianTimeSpan && pindex; i++, pindex = pindex->pprev)
+        *(--pbegin) = pindex->GetBlockTime();
+
+    std::sort(pbegin, pend);
+    return pbegin[(pend - pbegin) / 2];
+}
+
+void CBlockIndex::BuildMedianTimePast() { nMedianTimePast = ComputeMedianTimePast(); }
+
+void CBlockIndex::BuildVersionCounts(int nWindow)
+{
+    if (nWindow <= 0)
+        return;
+    nVersionWindow = nWindow;
+    if (pprev && pprev->nVersionWindow == nWindow)
+    {
+        // the window moves by one block, this one comes in and the one nWindow blocks back drops out
+        const CBlockIndex *pindexOut = nHeight >= nWindow ? GetAncestor(nHeight - nWindow) : nullptr;
+        for (int i = 0; i < 3; i++)
+        {
+            nVersionCounts[i] = pprev->nVersionCounts[i] + (nVersion >= i + 2) -
+                                (pindexOut && pindexOut->nVersion >= i + 2);
+        }
+        return;
+    }
+    nVersionCounts[0] = nVersionCounts[1] = nVersionCounts[2] = 0;
+    const CBlockIndex *pindex = this;
+    for (int n = 0; n < nWindow && pindex; n++, pindex = pindex->pprev)
+    {
+        for (int i = 0; i < 3; i++)
+            nVersionCounts[i] += (pindex->nVersion >= i + 2);
+    }
+}
+
+int CBlockIndex::GetVersionCount(int minVersion, int nWindow) const
+{
+    if (nVersionWindow == 0 || nVersionWindow != nWindow || minVersion < 2 || minVersion > 4)
+        return -1;
+    return nVersionCounts[minVersion - 2];
+}
+
+void CBlockIndex::LinkToParent()
+{
+    if (!pprev)
+        return;
+    psibling = pprev->pchild;
+    pprev->pchild = this;
+}
+
+void CBlockIndex::UnlinkFromParent()
+{
+    if (!pprev)
+        return;
+    for (CBlockIndex **ppnext = &pprev->pchild; *ppnext; ppnext = &(*ppnext)->psibling)
+    {
+        if (*ppnext == this)
+        {
+            *ppnext = psibling;
+            break;
+        }
+    }
+    psibling = nullptr;
+}
+
 bool CBlockIndex::IsProofOfWork() const { return !(nFlags & BLOCK_PROOF_OF_STAKE); }
 bool CBlockIndex::IsProofOfStake() const { return (nFlags & BLOCK_PROOF_OF_STAKE); }
 void CBlockIndex::SetProofOfStake() { nFlags |= BLOCK_PROOF_OF_STAKE; }
@@ -99,3 +182,10 @@ bool CBlockIndex::SetStakeEntropyBit(unsigned int nEntropyBit)
 }
 
 void CBlockIndex::SetStakeModifier(uint256 nModifier) { nStakeModifier = nModifier; }
+
+uint64_t CDiskBlockIndex::ComputeHashChecksum() const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << hashBlock << nVersion << hashPrev << hashMerkleRoot << nTime << nBits << nNonce;
+    return ss.GetHash().GetCheapHash();
+}
@@ -29,6 +29,7 @@
 #include "uint256.h"
 
 #include <string>
+#include <vector>
 
 struct CDiskBlockPos
 {
@@ -176,6 +177,28 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
+    //! (memory only) The nearest proof of work and proof of stake ancestors, null if there is none. Only set once
+    //! fTypeLinks is, when the block was connected and the types of its ancestors can no longer change.
+    const CBlockIndex *pprevPoW;
+    const CBlockIndex *pprevPoS;
+    bool fTypeLinks;
+
+    //! (memory only) The block data was stored by this process after CheckBlock passed on it, ConnectBlock then
+    //! does not repeat the checks that do not depend on the chain
+    bool fBlockChecked;
+
+    //! (memory only) Median time past of the entry, -1 until BuildMedianTimePast computed it
+    int64_t nMedianTimePast;
+
+    //! (memory only) Blocks of version 2, 3 and 4 or higher among the entry and its ancestors in a window of
+    //! nVersionWindow blocks, 0 until BuildVersionCounts counted them
+    int nVersionWindow;
+    int nVersionCounts[3];
+
+    //! (memory only) The first child of the entry and the next child of its pprev, set by LinkToParent
+    CBlockIndex *pchild;
+    CBlockIndex *psibling;
+
     void SetNull()
     {
         phashBlock = nullptr;
@@ -190,6 +213,15 @@ public:
         nChainTx = 0;
         nStatus = 0;
         nSequenceId = 0;
+        pprevPoW = nullptr;
+        pprevPoS = nullptr;
+        fTypeLinks = false;
+        fBlockChecked = false;
+        nMedianTimePast = -1;
+        nVersionWindow = 0;
+        nVersionCounts[0] = nVersionCounts[1] = nVersionCounts[2] = 0;
+        pchild = nullptr;
+        psibling = nullptr;
 
         nVersion = 0;
         hashMerkleRoot = uint256();
@@ -261,19 +293,10 @@ public:
         nMedianTimeSpan = 11
     };
 
-    int64_t GetMedianTimePast() const
-    {
-        int64_t pmedian[nMedianTimeSpan];
-        int64_t *pbegin = &pmedian[nMedianTimeSpan];
-        int64_t *pend = &pmedian[nMedianTimeSpan];
-
-        const CBlockIndex *pindex = this;
-        for (int i = 0; i < nMedianTimeSpan && pindex; i++, pindex = pindex->pprev)
-            *(--pbegin) = pindex->GetBlockTime();
+    //! The median of the block times of the entry and its 10 ancestors
+    int64_t ComputeMedianTimePast() const;
 
-        std::sort(pbegin, pend);
-        return pbegin[(pend - pbegin) / 2];
-    }
+    int64_t GetMedianTimePast() const { return nMedianTimePast >= 0 ? nMedianTimePast : ComputeMedianTimePast(); }
 
     std::string ToString() const
     {
@@ -310,6 +333,23 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Link to the nearest proof of work and proof of stake ancestors, once pprev has its links or there is none
+    void BuildTypeLinks();
+
+    //! Compute the median time past once, the block times of the entry and its ancestors never change
+    void BuildMedianTimePast();
+
+    //! Count the versions in the window ending at the entry, from the counts of pprev when it has them
+    void BuildVersionCounts(int nWindow);
+
+    //! Blocks of at least minVersion in the window ending at the entry, -1 if they were not counted for nWindow
+    int GetVersionCount(int minVersion, int nWindow) const;
+
+    //! Add the entry to the children of pprev, once for every entry
+    void LinkToParent();
+    //! Take the entry out of the children of pprev again
+    void UnlinkFromParent();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex *GetAncestor(int height);
     const CBlockIndex *GetAncestor(int height) const;
@@ -323,18 +363,55 @@ public:
     void SetStakeModifier(uint256 nModifier);
 };
 
+/** Call fn on every descendant of pindex through the child links, not on pindex itself */
+template <typename Callable>
+void ForEachDescendant(CBlockIndex *pindex, Callable fn)
+{
+    std::vector<CBlockIndex *> vStack;
+    if (pindex->pchild)
+        vStack.push_back(pindex->pchild);
+    while (!vStack.empty())
+    {
+        CBlockIndex *pindexWalk = vStack.back();
+        vStack.pop_back();
+        if (pindexWalk->psibling)
+            vStack.push_back(pindexWalk->psibling);
+        if (pindexWalk->pchild)
+            vStack.push_back(pindexWalk->pchild);
+        fn(pindexWalk);
+    }
+}
+
+/** Entries written with at least this version end with a checksum over the stored block hash
+ *  and header, which lets the block index be loaded without recomputing any scrypt hash. It is a
+ *  record version of its own, above the CLIENT_VERSION of every client that wrote entries without
+ *  one. Entries are written with it even by a client whose CLIENT_VERSION is lower.
+ */
+static const int DISK_BLOCK_INDEX_CHECKSUM_VERSION = 20516;
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashBlock;
     uint256 hashPrev;
+    uint64_t nHashChecksum;
+
+    // memory only, the version the entry was read with or is written with
+    int nDiskVersion;
 
-    CDiskBlockIndex() { hashPrev = uint256(); }
+    CDiskBlockIndex()
+    {
+        hashPrev = uint256();
+        nHashChecksum = 0;
+        nDiskVersion = 0;
+    }
     explicit CDiskBlockIndex(const CBlockIndex *pindex) : CBlockIndex(*pindex)
     {
         hashBlock = pindex->GetBlockHash();
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        nHashChecksum = ComputeHashChecksum();
+        nDiskVersion = 0;
     }
 
     ADD_SERIALIZE_METHODS
@@ -343,8 +420,12 @@ public:
     inline void SerializationOp(Stream &s, Operation ser_action)
     {
         int nStreamVersion = s.GetVersion();
+        // new entries always carry the checksum, whatever version the stream has
+        if (!ser_action.ForRead() && nStreamVersion < DISK_BLOCK_INDEX_CHECKSUM_VERSION)
+            nStreamVersion = DISK_BLOCK_INDEX_CHECKSUM_VERSION;
         if (!(s.GetType() & SER_GETHASH))
             READWRITE(VARINT(nStreamVersion, VarIntMode::NONNEGATIVE_SIGNED));
+        nDiskVersion = nStreamVersion;
 
         READWRITE(VARINT(nHeight, VarIntMode::NONNEGATIVE_SIGNED));
         READWRITE(VARINT(nStatus));
@@ -375,8 +456,18 @@ public:
             READWRITE(nStakeTime);
             READWRITE(hashProofOfStake);
         }
+        if (nStreamVersion >= DISK_BLOCK_INDEX_CHECKSUM_VERSION)
+            READWRITE(nHashChecksum);
     }
 
+    //! Cheap checksum binding hashBlock to the header fields it was computed from
+    uint64_t ComputeHashChecksum() const;
+    //! Whether the entry was stored with a checksum for hashBlock
+    bool HasHashChecksum() const { return nDiskVersion >= DISK_BLOCK_INDEX_CHECKSUM_VERSION; }
+    //! Whether hashBlock can be trusted without recomputing it
+    bool CheckHashChecksum() const { return HasHashChecksum() && nHashChecksum == ComputeHashChecksum(); }
+
+    //! Recompute the scrypt hash of the stored header, use hashBlock where it is trusted
     uint256 GetBlockHash() const
     {
         CBlockHeader block;
@@ -395,7 +486,7 @@ public:
         std::string str = "CDiskBlockIndex(";
         str += CBlockIndex::ToString();
         str +=
-            strprintf("\n                hashBlock=%s, hashPrev=%s)", GetBlockHash().ToString(), hashPrev.ToString());
+            strprintf("\n                hashBlock=%s, hashPrev=%s)", hashBlock.ToString(), hashPrev.ToString());
         return str;
     }
 };
@@ -0,0 +1,102 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2017-2018 Greg Griffith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blockmap.h"
+
+#include <assert.h>
+
+void CBlockMap::Rehash(size_t nNewCapacity)
+{
+    // capacity is always a power of two so the probe can mask instead of divide
+    assert((nNewCapacity & (nNewCapacity - 1)) == 0);
+    std::unique_ptr<CTable> newTable(new CTable(nNewCapacity));
+    const CTable *oldTable = ptable.load(std::memory_order_relaxed);
+    if (oldTable != nullptr)
+    {
+        for (size_t i = 0; i < oldTable->Capacity(); i++)
+        {
+            const CSlot &slot = oldTable->slots[i];
+            CBlockIndex *pindex = slot.pindex.load(std::memory_order_relaxed);
+            if (!IsEntry(pindex))
+                continue;
+            uint64_t nCheapHash = slot.nCheapHash.load(std::memory_order_relaxed);
+            size_t nPos = nCheapHash & newTable->nMask;
+            while (newTable->slots[nPos].pindex.load(std::memory_order_relaxed) != nullptr)
+                nPos = (nPos + 1) & newTable->nMask;
+            newTable->slots[nPos].nCheapHash.store(nCheapHash, std::memory_order_relaxed);
+            newTable->slots[nPos].pindex.store(pindex, std::memory_order_relaxed);
+        }
+    }
+    // readers that loaded the old table keep probing it, so it stays allocated
+    ptable.store(newTable.get(), std::memory_order_release);
+    vTables.push_back(std::move(newTable));
+    nTombstones = 0;
+}
+
+std::pair<CBlockMap::const_iterator, bool> CBlockMap::insert(CBlockIndex *pindex)
+{
+    assert(pindex && pindex->phashBlock);
+    // keep the load factor, tombstones included, at or below 3/4, linear probing degrades quickly past that
+    const CTable *table = ptable.load(std::memory_order_relaxed);
+    const size_t nCount = nSize.load(std::memory_order_relaxed);
+    if (table == nullptr || 4 * (nCount + nTombstones + 1) > 3 * table->Capacity())
+    {
+        // mostly tombstones are dropped in a table of the same size, live entries double it
+        size_t nCapacity = table ? table->Capacity() : MIN_CAPACITY;
+        while (8 * (nCount + 1) > 3 * nCapacity)
+            nCapacity *= 2;
+        Rehash(nCapacity);
+        table = ptable.load(std::memory_order_relaxed);
+    }
+
+    const uint256 &hash = *pindex->phashBlock;
+    const uint64_t nCheapHash = hash.GetCheapHash();
+    CSlot *slot = const_cast<CSlot *>(FindSlot(table, hash, nCheapHash));
+    const_iterator it(slot, &table->slots[0] + table->Capacity());
+    if (slot->pindex.load(std::memory_order_relaxed) != nullptr)
+        return std::make_pair(it, false);
+    // the entry pointer goes last, a reader that sees it also sees the cheap hash
+    slot->nCheapHash.store(nCheapHash, std::memory_order_relaxed);
+    slot->pindex.store(pindex, std::memory_order_release);
+    nSize.store(nCount + 1, std::memory_order_relaxed);
+    return std::make_pair(it, true);
+}
+
+bool CBlockMap::erase(const uint256 &hash)
+{
+    CTable *table = ptable.load(std::memory_order_relaxed);
+    if (table == nullptr)
+        return false;
+    CSlot *slot = const_cast<CSlot *>(FindSlot(table, hash, hash.GetCheapHash()));
+    if (slot->pindex.load(std::memory_order_relaxed) == nullptr)
+        return false;
+    slot->pindex.store(Tombstone(), std::memory_order_release);
+    nSize.store(nSize.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    nTombstones++;
+    return true;
+}
+
+CBlockMap &CBlockMap::operator=(const CBlockMap &other)
+{
+    if (this == &other)
+        return *this;
+    clear();
+    for (CBlockIndex *pindex : other)
+        insert(pindex);
+    return *this;
+}
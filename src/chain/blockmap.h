@@ -0,0 +1,338 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2017-2018 Greg Griffith
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOCKMAP_H
+#define BLOCKMAP_H
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "chain/blockindex.h"
+#include "memusage.h"
+#include "uint256.h"
+
+/** Allocates block index entries from large contiguous slabs instead of one heap
+ *  allocation each. Every entry is stored next to its block hash, which phashBlock
+ *  points to, so the hash table only has to hold pointers. An entry taken out of the
+ *  index is retired, and only reused after the next Reclaim(), so a lock free Lookup()
+ *  that found it just before still reads a valid entry. All of them go away in Clear().
+ *  Not thread safe, callers hold cs_mapBlockIndex exclusively.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t MIN_SLAB_ENTRIES = 1024;
+    static const size_t MAX_SLAB_ENTRIES = 65536;
+
+    struct CEntry
+    {
+        uint256 hash;
+        CBlockIndex index;
+
+        template <typename... Args>
+        CEntry(const uint256 &hashIn, Args &&... args) : hash(hashIn), index(std::forward<Args>(args)...)
+        {
+            index.phashBlock = &hash;
+        }
+    };
+
+    //! the slabs with the number of entries constructed in each
+    std::vector<std::pair<CEntry *, size_t> > vSlabs;
+    size_t nSlabCapacity;
+    //! entries out of the index since the last Reclaim(), and the ones Allocate() may construct again
+    std::vector<CEntry *> vRetired;
+    std::vector<CEntry *> vReusable;
+
+public:
+    CBlockIndexArena() : nSlabCapacity(0) {}
+    ~CBlockIndexArena() { Clear(); }
+    CBlockIndexArena(const CBlockIndexArena &) = delete;
+    CBlockIndexArena &operator=(const CBlockIndexArena &) = delete;
+
+    template <typename... Args>
+    CBlockIndex *Allocate(const uint256 &hash, Args &&... args)
+    {
+        if (!vReusable.empty())
+        {
+            CEntry *entry = vReusable.back();
+            vReusable.pop_back();
+            entry->~CEntry();
+            new (entry) CEntry(hash, std::forward<Args>(args)...);
+            return &entry->index;
+        }
+        if (vSlabs.empty() || vSlabs.back().second == nSlabCapacity)
+        {
+            // grow the slabs with the index so small chains stay small
+            nSlabCapacity = std::min(MAX_SLAB_ENTRIES, std::max(MIN_SLAB_ENTRIES, 2 * nSlabCapacity));
+            void *slab = ::operator new(nSlabCapacity * sizeof(CEntry));
+            vSlabs.push_back(std::make_pair(static_cast<CEntry *>(slab), 0));
+        }
+        std::pair<CEntry *, size_t> &slab = vSlabs.back();
+        CEntry *entry = new (slab.first + slab.second) CEntry(hash, std::forward<Args>(args)...);
+        slab.second++;
+        return &entry->index;
+    }
+
+    //! Give back an entry allocated here that is not in the index anymore
+    void Retire(CBlockIndex *pindex)
+    {
+        // the hash is the first member of the entry and phashBlock points to it
+        vRetired.push_back(reinterpret_cast<CEntry *>(const_cast<uint256 *>(pindex->phashBlock)));
+    }
+
+    //! Let Allocate() reuse the entries retired before, called when no Lookup() can still hold one of them
+    void Reclaim()
+    {
+        vReusable.insert(vReusable.end(), vRetired.begin(), vRetired.end());
+        vRetired.clear();
+    }
+
+    void Clear()
+    {
+        // retired entries stay constructed until they are reused, so every one is destroyed here
+        for (auto &slab : vSlabs)
+        {
+            for (size_t i = 0; i < slab.second; i++)
+                slab.first[i].~CEntry();
+            ::operator delete(slab.first);
+        }
+        vSlabs.clear();
+        vRetired.clear();
+        vReusable.clear();
+        nSlabCapacity = 0;
+    }
+
+    //! memory the slabs take, the unused room at the end of the last one included
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = memusage::DynamicUsage(vSlabs) + memusage::DynamicUsage(vRetired) +
+                        memusage::DynamicUsage(vReusable);
+        // the slabs grew as in Allocate()
+        size_t nCapacity = 0;
+        for (size_t i = 0; i < vSlabs.size(); i++)
+        {
+            nCapacity = std::min(MAX_SLAB_ENTRIES, std::max(MIN_SLAB_ENTRIES, 2 * nCapacity));
+            nUsage += memusage::MallocUsage(nCapacity * sizeof(CEntry));
+        }
+        return nUsage;
+    }
+};
+
+/** Open addressing hash table from block hash to block index entry.
+ *  Each slot holds the entry pointer and the cheap hash of its key, probing compares
+ *  the cheap hash first and only dereferences the entry (whose phashBlock is the key)
+ *  on a match. An erased entry leaves a tombstone in its slot, which keeps the probe
+ *  sequences through it intact for readers, and is dropped when the table is rebuilt.
+ *  Iterating yields the CBlockIndex pointers in no particular order.
+ *
+ *  Lookup() takes no lock and may run concurrently with one writer. Writers (insert,
+ *  erase, clear, assignment) and iteration still need cs_mapBlockIndex held exclusively or shared
+ *  respectively. A slot is published by storing its entry pointer last, and growing the
+ *  table builds the new one completely before publishing it. Replaced tables are kept
+ *  until clear() or the second ReleaseReplacedTables() after they were replaced because
+ *  a reader may still be probing them. While the map only grows they cost less memory
+ *  than the current table, rebuilds that drop tombstones do not shrink it though.
+ */
+class CBlockMap
+{
+private:
+    struct CSlot
+    {
+        std::atomic<uint64_t> nCheapHash;
+        std::atomic<CBlockIndex *> pindex;
+
+        CSlot() : nCheapHash(0), pindex(nullptr) {}
+    };
+
+    struct CTable
+    {
+        //! number of slots minus one, the number of slots is a power of two
+        size_t nMask;
+        std::unique_ptr<CSlot[]> slots;
+
+        explicit CTable(size_t nCapacity) : nMask(nCapacity - 1), slots(new CSlot[nCapacity]) {}
+        size_t Capacity() const { return nMask + 1; }
+    };
+
+    static const size_t MIN_CAPACITY = 1024;
+
+    std::atomic<CTable *> ptable;
+    std::atomic<size_t> nSize;
+    //! tombstones in the current table
+    size_t nTombstones;
+    std::vector<std::unique_ptr<CTable> > vTables;
+    //! tables at the front of vTables that were replaced before the last ReleaseReplacedTables()
+    size_t nReleasableTables;
+
+    //! stands in for an erased entry, never dereferenced
+    static CBlockIndex *Tombstone() { return reinterpret_cast<CBlockIndex *>(uintptr_t(1)); }
+    static bool IsEntry(const CBlockIndex *pindex) { return pindex != nullptr && pindex != Tombstone(); }
+
+    /** Return the slot holding hash, or the empty slot that ends its probe sequence */
+    static const CSlot *FindSlot(const CTable *table, const uint256 &hash, uint64_t nCheapHash)
+    {
+        size_t nPos = nCheapHash & table->nMask;
+        for (;;)
+        {
+            const CSlot *slot = &table->slots[nPos];
+            CBlockIndex *pindex = slot->pindex.load(std::memory_order_acquire);
+            if (pindex == nullptr)
+                return slot;
+            if (pindex != Tombstone() && slot->nCheapHash.load(std::memory_order_relaxed) == nCheapHash &&
+                *pindex->phashBlock == hash)
+                return slot;
+            nPos = (nPos + 1) & table->nMask;
+        }
+    }
+
+    void Rehash(size_t nNewCapacity);
+
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef CBlockIndex *value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef CBlockIndex *const *pointer;
+        // operator* hands out the pointer read from the slot, not a reference into it
+        typedef CBlockIndex *reference;
+
+    private:
+        const CSlot *pslot;
+        const CSlot *pend;
+
+        void SkipEmpty()
+        {
+            while (pslot != pend && !IsEntry(pslot->pindex.load(std::memory_order_relaxed)))
+                pslot++;
+        }
+
+    public:
+        const_iterator(const CSlot *pslotIn, const CSlot *pendIn) : pslot(pslotIn), pend(pendIn) { SkipEmpty(); }
+        CBlockIndex *operator*() const { return pslot->pindex.load(std::memory_order_relaxed); }
+        const_iterator &operator++()
+        {
+            pslot++;
+            SkipEmpty();
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator copy(*this);
+            ++(*this);
+            return copy;
+        }
+        bool operator==(const const_iterator &other) const { return pslot == other.pslot; }
+        bool operator!=(const const_iterator &other) const { return pslot != other.pslot; }
+    };
+    typedef const_iterator iterator;
+
+    CBlockMap() : ptable(nullptr), nSize(0), nTombstones(0), nReleasableTables(0) {}
+    CBlockMap(const CBlockMap &) = delete;
+    CBlockMap &operator=(const CBlockMap &other);
+
+    const_iterator begin() const
+    {
+        const CTable *table = ptable.load(std::memory_order_relaxed);
+        if (table == nullptr)
+            return const_iterator(nullptr, nullptr);
+        return const_iterator(&table->slots[0], &table->slots[0] + table->Capacity());
+    }
+    const_iterator end() const
+    {
+        const CTable *table = ptable.load(std::memory_order_relaxed);
+        if (table == nullptr)
+            return const_iterator(nullptr, nullptr);
+        return const_iterator(&table->slots[0] + table->Capacity(), &table->slots[0] + table->Capacity());
+    }
+
+    const_iterator find(const uint256 &hash) const
+    {
+        const CTable *table = ptable.load(std::memory_order_relaxed);
+        if (table == nullptr)
+            return end();
+        const CSlot *slot = FindSlot(table, hash, hash.GetCheapHash());
+        if (slot->pindex.load(std::memory_order_relaxed) == nullptr)
+            return end();
+        return const_iterator(slot, &table->slots[0] + table->Capacity());
+    }
+
+    /** Lock free lookup, returns nullptr if hash is not in the map */
+    CBlockIndex *Lookup(const uint256 &hash) const
+    {
+        const CTable *table = ptable.load(std::memory_order_acquire);
+        if (table == nullptr)
+            return nullptr;
+        // the slot may have been erased since FindSlot() saw the entry in it
+        CBlockIndex *pindex = FindSlot(table, hash, hash.GetCheapHash())->pindex.load(std::memory_order_acquire);
+        return IsEntry(pindex) ? pindex : nullptr;
+    }
+
+    size_t count(const uint256 &hash) const { return Lookup(hash) != nullptr ? 1 : 0; }
+    size_t size() const { return nSize.load(std::memory_order_relaxed); }
+    bool empty() const { return size() == 0; }
+
+    //! memory the current table and the replaced ones kept for readers take
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = memusage::DynamicUsage(vTables);
+        for (const auto &table : vTables)
+            nUsage += memusage::MallocUsage(sizeof(CTable)) + memusage::MallocUsage(table->Capacity() * sizeof(CSlot));
+        return nUsage;
+    }
+
+    /** Add an entry keyed on *pindex->phashBlock. Returns the entry already stored under
+     *  that hash and false if there is one.
+     */
+    std::pair<const_iterator, bool> insert(CBlockIndex *pindex);
+
+    /** Take the entry of hash out, false if there is none. A concurrent Lookup() may still return it, so the
+     *  entry itself has to stay valid until no reader can hold it anymore.
+     */
+    bool erase(const uint256 &hash);
+
+    /** Free the tables that were already replaced at the last call, the ones replaced since may still be probed
+     *  by a Lookup() that started before. Called at intervals far longer than any lookup takes.
+     */
+    void ReleaseReplacedTables()
+    {
+        vTables.erase(vTables.begin(), vTables.begin() + nReleasableTables);
+        nReleasableTables = vTables.empty() ? 0 : vTables.size() - 1;
+    }
+
+    /** Drop every entry and free the tables. Unlike the other writers this must not run
+     *  concurrently with Lookup().
+     */
+    void clear()
+    {
+        ptable.store(nullptr, std::memory_order_release);
+        vTables.clear();
+        nSize.store(0, std::memory_order_relaxed);
+        nTombstones = 0;
+        nReleasableTables = 0;
+    }
+};
+
+#endif // BLOCKMAP_H
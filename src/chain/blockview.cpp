@@ -0,0 +1,110 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain/blockview.h"
+
+#include "crypto/hash.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+
+/** The smallest a transaction, an input and an output can be serialized, to bound what a stated count reserves */
+static const size_t MIN_TX_SIZE = 14;
+static const size_t MIN_TXIN_SIZE = 41;
+static const size_t MIN_TXOUT_SIZE = 9;
+
+CBlockView::CBlockView(const uint8_t *pbeginIn, const uint8_t *pendIn) : pbegin(pbeginIn)
+{
+    // walks the same fields in the same order as CBlock and CTransaction deserialize them
+    CMemoryReader s(SER_NETWORK, PROTOCOL_VERSION, pbeginIn, pendIn);
+    const size_t nTotal = pendIn - pbeginIn;
+    s >> header;
+    const uint64_t nTxCount = ReadCompactSize(s);
+    vTx.reserve(std::min<uint64_t>(nTxCount, s.size() / MIN_TX_SIZE));
+    for (uint64_t i = 0; i < nTxCount; i++)
+    {
+        CTxOffsets tx;
+        tx.nBegin = nTotal - s.size();
+        int32_t nVersion;
+        s >> nVersion;
+        s.ignore(4); // nTime
+
+        tx.nFirstInput = vInputs.size();
+        tx.nInputs = ReadCompactSize(s);
+        vInputs.reserve(vInputs.size() + std::min<size_t>(tx.nInputs, s.size() / MIN_TXIN_SIZE));
+        for (uint32_t j = 0; j < tx.nInputs; j++)
+        {
+            vInputs.push_back(nTotal - s.size());
+            s.ignore(36); // prevout
+            s.ignore(ReadCompactSize(s));
+            s.ignore(4); // nSequence
+        }
+
+        tx.nFirstOutput = vOutputs.size();
+        tx.nOutputs = ReadCompactSize(s);
+        vOutputs.reserve(vOutputs.size() + std::min<size_t>(tx.nOutputs, s.size() / MIN_TXOUT_SIZE));
+        for (uint32_t j = 0; j < tx.nOutputs; j++)
+        {
+            vOutputs.push_back(nTotal - s.size());
+            s.ignore(8); // nValue
+            s.ignore(ReadCompactSize(s));
+        }
+
+        s.ignore(4); // nLockTime
+        if (nVersion == 2)
+            s.ignore(32); // serviceReferenceHash
+        tx.nEnd = nTotal - s.size();
+        vTx.push_back(tx);
+    }
+    nBlockSig = nTotal - s.size();
+    s.ignore(ReadCompactSize(s));
+    nSize = nTotal - s.size();
+
+    vTxHash.resize(vTx.size());
+    ForTransactionHashRanges(vTx.size(), [this](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++)
+            vTxHash[i] = Hash(pbegin + vTx[i].nBegin, pbegin + vTx[i].nEnd);
+    });
+}
+
+COutPoint CBlockView::GetPrevout(size_t nTx, size_t nIn) const
+{
+    const uint8_t *pin = pbegin + vInputs[vTx[nTx].nFirstInput + nIn];
+    CMemoryReader s(SER_NETWORK, PROTOCOL_VERSION, pin, pin + 36);
+    COutPoint prevout;
+    s >> prevout;
+    return prevout;
+}
+
+CTxOut CBlockView::GetOutput(size_t nTx, size_t nOut) const
+{
+    CMemoryReader s(SER_NETWORK, PROTOCOL_VERSION, pbegin + vOutputs[vTx[nTx].nFirstOutput + nOut], pbegin + nSize);
+    CTxOut txout;
+    s >> txout;
+    return txout;
+}
+
+CTransactionRef CBlockView::GetTransaction(size_t nTx) const
+{
+    CMemoryReader s(SER_NETWORK, PROTOCOL_VERSION, pbegin + vTx[nTx].nBegin, pbegin + vTx[nTx].nEnd);
+    return std::make_shared<CTransaction>(deserialize, vTxHash[nTx], s);
+}
+
+void CBlockView::GetBlock(CBlock &block, const std::vector<CTransactionRef> &vtxKnown) const
+{
+    block.SetNull();
+    *(CBlockHeader *)&block = header;
+    block.vtx.reserve(vTx.size());
+    for (size_t i = 0; i < vTx.size(); i++)
+    {
+        if (i < vtxKnown.size() && vtxKnown[i])
+            block.vtx.push_back(vtxKnown[i]);
+        else
+            block.vtx.push_back(GetTransaction(i));
+    }
+    CMemoryReader s(SER_NETWORK, PROTOCOL_VERSION, pbegin + nBlockSig, pbegin + nSize);
+    s >> block.vchBlockSig;
+    block.fTxHashesCached = true;
+}
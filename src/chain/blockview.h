@@ -0,0 +1,64 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAIN_BLOCKVIEW_H
+#define BITCOIN_CHAIN_BLOCKVIEW_H
+
+#include "chain/block.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A serialized block indexed where it lies, for example in the receive buffer of a peer. One pass over the bytes
+ * records where every transaction, input and output starts and hashes the transactions straight from the bytes;
+ * a transaction is only deserialized when it is asked for. The bytes must outlive the view. A malformed block
+ * throws std::ios_base::failure like deserializing a CBlock from them would.
+ */
+class CBlockView
+{
+public:
+    CBlockView(const uint8_t *pbeginIn, const uint8_t *pendIn);
+
+    const CBlockHeader &GetHeader() const { return header; }
+    size_t GetTxCount() const { return vTx.size(); }
+    const uint256 &GetTxHash(size_t nTx) const { return vTxHash[nTx]; }
+    size_t GetInputCount(size_t nTx) const { return vTx[nTx].nInputs; }
+    size_t GetOutputCount(size_t nTx) const { return vTx[nTx].nOutputs; }
+    //! The bytes of the block, from the header to the block signature
+    size_t GetSerializedSize() const { return nSize; }
+
+    COutPoint GetPrevout(size_t nTx, size_t nIn) const;
+    CTxOut GetOutput(size_t nTx, size_t nOut) const;
+    CTransactionRef GetTransaction(size_t nTx) const;
+
+    /**
+     * Materialize the block. A transaction vtxKnown has at its index is taken instead of being deserialized, it
+     * has to be the one with the hash GetTxHash() of that index. vtxKnown may be shorter than the block.
+     */
+    void GetBlock(CBlock &block, const std::vector<CTransactionRef> &vtxKnown = {}) const;
+
+private:
+    //! Offsets from the start of the block, 32 bits are plenty for any block a peer can send
+    struct CTxOffsets
+    {
+        uint32_t nBegin;
+        uint32_t nEnd;
+        uint32_t nFirstInput; //! index of the offset of its first input in vInputs
+        uint32_t nInputs;
+        uint32_t nFirstOutput; //! index of the offset of its first output in vOutputs
+        uint32_t nOutputs;
+    };
+
+    const uint8_t *pbegin;
+    size_t nSize;
+    CBlockHeader header;
+    std::vector<CTxOffsets> vTx;
+    std::vector<uint32_t> vInputs;
+    std::vector<uint32_t> vOutputs;
+    std::vector<uint256> vTxHash;
+    uint32_t nBlockSig;
+};
+
+#endif // BITCOIN_CHAIN_BLOCKVIEW_H
@@ -29,6 +29,8 @@ void CChain::SetTip(CBlockIndex *pindex)
     {
         vChain.clear();
         tip = nullptr;
+        // the block index entries may be unloaded next and their memory reused
+        std::atomic_store(&locatorCached, std::shared_ptr<const CCachedLocator>());
         return;
     }
     vChain.resize(pindex->nHeight + 1);
@@ -42,12 +44,19 @@ void CChain::SetTip(CBlockIndex *pindex)
 
 CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const
 {
+    if (!pindex)
+        pindex = Tip();
+    if (!pindex)
+        return CBlockLocator();
+    // every peer that syncs from us is sent the locator of the same best header
+    std::shared_ptr<const CCachedLocator> cached = std::atomic_load(&locatorCached);
+    if (cached && cached->first == pindex)
+        return cached->second;
+    const CBlockIndex *pindexLocator = pindex;
+
     int nStep = 1;
     std::vector<uint256> vHave;
     vHave.reserve(32);
-
-    if (!pindex)
-        pindex = Tip();
     while (pindex)
     {
         vHave.push_back(pindex->GetBlockHash());
@@ -70,7 +79,9 @@ CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const
             nStep *= 2;
     }
 
-    return CBlockLocator(vHave);
+    cached = std::make_shared<const CCachedLocator>(pindexLocator, CBlockLocator(vHave));
+    std::atomic_store(&locatorCached, cached);
+    return cached->second;
 }
 
 const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const
@@ -81,7 +92,13 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const
     }
     if (pindex->nHeight > Height())
         pindex = pindex->GetAncestor(Height());
+    // once an ancestor is in the chain all of its ancestors are, so skip back as long as the skip target is not
     while (pindex && !Contains(pindex))
-        pindex = pindex->pprev;
+    {
+        if (pindex->pskip && !Contains(pindex->pskip))
+            pindex = pindex->pskip;
+        else
+            pindex = pindex->pprev;
+    }
     return pindex;
 }
@@ -29,6 +29,8 @@
 #include "uint256.h"
 
 #include <atomic>
+#include <memory>
+#include <utility>
 #include <vector>
 
 /** An in-memory indexed chain of blocks. */
@@ -39,6 +41,11 @@ private:
 
     std::atomic<CBlockIndex *> tip;
 
+    /** The last locator GetLocator built and the entry it is for, only accessed through std::atomic_load and
+     *  std::atomic_store. The ancestors of an entry never change, so it stays valid while the entry exists */
+    typedef std::pair<const CBlockIndex *, CBlockLocator> CCachedLocator;
+    mutable std::shared_ptr<const CCachedLocator> locatorCached;
+
 public:
     CChain() : tip(nullptr) {}
     ~CChain()
@@ -75,6 +82,7 @@ public:
     {
         vChain = a.vChain;
         tip.store(a.tip.load());
+        std::atomic_store(&locatorCached, std::shared_ptr<const CCachedLocator>());
     }
 
     /** Efficiently check whether a block is present in this chain. */
@@ -93,7 +101,8 @@ public:
     /** Set/initialize a chain with a given tip. */
     void SetTip(CBlockIndex *pindex);
 
-    /** Return a CBlockLocator that refers to a block in this chain (by default the tip). */
+    /** Return a CBlockLocator that refers to a block in this chain (by default the tip), the locator of the entry
+     *  asked for last is reused */
     CBlockLocator GetLocator(const CBlockIndex *pindex = nullptr) const;
 
     /** Find the last common block between this chain and a block index entry. */
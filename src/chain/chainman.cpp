@@ -17,6 +17,9 @@
  */
 
 #include "chainman.h"
+#include "blockcompress.h"
+#include "blockfilemap.h"
+#include "blockimport.h"
 #include "checkpoints.h"
 #include "consensus/consensus.h"
 #include "init.h"
@@ -24,21 +27,43 @@
 #include "main.h"
 #include "net/messages.h"
 #include "net/nodestate.h"
+#include "net/orphanpool.h"
 #include "networks/netman.h"
 #include "processblock.h"
 #include "processheader.h"
 #include "txmempool.h"
 #include "undo.h"
 
+#include <thread>
+
 CBlockIndex *CChainManager::LookupBlockIndex(const uint256 &hash)
 {
-    READLOCK(cs_mapBlockIndex);
-    BlockMap::iterator mi = mapBlockIndex.find(hash);
-    if (mi == mapBlockIndex.end())
-        return nullptr;
-    return mi->second; // I can return this CBlockIndex because header pointers are never deleted
+    // no lock needed, the map supports lookups concurrent with the writer that holds
+    // cs_mapBlockIndex and block index entries are never deleted while the node runs
+    return mapBlockIndex.Lookup(hash);
 }
 
+void CChainManager::PublishTip()
+{
+    std::shared_ptr<CChainTip> tip = std::make_shared<CChainTip>();
+    CBlockIndex *pindex = chainActive.Tip();
+    if (pindex)
+    {
+        tip->pindex = pindex;
+        tip->hash = pindex->GetBlockHash();
+        tip->nHeight = pindex->nHeight;
+        tip->nTime = pindex->GetBlockTime();
+        tip->nMedianTimePast = pindex->GetMedianTimePast();
+        tip->nChainWork = pindex->nChainWork;
+        tip->fInitialBlockDownload = pindexBestHeader == nullptr || IsInitialBlockDownload();
+    }
+    if (pcoinsTip)
+    {
+        tip->nCoinsCacheUsage = pcoinsTip->DynamicMemoryUsage();
+        tip->nCoinsCacheSize = pcoinsTip->GetCacheSize();
+    }
+    std::atomic_store(&tipPublished, CChainTipRef(std::move(tip)));
+}
 
 CBlockIndex *CChainManager::AddToBlockIndex(const CBlockHeader &block)
 {
@@ -47,24 +72,28 @@ CBlockIndex *CChainManager::AddToBlockIndex(const CBlockHeader &block)
     uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
-        return it->second;
+        return *it;
 
     // Construct new block index object
-    CBlockIndex *pindexNew = new CBlockIndex(block);
+    CBlockIndex *pindexNew = blockIndexArena.Allocate(hash, block);
     assert(pindexNew);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
+    mapBlockIndex.insert(pindexNew);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
-        pindexNew->pprev = (*miPrev).second;
+        pindexNew->pprev = *miPrev;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
+        pindexNew->LinkToParent();
+        setBlockIndexLeaves.erase(pindexNew->pprev);
     }
+    setBlockIndexLeaves.insert(pindexNew);
+    pindexNew->BuildMedianTimePast();
+    pindexNew->BuildVersionCounts(pnetMan->getActivePaymentNetwork()->GetConsensus().nMajorityWindow);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
@@ -77,17 +106,12 @@ CBlockIndex *CChainManager::AddToBlockIndex(const CBlockHeader &block)
 
 CBlockIndex *CChainManager::FindForkInGlobalIndex(const CChain &chain, const CBlockLocator &locator)
 {
-    READLOCK(cs_mapBlockIndex);
-    // Find the first block the caller has in the main chain
+    // Find the first block the caller has in the main chain, the lookups need no lock
     for (auto const &hash : locator.vHave)
     {
-        BlockMap::iterator mi = mapBlockIndex.find(hash);
-        if (mi != mapBlockIndex.end())
-        {
-            CBlockIndex *pindex = (*mi).second;
-            if (chain.Contains(pindex))
-                return pindex;
-        }
+        CBlockIndex *pindex = mapBlockIndex.Lookup(hash);
+        if (pindex && chain.Contains(pindex))
+            return pindex;
     }
     return chain.Genesis();
 }
@@ -119,12 +143,11 @@ CBlockIndex *CChainManager::InsertBlockIndex(uint256 hash)
     // Return existing
     BlockMap::iterator mi = mapBlockIndex.find(hash);
     if (mi != mapBlockIndex.end())
-        return (*mi).second;
+        return *mi;
 
     // Create new
-    CBlockIndex *pindexNew = new CBlockIndex();
-    mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
+    CBlockIndex *pindexNew = blockIndexArena.Allocate(hash);
+    mapBlockIndex.insert(pindexNew);
 
     return pindexNew;
 }
@@ -142,6 +165,8 @@ bool CChainManager::InitBlockIndex(const CNetworkTemplate &chainparams)
 
     // Use the provided setting for -txindex in the new database
     pblocktree->WriteFlag("txindex", true);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -151,12 +176,14 @@ bool CChainManager::InitBlockIndex(const CNetworkTemplate &chainparams)
         {
             CBlock block = chainparams.GenesisBlock();
             // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            std::vector<unsigned char> vBlockData;
+            uint32_t nSizeField;
+            StoreBlockData(block, fCompressBlocks, vBlockData, nSizeField);
             CDiskBlockPos blockPos;
             CValidationState state;
-            if (!FindBlockPos(state, blockPos, nBlockSize + 8, 0, block.GetBlockTime()))
+            if (!FindBlockPos(state, blockPos, vBlockData.size() + 8, 0, block.GetBlockTime()))
                 return error("InitBlockIndex(): FindBlockPos failed");
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!WriteBlockToDisk(vBlockData, nSizeField, blockPos, chainparams.MessageStart()))
                 return error("InitBlockIndex(): writing genesis block to disk failed");
             CBlockIndex *pindex = AddToBlockIndex(block);
 
@@ -218,16 +245,36 @@ bool CChainManager::LoadBlockIndexDB()
     // Calculate nChainWork
     std::vector<std::pair<int, CBlockIndex *> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<uint256, CBlockIndex *> &item : mapBlockIndex)
+    for (CBlockIndex *pindex : mapBlockIndex)
     {
-        CBlockIndex *pindex = item.second;
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
     }
     std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex *> &item : vSortedByHeight)
+
+    // The proof of each block only depends on its own nBits, compute them all in parallel
+    // so the height ordered pass below only has to add them up.
+    std::vector<arith_uint256> vBlockProof(vSortedByHeight.size());
     {
-        CBlockIndex *pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        const size_t nThreads = std::max(1, GetNumCores());
+        const size_t nPerThread = (vSortedByHeight.size() + nThreads - 1) / nThreads;
+        std::vector<std::thread> vThreads;
+        for (size_t nFirst = 0; nFirst < vSortedByHeight.size(); nFirst += nPerThread)
+        {
+            const size_t nEnd = std::min(vSortedByHeight.size(), nFirst + nPerThread);
+            vThreads.emplace_back([&vSortedByHeight, &vBlockProof, nFirst, nEnd]() {
+                for (size_t i = nFirst; i < nEnd; i++)
+                    vBlockProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+            });
+        }
+        for (auto &thread : vThreads)
+            thread.join();
+    }
+
+    const int nMajorityWindow = pnetMan->getActivePaymentNetwork()->GetConsensus().nMajorityWindow;
+    for (size_t i = 0; i < vSortedByHeight.size(); i++)
+    {
+        CBlockIndex *pindex = vSortedByHeight[i].second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vBlockProof[i];
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0)
@@ -261,6 +308,16 @@ bool CChainManager::LoadBlockIndexDB()
         if (pindex->pprev)
         {
             pindex->BuildSkip();
+            pindex->LinkToParent();
+            setBlockIndexLeaves.erase(pindex->pprev);
+        }
+        setBlockIndexLeaves.insert(pindex);
+        pindex->BuildMedianTimePast();
+        pindex->BuildVersionCounts(nMajorityWindow);
+        // blocks that were connected have the types of their ancestors on disk
+        if (pindex->IsValid(BLOCK_VALID_SCRIPTS))
+        {
+            pindex->BuildTypeLinks();
         }
         if (pindex->IsValid(BLOCK_VALID_TREE) &&
             (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
@@ -273,6 +330,8 @@ bool CChainManager::LoadBlockIndexDB()
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
     LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
+    if (g_blockfilemapper)
+        g_blockfilemapper->SetFirstOpenFile(nLastBlockFile);
     for (int nFile = 0; nFile <= nLastBlockFile; nFile++)
     {
         pblocktree->ReadBlockFileInfo(nFile, vinfoBlockFile[nFile]);
@@ -291,12 +350,16 @@ bool CChainManager::LoadBlockIndexDB()
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
-    for (auto const &item : mapBlockIndex)
+    for (CBlockIndex *pindex : mapBlockIndex)
     {
-        CBlockIndex *pindex = item.second;
         if (pindex->nStatus & BLOCK_HAVE_DATA)
         {
             setBlkDataFiles.insert(pindex->nFile);
@@ -317,13 +380,18 @@ bool CChainManager::LoadBlockIndexDB()
     if (fReindexing)
         fReindex = true;
 
+    // A node that stopped while writing the chainstate has to finish that write before its best block is known
+    if (!ReplayBlocks(*pnetMan->getActivePaymentNetwork(), pcoinsdbview.get()))
+        return false;
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
     {
         return true;
     }
-    chainActive.SetTip(it->second);
+    chainActive.SetTip(*it);
+    PublishTip();
 
     PruneBlockIndexCandidates();
 
@@ -341,65 +409,38 @@ bool CChainManager::LoadExternalBlockFile(const CNetworkTemplate &chainparams, F
     int nLoaded = 0;
     try
     {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof())
+        // This takes over fileIn and closes it when done. The file is read, and its blocks deserialized and
+        // hashed, on threads of its own while the blocks found before are processed here in file order.
+        CBlockImporter importer(fileIn, chainparams.MessageStart());
+        CImportedBlock imported;
+        while (importer.Next(imported))
         {
             if (shutdown_threads.load())
             {
                 break;
             }
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
             try
             {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, std::begin(chainparams.MessageStart()), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            }
-            catch (const std::exception &)
-            {
-                // no valid block header found; don't complain
-                break;
-            }
-            try
-            {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+                    dbp->nPos = imported.nPos;
+                CBlock &block = *imported.pblock;
 
                 // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
+                const uint256 hash = imported.hash;
                 if (hash != chainparams.GetConsensus().hashGenesisBlock &&
                     mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end())
                 {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
+                    LogPrint(Logging::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
+                        hash.ToString(), block.hashPrevBlock.ToString());
                     if (dbp)
                         mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
                     continue;
                 }
 
                 // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)
+                CBlockIndex *pindexKnown = LookupBlockIndex(hash);
+                if (pindexKnown == nullptr || (pindexKnown->nStatus & BLOCK_HAVE_DATA) == 0)
                 {
                     CValidationState state;
                     if (ProcessNewBlock(state, chainparams, NULL, &block, true, dbp))
@@ -408,10 +449,10 @@ bool CChainManager::LoadExternalBlockFile(const CNetworkTemplate &chainparams, F
                         break;
                 }
                 else if (hash != chainparams.GetConsensus().hashGenesisBlock &&
-                         mapBlockIndex[hash]->nHeight % 1000 == 0)
+                         pindexKnown->nHeight % 1000 == 0)
                 {
                     LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(),
-                        mapBlockIndex[hash]->nHeight);
+                        pindexKnown->nHeight);
                 }
                 // Recursively process earlier encountered successors of this block
                 std::deque<uint256> queue;
@@ -462,15 +503,21 @@ void CChainManager::UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(nullptr);
+    PublishTip();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
     mempool.clear();
-    mapOrphanTransactions.clear();
-    mapOrphanTransactionsByPrev.clear();
+    orphanpool.Clear();
     nSyncStarted = 0;
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    fHavePruned = false;
+    if (g_blockfilemapper)
+    {
+        g_blockfilemapper->SetFirstOpenFile(0);
+        g_blockfilemapper->Clear();
+    }
     nBlockSequenceId = 1;
     mapBlockSource.clear();
     mapBlocksInFlight.clear();
@@ -487,10 +534,65 @@ void CChainManager::UnloadBlockIndex()
 
     {
         WRITELOCK(cs_mapBlockIndex);
-        for (auto &entry : mapBlockIndex)
+        mapBlockIndex.clear();
+        setBlockIndexLeaves.clear();
+        blockIndexArena.Clear();
+    }
+}
+
+size_t CChainManager::PruneStaleHeaders(const arith_uint256 &nMinWork,
+    const std::set<const CBlockIndex *> &setProtected)
+{
+    AssertLockHeld(cs_main);
+    std::vector<uint256> vErased;
+    {
+        WRITELOCK(cs_mapBlockIndex);
+        // readers that looked up an entry of the last pass had a whole interval to let go of it
+        blockIndexArena.Reclaim();
+        mapBlockIndex.ReleaseReplacedTables();
+
+        const std::vector<CBlockIndex *> vLeaves(setBlockIndexLeaves.begin(), setBlockIndexLeaves.end());
+        for (CBlockIndex *pindexTip : vLeaves)
         {
-            delete entry.second;
+            if (pindexTip->nChainWork >= nMinWork || chainActive.Contains(pindexTip))
+                continue;
+            CPrunedHeaderTip tip;
+            tip.hash = pindexTip->GetBlockHash();
+            tip.nHeight = pindexTip->nHeight;
+            const CBlockIndex *pindexFork = chainActive.FindFork(pindexTip);
+            tip.nBranchLen = pindexFork ? pindexTip->nHeight - pindexFork->nHeight : pindexTip->nHeight;
+            tip.nHeaders = 0;
+            tip.nTime = GetTime();
+
+            CBlockIndex *pindex = pindexTip;
+            while (pindex->pprev && pindex->pchild == nullptr &&
+                   !(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)) && !chainActive.Contains(pindex) &&
+                   pindex != pindexBestHeader && !setProtected.count(pindex))
+            {
+                CBlockIndex *pindexPrev = pindex->pprev;
+                pindex->UnlinkFromParent();
+                setBlockIndexLeaves.erase(pindex);
+                if (pindexPrev->pchild == nullptr)
+                    setBlockIndexLeaves.insert(pindexPrev);
+                setDirtyBlockIndex.erase(pindex);
+                setBlockIndexCandidates.erase(pindex);
+                mapBlocksUnlinked.erase(pindex);
+                vErased.push_back(pindex->GetBlockHash());
+                mapBlockIndex.erase(pindex->GetBlockHash());
+                blockIndexArena.Retire(pindex);
+                tip.nHeaders++;
+                pindex = pindexPrev;
+            }
+            if (tip.nHeaders == 0)
+                continue;
+            headerPruneStats.nHeaders += tip.nHeaders;
+            headerPruneStats.nBranches++;
+            headerPruneStats.dequeRecentTips.push_back(tip);
+            if (headerPruneStats.dequeRecentTips.size() > MAX_PRUNED_HEADER_TIPS)
+                headerPruneStats.dequeRecentTips.pop_front();
         }
-        mapBlockIndex.clear();
     }
+    if (!vErased.empty() && !pblocktree->EraseBlockIndexes(vErased))
+        LogPrintf("%s: failed to erase %u pruned headers from the block index database\n", __func__, vErased.size());
+    return vErased.size();
 }
@@ -19,19 +19,70 @@
 #ifndef CHAINMAN_H
 #define CHAINMAN_H
 
-#include <unordered_map>
-
 #include "chain.h"
+#include "chain/blockmap.h"
 #include "networks/networktemplate.h"
 #include "txdb.h"
 
+#include <deque>
+#include <memory>
+#include <set>
+
+typedef CBlockMap BlockMap;
+
+/** -prunestaleheaders default, in blocks of work behind the tip */
+static const int DEFAULT_STALE_HEADER_DEPTH = 1000;
+/** Seconds between two passes over the side branches of headers */
+static const int64_t STALE_HEADER_PRUNE_INTERVAL = 10 * 60;
+/** Pruned branches getchaintips reports, the most recent ones */
+static const size_t MAX_PRUNED_HEADER_TIPS = 100;
+
+/** The tip of a side branch of headers that was pruned */
+struct CPrunedHeaderTip
+{
+    uint256 hash;
+    int nHeight;
+    //! blocks between the tip and chainActive as it was when the branch was pruned
+    int nBranchLen;
+    //! headers dropped from the branch, fewer than nBranchLen when a part of it is still needed
+    size_t nHeaders;
+    int64_t nTime;
+};
 
-struct BlockHasher
+struct CHeaderPruneStats
 {
-    size_t operator()(const uint256 &hash) const { return hash.GetCheapHash(); }
+    uint64_t nHeaders;
+    uint64_t nBranches;
+    std::deque<CPrunedHeaderTip> dequeRecentTips;
+
+    CHeaderPruneStats() : nHeaders(0), nBranches(0) {}
 };
-typedef std::unordered_map<uint256, CBlockIndex *, BlockHasher> BlockMap;
 
+/** The chain tip as readers that must not wait for validation see it. A new one is published after
+ *  every change of the tip, a published one is never modified. */
+struct CChainTip
+{
+    //! the tip itself, nullptr while there is none. Block index entries outlive the snapshot
+    CBlockIndex *pindex;
+    uint256 hash;
+    //! -1 while there is no tip
+    int nHeight;
+    int64_t nTime;
+    int64_t nMedianTimePast;
+    arith_uint256 nChainWork;
+    //! IsInitialBlockDownload() when the tip was published, true while there is no tip
+    bool fInitialBlockDownload;
+    //! the coins cache as the tip was published, a flush in between is not seen before the next tip
+    size_t nCoinsCacheUsage;
+    unsigned int nCoinsCacheSize;
+
+    CChainTip()
+        : pindex(nullptr), nHeight(-1), nTime(0), nMedianTimePast(0), fInitialBlockDownload(true),
+          nCoinsCacheUsage(0), nCoinsCacheSize(0)
+    {
+    }
+};
+typedef std::shared_ptr<const CChainTip> CChainTipRef;
 
 /** Manages the BlockMap and CChain's for a given protocol. */
 class CChainManager
@@ -39,10 +90,16 @@ class CChainManager
 public:
     CSharedCriticalSection cs_mapBlockIndex;
 
-    /** map containing all block indexs ever seen for this chain */
+    /** map containing all block indexs ever seen for this chain, Lookup() on it needs no lock */
     BlockMap mapBlockIndex GUARDED_BY(cs_mapBlockIndex);
 
-    /** The currently-connected chain of blocks (protected by cs_main). */
+    /** owns every CBlockIndex in mapBlockIndex */
+    CBlockIndexArena blockIndexArena GUARDED_BY(cs_mapBlockIndex);
+
+    /** the entries of mapBlockIndex without children, the tips of all its branches */
+    std::set<CBlockIndex *> setBlockIndexLeaves GUARDED_BY(cs_mapBlockIndex);
+
+    /** The currently-connected chain of blocks (protected by cs_main), see GetPublishedTip() for lock free reads */
     CChain chainActive;
 
     /** Best header we've seen so far (used for getheaders queries' starting points). */
@@ -54,40 +111,46 @@ public:
     /** Global variable that points to the active block tree (protected by cs_main) */
     std::unique_ptr<CBlockTreeDB> pblocktree;
 
+    /** What PruneStaleHeaders() dropped so far (protected by cs_main) */
+    CHeaderPruneStats headerPruneStats;
+
 private:
+    /** the last published tip, only accessed through std::atomic_load and std::atomic_store */
+    CChainTipRef tipPublished;
+
     bool LoadBlockIndexDB();
 
 public:
     CChainManager()
     {
         mapBlockIndex.clear();
+        setBlockIndexLeaves.clear();
         chainActive = CChain();
         pindexBestHeader = NULL;
         pcoinsTip.reset();
         pblocktree.reset();
+        tipPublished = std::make_shared<const CChainTip>();
     }
 
     ~CChainManager()
     {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+        // block headers, the entries themselves are released with the arena
         mapBlockIndex.clear();
-        delete pindexBestHeader;
+        setBlockIndexLeaves.clear();
         pcoinsTip.reset();
         pblocktree.reset();
     }
 
-    void operator=(const CChainManager &oldMan)
-    {
-        WRITELOCK(cs_mapBlockIndex);
-        mapBlockIndex = oldMan.mapBlockIndex;
-        chainActive = oldMan.chainActive;
-        pindexBestHeader = oldMan.pindexBestHeader;
-        pcoinsTip.reset(oldMan.pcoinsTip.get());
-        pblocktree.reset(oldMan.pblocktree.get());
-    }
+    // the entries of mapBlockIndex live in blockIndexArena, a copy would point into the arena of the original
+    CChainManager(const CChainManager &) = delete;
+    CChainManager &operator=(const CChainManager &) = delete;
+
+    /** Publish the tip of chainActive for GetPublishedTip(), called with cs_main held after every change of it */
+    void PublishTip();
+
+    /** The tip as of the last PublishTip(). Needs no lock and never returns nullptr, so it can lag the
+     *  tip by a block that is being connected but never blocks on validation */
+    CChainTipRef GetPublishedTip() const { return std::atomic_load(&tipPublished); }
 
     /** Look up the block index entry for a given block hash. returns nullptr if it does not exist */
     CBlockIndex *LookupBlockIndex(const uint256 &hash);
@@ -115,6 +178,15 @@ public:
 
     /** Unload database information */
     void UnloadBlockIndex();
+
+    /**
+     * Drop the side branches of headers whose tip has less work than nMinWork from mapBlockIndex and the block tree
+     * database. A branch is taken apart from its tip down and the first entry that has block data, is in
+     * chainActive, has another branch on top of it or is in setProtected stays with everything under it. The
+     * entries dropped in the pass before become reusable, the ones of this pass stay valid for lock free readers
+     * until the next. Returns the number of headers dropped. Precondition: cs_main is held.
+     */
+    size_t PruneStaleHeaders(const arith_uint256 &nMinWork, const std::set<const CBlockIndex *> &setProtected);
 };
 
 #endif // CHAINMAN_H
@@ -63,4 +63,6 @@ public:
     std::string ToString() const;
 };
 
+SERIALIZE_AS_MEMORY_IMAGE(COutPoint, 36);
+
 #endif // OUTPOINT_H
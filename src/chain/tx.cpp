@@ -21,6 +21,7 @@
 #include "chain/tx.h"
 
 #include "args.h"
+#include "blockwriter.h"
 #include "chain/chain.h"
 #include "consensus/consensus.h"
 #include "crypto/hash.h"
@@ -36,28 +37,6 @@
 #include "wallet/wallet.h"
 
 
-struct serializeTx
-{
-    int32_t nVersion;
-    unsigned int nTime;
-    std::vector<CTxIn> vin;
-    std::vector<CTxOut> vout;
-    uint32_t nLockTime;
-
-    ADD_SERIALIZE_METHODS
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream &s, Operation ser_action)
-    {
-        READWRITE(*const_cast<int32_t *>(&this->nVersion));
-        nVersion = this->nVersion;
-        READWRITE(*const_cast<uint32_t *>(&this->nTime));
-        READWRITE(*const_cast<std::vector<CTxIn> *>(&vin));
-        READWRITE(*const_cast<std::vector<CTxOut> *>(&vout));
-        READWRITE(*const_cast<uint32_t *>(&nLockTime));
-    }
-};
-
 std::string COutPoint::ToString() const { return strprintf("COutPoint(%s, %u)", hash.ToString().substr(0, 10), n); }
 CTxIn::CTxIn(COutPoint prevoutIn, CScript scriptSigIn, uint32_t nSequenceIn)
 {
@@ -101,37 +80,13 @@ std::string CTxOut::ToString() const
         "CTxOut(nValue=%d.%08d, scriptPubKey=%s)", nValue / COIN, nValue % COIN, HexStr(scriptPubKey).substr(0, 30));
 }
 
-uint256 CTransaction::GetHash() const
-{
-    if (this->nVersion == 1)
-    {
-        serializeTx txtohash;
-        txtohash.nVersion = this->nVersion;
-        txtohash.nTime = this->nTime;
-        txtohash.vin = this->vin;
-        txtohash.vout = this->vout;
-        txtohash.nLockTime = this->nLockTime;
-        return SerializeHash(txtohash);
-    }
-    return SerializeHash(*this);
-}
+uint256 CTransaction::GetHash() const { return SerializeHash(*this); }
 
 void CTransaction::UpdateHash() const
 {
-    if (this->nVersion == 1)
-    {
-        serializeTx txtohash;
-        txtohash.nVersion = this->nVersion;
-        txtohash.nTime = this->nTime;
-        txtohash.vin = this->vin;
-        txtohash.vout = this->vout;
-        txtohash.nLockTime = this->nLockTime;
-        *const_cast<uint256 *>(&hash) = SerializeHash(txtohash);
-    }
-    else
-    {
-        *const_cast<uint256 *>(&hash) = SerializeHash(*this);
-    }
+    *const_cast<uint256 *>(&hash) = SerializeHash(*this);
+    SetCachedLegacySigOpCount(-1);
+    SetCachedP2SHSigOpCount(-1);
 }
 
 CTransaction::CTransaction()
@@ -157,6 +112,8 @@ CTransaction &CTransaction::operator=(const CTransaction &tx)
     *const_cast<unsigned int *>(&nLockTime) = tx.nLockTime;
     *const_cast<uint256 *>(&hash) = tx.hash;
     *const_cast<uint256 *>(&serviceReferenceHash) = tx.serviceReferenceHash;
+    SetCachedLegacySigOpCount(-1);
+    SetCachedP2SHSigOpCount(-1);
 
     return *this;
 }
@@ -254,14 +211,6 @@ uint64_t CTransaction::GetCoinAge(uint64_t nCoinAge, bool byValue) const
         if (!pnetMan->getChainActive()->pblocktree->ReadTxIndex(txin.prevout.hash, txindex))
             continue; // previous transaction not in main chain
 
-        // Read block header
-        CBlock block;
-        CDiskBlockPos blockPos(txindex.nFile, txindex.nPos);
-        if (!ReadBlockFromDisk(block, blockPos, pnetMan->getActivePaymentNetwork()->GetConsensus()))
-            return false; // unable to read block of previous transaction
-        if (block.GetBlockTime() + pnetMan->getActivePaymentNetwork()->getStakeMinAge() > nTime)
-            continue; // only count coins meeting min age requirement
-
         CTransaction txPrev;
         uint256 blockHashOfTx;
         if (!GetTransaction(
@@ -270,6 +219,13 @@ uint64_t CTransaction::GetCoinAge(uint64_t nCoinAge, bool byValue) const
             return false;
         }
 
+        // The block time comes from the index, the block itself may have been pruned
+        CBlockIndex *pindexPrev = pnetMan->getChainActive()->LookupBlockIndex(blockHashOfTx);
+        if (!pindexPrev)
+            return false; // unable to find block of previous transaction
+        if (pindexPrev->GetBlockTime() + pnetMan->getActivePaymentNetwork()->getStakeMinAge() > nTime)
+            continue; // only count coins meeting min age requirement
+
         if (nTime < txPrev.nTime)
             return false; // Transaction timestamp violation
 
@@ -307,14 +263,6 @@ bool CTransaction::GetCoinAge(uint64_t &nCoinAge) const
         if (!pnetMan->getChainActive()->pblocktree->ReadTxIndex(txin.prevout.hash, txindex))
             continue; // previous transaction not in main chain
 
-        // Read block header
-        CBlock block;
-        CDiskBlockPos blockPos(txindex.nFile, txindex.nPos);
-        if (!ReadBlockFromDisk(block, blockPos, pnetMan->getActivePaymentNetwork()->GetConsensus()))
-            return false; // unable to read block of previous transaction
-        if (block.GetBlockTime() + pnetMan->getActivePaymentNetwork()->getStakeMinAge() > nTime)
-            continue; // only count coins meeting min age requirement
-
         CTransaction txPrev;
         uint256 blockHashOfTx;
         if (!GetTransaction(
@@ -323,6 +271,13 @@ bool CTransaction::GetCoinAge(uint64_t &nCoinAge) const
             return false;
         }
 
+        // The block time comes from the index, the block itself may have been pruned
+        CBlockIndex *pindexPrev = pnetMan->getChainActive()->LookupBlockIndex(blockHashOfTx);
+        if (!pindexPrev)
+            return false; // unable to find block of previous transaction
+        if (pindexPrev->GetBlockTime() + pnetMan->getActivePaymentNetwork()->getStakeMinAge() > nTime)
+            continue; // only count coins meeting min age requirement
+
         if (nTime < txPrev.nTime)
             return false; // Transaction timestamp violation
 
@@ -365,6 +320,11 @@ bool GetTransaction(const uint256 &hash,
     CDiskTxPos postx;
     if (pnetMan->getChainActive()->pblocktree->ReadTxIndex(hash, postx))
     {
+        // Transactions that could still be spent were kept when the block file holding them was pruned
+        if (fHavePruned && pnetMan->getChainActive()->pblocktree->ReadPrunedTx(hash, hashBlock, txOut))
+            return true;
+        if (g_blockwriter)
+            g_blockwriter->WaitForWrite(false, postx);
         CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
         if (file.IsNull())
             return error("%s: OpenBlockFile failed", __func__);
@@ -25,6 +25,8 @@
 #include "txin.h"
 #include "txout.h"
 
+#include <atomic>
+
 /**
  * A TxId is the identifier of a transaction. Currently identical to TxHash but
  * differentiated for type safety.
@@ -35,6 +37,12 @@ struct TxId : public uint256
 };
 
 
+/** Tag for the deserializing constructor that leaves the hash to be computed later, in a batch */
+struct defer_hash_type
+{
+};
+constexpr defer_hash_type defer_hash{};
+
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
  */
@@ -43,6 +51,9 @@ class CTransaction
 private:
     /** Memory only. */
     const uint256 hash;
+    /** Memory only. The sigop counts of GetLegacySigOpCount() and GetP2SHSigOpCount(), -1 until they are counted */
+    mutable std::atomic<int32_t> nLegacySigOpCount{-1};
+    mutable std::atomic<int32_t> nP2SHSigOpCount{-1};
 
 public:
     // Default transaction version.
@@ -79,6 +90,16 @@ public:
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        SerializeFields(s, ser_action);
+        if (ser_action.ForRead())
+        {
+            UpdateHash();
+        }
+    }
+
+    template <typename Stream, typename Operation>
+    inline void SerializeFields(Stream &s, Operation ser_action)
     {
         READWRITE(*const_cast<int32_t *>(&this->nVersion));
         nVersion = this->nVersion;
@@ -90,10 +111,6 @@ public:
         {
             READWRITE(*const_cast<uint256 *>(&this->serviceReferenceHash));
         }
-        if (ser_action.ForRead())
-        {
-            UpdateHash();
-        }
     }
 
 
@@ -135,7 +152,34 @@ public:
         Unserialize(s);
     }
 
+    /** Deserialize without computing the hash, UpdateHash() must be called before the transaction is used */
+    template <typename Stream>
+    CTransaction(deserialize_type, defer_hash_type, Stream &s)
+    {
+        SerializeFields(s, CSerActionUnserialize());
+    }
+
+    /** Deserialize from bytes whose hash is already known, hashIn must be the hash of exactly the bytes read */
+    template <typename Stream>
+    CTransaction(deserialize_type, const uint256 &hashIn, Stream &s) : hash(hashIn)
+    {
+        SerializeFields(s, CSerActionUnserialize());
+    }
+
     bool IsNull() const { return vin.empty() && vout.empty(); }
+    /**
+     * The cached sigop counts, -1 if they were not counted yet. Only UpdateHash() and copying reset them, nothing
+     * notices a change to vin or vout. GetHash() does not need UpdateHash() either, so code that changes the scripts
+     * of a transaction that may have been counted already must call UpdateHash() itself, as IncrementExtraNonce()
+     * does for the coinbase.
+     */
+    int32_t GetCachedLegacySigOpCount() const { return nLegacySigOpCount.load(std::memory_order_relaxed); }
+    int32_t GetCachedP2SHSigOpCount() const { return nP2SHSigOpCount.load(std::memory_order_relaxed); }
+    void SetCachedLegacySigOpCount(int32_t nSigOps) const
+    {
+        nLegacySigOpCount.store(nSigOps, std::memory_order_relaxed);
+    }
+    void SetCachedP2SHSigOpCount(int32_t nSigOps) const { nP2SHSigOpCount.store(nSigOps, std::memory_order_relaxed); }
     const TxId GetId() const { return TxId(hash); }
     uint256 GetHash() const;
 
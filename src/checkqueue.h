@@ -21,6 +21,9 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -41,6 +44,13 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * By default all workers take their batches from one shared queue. A queue
+  * constructed with nDequesIn > 1 instead gives the master and each of the
+  * first nDequesIn-1 workers a deque of its own: Add() spreads a batch over
+  * the deques, every worker drains its own deque and then steals from the
+  * others, and the shared mutex is only taken when a worker runs dry.
+  * Workers beyond nDequesIn only steal.
   */
 template <typename T>
 class CCheckQueue
@@ -66,21 +76,95 @@ private:
     int nTotal;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Set by Stop(), workers return instead of waiting for more work
+    bool fQuit;
+
+    //! One worker's share of a batch, used as a LIFO by its owner and a FIFO by thieves
+    struct WorkerDeque
+    {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Per-worker deques, slot 0 belongs to the master. Empty unless work stealing is on.
+    std::vector<std::unique_ptr<WorkerDeque> > vDeques;
+
+    //! Number of workers that have claimed a deque, the master not included
+    std::atomic<unsigned int> nDequeWorkers;
+
+    //! Elements sitting in the deques, may briefly go negative while Add() is running
+    std::atomic<int64_t> nStealable;
+
+    //! Deque the next Add() starts at, only touched by the master
+    size_t nNextDeque;
+
+    //! Move up to nMax elements from one end of a deque into vChecks
+    unsigned int TakeFrom(WorkerDeque &wd, bool fOwner, std::vector<T> &vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(wd.mutex);
+        unsigned int nSize = wd.checks.size();
+        if (nSize == 0)
+            return 0;
+        // The owner keeps taking the work it was given, a thief takes half of what is left so the
+        // owner and the thief end up with about the same amount.
+        unsigned int nNow = fOwner ? std::min(nBatchSize, (nSize + 1) / 2) :
+                                     std::max(1U, std::min(nBatchSize, nSize / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++)
+        {
+            if (fOwner)
+            {
+                vChecks[i].swap(wd.checks.back());
+                wd.checks.pop_back();
+            }
+            else
+            {
+                vChecks[i].swap(wd.checks.front());
+                wd.checks.pop_front();
+            }
+        }
+        nStealable -= nNow;
+        return nNow;
+    }
+
+    //! Find work in the deques: our own first, then the others starting after ours
+    unsigned int TakeStealable(size_t nSelf, std::vector<T> &vChecks)
+    {
+        if (nSelf < vDeques.size())
+        {
+            unsigned int nNow = TakeFrom(*vDeques[nSelf], true, vChecks);
+            if (nNow)
+                return nNow;
+        }
+        for (size_t i = 1; i <= vDeques.size() && nStealable > 0; i++)
+        {
+            size_t nVictim = (nSelf + i) % vDeques.size();
+            if (nVictim == nSelf)
+                continue;
+            unsigned int nNow = TakeFrom(*vDeques[nVictim], false, vChecks);
+            if (nNow)
+                return nNow;
+        }
+        return 0;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
+        if (!vDeques.empty())
+            return LoopStealing(fMaster);
         boost::condition_variable &cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
@@ -93,7 +177,8 @@ private:
                 // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
                 if (nNow)
                 {
-                    fAllOk &= fOk;
+                    if (!fOk)
+                        fAllOk = false;
                     nTodo -= nNow;
                     if (nTodo == 0 && !fMaster)
                         // We processed the last element; inform the master it can exit and return the result
@@ -117,6 +202,8 @@ private:
                         // return the current status
                         return fRet;
                     }
+                    if (fQuit)
+                        return true;
                     nIdle++;
                     cond.wait(lock); // wait
                     nIdle--;
@@ -151,9 +238,75 @@ private:
         } while (true);
     }
 
+    /** Loop() for a work stealing queue, the shared mutex is only taken to go idle. */
+    bool LoopStealing(bool fMaster)
+    {
+        boost::condition_variable &cond = fMaster ? condMaster : condWorker;
+        size_t nSelf = fMaster ? 0 : (size_t)nDequeWorkers.fetch_add(1) + 1;
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nTotal++;
+        }
+        do
+        {
+            unsigned int nNow = TakeStealable(nSelf, vChecks);
+            if (nNow == 0)
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (nStealable > 0)
+                    continue;
+                if (fMaster && nTodo == 0)
+                {
+                    nTotal--;
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    return fRet;
+                }
+                if (fQuit)
+                    return true;
+                // Add() and the last worker to finish notify with the mutex held, after updating
+                // nStealable and nTodo, so checking them here under the mutex cannot miss a wakeup.
+                nIdle++;
+                cond.wait(lock);
+                nIdle--;
+                if (shutdown_threads.load() == true)
+                {
+                    return true;
+                }
+                continue;
+            }
+            // execute work
+            bool fOk = fAllOk;
+            for (auto &check : vChecks)
+                if (fOk)
+                    fOk = check();
+            vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster)
+            {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
+        } while (true);
+    }
+
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue, with work stealing across nDequesIn deques if that is more than one
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nDequesIn = 0)
+        : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn), fQuit(false), nDequeWorkers(0),
+          nStealable(0), nNextDeque(0)
+    {
+        if (nDequesIn > 1)
+        {
+            for (unsigned int i = 0; i < nDequesIn; i++)
+                vDeques.emplace_back(new WorkerDeque());
+        }
+    }
     //! Worker thread
     void Thread() { Loop(); }
     //! Wait until execution finishes, and return whether all evaluations were successful.
@@ -161,24 +314,65 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T> &vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (auto &check : vChecks)
+        if (vDeques.empty())
         {
-            queue.push_back(T());
-            check.swap(queue.back());
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (auto &check : vChecks)
+            {
+                queue.push_back(T());
+                check.swap(queue.back());
+            }
+            nTodo += vChecks.size();
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else if (vChecks.size() > 1)
+                condWorker.notify_all();
+            return;
         }
+
+        if (vChecks.empty())
+            return;
+        // Count the work before anyone can finish it, so nTodo cannot reach zero early
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        // Spread the batch in contiguous slices over the master and the workers that have a deque,
+        // starting one deque further on each time so that small batches are spread too.
+        size_t nParts = std::min(vDeques.size(), (size_t)nDequeWorkers + 1);
+        size_t nFirst = nNextDeque++ % nParts;
+        size_t nPos = 0;
+        for (size_t i = 0; i < nParts; i++)
+        {
+            size_t nEnd = (vChecks.size() * (i + 1) + nParts - 1) / nParts;
+            if (nEnd == nPos)
+                continue;
+            WorkerDeque &wd = *vDeques[(nFirst + i) % nParts];
+            {
+                boost::unique_lock<boost::mutex> lock(wd.mutex);
+                for (; nPos < nEnd; nPos++)
+                {
+                    wd.checks.push_back(T());
+                    vChecks[nPos].swap(wd.checks.back());
+                }
+            }
+        }
+        nStealable += vChecks.size();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        condWorker.notify_all();
     }
 
-    void Stop() { condWorker.notify_all(); }
+    void Stop()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fQuit = true;
+        condWorker.notify_all();
+    }
     ~CCheckQueue() {}
     bool IsIdle()
     {
         boost::unique_lock<boost::mutex> lock(mutex);
+        // A stealing worker that ran dry gives up its last batch before it goes idle, so it may still be on
+        // its way to the wait. That is harmless once nothing is left to do.
+        if (!vDeques.empty())
+            return (nTodo == 0 && fAllOk == true);
         return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
     }
 };
@@ -23,17 +23,62 @@
 #include "consensus/consensus.h"
 #include "memusage.h"
 #include "random.h"
+#include "streams.h"
 #include "util/logger.h"
+#include "util/trace.h"
 #include "util/util.h"
+
+#include <algorithm>
 #include <assert.h>
 
 
+/** What the hash of the set has for an unspent output */
+static std::vector<unsigned char> TxOutSetElement(const COutPoint &outpoint, const Coin &coin)
+{
+    std::vector<unsigned char> vch;
+    CVectorWriter ss(SER_DISK, 0, vch, 0);
+    ss << outpoint << coin;
+    return vch;
+}
+
+void CTxOutSetStats::Add(const COutPoint &outpoint, const Coin &coin)
+{
+    muhash.Insert(TxOutSetElement(outpoint, coin));
+    nTransactionOutputs++;
+    nTotalAmount += coin.out.nValue;
+}
+
+void CTxOutSetStats::Remove(const COutPoint &outpoint, const Coin &coin)
+{
+    muhash.Remove(TxOutSetElement(outpoint, coin));
+    nTransactionOutputs--;
+    nTotalAmount -= coin.out.nValue;
+}
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
+size_t CCoinsView::GetCoins(const std::vector<COutPoint> &vOutpoints,
+    std::vector<std::pair<COutPoint, Coin> > &vFound) const
+{
+    size_t nFound = 0;
+    for (const COutPoint &outpoint : vOutpoints)
+    {
+        Coin coin;
+        if (GetCoin(outpoint, coin) && !coin.IsSpent())
+        {
+            vFound.emplace_back(outpoint, std::move(coin));
+            nFound++;
+        }
+    }
+    return nFound;
+}
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
+std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
+bool CCoinsView::GetTxOutSetStats(CTxOutSetStats &stats) const { return false; }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins,
     const uint256 &hashBlock,
     const uint64_t nBestCoinHeight,
+    const CTxOutSetStats *pstats,
     size_t &nChildCachedCoinsUsage)
 {
     return false;
@@ -43,23 +88,38 @@ CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) {}
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
 bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
+std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
+bool CCoinsViewBacked::GetTxOutSetStats(CTxOutSetStats &stats) const { return base->GetTxOutSetStats(stats); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
     const uint256 &hashBlock,
     const uint64_t nBestCoinHeight,
+    const CTxOutSetStats *pstats,
     size_t &nChildCachedCoinsUsage)
 {
-    return base->BatchWrite(mapCoins, hashBlock, nBestCoinHeight, nChildCachedCoinsUsage);
+    return base->BatchWrite(mapCoins, hashBlock, nBestCoinHeight, pstats, nChildCachedCoinsUsage);
 }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
+bool fSipHash24Maps = DEFAULT_SIPHASH24_MAPS;
+
 SaltedOutpointHasher::SaltedOutpointHasher()
-    : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+    : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())),
+      fSipHash24(fSipHash24Maps)
+{
+}
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn)
+    : CCoinsViewBacked(baseIn), nBestCoinHeight(0),
+      cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource), cachedCoinsUsage(0),
+      fStatsFetched(false), fHaveStats(false), nFlushGeneration(0)
 {
 }
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), nBestCoinHeight(0), cachedCoinsUsage(0)
+CCoinsViewCache::~CCoinsViewCache()
 {
+    LOCK(cs_utxo);
+    FinishBackgroundFlush(true);
 }
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const
@@ -68,6 +128,12 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
 }
 
+size_t CCoinsViewCache::UsedMemoryUsage() const
+{
+    LOCK(cs_utxo);
+    return DynamicMemoryUsage() - cacheCoinsMemoryResource.NumFreeBytes();
+}
+
 size_t CCoinsViewCache::ResetCachedCoinUsage() const
 {
     LOCK(cs_utxo);
@@ -90,17 +156,47 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     if (it != cacheCoins.end())
         return it;
     Coin tmp;
-    if (!base->GetCoin(outpoint, tmp))
+    const bool fFound = base->GetCoin(outpoint, tmp);
+    TRACE3(utxocache, fetch_miss, outpoint.hash.begin(), outpoint.n, fFound);
+    if (!fFound)
         return cacheCoins.end();
+    return InsertFetched(outpoint, std::move(tmp));
+}
+
+void CCoinsViewCache::FetchCoins(const std::vector<COutPoint> &vOutpoints) const
+{
+    AssertLockHeld(cs_utxo);
+    std::vector<COutPoint> vMissing;
+    for (const COutPoint &outpoint : vOutpoints)
+    {
+        if (!cacheCoins.count(outpoint))
+            vMissing.push_back(outpoint);
+    }
+    if (vMissing.empty())
+        return;
+    std::sort(vMissing.begin(), vMissing.end());
+    std::vector<std::pair<COutPoint, Coin> > vFetched;
+    base->GetCoins(vMissing, vFetched);
+    for (std::pair<COutPoint, Coin> &fetched : vFetched)
+    {
+        // an outpoint may be asked for twice
+        if (!cacheCoins.count(fetched.first))
+            InsertFetched(fetched.first, std::move(fetched.second));
+    }
+}
+
+CCoinsMap::iterator CCoinsViewCache::InsertFetched(const COutPoint &outpoint, Coin &&coin) const
+{
+    AssertLockHeld(cs_utxo);
     CCoinsMap::iterator ret =
         cacheCoins
-            .emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp)))
+            .emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)))
             .first;
     if (ret->second.coin.IsSpent())
     {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
-        ret->second.flags = CCoinsCacheEntry::FRESH;
+        ret->second.SetFlags(CCoinsCacheEntry::FRESH);
     }
     cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
 
@@ -110,6 +206,17 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     return ret;
 }
 
+CTxOutSetStats *CCoinsViewCache::FetchStats() const
+{
+    AssertLockHeld(cs_utxo);
+    if (!fStatsFetched)
+    {
+        fHaveStats = base->GetTxOutSetStats(stats);
+        fStatsFetched = true;
+    }
+    return fHaveStats ? &stats : nullptr;
+}
+
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const
 {
     LOCK(cs_utxo);
@@ -122,12 +229,34 @@ bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const
     return false;
 }
 
+size_t CCoinsViewCache::GetCoins(const std::vector<COutPoint> &vOutpoints,
+    std::vector<std::pair<COutPoint, Coin> > &vFound) const
+{
+    LOCK(cs_utxo);
+    FetchCoins(vOutpoints);
+    size_t nFound = 0;
+    for (const COutPoint &outpoint : vOutpoints)
+    {
+        CCoinsMap::const_iterator it = cacheCoins.find(outpoint);
+        if (it != cacheCoins.end() && !it->second.coin.IsSpent())
+        {
+            vFound.emplace_back(outpoint, it->second.coin);
+            nFound++;
+        }
+    }
+    return nFound;
+}
+
 void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin &&coin, bool possible_overwrite)
 {
     LOCK(cs_utxo);
     assert(!coin.IsSpent());
     if (coin.out.scriptPubKey.IsUnspendable())
         return;
+    CTxOutSetStats *pstats = FetchStats();
+    // the totals have to lose a coin that is overwritten, so it has to be known whether there is one
+    if (possible_overwrite && pstats)
+        FetchCoin(outpoint);
     CCoinsMap::iterator it;
     bool inserted;
     std::tie(it, inserted) =
@@ -143,16 +272,22 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin &&coin, bool possi
         {
             throw std::logic_error("Adding new coin that replaces non-pruned entry");
         }
-        fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
+        fresh = !(it->second.GetFlags() & CCoinsCacheEntry::DIRTY);
+    }
+    if (pstats)
+    {
+        if (!it->second.coin.IsSpent())
+            pstats->Remove(outpoint, it->second.coin);
+        pstats->Add(outpoint, coin);
     }
     it->second.coin = std::move(coin);
-    it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.AddFlags(CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0));
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
     if (nBestCoinHeight < it->second.coin.nHeight)
         nBestCoinHeight = it->second.coin.nHeight;
 }
 
-void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight)
+void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight, bool check)
 {
     bool fCoinbase = tx.IsCoinBase();
     bool fCoinStake = tx.IsCoinStake();
@@ -162,7 +297,8 @@ void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight)
     {
         // Pass fCoinbase as the possible_overwrite flag to AddCoin, in order to correctly
         // deal with the pre-BIP30 occurrances of duplicate coinbase transactions.
-        cache.AddCoin(COutPoint(txid, i), Coin(tx.vout[i], nHeight, fCoinbase, fCoinStake, nTime), fCoinbase);
+        bool overwrite = check ? cache.HaveCoin(COutPoint(txid, i)) : fCoinbase;
+        cache.AddCoin(COutPoint(txid, i), Coin(tx.vout[i], nHeight, fCoinbase, fCoinStake, nTime), overwrite);
     }
 }
 
@@ -172,18 +308,21 @@ void CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin *moveout)
     CCoinsMap::iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end())
         return;
+    CTxOutSetStats *pstats = FetchStats();
+    if (pstats && !it->second.coin.IsSpent())
+        pstats->Remove(outpoint, it->second.coin);
     cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
     if (moveout)
     {
         *moveout = std::move(it->second.coin);
     }
-    if (it->second.flags & CCoinsCacheEntry::FRESH)
+    if (it->second.GetFlags() & CCoinsCacheEntry::FRESH)
     {
         cacheCoins.erase(it);
     }
     else
     {
-        it->second.flags |= CCoinsCacheEntry::DIRTY;
+        it->second.AddFlags(CCoinsCacheEntry::DIRTY);
         it->second.coin.Clear();
     }
 }
@@ -204,6 +343,51 @@ const Coin &CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const
     }
 }
 
+size_t CCoinsViewCache::Prefetch(std::vector<COutPoint> &vOutpoints) const
+{
+    uint64_t nGeneration;
+    {
+        LOCK(cs_utxo);
+        nGeneration = nFlushGeneration;
+        vOutpoints.erase(std::remove_if(vOutpoints.begin(), vOutpoints.end(),
+                             [&](const COutPoint &outpoint) { return cacheCoins.count(outpoint) != 0; }),
+            vOutpoints.end());
+    }
+    if (vOutpoints.empty())
+        return 0;
+
+    // the coins database is keyed by outpoint, reads in its order stay close together on disk
+    std::sort(vOutpoints.begin(), vOutpoints.end());
+    std::vector<std::pair<COutPoint, Coin> > vFound;
+    vFound.reserve(vOutpoints.size());
+    base->GetCoins(vOutpoints, vFound);
+
+    LOCK(cs_utxo);
+    if (nGeneration != nFlushGeneration)
+        return 0;
+    size_t nAdded = 0;
+    for (std::pair<COutPoint, Coin> &found : vFound)
+    {
+        // the owner of the cache may have fetched or added it meanwhile
+        if (cacheCoins.count(found.first))
+            continue;
+        InsertFetched(found.first, std::move(found.second));
+        nAdded++;
+    }
+    return nAdded;
+}
+
+void CCoinsViewCache::GetCachedOutpoints(std::vector<COutPoint> &vOutpoints) const
+{
+    LOCK(cs_utxo);
+    vOutpoints.reserve(vOutpoints.size() + cacheCoins.size());
+    for (const auto &entry : cacheCoins)
+    {
+        if (!entry.second.coin.IsSpent())
+            vOutpoints.push_back(entry.first);
+    }
+}
+
 bool CCoinsViewCache::HaveCoin(const COutPoint &outpoint) const
 {
     LOCK(cs_utxo);
@@ -226,6 +410,16 @@ uint256 CCoinsViewCache::GetBestBlock() const
     return hashBlock;
 }
 
+bool CCoinsViewCache::GetTxOutSetStats(CTxOutSetStats &statsOut) const
+{
+    LOCK(cs_utxo);
+    const CTxOutSetStats *pstats = FetchStats();
+    if (!pstats)
+        return false;
+    statsOut = *pstats;
+    return true;
+}
+
 void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn)
 {
     LOCK(cs_utxo);
@@ -235,12 +429,13 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn)
 bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
     const uint256 &hashBlockIn,
     const uint64_t nBestCoinHeightIn,
+    const CTxOutSetStats *pstatsIn,
     size_t &nChildCachedCoinsUsage)
 {
     LOCK(cs_utxo);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
     {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+        if (it->second.GetFlags() & CCoinsCacheEntry::DIRTY)
         { // Ignore non-dirty entries (optimization).
             // Update usage of the child cache before we do any swapping and deleting
             nChildCachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
@@ -250,19 +445,19 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
             {
                 // The parent cache does not have an entry, while the child does
                 // We can ignore it if it's both FRESH and pruned in the child
-                if (!(it->second.flags & CCoinsCacheEntry::FRESH && it->second.coin.IsSpent()))
+                if (!(it->second.GetFlags() & CCoinsCacheEntry::FRESH && it->second.coin.IsSpent()))
                 {
                     // Otherwise we will need to create it in the parent
                     // and move the data up and mark it as dirty
                     CCoinsCacheEntry &entry = cacheCoins[it->first];
                     entry.coin = std::move(it->second.coin);
                     cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
-                    entry.flags = CCoinsCacheEntry::DIRTY;
+                    entry.SetFlags(CCoinsCacheEntry::DIRTY);
                     // We can mark it FRESH in the parent if it was FRESH in the child
                     // Otherwise it might have just been flushed from the parent's cache
                     // and already exist in the grandparent
-                    if (it->second.flags & CCoinsCacheEntry::FRESH)
-                        entry.flags |= CCoinsCacheEntry::FRESH;
+                    if (it->second.GetFlags() & CCoinsCacheEntry::FRESH)
+                        entry.AddFlags(CCoinsCacheEntry::FRESH);
                 }
             }
             else
@@ -271,12 +466,12 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                 // parent cache entry has unspent outputs. If this ever happens,
                 // it means the FRESH flag was misapplied and there is a logic
                 // error in the calling code.
-                if ((it->second.flags & CCoinsCacheEntry::FRESH) && !itUs->second.coin.IsSpent())
+                if ((it->second.GetFlags() & CCoinsCacheEntry::FRESH) && !itUs->second.coin.IsSpent())
                     throw std::logic_error(
                         "FRESH flag misapplied to cache entry for base transaction with spendable outputs");
 
                 // Found the entry in the parent cache
-                if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent())
+                if ((itUs->second.GetFlags() & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent())
                 {
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
@@ -290,7 +485,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
                     itUs->second.coin = std::move(it->second.coin);
                     cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
-                    itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.AddFlags(CCoinsCacheEntry::DIRTY);
                 }
             }
 
@@ -303,6 +498,10 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
     hashBlock = hashBlockIn;
     if (nBestCoinHeightIn > nBestCoinHeight)
         nBestCoinHeight = nBestCoinHeightIn;
+    fStatsFetched = true;
+    fHaveStats = pstatsIn != nullptr;
+    if (pstatsIn)
+        stats = *pstatsIn;
 
     return true;
 }
@@ -310,13 +509,139 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
 bool CCoinsViewCache::Flush()
 {
     LOCK(cs_utxo);
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock, nBestCoinHeight, cachedCoinsUsage);
+    // what a background flush writes has to be in the base before anything newer
+    if (!FinishBackgroundFlush(true))
+        return false;
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, nBestCoinHeight, FetchStats(), cachedCoinsUsage);
+    nFlushGeneration++;
+    // give back the chunks of a pool that has nothing left to reuse them for
+    if (fOk && cacheCoins.empty() && cacheCoinsMemoryResource.NumAllocatedChunks() > 1)
+        ReallocateCache();
     return fOk;
 }
 
+bool CCoinsViewCache::FlushInBackground(size_t nTrimSize)
+{
+    LOCK(cs_utxo);
+    if (!FinishBackgroundFlush(true))
+        return false;
+
+    std::unique_ptr<FlushSnapshot> snapshot(new FlushSnapshot());
+    snapshot->nTrimSize = nTrimSize;
+    snapshot->hashBlock = hashBlock;
+    snapshot->nBestCoinHeight = nBestCoinHeight;
+    const CTxOutSetStats *pstats = FetchStats();
+    snapshot->fHaveStats = pstats != nullptr;
+    if (pstats)
+        snapshot->stats = *pstats;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();)
+    {
+        if (!(it->second.GetFlags() & CCoinsCacheEntry::DIRTY))
+        {
+            it++;
+            continue;
+        }
+        // the base never had a fresh entry that is spent, there is nothing to write for it
+        if ((it->second.GetFlags() & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent())
+        {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+            continue;
+        }
+        CCoinsCacheEntry &entry = snapshot->mapCoins[it->first];
+        entry.coin = it->second.coin;
+        entry.SetFlags(it->second.GetFlags());
+        snapshot->nCoinsUsage += entry.coin.DynamicMemoryUsage();
+        if (entry.coin.IsSpent())
+            snapshot->vSpent.push_back(it->first);
+        it->second.SetFlags(0);
+        it++;
+    }
+    LogPrint(Logging::COINDB, "Flushing %u coins in the background, %u stay cached\n",
+        (unsigned int)snapshot->mapCoins.size(), (unsigned int)cacheCoins.size());
+
+    pflushSnapshot = std::move(snapshot);
+    threadFlush = std::thread(&CCoinsViewCache::ThreadFlush, this, pflushSnapshot.get());
+    return true;
+}
+
+void CCoinsViewCache::ThreadFlush(FlushSnapshot *snapshot)
+{
+    RenameThread("bitcoin-coinsflush");
+    bool fOk = false;
+    try
+    {
+        fOk = base->BatchWrite(snapshot->mapCoins, snapshot->hashBlock, snapshot->nBestCoinHeight,
+            snapshot->fHaveStats ? &snapshot->stats : nullptr, snapshot->nCoinsUsage);
+    }
+    catch (const std::exception &e)
+    {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    snapshot->fOk = fOk;
+    snapshot->fDone = true;
+}
+
+bool CCoinsViewCache::FinishBackgroundFlush(bool fWait)
+{
+    LOCK(cs_utxo);
+    if (!pflushSnapshot || (!fWait && !pflushSnapshot->fDone))
+        return true;
+    threadFlush.join();
+    std::unique_ptr<FlushSnapshot> snapshot(std::move(pflushSnapshot));
+    if (!snapshot->fOk)
+        return false;
+
+    // the base no longer has the spent entries either, unless they were brought back since
+    nFlushGeneration++;
+    for (const COutPoint &outpoint : snapshot->vSpent)
+    {
+        CCoinsMap::iterator it = cacheCoins.find(outpoint);
+        if (it != cacheCoins.end() && it->second.GetFlags() == 0 && it->second.coin.IsSpent())
+        {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            cacheCoins.erase(it);
+        }
+    }
+    // what was written stays cached and clean, without this the cache only shrinks by a synchronous flush
+    if (snapshot->nTrimSize && UsedMemoryUsage() > snapshot->nTrimSize)
+        Trim(snapshot->nTrimSize);
+    return true;
+}
+
+bool CCoinsViewCache::IsFlushingInBackground() const
+{
+    LOCK(cs_utxo);
+    return pflushSnapshot != nullptr;
+}
+
+void CCoinsViewCache::Clear()
+{
+    LOCK(cs_utxo);
+    FinishBackgroundFlush(true);
+    cacheCoins.clear();
+    cachedCoinsUsage = 0;
+    nFlushGeneration++;
+    ReallocateCache();
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    AssertLockHeld(cs_utxo);
+    assert(cacheCoins.empty());
+    // the map has to go before the pool it takes its nodes from
+    cacheCoins.~CCoinsMap();
+    cacheCoinsMemoryResource.~CCoinsMapMemoryResource();
+    new (&cacheCoinsMemoryResource) CCoinsMapMemoryResource();
+    new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource);
+}
+
 void CCoinsViewCache::Trim(size_t nTrimSize) const
 {
     LOCK(cs_utxo);
+    // entries a background flush is writing have to stay until it is done
+    if (pflushSnapshot)
+        return;
 
     uint64_t nTrimmed = 0;
     uint64_t nTrimmedByHeight = 0;
@@ -326,7 +651,7 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
     // if we've already walked the nTrimHeight all the way back as far as we can go and there is nothing to trim
     // then no need to check further.  This should be the typical state after a block sync is completed and there is
     // enough dbcache to hold all the coins from recent transactions in memory.
-    if (nTrimHeight == 0 && DynamicMemoryUsage() <= nTrimSize)
+    if (nTrimHeight == 0 && UsedMemoryUsage() <= nTrimSize)
         return;
 
     // Begin first Trim loop. This loop will trim coins from cache by the coin height, removing the oldest coins first.
@@ -335,14 +660,15 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
     bool fDone = false;
     uint64_t nSmallestDelta = 50; // number of blocks to adjust trim height by
     CCoinsMap::iterator iter = cacheCoins.begin();
-    while (!fDone && DynamicMemoryUsage() > nTrimSize)
+    while (!fDone && UsedMemoryUsage() > nTrimSize)
     {
-        LogPrint("COINDB", "cacheCoinsUsage at start: %d total dynamic usage: %d trim to size: %d nBestCoinHeight: %d "
-                           "trim height:%d\n",
-            cachedCoinsUsage, DynamicMemoryUsage(), nTrimSize, nBestCoinHeight, nTrimHeight);
+        LogPrint(Logging::COINDB,
+            "cacheCoinsUsage at start: %d total dynamic usage: %d trim to size: %d nBestCoinHeight: %d "
+            "trim height:%d\n",
+            cachedCoinsUsage, UsedMemoryUsage(), nTrimSize, nBestCoinHeight, nTrimHeight);
 
         iter = cacheCoins.begin();
-        while (DynamicMemoryUsage() > nTrimSize)
+        while (UsedMemoryUsage() > nTrimSize)
         {
             if (iter == cacheCoins.end())
             {
@@ -350,7 +676,7 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
                 break;
             }
 
-            if (iter->second.flags == 0 && iter->second.coin.nHeight < nTrimHeight)
+            if (iter->second.GetFlags() == 0 && iter->second.coin.nHeight < nTrimHeight)
             {
                 cachedCoinsUsage -= iter->second.coin.DynamicMemoryUsage();
 
@@ -363,7 +689,7 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
         }
 
         // Gradually increase the nTrimHeight if we didn't trim enought entries.
-        if (fDone && DynamicMemoryUsage() > nTrimSize && nTrimHeightDelta > nSmallestDelta)
+        if (fDone && UsedMemoryUsage() > nTrimSize && nTrimHeightDelta > nSmallestDelta)
         {
             if (nTrimHeightDelta <= nSmallestDelta * 100)
                 nTrimHeightDelta =
@@ -380,7 +706,7 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
             // We're not done yet. We've adjusted the nTrimHeight so we have to go back and trim again.
             fDone = false;
 
-            LogPrint("COINDB", "Re-adjusting trim height to %d using a trim height delta of %d\n", nTrimHeight,
+            LogPrint(Logging::COINDB, "Re-adjusting trim height to %d using a trim height delta of %d\n", nTrimHeight,
                 nTrimHeightDelta);
         }
     }
@@ -388,13 +714,13 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
     // If trimming by coin height failed to find any or enough coins to trim then trim the cache by ignoring
     // coin height. While this is not ideal we still have to trim to keep the cache from growing unbounded.
     iter = cacheCoins.begin();
-    while (DynamicMemoryUsage() > nTrimSize)
+    while (UsedMemoryUsage() > nTrimSize)
     {
         if (iter == cacheCoins.end())
             break;
 
         // Only erase entries that have not been modified
-        if (iter->second.flags == 0)
+        if (iter->second.GetFlags() == 0)
         {
             cachedCoinsUsage -= iter->second.coin.DynamicMemoryUsage();
 
@@ -406,9 +732,10 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
     }
     if (nTrimmed > 0)
     {
-        LogPrint("COINDB", "Trimmed %d by coin height\n", nTrimmedByHeight);
-        LogPrint("COINDB", "Trimmed %ld from the CoinsViewCache, current size after trim: %ld and usage %ld bytes\n",
-            nTrimmed, cacheCoins.size(), cachedCoinsUsage);
+        LogPrint(Logging::COINDB, "Trimmed %d by coin height\n", nTrimmedByHeight);
+        LogPrint(Logging::COINDB,
+            "Trimmed %ld from the CoinsViewCache, current size after trim: %ld and usage %ld bytes\n", nTrimmed,
+            cacheCoins.size(), cachedCoinsUsage);
     }
 
     // If we're not trimming anything then gradually walk the trim height backwards from the tip.  This is to adjust
@@ -420,7 +747,7 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
         if (nTrimHeightDelta > nBestCoinHeight)
             nTrimHeightDelta = nBestCoinHeight;
         nTrimHeight = nBestCoinHeight - nTrimHeightDelta;
-        LogPrint("COINDB", "Re-adjusting trim height to %d using a trim height delta of %d\n", nTrimHeight,
+        LogPrint(Logging::COINDB, "Re-adjusting trim height to %d using a trim height delta of %d\n", nTrimHeight,
             nTrimHeightDelta);
     }
 }
@@ -428,10 +755,13 @@ void CCoinsViewCache::Trim(size_t nTrimSize) const
 void CCoinsViewCache::Uncache(const COutPoint &hash)
 {
     LOCK(cs_utxo);
+    // a coin a background flush is writing may not be in the base yet
+    if (pflushSnapshot)
+        return;
     CCoinsMap::iterator it = cacheCoins.find(hash);
 
     // only uncache coins that are not dirty.
-    if (it != cacheCoins.end() && it->second.flags == 0)
+    if (it != cacheCoins.end() && it->second.GetFlags() == 0)
     {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
         cacheCoins.erase(it);
@@ -468,6 +798,14 @@ bool CCoinsViewCache::HaveInputs(const CTransaction &tx) const
     LOCK(cs_utxo);
     if (!tx.IsCoinBase())
     {
+        if (tx.vin.size() > 1)
+        {
+            std::vector<COutPoint> vPrevouts;
+            vPrevouts.reserve(tx.vin.size());
+            for (const CTxIn &txin : tx.vin)
+                vPrevouts.push_back(txin.prevout);
+            FetchCoins(vPrevouts);
+        }
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             if (!HaveCoin(tx.vin[i].prevout))
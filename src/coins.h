@@ -34,13 +34,19 @@
 #include "compressor.h"
 #include "core_memusage.h"
 #include "crypto/hash.h"
+#include "crypto/muhash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "sync.h"
 #include "uint256.h"
 
 #include <assert.h>
+#include <atomic>
+#include <memory>
 #include <stdint.h>
+#include <thread>
+#include <vector>
 
 #include <boost/foreach.hpp>
 #include <boost/thread/locks.hpp>
@@ -65,6 +71,9 @@ struct CCoinsStats
     }
 };
 
+/** The heights of coins have 28 bits, that is more than 268 million blocks */
+static const uint32_t MAX_COIN_HEIGHT = (1 << 28) - 1;
+
 /**
  * A UTXO entry.
  *
@@ -83,20 +92,58 @@ public:
 
     uint32_t fCoinStake : 1;
 
-    //! at which height this containing transaction was included in the active block chain
-    uint32_t nHeight : 31;
+    //! at which height this containing transaction was included in the active block chain, MAX_COIN_HEIGHT at most
+    uint32_t nHeight : 28;
+
+    /**
+     * The CCoinsCacheEntry flags of the cache entry that holds this coin, they share the word of the height so an
+     * entry is no larger than its coin. They are not part of the value of the coin: copies start without them and
+     * assigning to a coin keeps its own, only the entry changes them.
+     */
+    uint32_t nCacheFlags : 2;
 
-    uint64_t nTime;
+    //! the time of the containing transaction, transaction times are 32 bits
+    uint32_t nTime;
 
     //! construct a Coin from a CTxOut and height/coinbase information.
     Coin(CTxOut &&outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn, uint64_t nTimeIn)
-        : out(std::move(outIn)), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn), nTime(nTimeIn)
+        : out(std::move(outIn)), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn), nCacheFlags(0),
+          nTime(nTimeIn)
     {
     }
     Coin(const CTxOut &outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn, uint64_t nTimeIn)
-        : out(outIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn), nTime(nTimeIn)
+        : out(outIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn), nCacheFlags(0),
+          nTime(nTimeIn)
+    {
+    }
+    Coin(const Coin &other)
+        : out(other.out), fCoinBase(other.fCoinBase), fCoinStake(other.fCoinStake), nHeight(other.nHeight),
+          nCacheFlags(0), nTime(other.nTime)
+    {
+    }
+    Coin(Coin &&other)
+        : out(std::move(other.out)), fCoinBase(other.fCoinBase), fCoinStake(other.fCoinStake),
+          nHeight(other.nHeight), nCacheFlags(0), nTime(other.nTime)
     {
     }
+    Coin &operator=(const Coin &other)
+    {
+        out = other.out;
+        fCoinBase = other.fCoinBase;
+        fCoinStake = other.fCoinStake;
+        nHeight = other.nHeight;
+        nTime = other.nTime;
+        return *this;
+    }
+    Coin &operator=(Coin &&other)
+    {
+        out = std::move(other.out);
+        fCoinBase = other.fCoinBase;
+        fCoinStake = other.fCoinStake;
+        nHeight = other.nHeight;
+        nTime = other.nTime;
+        return *this;
+    }
 
     void Clear()
     {
@@ -108,7 +155,7 @@ public:
     }
 
     //! empty constructor
-    Coin() : fCoinBase(false), nHeight(0) {}
+    Coin() : fCoinBase(false), fCoinStake(false), nHeight(0), nCacheFlags(0), nTime(0) {}
     bool IsCoinBase() const { return fCoinBase; }
     bool IsCoinStake() const { return fCoinStake; }
     template <typename Stream>
@@ -126,7 +173,9 @@ public:
         }
         assert((code & 3) != 3);
         ::Serialize(s, VARINT(code));
-        ::Serialize(s, VARINT(nHeight));
+        // a bit-field can not be bound to the reference VARINT takes, it goes through a whole integer
+        uint32_t nHeightSer = nHeight;
+        ::Serialize(s, VARINT(nHeightSer));
         ::Serialize(s, VARINT(nTime));
         ::Serialize(s, CTxOutCompressor(REF(out)));
     }
@@ -138,7 +187,9 @@ public:
         ::Unserialize(s, VARINT(code));
         fCoinBase = code & 1;
         fCoinStake = code & 2;
-        ::Unserialize(s, VARINT(nHeight));
+        uint32_t nHeightSer = 0;
+        ::Unserialize(s, VARINT(nHeightSer));
+        nHeight = nHeightSer;
         ::Unserialize(s, VARINT(nTime));
         ::Unserialize(s, REF(CTxOutCompressor(out)));
     }
@@ -147,22 +198,34 @@ public:
     size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(out.scriptPubKey); }
 };
 
+/** -siphash24maps default */
+static const bool DEFAULT_SIPHASH24_MAPS = false;
+
+/**
+ * Set from -siphash24maps, the salted hashers of the coins cache and the transaction maps use SipHash-2-4 instead of
+ * SipHash-1-3. A hasher keeps the function it was constructed with, maps never change theirs.
+ */
+extern bool fSipHash24Maps;
+
 class SaltedOutpointHasher
 {
 private:
     /** Salt */
     const uint64_t k0, k1;
+    const bool fSipHash24;
 
 public:
     SaltedOutpointHasher();
 
-    uint64_t operator()(const COutPoint &id) const { return SipHashUint256Extra(k0, k1, id.hash, id.n); }
+    uint64_t operator()(const COutPoint &id) const
+    {
+        return fSipHash24 ? SipHashUint256Extra(k0, k1, id.hash, id.n) : SipHash13Uint256Extra(k0, k1, id.hash, id.n);
+    }
 };
 
 struct CCoinsCacheEntry
 {
-    Coin coin; // The actual cached data.
-    unsigned char flags;
+    Coin coin; // The actual cached data, the flags of the entry are kept in its spare bits.
 
     enum Flags
     {
@@ -170,11 +233,71 @@ struct CCoinsCacheEntry
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin &&coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() {}
+    explicit CCoinsCacheEntry(Coin &&coin_) : coin(std::move(coin_)) {}
+    CCoinsCacheEntry(const CCoinsCacheEntry &other) : coin(other.coin) { coin.nCacheFlags = other.coin.nCacheFlags; }
+    CCoinsCacheEntry(CCoinsCacheEntry &&other) : coin(std::move(other.coin))
+    {
+        coin.nCacheFlags = other.coin.nCacheFlags;
+    }
+    CCoinsCacheEntry &operator=(const CCoinsCacheEntry &other)
+    {
+        coin = other.coin;
+        coin.nCacheFlags = other.coin.nCacheFlags;
+        return *this;
+    }
+    CCoinsCacheEntry &operator=(CCoinsCacheEntry &&other)
+    {
+        coin = std::move(other.coin);
+        coin.nCacheFlags = other.coin.nCacheFlags;
+        return *this;
+    }
+
+    unsigned char GetFlags() const { return coin.nCacheFlags; }
+    void SetFlags(unsigned char flags) { coin.nCacheFlags = flags; }
+    void AddFlags(unsigned char flags) { coin.nCacheFlags |= flags; }
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The nodes of the coins cache come from a pool, sized so that the node of a cache entry and its hash map links fit
+ * a block of their own. The memory used is then known exactly, and entries that are erased leave no holes behind in
+ * the heap, their blocks are reused for the next ones.
+ */
+typedef std::unordered_map<COutPoint,
+    CCoinsCacheEntry,
+    SaltedOutpointHasher,
+    std::equal_to<COutPoint>,
+    PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+        sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void *) * 4> >
+    CCoinsMap;
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
+
+/**
+ * Totals of the unspent outputs of a view, kept up to date as its coins are added and spent so they never have to
+ * be counted. A view that is not sure of them, like one whose base does not keep them, has none.
+ */
+struct CTxOutSetStats
+{
+    //! hash of the set of outpoints with their coins as the chainstate serializes them
+    MuHash3072 muhash;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+
+    CTxOutSetStats() : nTransactionOutputs(0), nTotalAmount(0) {}
+
+    void Add(const COutPoint &outpoint, const Coin &coin);
+    void Remove(const COutPoint &outpoint, const Coin &coin);
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(muhash);
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(nTotalAmount);
+    }
+};
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -206,6 +329,11 @@ public:
     //! Retrieve the Coin (unspent transaction output) for a given outpoint.
     virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
+    //! Retrieve the unspent coins of vOutpoints there are into vFound, in no particular order, returns how many.
+    //! Views that read from a database read them in its key order and should be given sorted outpoints.
+    virtual size_t GetCoins(const std::vector<COutPoint> &vOutpoints,
+        std::vector<std::pair<COutPoint, Coin> > &vFound) const;
+
     //! Just check whether we have data for a given outpoint.
     //! This may (but cannot always) return true for spent outputs.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
@@ -213,11 +341,20 @@ public:
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
+    //! Retrieve the range of blocks that may have been only partially written. If the database is in a consistent
+    //! state, the result is the empty vector. Otherwise, a two-element vector is returned consisting of the new and
+    //! the old block hash, in that order.
+    virtual std::vector<uint256> GetHeadBlocks() const;
+
+    //! Retrieve the totals of the unspent outputs as of the best block, false if the view does not keep them
+    virtual bool GetTxOutSetStats(CTxOutSetStats &stats) const;
+
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
+    //! The passed mapCoins can be modified. pstats are the totals after it, nullptr if they are not known.
     virtual bool BatchWrite(CCoinsMap &mapCoins,
         const uint256 &hashBlock,
         const uint64_t bestCoinHeight,
+        const CTxOutSetStats *pstats,
         size_t &nChildCachedCoinsUsage);
 
     //! Get a cursor to iterate over the whole state
@@ -241,10 +378,13 @@ public:
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
+    std::vector<uint256> GetHeadBlocks() const override;
+    bool GetTxOutSetStats(CTxOutSetStats &stats) const override;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins,
         const uint256 &hashBlock,
         const uint64_t nBestCoinHeight,
+        const CTxOutSetStats *pstats,
         size_t &nChildCachedCoinsUsage) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
@@ -261,23 +401,64 @@ protected:
      */
     mutable uint256 hashBlock;
     mutable uint64_t nBestCoinHeight;
+    //! where the nodes of cacheCoins come from, so it is declared before it
+    mutable CCoinsMapMemoryResource cacheCoinsMemoryResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    //! totals of the unspent outputs as of hashBlock, fetched from the base the first time they change
+    mutable CTxOutSetStats stats;
+    mutable bool fStatsFetched;
+    mutable bool fHaveStats;
+
+    //! counts the writes to the base that may have dropped entries it had, see Prefetch
+    mutable uint64_t nFlushGeneration;
+
+    /** A copy of the dirty entries of the cache, written to the base by a background flush */
+    struct FlushSnapshot
+    {
+        CCoinsMapMemoryResource resource;
+        CCoinsMap mapCoins;
+        size_t nCoinsUsage;
+        uint256 hashBlock;
+        uint64_t nBestCoinHeight;
+        CTxOutSetStats stats;
+        bool fHaveStats;
+        //! entries that were spent, the cache keeps them until they are gone from the base too
+        std::vector<COutPoint> vSpent;
+        //! what the cache is trimmed to when the flush is collected, see FlushInBackground
+        size_t nTrimSize;
+        std::atomic<bool> fDone;
+        bool fOk;
+
+        FlushSnapshot()
+            : mapCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource), nCoinsUsage(0),
+              nBestCoinHeight(0), fHaveStats(false), nTrimSize(0), fDone(false), fOk(false)
+        {
+        }
+    };
+    std::unique_ptr<FlushSnapshot> pflushSnapshot;
+    std::thread threadFlush;
+
 
 public:
     CCoinsViewCache(CCoinsView *baseIn);
+    ~CCoinsViewCache();
 
     // Standard CCoinsView methods
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    size_t GetCoins(const std::vector<COutPoint> &vOutpoints,
+        std::vector<std::pair<COutPoint, Coin> > &vFound) const override;
     bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
+    bool GetTxOutSetStats(CTxOutSetStats &stats) const;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins,
         const uint256 &hashBlock,
         const uint64_t nBestCoinHeight,
+        const CTxOutSetStats *pstats,
         size_t &nChildCachedCoinsUsage);
 
     /**
@@ -294,6 +475,18 @@ public:
      */
     const Coin &AccessCoin(const COutPoint &output) const;
 
+    /**
+     * Load the coins of vOutpoints that are not cached yet from the base without holding the lock of this cache,
+     * so other threads can warm it while it is used. The reads are made in key order. What was read is dropped
+     * if the base was written to meanwhile, a coin read before a flush may be spent after it. Only for a base
+     * that can be read from any thread. vOutpoints is sorted and left with the outpoints that were read.
+     * Returns the number of coins added.
+     */
+    size_t Prefetch(std::vector<COutPoint> &vOutpoints) const;
+
+    //! Append the outpoints of the unspent coins the cache holds to vOutpoints, in no particular order
+    void GetCachedOutpoints(std::vector<COutPoint> &vOutpoints) const;
+
     /**
      * Add a coin. Set potential_overwrite to true if a non-pruned version may
      * already exist.
@@ -315,9 +508,28 @@ public:
     bool Flush();
 
     /**
-     * Empty the coins cache. Used primarily when we're shutting down and want to release memory
+     * Like Flush(), but only the dirty entries are copied while the lock is held, a thread of its own writes them
+     * to the base while the cache is used on. The entries stay cached and are marked clean, and the ones that were
+     * spent are only dropped once the write is done, so nothing is read from the base that it is not yet up to date
+     * on. Once the write is collected, clean entries are trimmed until the cache takes at most nTrimSize bytes, 0
+     * keeps all of them. Returns false if an earlier background flush failed.
      */
-    void Clear() { cacheCoins.clear(); }
+    bool FlushInBackground(size_t nTrimSize = 0);
+
+    /**
+     * Wait for a background flush to finish, or with fWait false only collect one that already did. Returns false
+     * if it failed, the state of the cache and its base is then undefined as it is after a failed Flush().
+     */
+    bool FinishBackgroundFlush(bool fWait = true);
+
+    //! Whether a background flush has not been collected yet
+    bool IsFlushingInBackground() const;
+
+    /**
+     * Empty the coins cache, giving the memory of its pool back in one go. Used when we're shutting down, and after
+     * a flush left nothing dirty in a cache over its size.
+     */
+    void Clear();
     /**
      * Remove excess entries from this cache.
      * Entries are trimmed starting from the beginning of the map.  In this way if those entries
@@ -344,6 +556,11 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    /** Like DynamicMemoryUsage(), less what the pool of the cache has free. Erasing entries only puts their memory
+     *  back into the pool, this is what shrinks when the cache is trimmed.
+     */
+    size_t UsedMemoryUsage() const;
+
     //! Recalculate and Reset the size of cachedCoinsUsage
     size_t ResetCachedCoinUsage() const;
 
@@ -369,6 +586,15 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+    //! Cache the coins of vOutpoints that are not cached with one GetCoins of the base
+    void FetchCoins(const std::vector<COutPoint> &vOutpoints) const;
+    //! Cache a coin read from the base for an outpoint that is not cached
+    CCoinsMap::iterator InsertFetched(const COutPoint &outpoint, Coin &&coin) const;
+    //! the totals of the unspent outputs to update, nullptr if the base does not keep them
+    CTxOutSetStats *FetchStats() const;
+    //! Replace the empty cacheCoins and its pool with new ones, so the chunks the pool took go back to the system
+    void ReallocateCache();
+    void ThreadFlush(FlushSnapshot *snapshot);
 
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on
@@ -378,10 +604,12 @@ private:
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
-// It assumes that overwrites are only possible for coinbase transactions,
+// When check is false, this assumes that overwrites are only possible for coinbase transactions.
+// When check is true, the underlying view may be queried to determine whether an addition is
+// an overwrite.
 // TODO: pass in a boolean to limit these possible overwrites to known
 // (pre-BIP34) cases.
-void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight);
+void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight, bool check = false);
 
 //! Utility function to find any unspent output with a given txid.
 const Coin &AccessByTxid(const CCoinsViewCache &cache, const uint256 &txid);
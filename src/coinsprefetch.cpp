@@ -0,0 +1,112 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "chain/block.h"
+#include "coins.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <algorithm>
+
+std::unique_ptr<CCoinsPrefetcher> g_coinsprefetcher;
+
+CCoinsPrefetcher::CCoinsPrefetcher(CCoinsViewCache *pcoinsIn, int nThreadsIn, size_t nMaxQueuedIn)
+    : pcoins(pcoinsIn), nThreads(nThreadsIn), nMaxQueued(nMaxQueuedIn), fStop(false)
+{
+}
+
+CCoinsPrefetcher::~CCoinsPrefetcher() { Stop(); }
+
+void CCoinsPrefetcher::Start()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!threads.empty())
+        return;
+    fStop = false;
+    for (int i = 0; i < nThreads; i++)
+        threads.emplace_back(&CCoinsPrefetcher::ThreadPrefetch, this);
+}
+
+void CCoinsPrefetcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+        queue.clear();
+    }
+    condWork.notify_all();
+    for (std::thread &thread : threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+    std::lock_guard<std::mutex> lock(cs);
+    threads.clear();
+}
+
+bool CCoinsPrefetcher::Add(const CBlock &block)
+{
+    // outputs of the block itself are not in the cache or its base yet
+    std::vector<uint256> vTxids;
+    vTxids.reserve(block.vtx.size());
+    for (const auto &tx : block.vtx)
+        vTxids.push_back(tx->GetHash());
+    std::sort(vTxids.begin(), vTxids.end());
+
+    std::vector<COutPoint> vOutpoints;
+    for (const auto &tx : block.vtx)
+    {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn &txin : tx->vin)
+        {
+            if (!std::binary_search(vTxids.begin(), vTxids.end(), txin.prevout.hash))
+                vOutpoints.push_back(txin.prevout);
+        }
+    }
+    if (vOutpoints.empty())
+        return true;
+    std::sort(vOutpoints.begin(), vOutpoints.end());
+    vOutpoints.erase(std::unique(vOutpoints.begin(), vOutpoints.end()), vOutpoints.end());
+
+    const size_t nBatches = (vOutpoints.size() + COINS_PREFETCH_BATCH - 1) / COINS_PREFETCH_BATCH;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fStop || threads.empty())
+            return false;
+        if (!queue.empty() && queue.size() + nBatches > nMaxQueued)
+        {
+            LogPrint(Logging::COINDB, "Coins prefetch queue is full, not prefetching block %s\n",
+                block.GetHash().ToString());
+            return false;
+        }
+        for (size_t nStart = 0; nStart < vOutpoints.size(); nStart += COINS_PREFETCH_BATCH)
+        {
+            const size_t nEnd = std::min(vOutpoints.size(), nStart + COINS_PREFETCH_BATCH);
+            queue.emplace_back(vOutpoints.begin() + nStart, vOutpoints.begin() + nEnd);
+        }
+    }
+    condWork.notify_all();
+    return true;
+}
+
+void CCoinsPrefetcher::ThreadPrefetch()
+{
+    RenameThread("bitcoin-coinsprefetch");
+    while (true)
+    {
+        std::vector<COutPoint> vOutpoints;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWork.wait(lock, [&]() { return fStop || !queue.empty(); });
+            if (fStop)
+                return;
+            vOutpoints = std::move(queue.front());
+            queue.pop_front();
+        }
+        pcoins->Prefetch(vOutpoints);
+    }
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_COINSPREFETCH_H
+#define ECCOIN_COINSPREFETCH_H
+
+#include "chain/outpoint.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CCoinsViewCache;
+
+/** -coinsprefetchthreads default, 0 to not prefetch */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 4;
+static const int MAX_COINS_PREFETCH_THREADS = 16;
+/** Outpoints a worker reads in one go, they are a range of the sorted outpoints of a block */
+static const size_t COINS_PREFETCH_BATCH = 128;
+/** Batches that may wait for the workers, blocks that come in while the queue is full are not prefetched */
+static const size_t DEFAULT_COINS_PREFETCH_QUEUE = 1024;
+
+/**
+ * Warms a coins cache with the inputs of blocks before they are connected. A block is handed over as soon as it
+ * is received, or decoded during a reindex, and the worker threads read the coins it spends from the base of the
+ * cache while the validation thread is still busy with the block, or the ones before it. ConnectBlock then finds
+ * them cached instead of reading them one at a time.
+ *
+ * The coins are only a hint, a worker that loses a race with a flush drops what it read, see
+ * CCoinsViewCache::Prefetch.
+ */
+class CCoinsPrefetcher
+{
+private:
+    CCoinsViewCache *const pcoins;
+    const int nThreads;
+    const size_t nMaxQueued;
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::deque<std::vector<COutPoint> > queue;
+    bool fStop;
+    std::vector<std::thread> threads;
+
+    void ThreadPrefetch();
+
+public:
+    CCoinsPrefetcher(CCoinsViewCache *pcoinsIn, int nThreadsIn, size_t nMaxQueuedIn = DEFAULT_COINS_PREFETCH_QUEUE);
+    ~CCoinsPrefetcher();
+
+    void Start();
+    /** Stop the workers, what is still queued is dropped */
+    void Stop();
+
+    /** Queue the outpoints block spends that are not created in it, false if the queue is full */
+    bool Add(const CBlock &block);
+};
+
+/** Set while the workers run, coins are only read when they are needed otherwise */
+extern std::unique_ptr<CCoinsPrefetcher> g_coinsprefetcher;
+
+#endif // ECCOIN_COINSPREFETCH_H
@@ -60,44 +60,41 @@ bool CScriptCompressor::IsToPubKey(CPubKey &pubkey) const
     return false;
 }
 
-bool CScriptCompressor::Compress(std::vector<unsigned char> &out) const
+unsigned int CScriptCompressor::Compress(uint8_t *out) const
 {
     CKeyID keyID;
     if (IsToKeyID(keyID))
     {
-        out.resize(21);
         out[0] = 0x00;
         memcpy(&out[1], &keyID, 20);
-        return true;
+        return 21;
     }
     CScriptID scriptID;
     if (IsToScriptID(scriptID))
     {
-        out.resize(21);
         out[0] = 0x01;
         memcpy(&out[1], &scriptID, 20);
-        return true;
+        return 21;
     }
     CPubKey pubkey;
     if (IsToPubKey(pubkey))
     {
-        out.resize(33);
         memcpy(&out[1], &pubkey[1], 32);
         if (pubkey[0] == 0x02 || pubkey[0] == 0x03)
         {
             out[0] = pubkey[0];
-            return true;
+            return 33;
         }
         else if (pubkey[0] == 0x04)
         {
             out[0] = 0x04 | (pubkey[64] & 0x01);
-            return true;
+            return 33;
         }
     }
-    return false;
+    return 0;
 }
 
-unsigned int CScriptCompressor::GetSpecialSize(unsigned int nSize) const
+unsigned int CScriptCompressor::GetSpecialSize(unsigned int nSize)
 {
     if (nSize == 0 || nSize == 1)
         return 20;
@@ -106,7 +103,7 @@ unsigned int CScriptCompressor::GetSpecialSize(unsigned int nSize) const
     return 0;
 }
 
-bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigned char> &in)
+bool CScriptCompressor::Decompress(unsigned int nSize, const uint8_t *in)
 {
     switch (nSize)
     {
@@ -115,7 +112,7 @@ bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigne
         script[0] = OP_DUP;
         script[1] = OP_HASH160;
         script[2] = 20;
-        memcpy(&script[3], &in[0], 20);
+        memcpy(&script[3], in, 20);
         script[23] = OP_EQUALVERIFY;
         script[24] = OP_CHECKSIG;
         return true;
@@ -123,7 +120,7 @@ bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigne
         script.resize(23);
         script[0] = OP_HASH160;
         script[1] = 20;
-        memcpy(&script[2], &in[0], 20);
+        memcpy(&script[2], in, 20);
         script[22] = OP_EQUAL;
         return true;
     case 0x02:
@@ -131,14 +128,14 @@ bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigne
         script.resize(35);
         script[0] = 33;
         script[1] = nSize;
-        memcpy(&script[2], &in[0], 32);
+        memcpy(&script[2], in, 32);
         script[34] = OP_CHECKSIG;
         return true;
     case 0x04:
     case 0x05:
         unsigned char vch[33] = {};
         vch[0] = nSize - 2;
-        memcpy(&vch[1], &in[0], 32);
+        memcpy(&vch[1], in, 32);
         CPubKey pubkey(&vch[0], &vch[33]);
         if (!pubkey.Decompress())
             return false;
@@ -67,19 +67,25 @@ protected:
     bool IsToScriptID(CScriptID &hash) const;
     bool IsToPubKey(CPubKey &pubkey) const;
 
-    bool Compress(std::vector<uint8_t> &out) const;
-    unsigned int GetSpecialSize(unsigned int nSize) const;
-    bool Decompress(unsigned int nSize, const std::vector<uint8_t> &out);
+    /** Writes the special encoding of the script to out, MAX_SPECIAL_SIZE bytes at most, and returns its size */
+    unsigned int Compress(uint8_t *out) const;
+    static unsigned int GetSpecialSize(unsigned int nSize);
+    /** Sets the script to the one of special encoding nSize, with the GetSpecialSize(nSize) bytes at in */
+    bool Decompress(unsigned int nSize, const uint8_t *in);
 
 public:
+    static const unsigned int MAX_SPECIAL_SIZE = 33;
+
     CScriptCompressor(CScript &scriptIn) : script(scriptIn) {}
     template <typename Stream>
     void Serialize(Stream &s) const
     {
-        std::vector<uint8_t> compr;
-        if (Compress(compr))
+        // every coin and undo record goes through here, the special encodings stay on the stack
+        uint8_t compr[MAX_SPECIAL_SIZE];
+        const unsigned int nCompressed = Compress(compr);
+        if (nCompressed != 0)
         {
-            s << CFlatData(compr);
+            s.write((const char *)compr, nCompressed);
             return;
         }
         unsigned int nSize = script.size() + nSpecialScripts;
@@ -94,8 +100,8 @@ public:
         s >> VARINT(nSize);
         if (nSize < nSpecialScripts)
         {
-            std::vector<uint8_t> vch(GetSpecialSize(nSize), 0x00);
-            s >> REF(CFlatData(vch));
+            uint8_t vch[MAX_SPECIAL_SIZE - 1];
+            s.read((char *)vch, GetSpecialSize(nSize));
             Decompress(nSize, vch);
             return;
         }
@@ -20,6 +20,7 @@
 
 #include "merkle.h"
 #include "crypto/hash.h"
+#include "crypto/sha256.h"
 #include "util/utilstrencodings.h"
 
 /*     WARNING! If you're reading this because you're learning about crypto
@@ -172,11 +173,32 @@ static void MerkleComputation(const std::vector<uint256> &leaves,
         *proot = h;
 }
 
-uint256 ComputeMerkleRoot(const std::vector<uint256> &leaves, bool *mutated)
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool *mutated)
 {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, NULL);
-    return hash;
+    // Reduce one level at a time in place, so each level is a single batch of 64 byte double hashes for
+    // SHA256D64 to spread over the multi-way implementations. Pairs are checked for duplicates the same way
+    // MerkleComputation does, never the padding entry added to an odd level.
+    bool mutation = false;
+    while (hashes.size() > 1)
+    {
+        if (mutated)
+        {
+            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2)
+            {
+                if (hashes[pos] == hashes[pos + 1])
+                    mutation = true;
+            }
+        }
+        if (hashes.size() & 1)
+            hashes.push_back(hashes.back());
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+    }
+    if (mutated)
+        *mutated = mutation;
+    if (hashes.size() == 0)
+        return uint256();
+    return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256> &leaves, uint32_t position)
@@ -210,9 +232,11 @@ uint256 BlockMerkleRoot(const CBlock &block, bool *mutated)
     leaves.resize(block.vtx.size());
     for (size_t s = 0; s < block.vtx.size(); s++)
     {
-        leaves[s] = block.vtx[s]->GetHash();
+        // A deserialized block's txids were already computed in one batch, otherwise rehash in case a
+        // transaction was changed after it was added (e.g. the miner's coinbase)
+        leaves[s] = block.fTxHashesCached ? uint256(block.vtx[s]->GetId()) : block.vtx[s]->GetHash();
     }
-    return ComputeMerkleRoot(leaves, mutated);
+    return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock &block, uint32_t position)
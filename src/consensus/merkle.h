@@ -27,7 +27,7 @@
 #include "chain/block.h"
 #include "uint256.h"
 
-uint256 ComputeMerkleRoot(const std::vector<uint256> &leaves, bool *mutated = NULL);
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool *mutated = NULL);
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256> &leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256 &leaf, const std::vector<uint256> &branch, uint32_t position);
 
@@ -73,6 +73,8 @@ struct Params
     int64_t nTargetSpacing;
     int64_t nTargetTimespan;
     int64_t DifficultyAdjustmentInterval() const { return nTargetTimespan / nTargetSpacing; }
+    /** Scripts in ancestors of this block are assumed valid unless -assumevalid says otherwise, null for none */
+    uint256 defaultAssumeValid;
 };
 } // namespace Consensus
 
@@ -0,0 +1,135 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2017-2020 The Bitcoin Core developers
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+/** An unsigned 3072 bit number, kept modulo the prime 2^3072 - 1103717 */
+class Num3072
+{
+private:
+    void FullReduce();
+    bool IsOverflow() const;
+    Num3072 GetInverse() const;
+
+public:
+    static constexpr size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static constexpr int LIMBS = 48;
+    static constexpr int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+#endif
+    limb_t limbs[LIMBS];
+
+    // Sanity check for Num3072 constants
+    static_assert(LIMB_SIZE * LIMBS == 3072, "Num3072 isn't 3072 bits");
+    static_assert(sizeof(double_limb_t) == sizeof(limb_t) * 2, "bad size for double_limb_t");
+    static_assert(sizeof(limb_t) * 8 == LIMB_SIZE, "LIMB_SIZE is incorrect");
+
+    //! this = this * a modulo the prime
+    void Multiply(const Num3072 &a);
+    //! this = this / a modulo the prime, a must not be zero
+    void Divide(const Num3072 &a);
+    void SetToOne();
+    void Square();
+    //! little endian, fully reduced
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]);
+
+    Num3072() { this->SetToOne(); };
+    //! from little endian bytes, which may be up to 2^3072 - 1
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        for (int i = 0; i < LIMBS; ++i)
+            ::Serialize(s, this->limbs[i]);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s)
+    {
+        for (int i = 0; i < LIMBS; ++i)
+            ::Unserialize(s, this->limbs[i]);
+    }
+};
+
+/**
+ * A hash of a set of byte strings that does not depend on their order, so it can be kept up to date as elements
+ * are added to and removed from the set instead of being recomputed from all of them.
+ *
+ * Every element is hashed to a number modulo a 3072 bit prime and the hash of the set is the product of those
+ * numbers. Removing an element divides by its number, the products of the added and the removed elements are kept
+ * apart so only Finalize() has to do the expensive inversion. The empty set has the hash of the number one.
+ *
+ * This is the MuHash construction of Bellare and Micciancio, with the elements mapped to numbers by SHA256 and
+ * ChaCha20.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char *data, size_t len);
+
+public:
+    //! a hash of the empty set
+    MuHash3072() noexcept {};
+
+    //! add an element to the set
+    MuHash3072 &Insert(const unsigned char *data, size_t len) noexcept;
+    MuHash3072 &Insert(const std::vector<unsigned char> &in) noexcept { return Insert(in.data(), in.size()); }
+
+    //! remove an element from the set, which has to have been added before
+    MuHash3072 &Remove(const unsigned char *data, size_t len) noexcept;
+    MuHash3072 &Remove(const std::vector<unsigned char> &in) noexcept { return Remove(in.data(), in.size()); }
+
+    //! the union with another set
+    MuHash3072 &operator*=(const MuHash3072 &mul) noexcept;
+    //! the difference to a set that is part of this one
+    MuHash3072 &operator/=(const MuHash3072 &div) noexcept;
+
+    //! the 256 bit hash of the set
+    uint256 Finalize() const noexcept;
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
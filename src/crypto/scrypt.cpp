@@ -27,10 +27,16 @@
  * online backup system.
  */
 
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdint.h>
+#include <new>
 
 #include "scrypt.h"
+#include "scrypt_nway.h"
 #include "pbkdf2.h"
 
 #include "net/net.h"
@@ -176,7 +182,7 @@ void scrypt(const void* input, size_t inputlen, uint32_t *res, void *scratchpad)
     uint32_t X[32];
     V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
 
-    PBKDF2_SHA256((const uint8_t*)input, inputlen, (const uint8_t*)input, sizeof(CBlockHeader), 1, (uint8_t *)X, 128);
+    PBKDF2_SHA256((const uint8_t*)input, inputlen, (const uint8_t*)input, inputlen, 1, (uint8_t *)X, 128);
 
     scrypt_core(X, V);
 
@@ -185,14 +191,12 @@ void scrypt(const void* input, size_t inputlen, uint32_t *res, void *scratchpad)
 
 uint256 scrypt_hash(const void* input, size_t inputlen)
 {
-    unsigned char scratchpad[SCRYPT_BUFFER_SIZE];
-    return scrypt_nosalt(input, inputlen, scratchpad);
+    return scrypt_nosalt(input, inputlen, scrypt_buffer_thread());
 }
 
 uint256 scrypt_salted_hash(const void* input, size_t inputlen, const void* salt, size_t saltlen)
 {
-    unsigned char scratchpad[SCRYPT_BUFFER_SIZE];
-    return scrypt(input, inputlen, salt, saltlen, scratchpad);
+    return scrypt(input, inputlen, salt, saltlen, scrypt_buffer_thread());
 }
 
 uint256 scrypt_salted_multiround_hash(const void* input, size_t inputlen, const void* salt, size_t saltlen, const unsigned int nRounds)
@@ -211,8 +215,7 @@ uint256 scrypt_salted_multiround_hash(const void* input, size_t inputlen, const
 
 uint256 scrypt_blockhash(const void* input)
 {
-    unsigned char scratchpad[SCRYPT_BUFFER_SIZE];
-    return scrypt_nosalt(input, 80, scratchpad);
+    return scrypt_nosalt(input, 80, scrypt_buffer_thread());
 }
 
 unsigned int scanhash_scrypt(CBlockHeader *pdata, void *scratchbuf,
@@ -220,6 +223,8 @@ unsigned int scanhash_scrypt(CBlockHeader *pdata, void *scratchbuf,
     void *result, CBlockHeader *res_header)
 {
     hash_count = 0;
+    if (scratchbuf == NULL)
+        scratchbuf = scrypt_buffer_thread();
     CBlockHeader data = *pdata;
     uint32_t hash[8];
     unsigned char *hashc = (unsigned char *) &hash;
@@ -292,16 +297,106 @@ unsigned int scanhash_scrypt(CBlockHeader *pdata, void *scratchbuf,
     return (unsigned int) -1;
 }
 
+// the scratchpads come from operator new, so the benchmarks count them with everything else
 void *scrypt_buffer_alloc() {
-    return malloc(SCRYPT_BUFFER_SIZE);
+    return ::operator new(SCRYPT_BUFFER_SIZE);
 }
 
 void scrypt_buffer_free(void *scratchpad)
 {
-    free(scratchpad);
+    ::operator delete(scratchpad);
+}
+
+namespace
+{
+/** Owns the scratchpad of one thread, it is released when the thread exits */
+class CScryptScratchpad
+{
+public:
+    void *buffer;
+
+    CScryptScratchpad(size_t size) : buffer(::operator new(size)) {}
+    ~CScryptScratchpad() { ::operator delete(buffer); }
+};
+
+typedef void (*scrypt_core_nway_func)(uint32_t *X, uint32_t *V);
+
+struct CScryptBatchCore
+{
+    size_t lanes;
+    scrypt_core_nway_func core;
+};
+
+/** Pick the widest multi-buffer scrypt core this build and CPU support */
+CScryptBatchCore SelectBatchCore()
+{
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__i386__))
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return {8, scrypt_avx2::scrypt_core_8way};
+    }
+#endif
+#if defined(__SSE2__)
+    return {4, scrypt_sse2::scrypt_core_4way};
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    return {4, scrypt_neon::scrypt_core_4way};
+#else
+    return {1, nullptr};
+#endif
+}
+
+const CScryptBatchCore &GetBatchCore()
+{
+    static const CScryptBatchCore batchCore = SelectBatchCore();
+    return batchCore;
+}
+}
+
+void *scrypt_buffer_thread()
+{
+    static thread_local CScryptScratchpad scratchpad(SCRYPT_BUFFER_SIZE);
+    return scratchpad.buffer;
+}
+
+size_t scrypt_batch_lanes() { return GetBatchCore().lanes; }
+
+void scrypt_blockhash_batch(const void *const *inputs, uint256 *outputs, size_t count)
+{
+    const CScryptBatchCore &batchCore = GetBatchCore();
+    const size_t lanes = batchCore.lanes;
+
+    size_t i = 0;
+    if (lanes > 1 && count >= lanes)
+    {
+        static thread_local CScryptScratchpad scratchpad(SCRYPT_MAX_LANES * (SCRYPT_BUFFER_SIZE - 63) + 63);
+        uint32_t *V = (uint32_t *)(((uintptr_t)(scratchpad.buffer) + 63) & ~(uintptr_t)(63));
+        uint32_t X[SCRYPT_MAX_LANES * 32];
+
+        for (; i + lanes <= count; i += lanes)
+        {
+            for (size_t l = 0; l < lanes; l++)
+            {
+                const uint8_t *input = (const uint8_t *)inputs[i + l];
+                PBKDF2_SHA256(input, 80, input, 80, 1, (uint8_t *)&X[l * 32], 128);
+            }
+            batchCore.core(X, V);
+            for (size_t l = 0; l < lanes; l++)
+            {
+                const uint8_t *input = (const uint8_t *)inputs[i + l];
+                PBKDF2_SHA256(input, 80, (uint8_t *)&X[l * 32], 128, 1, (uint8_t *)&outputs[i + l], 32);
+            }
+        }
+    }
+    // whatever does not fill a whole batch is hashed one at a time
+    for (; i < count; i++)
+    {
+        outputs[i] = scrypt_blockhash(inputs[i]);
+    }
 }
 
 void scrypt_hash_mine(const void* input, size_t inputlen, uint32_t *res, void *scratchpad)
 {
+    if (scratchpad == NULL)
+        scratchpad = scrypt_buffer_thread();
     return scrypt(input, inputlen, res, scratchpad);
 }
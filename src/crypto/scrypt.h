@@ -9,10 +9,22 @@
 
 void *scrypt_buffer_alloc();
 void scrypt_buffer_free(void *scratchpad);
+/** Return the scratchpad owned by the calling thread. It is allocated on first use and reused by
+ *  every later scrypt call made from the same thread, so it must not be freed by the caller.
+ *  scrypt_hash_mine and scanhash_scrypt use it when they are given a NULL scratchpad.
+ */
+void *scrypt_buffer_thread();
 uint256 scrypt_salted_multiround_hash(const void* input, size_t inputlen, const void* salt, size_t saltlen, const unsigned int nRounds);
 uint256 scrypt_salted_hash(const void* input, size_t inputlen, const void* salt, size_t saltlen);
 uint256 scrypt_hash(const void* input, size_t inputlen);
 uint256 scrypt_blockhash(const void* input);
+/** Hash count 80 byte block headers, inputs[i] pointing at the first byte of header i, into
+ *  outputs[i]. Uses the widest multi-buffer scrypt core the CPU supports (AVX2 8-way, SSE2 or
+ *  NEON 4-way) and falls back to scrypt_blockhash for partial batches and other targets.
+ */
+void scrypt_blockhash_batch(const void *const *inputs, uint256 *outputs, size_t count);
+/** Number of headers scrypt_blockhash_batch hashes together, 1 when no multi-buffer core is used */
+size_t scrypt_batch_lanes();
 unsigned int scanhash_scrypt(CBlockHeader *pdata, void *scratchbuf, uint32_t max_nonce, uint32_t &hash_count, void *result, CBlockHeader *res_header);
 void scrypt_hash_mine(const void* input, size_t inputlen, uint32_t *res, void *scratchpad);
 
@@ -0,0 +1,47 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "crypto/scrypt_nway.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+namespace
+{
+struct NEONOps
+{
+    typedef uint32x4_t Vec;
+    static const int LANES = 4;
+
+    static inline Vec Add(Vec a, Vec b) { return vaddq_u32(a, b); }
+    static inline Vec Xor(Vec a, Vec b) { return veorq_u32(a, b); }
+    template <int n>
+    static inline Vec Rotl(Vec a)
+    {
+        return vorrq_u32(vshlq_n_u32(a, n), vshrq_n_u32(a, 32 - n));
+    }
+    static inline Vec Load(const uint32_t *p) { return vld1q_u32(p); }
+    static inline void Store(uint32_t *p, Vec a) { vst1q_u32(p, a); }
+};
+}
+
+namespace scrypt_neon
+{
+void scrypt_core_4way(uint32_t *X, uint32_t *V) { scrypt_detail::scrypt_core_nway<NEONOps>(X, V); }
+}
+#endif
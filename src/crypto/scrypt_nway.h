@@ -0,0 +1,133 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_CRYPTO_SCRYPT_NWAY_H
+#define ECCOIN_CRYPTO_SCRYPT_NWAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** The largest number of lanes any multi-buffer scrypt core processes at once */
+static const size_t SCRYPT_MAX_LANES = 8;
+
+/** Multi-buffer scrypt cores (N = 1024, r = 1, p = 1). Each one runs scrypt_core over
+ *  several independent inputs at once, one input per SIMD lane.
+ *  X holds the 32 word state of every lane, lane after lane.
+ *  V is the scratchpad, it must hold 1024 * 32 words per lane and be 64 byte aligned.
+ *  Which of these exist depends on the target, scrypt_blockhash_batch picks one at runtime.
+ */
+namespace scrypt_sse2
+{
+void scrypt_core_4way(uint32_t *X, uint32_t *V);
+}
+namespace scrypt_avx2
+{
+void scrypt_core_8way(uint32_t *X, uint32_t *V);
+}
+namespace scrypt_neon
+{
+void scrypt_core_4way(uint32_t *X, uint32_t *V);
+}
+
+namespace scrypt_detail
+{
+/** Salsa20/8 over LANES independent blocks. Ops provides the vector type and its
+ *  add, xor, rotate, load and store operations for one instruction set.
+ */
+template <typename Ops>
+inline void xor_salsa8_nway(typename Ops::Vec B[16], const typename Ops::Vec Bx[16])
+{
+    typename Ops::Vec x[16];
+    for (int i = 0; i < 16; i++)
+    {
+        B[i] = Ops::Xor(B[i], Bx[i]);
+        x[i] = B[i];
+    }
+    for (int i = 0; i < 8; i += 2)
+    {
+#define R(a, b, c, n) x[a] = Ops::Xor(x[a], Ops::template Rotl<n>(Ops::Add(x[b], x[c])))
+        /* Operate on columns. */
+        R(4, 0, 12, 7); R(9, 5, 1, 7); R(14, 10, 6, 7); R(3, 15, 11, 7);
+        R(8, 4, 0, 9); R(13, 9, 5, 9); R(2, 14, 10, 9); R(7, 3, 15, 9);
+        R(12, 8, 4, 13); R(1, 13, 9, 13); R(6, 2, 14, 13); R(11, 7, 3, 13);
+        R(0, 12, 8, 18); R(5, 1, 13, 18); R(10, 6, 2, 18); R(15, 11, 7, 18);
+
+        /* Operate on rows. */
+        R(1, 0, 3, 7); R(6, 5, 4, 7); R(11, 10, 9, 7); R(12, 15, 14, 7);
+        R(2, 1, 0, 9); R(7, 6, 5, 9); R(8, 11, 10, 9); R(13, 12, 15, 9);
+        R(3, 2, 1, 13); R(4, 7, 6, 13); R(9, 8, 11, 13); R(14, 13, 12, 13);
+        R(0, 3, 2, 18); R(5, 4, 7, 18); R(10, 9, 8, 18); R(15, 14, 13, 18);
+#undef R
+    }
+    for (int i = 0; i < 16; i++)
+        B[i] = Ops::Add(B[i], x[i]);
+}
+
+/** scrypt_core over Ops::LANES inputs. The state is kept word-interleaved, so vector k
+ *  holds word k of every lane, and the scratchpad stores those vectors as they are.
+ */
+template <typename Ops>
+inline void scrypt_core_nway(uint32_t *X, uint32_t *V)
+{
+    typedef typename Ops::Vec Vec;
+    const int N = Ops::LANES;
+    Vec x[32];
+    Vec *pV = (Vec *)V;
+    uint32_t words[N];
+
+    for (int k = 0; k < 32; k++)
+    {
+        for (int l = 0; l < N; l++)
+            words[l] = X[l * 32 + k];
+        x[k] = Ops::Load(words);
+    }
+
+    for (int i = 0; i < 1024; i++)
+    {
+        for (int k = 0; k < 32; k++)
+            pV[i * 32 + k] = x[k];
+        xor_salsa8_nway<Ops>(&x[0], &x[16]);
+        xor_salsa8_nway<Ops>(&x[16], &x[0]);
+    }
+    for (int i = 0; i < 1024; i++)
+    {
+        // every lane reads its own scratchpad row, so gather it one word at a time
+        uint32_t j[N];
+        Ops::Store(j, x[16]);
+        for (int l = 0; l < N; l++)
+            j[l] = 32 * (j[l] & 1023);
+        for (int k = 0; k < 32; k++)
+        {
+            for (int l = 0; l < N; l++)
+                words[l] = V[(j[l] + k) * N + l];
+            x[k] = Ops::Xor(x[k], Ops::Load(words));
+        }
+        xor_salsa8_nway<Ops>(&x[0], &x[16]);
+        xor_salsa8_nway<Ops>(&x[16], &x[0]);
+    }
+
+    for (int k = 0; k < 32; k++)
+    {
+        Ops::Store(words, x[k]);
+        for (int l = 0; l < N; l++)
+            X[l * 32 + k] = words[l];
+    }
+}
+}
+
+#endif // ECCOIN_CRYPTO_SCRYPT_NWAY_H
@@ -18,10 +18,43 @@
 
 #include "crypto/sha256.h"
 
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include "crypto/common.h"
 
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_ARM_SHANI) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+// Implementations in files of their own, built with the instruction sets they need. Only call them once
+// SHA256AutoDetect has checked the CPU.
+namespace sha256_sse41
+{
+void TransformD64_4way(unsigned char *out, const unsigned char *in);
+}
+namespace sha256_avx2
+{
+void TransformD64_8way(unsigned char *out, const unsigned char *in);
+}
+namespace sha256_shani
+{
+void Transform(uint32_t *s, const unsigned char *chunk, size_t blocks);
+void TransformD64_2way(unsigned char *out, const unsigned char *in);
+}
+namespace sha256_arm_shani
+{
+void Transform(uint32_t *s, const unsigned char *chunk, size_t blocks);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -58,7 +91,7 @@ void inline Initialize(uint32_t* s)
 }
 
 /** Perform one SHA-256 transformation, processing a 64-byte chunk. */
-void Transform(uint32_t* s, const unsigned char* chunk)
+void TransformBlock(uint32_t* s, const unsigned char* chunk)
 {
     uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
     uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
@@ -141,6 +174,60 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Perform SHA-256 transformations over blocks consecutive 64-byte chunks. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        TransformBlock(s, chunk);
+        chunk += 64;
+    }
+}
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Double SHA-256 of one 64-byte input with a given transform: the input, its padding, then the padded hash. */
+template <TransformType tr>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    // A 64-byte message is padded with a block of its own, ending in its length of 512 bits
+    static const unsigned char padding1[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 2, 0};
+    // The 32-byte hash fits in one block with its padding, ending in its length of 256 bits
+    unsigned char buffer[64] = {0};
+    buffer[32] = 0x80;
+    buffer[62] = 1;
+
+    uint32_t s[8];
+    Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer + 4 * i, s[i]);
+    Initialize(s);
+    tr(s, buffer, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+TransformType transform = Transform;
+TransformD64Type transformD64 = TransformD64Wrapper<Transform>;
+TransformD64Type transformD64_2way = nullptr;
+TransformD64Type transformD64_4way = nullptr;
+TransformD64Type transformD64_8way = nullptr;
+std::string strImplementation = "standard";
+
+#if defined(__x86_64__) || defined(__i386__)
+/** Whether the OS saves the AVX registers across context switches */
+bool AVXEnabledByOS()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace sha256
 } // namespace
 
@@ -161,14 +248,15 @@ CSHA256& CSHA256::Write(const uint8_t* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        sha256::transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        sha256::transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -201,3 +289,108 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+std::string SHA256AutoDetect()
+{
+    std::string strName = "standard";
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    bool fSSE41 = false, fAVX2 = false, fSHANI = false;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        fSSE41 = (ecx >> 19) & 1;
+        // AVX2 also needs the OS to save the upper halves of the registers, which OSXSAVE lets us ask
+        const bool fAVX = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && sha256::AVXEnabledByOS();
+        if (__get_cpuid_max(0, nullptr) >= 7)
+        {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            fAVX2 = fAVX && ((ebx >> 5) & 1);
+            fSHANI = fSSE41 && ((ebx >> 29) & 1);
+        }
+    }
+#if defined(ENABLE_SHANI)
+    if (fSHANI)
+    {
+        sha256::transform = sha256_shani::Transform;
+        sha256::transformD64 = sha256::TransformD64Wrapper<sha256_shani::Transform>;
+        sha256::transformD64_2way = sha256_shani::TransformD64_2way;
+        strName = "shani(1way,2way)";
+        // Two interleaved SHA-NI hashes beat eight lanes of AVX2 arithmetic
+        fSSE41 = false;
+        fAVX2 = false;
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (fSSE41)
+    {
+        sha256::transformD64_4way = sha256_sse41::TransformD64_4way;
+        strName += ",sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (fAVX2)
+    {
+        sha256::transformD64_8way = sha256_avx2::TransformD64_8way;
+        strName += ",avx2(8way)";
+    }
+#endif
+    (void)fSSE41;
+    (void)fAVX2;
+    (void)fSHANI;
+#endif // x86
+
+#if defined(ENABLE_ARM_SHANI) && defined(__linux__)
+    if (getauxval(AT_HWCAP) & HWCAP_SHA2)
+    {
+        sha256::transform = sha256_arm_shani::Transform;
+        sha256::transformD64 = sha256::TransformD64Wrapper<sha256_arm_shani::Transform>;
+        strName = "arm_shani(1way)";
+    }
+#endif
+
+    sha256::strImplementation = strName;
+    return strName;
+}
+
+std::string SHA256Implementation() { return sha256::strImplementation; }
+
+void SHA256D64(unsigned char *out, const unsigned char *in, size_t blocks)
+{
+    if (sha256::transformD64_8way)
+    {
+        while (blocks >= 8)
+        {
+            sha256::transformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (sha256::transformD64_4way)
+    {
+        while (blocks >= 4)
+        {
+            sha256::transformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    if (sha256::transformD64_2way)
+    {
+        while (blocks >= 2)
+        {
+            sha256::transformD64_2way(out, in);
+            out += 64;
+            in += 128;
+            blocks -= 2;
+        }
+    }
+    while (blocks)
+    {
+        sha256::transformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -39,4 +40,17 @@ public:
     CSHA256& Reset();
 };
 
+/** Pick the fastest SHA-256 implementations this build and CPU support, and return their names.
+ *  Until this is called the portable code is used. Call it once, before other threads hash anything.
+ */
+std::string SHA256AutoDetect();
+
+/** Name of the SHA-256 implementations in use, as returned by SHA256AutoDetect */
+std::string SHA256Implementation();
+
+/** Compute the double SHA-256 of each of blocks 64 byte inputs, to 32 bytes each.
+ *  out may be the same as in, as when hashing a level of a merkle tree in place.
+ */
+void SHA256D64(unsigned char *out, const unsigned char *in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,64 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "crypto/sha256_nway.h"
+
+// This file is built with the ARMv8 crypto extensions enabled, only call into it after checking the CPU has them
+#ifdef ENABLE_ARM_SHANI
+#include <arm_neon.h>
+
+namespace sha256_arm_shani
+{
+void Transform(uint32_t *s, const unsigned char *chunk, size_t blocks)
+{
+    uint32x4_t abcd = vld1q_u32(&s[0]);
+    uint32x4_t efgh = vld1q_u32(&s[4]);
+
+    while (blocks--)
+    {
+        const uint32x4_t abcdSave = abcd, efghSave = efgh;
+        uint32x4_t m[4];
+        for (int i = 0; i < 4; i++)
+            m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(chunk + 16 * i)));
+        for (int i = 0; i < 16; i++)
+        {
+            // four rounds on words 4 * i up to 4 * i + 3, then the words four rounds later take their place
+            const uint32x4_t wk = vaddq_u32(m[i & 3], vld1q_u32(&sha256_detail::K[4 * i]));
+            if (i < 12)
+            {
+                m[i & 3] =
+                    vsha256su1q_u32(vsha256su0q_u32(m[i & 3], m[(i + 1) & 3]), m[(i + 2) & 3], m[(i + 3) & 3]);
+            }
+            const uint32x4_t abcdPrev = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, wk);
+            efgh = vsha256h2q_u32(efgh, abcdPrev, wk);
+        }
+        abcd = vaddq_u32(abcd, abcdSave);
+        efgh = vaddq_u32(efgh, efghSave);
+        chunk += 64;
+    }
+
+    vst1q_u32(&s[0], abcd);
+    vst1q_u32(&s[4], efgh);
+}
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "crypto/sha256_nway.h"
+
+// This file is built with AVX2 enabled, only call into it after checking the CPU supports it
+#ifdef ENABLE_AVX2
+#include <immintrin.h>
+
+namespace
+{
+struct AVX2Ops
+{
+    typedef __m256i Vec;
+    static const int LANES = 8;
+
+    static inline Vec Add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+    static inline Vec Xor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+    static inline Vec And(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+    static inline Vec Or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+    static inline Vec Shr(Vec a, int n) { return _mm256_srli_epi32(a, n); }
+    static inline Vec Shl(Vec a, int n) { return _mm256_slli_epi32(a, n); }
+    static inline Vec Set1(uint32_t x) { return _mm256_set1_epi32(x); }
+    static inline Vec Load(const uint32_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+    static inline void Store(uint32_t *p, Vec a) { _mm256_storeu_si256((__m256i *)p, a); }
+};
+}
+
+namespace sha256_avx2
+{
+void TransformD64_8way(unsigned char *out, const unsigned char *in)
+{
+    sha256_detail::TransformD64_nway<AVX2Ops>(out, in);
+}
+}
+#endif
@@ -0,0 +1,184 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_CRYPTO_SHA256_NWAY_H
+#define ECCOIN_CRYPTO_SHA256_NWAY_H
+
+#include "crypto/common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sha256_detail
+{
+/** The SHA-256 round constants, four to a 16 byte vector for the instruction set specific transforms */
+alignas(16) static const uint32_t K[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+    0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+    0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c,
+    0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t INIT[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+/** The SHA-256 compression function over Ops::LANES independent blocks. Ops provides the vector type and
+ *  its add, xor, and, or, shift, broadcast, load and store operations for one instruction set.
+ *  Vector i of s and w holds word i of every lane.
+ */
+/**
+ * Round constants with the message schedule of the padding block of a 64 byte message already added in. That
+ * block never changes, so hashing it needs neither the schedule nor the constant loads. Static, as each
+ * user is built with its own instruction set flags and must not share a copy with the others.
+ */
+static inline const uint32_t *PaddingKW()
+{
+    struct Table
+    {
+        uint32_t kw[64];
+        Table()
+        {
+            uint32_t w[64] = {0x80000000};
+            w[15] = 0x200;
+            for (int i = 16; i < 64; i++)
+            {
+                const uint32_t s0 = ((w[i - 15] >> 7) | (w[i - 15] << 25)) ^ ((w[i - 15] >> 18) | (w[i - 15] << 14)) ^
+                                    (w[i - 15] >> 3);
+                const uint32_t s1 = ((w[i - 2] >> 17) | (w[i - 2] << 15)) ^ ((w[i - 2] >> 19) | (w[i - 2] << 13)) ^
+                                    (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            for (int i = 0; i < 64; i++)
+                kw[i] = K[i] + w[i];
+        }
+    };
+    alignas(16) static const Table table;
+    return table.kw;
+}
+
+template <typename Ops>
+struct Rounds
+{
+    typedef typename Ops::Vec Vec;
+
+    static inline Vec Rotr(Vec x, int n) { return Ops::Or(Ops::Shr(x, n), Ops::Shl(x, 32 - n)); }
+    static inline Vec Ch(Vec x, Vec y, Vec z) { return Ops::Xor(z, Ops::And(x, Ops::Xor(y, z))); }
+    static inline Vec Maj(Vec x, Vec y, Vec z) { return Ops::Or(Ops::And(x, y), Ops::And(z, Ops::Or(x, y))); }
+    static inline Vec Sigma0(Vec x) { return Ops::Xor(Ops::Xor(Rotr(x, 2), Rotr(x, 13)), Rotr(x, 22)); }
+    static inline Vec Sigma1(Vec x) { return Ops::Xor(Ops::Xor(Rotr(x, 6), Rotr(x, 11)), Rotr(x, 25)); }
+    static inline Vec sigma0(Vec x) { return Ops::Xor(Ops::Xor(Rotr(x, 7), Rotr(x, 18)), Ops::Shr(x, 3)); }
+    static inline Vec sigma1(Vec x) { return Ops::Xor(Ops::Xor(Rotr(x, 17), Rotr(x, 19)), Ops::Shr(x, 10)); }
+
+    /** One round, kw being the round constant plus the message word */
+    static inline void Round(Vec v[8], Vec kw)
+    {
+        Vec t1 = Ops::Add(Ops::Add(v[7], Sigma1(v[4])), Ops::Add(Ch(v[4], v[5], v[6]), kw));
+        Vec t2 = Ops::Add(Sigma0(v[0]), Maj(v[0], v[1], v[2]));
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = Ops::Add(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = Ops::Add(t1, t2);
+    }
+
+    static inline void AddState(Vec s[8], const Vec v[8])
+    {
+        for (int i = 0; i < 8; i++)
+            s[i] = Ops::Add(s[i], v[i]);
+    }
+};
+
+template <typename Ops>
+inline void Transform_nway(typename Ops::Vec s[8], typename Ops::Vec w[16])
+{
+    typedef Rounds<Ops> R;
+    typename Ops::Vec v[8];
+    for (int i = 0; i < 8; i++)
+        v[i] = s[i];
+    for (int i = 0; i < 64; i++)
+    {
+        if (i >= 16)
+        {
+            // the message schedule, kept in a ring of 16
+            w[i & 15] = Ops::Add(Ops::Add(w[i & 15], R::sigma0(w[(i + 1) & 15])),
+                Ops::Add(w[(i + 9) & 15], R::sigma1(w[(i + 14) & 15])));
+        }
+        R::Round(v, Ops::Add(Ops::Set1(K[i]), w[i & 15]));
+    }
+    R::AddState(s, v);
+}
+
+/** The padding block of a 64 byte message */
+template <typename Ops>
+inline void TransformPadding_nway(typename Ops::Vec s[8])
+{
+    typedef Rounds<Ops> R;
+    const uint32_t *kw = PaddingKW();
+    typename Ops::Vec v[8];
+    for (int i = 0; i < 8; i++)
+        v[i] = s[i];
+    for (int i = 0; i < 64; i++)
+        R::Round(v, Ops::Set1(kw[i]));
+    R::AddState(s, v);
+}
+
+template <typename Ops>
+inline void TransformD64_nway(unsigned char *out, const unsigned char *in)
+{
+    typedef typename Ops::Vec Vec;
+    const int N = Ops::LANES;
+    uint32_t words[N];
+    Vec s[8], w[16];
+
+    // First hash: the input block, then the block holding only its padding
+    for (int i = 0; i < 8; i++)
+        s[i] = Ops::Set1(INIT[i]);
+    for (int i = 0; i < 16; i++)
+    {
+        for (int l = 0; l < N; l++)
+            words[l] = ReadBE32(in + 64 * l + 4 * i);
+        w[i] = Ops::Load(words);
+    }
+    Transform_nway<Ops>(s, w);
+    TransformPadding_nway<Ops>(s);
+
+    // Second hash: the first hash with its padding, in one block
+    for (int i = 0; i < 8; i++)
+    {
+        w[i] = s[i];
+        s[i] = Ops::Set1(INIT[i]);
+    }
+    for (int i = 8; i < 16; i++)
+        w[i] = Ops::Set1(i == 8 ? 0x80000000 : i == 15 ? 0x100 : 0);
+    Transform_nway<Ops>(s, w);
+
+    for (int i = 0; i < 8; i++)
+    {
+        Ops::Store(words, s[i]);
+        for (int l = 0; l < N; l++)
+            WriteBE32(out + 32 * l + 4 * i, words[l]);
+    }
+}
+}
+
+#endif // ECCOIN_CRYPTO_SHA256_NWAY_H
@@ -0,0 +1,167 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "crypto/sha256_nway.h"
+
+// This file is built with the SHA extensions enabled, only call into it after checking the CPU supports them
+#ifdef ENABLE_SHANI
+#include <immintrin.h>
+
+namespace
+{
+/** Byte order of the message words within a 16 byte load */
+alignas(16) const uint8_t BSWAP_MASK[16] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+
+inline __m128i LoadMessage(const unsigned char *in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), _mm_load_si128((const __m128i *)BSWAP_MASK));
+}
+
+/** Four rounds on the message words in m, with round constants 4 * i up to 4 * i + 3 */
+inline void QuadRound(__m128i &abef, __m128i &cdgh, __m128i m, int i)
+{
+    const __m128i wk = _mm_add_epi32(m, _mm_load_si128((const __m128i *)&sha256_detail::K[4 * i]));
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));
+}
+
+/** The next four message words from the previous sixteen, m0 being the oldest four */
+inline __m128i NextMessage(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    const __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4));
+    return _mm_sha256msg2_epu32(t, m3);
+}
+
+/** Four rounds with the round constants already added to the message words */
+inline void QuadRoundKW(__m128i &abef, __m128i &cdgh, __m128i wk)
+{
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));
+}
+
+/** ABCD and EFGH to the ABEF and CDGH the round instructions want */
+inline void ToRoundOrder(__m128i dcba, __m128i hgfe, __m128i &abef, __m128i &cdgh)
+{
+    const __m128i badc = _mm_shuffle_epi32(dcba, 0xb1);
+    const __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    abef = _mm_alignr_epi8(badc, efgh, 8);
+    cdgh = _mm_blend_epi16(efgh, badc, 0xf0);
+}
+
+inline void FromRoundOrder(__m128i abef, __m128i cdgh, __m128i &dcba, __m128i &hgfe)
+{
+    const __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    const __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    dcba = _mm_blend_epi16(feba, dchg, 0xf0);
+    hgfe = _mm_alignr_epi8(dchg, feba, 8);
+}
+
+/** All 64 rounds over the message words m, which are overwritten by the schedule */
+template <int N>
+inline void Rounds(__m128i abef[N], __m128i cdgh[N], __m128i m[N][4])
+{
+    for (int i = 0; i < 16; i++)
+    {
+        for (int l = 0; l < N; l++)
+        {
+            if (i >= 4)
+                m[l][i & 3] = NextMessage(m[l][i & 3], m[l][(i + 1) & 3], m[l][(i + 2) & 3], m[l][(i + 3) & 3]);
+            QuadRound(abef[l], cdgh[l], m[l][i & 3], i);
+        }
+    }
+}
+}
+
+namespace sha256_shani
+{
+void Transform(uint32_t *s, const unsigned char *chunk, size_t blocks)
+{
+    __m128i abef[1], cdgh[1];
+    ToRoundOrder(_mm_loadu_si128((const __m128i *)s), _mm_loadu_si128((const __m128i *)(s + 4)), abef[0], cdgh[0]);
+
+    while (blocks--)
+    {
+        const __m128i abefSave = abef[0], cdghSave = cdgh[0];
+        __m128i m[1][4];
+        for (int i = 0; i < 4; i++)
+            m[0][i] = LoadMessage(chunk + 16 * i);
+        Rounds<1>(abef, cdgh, m);
+        abef[0] = _mm_add_epi32(abef[0], abefSave);
+        cdgh[0] = _mm_add_epi32(cdgh[0], cdghSave);
+        chunk += 64;
+    }
+
+    __m128i dcba, hgfe;
+    FromRoundOrder(abef[0], cdgh[0], dcba, hgfe);
+    _mm_storeu_si128((__m128i *)s, dcba);
+    _mm_storeu_si128((__m128i *)(s + 4), hgfe);
+}
+
+void TransformD64_2way(unsigned char *out, const unsigned char *in)
+{
+    // The two hashes are independent, interleaving them hides the latency of the round instructions
+    const __m128i mask = _mm_load_si128((const __m128i *)BSWAP_MASK);
+    __m128i initAbef, initCdgh;
+    ToRoundOrder(_mm_loadu_si128((const __m128i *)sha256_detail::INIT),
+        _mm_loadu_si128((const __m128i *)(sha256_detail::INIT + 4)), initAbef, initCdgh);
+    const uint32_t *kw = sha256_detail::PaddingKW();
+
+    // First hash: the input block, then the block holding only its padding
+    __m128i abef[2] = {initAbef, initAbef}, cdgh[2] = {initCdgh, initCdgh};
+    __m128i m[2][4];
+    for (int l = 0; l < 2; l++)
+        for (int i = 0; i < 4; i++)
+            m[l][i] = LoadMessage(in + 64 * l + 16 * i);
+    Rounds<2>(abef, cdgh, m);
+    __m128i abefMid[2], cdghMid[2];
+    for (int l = 0; l < 2; l++)
+    {
+        abefMid[l] = abef[l] = _mm_add_epi32(abef[l], initAbef);
+        cdghMid[l] = cdgh[l] = _mm_add_epi32(cdgh[l], initCdgh);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        const __m128i wk = _mm_loadu_si128((const __m128i *)(kw + 4 * i));
+        for (int l = 0; l < 2; l++)
+            QuadRoundKW(abef[l], cdgh[l], wk);
+    }
+
+    // Second hash: the first hash with its padding, in one block
+    for (int l = 0; l < 2; l++)
+    {
+        FromRoundOrder(_mm_add_epi32(abef[l], abefMid[l]), _mm_add_epi32(cdgh[l], cdghMid[l]), m[l][0], m[l][1]);
+        m[l][2] = _mm_set_epi32(0, 0, 0, 0x80000000);
+        m[l][3] = _mm_set_epi32(0x100, 0, 0, 0);
+        abef[l] = initAbef;
+        cdgh[l] = initCdgh;
+    }
+    Rounds<2>(abef, cdgh, m);
+    for (int l = 0; l < 2; l++)
+    {
+        __m128i dcba, hgfe;
+        FromRoundOrder(_mm_add_epi32(abef[l], initAbef), _mm_add_epi32(cdgh[l], initCdgh), dcba, hgfe);
+        _mm_storeu_si128((__m128i *)(out + 32 * l), _mm_shuffle_epi8(dcba, mask));
+        _mm_storeu_si128((__m128i *)(out + 32 * l + 16), _mm_shuffle_epi8(hgfe, mask));
+    }
+}
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "crypto/sha256_nway.h"
+
+// This file is built with SSE4.1 enabled, only call into it after checking the CPU supports it
+#ifdef ENABLE_SSE41
+#include <smmintrin.h>
+
+namespace
+{
+struct SSE41Ops
+{
+    typedef __m128i Vec;
+    static const int LANES = 4;
+
+    static inline Vec Add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+    static inline Vec Xor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+    static inline Vec And(Vec a, Vec b) { return _mm_and_si128(a, b); }
+    static inline Vec Or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+    static inline Vec Shr(Vec a, int n) { return _mm_srli_epi32(a, n); }
+    static inline Vec Shl(Vec a, int n) { return _mm_slli_epi32(a, n); }
+    static inline Vec Set1(uint32_t x) { return _mm_set1_epi32(x); }
+    static inline Vec Load(const uint32_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+    static inline void Store(uint32_t *p, Vec a)
+    {
+        p[0] = _mm_extract_epi32(a, 0);
+        p[1] = _mm_extract_epi32(a, 1);
+        p[2] = _mm_extract_epi32(a, 2);
+        p[3] = _mm_extract_epi32(a, 3);
+    }
+};
+}
+
+namespace sha256_sse41
+{
+void TransformD64_4way(unsigned char *out, const unsigned char *in)
+{
+    sha256_detail::TransformD64_nway<SSE41Ops>(out, in);
+}
+}
+#endif
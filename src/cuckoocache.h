@@ -0,0 +1,259 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include "crypto/common.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * Fixed size set of 256 bit hashes, for caches whose entries are already uniformly distributed (salted) hashes.
+ *
+ * The table is allocated once and never grows: every slot holds one entry in 32 bytes, so the memory used is
+ * Capacity() * 32 bytes. An entry may live in any of NUM_LOCATIONS slots, chosen from its own bits. Lookups
+ * and erases do not lock, inserts are serialized among themselves and move entries around cuckoo style to
+ * make room, dropping the last one displaced when that takes too long.
+ *
+ * The low byte of an entry is not stored, it holds the generation the entry was inserted or last refreshed
+ * in instead. Generation 0 marks a free slot. Erase() only zeroes the generation, and entries that have not
+ * been refreshed for two generations are overwritten the same way free ones are, so nothing is ever erased
+ * eagerly. The generation moves on after every Capacity() / 2 inserts.
+ *
+ * A lookup racing an insert into the same slot can miss an entry that is there, never find one that is not.
+ */
+class CCuckooCache
+{
+public:
+    static const int NUM_LOCATIONS = 8;
+    //! Number of displacements an insert attempts before it drops an entry
+    static const int MAX_DEPTH = 32;
+
+private:
+    struct Slot
+    {
+        //! words[3] is written last and carries the generation, readers use it as a sequence number
+        std::atomic<uint64_t> words[4];
+    };
+    static_assert(sizeof(Slot) == 32, "cuckoo cache slots must be exactly one entry wide");
+
+    static const uint64_t GENERATION_MASK = 0xff;
+
+    size_t nSlots;
+    std::unique_ptr<Slot[]> slots;
+
+    //! Serializes inserts, protects the members below
+    std::mutex cs_insert;
+    uint8_t nGeneration;
+    size_t nInsertsThisGeneration;
+    uint32_t nEvictCursor;
+
+    static void ToWords(const uint256 &entry, uint64_t words[4])
+    {
+        memcpy(words, entry.begin(), 32);
+        words[3] &= ~GENERATION_MASK;
+    }
+
+    void Locations(const uint64_t words[4], size_t locs[NUM_LOCATIONS]) const
+    {
+        // Any 32 bits of a salted hash are as good as a fresh hash, map each word onto [0, nSlots)
+        for (int i = 0; i < NUM_LOCATIONS; i++)
+        {
+            uint32_t w = (uint32_t)(words[i / 2] >> (32 * (i % 2)));
+            locs[i] = (size_t)(((uint64_t)w * nSlots) >> 32);
+        }
+    }
+
+    //! Read a slot without locking, returns false if a writer got in the way
+    static bool Read(const Slot &slot, uint64_t words[4])
+    {
+        uint64_t nSeq = slot.words[3].load(std::memory_order_acquire);
+        words[0] = slot.words[0].load(std::memory_order_relaxed);
+        words[1] = slot.words[1].load(std::memory_order_relaxed);
+        words[2] = slot.words[2].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        words[3] = nSeq;
+        return slot.words[3].load(std::memory_order_relaxed) == nSeq;
+    }
+
+    //! Must hold cs_insert. words[3] carries the generation.
+    static void Write(Slot &slot, const uint64_t words[4])
+    {
+        slot.words[3].store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.words[0].store(words[0], std::memory_order_relaxed);
+        slot.words[1].store(words[1], std::memory_order_relaxed);
+        slot.words[2].store(words[2], std::memory_order_relaxed);
+        slot.words[3].store(words[3], std::memory_order_release);
+    }
+
+    static bool SameEntry(const uint64_t a[4], const uint64_t b[4])
+    {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] &&
+               (a[3] & ~GENERATION_MASK) == (b[3] & ~GENERATION_MASK);
+    }
+
+    //! Must hold cs_insert. A slot can be overwritten if it is free or two generations old.
+    bool Reusable(uint64_t nWord3) const
+    {
+        uint8_t nGen = nWord3 & GENERATION_MASK;
+        if (nGen == 0)
+            return true;
+        uint8_t nPrev = nGeneration == 1 ? 255 : nGeneration - 1;
+        return nGen != nGeneration && nGen != nPrev;
+    }
+
+public:
+    //! Create a cache taking at most nBytes, which holds nothing if that is less than one entry
+    explicit CCuckooCache(size_t nBytes)
+        : nSlots(nBytes / sizeof(Slot)), nGeneration(1), nInsertsThisGeneration(0), nEvictCursor(0)
+    {
+        if (nSlots)
+        {
+            slots.reset(new Slot[nSlots]);
+            for (size_t i = 0; i < nSlots; i++)
+                for (int j = 0; j < 4; j++)
+                    slots[i].words[j].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t Capacity() const { return nSlots; }
+    size_t MemoryUsage() const { return nSlots * sizeof(Slot); }
+
+    /** Whether the entry is in the cache. With fErase, also mark it free for the next insert. */
+    bool Contains(const uint256 &entry, bool fErase = false)
+    {
+        if (nSlots == 0)
+            return false;
+        uint64_t key[4];
+        ToWords(entry, key);
+        size_t locs[NUM_LOCATIONS];
+        Locations(key, locs);
+        for (int i = 0; i < NUM_LOCATIONS; i++)
+        {
+            uint64_t words[4];
+            if (!Read(slots[locs[i]], words) || (words[3] & GENERATION_MASK) == 0 || !SameEntry(words, key))
+                continue;
+            if (fErase)
+            {
+                // Fails harmlessly if the slot was rewritten since we read it
+                slots[locs[i]].words[3].compare_exchange_strong(words[3], words[3] & ~GENERATION_MASK);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /** The entries in the cache, those of the oldest generation first. Inserting them in this order into a
+     *  cache too small for all of them keeps the most recent ones. The byte holding the generation is zero.
+     */
+    std::vector<uint256> GetEntries()
+    {
+        // generations run from 1 to 255, bucket the entries by how many generations ago they were refreshed
+        std::vector<std::vector<uint256> > vByAge(255);
+        {
+            std::lock_guard<std::mutex> lock(cs_insert);
+            for (size_t i = 0; i < nSlots; i++)
+            {
+                // with inserts locked out an erase is all that can race the read, and it only clears the generation
+                uint64_t words[4];
+                Read(slots[i], words);
+                const uint8_t nGen = words[3] & GENERATION_MASK;
+                if (nGen == 0)
+                    continue;
+                words[3] &= ~GENERATION_MASK;
+                uint256 entry;
+                memcpy(entry.begin(), words, 32);
+                vByAge[(nGeneration + 255 - nGen) % 255].push_back(entry);
+            }
+        }
+        std::vector<uint256> vEntries;
+        for (auto it = vByAge.rbegin(); it != vByAge.rend(); ++it)
+            vEntries.insert(vEntries.end(), it->begin(), it->end());
+        return vEntries;
+    }
+
+    /** Forget an entry, if it is in the cache */
+    void Erase(const uint256 &entry) { Contains(entry, true); }
+
+    /** Add an entry, possibly pushing out an older one */
+    void Insert(const uint256 &entry)
+    {
+        if (nSlots == 0)
+            return;
+        std::lock_guard<std::mutex> lock(cs_insert);
+        if (++nInsertsThisGeneration > nSlots / 2)
+        {
+            nGeneration = nGeneration == 255 ? 1 : nGeneration + 1;
+            nInsertsThisGeneration = 0;
+        }
+
+        uint64_t cur[4];
+        ToWords(entry, cur);
+        size_t locs[NUM_LOCATIONS];
+        Locations(cur, locs);
+        // Already there: only refresh its generation
+        for (int i = 0; i < NUM_LOCATIONS; i++)
+        {
+            uint64_t words[4];
+            Read(slots[locs[i]], words);
+            if ((words[3] & GENERATION_MASK) != 0 && SameEntry(words, cur))
+            {
+                slots[locs[i]].words[3].store(cur[3] | nGeneration, std::memory_order_release);
+                return;
+            }
+        }
+
+        cur[3] |= nGeneration;
+        size_t nLastLoc = nSlots;
+        for (int depth = 0; depth < MAX_DEPTH; depth++)
+        {
+            for (int i = 0; i < NUM_LOCATIONS; i++)
+            {
+                if (Reusable(slots[locs[i]].words[3].load(std::memory_order_relaxed)))
+                {
+                    Write(slots[locs[i]], cur);
+                    return;
+                }
+            }
+            // All taken by live entries: swap with one of them, not the one we just came from, and
+            // find the displaced entry a new home.
+            size_t nLoc = locs[nEvictCursor++ % NUM_LOCATIONS];
+            if (nLoc == nLastLoc)
+                nLoc = locs[nEvictCursor++ % NUM_LOCATIONS];
+            uint64_t victim[4];
+            Read(slots[nLoc], victim);
+            Write(slots[nLoc], cur);
+            memcpy(cur, victim, sizeof(cur));
+            nLastLoc = nLoc;
+            // its generation goes along with it, but its locations are those of the entry without it
+            uint64_t key[4] = {cur[0], cur[1], cur[2], cur[3] & ~GENERATION_MASK};
+            Locations(key, locs);
+        }
+        // Gave up, the entry left in hand is dropped
+    }
+};
+
+#endif // BITCOIN_CUCKOOCACHE_H
@@ -21,12 +21,15 @@
 
 #include "random.h"
 #include "util/util.h"
+#include "util/utilstrencodings.h"
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <leveldb/helpers/memenv/memenv.h>
+#include <sstream>
 #include <stdint.h>
+#include <stdio.h>
 
 void HandleError(const leveldb::Status &status) throw(dbwrapper_error)
 {
@@ -42,14 +45,57 @@ void HandleError(const leveldb::Status &status) throw(dbwrapper_error)
     throw dbwrapper_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+namespace
+{
+/** A block cache that counts how often LevelDB finds a block in it */
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache *pcache;
+    std::atomic<uint64_t> &nHits;
+    std::atomic<uint64_t> &nMisses;
+
+public:
+    CCountingCache(leveldb::Cache *pcacheIn, std::atomic<uint64_t> &nHitsIn, std::atomic<uint64_t> &nMissesIn)
+        : pcache(pcacheIn), nHits(nHitsIn), nMisses(nMissesIn)
+    {
+    }
+    ~CCountingCache() { delete pcache; }
+    Handle *Insert(const leveldb::Slice &key,
+        void *value,
+        size_t charge,
+        void (*deleter)(const leveldb::Slice &key, void *value)) override
+    {
+        return pcache->Insert(key, value, charge, deleter);
+    }
+    Handle *Lookup(const leveldb::Slice &key) override
+    {
+        Handle *handle = pcache->Lookup(key);
+        if (handle)
+            nHits.fetch_add(1, std::memory_order_relaxed);
+        else
+            nMisses.fetch_add(1, std::memory_order_relaxed);
+        return handle;
+    }
+    void Release(Handle *handle) override { pcache->Release(handle); }
+    void *Value(Handle *handle) override { return pcache->Value(handle); }
+    void Erase(const leveldb::Slice &key) override { pcache->Erase(key); }
+    uint64_t NewId() override { return pcache->NewId(); }
+    void Prune() override { pcache->Prune(); }
+    size_t TotalCharge() const override { return pcache->TotalCharge(); }
+};
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions &dbOptions)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = dbOptions.nWriteBufferSize ? dbOptions.nWriteBufferSize : nCacheSize / 4;
+    options.block_size = dbOptions.nBlockSize;
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.compression = dbOptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dbOptions.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16))
     {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -59,14 +105,23 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path &path,
+    size_t nCacheSize,
+    bool fMemory,
+    bool fWipe,
+    bool obfuscate,
+    const CDBOptions &dbOptions)
+    : dbopts(dbOptions), nBlockCacheSize(nCacheSize / 2), nReads(0), nReadMisses(0), nReadBytes(0), nBatches(0),
+      nBatchBytes(0), nCacheHits(0), nCacheMisses(0)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dbOptions);
+    options.block_cache = new CCountingCache(options.block_cache, nCacheHits, nCacheMisses);
+    dbopts.nWriteBufferSize = options.write_buffer_size;
     options.create_if_missing = true;
     if (fMemory)
     {
@@ -125,9 +180,71 @@ bool CDBWrapper::WriteBatch(CDBBatch &batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     HandleError(status);
+    nBatches.fetch_add(1, std::memory_order_relaxed);
+    nBatchBytes.fetch_add(batch.SizeEstimate(), std::memory_order_relaxed);
     return true;
 }
 
+CDBStats CDBWrapper::GetStats() const
+{
+    CDBStats stats;
+    stats.options = dbopts;
+    stats.nBlockCacheSize = nBlockCacheSize;
+    stats.nReads = nReads.load(std::memory_order_relaxed);
+    stats.nReadMisses = nReadMisses.load(std::memory_order_relaxed);
+    stats.nReadBytes = nReadBytes.load(std::memory_order_relaxed);
+    stats.nBatches = nBatches.load(std::memory_order_relaxed);
+    stats.nBatchBytes = nBatchBytes.load(std::memory_order_relaxed);
+    stats.nCacheHits = nCacheHits.load(std::memory_order_relaxed);
+    stats.nCacheMisses = nCacheMisses.load(std::memory_order_relaxed);
+    stats.nCacheUsage = options.block_cache->TotalCharge();
+
+    std::string strValue;
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nMemoryUsage = atoi64(strValue);
+
+    // as many levels as LevelDB has files counts for
+    while (pdb->GetProperty(strprintf("leveldb.num-files-at-level%u", stats.vLevels.size()), &strValue))
+    {
+        stats.vLevels.emplace_back();
+        stats.vLevels.back().nFiles = atoi(strValue);
+    }
+
+    // the sizes of the files, a line per level followed by one per file as " number:size[smallest .. largest]"
+    if (pdb->GetProperty("leveldb.sstables", &strValue))
+    {
+        std::istringstream lines(strValue);
+        std::string line;
+        size_t nLevel = 0;
+        while (std::getline(lines, line))
+        {
+            if (line.compare(0, 10, "--- level ") == 0)
+                nLevel = atoi(line.substr(10));
+            else if (nLevel < stats.vLevels.size() && line.find(':') != std::string::npos)
+                stats.vLevels[nLevel].nBytes += atoi64(line.substr(line.find(':') + 1));
+        }
+    }
+
+    // the compactions, a table with a row for every level that has files or was compacted into
+    if (pdb->GetProperty("leveldb.stats", &strValue))
+    {
+        std::istringstream lines(strValue);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            int nLevel, nFiles;
+            double dSize, dTime, dRead, dWrite;
+            if (sscanf(line.c_str(), "%d %d %lf %lf %lf %lf", &nLevel, &nFiles, &dSize, &dTime, &dRead, &dWrite) != 6 ||
+                nLevel < 0 || (size_t)nLevel >= stats.vLevels.size())
+                continue;
+            stats.vLevels[nLevel].dCompactionTime = dTime;
+            stats.vLevels[nLevel].dCompactionReadMB = dRead;
+            stats.vLevels[nLevel].dCompactionWriteMB = dWrite;
+        }
+    }
+    return stats;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -32,9 +32,18 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <atomic>
+#include <memory>
+#include <vector>
 
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+//! -<db>dbblocksize default, the size of the blocks of data tables before compression
+static const int64_t DEFAULT_DB_BLOCK_SIZE = 4096;
+//! -<db>dbmaxopenfiles default, LevelDB uses at least 74
+static const int64_t DEFAULT_DB_MAX_OPEN_FILES = 64;
+//! -<db>dbcompression default
+static const bool DEFAULT_DB_COMPRESSION = false;
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -44,6 +53,55 @@ public:
 
 class CDBWrapper;
 
+/** LevelDB settings of one database */
+struct CDBOptions
+{
+    size_t nBlockSize;
+    bool fCompression;
+    int nMaxOpenFiles;
+    //! the size of one write buffer, 0 for a quarter of the cache size
+    size_t nWriteBufferSize;
+
+    CDBOptions()
+        : nBlockSize(DEFAULT_DB_BLOCK_SIZE), fCompression(DEFAULT_DB_COMPRESSION),
+          nMaxOpenFiles(DEFAULT_DB_MAX_OPEN_FILES), nWriteBufferSize(0)
+    {
+    }
+};
+
+/** The files of one LevelDB level and the compactions that wrote them */
+struct CDBLevelStats
+{
+    int nFiles = 0;
+    uint64_t nBytes = 0;
+    //! LevelDB reports these in whole seconds and megabytes
+    double dCompactionTime = 0;
+    double dCompactionReadMB = 0;
+    double dCompactionWriteMB = 0;
+};
+
+/** What a CDBWrapper did since it was opened and how its data is laid out */
+struct CDBStats
+{
+    CDBOptions options;
+    size_t nBlockCacheSize = 0;
+
+    //! Read and Exists calls, the ones that found nothing and the size of the values found
+    uint64_t nReads = 0;
+    uint64_t nReadMisses = 0;
+    uint64_t nReadBytes = 0;
+    uint64_t nBatches = 0;
+    uint64_t nBatchBytes = 0;
+    //! lookups of the block cache, those of reads as well as iterators
+    uint64_t nCacheHits = 0;
+    uint64_t nCacheMisses = 0;
+    size_t nCacheUsage = 0;
+    //! the block cache and the write buffers
+    size_t nMemoryUsage = 0;
+
+    std::vector<CDBLevelStats> vLevels;
+};
+
 /**
  * These should be considered an implementation detail of the specific database.
  */
@@ -71,8 +129,8 @@ private:
     const CDBWrapper &parent;
     leveldb::WriteBatch batch;
 
-    CDataStream ssKey;
-    CDataStream ssValue;
+    CPublicDataStream ssKey;
+    CPublicDataStream ssValue;
 
     size_t size_estimate;
 
@@ -134,6 +192,23 @@ public:
     size_t SizeEstimate() const { return size_estimate; }
 };
 
+/** The state of a database when it was taken, iterators created on it do not see what is written later */
+class CDBSnapshot
+{
+private:
+    leveldb::DB *pdb;
+    const leveldb::Snapshot *psnapshot;
+
+    CDBSnapshot(leveldb::DB *pdbIn) : pdb(pdbIn), psnapshot(pdbIn->GetSnapshot()) {}
+    CDBSnapshot(const CDBSnapshot &);
+    void operator=(const CDBSnapshot &);
+
+    friend class CDBWrapper;
+
+public:
+    ~CDBSnapshot() { pdb->ReleaseSnapshot(psnapshot); }
+};
+
 class CDBIterator
 {
 private:
@@ -155,7 +230,7 @@ public:
     template <typename K>
     void Seek(const K &key)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
@@ -170,7 +245,7 @@ public:
         leveldb::Slice slKey = piter->key();
         try
         {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CPublicDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             ssKey >> key;
         }
         catch (const std::exception &)
@@ -181,13 +256,23 @@ public:
     }
 
     unsigned int GetKeySize() { return piter->key().size(); }
+    /** Copy the current value into ssValue with the obfuscation removed, so it can be
+     *  deserialized later, possibly on another thread.
+     */
+    void GetValueStream(CPublicDataStream &ssValue)
+    {
+        leveldb::Slice slValue = piter->value();
+        ssValue.clear();
+        ssValue.write(slValue.data(), slValue.size());
+        ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
+    }
     template <typename V>
     bool GetValue(V &value)
     {
         leveldb::Slice slValue = piter->value();
         try
         {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CPublicDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
             ssValue >> value;
         }
@@ -237,8 +322,31 @@ private:
     //! the length of the obfuscate key in number of bytes
     static const unsigned int OBFUSCATE_KEY_NUM_BYTES;
 
+    //! the settings the database was opened with, for GetStats
+    CDBOptions dbopts;
+    size_t nBlockCacheSize;
+
+    mutable std::atomic<uint64_t> nReads;
+    mutable std::atomic<uint64_t> nReadMisses;
+    mutable std::atomic<uint64_t> nReadBytes;
+    std::atomic<uint64_t> nBatches;
+    std::atomic<uint64_t> nBatchBytes;
+    //! counted by the block cache
+    std::atomic<uint64_t> nCacheHits;
+    std::atomic<uint64_t> nCacheMisses;
+
     std::vector<uint8_t> CreateObfuscateKey() const;
 
+    //! count a Read or Exists, valueSize of what was found
+    void CountRead(const leveldb::Status &status, size_t valueSize) const
+    {
+        nReads.fetch_add(1, std::memory_order_relaxed);
+        if (status.IsNotFound())
+            nReadMisses.fetch_add(1, std::memory_order_relaxed);
+        else
+            nReadBytes.fetch_add(valueSize, std::memory_order_relaxed);
+    }
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will
@@ -249,24 +357,27 @@ public:
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If
      * false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dbOptions   The LevelDB settings of this database.
      */
     CDBWrapper(const fs::path &path,
         size_t nCacheSize,
         bool fMemory = false,
         bool fWipe = false,
-        bool obfuscate = false);
+        bool obfuscate = false,
+        const CDBOptions &dbOptions = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V>
     bool Read(const K &key, V &value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        CountRead(status, strValue.size());
         if (!status.ok())
         {
             if (status.IsNotFound())
@@ -276,7 +387,7 @@ public:
         }
         try
         {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            CPublicDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(obfuscate_key);
             ssValue >> value;
         }
@@ -287,6 +398,49 @@ public:
         return true;
     }
 
+    /**
+     * Read the values of keys with one iterator seeking forward, the data block it is at serves the next key without
+     * another lookup. Keys in the order of the database read each block once. Adds the index in keys and the value
+     * of the ones there are to vFound.
+     */
+    template <typename K, typename V>
+    void ReadMany(const std::vector<K> &keys, std::vector<std::pair<size_t, V> > &vFound) const
+    {
+        std::unique_ptr<leveldb::Iterator> piter(pdb->NewIterator(readoptions));
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            ssKey.clear();
+            ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+            ssKey << keys[i];
+            leveldb::Slice slKey(ssKey.data(), ssKey.size());
+            piter->Seek(slKey);
+            if (!piter->Valid() || piter->key() != slKey)
+            {
+                if (!piter->status().ok())
+                {
+                    LogPrintf("LevelDB read failure: %s\n", piter->status().ToString());
+                    dbwrapper_private::HandleError(piter->status());
+                }
+                CountRead(leveldb::Status::NotFound(slKey), 0);
+                continue;
+            }
+            leveldb::Slice slValue = piter->value();
+            CountRead(leveldb::Status::OK(), slValue.size());
+            try
+            {
+                CPublicDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                ssValue.Xor(obfuscate_key);
+                V value;
+                ssValue >> value;
+                vFound.emplace_back(i, std::move(value));
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+    }
+
     template <typename K, typename V>
     bool Write(const K &key, const V &value, bool fSync = false)
     {
@@ -298,13 +452,14 @@ public:
     template <typename K>
     bool Exists(const K &key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        CountRead(status, strValue.size());
         if (!status.ok())
         {
             if (status.IsNotFound())
@@ -325,6 +480,9 @@ public:
 
     bool WriteBatch(CDBBatch &batch, bool fSync = false);
 
+    //! The counters of this database and the statistics of LevelDB
+    CDBStats GetStats() const;
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush() { return true; }
     bool Sync()
@@ -334,6 +492,14 @@ public:
     }
 
     CDBIterator *NewIterator() { return new CDBIterator(*this, pdb->NewIterator(iteroptions)); }
+    CDBSnapshot *NewSnapshot() const { return new CDBSnapshot(pdb); }
+    /** An iterator over the database as of snapshot, which has to outlive it */
+    CDBIterator *NewIterator(const CDBSnapshot &snapshot) const
+    {
+        leveldb::ReadOptions snapshotoptions = iteroptions;
+        snapshotoptions.snapshot = snapshot.psnapshot;
+        return new CDBIterator(*this, pdb->NewIterator(snapshotoptions));
+    }
     /**
      * Return true if the database managed by this class contains no entries.
      */
@@ -342,7 +508,7 @@ public:
     template <typename K>
     size_t EstimateSize(const K &key_begin, const K &key_end) const
     {
-        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
         ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey1 << key_begin;
@@ -361,7 +527,7 @@ public:
     template <typename K>
     void CompactRange(const K &key_begin, const K &key_end) const
     {
-        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
         ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey1 << key_begin;
@@ -0,0 +1,411 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flatblockindex.h"
+
+#include "chain/blockindex.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "crypto/hash.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <algorithm>
+#include <string.h>
+
+//! records read at once when the whole file is read for the slots only
+static const size_t FLAT_BLOCK_INDEX_SCAN_CHUNK = 16384;
+//! fewer free records than this are never worth a rewrite
+static const size_t FLAT_BLOCK_INDEX_MIN_COMPACT = 1024;
+
+static inline long SlotOffset(uint32_t nSlot) { return (long)(nSlot + 1) * FLAT_BLOCK_INDEX_RECORD_SIZE; }
+/** The checksum of a record covers the hash, the sequence number and the entry, nLen bytes of it, which follow at p */
+static inline uint32_t RecordChecksum(const uint8_t *p, uint32_t nLen)
+{
+    return (uint32_t)CSipHasher(0, 0).Write(p, sizeof(uint256) + 8 + nLen).Finalize();
+}
+
+CFlatBlockIndex::CFlatBlockIndex(const fs::path &pathIn, bool fWipe)
+    : path(pathIn), file(nullptr), nSlots(0), fSlotsKnown(false), nLoadSlot(0), nNextSeq(1)
+{
+    if (fWipe)
+    {
+        fs::remove(path);
+    }
+    Open();
+}
+
+CFlatBlockIndex::~CFlatBlockIndex() { Close(); }
+void CFlatBlockIndex::Close()
+{
+    if (file)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool CFlatBlockIndex::Open()
+{
+    file = fsbridge::fopen(path, "r+b");
+    if (!file)
+    {
+        file = fsbridge::fopen(path, "w+b");
+        if (!file)
+        {
+            return error("%s: cannot create %s", __func__, path.string());
+        }
+        std::vector<uint8_t> header(FLAT_BLOCK_INDEX_RECORD_SIZE, 0);
+        WriteLE32(&header[0], FLAT_BLOCK_INDEX_MAGIC);
+        WriteLE32(&header[4], FLAT_BLOCK_INDEX_VERSION);
+        WriteLE32(&header[8], FLAT_BLOCK_INDEX_RECORD_SIZE);
+        if (fwrite(header.data(), 1, header.size(), file) != header.size())
+        {
+            Close();
+            return error("%s: cannot write %s", __func__, path.string());
+        }
+        FileCommit(file);
+        nSlots = 0;
+        fSlotsKnown = true;
+        return true;
+    }
+
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || ReadLE32(header) != FLAT_BLOCK_INDEX_MAGIC ||
+        ReadLE32(header + 4) != FLAT_BLOCK_INDEX_VERSION || ReadLE32(header + 8) != FLAT_BLOCK_INDEX_RECORD_SIZE)
+    {
+        Close();
+        return error("%s: %s is not a block index of this version", __func__, path.string());
+    }
+    // a record cut short while it was appended is dropped, the flush that wrote it did not return
+    nSlots = (fs::file_size(path) - FLAT_BLOCK_INDEX_RECORD_SIZE) / FLAT_BLOCK_INDEX_RECORD_SIZE;
+    fSlotsKnown = nSlots == 0;
+    return true;
+}
+
+size_t CFlatBlockIndex::GetCount() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return mapSlots.size();
+}
+
+size_t CFlatBlockIndex::GetFreeCount() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return vFree.size();
+}
+
+void CFlatBlockIndex::StartLoad()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mapSlots.clear();
+    vFree.clear();
+    fSlotsKnown = false;
+    nLoadSlot = 0;
+    nNextSeq = 1;
+}
+
+bool CFlatBlockIndex::FreeRecord(uint32_t nSlot)
+{
+    const uint8_t zero[4] = {0, 0, 0, 0};
+    if (fseek(file, SlotOffset(nSlot), SEEK_SET) != 0 || fwrite(zero, 1, sizeof(zero), file) != sizeof(zero))
+    {
+        return error("%s: cannot write %s", __func__, path.string());
+    }
+    vFree.push_back(nSlot);
+    return true;
+}
+
+bool CFlatBlockIndex::ReadSeq(uint32_t nSlot, uint64_t &nSeq)
+{
+    uint8_t seq[8];
+    if (fseek(file, SlotOffset(nSlot) + 8 + sizeof(uint256), SEEK_SET) != 0 || fread(seq, 1, sizeof(seq), file) != 8)
+    {
+        return error("%s: cannot read %s", __func__, path.string());
+    }
+    nSeq = ReadLE64(seq);
+    return true;
+}
+
+bool CFlatBlockIndex::ReadChunk(size_t nMax, std::vector<uint256> *pvKeys, std::vector<CPublicDataStream> *pvValues)
+{
+    if (!file)
+    {
+        return false;
+    }
+    const uint32_t nCount = std::min<uint64_t>(nMax, nSlots - nLoadSlot);
+    if (nCount == 0)
+    {
+        fSlotsKnown = true;
+        return true;
+    }
+    std::vector<uint8_t> buf((size_t)nCount * FLAT_BLOCK_INDEX_RECORD_SIZE);
+    if (fseek(file, SlotOffset(nLoadSlot), SEEK_SET) != 0 || fread(buf.data(), 1, buf.size(), file) != buf.size())
+    {
+        return error("%s: cannot read %s", __func__, path.string());
+    }
+    for (uint32_t i = 0; i < nCount; i++)
+    {
+        const uint32_t nSlot = nLoadSlot + i;
+        const uint8_t *prec = &buf[(size_t)i * FLAT_BLOCK_INDEX_RECORD_SIZE];
+        const uint32_t nLen = ReadLE32(prec);
+        if (nLen == 0)
+        {
+            vFree.push_back(nSlot);
+            continue;
+        }
+        if (nLen > FLAT_BLOCK_INDEX_RECORD_SIZE - FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE ||
+            ReadLE32(prec + 4) != RecordChecksum(prec + 8, nLen))
+        {
+            // records in use are never written over, this one was being written when the flush was cut short
+            LogPrintf("%s: record %u of %s is corrupt, dropping it\n", __func__, nSlot, path.string());
+            vFree.push_back(nSlot);
+            continue;
+        }
+        uint256 hash;
+        memcpy(hash.begin(), prec + 8, sizeof(uint256));
+        const uint64_t nSeq = ReadLE64(prec + 8 + sizeof(uint256));
+        nNextSeq = std::max(nNextSeq, nSeq + 1);
+        auto inserted = mapSlots.emplace(hash, nSlot);
+        if (!inserted.second)
+        {
+            // a flush that did not get to free the record it replaced, the older of the two is dropped and cleared,
+            // or it would come back once the newer one is erased
+            uint64_t nOtherSeq;
+            if (!ReadSeq(inserted.first->second, nOtherSeq))
+            {
+                return false;
+            }
+            const uint32_t nOlder = nSeq < nOtherSeq ? nSlot : inserted.first->second;
+            if (!FreeRecord(nOlder))
+            {
+                return false;
+            }
+            if (nOlder == nSlot)
+            {
+                continue;
+            }
+            inserted.first->second = nSlot;
+        }
+        if (pvKeys)
+        {
+            pvKeys->push_back(hash);
+            const char *pdata = (const char *)prec + FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE;
+            pvValues->emplace_back(pdata, pdata + nLen, SER_DISK, CLIENT_VERSION);
+        }
+    }
+    nLoadSlot += nCount;
+    fSlotsKnown = nLoadSlot == nSlots;
+    return true;
+}
+
+bool CFlatBlockIndex::Load(size_t nMax,
+    std::vector<uint256> &vKeys,
+    std::vector<CPublicDataStream> &vValues,
+    bool &fEnd)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!ReadChunk(nMax, &vKeys, &vValues))
+    {
+        return false;
+    }
+    fEnd = fSlotsKnown;
+    return true;
+}
+
+bool CFlatBlockIndex::KnowSlots()
+{
+    if (fSlotsKnown)
+    {
+        return true;
+    }
+    // written to before it was loaded, only the slots are needed
+    mapSlots.clear();
+    vFree.clear();
+    nLoadSlot = 0;
+    while (!fSlotsKnown)
+    {
+        if (!ReadChunk(FLAT_BLOCK_INDEX_SCAN_CHUNK, nullptr, nullptr))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CFlatBlockIndex::Write(const std::vector<CDiskBlockIndex> &entries)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!file || !KnowSlots())
+    {
+        return false;
+    }
+    std::vector<uint8_t> rec;
+    rec.reserve(FLAT_BLOCK_INDEX_RECORD_SIZE);
+    std::vector<uint32_t> vReplaced;
+    for (const CDiskBlockIndex &entry : entries)
+    {
+        rec.resize(FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE);
+        CVectorWriter(SER_DISK, CLIENT_VERSION, rec, FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE) << entry;
+        const uint32_t nLen = rec.size() - FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE;
+        if (rec.size() > FLAT_BLOCK_INDEX_RECORD_SIZE)
+        {
+            return error("%s: block index entry %s does not fit a record", __func__, entry.hashBlock.ToString());
+        }
+        rec.resize(FLAT_BLOCK_INDEX_RECORD_SIZE, 0);
+        WriteLE32(&rec[0], nLen);
+        memcpy(&rec[8], entry.hashBlock.begin(), sizeof(uint256));
+        WriteLE64(&rec[8 + sizeof(uint256)], nNextSeq++);
+        WriteLE32(&rec[4], RecordChecksum(&rec[8], nLen));
+
+        uint32_t nSlot;
+        if (!vFree.empty())
+        {
+            nSlot = vFree.back();
+            vFree.pop_back();
+        }
+        else
+        {
+            nSlot = nSlots++;
+        }
+        if (fseek(file, SlotOffset(nSlot), SEEK_SET) != 0 || fwrite(rec.data(), 1, rec.size(), file) != rec.size())
+        {
+            return error("%s: cannot write %s", __func__, path.string());
+        }
+        auto inserted = mapSlots.emplace(entry.hashBlock, nSlot);
+        if (!inserted.second)
+        {
+            vReplaced.push_back(inserted.first->second);
+            inserted.first->second = nSlot;
+        }
+    }
+    FileCommit(file);
+
+    // the new records are on disk, the old ones can go, a crash before this leaves both and the newer is loaded
+    for (uint32_t nSlot : vReplaced)
+    {
+        if (!FreeRecord(nSlot))
+        {
+            return false;
+        }
+    }
+    if (!vReplaced.empty() && fflush(file) != 0)
+    {
+        return error("%s: cannot write %s", __func__, path.string());
+    }
+    return true;
+}
+
+bool CFlatBlockIndex::Erase(const uint256 &hash)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!file || !KnowSlots())
+    {
+        return false;
+    }
+    auto it = mapSlots.find(hash);
+    if (it == mapSlots.end())
+    {
+        return true;
+    }
+    if (!FreeRecord(it->second) || fflush(file) != 0)
+    {
+        return error("%s: cannot write %s", __func__, path.string());
+    }
+    mapSlots.erase(it);
+    return true;
+}
+
+bool CFlatBlockIndex::CompactIfSparse()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!file || !fSlotsKnown || vFree.size() < FLAT_BLOCK_INDEX_MIN_COMPACT || vFree.size() * 4 < nSlots)
+    {
+        return true;
+    }
+    return Compact();
+}
+
+bool CFlatBlockIndex::Compact()
+{
+    const fs::path pathNew = path.string() + ".new";
+    FILE *fileNew = fsbridge::fopen(pathNew, "wb");
+    if (!fileNew)
+    {
+        return error("%s: cannot create %s", __func__, pathNew.string());
+    }
+    std::vector<uint8_t> buf(FLAT_BLOCK_INDEX_RECORD_SIZE * FLAT_BLOCK_INDEX_SCAN_CHUNK);
+    std::unordered_map<uint256, uint32_t, SlotHasher> mapNewSlots;
+    mapNewSlots.reserve(mapSlots.size());
+    bool fOk = fseek(file, 0, SEEK_SET) == 0 && fread(buf.data(), 1, FLAT_BLOCK_INDEX_RECORD_SIZE, file) ==
+                                                    FLAT_BLOCK_INDEX_RECORD_SIZE &&
+               fwrite(buf.data(), 1, FLAT_BLOCK_INDEX_RECORD_SIZE, fileNew) == FLAT_BLOCK_INDEX_RECORD_SIZE;
+    // the records keep their order, only the free ones are left out
+    for (uint32_t nFirst = 0; fOk && nFirst < nSlots; nFirst += FLAT_BLOCK_INDEX_SCAN_CHUNK)
+    {
+        const uint32_t nCount = std::min<uint64_t>(FLAT_BLOCK_INDEX_SCAN_CHUNK, nSlots - nFirst);
+        const size_t nBytes = (size_t)nCount * FLAT_BLOCK_INDEX_RECORD_SIZE;
+        fOk = fread(buf.data(), 1, nBytes, file) == nBytes;
+        for (uint32_t i = 0; fOk && i < nCount; i++)
+        {
+            const uint8_t *prec = &buf[(size_t)i * FLAT_BLOCK_INDEX_RECORD_SIZE];
+            if (ReadLE32(prec) == 0)
+            {
+                continue;
+            }
+            // corrupt records are free too, though their size is not zero
+            uint256 hash;
+            memcpy(hash.begin(), prec + 8, sizeof(uint256));
+            auto it = mapSlots.find(hash);
+            if (it == mapSlots.end() || it->second != nFirst + i)
+            {
+                continue;
+            }
+            mapNewSlots.emplace(hash, mapNewSlots.size());
+            fOk = fwrite(prec, 1, FLAT_BLOCK_INDEX_RECORD_SIZE, fileNew) == FLAT_BLOCK_INDEX_RECORD_SIZE;
+        }
+    }
+    if (fOk)
+    {
+        FileCommit(fileNew);
+    }
+    fclose(fileNew);
+    if (!fOk || mapNewSlots.size() != mapSlots.size())
+    {
+        fs::remove(pathNew);
+        return error("%s: cannot compact %s", __func__, path.string());
+    }
+
+    Close();
+    if (!RenameOver(pathNew, path))
+    {
+        Open();
+        return error("%s: cannot replace %s", __func__, path.string());
+    }
+    LogPrintf("Compacted the block index, dropped %u free records\n", vFree.size());
+    if (!Open())
+    {
+        return false;
+    }
+    mapSlots.swap(mapNewSlots);
+    vFree.clear();
+    nSlots = mapSlots.size();
+    fSlotsKnown = true;
+    nLoadSlot = nSlots;
+    return true;
+}
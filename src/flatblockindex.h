@@ -0,0 +1,117 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_FLATBLOCKINDEX_H
+#define BITCOIN_FLATBLOCKINDEX_H
+
+#include "fs.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+class CDiskBlockIndex;
+
+/** -flatblockindex default */
+static const bool DEFAULT_FLAT_BLOCK_INDEX = false;
+
+/** Every record of the flat block index takes this many bytes, a serialized CDiskBlockIndex is at most 279 */
+static const size_t FLAT_BLOCK_INDEX_RECORD_SIZE = 384;
+/** The size, checksum, hash and sequence number that start a record */
+static const size_t FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE = 48;
+static const uint32_t FLAT_BLOCK_INDEX_MAGIC = 0x49464345;
+static const uint32_t FLAT_BLOCK_INDEX_VERSION = 2;
+
+/**
+ * The block index in one file of fixed size records, an alternative to keeping the entries in the block tree
+ * database. The first record holds the magic, version and record size, each one after it either the size of a
+ * serialized CDiskBlockIndex, a checksum, the block hash, a sequence number and the entry, or a zero size when the
+ * slot is free.
+ *
+ * Loading reads the file front to back in large chunks. A record is never written over while it is in use: a flush
+ * writes every changed or new entry to a free slot or appends it, syncs the file once for all of them, and only then
+ * frees the records they replace. A crash in between leaves either the old record or both, and of two records for
+ * the same block the one with the higher sequence number is used. A record that fails its checksum was torn by such
+ * a crash, or its disk lost it, and is treated as a free slot. Erased entries leave their slot to the next new one,
+ * the file is rewritten without them when they add up to a quarter of it.
+ */
+class CFlatBlockIndex
+{
+private:
+    struct SlotHasher
+    {
+        size_t operator()(const uint256 &hash) const { return hash.GetCheapHash(); }
+    };
+
+    mutable std::mutex cs;
+    const fs::path path;
+    FILE *file;
+    //! records in the file, used or free
+    uint32_t nSlots;
+    std::unordered_map<uint256, uint32_t, SlotHasher> mapSlots;
+    std::vector<uint32_t> vFree;
+    //! whether mapSlots and vFree cover every record, they are filled while loading
+    bool fSlotsKnown;
+    //! the next record to load
+    uint32_t nLoadSlot;
+    //! higher than that of every record in the file
+    uint64_t nNextSeq;
+
+    CFlatBlockIndex(const CFlatBlockIndex &);
+    CFlatBlockIndex &operator=(const CFlatBlockIndex &);
+
+    bool Open();
+    void Close();
+    bool ReadChunk(size_t nMax, std::vector<uint256> *pvKeys, std::vector<CPublicDataStream> *pvValues);
+    bool ReadSeq(uint32_t nSlot, uint64_t &nSeq);
+    //! clear the size of a record and put it on the free list
+    bool FreeRecord(uint32_t nSlot);
+    bool KnowSlots();
+    bool Compact();
+
+public:
+    /** Open the index at path, it is created when there is none and an existing one is dropped with fWipe */
+    CFlatBlockIndex(const fs::path &pathIn, bool fWipe);
+    ~CFlatBlockIndex();
+
+    bool IsOpen() const { return file != nullptr; }
+    /** Used records, only known once the index was loaded or written to */
+    size_t GetCount() const;
+    size_t GetFreeCount() const;
+
+    /** Restart loading at the first record */
+    void StartLoad();
+    /**
+     * Append the hashes and serialized entries of the next records, at most nMax of them, to vKeys and vValues
+     * and set fEnd once all were read. A block can come up twice when a crash left two of its records, the later
+     * one is the entry to keep. False if the file can not be read.
+     */
+    bool Load(size_t nMax, std::vector<uint256> &vKeys, std::vector<CPublicDataStream> &vValues, bool &fEnd);
+
+    /** Write entries into new records and free the ones they replace, synced to disk before returning */
+    bool Write(const std::vector<CDiskBlockIndex> &entries);
+    bool Erase(const uint256 &hash);
+    /** Rewrite the file without its free records when they are at least a quarter of them */
+    bool CompactIfSparse();
+};
+
+#endif // BITCOIN_FLATBLOCKINDEX_H
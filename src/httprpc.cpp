@@ -26,6 +26,7 @@
 #include "httpserver.h"
 #include "networks/networktemplate.h"
 #include "random.h"
+#include "rpc/jsonstream.h"
 #include "rpc/rpcprotocol.h"
 #include "rpc/rpcserver.h"
 #include "sync.h"
@@ -33,6 +34,7 @@
 #include "util/util.h"
 #include "util/utilstrencodings.h"
 #include "util/utilstrencodings.h"
+#include <set>
 #include <stdio.h>
 
 #include <boost/algorithm/string.hpp> // boost::trim
@@ -96,6 +98,50 @@ static void JSONErrorReply(HTTPRequest *req, const UniValue &objError, const Uni
     req->WriteReply(nStatus, strReply);
 }
 
+/**
+ * Send the reply to jreq as a chunked reply while its result is written, for the methods that can stream it.
+ * Returns false if jreq has to be executed the usual way. An error before the first chunk is thrown like one of
+ * tableRPC.execute, after it the reply is cut short and the client is left with JSON that does not parse.
+ */
+static bool JSONRPCStreamReply(HTTPRequest *req, const JSONRequest &jreq)
+{
+    bool fStarted = false;
+    CJSONStreamWriter writer([req, &fStarted](const std::string &strChunk) {
+        if (!fStarted)
+        {
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReplyStart(HTTP_OK);
+            fStarted = true;
+        }
+        req->WriteReplyChunk(strChunk);
+    });
+
+    writer.BeginObject();
+    writer.Key("result");
+    try
+    {
+        if (!tableRPC.executeStream(jreq.strMethod, jreq.params, writer))
+            return false;
+    }
+    catch (...)
+    {
+        if (!fStarted)
+            throw;
+        LogPrintf("ThreadRPCServer error while streaming the reply of %s\n", SanitizeString(jreq.strMethod));
+        req->WriteReplyEnd();
+        return true;
+    }
+    writer.Key("error");
+    writer.Value(NullUniValue);
+    writer.Key("id");
+    writer.Value(jreq.id);
+    writer.EndObject();
+    writer.Raw("\n");
+    writer.Flush();
+    req->WriteReplyEnd();
+    return true;
+}
+
 // This function checks username and password against -rpcauth
 // entries from config file.
 static bool multiUserAuthorized(std::string strUserPass)
@@ -209,6 +255,8 @@ static bool HTTPReq_JSONRPC(HTTPRequest *req, const std::string &)
         if (valRequest.isObject())
         {
             jreq.parse(valRequest);
+            if (JSONRPCStreamReply(req, jreq))
+                return true;
 
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
@@ -259,13 +307,59 @@ static bool InitRPCAuthentication()
     return true;
 }
 
+/** Methods whose requests are queued as fast or slow ones, those of all others are normal ones */
+static const std::set<std::string> setFastRPCMethods = {"getbestblockhash", "getblockcount", "getconnectioncount",
+    "getdifficulty", "getmempoolinfo", "getnettotals", "getrpcqueueinfo", "ping"};
+static const std::set<std::string> setSlowRPCMethods = {"backupwallet", "dumptxoutset", "dumpwallet", "generate",
+    "generatepos", "generatepostoaddress", "generatetoaddress", "gettxoutsetinfo", "importaddress", "importprivkey",
+    "importpubkey", "importwallet", "keypoolrefill", "verifychain"};
+
+/** How much of a request body is looked at to find its methods */
+static const size_t MAX_RPC_PRIORITY_PEEK = 64 * 1024;
+
+/**
+ * Pick the queue of a JSON-RPC request from the methods named in its body, without parsing it. A batch goes to the
+ * queue of its slowest method, a body without a method it can find to the normal one.
+ */
+static HTTPPriority HTTPReq_JSONRPCPriority(HTTPRequest *req, const std::string &)
+{
+    static const std::string strKey = "\"method\"";
+    const std::string strBody = req->PeekBody(MAX_RPC_PRIORITY_PEEK);
+    bool fFound = false;
+    HTTPPriority priority = HTTP_PRIORITY_FAST;
+    for (size_t pos = strBody.find(strKey); pos != std::string::npos; pos = strBody.find(strKey, pos))
+    {
+        pos += strKey.size();
+        while (pos < strBody.size() && isspace(strBody[pos]))
+            pos++;
+        if (pos >= strBody.size() || strBody[pos] != ':')
+            continue;
+        pos++;
+        while (pos < strBody.size() && isspace(strBody[pos]))
+            pos++;
+        if (pos >= strBody.size() || strBody[pos] != '"')
+            continue;
+        size_t end = strBody.find('"', ++pos);
+        if (end == std::string::npos)
+            break;
+        const std::string strMethod = strBody.substr(pos, end - pos);
+        fFound = true;
+        if (setSlowRPCMethods.count(strMethod))
+            return HTTP_PRIORITY_SLOW;
+        if (!setFastRPCMethods.count(strMethod))
+            priority = HTTP_PRIORITY_NORMAL;
+        pos = end;
+    }
+    return fFound ? priority : HTTP_PRIORITY_NORMAL;
+}
+
 bool StartHTTPRPC()
 {
-    LogPrint("rpc", "Starting HTTP RPC server\n");
+    LogPrint(Logging::RPC, "Starting HTTP RPC server\n");
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPCPriority);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -273,10 +367,10 @@ bool StartHTTPRPC()
     return true;
 }
 
-void InterruptHTTPRPC() { LogPrint("rpc", "Interrupting HTTP RPC server\n"); }
+void InterruptHTTPRPC() { LogPrint(Logging::RPC, "Interrupting HTTP RPC server\n"); }
 void StopHTTPRPC()
 {
-    LogPrint("rpc", "Stopping HTTP RPC server\n");
+    LogPrint(Logging::RPC, "Stopping HTTP RPC server\n");
     UnregisterHTTPHandler("/", true);
     if (httpRPCTimerInterface)
     {
@@ -49,4 +49,11 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Start serving the Prometheus metrics of the node at /metrics, see metrics.cpp.
+ * Precondition; HTTP has been started.
+ */
+bool StartHTTPMetrics();
+/** Stop serving /metrics */
+void StopHTTPMetrics();
+
 #endif
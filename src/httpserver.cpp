@@ -30,9 +30,12 @@
 
 #include "util/util.h"
 
+#include <atomic>
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
 
 #include <signal.h>
 #include <sys/stat.h>
@@ -42,6 +45,7 @@
 #include <event2/event.h>
 #include <event2/http.h>
 #include <event2/keyvalq_struct.h>
+#include <event2/listener.h>
 #include <event2/thread.h>
 #include <event2/util.h>
 
@@ -81,14 +85,27 @@ template <typename WorkItem>
 class WorkQueue
 {
 private:
+    /** A queued item and when it was queued */
+    struct QueuedItem
+    {
+        WorkItem *item;
+        int64_t nTimeQueued;
+    };
+
     /** Mutex protects entire object */
     CWaitableCriticalSection cs;
     CConditionVariable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem *> queue;
+    std::deque<QueuedItem> queue;
     bool running;
     size_t maxDepth;
     int numThreads;
+    /** Statistics, the ones updated while an item runs are kept out of the lock */
+    uint64_t nRejected;
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    std::atomic<uint64_t> nProcessed;
+    std::atomic<int64_t> nRunMicros;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -109,7 +126,11 @@ private:
     };
 
 public:
-    WorkQueue(size_t _maxDepth) : running(true), maxDepth(_maxDepth), numThreads(0) {}
+    WorkQueue(size_t _maxDepth)
+        : running(true), maxDepth(_maxDepth), numThreads(0), nRejected(0), nWaitMicros(0), nMaxWaitMicros(0),
+          nProcessed(0), nRunMicros(0)
+    {
+    }
     /*( Precondition: worker threads have all stopped
      * (call WaitExit)
      */
@@ -117,7 +138,7 @@ public:
     {
         while (!queue.empty())
         {
-            delete queue.front();
+            delete queue.front().item;
             queue.pop_front();
         }
     }
@@ -127,9 +148,10 @@ public:
         boost::unique_lock<boost::mutex> lock(cs);
         if (queue.size() >= maxDepth)
         {
+            nRejected++;
             return false;
         }
-        queue.push_back(item);
+        queue.push_back(QueuedItem{item, GetTimeMicros()});
         cond.notify_one();
         return true;
     }
@@ -146,11 +168,17 @@ public:
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
+                i = queue.front().item;
+                int64_t nWait = GetTimeMicros() - queue.front().nTimeQueued;
                 queue.pop_front();
+                nWaitMicros += nWait;
+                nMaxWaitMicros = std::max(nMaxWaitMicros, nWait);
             }
+            int64_t nTimeStart = GetTimeMicros();
             (*i)();
             delete i;
+            nRunMicros += GetTimeMicros() - nTimeStart;
+            nProcessed++;
         }
     }
     /** Interrupt and exit loops */
@@ -174,34 +202,63 @@ public:
         boost::unique_lock<boost::mutex> lock(cs);
         return queue.size();
     }
+
+    /** Fill in the statistics of this queue but for its name */
+    void GetStats(HTTPWorkQueueStats &stats)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        stats.nThreads = numThreads;
+        stats.nDepth = queue.size();
+        stats.nMaxDepth = maxDepth;
+        stats.nProcessed = nProcessed;
+        stats.nRejected = nRejected;
+        stats.nWaitMicros = nWaitMicros;
+        stats.nMaxWaitMicros = nMaxWaitMicros;
+        stats.nRunMicros = nRunMicros;
+    }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler)
-        : prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix,
+        bool _exactMatch,
+        HTTPRequestHandler _handler,
+        HTTPPriorityFunction _priority)
+        : prefix(_prefix), exactMatch(_exactMatch), handler(_handler), priority(_priority)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPPriorityFunction priority;
 };
 
 /** HTTP module state */
 
-//! libevent event loop
-static struct event_base *eventBase = 0;
-//! HTTP server
-struct evhttp *eventHTTP = 0;
+/** A libevent event loop with its own HTTP server and listening sockets. A request is read and answered on the
+ * loop of its connection, so the loops share the parsing and the writing of replies between them.
+ */
+struct HTTPEventLoop
+{
+    struct event_base *base;
+    struct evhttp *http;
+    //! Bound listening sockets
+    std::vector<evhttp_bound_socket *> boundSockets;
+    std::thread thread;
+    HTTPEventLoop() : base(0), http(0) {}
+};
+
+//! libevent event loops, one per -rpceventthreads, EventBase() is the one of the first
+static std::vector<std::unique_ptr<HTTPEventLoop> > eventLoops;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure> *workQueue = 0;
+//! Work queues for handling longer requests off the event loop thread, one per HTTPPriority
+static WorkQueue<HTTPClosure> *workQueues[HTTP_PRIORITY_COUNT] = {};
+//! Names of the work queues, for logging and statistics
+static const char *const workQueueNames[HTTP_PRIORITY_COUNT] = {"fast", "normal", "slow"};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
-//! Bound listening sockets
-std::vector<evhttp_bound_socket *> boundSockets;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr &netaddr)
@@ -278,7 +335,7 @@ static void http_request_cb(struct evhttp_request *req, void *arg)
 {
     std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req));
 
-    LogPrint("http", "Received a %s request for %s from %s\n", RequestMethodString(hreq->GetRequestMethod()),
+    LogPrint(Logging::HTTP, "Received a %s request for %s from %s\n", RequestMethodString(hreq->GetRequestMethod()),
         hreq->GetURI(), hreq->GetPeer().ToString());
 
     // Early address-based allow check
@@ -314,9 +371,12 @@ static void http_request_cb(struct evhttp_request *req, void *arg)
         }
     }
 
-    // Dispatch to worker thread
+    // Dispatch to worker thread of the class of the request
     if (i != iend)
     {
+        HTTPPriority priority = i->priority(hreq.get(), path);
+        assert(priority >= 0 && priority < HTTP_PRIORITY_COUNT);
+        WorkQueue<HTTPClosure> *workQueue = workQueues[priority];
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
         if (workQueue->Enqueue(item.get()))
@@ -333,22 +393,50 @@ static void http_request_cb(struct evhttp_request *req, void *arg)
 /** Callback to reject HTTP requests after shutdown. */
 static void http_reject_request_cb(struct evhttp_request *req, void *)
 {
-    LogPrint("http", "Rejecting request while shutting down\n");
+    LogPrint(Logging::HTTP, "Rejecting request while shutting down\n");
     evhttp_send_error(req, HTTP_SERVUNAVAIL, NULL);
 }
 
 /** Event dispatcher thread */
-static void ThreadHTTP(struct event_base *base, struct evhttp *http)
+static void ThreadHTTP(struct event_base *base)
 {
     RenameThread("bitcoin-http");
-    LogPrint("http", "Entering http event loop\n");
+    LogPrint(Logging::HTTP, "Entering http event loop\n");
     event_base_dispatch(base);
     // Event loop will be interrupted by InterruptHTTPServer()
-    LogPrint("http", "Exited http event loop\n");
+    LogPrint(Logging::HTTP, "Exited http event loop\n");
 }
 
-/** Bind HTTP server to specified addresses */
-static bool HTTPBindAddresses(struct evhttp *http)
+/** Bind the HTTP server of loop to an address. Several loops listen on the same address through SO_REUSEPORT,
+ * the kernel spreads the connections between them then.
+ */
+static evhttp_bound_socket *HTTPBindSocket(HTTPEventLoop &loop, const std::string &host, uint16_t port, bool fReusePort)
+{
+#ifdef LEV_OPT_REUSEABLE_PORT
+    if (fReusePort)
+    {
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        CService addrBind = LookupNumeric(host.empty() ? "0.0.0.0" : host.c_str(), port);
+        if (!addrBind.GetSockAddr((struct sockaddr *)&sockaddr, &len))
+            return NULL;
+        struct evconnlistener *listener = evconnlistener_new_bind(loop.base, NULL, NULL,
+            LEV_OPT_REUSEABLE | LEV_OPT_REUSEABLE_PORT | LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC, -1,
+            (struct sockaddr *)&sockaddr, len);
+        if (!listener)
+            return NULL;
+        evhttp_bound_socket *bind_handle = evhttp_bind_listener(loop.http, listener);
+        if (!bind_handle)
+            evconnlistener_free(listener);
+        return bind_handle;
+    }
+#endif
+    assert(!fReusePort);
+    return evhttp_bind_socket_with_handle(loop.http, host.empty() ? NULL : host.c_str(), port);
+}
+
+/** Bind the HTTP servers to the specified addresses, every event loop listens on all of them */
+static bool HTTPBindAddresses()
 {
     int defaultPort = gArgs.GetArg("-rpcport", pnetMan->getActivePaymentNetwork()->GetRPCPort());
     std::vector<std::pair<std::string, uint16_t> > endpoints;
@@ -382,21 +470,25 @@ static bool HTTPBindAddresses(struct evhttp *http)
     }
 
     // Bind addresses
+    const bool fReusePort = eventLoops.size() > 1;
     for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i)
     {
-        LogPrint("http", "Binding RPC on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle =
-            evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
-        if (bind_handle)
+        LogPrint(Logging::HTTP, "Binding RPC on address %s port %i\n", i->first, i->second);
+        for (std::unique_ptr<HTTPEventLoop> &loop : eventLoops)
         {
-            boundSockets.push_back(bind_handle);
-        }
-        else
-        {
-            LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+            evhttp_bound_socket *bind_handle = HTTPBindSocket(*loop, i->first, i->second, fReusePort);
+            if (bind_handle)
+            {
+                loop->boundSockets.push_back(bind_handle);
+            }
+            else
+            {
+                LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+                break;
+            }
         }
     }
-    return !boundSockets.empty();
+    return !eventLoops.front()->boundSockets.empty();
 }
 
 /** Simple wrapper to set thread name and run work queue */
@@ -416,14 +508,24 @@ static void libevent_log_cb(int severity, const char *msg)
     if (severity >= EVENT_LOG_WARN) // Log warn messages and higher without debug category
         LogPrintf("libevent: %s\n", msg);
     else
-        LogPrint("libevent", "libevent: %s\n", msg);
+        LogPrint(Logging::LIBEVENT, "libevent: %s\n", msg);
 }
 
-bool InitHTTPServer()
+/** Free the servers and event bases of the loops, their threads must have exited */
+static void FreeHTTPEventLoops()
 {
-    struct evhttp *http = 0;
-    struct event_base *base = 0;
+    for (std::unique_ptr<HTTPEventLoop> &loop : eventLoops)
+    {
+        if (loop->http)
+            evhttp_free(loop->http);
+        if (loop->base)
+            event_base_free(loop->base);
+    }
+    eventLoops.clear();
+}
 
+bool InitHTTPServer()
+{
     if (!InitHTTPAllowList())
         return false;
 
@@ -438,7 +540,7 @@ bool InitHTTPServer()
 #if LIBEVENT_VERSION_NUMBER >= 0x02010100
     // If -debug=libevent, set full libevent debugging.
     // Otherwise, disable all libevent debugging.
-    if (g_logger->LogAcceptCategory("libevent"))
+    if (g_logger->LogAcceptCategory(Logging::LIBEVENT))
         event_enable_debug_logging(EVENT_DBG_ALL);
     else
         event_enable_debug_logging(EVENT_DBG_NONE);
@@ -449,108 +551,144 @@ bool InitHTTPServer()
     evthread_use_pthreads();
 #endif
 
-    base = event_base_new(); // XXX RAII
-    if (!base)
+    int nEventThreads = std::max(1, std::min<int>(gArgs.GetArg("-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS),
+                                        MAX_HTTP_EVENT_THREADS));
+#ifndef LEV_OPT_REUSEABLE_PORT
+    if (nEventThreads > 1)
     {
-        LogPrintf("Couldn't create an event_base: exiting\n");
-        return false;
+        LogPrintf("HTTP: this libevent can not share a listening port between event loops, using one\n");
+        nEventThreads = 1;
     }
-
-    /* Create a new evhttp object to handle requests. */
-    http = evhttp_new(base); // XXX RAII
-    if (!http)
+#endif
+    for (int i = 0; i < nEventThreads; i++)
     {
-        LogPrintf("couldn't create evhttp. Exiting.\n");
-        event_base_free(base);
-        return false;
-    }
+        eventLoops.emplace_back(new HTTPEventLoop());
+        HTTPEventLoop &loop = *eventLoops.back();
+        loop.base = event_base_new();
+        if (!loop.base)
+        {
+            LogPrintf("Couldn't create an event_base: exiting\n");
+            FreeHTTPEventLoops();
+            return false;
+        }
 
-    evhttp_set_timeout(http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
-    evhttp_set_max_body_size(http, MAX_SIZE);
-    evhttp_set_gencb(http, http_request_cb, NULL);
+        /* Create a new evhttp object to handle requests. */
+        loop.http = evhttp_new(loop.base);
+        if (!loop.http)
+        {
+            LogPrintf("couldn't create evhttp. Exiting.\n");
+            FreeHTTPEventLoops();
+            return false;
+        }
 
-    if (!HTTPBindAddresses(http))
+        evhttp_set_timeout(loop.http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+        evhttp_set_max_headers_size(loop.http, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(loop.http, MAX_SIZE);
+        evhttp_set_gencb(loop.http, http_request_cb, NULL);
+    }
+
+    if (!HTTPBindAddresses())
     {
         LogPrintf("Unable to bind any endpoint for RPC server\n");
-        evhttp_free(http);
-        event_base_free(base);
+        FreeHTTPEventLoops();
         return false;
     }
 
-    LogPrint("http", "Initialized HTTP server\n");
+    LogPrint(Logging::HTTP, "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    LogPrintf("HTTP: creating work queues of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    eventBase = base;
-    eventHTTP = http;
+    for (WorkQueue<HTTPClosure> *&workQueue : workQueues)
+        workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
     return true;
 }
 
-std::thread *threadHTTP;
-
 bool StartHTTPServer()
 {
-    LogPrint("http", "Starting HTTP server\n");
-    int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
-    threadHTTP = new std::thread(&ThreadHTTP, eventBase, eventHTTP);
-
-    for (int i = 0; i < rpcThreads; i++)
+    LogPrint(Logging::HTTP, "Starting HTTP server\n");
+    // every class has its own workers, so slow calls can not take the threads of the others
+    int rpcThreads[HTTP_PRIORITY_COUNT];
+    rpcThreads[HTTP_PRIORITY_FAST] = std::max((long)gArgs.GetArg("-rpcfastthreads", DEFAULT_HTTP_FAST_THREADS), 1L);
+    rpcThreads[HTTP_PRIORITY_NORMAL] = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    rpcThreads[HTTP_PRIORITY_SLOW] = std::max((long)gArgs.GetArg("-rpcslowthreads", DEFAULT_HTTP_SLOW_THREADS), 1L);
+    LogPrintf("HTTP: starting %d event threads\n", eventLoops.size());
+    for (std::unique_ptr<HTTPEventLoop> &loop : eventLoops)
+        loop->thread = std::thread(&ThreadHTTP, loop->base);
+
+    for (int priority = 0; priority < HTTP_PRIORITY_COUNT; priority++)
     {
-        std::thread worker(&HTTPWorkQueueRun, workQueue);
-        worker.detach();
+        LogPrintf("HTTP: starting %d %s worker threads\n", rpcThreads[priority], workQueueNames[priority]);
+        for (int i = 0; i < rpcThreads[priority]; i++)
+        {
+            std::thread worker(&HTTPWorkQueueRun, workQueues[priority]);
+            worker.detach();
+        }
     }
     return true;
 }
 
 void InterruptHTTPServer()
 {
-    LogPrint("http", "Interrupting HTTP server\n");
-    if (eventHTTP)
+    LogPrint(Logging::HTTP, "Interrupting HTTP server\n");
+    for (std::unique_ptr<HTTPEventLoop> &loop : eventLoops)
     {
         // Unlisten sockets
-        for (auto *socket : boundSockets)
+        for (auto *socket : loop->boundSockets)
         {
-            evhttp_del_accept_socket(eventHTTP, socket);
+            evhttp_del_accept_socket(loop->http, socket);
         }
+        loop->boundSockets.clear();
         // Reject requests on current connections
-        evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
+        evhttp_set_gencb(loop->http, http_reject_request_cb, NULL);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (WorkQueue<HTTPClosure> *workQueue : workQueues)
+        if (workQueue)
+            workQueue->Interrupt();
 }
 
 void StopHTTPServer()
 {
-    LogPrint("http", "Stopping HTTP server\n");
-    if (workQueue)
+    LogPrint(Logging::HTTP, "Stopping HTTP server\n");
+    LogPrint(Logging::HTTP, "Waiting for HTTP worker threads to exit\n");
+    for (WorkQueue<HTTPClosure> *&workQueue : workQueues)
     {
-        LogPrint("http", "Waiting for HTTP worker threads to exit\n");
-        workQueue->WaitExit();
-        delete workQueue;
+        if (workQueue)
+        {
+            workQueue->WaitExit();
+            delete workQueue;
+            workQueue = 0;
+        }
     }
-    if (eventBase)
+    if (!eventLoops.empty())
     {
-        LogPrint("http", "HTTP event thread exiting...\n");
-        event_base_loopbreak(eventBase);
-        threadHTTP->join();
+        LogPrint(Logging::HTTP, "HTTP event threads exiting...\n");
     }
-    if (eventHTTP)
+    for (std::unique_ptr<HTTPEventLoop> &loop : eventLoops)
     {
-        evhttp_free(eventHTTP);
-        eventHTTP = 0;
+        event_base_loopbreak(loop->base);
+        if (loop->thread.joinable())
+            loop->thread.join();
     }
-    if (eventBase)
+    FreeHTTPEventLoops();
+    LogPrint(Logging::HTTP, "Stopped HTTP server\n");
+}
+
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats()
+{
+    std::vector<HTTPWorkQueueStats> vStats;
+    for (int priority = 0; priority < HTTP_PRIORITY_COUNT; priority++)
     {
-        event_base_free(eventBase);
-        eventBase = 0;
-    }
-    LogPrint("http", "Stopped HTTP server\n");
+        if (!workQueues[priority])
+            continue;
+        HTTPWorkQueueStats stats;
+        stats.name = workQueueNames[priority];
+        workQueues[priority]->GetStats(stats);
+        vStats.push_back(stats);
+    }
+    return vStats;
 }
 
-struct event_base *EventBase() { return eventBase; }
+struct event_base *EventBase() { return eventLoops.empty() ? 0 : eventLoops.front()->base; }
 static void httpevent_callback_fn(evutil_socket_t, short, void *data)
 {
     // Static handler: simply call inner handler
@@ -574,9 +712,17 @@ void HTTPEvent::trigger(struct timeval *tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
-HTTPRequest::HTTPRequest(struct evhttp_request *_req) : req(_req), replySent(false) {}
+HTTPRequest::HTTPRequest(struct evhttp_request *_req) : req(_req), base(EventBase()), replySent(false)
+{
+    // the reply goes out on the loop the request came in on
+    evhttp_connection *con = evhttp_request_get_connection(req);
+    if (con)
+        base = evhttp_connection_get_base(con);
+}
 HTTPRequest::~HTTPRequest()
 {
+    if (chunkedReply)
+        WriteReplyEnd();
     if (!replySent)
     {
         // Keep track of whether reply was sent to avoid request leaks
@@ -597,6 +743,17 @@ std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string &hdr)
         return std::make_pair(false, "");
 }
 
+std::string HTTPRequest::PeekBody(size_t nMaxSize)
+{
+    struct evbuffer *buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    std::string rv(std::min(evbuffer_get_length(buf), nMaxSize), '\0');
+    if (!rv.empty())
+        evbuffer_copyout(buf, &rv[0], rv.size());
+    return rv;
+}
+
 std::string HTTPRequest::ReadBody()
 {
     struct evbuffer *buf = evhttp_request_get_input_buffer(req);
@@ -637,12 +794,82 @@ void HTTPRequest::WriteReply(int nStatus, const std::string &strReply)
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
     HTTPEvent *ev = new HTTPEvent(
-        eventBase, true, boost::bind(evhttp_send_reply, req, nStatus, (const char *)NULL, (struct evbuffer *)NULL));
+        base, true, boost::bind(evhttp_send_reply, req, nStatus, (const char *)NULL, (struct evbuffer *)NULL));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+/** A chunked reply in flight, shared by the events that send its parts.
+ * Only touched from the main http thread once the reply is started.
+ */
+struct HTTPChunkedReply
+{
+    struct evhttp_request *req;
+    //! whether the connection was closed before the reply was finished, req is gone then
+    bool fClosed;
+    HTTPChunkedReply(struct evhttp_request *_req) : req(_req), fClosed(false) {}
+};
+
+static void http_chunked_close_cb(struct evhttp_connection *, void *arg)
+{
+    static_cast<HTTPChunkedReply *>(arg)->fClosed = true;
+}
+
+static void http_reply_start(std::shared_ptr<HTTPChunkedReply> reply, int nStatus)
+{
+    evhttp_connection_set_closecb(evhttp_request_get_connection(reply->req), http_chunked_close_cb, reply.get());
+    evhttp_send_reply_start(reply->req, nStatus, NULL);
+}
+
+static void http_reply_chunk(std::shared_ptr<HTTPChunkedReply> reply, struct evbuffer *evb)
+{
+    if (!reply->fClosed)
+        evhttp_send_reply_chunk(reply->req, evb);
+    evbuffer_free(evb);
+}
+
+static void http_reply_end(std::shared_ptr<HTTPChunkedReply> reply)
+{
+    if (reply->fClosed)
+        return;
+    evhttp_connection_set_closecb(evhttp_request_get_connection(reply->req), NULL, NULL);
+    evhttp_send_reply_end(reply->req);
+}
+
+/** The parts of a chunked reply are sent by events in the main http thread
+ * like the one of WriteReply, which run in the order they are triggered.
+ */
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && req);
+    chunkedReply = std::make_shared<HTTPChunkedReply>(req);
+    HTTPEvent *ev = new HTTPEvent(base, true, boost::bind(http_reply_start, chunkedReply, nStatus));
     ev->trigger(0);
     replySent = true;
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyChunk(const std::string &strChunk)
+{
+    assert(chunkedReply);
+    if (strChunk.empty())
+        return;
+    struct evbuffer *evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    HTTPEvent *ev = new HTTPEvent(base, true, boost::bind(http_reply_chunk, chunkedReply, evb));
+    ev->trigger(0);
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(chunkedReply);
+    HTTPEvent *ev = new HTTPEvent(base, true, boost::bind(http_reply_end, chunkedReply));
+    ev->trigger(0);
+    chunkedReply.reset();
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection *con = evhttp_request_get_connection(req);
@@ -681,10 +908,22 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix,
+    bool exactMatch,
+    const HTTPRequestHandler &handler,
+    HTTPPriority priority)
+{
+    RegisterHTTPHandler(
+        prefix, exactMatch, handler, [priority](HTTPRequest *, const std::string &) { return priority; });
+}
+
+void RegisterHTTPHandler(const std::string &prefix,
+    bool exactMatch,
+    const HTTPRequestHandler &handler,
+    const HTTPPriorityFunction &priority)
 {
-    LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    LogPrint(Logging::HTTP, "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, priority));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -696,7 +935,7 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
             break;
     if (i != iend)
     {
-        LogPrint("http", "Unregistering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
+        LogPrint(Logging::HTTP, "Unregistering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
         pathHandlers.erase(i);
     }
 }
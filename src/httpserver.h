@@ -23,17 +23,25 @@
 #include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <memory>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 static const int DEFAULT_HTTP_THREADS = 4;
 static const int DEFAULT_HTTP_WORKQUEUE = 16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT = 30;
+static const int DEFAULT_HTTP_FAST_THREADS = 1;
+static const int DEFAULT_HTTP_SLOW_THREADS = 1;
+/** -rpceventthreads default, the event loops that accept connections, read the requests and write the replies */
+static const int DEFAULT_HTTP_EVENT_THREADS = 1;
+static const int MAX_HTTP_EVENT_THREADS = 16;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReply;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -49,16 +57,61 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Classes of requests. Every class has its own work queue and worker
+ * threads, so requests of one class never wait for those of another.
+ */
+enum HTTPPriority
+{
+    //! cheap calls that should be answered at once, like the ones of health checks
+    HTTP_PRIORITY_FAST = 0,
+    HTTP_PRIORITY_NORMAL,
+    //! calls that can take minutes, like gettxoutsetinfo or a rescan
+    HTTP_PRIORITY_SLOW,
+    HTTP_PRIORITY_COUNT
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest *req, const std::string &)> HTTPRequestHandler;
+/** Class of a request to a certain HTTP path.
+ * Runs on the http event thread before the request is queued, so it has
+ * to be cheap.
+ */
+typedef boost::function<HTTPPriority(HTTPRequest *req, const std::string &)> HTTPPriorityFunction;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Its requests are of the class priority, or of the one the
+ * priority function picks for each of them.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix,
+    bool exactMatch,
+    const HTTPRequestHandler &handler,
+    HTTPPriority priority = HTTP_PRIORITY_NORMAL);
+void RegisterHTTPHandler(const std::string &prefix,
+    bool exactMatch,
+    const HTTPRequestHandler &handler,
+    const HTTPPriorityFunction &priority);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Statistics of the work queue of one class of requests */
+struct HTTPWorkQueueStats
+{
+    std::string name;
+    int nThreads;
+    size_t nDepth;
+    size_t nMaxDepth;
+    uint64_t nProcessed;
+    //! requests turned away because the queue was full
+    uint64_t nRejected;
+    //! total and longest time requests waited in the queue, and the total time they ran
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    int64_t nRunMicros;
+};
+
+/** Return the statistics of the work queues, in the order of HTTPPriority */
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats();
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -71,7 +124,10 @@ class HTTPRequest
 {
 private:
     struct evhttp_request *req;
+    //! the event loop of the connection of req, replies are sent from it
+    struct event_base *base;
     bool replySent;
+    std::shared_ptr<HTTPChunkedReply> chunkedReply;
 
 public:
     HTTPRequest(struct evhttp_request *req);
@@ -112,6 +168,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Return up to nMaxSize bytes of the start of the request body without
+     * consuming it.
+     */
+    std::string PeekBody(size_t nMaxSize);
+
     /**
      * Write output header.
      *
@@ -128,6 +190,20 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string &strReply = "");
+
+    /**
+     * Start a chunked HTTP reply with status nStatus. Its body is sent in
+     * WriteReplyChunk calls as it is produced and WriteReplyEnd finishes it.
+     * Clients that do not speak HTTP/1.1 get the body as it is and the
+     * connection closed after it.
+     *
+     * @note Call WriteHeader before this and neither WriteReply nor
+     * WriteHeader after it. If the client goes away the remaining chunks are
+     * dropped.
+     */
+    void WriteReplyStart(int nStatus);
+    void WriteReplyChunk(const std::string &strChunk);
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
@@ -23,22 +23,36 @@
 #include "amount.h"
 #include "args.h"
 #include "blockgeneration/blockgeneration.h"
+#include "blockgeneration/stratum.h"
+#include "blockcompress.h"
+#include "blockfilemap.h"
+#include "blockfilterindex.h"
+#include "blockwriter.h"
 #include "chain/chain.h"
 #include "chain/checkpoints.h"
+#include "coinsprefetch.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "httprpc.h"
 #include "httpserver.h"
 #include "key.h"
 #include "main.h"
 #include "net/addrman.h"
+#include "net/blockserver.h"
+#include "net/headersync.h"
 #include "net/messages.h"
 #include "net/net.h"
+#include "net/orphanpool.h"
+#include "net/txreconciliation.h"
 #include "networks/netman.h"
 #include "networks/networktemplate.h"
 #include "policy/policy.h"
 #include "processblock.h"
+#include "processheader.h"
 #include "rpc/rpcserver.h"
+#include "rpc/rpcunix.h"
+#include "scheduler.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
 #include "torcontrol.h"
@@ -47,12 +61,14 @@
 #include "util/util.h"
 #include "util/utilmoneystr.h"
 #include "util/utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "validationinterface.h"
 #include "verifydb.h"
 #include "wallet/db.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 
+#include <future>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -84,8 +100,15 @@ std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
 bool fFeeEstimatesInitialized = false;
+//! set once mempool.dat is loaded, so a shutdown during the load does not dump a partial mempool
+static std::atomic<bool> fDumpMempoolLater(false);
+//! set once sigcache.dat is loaded, so a shutdown during startup does not replace it with empty caches
+static std::atomic<bool> fDumpSigCacheLater(false);
+//! set once coinscache.dat is loaded, a shutdown before that keeps the file of the last run
+static std::atomic<bool> fDumpCoinsCacheLater(false);
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
+static const bool DEFAULT_METRICS_ENABLE = false;
 static const bool DEFAULT_DISABLE_SAFEMODE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 
@@ -170,6 +193,19 @@ public:
             abort();
         }
     }
+    size_t GetCoins(const std::vector<COutPoint> &vOutpoints,
+        std::vector<std::pair<COutPoint, Coin> > &vFound) const override
+    {
+        try
+        {
+            return base->GetCoins(vOutpoints, vFound);
+        }
+        catch (const std::runtime_error &e)
+        {
+            LogPrintf("Error reading from database: %s\n", e.what());
+            abort();
+        }
+    }
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
@@ -186,7 +222,20 @@ void Interrupt(thread_group &threadGroup)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
     InterruptScriptCheck();
+    InterruptHeaderHash();
+    InterruptStakeKernelSearch();
+}
+
+/** Resend wallet transactions that haven't gotten in a block yet, except during reindex, importing and IBD, when
+ *  old wallet transactions become unconfirmed and spam other nodes */
+static void MaybeResendWalletTxs(CConnman &connman)
+{
+    if (!fReindex && !fImporting && !pnetMan->getChainActive()->IsInitialBlockDownload())
+    {
+        GetMainSignals().Broadcast(nTimeBestReceived, &connman);
+    }
 }
 
 void Shutdown()
@@ -206,10 +255,20 @@ void Shutdown()
     RenameThread("bitcoin-shutoff");
     mempool.AddTransactionsUpdated(1);
 
+    StopRPCUnixSocket();
     StopHTTPRPC();
     StopREST();
+    StopHTTPMetrics();
     StopRPC();
     StopHTTPServer();
+    StopStratumServer();
+
+    // the periodic jobs use the wallet and connman
+    if (g_scheduler)
+    {
+        g_scheduler->Stop();
+        g_scheduler.reset();
+    }
 
     if (pwalletMain)
         pwalletMain->Flush(false);
@@ -220,15 +279,35 @@ void Shutdown()
     ThreadGeneration(pwalletMain, true, false);
 
     MapPort(false);
+    if (g_blockfilterindex)
+    {
+        g_blockfilterindex->Stop();
+        g_blockfilterindex.reset();
+    }
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
 
+    // the workers send to the peers of g_connman, the message handlers read blocks themselves once they stopped
+    if (g_blockserver)
+    {
+        g_blockserver->Stop();
+    }
     g_connman.reset();
+    g_blockserver.reset();
 
     StopTorControl();
 
     UnregisterNodeSignals(GetNodeSignals());
 
+    if (fDumpMempoolLater && gArgs.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+    {
+        DumpMempool();
+    }
+    if (fDumpSigCacheLater && gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE))
+    {
+        DumpSigCache();
+    }
+
     if (fFeeEstimatesInitialized)
     {
         fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -246,8 +325,26 @@ void Shutdown()
         {
             if (pnetMan->getChainActive()->pcoinsTip != nullptr)
             {
+                if (fDumpCoinsCacheLater && gArgs.GetBoolArg("-persistcoinscache", DEFAULT_PERSIST_COINSCACHE))
+                    DumpCoinsCache();
                 FlushStateToDisk();
             }
+        }
+        // the workers read from the coins cache that goes next
+        if (g_coinsprefetcher)
+        {
+            g_coinsprefetcher->Stop();
+            g_coinsprefetcher.reset();
+        }
+        // Everything that writes blocks has stopped and the flush above waited for the writer
+        if (g_blockwriter)
+        {
+            g_blockwriter->Stop();
+            g_blockwriter.reset();
+        }
+        g_blockfilemapper.reset();
+        if (pnetMan)
+        {
             pnetMan->getChainActive()->pcoinsTip.reset();
             pnetMan->getChainActive()->pcoinsTip = nullptr;
         }
@@ -267,6 +364,9 @@ void Shutdown()
         pwalletMain->Flush(true);
     }
 
+    // the queued listeners get what is still waiting
+    StopValidationInterfaceQueue();
+
 #if ENABLE_ZMQ
     if (pzmqNotificationInterface)
     {
@@ -293,6 +393,7 @@ void Shutdown()
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    g_logger->StopAsync();
     delete g_logger;
     g_logger = nullptr;
 }
@@ -331,7 +432,7 @@ bool static Bind(CConnman &connman, const CService &addr, unsigned int flags)
 void OnRPCStopped()
 {
     cvBlockChange.notify_all();
-    LogPrint("rpc", "RPC stopped.\n");
+    LogPrint(Logging::RPC, "RPC stopped.\n");
 }
 
 void OnRPCPreCommand(const CRPCCommand &cmd)
@@ -352,12 +453,32 @@ std::string HelpMessage()
     std::string strUsage = HelpMessageGroup(("Options:"));
     strUsage += HelpMessageOpt("-?", ("This help message"));
     strUsage += HelpMessageOpt("-version", ("Print version and exit"));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>",
+        strprintf(("If this block is in the chain assume that it and its ancestors are valid and potentially skip "
+                   "their script verification (0 to verify all, default: %s)"),
+            pnetMan->getActivePaymentNetwork()->GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage += HelpMessageOpt("-blockfilemappings=<n>",
+        strprintf(("Keep up to <n> finished block and undo files memory mapped for reads (0 to disable, default: %u)"),
+                                   DEFAULT_BLOCKFILE_MAPPINGS));
+    strUsage += HelpMessageOpt("-compressblocks",
+        strprintf(("Store the blocks written to the block files LZ4 compressed, blocks stored before stay as they "
+                   "are and either kind is read. Versions before this one can not read compressed blocks "
+                   "(default: %u)"),
+            DEFAULT_COMPRESS_BLOCKS));
     strUsage += HelpMessageOpt(
         "-blocknotify=<cmd>", ("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>",
         strprintf(("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
+    strUsage += HelpMessageOpt("-checkbackground",
+        strprintf(("Verify the -checkblocks blocks in the background once the node is up, instead of before it "
+                   "starts (default: %u)"),
+            DEFAULT_CHECKBACKGROUND));
     strUsage += HelpMessageOpt("-checklevel=<n>",
         strprintf(("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
+    strUsage += HelpMessageOpt("-coinsprefetchthreads=<n>",
+        strprintf(("Threads that read the coins spent by blocks into the cache before they are connected (0 to "
+                   "disable, up to %d, default: %d)"),
+            MAX_COINS_PREFETCH_THREADS, DEFAULT_COINS_PREFETCH_THREADS));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(("Specify configuration file (default: %s)"), CONF_FILENAME));
     strUsage += HelpMessageOpt("-returnchange",
         strprintf(("Specify if change is returned to same address (default: %u)"), DEFAULT_RETURN_CHANGE));
@@ -366,26 +487,64 @@ std::string HelpMessage()
         strUsage += HelpMessageOpt("-daemon", ("Run in the background as a daemon and accept commands"));
 #endif
     }
+    strUsage += HelpMessageOpt("-addressindex", strprintf(("Maintain an index of the outputs and spends of every "
+                                                            "address, used by the getaddress* calls (default: %u)"),
+                                                    DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(("Maintain an index of the BIP158 basic filter of "
+                                                                "every block, used by getblockfilter and to serve "
+                                                                "the filters to peers (default: %u)"),
+                                                        DEFAULT_BLOCKFILTERINDEX));
     strUsage += HelpMessageOpt("-datadir=<dir>", ("Specify data directory"));
     strUsage +=
         HelpMessageOpt("-dbcache=<n>", strprintf(("Set database cache size in megabytes (%d to %d, default: %d)"),
                                            nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-flatblockindex",
+        strprintf(("Keep the block index in one file of fixed size records instead of the block index database, "
+                   "the entries are moved over when this changes (default: %u)"),
+            DEFAULT_FLAT_BLOCK_INDEX));
     strUsage += HelpMessageOpt("-loadblock=<file>", ("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", ("Start from the UTXO snapshot in <file> when there is no "
+                                                         "chainstate yet, it has to be one the network lists (requires "
+                                                         "-prune)"));
     strUsage += HelpMessageOpt(
         "-maxorphantx=<n>", strprintf(("Keep at most <n> unconnectable transactions in memory (default: %u)"),
                                 DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphanpool=<n>",
+        strprintf(("Keep at most <n> megabytes of unconnectable transactions in memory (default: %u)"),
+                                   DEFAULT_MAX_ORPHAN_POOL_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>",
         strprintf(("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt(
         "-mempoolexpiry=<n>", strprintf(("Do not keep transactions in the mempool longer than <n> hours (default: %u)"),
                                   DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-persistmempool",
+        strprintf(("Whether to save the mempool on shutdown and load on restart (default: %u)"),
+                                   DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-persistcoinscache",
+        strprintf(("Whether to save which coins are cached on shutdown and read them back in on restart (default: %u)"),
+                                   DEFAULT_PERSIST_COINSCACHE));
+    strUsage += HelpMessageOpt("-persistsigcache",
+        strprintf(("Whether to save the signature caches on shutdown and load on restart (default: %u)"),
+                                   DEFAULT_PERSIST_SIGCACHE));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(("Set the number of script verification threads (%u to %d, 0 = "
                                                       "auto, <0 = leave that many cores free, default: %d)"),
                                                -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(("Specify pid file (default: %s)"), PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>",
+        strprintf(("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with "
+                   "-rescan. Warning: Reverting this setting requires re-downloading the entire blockchain. "
+                   "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"),
+                                   MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-prunestaleheaders=<n>",
+        strprintf(("Forget the headers of side branches more than <n> blocks of work behind the tip that have no "
+                   "block data (0 = keep them all, default: %d)"),
+                                   DEFAULT_STALE_HEADER_DEPTH));
     strUsage += HelpMessageOpt("-reindex", ("Rebuild block chain index from current blk000??.dat files on startup"));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(("Maintain an index of which input spent each output, used by "
+                                                          "the getspentinfo call (default: %u)"),
+                                                  DEFAULT_SPENTINDEX));
 
     strUsage += HelpMessageGroup(("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", ("Add a node to connect to and attempt to keep the connection open"));
@@ -396,6 +555,10 @@ std::string HelpMessage()
                             DEFAULT_MISBEHAVING_BANTIME));
     strUsage += HelpMessageOpt(
         "-bind=<addr>", ("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-blockservethreads=<n>",
+        strprintf(("Set the number of threads reading the blocks peers ask for from disk (0 to %d, 0 = read them "
+                   "while processing the request, default: %d)"),
+            MAX_BLOCK_SERVE_THREADS, DEFAULT_BLOCK_SERVE_THREADS));
     strUsage += HelpMessageOpt("-connect=<ip>", ("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt(
         "-discover", ("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
@@ -411,17 +574,31 @@ std::string HelpMessage()
         "-listenonion", strprintf(("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
     strUsage += HelpMessageOpt("-maxconnections=<n>",
         strprintf(("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
+    strUsage += HelpMessageOpt("-maxhistoryuploadrate=<n>",
+        strprintf(("Send blocks older than a week to each peer at no more than <n> kB per second, relay is not "
+                   "limited (0 = no limit, default: %d)"),
+            DEFAULT_MAX_HISTORY_UPLOAD_RATE));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>",
         strprintf(("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>",
         strprintf(("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>",
+        strprintf(("Set the number of threads processing peer messages (%d to %d, 0 = one per core, <0 = leave "
+                   "that many cores free, default: %d)"),
+            -GetNumCores(), MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>",
         strprintf(("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", ("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
+    strUsage += HelpMessageOpt("-parallelheaders",
+        strprintf(("Download the headers up to the last checkpoint from several peers at once (default: %u)"),
+            DEFAULT_PARALLEL_HEADERS));
     strUsage += HelpMessageOpt(
         "-permitbaremultisig", strprintf(("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
     strUsage += HelpMessageOpt("-peerbloomfilters",
         strprintf(("Support filtering of blocks and transaction with bloom filters (default: %u)"), 1));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(("Serve compact block filters to peers per BIP157, "
+                                                                "requires -blockfilterindex (default: %u)"),
+                                                        DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(("Listen for connections on <port> (default: %u)"),
                                                    pnetMan->getActivePaymentNetwork()->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", ("Connect through SOCKS5 proxy"));
@@ -429,11 +606,19 @@ std::string HelpMessage()
         strprintf(("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"),
                                    DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", ("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-sendcoalesce=<n>",
+        strprintf(("Let small messages to a peer wait up to <n> microseconds for more to send them with, blocks and "
+                   "pongs go right away (0 = send every message right away, default: %d)"),
+            DEFAULT_SEND_COALESCE));
     strUsage += HelpMessageOpt("-timeout=<n>",
         strprintf(("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>",
         strprintf(("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", ("Tor control port password (default: empty)"));
+    strUsage += HelpMessageOpt("-txreconciliation",
+        strprintf(("Offer peers to reconcile the transactions announced to them instead of sending an inv for each, "
+                   "a few outbound peers are still sent every one (default: %u)"),
+            DEFAULT_TXRECONCILIATION));
 #ifdef USE_UPNP
 #if USE_UPNP
     strUsage +=
@@ -510,6 +695,11 @@ std::string HelpMessage()
             strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and "
                       "mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)",
                                        pnetMan->getActivePaymentNetwork()->DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkblockindexinterval=<n>",
+            strprintf("With -checkblockindex only check the block index entries that changed after every block and "
+                      "header, and check the whole block tree in the background every <n> seconds, 0 to check all of "
+                      "it every time (default: %d)",
+                DEFAULT_CHECKBLOCKINDEX_INTERVAL));
         strUsage +=
             HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)",
                                                     pnetMan->getActivePaymentNetwork()->DefaultConsistencyChecks()));
@@ -517,6 +707,20 @@ std::string HelpMessage()
             "-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)",
                                 DEFAULT_CHECKPOINTS_ENABLED));
 
+        strUsage += HelpMessageOpt("-dbbatchsize=<n>",
+            strprintf("Maximum database write batch size in bytes, a chainstate flush writes as many as it needs "
+                      "(default: %u)",
+                                       nMaxDBBatchSize));
+        strUsage += HelpMessageOpt("-<db>dbblocksize=<n>",
+            strprintf("Size of the data blocks of the LevelDB database <db>, chainstate or blockindex, in bytes "
+                      "(default: %u)",
+                                       DEFAULT_DB_BLOCK_SIZE));
+        strUsage += HelpMessageOpt("-<db>dbcompression",
+            strprintf("Compress the data blocks of <db> if LevelDB has Snappy (default: %u)", DEFAULT_DB_COMPRESSION));
+        strUsage += HelpMessageOpt("-<db>dbmaxopenfiles=<n>",
+            strprintf("Number of files of <db> LevelDB keeps open (default: %u)", DEFAULT_DB_MAX_OPEN_FILES));
+        strUsage += HelpMessageOpt("-<db>dbwritebuffer=<n>",
+            "Size of a write buffer of <db> in megabytes, there may be two (default: a quarter of its cache)");
         strUsage += HelpMessageOpt("-dblogsize=<n>",
             strprintf("Flush wallet database activity from memory to disk log every <n> megabytes (default: %u)",
                                        DEFAULT_WALLET_DBLOGSIZE));
@@ -524,12 +728,21 @@ std::string HelpMessage()
             strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
+        strUsage += HelpMessageOpt("-feefilter",
+            strprintf("Tell peers the feerate below which we would not accept their transactions (default: %u)",
+                DEFAULT_FEEFILTER));
         strUsage += HelpMessageOpt("-fuzzmessagestest=<n>", "Randomly fuzz 1 of every <n> network messages");
 
         strUsage += HelpMessageOpt(
             "-flushwallet", strprintf("Run a thread to flush wallet periodically (default: %u)", DEFAULT_FLUSHWALLET));
+        strUsage += HelpMessageOpt("-siphash24maps",
+            strprintf("Hash the keys of the coins cache and the transaction maps with SipHash-2-4 instead of the "
+                      "faster SipHash-1-3 (default: %u)",
+                DEFAULT_SIPHASH24_MAPS));
         strUsage += HelpMessageOpt("-stopafterblockimport",
             strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT));
+        strUsage += HelpMessageOpt("-txoutsetsnapshot=<height>:<hash>:<outputs>:<snapshothash>",
+            "Let -loadtxoutset also load the UTXO snapshot dumptxoutset reported these values for (regtest only)");
 
         strUsage += HelpMessageOpt("-limitancestorcount=<n>",
             strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)",
@@ -548,15 +761,15 @@ std::string HelpMessage()
                                             DEFAULT_DESCENDANT_SIZE_LIMIT));
     }
     // Don't translate these and qt below
-    std::string debugCategories = "addrman, alert, bench, coindb, db, lock, rand, rpc, selectcoins, mempool, "
-                                  "mempoolrej, net, proxy, http, libevent, tor, zmq";
-    debugCategories += ", qt";
+    std::string debugCategories = CLogger::ListCategories();
     strUsage += HelpMessageOpt("-debug=<category>",
         strprintf(("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
             ("If <category> is not supplied or if <category> = 1, output all debugging information.") +
             ("<category> can be:") + " " + debugCategories + ".");
     if (showDebug)
         strUsage += HelpMessageOpt("-nodebug", "Turn off debugging messages, same as -debug=0");
+    strUsage += HelpMessageOpt("-genproclimit=<n>",
+        strprintf(("Set the number of proof-of-work miner threads, -1 for all cores (default: %d)"), DEFAULT_GENERATE_THREADS));
     strUsage += HelpMessageOpt("-staking", strprintf(("Generate coins (default: %u)"), DEFAULT_GENERATE));
     strUsage += HelpMessageOpt("-help-debug", ("Show all debugging options (usage: --help -help-debug)"));
     strUsage +=
@@ -565,6 +778,11 @@ std::string HelpMessage()
         "-logtimestamps", strprintf(("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-logasync",
+            strprintf("Write debug output from a background thread, dropping lines when it falls behind (default: %u)",
+                                       DEFAULT_LOGASYNC));
+        strUsage += HelpMessageOpt("-logbuffer=<n>",
+            strprintf("Number of log lines kept for the background writer (default: %u)", DEFAULT_LOGBUFFER));
         strUsage += HelpMessageOpt("-logtimemicros",
             strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
@@ -572,7 +790,8 @@ std::string HelpMessage()
             strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)",
                                        DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>",
-            strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+            strprintf("Limit size of signature and script execution caches to <n> MiB (default: %u)",
+                DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt(
         "-minrelaytxfee=<amt>", strprintf(("Fees (in %s/kB) smaller than this are considered zero fee for relaying, "
@@ -609,13 +828,30 @@ std::string HelpMessage()
     strUsage += HelpMessageGroup(("Block creation options:"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
+    strUsage += HelpMessageOpt("-stratum", strprintf(("Serve proof-of-work miners over stratum, for blocks that pay "
+                                                      "to the wallet (default: %u)"),
+                                               DEFAULT_STRATUM));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>", ("Bind the stratum server to the given address. Use [host]:port "
+                                                       "notation for IPv6. Can be specified multiple times (default: "
+                                                       "127.0.0.1 and ::1)"));
+    strUsage += HelpMessageOpt("-stratumdifficulty=<n>",
+        strprintf(("Difficulty of the shares stratum miners submit, as scrypt miners count it (default: %g)"),
+            DEFAULT_STRATUM_DIFFICULTY));
+    strUsage += HelpMessageOpt(
+        "-stratumport=<port>", strprintf(("Listen for stratum connections on <port> (default: %u)"), DEFAULT_STRATUM_PORT));
 
     strUsage += HelpMessageGroup(("RPC server options:"));
     strUsage += HelpMessageOpt("-server", ("Accept command line and JSON-RPC commands"));
     strUsage += HelpMessageOpt("-rest", strprintf(("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
+    strUsage += HelpMessageOpt("-metrics", strprintf("Serve Prometheus metrics at /metrics of the RPC port, "
+                                                     "without authentication as REST (default: %u)",
+                                               DEFAULT_METRICS_ENABLE));
     strUsage += HelpMessageOpt(
         "-rpcbind=<addr>", ("Bind to given address to listen for JSON-RPC connections. Use [host]:port notation for "
                             "IPv6. This option can be specified multiple times (default: bind to all interfaces)"));
+    strUsage += HelpMessageOpt("-rpcunixsocket=<path>",
+        ("Also accept JSON-RPC requests framed by their size on the Unix socket at <path>, relative to the data "
+         "directory, on connections that stay open. Anyone who can open the socket may call every method"));
     strUsage += HelpMessageOpt("-rpccookiefile=<loc>", ("Location of the auth cookie (default: data dir)"));
     strUsage += HelpMessageOpt("-rpcuser=<user>", ("Username for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", ("Password for JSON-RPC connections"));
@@ -629,12 +865,28 @@ std::string HelpMessage()
         "-rpcallowip=<ip>", ("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. "
                              "1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. "
                              "1.2.3.4/24). This option can be specified multiple times"));
+    strUsage += HelpMessageOpt("-rpceventthreads=<n>",
+        strprintf(("Set the number of threads accepting RPC connections and reading and writing their requests and "
+                   "replies, more than one share the RPC ports through SO_REUSEPORT (1 to %d, default: %d)"),
+            MAX_HTTP_EVENT_THREADS, DEFAULT_HTTP_EVENT_THREADS));
     strUsage += HelpMessageOpt("-rpcthreads=<n>",
         strprintf(("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-rpcfastthreads=<n>",
+            strprintf("Set the number of threads to service cheap RPC calls like getblockcount (default: %d)",
+                DEFAULT_HTTP_FAST_THREADS));
+        strUsage += HelpMessageOpt("-rpcslowthreads=<n>",
+            strprintf("Set the number of threads to service slow RPC calls like gettxoutsetinfo (default: %d)",
+                DEFAULT_HTTP_SLOW_THREADS));
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>",
-            strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+            strprintf("Set the depth of each of the fast, normal and slow work queues to service RPC calls "
+                      "(default: %d)",
+                DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcbatchthreads=<n>",
+            strprintf("Set the number of read only requests of a JSON-RPC batch that are run at the same time, 1 runs "
+                      "them one after another (default: %d)",
+                DEFAULT_RPC_BATCH_THREADS));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>",
             strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
@@ -686,6 +938,49 @@ struct CImportingNow
     }
 };
 
+// If we're using -prune with -reindex, then delete block files that will be ignored by the
+// reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
+// is missing, do the same here to delete any later block files after a gap.  Also delete all
+// rev files since they'll be rewritten by the reindex anyway.  This ensures that vinfoBlockFile
+// is in sync with what's actually on disk by the time we start downloading, so that pruning
+// works correctly.
+static void CleanupBlockRevFiles()
+{
+    std::map<std::string, fs::path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    fs::path blocksdir = GetDataDir() / "blocks";
+    for (fs::directory_iterator it(blocksdir); it != fs::directory_iterator(); it++)
+    {
+        if (fs::is_regular_file(*it) && it->path().filename().string().length() == 12 &&
+            it->path().filename().string().substr(8, 4) == ".dat")
+        {
+            if (it->path().filename().string().substr(0, 3) == "blk")
+                mapBlockFiles[it->path().filename().string().substr(3, 5)] = it->path();
+            else if (it->path().filename().string().substr(0, 3) == "rev")
+                fs::remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter.  Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const auto &item : mapBlockFiles)
+    {
+        if (atoi(item.first) == nContigCounter)
+        {
+            nContigCounter++;
+            continue;
+        }
+        fs::remove(item.second);
+    }
+}
+
 void ThreadImport(std::vector<fs::path> vImportFiles)
 {
     const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
@@ -749,11 +1044,30 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         }
     }
 
+    // the published tip caches IsInitialBlockDownload(), which depends on fImporting and fReindex
+    {
+        LOCK(cs_main);
+        pnetMan->getChainActive()->PublishTip();
+    }
+
     if (gArgs.GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT))
     {
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    // the mempool is accepted faster with its inputs cached
+    if (gArgs.GetBoolArg("-persistcoinscache", DEFAULT_PERSIST_COINSCACHE))
+    {
+        LoadCoinsCache();
+        fDumpCoinsCacheLater = !ShutdownRequested();
+    }
+
+    if (gArgs.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+    {
+        LoadMempool();
+        fDumpMempoolLater = !ShutdownRequested();
+    }
 }
 
 /** Sanity checks
@@ -785,6 +1099,8 @@ bool AppInitServers(thread_group &threadGroup)
         return false;
     if (gArgs.GetBoolArg("-rest", DEFAULT_REST_ENABLE) && !StartREST())
         return false;
+    if (gArgs.GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE) && !StartHTTPMetrics())
+        return false;
     if (!StartHTTPServer())
         return false;
     return true;
@@ -885,6 +1201,10 @@ void InitLogging()
     {
         g_logger->OpenDebugLog();
     }
+    if (gArgs.GetBoolArg("-logasync", DEFAULT_LOGASYNC))
+    {
+        g_logger->StartAsync(gArgs.GetArg("-logbuffer", DEFAULT_LOGBUFFER));
+    }
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Eccoin version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
@@ -901,11 +1221,24 @@ void GenerateNetworkTemplates()
     pnetMan->SetParams(ChainNameFromCommandLine());
 }
 
+/** Run a part of startup on a thread of its own next to AppInit2, nMillis is set to how long it took */
+template <typename Callable>
+static std::future<void> StartInitTask(const char *pszName, int64_t &nMillis, Callable func)
+{
+    return std::async(std::launch::async, [pszName, &nMillis, func]() {
+        RenameThread(strprintf("eccoin-init-%s", pszName).c_str());
+        int64_t nTaskStart = GetTimeMillis();
+        func();
+        nMillis = GetTimeMillis() - nTaskStart;
+    });
+}
+
 /** Initialize bitcoin.
  *  @pre Parameters should be parsed and config file should be read.
  */
 bool AppInit2(thread_group &threadGroup)
 {
+    const int64_t nInitStart = GetTimeMillis();
 // ********************************************************* Step 1: setup
 #ifdef _MSC_VER
     // Turn off Microsoft heap dump noise
@@ -987,12 +1320,20 @@ bool AppInit2(thread_group &threadGroup)
 
     // ********************************************************* Step 3: parameter-to-internal-flags
 
-    g_logger->fDebug = gArgs.IsArgSet("-debug");
+    // before the coins cache and the transaction maps of the node are made
+    fSipHash24Maps = gArgs.GetBoolArg("-siphash24maps", DEFAULT_SIPHASH24_MAPS);
+
     // Special-case: if -debug=0/-nodebug is set, turn off debugging messages
     const std::vector<std::string> &categories = gArgs.GetArgs("-debug");
-    if (gArgs.GetBoolArg("-nodebug", false) ||
-        find(categories.begin(), categories.end(), std::string("0")) != categories.end())
-        g_logger->fDebug = false;
+    if (!gArgs.GetBoolArg("-nodebug", false) &&
+        find(categories.begin(), categories.end(), std::string("0")) == categories.end())
+    {
+        for (const std::string &category : categories)
+        {
+            if (!g_logger->EnableCategory(category))
+                InitWarning(strprintf("Unsupported logging category -debug=%s.", category));
+        }
+    }
 
     // Check for -debugnet
     if (gArgs.GetBoolArg("-debugnet", false))
@@ -1020,8 +1361,17 @@ bool AppInit2(thread_group &threadGroup)
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    nCheckBlockIndexInterval =
+        std::max<int64_t>(gArgs.GetArg("-checkblockindexinterval", DEFAULT_CHECKBLOCKINDEX_INTERVAL), 0);
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
+    hashAssumeValid =
+        uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
+    if (!hashAssumeValid.IsNull())
+        LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
+    else
+        LogPrintf("Validating signatures for all blocks.\n");
+
     // mempool limits
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t nMempoolSizeMin = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000 * 40;
@@ -1037,6 +1387,46 @@ bool AppInit2(thread_group &threadGroup)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = gArgs.GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0)
+        return InitError(("Prune cannot be configured with a negative value."));
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget)
+    {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES)
+            return InitError(strprintf(("Prune configured below the minimum of %d MiB.  Please use a higher number."),
+                MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
+    if (gArgs.IsArgSet("-loadtxoutset") && !fPruneMode)
+        return InitError(("-loadtxoutset requires -prune, the blocks up to the snapshot are never downloaded."));
+    for (const std::string &strSnapshot : gArgs.GetArgs("-txoutsetsnapshot"))
+    {
+        if (!pnetMan->getActivePaymentNetwork()->MineBlocksOnDemand())
+            return InitError(("-txoutsetsnapshot may only be used on regtest."));
+        int nSnapshotHeight;
+        CTxOutSetSnapshotData snapshotData;
+        if (!ParseTxOutSetSnapshot(strSnapshot, nSnapshotHeight, snapshotData))
+            return InitError(strprintf(("Invalid value for -txoutsetsnapshot=<height>:<hash>:<outputs>:<snapshothash>: '%s'"),
+                strSnapshot));
+        pnetMan->getActivePaymentNetwork()->mapTxOutSetSnapshots[nSnapshotHeight] = snapshotData;
+    }
+    fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    if (fPruneMode && (fAddressIndex || fSpentIndex))
+        return InitError(("-addressindex and -spentindex are not possible in pruned mode, they are built from every "
+                          "block."));
+    if (fPruneMode && gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        return InitError(("-blockfilterindex is not possible in pruned mode, it is built from every block."));
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS) &&
+        !gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+        return InitError(("-peerblockfilters requires -blockfilterindex."));
+    if (fPruneMode && gArgs.GetBoolArg("-rescan", false))
+        return InitError(("Rescans are not possible in pruned mode. You will need to use -reindex which will "
+                          "download the whole blockchain again."));
+
     fServer = gArgs.GetBoolArg("-server", false);
 
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
@@ -1139,6 +1529,10 @@ bool AppInit2(thread_group &threadGroup)
     // ********************************************************* Step 4: application initialization: dir lock,
     // daemonize, pidfile, debug log
 
+    // Pick the fastest SHA256 implementation this CPU supports, before anything hashes
+    std::string strSHA256Impl = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", strSHA256Impl);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1194,8 +1588,26 @@ bool AppInit2(thread_group &threadGroup)
         {
             threadGroup.create_thread(&ThreadScriptCheck);
         }
+        // header hashes are computed by the same number of threads, see PrecomputeHeaderHashes
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        {
+            threadGroup.create_thread(&ThreadHeaderHash);
+        }
+        // and so are stake kernels, see FindStakeKernel
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        {
+            threadGroup.create_thread(&ThreadStakeKernelSearch);
+        }
     }
 
+    // Block and undo data are written on a thread of their own from here on
+    fCompressBlocks = gArgs.GetBoolArg("-compressblocks", DEFAULT_COMPRESS_BLOCKS);
+    g_blockwriter.reset(new CBlockWriter());
+    g_blockwriter->Start();
+    const int nBlockFileMappings = gArgs.GetArg("-blockfilemappings", DEFAULT_BLOCKFILE_MAPPINGS);
+    if (nBlockFileMappings > 0)
+        g_blockfilemapper.reset(new CBlockFileMapper(nBlockFileMappings));
+
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
      * that the server is there and will be ready later).  Warmup mode will
@@ -1205,6 +1617,8 @@ bool AppInit2(thread_group &threadGroup)
     {
         if (!AppInitServers(threadGroup))
             return InitError(("Unable to start HTTP server. See debug log for details."));
+        if (!StartRPCUnixSocket())
+            return InitError(("Unable to listen on the RPC Unix socket. See debug log for details."));
     }
 
     int64_t nStart;
@@ -1395,6 +1809,26 @@ bool AppInit2(thread_group &threadGroup)
 
     // ********************************************************* Step 7: load block chain
 
+    // Startup runs as tasks in the order they depend on each other. peers.dat, the ban list and the fee estimates
+    // need nothing from the chain and load while the block index does, the wallet is read while the chainstate is
+    // verified. The times are logged when init is done.
+    int64_t nBlockIndexTime = 0, nVerifyTime = 0, nWalletTime = 0, nAddressesTime = 0, nFeeEstimatesTime = 0,
+            nSigCacheTime = 0;
+    std::future<void> addressesLoaded =
+        StartInitTask("addresses", nAddressesTime, [&connman]() { connman.LoadAddresses(); });
+    std::future<void> feeEstimatesLoaded = StartInitTask("feeest", nFeeEstimatesTime, []() {
+        fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+        CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        // Allowed to fail as this file IS missing on first startup.
+        if (!est_filein.IsNull())
+            mempool.ReadFeeEstimates(est_filein);
+    });
+    // nothing checks a script before the chainstate is verified, which waits for this
+    std::future<void> sigCacheLoaded = StartInitTask("sigcache", nSigCacheTime, []() {
+        if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE))
+            LoadSigCache();
+    });
+
     fReindex = gArgs.GetBoolArg("-reindex", false);
 
     // Upgrading to 0.8; hard-link the old blknnnn.dat files into /blocks/
@@ -1437,6 +1871,12 @@ bool AppInit2(thread_group &threadGroup)
     if (nBlockTreeDBCache > (1 << 21) && !gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nBlockFilterIndexCache = 0;
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+    {
+        nBlockFilterIndexCache = nTotalCache / 8;
+        nTotalCache -= nBlockFilterIndexCache;
+    }
     // use 25%-50% of the remainder for disk cache
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23));
     nTotalCache -= nCoinDBCache;
@@ -1444,130 +1884,173 @@ bool AppInit2(thread_group &threadGroup)
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    if (nBlockFilterIndexCache)
+        LogPrintf(
+            "* Using %.1fMiB for the block filter index database\n", nBlockFilterIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
-    LOCK(cs_main);
-    bool fLoaded = false;
-    while (!fLoaded)
     {
-        bool fReset = fReindex;
-        std::string strLoadError;
-
-        LogPrintf("Loading block index...");
-        nStart = GetTimeMillis();
-        do
+        LOCK(cs_main);
+        bool fLoaded = false;
+        while (!fLoaded)
         {
-            try
+            bool fReset = fReindex;
+            std::string strLoadError;
+
+            LogPrintf("Loading block index...");
+            nStart = GetTimeMillis();
+            do
             {
-                pnetMan->getChainActive()->UnloadBlockIndex();
-                pnetMan->getChainActive()->pcoinsTip.reset();
-                pcoinsdbview.reset();
-                pcoinscatcher.reset();
-                pnetMan->getChainActive()->pblocktree.reset();
-
-                pnetMan->getChainActive()->pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReindex));
-                pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset));
-                pcoinscatcher.reset(new CCoinsViewErrorCatcher(pcoinsdbview.get()));
-                pnetMan->getChainActive()->pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
-
-                if (fReindex)
-                {
-                    pnetMan->getChainActive()->pblocktree->WriteReindexing(true);
-                }
-                else
+                try
                 {
-                    // If necessary, upgrade from older database format.
-                    if (!pcoinsdbview->Upgrade())
+                    pnetMan->getChainActive()->UnloadBlockIndex();
+                    pnetMan->getChainActive()->pcoinsTip.reset();
+                    pcoinsdbview.reset();
+                    pcoinscatcher.reset();
+                    pnetMan->getChainActive()->pblocktree.reset();
+
+                    pnetMan->getChainActive()->pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReindex));
+                    pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset));
+                    pcoinscatcher.reset(new CCoinsViewErrorCatcher(pcoinsdbview.get()));
+                    pnetMan->getChainActive()->pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+
+                    if (fReindex)
                     {
-                        strLoadError = ("Error upgrading chainstate database");
+                        pnetMan->getChainActive()->pblocktree->WriteReindexing(true);
+                        // If we're reindexing in prune mode, wipe away unusable block files and all undo data files
+                        if (fPruneMode)
+                            CleanupBlockRevFiles();
+                    }
+                    else
+                    {
+                        if (gArgs.IsArgSet("-loadtxoutset"))
+                        {
+                            if (!pcoinsdbview->GetBestBlock().IsNull())
+                                LogPrintf("Not loading the UTXO snapshot, there already is a chainstate\n");
+                            else
+                            {
+                                std::string strError;
+                                if (!LoadTxOutSet(fs::absolute(gArgs.GetArg("-loadtxoutset", ""), GetDataDir()),
+                                        chainparams, chainparams.TxOutSetSnapshots(),
+                                        *pnetMan->getChainActive()->pblocktree, *pcoinsdbview, strError))
+                                    return InitError(strprintf("Error loading UTXO snapshot: %s", strError));
+                            }
+                        }
+                        // If necessary, upgrade from older database format.
+                        if (!pcoinsdbview->Upgrade())
+                        {
+                            strLoadError = ("Error upgrading chainstate database");
+                            break;
+                        }
+                        if (!pnetMan->getChainActive()->pblocktree->Upgrade())
+                        {
+                            strLoadError = ("Error upgrading block index database");
+                            break;
+                        }
+                    }
+                    if (!pnetMan->getChainActive()->pblocktree->SetFlatIndex(
+                            gArgs.GetBoolArg("-flatblockindex", DEFAULT_FLAT_BLOCK_INDEX)))
+                    {
+                        strLoadError = ("Error moving the block index");
                         break;
                     }
-                }
 
-                if (!pnetMan->getChainActive()->LoadBlockIndex())
-                {
-                    strLoadError = ("Error loading block database");
-                    break;
-                }
-                // If the loaded chain has a wrong genesis, bail out immediately
-                // (we're likely using a testnet datadir, or the other way around).
-                {
-                    READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
-                    if (!pnetMan->getChainActive()->mapBlockIndex.empty() &&
-                        pnetMan->getChainActive()->mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) ==
-                            0)
+                    if (!pnetMan->getChainActive()->LoadBlockIndex())
                     {
-                        return InitError("Incorrect or no genesis block found. Wrong datadir for network?");
+                        strLoadError = ("Error loading block database");
+                        break;
+                    }
+                    // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                    // in the past, but is now trying to run unpruned.
+                    if (fHavePruned && !fPruneMode)
+                    {
+                        strLoadError = ("You need to rebuild the database using -reindex to go back to unpruned mode.  "
+                                        "This will redownload the entire blockchain");
+                        break;
+                    }
+                    // If the loaded chain has a wrong genesis, bail out immediately
+                    // (we're likely using a testnet datadir, or the other way around).
+                    {
+                        READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
+                        const uint256 &hashGenesis = chainparams.GetConsensus().hashGenesisBlock;
+                        if (!pnetMan->getChainActive()->mapBlockIndex.empty() &&
+                            pnetMan->getChainActive()->mapBlockIndex.count(hashGenesis) == 0)
+                        {
+                            return InitError("Incorrect or no genesis block found. Wrong datadir for network?");
+                        }
+                    }
+                    // The indexes only cover the blocks connected while they were on, so they can only change in a
+                    // database that is built again.
+                    if (pnetMan->getChainActive()->chainActive.Genesis() != nullptr)
+                    {
+                        bool fStoredAddressIndex = false;
+                        bool fStoredSpentIndex = false;
+                        pnetMan->getChainActive()->pblocktree->ReadFlag("addressindex", fStoredAddressIndex);
+                        pnetMan->getChainActive()->pblocktree->ReadFlag("spentindex", fStoredSpentIndex);
+                        if (fStoredAddressIndex != fAddressIndex || fStoredSpentIndex != fSpentIndex)
+                        {
+                            strLoadError = ("You need to rebuild the database using -reindex to change "
+                                            "-addressindex or -spentindex");
+                            break;
+                        }
                     }
-                }
-
-                // Initialize the block index (no-op if non-empty database was already loaded)
-                if (!pnetMan->getChainActive()->InitBlockIndex(chainparams))
-                {
-                    strLoadError = ("Error initializing block database");
-                    break;
-                }
 
-                /// check for services folder, if does not exist. make it
-                fs::path servicesFolder = (GetDataDir() / "services");
-                if (fs::exists(servicesFolder))
-                {
-                    if (!fs::is_directory(servicesFolder))
+                    // Initialize the block index (no-op if non-empty database was already loaded)
+                    if (!pnetMan->getChainActive()->InitBlockIndex(chainparams))
                     {
-                        LogPrintf("services exists but is not a folder, check your eccoin data files \n");
-                        assert(false);
+                        strLoadError = ("Error initializing block database");
+                        break;
                     }
-                }
-                else
-                {
-                    fs::create_directory(servicesFolder);
-                }
 
-                // verify the blocks
-                LogPrintf("Verifying blocks...");
+                    /// check for services folder, if does not exist. make it
+                    fs::path servicesFolder = (GetDataDir() / "services");
+                    if (fs::exists(servicesFolder))
+                    {
+                        if (!fs::is_directory(servicesFolder))
+                        {
+                            LogPrintf("services exists but is not a folder, check your eccoin data files \n");
+                            assert(false);
+                        }
+                    }
+                    else
+                    {
+                        fs::create_directory(servicesFolder);
+                    }
 
-                {
-                    CBlockIndex *tip = pnetMan->getChainActive()->chainActive.Tip();
-                    if (tip && tip->nTime > GetAdjustedTime() + 2 * 60 * 60)
                     {
-                        strLoadError = ("The block database contains a block which appears to be from the future. "
-                                        "This may be due to your computer's date and time being set incorrectly. "
-                                        "Only rebuild the block database if you are sure that your computer's "
-                                        "date and time are correct");
-                        break;
+                        CBlockIndex *tip = pnetMan->getChainActive()->chainActive.Tip();
+                        if (tip && tip->nTime > GetAdjustedTime() + 2 * 60 * 60)
+                        {
+                            strLoadError = ("The block database contains a block which appears to be from the future. "
+                                            "This may be due to your computer's date and time being set incorrectly. "
+                                            "Only rebuild the block database if you are sure that your computer's "
+                                            "date and time are correct");
+                            break;
+                        }
                     }
                 }
-
-                if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview.get(),
-                        gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
-                        gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS)))
+                catch (const std::exception &e)
                 {
-                    strLoadError = ("Corrupted block database detected");
+                    LogPrint(Logging::DB, "%s\n", e.what());
+                    strLoadError = ("Error opening block database");
                     break;
                 }
-            }
-            catch (const std::exception &e)
-            {
-                if (g_logger->fDebug)
-                    LogPrintf("%s\n", e.what());
-                strLoadError = ("Error opening block database");
-                break;
-            }
 
-            fLoaded = true;
-        } while (false);
+                fLoaded = true;
+            } while (false);
 
-        if (!fLoaded)
-        {
-            // first suggest a reindex
-            if (!fReset)
+            if (!fLoaded)
             {
-                LogPrintf("Aborted block database rebuild. Exiting.\n");
-                return false;
-            }
-            else
-            {
-                return InitError(strLoadError);
+                // first suggest a reindex
+                if (!fReset)
+                {
+                    LogPrintf("Aborted block database rebuild. Exiting.\n");
+                    return false;
+                }
+                else
+                {
+                    return InitError(strLoadError);
+                }
             }
         }
     }
@@ -1580,21 +2063,69 @@ bool AppInit2(thread_group &threadGroup)
         LogPrintf("Shutdown requested. Exiting.\n");
         return false;
     }
-    LogPrintf("total time for block index %15dms\n", GetTimeMillis() - nStart);
-
-    fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-    CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
-    // Allowed to fail as this file IS missing on first startup.
-    if (!est_filein.IsNull())
-        mempool.ReadFeeEstimates(est_filein);
-    fFeeEstimatesInitialized = true;
+    nBlockIndexTime = GetTimeMillis() - nStart;
+    LogPrintf("total time for block index %15dms\n", nBlockIndexTime);
+    sigCacheLoaded.get();
+    fDumpSigCacheLater = true;
+
+    // Verification holds cs_main throughout, reading the wallet does not need it. The wallet takes it to mark
+    // conflicts at the end of loading and to rescan, which then wait for the verification to finish.
+    bool fVerified = true;
+    std::future<void> verified;
+    if (!gArgs.GetBoolArg("-checkbackground", DEFAULT_CHECKBACKGROUND))
+    {
+        LogPrintf("Verifying blocks...\n");
+        const int nCheckLevel = gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL);
+        const int nCheckDepth = gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS);
+        verified = StartInitTask("verify", nVerifyTime, [&chainparams, &fVerified, nCheckLevel, nCheckDepth]() {
+            try
+            {
+                fVerified = CVerifyDB().VerifyDB(chainparams, pcoinsdbview.get(), nCheckLevel, nCheckDepth);
+            }
+            catch (const std::exception &e)
+            {
+                LogPrint(Logging::DB, "%s\n", e.what());
+                fVerified = false;
+            }
+            // a rescan of the wallet on a corrupted database would be wasted, init stops below anyway
+            if (!fVerified)
+                StartShutdown();
+        });
+    }
 
     // ********************************************************* Step 8: load wallet
 
+    int64_t nWalletStart = GetTimeMillis();
     CWallet::InitLoadWallet();
+    nWalletTime = GetTimeMillis() - nWalletStart;
+    if (verified.valid())
+        verified.get();
+    if (!fVerified)
+    {
+        if (!fReindex)
+        {
+            LogPrintf("Aborted block database rebuild. Exiting.\n");
+            return false;
+        }
+        return InitError("Corrupted block database detected");
+    }
     if (!pwalletMain)
         return false;
 
+    // the rest of init runs with cs_main held, as the block index load does
+    LOCK(cs_main);
+    feeEstimatesLoaded.get();
+    fFeeEstimatesInitialized = true;
+
+    // ********************************************************* Step 9: data directory maintenance
+
+    // if pruning, perform the initial blockstore prune after any wallet rescanning has taken place.
+    if (fPruneMode && !fReindex)
+    {
+        LogPrintf("Pruning blockstore...\n");
+        PruneAndFlush();
+    }
+
     // ********************************************************* Step 10: import blocks
 
     LogPrintf("Activating best chain...\n");
@@ -1605,6 +2136,14 @@ bool AppInit2(thread_group &threadGroup)
         for (auto const &strFile : gArgs.GetArgs("-loadblock"))
             vImportFiles.push_back(strFile);
     }
+    // the coins cache is not replaced from here on, blocks that are imported or received get their coins prefetched
+    const int nPrefetchThreads = std::min<int>(
+        gArgs.GetArg("-coinsprefetchthreads", DEFAULT_COINS_PREFETCH_THREADS), MAX_COINS_PREFETCH_THREADS);
+    if (nPrefetchThreads > 0)
+    {
+        g_coinsprefetcher.reset(new CCoinsPrefetcher(pnetMan->getChainActive()->pcoinsTip.get(), nPrefetchThreads));
+        g_coinsprefetcher->Start();
+    }
     threadGroup.create_thread(&ThreadImport, vImportFiles);
 
     if (pnetMan->getChainActive()->chainActive.Tip() == nullptr)
@@ -1616,11 +2155,26 @@ bool AppInit2(thread_group &threadGroup)
         }
     }
 
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+    {
+        // catches up on a thread of its own, filters of blocks it has not reached yet are not available
+        g_blockfilterindex.reset(new CBlockFilterIndex(BASIC_FILTER, nBlockFilterIndexCache));
+        g_blockfilterindex->Start();
+    }
+
+    StartValidationInterfaceQueue();
+    mempool.NotifyEntryAdded.connect([](CTransactionRef ptx, uint64_t nSequence) {
+        GetMainSignals().TransactionAddedToMempool(ptx, nSequence);
+    });
+    mempool.NotifyEntryRemoved.connect([](CTransactionRef ptx, MemPoolRemovalReason reason, uint64_t nSequence) {
+        GetMainSignals().TransactionRemovedFromMempool(ptx, reason, nSequence);
+    });
 #if ENABLE_ZMQ
     pzmqNotificationInterface = CZMQNotificationInterface::CreateWithArguments(gArgs.GetMapArgs());
     if (pzmqNotificationInterface)
     {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        // publishing to zmq does not hold up block connection
+        RegisterValidationInterface(pzmqNotificationInterface, true);
     }
 #endif
 
@@ -1650,8 +2204,36 @@ bool AppInit2(thread_group &threadGroup)
     // Map ports with UPnP
     MapPort(gArgs.GetBoolArg("-upnp", DEFAULT_UPNP));
 
+    addressesLoaded.get();
+    // the periodic jobs of the node, connman schedules its dumps on it
+    g_scheduler.reset(new CScheduler());
+    g_scheduler->Start();
+
+    if (gArgs.GetBoolArg("-parallelheaders", DEFAULT_PARALLEL_HEADERS) && fCheckpointsEnabled && !fReindex)
+    {
+        LOCK(cs_main);
+        const CBlockIndex *pindexCheckpoint =
+            Checkpoints::GetLastCheckpoint(pnetMan->getActivePaymentNetwork()->Checkpoints());
+        if (pindexCheckpoint)
+            headersync.Init(pnetMan->getActivePaymentNetwork()->Checkpoints().mapCheckpoints,
+                pindexCheckpoint->nHeight, GetTimeMicros());
+    }
+
+    const int nStaleHeaderDepth = gArgs.GetArg("-prunestaleheaders", DEFAULT_STALE_HEADER_DEPTH);
+    if (nStaleHeaderDepth > 0)
+        g_scheduler->ScheduleEvery(
+            [nStaleHeaderDepth]() { PruneStaleHeaderBranches(nStaleHeaderDepth); }, STALE_HEADER_PRUNE_INTERVAL * 1000);
+
+    // before the message handlers run, they read g_blockserver
+    const int nBlockServeThreads = std::max(0,
+        std::min<int>(gArgs.GetArg("-blockservethreads", DEFAULT_BLOCK_SERVE_THREADS), MAX_BLOCK_SERVE_THREADS));
+    if (nBlockServeThreads > 0)
+    {
+        g_blockserver.reset(new CBlockServer(&connman, nBlockServeThreads));
+        g_blockserver->Start();
+    }
     std::string strNodeError;
-    if (!connman.Start(strNodeError))
+    if (!connman.Start(*g_scheduler, strNodeError))
     {
         return InitError(strNodeError);
     }
@@ -1665,11 +2247,29 @@ bool AppInit2(thread_group &threadGroup)
     {
         ThreadGeneration(pwalletMain, false, true);
     }
+    if (!StartStratumServer())
+    {
+        return InitError(("Unable to start the stratum server. See debug log for details."));
+    }
 
     // ********************************************************* Step 12: finished
 
     SetRPCWarmupFinished();
     LogPrintf("Done loading");
+    LogPrintf("Startup times: block index %dms, verify %dms, wallet %dms (next to verify), addresses %dms, fee "
+              "estimates %dms and signature caches %dms (next to block index), total %dms\n",
+        nBlockIndexTime, nVerifyTime, nWalletTime, nAddressesTime, nFeeEstimatesTime, nSigCacheTime,
+        GetTimeMillis() - nInitStart);
+
+    if (gArgs.GetBoolArg("-checkbackground", DEFAULT_CHECKBACKGROUND))
+    {
+        threadGroup.create_thread(&ThreadVerifyDB, (int)gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
+            (int)gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS));
+    }
+    if (fCheckBlockIndex && nCheckBlockIndexInterval > 0)
+    {
+        threadGroup.create_thread(&ThreadCheckBlockIndex, nCheckBlockIndexInterval);
+    }
 
 
     if (pwalletMain)
@@ -1677,9 +2277,14 @@ bool AppInit2(thread_group &threadGroup)
         // Add wallet transactions that aren't already in a block to mapTransactions
         pwalletMain->ReacceptWalletTransactions();
 
-        // Run a thread to flush wallet periodically
-        threadGroup.create_thread(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile));
+        // Flush the wallet periodically
+        if (gArgs.GetBoolArg("-flushwallet", DEFAULT_FLUSHWALLET))
+        {
+            const std::string strFlushWalletFile = pwalletMain->strWalletFile;
+            g_scheduler->ScheduleEvery([strFlushWalletFile]() { MaybeFlushWalletDB(strFlushWalletFile); }, 500);
+        }
     }
+    g_scheduler->ScheduleEvery([&connman]() { MaybeResendWalletTxs(connman); }, 1000);
 
     return !shutdown_threads.load();
 }
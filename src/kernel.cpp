@@ -18,13 +18,16 @@
  */
 
 #include <algorithm>
+#include <map>
 
 #include "args.h"
 #include "chain/chain.h"
 #include "consensus/consensus.h"
+#include "crypto/common.h"
 #include "crypto/scrypt.h"
 #include "init.h"
 #include "kernel.h"
+#include "lrucache.h"
 #include "main.h"
 #include "net/net.h"
 #include "networks/netman.h"
@@ -32,12 +35,27 @@
 #include "script/stakescript.h"
 #include "timedata.h"
 #include "txdb.h"
+#include "txmempool.h"
 #include "util/logger.h"
+#include "util/trace.h"
 #include "util/utiltime.h"
 
-// The stake modifier used to hash for a stake kernel is chosen as the stake
-// modifier about a selection interval later than the coin generating the kernel
-static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint256 &nStakeModifier)
+// Kernel stake modifiers by the hash of the block the staked coin comes from. The walk
+// forward from that block depends on the active chain, so the cache only holds results
+// computed against hashStakeModifierTip and is emptied whenever the tip changes.
+static const size_t MAX_STAKE_MODIFIER_CACHE = 100000;
+static CCriticalSection cs_stakeModifierCache;
+static CLRUCache<uint256, uint256, SaltedTxidHasher> stakeModifierCache(MAX_STAKE_MODIFIER_CACHE);
+static uint256 hashStakeModifierTip GUARDED_BY(cs_stakeModifierCache);
+
+void ClearStakeModifierCache()
+{
+    LOCK(cs_stakeModifierCache);
+    stakeModifierCache.Clear();
+    hashStakeModifierTip.SetNull();
+}
+
+static bool ComputeKernelStakeModifier(const uint256 &hashBlockFrom, uint256 &nStakeModifier)
 {
     nStakeModifier.SetNull();
     const CBlockIndex *pindex = pnetMan->getChainActive()->LookupBlockIndex(hashBlockFrom);
@@ -46,7 +64,7 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint256 &nStakeModifie
         return error("GetKernelStakeModifier() : block not indexed");
     }
     int blocksToGo = 5;
-    if (pnetMan->getChainActive()->chainActive.Tip()->nHeight >= 1504350)
+    if (pnetMan->getChainActive()->GetPublishedTip()->nHeight >= 1504350)
     {
         blocksToGo = 180;
     }
@@ -57,7 +75,7 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint256 &nStakeModifie
     }
     if (blocksToGo > 0)
     {
-        LogPrint("kernel", "blocks to go was %i and it should be 0 but we ran out of indexes \n", blocksToGo);
+        LogPrint(Logging::KERNEL, "blocks to go was %i and it should be 0 but we ran out of indexes \n", blocksToGo);
         return false;
     }
 
@@ -73,6 +91,36 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint256 &nStakeModifie
     return true;
 }
 
+// The stake modifier used to hash for a stake kernel is chosen as the stake
+// modifier about a selection interval later than the coin generating the kernel
+static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint256 &nStakeModifier)
+{
+    const uint256 hashTip = pnetMan->getChainActive()->GetPublishedTip()->hash;
+    {
+        LOCK(cs_stakeModifierCache);
+        if (hashStakeModifierTip != hashTip)
+        {
+            stakeModifierCache.Clear();
+            hashStakeModifierTip = hashTip;
+        }
+        const uint256 *pcached = stakeModifierCache.Get(hashBlockFrom);
+        if (pcached)
+        {
+            nStakeModifier = *pcached;
+            return true;
+        }
+    }
+
+    // failures are not cached, they are rare and usually mean the chain is still catching up
+    if (!ComputeKernelStakeModifier(hashBlockFrom, nStakeModifier))
+        return false;
+
+    LOCK(cs_stakeModifierCache);
+    if (hashStakeModifierTip == hashTip)
+        stakeModifierCache.Put(hashBlockFrom, nStakeModifier);
+    return true;
+}
+
 // Stake Modifier (hash modifier of proof-of-stake):
 // The purpose of stake modifier is to prevent a txout (coin) owner from
 // computing future proof-of-stake generated by this txout at the time
@@ -125,20 +173,40 @@ bool ComputeNextStakeModifier(const CBlockIndex *pindexPrev, const CTransaction
         // previous transaction not in main chain, may occur during initial download
         return error("ComputeNextStakeModifier() : INFO: read txPrev failed");
 
-    // Read block header
-    CBlock block;
+    // The block header is in the index, the block itself may have been pruned
     CBlockIndex *index = pnetMan->getChainActive()->LookupBlockIndex(blockHashOfTx);
+    if (!index)
+    {
+        // unable to find block of previous transaction
+        LogPrint(Logging::KERNEL, "ComputeNextStakeModifier() : block index not found");
+        return false;
+    }
+
+    if (!GetKernelStakeModifier(index->GetBlockHash(), nStakeModifier))
+    {
+        LogPrint(Logging::KERNEL, "ComputeNextStakeModifier(): GetKernelStakeModifier return false\n");
+        return false;
+    }
+    return true;
+}
+
+bool ComputeNextStakeModifier(const CBlockIndex *pindexPrev, const Coin &coinKernel, uint256 &nStakeModifier)
+{
+    nStakeModifier.SetNull();
+    if (coinKernel.IsSpent())
+        return error("ComputeNextStakeModifier() : INFO: read txPrev failed");
 
-    if (!ReadBlockFromDisk(block, index, pnetMan->getActivePaymentNetwork()->GetConsensus()))
+    const CBlockIndex *index = pindexPrev->GetAncestor(coinKernel.nHeight);
+    if (!index)
     {
-        // unable to read block of previous transaction
-        LogPrint("kernel", "ComputeNextStakeModifier() : read block failed");
+        // unable to find block of previous transaction
+        LogPrint(Logging::KERNEL, "ComputeNextStakeModifier() : block index not found");
         return false;
     }
 
-    if (!GetKernelStakeModifier(block.GetHash(), nStakeModifier))
+    if (!GetKernelStakeModifier(index->GetBlockHash(), nStakeModifier))
     {
-        LogPrint("kernel", "ComputeNextStakeModifier(): GetKernelStakeModifier return false\n");
+        LogPrint(Logging::KERNEL, "ComputeNextStakeModifier(): GetKernelStakeModifier return false\n");
         return false;
     }
     return true;
@@ -168,31 +236,69 @@ bool ComputeNextStakeModifier(const CBlockIndex *pindexPrev, const CTransaction
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
+unsigned int GetStakeReduction(const arith_uint256 &reduction)
+{
+    // Consensus rule: the reduction is 64 minus the number of '0' digits in the 64 character
+    // hex string of the product, which is the number of non zero nibbles in it
+    const uint256 value = ArithToUint256(reduction);
+    unsigned int redux = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t word = ReadLE64(value.begin() + 8 * i);
+        // fold every nibble onto its lowest bit
+        word |= word >> 1;
+        word |= word >> 2;
+        redux += __builtin_popcountll(word & 0x1111111111111111ULL);
+    }
+    return redux;
+}
+
+unsigned int GetStakeKernelTarget(int nHeight)
+{
+    if (nHeight <= 1504350)
+        return 0;
+    return GetNextTargetRequired(pnetMan->getChainActive()->chainActive.Tip(), true);
+}
+
 bool CheckStakeKernelHash(int nHeight,
-    const CBlock &blockFrom,
+    const uint256 &hashBlockFrom,
+    unsigned int nTimeBlockFrom,
     unsigned int nTxPrevOffset,
     const CTransaction &txPrev,
     const COutPoint &prevout,
     unsigned int nTimeTx,
+    unsigned int nTargetBits,
+    uint256 &hashProofOfStake)
+{
+    return CheckStakeKernelHash(nHeight, hashBlockFrom, nTimeBlockFrom, nTxPrevOffset, txPrev.nTime,
+        txPrev.vout[prevout.n].nValue, prevout, nTimeTx, nTargetBits, hashProofOfStake);
+}
+
+bool CheckStakeKernelHash(int nHeight,
+    const uint256 &hashBlockFrom,
+    unsigned int nTimeBlockFrom,
+    unsigned int nTxPrevOffset,
+    unsigned int nTimeTxPrev,
+    CAmount nValueIn,
+    const COutPoint &prevout,
+    unsigned int nTimeTx,
+    unsigned int nTargetBits,
     uint256 &hashProofOfStake)
 {
-    if (nTimeTx < txPrev.nTime) // Transaction timestamp violation
+    if (nTimeTx < nTimeTxPrev) // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
     if (nTimeBlockFrom + pnetMan->getActivePaymentNetwork()->getStakeMinAge() > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation");
 
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-
     // v0.3 protocol kernel hash weight starts from 0 at the min age
     // this change increases active coins participating the hash and helps
     // to secure the network when proof-of-stake difficulty is low
-    int64_t nTimeWeight = ((int64_t)nTimeTx - txPrev.nTime) - pnetMan->getActivePaymentNetwork()->getStakeMinAge();
+    int64_t nTimeWeight = ((int64_t)nTimeTx - nTimeTxPrev) - pnetMan->getActivePaymentNetwork()->getStakeMinAge();
 
     if (nTimeWeight <= 0)
     {
-        LogPrint("kernel", "CheckStakeKernelHash(): ERROR: time weight was somehow <= 0 \n");
+        LogPrint(Logging::KERNEL, "CheckStakeKernelHash(): ERROR: time weight was somehow <= 0 \n");
         return false;
     }
 
@@ -202,15 +308,15 @@ bool CheckStakeKernelHash(int nHeight,
     uint256 nStakeModifier;
     nStakeModifier.SetNull();
 
-    if (!GetKernelStakeModifier(blockFrom.GetHash(), nStakeModifier))
+    if (!GetKernelStakeModifier(hashBlockFrom, nStakeModifier))
     {
-        LogPrint("kernel", ">>> CheckStakeKernelHash: GetKernelStakeModifier return false\n");
+        LogPrint(Logging::KERNEL, ">>> CheckStakeKernelHash: GetKernelStakeModifier return false\n");
         return false;
     }
     // LogPrintf(">>> CheckStakeKernelHash: passed GetKernelStakeModifier\n");
     ss << nStakeModifier;
 
-    ss << nTimeBlockFrom << nTxPrevOffset << txPrev.nTime << prevout.n << nTimeTx;
+    ss << nTimeBlockFrom << nTxPrevOffset << nTimeTxPrev << prevout.n << nTimeTx;
     hashProofOfStake = Hash(ss.begin(), ss.end());
 
     if (nHeight > 1504350)
@@ -231,31 +337,30 @@ bool CheckStakeKernelHash(int nHeight,
         arith_uint256 hashTarget;
         bool fNegative;
         bool fOverflow;
-        hashTarget.SetCompact(
-            GetNextTargetRequired(pnetMan->getChainActive()->chainActive.Tip(), true), &fNegative, &fOverflow);
+        hashTarget.SetCompact(nTargetBits, &fNegative, &fOverflow);
         if (fNegative || hashTarget == 0 || fOverflow ||
             hashTarget > UintToArith256(pnetMan->getActivePaymentNetwork()->GetConsensus().posLimit))
             return error("CheckStakeKernelHash(): nBits below minimum work for proof of stake");
 
-        std::string reductionHex = reduction.GetHex();
-        unsigned int n = std::count(reductionHex.begin(), reductionHex.end(), '0');
-        unsigned int redux = 64 - n; // 64 is max 0's in a 256 bit hex string
-        LogPrint("kernel", "reduction = %u \n", redux);
-        LogPrint("kernel", "pre reduction hashProofOfStake = %s \n", arith_hashProofOfStake.GetHex().c_str());
+        unsigned int redux = GetStakeReduction(reduction);
+        LogPrint(Logging::KERNEL, "reduction = %u \n", redux);
+        LogPrint(Logging::KERNEL, "pre reduction hashProofOfStake = %s \n", arith_hashProofOfStake.GetHex().c_str());
         // before we apply reduction, we want to shift the hash 20 bits to the right. the PoS limit is lead by 20 0's so
         // we want our reduction to apply to a hashproofofstake that is also lead by 20 0's
         arith_hashProofOfStake = arith_hashProofOfStake >> 20;
-        LogPrint("kernel", "mid reduction hashProofOfStake = %s \n", arith_hashProofOfStake.GetHex().c_str());
+        LogPrint(Logging::KERNEL, "mid reduction hashProofOfStake = %s \n", arith_hashProofOfStake.GetHex().c_str());
         arith_hashProofOfStake = arith_hashProofOfStake >> redux;
-        LogPrint("kernel", "post reduction hashProofOfStake = %s \n", arith_hashProofOfStake.GetHex().c_str());
+        LogPrint(Logging::KERNEL, "post reduction hashProofOfStake = %s \n", arith_hashProofOfStake.GetHex().c_str());
         // Now check if proof-of-stake hash meets target protocol
-        if (arith_hashProofOfStake > hashTarget)
+        const bool fMeetsTarget = arith_hashProofOfStake <= hashTarget;
+        TRACE5(kernel, stake_kernel_check, prevout.hash.begin(), prevout.n, nTimeTx, nValueIn, fMeetsTarget);
+        if (!fMeetsTarget)
         {
-            LogPrint("kernel", "CheckStakeKernelHash(): ERROR: hashProofOfStake %s > %s hashTarget\n",
+            LogPrint(Logging::KERNEL, "CheckStakeKernelHash(): ERROR: hashProofOfStake %s > %s hashTarget\n",
                 arith_hashProofOfStake.GetHex().c_str(), hashTarget.GetHex().c_str());
             return false;
         }
-        LogPrint("kernel", "CheckStakeKernelHash(): SUCCESS: hashProofOfStake %s < %s hashTarget\n",
+        LogPrint(Logging::KERNEL, "CheckStakeKernelHash(): SUCCESS: hashProofOfStake %s < %s hashTarget\n",
             arith_hashProofOfStake.GetHex().c_str(), hashTarget.GetHex().c_str());
     }
 
@@ -263,40 +368,46 @@ bool CheckStakeKernelHash(int nHeight,
 }
 
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(int nHeight, const CTransaction &tx, uint256 &hashProofOfStake)
+bool CheckProofOfStake(const CBlockIndex *pindex,
+    const CTransaction &tx,
+    const Coin &coinPrev,
+    uint256 &hashProofOfStake)
 {
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
 
     // Kernel (input 0) must match the stake hash target per coin age (nBits)
     const CTxIn &txin = tx.vin[0];
+    const int nHeight = pindex->nHeight;
 
-    // First try finding the previous transaction in database
-    CTransaction txPrev;
-    uint256 blockHashOfTx;
-    if (!GetTransaction(txin.prevout.hash, txPrev, pnetMan->getActivePaymentNetwork()->GetConsensus(), blockHashOfTx))
+    // The output staked, as it was in the coins view before the block spent it
+    if (coinPrev.IsSpent())
         // previous transaction not in main chain, may occur during initial download
         return error("CheckProofOfStake() : INFO: read txPrev failed");
     // Verify signature
-    if (!VerifySignature(txPrev, tx, 0, true))
+    if (!VerifyScript(txin.scriptSig, coinPrev.out.scriptPubKey, tx, 0, true))
         return error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString().c_str());
 
-    // Read block header
-    CBlock block;
-    CBlockIndex *index = pnetMan->getChainActive()->LookupBlockIndex(blockHashOfTx);
-
-    if (!ReadBlockFromDisk(block, index, pnetMan->getActivePaymentNetwork()->GetConsensus()))
+    // The coin is from a block of the chain the block extends, the block itself may have been pruned
+    const CBlockIndex *index = pindex->pprev ? pindex->pprev->GetAncestor(coinPrev.nHeight) : nullptr;
+    if (!index)
     {
-        LogPrint("kernel", "CheckProofOfStake() : read block failed");
+        LogPrint(Logging::KERNEL, "CheckProofOfStake() : block index not found");
         return false;
     }
 
+    // Only the offset of the transaction in its block is needed from the tx index, not the transaction. One
+    // missing from the index is hashed with an offset of zero, as it always was, not rejected
     CDiskTxPos txindex;
-    pnetMan->getChainActive()->pblocktree->ReadTxIndex(txPrev.GetHash(), txindex);
+    if (!pnetMan->getChainActive()->pblocktree->ReadTxIndex(txin.prevout.hash, txindex))
+        LogPrint(Logging::KERNEL, "CheckProofOfStake() : tx index of txPrev %s not found\n",
+            txin.prevout.hash.ToString());
+    const unsigned int nTimeTxPrev = coinPrev.nTime;
+    const unsigned int nTargetBits = GetStakeKernelTarget(nHeight);
     if (nHeight < 1505775)
     {
-        if (!CheckStakeKernelHash(
-                nHeight, block, txindex.nTxOffset + 80, txPrev, txin.prevout, tx.nTime, hashProofOfStake))
+        if (!CheckStakeKernelHash(nHeight, index->GetBlockHash(), index->GetBlockTime(), txindex.nTxOffset + 80,
+                nTimeTxPrev, coinPrev.out.nValue, txin.prevout, tx.nTime, nTargetBits, hashProofOfStake))
         {
             // may occur during initial download or if behind on block chain sync
             return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s",
@@ -305,7 +416,8 @@ bool CheckProofOfStake(int nHeight, const CTransaction &tx, uint256 &hashProofOf
     }
     else
     {
-        if (!CheckStakeKernelHash(nHeight, block, txindex.nTxOffset, txPrev, txin.prevout, tx.nTime, hashProofOfStake))
+        if (!CheckStakeKernelHash(nHeight, index->GetBlockHash(), index->GetBlockTime(), txindex.nTxOffset,
+                nTimeTxPrev, coinPrev.out.nValue, txin.prevout, tx.nTime, nTargetBits, hashProofOfStake))
         {
             // may occur during initial download or if behind on block chain sync
             return error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s",
@@ -22,20 +22,53 @@
 
 #include "main.h"
 
+// Forget the cached kernel stake modifiers, called whenever the active chain tip changes
+void ClearStakeModifierCache();
+
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex *pindexPrev, const CTransaction &tx, uint256 &nStakeModifier);
+// The same for a proof-of-stake block on pindexPrev whose coinstake spends coinKernel, without looking up
+// the transaction of the coin
+bool ComputeNextStakeModifier(const CBlockIndex *pindexPrev, const Coin &coinKernel, uint256 &nStakeModifier);
+
+// Number of bits the proof of stake hash is shifted right by for a given coin age weight
+// (seconds past the min age times the value staked). Matches counting the digits that are
+// not '0' in reduction.GetHex()
+unsigned int GetStakeReduction(const arith_uint256 &reduction);
+
+// Compact target a kernel at nHeight is checked against, computed from the current tip.
+// Only used after the reduction fork, returns 0 for earlier heights
+unsigned int GetStakeKernelTarget(int nHeight);
 
-// Check whether stake kernel meets hash target
+// Check whether stake kernel meets hash target, nTargetBits comes from GetStakeKernelTarget
+// so callers checking many kernels against the same tip only compute it once
 // Sets hashProofOfStake on success return
 bool CheckStakeKernelHash(int nHeight,
-    const CBlock &blockFrom,
+    const uint256 &hashBlockFrom,
+    unsigned int nTimeBlockFrom,
     unsigned int nTxPrevOffset,
     const CTransaction &txPrev,
     const COutPoint &prevout,
     unsigned int nTimeTx,
+    unsigned int nTargetBits,
+    uint256 &hashProofOfStake);
+// The same with the time and the value of the output staked given, as the coins view has them
+bool CheckStakeKernelHash(int nHeight,
+    const uint256 &hashBlockFrom,
+    unsigned int nTimeBlockFrom,
+    unsigned int nTxPrevOffset,
+    unsigned int nTimeTxPrev,
+    CAmount nValueIn,
+    const COutPoint &prevout,
+    unsigned int nTimeTx,
+    unsigned int nTargetBits,
     uint256 &hashProofOfStake);
 
-// Check kernel hash target and coinstake signature
+// Check kernel hash target and coinstake signature of the block pindex, coinPrev is the coin the
+// coinstake spends as its kernel, from the view before the block. Reads no block from disk
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(int nHeight, const CTransaction &tx, uint256 &hashProofOfStake);
+bool CheckProofOfStake(const CBlockIndex *pindex,
+    const CTransaction &tx,
+    const Coin &coinPrev,
+    uint256 &hashProofOfStake);
 #endif // PPCOIN_KERNEL_H
@@ -22,10 +22,71 @@
 
 #include "key.h"
 #include "pubkey.h"
+#include "random.h"
 #include "util/logger.h"
 #include "util/util.h"
 
+#include <limits>
+
 bool CKeyStore::AddKey(const CKey &key) { return AddKeyPubKey(key, key.GetPubKey()); }
+
+CScriptPrefilter::CScriptPrefilter()
+    : filter(INITIAL_CAPACITY, FALSE_POSITIVE_RATE, GetRand(std::numeric_limits<unsigned int>::max()), BLOOM_UPDATE_NONE),
+      nCapacity(INITIAL_CAPACITY)
+{
+}
+
+void CScriptPrefilter::Insert(const std::vector<unsigned char> &vch)
+{
+    vElements.push_back(vch);
+    if (vElements.size() <= nCapacity)
+    {
+        filter.insert(vch);
+        return;
+    }
+    // the filter is limited to MAX_BLOOM_FILTER_SIZE, past that the false positive rate of a bigger wallet grows
+    nCapacity *= 2;
+    filter = CBloomFilter(nCapacity, FALSE_POSITIVE_RATE, GetRand(std::numeric_limits<unsigned int>::max()), BLOOM_UPDATE_NONE);
+    for (const std::vector<unsigned char> &element : vElements)
+    {
+        filter.insert(element);
+    }
+}
+
+void CScriptPrefilter::AddPubKey(const CPubKey &pubkey)
+{
+    // pay to pubkey and multisig scripts push the key, pay to pubkey hash scripts its ID
+    Insert(std::vector<unsigned char>(pubkey.begin(), pubkey.end()));
+    const CKeyID keyID = pubkey.GetID();
+    Insert(std::vector<unsigned char>(keyID.begin(), keyID.end()));
+}
+
+void CScriptPrefilter::AddRedeemScript(const CScript &redeemScript)
+{
+    const CScriptID scriptID(redeemScript);
+    Insert(std::vector<unsigned char>(scriptID.begin(), scriptID.end()));
+}
+
+void CScriptPrefilter::AddWatchOnly(const CScript &dest) { Insert(std::vector<unsigned char>(dest.begin(), dest.end())); }
+
+bool CScriptPrefilter::MightMatch(const CScript &scriptPubKey) const
+{
+    // watch-only scripts match as a whole
+    if (filter.contains(std::vector<unsigned char>(scriptPubKey.begin(), scriptPubKey.end())))
+        return true;
+    // keys, key IDs and script IDs are pushed by the scripts Solver recognizes, a script it can not parse is only
+    // ours if it is watch-only
+    CScript::const_iterator pc = scriptPubKey.begin();
+    opcodetype opcode;
+    std::vector<unsigned char> vch;
+    while (scriptPubKey.GetOp(pc, opcode, vch))
+    {
+        if ((vch.size() == 20 || vch.size() == 33 || vch.size() == 65) && filter.contains(vch))
+            return true;
+    }
+    return false;
+}
+
 bool CBasicKeyStore::GetPubKey(const CKeyID &address, CPubKey &vchPubKeyOut) const
 {
     CKey key;
@@ -47,6 +108,7 @@ bool CBasicKeyStore::AddKeyPubKey(const CKey &key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    prefilter.AddPubKey(pubkey);
     return true;
 }
 
@@ -57,6 +119,7 @@ bool CBasicKeyStore::AddCScript(const CScript &redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[CScriptID(redeemScript)] = redeemScript;
+    prefilter.AddRedeemScript(redeemScript);
     return true;
 }
 
@@ -98,6 +161,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    prefilter.AddWatchOnly(dest);
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey))
         mapWatchKeys[pubKey.GetID()] = pubKey;
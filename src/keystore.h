@@ -21,6 +21,7 @@
 #ifndef BITCOIN_KEYSTORE_H
 #define BITCOIN_KEYSTORE_H
 
+#include "bloom.h"
 #include "key.h"
 #include "pubkey.h"
 #include "script/script.h"
@@ -58,6 +59,35 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest) = 0;
     virtual bool HaveWatchOnly(const CScript &dest) const = 0;
     virtual bool HaveWatchOnly() const = 0;
+
+    //! False if IsMine() is certain to find nothing in the script, without running the Solver
+    virtual bool MightBeMine(const CScript &scriptPubKey) const { return true; }
+};
+
+/**
+ * A bloom filter over what IsMine() can recognize in an output script: the public keys of the key store and their
+ * IDs, the IDs of its redeem scripts and its watch-only scripts. It has false positives but no false negatives, most
+ * outputs that are not ours are rejected by checking the data pushes of the script against it.
+ */
+class CScriptPrefilter
+{
+private:
+    static const size_t INITIAL_CAPACITY = 1000;
+    static constexpr double FALSE_POSITIVE_RATE = 0.001;
+    CBloomFilter filter;
+    size_t nCapacity;
+    //! everything inserted so far, to fill a larger filter once the capacity is exceeded
+    std::vector<std::vector<unsigned char> > vElements;
+
+    void Insert(const std::vector<unsigned char> &vch);
+
+public:
+    CScriptPrefilter();
+
+    void AddPubKey(const CPubKey &pubkey);
+    void AddRedeemScript(const CScript &redeemScript);
+    void AddWatchOnly(const CScript &dest);
+    bool MightMatch(const CScript &scriptPubKey) const;
 };
 
 typedef std::map<CKeyID, CKey> KeyMap;
@@ -73,6 +103,8 @@ protected:
     WatchKeyMap mapWatchKeys;
     ScriptMap mapScripts;
     WatchOnlySet setWatchOnly;
+    //! what is in the maps above, removed watch-only scripts stay in it
+    CScriptPrefilter prefilter;
 
 public:
     bool AddKeyPubKey(const CKey &key, const CPubKey &pubkey);
@@ -120,6 +152,12 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest);
     virtual bool HaveWatchOnly(const CScript &dest) const;
     virtual bool HaveWatchOnly() const;
+
+    virtual bool MightBeMine(const CScript &scriptPubKey) const
+    {
+        LOCK(cs_KeyStore);
+        return prefilter.MightMatch(scriptPubKey);
+    }
 };
 
 typedef std::vector<unsigned char, secure_allocator<unsigned char> > CKeyingMaterial;
@@ -0,0 +1,156 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_LRUCACHE_H
+#define ECCOIN_LRUCACHE_H
+
+#include <assert.h>
+#include <functional>
+#include <list>
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+
+/** Weighs every entry as one, the bound of the cache is then a number of entries */
+struct CLRUCountWeigher
+{
+    template <typename K, typename V>
+    size_t operator()(const K &, const V &) const
+    {
+        return 1;
+    }
+};
+
+/** A bounded map that drops the least recently used entries. The entries are in a list ordered by their last use
+ *  and a hash table points into it, so a lookup, an insert and an erase are a hash lookup and a splice each. The
+ *  bound is on the sum of the weights of the entries, Weigher gives the weight of an entry when it is put in: bytes
+ *  for caches of blocks, or one per entry with CLRUCountWeigher. Lookups with Get count as hits and misses.
+ *  Not thread safe, the callers lock around it.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>, typename Weigher = CLRUCountWeigher>
+class CLRUCache
+{
+public:
+    struct Entry
+    {
+        K key;
+        V value;
+        size_t nWeight;
+    };
+    typedef typename std::list<Entry>::const_iterator const_iterator;
+
+private:
+    //! most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<K, typename std::list<Entry>::iterator, Hash> index;
+    Weigher weigher;
+    size_t nWeight;
+    size_t nMaxWeight;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    //! Drop the least recently used entries until the bound holds, the most recent one always stays
+    void Trim()
+    {
+        while (nWeight > nMaxWeight && entries.size() > 1)
+        {
+            nWeight -= entries.back().nWeight;
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+public:
+    explicit CLRUCache(size_t nMaxWeightIn, const Hash &hasher = Hash(), const Weigher &weigherIn = Weigher())
+        : index(0, hasher), weigher(weigherIn), nWeight(0), nMaxWeight(nMaxWeightIn), nHits(0), nMisses(0)
+    {
+        assert(nMaxWeightIn > 0);
+    }
+
+    /** The value of key, marked as used most recently, or null if it is not cached */
+    V *Get(const K &key)
+    {
+        auto it = index.find(key);
+        if (it == index.end())
+        {
+            nMisses++;
+            return nullptr;
+        }
+        nHits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return &it->second->value;
+    }
+
+    /** The value of key without marking it as used or counting the lookup */
+    const V *Peek(const K &key) const
+    {
+        auto it = index.find(key);
+        return it == index.end() ? nullptr : &it->second->value;
+    }
+
+    bool Contains(const K &key) const { return index.count(key) != 0; }
+    /** Cache value under key, or replace the value cached there, as the most recently used entry. The least
+     *  recently used entries are dropped to keep the bound. Returns the cached value.
+     */
+    V &Put(const K &key, V value)
+    {
+        const size_t nNewWeight = weigher(key, value);
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            nWeight -= it->second->nWeight;
+            it->second->value = std::move(value);
+            it->second->nWeight = nNewWeight;
+            entries.splice(entries.begin(), entries, it->second);
+        }
+        else
+        {
+            entries.push_front(Entry{key, std::move(value), nNewWeight});
+            index.emplace(key, entries.begin());
+        }
+        nWeight += nNewWeight;
+        Trim();
+        return entries.front().value;
+    }
+
+    bool Erase(const K &key)
+    {
+        auto it = index.find(key);
+        if (it == index.end())
+        {
+            return false;
+        }
+        nWeight -= it->second->nWeight;
+        entries.erase(it->second);
+        index.erase(it);
+        return true;
+    }
+
+    //! Drop all entries, the hit and miss counts stay
+    void Clear()
+    {
+        entries.clear();
+        index.clear();
+        nWeight = 0;
+    }
+
+    //! most recently used first
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    size_t Weight() const { return nWeight; }
+    size_t MaxWeight() const { return nMaxWeight; }
+    void SetMaxWeight(size_t nMaxWeightIn)
+    {
+        assert(nMaxWeightIn > 0);
+        nMaxWeight = nMaxWeightIn;
+        Trim();
+    }
+    uint64_t Hits() const { return nHits; }
+    uint64_t Misses() const { return nMisses; }
+};
+
+#endif // ECCOIN_LRUCACHE_H
@@ -22,6 +22,9 @@
 
 #include "args.h"
 #include "arith_uint256.h"
+#include "blockcompress.h"
+#include "blockfilemap.h"
+#include "blockwriter.h"
 #include "chain/chain.h"
 #include "chain/checkpoints.h"
 #include "checkqueue.h"
@@ -29,6 +32,8 @@
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "crypto/hash.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "init.h"
 #include "kernel.h"
 #include "merkleblock.h"
@@ -51,6 +56,7 @@
 #include "txmempool.h"
 
 #include "undo.h"
+#include "util/trace.h"
 #include "util/util.h"
 #include "util/utilmoneystr.h"
 #include "util/utilstrencodings.h"
@@ -82,11 +88,19 @@ CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
+bool fHavePruned = false;
+bool fPruneMode = false;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
+uint64_t nPruneTarget = 0;
+bool fCheckForPruning = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 unsigned int nBytesPerSigOp = DEFAULT_BYTES_PER_SIGOP;
 bool fCheckBlockIndex = false;
+int64_t nCheckBlockIndexInterval = DEFAULT_CHECKBLOCKINDEX_INTERVAL;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+uint256 hashAssumeValid;
 size_t nCoinCacheUsage = 5000 * 300;
 
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying, mining and transaction creation) */
@@ -95,10 +109,6 @@ CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 CTxMemPool mempool(::minRelayTxFee);
 
 
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-;
-std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
-;
 
 
 /**
@@ -423,6 +433,9 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints *lp, bool
 
 unsigned int GetLegacySigOpCount(const CTransaction &tx)
 {
+    const int32_t nCached = tx.GetCachedLegacySigOpCount();
+    if (nCached >= 0)
+        return nCached;
     unsigned int nSigOps = 0;
     for (auto const &txin : tx.vin)
     {
@@ -432,6 +445,7 @@ unsigned int GetLegacySigOpCount(const CTransaction &tx)
     {
         nSigOps += txout.scriptPubKey.GetSigOpCount(false);
     }
+    tx.SetCachedLegacySigOpCount(nSigOps);
     return nSigOps;
 }
 
@@ -439,16 +453,25 @@ unsigned int GetP2SHSigOpCount(const CTransaction &tx, const CCoinsViewCache &in
 {
     if (tx.IsCoinBase())
         return 0;
+    const int32_t nCached = tx.GetCachedP2SHSigOpCount();
+    if (nCached >= 0)
+        return nCached;
 
     unsigned int nSigOps = 0;
+    bool fHaveInputs = true;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        const CTxOut &prevout = inputs.AccessCoin(tx.vin[i].prevout).out;
+        const Coin &coin = inputs.AccessCoin(tx.vin[i].prevout);
+        fHaveInputs &= !coin.IsSpent();
+        const CTxOut &prevout = coin.out;
         if (prevout.scriptPubKey.IsPayToScriptHash())
         {
             nSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
         }
     }
+    // the outpoints fix the scripts spent, so the count holds for any view that has them
+    if (fHaveInputs)
+        tx.SetCachedP2SHSigOpCount(nSigOps);
     return nSigOps;
 }
 
@@ -461,7 +484,7 @@ void LimitMempoolSize(CTxMemPool &pool, size_t limit, unsigned long age)
         pnetMan->getChainActive()->pcoinsTip->Uncache(txin);
     }
     if (expired != 0)
-        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+        LogPrint(Logging::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
 
     std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
@@ -478,18 +501,52 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetDebugMessage().empty() ? "" : ", " + state.GetDebugMessage(), state.GetRejectCode());
 }
 
-bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
-    CValidationState &state,
-    const CTransactionRef &ptx,
-    bool fLimitFree,
-    bool *pfMissingInputs,
-    bool fOverrideMempoolLimit,
-    bool fRejectAbsurdFee,
-    std::vector<COutPoint> &vCoinsToUncache)
+namespace
 {
-    const CTransaction &tx = *ptx;
-    AssertLockHeld(cs_main);
+/** What the locked preparation of a mempool candidate hands on to its script checks and its commit */
+struct CMempoolCandidate
+{
+    CCoinsView dummy;
+    //! Every coin the transaction spends, detached from the chain and the pool once prepared
+    CCoinsViewCache view;
+    CTxMemPoolEntry entry;
+    //! The tip the contextual checks ran against
+    const CBlockIndex *pindexPrepared;
+    //! Script flags a block on top of pindexPrepared is checked with, what the script execution cache is filled for
+    unsigned int nBlockScriptFlags;
+    //! The MempoolAcceptStage the preparation reached, the one a rejection is counted for
+    int nStage;
+
+    CMempoolCandidate() : view(&dummy), pindexPrepared(nullptr), nBlockScriptFlags(0), nStage(MEMPOOLSTAGE_POOL) {}
+};
+} // anon namespace
+
+static CCriticalSection cs_mempoolRejects;
+static CMempoolRejectStats mempoolRejects;
+
+const char *MempoolAcceptStageName(int nStage)
+{
+    static const char *const names[MEMPOOLSTAGE_COUNT] = {"check", "pool", "fee", "inputs", "scripts", "commit"};
+    return nStage >= 0 && nStage < MEMPOOLSTAGE_COUNT ? names[nStage] : "unknown";
+}
+
+CMempoolRejectStats GetMempoolRejectStats()
+{
+    LOCK(cs_mempoolRejects);
+    return mempoolRejects;
+}
 
+/** Count a transaction the stage nStage turned away, a missing input as one reason of its own */
+static void CountMempoolReject(int nStage, const CValidationState &state, bool fMissingInputs)
+{
+    const std::string strReason = fMissingInputs ? "missing-inputs" : state.GetRejectReason();
+    LOCK(cs_mempoolRejects);
+    mempoolRejects.vReasons[nStage][strReason.empty() ? "unknown" : strReason]++;
+}
+
+/** Checks of a mempool candidate that need neither the chain nor the pool, and so no lock */
+static bool CheckMempoolCandidate(const CTransaction &tx, CValidationState &state)
+{
     if (!CheckTransaction(tx, state))
     {
         return false;
@@ -508,6 +565,47 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
         return state.DoS(0, false, REJECT_NONSTANDARD, reason);
     }
 
+    // The sigops of the transaction alone are a part of the ones checked again once the inputs are known, too
+    // many of them already reject it without fetching a coin
+    const unsigned int nSigOps = GetLegacySigOpCount(tx);
+    const unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    if ((nSigOps > MAX_STANDARD_TX_SIGOPS) || (nBytesPerSigOp && nSigOps > nSize / nBytesPerSigOp))
+    {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false, strprintf("%d", nSigOps));
+    }
+    return true;
+}
+
+/**
+ * Contextual checks of a transaction against the chain and the pool: inputs, sequence locks, standardness
+ * of the inputs, fees and free relay limiting. Fills in candidate.view with the coins the transaction spends
+ * so its scripts can be checked without any lock held. fRetry is set when the chain moved after an earlier
+ * preparation of the same transaction.
+ *
+ * The checks run cheapest first and candidate.nStage follows them: those against the pool without a coin, the
+ * coin fetch with the fee against the pool minimum right after it, and then everything else about the inputs.
+ */
+static bool PrepareMempoolCandidate(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransactionRef &ptx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    int64_t nAcceptTime,
+    bool fRejectAbsurdFee,
+    bool fRetry,
+    std::vector<COutPoint> &vCoinsToUncache,
+    CMempoolCandidate &candidate)
+{
+    AssertLockHeld(cs_main);
+    const CTransaction &tx = *ptx;
+    const uint256 hash = tx.GetHash();
+    CCoinsView &dummy = candidate.dummy;
+    CCoinsViewCache &view = candidate.view;
+    CTxMemPoolEntry &entry = candidate.entry;
+    candidate.pindexPrepared = pnetMan->getChainActive()->chainActive.Tip();
+    candidate.nBlockScriptFlags = GetBlockScriptFlags(CBlockHeader::CURRENT_VERSION, candidate.pindexPrepared,
+        pnetMan->getActivePaymentNetwork()->GetConsensus());
+
     // Only accept nLockTime-using transactions that can be mined in the next
     // block; we don't want our mempool filled up with transactions that can't
     // be mined yet.
@@ -516,8 +614,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
         return state.DoS(0, false, REJECT_NONSTANDARD, "non-final");
     }
 
+    candidate.nStage = MEMPOOLSTAGE_POOL;
     // is it already in the memory pool?
-    uint256 hash = tx.GetHash();
     if (pool.exists(hash))
     {
         return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-in-mempool");
@@ -537,301 +635,873 @@ bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
         }
     }
 
+    // The pool minimum only needs the size, so it is at hand the moment the fee is
+    const unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    const size_t nMaxMempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    candidate.nStage = MEMPOOLSTAGE_FEE;
+
+    CAmount nValueIn = 0;
+    CAmount nFees = 0;
+    // nModifiedFees includes any fee deltas from PrioritiseTransaction
+    CAmount nModifiedFees = 0;
+    LockPoints lp;
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
+        WRITELOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pnetMan->getChainActive()->pcoinsTip.get(), pool);
+        view.SetBackend(viewMemPool);
 
-        CAmount nValueIn = 0;
-        LockPoints lp;
+        // do all inputs exist?
+        if (pfMissingInputs)
         {
-            WRITELOCK(pool.cs);
-            CCoinsViewMemPool viewMemPool(pnetMan->getChainActive()->pcoinsTip.get(), pool);
-            view.SetBackend(viewMemPool);
-
-            // do all inputs exist?
-            if (pfMissingInputs)
+            *pfMissingInputs = false;
+            BOOST_FOREACH (const CTxIn txin, tx.vin)
             {
-                *pfMissingInputs = false;
-                BOOST_FOREACH (const CTxIn txin, tx.vin)
+                // At this point we begin to collect coins that are potential candidates for uncaching because as
+                // soon as we make the call below to view.HaveCoin() any missing coins will be pulled into cache.
+                // Therefore, any coin in this transaction that is not already in cache will be tracked here such
+                // that if this transaction fails to enter the memory pool, we will then uncache those coins that
+                // were not already present, unless the transaction is an orphan.
+                //
+                // We still want to keep orphantx coins in the event the orphantx is finally accepted into the
+                // mempool or shows up in a block that is mined.  Therefore if pfMissingInputs returns true then
+                // any coins in vCoinsToUncache will NOT be uncached.
+                if (!pnetMan->getChainActive()->pcoinsTip->HaveCoinInCache(txin.prevout))
                 {
-                    // At this point we begin to collect coins that are potential candidates for uncaching because as
-                    // soon as we make the call below to view.HaveCoin() any missing coins will be pulled into cache.
-                    // Therefore, any coin in this transaction that is not already in cache will be tracked here such
-                    // that if this transaction fails to enter the memory pool, we will then uncache those coins that
-                    // were not already present, unless the transaction is an orphan.
-                    //
-                    // We still want to keep orphantx coins in the event the orphantx is finally accepted into the
-                    // mempool or shows up in a block that is mined.  Therefore if pfMissingInputs returns true then
-                    // any coins in vCoinsToUncache will NOT be uncached.
-                    if (!pnetMan->getChainActive()->pcoinsTip->HaveCoinInCache(txin.prevout))
-                    {
-                        vCoinsToUncache.push_back(txin.prevout);
-                    }
-
-                    if (!view.HaveCoin(txin.prevout))
-                    {
-                        // fMissingInputs and not state.IsInvalid() is used to detect this condition, don't set
-                        // state.Invalid()
-                        *pfMissingInputs = true;
-                    }
+                    vCoinsToUncache.push_back(txin.prevout);
+                }
+
+                if (!view.HaveCoin(txin.prevout))
+                {
+                    // fMissingInputs and not state.IsInvalid() is used to detect this condition, don't set
+                    // state.Invalid()
+                    *pfMissingInputs = true;
                 }
-                if (*pfMissingInputs == true)
-                    return false;
             }
+            if (*pfMissingInputs == true)
+                return false;
+        }
 
-            // Bring the best block into scope
-            view.GetBestBlock();
+        // Bring the best block into scope
+        view.GetBestBlock();
 
-            nValueIn = view.GetValueIn(tx);
+        nValueIn = view.GetValueIn(tx);
 
-            // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
-            view.SetBackend(dummy);
+        // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
+        view.SetBackend(dummy);
 
-            // Only accept BIP68 sequence locked transactions that can be mined in the next
-            // block; we don't want our mempool filled up with transactions that can't
-            // be mined yet.
-            // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-            // CoinsViewCache instead of create its own
-            if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
-            {
-                return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
-            }
+        // A flood of low fee transactions into a full pool stops here, before the rest of the input checks
+        nFees = nValueIn - tx.GetValueOut();
+        nModifiedFees = nFees;
+        double nPriorityDummy = 0;
+        pool._ApplyDeltas(hash, nPriorityDummy, nModifiedFees);
+        CAmount mempoolRejectFee = pool._GetMinFee(nMaxMempool).GetFee(nSize);
+        if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
+        {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false,
+                strprintf("%d < %d", nFees, mempoolRejectFee));
+        }
+        candidate.nStage = MEMPOOLSTAGE_INPUTS;
+
+        // Only accept BIP68 sequence locked transactions that can be mined in the next
+        // block; we don't want our mempool filled up with transactions that can't
+        // be mined yet.
+        // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
+        // CoinsViewCache instead of create its own
+        if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+        {
+            return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
         }
+    }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (fRequireStandard && !AreInputsStandard(tx, view))
+    // Check for non-standard pay-to-script-hash in inputs
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+    {
+        return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+    }
+
+    unsigned int nSigOps = GetLegacySigOpCount(tx);
+    nSigOps += GetP2SHSigOpCount(tx, view);
+
+    CAmount inChainInputValue;
+    double dPriority = view.GetPriority(tx, pnetMan->getChainActive()->chainActive.Height(), inChainInputValue);
+
+    // Keep track of transactions that spend a coinbase, which we re-scan
+    // during reorgs to ensure COINBASE_MATURITY is still met.
+    bool fSpendsCoinbase = false;
+    for (auto const &txin : tx.vin)
+    {
+        const Coin coin = view.AccessCoin(txin.prevout);
+        if (coin.IsCoinBase())
         {
-            return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+            fSpendsCoinbase = true;
+            break;
         }
+    }
 
-        unsigned int nSigOps = GetLegacySigOpCount(tx);
-        nSigOps += GetP2SHSigOpCount(tx, view);
+    entry = CTxMemPoolEntry(ptx, nFees, nAcceptTime, dPriority, pnetMan->getChainActive()->chainActive.Height(),
+        pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
 
-        CAmount nValueOut = tx.GetValueOut();
-        CAmount nFees = nValueIn - nValueOut;
-        // nModifiedFees includes any fee deltas from PrioritiseTransaction
-        CAmount nModifiedFees = nFees;
-        double nPriorityDummy = 0;
-        pool.ApplyDeltas(hash, nPriorityDummy, nModifiedFees);
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
+    // merely non-standard transaction.
+    if ((nSigOps > MAX_STANDARD_TX_SIGOPS) || (nBytesPerSigOp && nSigOps > nSize / nBytesPerSigOp))
+    {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false, strprintf("%d", nSigOps));
+    }
 
-        CAmount inChainInputValue;
-        double dPriority = view.GetPriority(tx, pnetMan->getChainActive()->chainActive.Height(), inChainInputValue);
+    // Continuously rate-limit free (really, very-low-fee) transactions
+    // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
+    // be annoying or make others' transactions take longer to confirm.
+    static const double maxFeeCutoff =
+        boost::lexical_cast<double>(gArgs.GetArg("-maxlimitertxfee", DEFAULT_MAXLIMITERTXFEE));
+    // starting value for feeCutoff in satoshi per byte
+    static const double initFeeCutoff =
+        boost::lexical_cast<double>(gArgs.GetArg("-minlimitertxfee", DEFAULT_MINLIMITERTXFEE));
+    static const int nLimitFreeRelay = gArgs.GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY);
 
-        // Keep track of transactions that spend a coinbase, which we re-scan
-        // during reorgs to ensure COINBASE_MATURITY is still met.
-        bool fSpendsCoinbase = false;
-        for (auto const &txin : tx.vin)
+    // get current memory pool size
+    uint64_t poolBytes = pool.GetTotalTxSize();
+
+    // Calculate feeCutoff in satoshis per byte:
+    //   When the feeCutoff is larger than the satoshiPerByte of the
+    //   current transaction then spam blocking will be in effect. However
+    //   Some free transactions will still get through based on -limitfreerelay
+    static double feeCutoff = initFeeCutoff;
+    static double nFreeLimit = nLimitFreeRelay;
+    static int64_t nLastTime = GetTime();
+
+    int64_t nNow = GetTime();
+
+    // When the mempool starts falling use an exponentially decaying ~24 hour window:
+    // nFreeLimit = nFreeLimit + ((double)(DEFAULT_LIMIT_FREE_RELAY - nFreeLimit) / pow(1.0 - 1.0/86400,
+    // (double)(nNow - nLastTime)));
+    nFreeLimit /= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
+
+    // When the mempool starts falling use an exponentially decaying ~24 hour window:
+    feeCutoff *= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
+
+    uint64_t nLargestBlockSeen = MAX_BLOCK_SIZE;
+    if (poolBytes < nLargestBlockSeen)
+    {
+        feeCutoff = std::max(feeCutoff, initFeeCutoff);
+        nFreeLimit = std::min(nFreeLimit, (double)nLimitFreeRelay);
+    }
+    else if (poolBytes < (nLargestBlockSeen * MAX_BLOCK_SIZE_MULTIPLIER))
+    {
+        // Gradually choke off what is considered a free transaction
+        feeCutoff =
+            std::max(feeCutoff, initFeeCutoff + ((maxFeeCutoff - initFeeCutoff) * (poolBytes - nLargestBlockSeen) /
+                                                    (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1))));
+
+        // Gradually choke off the nFreeLimit as well but leave at least DEFAULT_MIN_LIMITFREERELAY
+        // So that some free transactions can still get through
+        nFreeLimit = std::min(
+            nFreeLimit, ((double)nLimitFreeRelay - ((double)(nLimitFreeRelay - DEFAULT_MIN_LIMITFREERELAY) *
+                                                       (double)(poolBytes - nLargestBlockSeen) /
+                                                       (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1)))));
+        if (nFreeLimit < DEFAULT_MIN_LIMITFREERELAY)
+            nFreeLimit = DEFAULT_MIN_LIMITFREERELAY;
+    }
+    else
+    {
+        feeCutoff = maxFeeCutoff;
+        nFreeLimit = DEFAULT_MIN_LIMITFREERELAY;
+    }
+    minRelayTxFee = CFeeRate(feeCutoff * 1000);
+    LogPrint(Logging::MEMPOOL,
+        "MempoolBytes:%d  LimitFreeRelay:%.5g  FeeCutOff:%.4g  FeesSatoshiPerByte:%.4g  TxBytes:%d  TxFees:%d\n",
+        poolBytes, nFreeLimit, ((double)::minRelayTxFee.GetFee(nSize)) / nSize, ((double)nFees) / nSize, nSize,
+        nFees);
+    // A retry after the tip moved was already charged on the first attempt
+    if (fLimitFree && !fRetry && nModifiedFees < ::minRelayTxFee.GetFee(nSize))
+    {
+        static double dFreeCount;
+
+        // Use an exponentially decaying ~10-minute window:
+        dFreeCount *= pow(1.0 - 1.0 / 600.0, (double)(nNow - nLastTime));
+        nLastTime = nNow;
+        // -limitfreerelay unit is thousand-bytes-per-minute
+        // At default rate it would take over a month to fill 1GB
+        if (dFreeCount >= gArgs.GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000)
         {
-            const Coin coin = view.AccessCoin(txin.prevout);
-            if (coin.IsCoinBase())
-            {
-                fSpendsCoinbase = true;
-                break;
-            }
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
         }
+        LogPrint(Logging::MEMPOOL, "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount + nSize);
+        dFreeCount += nSize;
+    }
 
-        CTxMemPoolEntry entry(ptx, nFees, GetTime(), dPriority, pnetMan->getChainActive()->chainActive.Height(),
-            pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
-        unsigned int nSize = entry.GetTxSize();
+    if (fRejectAbsurdFee && tx.nVersion == 1 && nFees > maxTxFee)
+    {
+        LogPrintf("Absurdly-high-fee of %d for tx with version of 1 \n", nFees);
+        return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee",
+            strprintf("%d > %d", nFees, ::minRelayTxFee.GetFee(nSize) * 10000));
+    }
+
+    if (fRejectAbsurdFee && tx.nVersion == 2 && nFees > 100000000)
+    {
+        LogPrintf("Absurdly-high-fee of %d for tx with version of 2 \n", nFees);
+        return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee", strprintf("%d > %d", nFees, 100000000));
+    }
 
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
-        // merely non-standard transaction.
-        if ((nSigOps > MAX_STANDARD_TX_SIGOPS) || (nBytesPerSigOp && nSigOps > nSize / nBytesPerSigOp))
+    // The inexpensive input checks: amounts, maturity. These need the chain, the scripts do not.
+    if (!CheckInputs(tx, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, true, nullptr))
+    {
+        LogPrint(Logging::MEMPOOL, "CheckInputs failed for tx: %s\n", tx.GetHash().ToString().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Check a candidate whose scripts passed once more, with the flags the next block will be checked with, and
+ * remember the result so that ConnectBlock can skip the scripts of the transaction altogether. The signatures
+ * are cached by now, so this is cheap.
+ */
+static bool CacheMempoolCandidateScripts(const CTransaction &tx,
+    CValidationState &state,
+    const CMempoolCandidate &candidate)
+{
+    if (!CheckInputScripts(tx, state, candidate.view, candidate.nBlockScriptFlags, true, true))
+    {
+        return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against block flags but not STANDARD flags "
+                     "%s, %s",
+            __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+    }
+    return true;
+}
+
+/** Script and signature checks of a prepared candidate. Needs no lock, the coins are in candidate.view. */
+static bool CheckMempoolCandidateScripts(const CTransaction &tx,
+    CValidationState &state,
+    const CMempoolCandidate &candidate)
+{
+    // Check against previous transactions
+    // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    if (!CheckInputScripts(tx, state, candidate.view, STANDARD_SCRIPT_VERIFY_FLAGS, true, false))
+    {
+        LogPrint(Logging::MEMPOOL, "CheckInputs failed for tx: %s\n", tx.GetHash().ToString().c_str());
+        return false;
+    }
+
+    // Check again against just the consensus-critical mandatory script
+    // verification flags, in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain
+    // CHECKSIG NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks, however allowing such transactions into the mempool
+    // can be exploited as a DoS attack.
+    if (!CheckInputScripts(tx, state, candidate.view, MANDATORY_SCRIPT_VERIFY_FLAGS, true, false))
+    {
+        return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
+            __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+    }
+    return CacheMempoolCandidateScripts(tx, state, candidate);
+}
+
+/**
+ * Add a prepared candidate whose scripts passed to the pool. Runs under cs_main and the pool write lock, and
+ * repeats the checks that other admissions may have invalidated since the preparation: double spends of the
+ * same outpoints, inputs that left the pool, and the package limits. Then trims the pool to its limits
+ * and hands the transaction to the wallets.
+ */
+static bool CommitMempoolCandidate(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransactionRef &ptx,
+    bool *pfMissingInputs,
+    bool fOverrideMempoolLimit,
+    bool fRejectAbsurdFee,
+    CMempoolCandidate &candidate)
+{
+    AssertLockHeld(cs_main);
+    const CTransaction &tx = *ptx;
+    const uint256 hash = tx.GetHash();
+
+    // Calculate in-mempool ancestors, up to a limit.
+    CTxMemPool::setEntries setAncestors;
+    size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+    std::string errString;
+
+    {
+        // one lock for all of it, setAncestors holds iterators into the pool
+        WRITELOCK(pool.cs);
+        if (pool._exists(hash))
         {
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false, strprintf("%d", nSigOps));
+            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-in-mempool");
+        }
+        for (const CTxIn &txin : tx.vin)
+        {
+            if (pool.mapNextTx.count(txin.prevout))
+            {
+                return state.Invalid(false, REJECT_CONFLICT, "txn-mempool-conflict");
+            }
+            // The tip did not move, so a coin that was in the chain still is. A parent in the pool may have
+            // been evicted in the meantime though.
+            CTxMemPool::txiter parent = pool.mapTx.find(txin.prevout.hash);
+            if (parent == pool.mapTx.end() ? !pnetMan->getChainActive()->pcoinsTip->HaveCoin(txin.prevout) :
+                                             txin.prevout.n >= parent->GetTx().vout.size())
+            {
+                if (pfMissingInputs)
+                    *pfMissingInputs = true;
+                return false;
+            }
         }
 
-        CAmount mempoolRejectFee =
-            pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
+        if (!pool._CalculateMemPoolAncestors(candidate.entry, setAncestors, nLimitAncestors, nLimitAncestorSize,
+                nLimitDescendants, nLimitDescendantSize, errString))
         {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false,
-                strprintf("%d < %d", nFees, mempoolRejectFee));
+            return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
         }
 
-        // Continuously rate-limit free (really, very-low-fee) transactions
-        // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
-        // be annoying or make others' transactions take longer to confirm.
-        static const double maxFeeCutoff =
-            boost::lexical_cast<double>(gArgs.GetArg("-maxlimitertxfee", DEFAULT_MAXLIMITERTXFEE));
-        // starting value for feeCutoff in satoshi per byte
-        static const double initFeeCutoff =
-            boost::lexical_cast<double>(gArgs.GetArg("-minlimitertxfee", DEFAULT_MINLIMITERTXFEE));
-        static const int nLimitFreeRelay = gArgs.GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY);
+        // Store transaction in memory
+        pool.addUnchecked(hash, candidate.entry, setAncestors, !pnetMan->getChainActive()->IsInitialBlockDownload());
+    }
 
-        // get current memory pool size
-        uint64_t poolBytes = pool.GetTotalTxSize();
+    // trim mempool and check if tx was trimmed
+    if (!fOverrideMempoolLimit)
+    {
+        LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+            gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+        {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
+    }
+
+    if (!fRejectAbsurdFee)
+    {
+        SyncWithWallets(ptx, nullptr, -1);
+    }
+    return true;
+}
 
-        // Calculate feeCutoff in satoshis per byte:
-        //   When the feeCutoff is larger than the satoshiPerByte of the
-        //   current transaction then spam blocking will be in effect. However
-        //   Some free transactions will still get through based on -limitfreerelay
-        static double feeCutoff = initFeeCutoff;
-        static double nFreeLimit = nLimitFreeRelay;
-        static int64_t nLastTime = GetTime();
+bool AcceptToMemoryPoolWorker(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransactionRef &ptx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    int64_t nAcceptTime,
+    bool fOverrideMempoolLimit,
+    bool fRejectAbsurdFee,
+    std::vector<COutPoint> &vCoinsToUncache)
+{
+    const CTransaction &tx = *ptx;
 
-        int64_t nNow = GetTime();
+    // Admission runs in stages so that only the cheap parts are serialized:
+    // - context-free checks, no lock
+    // - contextual checks under cs_main, which copy the spent coins into a private view
+    // - script and signature checks, no lock, so callers that do not hold cs_main run them concurrently
+    // - the final conflict checks and addUnchecked under cs_main and the pool write lock
+    if (!CheckMempoolCandidate(tx, state))
+    {
+        CountMempoolReject(MEMPOOLSTAGE_CHECK, state, false);
+        return false;
+    }
 
-        // When the mempool starts falling use an exponentially decaying ~24 hour window:
-        // nFreeLimit = nFreeLimit + ((double)(DEFAULT_LIMIT_FREE_RELAY - nFreeLimit) / pow(1.0 - 1.0/86400,
-        // (double)(nNow - nLastTime)));
-        nFreeLimit /= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
+    bool fScriptsChecked = false;
+    for (bool fRetry = false;; fRetry = true)
+    {
+        CMempoolCandidate candidate;
+        {
+            LOCK(cs_main);
+            if (!PrepareMempoolCandidate(pool, state, ptx, fLimitFree, pfMissingInputs, nAcceptTime, fRejectAbsurdFee,
+                    fRetry, vCoinsToUncache, candidate))
+            {
+                CountMempoolReject(candidate.nStage, state, pfMissingInputs && *pfMissingInputs);
+                return false;
+            }
+        }
 
-        // When the mempool starts falling use an exponentially decaying ~24 hour window:
-        feeCutoff *= std::pow(1.0 - 1.0 / 86400, (double)(nNow - nLastTime));
+        // The scripts commit to the outpoints they spend, not to the chain, so once checked they stay
+        // valid against a later preparation.
+        if (!fScriptsChecked)
+        {
+            if (!CheckMempoolCandidateScripts(tx, state, candidate))
+            {
+                CountMempoolReject(MEMPOOLSTAGE_SCRIPTS, state, false);
+                return false;
+            }
+            fScriptsChecked = true;
+        }
 
-        uint64_t nLargestBlockSeen = MAX_BLOCK_SIZE;
-        if (poolBytes < nLargestBlockSeen)
+        LOCK(cs_main);
+        if (pnetMan->getChainActive()->chainActive.Tip() != candidate.pindexPrepared)
         {
-            feeCutoff = std::max(feeCutoff, initFeeCutoff);
-            nFreeLimit = std::min(nFreeLimit, (double)nLimitFreeRelay);
+            // A block was connected or disconnected while the scripts were checked. Maturity, sequence locks
+            // and the inputs themselves may have changed, prepare again against the new tip.
+            continue;
         }
-        else if (poolBytes < (nLargestBlockSeen * MAX_BLOCK_SIZE_MULTIPLIER))
+        if (!CommitMempoolCandidate(
+                pool, state, ptx, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, candidate))
         {
-            // Gradually choke off what is considered a free transaction
-            feeCutoff =
-                std::max(feeCutoff, initFeeCutoff + ((maxFeeCutoff - initFeeCutoff) * (poolBytes - nLargestBlockSeen) /
-                                                        (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1))));
+            CountMempoolReject(MEMPOOLSTAGE_COMMIT, state, pfMissingInputs && *pfMissingInputs);
+            return false;
+        }
+        return true;
+    }
+}
 
-            // Gradually choke off the nFreeLimit as well but leave at least DEFAULT_MIN_LIMITFREERELAY
-            // So that some free transactions can still get through
-            nFreeLimit = std::min(
-                nFreeLimit, ((double)nLimitFreeRelay - ((double)(nLimitFreeRelay - DEFAULT_MIN_LIMITFREERELAY) *
-                                                           (double)(poolBytes - nLargestBlockSeen) /
-                                                           (nLargestBlockSeen * (MAX_BLOCK_SIZE_MULTIPLIER - 1)))));
-            if (nFreeLimit < DEFAULT_MIN_LIMITFREERELAY)
-                nFreeLimit = DEFAULT_MIN_LIMITFREERELAY;
+/** The outcome of a transaction offered to the mempool, for the mempool:accept_result tracepoint */
+static void TraceAcceptResult(const CTransaction &tx, bool fAccepted, const CValidationState &state, bool fMissing)
+{
+    TRACE5(mempool, accept_result, tx.GetHash().begin(), fAccepted, fMissing, state.GetRejectCode(),
+        state.GetRejectReason().c_str());
+}
+
+bool AcceptToMemoryPoolWithTime(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransactionRef &tx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    int64_t nAcceptTime,
+    bool fOverrideMempoolLimit,
+    bool fRejectAbsurdFee)
+{
+    std::vector<COutPoint> vCoinsToUncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime,
+        fOverrideMempoolLimit, fRejectAbsurdFee, vCoinsToUncache);
+    TraceAcceptResult(*tx, res, state, pfMissingInputs && *pfMissingInputs);
+    if (pfMissingInputs && !res && !*pfMissingInputs)
+    {
+        LOCK(cs_main);
+        for (const COutPoint &remove : vCoinsToUncache)
+        {
+            pnetMan->getChainActive()->pcoinsTip->Uncache(remove);
         }
+    }
+    return res;
+}
+
+bool AcceptToMemoryPool(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransactionRef &tx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    bool fOverrideMempoolLimit,
+    bool fRejectAbsurdFee)
+{
+    return AcceptToMemoryPoolWithTime(
+        pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectAbsurdFee);
+}
+
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool &pool,
+    const std::vector<CTransactionRef> &vtx,
+    std::vector<CValidationState> &vState,
+    std::vector<bool> &vAccepted,
+    std::vector<bool> &vMissingInputs,
+    bool fLimitFree,
+    bool fRejectAbsurdFee,
+    const std::vector<int64_t> *pvAcceptTime)
+{
+    const size_t nTx = vtx.size();
+    const int64_t nAcceptTime = GetTime();
+    vState.assign(nTx, CValidationState());
+    vAccepted.assign(nTx, false);
+    vMissingInputs.assign(nTx, false);
+    std::vector<std::vector<COutPoint> > vCoinsToUncache(nTx);
+    std::vector<bool> vPrepared(nTx, false);
+
+    std::set<uint256> setBatch;
+    std::vector<size_t> vPending;
+    for (size_t i = 0; i < nTx; i++)
+    {
+        setBatch.insert(vtx[i]->GetHash());
+        if (CheckMempoolCandidate(*vtx[i], vState[i]))
+            vPending.push_back(i);
         else
+            CountMempoolReject(MEMPOOLSTAGE_CHECK, vState[i], false);
+    }
+
+    // Each round prepares whatever it can, checks the scripts of all of it together and commits what
+    // passed. A transaction whose parent is later in the batch waits for the round after its parent's.
+    unsigned int nAccepted = 0;
+    while (!vPending.empty())
+    {
+        std::vector<size_t> vRound, vNext;
+        std::vector<std::unique_ptr<CMempoolCandidate> > vCandidates(nTx);
         {
-            feeCutoff = maxFeeCutoff;
-            nFreeLimit = DEFAULT_MIN_LIMITFREERELAY;
+            LOCK(cs_main);
+            for (size_t i : vPending)
+            {
+                bool fMissingInputs = false;
+                vCandidates[i].reset(new CMempoolCandidate());
+                if (PrepareMempoolCandidate(pool, vState[i], vtx[i], fLimitFree, &fMissingInputs,
+                        pvAcceptTime ? (*pvAcceptTime)[i] : nAcceptTime, fRejectAbsurdFee, vPrepared[i], vCoinsToUncache[i], *vCandidates[i]))
+                {
+                    vPrepared[i] = true;
+                    vRound.push_back(i);
+                    continue;
+                }
+                bool fParentInBatch = false;
+                for (const CTxIn &txin : vtx[i]->vin)
+                    fParentInBatch |= setBatch.count(txin.prevout.hash) > 0;
+                const int nStage = vCandidates[i]->nStage;
+                vCandidates[i].reset();
+                if (fMissingInputs && fParentInBatch)
+                {
+                    vNext.push_back(i);
+                    continue;
+                }
+                vMissingInputs[i] = fMissingInputs;
+                CountMempoolReject(nStage, vState[i], fMissingInputs);
+            }
         }
-        minRelayTxFee = CFeeRate(feeCutoff * 1000);
-        LogPrint("MEMPOOL",
-            "MempoolBytes:%d  LimitFreeRelay:%.5g  FeeCutOff:%.4g  FeesSatoshiPerByte:%.4g  TxBytes:%d  TxFees:%d\n",
-            poolBytes, nFreeLimit, ((double)::minRelayTxFee.GetFee(nSize)) / nSize, ((double)nFees) / nSize, nSize,
-            nFees);
-        if (fLimitFree && nModifiedFees < ::minRelayTxFee.GetFee(nSize))
-        {
-            static double dFreeCount;
-
-            // Use an exponentially decaying ~10-minute window:
-            dFreeCount *= pow(1.0 - 1.0 / 600.0, (double)(nNow - nLastTime));
-            nLastTime = nNow;
-            // -limitfreerelay unit is thousand-bytes-per-minute
-            // At default rate it would take over a month to fill 1GB
-            if (dFreeCount >= gArgs.GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000)
+        if (vRound.empty())
+        {
+            // Nothing could be prepared, so no parent is coming either
+            for (size_t i : vNext)
             {
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
+                vMissingInputs[i] = true;
+                CountMempoolReject(MEMPOOLSTAGE_FEE, vState[i], true);
             }
-            LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount + nSize);
-            dFreeCount += nSize;
+            break;
         }
 
-        if (fRejectAbsurdFee && tx.nVersion == 1 && nFees > maxTxFee)
+        // The expensive part, across all script check threads at once. Only if some check fails is the
+        // round walked again to find out which transactions failed, and why.
+        std::vector<CScriptCheck> vChecks;
+        for (size_t i : vRound)
+            CheckInputScripts(
+                *vtx[i], vState[i], vCandidates[i]->view, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, &vChecks);
+        const bool fAllScriptsOk = RunScriptChecks(vChecks);
+        std::vector<size_t> vScriptsOk;
+        for (size_t i : vRound)
         {
-            LogPrintf("Absurdly-high-fee of %d for tx with version of 1 \n", nFees);
-            return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee",
-                strprintf("%d > %d", nFees, ::minRelayTxFee.GetFee(nSize) * 10000));
+            // With the signatures cached by the run above, the checks repeated here are cheap
+            bool fOk = fAllScriptsOk ?
+                           CheckInputScripts(*vtx[i], vState[i], vCandidates[i]->view, MANDATORY_SCRIPT_VERIFY_FLAGS,
+                               true, false) &&
+                               CacheMempoolCandidateScripts(*vtx[i], vState[i], *vCandidates[i]) :
+                           CheckMempoolCandidateScripts(*vtx[i], vState[i], *vCandidates[i]);
+            if (fOk)
+                vScriptsOk.push_back(i);
+            else
+                CountMempoolReject(MEMPOOLSTAGE_SCRIPTS, vState[i], false);
         }
 
-        if (fRejectAbsurdFee && tx.nVersion == 2 && nFees > 100000000)
         {
-            LogPrintf("Absurdly-high-fee of %d for tx with version of 2 \n", nFees);
-            return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee", strprintf("%d > %d", nFees, 100000000));
+            LOCK(cs_main);
+            for (size_t i : vScriptsOk)
+            {
+                if (pnetMan->getChainActive()->chainActive.Tip() != vCandidates[i]->pindexPrepared)
+                {
+                    // Prepare again against the new tip
+                    vNext.push_back(i);
+                    continue;
+                }
+                bool fMissingInputs = false;
+                if (CommitMempoolCandidate(
+                        pool, vState[i], vtx[i], &fMissingInputs, false, fRejectAbsurdFee, *vCandidates[i]))
+                {
+                    vAccepted[i] = true;
+                    nAccepted++;
+                }
+                else
+                    CountMempoolReject(MEMPOOLSTAGE_COMMIT, vState[i], fMissingInputs);
+                vMissingInputs[i] = fMissingInputs;
+            }
         }
+        vPending.swap(vNext);
+    }
+
+    LOCK(cs_main);
+    for (size_t i = 0; i < nTx; i++)
+    {
+        TraceAcceptResult(*vtx[i], vAccepted[i], vState[i], vMissingInputs[i]);
+        if (vAccepted[i] || vMissingInputs[i])
+            continue;
+        for (const COutPoint &remove : vCoinsToUncache[i])
+            pnetMan->getChainActive()->pcoinsTip->Uncache(remove);
+    }
+    return nAccepted;
+}
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+bool LoadMempool()
+{
+    const int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE *filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
 
-        // Calculate in-mempool ancestors, up to a limit.
-        CTxMemPool::setEntries setAncestors;
-        size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
-        size_t nLimitAncestorSize = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
-        size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
-        size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
-        std::string errString;
+    int64_t nStart = GetTimeMillis();
+    int64_t count = 0;
+    int64_t skipped = 0;
+    int64_t failed = 0;
+    int64_t nNow = GetTime();
 
-        // Check against previous transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, nullptr))
+    try
+    {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION)
         {
-            LogPrint("MEMPOOL", "CheckInputs failed for tx: %s\n", tx.GetHash().ToString().c_str());
             return false;
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, nullptr))
+        // the deltas come first, so the transactions they are for are accepted with them
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (const auto &i : mapDeltas)
         {
-            return error(
-                "%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
-                __func__, hash.ToString(), FormatStateMessage(state));
+            mempool.PrioritiseTransaction(i.first, i.first.ToString(), i.second.first, i.second.second);
         }
+
+        uint64_t num;
+        file >> num;
+        while (num > 0)
         {
-            WRITELOCK(pool.cs);
-            if (!pool._CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize,
-                    nLimitDescendants, nLimitDescendantSize, errString))
+            // a batch at a time goes through AcceptToMemoryPoolBatch, which checks their scripts on the script
+            // check threads and holds cs_main only around the mempool and coins lookups, not the checks
+            std::vector<CTransactionRef> vtx;
+            std::vector<int64_t> vTime;
+            for (; num > 0 && vtx.size() < MEMPOOL_LOAD_BATCH_SIZE; num--)
+            {
+                CTransactionRef tx;
+                int64_t nTime;
+                file >> tx;
+                file >> nTime;
+
+                if (nTime + nExpiryTimeout <= nNow)
+                {
+                    ++skipped;
+                    continue;
+                }
+                vtx.push_back(tx);
+                vTime.push_back(nTime);
+            }
+            std::vector<CValidationState> vState;
+            std::vector<bool> vAccepted, vMissingInputs;
+            const unsigned int nAccepted =
+                AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, vMissingInputs, false, false, &vTime);
+            count += nAccepted;
+            failed += vtx.size() - nAccepted;
+            if (ShutdownRequested())
             {
-                return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
+                return false;
             }
         }
+    }
+    catch (const std::exception &e)
+    {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired  %dms\n", count, failed,
+        skipped, GetTimeMillis() - nStart);
+    return true;
+}
 
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<std::pair<uint64_t, const CTxMemPoolEntry *> > vSorted;
+    std::vector<std::pair<CTransactionRef, int64_t> > vEntries;
+    {
+        READLOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        // parents have fewer ancestors than their children, so they go first and are there
+        // when the children are loaded
+        vSorted.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry &e : mempool.mapTx)
+        {
+            vSorted.emplace_back(e.GetCountWithAncestors(), &e);
+        }
+        std::sort(vSorted.begin(), vSorted.end());
+        vEntries.reserve(vSorted.size());
+        for (const auto &i : vSorted)
         {
-            WRITELOCK(pool.cs);
-            // Store transaction in memory
-            pool.addUnchecked(hash, entry, setAncestors, !pnetMan->getChainActive()->IsInitialBlockDownload());
+            vEntries.emplace_back(i.second->GetSharedTx(), i.second->GetTime());
         }
+    }
 
-        // trim mempool and check if tx was trimmed
-        if (!fOverrideMempoolLimit)
+    try
+    {
+        fs::path pathTmp = GetDataDir() / "mempool.dat.new";
+        FILE *filestr = fopen(pathTmp.string().c_str(), "wb");
+        if (!filestr)
         {
-            LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
-                gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
-            if (!pool.exists(hash))
-            {
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
-            }
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        file << MEMPOOL_DUMP_VERSION;
+        file << mapDeltas;
+        file << (uint64_t)vEntries.size();
+        for (const auto &i : vEntries)
+        {
+            file << *i.first;
+            file << i.second;
         }
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathTmp, GetDataDir() / "mempool.dat"))
+        {
+            return error("%s: Rename-into-place failed", __func__);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
 
-        if (!fRejectAbsurdFee)
+    LogPrintf("Dumped %u mempool transactions to mempool.dat  %dms\n", vEntries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+static const uint64_t COINSCACHE_DUMP_VERSION = 1;
+
+bool LoadCoinsCache()
+{
+    FILE *filestr = fopen((GetDataDir() / "coinscache.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        LogPrintf("Failed to open coins cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    CCoinsViewCache *pcoins = pnetMan->getChainActive()->pcoinsTip.get();
+    int64_t nStart = GetTimeMillis();
+    size_t nRead = 0;
+    size_t nAdded = 0;
+    try
+    {
+        uint64_t version;
+        file >> version;
+        if (version != COINSCACHE_DUMP_VERSION)
         {
-            SyncWithWallets(ptx, nullptr, -1);
+            return false;
+        }
+
+        // the mempool inputs, then the rest of what was cached, each sorted so the reads follow the database
+        bool fFull = false;
+        for (int nPart = 0; nPart < 2 && !fFull; nPart++)
+        {
+            uint64_t num;
+            file >> num;
+            while (num > 0)
+            {
+                if (pcoins->DynamicMemoryUsage() >= nCoinCacheUsage / 2)
+                {
+                    LogPrintf("Coins cache is half full, not reading the rest of coinscache.dat\n");
+                    fFull = true;
+                    break;
+                }
+                std::vector<COutPoint> vOutpoints;
+                vOutpoints.reserve(std::min<uint64_t>(num, COINSCACHE_LOAD_BATCH_SIZE));
+                for (; num > 0 && vOutpoints.size() < COINSCACHE_LOAD_BATCH_SIZE; num--)
+                {
+                    COutPoint outpoint;
+                    file >> outpoint;
+                    vOutpoints.push_back(outpoint);
+                }
+                nRead += vOutpoints.size();
+                nAdded += pcoins->Prefetch(vOutpoints);
+                if (ShutdownRequested())
+                {
+                    return false;
+                }
+            }
         }
     }
+    catch (const std::exception &e)
+    {
+        LogPrintf("Failed to deserialize coins cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
 
+    LogPrintf("Warmed the coins cache from disk: %u of %u outpoints read, %.1fMiB cached  %dms\n", nAdded, nRead,
+        pcoins->DynamicMemoryUsage() * (1.0 / 1024 / 1024), GetTimeMillis() - nStart);
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool &pool,
-    CValidationState &state,
-    const CTransactionRef &tx,
-    bool fLimitFree,
-    bool *pfMissingInputs,
-    bool fOverrideMempoolLimit,
-    bool fRejectAbsurdFee)
+bool DumpCoinsCache()
 {
-    std::vector<COutPoint> vCoinsToUncache;
-    bool res = AcceptToMemoryPoolWorker(
-        pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, vCoinsToUncache);
-    if (pfMissingInputs && !res && !*pfMissingInputs)
+    int64_t nStart = GetTimeMillis();
+
+    // inputs of the mempool that are spent from the chain, not from other mempool transactions
+    std::vector<COutPoint> vMempool;
     {
-        for (const COutPoint &remove : vCoinsToUncache)
+        READLOCK(mempool.cs);
+        std::vector<uint256> vTxids;
+        vTxids.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry &e : mempool.mapTx)
         {
-            pnetMan->getChainActive()->pcoinsTip->Uncache(remove);
+            vTxids.push_back(e.GetTx().GetHash());
+            for (const CTxIn &txin : e.GetTx().vin)
+                vMempool.push_back(txin.prevout);
+        }
+        std::sort(vTxids.begin(), vTxids.end());
+        vMempool.erase(std::remove_if(vMempool.begin(), vMempool.end(),
+                           [&](const COutPoint &outpoint) {
+                               return std::binary_search(vTxids.begin(), vTxids.end(), outpoint.hash);
+                           }),
+            vMempool.end());
+    }
+    std::sort(vMempool.begin(), vMempool.end());
+    vMempool.erase(std::unique(vMempool.begin(), vMempool.end()), vMempool.end());
+
+    std::vector<COutPoint> vCached;
+    pnetMan->getChainActive()->pcoinsTip->GetCachedOutpoints(vCached);
+    std::sort(vCached.begin(), vCached.end());
+    vCached.erase(std::remove_if(vCached.begin(), vCached.end(),
+                      [&](const COutPoint &outpoint) {
+                          return std::binary_search(vMempool.begin(), vMempool.end(), outpoint);
+                      }),
+        vCached.end());
+
+    try
+    {
+        fs::path pathTmp = GetDataDir() / "coinscache.dat.new";
+        FILE *filestr = fopen(pathTmp.string().c_str(), "wb");
+        if (!filestr)
+        {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        file << COINSCACHE_DUMP_VERSION;
+        for (const std::vector<COutPoint> *pvOutpoints : {&vMempool, &vCached})
+        {
+            file << (uint64_t)pvOutpoints->size();
+            for (const COutPoint &outpoint : *pvOutpoints)
+                file << outpoint;
+        }
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathTmp, GetDataDir() / "coinscache.dat"))
+        {
+            return error("%s: Rename-into-place failed", __func__);
         }
     }
-    return res;
+    catch (const std::exception &e)
+    {
+        LogPrintf("Failed to dump coins cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Dumped %u mempool inputs and %u cached coins to coinscache.dat  %dms\n", vMempool.size(),
+        vCached.size(), GetTimeMillis() - nStart);
+    return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -841,21 +1511,37 @@ bool AcceptToMemoryPool(CTxMemPool &pool,
 
 bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos, const CMessageHeader::MessageMagic &messageStart)
 {
+    std::vector<unsigned char> data;
+    uint32_t nSizeField;
+    StoreBlockData(block, fCompressBlocks, data, nSizeField);
+    return WriteBlockToDisk(data, nSizeField, pos, messageStart);
+}
+
+bool WriteBlockToDisk(const std::vector<unsigned char> &data,
+    uint32_t nSizeField,
+    CDiskBlockPos &pos,
+    const CMessageHeader::MessageMagic &messageStart)
+{
+    if (g_blockwriter)
+    {
+        g_blockwriter->WriteBlock(data, nSizeField, pos, messageStart);
+        return true;
+    }
+
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << nSizeField;
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout.write((const char *)data.data(), data.size());
 
     return true;
 }
@@ -864,19 +1550,45 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos, const Consensus:
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    if (g_blockwriter)
+        g_blockwriter->WaitForWrite(false, pos);
 
-    // Read block
-    try
-    {
-        filein >> block;
-    }
-    catch (const std::exception &e)
+    if (!g_blockfilemapper || !g_blockfilemapper->ReadBlock(block, pos))
     {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Open history file to read, the block is preceded by its size
+        if (pos.nPos < sizeof(uint32_t))
+            return error("ReadBlockFromDisk: no block at %s", pos.ToString());
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true), SER_DISK,
+            CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        // Read block
+        try
+        {
+            uint32_t nSizeField;
+            filein >> nSizeField;
+            if (nSizeField & BLOCK_COMPRESSED_FLAG)
+            {
+                const uint32_t nSize = nSizeField & ~BLOCK_COMPRESSED_FLAG;
+                if (nSize > MAX_SIZE)
+                    return error("%s: block size %u out of range at %s", __func__, nSize, pos.ToString());
+                std::vector<unsigned char> data(nSize);
+                filein.read((char *)data.data(), data.size());
+                std::string strRaw;
+                if (!UncompressBlockData(data.data(), data.size(), strRaw))
+                    return error("%s: can not uncompress the block at %s", __func__, pos.ToString());
+                CDataStream(strRaw.data(), strRaw.data() + strRaw.size(), SER_DISK, CLIENT_VERSION) >> block;
+            }
+            else
+            {
+                filein >> block;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -906,6 +1618,49 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::string &strOut, const CDiskBlockPos &pos)
+{
+    if (g_blockwriter)
+        g_blockwriter->WaitForWrite(false, pos);
+
+    if (g_blockfilemapper && g_blockfilemapper->ReadRawBlock(strOut, pos))
+        return true;
+
+    // the block is preceded by its size
+    if (pos.nPos < sizeof(uint32_t))
+        return error("%s: no block at %s", __func__, pos.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true), SER_DISK,
+        CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    try
+    {
+        uint32_t nSize;
+        filein >> nSize;
+        const bool fCompressed = nSize & BLOCK_COMPRESSED_FLAG;
+        nSize &= ~BLOCK_COMPRESSED_FLAG;
+        if (nSize > MAX_SIZE)
+            return error("%s: block size %u out of range at %s", __func__, nSize, pos.ToString());
+        if (fCompressed)
+        {
+            // peers and REST clients get the serialized block
+            std::vector<unsigned char> data(nSize);
+            filein.read((char *)data.data(), nSize);
+            if (!UncompressBlockData(data.data(), nSize, strOut))
+                return error("%s: can not uncompress the block at %s", __func__, pos.ToString());
+            return true;
+        }
+        const size_t nOffset = strOut.size();
+        strOut.resize(nOffset + nSize);
+        filein.read(&strOut[nOffset], nSize);
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 void UpdateCoins(const CTransaction &tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, int nHeight)
 {
     // mark inputs spent
@@ -931,8 +1686,8 @@ void UpdateCoins(const CTransaction &tx, CValidationState &state, CCoinsViewCach
 bool CScriptCheck::operator()()
 {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(
-            scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error))
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags,
+            CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata.get()), &error))
     {
         return false;
     }
@@ -1008,7 +1763,7 @@ bool CheckTxInputs(const CTransaction &tx, CValidationState &state, const CCoins
         if (nStakeReward >
             GetProofOfStakeReward(tx.GetCoinAge(nCoinAge, true), nSpendHeight) + DEFAULT_TRANSACTION_MINFEE)
         {
-            LogPrint("kernel", "nStakeReward = %d , CoinAge = %d \n", nStakeReward, nCoinAge);
+            LogPrint(Logging::KERNEL, "nStakeReward = %d , CoinAge = %d \n", nStakeReward, nCoinAge);
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-stake-reward-too-high", false,
                 strprintf("ConnectInputs() : %s stake reward exceeded", tx.GetHash().ToString().substr(0, 10).c_str()));
         }
@@ -1030,9 +1785,6 @@ bool CheckInputs(const CTransaction &tx,
         if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs)))
             return false;
 
-        if (pvChecks)
-            pvChecks->reserve(tx.vin.size());
-
         // The first loop above does all the inexpensive checks.
         // Only if ALL inputs pass do we perform expensive ECDSA signature checks.
         // Helps prevent CPU exhaustion attacks.
@@ -1042,60 +1794,212 @@ bool CheckInputs(const CTransaction &tx,
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks)
         {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
+            return CheckInputScripts(tx, state, inputs, flags, cacheStore, cacheStore, pvChecks);
+        }
+    }
+
+    return true;
+}
+
+namespace
+{
+/**
+ * Transactions whose scripts all passed under a set of flags, so that a block made of transactions that were
+ * in the mempool does not run the interpreter for them a second time. The inputs of a transaction are fixed
+ * by its hash, and so are the outputs they spend and the outcome of the scripts, for given flags.
+ */
+class CScriptExecutionCache
+{
+private:
+    //! Entries are SHA256(nonce || txid || flags)
+    uint256 nonce;
+    CCuckooCache setValid;
+
+public:
+    CScriptExecutionCache() : setValid(GetSigCacheBytes())
+    {
+        GetRandBytes(nonce.begin(), 32);
+        LogPrintf("Using %u MiB for the script execution cache, room for %u entries\n", setValid.MemoryUsage() >> 20,
+            setValid.Capacity());
+    }
+
+    void ComputeEntry(uint256 &entry, const CTransaction &tx, unsigned int flags)
+    {
+        const uint256 &hash = tx.GetHash();
+        CSHA256()
+            .Write(nonce.begin(), 32)
+            .Write(hash.begin(), 32)
+            .Write((const unsigned char *)&flags, sizeof(flags))
+            .Finalize(entry.begin());
+    }
+
+    bool Get(const uint256 &entry) { return setValid.Contains(entry); }
+    void Set(const uint256 &entry) { setValid.Insert(entry); }
+    size_t MemoryUsage() const { return setValid.MemoryUsage(); }
+    void Dump(CAutoFile &file) { DumpSaltedCache(file, nonce, setValid); }
+    size_t Load(CAutoFile &file) { return LoadSaltedCache(file, nonce, setValid); }
+};
+
+CScriptExecutionCache &ScriptExecutionCache()
+{
+    static CScriptExecutionCache scriptExecutionCache;
+    return scriptExecutionCache;
+}
+} // anon namespace
+
+size_t GetScriptExecutionCacheUsage() { return ScriptExecutionCache().MemoryUsage(); }
+
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
+bool LoadSigCache()
+{
+    FILE *filestr = fopen((GetDataDir() / "sigcache.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+    {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t nStart = GetTimeMillis();
+    size_t nSignatures = 0;
+    size_t nScripts = 0;
+    try
+    {
+        uint64_t version;
+        file >> version;
+        if (version != SIGCACHE_DUMP_VERSION)
+        {
+            return false;
+        }
+        nSignatures = LoadSignatureCache(file);
+        nScripts = ScriptExecutionCache().Load(file);
+    }
+    catch (const std::exception &e)
+    {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported %u signatures and %u script executions from sigcache.dat  %dms\n", nSignatures, nScripts,
+        GetTimeMillis() - nStart);
+    return true;
+}
+
+bool DumpSigCache()
+{
+    int64_t nStart = GetTimeMillis();
+
+    try
+    {
+        fs::path pathTmp = GetDataDir() / "sigcache.dat.new";
+        FILE *filestr = fopen(pathTmp.string().c_str(), "wb");
+        if (!filestr)
+        {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        file << SIGCACHE_DUMP_VERSION;
+        DumpSignatureCache(file);
+        ScriptExecutionCache().Dump(file);
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathTmp, GetDataDir() / "sigcache.dat"))
+        {
+            return error("%s: Rename-into-place failed", __func__);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Dumped signature caches to sigcache.dat  %dms\n", GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CheckInputScripts(const CTransaction &tx,
+    CValidationState &state,
+    const CCoinsViewCache &inputs,
+    unsigned int flags,
+    bool cacheStore,
+    bool cacheFullScriptStore,
+    std::vector<CScriptCheck> *pvChecks)
+{
+    if (tx.IsCoinBase())
+        return true;
+
+    // Passed under these very flags before: nothing to run, and nothing to queue either
+    uint256 hashCacheEntry;
+    ScriptExecutionCache().ComputeEntry(hashCacheEntry, tx, flags);
+    if (ScriptExecutionCache().Get(hashCacheEntry))
+        return true;
+
+    if (pvChecks)
+        pvChecks->reserve(pvChecks->size() + tx.vin.size());
+
+    // what the signature hashes of all inputs share, made once for the checks of all of them
+    const std::shared_ptr<const PrecomputedTransactionData> txdata =
+        std::make_shared<const PrecomputedTransactionData>(tx);
+
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        const COutPoint &prevout = tx.vin[i].prevout;
+        const Coin &coin = inputs.AccessCoin(prevout);
+        assert(!coin.IsSpent());
+
+        // We very carefully only pass in things to CScriptCheck which
+        // are clearly committed. This provides
+        // a sanity check that our caching is not introducing consensus
+        // failures through additional data in, eg, the coins being
+        // spent being checked as a part of CScriptCheck.
+        const CScript &scriptPubKey = coin.out.scriptPubKey;
+        const CAmount amount = coin.out.nValue;
+
+        // Verify signature
+        CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheStore, txdata);
+        if (pvChecks)
+        {
+            pvChecks->push_back(CScriptCheck());
+            check.swap(pvChecks->back());
+        }
+        else if (!check())
+        {
+            if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS)
             {
-                const COutPoint &prevout = tx.vin[i].prevout;
-                const Coin &coin = inputs.AccessCoin(prevout);
-                assert(!coin.IsSpent());
-
-                // We very carefully only pass in things to CScriptCheck which
-                // are clearly committed. This provides
-                // a sanity check that our caching is not introducing consensus
-                // failures through additional data in, eg, the coins being
-                // spent being checked as a part of CScriptCheck.
-                const CScript &scriptPubKey = coin.out.scriptPubKey;
-                const CAmount amount = coin.out.nValue;
-
-                // Verify signature
-                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheStore);
-                if (pvChecks)
+                // Check whether the failure was caused by a
+                // non-mandatory script verification check, such as
+                // non-standard DER encodings or non-null dummy
+                // arguments; if so, don't trigger DoS protection to
+                // avoid splitting the network between upgraded and
+                // non-upgraded nodes.
+                CScriptCheck check2(
+                    scriptPubKey, amount, tx, i, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
+                if (check2())
                 {
-                    pvChecks->push_back(CScriptCheck());
-                    check.swap(pvChecks->back());
-                }
-                else if (!check())
-                {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS)
-                    {
-                        // Check whether the failure was caused by a
-                        // non-mandatory script verification check, such as
-                        // non-standard DER encodings or non-null dummy
-                        // arguments; if so, don't trigger DoS protection to
-                        // avoid splitting the network between upgraded and
-                        // non-upgraded nodes.
-                        CScriptCheck check2(
-                            scriptPubKey, amount, tx, i, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
-                        if (check2())
-                        {
-                            return state.Invalid(
-                                false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)",
-                                                               ScriptErrorString(check.GetScriptError())));
-                        }
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after a soft-fork
-                    // super-majority vote has passed.
-                    return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)",
-                                                                     ScriptErrorString(check.GetScriptError())));
+                    return state.Invalid(false, REJECT_NONSTANDARD,
+                        strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+            // Failures of other flags indicate a transaction that is
+            // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+            // such nodes as they are not following the protocol. That
+            // said during an upgrade careful thought should be taken
+            // as to the correct behavior - we may want to continue
+            // peering with non-upgraded nodes even after a soft-fork
+            // super-majority vote has passed.
+            return state.DoS(100, false, REJECT_INVALID,
+                strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
         }
     }
 
+    // Queued checks have not run yet, only a transaction that was checked right here can go in the cache
+    if (cacheFullScriptStore && !pvChecks)
+        ScriptExecutionCache().Set(hashCacheEntry);
+
     return true;
 }
 
@@ -1115,10 +2019,19 @@ bool AbortNode(CValidationState &state, const std::string &strMessage, const std
     return state.Error(strMessage);
 }
 
-void static FlushBlockFile(bool fFinalize = false)
+bool static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    if (g_blockwriter)
+    {
+        // The writer syncs what it wrote itself, only finalizing a file needs more than waiting for it
+        if (!g_blockwriter->Flush())
+            return false;
+        if (!fFinalize)
+            return true;
+    }
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE *fileOld = OpenBlockFile(posOld);
@@ -1138,6 +2051,7 @@ void static FlushBlockFile(bool fFinalize = false)
         FileCommit(fileOld);
         fclose(fileOld);
     }
+    return true;
 }
 
 // Protected by cs_main
@@ -1163,6 +2077,213 @@ int32_t ComputeBlockVersion(const CBlockIndex *pindexPrev, const Consensus::Para
 // Protected by cs_main
 ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+/**
+ * Transactions with outputs spent by the last MIN_BLOCKS_TO_KEEP blocks of the active chain, with the last block
+ * spending from each. Those blocks can still be disconnected, which makes the outputs spendable, and stakeable, again.
+ */
+static bool GetTxidsSpentByRecentBlocks(std::map<uint256, uint256> &mapSpent)
+{
+    const CChain &chain = pnetMan->getChainActive()->chainActive;
+    const Consensus::Params &consensusParams = pnetMan->getActivePaymentNetwork()->GetConsensus();
+    for (CBlockIndex *pindex = chain.Tip(); pindex && pindex->nHeight + (int)MIN_BLOCKS_TO_KEEP > chain.Height();
+         pindex = pindex->pprev)
+    {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensusParams))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        for (const auto &ptx : block.vtx)
+        {
+            if (ptx->IsCoinBase())
+                continue;
+            // the walk goes down from the tip, the first block found is the last one
+            for (const CTxIn &txin : ptx->vin)
+                mapSpent.emplace(txin.prevout.hash, pindex->GetBlockHash());
+        }
+    }
+    return true;
+}
+
+/**
+ * Keep the transactions of the blocks in a file that is about to be pruned which GetTransaction may still be asked
+ * for by staking: those with an output that is unspent, or only spent by a block that may yet be disconnected.
+ * They are kept as GetTransaction would have read them, with the block the transaction index points at. Those
+ * with no unspent output are set aside for the last block spending from them, as ConnectBlock would have done.
+ */
+static bool KeepSpendableTransactions(const int fileNumber,
+    const std::vector<CBlockIndex *> &vBlocks,
+    const std::map<uint256, uint256> &mapSpentRecently)
+{
+    CBlockTreeDB *pblocktree = pnetMan->getChainActive()->pblocktree.get();
+    CCoinsViewCache *pcoinsTip = pnetMan->getChainActive()->pcoinsTip.get();
+    const Consensus::Params &consensusParams = pnetMan->getActivePaymentNetwork()->GetConsensus();
+    std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > vKeep;
+    std::map<uint256, std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > > mapSpentBy;
+    for (CBlockIndex *pindex : vBlocks)
+    {
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+            continue;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensusParams))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        for (const auto &ptx : block.vtx)
+        {
+            const uint256 txid = ptx->GetHash();
+            // a transaction that is in more than one block is read from the one the index points at
+            CDiskTxPos postx;
+            if (!pblocktree->ReadTxIndex(txid, postx) || postx.nFile != fileNumber || postx.nPos != pindex->nDataPos)
+                continue;
+            bool fUnspent = false;
+            for (uint32_t i = 0; !fUnspent && i < ptx->vout.size(); i++)
+                fUnspent = pcoinsTip->HaveCoin(COutPoint(txid, i));
+            std::map<uint256, uint256>::const_iterator it = mapSpentRecently.find(txid);
+            if (fUnspent)
+                vKeep.emplace_back(txid, std::make_pair(pindex->GetBlockHash(), *ptx));
+            else if (it != mapSpentRecently.end())
+                mapSpentBy[it->second].emplace_back(txid, std::make_pair(pindex->GetBlockHash(), *ptx));
+        }
+    }
+    if (!pblocktree->WritePrunedTxs(vKeep))
+        return error("%s: failed to write the transactions kept from blk%05u.dat", __func__, fileNumber);
+    size_t nSpent = 0;
+    for (const auto &item : mapSpentBy)
+    {
+        if (!pblocktree->MovePrunedTxsSpentBy(item.first, item.second))
+            return error("%s: failed to write the transactions kept from blk%05u.dat", __func__, fileNumber);
+        nSpent += item.second.size();
+    }
+    LogPrint(Logging::PRUNE, "Prune: kept %u transactions of blk%05u.dat, %u of them spent by recent blocks\n",
+        vKeep.size() + nSpent, fileNumber, nSpent);
+    return true;
+}
+
+static bool PruneOneBlockFile(const int fileNumber, const std::map<uint256, uint256> &mapSpentRecently)
+{
+    AssertLockHeld(cs_main);
+    std::vector<CBlockIndex *> vBlocks;
+    {
+        READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
+        for (CBlockIndex *pindex : pnetMan->getChainActive()->mapBlockIndex)
+        {
+            if (pindex->nFile == fileNumber && (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)))
+                vBlocks.push_back(pindex);
+        }
+    }
+    if (!KeepSpendableTransactions(fileNumber, vBlocks, mapSpentRecently))
+        return false;
+
+    for (CBlockIndex *pindex : vBlocks)
+    {
+        pindex->nStatus &= ~BLOCK_HAVE_DATA;
+        pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+        pindex->nFile = 0;
+        pindex->nDataPos = 0;
+        pindex->nUndoPos = 0;
+        setDirtyBlockIndex.insert(pindex);
+
+        // Prune from mapBlocksUnlinked -- any block we prune would have
+        // to be downloaded again in order to consider its chain, at which
+        // point it would be considered as a candidate for
+        // mapBlocksUnlinked or setBlockIndexCandidates.
+        std::pair<std::multimap<CBlockIndex *, CBlockIndex *>::iterator,
+            std::multimap<CBlockIndex *, CBlockIndex *>::iterator>
+            range = mapBlocksUnlinked.equal_range(pindex->pprev);
+        while (range.first != range.second)
+        {
+            std::multimap<CBlockIndex *, CBlockIndex *>::iterator it = range.first;
+            range.first++;
+            if (it->second == pindex)
+            {
+                mapBlocksUnlinked.erase(it);
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+    return true;
+}
+
+bool PruneOneBlockFile(const int fileNumber)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    std::map<uint256, uint256> mapSpentRecently;
+    return GetTxidsSpentByRecentBlocks(mapSpentRecently) && PruneOneBlockFile(fileNumber, mapSpentRecently);
+}
+
+void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune)
+{
+    for (int nFile : setFilesToPrune)
+    {
+        if (g_blockfilemapper)
+            g_blockfilemapper->Drop(nFile);
+        CDiskBlockPos pos(nFile, 0);
+        fs::remove(GetBlockPosFilename(pos, "blk"));
+        fs::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, nFile);
+    }
+}
+
+/* Calculate the block/rev files that should be deleted to remain under target */
+static void FindFilesToPrune(std::set<int> &setFilesToPrune)
+{
+    const CChain &chain = pnetMan->getChainActive()->chainActive;
+    if (chain.Tip() == nullptr || nPruneTarget == 0)
+    {
+        return;
+    }
+    if (chain.Height() <= (int)MIN_BLOCKS_TO_KEEP)
+    {
+        return;
+    }
+
+    const unsigned int nLastBlockWeCanPrune = chain.Height() - MIN_BLOCKS_TO_KEEP;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files
+    // So we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    const uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    std::map<uint256, uint256> mapSpentRecently;
+    bool fSpentRecentlyRead = false;
+    int count = 0;
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget)
+    {
+        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++)
+        {
+            const uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip but keep
+            // scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+                continue;
+
+            if (!fSpentRecentlyRead)
+            {
+                if (!GetTxidsSpentByRecentBlocks(mapSpentRecently))
+                    break;
+                fSpentRecentlyRead = true;
+            }
+            if (!PruneOneBlockFile(fileNumber, mapSpentRecently))
+                break;
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            count++;
+        }
+    }
+
+    LogPrint(Logging::PRUNE,
+        "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024, nLastBlockWeCanPrune, count);
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -1175,8 +2296,29 @@ bool FlushStateToDisk(CValidationState &state, FlushStateMode mode)
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try
     {
+        // Collect a background flush of the coins cache that is done, which trims the cache
+        const bool fWasFlushing = pnetMan->getChainActive()->pcoinsTip->IsFlushingInBackground();
+        if (!pnetMan->getChainActive()->pcoinsTip->FinishBackgroundFlush(false))
+            return AbortNode(state, "Failed to write to coin database");
+        const bool fFlushing = pnetMan->getChainActive()->pcoinsTip->IsFlushingInBackground();
+        if (fPruneMode && fCheckForPruning && !fReindex)
+        {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty())
+            {
+                fFlushForPrune = true;
+                if (!fHavePruned)
+                {
+                    pnetMan->getChainActive()->pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
         int64_t nNow = GetTimeMicros();
         // Avoid writing/flushing immediately after startup.
         if (nLastWrite == 0)
@@ -1191,9 +2333,12 @@ bool FlushStateToDisk(CValidationState &state, FlushStateMode mode)
         {
             nLastSetChain = nNow;
         }
-        size_t cacheSize = pnetMan->getChainActive()->pcoinsTip->DynamicMemoryUsage();
+        // what a trim gave back to the pool of the cache is room for new coins
+        size_t cacheSize = pnetMan->getChainActive()->pcoinsTip->UsedMemoryUsage();
         // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0 / 9) > nCoinCacheUsage;
+        // Not while a background flush runs or right after one, which left the cache as small as it can get it.
+        bool fCacheLarge =
+            mode == FLUSH_STATE_PERIODIC && !fWasFlushing && cacheSize * (10.0 / 9) > nCoinCacheUsage;
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload
@@ -1204,7 +2349,8 @@ bool FlushStateToDisk(CValidationState &state, FlushStateMode mode)
         bool fPeriodicFlush =
             mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
-        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+        bool fDoFullFlush =
+            (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite)
         {
@@ -1212,7 +2358,8 @@ bool FlushStateToDisk(CValidationState &state, FlushStateMode mode)
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
-            FlushBlockFile();
+            if (!FlushBlockFile())
+                return AbortNode(state, "Failed to write block files");
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo *> > vFiles;
@@ -1246,11 +2393,33 @@ bool FlushStateToDisk(CValidationState &state, FlushStateMode mode)
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(128 * 2 * 2 * pnetMan->getChainActive()->pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // Flush the chainstate (which may refer to block index entries).
-            if (!pnetMan->getChainActive()->pcoinsTip->Flush())
-                return AbortNode(state, "Failed to write to coin database");
+            // Flush the chainstate (which may refer to block index entries). When there is time, the dirty coins
+            // are written in the background and the cache stays warm, validation does not have to wait for it.
+            if (mode == FLUSH_STATE_PERIODIC && !fFlushForPrune)
+            {
+                // One at a time, a cache that stays large would otherwise have every block wait for the last one
+                if (!fFlushing && !pnetMan->getChainActive()->pcoinsTip->FlushInBackground(
+                                      nCoinCacheUsage / 100 * COINS_CACHE_TRIM_PERCENT))
+                    return AbortNode(state, "Failed to write to coin database");
+            }
+            else
+            {
+                if (!pnetMan->getChainActive()->pcoinsTip->Flush())
+                    return AbortNode(state, "Failed to write to coin database");
+                // Everything left in the cache is clean now. If that is still over the limit, drop all of it and
+                // give its pool back at once, rather than having the next block flush again.
+                if (pnetMan->getChainActive()->pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage)
+                    pnetMan->getChainActive()->pcoinsTip->Clear();
+            }
             nLastFlush = nNow;
         }
+        // Finally remove any pruned files, nothing on disk refers to them any more
+        if (fFlushForPrune)
+            UnlinkPrunedFiles(setFilesToPrune);
+        if (fDoFullFlush || fPeriodicWrite)
+        {
+            TRACE5(utxocache, flush, GetTimeMicros() - nNow, (int)mode, cacheSize, fDoFullFlush, fFlushForPrune);
+        }
         if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) &&
                                 nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000))
         {
@@ -1272,6 +2441,16 @@ void FlushStateToDisk()
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    {
+        LOCK(cs_LastBlockFile);
+        fCheckForPruning = true;
+    }
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Delete all entries in setBlockIndexCandidates that are worse than the current tip. */
 void PruneBlockIndexCandidates()
 {
@@ -1292,10 +2471,18 @@ bool InvalidateBlock(CValidationState &state, const Consensus::Params &consensus
 {
     AssertLockHeld(cs_main);
 
-    // Mark the block itself as invalid.
+    // Mark the block itself as invalid, and its descendants as descending from it.
     pindex->nStatus |= BLOCK_FAILED_VALID;
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
+    {
+        READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
+        ForEachDescendant(pindex, [](CBlockIndex *pindexDescendant) {
+            pindexDescendant->nStatus |= BLOCK_FAILED_CHILD;
+            setDirtyBlockIndex.insert(pindexDescendant);
+            setBlockIndexCandidates.erase(pindexDescendant);
+        });
+    }
 
     while (pnetMan->getChainActive()->chainActive.Contains(pindex))
     {
@@ -1317,18 +2504,25 @@ bool InvalidateBlock(CValidationState &state, const Consensus::Params &consensus
         gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore, so
-    // add it again.
+    // add it again. Every block at least as good as the tip has at least its work, so only
+    // the branches down from the leaves as far as they have that much work are looked at.
     {
         READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
-        BlockMap::iterator it = pnetMan->getChainActive()->mapBlockIndex.begin();
-        while (it != pnetMan->getChainActive()->mapBlockIndex.end())
+        CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+        std::set<CBlockIndex *> setVisited;
+        for (CBlockIndex *pindexLeaf : pnetMan->getChainActive()->setBlockIndexLeaves)
         {
-            if (it->second->IsValid(BLOCK_VALID_TRANSACTIONS) && it->second->nChainTx &&
-                !setBlockIndexCandidates.value_comp()(it->second, pnetMan->getChainActive()->chainActive.Tip()))
+            for (CBlockIndex *pindexWalk = pindexLeaf; pindexWalk && pindexWalk->nChainWork >= pindexTip->nChainWork;
+                 pindexWalk = pindexWalk->pprev)
             {
-                setBlockIndexCandidates.insert(it->second);
+                if (!setVisited.insert(pindexWalk).second)
+                    break;
+                if (pindexWalk->IsValid(BLOCK_VALID_TRANSACTIONS) && pindexWalk->nChainTx &&
+                    !setBlockIndexCandidates.value_comp()(pindexWalk, pindexTip))
+                {
+                    setBlockIndexCandidates.insert(pindexWalk);
+                }
             }
-            it++;
         }
     }
 
@@ -1342,8 +2536,6 @@ bool ReconsiderBlock(CValidationState &state, CBlockIndex *pindex)
 {
     AssertLockHeld(cs_main);
 
-    int nHeight = pindex->nHeight;
-
     READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
     // Remove the invalidity flag from this block
     if (!pindex->IsValid())
@@ -1363,26 +2555,23 @@ bool ReconsiderBlock(CValidationState &state, CBlockIndex *pindex)
     }
 
     // Remove the invalidity flag from all descendants.
-    BlockMap::iterator it = pnetMan->getChainActive()->mapBlockIndex.begin();
-    while (it != pnetMan->getChainActive()->mapBlockIndex.end())
-    {
-        if (!it->second->IsValid() && it->second->GetAncestor(nHeight) == pindex)
+    ForEachDescendant(pindex, [](CBlockIndex *pindexDescendant) {
+        if (!pindexDescendant->IsValid())
         {
-            it->second->nStatus &= ~BLOCK_FAILED_MASK;
-            setDirtyBlockIndex.insert(it->second);
-            if (it->second->IsValid(BLOCK_VALID_TRANSACTIONS) && it->second->nChainTx &&
-                setBlockIndexCandidates.value_comp()(pnetMan->getChainActive()->chainActive.Tip(), it->second))
+            pindexDescendant->nStatus &= ~BLOCK_FAILED_MASK;
+            setDirtyBlockIndex.insert(pindexDescendant);
+            if (pindexDescendant->IsValid(BLOCK_VALID_TRANSACTIONS) && pindexDescendant->nChainTx &&
+                setBlockIndexCandidates.value_comp()(pnetMan->getChainActive()->chainActive.Tip(), pindexDescendant))
             {
-                setBlockIndexCandidates.insert(it->second);
+                setBlockIndexCandidates.insert(pindexDescendant);
             }
-            if (it->second == pindexBestInvalid)
+            if (pindexDescendant == pindexBestInvalid)
             {
                 // Reset invalid block marker if it was pointing to one of those.
                 pindexBestInvalid = NULL;
             }
         }
-        it++;
-    }
+    });
 
     // Remove the invalidity flag from all ancestors too.
     while (pindex != NULL)
@@ -1491,8 +2680,11 @@ bool FindBlockPos(CValidationState &state,
         {
             LogPrintf("Leaving block file %i: %s\n", nLastBlockFile, vinfoBlockFile[nLastBlockFile].ToString());
         }
-        FlushBlockFile(!fKnown);
+        if (!FlushBlockFile(!fKnown))
+            return AbortNode(state, "Failed to write block files");
         nLastBlockFile = nFile;
+        if (g_blockfilemapper)
+            g_blockfilemapper->SetFirstOpenFile(nLastBlockFile);
     }
 
     vinfoBlockFile[nFile].AddBlock(nHeight, nTime);
@@ -1517,6 +2709,8 @@ bool FindBlockPos(CValidationState &state,
                     AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
                     fclose(file);
                 }
+                if (fPruneMode)
+                    fCheckForPruning = true;
             }
             else
                 return state.Error("out of disk space");
@@ -1715,14 +2909,51 @@ bool IsSuperMajority(int minVersion,
     unsigned nRequired,
     const Consensus::Params &consensusParams)
 {
+    return CountBlockVersions(minVersion, pstart, consensusParams, nRequired) >= nRequired;
+}
+
+unsigned int CountBlockVersions(int minVersion,
+    const CBlockIndex *pstart,
+    const Consensus::Params &consensusParams,
+    unsigned int nStopAt)
+{
+    // block index entries count the versions of their window once, when they are added
+    const int nCounted = pstart ? pstart->GetVersionCount(minVersion, consensusParams.nMajorityWindow) : 0;
+    if (nCounted >= 0)
+        return nCounted;
     unsigned int nFound = 0;
-    for (int i = 0; i < consensusParams.nMajorityWindow && nFound < nRequired && pstart != NULL; i++)
+    for (int i = 0; i < consensusParams.nMajorityWindow && nFound < nStopAt && pstart != NULL; i++)
     {
         if (pstart->nVersion >= minVersion)
             ++nFound;
         pstart = pstart->pprev;
     }
-    return (nFound >= nRequired);
+    return nFound;
+}
+
+unsigned int GetBlockScriptFlags(int nVersion,
+    const CBlockIndex *pindexPrev,
+    const Consensus::Params &consensusParams)
+{
+    unsigned int flags = SCRIPT_VERIFY_P2SH;
+
+    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
+    // when 75% of the network has upgraded:
+    if (nVersion >= 3 && IsSuperMajority(3, pindexPrev, consensusParams.nMajorityEnforceBlockUpgrade, consensusParams))
+    {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
+    // blocks, when 75% of the network has upgraded:
+    if (nVersion >= 4 && IsSuperMajority(4, pindexPrev, consensusParams.nMajorityEnforceBlockUpgrade, consensusParams))
+    {
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    // Start enforcing BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    return flags;
 }
 
 
@@ -1738,6 +2969,9 @@ uint64_t CalculateCurrentUsage()
     {
         retval += file.nSize + file.nUndoSize;
     }
+    // the transactions kept from pruned blocks take the place of the files
+    if (fHavePruned && pnetMan->getChainActive()->pblocktree)
+        retval += pnetMan->getChainActive()->pblocktree->EstimatePrunedTxsSize();
     return retval;
 }
 
@@ -1842,28 +3076,25 @@ ThresholdState VersionBitsTipState(const Consensus::Params &params, Consensus::D
     return VersionBitsState(pnetMan->getChainActive()->chainActive.Tip(), params, pos, versionbitscache);
 }
 
-class CMainCleanup
-{
-public:
-    CMainCleanup() {}
-    ~CMainCleanup()
-    {
-        // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
-    }
-} instance_of_cmaincleanup;
-
 // ppcoin: find last block index up to pindex
 const CBlockIndex *GetLastBlockIndex(const CBlockIndex *pindex, bool fProofOfStake)
 {
     while (pindex && pindex->pprev && (pindex->IsProofOfStake() != fProofOfStake))
+    {
+        // headers that are not connected yet are walked, from a connected block on the links jump to the answer
+        if (pindex->fTypeLinks)
+        {
+            const CBlockIndex *pindexType = fProofOfStake ? pindex->pprevPoS : pindex->pprevPoW;
+            // without one the walk ends at the genesis block
+            return pindexType ? pindexType : pindex->GetAncestor(0);
+        }
         pindex = pindex->pprev;
+    }
     return pindex;
 }
 
 
-unsigned int GetNextTargetRequired(const CBlockIndex *pindexLast, bool fProofOfStake)
+static unsigned int ComputeNextTargetRequired(const CBlockIndex *pindexLast, bool fProofOfStake)
 {
     arith_uint256 bnTargetLimit = UintToArith256(pnetMan->getActivePaymentNetwork()->GetConsensus().powLimit);
 
@@ -1932,6 +3163,40 @@ unsigned int GetNextTargetRequired(const CBlockIndex *pindexLast, bool fProofOfS
     return bnNew.GetCompact();
 }
 
+/** The targets GetNextTargetRequired computed last, a minting cycle asks for the same ones over and over */
+struct CTargetCacheEntry
+{
+    uint256 hashLast;
+    bool fProofOfStake;
+    unsigned int nBits;
+};
+static const size_t TARGET_CACHE_SIZE = 8;
+static std::mutex cs_targetCache;
+static CTargetCacheEntry vTargetCache[TARGET_CACHE_SIZE];
+static size_t nTargetCacheNext = 0;
+
+unsigned int GetNextTargetRequired(const CBlockIndex *pindexLast, bool fProofOfStake)
+{
+    // the target only depends on the block and its ancestors, once they are connected their types do not change
+    // and a block hash always has the same answer. Headers that are not connected yet are computed every time.
+    if (pindexLast == NULL || pindexLast->phashBlock == NULL || !pindexLast->fTypeLinks)
+        return ComputeNextTargetRequired(pindexLast, fProofOfStake);
+    const uint256 &hashLast = pindexLast->GetBlockHash();
+    {
+        std::lock_guard<std::mutex> lock(cs_targetCache);
+        for (const CTargetCacheEntry &entry : vTargetCache)
+        {
+            if (entry.fProofOfStake == fProofOfStake && entry.hashLast == hashLast)
+                return entry.nBits;
+        }
+    }
+    const unsigned int nBits = ComputeNextTargetRequired(pindexLast, fProofOfStake);
+    std::lock_guard<std::mutex> lock(cs_targetCache);
+    vTargetCache[nTargetCacheNext] = {hashLast, fProofOfStake, nBits};
+    nTargetCacheNext = (nTargetCacheNext + 1) % TARGET_CACHE_SIZE;
+    return nBits;
+}
+
 int generateMTRandom(unsigned int s, int range)
 {
     std::mt19937 gen(s);
@@ -1981,7 +3246,7 @@ int64_t GetProofOfStakeReward(int64_t nCoinAge, int nHeight)
     if (CMS == MAX_MONEY)
     {
         // if we are already at max money supply limits (25 billion coins, we return 0 as no new coins are to be minted
-        LogPrint("kernel", "GetProofOfStakeReward(): create=%i nCoinAge=%d\n", 0, nCoinAge);
+        LogPrint(Logging::KERNEL, "GetProofOfStakeReward(): create=%i nCoinAge=%d\n", 0, nCoinAge);
         return 0;
     }
     if (nHeight > 500000 && nHeight < 1005000)
@@ -1997,7 +3262,8 @@ int64_t GetProofOfStakeReward(int64_t nCoinAge, int nHeight)
             nRewardCoinYear = 0;
         }
         int64_t nSubsidy = nCoinAge * nRewardCoinYear / 365;
-        LogPrint("kernel", "GetProofOfStakeReward(): create=%s nCoinAge=%d\n", FormatMoney(nSubsidy).c_str(), nCoinAge);
+        LogPrint(Logging::KERNEL, "GetProofOfStakeReward(): create=%s nCoinAge=%d\n", FormatMoney(nSubsidy).c_str(),
+            nCoinAge);
         return nSubsidy;
     }
 
@@ -2017,6 +3283,7 @@ int64_t GetProofOfStakeReward(int64_t nCoinAge, int nHeight)
             nSubsidy = nSubsidy - difference;
         }
     }
-    LogPrint("kernel", "GetProofOfStakeReward(): create=%s nCoinAge=%d\n", FormatMoney(nSubsidy).c_str(), nCoinAge);
+    LogPrint(Logging::KERNEL, "GetProofOfStakeReward(): create=%s nCoinAge=%d\n", FormatMoney(nSubsidy).c_str(),
+        nCoinAge);
     return nSubsidy;
 }
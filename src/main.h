@@ -34,7 +34,9 @@
 
 #include <algorithm>
 #include <exception>
+#include <limits>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -53,6 +55,7 @@ class CValidationInterface;
 class CValidationState;
 
 struct LockPoints;
+struct PrecomputedTransactionData;
 /** Default for returning change from tx back an address we already owned instead of a new one (try to select address
  * with most value in it). */
 static const bool DEFAULT_RETURN_CHANGE = false;
@@ -74,6 +77,14 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool, keep the mempool in mempool.dat across restarts */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Transactions LoadMempool() reads and validates together */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+/** Default for -persistcoinscache, read the coins that were cached at shutdown back into the cache on restart */
+static const bool DEFAULT_PERSIST_COINSCACHE = true;
+/** Outpoints LoadCoinsCache() reads from the coins database in one go */
+static const size_t COINSCACHE_LOAD_BATCH_SIZE = 1000;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -87,7 +98,14 @@ static const int MAX_SCRIPTCHECK_THREADS = 16;
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
-/** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
+/** Fewest blocks a peer gets in flight, however slow it is */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Blocks a peer gets in flight before we know how fast it delivers them */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** A peer gets as many blocks in flight as it delivers in this many microseconds */
+static const int64_t BLOCK_DOWNLOAD_QUOTA_TIME = 10 * 1000000;
+/** Timeout in seconds during which a peer must stall block download progress before the block it holds is
+ *  requested from a faster peer. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
@@ -101,6 +119,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 6;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 6;
+/** Percentage of the coins cache limit the clean coins are trimmed down to after a background flush */
+static const unsigned int COINS_CACHE_TRIM_PERCENT = 75;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -121,7 +141,13 @@ static const unsigned int DEFAULT_LIMITFREERELAY = 1000;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const unsigned int DEFAULT_BYTES_PER_SIGOP = 20;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -checkblockindexinterval */
+static const int64_t DEFAULT_CHECKBLOCKINDEX_INTERVAL = 0;
+/** How much work, in seconds at the current difficulty, must be on top of a block for -assumevalid to skip its scripts */
+static const int64_t ASSUMEVALID_MIN_BURIED_TIME = 60 * 60 * 24 * 7 * 2;
 static const bool DEFAULT_TXINDEX = true;
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -151,21 +177,31 @@ extern CWaitableCriticalSection csBestBlock;
 extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** True if the address index (-addressindex) and spent index (-spentindex) are kept in the block tree database. */
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+/** Number of bytes of block and undo files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+/** Set when block or undo files grew, the next FlushStateToDisk looks for files to prune. Protected by
+ *  cs_LastBlockFile. */
+extern bool fCheckForPruning;
 extern int nScriptCheckThreads;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
 extern bool fCheckBlockIndex;
+/** Seconds between the full checks of the block tree with -checkblockindex, 0 to check all of it every time */
+extern int64_t nCheckBlockIndexInterval;
 extern bool fCheckpointsEnabled;
+/** Scripts in ancestors of this block are not checked, if it is buried deep enough in the best header chain */
+extern uint256 hashAssumeValid;
 extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 
-struct COrphanTx
-{
-    CTransaction tx;
-    NodeId fromPeer;
-};
-
 struct CBlockIndexWorkComparator
 {
     bool operator()(CBlockIndex *pa, CBlockIndex *pb) const
@@ -196,10 +232,6 @@ struct CBlockIndexWorkComparator
 
 extern CBlockIndex *pindexBestInvalid;
 extern std::multimap<CBlockIndex *, CBlockIndex *> mapBlocksUnlinked;
-extern std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
-;
 void LimitMempoolSize(CTxMemPool &pool, size_t limit, unsigned long age);
 extern std::set<CBlockIndex *> setDirtyBlockIndex;
 extern ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
@@ -212,6 +244,15 @@ bool IsSuperMajority(int minVersion,
     const CBlockIndex *pstart,
     unsigned nRequired,
     const Consensus::Params &consensusParams);
+/** Blocks of at least minVersion in the majority window ending at pstart, counting stops at nStopAt */
+unsigned int CountBlockVersions(int minVersion,
+    const CBlockIndex *pstart,
+    const Consensus::Params &consensusParams,
+    unsigned int nStopAt = std::numeric_limits<unsigned int>::max());
+/** Script verification flags a block of version nVersion on top of pindexPrev is checked with */
+unsigned int GetBlockScriptFlags(int nVersion,
+    const CBlockIndex *pindexPrev,
+    const Consensus::Params &consensusParams);
 
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
@@ -272,10 +313,47 @@ extern int nPeersWithValidatedDownloads;
 
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+
+/** Calculate the amount of disk space the block & undo files and the transactions kept from pruned ones use */
+uint64_t CalculateCurrentUsage();
+/**
+ *  Mark one block file as pruned: its blocks lose their data and undo flags and positions. The transactions
+ *  of its blocks that staking can still read through GetTransaction are kept in the block tree database first,
+ *  until ConnectBlock spends their last unspent output in a block that can no longer be disconnected.
+ */
+bool PruneOneBlockFile(const int fileNumber);
+/** Actually unlink the specified files */
+void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune);
 
 bool AbortNode(CValidationState &state, const std::string &strMessage, const std::string &userMessage = "");
 
-/** (try to) add transaction to memory pool **/
+/** The stages AcceptToMemoryPool takes a transaction through, cheapest first */
+enum MempoolAcceptStage
+{
+    MEMPOOLSTAGE_CHECK, //! size, standardness and sigops of the transaction alone, without a lock
+    MEMPOOLSTAGE_POOL, //! finality, already in the pool, conflicts with it, without a coin
+    MEMPOOLSTAGE_FEE, //! fetch the coins and hold the fee against the pool minimum for the size
+    MEMPOOLSTAGE_INPUTS, //! sequence locks, input standardness, sigops, free relay, absurd fees and amounts
+    MEMPOOLSTAGE_SCRIPTS, //! scripts and signatures, without a lock
+    MEMPOOLSTAGE_COMMIT, //! the final conflict and chain limit checks and the pool trim
+    MEMPOOLSTAGE_COUNT
+};
+/** The name getmempoolrejects shows for a stage */
+const char *MempoolAcceptStageName(int nStage);
+
+/** The transactions each stage turned away since the node started, by reject reason */
+struct CMempoolRejectStats
+{
+    std::map<std::string, uint64_t> vReasons[MEMPOOLSTAGE_COUNT];
+};
+CMempoolRejectStats GetMempoolRejectStats();
+
+/** (try to) add transaction to memory pool
+ *  Takes cs_main itself, and releases it while the scripts are checked, so callers that do not hold
+ *  cs_main admit transactions concurrently. Only the final conflict check and the insertion are serialized.
+ **/
 bool AcceptToMemoryPool(CTxMemPool &pool,
     CValidationState &state,
     const CTransactionRef &tx,
@@ -284,6 +362,56 @@ bool AcceptToMemoryPool(CTxMemPool &pool,
     bool fOverrideMempoolLimit = false,
     bool fRejectAbsurdFee = false);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool &pool,
+    CValidationState &state,
+    const CTransactionRef &tx,
+    bool fLimitFree,
+    bool *pfMissingInputs,
+    int64_t nAcceptTime,
+    bool fOverrideMempoolLimit = false,
+    bool fRejectAbsurdFee = false);
+
+/** (try to) add many transactions to the memory pool at once, as AcceptToMemoryPool would one by one.
+ *  The script checks of all of them run together across the script check threads. Transactions may
+ *  spend each other in any order. vState, vAccepted and vMissingInputs get one entry per transaction,
+ *  the return value is the number accepted. Takes cs_main itself and not while the scripts are checked.
+ *  The transactions enter the mempool at pvAcceptTime, one time per transaction, if given, or else now.
+ */
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool &pool,
+    const std::vector<CTransactionRef> &vtx,
+    std::vector<CValidationState> &vState,
+    std::vector<bool> &vAccepted,
+    std::vector<bool> &vMissingInputs,
+    bool fLimitFree,
+    bool fRejectAbsurdFee = false,
+    const std::vector<int64_t> *pvAcceptTime = nullptr);
+
+/** Load the mempool from mempool.dat, revalidating every transaction with AcceptToMemoryPoolBatch.
+ *  Meant to run on a background thread once the node is up, the import thread does.
+ */
+bool LoadMempool();
+
+/** Dump the mempool, with entry times and PrioritiseTransaction deltas, to mempool.dat */
+bool DumpMempool();
+
+/** Read the coins of the outpoints in coinscache.dat into the coins cache, the inputs of the mempool first and
+ *  each part in key order, without holding cs_main. Stops once the cache takes half of -dbcache, the rest is left
+ *  for the blocks. Meant to run in the background once the node is up.
+ */
+bool LoadCoinsCache();
+
+/** Dump the outpoints of the unspent coins in the coins cache and of the inputs of the mempool to coinscache.dat */
+bool DumpCoinsCache();
+
+/** Load the signature and script execution caches, with their nonces, from sigcache.dat. Has to finish before
+ *  any script is checked, as it replaces the nonces.
+ */
+bool LoadSigCache();
+
+/** Dump the signature and script execution caches to sigcache.dat */
+bool DumpSigCache();
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -318,14 +446,16 @@ struct CDiskTxPos : public CDiskBlockPos
 
 
 /**
- * Count ECDSA signature operations the old-fashioned (pre-0.6) way
+ * Count ECDSA signature operations the old-fashioned (pre-0.6) way, once per transaction object
  * @return number of sigops this transaction's outputs will produce when spent
  * @see CTransaction::FetchInputs
  */
 unsigned int GetLegacySigOpCount(const CTransaction &tx);
 
 /**
- * Count ECDSA signature operations in pay-to-script-hash inputs.
+ * Count ECDSA signature operations in pay-to-script-hash inputs. The count is cached on the transaction once
+ * all of its inputs were found, so a transaction the mempool counted is not counted again when a block that
+ * shares it is connected or assembled.
  *
  * @param[in] mapInputs Map of previous transactions that have outputs we're spending
  * @return maximum number of sigops required to validate this transaction's inputs
@@ -347,6 +477,24 @@ bool CheckInputs(const CTransaction &tx,
     bool cacheStore,
     std::vector<CScriptCheck> *pvChecks = nullptr);
 
+/**
+ * The script and signature half of CheckInputs: verify every input of tx against the coin it spends
+ * in view. Needs no lock beyond what protects view, so it can run off cs_main against a private cache
+ * that already holds the coins. If pvChecks is not NULL, the checks are pushed onto it instead.
+ * A transaction that passed under the same flags before is not checked again. With cacheFullScriptStore,
+ * one that passes now (and was not merely queued onto pvChecks) is remembered.
+ */
+bool CheckInputScripts(const CTransaction &tx,
+    CValidationState &state,
+    const CCoinsViewCache &view,
+    unsigned int flags,
+    bool cacheStore,
+    bool cacheFullScriptStore,
+    std::vector<CScriptCheck> *pvChecks = nullptr);
+
+/** Bytes the script execution cache of CheckInputScripts takes */
+size_t GetScriptExecutionCacheUsage();
+
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction &tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight);
 void UpdateCoins(const CTransaction &tx,
@@ -408,6 +556,8 @@ protected:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    //! shared by the checks of all inputs of *ptxTo
+    std::shared_ptr<const PrecomputedTransactionData> txdata;
 
 public:
     CScriptCheck() : amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
@@ -416,9 +566,10 @@ public:
         const CTransaction &txToIn,
         unsigned int nInIn,
         unsigned int nFlagsIn,
-        bool cacheIn)
+        bool cacheIn,
+        const std::shared_ptr<const PrecomputedTransactionData> &txdataIn = nullptr)
         : scriptPubKey(scriptPubKeyIn), amount(amountIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn),
-          cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR)
+          cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn)
     {
     }
 
@@ -433,6 +584,7 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        txdata.swap(check.txdata);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -441,8 +593,15 @@ public:
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos, const CMessageHeader::MessageMagic &messageStart);
+/** Write a record with the data and size field StoreBlockData gave, which FindBlockPos made room for at pos */
+bool WriteBlockToDisk(const std::vector<unsigned char> &data,
+    uint32_t nSizeField,
+    CDiskBlockPos &pos,
+    const CMessageHeader::MessageMagic &messageStart);
 bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos, const Consensus::Params &consensusParams);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex, const Consensus::Params &consensusParams);
+/** Append the block at pos to strOut serialized as it is on disk, without deserializing or checking it */
+bool ReadRawBlockFromDisk(std::string &strOut, const CDiskBlockPos &pos);
 
 /** Functions for validating blocks and updating the block tree */
 
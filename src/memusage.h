@@ -20,6 +20,9 @@
 #ifndef BITCOIN_MEMUSAGE_H
 #define BITCOIN_MEMUSAGE_H
 
+#include "prevector.h"
+#include "support/allocators/pool.h"
+
 #include <stdlib.h>
 
 #include <map>
@@ -148,6 +151,12 @@ static inline size_t IncrementalDynamicUsage(const std::map<X, Y, Z> &m)
     return MallocUsage(sizeof(stl_tree_node<std::pair<const X, Y> >));
 }
 
+template <typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const std::multimap<X, Y, Z> &m)
+{
+    return MallocUsage(sizeof(stl_tree_node<std::pair<const X, Y> >)) * m.size();
+}
+
 template <typename X>
 static inline size_t DynamicUsage(const std::shared_ptr<X> &p)
 {
@@ -201,6 +210,16 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z> &m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() +
            MallocUsage(sizeof(void *) * m.bucket_count());
 }
+
+/** The nodes of a pool allocated map are in the chunks of its pool, freed ones included */
+template <typename X, typename Y, typename Z, typename E, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(
+    const std::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> > &m)
+{
+    const PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> *resource = m.get_allocator().resource();
+    return MallocUsage(resource->ChunkSizeBytes()) * resource->NumAllocatedChunks() +
+           MallocUsage(sizeof(void *) * m.bucket_count());
+}
 }
 
 #endif // BITCOIN_MEMUSAGE_H
@@ -24,30 +24,30 @@
 #include "crypto/hash.h"
 #include "util/utilstrencodings.h"
 
-CMerkleBlock::CMerkleBlock(const CBlock &block, CBloomFilter &filter)
+CMerkleBlock::CMerkleBlock(const CBlock &block, CBloomFilter &filter, const CMerkleTreeLevels *pLevels)
 {
     header = block.GetBlockHeader();
 
     std::vector<bool> vMatch;
     std::vector<uint256> vHashes;
 
-    vMatch.reserve(block.vtx.size());
-    vHashes.reserve(block.vtx.size());
+    vMatchedTxn.reserve(filter.IsRelevantAndUpdate(block.vtx, vMatch));
+    if (!pLevels)
+        vHashes.reserve(block.vtx.size());
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const uint256 &hash = block.vtx[i]->GetHash();
-        if (filter.IsRelevantAndUpdate(*block.vtx[i]))
-        {
-            vMatch.push_back(true);
+        if (vMatch[i])
             vMatchedTxn.push_back(std::make_pair(i, hash));
-        }
-        else
-            vMatch.push_back(false);
-        vHashes.push_back(hash);
+        if (!pLevels)
+            vHashes.push_back(hash);
     }
 
-    txn = CPartialMerkleTree(vHashes, vMatch);
+    if (pLevels)
+        txn = CPartialMerkleTree(*pLevels, vMatch);
+    else
+        txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
 CMerkleBlock::CMerkleBlock(const CBlock &block, const std::set<uint256> &txids)
@@ -73,6 +73,31 @@ CMerkleBlock::CMerkleBlock(const CBlock &block, const std::set<uint256> &txids)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleTreeLevels::CMerkleTreeLevels(const std::vector<uint256> &vTxid)
+{
+    vLevels.push_back(vTxid);
+    while (vLevels.back().size() > 1)
+    {
+        const std::vector<uint256> &below = vLevels.back();
+        std::vector<uint256> level((below.size() + 1) / 2);
+        for (unsigned int pos = 0; pos < level.size(); pos++)
+        {
+            const uint256 &left = below[pos * 2];
+            const uint256 &right = pos * 2 + 1 < below.size() ? below[pos * 2 + 1] : left;
+            level[pos] = Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+        }
+        vLevels.push_back(std::move(level));
+    }
+}
+
+size_t CMerkleTreeLevels::GetHashCount() const
+{
+    size_t nCount = 0;
+    for (const std::vector<uint256> &level : vLevels)
+        nCount += level.size();
+    return nCount;
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid)
 {
     if (height == 0)
@@ -97,7 +122,8 @@ uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::ve
 void CPartialMerkleTree::TraverseAndBuild(int height,
     unsigned int pos,
     const std::vector<uint256> &vTxid,
-    const std::vector<bool> &vMatch)
+    const std::vector<bool> &vMatch,
+    const CMerkleTreeLevels *pLevels)
 {
     // determine whether this node is the parent of at least one matched txid
     bool fParentOfMatch = false;
@@ -108,14 +134,14 @@ void CPartialMerkleTree::TraverseAndBuild(int height,
     if (height == 0 || !fParentOfMatch)
     {
         // if at height 0, or nothing interesting below, store hash and stop
-        vHash.push_back(CalcHash(height, pos, vTxid));
+        vHash.push_back(pLevels ? pLevels->Get(height, pos) : CalcHash(height, pos, vTxid));
     }
     else
     {
         // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height - 1, pos * 2, vTxid, vMatch);
+        TraverseAndBuild(height - 1, pos * 2, vTxid, vMatch, pLevels);
         if (pos * 2 + 1 < CalcTreeWidth(height - 1))
-            TraverseAndBuild(height - 1, pos * 2 + 1, vTxid, vMatch);
+            TraverseAndBuild(height - 1, pos * 2 + 1, vTxid, vMatch, pLevels);
     }
 }
 
@@ -185,6 +211,13 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
     TraverseAndBuild(nHeight, 0, vTxid, vMatch);
 }
 
+CPartialMerkleTree::CPartialMerkleTree(const CMerkleTreeLevels &levels, const std::vector<bool> &vMatch)
+    : nTransactions(levels.vLevels[0].size()), fBad(false)
+{
+    // the levels above the txids are the heights of the tree
+    TraverseAndBuild(levels.vLevels.size() - 1, 0, levels.vLevels[0], vMatch, &levels);
+}
+
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
 uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch)
 {
@@ -26,6 +26,22 @@
 
 #include <vector>
 
+/**
+ * Every level of the merkle tree of a block, the txids at height 0 and the root at the top. A node without a right
+ * sibling is hashed with itself, as in CPartialMerkleTree. Built once for a block, it lets the partial trees of
+ * many filtered peers take their hashes from it instead of recomputing them.
+ */
+class CMerkleTreeLevels
+{
+public:
+    std::vector<std::vector<uint256> > vLevels;
+
+    explicit CMerkleTreeLevels(const std::vector<uint256> &vTxid);
+
+    const uint256 &Get(int height, unsigned int pos) const { return vLevels[height][pos]; }
+    size_t GetHashCount() const;
+};
+
 /** Data structure that represents a partial merkle tree.
  *
  * It represents a subset of the txid's of a known block, in a way that
@@ -84,7 +100,8 @@ protected:
     void TraverseAndBuild(int height,
         unsigned int pos,
         const std::vector<uint256> &vTxid,
-        const std::vector<bool> &vMatch);
+        const std::vector<bool> &vMatch,
+        const CMerkleTreeLevels *pLevels = nullptr);
 
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
@@ -126,6 +143,8 @@ public:
 
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+    /** The same with the hashes of the nodes taken from the levels of the whole tree */
+    CPartialMerkleTree(const CMerkleTreeLevels &levels, const std::vector<bool> &vMatch);
 
     CPartialMerkleTree();
 
@@ -155,9 +174,9 @@ public:
     /**
      * Create from a CBlock, filtering transactions according to filter
      * Note that this will call IsRelevantAndUpdate on the filter for each transaction,
-     * thus the filter will likely be modified.
+     * thus the filter will likely be modified. pLevels, when set, are the levels of the tree of block.
      */
-    CMerkleBlock(const CBlock &block, CBloomFilter &filter);
+    CMerkleBlock(const CBlock &block, CBloomFilter &filter, const CMerkleTreeLevels *pLevels = nullptr);
 
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock &block, const std::set<uint256> &txids);
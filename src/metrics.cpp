@@ -0,0 +1,139 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "httprpc.h"
+
+#include "chain/chainman.h"
+#include "httpserver.h"
+#include "main.h"
+#include "net/net.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "rpc/rpcprotocol.h"
+#include "tinyformat.h"
+#include "txmempool.h"
+
+#include <string>
+
+/**
+ * /metrics serves the state of the node in the Prometheus text format. Every value is read without cs_main, the
+ * mempool lock or cs_vNodes: the tip, the coins cache and the block connect times as they were published with the
+ * last tip, the mempool as of its last change and the peers as the socket handler last counted them. A scrape
+ * never waits for validation and never holds it up.
+ */
+
+namespace
+{
+class CMetricsWriter
+{
+public:
+    std::string strOut;
+
+    void Head(const std::string &strName, const std::string &strType, const std::string &strHelp)
+    {
+        strOut += "# HELP " + strName + " " + strHelp + "\n";
+        strOut += "# TYPE " + strName + " " + strType + "\n";
+    }
+    template <typename T>
+    void Value(const std::string &strName, const T &value, const std::string &strLabels = "")
+    {
+        strOut += strName + (strLabels.empty() ? "" : "{" + strLabels + "}") + " " + tfm::format("%d", value) + "\n";
+    }
+    template <typename T>
+    void Gauge(const std::string &strName, const std::string &strHelp, const T &value)
+    {
+        Head(strName, "gauge", strHelp);
+        Value(strName, value);
+    }
+    template <typename T>
+    void Counter(const std::string &strName, const std::string &strHelp, const T &value)
+    {
+        Head(strName, "counter", strHelp);
+        Value(strName, value);
+    }
+};
+
+void WriteChainMetrics(CMetricsWriter &writer)
+{
+    const CChainTipRef tip = pnetMan->getChainActive()->GetPublishedTip();
+    writer.Gauge("eccoin_tip_height", "Height of the tip of the active chain", tip->nHeight);
+    writer.Gauge("eccoin_tip_time_seconds", "Block time of the tip", tip->nTime);
+    writer.Gauge("eccoin_initial_block_download", "1 while the node is in initial block download",
+        tip->fInitialBlockDownload ? 1 : 0);
+    writer.Gauge("eccoin_coins_cache_usage_bytes", "Memory the coins cache uses", tip->nCoinsCacheUsage);
+    writer.Gauge("eccoin_coins_cache_coins", "Coins in the coins cache", tip->nCoinsCacheSize);
+
+    uint64_t nTxs, nBytes, nUsage;
+    mempool.GetPublishedSize(nTxs, nBytes, nUsage);
+    writer.Gauge("eccoin_mempool_transactions", "Transactions in the mempool", nTxs);
+    writer.Gauge("eccoin_mempool_bytes", "Serialized size of the transactions in the mempool", nBytes);
+    writer.Gauge("eccoin_mempool_usage_bytes", "Memory the mempool uses", nUsage);
+
+    const CBlockConnectTimes times = GetPublishedBlockConnectTimes();
+    writer.Counter("eccoin_blocks_connected_total", "Blocks connected to the tip", times.nBlocks);
+    writer.Counter("eccoin_block_inputs_verified_total", "Inputs of the transactions of connected blocks",
+        times.nInputs);
+    const std::string strStages = "eccoin_block_connect_seconds_total";
+    writer.Head(strStages, "counter", "Time spent in the stages of connecting blocks, verify includes connect");
+    const std::pair<const char *, int64_t> vStages[] = {{"read", times.nReadFromDisk},
+        {"connect_total", times.nConnectTotal}, {"check", times.nCheck}, {"forks", times.nForks},
+        {"connect", times.nConnect}, {"verify", times.nVerify}, {"index", times.nIndex},
+        {"callbacks", times.nCallbacks}, {"flush", times.nFlush}, {"chainstate", times.nChainState},
+        {"postconnect", times.nPostConnect}, {"total", times.nTotal}};
+    for (const auto &stage : vStages)
+        writer.strOut += strprintf("%s{stage=\"%s\"} %.6f\n", strStages, stage.first, stage.second * 0.000001);
+}
+
+void WriteNetMetrics(CMetricsWriter &writer)
+{
+    if (!g_connman)
+        return;
+    size_t nInbound, nOutbound;
+    g_connman->GetPublishedNodeCounts(nInbound, nOutbound);
+    writer.Head("eccoin_peers", "gauge", "Connected peers");
+    writer.Value("eccoin_peers", nInbound, "direction=\"inbound\"");
+    writer.Value("eccoin_peers", nOutbound, "direction=\"outbound\"");
+    writer.Counter("eccoin_net_received_bytes_total", "Bytes received from peers", g_connman->GetTotalBytesRecv());
+    writer.Counter("eccoin_net_sent_bytes_total", "Bytes sent to peers", g_connman->GetTotalBytesSent());
+}
+
+void WriteHTTPMetrics(CMetricsWriter &writer)
+{
+    // the work queues only lock themselves, and only to copy their counters
+    const std::vector<HTTPWorkQueueStats> vStats = GetHTTPWorkQueueStats();
+    writer.Head("eccoin_http_queue_depth", "gauge", "Requests waiting in the work queue of the HTTP server");
+    for (const HTTPWorkQueueStats &stats : vStats)
+        writer.Value("eccoin_http_queue_depth", stats.nDepth, "queue=\"" + stats.name + "\"");
+    writer.Head("eccoin_http_requests_total", "counter", "Requests the work queue handled");
+    for (const HTTPWorkQueueStats &stats : vStats)
+        writer.Value("eccoin_http_requests_total", stats.nProcessed, "queue=\"" + stats.name + "\"");
+    writer.Head("eccoin_http_rejected_total", "counter", "Requests turned away because the work queue was full");
+    for (const HTTPWorkQueueStats &stats : vStats)
+        writer.Value("eccoin_http_rejected_total", stats.nRejected, "queue=\"" + stats.name + "\"");
+}
+
+bool HTTPReq_Metrics(HTTPRequest *req, const std::string &)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET)
+    {
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET requests allowed");
+        return false;
+    }
+    CMetricsWriter writer;
+    WriteChainMetrics(writer);
+    WriteNetMetrics(writer);
+    WriteHTTPMetrics(writer);
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, writer.strOut);
+    return true;
+}
+}
+
+bool StartHTTPMetrics()
+{
+    RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics, HTTP_PRIORITY_FAST);
+    return true;
+}
+
+void StopHTTPMetrics() { UnregisterHTTPHandler("/metrics", true); }
@@ -21,6 +21,7 @@
 #include "addrdb.h"
 
 #include "clientversion.h"
+#include "compat.h"
 #include "crypto/hash.h"
 #include "init.h"
 #include "net/addrman.h"
@@ -31,20 +32,95 @@
 
 #include <boost/filesystem.hpp>
 
-CBanDB::CBanDB() { pathBanlist = GetDataDir() / "banlist.dat"; }
-bool CBanDB::Write(const banmap_t &banSet)
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+/** A file mapped read only into memory, so loading it does not copy it into a buffer first.
+ *  Where it can not be mapped it is read in whole.
+ */
+class CReadOnlyFile
+{
+public:
+    CReadOnlyFile() : pMapped(nullptr), nSize(0) {}
+    ~CReadOnlyFile()
+    {
+#ifndef WIN32
+        if (pMapped)
+            munmap(pMapped, nSize);
+#endif
+    }
+    CReadOnlyFile(const CReadOnlyFile &) = delete;
+    CReadOnlyFile &operator=(const CReadOnlyFile &) = delete;
+
+    bool Open(const fs::path &path)
+    {
+#ifndef WIN32
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        nSize = st.st_size;
+        if (nSize > 0)
+        {
+            void *p = mmap(nullptr, nSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                pMapped = p;
+                // the file is deserialized front to back exactly once
+                posix_madvise(pMapped, nSize, POSIX_MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+        if (pMapped || nSize == 0)
+            return true;
+#endif
+        FILE *file = fopen(path.string().c_str(), "rb");
+        if (!file)
+            return false;
+        nSize = fs::file_size(path);
+        vchData.resize(nSize);
+        bool fRead = nSize == 0 || fread(vchData.data(), 1, nSize, file) == nSize;
+        fclose(file);
+        return fRead;
+    }
+
+    const uint8_t *data() const { return pMapped ? (const uint8_t *)pMapped : vchData.data(); }
+    size_t size() const { return nSize; }
+
+private:
+    void *pMapped;
+    size_t nSize;
+    std::vector<uint8_t> vchData;
+};
+
+/** Write the network magic, data and a checksum of both to a temporary file and rename it over
+ *  path. If phashLast holds the checksum the data has now the file already has this data and
+ *  is left alone, otherwise it is set to the checksum written.
+ */
+template <typename Data>
+bool SerializeFileDB(const std::string &prefix, const fs::path &path, const Data &data, uint256 *phashLast)
 {
+    // serialize data, checksum data up to that point, then append csum
+    CDataStream ssData(SER_DISK, CLIENT_VERSION);
+    ssData << FLATDATA(pnetMan->getActivePaymentNetwork()->MessageStart());
+    ssData << data;
+    uint256 hash = Hash(ssData.begin(), ssData.end());
+    if (phashLast && *phashLast == hash)
+        return true;
+    ssData << hash;
+
     // Generate random temporary filename
     unsigned short randv = 0;
     GetRandBytes((uint8_t *)&randv, sizeof(randv));
-    std::string tmpfn = strprintf("banlist.dat.%04x", randv);
-
-    // serialize banlist, checksum data up to that point, then append csum
-    CDataStream ssBanlist(SER_DISK, CLIENT_VERSION);
-    ssBanlist << FLATDATA(pnetMan->getActivePaymentNetwork()->MessageStart());
-    ssBanlist << banSet;
-    uint256 hash = Hash(ssBanlist.begin(), ssBanlist.end());
-    ssBanlist << hash;
+    std::string tmpfn = strprintf("%s.%04x", prefix, randv);
 
     // open temp output file, and associate with CAutoFile
     fs::path pathTmp = GetDataDir() / tmpfn;
@@ -56,7 +132,7 @@ bool CBanDB::Write(const banmap_t &banSet)
     // Write and commit header, data
     try
     {
-        fileout << ssBanlist;
+        fileout << ssData;
     }
     catch (const std::exception &e)
     {
@@ -65,55 +141,23 @@ bool CBanDB::Write(const banmap_t &banSet)
     FileCommit(fileout.Get());
     fileout.fclose();
 
-    // replace existing banlist.dat, if any, with new banlist.dat.XXXX
-    if (!RenameOver(pathTmp, pathBanlist))
+    // replace existing file, if any, with the new one
+    if (!RenameOver(pathTmp, path))
         return error("%s: Rename-into-place failed", __func__);
 
+    if (phashLast)
+        *phashLast = hash;
     return true;
 }
 
-bool CBanDB::Read(banmap_t &banSet)
+template <typename Stream, typename Data>
+bool DeserializeDB(Stream &stream, Data &data)
 {
-    // open input file, and associate with CAutoFile
-    FILE *file = fopen(pathBanlist.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: Failed to open file %s", __func__, pathBanlist.string());
-
-    // use file size to size memory buffer
-    uint64_t fileSize = fs::file_size(pathBanlist);
-    uint64_t dataSize = 0;
-    // Don't try to resize to a negative number if file is small
-    if (fileSize >= sizeof(uint256))
-        dataSize = fileSize - sizeof(uint256);
-    std::vector<uint8_t> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try
-    {
-        filein.read((char *)&vchData[0], dataSize);
-        filein >> hashIn;
-    }
-    catch (const std::exception &e)
-    {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-    }
-    filein.fclose();
-
-    CDataStream ssBanlist(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssBanlist.begin(), ssBanlist.end());
-    if (hashIn != hashTmp)
-        return error("%s: Checksum mismatch, data corrupted", __func__);
-
     uint8_t pchMsgTmp[4];
     try
     {
         // de-serialize file header (network specific magic number) and ..
-        ssBanlist >> FLATDATA(pchMsgTmp);
+        stream >> FLATDATA(pchMsgTmp);
 
         // ... verify the network matches ours
         if (memcmp(pchMsgTmp, std::begin(pnetMan->getActivePaymentNetwork()->MessageStart()), sizeof(pchMsgTmp)))
@@ -121,8 +165,7 @@ bool CBanDB::Read(banmap_t &banSet)
             return error("%s: Invalid network magic number", __func__);
         }
 
-        // de-serialize ban data
-        ssBanlist >> banSet;
+        stream >> data;
     }
     catch (const std::exception &e)
     {
@@ -132,110 +175,66 @@ bool CBanDB::Read(banmap_t &banSet)
     return true;
 }
 
-CAddrDB::CAddrDB() { pathAddr = GetDataDir() / "peers.dat"; }
-bool CAddrDB::Write(const CAddrMan &addr)
+/** Verify the checksum at the end of the file at path and deserialize data straight out of the
+ *  mapped file
+ */
+template <typename Data>
+bool DeserializeFileDB(const fs::path &path, Data &data)
 {
-    // Generate random temporary filename
-    unsigned short randv = 0;
-    GetRandBytes((uint8_t *)&randv, sizeof(randv));
-    std::string tmpfn = strprintf("peers.dat.%04x", randv);
+    CReadOnlyFile file;
+    if (!file.Open(path))
+        return error("%s: Failed to open file %s", __func__, path.string());
 
-    // serialize addresses, checksum data up to that point, then append csum
-    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
-    ssPeers << FLATDATA(pnetMan->getActivePaymentNetwork()->MessageStart());
-    ssPeers << addr;
-    uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
-    ssPeers << hash;
+    // a file too short for the checksum fails the check below
+    size_t nDataSize = file.size() >= sizeof(uint256) ? file.size() - sizeof(uint256) : 0;
+    uint256 hashIn;
+    if (file.size() >= sizeof(uint256))
+        memcpy(hashIn.begin(), file.data() + nDataSize, sizeof(uint256));
 
-    // open temp output file, and associate with CAutoFile
-    fs::path pathTmp = GetDataDir() / tmpfn;
-    FILE *file = fopen(pathTmp.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    // verify stored checksum matches input data
+    uint256 hashTmp = Hash(file.data(), file.data() + nDataSize);
+    if (hashIn != hashTmp)
+        return error("%s: Checksum mismatch, data corrupted", __func__);
 
-    // Write and commit header, data
-    try
-    {
-        fileout << ssPeers;
-    }
-    catch (const std::exception &e)
-    {
-        return error("%s: Serialize or I/O error - %s", __func__, e.what());
-    }
-    FileCommit(fileout.Get());
-    fileout.fclose();
+    CMemoryReader stream(SER_DISK, CLIENT_VERSION, file.data(), file.data() + nDataSize);
+    return DeserializeDB(stream, data);
+}
+} // namespace
 
-    // replace existing peers.dat, if any, with new peers.dat.XXXX
-    if (!RenameOver(pathTmp, pathAddr))
-        return error("%s: Rename-into-place failed", __func__);
+CBanDB::CBanDB() { pathBanlist = GetDataDir() / "banlist.dat"; }
+bool CBanDB::Write(const banmap_t &banSet) { return SerializeFileDB("banlist.dat", pathBanlist, banSet, nullptr); }
+bool CBanDB::Read(banmap_t &banSet) { return DeserializeFileDB(pathBanlist, banSet); }
+CDNSSeedDB::CDNSSeedDB() { pathSeeds = GetDataDir() / "dnsseeds.dat"; }
+bool CDNSSeedDB::Write(const dnsseedcache_t &seeds)
+{
+    return SerializeFileDB("dnsseeds.dat", pathSeeds, seeds, nullptr);
+}
 
-    return true;
+bool CDNSSeedDB::Read(dnsseedcache_t &seeds) { return DeserializeFileDB(pathSeeds, seeds); }
+CAddrDB::CAddrDB() { pathAddr = GetDataDir() / "peers.dat"; }
+bool CAddrDB::Write(const CAddrMan &addr, uint256 *phashLast)
+{
+    return SerializeFileDB("peers.dat", pathAddr, addr, phashLast);
 }
 
 bool CAddrDB::Read(CAddrMan &addr)
 {
-    // open input file, and associate with CAutoFile
-    FILE *file = fopen(pathAddr.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: Failed to open file %s", __func__, pathAddr.string());
-
-    // use file size to size memory buffer
-    uint64_t fileSize = fs::file_size(pathAddr);
-    uint64_t dataSize = 0;
-    // Don't try to resize to a negative number if file is small
-    if (fileSize >= sizeof(uint256))
-        dataSize = fileSize - sizeof(uint256);
-    std::vector<uint8_t> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try
-    {
-        filein.read((char *)&vchData[0], dataSize);
-        filein >> hashIn;
-    }
-    catch (const std::exception &e)
+    if (!DeserializeFileDB(pathAddr, addr))
     {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        // de-serialization has failed, ensure addrman is left in a clean state
+        addr.Clear();
+        return false;
     }
-    filein.fclose();
-
-    CDataStream ssPeers(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssPeers.begin(), ssPeers.end());
-    if (hashIn != hashTmp)
-        return error("%s: Checksum mismatch, data corrupted", __func__);
-
-    return Read(addr, ssPeers);
+    return true;
 }
 
 bool CAddrDB::Read(CAddrMan &addr, CDataStream &ssPeers)
 {
-    uint8_t pchMsgTmp[4];
-    try
-    {
-        // de-serialize file header (network specific magic number) and ..
-        ssPeers >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, std::begin(pnetMan->getActivePaymentNetwork()->MessageStart()), sizeof(pchMsgTmp)))
-        {
-            return error("%s: Invalid network magic number", __func__);
-        }
-
-        // de-serialize address data into one CAddrMan object
-        ssPeers >> addr;
-    }
-    catch (const std::exception &e)
+    if (!DeserializeDB(ssPeers, addr))
     {
         // de-serialization has failed, ensure addrman is left in a clean state
         addr.Clear();
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        return false;
     }
-
     return true;
 }
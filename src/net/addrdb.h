@@ -22,14 +22,17 @@
 #define BITCOIN_ADDRDB_H
 
 #include "fs.h"
+#include "net/netaddress.h"
 #include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
 
 #include <map>
 #include <string>
+#include <vector>
 
 class CSubNet;
 class CAddrMan;
-class CDataStream;
 
 typedef enum BanReason { BanReasonUnknown = 0, BanReasonNodeMisbehaving = 1, BanReasonManuallyAdded = 2 } BanReason;
 
@@ -84,6 +87,33 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
+/** What a DNS seed resolved to, kept so a restart can use it without asking the seed again */
+class CDNSSeedCacheEntry
+{
+public:
+    int64_t nResolveTime;
+    //! the service bits the host name was asked for
+    uint64_t nServices;
+    std::vector<CNetAddr> vIPs;
+    //! what the addresses are added to addrman as coming from
+    CService source;
+
+    CDNSSeedCacheEntry() : nResolveTime(0), nServices(0) {}
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(nResolveTime);
+        READWRITE(nServices);
+        READWRITE(vIPs);
+        READWRITE(source);
+    }
+};
+
+//! by the host name that was resolved
+typedef std::map<std::string, CDNSSeedCacheEntry> dnsseedcache_t;
+
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
 {
@@ -92,7 +122,10 @@ private:
 
 public:
     CAddrDB();
-    bool Write(const CAddrMan &addr);
+    /** Write addr to peers.dat. If phashLast is given and peers.dat already holds what addr
+     *  serializes to, going by the checksum of the last write kept there, nothing is written.
+     */
+    bool Write(const CAddrMan &addr, uint256 *phashLast = nullptr);
     bool Read(CAddrMan &addr);
     bool Read(CAddrMan &addr, CDataStream &ssPeers);
 };
@@ -109,4 +142,16 @@ public:
     bool Read(banmap_t &banSet);
 };
 
+/** Access to the DNS seed results of the last startup (dnsseeds.dat) */
+class CDNSSeedDB
+{
+private:
+    fs::path pathSeeds;
+
+public:
+    CDNSSeedDB();
+    bool Write(const dnsseedcache_t &seeds);
+    bool Read(dnsseedcache_t &seeds);
+};
+
 #endif // BITCOIN_ADDRDB_H
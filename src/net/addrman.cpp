@@ -150,6 +150,24 @@ void CAddrMan::Delete(int nId)
     nNew--;
 }
 
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    vvNew[nUBucket][nUBucketPos] = nId;
+    if (nId == -1)
+        newPositions.Remove(nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos);
+    else
+        newPositions.Add(nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos);
+}
+
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    vvTried[nKBucket][nKBucketPos] = nId;
+    if (nId == -1)
+        triedPositions.Remove(nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos);
+    else
+        triedPositions.Add(nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos);
+}
+
 void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
 {
     // if there is an entry in the specified bucket, delete it.
@@ -159,7 +177,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo &infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0)
         {
             Delete(nIdDelete);
@@ -175,7 +193,7 @@ void CAddrMan::MakeTried(CAddrInfo &info, int nId)
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId)
         {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -198,7 +216,7 @@ void CAddrMan::MakeTried(CAddrInfo &info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -209,12 +227,12 @@ void CAddrMan::MakeTried(CAddrInfo &info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -268,7 +286,7 @@ void CAddrMan::Good_(const CService &addr, int64_t nTime)
     if (nUBucket == -1)
         return;
 
-    LogPrint("addrman", "Moving %s to tried\n", addr.ToString());
+    LogPrint(Logging::ADDRMAN, "Moving %s to tried\n", addr.ToString());
 
     // move nId to the tried tables
     MakeTried(info, nId);
@@ -346,7 +364,7 @@ bool CAddrMan::Add_(const CAddress &addr, const CNetAddr &source, int64_t nTimeP
         {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         }
         else
         {
@@ -392,51 +410,24 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         return CAddrInfo();
 
     // Use a 50% chance for choosing between tried and new table entries.
-    if (!newOnly && (nTried > 0 && (nNew == 0 || RandomInt(2) == 0)))
+    const bool fTried = !newOnly && (nTried > 0 && (nNew == 0 || RandomInt(2) == 0));
+    const CAddrTablePositions &positions = fTried ? triedPositions : newPositions;
+    assert(positions.size() > 0);
+
+    // An occupied position is picked directly, and accepted with the chance of its entry. fChanceFactor grows until
+    // even the least likely entry (GetChance is above 1 / 3000) is accepted, which takes at most about 45 rounds.
+    double fChanceFactor = 1.0;
+    while (1)
     {
-        // use a tried node
-        double fChanceFactor = 1.0;
-        while (1)
-        {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1)
-            {
-                nKBucket =
-                    (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo &info = mapInfo[nId];
-            if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
-            {
-                return info;
-            }
-            fChanceFactor *= 1.2;
-        }
-    }
-    else
-    {
-        // use a new node
-        double fChanceFactor = 1.0;
-        while (1)
-        {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1)
-            {
-                nUBucket =
-                    (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo &info = mapInfo[nId];
-            if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
-                return info;
-            fChanceFactor *= 1.2;
-        }
+        const int nPosition = positions[RandomInt(positions.size())];
+        const int nBucket = nPosition / ADDRMAN_BUCKET_SIZE;
+        const int nBucketPos = nPosition % ADDRMAN_BUCKET_SIZE;
+        const int nId = fTried ? vvTried[nBucket][nBucketPos] : vvNew[nBucket][nBucketPos];
+        assert(mapInfo.count(nId) == 1);
+        CAddrInfo &info = mapInfo[nId];
+        if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
+            return info;
+        fChanceFactor *= 1.2;
     }
 }
 
@@ -483,6 +474,8 @@ int CAddrMan::Check_()
         return -9;
     if (mapNew.size() != nNew)
         return -10;
+    if (triedPositions.size() != nTried)
+        return -20;
 
     for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++)
     {
@@ -590,4 +583,4 @@ void CAddrMan::SetServices_(const CService &addr, ServiceFlags nServices)
     info.nServices = nServices;
 }
 
-int CAddrMan::RandomInt(int nMax) { return GetRandInt(nMax); }
+int CAddrMan::RandomInt(int nMax) { return GetFastRand(nMax); }
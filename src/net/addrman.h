@@ -19,6 +19,7 @@
 #ifndef BITCOIN_ADDRMAN_H
 #define BITCOIN_ADDRMAN_H
 
+#include "memusage.h"
 #include "net/netbase.h"
 #include "net/protocol.h"
 #include "random.h"
@@ -27,6 +28,7 @@
 #include "util/logger.h"
 #include "util/util.h"
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -194,6 +196,51 @@ public:
 #define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
 #define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
 
+/**
+ * The positions of an addrman table that hold an entry, numbered bucket * ADDRMAN_BUCKET_SIZE + position, so a
+ * random one is picked in constant time however sparse the table is.
+ */
+class CAddrTablePositions
+{
+private:
+    //! the occupied positions, in no particular order
+    std::vector<int> vOccupied;
+    //! the index in vOccupied of every position of the table, -1 for an empty one
+    std::vector<int> vIndex;
+
+public:
+    explicit CAddrTablePositions(int nPositions) : vIndex(nPositions, -1) {}
+    void Add(int nPosition)
+    {
+        if (vIndex[nPosition] != -1)
+            return;
+        vIndex[nPosition] = vOccupied.size();
+        vOccupied.push_back(nPosition);
+    }
+
+    void Remove(int nPosition)
+    {
+        const int nIndex = vIndex[nPosition];
+        if (nIndex == -1)
+            return;
+        // the last one takes the place of the removed one
+        vOccupied[nIndex] = vOccupied.back();
+        vIndex[vOccupied[nIndex]] = nIndex;
+        vOccupied.pop_back();
+        vIndex[nPosition] = -1;
+    }
+
+    void Clear()
+    {
+        vOccupied.clear();
+        std::fill(vIndex.begin(), vIndex.end(), -1);
+    }
+
+    int size() const { return vOccupied.size(); }
+    int operator[](int n) const { return vOccupied[n]; }
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vOccupied) + memusage::DynamicUsage(vIndex); }
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -221,12 +268,18 @@ private:
     //! list of "tried" buckets
     int vvTried[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! the positions of vvTried that hold an entry
+    CAddrTablePositions triedPositions;
+
     //! number of (unique) "new" entries
     int nNew;
 
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! the positions of vvNew that hold an entry
+    CAddrTablePositions newPositions;
+
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
@@ -247,6 +300,10 @@ protected:
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2);
 
+    //! Set a position of a table to nId, -1 to empty it. Entries are only stored in the tables through these.
+    void SetNew(int nUBucket, int nUBucketPos, int nId);
+    void SetTried(int nKBucket, int nKBucketPos, int nId);
+
     //! Move an entry from the "new" table(s) to the "tried" table
     void MakeTried(CAddrInfo &info, int nId);
 
@@ -270,7 +327,7 @@ protected:
     //! table is selected from.
     CAddrInfo Select_(bool newOnly);
 
-    //! Wraps GetRandInt to allow tests to override RandomInt and make it
+    //! Wraps GetFastRand to allow tests to override RandomInt and make it
     //! determinismistic.
     virtual int RandomInt(int nMax);
 
@@ -430,7 +487,7 @@ public:
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1)
                 {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -452,7 +509,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             }
             else
@@ -479,7 +536,7 @@ public:
                         info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS)
                     {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -502,7 +559,7 @@ public:
         }
         if (nLost + nLostUnk > 0)
         {
-            LogPrint("addrman", "addrman lost %i new and %i tried addresses "
+            LogPrint(Logging::ADDRMAN, "addrman lost %i new and %i tried addresses "
                                 "due to collisions\n",
                 nLostUnk, nLost);
         }
@@ -521,6 +578,7 @@ public:
                 vvNew[bucket][entry] = -1;
             }
         }
+        newPositions.Clear();
         for (size_t bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++)
         {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++)
@@ -528,6 +586,7 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        triedPositions.Clear();
 
         nIdCount = 0;
         nTried = 0;
@@ -536,7 +595,13 @@ public:
         nLastGood = 1;
     }
 
-    CAddrMan() { Clear(); }
+    CAddrMan()
+        : triedPositions(ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE),
+          newPositions(ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE)
+    {
+        Clear();
+    }
+
     ~CAddrMan() { nKey.SetNull(); }
     //! Return the number of (unique) addresses in all tables.
     size_t size() const
@@ -546,6 +611,15 @@ public:
         return vRandom.size();
     }
 
+    //! Memory the address manager takes, the bucket tables it holds in place included
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return sizeof(*this) + memusage::DynamicUsage(mapInfo) + memusage::DynamicUsage(mapAddr) +
+               memusage::DynamicUsage(vRandom) + triedPositions.DynamicMemoryUsage() +
+               newPositions.DynamicMemoryUsage();
+    }
+
     //! Consistency check
     void Check()
     {
@@ -568,7 +642,7 @@ public:
         fRet |= Add_(addr, source, nTimePenalty);
         Check();
         if (fRet)
-            LogPrint("addrman", "Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort(), source.ToString(),
+            LogPrint(Logging::ADDRMAN, "Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort(), source.ToString(),
                 nTried, nNew);
         return fRet;
     }
@@ -583,8 +657,8 @@ public:
             nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
         Check();
         if (nAdd)
-            LogPrint(
-                "addrman", "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
+            LogPrint(Logging::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(),
+                nTried, nNew);
         return nAdd > 0;
     }
 
@@ -0,0 +1,199 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/banindex.h"
+
+#include <algorithm>
+#include <string.h>
+
+static inline int GetBit(const uint8_t *pch, int n) { return (pch[n >> 3] >> (7 - (n & 7))) & 1; }
+/** The number of leading bits a and b share, at most nMax, the first nStart are known to match */
+static int CommonBits(const uint8_t *a, const uint8_t *b, int nMax, int nStart = 0)
+{
+    int n = nStart;
+    while (n < nMax && (n & 7) && GetBit(a, n) == GetBit(b, n))
+        ++n;
+    if (n & 7)
+        return n;
+    while (n + 8 <= nMax && a[n >> 3] == b[n >> 3])
+        n += 8;
+    while (n < nMax && GetBit(a, n) == GetBit(b, n))
+        ++n;
+    return n;
+}
+
+static void GetKey(const CNetAddr &addr, uint8_t *pchKey)
+{
+    for (int i = 0; i < 16; i++)
+        pchKey[i] = addr.GetByte(15 - i);
+}
+
+CBanIndex::CNode::CNode(const uint8_t *pchKey, int nBitsIn) : nBits(nBitsIn), fBanned(false), nBanUntil(0)
+{
+    memset(prefix, 0, sizeof(prefix));
+    memcpy(prefix, pchKey, nBits >> 3);
+    if (nBits & 7)
+        prefix[nBits >> 3] = pchKey[nBits >> 3] & (0xff << (8 - (nBits & 7)));
+}
+
+void CBanIndex::Add(const CSubNet &subNet, int64_t nBanUntil)
+{
+    if (!subNet.IsValid())
+        return;
+    int nBits = subNet.GetPrefixLength();
+    if (nBits < 0)
+    {
+        if (mapNonPrefix.emplace(subNet, nBanUntil).second)
+            nSize++;
+        else
+            mapNonPrefix[subNet] = nBanUntil;
+        return;
+    }
+
+    uint8_t key[16];
+    GetKey(subNet.GetNetwork(), key);
+    std::unique_ptr<CNode> *slot = &root;
+    while (true)
+    {
+        CNode *node = slot->get();
+        if (!node)
+        {
+            slot->reset(new CNode(key, nBits));
+            (*slot)->fBanned = true;
+            (*slot)->nBanUntil = nBanUntil;
+            nSize++;
+            return;
+        }
+        int nCommon = CommonBits(node->prefix, key, std::min(node->nBits, nBits));
+        if (nCommon == node->nBits)
+        {
+            if (node->nBits == nBits)
+            {
+                if (!node->fBanned)
+                    nSize++;
+                node->fBanned = true;
+                node->nBanUntil = nBanUntil;
+                return;
+            }
+            slot = &node->child[GetBit(key, node->nBits)];
+            continue;
+        }
+
+        // the subnet branches off within this node, put a node for the shared bits above it
+        std::unique_ptr<CNode> split(new CNode(key, nCommon));
+        split->child[GetBit(node->prefix, nCommon)] = std::move(*slot);
+        if (nCommon == nBits)
+        {
+            split->fBanned = true;
+            split->nBanUntil = nBanUntil;
+        }
+        else
+        {
+            std::unique_ptr<CNode> &leaf = split->child[GetBit(key, nCommon)];
+            leaf.reset(new CNode(key, nBits));
+            leaf->fBanned = true;
+            leaf->nBanUntil = nBanUntil;
+        }
+        *slot = std::move(split);
+        nSize++;
+        return;
+    }
+}
+
+bool CBanIndex::Remove(const CSubNet &subNet)
+{
+    if (!subNet.IsValid())
+        return false;
+    int nBits = subNet.GetPrefixLength();
+    if (nBits < 0)
+    {
+        if (!mapNonPrefix.erase(subNet))
+            return false;
+        nSize--;
+        return true;
+    }
+
+    uint8_t key[16];
+    GetKey(subNet.GetNetwork(), key);
+    std::unique_ptr<CNode> *parent = nullptr;
+    std::unique_ptr<CNode> *slot = &root;
+    while (*slot)
+    {
+        CNode *node = slot->get();
+        if (node->nBits > nBits || CommonBits(node->prefix, key, node->nBits) < node->nBits)
+            return false;
+        if (node->nBits == nBits)
+        {
+            if (!node->fBanned)
+                return false;
+            node->fBanned = false;
+            nSize--;
+            Prune(*slot);
+            if (parent)
+                Prune(*parent);
+            return true;
+        }
+        parent = slot;
+        slot = &node->child[GetBit(key, node->nBits)];
+    }
+    return false;
+}
+
+void CBanIndex::Prune(std::unique_ptr<CNode> &slot)
+{
+    if (slot->fBanned)
+        return;
+    if (slot->child[0] && slot->child[1])
+        return;
+    std::unique_ptr<CNode> child = std::move(slot->child[slot->child[0] ? 0 : 1]);
+    slot = std::move(child);
+}
+
+void CBanIndex::Clear()
+{
+    root.reset();
+    mapNonPrefix.clear();
+    nSize = 0;
+}
+
+bool CBanIndex::IsBanned(const CNetAddr &addr, int64_t nNow) const
+{
+    if (!addr.IsValid())
+        return false;
+
+    uint8_t key[16];
+    GetKey(addr, key);
+    const CNode *node = root.get();
+    int nMatched = 0;
+    while (node && CommonBits(node->prefix, key, node->nBits, nMatched) == node->nBits)
+    {
+        if (node->fBanned && nNow < node->nBanUntil)
+            return true;
+        if (node->nBits == 128)
+            break;
+        nMatched = node->nBits;
+        node = node->child[GetBit(key, node->nBits)].get();
+    }
+
+    for (const auto &entry : mapNonPrefix)
+    {
+        if (entry.first.Match(addr) && nNow < entry.second)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_BANINDEX_H
+#define ECCOIN_BANINDEX_H
+
+#include "net/netaddress.h"
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+
+/** The banned subnets as a path compressed binary trie over the 128 bits of the address, IPv4
+ *  and onion addresses are looked up by their IPv6 mapping. Every node holds the bits all
+ *  subnets below it share, so looking up an address walks one node per differing bit at most
+ *  and costs O(prefix length) however many subnets are banned. Subnets with a netmask that is
+ *  not a prefix are rare and are matched one by one. Not thread safe, CConnman keeps it under
+ *  cs_setBanned next to setBanned.
+ */
+class CBanIndex
+{
+public:
+    //! ban subNet until nBanUntil, replacing the time it was banned until before
+    void Add(const CSubNet &subNet, int64_t nBanUntil);
+    //! false if subNet was not banned
+    bool Remove(const CSubNet &subNet);
+    void Clear();
+
+    //! whether a subnet holding addr is banned until after nNow
+    bool IsBanned(const CNetAddr &addr, int64_t nNow) const;
+
+    size_t size() const { return nSize; }
+
+private:
+    struct CNode
+    {
+        //! the first nBits bits of the address, the rest is zero
+        uint8_t prefix[16];
+        int nBits;
+        //! whether a banned subnet ends here, the subnets below are longer
+        bool fBanned;
+        int64_t nBanUntil;
+        std::unique_ptr<CNode> child[2];
+
+        CNode(const uint8_t *pchKey, int nBitsIn);
+    };
+
+    std::unique_ptr<CNode> root;
+    std::map<CSubNet, int64_t> mapNonPrefix;
+    size_t nSize = 0;
+
+    //! drop a node that no ban ends at and fold a lone child into its parent
+    static void Prune(std::unique_ptr<CNode> &slot);
+};
+
+#endif // ECCOIN_BANINDEX_H
@@ -0,0 +1,235 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/blockencodings.h"
+
+#include "consensus/merkle.h"
+#include "crypto/common.h"
+#include "crypto/hash.h"
+#include "crypto/sha256.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util/logger.h"
+#include "version.h"
+
+#include <unordered_map>
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
+    : nonce(GetRand(std::numeric_limits<uint64_t>::max())), header(block.GetBlockHeader()),
+      vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+    // the coinbase, and the coinstake of proof-of-stake blocks, were never relayed on their own
+    size_t nPrefilled = (block.IsProofOfStake() && block.vtx.size() > 1) ? 2 : 1;
+    nPrefilled = std::min(nPrefilled, block.vtx.size());
+    prefilledtxn.resize(nPrefilled);
+    for (size_t i = 0; i < nPrefilled; i++)
+    {
+        // every index after the first is encoded as the distance to the previous one
+        prefilledtxn[i] = {0, block.vtx[i]};
+    }
+    shorttxids.resize(block.vtx.size() - nPrefilled);
+    for (size_t i = nPrefilled; i < block.vtx.size(); i++)
+    {
+        shorttxids[i - nPrefilled] = GetShortID(block.vtx[i]->GetHash());
+    }
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CPublicDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    CSHA256 hasher;
+    hasher.Write((const unsigned char *)&(*stream.begin()), stream.end() - stream.begin());
+    uint256 shorttxidhash;
+    hasher.Finalize(shorttxidhash.begin());
+    shorttxidk0 = ReadLE64(shorttxidhash.begin());
+    shorttxidk1 = ReadLE64(shorttxidhash.begin() + 8);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256 &txhash) const
+{
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs &cmpctblock)
+{
+    if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
+    {
+        return READ_STATUS_INVALID;
+    }
+    if (cmpctblock.BlockTxCount() > MAX_BLOCK_SIZE / MIN_SERIALIZED_TX_SIZE)
+    {
+        return READ_STATUS_INVALID;
+    }
+
+    assert(header.IsNull() && txn_available.empty());
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    txn_available.resize(cmpctblock.BlockTxCount());
+
+    int32_t lastprefilledindex = -1;
+    for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++)
+    {
+        if (!cmpctblock.prefilledtxn[i].tx || cmpctblock.prefilledtxn[i].tx->IsNull())
+        {
+            return READ_STATUS_INVALID;
+        }
+        // the index is differentially encoded, this can not overflow as it is at most
+        // 2 * 2^16 which fits in an int32_t
+        lastprefilledindex += cmpctblock.prefilledtxn[i].index + 1;
+        if (lastprefilledindex > std::numeric_limits<uint16_t>::max())
+        {
+            return READ_STATUS_INVALID;
+        }
+        if ((uint32_t)lastprefilledindex > cmpctblock.shorttxids.size() + i)
+        {
+            // the prefilled indexes must be in range of the whole block, counting the short ids
+            // before them
+            return READ_STATUS_INVALID;
+        }
+        txn_available[lastprefilledindex] = cmpctblock.prefilledtxn[i].tx;
+    }
+    prefilled_count = cmpctblock.prefilledtxn.size();
+
+    // where each short id goes in the block, the prefilled transactions take up slots
+    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    uint16_t index_offset = 0;
+    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++)
+    {
+        while (txn_available[i + index_offset])
+        {
+            index_offset++;
+        }
+        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
+    }
+    if (shorttxids.size() != cmpctblock.shorttxids.size())
+    {
+        // two transactions of the block share a short id, the block can not be rebuilt from
+        // short ids and needs to be fetched whole
+        return READ_STATUS_FAILED;
+    }
+
+    std::vector<bool> have_txn(txn_available.size());
+    {
+        READLOCK(pool->cs);
+        for (CTxMemPool::txiter it = pool->mapTx.begin(); it != pool->mapTx.end(); ++it)
+        {
+            uint64_t shortid = cmpctblock.GetShortID(it->GetTx().GetHash());
+            std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
+            if (idit == shorttxids.end())
+            {
+                continue;
+            }
+            if (!have_txn[idit->second])
+            {
+                txn_available[idit->second] = it->GetSharedTx();
+                have_txn[idit->second] = true;
+                mempool_count++;
+            }
+            else if (txn_available[idit->second])
+            {
+                // two mempool transactions match one short id, we can not tell which one the
+                // block has, so ask for it
+                txn_available[idit->second].reset();
+                mempool_count--;
+            }
+            if (mempool_count == shorttxids.size())
+            {
+                break;
+            }
+        }
+    }
+
+    LogPrint(Logging::CMPCTBLOCK, "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n",
+        cmpctblock.header.GetHash().ToString(),
+        GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const
+{
+    assert(!header.IsNull());
+    assert(index < txn_available.size());
+    return txn_available[index] != nullptr;
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock &block, const std::vector<CTransactionRef> &vtx_missing)
+{
+    // a peer may answer twice, the first answer used the block up
+    if (header.IsNull())
+    {
+        return READ_STATUS_INVALID;
+    }
+    block = header;
+    block.vtx.resize(txn_available.size());
+    block.vchBlockSig = vchBlockSig;
+
+    size_t tx_missing_offset = 0;
+    for (size_t i = 0; i < txn_available.size(); i++)
+    {
+        if (!txn_available[i])
+        {
+            if (vtx_missing.size() <= tx_missing_offset)
+            {
+                return READ_STATUS_INVALID;
+            }
+            block.vtx[i] = vtx_missing[tx_missing_offset++];
+        }
+        else
+        {
+            block.vtx[i] = txn_available[i];
+        }
+    }
+
+    // this block can only be filled once
+    header.SetNull();
+    txn_available.clear();
+
+    if (vtx_missing.size() != tx_missing_offset)
+    {
+        return READ_STATUS_INVALID;
+    }
+
+    // a short id that matched the wrong mempool transaction shows up as a merkle root that is
+    // off, that is not the peer's fault so the block gets fetched whole instead
+    bool mutated = false;
+    if (BlockMerkleRoot(block, &mutated) != block.hashMerkleRoot || mutated)
+    {
+        return READ_STATUS_FAILED;
+    }
+
+    LogPrint(Logging::CMPCTBLOCK,
+        "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool and "
+        "%lu txn requested\n",
+        block.GetHash().ToString(), prefilled_count, mempool_count, vtx_missing.size());
+    if (vtx_missing.size() < 5)
+    {
+        for (const CTransactionRef &tx : vtx_missing)
+        {
+            LogPrint(Logging::CMPCTBLOCK, "Reconstructed block %s required tx %s\n", block.GetHash().ToString(),
+                tx->GetHash().ToString());
+        }
+    }
+
+    return READ_STATUS_OK;
+}
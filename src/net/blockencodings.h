@@ -0,0 +1,253 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_BLOCKENCODINGS_H
+#define ECCOIN_BLOCKENCODINGS_H
+
+#include "chain/block.h"
+#include "consensus/consensus.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <ios>
+#include <limits>
+#include <vector>
+
+class CTxMemPool;
+
+/** The only compact block encoding we speak, sent in sendcmpct */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+/** Only serve cmpctblock for blocks this close to the tip, older ones go out whole */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Only answer getblocktxn for blocks this close to the tip, older ones go out whole */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** No serialized transaction is smaller than this, which bounds the transactions of a block */
+static const size_t MIN_SERIALIZED_TX_SIZE = 10;
+
+/** Transaction indexes are sent differentially encoded, each one as the distance from the
+ *  previous index minus one, so a run of requested transactions costs a byte each.
+ */
+template <typename Stream>
+void SerializeDifferentialIndexes(Stream &s, const std::vector<uint16_t> &indexes)
+{
+    WriteCompactSize(s, indexes.size());
+    for (size_t i = 0; i < indexes.size(); i++)
+    {
+        WriteCompactSize(s, indexes[i] - (i == 0 ? 0 : (indexes[i - 1] + 1)));
+    }
+}
+
+template <typename Stream>
+void UnserializeDifferentialIndexes(Stream &s, std::vector<uint16_t> &indexes)
+{
+    uint64_t nCount = ReadCompactSize(s);
+    if (nCount > std::numeric_limits<uint16_t>::max())
+    {
+        throw std::ios_base::failure("too many transaction indexes");
+    }
+    indexes.resize(nCount);
+    uint64_t nOffset = 0;
+    for (size_t i = 0; i < indexes.size(); i++)
+    {
+        uint64_t nIndex = ReadCompactSize(s) + nOffset;
+        if (nIndex > std::numeric_limits<uint16_t>::max())
+        {
+            throw std::ios_base::failure("transaction index overflowed 16 bits");
+        }
+        indexes[i] = nIndex;
+        nOffset = nIndex + 1;
+    }
+}
+
+/** getblocktxn: the transactions of a compact block the receiver could not find */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> indexes;
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        s << blockhash;
+        SerializeDifferentialIndexes(s, indexes);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s)
+    {
+        s >> blockhash;
+        UnserializeDifferentialIndexes(s, indexes);
+    }
+};
+
+/** blocktxn: the answer to a getblocktxn, in the order they were asked for */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransactionRef> txn;
+
+    BlockTransactions() {}
+    explicit BlockTransactions(const BlockTransactionsRequest &req) : blockhash(req.blockhash), txn(req.indexes.size())
+    {
+    }
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent along with the short ids because the receiver can not have it */
+struct PrefilledTransaction
+{
+    //! differentially encoded on the wire like the getblocktxn indexes
+    uint16_t index;
+    CTransactionRef tx;
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        uint64_t nIndex = index;
+        READWRITE(COMPACTSIZE(nIndex));
+        if (nIndex > std::numeric_limits<uint16_t>::max())
+        {
+            throw std::ios_base::failure("index overflowed 16 bits");
+        }
+        index = nIndex;
+        READWRITE(tx);
+    }
+};
+
+typedef enum ReadStatus_t
+{
+    READ_STATUS_OK,
+    //! the message is malformed, the peer misbehaved
+    READ_STATUS_INVALID,
+    //! the block could not be rebuilt, for example because of a short id collision
+    READ_STATUS_FAILED,
+} ReadStatus;
+
+/** cmpctblock: a block as its header, the coinbase and coinstake, which the receiver can not
+ *  have in its mempool, and 6 byte short ids for every other transaction. The short ids are
+ *  SipHash-2-4 of the txid keyed on the header and a random nonce, so the collisions a peer
+ *  could grind for are different on every link. The block signature of proof-of-stake blocks
+ *  comes along too.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+    static const int SHORTTXIDS_LENGTH = 6;
+
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() {}
+    explicit CBlockHeaderAndShortTxIDs(const CBlock &block);
+
+    uint64_t GetShortID(const uint256 &txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(header);
+        READWRITE(nonce);
+
+        uint64_t nShortTxIDs = shorttxids.size();
+        READWRITE(COMPACTSIZE(nShortTxIDs));
+        if (ser_action.ForRead())
+        {
+            if (nShortTxIDs > std::numeric_limits<uint16_t>::max())
+            {
+                throw std::ios_base::failure("too many short ids");
+            }
+            shorttxids.resize(nShortTxIDs);
+        }
+        for (size_t i = 0; i < shorttxids.size(); i++)
+        {
+            uint32_t lsb = shorttxids[i] & 0xffffffff;
+            uint16_t msb = (shorttxids[i] >> 32) & 0xffff;
+            READWRITE(lsb);
+            READWRITE(msb);
+            shorttxids[i] = (uint64_t(msb) << 32) | uint64_t(lsb);
+        }
+
+        READWRITE(prefilledtxn);
+        READWRITE(vchBlockSig);
+
+        if (ser_action.ForRead())
+        {
+            if (BlockTxCount() > std::numeric_limits<uint16_t>::max())
+            {
+                throw std::ios_base::failure("block has too many transactions");
+            }
+            FillShortTxIDSelector();
+        }
+    }
+};
+
+/** A block being rebuilt from a cmpctblock, with the transactions found so far */
+class PartiallyDownloadedBlock
+{
+protected:
+    std::vector<CTransactionRef> txn_available;
+    size_t prefilled_count = 0, mempool_count = 0;
+    CTxMemPool *pool;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    explicit PartiallyDownloadedBlock(CTxMemPool *poolIn) : pool(poolIn) {}
+
+    /** Take the prefilled transactions and find the rest in the mempool. Needs cs_main held,
+     *  takes the mempool lock.
+     */
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs &cmpctblock);
+    bool IsTxAvailable(size_t index) const;
+    /** Put the block together with vtx_missing filling the gaps in order. Checks the merkle
+     *  root, a mismatch means a short id matched the wrong transaction.
+     */
+    ReadStatus FillBlock(CBlock &block, const std::vector<CTransactionRef> &vtx_missing);
+};
+
+#endif // ECCOIN_BLOCKENCODINGS_H
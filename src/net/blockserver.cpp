@@ -0,0 +1,113 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/blockserver.h"
+
+#include "main.h"
+#include "net/protocol.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+std::unique_ptr<CBlockServer> g_blockserver;
+
+CBlockServer::CBlockServer(CConnman *connmanIn, int nThreadsIn)
+    : connman(connmanIn), nThreads(nThreadsIn), fStop(false)
+{
+}
+
+CBlockServer::~CBlockServer() { Stop(); }
+
+void CBlockServer::Start()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!threads.empty())
+        return;
+    fStop = false;
+    for (int i = 0; i < nThreads; i++)
+        threads.emplace_back(&CBlockServer::ThreadServe, this);
+}
+
+void CBlockServer::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+        queue.clear();
+    }
+    condWork.notify_all();
+    for (std::thread &thread : threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+    std::lock_guard<std::mutex> lock(cs);
+    threads.clear();
+}
+
+bool CBlockServer::Add(const CBlockServeRequest &req)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fStop || threads.empty())
+            return false;
+        queue.push_back(req);
+    }
+    condWork.notify_one();
+    return true;
+}
+
+void CBlockServer::Serve(const CBlockServeRequest &req, std::string &strRaw)
+{
+    // ReadRawBlockFromDisk appends
+    strRaw.clear();
+    CSerializedPayloadRef payload;
+    if (ReadRawBlockFromDisk(strRaw, req.pos))
+    {
+        payload = std::make_shared<const CSerializedPayload>(
+            std::vector<uint8_t>(strRaw.begin(), strRaw.end()), req.nSendVersion);
+    }
+    else
+    {
+        LogPrintf("%s: cannot load block %s from disk for peer=%d\n", __func__, req.hash.ToString(), req.nodeid);
+    }
+
+    connman->ForNode(req.nodeid, [&](CNode *pnode) {
+        if (payload)
+        {
+            connman->PushSerializedMessage(pnode, NetMsgType::BLOCK, payload, req.lane);
+            if (!req.hashContinueTip.IsNull())
+            {
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK, req.hashContinueTip));
+                connman->PushMessage(pnode, req.lane, NetMsgType::INV, vInv);
+            }
+        }
+        else
+        {
+            pnode->fDisconnect = true;
+        }
+        pnode->fBlockReadPending = false;
+        return true;
+    });
+    // the rest of the getdata of the peer waited for this block
+    connman->WakeMessageHandler();
+}
+
+void CBlockServer::ThreadServe()
+{
+    RenameThread("bitcoin-blockserve");
+    std::string strRaw;
+    while (true)
+    {
+        CBlockServeRequest req;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWork.wait(lock, [&]() { return fStop || !queue.empty(); });
+            if (fStop)
+                return;
+            req = queue.front();
+            queue.pop_front();
+        }
+        Serve(req, strRaw);
+    }
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_BLOCKSERVER_H
+#define ECCOIN_BLOCKSERVER_H
+
+#include "chain/blockindex.h"
+#include "net/net.h"
+#include "uint256.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** -blockservethreads default, 0 to read the blocks peers ask for on the message handler thread */
+static const int DEFAULT_BLOCK_SERVE_THREADS = 2;
+static const int MAX_BLOCK_SERVE_THREADS = 16;
+
+/** A whole block a peer asked for that is read from disk by a CBlockServer thread */
+struct CBlockServeRequest
+{
+    NodeId nodeid;
+    uint256 hash;
+    CDiskBlockPos pos;
+    int nSendVersion;
+    SendLane lane;
+    //! the tip to announce right after the block when it was the hashContinue of the peer, null if not
+    uint256 hashContinueTip;
+};
+
+/**
+ * Reads the blocks peers ask for that are not among the recently served ones and queues them for sending, so a
+ * peer that syncs from us does not hold cs_main and its message handler thread while the disk seeks. The block is
+ * sent as it is on disk, that is its network serialization. A peer has at most one block read pending, while it
+ * is its getdata and other messages wait (CNode::fBlockReadPending), so its responses keep their order.
+ */
+class CBlockServer
+{
+private:
+    CConnman *const connman;
+    const int nThreads;
+
+    std::mutex cs;
+    std::condition_variable condWork;
+    std::deque<CBlockServeRequest> queue;
+    bool fStop;
+    std::vector<std::thread> threads;
+
+    void ThreadServe();
+    void Serve(const CBlockServeRequest &req, std::string &strRaw);
+
+public:
+    CBlockServer(CConnman *connmanIn, int nThreadsIn);
+    ~CBlockServer();
+
+    void Start();
+    /** Stop the workers, what is still queued is dropped */
+    void Stop();
+
+    /** Queue a block read, false if the workers do not run and the caller has to read it itself */
+    bool Add(const CBlockServeRequest &req);
+};
+
+/** Set while the workers run */
+extern std::unique_ptr<CBlockServer> g_blockserver;
+
+#endif // ECCOIN_BLOCKSERVER_H
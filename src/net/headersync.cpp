@@ -0,0 +1,227 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/headersync.h"
+
+#include "consensus/validation.h"
+#include "main.h"
+#include "processheader.h"
+#include "util/logger.h"
+
+#include <iterator>
+
+CHeaderSegmentSync headersync;
+
+void CHeaderSegmentSync::Init(const MapCheckpoints &checkpoints, int nKnownHeight, int64_t nNow)
+{
+    LOCK(cs_headersync);
+    mapSegments.clear();
+    mapPeerSegment.clear();
+    nLastProgress = nNow;
+
+    MapCheckpoints::const_iterator itStart = checkpoints.find(nKnownHeight);
+    if (itStart == checkpoints.end())
+        return;
+    for (MapCheckpoints::const_iterator it = std::next(itStart); it != checkpoints.end(); ++it)
+    {
+        if (it->first - itStart->first < HEADER_SEGMENT_MIN_SPAN && std::next(it) != checkpoints.end())
+            continue;
+        CHeaderSegment &segment = mapSegments[itStart->first];
+        segment.hashStart = itStart->second;
+        segment.nStartHeight = itStart->first;
+        segment.hashEnd = it->second;
+        segment.nEndHeight = it->first;
+        itStart = it;
+    }
+    if (!mapSegments.empty())
+        LogPrint(Logging::NET, "downloading headers %d to %d from several peers in %u segments\n", nKnownHeight,
+            itStart->first, mapSegments.size());
+}
+
+void CHeaderSegmentSync::Release(CHeaderSegment &segment, bool fTried)
+{
+    if (segment.peer < 0)
+        return;
+    if (fTried)
+    {
+        if (segment.setTried.size() >= MAX_HEADER_SEGMENT_TRIES)
+            segment.setTried.clear();
+        segment.setTried.insert(segment.peer);
+    }
+    mapPeerSegment.erase(segment.peer);
+    segment.peer = -1;
+    segment.fRequested = false;
+}
+
+bool CHeaderSegmentSync::GetRequest(NodeId peer, int nPeerHeight, int64_t nNow, uint256 &hashFrom, uint256 &hashStop)
+{
+    LOCK(cs_headersync);
+    if (mapSegments.empty())
+        return false;
+    if (nNow - nLastProgress > HEADER_SEGMENT_STALL_TIMEOUT)
+    {
+        LogPrintf("No headers segment made progress for %d seconds, downloading headers from one peer\n",
+            HEADER_SEGMENT_STALL_TIMEOUT / 1000000);
+        mapSegments.clear();
+        mapPeerSegment.clear();
+        return false;
+    }
+    for (auto &item : mapSegments)
+    {
+        CHeaderSegment &segment = item.second;
+        if (segment.fRequested && segment.nExpiry < nNow)
+        {
+            LogPrint(Logging::NET, "headers segment %d to %d timed out on peer=%d\n", segment.nStartHeight,
+                segment.nEndHeight, segment.peer);
+            Release(segment, true);
+        }
+    }
+
+    CHeaderSegment *psegment = nullptr;
+    std::map<NodeId, int>::const_iterator itPeer = mapPeerSegment.find(peer);
+    if (itPeer != mapPeerSegment.end())
+    {
+        psegment = &mapSegments[itPeer->second];
+        if (psegment->fRequested)
+            return false;
+    }
+    else
+    {
+        const int nWindowEnd = mapSegments.begin()->first + HEADER_SEGMENT_WINDOW;
+        for (auto &item : mapSegments)
+        {
+            CHeaderSegment &segment = item.second;
+            if (segment.nStartHeight > nWindowEnd)
+                break;
+            if (segment.peer < 0 && !segment.IsComplete() && segment.nEndHeight <= nPeerHeight &&
+                !segment.setTried.count(peer))
+            {
+                psegment = &segment;
+                break;
+            }
+        }
+        if (psegment == nullptr)
+            return false;
+        psegment->peer = peer;
+        mapPeerSegment[peer] = psegment->nStartHeight;
+    }
+
+    psegment->fRequested = true;
+    psegment->nExpiry = nNow + HEADER_SEGMENT_TIMEOUT;
+    hashFrom = psegment->GetLastHash();
+    hashStop = psegment->hashEnd;
+    return true;
+}
+
+bool CHeaderSegmentSync::ReceivedHeaders(NodeId peer,
+    const std::vector<CBlockHeader> &headers,
+    int64_t nNow,
+    int &nDoS)
+{
+    nDoS = 0;
+    LOCK(cs_headersync);
+    std::map<NodeId, int>::const_iterator itPeer = mapPeerSegment.find(peer);
+    if (itPeer == mapPeerSegment.end())
+        return false;
+    CHeaderSegment &segment = mapSegments[itPeer->second];
+    if (!segment.fRequested)
+        return false;
+    if (headers.empty())
+    {
+        // it does not have the segment, the empty reply is left to the usual handling
+        Release(segment, true);
+        return false;
+    }
+    if (headers.front().hashPrevBlock != segment.GetLastHash())
+        return false;
+
+    const size_t nMissing = segment.nEndHeight - segment.nStartHeight - segment.vHeaders.size();
+    if (headers.size() > nMissing)
+    {
+        nDoS = 20;
+        Release(segment, true);
+        return true;
+    }
+    uint256 hashPrev = segment.GetLastHash();
+    for (const CBlockHeader &header : headers)
+    {
+        CValidationState state;
+        if (header.hashPrevBlock != hashPrev)
+        {
+            nDoS = 20;
+            Release(segment, true);
+            return true;
+        }
+        if (!CheckBlockHeader(header, state))
+        {
+            state.IsInvalid(nDoS);
+            Release(segment, true);
+            return true;
+        }
+        hashPrev = header.GetHash();
+    }
+
+    segment.vHeaders.insert(segment.vHeaders.end(), headers.begin(), headers.end());
+    segment.setSuppliers.insert(peer);
+    segment.fRequested = false;
+    nLastProgress = nNow;
+    if (segment.IsComplete())
+    {
+        if (hashPrev != segment.hashEnd)
+        {
+            // somewhere in the segment a peer sent a chain other than the checkpointed one
+            LogPrint(Logging::NET, "headers segment %d to %d does not end at its checkpoint, peer=%d\n",
+                segment.nStartHeight, segment.nEndHeight, peer);
+            nDoS = 20;
+            segment.vHeaders.clear();
+            segment.setSuppliers.clear();
+            Release(segment, true);
+            return true;
+        }
+        Release(segment, false);
+    }
+    else if (headers.size() < MAX_HEADERS_RESULTS)
+    {
+        // the peer has no more of it, the next one continues where it stopped
+        Release(segment, true);
+    }
+    return true;
+}
+
+void CHeaderSegmentSync::TakeConnectable(std::vector<CBlockHeader> &vHeaders, std::set<NodeId> &setSuppliers)
+{
+    LOCK(cs_headersync);
+    while (!mapSegments.empty() && mapSegments.begin()->second.IsComplete())
+    {
+        CHeaderSegment &segment = mapSegments.begin()->second;
+        vHeaders.insert(vHeaders.end(), segment.vHeaders.begin(), segment.vHeaders.end());
+        setSuppliers.insert(segment.setSuppliers.begin(), segment.setSuppliers.end());
+        Release(segment, false);
+        mapSegments.erase(mapSegments.begin());
+    }
+}
+
+void CHeaderSegmentSync::DisconnectedPeer(NodeId peer)
+{
+    LOCK(cs_headersync);
+    std::map<NodeId, int>::const_iterator itPeer = mapPeerSegment.find(peer);
+    if (itPeer != mapPeerSegment.end())
+        Release(mapSegments[itPeer->second], false);
+}
+
+void CHeaderSegmentSync::Clear()
+{
+    LOCK(cs_headersync);
+    mapSegments.clear();
+    mapPeerSegment.clear();
+}
+
+size_t CHeaderSegmentSync::GetBufferedCount() const
+{
+    LOCK(cs_headersync);
+    size_t nCount = 0;
+    for (const auto &item : mapSegments)
+        nCount += item.second.vHeaders.size();
+    return nCount;
+}
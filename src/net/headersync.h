@@ -0,0 +1,113 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_HEADERSYNC_H
+#define ECCOIN_HEADERSYNC_H
+
+#include "chain/block.h"
+#include "net/net.h"
+#include "networks/networktemplate.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+/** -parallelheaders default */
+static const bool DEFAULT_PARALLEL_HEADERS = false;
+/** Checkpoints closer together than this are merged into one segment */
+static const int HEADER_SEGMENT_MIN_SPAN = 2000;
+/** Segments are only handed out while they start at most this many headers above the first one that is not
+ *  connected yet, which bounds the headers held in memory */
+static const int HEADER_SEGMENT_WINDOW = 100000;
+/** Microseconds a peer has to answer a getheaders for a segment before it is given to another peer */
+static const int64_t HEADER_SEGMENT_TIMEOUT = 60 * 1000000;
+/** Microseconds without any segment headers coming in before the node falls back to headers from one peer */
+static const int64_t HEADER_SEGMENT_STALL_TIMEOUT = 5 * 60 * 1000000;
+/** Peers a segment remembers as unable to serve it, the list starts over once it is this long */
+static const size_t MAX_HEADER_SEGMENT_TRIES = 8;
+
+/** Headers download from several peers at once for the span covered by the checkpoints. The span is split at
+ *  the checkpoints into segments anchored at both ends, each of them is asked for with a getheaders from its start
+ *  hash stopping at its end hash, and different peers serve different segments. A segment needs more than one
+ *  round trip when it is longer than MAX_HEADERS_RESULTS, its peer is then asked again from the last header it
+ *  sent. Arriving headers only have to connect to each other and pass CheckBlockHeader, a segment is complete once
+ *  its last header is the checkpoint it ends at, so the whole run is known to be the one the checkpoints commit to
+ *  before any of it reaches mapBlockIndex. Complete segments are taken in height order once the one below them is,
+ *  everything above the last checkpoint is left to the usual headers sync. Has its own lock, callers do not need
+ *  cs_main.
+ */
+class CHeaderSegmentSync
+{
+public:
+    CHeaderSegmentSync() : nLastProgress(0) {}
+
+    /** Split the span from the checkpoint at nKnownHeight, which has to be in mapBlockIndex, to the last one */
+    void Init(const MapCheckpoints &checkpoints, int nKnownHeight, int64_t nNow);
+    //! whether there are segments left to download or connect
+    bool IsActive() const
+    {
+        LOCK(cs_headersync);
+        return !mapSegments.empty();
+    }
+
+    /** Whether peer, whose chain is nPeerHeight high, should send a getheaders now, from hashFrom and stopping at
+     *  hashStop. Gives it a segment if it has none. Expires the requests that were out too long, and drops every
+     *  segment when none made progress for HEADER_SEGMENT_STALL_TIMEOUT.
+     */
+    bool GetRequest(NodeId peer, int nPeerHeight, int64_t nNow, uint256 &hashFrom, uint256 &hashStop);
+    /** Take the headers peer sent if they continue its segment, true if they did. nDoS is set when they do not
+     *  connect, fail CheckBlockHeader or end somewhere else than the checkpoint of the segment.
+     */
+    bool ReceivedHeaders(NodeId peer, const std::vector<CBlockHeader> &headers, int64_t nNow, int &nDoS);
+    /** Move the headers of the complete segments that connect to mapBlockIndex to vHeaders, in order, and the
+     *  peers that sent them to setSuppliers
+     */
+    void TakeConnectable(std::vector<CBlockHeader> &vHeaders, std::set<NodeId> &setSuppliers);
+    void DisconnectedPeer(NodeId peer);
+    void Clear();
+
+    //! segments not connected yet
+    size_t GetSegmentCount() const
+    {
+        LOCK(cs_headersync);
+        return mapSegments.size();
+    }
+    //! headers received and not connected yet
+    size_t GetBufferedCount() const;
+
+private:
+    struct CHeaderSegment
+    {
+        uint256 hashStart;
+        int nStartHeight;
+        uint256 hashEnd;
+        int nEndHeight;
+        //! the headers above hashStart received so far
+        std::vector<CBlockHeader> vHeaders;
+        NodeId peer = -1;
+        bool fRequested = false;
+        int64_t nExpiry = 0;
+        std::set<NodeId> setTried;
+        std::set<NodeId> setSuppliers;
+
+        bool IsComplete() const { return nStartHeight + (int)vHeaders.size() == nEndHeight; }
+        uint256 GetLastHash() const { return vHeaders.empty() ? hashStart : vHeaders.back().GetHash(); }
+    };
+
+    mutable CCriticalSection cs_headersync;
+    //! by start height
+    std::map<int, CHeaderSegment> mapSegments GUARDED_BY(cs_headersync);
+    //! the start height of the segment of every peer that has one
+    std::map<NodeId, int> mapPeerSegment GUARDED_BY(cs_headersync);
+    int64_t nLastProgress GUARDED_BY(cs_headersync);
+
+    //! Take segment away from its peer, which is not given it again if fTried
+    void Release(CHeaderSegment &segment, bool fTried);
+};
+
+extern CHeaderSegmentSync headersync;
+
+#endif // ECCOIN_HEADERSYNC_H
@@ -21,15 +21,25 @@
 #include "net/messages.h"
 
 #include "args.h"
+#include "blockfilterindex.h"
+#include "chain/blockview.h"
 #include "chain/chain.h"
 #include "chain/tx.h"
+#include "coinsprefetch.h"
 #include "consensus/validation.h"
 #include "init.h"
+#include "lrucache.h"
 #include "main.h"
 #include "merkleblock.h"
 #include "net/addrman.h"
+#include "net/blockencodings.h"
+#include "net/blockserver.h"
+#include "net/headersync.h"
 #include "net/nodestate.h"
+#include "net/orphanpool.h"
 #include "net/protocol.h"
+#include "net/txreconciliation.h"
+#include "net/txrequest.h"
 #include "networks/netman.h"
 #include "networks/networktemplate.h"
 #include "policy/fees.h"
@@ -56,7 +66,6 @@
 // Messages
 //
 
-void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /**
  * Filter for transactions that were recently rejected by
@@ -87,6 +96,170 @@ CCriticalSection cs_mapRelay;
 std::map<uint256, CTransaction> mapRelay;
 std::deque<std::pair<int64_t, std::map<uint256, CTransaction>::iterator> > vRelayExpiration;
 
+/** The last block announced by NewPoWValidBlock with its compact encoding, so the peers asking
+ *  for it right after the announcement are served without reading it back from disk
+ */
+CCriticalSection cs_mostRecentBlock;
+std::shared_ptr<const CBlock> mostRecentBlock;
+std::shared_ptr<const CBlockHeaderAndShortTxIDs> mostRecentCompactBlock;
+uint256 mostRecentBlockHash;
+
+/** Blocks served recently, kept read from disk and serialized once for every send version
+ *  that asked for them. Peers that download the chain at about the same height, or ask for the
+ *  new tip right after it was announced, want the same blocks, and they share one copy in their
+ *  send queues.
+ */
+struct CServedBlock
+{
+    std::shared_ptr<const CBlock> pblock;
+    size_t nBlockSize;
+    std::vector<CSerializedPayloadRef> vPayloads;
+    //! the merkle tree of the block, once a filtered peer asked for it
+    std::shared_ptr<const CMerkleTreeLevels> pmerkle;
+};
+struct CServedBlockWeigher
+{
+    size_t operator()(const uint256 &, const CServedBlock &entry) const
+    {
+        size_t nBytes = entry.nBlockSize;
+        for (const CSerializedPayloadRef &payload : entry.vPayloads)
+        {
+            nBytes += payload->data.size();
+        }
+        if (entry.pmerkle)
+        {
+            nBytes += entry.pmerkle->GetHashCount() * sizeof(uint256);
+        }
+        return nBytes;
+    }
+};
+static const size_t MAX_SERVED_BLOCK_BYTES = 16 * 1000 * 1000;
+CCriticalSection cs_servedBlocks;
+CLRUCache<uint256, CServedBlock, SaltedTxidHasher, CServedBlockWeigher> servedBlocks(MAX_SERVED_BLOCK_BYTES);
+
+/** The block with this hash if it is cached, and its serialization for nVersion in payloadOut
+ *  if that was made already. Counts as a hit or a miss.
+ */
+static std::shared_ptr<const CBlock> GetServedBlock(const uint256 &hash, int nVersion, CSerializedPayloadRef &payloadOut)
+{
+    LOCK(cs_servedBlocks);
+    const CServedBlock *entry = servedBlocks.Get(hash);
+    if (!entry)
+    {
+        return nullptr;
+    }
+    for (const CSerializedPayloadRef &payload : entry->vPayloads)
+    {
+        if (payload->nVersion == nVersion)
+        {
+            payloadOut = payload;
+        }
+    }
+    return entry->pblock;
+}
+
+/** Cache a block, with its serialization for one send version if payload is set */
+static void AddServedBlock(const uint256 &hash,
+    const std::shared_ptr<const CBlock> &pblock,
+    const CSerializedPayloadRef &payload)
+{
+    LOCK(cs_servedBlocks);
+    CServedBlock entry;
+    const CServedBlock *cached = servedBlocks.Peek(hash);
+    if (cached)
+    {
+        entry = *cached;
+    }
+    else
+    {
+        entry.pblock = pblock;
+        entry.nBlockSize = ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    }
+    if (payload)
+    {
+        entry.vPayloads.push_back(payload);
+    }
+    // the weight goes up with the payload, so it is put back rather than changed in place
+    servedBlocks.Put(hash, std::move(entry));
+}
+
+/** The merkle tree of a served block, built the first time a filtered peer asks for the block and then kept with
+ *  it, so every merkleblock of it takes its hashes from the same tree
+ */
+static std::shared_ptr<const CMerkleTreeLevels> GetServedMerkleLevels(const uint256 &hash, const CBlock &block)
+{
+    {
+        LOCK(cs_servedBlocks);
+        const CServedBlock *cached = servedBlocks.Peek(hash);
+        if (cached && cached->pmerkle)
+        {
+            return cached->pmerkle;
+        }
+    }
+
+    std::vector<uint256> vTxid;
+    vTxid.reserve(block.vtx.size());
+    for (const CTransactionRef &tx : block.vtx)
+    {
+        vTxid.push_back(tx->GetHash());
+    }
+    std::shared_ptr<const CMerkleTreeLevels> pmerkle = std::make_shared<const CMerkleTreeLevels>(vTxid);
+
+    LOCK(cs_servedBlocks);
+    const CServedBlock *cached = servedBlocks.Peek(hash);
+    if (cached)
+    {
+        if (cached->pmerkle)
+        {
+            return cached->pmerkle;
+        }
+        CServedBlock entry = *cached;
+        entry.pmerkle = pmerkle;
+        servedBlocks.Put(hash, std::move(entry));
+    }
+    return pmerkle;
+}
+
+void GetServedBlockStats(uint64_t &nHits, uint64_t &nMisses, size_t &nBlocks, size_t &nBytes)
+{
+    LOCK(cs_servedBlocks);
+    nHits = servedBlocks.Hits();
+    nMisses = servedBlocks.Misses();
+    nBlocks = servedBlocks.size();
+    nBytes = servedBlocks.Weight();
+}
+
+void PruneStaleHeaderBranches(int nDepth)
+{
+    LOCK(cs_main);
+    CChainManager *pchainman = pnetMan->getChainActive();
+    const CBlockIndex *tip = pchainman->chainActive.Tip();
+    if (tip == nullptr || pchainman->IsInitialBlockDownload())
+        return;
+    const arith_uint256 nDepthWork = GetBlockProof(*tip) * nDepth;
+    if (nDepthWork >= tip->nChainWork)
+        return;
+
+    // everything something still points to stays, along with the part of its branch below it
+    std::set<const CBlockIndex *> setProtected;
+    for (const CBlockIndex *pindex : {pindexBestInvalid, pindexBestForkTip, pindexBestForkBase})
+    {
+        if (pindex)
+            setProtected.insert(pindex);
+    }
+    for (const auto &item : mapBlocksInFlight)
+    {
+        if (item.second.second->pindex)
+            setProtected.insert(item.second.second->pindex);
+    }
+    nodestateman.GetReferencedBlockIndexes(setProtected);
+
+    const size_t nPruned = pchainman->PruneStaleHeaders(tip->nChainWork - nDepthWork, setProtected);
+    if (nPruned > 0)
+        LogPrint(Logging::NET, "pruned %u stale headers, %u block index entries left\n", nPruned,
+            pchainman->mapBlockIndex.size());
+}
+
 uint64_t nLocalHostNonce = 0;
 extern CCriticalSection cs_mapInboundConnectionTracker;
 extern std::map<CNetAddr, ConnectionHistory> mapInboundConnectionTracker;
@@ -97,6 +270,23 @@ uint32_t GetFetchFlags(CNode *pfrom, const CBlockIndex *pprev, const Consensus::
     return nFetchFlags;
 }
 
+// Outbound peers are asked first, and a peer with many requests out waits, so one peer
+// can not hold up all the transactions it announced.
+static void AddTxAnnouncement(const CNode *pnode, const uint256 &txhash, int64_t nNow)
+{
+    const bool fPreferred = !pnode->fInbound;
+    int64_t nDelay = 0;
+    if (!fPreferred)
+    {
+        nDelay += NONPREF_PEER_TX_DELAY;
+    }
+    if (txrequest.CountInFlight(pnode->GetId()) >= MAX_PEER_TX_REQUEST_IN_FLIGHT)
+    {
+        nDelay += OVERLOADED_PEER_TX_DELAY;
+    }
+    txrequest.ReceivedInv(pnode->GetId(), txhash, fPreferred, nNow + nDelay);
+}
+
 void PushNodeVersion(CNode *pnode, CConnman &connman, int64_t nTime)
 {
     ServiceFlags nLocalNodeServices = pnode->GetLocalServices();
@@ -109,8 +299,9 @@ void PushNodeVersion(CNode *pnode, CConnman &connman, int64_t nTime)
 
     GetRandBytes((unsigned char *)&nLocalHostNonce, sizeof(nLocalHostNonce));
 
+    // a block relay only peer is asked not to announce transactions to us
     connman.PushMessage(pnode, NetMsgType::VERSION, PROTOCOL_VERSION, (uint64_t)nLocalNodeServices, nTime, addrYou,
-        addrMe, nLocalHostNonce, strSubVersion, nNodeStartingHeight, ::fRelayTxes);
+        addrMe, nLocalHostNonce, strSubVersion, nNodeStartingHeight, ::fRelayTxes && !pnode->fBlockRelayOnly);
 
     if (g_logger->fLogIPs)
     {
@@ -175,7 +366,10 @@ void FinalizeNode(NodeId nodeid, bool &fUpdateConnectionTime)
         }
     }
 
-    EraseOrphansFor(nodeid);
+    orphanpool.EraseForPeer(nodeid);
+    txrequest.DisconnectedPeer(nodeid);
+    txreconciliation.ForgetPeer(nodeid);
+    headersync.DisconnectedPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -192,6 +386,19 @@ void FinalizeNode(NodeId nodeid, bool &fUpdateConnectionTime)
 }
 
 // TODO might require cs_main
+/** How many blocks a peer gets in flight: as many as it delivers in BLOCK_DOWNLOAD_QUOTA_TIME
+ *  going by how fast it was so far, so a slow peer holds few blocks others could be fetching
+ */
+static int GetBlockQuota(const CNodeState *state)
+{
+    if (state->nAvgBlockTime == 0)
+    {
+        return DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    int64_t nQuota = BLOCK_DOWNLOAD_QUOTA_TIME / state->nAvgBlockTime;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, nQuota));
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats)
 {
     CNodeStateAccessor state(nodestateman, nodeid);
@@ -210,6 +417,9 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
         }
     }
+    stats.nBlockQuota = GetBlockQuota(state.Get());
+    stats.nAvgBlockTime = state->nAvgBlockTime;
+    stats.nBlockStalls = state->nBlockStalls;
     return true;
 }
 
@@ -250,7 +460,7 @@ static void Misbehaving(CNode *node, int howmuch, const std::string &reason)
 
 // Requires cs_main.
 // Returns a bool indicating whether we requested this block.
-bool MarkBlockAsReceived(const uint256 &hash)
+bool MarkBlockAsReceived(const uint256 &hash, NodeId nodeFrom)
 {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight =
         mapBlocksInFlight.find(hash);
@@ -266,7 +476,16 @@ bool MarkBlockAsReceived(const uint256 &hash)
         if (state->vBlocksInFlight.begin() == itInFlight->second.second)
         {
             // First block on the queue was received, update the start download time for the next one
-            state->nDownloadingSince = std::max(state->nDownloadingSince, GetTimeMicros());
+            int64_t nNow = GetTimeMicros();
+            if (itInFlight->second.first == nodeFrom && nNow > state->nDownloadingSince)
+            {
+                // it was the one we waited for since nDownloadingSince
+                int64_t nBlockTime = nNow - state->nDownloadingSince;
+                state->nAvgBlockTime =
+                    state->nAvgBlockTime == 0 ? nBlockTime : (state->nAvgBlockTime * 7 + nBlockTime) / 8;
+                state->nStallingSince = 0;
+            }
+            state->nDownloadingSince = std::max(state->nDownloadingSince, nNow);
         }
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
@@ -289,10 +508,19 @@ const CBlockIndex *LastCommonAncestor(const CBlockIndex *pa, const CBlockIndex *
         pb = pb->GetAncestor(pa->nHeight);
     }
 
+    // entries at the same height skip to the same height, so skip while that still lands on two branches
     while (pa != pb && pa && pb)
     {
-        pa = pa->pprev;
-        pb = pb->pprev;
+        if (pa->pskip && pb->pskip && pa->pskip != pb->pskip)
+        {
+            pa = pa->pskip;
+            pb = pb->pskip;
+        }
+        else
+        {
+            pa = pa->pprev;
+            pb = pb->pprev;
+        }
     }
 
     // Eventually all chain branches meet at the genesis block.
@@ -329,145 +557,137 @@ void RelayTransaction(const CTransaction &tx, CConnman &connman)
             vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, ret.first));
         }
     }
-    connman.ForEachNode([&inv](CNode *pnode) { pnode->PushInventory(inv); });
+    // looked up once for every peer, it orders the announcements
+    CAmount nFeeRate = 0;
+    {
+        READLOCK(mempool.cs);
+        CTxMemPool::txiter it = mempool.mapTx.find(inv.hash);
+        if (it != mempool.mapTx.end())
+        {
+            nFeeRate = CFeeRate(it->GetModifiedFee(), it->GetTxSize()).GetFeePerK();
+        }
+    }
+    connman.ForEachNode([&inv, nFeeRate](CNode *pnode) { pnode->PushInventory(inv, nFeeRate); });
 }
 
-static void RelayAddress(const CAddress &addr, bool fReachable, CConnman &connman)
+/** The peers one address of an addr message is relayed to */
+struct CAddressRelay
 {
+    const CAddress &addr;
     // Limited relaying of addresses outside our network(s)
-    unsigned int nRelayNodes = fReachable ? 2 : 1;
+    const unsigned int nRelayNodes;
+    const CSipHasher hasher;
+    std::array<std::pair<uint64_t, CNode *>, 2> best;
 
+    CAddressRelay(const CAddress &addrIn, unsigned int nRelayNodesIn, const CSipHasher &hasherIn)
+        : addr(addrIn), nRelayNodes(nRelayNodesIn), hasher(hasherIn), best{{{0, nullptr}, {0, nullptr}}}
+    {
+        assert(nRelayNodes <= best.size());
+    }
+};
+
+/** Relay the addresses of one addr message, with their reachability, all in one pass over the peers */
+static void RelayAddresses(const std::vector<std::pair<CAddress, bool> > &vAddrRelay, CConnman &connman)
+{
     // Relay to a limited number of other nodes.
     // Use deterministic randomness to send to the same nodes for 24 hours at a
     // time so the addrKnowns of the chosen nodes prevent repeats.
-    uint64_t hashAddr = addr.GetHash();
-    const CSipHasher hasher = connman.GetDeterministicRandomizer(RANDOMIZER_ID_ADDRESS_RELAY)
-                                  .Write(hashAddr << 32)
-                                  .Write((GetTime() + hashAddr) / (24 * 60 * 60));
+    const CSipHasher randomizer = connman.GetDeterministicRandomizer(RANDOMIZER_ID_ADDRESS_RELAY);
+    const int64_t nNow = GetTime();
+    std::vector<CAddressRelay> vRelay;
+    vRelay.reserve(vAddrRelay.size());
+    for (const std::pair<CAddress, bool> &entry : vAddrRelay)
+    {
+        uint64_t hashAddr = entry.first.GetHash();
+        vRelay.emplace_back(entry.first, entry.second ? 2 : 1,
+            CSipHasher(randomizer).Write(hashAddr << 32).Write((nNow + hashAddr) / (24 * 60 * 60)));
+    }
     FastRandomContext insecure_rand;
 
-    std::array<std::pair<uint64_t, CNode *>, 2> best{{{0, nullptr}, {0, nullptr}}};
-    assert(nRelayNodes <= best.size());
-
-    auto sortfunc = [&best, &hasher, nRelayNodes](CNode *pnode) {
-        uint64_t hashKey = CSipHasher(hasher).Write(pnode->id).Finalize();
-        for (unsigned int i = 0; i < nRelayNodes; i++)
+    auto sortfunc = [&vRelay](CNode *pnode) {
+        if (pnode->fBlockRelayOnly)
+        {
+            return;
+        }
+        for (CAddressRelay &relay : vRelay)
         {
-            if (hashKey > best[i].first)
+            uint64_t hashKey = CSipHasher(relay.hasher).Write(pnode->id).Finalize();
+            for (unsigned int i = 0; i < relay.nRelayNodes; i++)
             {
-                std::copy(best.begin() + i, best.begin() + nRelayNodes - 1, best.begin() + i + 1);
-                best[i] = std::make_pair(hashKey, pnode);
-                break;
+                if (hashKey > relay.best[i].first)
+                {
+                    std::copy(relay.best.begin() + i, relay.best.begin() + relay.nRelayNodes - 1,
+                        relay.best.begin() + i + 1);
+                    relay.best[i] = std::make_pair(hashKey, pnode);
+                    break;
+                }
             }
         }
     };
 
-    auto pushfunc = [&addr, &best, nRelayNodes, &insecure_rand] {
-        for (unsigned int i = 0; i < nRelayNodes && best[i].first != 0; i++)
+    auto pushfunc = [&vRelay, &insecure_rand] {
+        for (const CAddressRelay &relay : vRelay)
         {
-            best[i].second->PushAddress(addr, insecure_rand);
+            for (unsigned int i = 0; i < relay.nRelayNodes && relay.best[i].first != 0; i++)
+            {
+                relay.best[i].second->PushAddress(relay.addr, insecure_rand);
+            }
         }
     };
 
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
-bool AddOrphanTx(const CTransaction &tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    uint256 hash = tx.GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-    unsigned int sz = GetSerializeSize(tx, SER_NETWORK, CTransaction::CURRENT_VERSION);
-    if (sz > 5000)
-    {
-        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
-        return false;
-    }
-
-    mapOrphanTransactions[hash].tx = tx;
-    mapOrphanTransactions[hash].fromPeer = peer;
-    for (const CTxIn &txin : tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
-
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(), mapOrphanTransactions.size(),
-        mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-
-void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+/** Announce the transactions a reconciliation with pto found it lacks, those that are still in the mempool */
+static void AnnounceReconciledTxs(CNode *pto, const std::vector<uint256> &vTxids, CConnman &connman)
 {
-    std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return;
-    for (const CTxIn &txin : it->second.tx.vin)
+    std::vector<CInv> vInv;
+    for (const uint256 &txid : vTxids)
     {
-        std::map<uint256, std::set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
+        if (!mempool.exists(txid))
             continue;
-        itPrev->second.erase(hash);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-    mapOrphanTransactions.erase(it);
-}
-
-void EraseOrphansFor(NodeId peer)
-{
-    int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
+        vInv.push_back(CInv(MSG_TX, txid));
+        if (vInv.size() == MAX_INV_SZ)
         {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
-            ++nErased;
+            connman.PushMessage(pto, NetMsgType::INV, vInv);
+            vInv.clear();
         }
     }
-    if (nErased > 0)
-        LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
-}
-
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
+    if (!vInv.empty())
+        connman.PushMessage(pto, NetMsgType::INV, vInv);
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid,
+// With pit set the entry gets a partial block for a cmpctblock download and *pit points at it. If
+// the block is in flight from this peer already that entry is kept, *pit points at it and this
+// returns false.
+bool MarkBlockAsInFlight(NodeId nodeid,
     const uint256 &hash,
     const Consensus::Params &consensusParams,
-    const CBlockIndex *pindex = nullptr)
+    const CBlockIndex *pindex = nullptr,
+    std::list<QueuedBlock>::iterator **pit = nullptr)
 {
     CNodeStateAccessor state(nodestateman, nodeid);
     assert(state.IsNull() == false);
 
+    if (pit)
+    {
+        std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight =
+            mapBlocksInFlight.find(hash);
+        if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid)
+        {
+            *pit = &itInFlight->second.second;
+            return false;
+        }
+    }
+
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, pindex, pindex != NULL};
-    std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    QueuedBlock newentry = {hash, pindex, pindex != NULL,
+        std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)};
+    std::list<QueuedBlock>::iterator it =
+        state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), std::move(newentry));
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
     if (state->nBlocksInFlight == 1)
@@ -479,7 +699,13 @@ void MarkBlockAsInFlight(NodeId nodeid,
     {
         nPeersWithValidatedDownloads++;
     }
-    mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    std::pair<NodeId, std::list<QueuedBlock>::iterator> &inFlight = mapBlocksInFlight[hash];
+    inFlight = std::make_pair(nodeid, it);
+    if (pit)
+    {
+        *pit = &inFlight.second;
+    }
+    return true;
 }
 
 /** Check whether the last unknown block a peer advertized is not yet known. */
@@ -518,7 +744,8 @@ void UpdatePreferredDownload(CNode *node)
 void FindNextBlocksToDownload(NodeId nodeid,
     unsigned int count,
     std::vector<const CBlockIndex *> &vBlocks,
-    NodeId &nodeStaller)
+    NodeId &nodeStaller,
+    const CBlockIndex *&pindexStalled)
 {
     if (count == 0)
         return;
@@ -560,6 +787,7 @@ void FindNextBlocksToDownload(NodeId nodeid,
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex *pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight)
     {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
@@ -602,6 +830,7 @@ void FindNextBlocksToDownload(NodeId nodeid,
                     {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -615,6 +844,7 @@ void FindNextBlocksToDownload(NodeId nodeid,
             {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -656,21 +886,67 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256 &hash)
     }
 }
 
-static bool SendRejectsAndCheckIfBanned(CNode *pnode, CConnman &connman)
+/** Add the headers of the segments that connect now to mapBlockIndex */
+static void ConnectHeaderSegments(const CNetworkTemplate &chainparams)
 {
     AssertLockHeld(cs_main);
-    CNodeState state = *CNodeStateAccessor(nodestateman, pnode->GetId());
+    std::vector<CBlockHeader> vHeaders;
+    std::set<NodeId> setSuppliers;
+    headersync.TakeConnectable(vHeaders, setSuppliers);
+    if (vHeaders.empty())
+    {
+        return;
+    }
+
+    CBlockIndex *pindexLast = nullptr;
+    for (const CBlockHeader &header : vHeaders)
+    {
+        CValidationState state;
+        if (!AcceptBlockHeader(header, state, chainparams, &pindexLast))
+        {
+            // the segments end at checkpoints, this is not a peer sending a wrong chain
+            LogPrintf("Header %s of a segment was not accepted: %s, downloading headers from one peer\n",
+                header.GetHash().ToString(), state.GetRejectReason());
+            headersync.Clear();
+            return;
+        }
+    }
+    LogPrint(Logging::NET, "connected %u segment headers up to height %d\n", vHeaders.size(), pindexLast->nHeight);
 
-    for (const CBlockReject &reject : state.rejects)
+    for (NodeId peer : setSuppliers)
+    {
+        CNodeStateAccessor state(nodestateman, peer);
+        if (!state.IsNull())
+        {
+            UpdateBlockAvailability(peer, pindexLast->GetBlockHash());
+        }
+    }
+}
+
+static bool SendRejectsAndCheckIfBanned(CNode *pnode, CConnman &connman)
+{
+    // only the node state is needed, not cs_main. Take what is pending out of it so the node
+    // state lock is not held while pushing messages or banning
+    std::vector<CBlockReject> rejects;
+    bool fShouldBan = false;
+    {
+        CNodeStateAccessor state(nodestateman, pnode->GetId());
+        if (state.IsNull())
+        {
+            return false;
+        }
+        rejects.swap(state->rejects);
+        std::swap(fShouldBan, state->fShouldBan);
+    }
+
+    for (const CBlockReject &reject : rejects)
     {
         connman.PushMessage(pnode, NetMsgType::REJECT, std::string(NetMsgType::BLOCK), reject.chRejectCode,
             reject.strRejectReason, reject.hashBlock);
     }
-    state.rejects.clear();
 
-    if (state.fShouldBan)
+    if (fShouldBan)
     {
-        state.fShouldBan = false;
         if (pnode->fWhitelisted)
         {
             LogPrintf("Warning: not punishing whitelisted peer %s!\n", pnode->addr.ToString());
@@ -717,24 +993,53 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const CBlo
     }
     nHighestFastAnnounce = pindex->nHeight;
     uint256 hashBlock(pblock->GetHash());
-    connman->ForEachNode([this, pindex, &hashBlock](CNode *pnode) {
-        // TODO: Avoid the repeated-serialization here
+
+    // encode the block once for every peer, and keep it for the getdata and getblocktxn that follow
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
+        std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
+    {
+        LOCK(cs_mostRecentBlock);
+        mostRecentBlockHash = hashBlock;
+        mostRecentBlock = std::make_shared<const CBlock>(*pblock);
+        mostRecentCompactBlock = pcmpctblock;
+    }
+    // the peers the block is announced to ask for it next
+    AddServedBlock(hashBlock, mostRecentBlock, nullptr);
+
+    // serialized once for every send version among the peers, usually just one
+    std::map<int, CSerializedPayloadRef> mapCmpctPayloads;
+
+    connman->ForEachNode([this, pindex, &hashBlock, &pcmpctblock, &mapCmpctPayloads](CNode *pnode) {
         if (pnode->fDisconnect)
         {
             return;
         }
         ProcessBlockAvailability(pnode->GetId());
-        CNodeState &state = *CNodeStateAccessor(nodestateman, pnode->GetId());
+        CNodeStateAccessor state(nodestateman, pnode->GetId());
         // If the peer has, or we announced to them the previous block already,
         // but we don't think they have this one, go ahead and announce it.
-        if (!PeerHasHeader(&state, pindex) && PeerHasHeader(&state, pindex->pprev))
+        if (!state.IsNull() && !PeerHasHeader(state.Get(), pindex) && PeerHasHeader(state.Get(), pindex->pprev))
         {
-            LogPrint("net", "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
-                hashBlock.ToString(), pnode->id);
-            std::vector<CBlock> vHeaders;
-            vHeaders.push_back(pindex->GetBlockHeader());
-            connman->PushMessage(pnode, NetMsgType::HEADERS, vHeaders);
-            state.pindexBestHeaderSent = pindex;
+            if (state->fPreferHeaderAndIDs)
+            {
+                LogPrint(Logging::NET, "%s sending header-and-ids %s to peer=%d\n",
+                    "PeerLogicValidation::NewPoWValidBlock", hashBlock.ToString(), pnode->id);
+                CSerializedPayloadRef &payload = mapCmpctPayloads[pnode->GetSendVersion()];
+                if (!payload)
+                {
+                    payload = MakeSerializedPayload(pnode->GetSendVersion(), *pcmpctblock);
+                }
+                connman->PushSerializedMessage(pnode, NetMsgType::CMPCTBLOCK, payload);
+            }
+            else
+            {
+                LogPrint(Logging::NET, "%s sending header %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
+                    hashBlock.ToString(), pnode->id);
+                std::vector<CBlock> vHeaders;
+                vHeaders.push_back(pindex->GetBlockHeader());
+                connman->PushMessage(pnode, NetMsgType::HEADERS, vHeaders);
+            }
+            state->pindexBestHeaderSent = pindex;
         }
     });
 }
@@ -756,14 +1061,13 @@ bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
             recentRejects->reset();
         }
 
-        return recentRejects->contains(inv.hash) || mempool.exists(inv.hash) || mapOrphanTransactions.count(inv.hash) ||
+        return recentRejects->contains(inv.hash) || mempool.exists(inv.hash) || orphanpool.HaveTx(inv.hash) ||
                // Best effort: only try output 0 and 1
                pnetMan->getChainActive()->pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) ||
                pnetMan->getChainActive()->pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
     }
     case MSG_BLOCK:
-        READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
-        return pnetMan->getChainActive()->mapBlockIndex.count(inv.hash);
+        return pnetMan->getChainActive()->LookupBlockIndex(inv.hash) != nullptr;
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -771,6 +1075,11 @@ bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
 void static ProcessGetData(CNode *pfrom, CConnman &connman, const Consensus::Params &consensusParams)
 {
+    // the rest waits until the block being read is queued for sending
+    if (pfrom->fBlockReadPending)
+    {
+        return;
+    }
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     std::vector<CInv> vNotFound;
@@ -788,7 +1097,7 @@ void static ProcessGetData(CNode *pfrom, CConnman &connman, const Consensus::Par
 
         it++;
 
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
         {
             bool send = false;
             CBlockIndex *pindex = pnetMan->getChainActive()->LookupBlockIndex(inv.hash);
@@ -841,32 +1150,119 @@ void static ProcessGetData(CNode *pfrom, CConnman &connman, const Consensus::Par
             // it's available before trying to send.
             if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
             {
-                // Send block from disk
-                CBlock block;
-                if (!ReadBlockFromDisk(block, pindex, consensusParams))
+                // old blocks go to peers that sync, they wait behind relay and can be rate limited on their own
+                const CBlockIndex *pindexHeader = pnetMan->getChainActive()->pindexBestHeader;
+                const bool fHistorical =
+                    pindexHeader != nullptr && pindexHeader->GetBlockTime() - pindex->GetBlockTime() > nOneWeek;
+                const SendLane blockLane = fHistorical ? SEND_LANE_HISTORY : SEND_LANE_BLOCK;
+                // a peer far behind has few of the transactions of an old block, it gets
+                // those whole
+                bool fSendWhole = inv.type == MSG_BLOCK ||
+                                  (inv.type == MSG_CMPCT_BLOCK &&
+                                      pindex->nHeight <
+                                          pnetMan->getChainActive()->chainActive.Height() - MAX_CMPCTBLOCK_DEPTH);
+
+                // Send recently served blocks from memory, anything else from disk
+                CSerializedPayloadRef pblockPayload;
+                std::shared_ptr<const CBlock> pblock =
+                    GetServedBlock(inv.hash, pfrom->GetSendVersion(), pblockPayload);
+                if (!pblock && fSendWhole && g_blockserver)
+                {
+                    // read without cs_main on a block server thread, it sends the block
+                    CBlockServeRequest req;
+                    req.nodeid = pfrom->GetId();
+                    req.hash = inv.hash;
+                    req.pos = pindex->GetBlockPos();
+                    req.nSendVersion = pfrom->GetSendVersion();
+                    req.lane = blockLane;
+                    if (inv.hash == pfrom->hashContinue)
+                    {
+                        req.hashContinueTip = pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash();
+                    }
+                    // set before the worker can clear it
+                    pfrom->fBlockReadPending = true;
+                    if (g_blockserver->Add(req))
+                    {
+                        if (!req.hashContinueTip.IsNull())
+                        {
+                            pfrom->hashContinue.SetNull();
+                        }
+                        GetMainSignals().Inventory(inv.hash);
+                        break;
+                    }
+                    pfrom->fBlockReadPending = false;
+                }
+                if (!pblock)
                 {
-                    LogPrintf("cannot load block from disk");
-                    assert(false);
+                    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+                    if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+                    {
+                        // as on the block server, the peer gets nothing more rather than a gap
+                        LogPrintf("%s: cannot load block %s from disk for peer=%d\n", __func__, inv.hash.ToString(),
+                            pfrom->GetId());
+                        pfrom->fDisconnect = true;
+                        break;
+                    }
+                    pblock = pblockRead;
+                    AddServedBlock(inv.hash, pblock, nullptr);
                 }
-                if (inv.type == MSG_BLOCK)
+
+                if (fSendWhole)
                 {
-                    connman.PushMessage(pfrom, NetMsgType::BLOCK, block);
+                    if (!pblockPayload)
+                    {
+                        pblockPayload = MakeSerializedPayload(pfrom->GetSendVersion(), *pblock);
+                        AddServedBlock(inv.hash, pblock, pblockPayload);
+                    }
+                    connman.PushSerializedMessage(pfrom, NetMsgType::BLOCK, pblockPayload, blockLane);
+                }
+                else if (inv.type == MSG_CMPCT_BLOCK)
+                {
+                    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+                    {
+                        LOCK(cs_mostRecentBlock);
+                        if (mostRecentBlockHash == inv.hash)
+                        {
+                            pcmpctblock = mostRecentCompactBlock;
+                        }
+                    }
+                    if (pcmpctblock)
+                    {
+                        connman.PushMessage(pfrom, blockLane, NetMsgType::CMPCTBLOCK, *pcmpctblock);
+                    }
+                    else
+                    {
+                        connman.PushMessage(
+                            pfrom, blockLane, NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(*pblock));
+                    }
                 }
                 else if (inv.type == MSG_FILTERED_BLOCK)
                 {
+                    const CBlock &block = *pblock;
                     bool sendMerkleBlock = false;
                     CMerkleBlock merkleBlock;
+                    bool fHasFilter = false;
+                    {
+                        LOCK(pfrom->cs_filter);
+                        fHasFilter = pfrom->pfilter != nullptr;
+                    }
+                    // outside cs_filter, the first filtered peer to ask builds the tree for all of them
+                    std::shared_ptr<const CMerkleTreeLevels> pmerkle;
+                    if (fHasFilter)
+                    {
+                        pmerkle = GetServedMerkleLevels(inv.hash, block);
+                    }
                     {
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
                         {
                             sendMerkleBlock = true;
-                            merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                            merkleBlock = CMerkleBlock(block, *pfrom->pfilter, pmerkle.get());
                         }
                     }
                     if (sendMerkleBlock)
                     {
-                        connman.PushMessage(pfrom, NetMsgType::MERKLEBLOCK, merkleBlock);
+                        connman.PushMessage(pfrom, blockLane, NetMsgType::MERKLEBLOCK, merkleBlock);
                         // CMerkleBlock just contains hashes, so also push
                         // any transactions in the block the client did not
                         // see. This avoids hurting performance by
@@ -881,7 +1277,8 @@ void static ProcessGetData(CNode *pfrom, CConnman &connman, const Consensus::Par
                         typedef std::pair<unsigned int, uint256> PairType;
                         for (PairType &pair : merkleBlock.vMatchedTxn)
                         {
-                            connman.PushMessage(pfrom, NetMsgType::TX, block.vtx[pair.first]);
+                            // on the lane of the merkle block, they have to follow it
+                            connman.PushMessage(pfrom, blockLane, NetMsgType::TX, block.vtx[pair.first]);
                         }
                     }
                     // else
@@ -897,7 +1294,7 @@ void static ProcessGetData(CNode *pfrom, CConnman &connman, const Consensus::Par
                     // so they don't wait for other stuff first.
                     std::vector<CInv> vInv;
                     vInv.push_back(CInv(MSG_BLOCK, pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash()));
-                    connman.PushMessage(pfrom, NetMsgType::INV, vInv);
+                    connman.PushMessage(pfrom, blockLane, NetMsgType::INV, vInv);
                     pfrom->hashContinue.SetNull();
                 }
             }
@@ -921,7 +1318,7 @@ void static ProcessGetData(CNode *pfrom, CConnman &connman, const Consensus::Par
         }
         // Track requests for our stuff.
         GetMainSignals().Inventory(inv.hash);
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
         {
             break;
         }
@@ -958,19 +1355,209 @@ void UnregisterNodeSignals(CNodeSignals &nodeSignals)
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
 }
 
+/** Answer a getblocktxn from block */
+void static SendBlockTransactions(const CBlock &block,
+    const BlockTransactionsRequest &req,
+    CNode *pfrom,
+    CConnman &connman)
+{
+    BlockTransactions resp(req);
+    for (size_t i = 0; i < req.indexes.size(); i++)
+    {
+        if (req.indexes[i] >= block.vtx.size())
+        {
+            Misbehaving(pfrom, 100, "out-of-bound-tx-index");
+            LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->id);
+            return;
+        }
+        resp.txn[i] = block.vtx[req.indexes[i]];
+    }
+    connman.PushMessage(pfrom, NetMsgType::BLOCKTXN, resp);
+}
+
+/**
+ * Check a BIP157 request and find its stop block, false if it is not answered. A peer asking for a filter type we do
+ * not serve or for a range that is not allowed is disconnected, one asking for a block we do not have in the active
+ * chain or have not indexed yet gets no answer.
+ */
+static bool PrepareBlockFilterRequest(CNode *pfrom,
+    uint8_t nFilterType,
+    uint32_t nStartHeight,
+    const uint256 &hashStop,
+    uint32_t nMaxHeightRange,
+    const CBlockIndex *&pindexStop)
+{
+    if (!(pfrom->GetLocalServices() & NODE_COMPACT_FILTERS) || !g_blockfilterindex ||
+        nFilterType != g_blockfilterindex->GetFilterType())
+    {
+        LogPrint(Logging::NET, "peer %d requested unsupported block filter type: %d\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    {
+        LOCK(cs_main);
+        pindexStop = pnetMan->getChainActive()->LookupBlockIndex(hashStop);
+        if (!pindexStop || !pnetMan->getChainActive()->chainActive.Contains(pindexStop))
+        {
+            LogPrint(Logging::NET, "peer %d requested filters up to a block not in the active chain: %s\n",
+                pfrom->id, hashStop.ToString());
+            return false;
+        }
+    }
+    const uint32_t nStopHeight = pindexStop->nHeight;
+    if (nStartHeight > nStopHeight)
+    {
+        LogPrint(Logging::NET, "peer %d sent invalid getcfilters/getcfheaders with start height %d > stop height %d\n",
+            pfrom->id, nStartHeight, nStopHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (nStopHeight - nStartHeight >= nMaxHeightRange)
+    {
+        LogPrint(Logging::NET, "peer %d requested too many filters or filter hashes: %d / %d\n", pfrom->id,
+            nStopHeight - nStartHeight + 1, nMaxHeightRange);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    return true;
+}
+
+/** Answer a getcfilters with a cfilter for every block in the range */
+static void ProcessGetCFilters(CNode *pfrom, CPublicDataStream &vRecv, CConnman &connman)
+{
+    uint8_t nFilterType;
+    uint32_t nStartHeight;
+    uint256 hashStop;
+    vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+    const CBlockIndex *pindexStop = nullptr;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+        return;
+
+    std::vector<BlockFilter> vFilters;
+    if (!g_blockfilterindex->LookupFilterRange(nStartHeight, pindexStop, vFilters))
+    {
+        LogPrint(Logging::NET, "Failed to find block filters up to %s for peer %d\n", hashStop.ToString(), pfrom->id);
+        return;
+    }
+    for (const BlockFilter &filter : vFilters)
+        connman.PushMessage(pfrom, NetMsgType::CFILTER, filter);
+}
+
+/** Answer a getcfheaders with the filter hashes of the range and the filter header before it */
+static void ProcessGetCFHeaders(CNode *pfrom, CPublicDataStream &vRecv, CConnman &connman)
+{
+    uint8_t nFilterType;
+    uint32_t nStartHeight;
+    uint256 hashStop;
+    vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+    const CBlockIndex *pindexStop = nullptr;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+        return;
+
+    uint256 prevHeader;
+    if (nStartHeight > 0)
+    {
+        const CBlockIndex *pindexPrev = pindexStop->GetAncestor(nStartHeight - 1);
+        if (!g_blockfilterindex->LookupFilterHeader(pindexPrev, prevHeader))
+        {
+            LogPrint(Logging::NET, "Failed to find block filter header of %s for peer %d\n",
+                pindexPrev->GetBlockHash().ToString(), pfrom->id);
+            return;
+        }
+    }
+    std::vector<uint256> vFilterHashes;
+    if (!g_blockfilterindex->LookupFilterHashRange(nStartHeight, pindexStop, vFilterHashes))
+    {
+        LogPrint(Logging::NET, "Failed to find block filter hashes up to %s for peer %d\n", hashStop.ToString(),
+            pfrom->id);
+        return;
+    }
+    connman.PushMessage(pfrom, NetMsgType::CFHEADERS, nFilterType, hashStop, prevHeader, vFilterHashes);
+}
+
+/** Answer a getcfcheckpt with the filter header of every CFCHECKPT_INTERVAL-th block up to the stop block */
+static void ProcessGetCFCheckPt(CNode *pfrom, CPublicDataStream &vRecv, CConnman &connman)
+{
+    uint8_t nFilterType;
+    uint256 hashStop;
+    vRecv >> nFilterType >> hashStop;
+
+    const CBlockIndex *pindexStop = nullptr;
+    if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<uint32_t>::max(), pindexStop))
+        return;
+
+    std::vector<uint256> vHeaders(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+    const CBlockIndex *pindex = pindexStop;
+    for (size_t i = vHeaders.size(); i-- > 0;)
+    {
+        pindex = pindex->GetAncestor((i + 1) * CFCHECKPT_INTERVAL);
+        if (!g_blockfilterindex->LookupFilterHeader(pindex, vHeaders[i]))
+        {
+            LogPrint(Logging::NET, "Failed to find block filter header of %s for peer %d\n",
+                pindex->GetBlockHash().ToString(), pfrom->id);
+            return;
+        }
+    }
+    connman.PushMessage(pfrom, NetMsgType::CFCHECKPT, nFilterType, hashStop, vHeaders);
+}
+
+/** Hand a block received, or rebuilt from a cmpctblock, from pfrom to validation */
+void static ProcessBlockFromPeer(CNode *pfrom,
+    CConnman &connman,
+    const CNetworkTemplate &chainparams,
+    const CBlock &block,
+    const std::string &strCommand)
+{
+    const uint256 hash(block.GetHash());
+
+    // Process all blocks from whitelisted peers, even if not requested,
+    // unless we're still syncing with the network. Such an unrequested
+    // block may still be processed, subject to the conditions in
+    // AcceptBlock().
+    bool forceProcessing = pfrom->fWhitelisted && !pnetMan->getChainActive()->IsInitialBlockDownload();
+    {
+        LOCK(cs_main);
+        // Also always process if we requested the block explicitly, as we
+        // may need it even though it is not a candidate for a new best tip.
+        forceProcessing |= MarkBlockAsReceived(hash, pfrom->GetId());
+        // mapBlockSource is only used for sending reject messages and DoS
+        // scores, so the race between here and cs_main in ProcessNewBlock
+        // is fine.
+        mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
+    }
+    // the inputs are read while the block is checked and the ones before it are connected
+    if (g_coinsprefetcher)
+        g_coinsprefetcher->Add(block);
+    CValidationState state;
+    ProcessNewBlock(state, chainparams, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS))
+    {
+        assert(state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+        connman.PushMessage(pfrom, NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
+            state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hash);
+        if (nDoS > 0)
+        {
+            Misbehaving(pfrom->GetId(), nDoS, "invalid-blk");
+        }
+    }
+}
+
 
 bool static ProcessMessage(CNode *pfrom,
     std::string strCommand,
-    CDataStream &vRecv,
+    CPublicDataStream &vRecv,
     int64_t nTimeReceived,
     CConnman &connman)
 {
     const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
     RandAddSeedPerfmon();
-    LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
-    if (gArgs.IsArgSet("-dropmessagestest") && GetRand(atoi(gArgs.GetArg("-dropmessagestest", "0"))) == 0)
+    LogPrint(Logging::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
+    if (gArgs.IsArgSet("-dropmessagestest") && GetFastRand(atoi(gArgs.GetArg("-dropmessagestest", "0"))) == 0)
     {
-        LogPrint("net", "dropmessagestest DROPPING RECV MESSAGE \n");
+        LogPrint(Logging::NET, "dropmessagestest DROPPING RECV MESSAGE \n");
         return true;
     }
 
@@ -1093,7 +1680,7 @@ bool static ProcessMessage(CNode *pfrom,
         {
             LOCK(pfrom->cs_filter);
             // set to true after we get the first filter* message
-            pfrom->fRelayTxes = fRelay;
+            pfrom->fRelayTxes = fRelay && !pfrom->fBlockRelayOnly;
         }
 
         // Change version
@@ -1105,14 +1692,14 @@ bool static ProcessMessage(CNode *pfrom,
 
         if (!pfrom->fInbound)
         {
-            // Advertise our address
-            if (fListen && !pnetMan->getChainActive()->IsInitialBlockDownload())
+            // Advertise our address, a block relay only peer does not take part in address relay
+            if (fListen && !pfrom->fBlockRelayOnly && !pnetMan->getChainActive()->IsInitialBlockDownload())
             {
                 CAddress addr = GetLocalAddress(&pfrom->addr, pfrom->GetLocalServices());
                 FastRandomContext insecure_rand;
                 if (addr.IsRoutable())
                 {
-                    LogPrint("net", "ProcessMessages: advertising address %s\n", addr.ToString());
+                    LogPrint(Logging::NET, "ProcessMessages: advertising address %s\n", addr.ToString());
                     pfrom->PushAddress(addr, insecure_rand);
                 }
                 else if (IsPeerAddrLocalGood(pfrom))
@@ -1124,10 +1711,12 @@ bool static ProcessMessage(CNode *pfrom,
             }
 
             // Get recent addresses
-            if (pfrom->fOneShot || connman.GetAddressCount() < 1000)
+            if (!pfrom->fBlockRelayOnly && (pfrom->fOneShot || connman.GetAddressCount() < 1000))
             {
                 connman.PushMessage(pfrom, NetMsgType::GETADDR);
                 pfrom->fGetAddr = true;
+                // the answer may be a whole message of addresses
+                pfrom->nAddrTokenBucket += MAX_ADDR_TO_SEND;
             }
             connman.MarkAddressGood(pfrom->addr);
         }
@@ -1185,6 +1774,25 @@ bool static ProcessMessage(CNode *pfrom,
             // nodes)
             connman.PushMessage(pfrom, NetMsgType::SENDHEADERS);
         }
+        if (pfrom->nVersion >= COMPACT_BLOCKS_VERSION)
+        {
+            // Tell our peer we can rebuild blocks from cmpctblocks. Only the peers we picked
+            // ourselves are asked to announce new blocks that way, a cmpctblock from every
+            // inbound peer would cost more bandwidth than it saves
+            bool fAnnounceUsingCMPCTBLOCK = !pfrom->fInbound;
+            connman.PushMessage(pfrom, NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, CMPCTBLOCKS_VERSION);
+        }
+        bool fPeerRelaysTxes = false;
+        {
+            LOCK(pfrom->cs_filter);
+            fPeerRelaysTxes = pfrom->fRelayTxes;
+        }
+        if (fPeerRelaysTxes && ::fRelayTxes && gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION))
+        {
+            // offer to reconcile, a peer that does not know the message ignores it
+            const uint64_t nSalt = txreconciliation.PreRegister(pfrom->GetId());
+            connman.PushMessage(pfrom, NetMsgType::SENDTXRCNCL, TXRECONCILIATION_VERSION, nSalt);
+        }
         pfrom->fSuccessfullyConnected = true;
     }
 
@@ -1206,6 +1814,11 @@ bool static ProcessMessage(CNode *pfrom,
 
     else if (strCommand == NetMsgType::ADDR)
     {
+        // we neither asked for them nor relay them
+        if (pfrom->fBlockRelayOnly)
+        {
+            return true;
+        }
         std::vector<CAddress> vAddr;
         vRecv >> vAddr;
 
@@ -1220,16 +1833,37 @@ bool static ProcessMessage(CNode *pfrom,
             return error("message addr size() = %u", vAddr.size());
         }
 
-        // Store the new addresses
+        // Refill the token bucket of the peer, it is only full again after a few hours
+        const int64_t nNowMicros = GetTimeMicros();
+        if (pfrom->nAddrTokenBucket < MAX_ADDR_PROCESSING_TOKEN_BUCKET)
+        {
+            const double nIncrement =
+                (nNowMicros - pfrom->nAddrTokenTimestamp) * MAX_ADDR_RATE_PER_SECOND / 1000000;
+            pfrom->nAddrTokenBucket = std::min(pfrom->nAddrTokenBucket + nIncrement, MAX_ADDR_PROCESSING_TOKEN_BUCKET);
+        }
+        pfrom->nAddrTokenTimestamp = nNowMicros;
+
+        // Store the new addresses, all of them at once, and relay the fresh ones together afterwards
         std::vector<CAddress> vAddrOk;
+        std::vector<std::pair<CAddress, bool> > vAddrRelay;
         int64_t nNow = GetAdjustedTime();
         int64_t nSince = nNow - 10 * 60;
+        uint64_t nRateLimited = 0;
         for (CAddress &addr : vAddr)
         {
             if ((addr.nServices & REQUIRED_SERVICES) != REQUIRED_SERVICES)
             {
                 continue;
             }
+            if (!pfrom->fWhitelisted)
+            {
+                if (pfrom->nAddrTokenBucket < 1.0)
+                {
+                    nRateLimited++;
+                    continue;
+                }
+                pfrom->nAddrTokenBucket -= 1.0;
+            }
 
             if (addr.nTime <= 100000000 || addr.nTime > nNow + 10 * 60)
             {
@@ -1239,8 +1873,7 @@ bool static ProcessMessage(CNode *pfrom,
             bool fReachable = IsReachable(addr);
             if (addr.nTime > nSince && !pfrom->fGetAddr && vAddr.size() <= 10 && addr.IsRoutable())
             {
-                // Relay to a limited number of other nodes
-                RelayAddress(addr, fReachable, connman);
+                vAddrRelay.emplace_back(addr, fReachable);
             }
             // Do not store addresses outside our network
             if (fReachable)
@@ -1248,7 +1881,22 @@ bool static ProcessMessage(CNode *pfrom,
                 vAddrOk.push_back(addr);
             }
         }
-        connman.AddNewAddresses(vAddrOk, pfrom->addr, 2 * 60 * 60);
+        pfrom->nAddrProcessed += vAddr.size() - nRateLimited;
+        pfrom->nAddrRateLimited += nRateLimited;
+        if (nRateLimited)
+        {
+            LogPrint(Logging::NET, "addr message from peer=%d: %u of %u addresses dropped for the rate limit\n",
+                pfrom->GetId(), nRateLimited, vAddr.size());
+        }
+        // Relay to a limited number of other nodes
+        if (!vAddrRelay.empty())
+        {
+            RelayAddresses(vAddrRelay, connman);
+        }
+        if (!vAddrOk.empty())
+        {
+            connman.AddNewAddresses(vAddrOk, pfrom->addr, 2 * 60 * 60);
+        }
         if (vAddr.size() < 1000)
         {
             pfrom->fGetAddr = false;
@@ -1266,6 +1914,103 @@ bool static ProcessMessage(CNode *pfrom,
     }
 
 
+    else if (strCommand == NetMsgType::SENDCMPCT)
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        // ignore versions we do not speak, the peer may send several and keep the one we answer to
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION)
+        {
+            CNodeStateAccessor state(nodestateman, pfrom->GetId());
+            state->fProvidesHeaderAndIDs = true;
+            state->fSupportsDesiredCmpctVersion = true;
+            state->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::FEEFILTER)
+    {
+        CAmount newFeeFilter = 0;
+        vRecv >> newFeeFilter;
+        if (MoneyRange(newFeeFilter))
+        {
+            pfrom->minFeeFilter = newFeeFilter;
+            LogPrint(Logging::NET, "received: feefilter of %s from peer=%d\n", CFeeRate(newFeeFilter).ToString(),
+                pfrom->id);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::SENDTXRCNCL)
+    {
+        uint32_t nReconVersion = 0;
+        uint64_t nRemoteSalt = 0;
+        vRecv >> nReconVersion >> nRemoteSalt;
+        if (txreconciliation.IsRegistered(pfrom->GetId()))
+        {
+            Misbehaving(pfrom, 10, "duplicate-sendtxrcncl");
+            return false;
+        }
+        // we did not offer it, or the peer speaks no version we know, and announces as usual
+        if (txreconciliation.Register(pfrom->GetId(), pfrom->fInbound, nReconVersion, nRemoteSalt))
+            LogPrint(Logging::NET, "reconciling transactions with peer=%d%s\n", pfrom->id,
+                txreconciliation.ShouldFlood(pfrom->GetId()) ? ", still flooding it" : "");
+    }
+
+
+    else if (strCommand == NetMsgType::REQRECON)
+    {
+        uint16_t nRemoteSetSize = 0;
+        uint16_t nQ = 0;
+        vRecv >> nRemoteSetSize >> nQ;
+        std::vector<uint8_t> vSketch;
+        std::vector<uint256> vAnnounce;
+        if (!txreconciliation.HandleRequest(pfrom->GetId(), nRemoteSetSize, nQ, GetTimeMicros(), vSketch, vAnnounce))
+        {
+            Misbehaving(pfrom, 10, "unexpected-reqrecon");
+            return false;
+        }
+        AnnounceReconciledTxs(pfrom, vAnnounce, connman);
+        connman.PushMessage(pfrom, NetMsgType::SKETCH, vSketch);
+    }
+
+
+    else if (strCommand == NetMsgType::SKETCH)
+    {
+        std::vector<uint8_t> vSketch;
+        vRecv >> vSketch;
+        std::vector<uint256> vAnnounce;
+        std::vector<uint32_t> vAsk;
+        bool fSuccess = false;
+        if (!txreconciliation.HandleSketch(pfrom->GetId(), vSketch, vAnnounce, vAsk, fSuccess))
+        {
+            Misbehaving(pfrom, 10, "unexpected-sketch");
+            return false;
+        }
+        LogPrint(Logging::NET, "reconciled with peer=%d, announcing %u and asking for %u transactions\n",
+            pfrom->id, vAnnounce.size(), vAsk.size());
+        connman.PushMessage(pfrom, NetMsgType::RECONCILDIFF, (uint8_t)fSuccess, vAsk);
+        AnnounceReconciledTxs(pfrom, vAnnounce, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::RECONCILDIFF)
+    {
+        uint8_t nSuccess = 0;
+        std::vector<uint32_t> vAsk;
+        vRecv >> nSuccess >> vAsk;
+        std::vector<uint256> vAnnounce;
+        if (!txreconciliation.HandleDiff(pfrom->GetId(), nSuccess != 0, vAsk, vAnnounce))
+        {
+            Misbehaving(pfrom, 10, "unexpected-reconcildiff");
+            return false;
+        }
+        AnnounceReconciledTxs(pfrom, vAnnounce, connman);
+    }
+
+
     else if (strCommand == NetMsgType::INV)
     {
         std::vector<CInv> vInv;
@@ -1284,6 +2029,21 @@ bool static ProcessMessage(CNode *pfrom,
         {
             fBlocksOnly = false;
         }
+        // a block relay only peer was told not to announce transactions
+        if (pfrom->fBlockRelayOnly)
+        {
+            fBlocksOnly = true;
+        }
+
+        // the peer knows what it announced, record that before waiting for cs_main
+        for (const CInv &inv : vInv)
+        {
+            if (inv.type != MSG_BLOCK)
+            {
+                pfrom->AddInventoryKnown(inv);
+                txreconciliation.RemoveFromSet(pfrom->GetId(), inv.hash);
+            }
+        }
 
         LOCK(cs_main);
 
@@ -1327,13 +2087,12 @@ bool static ProcessMessage(CNode *pfrom,
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
                     }
-                    LogPrint("net", "getheaders (%d) %s to peer=%d\n",
+                    LogPrint(Logging::NET, "getheaders (%d) %s to peer=%d\n",
                         pnetMan->getChainActive()->pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
                 }
             }
             else
             {
-                pfrom->AddInventoryKnown(inv);
                 if (fBlocksOnly)
                 {
                     LogPrintf(
@@ -1342,7 +2101,7 @@ bool static ProcessMessage(CNode *pfrom,
                 else if (!fAlreadyHave && !fImporting && !fReindex &&
                          !pnetMan->getChainActive()->IsInitialBlockDownload())
                 {
-                    pfrom->AskFor(inv);
+                    AddTxAnnouncement(pfrom, inv.hash, GetTimeMicros());
                 }
             }
 
@@ -1411,8 +2170,8 @@ bool static ProcessMessage(CNode *pfrom,
             {
                 // When this block is requested, we'll send an inv that'll
                 // trigger the peer to getblocks the next batch of inventory.
-                LogPrint(
-                    "net", "  getblocks stopping at limit %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                LogPrint(Logging::NET, "  getblocks stopping at limit %d %s\n", pindex->nHeight,
+                    pindex->GetBlockHash().ToString());
                 pfrom->hashContinue = pindex->GetBlockHash();
                 break;
             }
@@ -1489,14 +2248,13 @@ bool static ProcessMessage(CNode *pfrom,
         // Stop processing the transaction early if
         // We are in blocks only mode and peer is either not whitelisted or
         // whitelistrelay is off
-        if (!fRelayTxes && (!pfrom->fWhitelisted || !gArgs.GetBoolArg("-whitelistrelay", DEFAULT_WHITELISTRELAY)))
+        if ((!fRelayTxes && (!pfrom->fWhitelisted || !gArgs.GetBoolArg("-whitelistrelay", DEFAULT_WHITELISTRELAY))) ||
+            pfrom->fBlockRelayOnly)
         {
             LogPrintf("transaction sent in violation of protocol peer=%d\n", pfrom->id);
             return true;
         }
 
-        std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
         CTransaction tx;
         vRecv >> tx;
         const CTransactionRef ptx = std::make_shared<CTransaction>(tx);
@@ -1509,42 +2267,35 @@ bool static ProcessMessage(CNode *pfrom,
         bool fMissingInputs = false;
         CValidationState state;
 
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
+        txrequest.ReceivedResponse(pfrom->GetId(), inv.hash);
 
         if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs))
         {
+            txrequest.ForgetTxHash(inv.hash);
             mempool.check(pnetMan->getChainActive()->pcoinsTip.get());
             RelayTransaction(tx, connman);
-            for (size_t i = 0; i < tx.vout.size(); i++)
-            {
-                vWorkQueue.emplace_back(inv.hash, i);
-            }
 
             pfrom->nLastTXTime = GetTime();
 
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d: accepted %s "
+            LogPrint(Logging::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s "
                                 "(poolsz %u txn, %u kB)\n",
                 pfrom->id, tx.GetId().ToString(), mempool.size(), mempool.DynamicMemoryUsage() / 1000);
 
-            // Recursively process any orphan transactions that depended on this
-            // one
-            std::set<NodeId> setMisbehaving;
-            while (!vWorkQueue.empty())
-            {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[0].hash);
-                vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                {
-                    continue;
-                }
-                for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi)
+            // Process the orphan transactions that depended on this one a
+            // generation at a time: all orphans of the transactions accepted
+            // in the previous round are tried in the order they arrived, the
+            // ones accepted make up the next round.
+            std::set<NodeId> setMisbehaving;
+            std::vector<CTransactionRef> vAccepted(1, ptx);
+            while (!vAccepted.empty())
+            {
+                std::vector<COrphanPool::COrphanTx> vChildren = orphanpool.GetChildren(vAccepted);
+                vAccepted.clear();
+                for (const COrphanPool::COrphanTx &orphan : vChildren)
                 {
-                    const uint256 &orphanHash = *mi;
-                    const CTransaction orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    const CTransactionRef &porphanTx = std::make_shared<CTransaction>(orphanTx);
-                    const uint256 &orphanId = orphanTx.GetId();
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
+                    const CTransactionRef &porphanTx = orphan.tx;
+                    const uint256 &orphanId = porphanTx->GetId();
+                    NodeId fromPeer = orphan.fromPeer;
 
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes
@@ -1560,12 +2311,10 @@ bool static ProcessMessage(CNode *pfrom,
                     if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2))
                     {
                         LogPrintf("   accepted orphan tx %s\n", orphanId.ToString());
-                        RelayTransaction(orphanTx, connman);
-                        for (size_t i = 0; i < orphanTx.vout.size(); i++)
-                        {
-                            vWorkQueue.emplace_back(orphanId, i);
-                        }
-                        vEraseQueue.push_back(orphanId);
+                        RelayTransaction(*porphanTx, connman);
+                        vAccepted.push_back(porphanTx);
+                        orphanpool.EraseTx(porphanTx->GetHash());
+                        txrequest.ForgetTxHash(orphanId);
                     }
                     else if (!fMissingInputs2)
                     {
@@ -1580,7 +2329,7 @@ bool static ProcessMessage(CNode *pfrom,
                         // Has inputs but not accepted to mempool
                         // Probably non-standard or insufficient fee/priority
                         LogPrintf("   removed orphan tx %s\n", orphanId.ToString());
-                        vEraseQueue.push_back(orphanId);
+                        orphanpool.EraseTx(porphanTx->GetHash());
                         if (!stateDummy.CorruptionPossible())
                         {
                             // Do not use rejection cache for witness
@@ -1590,15 +2339,11 @@ bool static ProcessMessage(CNode *pfrom,
                             // for details.
                             assert(recentRejects);
                             recentRejects->insert(orphanId);
+                            txrequest.ForgetTxHash(orphanId);
                         }
                     }
-                    mempool.check(pnetMan->getChainActive()->pcoinsTip.get());
                 }
-            }
-
-            for (uint256 hash : vEraseQueue)
-            {
-                EraseOrphanTx(hash);
+                mempool.check(pnetMan->getChainActive()->pcoinsTip.get());
             }
         }
         else if (fMissingInputs)
@@ -1618,22 +2363,26 @@ bool static ProcessMessage(CNode *pfrom,
             {
                 uint32_t nFetchFlags =
                     GetFetchFlags(pfrom, pnetMan->getChainActive()->chainActive.Tip(), chainparams.GetConsensus());
+                const int64_t nNowMicros = GetTimeMicros();
                 for (const CTxIn &txin : tx.vin)
                 {
                     CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
                     pfrom->AddInventoryKnown(_inv);
                     if (!AlreadyHave(_inv))
                     {
-                        pfrom->AskFor(_inv);
+                        AddTxAnnouncement(pfrom, _inv.hash, nNowMicros);
                     }
                 }
-                AddOrphanTx(tx, pfrom->GetId());
+                orphanpool.AddTx(ptx, pfrom->GetId());
+                txrequest.ForgetTxHash(tx.GetId());
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow
+                // DoS prevention: do not allow the orphan pool to grow
                 // unbounded
                 unsigned int nMaxOrphanTx =
                     (unsigned int)std::max(int64_t(0), gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                uint64_t nMaxOrphanBytes =
+                    std::max(int64_t(0), gArgs.GetArg("-maxorphanpool", DEFAULT_MAX_ORPHAN_POOL_SIZE)) * 1000000;
+                unsigned int nEvicted = orphanpool.LimitSize(nMaxOrphanTx, nMaxOrphanBytes);
                 if (nEvicted > 0)
                 {
                     LogPrintf("mapOrphan overflow, removed %u tx\n", nEvicted);
@@ -1645,6 +2394,7 @@ bool static ProcessMessage(CNode *pfrom,
                 // We will continue to reject this tx since it has rejected
                 // parents so avoid re-requesting it from other peers.
                 recentRejects->insert(tx.GetId());
+                txrequest.ForgetTxHash(tx.GetId());
             }
         }
         else
@@ -1657,6 +2407,7 @@ bool static ProcessMessage(CNode *pfrom,
                 // for details.
                 assert(recentRejects);
                 recentRejects->insert(tx.GetId());
+                txrequest.ForgetTxHash(tx.GetId());
             }
 
             if (pfrom->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY))
@@ -1672,13 +2423,13 @@ bool static ProcessMessage(CNode *pfrom,
                 int nDoS = 0;
                 if (!state.IsInvalid(nDoS) || nDoS == 0)
                 {
-                    LogPrint(
-                        "net", "Force relaying tx %s from whitelisted peer=%d\n", tx.GetId().ToString(), pfrom->id);
+                    LogPrint(Logging::NET, "Force relaying tx %s from whitelisted peer=%d\n", tx.GetId().ToString(),
+                        pfrom->id);
                     RelayTransaction(tx, connman);
                 }
                 else
                 {
-                    LogPrint("net", "Not relaying invalid transaction %s from "
+                    LogPrint(Logging::NET, "Not relaying invalid transaction %s from "
                                     "whitelisted peer=%d (%s)\n",
                         tx.GetId().ToString(), pfrom->id, FormatStateMessage(state));
                 }
@@ -1722,6 +2473,23 @@ bool static ProcessMessage(CNode *pfrom,
             ReadCompactSize(vRecv); // ignore empty vchBlockSig
         }
 
+        // scrypt the whole batch in parallel before taking cs_main, AcceptBlockHeader
+        // and AddToBlockIndex then find every hash already cached on its header
+        PrecomputeHeaderHashes(headers);
+
+        int nSegmentDoS = 0;
+        if (headersync.ReceivedHeaders(pfrom->GetId(), headers, GetTimeMicros(), nSegmentDoS))
+        {
+            LOCK(cs_main);
+            if (nSegmentDoS > 0)
+            {
+                Misbehaving(pfrom->GetId(), nSegmentDoS, "bad-header-segment");
+                return error("invalid headers segment received");
+            }
+            ConnectHeaderSegments(chainparams);
+            return true;
+        }
+
         LOCK(cs_main);
 
         if (nCount == 0)
@@ -1781,8 +2549,8 @@ bool static ProcessMessage(CNode *pfrom,
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
-            LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id,
-                pfrom->nStartingHeight);
+            LogPrint(Logging::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight,
+                pfrom->id, pfrom->nStartingHeight);
             connman.PushMessage(pfrom, NetMsgType::GETHEADERS,
                 pnetMan->getChainActive()->chainActive.GetLocator(pindexLast), uint256());
         }
@@ -1813,8 +2581,8 @@ bool static ProcessMessage(CNode *pfrom,
             // direct fetch and rely on parallel download instead.
             if (!pnetMan->getChainActive()->chainActive.Contains(pindexWalk))
             {
-                LogPrint("net", "Large reorg, won't direct fetch to %s (%d)\n", pindexLast->GetBlockHash().ToString(),
-                    pindexLast->nHeight);
+                LogPrint(Logging::NET, "Large reorg, won't direct fetch to %s (%d)\n",
+                    pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
             }
             else
             {
@@ -1829,14 +2597,22 @@ bool static ProcessMessage(CNode *pfrom,
                     }
                     vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                     MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex);
-                    LogPrint(
-                        "net", "Requesting block %s from  peer=%d\n", pindex->GetBlockHash().ToString(), pfrom->id);
+                    LogPrint(Logging::NET, "Requesting block %s from  peer=%d\n", pindex->GetBlockHash().ToString(),
+                        pfrom->id);
                 }
                 if (vGetData.size() > 1)
                 {
-                    LogPrint("net", "Downloading blocks toward %s (%d) via headers direct fetch\n",
+                    LogPrint(Logging::NET, "Downloading blocks toward %s (%d) via headers direct fetch\n",
                         pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
                 }
+                else if (vGetData.size() == 1 && nodestate->fSupportsDesiredCmpctVersion &&
+                         mapBlocksInFlight.size() == 1 &&
+                         pindexLast->pprev == pnetMan->getChainActive()->chainActive.Tip())
+                {
+                    // a single new block on our tip is mostly transactions our mempool has
+                    // already, so ask for it compact
+                    vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
+                }
                 if (vGetData.size() > 0)
                 {
                     connman.PushMessage(pfrom, NetMsgType::GETDATA, vGetData);
@@ -1848,40 +2624,321 @@ bool static ProcessMessage(CNode *pfrom,
 
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
+        // index the block where it lies in vRecv, the transactions the mempool already has are then shared with
+        // it instead of being deserialized a second time
+        const CBlockView view(reinterpret_cast<const uint8_t *>(vRecv.data()),
+            reinterpret_cast<const uint8_t *>(vRecv.data() + vRecv.size()));
+        std::vector<CTransactionRef> vtxKnown(view.GetTxCount());
+        {
+            READLOCK(mempool.cs);
+            for (size_t i = 1; i < vtxKnown.size(); i++)
+                vtxKnown[i] = mempool._get(view.GetTxHash(i));
+        }
         CBlock block;
-        vRecv >> block;
+        view.GetBlock(block, vtxKnown);
+
+        LogPrint(Logging::NET, "received block %s peer=%d\n", block.GetHash().ToString(), pfrom->id);
+        ProcessBlockFromPeer(pfrom, connman, chainparams, block, strCommand);
+    }
+
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
 
-        const uint256 hash(block.GetHash());
-        LogPrint("net", "received block %s peer=%d\n", hash.ToString(), pfrom->id);
+        // scrypt the header before taking cs_main
+        const uint256 hash(cmpctblock.header.GetHash());
+        LogPrint(Logging::NET, "received cmpctblock %s peer=%d\n", hash.ToString(), pfrom->id);
 
-        // Process all blocks from whitelisted peers, even if not requested,
-        // unless we're still syncing with the network. Such an unrequested
-        // block may still be processed, subject to the conditions in
-        // AcceptBlock().
-        bool forceProcessing = pfrom->fWhitelisted && !pnetMan->getChainActive()->IsInitialBlockDownload();
+        bool fBlockReconstructed = false;
+        CBlock block;
         {
             LOCK(cs_main);
-            // Also always process if we requested the block explicitly, as we
-            // may need it even though it is not a candidate for a new best tip.
-            forceProcessing |= MarkBlockAsReceived(hash);
-            // mapBlockSource is only used for sending reject messages and DoS
-            // scores, so the race between here and cs_main in ProcessNewBlock
-            // is fine.
-            mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
+
+            if (pnetMan->getChainActive()->LookupBlockIndex(cmpctblock.header.hashPrevBlock) == nullptr)
+            {
+                // Doesn't connect, ask for the headers in between instead of punishing the peer
+                if (!pnetMan->getChainActive()->IsInitialBlockDownload())
+                {
+                    connman.PushMessage(pfrom, NetMsgType::GETHEADERS,
+                        pnetMan->getChainActive()->chainActive.GetLocator(pnetMan->getChainActive()->pindexBestHeader),
+                        uint256());
+                }
+                return true;
+            }
+
+            CBlockIndex *pindex = nullptr;
+            CValidationState state;
+            if (!AcceptBlockHeader(cmpctblock.header, state, chainparams, &pindex))
+            {
+                int nDoS;
+                if (state.IsInvalid(nDoS))
+                {
+                    if (nDoS > 0)
+                    {
+                        Misbehaving(pfrom->GetId(), nDoS, state.GetRejectReason());
+                    }
+                    LogPrintf("Peer %d sent us invalid header via cmpctblock\n", pfrom->id);
+                    return true;
+                }
+            }
+            if (pindex == nullptr)
+            {
+                return true;
+            }
+            UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+            {
+                // Nothing to do here
+                return true;
+            }
+
+            std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight =
+                mapBlocksInFlight.find(hash);
+            bool fAlreadyInFlight = itInFlight != mapBlocksInFlight.end();
+            bool fInFlightFromThis = fAlreadyInFlight && itInFlight->second.first == pfrom->GetId();
+            const CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+
+            if (pindex->nChainWork <= pindexTip->nChainWork || pindex->nTx != 0)
+            {
+                // not a new best block, only get it if we asked for it
+                if (fAlreadyInFlight)
+                {
+                    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                    connman.PushMessage(pfrom, NetMsgType::GETDATA, vInv);
+                }
+                return true;
+            }
+
+            if (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))
+            {
+                return true;
+            }
+
+            // our mempool only helps with blocks right on top of our tip, the block
+            // download logic fetches the others whole once it saw this header
+            if (pindex->nHeight > pindexTip->nHeight + 2)
+            {
+                if (fAlreadyInFlight)
+                {
+                    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                    connman.PushMessage(pfrom, NetMsgType::GETDATA, vInv);
+                }
+                return true;
+            }
+
+            bool fCanRequest = false;
+            {
+                CNodeStateAccessor nodestate(nodestateman, pfrom->GetId());
+                fCanRequest = fInFlightFromThis ||
+                              (!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+            }
+            if (fCanRequest)
+            {
+                std::list<QueuedBlock>::iterator *queuedBlockIt = nullptr;
+                if (!MarkBlockAsInFlight(pfrom->GetId(), hash, chainparams.GetConsensus(), pindex, &queuedBlockIt))
+                {
+                    if (!(*queuedBlockIt)->partialBlock)
+                    {
+                        (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                    }
+                    else
+                    {
+                        // The block was already in flight using compact blocks from the same peer
+                        LogPrint(Logging::NET, "Peer sent us compact block we were already syncing!\n");
+                        return true;
+                    }
+                }
+
+                PartiallyDownloadedBlock &partialBlock = *(*queuedBlockIt)->partialBlock;
+                ReadStatus status = partialBlock.InitData(cmpctblock);
+                if (status == READ_STATUS_INVALID)
+                {
+                    // Reset in-flight state in case of whitelist
+                    MarkBlockAsReceived(hash);
+                    Misbehaving(pfrom->GetId(), 100, "invalid-cmpctblk");
+                    LogPrintf("Peer %d sent us invalid compact block\n", pfrom->id);
+                    return true;
+                }
+                else if (status == READ_STATUS_FAILED)
+                {
+                    // Duplicate txindexes, the block is now in-flight, so just request it
+                    std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                    connman.PushMessage(pfrom, NetMsgType::GETDATA, vInv);
+                    return true;
+                }
+
+                BlockTransactionsRequest req;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++)
+                {
+                    if (!partialBlock.IsTxAvailable(i))
+                    {
+                        req.indexes.push_back(i);
+                    }
+                }
+                if (req.indexes.empty())
+                {
+                    // everything was in our mempool
+                    status = partialBlock.FillBlock(block, std::vector<CTransactionRef>());
+                    if (status == READ_STATUS_OK)
+                    {
+                        fBlockReconstructed = true;
+                    }
+                    else
+                    {
+                        std::vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+                        connman.PushMessage(pfrom, NetMsgType::GETDATA, vInv);
+                        return true;
+                    }
+                }
+                else
+                {
+                    req.blockhash = hash;
+                    connman.PushMessage(pfrom, NetMsgType::GETBLOCKTXN, req);
+                }
+            }
+            else
+            {
+                // The block is in flight from another peer, or this one has too many blocks
+                // outstanding. Try to rebuild it anyway, without asking for anything, as our
+                // mempool may have everything
+                PartiallyDownloadedBlock tempBlock(&mempool);
+                ReadStatus status = tempBlock.InitData(cmpctblock);
+                if (status != READ_STATUS_OK)
+                {
+                    // TODO: don't ignore failures
+                    return true;
+                }
+                status = tempBlock.FillBlock(block, std::vector<CTransactionRef>());
+                if (status == READ_STATUS_OK)
+                {
+                    fBlockReconstructed = true;
+                }
+            }
         }
-        CValidationState state;
-        ProcessNewBlock(state, chainparams, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS))
+
+        if (fBlockReconstructed)
         {
-            assert(state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
-            connman.PushMessage(pfrom, NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
-                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hash);
-            if (nDoS > 0)
+            ProcessBlockFromPeer(pfrom, connman, chainparams, block, strCommand);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN)
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_mostRecentBlock);
+            if (mostRecentBlockHash == req.blockhash)
+            {
+                pblock = mostRecentBlock;
+            }
+        }
+        if (pblock)
+        {
+            SendBlockTransactions(*pblock, req, pfrom, connman);
+            return true;
+        }
+
+        LOCK(cs_main);
+
+        CBlockIndex *pindex = pnetMan->getChainActive()->LookupBlockIndex(req.blockhash);
+        if (!pindex || !(pindex->nStatus & BLOCK_HAVE_DATA))
+        {
+            LogPrint(Logging::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (pindex->nHeight < pnetMan->getChainActive()->chainActive.Height() - MAX_BLOCKTXN_DEPTH)
+        {
+            // An old block is unlikely to be one the peer is rebuilding, and answering for
+            // those would let anyone make us read blocks back from disk cheaply. Send it whole
+            // like a getdata would, which also counts towards the upload limit.
+            LogPrint(Logging::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id,
+                MAX_BLOCKTXN_DEPTH);
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+        {
+            LogPrintf("cannot load block from disk");
+            assert(false);
+        }
+        SendBlockTransactions(block, req, pfrom, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFILTERS)
+    {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        bool fBlockRead = false;
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator it =
+                mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                it->second.first != pfrom->GetId())
             {
-                Misbehaving(pfrom->GetId(), nDoS, "invalid-blk");
+                LogPrint(Logging::NET, "Peer %d sent us block transactions for block we weren't expecting\n",
+                    pfrom->id);
+                return true;
+            }
+
+            PartiallyDownloadedBlock &partialBlock = *it->second.second->partialBlock;
+            ReadStatus status = partialBlock.FillBlock(block, resp.txn);
+            if (status == READ_STATUS_INVALID)
+            {
+                // Reset in-flight state in case of whitelist
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100, "invalid-cmpctblk-txns");
+                LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+                return true;
+            }
+            else if (status == READ_STATUS_FAILED)
+            {
+                // Might have collided, fall back to getdata now :(
+                std::vector<CInv> invs(1, CInv(MSG_BLOCK, resp.blockhash));
+                connman.PushMessage(pfrom, NetMsgType::GETDATA, invs);
+            }
+            else
+            {
+                fBlockRead = true;
             }
         }
+
+        if (fBlockRead)
+        {
+            ProcessBlockFromPeer(pfrom, connman, chainparams, block, strCommand);
+        }
     }
 
     // This asymmetric behavior for inbound and outbound connections was introduced
@@ -1924,19 +2981,26 @@ bool static ProcessMessage(CNode *pfrom,
 
     else if (strCommand == NetMsgType::MEMPOOL)
     {
+        if (pfrom->fBlockRelayOnly)
+        {
+            return true;
+        }
         std::vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
         std::vector<CInv> vInv;
+        const CAmount nFeeFilter = pfrom->minFeeFilter;
         BOOST_FOREACH (uint256 &hash, vtxid)
         {
             CInv inv(MSG_TX, hash);
-            if (pfrom->pfilter)
+            if (pfrom->pfilter || nFeeFilter > 0)
             {
                 CTxMemPoolEntry txe;
                 bool fInMemPool = mempool.lookup(hash, txe);
                 if (!fInMemPool)
                     continue; // another thread removed since queryHashes, maybe...
-                if (!pfrom->pfilter->IsRelevantAndUpdate(txe.GetTx()))
+                if (nFeeFilter > 0 && CFeeRate(txe.GetFee(), txe.GetTxSize()).GetFeePerK() < nFeeFilter)
+                    continue;
+                if (pfrom->pfilter && !pfrom->pfilter->IsRelevantAndUpdate(txe.GetTx()))
                     continue;
             }
             vInv.push_back(inv);
@@ -2032,7 +3096,7 @@ bool static ProcessMessage(CNode *pfrom,
 
         if (!(sProblem.empty()))
         {
-            LogPrint("net", "pong peer=%d: %s, %x expected, %x received, %u bytes\n", pfrom->id, sProblem,
+            LogPrint(Logging::NET, "pong peer=%d: %s, %x expected, %x received, %u bytes\n", pfrom->id, sProblem,
                 pfrom->nPingNonceSent, nonce, nAvail);
         }
         if (bPingFinished)
@@ -2056,7 +3120,7 @@ bool static ProcessMessage(CNode *pfrom,
             pfrom->pfilter = new CBloomFilter(filter);
             pfrom->pfilter->UpdateEmptyFull();
         }
-        pfrom->fRelayTxes = true;
+        pfrom->fRelayTxes = !pfrom->fBlockRelayOnly;
     }
 
 
@@ -2087,13 +3151,30 @@ bool static ProcessMessage(CNode *pfrom,
         LOCK(pfrom->cs_filter);
         delete pfrom->pfilter;
         pfrom->pfilter = new CBloomFilter();
-        pfrom->fRelayTxes = true;
+        pfrom->fRelayTxes = !pfrom->fBlockRelayOnly;
     }
 
 
+    else if (strCommand == NetMsgType::NOTFOUND)
+    {
+        std::vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() <= MAX_INV_SZ)
+        {
+            // the next announcer of these is asked
+            for (const CInv &inv : vInv)
+            {
+                if (inv.type == MSG_TX)
+                {
+                    txrequest.ReceivedResponse(pfrom->GetId(), inv.hash);
+                }
+            }
+        }
+    }
+
     else if (strCommand == NetMsgType::REJECT)
     {
-        if (g_logger->fDebug)
+        if (g_logger->LogAcceptCategory(Logging::NET))
         {
             try
             {
@@ -2112,12 +3193,12 @@ bool static ProcessMessage(CNode *pfrom,
                     vRecv >> hash;
                     ss << ": hash " << hash.ToString();
                 }
-                LogPrint("net", "Reject %s\n", SanitizeString(ss.str()));
+                LogPrint(Logging::NET, "Reject %s\n", SanitizeString(ss.str()));
             }
             catch (const std::ios_base::failure &)
             {
                 // Avoid feedback loops by preventing reject messages from triggering a new reject message.
-                LogPrint("net", "Unparseable reject message received\n");
+                LogPrint(Logging::NET, "Unparseable reject message received\n");
             }
         }
     }
@@ -2125,7 +3206,7 @@ bool static ProcessMessage(CNode *pfrom,
     else
     {
         // Ignore unknown commands for extensibility
-        LogPrint("net", "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
+        LogPrint(Logging::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
     }
 
 
@@ -2154,6 +3235,12 @@ bool ProcessMessages(CNode *pfrom, CConnman &connman)
         return false;
     }
 
+    // the block server wakes the message handler once the block is queued
+    if (pfrom->fBlockReadPending)
+    {
+        return false;
+    }
+
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty())
     {
@@ -2205,7 +3292,7 @@ bool ProcessMessages(CNode *pfrom, CConnman &connman)
     unsigned int nMessageSize = hdr.nMessageSize;
 
     // Checksum
-    CDataStream &vRecv = msg.vRecv;
+    CPublicDataStream &vRecv = msg.vRecv;
     const uint256 &hash = msg.GetMessageHash();
     if (memcmp(hash.begin(), hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) != 0)
     {
@@ -2217,6 +3304,7 @@ bool ProcessMessages(CNode *pfrom, CConnman &connman)
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
     try
     {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman);
@@ -2261,13 +3349,14 @@ bool ProcessMessages(CNode *pfrom, CConnman &connman)
     {
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
+    connman.RecordMessageTimes(pfrom, strCommand, nProcessStart - msg.nTime, GetTimeMicros() - nProcessStart);
+    msg.ReleaseBuffer();
 
     if (!fRet)
     {
         LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
     }
 
-    LOCK(cs_main);
     SendRejectsAndCheckIfBanned(pfrom, connman);
 
     return fMoreWork;
@@ -2310,14 +3399,14 @@ bool SendMessages(CNode *pto, CConnman &connman)
         connman.PushMessage(pto, NetMsgType::PING, nonce);
     }
 
-    // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
-    TRY_LOCK(cs_main, lockMain);
-    if (!lockMain)
+    if (SendRejectsAndCheckIfBanned(pto, connman))
     {
         return true;
     }
 
-    if (SendRejectsAndCheckIfBanned(pto, connman))
+    // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
     {
         return true;
     }
@@ -2380,7 +3469,21 @@ bool SendMessages(CNode *pto, CConnman &connman)
     // might do.
     bool fFetch = nodestate->fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot);
 
-    if (!nodestate->fSyncStarted && !pto->fClient && !fImporting && !fReindex)
+    // Headers up to the last checkpoint come in segments from several peers at once
+    if (fFetch && !pto->fClient && !fImporting && !fReindex)
+    {
+        uint256 hashFrom;
+        uint256 hashStop;
+        if (headersync.GetRequest(pto->GetId(), pto->nStartingHeight, nNow, hashFrom, hashStop))
+        {
+            LogPrint(Logging::NET, "segment getheaders from %s to %s to peer=%d\n", hashFrom.ToString(),
+                hashStop.ToString(), pto->id);
+            connman.PushMessage(
+                pto, NetMsgType::GETHEADERS, CBlockLocator(std::vector<uint256>(1, hashFrom)), hashStop);
+        }
+    }
+
+    if (!nodestate->fSyncStarted && !headersync.IsActive() && !pto->fClient && !fImporting && !fReindex)
     {
         // Only actively request headers from a single peer, unless we're close
         // to today.
@@ -2403,21 +3506,13 @@ bool SendMessages(CNode *pto, CConnman &connman)
                 pindexStart = pindexStart->pprev;
             }
 
-            LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id,
-                pto->nStartingHeight);
+            LogPrint(Logging::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight,
+                pto->id, pto->nStartingHeight);
             connman.PushMessage(
                 pto, NetMsgType::GETHEADERS, pnetMan->getChainActive()->chainActive.GetLocator(pindexStart), uint256());
         }
     }
 
-    // Resend wallet transactions that haven't gotten in a block yet
-    // Except during reindex, importing and IBD, when old wallet transactions
-    // become unconfirmed and spams other nodes.
-    if (!fReindex && !fImporting && !pnetMan->getChainActive()->IsInitialBlockDownload())
-    {
-        GetMainSignals().Broadcast(nTimeBestReceived, &connman);
-    }
-
     //
     // Try sending block announcements via headers
     //
@@ -2429,8 +3524,10 @@ bool SendMessages(CNode *pto, CConnman &connman)
         // or if the peer doesn't want headers, just add all to the inv queue.
         LOCK(pto->cs_inventory);
         std::vector<CBlock> vHeaders;
-        bool fRevertToInv = ((!nodestate->fPreferHeaders && (pto->vBlockHashesToAnnounce.size() > 1)) ||
-                             pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
+        bool fRevertToInv =
+            ((!nodestate->fPreferHeaders &&
+                 (!nodestate->fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
+                pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
         // last header queued for delivery
         CBlockIndex *pBestIndex = nullptr;
         // ensure pindexBestKnownBlock is up-to-date
@@ -2496,16 +3593,46 @@ bool SendMessages(CNode *pto, CConnman &connman)
         }
         if (!fRevertToInv && !vHeaders.empty())
         {
-            if (nodestate->fPreferHeaders)
+            if (vHeaders.size() == 1 && nodestate->fPreferHeaderAndIDs)
+            {
+                // the peer has the parent of this block, so it most likely got the
+                // transactions of it relayed already
+                LogPrint(Logging::NET, "%s sending header-and-ids %s to peer=%d\n", __func__,
+                    vHeaders.front().GetHash().ToString(), pto->id);
+                std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
+                {
+                    LOCK(cs_mostRecentBlock);
+                    if (mostRecentBlockHash == pBestIndex->GetBlockHash())
+                    {
+                        pcmpctblock = mostRecentCompactBlock;
+                    }
+                }
+                if (pcmpctblock)
+                {
+                    connman.PushMessage(pto, NetMsgType::CMPCTBLOCK, *pcmpctblock);
+                }
+                else
+                {
+                    CBlock block;
+                    if (!ReadBlockFromDisk(block, pBestIndex, consensusParams))
+                    {
+                        LogPrintf("cannot load block from disk");
+                        assert(false);
+                    }
+                    connman.PushMessage(pto, NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block));
+                }
+                nodestate->pindexBestHeaderSent = pBestIndex;
+            }
+            else if (nodestate->fPreferHeaders)
             {
                 if (vHeaders.size() > 1)
                 {
-                    LogPrint("net", "%s: %u headers, range (%s, %s), to peer=%d\n", __func__, vHeaders.size(),
+                    LogPrint(Logging::NET, "%s: %u headers, range (%s, %s), to peer=%d\n", __func__, vHeaders.size(),
                         vHeaders.front().GetHash().ToString(), vHeaders.back().GetHash().ToString(), pto->id);
                 }
                 else
                 {
-                    LogPrint("net", "%s: sending header %s to peer=%d\n", __func__,
+                    LogPrint(Logging::NET, "%s: sending header %s to peer=%d\n", __func__,
                         vHeaders.front().GetHash().ToString(), pto->id);
                 }
                 connman.PushMessage(pto, NetMsgType::HEADERS, vHeaders);
@@ -2532,7 +3659,8 @@ bool SendMessages(CNode *pto, CConnman &connman)
                 // Just log for now.
                 if (pnetMan->getChainActive()->chainActive[pindex->nHeight] != pindex)
                 {
-                    LogPrint("net", "Announcing block %s not on main chain (tip=%s)\n", hashToAnnounce.ToString(),
+                    LogPrint(Logging::NET, "Announcing block %s not on main chain (tip=%s)\n",
+                        hashToAnnounce.ToString(),
                         pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash().ToString());
                 }
 
@@ -2540,7 +3668,8 @@ bool SendMessages(CNode *pto, CConnman &connman)
                 if (!PeerHasHeader(nodestate.Get(), pindex))
                 {
                     pto->PushInventory(CInv(MSG_BLOCK, hashToAnnounce));
-                    LogPrint("net", "%s: sending inv peer=%d hash=%s\n", __func__, pto->id, hashToAnnounce.ToString());
+                    LogPrint(Logging::NET, "%s: sending inv peer=%d hash=%s\n", __func__, pto->id,
+                        hashToAnnounce.ToString());
                 }
             }
         }
@@ -2583,41 +3712,55 @@ bool SendMessages(CNode *pto, CConnman &connman)
             LOCK(pto->cs_filter);
             if (!pto->fRelayTxes)
             {
-                pto->setInventoryTxToSend.clear();
+                pto->mapInventoryTxToSend.clear();
+                pto->setInventoryTxByFeeRate.clear();
             }
         }
 
         // Determine transactions to relay
         if (fSendTrickle)
         {
-            // Produce a vector with all candidates for sending
-            std::vector<std::set<uint256>::iterator> vInvTx;
-            vInvTx.reserve(pto->setInventoryTxToSend.size());
-            for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin();
-                 it != pto->setInventoryTxToSend.end(); it++)
-            {
-                vInvTx.push_back(it);
-            }
             // No reason to drain out at many times the network's capacity,
             // especially since we have many peers and some will draw much
-            // shorter delays.
+            // shorter delays. Highest feerate first, and a bounded number of
+            // entries looked at so a flood holds up the rest of this peer's
+            // messages for no longer than that, what is left waits for the
+            // next round.
             unsigned int nRelayedTransactions = 0;
+            unsigned int nExamined = 0;
+            const CAmount nFeeFilter = pto->minFeeFilter;
+            const bool fFlood = txreconciliation.ShouldFlood(pto->GetId());
             LOCK(pto->cs_filter);
-            while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX)
+            READLOCK(mempool.cs);
+            while (!pto->setInventoryTxByFeeRate.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX &&
+                   nExamined < INVENTORY_BROADCAST_MAX_WORK)
             {
-                std::set<uint256>::iterator it = vInvTx.back();
-                vInvTx.pop_back();
-                uint256 hash = *it;
+                std::set<std::pair<CAmount, uint256> >::iterator it = std::prev(pto->setInventoryTxByFeeRate.end());
+                uint256 hash = it->second;
                 // Remove it from the to-be-sent set
-                pto->setInventoryTxToSend.erase(it);
+                pto->setInventoryTxByFeeRate.erase(it);
+                pto->mapInventoryTxToSend.erase(hash);
+                nExamined++;
                 // Check if not in the filter already
                 if (pto->filterInventoryKnown.contains(hash))
                 {
                     continue;
                 }
                 // Not in the mempool anymore? don't bother sending it.
-                if (!mempool.exists(hash))
+                CTxMemPool::txiter txit = mempool.mapTx.find(hash);
+                if (txit == mempool.mapTx.end())
+                {
+                    continue;
+                }
+                // Below what the peer accepts, it goes by the fee paid and not by a prioritisation of ours
+                if (nFeeFilter > 0 && CFeeRate(txit->GetFee(), txit->GetTxSize()).GetFeePerK() < nFeeFilter)
+                {
+                    continue;
+                }
+                // Kept for the next reconciliation instead, flooded when the set is full
+                if (!fFlood && txreconciliation.AddToSet(pto->GetId(), hash))
                 {
+                    pto->filterInventoryKnown.insert(hash);
                     continue;
                 }
                 // Send
@@ -2637,6 +3780,20 @@ bool SendMessages(CNode *pto, CConnman &connman)
         connman.PushMessage(pto, NetMsgType::INV, vInv);
     }
 
+    //
+    // Message: reqrecon
+    //
+    if (txreconciliation.IsRegistered(pto->GetId()))
+    {
+        uint16_t nSetSize = 0;
+        uint16_t nQ = 0;
+        if (txreconciliation.GetRequest(pto->GetId(), nNow, nSetSize, nQ))
+            connman.PushMessage(pto, NetMsgType::REQRECON, nSetSize, nQ);
+        std::vector<uint256> vAnnounce;
+        txreconciliation.ExpireResponse(pto->GetId(), nNow, vAnnounce);
+        AnnounceReconciledTxs(pto, vAnnounce, connman);
+    }
+
     // Detect whether we're stalling
     nNow = GetTimeMicros();
     // In case there is a block that has been in flight from this peer for 2 +
@@ -2672,33 +3829,65 @@ bool SendMessages(CNode *pto, CConnman &connman)
     // Message: getdata (blocks)
     //
     std::vector<CInv> vGetData;
+    int nBlockQuota = GetBlockQuota(nodestate.Get());
     if (!pto->fClient && (fFetch || !pnetMan->getChainActive()->IsInitialBlockDownload()) &&
-        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+        nodestate->nBlocksInFlight < nBlockQuota)
     {
         std::vector<const CBlockIndex *> vToDownload;
         NodeId staller = -1;
+        const CBlockIndex *pindexStalled = nullptr;
         FindNextBlocksToDownload(
-            pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - nodestate->nBlocksInFlight, vToDownload, staller);
+            pto->GetId(), nBlockQuota - nodestate->nBlocksInFlight, vToDownload, staller, pindexStalled);
+        if (staller != -1 && pindexStalled)
+        {
+            // the window is full, and the lowest block of it is in flight from another peer. When
+            // that peer has been sitting on it for longer than we would take, we ask for the block
+            CNodeStateAccessor stallerstate(nodestateman, staller);
+            if (!stallerstate.IsNull())
+            {
+                int64_t nStalledFor = nNow - stallerstate->nDownloadingSince;
+                int64_t nExpected =
+                    nodestate->nAvgBlockTime != 0 ? nodestate->nAvgBlockTime : BLOCK_STALLING_TIMEOUT * 1000000;
+                if (stallerstate->nStallingSince == 0)
+                {
+                    stallerstate->nStallingSince = nNow;
+                }
+                else if (nNow - stallerstate->nStallingSince > BLOCK_STALLING_TIMEOUT * 1000000 &&
+                         nStalledFor > nExpected)
+                {
+                    LogPrint(Logging::NET, "Block %s (%d) stalled on peer=%d for %ds, requesting it from peer=%d\n",
+                        pindexStalled->GetBlockHash().ToString(), pindexStalled->nHeight, staller,
+                        nStalledFor / 1000000, pto->id);
+                    // it has been at least this slow, which shrinks its quota
+                    stallerstate->nAvgBlockTime = std::max(stallerstate->nAvgBlockTime, nStalledFor);
+                    stallerstate->nStallingSince = 0;
+                    stallerstate->nBlockStalls++;
+                    vToDownload.push_back(pindexStalled);
+                }
+            }
+        }
         for (const CBlockIndex *pindex : vToDownload)
         {
             uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
             vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
             MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
-            LogPrint("net", "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(), pindex->nHeight,
-                pto->id);
+            LogPrint(Logging::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
+                pindex->nHeight, pto->id);
         }
     }
 
     //
     // Message: getdata (non-blocks)
     //
-    while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
+    const uint32_t nTxFetchFlags = GetFetchFlags(pto, pnetMan->getChainActive()->chainActive.Tip(), consensusParams);
+    for (const uint256 &txhash : txrequest.GetRequestable(pto->GetId(), nNow))
     {
-        const CInv &inv = (*pto->mapAskFor.begin()).second;
+        const CInv inv(MSG_TX | nTxFetchFlags, txhash);
         if (!AlreadyHave(inv))
         {
-            LogPrint("net", "Requesting %s peer=%d\n", inv.ToString(), pto->id);
+            LogPrint(Logging::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->id);
             vGetData.push_back(inv);
+            txrequest.RequestedTx(pto->GetId(), txhash, nNow + GETDATA_TX_INTERVAL);
             if (vGetData.size() >= 1000)
             {
                 connman.PushMessage(pto, NetMsgType::GETDATA, vGetData);
@@ -2707,15 +3896,45 @@ bool SendMessages(CNode *pto, CConnman &connman)
         }
         else
         {
-            // If we're not going to ask, don't expect a response.
-            pto->setAskFor.erase(inv.hash);
+            // we have it already, no peer needs to be asked for it
+            txrequest.ForgetTxHash(txhash);
         }
-        pto->mapAskFor.erase(pto->mapAskFor.begin());
     }
     if (!vGetData.empty())
     {
         connman.PushMessage(pto, NetMsgType::GETDATA, vGetData);
     }
+
+    //
+    // Message: feefilter
+    //
+    // Peers that relay everything from us anyway are not told, neither are they during our
+    // initial block download, when the mempool minimum means nothing yet
+    if (pto->nVersion >= FEEFILTER_VERSION && !pto->fBlockRelayOnly && gArgs.GetBoolArg("-feefilter", DEFAULT_FEEFILTER) &&
+        !(pto->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) &&
+        !pnetMan->getChainActive()->IsInitialBlockDownload())
+    {
+        int64_t timeNow = GetTimeMicros();
+        CAmount currentFilter =
+            mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
+        // what we do not relay ourselves is not worth announcing to us either
+        CAmount filterToSend = std::max(currentFilter, ::minRelayTxFee.GetFeePerK());
+        if (timeNow > pto->nextSendTimeFeeFilter)
+        {
+            if (filterToSend != pto->lastSentFeeFilter)
+            {
+                connman.PushMessage(pto, NetMsgType::FEEFILTER, filterToSend);
+                pto->lastSentFeeFilter = filterToSend;
+            }
+            pto->nextSendTimeFeeFilter = PoissonNextSend(timeNow, AVG_FEEFILTER_BROADCAST_INTERVAL);
+        }
+        // A large change of the mempool minimum goes out sooner than the next regular broadcast
+        else if (timeNow + MAX_FEEFILTER_CHANGE_DELAY * 1000000 < pto->nextSendTimeFeeFilter &&
+                 (filterToSend < 3 * pto->lastSentFeeFilter / 4 || filterToSend > 4 * pto->lastSentFeeFilter / 3))
+        {
+            pto->nextSendTimeFeeFilter = timeNow + GetRandInt(MAX_FEEFILTER_CHANGE_DELAY) * 1000000;
+        }
+    }
     return true;
 }
 
@@ -2726,7 +3945,7 @@ public:
     ~CNetProcessingCleanup()
     {
         // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
+        orphanpool.Clear();
+        txrequest.Clear();
     }
 } instance_of_cnetprocessingcleanup;
@@ -22,6 +22,7 @@
 #define MESSAGES_H
 
 #include "chain/blockindex.h"
+#include "net/blockencodings.h"
 #include "net/net.h"
 #include "validationinterface.h"
 
@@ -35,6 +36,10 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
 
+/** Maximum number of queued transactions looked at per transmission, the ones the peer knows
+ *  by now or that left the mempool included. */
+static const unsigned int INVENTORY_BROADCAST_MAX_WORK = 1000;
+
 /** Maximum number of unconnecting headers announcements before DoS score */
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
@@ -71,6 +76,9 @@ struct CNodeStateStats
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlockQuota;
+    int64_t nAvgBlockTime;
+    int nBlockStalls;
 };
 
 
@@ -87,6 +95,7 @@ struct QueuedBlock
     uint256 hash;
     const CBlockIndex *pindex; //!< Optional.
     bool fValidatedHeaders; //!< Whether this block has validated headers at the time of request.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock; //!< Optional, used for cmpctblock downloads
 };
 
 extern std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
@@ -96,6 +105,10 @@ extern std::map<uint256, std::pair<NodeId, bool> > mapBlockSource;
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch, const std::string &reason);
+/** Requests for blocks served from memory and from disk, and the blocks held in memory */
+void GetServedBlockStats(uint64_t &nHits, uint64_t &nMisses, size_t &nBlocks, size_t &nBytes);
+/** Drop the side branches of headers more than nDepth blocks of work behind the tip, see PruneStaleHeaders() */
+void PruneStaleHeaderBranches(int nDepth);
 
 
 /** Process protocol messages received from a given node */
@@ -105,8 +118,8 @@ bool ProcessMessages(CNode *pfrom, CConnman &connman);
 bool SendMessages(CNode *pto, CConnman &connman);
 
 /** Returns a bool indicating whether we requested this block. If we did request it, marks it as receieved and removes
- * block from in flight list*/
-bool MarkBlockAsReceived(const uint256 &hash);
+ * block from in flight list. When nodeFrom is the peer we asked, the time it took goes into its download speed. */
+bool MarkBlockAsReceived(const uint256 &hash, NodeId nodeFrom = -1);
 
 const CBlockIndex *LastCommonAncestor(const CBlockIndex *pa, const CBlockIndex *pb);
 
@@ -21,21 +21,30 @@
 #include "net/net.h"
 
 #include "args.h"
+#include "blockfilterindex.h"
 #include "chain/tx.h"
 #include "clientversion.h"
 #include "consensus/consensus.h"
 #include "crypto/common.h"
 #include "crypto/hash.h"
 #include "init.h"
+#include "main.h"
+#include "memusage.h"
 #include "net/addrman.h"
+#include "net/recvbufferpool.h"
+#include "net/socketevents.h"
 #include "networks/netman.h"
+#include "scheduler.h"
 
+#include "util/trace.h"
 #include "util/utilstrencodings.h"
 
 #ifdef WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -47,7 +56,9 @@
 
 #include <boost/filesystem.hpp>
 
+#include <chrono>
 #include <memory>
+#include <set>
 
 #include <cmath>
 
@@ -90,8 +101,6 @@ CCriticalSection cs_mapLocalHost;
 std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 static bool vfLimited[NET_MAX] = {};
 
-limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
-
 std::string strSubVersion;
 
 // Connection Slot mitigation - used to determine how many connection attempts over time
@@ -179,7 +188,7 @@ void AdvertiseLocal(CNode *pnode)
         // us that it sees us as in case it has a better idea of our address
         // than we do.
         if (IsPeerAddrLocalGood(pnode) &&
-            (!addrLocal.IsRoutable() || GetRand((GetnScore(addrLocal) > LOCAL_MANUAL) ? 8 : 2) == 0))
+            (!addrLocal.IsRoutable() || GetFastRand((GetnScore(addrLocal) > LOCAL_MANUAL) ? 8 : 2) == 0))
         {
             addrLocal.SetIP(pnode->GetAddrLocal());
         }
@@ -339,7 +348,7 @@ CNode *CConnman::FindNode(const CService &addr)
     return nullptr;
 }
 
-CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure)
+CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure, bool fBlockRelayOnly)
 {
     if (pszDest == nullptr)
     {
@@ -368,7 +377,7 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
                       pnetMan->getActivePaymentNetwork()->GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket))
+        if (!CSocketEvents::IsSupported(hSocket))
         {
             LogPrintf("Cannot create connection: non-selectable socket created "
                       "(fd >= FD_SETSIZE ?)\n");
@@ -400,7 +409,7 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         NodeId id = GetNewNodeId();
         uint64_t nonce = GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE).Write(id).Finalize();
         CNode *pnode = new CNode(id, nLocalServices, GetBestHeight(), hSocket, addrConnect,
-            CalculateKeyedNetGroup(addrConnect), nonce, pszDest ? pszDest : "", false);
+            CalculateKeyedNetGroup(addrConnect), nonce, pszDest ? pszDest : "", false, fBlockRelayOnly);
         pnode->nServicesExpected = ServiceFlags(addrConnect.nServices & nRelevantServices);
         pnode->AddRef();
 
@@ -455,6 +464,7 @@ void CConnman::ClearBanned()
     {
         LOCK(cs_setBanned);
         setBanned.clear();
+        banIndex.Clear();
         setBannedIsDirty = true;
     }
 
@@ -465,20 +475,7 @@ void CConnman::ClearBanned()
 bool CConnman::IsBanned(CNetAddr ip)
 {
     LOCK(cs_setBanned);
-
-    bool fResult = false;
-    for (banmap_t::iterator it = setBanned.begin(); it != setBanned.end(); it++)
-    {
-        CSubNet subNet = (*it).first;
-        CBanEntry banEntry = (*it).second;
-
-        if (subNet.Match(ip) && GetTime() < banEntry.nBanUntil)
-        {
-            fResult = true;
-        }
-    }
-
-    return fResult;
+    return banIndex.IsBanned(ip, GetTime());
 }
 
 bool CConnman::IsBanned(CSubNet subnet)
@@ -521,6 +518,7 @@ void CConnman::Ban(const CSubNet &subNet, const BanReason &banReason, int64_t ba
         if (setBanned[subNet].nBanUntil < banEntry.nBanUntil)
         {
             setBanned[subNet] = banEntry;
+            banIndex.Add(subNet, banEntry.nBanUntil);
             setBannedIsDirty = true;
         }
         else
@@ -561,6 +559,7 @@ bool CConnman::Unban(const CSubNet &subNet)
         {
             return false;
         }
+        banIndex.Remove(subNet);
         setBannedIsDirty = true;
     }
     // Store banlist to disk immediately.
@@ -581,6 +580,11 @@ void CConnman::SetBanned(const banmap_t &banMap)
 {
     LOCK(cs_setBanned);
     setBanned = banMap;
+    banIndex.Clear();
+    for (const auto &entry : setBanned)
+    {
+        banIndex.Add(entry.first, entry.second.nBanUntil);
+    }
     setBannedIsDirty = true;
 }
 
@@ -597,6 +601,7 @@ void CConnman::SweepBanned()
         if (now > banEntry.nBanUntil)
         {
             setBanned.erase(it++);
+            banIndex.Remove(subNet);
             setBannedIsDirty = true;
             LogPrintf("%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
         }
@@ -698,6 +703,7 @@ void CNode::copyStats(CNodeStats &stats)
     }
     X(fInbound);
     X(fAddnode);
+    X(fBlockRelayOnly);
     X(nStartingHeight);
     {
         LOCK(cs_vSend);
@@ -709,7 +715,15 @@ void CNode::copyStats(CNodeStats &stats)
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_msgTimes);
+        X(mapMsgTimesPerCmd);
+        X(sendMessagesTimes);
+    }
     X(fWhitelisted);
+    X(nAddrProcessed);
+    X(nAddrRateLimited);
+    X(minFeeFilter);
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer. Merely reporting
@@ -748,8 +762,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool &complete
         // Get current incomplete message, or create a new one.
         if (vRecvMsg.empty() || vRecvMsg.back().complete())
         {
-            vRecvMsg.push_back(
-                CNetMessage(pnetMan->getActivePaymentNetwork()->MessageStart(), SER_NETWORK, MIN_PROTO_VERSION));
+            vRecvMsg.emplace_back(pnetMan->getActivePaymentNetwork()->MessageStart(), SER_NETWORK, MIN_PROTO_VERSION);
         }
 
         CNetMessage &msg = vRecvMsg.back();
@@ -792,6 +805,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool &complete
 
             assert(i != mapRecvBytesPerMsgCmd.end());
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+            TRACE3(net, inbound_message, GetId(), i->first.c_str(), msg.hdr.nMessageSize);
 
             msg.nTime = nTimeMicros;
             complete = true;
@@ -845,8 +859,14 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
         return -1;
     }
 
-    // switch state to reading message data
+    // switch state to reading message data, into a buffer that already has room for it
     in_data = true;
+    if (hdr.nMessageSize > 0)
+    {
+        CPublicSerializeData vch;
+        recvBufferPool.Get(vch, hdr.nMessageSize);
+        vRecv.SwapBuffer(vch);
+    }
 
     return nCopy;
 }
@@ -856,20 +876,22 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy)
-    {
-        // Allocate up to 256 KiB ahead, but never more than the total message
-        // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
-
+    // the buffer from recvBufferPool holds the whole message unless it is larger than the
+    // largest pooled buffer, then it grows as the data arrives
     hasher.Write((const uint8_t *)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+void CNetMessage::ReleaseBuffer()
+{
+    CPublicSerializeData vch;
+    vRecv.SwapBuffer(vch);
+    recvBufferPool.Release(vch);
+}
+
 const uint256 &CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -880,17 +902,29 @@ const uint256 &CNetMessage::GetMessageHash() const
     return data_hash;
 }
 
+//! the peer the message handler on this thread is processing, FlushSendBuffer() runs for it once it is done
+static thread_local const CNode *pnodeHandled = nullptr;
+
+#ifndef WIN32
+//! buffers handed to one sendmsg call, POSIX guarantees at least 16 and Linux takes 1024
+static const size_t MAX_SEND_BUFFERS = 64;
+#endif
+
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode) const
 {
     AssertLockHeld(pnode->cs_vSend);
     size_t nSentSize = 0;
-    size_t nMsgCount = 0;
+    // whatever waited to be coalesced goes now, what the socket does not take waits for it to be writable
+    pnode->nSendFlushDeadline = 0;
 
-    for (const auto &data : pnode->vSendMsg)
+    // vSendMsg is refilled from the lanes whenever it went out completely
+    while (!pnode->vSendMsg.empty() ||
+           pnode->sendLanes.Schedule(pnode->vSendMsg, GetTimeMicros(), nMaxHistoryUploadRate, true) > 0)
     {
-        assert(data.size() > pnode->nSendOffset);
+        assert(pnode->vSendMsg.front()->size() > pnode->nSendOffset);
         int nBytes = 0;
+        size_t nRequested = 0;
 
         {
             LOCK(pnode->cs_hSocket);
@@ -899,8 +933,34 @@ size_t CConnman::SocketSendData(CNode *pnode) const
                 break;
             }
 
+#ifdef WIN32
+            const std::vector<uint8_t> &data = *pnode->vSendMsg.front();
+            nRequested = data.size() - pnode->nSendOffset;
             nBytes = send(pnode->hSocket, reinterpret_cast<const char *>(data.data()) + pnode->nSendOffset,
-                data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+                nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // hand the kernel as many queued buffers as it takes in one call, the headers and
+            // payloads of small messages would otherwise cost a system call each
+            struct iovec vecs[MAX_SEND_BUFFERS];
+            size_t nBuffers = 0;
+            for (const auto &data : pnode->vSendMsg)
+            {
+                if (nBuffers == MAX_SEND_BUFFERS || nBuffers == IOV_MAX)
+                {
+                    break;
+                }
+                size_t nOffset = nBuffers == 0 ? pnode->nSendOffset : 0;
+                vecs[nBuffers].iov_base = const_cast<uint8_t *>(data->data()) + nOffset;
+                vecs[nBuffers].iov_len = data->size() - nOffset;
+                nRequested += vecs[nBuffers].iov_len;
+                nBuffers++;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = vecs;
+            msg.msg_iovlen = nBuffers;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
 
         if (nBytes == 0)
@@ -923,33 +983,147 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         }
 
         assert(nBytes > 0);
+        TRACE3(net, socket_send, pnode->GetId(), nBytes, nRequested);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size())
+
+        // drop the buffers that went out completely
+        size_t nRemaining = nBytes;
+        while (nRemaining > 0)
+        {
+            size_t nLeft = pnode->vSendMsg.front()->size() - pnode->nSendOffset;
+            if (nRemaining < nLeft)
+            {
+                pnode->nSendOffset += nRemaining;
+                break;
+            }
+            nRemaining -= nLeft;
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= pnode->vSendMsg.front()->size();
+            pnode->vSendMsg.pop_front();
+        }
+        pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+        if ((size_t)nBytes < nRequested)
         {
             // could not send full message; stop sending more
             break;
         }
-
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
-        pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
     }
 
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), pnode->vSendMsg.begin() + nMsgCount);
-
     if (pnode->vSendMsg.empty())
     {
         assert(pnode->nSendOffset == 0);
-        assert(pnode->nSendSize == 0);
+        assert(pnode->nSendSize == pnode->sendLanes.size());
     }
 
     return nSentSize;
 }
 
+CSerializedPayload::CSerializedPayload(std::vector<uint8_t> &&dataIn, int nVersionIn)
+    : data(std::move(dataIn)), nVersion(nVersionIn)
+{
+    uint256 hash = Hash(data.data(), data.data() + data.size());
+    memcpy(checksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+}
+
+void CConnman::RecordMessageQueued(CNode *pnode, const std::string &sCommand, size_t nMessageSize)
+{
+    AssertLockHeld(pnode->cs_vSend);
+    const size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+
+    // log total amount of bytes per command
+    pnode->mapSendBytesPerMsgCmd[sCommand] += nTotalSize;
+    pnode->nSendSize += nTotalSize;
+
+    if (pnode->nSendSize > nSendBufferMaxSize)
+    {
+        pnode->fPauseSend = true;
+    }
+    const char *strCommand = sCommand.c_str();
+    if (strcmp(strCommand, NetMsgType::PING) != 0 && strcmp(strCommand, NetMsgType::PONG) != 0 &&
+        strcmp(strCommand, NetMsgType::ADDR) != 0 && strcmp(strCommand, NetMsgType::VERSION) != 0 &&
+        strcmp(strCommand, NetMsgType::VERACK) != 0 && strcmp(strCommand, NetMsgType::INV) != 0)
+    {
+        pnode->nActivityBytes += nMessageSize;
+    }
+}
+
+void CConnman::PushSerializedMessage(CNode *pnode,
+    const std::string &sCommand,
+    const CSerializedPayloadRef &payload,
+    SendLane lane)
+{
+    size_t nMessageSize = payload->data.size();
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint(Logging::NET, "sending %s (%d bytes) peer=%d\n", SanitizeString(sCommand.c_str()), nMessageSize,
+        pnode->id);
+
+    std::shared_ptr<std::vector<uint8_t> > serializedHeader = std::make_shared<std::vector<uint8_t> >();
+    serializedHeader->reserve(CMessageHeader::HEADER_SIZE);
+    CMessageHeader hdr(pnetMan->getActivePaymentNetwork()->MessageStart(), sCommand.c_str(), nMessageSize);
+    memcpy(hdr.pchChecksum, payload->checksum, CMessageHeader::CHECKSUM_SIZE);
+
+    CVectorWriter{SER_NETWORK, MIN_PROTO_VERSION, *serializedHeader, 0, hdr};
+
+    size_t nBytesSent = 0;
+    {
+        LOCK(pnode->cs_vSend);
+        bool optimisticSend(pnode->vSendMsg.empty());
+
+        RecordMessageQueued(pnode, sCommand, nMessageSize);
+        // shares the payload, the aliasing pointer keeps all of it alive
+        std::shared_ptr<const std::vector<uint8_t> > payloadData;
+        if (nMessageSize)
+        {
+            payloadData = std::shared_ptr<const std::vector<uint8_t> >(payload, &payload->data);
+        }
+        pnode->sendLanes.Push(lane, std::move(serializedHeader), std::move(payloadData), nTotalSize);
+        const char *strCommand = sCommand.c_str();
+
+        // If write queue empty, attempt "optimistic write". Small messages the message handler sends wait for the
+        // ones that usually follow them in its round, blocks and pongs are not held back since their latency is
+        // measured, headers are.
+        if (optimisticSend == true)
+        {
+            const int64_t nNow = GetTimeMicros();
+            const bool fUrgent = (lane == SEND_LANE_BLOCK && strcmp(strCommand, NetMsgType::HEADERS) != 0) ||
+                                 strcmp(strCommand, NetMsgType::PONG) == 0;
+            if (nSendCoalesceMicros == 0 || pnodeHandled != pnode || fUrgent ||
+                nTotalSize > SEND_COALESCE_MAX_MESSAGE || pnode->sendLanes.size() >= SEND_COALESCE_BUFFER_SIZE ||
+                (pnode->nSendFlushDeadline != 0 && nNow >= pnode->nSendFlushDeadline))
+            {
+                nBytesSent = SocketSendData(pnode);
+            }
+            else if (pnode->nSendFlushDeadline == 0)
+            {
+                pnode->nSendFlushDeadline = nNow + nSendCoalesceMicros;
+            }
+        }
+    }
+    if (nBytesSent)
+    {
+        RecordBytesSent(nBytesSent);
+    }
+}
+
+void CConnman::FlushSendBuffer(CNode *pnode)
+{
+    size_t nBytesSent = 0;
+    {
+        LOCK(pnode->cs_vSend);
+        if (pnode->nSendFlushDeadline == 0 || !pnode->vSendMsg.empty())
+        {
+            return;
+        }
+        nBytesSent = SocketSendData(pnode);
+    }
+    if (nBytesSent)
+    {
+        RecordBytesSent(nBytesSent);
+    }
+}
+
 static bool CompareNodeActivityBytes(const CNodeRef &a, const CNodeRef &b)
 {
     return a->nActivityBytes < b->nActivityBytes;
@@ -957,42 +1131,51 @@ static bool CompareNodeActivityBytes(const CNodeRef &a, const CNodeRef &b)
 
 bool CConnman::AttemptToEvictConnection()
 {
-    std::vector<CNodeRef> vEvictionCandidates;
+    // If we get here then we prioritize connections based on activity.  The least active incoming peer is
+    // de-prioritized based on bytes in and bytes out.  A whitelisted peer will always get a connection and there is
+    // no need here to check whether the peer is whitelisted or not. It is picked in the pass that decays the
+    // activity, the candidates are only collected and sorted for the eviction log.
+    CNodeRef evict;
     std::vector<CNodeRef> vEvictionCandidatesByActivity;
+    const bool fLogCandidates = g_logger->LogAcceptCategory(Logging::EVICT);
     {
         LOCK(cs_vNodes);
         static int64_t nLastTime = GetTime();
+        const int64_t nNow = GetTime();
+        const double nDecay = pow(1.0 - 1.0 / 7200, (double)(nNow - nLastTime)); // exponential 2 hour decay
+        CNode *pnodeLeastActive = nullptr;
         for (CNode *node : vNodes)
         {
-            int64_t nNow = GetTime();
-            node->nActivityBytes *= pow(1.0 - 1.0 / 7200, (double)(nNow - nLastTime)); // exponential 2 hour decay
+            node->nActivityBytes *= nDecay;
 
             if (node->fWhitelisted || !node->fInbound || node->fDisconnect)
             {
                 continue;
             }
-            vEvictionCandidates.push_back(CNodeRef(node));
+            if (!pnodeLeastActive || node->nActivityBytes < pnodeLeastActive->nActivityBytes)
+            {
+                pnodeLeastActive = node;
+            }
+            if (fLogCandidates)
+            {
+                vEvictionCandidatesByActivity.push_back(CNodeRef(node));
+            }
         }
-        nLastTime = GetTime();
+        nLastTime = nNow;
+        evict = pnodeLeastActive;
     }
-    vEvictionCandidatesByActivity = vEvictionCandidates;
 
-    if (vEvictionCandidates.empty())
+    if (!evict)
     {
         return false;
     }
-
-    // If we get here then we prioritize connections based on activity.  The least active incoming peer is
-    // de-prioritized based on bytes in and bytes out.  A whitelisted peer will always get a connection and there is
-    // no need here to check whether the peer is whitelisted or not.
-    std::sort(vEvictionCandidatesByActivity.begin(), vEvictionCandidatesByActivity.end(), CompareNodeActivityBytes);
-    vEvictionCandidatesByActivity[0]->fDisconnect = true;
+    evict->fDisconnect = true;
 
     // BU - update the connection tracker
     {
         double nEvictions = 0;
         LOCK(cs_mapInboundConnectionTracker);
-        CNetAddr ipAddress = (CNetAddr)vEvictionCandidatesByActivity[0]->addr;
+        CNetAddr ipAddress = (CNetAddr)evict->addr;
         if (mapInboundConnectionTracker.count(ipAddress))
         {
             // Decay the current number of evictions (over 1800 seconds) depending on the last eviction
@@ -1008,22 +1191,23 @@ bool CConnman::AttemptToEvictConnection()
         mapInboundConnectionTracker[ipAddress].nEvictions = nEvictions;
         mapInboundConnectionTracker[ipAddress].nLastEvictionTime = GetTime();
 
-        LogPrint("EVICT", "Number of Evictions is %f for %s\n", nEvictions,
-            vEvictionCandidatesByActivity[0]->addr.ToString());
+        LogPrint(Logging::EVICT, "Number of Evictions is %f for %s\n", nEvictions, evict->addr.ToString());
         if (nEvictions > 15)
         {
             int nHoursToBan = 4;
             Ban(ipAddress, BanReasonNodeMisbehaving, nHoursToBan * 60 * 60);
-            LogPrintf("Banning %s for %d hours: Too many evictions - connection dropped\n",
-                vEvictionCandidatesByActivity[0]->addr.ToString(), nHoursToBan);
+            LogPrintf("Banning %s for %d hours: Too many evictions - connection dropped\n", evict->addr.ToString(),
+                nHoursToBan);
         }
     }
 
-    LogPrint("EVICT", "Node disconnected because too inactive:%d bytes of activity for peer %s\n",
-        vEvictionCandidatesByActivity[0]->nActivityBytes, vEvictionCandidatesByActivity[0]->addrName);
+    LogPrint(Logging::EVICT, "Node disconnected because too inactive:%d bytes of activity for peer %s\n",
+        evict->nActivityBytes, evict->addrName);
+    std::stable_sort(
+        vEvictionCandidatesByActivity.begin(), vEvictionCandidatesByActivity.end(), CompareNodeActivityBytes);
     for (unsigned int i = 0; i < vEvictionCandidatesByActivity.size(); i++)
     {
-        LogPrint("EVICT", "Node %s bytes %d candidate %d\n", vEvictionCandidatesByActivity[i]->addrName,
+        LogPrint(Logging::EVICT, "Node %s bytes %d candidate %d\n", vEvictionCandidatesByActivity[i]->addrName,
             vEvictionCandidatesByActivity[i]->nActivityBytes, i);
     }
 
@@ -1069,7 +1253,7 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket)
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!CSocketEvents::IsSupported(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1092,18 +1276,6 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket)
         return;
     }
 
-    if (nInbound >= nMaxInbound)
-    {
-        if (!AttemptToEvictConnection())
-        {
-            // No connection to evict, disconnect the new connection
-            LogPrintf("failed to find an eviction candidate - "
-                      "connection dropped (full)\n");
-            CloseSocket(hSocket);
-            return;
-        }
-    }
-
     // If connection attempts exceeded within allowable timeframe then ban peer
     {
         double nConnections = 0;
@@ -1136,7 +1308,7 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket)
         mapInboundConnectionTracker[ipAddress].nConnections = nConnections;
         mapInboundConnectionTracker[ipAddress].nLastConnectionTime = GetTime();
 
-        LogPrint("EVICT", "Number of connection attempts is %f for %s\n", nConnections, addr.ToString());
+        LogPrint(Logging::EVICT, "Number of connection attempts is %f for %s\n", nConnections, addr.ToString());
         if (nConnections > 4 && !whitelisted && !addr.IsLocal()) // local connections are auto-whitelisted
         {
             int nHoursToBan = 4;
@@ -1148,6 +1320,19 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket)
         }
     }
 
+    // after the attempts are counted, a peer flooding us is banned before it takes the slot of another one
+    if (nInbound >= nMaxInbound)
+    {
+        if (!AttemptToEvictConnection())
+        {
+            // No connection to evict, disconnect the new connection
+            LogPrintf("failed to find an eviction candidate - "
+                      "connection dropped (full)\n");
+            CloseSocket(hSocket);
+            return;
+        }
+    }
+
     NodeId id = GetNewNodeId();
     uint64_t nonce = GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE).Write(id).Finalize();
 
@@ -1169,6 +1354,7 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket)
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    CSocketEvents socketEvents;
     while (interruptNet.load() == false)
     {
         //
@@ -1229,34 +1415,29 @@ void CConnman::ThreadSocketHandler()
         {
             LOCK(cs_vNodes);
             vNodesSize = vNodes.size();
+            size_t nInbound = 0;
+            for (const CNode *pnode : vNodes)
+                nInbound += pnode->fInbound;
+            nNodesInboundPublished.store(nInbound, std::memory_order_relaxed);
+            nNodesOutboundPublished.store(vNodesSize - nInbound, std::memory_order_relaxed);
         }
         if (vNodesSize != nPrevNodeCount)
         {
             nPrevNodeCount = vNodesSize;
+            GetNodeSignals().NumConnectionsChanged(vNodesSize);
         }
 
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
         // Frequency to poll pnode->vSend
-        timeout.tv_usec = 50000;
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        const int64_t nTimeoutMs = 50;
+        int64_t nWaitMs = nTimeoutMs;
 
-        for (const ListenSocket &hListenSocket : vhListenSocket)
+        for (size_t i = 0; i < vhListenSocket.size(); i++)
         {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+            // listen sockets own the negative range, nodes are owned by their id
+            socketEvents.Set(vhListenSocket[i].socket, -1 - (int64_t)i, CSocketEvents::RECV);
         }
 
         {
@@ -1264,14 +1445,14 @@ void CConnman::ThreadSocketHandler()
             for (CNode *pnode : vNodes)
             {
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As
+                // * If there is data to send, wait for sending data. As
                 // this only happens when optimistic write failed, we choose to
                 // first drain the write buffer in this case before receiving
                 // more. This avoids needlessly queueing received data, if the
                 // remote peer is not themselves receiving data. This means
                 // properly utilizing TCP flow control signalling.
                 // * Otherwise, if there is space left in the receive buffer,
-                // select() for receiving data.
+                // wait for receiving data.
                 // * Hand off all complete messages to the processor, to be
                 // handled without blocking here.
 
@@ -1279,7 +1460,21 @@ void CConnman::ThreadSocketHandler()
                 bool select_send;
                 {
                     LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
+                    // messages that wait to be coalesced are left alone until their deadline, which the wait
+                    // below does not sleep past
+                    const int64_t nNow = GetTimeMicros();
+                    if (pnode->vSendMsg.empty() && pnode->nSendFlushDeadline > nNow)
+                    {
+                        select_send = false;
+                        nWaitMs = std::min<int64_t>(nWaitMs, (pnode->nSendFlushDeadline - nNow + 999) / 1000);
+                    }
+                    else
+                    {
+                        // a throttled history lane gets another chance every round
+                        select_send =
+                            !pnode->vSendMsg.empty() ||
+                            pnode->sendLanes.Schedule(pnode->vSendMsg, nNow, nMaxHistoryUploadRate, true) > 0;
+                    }
                 }
 
                 LOCK(pnode->cs_hSocket);
@@ -1288,42 +1483,28 @@ void CConnman::ThreadSocketHandler()
                     continue;
                 }
 
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
+                uint8_t nInterest = CSocketEvents::NONE;
                 if (select_send)
                 {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
+                    nInterest = CSocketEvents::SEND;
                 }
-                if (select_recv)
+                else if (select_recv)
                 {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
+                    nInterest = CSocketEvents::RECV;
                 }
+                socketEvents.Set(pnode->hSocket, pnode->id, nInterest);
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        bool fWaited = socketEvents.Wait(nWaitMs);
         if (interruptNet.load() == true)
         {
             return;
         }
 
-        if (nSelect == SOCKET_ERROR)
+        if (!fWaited)
         {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                {
-                    FD_SET(i, &fdsetRecv);
-                }
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
+            MilliSleep(nWaitMs);
             if (interruptNet.load() == true)
             {
                 return;
@@ -1335,7 +1516,8 @@ void CConnman::ThreadSocketHandler()
         //
         for (const ListenSocket &hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET &&
+                (socketEvents.Ready(hListenSocket.socket) & CSocketEvents::RECV))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1372,9 +1554,10 @@ void CConnman::ThreadSocketHandler()
                 {
                     continue;
                 }
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                uint8_t nReady = socketEvents.Ready(pnode->hSocket);
+                recvSet = nReady & CSocketEvents::RECV;
+                sendSet = nReady & CSocketEvents::SEND;
+                errorSet = nReady & CSocketEvents::ERR;
             }
             if (recvSet || errorSet)
             {
@@ -1417,6 +1600,10 @@ void CConnman::ThreadSocketHandler()
                             pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                         }
                     }
+                    size_t nRecvMsgUsage = 0;
+                    for (const CNetMessage &msg : pnode->vRecvMsg)
+                        nRecvMsgUsage += sizeof(CNetMessage) + msg.hdrbuf.capacity() + msg.vRecv.capacity();
+                    pnode->nRecvMsgUsage = nRecvMsgUsage;
                 }
                 else if (nBytes == 0)
                 {
@@ -1669,6 +1856,19 @@ static std::string GetDNSHost(const CDNSSeedData &data, ServiceFlags *requiredSe
     return strprintf("x%x.%s", *requiredServiceBits, data.host);
 }
 
+namespace
+{
+/** The DNS seed lookups in progress, shared with the threads doing them */
+struct CDNSSeedLookups
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    int nPending = 0;
+    //! the addresses and the source of each seed that answered, by its index in the seeds of the network
+    std::map<size_t, std::pair<std::vector<CNetAddr>, CService> > mapResults;
+};
+}
+
 void CConnman::ThreadDNSAddressSeed()
 {
     // goal: only query DNS seeds if address need is acute.
@@ -1701,54 +1901,141 @@ void CConnman::ThreadDNSAddressSeed()
 
     LogPrintf("Loading addresses from DNS seeds (could take a while)\n");
 
-    for (const CDNSSeedData &seed : vSeeds)
+    dnsseedcache_t mapCache;
+    CDNSSeedDB seedDB;
+    if (fs::exists(GetDataDir() / "dnsseeds.dat") && !seedDB.Read(mapCache))
+        mapCache.clear();
+    bool fCacheChanged = false;
+
+    // what each seed is asked for and the service bits that come with the answer, the seeds with a recent answer in
+    // the cache are not asked at all
+    std::vector<std::string> vHosts(vSeeds.size());
+    std::vector<ServiceFlags> vServices(vSeeds.size(), nRelevantServices);
+    std::shared_ptr<CDNSSeedLookups> lookups = std::make_shared<CDNSSeedLookups>();
+    for (size_t i = 0; i < vSeeds.size(); i++)
     {
+        const CDNSSeedData &seed = vSeeds[i];
         if (HaveNameProxy())
         {
             AddOneShot(seed.host);
+            continue;
         }
-        else
+        vHosts[i] = GetDNSHost(seed, &vServices[i]);
+        auto it = mapCache.find(vHosts[i]);
+        if (it != mapCache.end() && it->second.nResolveTime > GetTime() - DNSSEED_CACHE_LIFETIME)
         {
+            found += AddSeedAddresses(it->second.vIPs, vServices[i], it->second.source);
+            continue;
+        }
+
+        // getaddrinfo blocks, each seed gets a thread of its own that is left to finish on its own if it takes too
+        // long. It only touches lookups, which it shares.
+        {
+            std::lock_guard<std::mutex> lock(lookups->cs);
+            lookups->nPending++;
+        }
+        const std::string strHost = vHosts[i];
+        const std::string strName = seed.name;
+        std::thread([lookups, i, strHost, strName]() {
+            RenameThread("eccoin-dnsseed");
             std::vector<CNetAddr> vIPs;
-            std::vector<CAddress> vAdd;
-            ServiceFlags requiredServiceBits = nRelevantServices;
-            if (LookupHost(GetDNSHost(seed, &requiredServiceBits).c_str(), vIPs, 0, true))
-            {
-                for (const CNetAddr &ip : vIPs)
-                {
-                    int nOneDay = 24 * 3600;
-                    CAddress addr = CAddress(
-                        CService(ip, pnetMan->getActivePaymentNetwork()->GetDefaultPort()), requiredServiceBits);
-                    // Use a random age between 3 and 7 days old.
-                    addr.nTime = GetTime() - 3 * nOneDay - GetRand(4 * nOneDay);
-                    vAdd.push_back(addr);
-                    found++;
-                }
-            }
-            // TODO: The seed name resolve may fail, yielding an IP of [::],
-            // which results in addrman assigning the same source to results
-            // from different seeds. This should switch to a hard-coded stable
-            // dummy IP for each seed name, so that the resolve is not required
-            // at all.
-            if (!vIPs.empty())
+            CService source;
+            if (LookupHost(strHost.c_str(), vIPs, 0, true) && !vIPs.empty())
             {
-                CService seedSource;
-                Lookup(seed.name.c_str(), seedSource, 0, true);
-                addrman.Add(vAdd, seedSource);
+                // TODO: The seed name resolve may fail, yielding an IP of [::],
+                // which results in addrman assigning the same source to results
+                // from different seeds. This should switch to a hard-coded stable
+                // dummy IP for each seed name, so that the resolve is not required
+                // at all.
+                Lookup(strName.c_str(), source, 0, true);
             }
+            std::lock_guard<std::mutex> lock(lookups->cs);
+            lookups->mapResults[i] = std::make_pair(std::move(vIPs), source);
+            lookups->nPending--;
+            lookups->cond.notify_all();
+        })
+            .detach();
+    }
+
+    std::map<size_t, std::pair<std::vector<CNetAddr>, CService> > mapResults;
+    {
+        const int64_t nDeadline = GetTimeMillis() + DNSSEED_LOOKUP_TIMEOUT * 1000;
+        std::unique_lock<std::mutex> lock(lookups->cs);
+        while (lookups->nPending > 0 && !interruptNet.load() && GetTimeMillis() < nDeadline)
+            lookups->cond.wait_for(lock, std::chrono::milliseconds(100));
+        if (lookups->nPending > 0)
+            LogPrintf("%d DNS seeds did not answer within %d seconds\n", lookups->nPending, DNSSEED_LOOKUP_TIMEOUT);
+        mapResults.swap(lookups->mapResults);
+    }
+    if (interruptNet.load())
+        return;
+
+    for (size_t i = 0; i < vSeeds.size(); i++)
+    {
+        if (HaveNameProxy())
+            break;
+        auto itResult = mapResults.find(i);
+        if (itResult != mapResults.end() && !itResult->second.first.empty())
+        {
+            found += AddSeedAddresses(itResult->second.first, vServices[i], itResult->second.second);
+            CDNSSeedCacheEntry &entry = mapCache[vHosts[i]];
+            entry.nResolveTime = GetTime();
+            entry.nServices = vServices[i];
+            entry.vIPs = std::move(itResult->second.first);
+            entry.source = itResult->second.second;
+            fCacheChanged = true;
+            continue;
+        }
+        // a seed that was asked and did not answer, what it answered before is better than nothing
+        auto itCache = mapCache.find(vHosts[i]);
+        if (itCache != mapCache.end() && itCache->second.nResolveTime <= GetTime() - DNSSEED_CACHE_LIFETIME)
+        {
+            LogPrint(Logging::NET, "using the addresses %s answered %d seconds ago\n", vHosts[i],
+                GetTime() - itCache->second.nResolveTime);
+            found += AddSeedAddresses(itCache->second.vIPs, vServices[i], itCache->second.source);
         }
     }
 
+    if (fCacheChanged && !seedDB.Write(mapCache))
+        LogPrintf("Failed to write %s\n", (GetDataDir() / "dnsseeds.dat").string());
+
     LogPrintf("%d addresses found from DNS seeds\n", found);
 }
 
+int CConnman::AddSeedAddresses(const std::vector<CNetAddr> &vIPs, ServiceFlags nServices, const CService &source)
+{
+    std::vector<CAddress> vAdd;
+    for (const CNetAddr &ip : vIPs)
+    {
+        int nOneDay = 24 * 3600;
+        CAddress addr = CAddress(CService(ip, pnetMan->getActivePaymentNetwork()->GetDefaultPort()), nServices);
+        // Use a random age between 3 and 7 days old.
+        addr.nTime = GetTime() - 3 * nOneDay - GetFastRand(4 * nOneDay);
+        vAdd.push_back(addr);
+    }
+    if (!vAdd.empty())
+        addrman.Add(vAdd, source);
+    return vAdd.size();
+}
+
 void CConnman::DumpAddresses()
 {
     int64_t nStart = GetTimeMillis();
 
+    LOCK(cs_hashAddressesDumped);
+    uint256 hashBefore = hashAddressesDumped;
     CAddrDB adb;
-    adb.Write(addrman);
+    if (!adb.Write(addrman, &hashAddressesDumped))
+    {
+        return;
+    }
 
+    if (hashAddressesDumped == hashBefore)
+    {
+        LogPrint(Logging::NET, "Addresses unchanged since the last flush to peers.dat  %dms\n",
+            GetTimeMillis() - nStart);
+        return;
+    }
     LogPrintf("Flushed %d addresses to peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
 }
 
@@ -1758,25 +2045,6 @@ void CConnman::_DumpData()
     DumpBanlist();
 }
 
-void CConnman::DumpData(int64_t seconds_between_runs)
-{
-    while (interruptNet.load() == false)
-    {
-        // this has the potential to be a long sleep. so do it in chunks incase of node shutdown
-        int64_t nStart = GetTime();
-        int64_t nEnd = nStart + seconds_between_runs;
-        while (nStart < nEnd)
-        {
-            if (interruptNet.load() == true)
-            {
-                break;
-            }
-            std::this_thread::sleep_for(std::chrono::seconds(2));
-        }
-        _DumpData();
-    }
-}
-
 void CConnman::ProcessOneShot()
 {
     std::string strDest;
@@ -1873,6 +2141,7 @@ void CConnman::ThreadOpenConnections()
         // this here so we don't have to critsect vNodes inside mapAddresses
         // critsect.
         int nOutbound = 0;
+        int nOutboundBlockRelay = 0;
         std::set<std::vector<uint8_t> > setConnected;
         {
             LOCK(cs_vNodes);
@@ -1880,6 +2149,10 @@ void CConnman::ThreadOpenConnections()
             {
                 if (!pnode->fInbound && !pnode->fAddnode)
                 {
+                    if (pnode->fBlockRelayOnly)
+                    {
+                        nOutboundBlockRelay++;
+                    }
                     // Netgroups for inbound and addnode peers are not excluded
                     // because our goal here is to not use multiple of our
                     // limited outbound slots on a single netgroup but inbound
@@ -1893,6 +2166,12 @@ void CConnman::ThreadOpenConnections()
             }
         }
 
+        // The full relay slots are filled first, block relay only connections take the last few. A
+        // block relay only peer is not seen in our tx and addr relay, so it is harder for an attacker
+        // to find and to isolate us from the blocks of the rest of the network.
+        const bool fBlockRelayOnly = nOutbound - nOutboundBlockRelay >= nMaxOutbound - nMaxOutboundBlockRelay &&
+                                     nOutboundBlockRelay < nMaxOutboundBlockRelay;
+
         // Feeler Connections
         //
         // Design goals:
@@ -1906,7 +2185,7 @@ void CConnman::ThreadOpenConnections()
         //  * Only make a feeler connection once every few minutes.
         //
         bool fFeeler = false;
-        if (nOutbound >= nMaxOutbound)
+        if (nOutbound >= nMaxOutbound && !fBlockRelayOnly)
         {
             // The current time right now (in microseconds).
             int64_t nTime = GetTimeMicros();
@@ -1986,7 +2265,7 @@ void CConnman::ThreadOpenConnections()
             {
                 // Add small amount of random noise before connection to avoid
                 // synchronization.
-                int randsleep = GetRandInt(FEELER_SLEEP_WINDOW * 1000);
+                int randsleep = GetFastRand(FEELER_SLEEP_WINDOW * 1000);
                 MilliSleep(randsleep);
                 {
                     if (interruptNet.load() == true)
@@ -1998,7 +2277,7 @@ void CConnman::ThreadOpenConnections()
             }
 
             OpenNetworkConnection(addrConnect, (int)setConnected.size() >= std::min(nMaxConnections - 1, 2), &grant,
-                nullptr, false, fFeeler);
+                nullptr, false, fFeeler, false, fBlockRelayOnly);
         }
     }
 }
@@ -2132,7 +2411,8 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     const char *pszDest,
     bool fOneShot,
     bool fFeeler,
-    bool fAddnode)
+    bool fAddnode,
+    bool fBlockRelayOnly)
 {
     //
     // Initiate outbound network connection
@@ -2154,7 +2434,7 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect,
         return false;
     }
 
-    CNode *pnode = ConnectNode(addrConnect, pszDest, fCountFailure);
+    CNode *pnode = ConnectNode(addrConnect, pszDest, fCountFailure, fBlockRelayOnly);
 
     if (!pnode)
     {
@@ -2186,17 +2466,28 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(unsigned int nThread, unsigned int nThreads)
 {
     while (interruptNet.load() == false)
     {
+        uint64_t nWake;
+        {
+            std::lock_guard<std::mutex> lock(mutexMsgProc);
+            nWake = nMsgProcWake;
+        }
+        // every node is handled by one thread only, so its messages are still processed in the
+        // order they arrived and one slow peer only holds up the peers sharing its thread
         std::vector<CNode *> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode *pnode : vNodesCopy)
+            for (CNode *pnode : vNodes)
             {
+                if ((uint64_t)pnode->GetId() % nThreads != nThread)
+                {
+                    continue;
+                }
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
@@ -2210,14 +2501,20 @@ void CConnman::ThreadMessageHandler()
             }
 
             // Receive messages
+            pnodeHandled = pnode;
             bool fMoreNodeWork = GetNodeSignals().ProcessMessages(pnode, *this);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
 
             // Send messages
             {
                 LOCK(pnode->cs_sendProcessing);
+                const int64_t nSendStart = GetTimeMicros();
                 GetNodeSignals().SendMessages(pnode, *this);
+                RecordSendMessagesTime(pnode, GetTimeMicros() - nSendStart);
             }
+            // what the peer was sent in this round goes out together
+            pnodeHandled = nullptr;
+            FlushSendBuffer(pnode);
         }
 
         {
@@ -2230,11 +2527,23 @@ void CConnman::ThreadMessageHandler()
 
         if (!fMoreWork)
         {
-            MilliSleep(100);
+            // a wake while the nodes were processed ends the wait right away
+            std::unique_lock<std::mutex> lock(mutexMsgProc);
+            condMsgProc.wait_for(lock, std::chrono::milliseconds(100),
+                [&]() { return nMsgProcWake != nWake || interruptNet.load(); });
         }
     }
 }
 
+void CConnman::WakeMessageHandler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        nMsgProcWake++;
+    }
+    condMsgProc.notify_all();
+}
+
 bool CConnman::BindListenPort(const CService &addrBind, std::string &strError, bool fWhitelisted)
 {
     strError = "";
@@ -2259,7 +2568,7 @@ bool CConnman::BindListenPort(const CService &addrBind, std::string &strError, b
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket))
+    if (!CSocketEvents::IsSupported(hListenSocket))
     {
         strError = "Error: Couldn't create a listenable socket for incoming "
                    "connections";
@@ -2416,15 +2725,20 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
 {
     setBannedIsDirty = false;
     fAddressesInitialized = false;
+    fAddressesLoaded = false;
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
+    nMaxHistoryUploadRate = 0;
+    nSendCoalesceMicros = 0;
     semOutbound = nullptr;
     semAddnode = nullptr;
     nMaxConnections = 0;
     nMaxOutbound = 0;
+    nMaxOutboundBlockRelay = 0;
     nMaxAddnode = 0;
     nBestHeight = 0;
+    nMsgProcWake = 0;
     interruptNet.store(false);
 }
 
@@ -2434,38 +2748,12 @@ ServiceFlags DEFAULT_LOCAL_SERVICES = NODE_NETWORK;
 
 extern int initMaxConnections;
 
-bool CConnman::Start(std::string &strNodeError)
+void CConnman::LoadAddresses()
 {
-    nTotalBytesRecv = 0;
-    nTotalBytesSent = 0;
-    nMaxOutboundTotalBytesSentInCycle = 0;
-    nMaxOutboundCycleStartTime = 0;
-
-    nRelevantServices = DEFAULT_RELEVANT_SERVICES;
-    nLocalServices = DEFAULT_LOCAL_SERVICES;
-    if (gArgs.GetBoolArg("-peerbloomfilters", true))
-    {
-        nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
-    }
-
-    nMaxConnections = initMaxConnections;
-    nMaxOutbound = std::min(MAX_OUTBOUND_CONNECTIONS, nMaxConnections);
-    nMaxAddnode = MAX_ADDNODE_CONNECTIONS;
-    nMaxFeeler = 1;
-
-    nSendBufferMaxSize = 1000 * gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
-    nReceiveFloodSize = 1000 * gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
-
-    nMaxOutboundLimit = 0;
-
-    if (gArgs.IsArgSet("-maxuploadtarget"))
+    if (fAddressesLoaded)
     {
-        nMaxOutboundLimit = gArgs.GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET) * 1024 * 1024;
+        return;
     }
-    nMaxOutboundTimeframe = MAX_UPLOAD_TIMEFRAME;
-
-    SetBestHeight(pnetMan->getChainActive()->chainActive.Height());
-
     LogPrintf("Loading addresses...");
     // Load addresses from peers.dat
     int64_t nStart = GetTimeMillis();
@@ -2507,6 +2795,56 @@ bool CConnman::Start(std::string &strNodeError)
         SetBannedSetDirty(true);
         DumpBanlist();
     }
+    fAddressesLoaded = true;
+}
+
+bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError)
+{
+    nTotalBytesRecv = 0;
+    nTotalBytesSent = 0;
+    nMaxOutboundTotalBytesSentInCycle = 0;
+    nMaxOutboundCycleStartTime = 0;
+
+    nRelevantServices = DEFAULT_RELEVANT_SERVICES;
+    nLocalServices = DEFAULT_LOCAL_SERVICES;
+    if (gArgs.GetBoolArg("-peerbloomfilters", true))
+    {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
+    }
+    if (g_blockfilterindex && gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS))
+    {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+    // a pruned node can not serve the full chain
+    if (fPruneMode)
+    {
+        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+    }
+
+    nMaxConnections = initMaxConnections;
+    nMaxOutbound = std::min(MAX_OUTBOUND_CONNECTIONS, nMaxConnections);
+    nMaxOutboundBlockRelay = std::min(MAX_BLOCK_RELAY_ONLY_CONNECTIONS, nMaxOutbound / 4);
+    nMaxAddnode = MAX_ADDNODE_CONNECTIONS;
+    nMaxFeeler = 1;
+
+    nSendBufferMaxSize = 1000 * gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
+    nReceiveFloodSize = 1000 * gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    nMaxHistoryUploadRate =
+        1000 * std::max<int64_t>(0, gArgs.GetArg("-maxhistoryuploadrate", DEFAULT_MAX_HISTORY_UPLOAD_RATE));
+    nSendCoalesceMicros = std::max<int64_t>(0, gArgs.GetArg("-sendcoalesce", DEFAULT_SEND_COALESCE));
+
+    nMaxOutboundLimit = 0;
+
+    if (gArgs.IsArgSet("-maxuploadtarget"))
+    {
+        nMaxOutboundLimit = gArgs.GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET) * 1024 * 1024;
+    }
+    nMaxOutboundTimeframe = MAX_UPLOAD_TIMEFRAME;
+
+    SetBestHeight(pnetMan->getChainActive()->chainActive.Height());
+
+    LoadAddresses();
 
     LogPrintf("Starting network threads...");
 
@@ -2551,11 +2889,21 @@ bool CConnman::Start(std::string &strNodeError)
         netThreads.create_thread(&CConnman::ThreadOpenConnections, this);
     }
 
-    // Process messages
-    netThreads.create_thread(&CConnman::ThreadMessageHandler, this);
+    // Process messages, -msghandlerthreads <= 0 leaves that many cores free
+    int nMsgHandlerThreads = gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
+    if (nMsgHandlerThreads <= 0)
+    {
+        nMsgHandlerThreads += GetNumCores();
+    }
+    nMsgHandlerThreads = std::max(1, std::min(nMsgHandlerThreads, MAX_MSGHANDLER_THREADS));
+    for (int i = 0; i < nMsgHandlerThreads; i++)
+    {
+        netThreads.create_thread(
+            &CConnman::ThreadMessageHandler, this, (unsigned int)i, (unsigned int)nMsgHandlerThreads);
+    }
 
     // Dump network addresses
-    netThreads.create_thread(&CConnman::DumpData, this, DUMP_ADDRESSES_INTERVAL);
+    scheduler.ScheduleEvery(std::bind(&CConnman::_DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
 
     return true;
 }
@@ -2577,6 +2925,7 @@ void CConnman::Interrupt()
 {
     interruptNet.store(true);
     InterruptSocks5(true);
+    WakeMessageHandler();
 
     if (semOutbound)
     {
@@ -2598,6 +2947,7 @@ void CConnman::Interrupt()
 void CConnman::Stop()
 {
     netThreads.interrupt_all();
+    WakeMessageHandler();
     netThreads.join_all();
 
     if (fAddressesInitialized)
@@ -2732,6 +3082,34 @@ void CConnman::GetNodeStats(std::vector<CNodeStats> &vstats)
     }
 }
 
+void CConnman::GetNodeBufferUsage(size_t &nSendUsage, size_t &nRecvUsage)
+{
+    nSendUsage = 0;
+    nRecvUsage = 0;
+    std::set<const std::vector<uint8_t> *> setPayloads;
+    LOCK(cs_vNodes);
+    for (CNode *pnode : vNodes)
+    {
+        {
+            LOCK(pnode->cs_vSend);
+            auto countBuffer = [&nSendUsage, &setPayloads](const CSendLanes::Buffer &payload) {
+                nSendUsage += sizeof(payload);
+                if (setPayloads.insert(payload.get()).second)
+                    nSendUsage += memusage::DynamicUsage(payload) + memusage::DynamicUsage(*payload);
+            };
+            for (const auto &payload : pnode->vSendMsg)
+                countBuffer(payload);
+            pnode->sendLanes.ForEachBuffer(countBuffer);
+        }
+        {
+            LOCK(pnode->cs_vProcessMsg);
+            for (const CNetMessage &msg : pnode->vProcessMsg)
+                nRecvUsage += sizeof(CNetMessage) + msg.hdrbuf.capacity() + msg.vRecv.capacity();
+        }
+        nRecvUsage += pnode->nRecvMsgUsage;
+    }
+}
+
 bool CConnman::DisconnectNode(const std::string &strNode)
 {
     LOCK(cs_vNodes);
@@ -2870,6 +3248,48 @@ uint64_t CConnman::GetTotalBytesRecv()
     return nTotalBytesRecv;
 }
 
+// Only the commands of the protocol get their own times, as for the bytes received per command
+static const std::string &MsgTimesCommand(const std::string &strCommand)
+{
+    static const std::set<std::string> setCommands(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    return setCommands.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+}
+
+void CConnman::RecordMessageTimes(CNode *pnode,
+    const std::string &strCommand,
+    int64_t nQueueMicros,
+    int64_t nProcessMicros)
+{
+    const std::string &strKey = MsgTimesCommand(strCommand);
+    {
+        LOCK(pnode->cs_msgTimes);
+        CMsgCmdTimes &times = pnode->mapMsgTimesPerCmd[strKey];
+        times.queue.Add(nQueueMicros);
+        times.process.Add(nProcessMicros);
+    }
+    LOCK(cs_msgTimes);
+    CMsgCmdTimes &times = mapMsgTimesPerCmd[strKey];
+    times.queue.Add(nQueueMicros);
+    times.process.Add(nProcessMicros);
+}
+
+void CConnman::RecordSendMessagesTime(CNode *pnode, int64_t nMicros)
+{
+    {
+        LOCK(pnode->cs_msgTimes);
+        pnode->sendMessagesTimes.Add(nMicros);
+    }
+    LOCK(cs_msgTimes);
+    sendMessagesTimes.Add(nMicros);
+}
+
+void CConnman::GetMessageTimes(mapMsgCmdTimes &mapTimes, CTimeHistogram &sendTimes)
+{
+    LOCK(cs_msgTimes);
+    mapTimes = mapMsgTimesPerCmd;
+    sendTimes = sendMessagesTimes;
+}
+
 uint64_t CConnman::GetTotalBytesSent()
 {
     LOCK(cs_totalBytesSent);
@@ -2889,9 +3309,11 @@ CNode::CNode(NodeId idIn,
     uint64_t nKeyedNetGroupIn,
     uint64_t nLocalHostNonceIn,
     const std::string &addrNameIn,
-    bool fInboundIn)
-    : nTimeConnected(GetSystemTimeInSeconds()), addr(addrIn), fInbound(fInboundIn), id(idIn),
-      nKeyedNetGroup(nKeyedNetGroupIn), addrKnown(5000, 0.001), filterInventoryKnown(50000, 0.000001),
+    bool fInboundIn,
+    bool fBlockRelayOnlyIn)
+    : nTimeConnected(GetSystemTimeInSeconds()), addr(addrIn), fInbound(fInboundIn), fBlockRelayOnly(fBlockRelayOnlyIn),
+      id(idIn), nKeyedNetGroup(nKeyedNetGroupIn), addrKnown(fBlockRelayOnlyIn ? 1 : 5000, 0.001),
+      filterInventoryKnown(fBlockRelayOnlyIn ? 1 : 50000, 0.000001),
       nLocalServices(nLocalServicesIn), nMyStartingHeight(nMyStartingHeightIn), nSendVersion(0)
 {
     nServices = NODE_NONE;
@@ -2918,6 +3340,7 @@ CNode::CNode(NodeId idIn,
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    nSendFlushDeadline = 0;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2925,7 +3348,14 @@ CNode::CNode(NodeId idIn,
     fGetAddr = false;
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
+    nAddrTokenBucket = 1;
+    nAddrTokenTimestamp = GetTimeMicros();
+    nAddrProcessed = 0;
+    nAddrRateLimited = 0;
     nNextInvSend = 0;
+    minFeeFilter = 0;
+    lastSentFeeFilter = 0;
+    nextSendTimeFeeFilter = 0;
     fRelayTxes = false;
     fSentAddr = false;
     pfilter = new CBloomFilter();
@@ -2939,7 +3369,9 @@ CNode::CNode(NodeId idIn,
     nMinPingUsecTime = std::numeric_limits<int64_t>::max();
     fPauseRecv = false;
     fPauseSend = false;
+    fBlockReadPending = false;
     nProcessQueueSize = 0;
+    nRecvMsgUsage = 0;
 
     for (const std::string &msg : getAllNetMessageTypes())
     {
@@ -2967,55 +3399,6 @@ CNode::~CNode()
     }
 }
 
-void CNode::AskFor(const CInv &inv)
-{
-    if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ)
-    {
-        return;
-    }
-
-    // a peer may not have multiple non-responded queue positions for a single
-    // inv item.
-    if (!setAskFor.insert(inv.hash).second)
-    {
-        return;
-    }
-
-    // We're using mapAskFor as a priority queue, the key is the earliest time
-    // the request can be sent.
-    int64_t nRequestTime;
-    limitedmap<uint256, int64_t>::const_iterator it = mapAlreadyAskedFor.find(inv.hash);
-    if (it != mapAlreadyAskedFor.end())
-    {
-        nRequestTime = it->second;
-    }
-    else
-    {
-        nRequestTime = 0;
-    }
-    LogPrintf("askfor %s  %d (%s) peer=%d\n", inv.ToString(), nRequestTime,
-        DateTimeStrFormat("%H:%M:%S", nRequestTime / 1000000), id);
-
-    // Make sure not to reuse time indexes to keep things in the same order
-    int64_t nNow = GetTimeMicros() - 1000000;
-    static int64_t nLastTime;
-    ++nLastTime;
-    nNow = std::max(nNow, nLastTime);
-    nLastTime = nNow;
-
-    // Each retry is 2 minutes after the last
-    nRequestTime = std::max(nRequestTime + 2 * 60 * 1000000, nNow);
-    if (it != mapAlreadyAskedFor.end())
-    {
-        mapAlreadyAskedFor.update(it, nRequestTime);
-    }
-    else
-    {
-        mapAlreadyAskedFor.insert(std::make_pair(inv.hash, nRequestTime));
-    }
-    mapAskFor.insert(std::make_pair(nRequestTime, inv));
-}
-
 bool CConnman::NodeFullyConnected(const CNode *pnode)
 {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
@@ -3038,7 +3421,7 @@ bool CConnman::ForNode(NodeId id, std::function<bool(CNode *pnode)> func)
 
 int64_t PoissonNextSend(int64_t nNow, int average_interval_seconds)
 {
-    return nNow + int64_t(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) *
+    return nNow + int64_t(log1p(GetFastRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) *
                               average_interval_seconds * -1000000.0 +
                           0.5);
 }
@@ -26,6 +26,7 @@
 #include <cstdint>
 #include <deque>
 #include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <thread>
 
@@ -34,16 +35,18 @@
 #include "bloom.h"
 #include "compat.h"
 #include "crypto/hash.h"
-#include "limitedmap.h"
 #include "net/addrman.h"
+#include "net/banindex.h"
 #include "net/netbase.h"
 #include "net/protocol.h"
+#include "net/sendlanes.h"
 #include "networks/netman.h"
 #include "random.h"
 #include "streams.h"
 #include "sync.h"
 #include "threadgroup.h"
 #include "uint256.h"
+#include "util/timehistogram.h"
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -65,6 +68,10 @@ static const int FEELER_INTERVAL = 120;
 static const unsigned int MAX_INV_SZ = 50000;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
+/** Addresses a peer may send us per second on average, the ones beyond are dropped without being processed */
+static const double MAX_ADDR_RATE_PER_SECOND = 0.1;
+/** Addresses a peer may send at once before the rate applies, the answer to our getaddr is allowed on top */
+static const double MAX_ADDR_PROCESSING_TOKEN_BUCKET = MAX_ADDR_TO_SEND;
 /** Maximum length of incoming protocol messages (no message over 32 MB is
  * currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 32 * 1000 * 1000;
@@ -74,6 +81,8 @@ static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 /** Maximum number of automatic outgoing nodes */
 static const int MAX_OUTBOUND_CONNECTIONS = DEFAULT_MAX_PEER_CONNECTIONS * 3 / 5;
+/** Maximum number of the automatic outgoing nodes that only relay blocks, a quarter of them at most */
+static const int MAX_BLOCK_RELAY_ONLY_CONNECTIONS = 2;
 /** Maximum number of addnode outgoing nodes */
 static const int MAX_ADDNODE_CONNECTIONS = 16;
 /** -listen default */
@@ -84,10 +93,6 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
-/** The maximum number of entries in mapAskFor */
-static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
-/** The maximum number of entries in setAskFor (larger due to getdata latency)*/
-static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The default for -maxuploadtarget. 0 = Unlimited */
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 /** The default timeframe for -maxuploadtarget. 1 day. */
@@ -99,8 +104,18 @@ static const bool DEFAULT_BLOCKSONLY = false;
 // as long as seeders are working.
 // TODO: Change this back to false after the forked network is stable.
 static const bool DEFAULT_FORCEDNSSEED = true;
+/** How long the DNS seeds are given to answer, they are asked at the same time */
+static const int64_t DNSSEED_LOOKUP_TIMEOUT = 15;
+/** How long what a DNS seed answered is used instead of asking it again, in seconds. getaddrinfo does not report
+ *  the TTL of the records, seeds typically set a much shorter one but the peers they return live for days. */
+static const int64_t DNSSEED_CACHE_LIFETIME = 24 * 60 * 60;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
+/** -sendcoalesce default, microseconds small messages to a peer wait for more to go out with them */
+static const int64_t DEFAULT_SEND_COALESCE = 1000;
+/** Message handler threads, 0 means one per core */
+static const int DEFAULT_MSGHANDLER_THREADS = 0;
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = ServiceFlags(NODE_NETWORK);
 
@@ -116,6 +131,14 @@ extern CNetworkManager *pnetMan;
 typedef int64_t NodeId;
 // Command, total bytes
 typedef std::map<std::string, uint64_t> mapMsgCmdSize;
+/** How long the messages of one command waited after they were received and how long processing them took */
+struct CMsgCmdTimes
+{
+    CTimeHistogram queue;
+    CTimeHistogram process;
+};
+// Command, times
+typedef std::map<std::string, CMsgCmdTimes> mapMsgCmdTimes;
 
 struct AddedNodeInfo
 {
@@ -128,6 +151,7 @@ struct AddedNodeInfo
 class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
+class CScheduler;
 
 
 class CNetMessage
@@ -141,13 +165,13 @@ public:
     bool in_data;
 
     // Partially received header.
-    CDataStream hdrbuf;
+    CPublicDataStream hdrbuf;
     // Complete header.
     CMessageHeader hdr;
     unsigned int nHdrPos;
 
     // Received message data.
-    CDataStream vRecv;
+    CPublicDataStream vRecv;
     unsigned int nDataPos;
 
     // Time (in microseconds) of message receipt.
@@ -183,7 +207,34 @@ public:
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    //! hand the payload buffer back to recvBufferPool once the message was processed
+    void ReleaseBuffer();
+};
+
+/** A serialized message payload with its checksum. It never changes once built, so a payload
+ *  serialized once, a block served to many peers for example, can sit in the send queues of
+ *  all of them without a copy each.
+ */
+class CSerializedPayload
+{
+public:
+    const std::vector<uint8_t> data;
+    //! the send version the payload was serialized with
+    const int nVersion;
+    uint8_t checksum[CMessageHeader::CHECKSUM_SIZE];
+
+    CSerializedPayload(std::vector<uint8_t> &&dataIn, int nVersionIn);
 };
+typedef std::shared_ptr<const CSerializedPayload> CSerializedPayloadRef;
+
+template <typename... Args>
+CSerializedPayloadRef MakeSerializedPayload(int nVersion, Args &&... args)
+{
+    std::vector<uint8_t> data;
+    CVectorWriter{SER_NETWORK, nVersion, data, 0, std::forward<Args>(args)...};
+    return std::make_shared<const CSerializedPayload>(std::move(data), nVersion);
+}
 
 /** Information about a peer */
 class CNode
@@ -196,14 +247,19 @@ public:
     // Services expected from a peer, otherwise it will be disconnected
     ServiceFlags nServicesExpected;
     SOCKET hSocket;
-    // Total size of all vSendMsg entries.
+    // Total size of all vSendMsg entries and of the messages waiting in sendLanes.
     size_t nSendSize;
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset;
+    // When the messages in sendLanes that wait to be coalesced are sent at the latest, 0 if none wait.
+    int64_t nSendFlushDeadline;
     uint64_t nSendBytes;
     // Total bytes sent and received
     uint64_t nActivityBytes;
-    std::deque<std::vector<uint8_t> > vSendMsg;
+    // Message headers and payloads waiting to be sent, payloads may be shared with other nodes
+    std::deque<std::shared_ptr<const std::vector<uint8_t> > > vSendMsg;
+    // Messages not handed to vSendMsg yet, by priority. vSendMsg is refilled from them when it runs empty.
+    CSendLanes sendLanes;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -211,6 +267,8 @@ public:
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
+    //! memory the messages still being received take, as the socket handler last counted it
+    std::atomic<size_t> nRecvMsgUsage;
 
     CCriticalSection cs_sendProcessing;
 
@@ -240,6 +298,9 @@ public:
     bool fAddnode;
     bool fClient;
     const bool fInbound;
+    // An outbound connection that only takes part in block relay, without transaction and address
+    // relay. Set when it is made, the filters for those are kept at their smallest.
+    const bool fBlockRelayOnly;
     std::atomic_bool fSuccessfullyConnected;
     std::atomic_bool fDisconnect;
     // We use fRelayTxes for two purposes -
@@ -260,10 +321,16 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    //! a block it asked for is read by g_blockserver, the rest of its getdata and its messages wait for it
+    std::atomic_bool fBlockReadPending;
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    // the message handler times of this node, CConnman keeps those of all nodes
+    CCriticalSection cs_msgTimes;
+    mapMsgCmdTimes mapMsgTimesPerCmd;
+    CTimeHistogram sendMessagesTimes;
 
 public:
     uint256 hashContinue;
@@ -276,19 +343,24 @@ public:
     std::set<uint256> setKnown;
     int64_t nNextAddrSend;
     int64_t nNextLocalAddrSend;
+    //! addresses the peer may still send, refilled at MAX_ADDR_RATE_PER_SECOND
+    double nAddrTokenBucket;
+    int64_t nAddrTokenTimestamp;
+    std::atomic<uint64_t> nAddrProcessed;
+    std::atomic<uint64_t> nAddrRateLimited;
 
     // Inventory based relay.
     CRollingBloomFilter filterInventoryKnown;
-    // Set of transaction ids we still have to announce. They are sorted by the
-    // mempool before relay, so the order is not important.
-    std::set<uint256> setInventoryTxToSend;
+    // Transaction ids we still have to announce, each with the feerate (in satoshis per 1000
+    // bytes) it had in the mempool when it was queued. setInventoryTxByFeeRate holds the same
+    // entries ordered by that feerate, so the best paying ones are announced first.
+    std::map<uint256, CAmount> mapInventoryTxToSend;
+    std::set<std::pair<CAmount, uint256> > setInventoryTxByFeeRate;
     // List of block ids we still have announce. There is no final sorting
     // before sending, as they are always sent immediately and in the order
     // requested.
     std::vector<uint256> vInventoryBlockToSend;
     CCriticalSection cs_inventory;
-    std::set<uint256> setAskFor;
-    std::multimap<int64_t, CInv> mapAskFor;
     int64_t nNextInvSend;
     // Used for headers announcements - unfiltered blocks to relay. Also
     // protected by cs_inventory.
@@ -296,6 +368,13 @@ public:
     // Used for BIP35 mempool sending, also protected by cs_inventory.
     bool fSendMempool;
 
+    // The feerate (in satoshis per 1000 bytes) below which the peer asked us not to announce
+    // transactions with a feefilter, and ours as we sent it last. Only SendMessages uses the
+    // last two.
+    std::atomic<CAmount> minFeeFilter;
+    CAmount lastSentFeeFilter;
+    int64_t nextSendTimeFeeFilter;
+
     // Last time a "MEMPOOL" request was serviced.
     std::atomic<int64_t> timeLastMempoolReq;
 
@@ -323,7 +402,8 @@ public:
         uint64_t nKeyedNetGroupIn,
         uint64_t nLocalHostNonceIn,
         const std::string &addrNameIn = "",
-        bool fInboundIn = false);
+        bool fInboundIn = false,
+        bool fBlockRelayOnlyIn = false);
     ~CNode();
 
 private:
@@ -373,6 +453,10 @@ public:
     void AddAddressKnown(const CAddress &_addr) { addrKnown.insert(_addr.GetKey()); }
     void PushAddress(const CAddress &_addr, FastRandomContext &insecure_rand)
     {
+        if (fBlockRelayOnly)
+        {
+            return;
+        }
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -395,14 +479,18 @@ public:
         filterInventoryKnown.insert(inv.hash);
     }
 
-    void PushInventory(const CInv &inv)
+    void PushInventory(const CInv &inv, CAmount nFeeRate = 0)
     {
         LOCK(cs_inventory);
         if (inv.type == MSG_TX)
         {
-            if (!filterInventoryKnown.contains(inv.hash))
+            if (fBlockRelayOnly)
+            {
+                return;
+            }
+            if (!filterInventoryKnown.contains(inv.hash) && mapInventoryTxToSend.emplace(inv.hash, nFeeRate).second)
             {
-                setInventoryTxToSend.insert(inv.hash);
+                setInventoryTxByFeeRate.emplace(nFeeRate, inv.hash);
             }
         }
         else if (inv.type == MSG_BLOCK)
@@ -417,8 +505,6 @@ public:
         vBlockHashesToAnnounce.push_back(hash);
     }
 
-    void AskFor(const CInv &inv);
-
     void CloseSocketDisconnect();
 
     void copyStats(CNodeStats &stats);
@@ -442,7 +528,12 @@ public:
 
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
-    bool Start(std::string &strNodeError);
+    /** Start the network threads, the periodic dumps of peers.dat and banlist.dat run on scheduler */
+    bool Start(CScheduler &scheduler, std::string &strNodeError);
+    /** Read peers.dat and banlist.dat, Start() does if it was not called before. Needs nothing from the chain, so
+     *  init runs it while the block index loads.
+     */
+    void LoadAddresses();
     void Stop();
     void Interrupt();
     bool BindListenPort(const CService &bindAddr, std::string &strError, bool fWhitelisted = false);
@@ -452,64 +543,42 @@ public:
         const char *strDest = nullptr,
         bool fOneShot = false,
         bool fFeeler = false,
-        bool fAddnode = false);
+        bool fAddnode = false,
+        bool fBlockRelayOnly = false);
 
     bool ForNode(NodeId id, std::function<bool(CNode *pnode)> func);
+    /** Let the message handler threads run now instead of after their idle sleep */
+    void WakeMessageHandler();
 
     template <typename... Args>
     void PushMessage(CNode *pnode, std::string sCommand, Args &&... args)
     {
-        std::vector<uint8_t> data;
-        CVectorWriter{SER_NETWORK, pnode->GetSendVersion(), data, 0, std::forward<Args>(args)...};
-        size_t nMessageSize = data.size();
-        size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-        LogPrint("net", "sending %s (%d bytes) peer=%d\n", SanitizeString(sCommand.c_str()), nMessageSize, pnode->id);
-
-        std::vector<uint8_t> serializedHeader;
-        serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-        uint256 hash = Hash(data.data(), data.data() + nMessageSize);
-        CMessageHeader hdr(pnetMan->getActivePaymentNetwork()->MessageStart(), sCommand.c_str(), nMessageSize);
-        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
-
-        CVectorWriter{SER_NETWORK, MIN_PROTO_VERSION, serializedHeader, 0, hdr};
-
-        size_t nBytesSent = 0;
-        {
-            LOCK(pnode->cs_vSend);
-            bool optimisticSend(pnode->vSendMsg.empty());
-
-            // log total amount of bytes per command
-            pnode->mapSendBytesPerMsgCmd[sCommand] += nTotalSize;
-            pnode->nSendSize += nTotalSize;
+        PushSerializedMessage(
+            pnode, sCommand, MakeSerializedPayload(pnode->GetSendVersion(), std::forward<Args>(args)...));
+    }
 
-            if (pnode->nSendSize > nSendBufferMaxSize)
-            {
-                pnode->fPauseSend = true;
-            }
-            pnode->vSendMsg.push_back(std::move(serializedHeader));
-            if (nMessageSize)
-            {
-                pnode->vSendMsg.push_back(std::move(data));
-            }
-            const char *strCommand = sCommand.c_str();
-            if (strcmp(strCommand, NetMsgType::PING) != 0 && strcmp(strCommand, NetMsgType::PONG) != 0 &&
-                strcmp(strCommand, NetMsgType::ADDR) != 0 && strcmp(strCommand, NetMsgType::VERSION) != 0 &&
-                strcmp(strCommand, NetMsgType::VERACK) != 0 && strcmp(strCommand, NetMsgType::INV) != 0)
-            {
-                pnode->nActivityBytes += nMessageSize;
-            }
+    //! Queue a message on lane instead of the lane of its command
+    template <typename... Args>
+    void PushMessage(CNode *pnode, SendLane lane, std::string sCommand, Args &&... args)
+    {
+        PushSerializedMessage(
+            pnode, sCommand, MakeSerializedPayload(pnode->GetSendVersion(), std::forward<Args>(args)...), lane);
+    }
 
-            // If write queue empty, attempt "optimistic write"
-            if (optimisticSend == true)
-            {
-                nBytesSent = SocketSendData(pnode);
-            }
-        }
-        if (nBytesSent)
-        {
-            RecordBytesSent(nBytesSent);
-        }
+    /** Queue a message whose payload is serialized already. The payload must have been
+     *  serialized with the send version of pnode
+     */
+    void PushSerializedMessage(CNode *pnode, const std::string &sCommand, const CSerializedPayloadRef &payload)
+    {
+        PushSerializedMessage(pnode, sCommand, payload, GetSendLane(sCommand));
     }
+    void PushSerializedMessage(CNode *pnode,
+        const std::string &sCommand,
+        const CSerializedPayloadRef &payload,
+        SendLane lane);
+    /** Send the messages to pnode that wait for more to coalesce with, the message handler calls it once it is
+     *  done with the peer for the round */
+    void FlushSendBuffer(CNode *pnode);
 
     template <typename Callable>
     void ForEachNode(Callable &&func)
@@ -593,7 +662,19 @@ public:
     std::vector<AddedNodeInfo> GetAddedNodeInfo();
 
     size_t GetNodeCount(NumConnections num);
+    /** The inbound and outbound nodes as the socket handler last counted them, takes no lock */
+    void GetPublishedNodeCounts(size_t &nInbound, size_t &nOutbound) const
+    {
+        nInbound = nNodesInboundPublished.load(std::memory_order_relaxed);
+        nOutbound = nNodesOutboundPublished.load(std::memory_order_relaxed);
+    }
     void GetNodeStats(std::vector<CNodeStats> &vstats);
+    /** Memory the send queues of the nodes take, a payload queued for several nodes counted once, and the
+     *  messages the nodes received and that wait to be processed or are still coming in
+     */
+    void GetNodeBufferUsage(size_t &nSendUsage, size_t &nRecvUsage);
+    //! memory the address manager takes
+    size_t GetAddrManUsage() const { return addrman.DynamicMemoryUsage(); }
     bool DisconnectNode(const std::string &node);
     bool DisconnectNode(NodeId id);
 
@@ -628,6 +709,11 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    /** Count a message ProcessMessages processed nQueueMicros after it was received, for the node and in total */
+    void RecordMessageTimes(CNode *pnode, const std::string &strCommand, int64_t nQueueMicros, int64_t nProcessMicros);
+    /** The message handler times of all nodes since the start, those that disconnected included */
+    void GetMessageTimes(mapMsgCmdTimes &mapTimes, CTimeHistogram &sendTimes);
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -648,10 +734,13 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    /** Process the messages of the nodes whose id is nThread modulo nThreads */
+    void ThreadMessageHandler(unsigned int nThread, unsigned int nThreads);
     void AcceptConnection(const ListenSocket &hListenSocket);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
+    /** Add what a DNS seed resolved to to addrman, returns how many addresses there were */
+    int AddSeedAddresses(const std::vector<CNetAddr> &vIPs, ServiceFlags nServices, const CService &source);
 
     uint64_t CalculateKeyedNetGroup(const CAddress &ad) const;
 
@@ -661,7 +750,7 @@ private:
     CNode *FindNode(const CService &addr);
 
     bool AttemptToEvictConnection();
-    CNode *ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure);
+    CNode *ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure, bool fBlockRelayOnly = false);
     bool IsWhitelistedRange(const CNetAddr &addr);
 
     void DeleteNode(CNode *pnode);
@@ -669,6 +758,9 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    /** Account for a message of nMessageSize payload bytes queued to pnode, the send buffer size, bytes per
+     *  command and activity bytes. Requires cs_vSend */
+    void RecordMessageQueued(CNode *pnode, const std::string &sCommand, size_t nMessageSize);
     //! check is the banlist has unwritten changes
     bool BannedSetIsDirty();
     //! set the "dirty" flag for the banlist
@@ -677,12 +769,12 @@ private:
     void SweepBanned();
     void DumpAddresses();
     void _DumpData();
-    void DumpData(int64_t seconds_between_runs);
     void DumpBanlist();
 
     // Network stats
     void RecordBytesRecv(uint64_t bytes);
     void RecordBytesSent(uint64_t bytes);
+    void RecordSendMessagesTime(CNode *pnode, int64_t nMicros);
 
     // Whether the node should be passed out in ForEach* callbacks
     static bool NodeFullyConnected(const CNode *pnode);
@@ -693,6 +785,15 @@ private:
     uint64_t nTotalBytesRecv;
     uint64_t nTotalBytesSent;
 
+    // Node counts for GetPublishedNodeCounts
+    std::atomic<size_t> nNodesInboundPublished{0};
+    std::atomic<size_t> nNodesOutboundPublished{0};
+
+    // Message handler times of all nodes
+    CCriticalSection cs_msgTimes;
+    mapMsgCmdTimes mapMsgTimesPerCmd;
+    CTimeHistogram sendMessagesTimes;
+
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle;
     uint64_t nMaxOutboundCycleStartTime;
@@ -706,13 +807,23 @@ private:
 
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
+    //! bytes per second each peer is sent from its history lane at most, 0 for no limit
+    int64_t nMaxHistoryUploadRate;
+    //! microseconds a small message waits for others to share its send with, 0 to send each right away
+    int64_t nSendCoalesceMicros;
 
     std::vector<ListenSocket> vhListenSocket;
     banmap_t setBanned;
+    //! setBanned as a trie for IsBanned(CNetAddr), which runs for every connection we accept
+    CBanIndex banIndex;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
     bool fAddressesInitialized;
+    std::atomic<bool> fAddressesLoaded;
     CAddrMan addrman;
+    //! checksum of what DumpAddresses() last wrote, it skips the write while addrman is unchanged
+    uint256 hashAddressesDumped;
+    CCriticalSection cs_hashAddressesDumped;
     std::deque<std::string> vOneShots;
     CCriticalSection cs_vOneShots;
     std::vector<std::string> vAddedNodes;
@@ -732,6 +843,8 @@ private:
     std::unique_ptr<CSemaphore> semAddnode;
     int nMaxConnections;
     int nMaxOutbound;
+    //! of nMaxOutbound, the connections that only relay blocks
+    int nMaxOutboundBlockRelay;
     int nMaxAddnode;
     int nMaxFeeler;
     std::atomic<int> nBestHeight;
@@ -741,6 +854,11 @@ private:
 
     std::atomic<bool> interruptNet;
     thread_group netThreads;
+
+    //! counts the wakes of the message handler threads, each one waits for a change
+    std::mutex mutexMsgProc;
+    std::condition_variable condMsgProc;
+    uint64_t nMsgProcWake;
 };
 
 extern std::unique_ptr<CConnman> g_connman;
@@ -776,6 +894,8 @@ struct CNodeSignals
     boost::signals2::signal<bool(CNode *, CConnman &), CombinerAll> SendMessages;
     boost::signals2::signal<void(CNode *, CConnman &)> InitializeNode;
     boost::signals2::signal<void(NodeId, bool &)> FinalizeNode;
+    /** Fired from the socket handler thread whenever the number of connected nodes changes */
+    boost::signals2::signal<void(size_t)> NumConnectionsChanged;
 };
 
 CNodeSignals &GetNodeSignals();
@@ -815,8 +935,6 @@ extern bool fDiscover;
 extern bool fListen;
 extern bool fRelayTxes;
 
-extern limitedmap<uint256, int64_t> mapAlreadyAskedFor;
-
 struct LocalServiceInfo
 {
     int nScore;
@@ -841,12 +959,18 @@ public:
     std::string cleanSubVer;
     bool fInbound;
     bool fAddnode;
+    bool fBlockRelayOnly;
     int nStartingHeight;
     uint64_t nSendBytes;
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdTimes mapMsgTimesPerCmd;
+    CTimeHistogram sendMessagesTimes;
     bool fWhitelisted;
+    uint64_t nAddrProcessed;
+    uint64_t nAddrRateLimited;
+    CAmount minFeeFilter;
     double dPingTime;
     double dPingWait;
     double dMinPing;
@@ -148,6 +148,13 @@ public:
 
     bool Match(const CNetAddr &addr) const;
 
+    //! the base address, with the bits outside the netmask cleared
+    const CNetAddr &GetNetwork() const { return network; }
+    /** The number of leading bits of the 128 bit address the netmask covers, IPv4 subnets
+     *  count the 96 bits of their IPv6 mapping. -1 if the netmask is not a prefix.
+     */
+    int GetPrefixLength() const;
+
     std::string ToString() const;
     bool IsValid() const;
 
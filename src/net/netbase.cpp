@@ -27,6 +27,7 @@
 #include "net/netbase.h"
 
 #include "crypto/hash.h"
+#include "net/socketevents.h"
 #include "random.h"
 #include "sync.h"
 #include "uint256.h"
@@ -257,15 +258,11 @@ static bool InterruptibleRecv(char *data, size_t len, int timeout, SOCKET &hSock
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL)
             {
-                if (!IsSelectableSocket(hSocket))
+                if (!CSocketEvents::IsSupported(hSocket))
                 {
                     return false;
                 }
-                struct timeval tval = MillisToTimeval(std::min(endTime - curTime, maxWait));
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(hSocket, &fdset);
-                int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+                int nRet = WaitForSocket(hSocket, false, std::min(endTime - curTime, maxWait));
                 if (nRet == SOCKET_ERROR)
                 {
                     return false;
@@ -524,11 +521,7 @@ static bool ConnectSocketDirectly(const CService &addrConnect, SOCKET &hSocketRe
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL)
         {
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+            int nRet = WaitForSocket(hSocket, true, nTimeout);
             if (nRet == 0)
             {
                 LogPrintf("connection to %s timeout\n", addrConnect.ToString());
@@ -708,7 +701,7 @@ bool ConnectSocketByName(CService &addr,
     {
         if (addrResolved.size() > 0)
         {
-            addr = addrResolved[GetRand(addrResolved.size())];
+            addr = addrResolved[GetFastRand(addrResolved.size())];
             return ConnectSocket(addr, hSocketRet, nTimeout);
         }
     }
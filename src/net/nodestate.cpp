@@ -22,3 +22,18 @@ void CNodesStateManager::RemoveNodeState(const NodeId id)
     LOCK(cs);
     mapNodeState.erase(id);
 }
+
+void CNodesStateManager::GetReferencedBlockIndexes(std::set<const CBlockIndex *> &setRefs)
+{
+    LOCK(cs);
+    for (const auto &item : mapNodeState)
+    {
+        const CNodeState &state = item.second;
+        for (const CBlockIndex *pindex :
+            {state.pindexBestKnownBlock, state.pindexLastCommonBlock, state.pindexBestHeaderSent})
+        {
+            if (pindex)
+                setRefs.insert(pindex);
+        }
+    }
+}
@@ -2,8 +2,8 @@
 #include "net.h"
 
 /**
- * Maintain validation-specific state about nodes, protected by cs_main, instead
- * by CNode's own locks. This simplifies asynchronous operation, where
+ * Maintain validation-specific state about nodes, protected by the lock of
+ * nodestateman instead of cs_main or CNode's own locks. This simplifies asynchronous operation, where
  * processing of incoming data is done after the ProcessMessage call returns,
  * and we're no longer holding the node's locks.
  */
@@ -42,6 +42,13 @@ struct CNodeState
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving average of the microseconds this peer takes per block while it has blocks in
+    //! flight, 0 until the first block arrived
+    int64_t nAvgBlockTime;
+    //! When this peer was first found holding up the download window, 0 if it is not
+    int64_t nStallingSince;
+    //! Blocks requested from another peer because this one held up the download window
+    int nBlockStalls;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block
@@ -54,12 +61,10 @@ struct CNodeState
      * version of compact blocks we send.
      */
     bool fProvidesHeaderAndIDs;
-    /**
-     * If we've announced NODE_WITNESS to this peer: whether the peer sends
-     * witnesses in cmpctblocks/blocktxns, otherwise: whether this peer sends
-     * non-witnesses in cmpctblocks/blocktxns.
-     */
+    //! Whether this peer speaks CMPCTBLOCKS_VERSION, so we may ask it for cmpctblocks
     bool fSupportsDesiredCmpctVersion;
+    //! Whether this peer wants new blocks announced with a cmpctblock rather than headers
+    bool fPreferHeaderAndIDs;
 
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn)
     {
@@ -75,10 +80,14 @@ struct CNodeState
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nAvgBlockTime = 0;
+        nStallingSince = 0;
+        nBlockStalls = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fProvidesHeaderAndIDs = false;
         fSupportsDesiredCmpctVersion = false;
+        fPreferHeaderAndIDs = false;
     }
 };
 
@@ -86,10 +95,11 @@ class CNodesStateManager
 {
 protected:
     CCriticalSection cs;
-    std::map<NodeId, CNodeState> mapNodeState;
+    std::map<NodeId, CNodeState> mapNodeState GUARDED_BY(cs);
     friend class CNodeStateAccessor;
 
 public:
+    //! cs has to be held, see CNodeStateAccessor
     CNodeState *_GetNodeState(const NodeId id);
 
     /** Add a nodestate from the map */
@@ -105,6 +115,9 @@ public:
         mapNodeState.clear();
     }
 
+    /** Add the block index entries any nodestate points to */
+    void GetReferencedBlockIndexes(std::set<const CBlockIndex *> &setRefs);
+
     /** Is mapNodestate empty */
     bool Empty()
     {
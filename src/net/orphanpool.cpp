@@ -0,0 +1,222 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2009-2010 Satoshi Nakamoto
+ * Copyright (c) 2009-2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/orphanpool.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+#include "random.h"
+#include "serialize.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <algorithm>
+
+COrphanPool orphanpool;
+
+bool COrphanPool::AddTx(const CTransactionRef &tx, NodeId peer)
+{
+    LOCK(cs_orphans);
+    const uint256 &hash = tx->GetHash();
+    if (mapOrphans.count(hash))
+    {
+        return false;
+    }
+
+    // Ignore big transactions, to avoid a send-big-orphans memory exhaustion attack
+    unsigned int sz = GetSerializeSize(*tx, SER_NETWORK, CTransaction::CURRENT_VERSION);
+    if (sz > MAX_ORPHAN_TX_SIZE)
+    {
+        LogPrint(Logging::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    COrphanTx orphan = {tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, sz, vOrphans.size(), nNextSequence++};
+    mapOrphans.emplace(hash, orphan);
+    vOrphans.push_back(hash);
+    for (const CTxIn &txin : tx->vin)
+    {
+        mapOrphansByPrev[txin.prevout.hash].insert(hash);
+    }
+    mapOrphansByPeer[peer].insert(hash);
+    nTotalBytes += sz;
+
+    LogPrint(Logging::MEMPOOL, "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(), mapOrphans.size(),
+        mapOrphansByPrev.size());
+    return true;
+}
+
+bool COrphanPool::_EraseTx(const uint256 &hash)
+{
+    OrphanMap::iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+    {
+        return false;
+    }
+    const COrphanTx &orphan = it->second;
+    for (const CTxIn &txin : orphan.tx->vin)
+    {
+        auto itPrev = mapOrphansByPrev.find(txin.prevout.hash);
+        if (itPrev == mapOrphansByPrev.end())
+        {
+            continue;
+        }
+        itPrev->second.erase(hash);
+        if (itPrev->second.empty())
+        {
+            mapOrphansByPrev.erase(itPrev);
+        }
+    }
+    auto itPeer = mapOrphansByPeer.find(orphan.fromPeer);
+    if (itPeer != mapOrphansByPeer.end())
+    {
+        itPeer->second.erase(hash);
+        if (itPeer->second.empty())
+        {
+            mapOrphansByPeer.erase(itPeer);
+        }
+    }
+
+    // move the last orphan of the list into the gap
+    size_t nPos = orphan.nListPos;
+    if (nPos != vOrphans.size() - 1)
+    {
+        vOrphans[nPos] = vOrphans.back();
+        mapOrphans[vOrphans[nPos]].nListPos = nPos;
+    }
+    vOrphans.pop_back();
+
+    nTotalBytes -= orphan.nSize;
+    mapOrphans.erase(it);
+    return true;
+}
+
+unsigned int COrphanPool::EraseForPeer(NodeId peer)
+{
+    LOCK(cs_orphans);
+    auto itPeer = mapOrphansByPeer.find(peer);
+    if (itPeer == mapOrphansByPeer.end())
+    {
+        return 0;
+    }
+    // _EraseTx drops the peer's entry with its last orphan
+    std::set<uint256> setErase;
+    setErase.swap(itPeer->second);
+    mapOrphansByPeer.erase(itPeer);
+    unsigned int nErased = 0;
+    for (const uint256 &hash : setErase)
+    {
+        nErased += _EraseTx(hash);
+    }
+    if (nErased > 0)
+    {
+        LogPrint(Logging::MEMPOOL, "Erased %d orphan tx from peer %d\n", nErased, peer);
+    }
+    return nErased;
+}
+
+unsigned int COrphanPool::EraseExpired(int64_t nNow)
+{
+    std::vector<uint256> vExpired;
+    for (const auto &entry : mapOrphans)
+    {
+        if (entry.second.nTimeExpire <= nNow)
+        {
+            vExpired.push_back(entry.first);
+        }
+    }
+    for (const uint256 &hash : vExpired)
+    {
+        _EraseTx(hash);
+    }
+    if (!vExpired.empty())
+    {
+        LogPrint(Logging::MEMPOOL, "Erased %d expired orphan tx\n", vExpired.size());
+    }
+    return vExpired.size();
+}
+
+unsigned int COrphanPool::LimitSize(unsigned int nMaxOrphans, uint64_t nMaxBytes)
+{
+    LOCK(cs_orphans);
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow)
+    {
+        nEvicted += EraseExpired(nNow);
+        nNextSweep = nNow + ORPHAN_TX_EXPIRE_INTERVAL;
+    }
+    while (!vOrphans.empty() && (vOrphans.size() > nMaxOrphans || nTotalBytes > nMaxBytes))
+    {
+        // Evict a random orphan
+        _EraseTx(vOrphans[GetFastRand(vOrphans.size())]);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+std::vector<COrphanPool::COrphanTx> COrphanPool::GetChildren(const std::vector<CTransactionRef> &vParents) const
+{
+    LOCK(cs_orphans);
+    std::set<uint256> setChildren;
+    std::vector<COrphanTx> vChildren;
+    for (const CTransactionRef &parent : vParents)
+    {
+        auto itByPrev = mapOrphansByPrev.find(parent->GetHash());
+        if (itByPrev == mapOrphansByPrev.end())
+        {
+            continue;
+        }
+        for (const uint256 &hash : itByPrev->second)
+        {
+            if (setChildren.insert(hash).second)
+            {
+                vChildren.push_back(mapOrphans.at(hash));
+            }
+        }
+    }
+    std::sort(vChildren.begin(), vChildren.end(),
+        [](const COrphanTx &a, const COrphanTx &b) { return a.nSequence < b.nSequence; });
+    return vChildren;
+}
+
+size_t COrphanPool::DynamicMemoryUsage() const
+{
+    LOCK(cs_orphans);
+    size_t nUsage = memusage::DynamicUsage(mapOrphans) + memusage::DynamicUsage(mapOrphansByPrev) +
+                    memusage::DynamicUsage(mapOrphansByPeer) + memusage::DynamicUsage(vOrphans);
+    for (const auto &orphan : mapOrphans)
+        nUsage += RecursiveDynamicUsage(orphan.second.tx);
+    for (const auto &prev : mapOrphansByPrev)
+        nUsage += memusage::DynamicUsage(prev.second);
+    for (const auto &peer : mapOrphansByPeer)
+        nUsage += memusage::DynamicUsage(peer.second);
+    return nUsage;
+}
+
+void COrphanPool::Clear()
+{
+    LOCK(cs_orphans);
+    mapOrphans.clear();
+    mapOrphansByPrev.clear();
+    mapOrphansByPeer.clear();
+    vOrphans.clear();
+    nTotalBytes = 0;
+}
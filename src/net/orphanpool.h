@@ -0,0 +1,130 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2009-2010 Satoshi Nakamoto
+ * Copyright (c) 2009-2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_ORPHANPOOL_H
+#define ECCOIN_ORPHANPOOL_H
+
+#include "chain/tx.h"
+#include "net/net.h"
+#include "sync.h"
+#include "txmempool.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/** Orphans larger than this are not kept, a peer with a legitimate large transaction whose
+ *  parent we miss is assumed to send it again once the parent was mined or relayed */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** Default for -maxorphanpool, maximum megabytes of orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_POOL_SIZE = 5;
+/** Seconds an orphan is kept at most */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Seconds between sweeps for expired orphans */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/** Transactions whose inputs we can not find yet, kept until a parent shows up. Indexed by
+ *  txid, by the txids they spend from and by the peer that sent them, so looking up the orphans a
+ *  new transaction resolves and dropping the orphans of a peer that went away only touch those
+ *  orphans. Bounded in count and bytes, and every orphan expires after ORPHAN_TX_EXPIRE_TIME.
+ *  Has its own lock, callers do not need cs_main.
+ */
+class COrphanPool
+{
+public:
+    struct COrphanTx
+    {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        size_t nSize;
+        //! where the orphan is in vOrphans
+        size_t nListPos;
+        //! orphans are numbered as they are added
+        uint64_t nSequence;
+    };
+
+    COrphanPool() : nTotalBytes(0), nNextSweep(0) {}
+
+    /** Keep tx until its parents arrive. Fails for transactions we have already and for ones
+     *  larger than MAX_ORPHAN_TX_SIZE.
+     */
+    bool AddTx(const CTransactionRef &tx, NodeId peer);
+    bool HaveTx(const uint256 &hash) const
+    {
+        LOCK(cs_orphans);
+        return mapOrphans.count(hash) != 0;
+    }
+    bool EraseTx(const uint256 &hash)
+    {
+        LOCK(cs_orphans);
+        return _EraseTx(hash);
+    }
+    //! returns how many orphans were dropped
+    unsigned int EraseForPeer(NodeId peer);
+
+    /** Drop expired orphans, then random ones until at most nMaxOrphans of at most nMaxBytes
+     *  together are left. Returns how many were dropped.
+     */
+    unsigned int LimitSize(unsigned int nMaxOrphans, uint64_t nMaxBytes);
+
+    /** The orphans spending an output of any of vParents, each once, in the order they were
+     *  added. They stay in the pool.
+     */
+    std::vector<COrphanTx> GetChildren(const std::vector<CTransactionRef> &vParents) const;
+
+    size_t Size() const
+    {
+        LOCK(cs_orphans);
+        return mapOrphans.size();
+    }
+    uint64_t GetTotalBytes() const
+    {
+        LOCK(cs_orphans);
+        return nTotalBytes;
+    }
+    //! memory the orphans and the indexes over them take
+    size_t DynamicMemoryUsage() const;
+    void Clear();
+
+private:
+    typedef std::unordered_map<uint256, COrphanTx, SaltedTxidHasher> OrphanMap;
+
+    mutable CCriticalSection cs_orphans;
+    OrphanMap mapOrphans GUARDED_BY(cs_orphans);
+    //! orphans by the txid of a transaction they spend from
+    std::unordered_map<uint256, std::set<uint256>, SaltedTxidHasher> mapOrphansByPrev GUARDED_BY(cs_orphans);
+    std::map<NodeId, std::set<uint256> > mapOrphansByPeer GUARDED_BY(cs_orphans);
+    //! every orphan once, for picking a random one to evict
+    std::vector<uint256> vOrphans GUARDED_BY(cs_orphans);
+    uint64_t nNextSequence GUARDED_BY(cs_orphans) = 0;
+    uint64_t nTotalBytes GUARDED_BY(cs_orphans);
+    int64_t nNextSweep GUARDED_BY(cs_orphans);
+
+    //! EraseTx and EraseExpired with cs_orphans held
+    bool _EraseTx(const uint256 &hash);
+    unsigned int EraseExpired(int64_t nNow);
+};
+
+extern COrphanPool orphanpool;
+
+#endif // ECCOIN_ORPHANPOOL_H
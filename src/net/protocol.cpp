@@ -52,12 +52,28 @@ const char *FILTERADD = "filteradd";
 const char *FILTERCLEAR = "filterclear";
 const char *REJECT = "reject";
 const char *SENDHEADERS = "sendheaders";
+const char *SENDCMPCT = "sendcmpct";
+const char *CMPCTBLOCK = "cmpctblock";
+const char *GETBLOCKTXN = "getblocktxn";
+const char *BLOCKTXN = "blocktxn";
+const char *GETCFILTERS = "getcfilters";
+const char *CFILTER = "cfilter";
+const char *GETCFHEADERS = "getcfheaders";
+const char *CFHEADERS = "cfheaders";
+const char *GETCFCHECKPT = "getcfcheckpt";
+const char *CFCHECKPT = "cfcheckpt";
+const char *FEEFILTER = "feefilter";
+const char *SENDTXRCNCL = "sendtxrcncl";
+const char *REQRECON = "reqrecon";
+const char *SKETCH = "sketch";
+const char *RECONCILDIFF = "reconcildiff";
 };
 
 static const char *ppszTypeName[] = {
     "ERROR", // Should never occur
     NetMsgType::TX, NetMsgType::BLOCK,
     "filtered block", // Should never occur
+    "compact block", // Should never occur
 };
 
 /** All known message types. Keep this in the same order as the list of
@@ -67,7 +83,11 @@ const static std::string allNetMessageTypes[] = {NetMsgType::VERSION, NetMsgType
     NetMsgType::INV, NetMsgType::GETDATA, NetMsgType::MERKLEBLOCK, NetMsgType::GETBLOCKS, NetMsgType::GETHEADERS,
     NetMsgType::TX, NetMsgType::HEADERS, NetMsgType::BLOCK, NetMsgType::GETADDR, NetMsgType::MEMPOOL, NetMsgType::PING,
     NetMsgType::PONG, NetMsgType::ALERT, NetMsgType::NOTFOUND, NetMsgType::FILTERLOAD, NetMsgType::FILTERADD,
-    NetMsgType::FILTERCLEAR, NetMsgType::REJECT, NetMsgType::SENDHEADERS};
+    NetMsgType::FILTERCLEAR, NetMsgType::REJECT, NetMsgType::SENDHEADERS, NetMsgType::SENDCMPCT,
+    NetMsgType::CMPCTBLOCK, NetMsgType::GETBLOCKTXN, NetMsgType::BLOCKTXN, NetMsgType::GETCFILTERS,
+    NetMsgType::CFILTER, NetMsgType::GETCFHEADERS, NetMsgType::CFHEADERS, NetMsgType::GETCFCHECKPT,
+    NetMsgType::CFCHECKPT, NetMsgType::FEEFILTER, NetMsgType::SENDTXRCNCL, NetMsgType::REQRECON, NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF};
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes,
     allNetMessageTypes + ARRAYLEN(allNetMessageTypes));
 
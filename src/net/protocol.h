@@ -234,6 +234,91 @@ extern const char *REJECT;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char *SENDHEADERS;
+/**
+ * Contains a 1-byte bool and 8-byte LE version number. Indicates that a node
+ * is willing to provide blocks via "cmpctblock" messages and whether it wants
+ * new blocks announced with them instead of "headers".
+ * @since protocol version 60040, modelled on BIP152.
+ */
+extern const char *SENDCMPCT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
+ * list of "short txids".
+ * @since protocol version 60040, modelled on BIP152.
+ */
+extern const char *CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * @since protocol version 60040, modelled on BIP152.
+ */
+extern const char *GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * @since protocol version 60040, modelled on BIP152.
+ */
+extern const char *BLOCKTXN;
+/**
+ * Contains a 1-byte filter type, a 4-byte start height and a block hash. Asks for a "cfilter" for every block
+ * from that height up to the block.
+ * Only available with service bit NODE_COMPACT_FILTERS, as described by BIP157.
+ */
+extern const char *GETCFILTERS;
+/**
+ * Contains a filter type, a block hash and the filter of the block.
+ * Sent in response to a "getcfilters" message.
+ */
+extern const char *CFILTER;
+/**
+ * Contains the same as a "getcfilters" message. Asks for the filter hashes of the blocks from the start height up
+ * to the block hash, and the filter header before them.
+ * Only available with service bit NODE_COMPACT_FILTERS, as described by BIP157.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * Contains a filter type, the stop hash, the previous filter header and the filter hashes.
+ * Sent in response to a "getcfheaders" message.
+ */
+extern const char *CFHEADERS;
+/**
+ * Contains a filter type and a block hash. Asks for the filter headers of every 1000th block up to the block.
+ * Only available with service bit NODE_COMPACT_FILTERS, as described by BIP157.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * Contains a filter type, the stop hash and the filter headers.
+ * Sent in response to a "getcfcheckpt" message.
+ */
+extern const char *CFCHECKPT;
+/**
+ * Contains an 8-byte LE feerate in satoshis per 1000 bytes. Tells the receiving peer not to
+ * announce transactions that pay less than that, they would not be accepted.
+ * @since protocol version 60041, modelled on BIP133.
+ */
+extern const char *FEEFILTER;
+/**
+ * Contains a 4-byte LE reconciliation version and an 8-byte LE salt. Sent after "verack" by a node that will
+ * reconcile the transactions it announces instead of sending an "inv" for each, once both sides sent it.
+ * Modelled on Erlay.
+ */
+extern const char *SENDTXRCNCL;
+/**
+ * Contains the 2-byte LE size of the reconciliation set of the sender and the 2-byte LE q of the capacity
+ * estimate. Sent by the node that opened the connection, the peer answers with a "sketch" of its set.
+ */
+extern const char *REQRECON;
+/**
+ * Contains the power sums of the short ids of a reconciliation set, 4 bytes each.
+ * Sent in response to a "reqrecon" message.
+ */
+extern const char *SKETCH;
+/**
+ * Contains a 1-byte bool, whether the difference of the sets could be decoded, and the short ids of the
+ * transactions the sender lacks. Sent in response to a "sketch" message, the peer announces those or, when
+ * the decoding failed, its whole set.
+ */
+extern const char *RECONCILDIFF;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -256,6 +341,9 @@ enum ServiceFlags : uint64_t
     // Bitcoin Core nodes used to support this by default, without advertising this bit,
     // but no longer do as of protocol version 70011 (= NO_BLOOM_VERSION)
     NODE_BLOOM = (1 << 2),
+    // NODE_COMPACT_FILTERS means the node serves the basic block filters and their headers as described by
+    // BIP157 and BIP158.
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -330,6 +418,8 @@ public:
     uint256 hash;
 };
 
+SERIALIZE_AS_MEMORY_IMAGE(CInv, 36);
+
 enum
 {
     MSG_TX = 1,
@@ -337,6 +427,8 @@ enum
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.
     MSG_FILTERED_BLOCK,
+    // Defined in BIP152, only used in getdata to ask for a cmpctblock
+    MSG_CMPCT_BLOCK,
 };
 
 #endif // BITCOIN_PROTOCOL_H
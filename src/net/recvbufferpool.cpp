@@ -0,0 +1,89 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/recvbufferpool.h"
+
+#include "memusage.h"
+
+CRecvBufferPool recvBufferPool;
+
+void CRecvBufferPool::Get(CPublicSerializeData &vch, size_t nSize)
+{
+    size_t nClass = 0;
+    while (nClass < NUM_CLASSES - 1 && ClassSize(nClass) < nSize)
+    {
+        nClass++;
+    }
+    {
+        LOCK(cs);
+        if (!vPool[nClass].empty())
+        {
+            vch.swap(vPool[nClass].back());
+            vPool[nClass].pop_back();
+            nHits++;
+            return;
+        }
+        nMisses++;
+    }
+    CPublicSerializeData vchNew;
+    vchNew.reserve(ClassSize(nClass));
+    vch.swap(vchNew);
+}
+
+void CRecvBufferPool::Release(CPublicSerializeData &vch)
+{
+    CPublicSerializeData vchRelease;
+    vchRelease.swap(vch);
+    if (vchRelease.capacity() < MIN_BUFFER_SIZE || vchRelease.capacity() > MAX_BUFFER_SIZE)
+    {
+        return;
+    }
+    // the largest class the buffer still has room for
+    size_t nClass = NUM_CLASSES - 1;
+    while (ClassSize(nClass) > vchRelease.capacity())
+    {
+        nClass--;
+    }
+    vchRelease.clear();
+    LOCK(cs);
+    if (vPool[nClass].size() < MAX_POOLED_BYTES_PER_CLASS / ClassSize(nClass))
+    {
+        vPool[nClass].emplace_back();
+        vPool[nClass].back().swap(vchRelease);
+    }
+}
+
+void CRecvBufferPool::GetStats(uint64_t &nHitsOut, uint64_t &nMissesOut) const
+{
+    LOCK(cs);
+    nHitsOut = nHits;
+    nMissesOut = nMisses;
+}
+
+size_t CRecvBufferPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    size_t nUsage = 0;
+    for (size_t nClass = 0; nClass < NUM_CLASSES; nClass++)
+    {
+        nUsage += memusage::MallocUsage(vPool[nClass].capacity() * sizeof(CPublicSerializeData));
+        for (const CPublicSerializeData &vch : vPool[nClass])
+            nUsage += memusage::MallocUsage(vch.capacity());
+    }
+    return nUsage;
+}
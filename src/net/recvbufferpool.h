@@ -0,0 +1,69 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_RECVBUFFERPOOL_H
+#define ECCOIN_RECVBUFFERPOOL_H
+
+#include "streams.h"
+#include "sync.h"
+
+#include <stddef.h>
+#include <vector>
+
+/** Keeps the buffers of received message payloads for reuse. Buffers come in size classes of
+ *  1, 4, 16, 64 and 256 KiB, a message gets one of the smallest class that holds it so reading
+ *  it in never reallocates. Payloads above the largest class start out with a buffer of that
+ *  class and grow as they arrive, like a peer that announces a large message and stalls can not
+ *  make us allocate more than that up front. Thread safe.
+ */
+class CRecvBufferPool
+{
+public:
+    static const size_t MIN_BUFFER_SIZE = 1024;
+    static const size_t NUM_CLASSES = 5;
+    static const size_t MAX_BUFFER_SIZE = MIN_BUFFER_SIZE << (2 * (NUM_CLASSES - 1));
+    //! the most every size class keeps around
+    static const size_t MAX_POOLED_BYTES_PER_CLASS = 2 * 1024 * 1024;
+
+    /** Put an empty buffer with room for nSize bytes, or MAX_BUFFER_SIZE if that is less, in
+     *  vch. What vch held before is dropped.
+     */
+    void Get(CPublicSerializeData &vch, size_t nSize);
+
+    /** Take back a buffer handed out by Get(), vch is left empty. Buffers that outgrew the
+     *  largest class are freed.
+     */
+    void Release(CPublicSerializeData &vch);
+
+    //! buffers handed out from the pool and newly allocated ones
+    void GetStats(uint64_t &nHitsOut, uint64_t &nMissesOut) const;
+    //! memory the buffers waiting in the pool take
+    size_t DynamicMemoryUsage() const;
+
+private:
+    mutable CCriticalSection cs;
+    std::vector<CPublicSerializeData> vPool[NUM_CLASSES];
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+
+    static size_t ClassSize(size_t nClass) { return MIN_BUFFER_SIZE << (2 * nClass); }
+};
+
+extern CRecvBufferPool recvBufferPool;
+
+#endif // ECCOIN_RECVBUFFERPOOL_H
@@ -0,0 +1,194 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/sendlanes.h"
+
+#include "net/protocol.h"
+
+#include <algorithm>
+#include <string.h>
+
+//! quanta per round of the lanes after the control lane, which always goes first
+static const int64_t SEND_LANE_WEIGHT[SEND_LANE_COUNT] = {0, 8, 2, 1};
+
+SendLane GetSendLane(const std::string &strCommand)
+{
+    const char *pszCommand = strCommand.c_str();
+    if (strcmp(pszCommand, NetMsgType::BLOCK) == 0 || strcmp(pszCommand, NetMsgType::CMPCTBLOCK) == 0 ||
+        strcmp(pszCommand, NetMsgType::BLOCKTXN) == 0 || strcmp(pszCommand, NetMsgType::HEADERS) == 0 ||
+        strcmp(pszCommand, NetMsgType::MERKLEBLOCK) == 0)
+    {
+        return SEND_LANE_BLOCK;
+    }
+    if (strcmp(pszCommand, NetMsgType::TX) == 0 || strcmp(pszCommand, NetMsgType::INV) == 0 ||
+        strcmp(pszCommand, NetMsgType::ADDR) == 0)
+    {
+        return SEND_LANE_TX;
+    }
+    if (strcmp(pszCommand, NetMsgType::CFILTER) == 0 || strcmp(pszCommand, NetMsgType::CFHEADERS) == 0 ||
+        strcmp(pszCommand, NetMsgType::CFCHECKPT) == 0)
+    {
+        return SEND_LANE_HISTORY;
+    }
+    return SEND_LANE_CONTROL;
+}
+
+const char *SendLaneName(SendLane lane)
+{
+    switch (lane)
+    {
+    case SEND_LANE_CONTROL:
+        return "control";
+    case SEND_LANE_BLOCK:
+        return "block";
+    case SEND_LANE_TX:
+        return "tx";
+    case SEND_LANE_HISTORY:
+        return "history";
+    default:
+        return "unknown";
+    }
+}
+
+CSendLanes::CSendLanes()
+    : nTotalBytes(0), nCurrent(SEND_LANE_BLOCK), fQuantumAdded(false), nHistoryTokens(0), nHistoryRefill(0)
+{
+    std::fill(nLaneBytes, nLaneBytes + SEND_LANE_COUNT, 0);
+    std::fill(nDeficit, nDeficit + SEND_LANE_COUNT, 0);
+}
+
+void CSendLanes::Push(SendLane lane, Buffer &&header, Buffer &&payload, size_t nSize)
+{
+    vLanes[lane].push_back(CQueuedMessage{std::move(header), std::move(payload), nSize});
+    nLaneBytes[lane] += nSize;
+    nTotalBytes += nSize;
+}
+
+bool CSendLanes::CanSend(int lane, int64_t nNowMicros, int64_t nHistoryRate)
+{
+    if (vLanes[lane].empty())
+    {
+        return false;
+    }
+    if (lane != SEND_LANE_HISTORY || nHistoryRate <= 0)
+    {
+        return true;
+    }
+    // refill, a second worth of tokens at most
+    if (nHistoryRefill == 0)
+    {
+        nHistoryTokens = nHistoryRate;
+    }
+    else if (nNowMicros > nHistoryRefill)
+    {
+        const int64_t nRefill = (nNowMicros - nHistoryRefill) * nHistoryRate / 1000000;
+        nHistoryTokens = std::min(nHistoryRate, nHistoryTokens + nRefill);
+    }
+    nHistoryRefill = std::max(nHistoryRefill, nNowMicros);
+    return nHistoryTokens > 0;
+}
+
+size_t CSendLanes::Move(int lane, std::deque<Buffer> &vSendMsg, std::shared_ptr<std::vector<uint8_t> > *coalesced)
+{
+    CQueuedMessage &msg = vLanes[lane].front();
+    const size_t nSize = msg.nSize;
+    if (coalesced && nSize <= SEND_COALESCE_MAX_MESSAGE)
+    {
+        // the buffer is only appended to while it is the last one queued and nothing of it was sent yet
+        if (!*coalesced || (*coalesced)->size() + nSize > SEND_COALESCE_BUFFER_SIZE)
+        {
+            *coalesced = std::make_shared<std::vector<uint8_t> >();
+            (*coalesced)->reserve(SEND_COALESCE_BUFFER_SIZE);
+            vSendMsg.push_back(*coalesced);
+        }
+        (*coalesced)->insert((*coalesced)->end(), msg.header->begin(), msg.header->end());
+        if (msg.payload)
+        {
+            (*coalesced)->insert((*coalesced)->end(), msg.payload->begin(), msg.payload->end());
+        }
+    }
+    else
+    {
+        if (coalesced)
+        {
+            coalesced->reset();
+        }
+        vSendMsg.push_back(std::move(msg.header));
+        if (msg.payload)
+        {
+            vSendMsg.push_back(std::move(msg.payload));
+        }
+    }
+    vLanes[lane].pop_front();
+    nLaneBytes[lane] -= nSize;
+    nTotalBytes -= nSize;
+    if (lane == SEND_LANE_HISTORY)
+    {
+        nHistoryTokens -= nSize;
+    }
+    return nSize;
+}
+
+void CSendLanes::Advance()
+{
+    nCurrent = nCurrent + 1 == SEND_LANE_COUNT ? SEND_LANE_BLOCK : nCurrent + 1;
+    fQuantumAdded = false;
+}
+
+size_t CSendLanes::Schedule(std::deque<Buffer> &vSendMsg,
+    int64_t nNowMicros,
+    int64_t nHistoryRate,
+    bool fCoalesce)
+{
+    size_t nMoved = 0;
+    std::shared_ptr<std::vector<uint8_t> > coalesced;
+    std::shared_ptr<std::vector<uint8_t> > *pcoalesced = fCoalesce ? &coalesced : nullptr;
+    while (nMoved < SEND_COMMIT_BYTES && nTotalBytes > 0)
+    {
+        // control messages are small and go between any two others
+        if (!vLanes[SEND_LANE_CONTROL].empty())
+        {
+            nMoved += Move(SEND_LANE_CONTROL, vSendMsg, pcoalesced);
+            continue;
+        }
+        bool fAny = false;
+        for (int lane = SEND_LANE_BLOCK; lane < SEND_LANE_COUNT; lane++)
+        {
+            fAny |= CanSend(lane, nNowMicros, nHistoryRate);
+        }
+        if (!fAny)
+        {
+            break;
+        }
+        if (!CanSend(nCurrent, nNowMicros, nHistoryRate))
+        {
+            // an empty lane does not save up for later
+            if (vLanes[nCurrent].empty())
+            {
+                nDeficit[nCurrent] = 0;
+            }
+            Advance();
+            continue;
+        }
+        if (!fQuantumAdded)
+        {
+            nDeficit[nCurrent] += SEND_LANE_WEIGHT[nCurrent] * SEND_LANE_QUANTUM;
+            fQuantumAdded = true;
+        }
+        const int64_t nSize = vLanes[nCurrent].front().nSize;
+        if (nSize > nDeficit[nCurrent])
+        {
+            Advance();
+            continue;
+        }
+        nDeficit[nCurrent] -= nSize;
+        nMoved += Move(nCurrent, vSendMsg, pcoalesced);
+        if (vLanes[nCurrent].empty())
+        {
+            nDeficit[nCurrent] = 0;
+            Advance();
+        }
+    }
+    return nMoved;
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_SENDLANES_H
+#define ECCOIN_SENDLANES_H
+
+#include <deque>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** The queues a message to a peer can wait in, see CSendLanes */
+enum SendLane
+{
+    //! small protocol messages: version, ping, getdata, getheaders, ...
+    SEND_LANE_CONTROL,
+    //! blocks, compact blocks and headers near the tip
+    SEND_LANE_BLOCK,
+    //! transactions, inv and addr
+    SEND_LANE_TX,
+    //! blocks more than a week old served to peers that sync
+    SEND_LANE_HISTORY,
+    SEND_LANE_COUNT
+};
+
+/** Bytes a lane may send per round of the scheduler for each unit of its weight */
+static const int64_t SEND_LANE_QUANTUM = 16 * 1024;
+/** Bytes the scheduler moves from the lanes to the socket queue at a time. This many bytes of lower priority
+ *  messages can be ahead of a new block. */
+static const size_t SEND_COMMIT_BYTES = 64 * 1024;
+/** Messages up to this size are copied into a shared buffer with the ones next to them when Schedule coalesces,
+ *  a burst of inv and ping messages then goes out of one buffer instead of two for each */
+static const size_t SEND_COALESCE_MAX_MESSAGE = 1024;
+/** Bytes a coalescing buffer takes at most */
+static const size_t SEND_COALESCE_BUFFER_SIZE = 16 * 1024;
+/** -maxhistoryuploadrate default, 0 = no limit */
+static const int64_t DEFAULT_MAX_HISTORY_UPLOAD_RATE = 0;
+
+//! The lane of a message with this command when the sender does not pick one
+SendLane GetSendLane(const std::string &strCommand);
+const char *SendLaneName(SendLane lane);
+
+/** The messages queued for a peer, one queue per SendLane. Schedule moves whole messages to the queue the socket
+ *  sends from: control messages first, the other lanes by deficit round robin with blocks weighted over
+ *  transactions and history. The history lane can be limited to a rate in bytes per second on its own, a peer
+ *  syncing old blocks then does not take the upload from relay. Guarded by cs_vSend of its node.
+ */
+class CSendLanes
+{
+public:
+    typedef std::shared_ptr<const std::vector<uint8_t> > Buffer;
+
+    CSendLanes();
+
+    //! Queue a message, payload may be null for messages without one
+    void Push(SendLane lane, Buffer &&header, Buffer &&payload, size_t nSize);
+    /** Move messages to vSendMsg until SEND_COMMIT_BYTES are moved or no lane can send. nHistoryRate is in bytes
+     *  per second, 0 for no limit. With fCoalesce the messages of up to SEND_COALESCE_MAX_MESSAGE bytes that are
+     *  moved one after the other are copied into one buffer. Returns the bytes moved.
+     */
+    size_t Schedule(std::deque<Buffer> &vSendMsg, int64_t nNowMicros, int64_t nHistoryRate, bool fCoalesce = false);
+
+    bool empty() const { return nTotalBytes == 0; }
+    //! bytes queued in all lanes
+    size_t size() const { return nTotalBytes; }
+    size_t LaneSize(SendLane lane) const { return nLaneBytes[lane]; }
+
+    template <typename Callable>
+    void ForEachBuffer(Callable &&func) const
+    {
+        for (const auto &lane : vLanes)
+        {
+            for (const CQueuedMessage &msg : lane)
+            {
+                func(msg.header);
+                if (msg.payload)
+                    func(msg.payload);
+            }
+        }
+    }
+
+private:
+    struct CQueuedMessage
+    {
+        Buffer header;
+        Buffer payload;
+        size_t nSize;
+    };
+
+    std::deque<CQueuedMessage> vLanes[SEND_LANE_COUNT];
+    size_t nLaneBytes[SEND_LANE_COUNT];
+    size_t nTotalBytes;
+    int64_t nDeficit[SEND_LANE_COUNT];
+    //! the lane the round robin is at, and whether it got its quantum for this round yet
+    int nCurrent;
+    bool fQuantumAdded;
+    //! token bucket of the history lane, it may go into debt by one message
+    int64_t nHistoryTokens;
+    int64_t nHistoryRefill;
+
+    bool CanSend(int lane, int64_t nNowMicros, int64_t nHistoryRate);
+    //! coalesced is the buffer small messages are appended to, null to start a new one
+    size_t Move(int lane, std::deque<Buffer> &vSendMsg, std::shared_ptr<std::vector<uint8_t> > *coalesced);
+    void Advance();
+};
+
+#endif // ECCOIN_SENDLANES_H
@@ -0,0 +1,264 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2009-2010 Satoshi Nakamoto
+ * Copyright (c) 2009-2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net/socketevents.h"
+
+#include "net/netbase.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+CSocketEvents::CSocketEvents()
+{
+#if defined(USE_EPOLL)
+    fdEvents = epoll_create1(EPOLL_CLOEXEC);
+    if (fdEvents < 0)
+        LogPrintf("%s: epoll_create1 failed: %s\n", __func__, NetworkErrorString(errno));
+#elif defined(USE_KQUEUE)
+    fdEvents = kqueue();
+    if (fdEvents < 0)
+        LogPrintf("%s: kqueue failed: %s\n", __func__, NetworkErrorString(errno));
+#endif
+}
+
+CSocketEvents::~CSocketEvents()
+{
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    if (fdEvents >= 0)
+        close(fdEvents);
+#endif
+}
+
+bool CSocketEvents::IsSupported(SOCKET hSocket)
+{
+#if (defined(USE_EPOLL) || defined(USE_KQUEUE)) && defined(HAVE_POLL_H)
+    return true;
+#else
+    return IsSelectableSocket(hSocket);
+#endif
+}
+
+#if defined(USE_EPOLL)
+void CSocketEvents::Update(SOCKET hSocket, uint8_t nOldInterest, uint8_t nInterest, bool fNew, bool fRemove)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.data.fd = hSocket;
+    // errors and hangups are always reported
+    event.events = ((nInterest & RECV) ? (uint32_t)EPOLLIN : 0) | ((nInterest & SEND) ? (uint32_t)EPOLLOUT : 0);
+    if (fRemove)
+    {
+        // fails harmlessly when the socket is closed already, which removed it
+        epoll_ctl(fdEvents, EPOLL_CTL_DEL, hSocket, &event);
+        return;
+    }
+    if (epoll_ctl(fdEvents, fNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, hSocket, &event) == 0)
+        return;
+    // a closed descriptor leaves the set by itself, so when it gets reused our view and the
+    // kernel's can disagree about whether it is registered
+    if (errno == EEXIST)
+        epoll_ctl(fdEvents, EPOLL_CTL_MOD, hSocket, &event);
+    else if (errno == ENOENT)
+        epoll_ctl(fdEvents, EPOLL_CTL_ADD, hSocket, &event);
+}
+#elif defined(USE_KQUEUE)
+void CSocketEvents::Update(SOCKET hSocket, uint8_t nOldInterest, uint8_t nInterest, bool fNew, bool fRemove)
+{
+    if (fRemove)
+        nInterest = NONE;
+    struct kevent changes[2];
+    int nChanges = 0;
+    // read and write are separate filters, only submit the ones that change. Deleting a filter
+    // that is gone already fails harmlessly, kevent reports that as an error we ignore
+    if ((nInterest & RECV) && (fNew || !(nOldInterest & RECV)))
+        EV_SET(&changes[nChanges++], hSocket, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+    else if (!(nInterest & RECV) && (fRemove || (nOldInterest & RECV)))
+        EV_SET(&changes[nChanges++], hSocket, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    if ((nInterest & SEND) && (fNew || !(nOldInterest & SEND)))
+        EV_SET(&changes[nChanges++], hSocket, EVFILT_WRITE, EV_ADD, 0, 0, nullptr);
+    else if (!(nInterest & SEND) && (fRemove || (nOldInterest & SEND)))
+        EV_SET(&changes[nChanges++], hSocket, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+    for (int i = 0; i < nChanges; i++)
+        kevent(fdEvents, &changes[i], 1, nullptr, 0, nullptr);
+}
+#endif
+
+void CSocketEvents::Set(SOCKET hSocket, int64_t nOwner, uint8_t nInterest)
+{
+    auto it = mapSockets.find(hSocket);
+    if (it == mapSockets.end() || it->second.nOwner != nOwner)
+    {
+        // a new socket, or a descriptor that was closed and reused by someone else, which took
+        // the old registration with it
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+        Update(hSocket, NONE, nInterest, true, false);
+#endif
+        CEntry &entry = mapSockets[hSocket];
+        entry.nOwner = nOwner;
+        entry.nInterest = nInterest;
+        entry.fSeen = true;
+        return;
+    }
+    CEntry &entry = it->second;
+    if (entry.nInterest != nInterest)
+    {
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+        Update(hSocket, entry.nInterest, nInterest, false, false);
+#endif
+        entry.nInterest = nInterest;
+    }
+    entry.fSeen = true;
+}
+
+bool CSocketEvents::Wait(int64_t nTimeoutMs)
+{
+    // forget the sockets nobody asked about this round
+    for (auto it = mapSockets.begin(); it != mapSockets.end();)
+    {
+        if (!it->second.fSeen)
+        {
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+            Update(it->first, it->second.nInterest, NONE, false, true);
+#endif
+            it = mapSockets.erase(it);
+            continue;
+        }
+        it->second.fSeen = false;
+        ++it;
+    }
+    mapReady.clear();
+
+    int nReady;
+#if defined(USE_EPOLL)
+    std::vector<struct epoll_event> events(std::max<size_t>(mapSockets.size(), 1));
+    nReady = epoll_wait(fdEvents, events.data(), events.size(), nTimeoutMs);
+    for (int i = 0; i < nReady; i++)
+    {
+        uint8_t nFlags = NONE;
+        if (events[i].events & EPOLLIN)
+            nFlags |= RECV;
+        if (events[i].events & EPOLLOUT)
+            nFlags |= SEND;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            nFlags |= ERR;
+        mapReady[events[i].data.fd] |= nFlags;
+    }
+#elif defined(USE_KQUEUE)
+    std::vector<struct kevent> events(std::max<size_t>(2 * mapSockets.size(), 1));
+    struct timespec timeout;
+    timeout.tv_sec = nTimeoutMs / 1000;
+    timeout.tv_nsec = (nTimeoutMs % 1000) * 1000000;
+    nReady = kevent(fdEvents, nullptr, 0, events.data(), events.size(), &timeout);
+    for (int i = 0; i < nReady; i++)
+    {
+        uint8_t nFlags = NONE;
+        if (events[i].flags & EV_ERROR)
+            nFlags |= ERR;
+        else if (events[i].filter == EVFILT_READ)
+            nFlags |= RECV;
+        else if (events[i].filter == EVFILT_WRITE)
+            nFlags |= SEND;
+        mapReady[(SOCKET)events[i].ident] |= nFlags;
+    }
+#else
+    struct timeval timeout = MillisToTimeval(nTimeoutMs);
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    for (const auto &socket : mapSockets)
+    {
+        FD_SET(socket.first, &fdsetError);
+        if (socket.second.nInterest & RECV)
+            FD_SET(socket.first, &fdsetRecv);
+        if (socket.second.nInterest & SEND)
+            FD_SET(socket.first, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, socket.first);
+    }
+    nReady = select(mapSockets.empty() ? 0 : hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (nReady > 0)
+    {
+        for (const auto &socket : mapSockets)
+        {
+            uint8_t nFlags = NONE;
+            if (FD_ISSET(socket.first, &fdsetRecv))
+                nFlags |= RECV;
+            if (FD_ISSET(socket.first, &fdsetSend))
+                nFlags |= SEND;
+            if (FD_ISSET(socket.first, &fdsetError))
+                nFlags |= ERR;
+            if (nFlags != NONE)
+                mapReady[socket.first] = nFlags;
+        }
+    }
+#endif
+
+    if (nReady < 0)
+    {
+        if (!mapSockets.empty())
+        {
+            LogPrintf("socket select error %s\n", NetworkErrorString(WSAGetLastError()));
+            for (const auto &socket : mapSockets)
+                mapReady[socket.first] = RECV;
+        }
+        return false;
+    }
+    return true;
+}
+
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeoutMs)
+{
+#ifdef HAVE_POLL_H
+    struct pollfd pfd;
+    pfd.fd = hSocket;
+    pfd.events = fWrite ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    int nRet = poll(&pfd, 1, nTimeoutMs);
+    return nRet < 0 ? SOCKET_ERROR : nRet;
+#else
+    if (!IsSelectableSocket(hSocket))
+        return SOCKET_ERROR;
+    struct timeval timeout = MillisToTimeval(nTimeoutMs);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(hSocket, &fdset);
+    return select(hSocket + 1, fWrite ? nullptr : &fdset, fWrite ? &fdset : nullptr, nullptr, &timeout);
+#endif
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2009-2010 Satoshi Nakamoto
+ * Copyright (c) 2009-2016 The Bitcoin Core developers
+ * Copyright (c) 2014-2018 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ECCOIN_SOCKETEVENTS_H
+#define ECCOIN_SOCKETEVENTS_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "compat.h"
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#if defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#elif defined(HAVE_SYS_EVENT_H)
+#define USE_KQUEUE
+#endif
+
+/** Waits for sockets to become ready. Registrations persist between waits, every round the
+ *  caller states what it wants from each socket with Set() and only the sockets whose wishes
+ *  changed cost a system call. Sockets that were not Set() in a round are dropped before the
+ *  next wait. Uses epoll on Linux, kqueue on the BSDs and macOS and select() everywhere else,
+ *  chosen when building. Not thread safe.
+ */
+class CSocketEvents
+{
+public:
+    static const uint8_t NONE = 0;
+    static const uint8_t RECV = 1;
+    static const uint8_t SEND = 2;
+    static const uint8_t ERR = 4;
+
+    CSocketEvents();
+    ~CSocketEvents();
+    CSocketEvents(const CSocketEvents &) = delete;
+    CSocketEvents &operator=(const CSocketEvents &) = delete;
+
+    /** Wait for RECV and/or SEND on hSocket, errors are always reported. nOwner tells apart
+     *  sockets that got the same descriptor after the previous owner closed it.
+     */
+    void Set(SOCKET hSocket, int64_t nOwner, uint8_t nInterest);
+
+    /** Wait until a socket is ready or nTimeoutMs passed. Returns false if the wait failed,
+     *  in which case every socket is reported readable so the callers notice what broke.
+     */
+    bool Wait(int64_t nTimeoutMs);
+
+    /** What hSocket was found ready for by the last Wait() */
+    uint8_t Ready(SOCKET hSocket) const
+    {
+        auto it = mapReady.find(hSocket);
+        return it == mapReady.end() ? NONE : it->second;
+    }
+
+    /** Whether this backend can wait on hSocket, select() only takes descriptors below FD_SETSIZE */
+    static bool IsSupported(SOCKET hSocket);
+
+private:
+    struct CEntry
+    {
+        int64_t nOwner;
+        uint8_t nInterest;
+        //! whether the socket was Set() since the last wait
+        bool fSeen;
+    };
+
+    std::unordered_map<SOCKET, CEntry> mapSockets;
+    std::unordered_map<SOCKET, uint8_t> mapReady;
+
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    int fdEvents;
+    //! register, change or drop (nInterest NONE with fRemove) the kernel side of a socket
+    void Update(SOCKET hSocket, uint8_t nOldInterest, uint8_t nInterest, bool fNew, bool fRemove);
+#endif
+};
+
+/** Wait up to nTimeoutMs for hSocket to become readable, or writable if fWrite is set. Returns
+ *  1 when it is ready, 0 on timeout and SOCKET_ERROR on failure, like select() on one socket.
+ *  Uses poll() where available so it takes descriptors at or above FD_SETSIZE.
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeoutMs);
+
+#endif // ECCOIN_SOCKETEVENTS_H
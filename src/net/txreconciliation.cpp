@@ -0,0 +1,270 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/txreconciliation.h"
+
+#include "crypto/common.h"
+#include "crypto/hash.h"
+#include "crypto/sha256.h"
+#include "random.h"
+#include "util/logger.h"
+
+#include <algorithm>
+#include <limits>
+
+CTxReconciliationTracker txreconciliation;
+
+static const char RECON_SALT_TAG[] = "Eccoin tx reconciliation salt";
+
+void CTxReconciliationTracker::DeriveKeys(uint64_t nSalt1, uint64_t nSalt2, uint64_t &k0, uint64_t &k1)
+{
+    // both sides hash the salts in the same order, the smaller one first
+    uint8_t vSalts[16];
+    WriteLE64(vSalts, std::min(nSalt1, nSalt2));
+    WriteLE64(vSalts + 8, std::max(nSalt1, nSalt2));
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    CSHA256()
+        .Write((const uint8_t *)RECON_SALT_TAG, sizeof(RECON_SALT_TAG) - 1)
+        .Write(vSalts, sizeof(vSalts))
+        .Finalize(hash);
+    k0 = ReadLE64(hash);
+    k1 = ReadLE64(hash + 8);
+}
+
+uint32_t CTxReconciliationTracker::ComputeCapacity(size_t nLocal, size_t nRemote, uint16_t nQ)
+{
+    const uint64_t nDiff = nLocal > nRemote ? nLocal - nRemote : nRemote - nLocal;
+    const uint64_t nCapacity = nDiff + (uint64_t)nQ * std::min(nLocal, nRemote) / RECON_Q_PRECISION + 1;
+    return (uint32_t)std::min<uint64_t>(nCapacity, MAX_SKETCH_CAPACITY);
+}
+
+uint32_t CTxReconciliationTracker::GetShortID(const CPeerRecon &recon, const uint256 &txid)
+{
+    return 1 + (uint32_t)(SipHashUint256(recon.k0, recon.k1, txid) % 0xffffffff);
+}
+
+void CTxReconciliationTracker::TakeAll(std::map<uint32_t, uint256> &mapFrom, std::vector<uint256> &vTo)
+{
+    for (const auto &item : mapFrom)
+        vTo.push_back(item.second);
+    mapFrom.clear();
+}
+
+uint64_t CTxReconciliationTracker::PreRegister(NodeId peer)
+{
+    const uint64_t nSalt = GetRand(std::numeric_limits<uint64_t>::max());
+    LOCK(cs_txreconciliation);
+    mapPeers[peer].nLocalSalt = nSalt;
+    return nSalt;
+}
+
+bool CTxReconciliationTracker::Register(NodeId peer, bool fInbound, uint32_t nVersion, uint64_t nRemoteSalt)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || it->second.fRegistered || nVersion < 1)
+        return false;
+    CPeerRecon &recon = it->second;
+
+    DeriveKeys(recon.nLocalSalt, nRemoteSalt, recon.k0, recon.k1);
+    recon.fRegistered = true;
+    recon.fInitiator = !fInbound;
+    if (!fInbound && nFloodOutbound < RECON_FLOOD_OUTBOUND)
+    {
+        recon.fFlood = true;
+        nFloodOutbound++;
+    }
+    return true;
+}
+
+void CTxReconciliationTracker::ForgetPeer(NodeId peer)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end())
+        return;
+    if (it->second.fFlood)
+        nFloodOutbound--;
+    mapPeers.erase(it);
+}
+
+bool CTxReconciliationTracker::IsRegistered(NodeId peer) const
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::const_iterator it = mapPeers.find(peer);
+    return it != mapPeers.end() && it->second.fRegistered;
+}
+
+bool CTxReconciliationTracker::ShouldFlood(NodeId peer) const
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::const_iterator it = mapPeers.find(peer);
+    return it == mapPeers.end() || !it->second.fRegistered || it->second.fFlood;
+}
+
+bool CTxReconciliationTracker::AddToSet(NodeId peer, const uint256 &txid)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fRegistered)
+        return false;
+    CPeerRecon &recon = it->second;
+    if (recon.mapSet.size() >= MAX_RECON_SET_SIZE)
+        return false;
+    std::pair<std::map<uint32_t, uint256>::iterator, bool> ret =
+        recon.mapSet.emplace(GetShortID(recon, txid), txid);
+    return ret.second || ret.first->second == txid;
+}
+
+void CTxReconciliationTracker::RemoveFromSet(NodeId peer, const uint256 &txid)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fRegistered)
+        return;
+    CPeerRecon &recon = it->second;
+    std::map<uint32_t, uint256>::iterator itTx = recon.mapSet.find(GetShortID(recon, txid));
+    if (itTx != recon.mapSet.end() && itTx->second == txid)
+        recon.mapSet.erase(itTx);
+}
+
+size_t CTxReconciliationTracker::GetSetSize(NodeId peer) const
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::const_iterator it = mapPeers.find(peer);
+    return it == mapPeers.end() ? 0 : it->second.mapSet.size();
+}
+
+bool CTxReconciliationTracker::GetRequest(NodeId peer, int64_t nNow, uint16_t &nSetSize, uint16_t &nQ)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fRegistered || !it->second.fInitiator)
+        return false;
+    CPeerRecon &recon = it->second;
+    if (recon.fRequested)
+    {
+        if (nNow <= recon.nRequestTime + RECON_RESPONSE_TIMEOUT)
+            return false;
+        // the set stays for the next round
+        recon.fRequested = false;
+    }
+    if (nNow < recon.nNextRequest)
+        return false;
+    nSetSize = (uint16_t)std::min<size_t>(recon.mapSet.size(), std::numeric_limits<uint16_t>::max());
+    nQ = RECON_Q;
+    recon.fRequested = true;
+    recon.nRequestTime = nNow;
+    recon.nNextRequest = nNow + RECON_REQUEST_INTERVAL;
+    return true;
+}
+
+bool CTxReconciliationTracker::HandleRequest(NodeId peer,
+    uint16_t nRemoteSetSize,
+    uint16_t nQ,
+    int64_t nNow,
+    std::vector<uint8_t> &vSketch,
+    std::vector<uint256> &vAnnounce)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fRegistered || it->second.fInitiator || nQ > RECON_Q_PRECISION)
+        return false;
+    CPeerRecon &recon = it->second;
+    if (recon.fResponded)
+        TakeAll(recon.mapSnapshot, vAnnounce);
+
+    recon.mapSnapshot.swap(recon.mapSet);
+    recon.mapSet.clear();
+    CTxSketch sketch(ComputeCapacity(recon.mapSnapshot.size(), nRemoteSetSize, nQ));
+    for (const auto &item : recon.mapSnapshot)
+        sketch.Add(item.first);
+    vSketch = sketch.Serialize();
+    recon.fResponded = true;
+    recon.nResponseTime = nNow;
+    return true;
+}
+
+bool CTxReconciliationTracker::HandleSketch(NodeId peer,
+    const std::vector<uint8_t> &vSketch,
+    std::vector<uint256> &vAnnounce,
+    std::vector<uint32_t> &vAsk,
+    bool &fSuccess)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fRegistered || !it->second.fRequested)
+        return false;
+    CPeerRecon &recon = it->second;
+    CTxSketch remote;
+    if (vSketch.empty() || vSketch.size() > 4 * MAX_SKETCH_CAPACITY || !remote.Deserialize(vSketch))
+        return false;
+    recon.fRequested = false;
+
+    // what was added since the request is in the difference too, and is announced with the rest
+    CTxSketch local(remote.GetCapacity());
+    for (const auto &item : recon.mapSet)
+        local.Add(item.first);
+    local.Merge(remote);
+    std::vector<uint32_t> vDiff;
+    fSuccess = local.Decode(vDiff);
+    if (!fSuccess)
+    {
+        LogPrint(Logging::NET, "reconciliation with peer=%d failed, announcing %u transactions\n", peer,
+            recon.mapSet.size());
+        TakeAll(recon.mapSet, vAnnounce);
+        return true;
+    }
+    for (uint32_t nShortID : vDiff)
+    {
+        std::map<uint32_t, uint256>::const_iterator itTx = recon.mapSet.find(nShortID);
+        if (itTx != recon.mapSet.end())
+            vAnnounce.push_back(itTx->second);
+        else
+            vAsk.push_back(nShortID);
+    }
+    // the rest of the set the peer has already
+    recon.mapSet.clear();
+    return true;
+}
+
+bool CTxReconciliationTracker::HandleDiff(NodeId peer,
+    bool fSuccess,
+    const std::vector<uint32_t> &vAsk,
+    std::vector<uint256> &vAnnounce)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fRegistered || !it->second.fResponded ||
+        vAsk.size() > MAX_SKETCH_CAPACITY)
+        return false;
+    CPeerRecon &recon = it->second;
+    recon.fResponded = false;
+    if (!fSuccess)
+    {
+        TakeAll(recon.mapSnapshot, vAnnounce);
+        return true;
+    }
+    for (uint32_t nShortID : vAsk)
+    {
+        std::map<uint32_t, uint256>::const_iterator itTx = recon.mapSnapshot.find(nShortID);
+        if (itTx != recon.mapSnapshot.end())
+            vAnnounce.push_back(itTx->second);
+    }
+    recon.mapSnapshot.clear();
+    return true;
+}
+
+void CTxReconciliationTracker::ExpireResponse(NodeId peer, int64_t nNow, std::vector<uint256> &vAnnounce)
+{
+    LOCK(cs_txreconciliation);
+    std::map<NodeId, CPeerRecon>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fResponded)
+        return;
+    CPeerRecon &recon = it->second;
+    if (nNow <= recon.nResponseTime + RECON_RESPONSE_TIMEOUT)
+        return;
+    recon.fResponded = false;
+    TakeAll(recon.mapSnapshot, vAnnounce);
+}
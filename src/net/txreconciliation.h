@@ -0,0 +1,135 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_TXRECONCILIATION_H
+#define ECCOIN_TXRECONCILIATION_H
+
+#include "net/net.h"
+#include "net/txsketch.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+/** -txreconciliation default */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** The version of the reconciliation protocol sent in sendtxrcncl */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Outbound peers that reconcile and are still sent every transaction as an inv right away */
+static const int RECON_FLOOD_OUTBOUND = 2;
+/** Microseconds between two reconciliations the node starts with an outbound peer */
+static const int64_t RECON_REQUEST_INTERVAL = 8 * 1000000;
+/** Microseconds a reconciliation may take before the node gives up on it and announces its set */
+static const int64_t RECON_RESPONSE_TIMEOUT = 30 * 1000000;
+/** Transactions waiting to be reconciled with a peer, more are flooded to it */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** The largest sketch asked for or accepted, decoding takes time quadratic in it */
+static const uint32_t MAX_SKETCH_CAPACITY = 128;
+/** q, the share of the smaller set expected to differ beyond the difference of the set sizes, as sent in reqrecon
+ *  in units of 1 / RECON_Q_PRECISION */
+static const uint16_t RECON_Q = 8192;
+static const uint32_t RECON_Q_PRECISION = 32767;
+
+/** Transaction relay by set reconciliation in the way of Erlay. Peers that both sent sendtxrcncl do not announce
+ *  every transaction to each other, each keeps the set it would have announced. The side that opened the
+ *  connection asks for a sketch of the set of the other side every RECON_REQUEST_INTERVAL, merges it with the
+ *  sketch of its own to learn the difference, announces what the other side lacks and asks for what it lacks
+ *  itself in reconcildiff, by the 32 bit short ids both sides compute with the salts they exchanged. When the
+ *  difference is too large to decode both sides announce their whole set. A few outbound peers are still flooded
+ *  so transactions keep spreading fast. Has its own lock, callers do not need cs_main.
+ */
+class CTxReconciliationTracker
+{
+public:
+    CTxReconciliationTracker() : nFloodOutbound(0) {}
+
+    /** The salt to send peer in sendtxrcncl, the peer reconciles once its own arrives */
+    uint64_t PreRegister(NodeId peer);
+    /** peer sent sendtxrcncl, false if it was not expected or came twice */
+    bool Register(NodeId peer, bool fInbound, uint32_t nVersion, uint64_t nRemoteSalt);
+    void ForgetPeer(NodeId peer);
+    bool IsRegistered(NodeId peer) const;
+    //! whether transactions for peer go out as inv right away, it is not registered or one of the flooded ones
+    bool ShouldFlood(NodeId peer) const;
+
+    /** Keep txid for the next reconciliation with peer instead of announcing it, false when the set is full or
+     *  another transaction in it has the same short id
+     */
+    bool AddToSet(NodeId peer, const uint256 &txid);
+    //! peer announced txid, it does not have to be reconciled
+    void RemoveFromSet(NodeId peer, const uint256 &txid);
+    size_t GetSetSize(NodeId peer) const;
+
+    /** Whether to send peer a reqrecon now, with the size of our set and q. The node only asks the peers it
+     *  connected to, one reconciliation at a time. A request without an answer is given up after
+     *  RECON_RESPONSE_TIMEOUT.
+     */
+    bool GetRequest(NodeId peer, int64_t nNow, uint16_t &nSetSize, uint16_t &nQ);
+    /** peer sent a reqrecon, vSketch is the sketch of our set to answer with. The set is kept aside until the
+     *  reconcildiff, what was kept from a round that did not finish goes to vAnnounce. False if the peer should
+     *  not have asked.
+     */
+    bool HandleRequest(NodeId peer,
+        uint16_t nRemoteSetSize,
+        uint16_t nQ,
+        int64_t nNow,
+        std::vector<uint8_t> &vSketch,
+        std::vector<uint256> &vAnnounce);
+    /** peer answered our reqrecon with vSketch. vAnnounce gets the transactions it lacks, vAsk the short ids of
+     *  the ones we lack and fSuccess whether the difference could be decoded, those go to it in reconcildiff.
+     *  False if the sketch was not asked for or is too large.
+     */
+    bool HandleSketch(NodeId peer,
+        const std::vector<uint8_t> &vSketch,
+        std::vector<uint256> &vAnnounce,
+        std::vector<uint32_t> &vAsk,
+        bool &fSuccess);
+    /** peer sent the reconcildiff of the round it asked for, vAnnounce gets the transactions of the set kept
+     *  aside that it asked for, or all of them if the difference could not be decoded. False if there was no
+     *  round.
+     */
+    bool HandleDiff(NodeId peer, bool fSuccess, const std::vector<uint32_t> &vAsk, std::vector<uint256> &vAnnounce);
+    //! the set kept aside for a reconcildiff that did not come in RECON_RESPONSE_TIMEOUT goes to vAnnounce
+    void ExpireResponse(NodeId peer, int64_t nNow, std::vector<uint256> &vAnnounce);
+
+    //! the capacity of the sketch for sets of nLocal and nRemote transactions
+    static uint32_t ComputeCapacity(size_t nLocal, size_t nRemote, uint16_t nQ);
+
+private:
+    struct CPeerRecon
+    {
+        uint64_t nLocalSalt;
+        bool fRegistered = false;
+        //! we opened the connection, we start the reconciliations
+        bool fInitiator = false;
+        bool fFlood = false;
+        uint64_t k0 = 0;
+        uint64_t k1 = 0;
+        //! the transactions to reconcile by short id
+        std::map<uint32_t, uint256> mapSet;
+        //! initiator: the reqrecon that was not answered yet
+        bool fRequested = false;
+        int64_t nRequestTime = 0;
+        int64_t nNextRequest = 0;
+        //! responder: the set a sketch was sent for, until the reconcildiff comes
+        bool fResponded = false;
+        int64_t nResponseTime = 0;
+        std::map<uint32_t, uint256> mapSnapshot;
+    };
+
+    mutable CCriticalSection cs_txreconciliation;
+    std::map<NodeId, CPeerRecon> mapPeers GUARDED_BY(cs_txreconciliation);
+    int nFloodOutbound GUARDED_BY(cs_txreconciliation);
+
+    //! the SipHash keys of a connection whose salts are nSalt1 and nSalt2, the same on both sides
+    static void DeriveKeys(uint64_t nSalt1, uint64_t nSalt2, uint64_t &k0, uint64_t &k1);
+    //! the nonzero 32 bit id of txid in the sketches of the connection
+    static uint32_t GetShortID(const CPeerRecon &recon, const uint256 &txid);
+    static void TakeAll(std::map<uint32_t, uint256> &mapFrom, std::vector<uint256> &vTo);
+};
+
+extern CTxReconciliationTracker txreconciliation;
+
+#endif // ECCOIN_TXRECONCILIATION_H
@@ -0,0 +1,252 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/txrequest.h"
+
+#include <algorithm>
+
+CTxRequestTracker txrequest;
+
+void CTxRequestTracker::ReceivedInv(NodeId peer, const uint256 &txhash, bool fPreferred, int64_t nReqTime)
+{
+    LOCK(cs_txrequest);
+    const std::pair<NodeId, uint256> key(peer, txhash);
+    if (mapAnnouncements.count(key))
+    {
+        return;
+    }
+    CPeerInfo &peerinfo = mapPeerInfo[peer];
+    if (peerinfo.nTotal >= MAX_PEER_TX_ANNOUNCEMENTS)
+    {
+        return;
+    }
+    CAnnouncement ann;
+    ann.state = DELAYED;
+    ann.fPreferred = fPreferred;
+    ann.nTime = nReqTime;
+    ann.nSequence = nNextSequence++;
+    mapAnnouncements.emplace(key, ann);
+    peerinfo.nTotal++;
+    CTxInfo &info = mapTxInfo[txhash];
+    info.vPeers.push_back(peer);
+    info.nPending++;
+    setDelayed.insert(std::make_pair(nReqTime, key));
+}
+
+void CTxRequestTracker::Unlink(AnnouncementMap::iterator it)
+{
+    const NodeId peer = it->first.first;
+    const uint256 &txhash = it->first.second;
+    CAnnouncement &ann = it->second;
+    CTxInfo &info = mapTxInfo[txhash];
+    switch (ann.state)
+    {
+    case DELAYED:
+        setDelayed.erase(std::make_pair(ann.nTime, it->first));
+        break;
+    case READY:
+        info.setReady.erase(std::make_pair(ann.Priority(), peer));
+        if (info.best == peer)
+        {
+            mapPeerInfo[peer].setBest.erase(std::make_pair(ann.nSequence, txhash));
+            info.best = -1;
+        }
+        break;
+    case REQUESTED:
+        setExpiry.erase(std::make_pair(ann.nTime, it->first));
+        info.requested = -1;
+        mapPeerInfo[peer].nRequested--;
+        break;
+    case COMPLETED:
+        break;
+    }
+}
+
+void CTxRequestTracker::MakeReady(AnnouncementMap::iterator it)
+{
+    Unlink(it);
+    it->second.state = READY;
+    CTxInfo &info = mapTxInfo[it->first.second];
+    info.setReady.insert(std::make_pair(it->second.Priority(), it->first.first));
+    UpdateBest(it->first.second, info);
+}
+
+void CTxRequestTracker::Complete(AnnouncementMap::iterator it)
+{
+    if (it->second.state == COMPLETED)
+    {
+        return;
+    }
+    Unlink(it);
+    it->second.state = COMPLETED;
+    CTxInfo &info = mapTxInfo[it->first.second];
+    info.nPending--;
+    UpdateBest(it->first.second, info);
+}
+
+void CTxRequestTracker::UpdateBest(const uint256 &txhash, CTxInfo &info)
+{
+    const NodeId best = (info.requested == -1 && !info.setReady.empty()) ? info.setReady.begin()->second : -1;
+    if (best == info.best)
+    {
+        return;
+    }
+    if (info.best != -1)
+    {
+        const CAnnouncement &ann = mapAnnouncements[std::make_pair(info.best, txhash)];
+        mapPeerInfo[info.best].setBest.erase(std::make_pair(ann.nSequence, txhash));
+    }
+    if (best != -1)
+    {
+        const CAnnouncement &ann = mapAnnouncements[std::make_pair(best, txhash)];
+        mapPeerInfo[best].setBest.insert(std::make_pair(ann.nSequence, txhash));
+    }
+    info.best = best;
+}
+
+void CTxRequestTracker::EraseIfDone(const uint256 &txhash)
+{
+    auto it = mapTxInfo.find(txhash);
+    if (it != mapTxInfo.end() && it->second.nPending == 0)
+    {
+        EraseTxHash(txhash);
+    }
+}
+
+void CTxRequestTracker::EraseTxHash(const uint256 &txhash)
+{
+    auto infoit = mapTxInfo.find(txhash);
+    if (infoit == mapTxInfo.end())
+    {
+        return;
+    }
+    for (const NodeId peer : infoit->second.vPeers)
+    {
+        auto it = mapAnnouncements.find(std::make_pair(peer, txhash));
+        Unlink(it);
+        mapAnnouncements.erase(it);
+        auto peerit = mapPeerInfo.find(peer);
+        if (--peerit->second.nTotal == 0)
+        {
+            mapPeerInfo.erase(peerit);
+        }
+    }
+    mapTxInfo.erase(infoit);
+}
+
+void CTxRequestTracker::PromoteAndExpire(int64_t nNow)
+{
+    while (!setDelayed.empty() && setDelayed.begin()->first <= nNow)
+    {
+        MakeReady(mapAnnouncements.find(setDelayed.begin()->second));
+    }
+    while (!setExpiry.empty() && setExpiry.begin()->first <= nNow)
+    {
+        const uint256 txhash = setExpiry.begin()->second.second;
+        Complete(mapAnnouncements.find(setExpiry.begin()->second));
+        EraseIfDone(txhash);
+    }
+}
+
+std::vector<uint256> CTxRequestTracker::GetRequestable(NodeId peer, int64_t nNow)
+{
+    LOCK(cs_txrequest);
+    PromoteAndExpire(nNow);
+    std::vector<uint256> vHashes;
+    auto peerit = mapPeerInfo.find(peer);
+    if (peerit == mapPeerInfo.end())
+    {
+        return vHashes;
+    }
+    vHashes.reserve(peerit->second.setBest.size());
+    for (const std::pair<uint64_t, uint256> &best : peerit->second.setBest)
+    {
+        vHashes.push_back(best.second);
+    }
+    return vHashes;
+}
+
+void CTxRequestTracker::RequestedTx(NodeId peer, const uint256 &txhash, int64_t nExpiry)
+{
+    LOCK(cs_txrequest);
+    auto it = mapAnnouncements.find(std::make_pair(peer, txhash));
+    if (it == mapAnnouncements.end() || it->second.state != READY || mapTxInfo[txhash].best != peer)
+    {
+        return;
+    }
+    Unlink(it);
+    it->second.state = REQUESTED;
+    it->second.nTime = nExpiry;
+    mapTxInfo[txhash].requested = peer;
+    mapPeerInfo[peer].nRequested++;
+    setExpiry.insert(std::make_pair(nExpiry, it->first));
+}
+
+void CTxRequestTracker::ReceivedResponse(NodeId peer, const uint256 &txhash)
+{
+    LOCK(cs_txrequest);
+    auto it = mapAnnouncements.find(std::make_pair(peer, txhash));
+    if (it == mapAnnouncements.end())
+    {
+        return;
+    }
+    Complete(it);
+    EraseIfDone(txhash);
+}
+
+void CTxRequestTracker::ForgetTxHash(const uint256 &txhash)
+{
+    LOCK(cs_txrequest);
+    EraseTxHash(txhash);
+}
+
+void CTxRequestTracker::DisconnectedPeer(NodeId peer)
+{
+    LOCK(cs_txrequest);
+    std::vector<uint256> vHashes;
+    for (auto it = mapAnnouncements.lower_bound(std::make_pair(peer, uint256()));
+         it != mapAnnouncements.end() && it->first.first == peer; ++it)
+    {
+        vHashes.push_back(it->first.second);
+    }
+    for (const uint256 &txhash : vHashes)
+    {
+        auto it = mapAnnouncements.find(std::make_pair(peer, txhash));
+        CTxInfo &info = mapTxInfo[txhash];
+        if (it->second.state != COMPLETED)
+        {
+            info.nPending--;
+        }
+        Unlink(it);
+        mapAnnouncements.erase(it);
+        info.vPeers.erase(std::find(info.vPeers.begin(), info.vPeers.end(), peer));
+        UpdateBest(txhash, info);
+        EraseIfDone(txhash);
+    }
+    mapPeerInfo.erase(peer);
+}
+
+size_t CTxRequestTracker::Count(NodeId peer) const
+{
+    LOCK(cs_txrequest);
+    auto it = mapPeerInfo.find(peer);
+    return it == mapPeerInfo.end() ? 0 : it->second.nTotal;
+}
+
+size_t CTxRequestTracker::CountInFlight(NodeId peer) const
+{
+    LOCK(cs_txrequest);
+    auto it = mapPeerInfo.find(peer);
+    return it == mapPeerInfo.end() ? 0 : it->second.nRequested;
+}
+
+void CTxRequestTracker::Clear()
+{
+    LOCK(cs_txrequest);
+    mapAnnouncements.clear();
+    mapTxInfo.clear();
+    mapPeerInfo.clear();
+    setDelayed.clear();
+    setExpiry.clear();
+}
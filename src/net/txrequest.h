@@ -0,0 +1,141 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_TXREQUEST_H
+#define ECCOIN_TXREQUEST_H
+
+#include "net/net.h"
+#include "sync.h"
+#include "txmempool.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/** Announcements a peer can have outstanding, further announcements of it are ignored */
+static const size_t MAX_PEER_TX_ANNOUNCEMENTS = 5000;
+/** Transactions a peer is asked for at once before its new announcements are delayed */
+static const size_t MAX_PEER_TX_REQUEST_IN_FLIGHT = 100;
+/** Microseconds an inbound peer waits before it is asked, so outbound peers that announced too are asked first */
+static const int64_t NONPREF_PEER_TX_DELAY = 2 * 1000000;
+/** Microseconds the announcements of a peer with MAX_PEER_TX_REQUEST_IN_FLIGHT requests out are delayed */
+static const int64_t OVERLOADED_PEER_TX_DELAY = 2 * 1000000;
+/** Microseconds a peer has to answer a getdata for a transaction before the next announcer is asked */
+static const int64_t GETDATA_TX_INTERVAL = 60 * 1000000;
+
+/** Which peer to ask for which announced transaction and when. Every announcement, one per peer and txid, waits
+ *  until its request time, then the best of the ready announcements of a txid is requested: the ones of preferred
+ *  (outbound) peers before the others, each in the order they came in. At most one peer is asked for a txid at a
+ *  time. When it answers without the transaction, times out or disconnects the next best announcer is asked, a
+ *  peer is never asked twice. Announcements are indexed by peer, by txid and by the time they become ready or
+ *  expire, so every step is logarithmic in the number of announcements, and a peer can have at most
+ *  MAX_PEER_TX_ANNOUNCEMENTS of them. Has its own lock, callers do not need cs_main.
+ */
+class CTxRequestTracker
+{
+public:
+    CTxRequestTracker() {}
+
+    /** peer announced txhash, it can be requested from it from nReqTime on */
+    void ReceivedInv(NodeId peer, const uint256 &txhash, bool fPreferred, int64_t nReqTime);
+    /** The txids to ask peer for now, in the order it announced them. Expires the requests out longer than they
+     *  were given first, their txids go to the next announcer. Each of them has to be passed to RequestedTx or
+     *  ForgetTxHash.
+     */
+    std::vector<uint256> GetRequestable(NodeId peer, int64_t nNow);
+    /** peer was asked for txhash, it has until nExpiry to answer */
+    void RequestedTx(NodeId peer, const uint256 &txhash, int64_t nExpiry);
+    /** peer sent txhash or said it does not have it, the next announcer is asked if it is still needed */
+    void ReceivedResponse(NodeId peer, const uint256 &txhash);
+    /** txhash is not needed anymore: it is in the mempool or the orphan pool, or it was rejected */
+    void ForgetTxHash(const uint256 &txhash);
+    void DisconnectedPeer(NodeId peer);
+
+    //! announcements of peer, in any state
+    size_t Count(NodeId peer) const;
+    //! transactions peer was asked for and did not answer yet
+    size_t CountInFlight(NodeId peer) const;
+    //! all announcements
+    size_t Size() const
+    {
+        LOCK(cs_txrequest);
+        return mapAnnouncements.size();
+    }
+    void Clear();
+
+private:
+    enum State
+    {
+        //! announced, its request time is still in the future
+        DELAYED,
+        //! can be requested, it is if it is the best of its txid
+        READY,
+        REQUESTED,
+        //! answered or timed out, the peer is not asked again
+        COMPLETED
+    };
+
+    struct CAnnouncement
+    {
+        State state;
+        bool fPreferred;
+        //! the request time while DELAYED, the expiry while REQUESTED
+        int64_t nTime;
+        //! announcements are numbered as they come in
+        uint64_t nSequence;
+
+        //! lower is asked first
+        std::pair<bool, uint64_t> Priority() const { return std::make_pair(!fPreferred, nSequence); }
+    };
+
+    struct CTxInfo
+    {
+        //! the READY announcements by priority
+        std::set<std::pair<std::pair<bool, uint64_t>, NodeId> > setReady;
+        std::vector<NodeId> vPeers;
+        NodeId requested = -1;
+        //! the first of setReady while nothing is requested
+        NodeId best = -1;
+        //! announcements that are not COMPLETED
+        size_t nPending = 0;
+    };
+
+    struct CPeerInfo
+    {
+        size_t nTotal = 0;
+        size_t nRequested = 0;
+        //! the txids peer is the best announcer of, by announcement order
+        std::set<std::pair<uint64_t, uint256> > setBest;
+    };
+
+    typedef std::map<std::pair<NodeId, uint256>, CAnnouncement> AnnouncementMap;
+    //! DELAYED or REQUESTED announcements by their time
+    typedef std::set<std::pair<int64_t, std::pair<NodeId, uint256> > > TimeSet;
+
+    mutable CCriticalSection cs_txrequest;
+    //! by peer, then txid
+    AnnouncementMap mapAnnouncements GUARDED_BY(cs_txrequest);
+    std::unordered_map<uint256, CTxInfo, SaltedTxidHasher> mapTxInfo GUARDED_BY(cs_txrequest);
+    std::map<NodeId, CPeerInfo> mapPeerInfo GUARDED_BY(cs_txrequest);
+    TimeSet setDelayed GUARDED_BY(cs_txrequest);
+    TimeSet setExpiry GUARDED_BY(cs_txrequest);
+    uint64_t nNextSequence GUARDED_BY(cs_txrequest) = 0;
+
+    //! Take it out of the index of its state, with cs_txrequest held
+    void Unlink(AnnouncementMap::iterator it);
+    void MakeReady(AnnouncementMap::iterator it);
+    void Complete(AnnouncementMap::iterator it);
+    //! Move the best mark of txhash to the first ready announcement if nothing is requested
+    void UpdateBest(const uint256 &txhash, CTxInfo &info);
+    //! Drop all announcements of txhash once none of them is pending anymore
+    void EraseIfDone(const uint256 &txhash);
+    void EraseTxHash(const uint256 &txhash);
+    void PromoteAndExpire(int64_t nNow);
+};
+
+extern CTxRequestTracker txrequest;
+
+#endif // ECCOIN_TXREQUEST_H
@@ -0,0 +1,247 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/txsketch.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+
+// GF(2^32) as the polynomials over GF(2) modulo x^32 + x^7 + x^3 + x^2 + 1, an element holds the coefficients
+// of x^0 to x^31 in its bits. A polynomial over the field is the vector of its coefficients from x^0 up, with no
+// zero ones at the end.
+typedef std::vector<uint32_t> Poly;
+
+static uint32_t GFMul(uint32_t a, uint32_t b)
+{
+    // carry-less product, four bits of b at a time
+    uint64_t table[16];
+    table[0] = 0;
+    for (int k = 1; k < 16; k++)
+        table[k] = (k & 1) ? table[k - 1] ^ a : table[k >> 1] << 1;
+    uint64_t r = 0;
+    for (int i = 28; i >= 0; i -= 4)
+        r = (r << 4) ^ table[(b >> i) & 15];
+    // x^32 is x^7 + x^3 + x^2 + 1, twice since the first round can leave up to 6 bits above the 32
+    for (int i = 0; i < 2; i++)
+    {
+        const uint64_t hi = r >> 32;
+        r = (r & 0xffffffff) ^ hi ^ (hi << 2) ^ (hi << 3) ^ (hi << 7);
+    }
+    return (uint32_t)r;
+}
+
+//! a^(2^32 - 2), which is the inverse of a nonzero a
+static uint32_t GFInv(uint32_t a)
+{
+    uint32_t r = 1;
+    uint32_t nPow = a;
+    for (int i = 1; i < 32; i++)
+    {
+        nPow = GFMul(nPow, nPow);
+        r = GFMul(r, nPow);
+    }
+    return r;
+}
+
+static void Trim(Poly &p)
+{
+    while (!p.empty() && p.back() == 0)
+        p.pop_back();
+}
+
+//! a becomes the remainder of a divided by m, into q goes the quotient if it is given
+static void PolyDivMod(Poly &a, const Poly &m, Poly *q = nullptr)
+{
+    const uint32_t nInvLead = GFInv(m.back());
+    if (q)
+        q->assign(a.size() >= m.size() ? a.size() - m.size() + 1 : 0, 0);
+    while (a.size() >= m.size())
+    {
+        const size_t nShift = a.size() - m.size();
+        const uint32_t nCoef = GFMul(a.back(), nInvLead);
+        if (q)
+            (*q)[nShift] = nCoef;
+        for (size_t i = 0; i < m.size(); i++)
+            a[nShift + i] ^= GFMul(nCoef, m[i]);
+        Trim(a);
+    }
+}
+
+static void MakeMonic(Poly &p)
+{
+    const uint32_t nInvLead = GFInv(p.back());
+    for (uint32_t &nCoef : p)
+        nCoef = GFMul(nCoef, nInvLead);
+}
+
+//! the monic greatest common divisor of a and b, a is not zero
+static Poly PolyGCD(Poly a, Poly b)
+{
+    while (!b.empty())
+    {
+        PolyDivMod(a, b);
+        std::swap(a, b);
+    }
+    MakeMonic(a);
+    return a;
+}
+
+//! t^2 mod f, squaring is linear in characteristic 2 so only the coefficients are squared
+static Poly PolySqrMod(const Poly &t, const Poly &f)
+{
+    Poly r(t.empty() ? 0 : 2 * t.size() - 1, 0);
+    for (size_t i = 0; i < t.size(); i++)
+        r[2 * i] = GFMul(t[i], t[i]);
+    PolyDivMod(r, f);
+    return r;
+}
+
+/** The roots of f, monic and a product of distinct linear factors, into vRoots. The trace map of beta * x takes
+ *  the values 0 and 1 only, gcd(f, Tr(beta * x) mod f) splits apart the roots it maps to 1. Every two different
+ *  roots are told apart by one of the basis elements 1, x, ..., x^31 as beta, and the ones below nBeta keep all
+ *  roots of f together already.
+ */
+static bool FindRoots(const Poly &f, int nBeta, std::vector<uint32_t> &vRoots)
+{
+    if (f.size() == 2)
+    {
+        // x + a, the root is a as - and + are the same
+        vRoots.push_back(f[0]);
+        return true;
+    }
+    for (; nBeta < 32; nBeta++)
+    {
+        Poly t{0, (uint32_t)1 << nBeta};
+        Poly trace = t;
+        for (int i = 1; i < 32; i++)
+        {
+            t = PolySqrMod(t, f);
+            trace.resize(std::max(trace.size(), t.size()), 0);
+            for (size_t j = 0; j < t.size(); j++)
+                trace[j] ^= t[j];
+        }
+        Trim(trace);
+        if (trace.empty())
+            continue;
+        Poly g = PolyGCD(f, trace);
+        if (g.size() > 1 && g.size() < f.size())
+        {
+            Poly h;
+            Poly r = f;
+            PolyDivMod(r, g, &h);
+            return FindRoots(g, nBeta + 1, vRoots) && FindRoots(h, nBeta + 1, vRoots);
+        }
+    }
+    return false;
+}
+
+void CTxSketch::Add(uint32_t nElement)
+{
+    const uint32_t nSquare = GFMul(nElement, nElement);
+    uint32_t nPow = nElement;
+    for (uint32_t &nSyndrome : vSyndromes)
+    {
+        nSyndrome ^= nPow;
+        nPow = GFMul(nPow, nSquare);
+    }
+}
+
+void CTxSketch::Merge(const CTxSketch &other)
+{
+    for (size_t i = 0; i < vSyndromes.size() && i < other.vSyndromes.size(); i++)
+        vSyndromes[i] ^= other.vSyndromes[i];
+}
+
+bool CTxSketch::Decode(std::vector<uint32_t> &vElements) const
+{
+    vElements.clear();
+    const size_t nCapacity = vSyndromes.size();
+    // the sums of the powers 1 to 2 * capacity, the one of power 2k is the square of the one of power k
+    std::vector<uint32_t> vSums(2 * nCapacity);
+    for (size_t i = 0; i < nCapacity; i++)
+        vSums[2 * i] = vSyndromes[i];
+    for (size_t i = 1; i < vSums.size(); i += 2)
+        vSums[i] = GFMul(vSums[i / 2], vSums[i / 2]);
+
+    // Berlekamp-Massey finds the shortest recurrence of the sums, whose polynomial has the inverses of the
+    // elements as its roots
+    Poly c{1};
+    Poly b{1};
+    size_t nLen = 0;
+    size_t nGap = 1;
+    uint32_t nLastDiscrepancy = 1;
+    for (size_t n = 0; n < vSums.size(); n++)
+    {
+        uint32_t nDiscrepancy = vSums[n];
+        for (size_t i = 1; i <= nLen && i < c.size(); i++)
+            nDiscrepancy ^= GFMul(c[i], vSums[n - i]);
+        if (nDiscrepancy == 0)
+        {
+            nGap++;
+            continue;
+        }
+        const uint32_t nCoef = GFMul(nDiscrepancy, GFInv(nLastDiscrepancy));
+        const Poly prev = c;
+        c.resize(std::max(c.size(), b.size() + nGap), 0);
+        for (size_t i = 0; i < b.size(); i++)
+            c[i + nGap] ^= GFMul(nCoef, b[i]);
+        if (2 * nLen <= n)
+        {
+            nLen = n + 1 - nLen;
+            b = prev;
+            nLastDiscrepancy = nDiscrepancy;
+            nGap = 1;
+        }
+        else
+        {
+            nGap++;
+        }
+    }
+    Trim(c);
+    if (nLen == 0)
+        return true;
+    // a recurrence as long as the capacity fits the sums of any set, one that is shorter fits those of a larger
+    // set only by chance
+    if (nLen >= nCapacity || c.size() != nLen + 1)
+        return false;
+
+    // reversed, the polynomial has the elements themselves as roots, and it is monic
+    Poly f(c.rbegin(), c.rend());
+    if (f[0] == 0)
+        return false;
+    // all roots are in the field and distinct exactly when f divides x^(2^32) - x
+    if (f.size() > 2)
+    {
+        Poly t{0, 1};
+        for (int i = 0; i < 32; i++)
+            t = PolySqrMod(t, f);
+        if (t != Poly{0, 1})
+            return false;
+    }
+    if (!FindRoots(f, 0, vElements) || vElements.size() != nLen)
+    {
+        vElements.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> CTxSketch::Serialize() const
+{
+    std::vector<uint8_t> vData(4 * vSyndromes.size());
+    for (size_t i = 0; i < vSyndromes.size(); i++)
+        WriteLE32(&vData[4 * i], vSyndromes[i]);
+    return vData;
+}
+
+bool CTxSketch::Deserialize(const std::vector<uint8_t> &vData)
+{
+    if (vData.size() % 4 != 0)
+        return false;
+    vSyndromes.resize(vData.size() / 4);
+    for (size_t i = 0; i < vSyndromes.size(); i++)
+        vSyndromes[i] = ReadLE32(&vData[4 * i]);
+    return true;
+}
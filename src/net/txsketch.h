@@ -0,0 +1,45 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_TXSKETCH_H
+#define ECCOIN_TXSKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** A PinSketch of a set of nonzero 32 bit elements, as used by the set reconciliation of transaction relay. It
+ *  holds the odd power sums of the elements in GF(2^32) up to the power 2 * capacity - 1, the even ones follow from
+ *  them. Adding is its own inverse, so merging the sketches of two sets gives the sketch of the elements that are
+ *  in only one of them, and that can be decoded as long as there are fewer of them than the capacity. The last
+ *  unit of capacity is what tells a larger set apart. A sketch takes 4 bytes per unit of capacity whatever the
+ *  size of the sets.
+ */
+class CTxSketch
+{
+public:
+    explicit CTxSketch(size_t nCapacity = 0) : vSyndromes(nCapacity, 0) {}
+
+    size_t GetCapacity() const { return vSyndromes.size(); }
+    //! Add nElement, which must not be zero, or remove it if it was in the set
+    void Add(uint32_t nElement);
+    //! Turn the sketch into the one of the symmetric difference with the set of other, of the same capacity
+    void Merge(const CTxSketch &other);
+    /** The elements of the set, false if it has as many elements as the capacity or more. A larger set is only
+     *  mistaken for a smaller one with a chance of about one in 2^32.
+     */
+    bool Decode(std::vector<uint32_t> &vElements) const;
+
+    //! the power sums in order, 4 bytes little endian each
+    std::vector<uint8_t> Serialize() const;
+    //! the capacity becomes a quarter of the size of vData, false when that is not a whole number
+    bool Deserialize(const std::vector<uint8_t> &vData);
+
+    bool operator==(const CTxSketch &other) const { return vSyndromes == other.vSyndromes; }
+
+private:
+    std::vector<uint32_t> vSyndromes;
+};
+
+#endif // ECCOIN_TXSKETCH_H
@@ -186,6 +186,14 @@ void CNetworkManager::ConstructLegacyNetworkTemplate()
             1491250, uint256S("0x45a01a2b45ca91433c8c12378914463bd13afc410b27eeb18855d5b060d7e270"))(
             1492500, uint256S("0xd4185d9ae0c38211ac6e0ceddcca4207a00fc59d11b087e76c9bf6d4081856c8"))(
             1493040, uint256S("0xcd266ca5eaca1f561d3adf5ab0bc4994ea26418dd12d9072d5c5194639c40ac2"))};
+
+    // Scripts below the last checkpoint are skipped already, only a block past it is worth assuming valid. Set it
+    // to a recent block of the best chain when cutting a release.
+    legacyTemplate->consensus.defaultAssumeValid = uint256();
+
+    // UTXO snapshots -loadtxoutset accepts, add what dumptxoutset reports for a block buried under the last
+    // checkpoint with each release
+    legacyTemplate->mapTxOutSetSnapshots = MapTxOutSetSnapshots();
 }
 
 void CNetworkManager::ConstructTetnet0Template()
@@ -264,6 +272,9 @@ void CNetworkManager::ConstructTetnet0Template()
 
     testnet0Template->checkpointData = (CCheckpointData){
         boost::assign::map_list_of(0, uint256S("0xcdf2b68d2fc9afdf991df5e321f59198189926ee757bf5efcf5c8c1a07b7c90e"))};
+
+    testnet0Template->consensus.defaultAssumeValid = uint256();
+    testnet0Template->mapTxOutSetSnapshots = MapTxOutSetSnapshots();
 }
 
 void CNetworkManager::ConstructRegTestTemplate()
@@ -342,6 +353,10 @@ void CNetworkManager::ConstructRegTestTemplate()
 
     regTestTemplate->checkpointData = (CCheckpointData){
         boost::assign::map_list_of(0, uint256S("0x296d58ef241b0dde2372fbc7b09ec4aacf7b4dad88561f02469f3f4695c4fbb1"))};
+
+    regTestTemplate->consensus.defaultAssumeValid = uint256();
+    // every regtest chain is a different one, -txoutsetsnapshot lists the snapshots of this one
+    regTestTemplate->mapTxOutSetSnapshots = MapTxOutSetSnapshots();
 }
 
 std::string ChainNameFromCommandLine()
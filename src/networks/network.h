@@ -52,10 +52,7 @@
 class CNetwork : public CNetworkTemplate
 {
 public:
-    CNetwork(CNetworkTemplate *param_netTemplate) : CNetworkTemplate(param_netTemplate)
-    {
-        this->chainman = CChainManager();
-    }
+    CNetwork(CNetworkTemplate *param_netTemplate) : CNetworkTemplate(param_netTemplate) {}
     const std::string &DataDir() const { return strNetworkDataDir; }
     CChainManager *getChainManager() { return &chainman; }
     /// TODO: put a check somewhere to make sure all data members have been set properly
@@ -43,6 +43,18 @@ struct CCheckpointData
     MapCheckpoints mapCheckpoints;
 };
 
+/** What dumptxoutset reported for a UTXO snapshot, -loadtxoutset only loads snapshots that match one of these */
+struct CTxOutSetSnapshotData
+{
+    uint256 hashBlock;
+    //! hash of the snapshot file past its header
+    uint256 hashSnapshot;
+    uint64_t nCoins;
+};
+
+//! snapshots by the height of the block they were taken at
+typedef std::map<int, CTxOutSetSnapshotData> MapTxOutSetSnapshots;
+
 /**
  * CChainParams defines various tweakable parameters of a given instance of the
  * Bitcoin system. There are three: the main network on which people trade goods
@@ -82,6 +94,7 @@ public:
     bool fMineBlocksOnDemand;
     bool fTestnetToBeDeprecatedFieldRPC;
     CCheckpointData checkpointData;
+    MapTxOutSetSnapshots mapTxOutSetSnapshots;
     unsigned int nStakeMaxAge;
     unsigned int nStakeMinAge;
 
@@ -108,6 +121,7 @@ public:
     const std::vector<CDNSSeedData> &DNSSeeds() const { return vSeeds; }
     const std::vector<unsigned char> &Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const CCheckpointData &Checkpoints() const { return checkpointData; }
+    const MapTxOutSetSnapshots &TxOutSetSnapshots() const { return mapTxOutSetSnapshots; }
     unsigned int getStakeMaxAge() const { return nStakeMaxAge; }
     unsigned int getStakeMinAge() const { return nStakeMinAge; }
     int getpch0() const { return pchMessageStart[0]; }
@@ -148,6 +162,7 @@ public:
         this->fMineBlocksOnDemand = param_netTemplate->MineBlocksOnDemand();
         this->fTestnetToBeDeprecatedFieldRPC = param_netTemplate->TestnetToBeDeprecatedFieldRPC();
         this->checkpointData = param_netTemplate->Checkpoints();
+        this->mapTxOutSetSnapshots = param_netTemplate->TxOutSetSnapshots();
         this->nStakeMaxAge = param_netTemplate->getStakeMaxAge();
         this->nStakeMinAge = param_netTemplate->getStakeMinAge();
     }
@@ -29,18 +29,21 @@
 #include "util/logger.h"
 #include "util/util.h"
 
+#include <algorithm>
+
+/** How small the scale of the moving averages gets before it is folded into them, reached in ~115000 blocks at .998 */
+static const double MIN_AVERAGES_SCALE = 1e-100;
+
 void TxConfirmStats::Initialize(std::vector<double> &defaultBuckets,
     unsigned int maxConfirms,
     double _decay,
     std::string _dataTypeString)
 {
     decay = _decay;
+    scale = 1;
     dataTypeString = _dataTypeString;
     for (unsigned int i = 0; i < defaultBuckets.size(); i++)
-    {
         buckets.push_back(defaultBuckets[i]);
-        bucketMap[defaultBuckets[i]] = i;
-    }
     confAvg.resize(maxConfirms);
     curBlockConf.resize(maxConfirms);
     unconfTxs.resize(maxConfirms);
@@ -58,6 +61,27 @@ void TxConfirmStats::Initialize(std::vector<double> &defaultBuckets,
     avg.resize(buckets.size());
 }
 
+unsigned int TxConfirmStats::FindBucketIndex(double val) const
+{
+    // the last bucket is unbounded, anything above it is counted there as well
+    const auto it = std::lower_bound(buckets.begin(), buckets.end(), val);
+    return it == buckets.end() ? buckets.size() - 1 : it - buckets.begin();
+}
+
+void TxConfirmStats::Normalize()
+{
+    if (scale == 1)
+        return;
+    for (unsigned int j = 0; j < buckets.size(); j++)
+    {
+        for (unsigned int i = 0; i < confAvg.size(); i++)
+            confAvg[i][j] *= scale;
+        avg[j] *= scale;
+        txCtAvg[j] *= scale;
+    }
+    scale = 1;
+}
+
 // Zero out the data for the current block
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
@@ -65,11 +89,15 @@ void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
     {
         oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
         unconfTxs[nBlockHeight % unconfTxs.size()][j] = 0;
+    }
+    for (unsigned int j : curBlockBuckets)
+    {
         for (unsigned int i = 0; i < curBlockConf.size(); i++)
             curBlockConf[i][j] = 0;
         curBlockTxCt[j] = 0;
         curBlockVal[j] = 0;
     }
+    curBlockBuckets.clear();
 }
 
 
@@ -78,7 +106,9 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     // blocksToConfirm is 1-based
     if (blocksToConfirm < 1)
         return;
-    unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+    unsigned int bucketindex = FindBucketIndex(val);
+    if (curBlockTxCt[bucketindex] == 0)
+        curBlockBuckets.push_back(bucketindex);
     for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++)
     {
         curBlockConf[i - 1][bucketindex]++;
@@ -89,13 +119,17 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++)
+    scale *= decay;
+    const double invScale = 1 / scale;
+    for (unsigned int j : curBlockBuckets)
     {
         for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
-        avg[j] = avg[j] * decay + curBlockVal[j];
-        txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
+            confAvg[i][j] += curBlockConf[i][j] * invScale;
+        avg[j] += curBlockVal[j] * invScale;
+        txCtAvg[j] += curBlockTxCt[j] * invScale;
     }
+    if (scale < MIN_AVERAGES_SCALE)
+        Normalize();
 }
 
 // returns -1 on error conditions
@@ -136,8 +170,8 @@ double TxConfirmStats::EstimateMedianVal(int confTarget,
     for (int bucket = startbucket; bucket >= 0 && bucket <= maxbucketindex; bucket += step)
     {
         curFarBucket = bucket;
-        nConf += confAvg[confTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
+        nConf += confAvg[confTarget - 1][bucket] * scale;
+        totalNum += txCtAvg[bucket] * scale;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -177,6 +211,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget,
     // Find the bucket with the median transaction and then report the average fee from that bucket
     // This is a compromise between finding the median which we can't since we don't save all tx's
     // and reporting the average which is less accurate
+    // Only ratios of the moving averages are used from here on, so their scale does not matter
     unsigned int minBucket = bestNearBucket < bestFarBucket ? bestNearBucket : bestFarBucket;
     unsigned int maxBucket = bestNearBucket > bestFarBucket ? bestNearBucket : bestFarBucket;
     for (unsigned int j = minBucket; j <= maxBucket; j++)
@@ -198,21 +233,34 @@ double TxConfirmStats::EstimateMedianVal(int confTarget,
         }
     }
 
-    LogPrint("estimatefee", "%3d: For conf success %s %4.2f need %s %s: %12.5g from buckets %8g - %8g  Cur Bucket "
-                            "stats %6.2f%%  %8.1f/(%.1f+%d mempool)\n",
+    LogPrint(Logging::ESTIMATEFEE,
+        "%3d: For conf success %s %4.2f need %s %s: %12.5g from buckets %8g - %8g  Cur Bucket "
+        "stats %6.2f%%  %8.1f/(%.1f+%d mempool)\n",
         confTarget, requireGreater ? ">" : "<", successBreakPoint, dataTypeString, requireGreater ? ">" : "<", median,
         buckets[minBucket], buckets[maxBucket], 100 * nConf / (totalNum + extraNum), nConf, totalNum, extraNum);
 
     return median;
 }
 
-void TxConfirmStats::Write(CAutoFile &fileout)
+std::vector<double> TxConfirmStats::Scaled(const std::vector<double> &vStored) const
+{
+    std::vector<double> vScaled(vStored);
+    for (double &value : vScaled)
+        value *= scale;
+    return vScaled;
+}
+
+void TxConfirmStats::Write(CAutoFile &fileout) const
 {
+    // estimates may be asked for while this is written, so the stored values are left as they are
     fileout << decay;
     fileout << buckets;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
+    fileout << Scaled(avg);
+    fileout << Scaled(txCtAvg);
+    std::vector<std::vector<double> > scaledConfAvg;
+    for (const std::vector<double> &vConfAvg : confAvg)
+        scaledConfAvg.push_back(Scaled(vConfAvg));
+    fileout << scaledConfAvg;
 }
 
 void TxConfirmStats::Read(CAutoFile &filein)
@@ -256,7 +304,7 @@ void TxConfirmStats::Read(CAutoFile &filein)
     avg = fileAvg;
     confAvg = fileConfAvg;
     txCtAvg = fileTxCtAvg;
-    bucketMap.clear();
+    scale = 1;
 
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
@@ -267,6 +315,7 @@ void TxConfirmStats::Read(CAutoFile &filein)
     }
     curBlockTxCt.resize(buckets.size());
     curBlockVal.resize(buckets.size());
+    curBlockBuckets.clear();
 
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++)
@@ -275,19 +324,16 @@ void TxConfirmStats::Read(CAutoFile &filein)
     }
     oldUnconfTxs.resize(buckets.size());
 
-    for (unsigned int i = 0; i < buckets.size(); i++)
-        bucketMap[buckets[i]] = i;
-
-    LogPrint("estimatefee", "Reading estimates: %u %s buckets counting confirms up to %u blocks\n", numBuckets,
+    LogPrint(Logging::ESTIMATEFEE, "Reading estimates: %u %s buckets counting confirms up to %u blocks\n", numBuckets,
         dataTypeString, maxConfirms);
 }
 
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
-    unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+    unsigned int bucketindex = FindBucketIndex(val);
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
     unconfTxs[blockIndex][bucketindex]++;
-    LogPrint("estimatefee", "adding to %s", dataTypeString);
+    LogPrint(Logging::ESTIMATEFEE, "adding to %s", dataTypeString);
     return bucketindex;
 }
 
@@ -299,7 +345,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         blocksAgo = 0;
     if (blocksAgo < 0)
     {
-        LogPrint("estimatefee", "Blockpolicy error, blocks ago is negative for mempool tx\n");
+        LogPrint(Logging::ESTIMATEFEE, "Blockpolicy error, blocks ago is negative for mempool tx\n");
         return; // This can't happen because we call this with our best seen height, no entries can have higher
     }
 
@@ -308,8 +354,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         if (oldUnconfTxs[bucketindex] > 0)
             oldUnconfTxs[bucketindex]--;
         else
-            LogPrint("estimatefee", "Blockpolicy error, mempool tx removed from >25 blocks,bucketIndex=%u already\n",
-                bucketindex);
+            LogPrint(Logging::ESTIMATEFEE,
+                "Blockpolicy error, mempool tx removed from >25 blocks,bucketIndex=%u already\n", bucketindex);
     }
     else
     {
@@ -317,8 +363,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         if (unconfTxs[blockIndex][bucketindex] > 0)
             unconfTxs[blockIndex][bucketindex]--;
         else
-            LogPrint("estimatefee", "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
-                blockIndex, bucketindex);
+            LogPrint(Logging::ESTIMATEFEE,
+                "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n", blockIndex,
+                bucketindex);
     }
 }
 
@@ -327,7 +374,8 @@ void CBlockPolicyEstimator::removeTx(uint256 hash)
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos == mapMemPoolTxs.end())
     {
-        LogPrint("estimatefee", "Blockpolicy error mempool tx %s not found for removeTx\n", hash.ToString().c_str());
+        LogPrint(Logging::ESTIMATEFEE, "Blockpolicy error mempool tx %s not found for removeTx\n",
+            hash.ToString().c_str());
         return;
     }
     TxConfirmStats *stats = pos->second.stats;
@@ -335,7 +383,11 @@ void CBlockPolicyEstimator::removeTx(uint256 hash)
     unsigned int bucketIndex = pos->second.bucketIndex;
 
     if (stats != NULL)
+    {
         stats->removeTx(entryHeight, nBestSeenHeight, bucketIndex);
+        if (stats == &feeStats)
+            MempoolTxChanged(entryHeight);
+    }
     mapMemPoolTxs.erase(hash);
 }
 
@@ -364,6 +416,34 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate &_minRelayFee) : nBe
     feeLikely = CFeeRate(INF_FEERATE);
     priUnlikely = 0;
     priLikely = INF_PRIORITY;
+
+    vFeeEstimates.resize(MAX_BLOCK_CONFIRMS);
+    vFeeEstimateValid.resize(MAX_BLOCK_CONFIRMS, false);
+}
+
+void CBlockPolicyEstimator::MempoolTxChanged(unsigned int nEntryHeight)
+{
+    // The estimates count the transactions that waited from 1 block on, while the height is below the number of
+    // confirms tracked their slots wrap around and may include the one of the best height as well
+    if (nEntryHeight == nBestSeenHeight && nBestSeenHeight >= feeStats.GetMaxConfirms())
+        return;
+    LOCK(cs_feeEstimates);
+    vFeeEstimateValid.assign(vFeeEstimateValid.size(), false);
+}
+
+double CBlockPolicyEstimator::EstimateMedianFee(int confTarget)
+{
+    // vFeeEstimates covers the targets feeStats tracks, read from a file they may be fewer or more
+    if ((unsigned int)confTarget > vFeeEstimates.size())
+        return feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    LOCK(cs_feeEstimates);
+    if (!vFeeEstimateValid[confTarget - 1])
+    {
+        vFeeEstimates[confTarget - 1] =
+            feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        vFeeEstimateValid[confTarget - 1] = true;
+    }
+    return vFeeEstimates[confTarget - 1];
 }
 
 bool CBlockPolicyEstimator::isFeeDataPoint(const CFeeRate &fee, double pri)
@@ -390,7 +470,8 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry &entry, boo
     uint256 hash = entry.GetTx().GetHash();
     if (mapMemPoolTxs[hash].stats != NULL)
     {
-        LogPrint("estimatefee", "Blockpolicy error mempool tx %s already being tracked\n", hash.ToString().c_str());
+        LogPrint(Logging::ESTIMATEFEE, "Blockpolicy error mempool tx %s already being tracked\n",
+            hash.ToString().c_str());
         return;
     }
 
@@ -423,7 +504,7 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry &entry, boo
     double curPri = entry.GetPriority(txHeight);
     mapMemPoolTxs[hash].blockHeight = txHeight;
 
-    LogPrint("estimatefee", "Blockpolicy mempool tx %s ", hash.ToString().substr(0, 10));
+    LogPrint(Logging::ESTIMATEFEE, "Blockpolicy mempool tx %s ", hash.ToString().substr(0, 10));
     // Record this as a priority estimate
     if (entry.GetFee() == 0 || isPriDataPoint(feeRate, curPri))
     {
@@ -435,12 +516,13 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry &entry, boo
     {
         mapMemPoolTxs[hash].stats = &feeStats;
         mapMemPoolTxs[hash].bucketIndex = feeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
+        MempoolTxChanged(txHeight);
     }
     else
     {
-        LogPrint("estimatefee", "not adding");
+        LogPrint(Logging::ESTIMATEFEE, "not adding");
     }
-    LogPrint("estimatefee", "\n");
+    LogPrint(Logging::ESTIMATEFEE, "\n");
 }
 
 void CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry &entry)
@@ -461,7 +543,7 @@ void CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     {
         // This can't happen because we don't process transactions from a block with a height
         // lower than our greatest seen height
-        LogPrint("estimatefee", "Blockpolicy error Transaction had negative blocksToConfirm\n");
+        LogPrint(Logging::ESTIMATEFEE, "Blockpolicy error Transaction had negative blocksToConfirm\n");
         return;
     }
 
@@ -498,6 +580,11 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
         return;
     }
     nBestSeenHeight = nBlockHeight;
+    {
+        // the transactions in the mempool have waited another block
+        LOCK(cs_feeEstimates);
+        vFeeEstimateValid.assign(vFeeEstimateValid.size(), false);
+    }
 
     // Only want to be updating estimates when our blockchain is synced,
     // otherwise we'll miscalculate how many blocks its taking to get included.
@@ -507,7 +594,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // Update the dynamic cutoffs
     // a fee/priority is "likely" the reason your tx was included in a block if >85% of such tx's
     // were confirmed in 2 blocks and is "unlikely" if <50% were confirmed in 10 blocks
-    LogPrint("estimatefee", "Blockpolicy recalculating dynamic cutoffs:\n");
+    LogPrint(Logging::ESTIMATEFEE, "Blockpolicy recalculating dynamic cutoffs:\n");
     priLikely = priStats.EstimateMedianVal(2, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT, true, nBlockHeight);
     if (priLikely == -1)
         priLikely = INF_PRIORITY;
@@ -540,8 +627,9 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     feeStats.UpdateMovingAverages();
     priStats.UpdateMovingAverages();
 
-    LogPrint("estimatefee", "Blockpolicy after updating estimates for %u confirmed entries, new mempool map size %u\n",
-        entries.size(), mapMemPoolTxs.size());
+    LogPrint(Logging::ESTIMATEFEE,
+        "Blockpolicy after updating estimates for %u confirmed entries, new mempool map size %u\n", entries.size(),
+        mapMemPoolTxs.size());
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
@@ -550,7 +638,7 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
     if (confTarget <= 0 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
         return CFeeRate(0);
 
-    double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    double median = EstimateMedianFee(confTarget);
 
     if (median < 0)
         return CFeeRate(0);
@@ -569,7 +657,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoun
     double median = -1;
     while (median < 0 && (unsigned int)confTarget <= feeStats.GetMaxConfirms())
     {
-        median = feeStats.EstimateMedianVal(confTarget++, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        median = EstimateMedianFee(confTarget++);
     }
 
     if (answerFoundAtTarget)
@@ -600,4 +688,6 @@ void CBlockPolicyEstimator::Read(CAutoFile &filein)
     feeStats.Read(filein);
     priStats.Read(filein);
     nBestSeenHeight = nFileBestSeenHeight;
+    LOCK(cs_feeEstimates);
+    vFeeEstimateValid.assign(vFeeEstimateValid.size(), false);
 }
@@ -23,6 +23,7 @@
 
 #include "amount.h"
 #include "random.h"
+#include "sync.h"
 #include "uint256.h"
 
 #include <map>
@@ -97,8 +98,7 @@ class TxConfirmStats
 {
 private:
     // Define the buckets we will group transactions into (both fee buckets and priority buckets)
-    std::vector<double> buckets; // The upper-bound of the range for the bucket (inclusive)
-    std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
+    std::vector<double> buckets; // The upper-bound of the range for the bucket (inclusive), ascending
 
     // For each bucket X:
     // Count the total # of txs in each bucket
@@ -118,6 +118,12 @@ private:
     std::vector<double> avg;
     // and calculate the total for the current block to update the moving average
     std::vector<double> curBlockVal;
+    // The buckets the current block has transactions in, the only ones its moving average update touches
+    std::vector<unsigned int> curBlockBuckets;
+
+    // The moving averages are stored divided by scale: decaying all of them is multiplying scale by decay, and a
+    // block adds its counts divided by scale. Folded back into the stored values before it gets too small.
+    double scale;
 
     // Combine the conf counts with tx counts to calculate the confirmation % for each Y,X
     // Combine the total value with the tx counts to calculate the avg fee/priority per bucket
@@ -132,6 +138,13 @@ private:
     // transactions still unconfirmed after MAX_CONFIRMS for each bucket
     std::vector<int> oldUnconfTxs;
 
+    /** The index of the bucket val falls into, the first whose upper bound is not below it */
+    unsigned int FindBucketIndex(double val) const;
+    /** Multiply the stored moving averages by scale and reset it to 1 */
+    void Normalize();
+    /** The stored moving averages multiplied by scale */
+    std::vector<double> Scaled(const std::vector<double> &vStored) const;
+
 public:
     /**
      * Initialize the data structures.  This is called by BlockPolicyEstimator's
@@ -164,7 +177,8 @@ public:
     void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight, unsigned int bucketIndex);
 
     /** Update our estimates by decaying our historical moving average and updating
-        with the data gathered from the current block */
+        with the data gathered from the current block. Only the buckets the block has
+        transactions in are touched, the decay of the others is applied through scale */
     void UpdateMovingAverages();
 
     /**
@@ -186,8 +200,8 @@ public:
 
     /** Return the max number of confirms we're tracking */
     unsigned int GetMaxConfirms() { return confAvg.size(); }
-    /** Write state of estimation data to a file*/
-    void Write(CAutoFile &fileout);
+    /** Write state of estimation data to a file, the moving averages as their actual values*/
+    void Write(CAutoFile &fileout) const;
 
     /**
      * Read saved state of estimation data from a file and replace all internal data structures and
@@ -295,5 +309,20 @@ private:
     /** Breakpoints to help determine whether a transaction was confirmed by priority or Fee */
     CFeeRate feeLikely, feeUnlikely;
     double priLikely, priUnlikely;
+
+    /**
+     * The fee estimate of each target once it was asked for, until something it depends on changes. A mempool
+     * transaction only counts towards an estimate once it waited a block, so the ones that enter the mempool at the
+     * best height between blocks leave them valid and the estimates are only computed once per block. The mempool
+     * asks for estimates holding its lock shared, so they have a lock of their own.
+     */
+    CCriticalSection cs_feeEstimates;
+    std::vector<double> vFeeEstimates;
+    std::vector<bool> vFeeEstimateValid;
+
+    /** The fee estimate of confTarget, from vFeeEstimates if it has it */
+    double EstimateMedianFee(int confTarget);
+    /** Forget the estimates if a mempool transaction that entered at nEntryHeight may count towards them */
+    void MempoolTxChanged(unsigned int nEntryHeight);
 };
 #endif /*BITCOIN_POLICYESTIMATOR_H */
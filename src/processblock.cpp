@@ -24,12 +24,19 @@
 #include <boost/foreach.hpp>
 #include <boost/math/distributions/poisson.hpp>
 #include <boost/range/adaptor/reversed.hpp>
+#include <deque>
+#include <set>
 
 #include <sstream>
 
+#include "addressindex.h"
 #include "args.h"
+#include "blockcompress.h"
+#include "blockfilemap.h"
+#include "blockwriter.h"
 #include "chain/checkpoints.h"
 #include "checkqueue.h"
+#include "consensus/merkle.h"
 #include "crypto/hash.h"
 #include "init.h"
 #include "kernel.h"
@@ -39,12 +46,14 @@
 #include "networks/netman.h"
 #include "networks/networktemplate.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "processblock.h"
 #include "processheader.h"
 #include "processtx.h"
 #include "txmempool.h"
 
 #include "undo.h"
+#include "util/trace.h"
 #include "util/util.h"
 #include "validationinterface.h"
 
@@ -145,15 +154,24 @@ bool AcceptBlock(const CBlock *pblock,
     {
         unsigned int nBlockSize = ::GetSerializeSize(*pblock, SER_DISK, CLIENT_VERSION);
         CDiskBlockPos blockPos;
+        // a block that is written may be compressed, room is made for what is stored
+        std::vector<unsigned char> vBlockData;
+        uint32_t nSizeField = 0;
         if (dbp != NULL)
             blockPos = *dbp;
+        else
+        {
+            StoreBlockData(*pblock, fCompressBlocks, vBlockData, nSizeField);
+            nBlockSize = vBlockData.size();
+        }
         if (!FindBlockPos(state, blockPos, nBlockSize + 8, nHeight, (*pblock).GetBlockTime(), dbp != NULL))
             return error("AcceptBlock(): FindBlockPos failed");
         if (dbp == NULL)
-            if (!WriteBlockToDisk(*pblock, blockPos, chainparams.MessageStart()))
+            if (!WriteBlockToDisk(vBlockData, nSizeField, blockPos, chainparams.MessageStart()))
                 AbortNode(state, "Failed to write block");
         if (!ReceivedBlockTransactions(*pblock, state, pindex, blockPos))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
+        pindex->fBlockChecked = pblock->fChecked;
     }
     catch (const std::runtime_error &e)
     {
@@ -204,6 +222,8 @@ void UpdateTip(CBlockIndex *pindexNew)
 {
     const CNetworkTemplate &chainParams = pnetMan->getActivePaymentNetwork();
     pnetMan->getChainActive()->chainActive.SetTip(pindexNew);
+    pnetMan->getChainActive()->PublishTip();
+    ClearStakeModifierCache();
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -270,27 +290,92 @@ void UpdateTip(CBlockIndex *pindexNew)
 
 /** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size
  * after this, with cs_main held. */
+/** A block ConnectTip connected with its undo data */
+struct CRecentBlock
+{
+    uint256 hash;
+    std::shared_ptr<const CBlock> pblock;
+    //! DisconnectBlock moves the coins out of it
+    std::shared_ptr<CBlockUndo> pblockundo;
+    size_t nBytes;
+};
+//! the blocks connected last, the tip first, bounded by RECENT_BLOCKS_CACHED and RECENT_BLOCKS_CACHE_BYTES
+static std::deque<CRecentBlock> dequeRecentBlocks;
+static size_t nRecentBlocksBytes = 0;
+
+static void AddRecentBlock(const CBlockIndex *pindex, const CBlock &block, CBlockUndo &&blockundo)
+{
+    AssertLockHeld(cs_main);
+    CRecentBlock recent;
+    recent.hash = pindex->GetBlockHash();
+    recent.nBytes = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) +
+                    ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
+    if (recent.nBytes > RECENT_BLOCKS_CACHE_BYTES)
+        return;
+    // a copy of the block shares the transactions with the caller
+    recent.pblock = std::make_shared<const CBlock>(block);
+    recent.pblockundo = std::make_shared<CBlockUndo>(std::move(blockundo));
+    nRecentBlocksBytes += recent.nBytes;
+    dequeRecentBlocks.push_front(std::move(recent));
+    while (dequeRecentBlocks.size() > RECENT_BLOCKS_CACHED || nRecentBlocksBytes > RECENT_BLOCKS_CACHE_BYTES)
+    {
+        nRecentBlocksBytes -= dequeRecentBlocks.back().nBytes;
+        dequeRecentBlocks.pop_back();
+    }
+}
+
+/** Takes the block and its undo data out of the recent blocks, false if they are not there */
+static bool TakeRecentBlock(const CBlockIndex *pindex, CRecentBlock &recent)
+{
+    AssertLockHeld(cs_main);
+    for (auto it = dequeRecentBlocks.begin(); it != dequeRecentBlocks.end(); ++it)
+    {
+        if (it->hash == pindex->GetBlockHash())
+        {
+            recent = std::move(*it);
+            nRecentBlocksBytes -= recent.nBytes;
+            dequeRecentBlocks.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
 bool DisconnectTip(CValidationState &state, const Consensus::Params &consensusParams)
 {
     CBlockIndex *pindexDelete = pnetMan->getChainActive()->chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock &block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, consensusParams))
-        return AbortNode(state, "Failed to read block");
+    // Read block from disk, unless it was connected recently
+    CRecentBlock recent;
+    if (!TakeRecentBlock(pindexDelete, recent))
+    {
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindexDelete, consensusParams))
+            return AbortNode(state, "Failed to read block");
+        recent.pblock = pblockRead;
+    }
+    const CBlock &block = *recent.pblock;
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pnetMan->getChainActive()->pcoinsTip.get());
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        CAddressIndexUpdate indexUpdate;
+        if (!DisconnectBlock(block, state, pindexDelete, view, nullptr,
+                (fAddressIndex || fSpentIndex) ? &indexUpdate : nullptr, recent.pblockundo.get()))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        if (!indexUpdate.empty() && !pnetMan->getChainActive()->pblocktree->UpdateAddressIndexes(indexUpdate))
+            return AbortNode(state, "Failed to write address index");
+        if (fHavePruned &&
+            !pnetMan->getChainActive()->pblocktree->RestorePrunedTxsSpentBy(pindexDelete->GetBlockHash()))
+            return AbortNode(state, "Failed to write the transactions kept from pruned blocks");
         assert(view.Flush());
     }
-    LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+    LogPrint(Logging::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
+    // before the mempool takes the transactions back, so listeners see them return after the block went
+    GetMainSignals().BlockDisconnected(pindexDelete);
     // Resurrect mempool transactions from the disconnected block.
     std::vector<uint256> vHashUpdate;
     for (auto const &ptx : block.vtx)
@@ -301,7 +386,7 @@ bool DisconnectTip(CValidationState &state, const Consensus::Params &consensusPa
         CValidationState stateDummy;
         if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, ptx, false, NULL, true))
         {
-            mempool.remove(tx, removed, true);
+            mempool.remove(tx, removed, true, MemPoolRemovalReason::REORG);
         }
         else if (mempool.exists(tx.GetHash()))
         {
@@ -318,10 +403,7 @@ bool DisconnectTip(CValidationState &state, const Consensus::Params &consensusPa
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    for (const auto &ptx : block.vtx)
-    {
-        SyncWithWallets(ptx, nullptr, -1);
-    }
+    SyncWithWallets(block.vtx, nullptr);
     return true;
 }
 
@@ -331,6 +413,29 @@ static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
 static int64_t nTimeTotal = 0;
+static uint64_t nBlocksConnected = 0;
+//! the stages of the block being connected, ConnectBlock fills in its own
+static CBlockConnectRecord blockConnecting;
+static CTimeHistogram vBlockStageTimes[BLOCKSTAGE_COUNT];
+static std::deque<CBlockConnectRecord> dequeBlocksConnected;
+//! the totals as of the last block connected, only accessed through std::atomic_load and std::atomic_store
+static std::shared_ptr<const CBlockConnectTimes> blockConnectTimesPublished = std::make_shared<CBlockConnectTimes>();
+static CBlockConnectTimes _GetBlockConnectTimes();
+
+static void RecordBlockConnected(const CBlockIndex *pindex, const CBlock &block)
+{
+    blockConnecting.hash = pindex->GetBlockHash();
+    blockConnecting.nHeight = pindex->nHeight;
+    blockConnecting.nTx = block.vtx.size();
+    blockConnecting.nTime = GetTime();
+    for (int i = 0; i < BLOCKSTAGE_COUNT; i++)
+        vBlockStageTimes[i].Add(blockConnecting.vMicros[i]);
+    dequeBlocksConnected.push_front(blockConnecting);
+    if (dequeBlocksConnected.size() > BLOCK_CONNECT_RECORDS)
+        dequeBlocksConnected.pop_back();
+    std::atomic_store(&blockConnectTimesPublished,
+        std::shared_ptr<const CBlockConnectTimes>(std::make_shared<CBlockConnectTimes>(_GetBlockConnectTimes())));
+}
 
 
 /**
@@ -345,6 +450,7 @@ bool ConnectTip(CValidationState &state,
     assert(pindexNew->pprev == pnetMan->getChainActive()->chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
+    blockConnecting = CBlockConnectRecord();
 
     CBlock block;
     if (!pblock)
@@ -359,12 +465,14 @@ bool ConnectTip(CValidationState &state,
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros();
     nTimeReadFromDisk += nTime2 - nTime1;
+    blockConnecting.vMicros[BLOCKSTAGE_READ] = nTime2 - nTime1;
     int64_t nTime3;
-    LogPrint(
-        "bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    LogPrint(Logging::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001,
+        nTimeReadFromDisk * 0.000001);
     {
         CCoinsViewCache view(pnetMan->getChainActive()->pcoinsTip.get());
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view);
+        CBlockUndo blockundo;
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, &blockundo);
         if (!rv)
         {
             if (state.IsInvalid())
@@ -375,20 +483,24 @@ bool ConnectTip(CValidationState &state,
         }
         nTime3 = GetTimeMicros();
         nTimeConnectTotal += nTime3 - nTime2;
-        LogPrint(
-            "bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        blockConnecting.vMicros[BLOCKSTAGE_CONNECT] = nTime3 - nTime2;
+        LogPrint(Logging::BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001,
+            nTimeConnectTotal * 0.000001);
         assert(view.Flush());
+        AddRecentBlock(pindexNew, *pblock, std::move(blockundo));
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
-    LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    blockConnecting.vMicros[BLOCKSTAGE_FLUSH] = nTime4 - nTime3;
+    LogPrint(Logging::BENCH, "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros();
     nTimeChainState += nTime5 - nTime4;
-    LogPrint(
-        "bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    blockConnecting.vMicros[BLOCKSTAGE_CHAINSTATE] = nTime5 - nTime4;
+    LogPrint(Logging::BENCH, "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001,
+        nTimeChainState * 0.000001);
     // Remove conflicting transactions from the mempool.
     std::list<CTransactionRef> txConflicted;
     mempool.removeForBlock(
@@ -398,24 +510,21 @@ bool ConnectTip(CValidationState &state,
 
     // Tell wallet about transactions that went from mempool
     // to conflicted:
-    for (const auto &ptx : txConflicted)
-    {
-        SyncWithWallets(ptx, nullptr, -1);
-    }
+    SyncWithWallets(std::vector<CTransactionRef>(txConflicted.begin(), txConflicted.end()), nullptr);
     // ... and about transactions that got confirmed:
-    int txIdx = 0;
-    for (const auto &ptx : pblock->vtx)
-    {
-        SyncWithWallets(ptx, pblock, txIdx);
-        txIdx++;
-    }
+    SyncWithWallets(pblock->vtx, pblock);
+    GetMainSignals().BlockConnected(pindexNew);
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
     nTimeTotal += nTime6 - nTime1;
-    LogPrint(
-        "bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
-    LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    nBlocksConnected++;
+    blockConnecting.vMicros[BLOCKSTAGE_POSTCONNECT] = nTime6 - nTime5;
+    blockConnecting.vMicros[BLOCKSTAGE_TOTAL] = nTime6 - nTime1;
+    RecordBlockConnected(pindexNew, *pblock);
+    LogPrint(Logging::BENCH, "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001,
+        nTimePostConnect * 0.000001);
+    LogPrint(Logging::BENCH, "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
     return true;
 }
 
@@ -611,6 +720,9 @@ bool ActivateBestChain(CValidationState &state, const CNetworkTemplate &chainpar
         if (ShutdownRequested())
             break;
 
+        // don't run ahead of the queued listeners by more than the queue holds
+        LimitValidationInterfaceQueue();
+
         CBlockIndex *pindexNewTip = NULL;
         const CBlockIndex *pindexFork;
         bool fInitialDownload;
@@ -689,13 +801,79 @@ bool ActivateBestChain(CValidationState &state, const CNetworkTemplate &chainpar
 }
 
 
-void CheckBlockIndex(const Consensus::Params &consensusParams)
+/** The checks of CheckBlockIndexTree that only need the entry and its parent, which were checked before */
+static void CheckBlockIndexEntry(CBlockIndex *pindex, const Consensus::Params &consensusParams)
 {
-    if (!fCheckBlockIndex)
+    const unsigned int nValidity = pindex->nStatus & BLOCK_VALID_MASK;
+    if (pindex->pprev == NULL)
     {
+        assert(pindex->GetBlockHash() == consensusParams.hashGenesisBlock);
+        assert(pindex->nHeight == 0);
+    }
+    else
+    {
+        assert(pindex->nHeight == pindex->pprev->nHeight + 1);
+        assert(pindex->nChainWork >= pindex->pprev->nChainWork);
+        assert(nValidity >= BLOCK_VALID_TREE);
+        // CHAIN and SCRIPTS valid imply the parents are as valid, the genesis block has no level to compare with
+        if (pindex->pprev->pprev != NULL && nValidity >= BLOCK_VALID_CHAIN)
+            assert((pindex->pprev->nStatus & BLOCK_VALID_MASK) >= nValidity);
+    }
+    assert(pindex->nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < pindex->nHeight)));
+    if (pindex->nChainTx == 0)
+        assert(pindex->nSequenceId == 0);
+    if (!fHavePruned)
+        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+    else if (pindex->nStatus & BLOCK_HAVE_DATA)
+        assert(pindex->nTx > 0);
+    if (pindex->nStatus & BLOCK_HAVE_UNDO)
+        assert(pindex->nStatus & BLOCK_HAVE_DATA);
+    assert((nValidity >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
+    // nChainTx is set once the entry and all of its parents were processed
+    assert((pindex->nChainTx != 0) == (pindex->nTx > 0 && (pindex->pprev == NULL || pindex->pprev->nChainTx != 0)));
+    if (setBlockIndexCandidates.count(pindex))
+    {
+        assert(pindex->nChainTx != 0);
+        assert(!CBlockIndexWorkComparator()(pindex, pnetMan->getChainActive()->chainActive.Tip()));
+    }
+}
+
+/** The entries of setDirtyBlockIndex CheckBlockIndexChanged checked already, until they are flushed */
+static std::set<CBlockIndex *> setBlockIndexChecked;
+
+/**
+ * Check the block index entries that changed since the last check, and the candidates, which change with every tip.
+ * New headers and changed entries are in setDirtyBlockIndex until the next flush, an entry that changes again
+ * before that is left to the next full check.
+ */
+static void CheckBlockIndexChanged(const Consensus::Params &consensusParams)
+{
+    LOCK(cs_main);
+    READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
+    CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+    if (pindexTip == NULL)
         return;
+
+    if (setBlockIndexChecked.size() > setDirtyBlockIndex.size())
+        setBlockIndexChecked.clear();
+    for (CBlockIndex *pindex : setDirtyBlockIndex)
+    {
+        if (setBlockIndexChecked.insert(pindex).second)
+            CheckBlockIndexEntry(pindex, consensusParams);
+    }
+    assert(setBlockIndexCandidates.count(pindexTip));
+    for (CBlockIndex *pindex : setBlockIndexCandidates)
+        CheckBlockIndexEntry(pindex, consensusParams);
+    for (const std::pair<CBlockIndex *const, CBlockIndex *> &item : mapBlocksUnlinked)
+    {
+        assert(item.second->pprev == item.first);
+        assert(item.second->nStatus & BLOCK_HAVE_DATA);
     }
+}
 
+/** A depth-first traversal of the whole block tree, which checks every entry against the path to it */
+static void CheckBlockIndexTree(const Consensus::Params &consensusParams)
+{
     LOCK(cs_main);
     READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
 
@@ -713,7 +891,7 @@ void CheckBlockIndex(const Consensus::Params &consensusParams)
     for (BlockMap::iterator it = pnetMan->getChainActive()->mapBlockIndex.begin();
          it != pnetMan->getChainActive()->mapBlockIndex.end(); it++)
     {
-        forward.insert(std::make_pair(it->second->pprev, it->second));
+        forward.insert(std::make_pair((*it)->pprev, *it));
     }
 
     assert(forward.size() == pnetMan->getChainActive()->mapBlockIndex.size());
@@ -777,9 +955,18 @@ void CheckBlockIndex(const Consensus::Params &consensusParams)
         // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
         // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
 
-        // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        if (!fHavePruned)
+        {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        }
+        else
+        {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                assert(pindex->nTx > 0);
+        }
 
         if (pindex->nStatus & BLOCK_HAVE_UNDO)
             assert(pindex->nStatus & BLOCK_HAVE_DATA);
@@ -868,7 +1055,23 @@ void CheckBlockIndex(const Consensus::Params &consensusParams)
         {
             // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently
             // missing data for some parent.
-            assert(false); // We must have pruned but pruning was removed so something just went wrong.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the
+            //    tip, and
+            //  - we tried switching to that descendant but were missing
+            //    data for some intermediate block between chainActive and the
+            //    tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, pnetMan->getChainActive()->chainActive.Tip()) &&
+                setBlockIndexCandidates.count(pindex) == 0)
+            {
+                if (pindexFirstInvalid == NULL)
+                {
+                    assert(foundInUnlinked);
+                }
+            }
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -938,6 +1141,34 @@ void CheckBlockIndex(const Consensus::Params &consensusParams)
     assert(nNodes == forward.size());
 }
 
+void CheckBlockIndex(const Consensus::Params &consensusParams)
+{
+    if (!fCheckBlockIndex)
+    {
+        return;
+    }
+    if (nCheckBlockIndexInterval > 0)
+        CheckBlockIndexChanged(consensusParams);
+    else
+        CheckBlockIndexTree(consensusParams);
+}
+
+void ThreadCheckBlockIndex(int64_t nInterval)
+{
+    RenameThread("bitcoin-checkblockindex");
+    int64_t nLastCheck = GetTime();
+    while (true)
+    {
+        MilliSleep(500);
+        if (shutdown_threads.load())
+            return;
+        if (GetTime() - nLastCheck < nInterval)
+            continue;
+        CheckBlockIndexTree(pnetMan->getActivePaymentNetwork()->GetConsensus());
+        nLastCheck = GetTime();
+    }
+}
+
 
 /**
  * Return the tip of the chain with the most work in it, that isn't
@@ -996,6 +1227,15 @@ CBlockIndex *FindMostWorkChain()
                     pindexFailed = pindexFailed->pprev;
                 }
                 setBlockIndexCandidates.erase(pindexTest);
+                if (fFailedChain)
+                {
+                    // the other branches above the invalid block go too, instead of being tried one by one
+                    READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
+                    ForEachDescendant(pindexTest, [](CBlockIndex *pindexDescendant) {
+                        pindexDescendant->nStatus |= BLOCK_FAILED_CHILD;
+                        setBlockIndexCandidates.erase(pindexDescendant);
+                    });
+                }
                 fInvalidAncestor = true;
                 break;
             }
@@ -1061,6 +1301,8 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
                 AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
                 fclose(file);
             }
+            if (fPruneMode)
+                fCheckForPruning = true;
         }
         else
             return state.Error("out of disk space");
@@ -1074,6 +1316,12 @@ bool UndoWriteToDisk(const CBlockUndo &blockundo,
     const uint256 &hashBlock,
     const CMessageHeader::MessageMagic &messageStart)
 {
+    if (g_blockwriter)
+    {
+        g_blockwriter->WriteUndo(blockundo, pos, hashBlock, messageStart);
+        return true;
+    }
+
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
@@ -1101,33 +1349,62 @@ bool UndoWriteToDisk(const CBlockUndo &blockundo,
 
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos, const uint256 &hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (g_blockwriter)
+        g_blockwriter->WaitForWrite(true, pos);
+
+    if (g_blockfilemapper && g_blockfilemapper->ReadUndo(blockundo, pos, hashBlock))
+        return true;
+
+    // Open history file to read, at the size in front of the record
+    if (pos.nPos < sizeof(uint32_t))
+        return error("%s: no record at %s", __func__, pos.ToString());
+    const CDiskBlockPos posSize(pos.nFile, pos.nPos - sizeof(uint32_t));
+    CAutoFile filein(OpenUndoFile(posSize, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("%s: OpenBlockFile failed", __func__);
 
-    // Read block
+    // Read the record and its checksum in one go and decode the coins from memory, instead of pulling every varint
+    // a byte at a time through the file and the hasher
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein);
+    std::vector<uint8_t> vData;
     try
     {
-        verifier << hashBlock;
-        verifier >> blockundo;
+        unsigned int nSize;
+        filein >> nSize;
+        if (nSize > MAX_SIZE)
+            return error("%s: undo record of %u bytes", __func__, nSize);
+        vData.resize(nSize);
+        filein.read((char *)vData.data(), nSize);
         filein >> hashChecksum;
     }
     catch (const std::exception &e)
     {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        return error("%s: I/O error - %s", __func__, e.what());
     }
 
     // Verify checksum
-    if (hashChecksum != verifier.GetHash())
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher.write((const char *)vData.data(), vData.size());
+    if (hashChecksum != hasher.GetHash())
         return error("%s: Checksum mismatch", __func__);
 
+    try
+    {
+        CMemoryReader stream(SER_DISK, CLIENT_VERSION, vData.data(), vData.data() + vData.size());
+        stream >> blockundo;
+    }
+    catch (const std::exception &e)
+    {
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
+/** scriptcheckqueue takes one master at a time: ConnectBlock, or a batch of mempool checks.
+ *  Taken after cs_main by ConnectBlock, never held while taking cs_main. */
+static CCriticalSection cs_scriptcheckqueue;
 
 void ThreadScriptCheck()
 {
@@ -1136,23 +1413,145 @@ void ThreadScriptCheck()
 }
 
 void InterruptScriptCheck() { scriptcheckqueue.Stop(); }
+
+bool RunScriptChecks(std::vector<CScriptCheck> &vChecks)
+{
+    if (!nScriptCheckThreads)
+    {
+        for (CScriptCheck &check : vChecks)
+        {
+            if (!check())
+                return false;
+        }
+        return true;
+    }
+    LOCK(cs_scriptcheckqueue);
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+/**
+ * Add what tx changes in the address and spent indexes to update. The outputs tx spends have to be in view: before
+ * UpdateCoins when connecting, after they are restored when disconnecting.
+ */
+static void AddAddressIndexUpdates(const CTransaction &tx,
+    const CCoinsViewCache &view,
+    int nHeight,
+    bool fConnect,
+    CAddressIndexUpdate &update)
+{
+    const uint256 &hash = tx.GetHash();
+    uint8_t nType;
+    uint160 hashBytes;
+    if (!tx.IsCoinBase())
+    {
+        for (uint32_t j = 0; j < tx.vin.size(); j++)
+        {
+            const COutPoint &prevout = tx.vin[j].prevout;
+            const Coin &coin = view.AccessCoin(prevout);
+            const bool fAddress = GetAddressIndexHash(coin.out.scriptPubKey, nType, hashBytes);
+            if (!fAddress)
+            {
+                nType = ADDRESS_NONE;
+                hashBytes.SetNull();
+            }
+            if (fAddressIndex && fAddress)
+            {
+                CAddressIndexKey key(nType, hashBytes, nHeight, hash, j, true);
+                CAddressUnspentKey unspentKey(nType, hashBytes, prevout.hash, prevout.n);
+                if (fConnect)
+                {
+                    update.vAddressIndex.emplace_back(key, -coin.out.nValue);
+                    update.vAddressUnspent.emplace_back(unspentKey, CAddressUnspentValue());
+                }
+                else
+                {
+                    update.vAddressIndexErase.push_back(key);
+                    update.vAddressUnspent.emplace_back(
+                        unspentKey, CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+                }
+            }
+            if (fSpentIndex)
+            {
+                update.vSpent.emplace_back(CSpentIndexKey(prevout.hash, prevout.n),
+                    fConnect ? CSpentIndexValue(hash, j, nHeight, coin.out.nValue, nType, hashBytes) :
+                               CSpentIndexValue());
+            }
+        }
+    }
+    if (!fAddressIndex)
+        return;
+    for (uint32_t o = 0; o < tx.vout.size(); o++)
+    {
+        const CTxOut &out = tx.vout[o];
+        if (!GetAddressIndexHash(out.scriptPubKey, nType, hashBytes))
+            continue;
+        CAddressIndexKey key(nType, hashBytes, nHeight, hash, o, false);
+        CAddressUnspentKey unspentKey(nType, hashBytes, hash, o);
+        if (fConnect)
+        {
+            update.vAddressIndex.emplace_back(key, out.nValue);
+            update.vAddressUnspent.emplace_back(
+                unspentKey, CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight));
+        }
+        else
+        {
+            update.vAddressIndexErase.push_back(key);
+            update.vAddressUnspent.emplace_back(unspentKey, CAddressUnspentValue());
+        }
+    }
+}
+
+/**
+ * Set aside the copies kept of pruned transactions whose last unspent output the block spends, so disconnecting it
+ * can put them back. Those the block MIN_BLOCKS_TO_KEEP below set aside are dropped, it is no longer disconnected.
+ * The outputs the block spends have to be spent in view.
+ */
+static bool SpendPrunedTxs(const CBlockIndex *pindex,
+    const std::set<uint256> &setSpentPruned,
+    const CCoinsViewCache &view)
+{
+    CBlockTreeDB *pblocktree = pnetMan->getChainActive()->pblocktree.get();
+    std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > vSpent;
+    for (const uint256 &txid : setSpentPruned)
+    {
+        std::pair<uint256, CTransaction> item;
+        if (!pblocktree->ReadPrunedTx(txid, item.first, item.second))
+            continue;
+        bool fUnspent = false;
+        for (uint32_t n = 0; !fUnspent && n < item.second.vout.size(); n++)
+            fUnspent = view.HaveCoin(COutPoint(txid, n));
+        if (!fUnspent)
+            vSpent.emplace_back(txid, std::move(item));
+    }
+    if (!pblocktree->MovePrunedTxsSpentBy(pindex->GetBlockHash(), vSpent))
+        return false;
+    const CBlockIndex *pindexFinal = pindex->GetAncestor(pindex->nHeight - (int)MIN_BLOCKS_TO_KEEP);
+    return !pindexFinal || pblocktree->ErasePrunedTxsSpentBy(pindexFinal->GetBlockHash());
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
+static uint64_t nInputsVerified = 0;
 
 bool ConnectBlock(const CBlock &block,
     CValidationState &state,
     CBlockIndex *pindex,
     CCoinsViewCache &view,
-    bool fJustCheck)
+    bool fJustCheck,
+    CBlockUndo *pblockundo)
 {
     const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
     AssertLockHeld(cs_main);
 
     int64_t nTimeStart = GetTimeMicros();
+    TRACE4(validation, block_connect_start, pindex->phashBlock->begin(), pindex->nHeight, block.vtx.size(),
+        fJustCheck);
 
     if (pindex->GetBlockHash() != chainparams.GetConsensus().hashGenesisBlock)
     {
@@ -1160,9 +1559,19 @@ bool ConnectBlock(const CBlock &block,
         // before this runs there should have been no flags set. so it is ok to reset the flags to 0
         pindex->updateForPos(block);
     }
+    // the ancestors are connected, their types are final
+    pindex->BuildTypeLinks();
 
+    if (pindex->fBlockChecked)
+    {
+        // checked when it came in, the transactions read back only have to be the ones the header commits to
+        bool mutated;
+        if (BlockMerkleRoot(block, &mutated) != block.hashMerkleRoot || mutated)
+            return state.DoS(
+                100, error("ConnectBlock(): hashMerkleRoot mismatch"), REJECT_INVALID, "bad-txnmrklroot", true);
+    }
     // Check it again in case a previous version let a bad block in
-    if (!CheckBlock(block, state, !fJustCheck, !fJustCheck))
+    else if (!CheckBlock(block, state, !fJustCheck, !fJustCheck))
         return false;
 
     // verify that the view's current state corresponds to the previous block
@@ -1188,11 +1597,28 @@ bool ConnectBlock(const CBlock &block,
             fScriptChecks = false;
         }
     }
+    if (fScriptChecks && !hashAssumeValid.IsNull())
+    {
+        CBlockIndex *pindexAssumeValid = pnetMan->getChainActive()->LookupBlockIndex(hashAssumeValid);
+        CBlockIndex *pindexBestHeader = pnetMan->getChainActive()->pindexBestHeader;
+        if (pindexAssumeValid && pindexBestHeader &&
+            pindexAssumeValid->GetAncestor(pindex->nHeight) == pindex &&
+            pindexBestHeader->GetAncestor(pindexAssumeValid->nHeight) == pindexAssumeValid)
+        {
+            // This block is an ancestor of the assumed valid block, and that one is in the best header chain.
+            // Only skip the scripts when there is a good deal of work on top as well, so that a fork with an
+            // invalid block cannot get nodes to accept it just by telling people to set -assumevalid to it.
+            fScriptChecks = GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader,
+                                chainparams.GetConsensus()) <= ASSUMEVALID_MIN_BURIED_TIME;
+        }
+    }
 
 
     int64_t nTime1 = GetTimeMicros();
     nTimeCheck += nTime1 - nTimeStart;
-    LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
+    blockConnecting.vMicros[BLOCKSTAGE_CHECK] = nTime1 - nTimeStart;
+    LogPrint(Logging::BENCH, "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart),
+        nTimeCheck * 0.000001);
     {
         for (auto const &tx : block.vtx)
         {
@@ -1207,35 +1633,20 @@ bool ConnectBlock(const CBlock &block,
         }
     }
 
-    unsigned int flags = SCRIPT_VERIFY_P2SH;
+    unsigned int flags = GetBlockScriptFlags(block.nVersion, pindex->pprev, chainparams.GetConsensus());
 
-    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
-    // when 75% of the network has upgraded:
-    if (block.nVersion >= 3 && IsSuperMajority(3, pindex->pprev,
-                                   chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus()))
-    {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
-    // blocks, when 75% of the network has upgraded:
-    if (block.nVersion >= 4 && IsSuperMajority(4, pindex->pprev,
-                                   chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus()))
-    {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
-
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    // Start enforcing BIP68 (sequence locks) using versionbits logic.
     int nLockTimeFlags = 0;
-    flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
     nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
 
     int64_t nTime2 = GetTimeMicros();
     nTimeForks += nTime2 - nTime1;
-    LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
+    blockConnecting.vMicros[BLOCKSTAGE_FORKS] = nTime2 - nTime1;
+    LogPrint(Logging::BENCH, "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
 
+    LOCK(cs_scriptcheckqueue);
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     std::vector<int> prevheights;
@@ -1247,6 +1658,11 @@ bool ConnectBlock(const CBlock &block,
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    CAddressIndexUpdate indexUpdate;
+    // transactions of pruned blocks the block spends from, a copy of them may be kept for staking
+    std::set<uint256> setSpentPruned;
+    // the output the coinstake stakes, kept before it is spent so the kernel check needs no read of its block
+    Coin coinStakeKernel;
     if (block.IsProofOfStake())
     {
         blockundo.vtxundo.reserve(block.vtx.size());
@@ -1283,6 +1699,8 @@ bool ConnectBlock(const CBlock &block,
             for (size_t j = 0; j < tx.vin.size(); j++)
             {
                 prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
+                if (fHavePruned && !(pindex->GetAncestor(prevheights[j])->nStatus & BLOCK_HAVE_DATA))
+                    setSpentPruned.insert(tx.vin[j].prevout.hash);
             }
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex))
@@ -1321,6 +1739,13 @@ bool ConnectBlock(const CBlock &block,
             control.Add(vChecks);
         }
 
+        if (fAddressIndex || fSpentIndex)
+            AddAddressIndexUpdates(tx, view, pindex->nHeight, true, indexUpdate);
+
+        if (i == 1 && tx.IsCoinStake())
+        {
+            coinStakeKernel = view.AccessCoin(tx.vin[0].prevout);
+        }
         CTxUndo undoDummy;
         if (i > 0 || tx.IsCoinStake())
         {
@@ -1335,7 +1760,8 @@ bool ConnectBlock(const CBlock &block,
 
     int64_t nTime3 = GetTimeMicros();
     nTimeConnect += nTime3 - nTime2;
-    LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n",
+    blockConnecting.vMicros[BLOCKSTAGE_INPUTS] = nTime3 - nTime2;
+    LogPrint(Logging::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n",
         (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(),
         nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs - 1), nTimeConnect * 0.000001);
     CAmount blockReward = 0;
@@ -1386,8 +1812,12 @@ bool ConnectBlock(const CBlock &block,
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeVerify += nTime4 - nTime2;
-    LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2),
-        nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs - 1), nTimeVerify * 0.000001);
+    blockConnecting.vMicros[BLOCKSTAGE_SCRIPTS] = nTime4 - nTime3;
+    blockConnecting.nInputs = nInputs;
+    nInputsVerified += nInputs;
+    LogPrint(Logging::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1,
+        0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs - 1),
+        nTimeVerify * 0.000001);
 
 
     // ppcoin: track money supply and mint amount info
@@ -1401,7 +1831,7 @@ bool ConnectBlock(const CBlock &block,
     hashProofOfStake.SetNull();
     if (block.IsProofOfStake())
     {
-        if (!CheckProofOfStake(pindex->nHeight, *(block.vtx[1]), hashProofOfStake))
+        if (!CheckProofOfStake(pindex, *(block.vtx[1]), coinStakeKernel, hashProofOfStake))
         {
             return state.DoS(100, error("WARNING: ProcessBlock(): check proof-of-stake failed for block %s\n",
                                       block.GetHash().ToString().c_str()),
@@ -1422,7 +1852,7 @@ bool ConnectBlock(const CBlock &block,
     nStakeModifier.SetNull();
     if (block.IsProofOfStake())
     {
-        if (!ComputeNextStakeModifier(pindex->pprev, *(block.vtx[1]), nStakeModifier))
+        if (!ComputeNextStakeModifier(pindex->pprev, coinStakeKernel, nStakeModifier))
             return state.DoS(100, error("ConnectBlock() : ComputeNextStakeModifier() failed"), REJECT_INVALID,
                 "bad-stakemodifier-pos");
     }
@@ -1441,6 +1871,7 @@ bool ConnectBlock(const CBlock &block,
     {
         if (pindex->GetUndoPos().IsNull())
         {
+            const int64_t nTimeUndoStart = GetTimeMicros();
             CDiskBlockPos pos;
             if (!FindUndoPos(state, pindex->nFile, pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
                 return error("ConnectBlock(): FindUndoPos failed");
@@ -1450,6 +1881,7 @@ bool ConnectBlock(const CBlock &block,
             // update nUndoPos in block index
             pindex->nUndoPos = pos.nPos;
             pindex->nStatus |= BLOCK_HAVE_UNDO;
+            blockConnecting.vMicros[BLOCKSTAGE_UNDO] = GetTimeMicros() - nTimeUndoStart;
         }
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
@@ -1459,20 +1891,104 @@ bool ConnectBlock(const CBlock &block,
     {
         return AbortNode(state, "Failed to write transaction index");
     }
+    if (!indexUpdate.empty() && !pnetMan->getChainActive()->pblocktree->UpdateAddressIndexes(indexUpdate))
+    {
+        return AbortNode(state, "Failed to write address index");
+    }
+    if (fHavePruned && !SpendPrunedTxs(pindex, setSpentPruned, view))
+    {
+        return AbortNode(state, "Failed to write the transactions kept from pruned blocks");
+    }
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros();
     nTimeIndex += nTime5 - nTime4;
-    LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
+    blockConnecting.vMicros[BLOCKSTAGE_INDEX] = nTime5 - nTime4 - blockConnecting.vMicros[BLOCKSTAGE_UNDO];
+    LogPrint(Logging::BENCH, "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
     int64_t nTime6 = GetTimeMicros();
     nTimeCallbacks += nTime6 - nTime5;
-    LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
+    LogPrint(Logging::BENCH, "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
+    TRACE5(validation, block_connected, pindex->phashBlock->begin(), pindex->nHeight, block.vtx.size(), nInputs,
+        nTime6 - nTimeStart);
 
+    if (pblockundo)
+        *pblockundo = std::move(blockundo);
     return true;
 }
 
+static CBlockConnectTimes _GetBlockConnectTimes()
+{
+    AssertLockHeld(cs_main);
+    CBlockConnectTimes times;
+    times.nReadFromDisk = nTimeReadFromDisk;
+    times.nConnectTotal = nTimeConnectTotal;
+    times.nFlush = nTimeFlush;
+    times.nChainState = nTimeChainState;
+    times.nPostConnect = nTimePostConnect;
+    times.nTotal = nTimeTotal;
+    times.nCheck = nTimeCheck;
+    times.nForks = nTimeForks;
+    times.nConnect = nTimeConnect;
+    times.nVerify = nTimeVerify;
+    times.nIndex = nTimeIndex;
+    times.nCallbacks = nTimeCallbacks;
+    times.nBlocks = nBlocksConnected;
+    times.nInputs = nInputsVerified;
+    return times;
+}
+
+CBlockConnectTimes GetBlockConnectTimes()
+{
+    LOCK(cs_main);
+    return _GetBlockConnectTimes();
+}
+
+CBlockConnectTimes GetPublishedBlockConnectTimes() { return *std::atomic_load(&blockConnectTimesPublished); }
+
+const char *BlockConnectStageName(int nStage)
+{
+    switch (nStage)
+    {
+    case BLOCKSTAGE_READ:
+        return "read";
+    case BLOCKSTAGE_CONNECT:
+        return "connect";
+    case BLOCKSTAGE_CHECK:
+        return "check";
+    case BLOCKSTAGE_FORKS:
+        return "forks";
+    case BLOCKSTAGE_INPUTS:
+        return "inputs";
+    case BLOCKSTAGE_SCRIPTS:
+        return "scripts";
+    case BLOCKSTAGE_UNDO:
+        return "undo";
+    case BLOCKSTAGE_INDEX:
+        return "index";
+    case BLOCKSTAGE_FLUSH:
+        return "flush";
+    case BLOCKSTAGE_CHAINSTATE:
+        return "chainstate";
+    case BLOCKSTAGE_POSTCONNECT:
+        return "postconnect";
+    case BLOCKSTAGE_TOTAL:
+        return "total";
+    }
+    return "unknown";
+}
+
+CBlockConnectStats GetBlockConnectStats()
+{
+    LOCK(cs_main);
+    CBlockConnectStats stats;
+    for (int i = 0; i < BLOCKSTAGE_COUNT; i++)
+        stats.vStages[i] = vBlockStageTimes[i];
+    stats.vRecent.assign(dequeBlocksConnected.begin(), dequeBlocksConnected.end());
+    return stats;
+}
+
 /**
  * Apply the undo operation of a CTxInUndo to the given chain state.
  * @param undo The Coin to be restored.
@@ -1504,7 +2020,9 @@ bool ApplyTxInUndo(Coin &&undo, CCoinsViewCache &view, const COutPoint &out)
             return DISCONNECT_FAILED; // adding output for transaction without known metadata
         }
     }
-    view.AddCoin(out, std::move(undo), undo.fCoinBase);
+    // an output that is still there is overwritten, which replaying an interrupted chainstate write can run into
+    bool fOverwrite = undo.fCoinBase || !fClean;
+    view.AddCoin(out, std::move(undo), fOverwrite);
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -1513,7 +2031,9 @@ bool DisconnectBlock(const CBlock &block,
     CValidationState &state,
     const CBlockIndex *pindex,
     CCoinsViewCache &view,
-    bool *pfClean)
+    bool *pfClean,
+    CAddressIndexUpdate *pindexUpdate,
+    CBlockUndo *pblockundo)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -1522,16 +2042,21 @@ bool DisconnectBlock(const CBlock &block,
 
     bool fClean = true;
 
-    CBlockUndo blockUndo;
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull())
-    {
-        return error("DisconnectBlock(): no undo data available");
-    }
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
+    CBlockUndo blockUndoRead;
+    if (!pblockundo)
     {
-        return error("DisconnectBlock(): failure reading undo data");
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull())
+        {
+            return error("DisconnectBlock(): no undo data available");
+        }
+        if (!UndoReadFromDisk(blockUndoRead, pos, pindex->pprev->GetBlockHash()))
+        {
+            return error("DisconnectBlock(): failure reading undo data");
+        }
+        pblockundo = &blockUndoRead;
     }
+    CBlockUndo &blockUndo = *pblockundo;
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
     {
@@ -1575,6 +2100,8 @@ bool DisconnectBlock(const CBlock &block,
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
             }
         }
+        if (pindexUpdate)
+            AddAddressIndexUpdates(tx, view, pindex->nHeight, false, *pindexUpdate);
     }
 
     // move best block pointer to prevout block
@@ -1588,3 +2115,108 @@ bool DisconnectBlock(const CBlock &block,
 
     return fClean;
 }
+
+/** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
+static bool RollforwardBlock(const CBlockIndex *pindex, CCoinsViewCache &inputs, const CNetworkTemplate &chainparams)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+    {
+        return error("ReplayBlocks(): ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight,
+            pindex->GetBlockHash().ToString());
+    }
+
+    for (const CTransactionRef &tx : block.vtx)
+    {
+        if (!tx->IsCoinBase())
+        {
+            for (const CTxIn &txin : tx->vin)
+            {
+                inputs.SpendCoin(txin.prevout);
+            }
+        }
+        // Pass check = true as every addition may be an overwrite.
+        AddCoins(inputs, *tx, pindex->nHeight, true);
+    }
+    return true;
+}
+
+bool ReplayBlocks(const CNetworkTemplate &chainparams, CCoinsView *view)
+{
+    LOCK(cs_main);
+
+    CCoinsViewCache cache(view);
+
+    std::vector<uint256> hashHeads = view->GetHeadBlocks();
+    if (hashHeads.empty())
+        return true; // We're already in a consistent state.
+    if (hashHeads.size() != 2)
+        return error("ReplayBlocks(): unknown inconsistent state");
+
+    LogPrintf("Replaying blocks\n");
+
+    const CBlockIndex *pindexOld = nullptr; // Old tip during the interrupted flush.
+    const CBlockIndex *pindexNew; // New tip during the interrupted flush.
+    const CBlockIndex *pindexFork = nullptr; // Latest block common to both the old and the new tip.
+
+    pindexNew = pnetMan->getChainActive()->LookupBlockIndex(hashHeads[0]);
+    if (!pindexNew)
+        return error("ReplayBlocks(): reorganization to unknown block requested");
+
+    if (!hashHeads[1].IsNull())
+    {
+        // The old tip is allowed to be 0, indicating it's the first flush.
+        pindexOld = pnetMan->getChainActive()->LookupBlockIndex(hashHeads[1]);
+        if (!pindexOld)
+            return error("ReplayBlocks(): reorganization from unknown block requested");
+        pindexFork = LastCommonAncestor(pindexOld, pindexNew);
+        assert(pindexFork != nullptr);
+    }
+
+    // Rollback along the old branch.
+    while (pindexOld != pindexFork)
+    {
+        if (pindexOld->nHeight > 0)
+        {
+            // Never disconnect the genesis block.
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexOld, chainparams.GetConsensus()))
+            {
+                return error("ReplayBlocks(): ReadBlockFromDisk failed at %d, hash=%s", pindexOld->nHeight,
+                    pindexOld->GetBlockHash().ToString());
+            }
+            LogPrintf("Rolling back %s (%i)\n", pindexOld->GetBlockHash().ToString(), pindexOld->nHeight);
+            // If the block is unclean, a non-existing UTXO was deleted, or an existing UTXO was overwritten. It
+            // corresponds to cases where the block-to-be-disconnect never had all its operations applied to the
+            // UTXO set. However, as both writing a UTXO and deleting a UTXO are idempotent operations, the result
+            // is still a version of the UTXO set with the effects of that block undone.
+            CValidationState state;
+            bool fClean = true;
+            cache.SetBestBlock(pindexOld->GetBlockHash());
+            if (!DisconnectBlock(block, state, pindexOld, cache, &fClean))
+            {
+                return error("ReplayBlocks(): DisconnectBlock failed at %d, hash=%s", pindexOld->nHeight,
+                    pindexOld->GetBlockHash().ToString());
+            }
+            if (!pnetMan->getChainActive()->pblocktree->RestorePrunedTxsSpentBy(pindexOld->GetBlockHash()))
+            {
+                return error("ReplayBlocks(): failed to restore the transactions kept from pruned blocks at %d",
+                    pindexOld->nHeight);
+            }
+        }
+        pindexOld = pindexOld->pprev;
+    }
+
+    // Roll forward from the forking point to the new tip.
+    int nForkHeight = pindexFork ? pindexFork->nHeight : 0;
+    for (int nHeight = nForkHeight + 1; nHeight <= pindexNew->nHeight; ++nHeight)
+    {
+        const CBlockIndex *pindex = pindexNew->GetAncestor(nHeight);
+        LogPrintf("Rolling forward %s (%i)\n", pindex->GetBlockHash().ToString(), nHeight);
+        if (!RollforwardBlock(pindex, cache, chainparams))
+            return false;
+    }
+
+    cache.SetBestBlock(pindexNew->GetBlockHash());
+    return cache.Flush();
+}
@@ -24,7 +24,9 @@
 #include "consensus/params.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "util/timehistogram.h"
 
+struct CAddressIndexUpdate;
 class CValidationState;
 class CNode;
 class CBlock;
@@ -34,9 +36,14 @@ class CBlockIndex;
 
 extern bool fLargeWorkForkFound;
 extern bool fLargeWorkInvalidChainFound;
+extern CBlockIndex *pindexBestForkTip;
+extern CBlockIndex *pindexBestForkBase;
 
 CBlockIndex *FindMostWorkChain();
+/** With -checkblockindex check the whole block tree, or with -checkblockindexinterval only the entries that changed */
 void CheckBlockIndex(const Consensus::Params &consensusParams);
+/** Check the whole block tree every nInterval seconds, until shutdown */
+void ThreadCheckBlockIndex(int64_t nInterval);
 /**
  * Process an incoming block. This only returns after the best known valid
  * block is made active. Note that it does not, however, guarantee that the
@@ -69,23 +76,107 @@ bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos, const uin
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
 void InterruptScriptCheck();
+/** Run vChecks across the script checking threads, or inline if there are none. Returns whether all
+ *  of them passed. Waits for a ConnectBlock using the threads to finish first. */
+bool RunScriptChecks(std::vector<CScriptCheck> &vChecks);
 
-/** Apply the effects of this block (with given index) on the UTXO set represented by coins */
+/** Apply the effects of this block (with given index) on the UTXO set represented by coins. The undo data of the
+ *  block is moved to pblockundo when that is provided. */
 bool ConnectBlock(const CBlock &block,
     CValidationState &state,
     CBlockIndex *pindex,
     CCoinsViewCache &coins,
-    bool fJustCheck = false);
+    bool fJustCheck = false,
+    CBlockUndo *pblockundo = nullptr);
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
+ *  of problems. Note that in any case, coins may be modified. What disconnecting changes in the address and spent
+ *  indexes is added to pindexUpdate when that is provided. The undo data is read from disk unless pblockundo has it,
+ *  the coins are then moved out of pblockundo. */
 bool DisconnectBlock(const CBlock &block,
     CValidationState &state,
     const CBlockIndex *pindex,
     CCoinsViewCache &coins,
-    bool *pfClean = nullptr);
+    bool *pfClean = nullptr,
+    CAddressIndexUpdate *pindexUpdate = nullptr,
+    CBlockUndo *pblockundo = nullptr);
+
+/** The totals of the -debug=bench timings of connecting blocks to the tip, in microseconds */
+struct CBlockConnectTimes
+{
+    //! the stages of ConnectTip, nTotal is all of them
+    int64_t nReadFromDisk = 0;
+    int64_t nConnectTotal = 0;
+    int64_t nFlush = 0;
+    int64_t nChainState = 0;
+    int64_t nPostConnect = 0;
+    int64_t nTotal = 0;
+    //! the stages of ConnectBlock, nVerify includes nConnect
+    int64_t nCheck = 0;
+    int64_t nForks = 0;
+    int64_t nConnect = 0;
+    int64_t nVerify = 0;
+    int64_t nIndex = 0;
+    int64_t nCallbacks = 0;
+    //! the blocks ConnectTip connected and the inputs of the transactions ConnectBlock verified
+    uint64_t nBlocks = 0;
+    uint64_t nInputs = 0;
+};
+CBlockConnectTimes GetBlockConnectTimes();
+/** GetBlockConnectTimes as of the last block ConnectTip connected, needs no lock */
+CBlockConnectTimes GetPublishedBlockConnectTimes();
+
+/** The stages each block connected to the tip is timed in. CHECK to INDEX are the parts of CONNECT. */
+enum BlockConnectStage
+{
+    BLOCKSTAGE_READ, //! load the block from disk
+    BLOCKSTAGE_CONNECT, //! all of ConnectBlock
+    BLOCKSTAGE_CHECK, //! sanity checks
+    BLOCKSTAGE_FORKS, //! fork checks
+    BLOCKSTAGE_INPUTS, //! fetch the inputs and queue the script checks
+    BLOCKSTAGE_SCRIPTS, //! wait for the script checks
+    BLOCKSTAGE_UNDO, //! write the undo data
+    BLOCKSTAGE_INDEX, //! the rest of index writing
+    BLOCKSTAGE_FLUSH, //! flush the view to the coins cache
+    BLOCKSTAGE_CHAINSTATE, //! write the chainstate if needed
+    BLOCKSTAGE_POSTCONNECT, //! mempool, tip and wallet updates
+    BLOCKSTAGE_TOTAL,
+    BLOCKSTAGE_COUNT
+};
+/** The name getvalidationstats and getblockstats show for a stage */
+const char *BlockConnectStageName(int nStage);
+
+/** How many of the blocks connected last are kept with their times */
+static const unsigned int BLOCK_CONNECT_RECORDS = 144;
+
+/** How many of the blocks connected last stay in memory with their undo data, and the serialized bytes they may
+ *  take together. DisconnectTip takes them from there, a shallow reorg does not wait on the disk. */
+static const unsigned int RECENT_BLOCKS_CACHED = 6;
+static const size_t RECENT_BLOCKS_CACHE_BYTES = 16 * 1000 * 1000;
+
+/** The times of the stages of one connected block, in microseconds */
+struct CBlockConnectRecord
+{
+    uint256 hash;
+    int nHeight = 0;
+    unsigned int nTx = 0;
+    unsigned int nInputs = 0;
+    int64_t nTime = 0;
+    int64_t vMicros[BLOCKSTAGE_COUNT] = {};
+};
+
+/** The times of all connected blocks per stage and the records of the last BLOCK_CONNECT_RECORDS, newest first */
+struct CBlockConnectStats
+{
+    CTimeHistogram vStages[BLOCKSTAGE_COUNT];
+    std::vector<CBlockConnectRecord> vRecent;
+};
+CBlockConnectStats GetBlockConnectStats();
+
+/** Replay the blocks of a chainstate write that was interrupted, so the chainstate is at the block of that write */
+bool ReplayBlocks(const CNetworkTemplate &chainparams, CCoinsView *view);
 
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState &state, const CNetworkTemplate &chainparams, const CBlock *pblock = nullptr);
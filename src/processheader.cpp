@@ -19,6 +19,8 @@
  */
 
 #include "processheader.h"
+#include "checkqueue.h"
+#include "crypto/scrypt.h"
 #include "init.h"
 #include "main.h"
 #include "timedata.h"
@@ -98,3 +100,45 @@ bool ContextualCheckBlockHeader(const CBlockHeader &block, CValidationState &sta
 
     return true;
 }
+
+bool CHeaderHashCheck::operator()()
+{
+    CBlockHeader::PrecomputeHashes(pheaders, nCount);
+    return true;
+}
+
+static CCheckQueue<CHeaderHashCheck> headerhashqueue(8);
+// only one thread at a time may act as the master of headerhashqueue
+static CCriticalSection cs_headerhashmaster;
+
+void ThreadHeaderHash()
+{
+    RenameThread("ecc-headerhash");
+    headerhashqueue.Thread();
+}
+
+void InterruptHeaderHash() { headerhashqueue.Stop(); }
+
+void PrecomputeHeaderHashes(const std::vector<CBlockHeader> &headers)
+{
+    // every check covers a few full scrypt batches
+    const size_t nPerCheck = 4 * scrypt_batch_lanes();
+
+    TRY_LOCK(cs_headerhashmaster, lockMaster);
+    if (!lockMaster || nScriptCheckThreads == 0 || headers.size() <= nPerCheck)
+    {
+        CBlockHeader::PrecomputeHashes(headers.data(), headers.size());
+        return;
+    }
+
+    std::vector<CHeaderHashCheck> vChecks;
+    vChecks.reserve(headers.size() / nPerCheck + 1);
+    for (size_t nStart = 0; nStart < headers.size(); nStart += nPerCheck)
+    {
+        vChecks.push_back(CHeaderHashCheck(&headers[nStart], std::min(nPerCheck, headers.size() - nStart)));
+    }
+
+    CCheckQueueControl<CHeaderHashCheck> control(&headerhashqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
@@ -31,4 +31,31 @@ bool AcceptBlockHeader(const CBlockHeader &block,
     const CNetworkTemplate &chainparams,
     CBlockIndex **ppindex = NULL);
 
+/** A run of headers whose hashes are computed by one header hashing worker */
+class CHeaderHashCheck
+{
+private:
+    const CBlockHeader *pheaders;
+    size_t nCount;
+
+public:
+    CHeaderHashCheck() : pheaders(nullptr), nCount(0) {}
+    CHeaderHashCheck(const CBlockHeader *pheadersIn, size_t nCountIn) : pheaders(pheadersIn), nCount(nCountIn) {}
+    bool operator()();
+
+    void swap(CHeaderHashCheck &check)
+    {
+        std::swap(pheaders, check.pheaders);
+        std::swap(nCount, check.nCount);
+    }
+};
+
+void ThreadHeaderHash();
+void InterruptHeaderHash();
+
+/** Compute and cache the hash of every header, spread over the header hashing threads.
+ *  Meant to be called before taking cs_main so AcceptBlockHeader finds the hashes ready.
+ */
+void PrecomputeHeaderHashes(const std::vector<CBlockHeader> &headers);
+
 #endif // PROCESSHEADER_H
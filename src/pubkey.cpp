@@ -29,11 +29,47 @@
 
 #include <secp256k1.h>
 #include <secp256k1_recovery.h>
+#include <string.h>
 
 namespace
 {
 /* Global secp256k1_context object used for verification. */
 secp256k1_context *secp256k1_context_verify = nullptr;
+
+/**
+ * The public keys the verifications of a thread parsed last. A CCheckQueue worker verifies the inputs of its batch
+ * one after another, and inputs signed by the same key are common, so most of them skip the decompression of the
+ * key. The slot is picked by a byte of the x coordinate.
+ */
+class CParsedPubKeyCache
+{
+private:
+    static const size_t SLOTS = 16;
+    struct CEntry
+    {
+        unsigned int nSize = 0;
+        unsigned char vch[65];
+        secp256k1_pubkey pubkey;
+    };
+    CEntry entries[SLOTS];
+
+public:
+    bool Parse(const CPubKey &key, secp256k1_pubkey &pubkey)
+    {
+        CEntry &entry = entries[key[1] % SLOTS];
+        if (entry.nSize == key.size() && memcmp(entry.vch, key.begin(), key.size()) == 0)
+        {
+            pubkey = entry.pubkey;
+            return true;
+        }
+        if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, key.begin(), key.size()))
+            return false;
+        entry.nSize = key.size();
+        memcpy(entry.vch, key.begin(), key.size());
+        entry.pubkey = pubkey;
+        return true;
+    }
+};
 } // namespace
 
 
@@ -230,9 +266,10 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char> &vchS
 {
     if (!IsValid())
         return false;
+    static thread_local CParsedPubKeyCache parsedkeys;
     secp256k1_pubkey pubkey;
     secp256k1_ecdsa_signature sig;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size()))
+    if (!parsedkeys.Parse(*this, pubkey))
     {
         return false;
     }
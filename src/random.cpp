@@ -206,7 +206,7 @@ void RandAddSeedPerfmon()
     {
         RAND_add(begin_ptr(vData), nSize, nSize / 100.0);
         memory_cleanse(begin_ptr(vData), nSize);
-        LogPrint("rand", "%s: %lu bytes\n", __func__, nSize);
+        LogPrint(Logging::RAND, "%s: %lu bytes\n", __func__, nSize);
     }
     else
     {
@@ -287,6 +287,20 @@ void FastRandomContext::RandomSeed()
     requires_seed = false;
 }
 
+FastRandomContext &GetThreadFastRandomContext()
+{
+    // the constructor does not seed, the first output does
+    static thread_local FastRandomContext ctx;
+    return ctx;
+}
+
+uint64_t GetFastRand(uint64_t nMax)
+{
+    if (nMax == 0)
+        return 0;
+    return GetThreadFastRandomContext().randrange(nMax);
+}
+
 FastRandomContext::FastRandomContext(const uint256 &seed) : requires_seed(false), bytebuf_size(0), bitbuf_size(0)
 {
     rng.SetKey(seed.begin(), 32);
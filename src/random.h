@@ -184,6 +184,15 @@ public:
     bool randbool() { return randbits(1); }
 };
 
+/**
+ * The FastRandomContext of the calling thread, seeded from GetRandHash on first use. For randomness that
+ * does not have to be secure and is drawn often: evictions, timers, sampling.
+ */
+FastRandomContext &GetThreadFastRandomContext();
+
+/** Like GetRand, from the FastRandomContext of the calling thread */
+uint64_t GetFastRand(uint64_t nMax);
+
 /**
  * Number of random bytes returned by GetOSRand.
  * When changing this constant make sure to change all call sites, and make sure
@@ -10,6 +10,7 @@
 #include "httpserver.h"
 #include "init.h"
 #include "main.h"
+#include "rpc/jsonstream.h"
 #include "rpc/rpcserver.h"
 #include "streams.h"
 #include "sync.h"
@@ -24,6 +25,10 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; // allow a max of 15 outpoints to be queried at once
+//! outpoints /rest/getutxosbatch takes at once
+static const size_t MAX_GETUTXOS_BATCH_OUTPOINTS = 20000;
+//! outpoints /rest/getutxosbatch reads from the coins database at a time before it looks them up under cs_main
+static const size_t GETUTXOS_BATCH_PREFETCH = 1024;
 
 enum RetFormat
 {
@@ -62,8 +67,10 @@ struct CCoin
 
 extern void TxToJSON(const CTransaction &tx, const uint256 hashBlock, UniValue &entry);
 extern UniValue blockToJSON(const CBlock &block, const CBlockIndex *blockindex, bool txDetails = false);
+extern void blockToJSON(CJSONStreamWriter &writer, const CBlock &block, const CBlockIndex *blockindex, bool txDetails);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern UniValue mempoolToJSON(bool fVerbose = false, bool fSequence = false);
+extern void mempoolToJSON(CJSONStreamWriter &writer);
 extern void ScriptPubKeyToJSON(const CScript &scriptPubKey, UniValue &out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex *blockindex);
 
@@ -121,6 +128,21 @@ static bool ParseHashStr(const string &strReq, uint256 &v)
     return true;
 }
 
+/** Start a chunked JSON reply to req, for a writer that sends its chunks to it */
+static CJSONStreamWriter::Sink StartJSONStream(HTTPRequest *req)
+{
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReplyStart(HTTP_OK);
+    return [req](const std::string &strChunk) { req->WriteReplyChunk(strChunk); };
+}
+
+static void EndJSONStream(HTTPRequest *req, CJSONStreamWriter &writer)
+{
+    writer.Raw("\n");
+    writer.Flush();
+    req->WriteReplyEnd();
+}
+
 static bool CheckWarmup(HTTPRequest *req)
 {
     std::string statusmessage;
@@ -209,6 +231,142 @@ static bool rest_headers(HTTPRequest *req, const std::string &strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/** Most blocks and headers a range request can ask for */
+static const long MAX_REST_BLOCKS_RANGE = 1000;
+static const long MAX_REST_HEADERS_RANGE = 20000;
+/** Size of the chunks a range is sent in */
+static const size_t REST_RANGE_CHUNK_SIZE = 1024 * 1024;
+
+/** Parse the <height>/<count> of a range request and look up the blocks of the active chain it covers */
+static bool ParseRange(HTTPRequest *req,
+    const std::string &param,
+    long nMaxCount,
+    const std::string &strUsage,
+    std::vector<const CBlockIndex *> &vIndex)
+{
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No range specified. Use " + strUsage + ".");
+
+    int32_t nHeight;
+    if (!ParseInt32(path[0], &nHeight) || nHeight < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[0]);
+    int32_t nCount;
+    if (!ParseInt32(path[1], &nCount) || nCount < 1 || nCount > nMaxCount)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + path[1]);
+
+    // the range is resolved once, what is sent is read without cs_main
+    LOCK(cs_main);
+    const CChain &chain = pnetMan->getChainActive()->chainActive;
+    if (nHeight > chain.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Height out of range: " + path[0]);
+    const int nEnd = std::min(nHeight + nCount - 1, chain.Height());
+    vIndex.reserve(nEnd - nHeight + 1);
+    for (int i = nHeight; i <= nEnd; i++)
+        vIndex.push_back(chain[i]);
+    return true;
+}
+
+/** Send the headers of the active chain from <height> on, up to <count> of them */
+static bool rest_headers_range(HTTPRequest *req, const std::string &strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX && rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex, .json)");
+
+    std::vector<const CBlockIndex *> vIndex;
+    if (!ParseRange(req, param, MAX_REST_HEADERS_RANGE, "/rest/headersrange/<height>/<count>.<ext>", vIndex))
+        return false;
+
+    if (rf == RF_JSON)
+    {
+        CJSONStreamWriter writer(StartJSONStream(req));
+        writer.BeginArray();
+        for (const CBlockIndex *pindex : vIndex)
+            writer.Value(blockheaderToJSON(pindex));
+        writer.EndArray();
+        EndJSONStream(req, writer);
+        return true;
+    }
+
+    req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+    req->WriteReplyStart(HTTP_OK);
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    for (const CBlockIndex *pindex : vIndex)
+    {
+        ssHeader << pindex->GetBlockHeader();
+        if (ssHeader.size() >= REST_RANGE_CHUNK_SIZE)
+        {
+            req->WriteReplyChunk(rf == RF_BINARY ? ssHeader.str() : HexStr(ssHeader.begin(), ssHeader.end()));
+            ssHeader.clear();
+        }
+    }
+    req->WriteReplyChunk(rf == RF_BINARY ? ssHeader.str() : HexStr(ssHeader.begin(), ssHeader.end()));
+    if (rf == RF_HEX)
+        req->WriteReplyChunk("\n");
+    req->WriteReplyEnd();
+    return true;
+}
+
+/**
+ * Send the blocks of the active chain from <height> on, up to <count> of them, one after the other as they are in
+ * the block files. They are read straight from the mappings of the files where there are ones and never
+ * deserialized. A block that can not be read after the reply was started cuts it short.
+ */
+static bool rest_block_range(HTTPRequest *req, const std::string &strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    std::vector<const CBlockIndex *> vIndex;
+    if (!ParseRange(req, param, MAX_REST_BLOCKS_RANGE, "/rest/blockrange/<height>/<count>.<ext>", vIndex))
+        return false;
+
+    std::vector<CDiskBlockPos> vPos;
+    vPos.reserve(vIndex.size());
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex *pindex : vIndex)
+        {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+            vPos.push_back(pindex->GetBlockPos());
+        }
+    }
+
+    req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+    req->WriteReplyStart(HTTP_OK);
+    std::string strChunk;
+    for (size_t i = 0; i < vPos.size(); i++)
+    {
+        const size_t nPrevSize = strChunk.size();
+        if (!ReadRawBlockFromDisk(strChunk, vPos[i]))
+        {
+            LogPrintf("%s: could not read block %d, the reply is cut short\n", __func__, vIndex[i]->nHeight);
+            strChunk.resize(nPrevSize);
+            break;
+        }
+        if (strChunk.size() >= REST_RANGE_CHUNK_SIZE)
+        {
+            req->WriteReplyChunk(rf == RF_BINARY ? strChunk : HexStr(strChunk.begin(), strChunk.end()));
+            strChunk.clear();
+        }
+    }
+    req->WriteReplyChunk(rf == RF_BINARY ? strChunk : HexStr(strChunk.begin(), strChunk.end()));
+    if (rf == RF_HEX)
+        req->WriteReplyChunk("\n");
+    req->WriteReplyEnd();
+    return true;
+}
+
 static bool rest_block(HTTPRequest *req, const std::string &strURIPart, bool showTxDetails)
 {
     if (!CheckWarmup(req))
@@ -224,10 +382,13 @@ static bool rest_block(HTTPRequest *req, const std::string &strURIPart, bool sho
     CBlockIndex *pblockindex = NULL;
     {
         LOCK(cs_main);
-        CBlockIndex *pblockindex = pnetMan->getChainActive()->LookupBlockIndex(hash);
+        pblockindex = pnetMan->getChainActive()->LookupBlockIndex(hash);
         if (!pblockindex)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+
         if (!ReadBlockFromDisk(block, pblockindex, pnetMan->getActivePaymentNetwork()->GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
@@ -255,10 +416,9 @@ static bool rest_block(HTTPRequest *req, const std::string &strURIPart, bool sho
 
     case RF_JSON:
     {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        CJSONStreamWriter writer(StartJSONStream(req));
+        blockToJSON(writer, block, pblockindex, showTxDetails);
+        EndJSONStream(req, writer);
         return true;
     }
 
@@ -353,11 +513,9 @@ static bool rest_mempool_contents(HTTPRequest *req, const std::string &strURIPar
     {
     case RF_JSON:
     {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        CJSONStreamWriter writer(StartJSONStream(req));
+        mempoolToJSON(writer);
+        EndJSONStream(req, writer);
         return true;
     }
     default:
@@ -428,6 +586,49 @@ static bool rest_tx(HTTPRequest *req, const std::string &strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Look the outpoints up in the coins of the tip, and in the mempool with fCheckMemPool, under cs_main and the mempool
+ * lock so they are all as of the same tip, which is returned with its height.
+ */
+static void LookupUTXOs(const std::vector<COutPoint> &vOutPoints,
+    bool fCheckMemPool,
+    std::vector<bool> &hits,
+    std::vector<CCoin> &outs,
+    int &nHeight,
+    uint256 &hashTip)
+{
+    hits.reserve(vOutPoints.size());
+
+    LOCK(cs_main);
+    READLOCK(mempool.cs);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    CCoinsViewCache &viewChain = *(pnetMan->getChainActive()->pcoinsTip);
+    CCoinsViewMemPool viewMempool(&viewChain, mempool);
+
+    if (fCheckMemPool)
+        view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
+
+    // what the tip does not have cached is read in one pass over the database, the lookups below hit view
+    std::vector<std::pair<COutPoint, Coin> > vFound;
+    view.GetCoins(vOutPoints, vFound);
+    for (size_t i = 0; i < vOutPoints.size(); i++)
+    {
+        bool hit = false;
+        Coin coin;
+        if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i]))
+        {
+            hit = true;
+            outs.emplace_back(std::move(coin));
+        }
+        hits.push_back(hit);
+    }
+    nHeight = pnetMan->getChainActive()->chainActive.Height();
+    hashTip = pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash();
+}
+
 static bool rest_getutxos(HTTPRequest *req, const std::string &strURIPart)
 {
     if (!CheckWarmup(req))
@@ -537,35 +738,14 @@ static bool rest_getutxos(HTTPRequest *req, const std::string &strURIPart)
     vector<CCoin> outs;
     std::string bitmapStringRepresentation;
     std::vector<bool> hits;
+    int nHeight;
+    uint256 hashTip;
+    LookupUTXOs(vOutPoints, fCheckMemPool, hits, outs, nHeight, hashTip);
     bitmap.resize((vOutPoints.size() + 7) / 8);
+    for (size_t i = 0; i < hits.size(); i++)
     {
-        LOCK(cs_main);
-        READLOCK(mempool.cs);
-
-        CCoinsView viewDummy;
-        CCoinsViewCache view(&viewDummy);
-
-        CCoinsViewCache &viewChain = *(pnetMan->getChainActive()->pcoinsTip);
-        CCoinsViewMemPool viewMempool(&viewChain, mempool);
-
-        if (fCheckMemPool)
-            view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
-
-        for (size_t i = 0; i < vOutPoints.size(); i++)
-        {
-            bool hit = false;
-            Coin coin;
-            if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i]))
-            {
-                hit = true;
-                outs.emplace_back(std::move(coin));
-            }
-
-            hits.push_back(hit);
-            // form a binary string representation (human-readable for json output)
-            bitmapStringRepresentation.append(hit ? "1" : "0");
-            bitmap[i / 8] |= ((uint8_t)hit) << (i % 8);
-        }
+        bitmapStringRepresentation.append(hits[i] ? "1" : "0");
+        bitmap[i / 8] |= ((uint8_t)hits[i]) << (i % 8);
     }
 
     switch (rf)
@@ -575,8 +755,7 @@ static bool rest_getutxos(HTTPRequest *req, const std::string &strURIPart)
         // serialize data
         // use exact same output as mentioned in Bip64
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << pnetMan->getChainActive()->chainActive.Height()
-                          << pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nHeight << hashTip << bitmap << outs;
         string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
         req->WriteHeader("Content-Type", "application/octet-stream");
@@ -587,8 +766,7 @@ static bool rest_getutxos(HTTPRequest *req, const std::string &strURIPart)
     case RF_HEX:
     {
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << pnetMan->getChainActive()->chainActive.Height()
-                          << pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nHeight << hashTip << bitmap << outs;
         string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
@@ -602,9 +780,8 @@ static bool rest_getutxos(HTTPRequest *req, const std::string &strURIPart)
 
         // pack in some essentials
         // use more or less the same output as mentioned in Bip64
-        objGetUTXOResponse.push_back(Pair("chainHeight", pnetMan->getChainActive()->chainActive.Height()));
-        objGetUTXOResponse.push_back(
-            Pair("chaintipHash", pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash().GetHex()));
+        objGetUTXOResponse.push_back(Pair("chainHeight", nHeight));
+        objGetUTXOResponse.push_back(Pair("chaintipHash", hashTip.GetHex()));
         objGetUTXOResponse.push_back(Pair("bitmap", bitmapStringRepresentation));
 
         UniValue utxos(UniValue::VARR);
@@ -639,21 +816,110 @@ static bool rest_getutxos(HTTPRequest *req, const std::string &strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * getutxos for up to MAX_GETUTXOS_BATCH_OUTPOINTS outpoints, posted as in the binary or hex getutxos request. The
+ * coins that are not cached are read in key order without cs_main first, so the lookup under it for a consistent
+ * answer stays in memory and validation does not wait for the disk. The reply is the one of getutxos, streamed.
+ */
+static bool rest_getutxos_batch(HTTPRequest *req, const std::string &strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    std::string strRequest = req->ReadBody();
+    if (rf == RF_HEX)
+    {
+        std::vector<unsigned char> vRequest = ParseHex(strRequest);
+        strRequest.assign(vRequest.begin(), vRequest.end());
+    }
+    if (strRequest.empty())
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Error: empty request");
+
+    bool fCheckMemPool = false;
+    std::vector<COutPoint> vOutPoints;
+    try
+    {
+        CDataStream oss(strRequest.data(), strRequest.data() + strRequest.size(), SER_NETWORK, PROTOCOL_VERSION);
+        oss >> fCheckMemPool;
+        oss >> vOutPoints;
+    }
+    catch (const std::ios_base::failure &e)
+    {
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Parse error");
+    }
+    if (vOutPoints.size() > MAX_GETUTXOS_BATCH_OUTPOINTS)
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)",
+                                                            MAX_GETUTXOS_BATCH_OUTPOINTS, vOutPoints.size()));
+
+    // Prefetch sorts, what a flush meanwhile drops is read again under cs_main
+    std::vector<COutPoint> vSorted(vOutPoints);
+    std::sort(vSorted.begin(), vSorted.end());
+    const CCoinsViewCache &viewChain = *(pnetMan->getChainActive()->pcoinsTip);
+    for (size_t nStart = 0; nStart < vSorted.size(); nStart += GETUTXOS_BATCH_PREFETCH)
+    {
+        std::vector<COutPoint> vBatch(vSorted.begin() + nStart,
+            vSorted.begin() + std::min(vSorted.size(), nStart + GETUTXOS_BATCH_PREFETCH));
+        viewChain.Prefetch(vBatch);
+    }
+
+    std::vector<bool> hits;
+    std::vector<CCoin> outs;
+    int nHeight;
+    uint256 hashTip;
+    LookupUTXOs(vOutPoints, fCheckMemPool, hits, outs, nHeight, hashTip);
+    std::vector<unsigned char> bitmap((vOutPoints.size() + 7) / 8);
+    for (size_t i = 0; i < hits.size(); i++)
+        bitmap[i / 8] |= ((uint8_t)hits[i]) << (i % 8);
+
+    // the serialization of << bitmap << outs, with the coins written a chunk at a time
+    req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+    req->WriteReplyStart(HTTP_OK);
+    CDataStream ssChunk(SER_NETWORK, PROTOCOL_VERSION);
+    ssChunk << nHeight << hashTip << bitmap;
+    WriteCompactSize(ssChunk, outs.size());
+    for (const CCoin &coin : outs)
+    {
+        ssChunk << coin;
+        if (ssChunk.size() >= REST_RANGE_CHUNK_SIZE)
+        {
+            req->WriteReplyChunk(rf == RF_BINARY ? ssChunk.str() : HexStr(ssChunk.begin(), ssChunk.end()));
+            ssChunk.clear();
+        }
+    }
+    req->WriteReplyChunk(rf == RF_BINARY ? ssChunk.str() : HexStr(ssChunk.begin(), ssChunk.end()));
+    if (rf == RF_HEX)
+        req->WriteReplyChunk("\n");
+    req->WriteReplyEnd();
+    return true;
+}
+
 static const struct
 {
     const char *prefix;
     bool (*handler)(HTTPRequest *req, const std::string &strReq);
+    HTTPPriority priority;
 } uri_prefixes[] = {
-    {"/rest/tx/", rest_tx}, {"/rest/block/notxdetails/", rest_block_notxdetails}, {"/rest/block/", rest_block_extended},
-    {"/rest/chaininfo", rest_chaininfo}, {"/rest/mempool/info", rest_mempool_info},
-    {"/rest/mempool/contents", rest_mempool_contents}, {"/rest/headers/", rest_headers},
-    {"/rest/getutxos", rest_getutxos},
+    {"/rest/tx/", rest_tx, HTTP_PRIORITY_NORMAL},
+    {"/rest/block/notxdetails/", rest_block_notxdetails, HTTP_PRIORITY_NORMAL},
+    {"/rest/block/", rest_block_extended, HTTP_PRIORITY_NORMAL},
+    {"/rest/chaininfo", rest_chaininfo, HTTP_PRIORITY_FAST},
+    {"/rest/mempool/info", rest_mempool_info, HTTP_PRIORITY_FAST},
+    {"/rest/mempool/contents", rest_mempool_contents, HTTP_PRIORITY_NORMAL},
+    {"/rest/headers/", rest_headers, HTTP_PRIORITY_NORMAL},
+    {"/rest/getutxosbatch", rest_getutxos_batch, HTTP_PRIORITY_SLOW},
+    {"/rest/getutxos", rest_getutxos, HTTP_PRIORITY_NORMAL},
+    {"/rest/headersrange/", rest_headers_range, HTTP_PRIORITY_NORMAL},
+    {"/rest/blockrange/", rest_block_range, HTTP_PRIORITY_SLOW},
 };
 
 bool StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler, uri_prefixes[i].priority);
     return true;
 }
 
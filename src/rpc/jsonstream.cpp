@@ -0,0 +1,121 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+#include <univalue.h>
+
+CJSONStreamWriter::CJSONStreamWriter(const Sink &sinkIn, size_t nChunkSizeIn)
+    : sink(sinkIn), nChunkSize(nChunkSizeIn), fKey(false), nFlushed(0)
+{
+}
+
+void CJSONStreamWriter::Separate()
+{
+    if (fKey)
+    {
+        fKey = false;
+        return;
+    }
+    if (vEmpty.empty())
+        return;
+    if (!vEmpty.back())
+        buffer += ',';
+    vEmpty.back() = false;
+}
+
+void CJSONStreamWriter::FlushIfFull()
+{
+    if (buffer.size() >= nChunkSize)
+        Flush();
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    Separate();
+    buffer += '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fKey);
+    vEmpty.pop_back();
+    buffer += '}';
+    FlushIfFull();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    Separate();
+    buffer += '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fKey);
+    vEmpty.pop_back();
+    buffer += ']';
+    FlushIfFull();
+}
+
+void CJSONStreamWriter::Key(const std::string &key)
+{
+    assert(!fKey);
+    Separate();
+    UniValue(key).writeTo(buffer);
+    buffer += ':';
+    fKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue &value)
+{
+    Separate();
+    value.writeTo(buffer);
+    FlushIfFull();
+}
+
+void CJSONStreamWriter::Fields(const UniValue &obj)
+{
+    assert(obj.isObject());
+    const std::vector<std::string> &keys = obj.getKeys();
+    const std::vector<UniValue> &values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        Key(keys[i]);
+        Value(values[i]);
+    }
+}
+
+void CJSONStreamWriter::Raw(const std::string &str)
+{
+    buffer += str;
+    FlushIfFull();
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (buffer.empty())
+        return;
+    sink(buffer);
+    nFlushed += buffer.size();
+    buffer.clear();
+}
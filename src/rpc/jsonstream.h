@@ -0,0 +1,78 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <boost/function.hpp>
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Size of the pieces a CJSONStreamWriter hands to its sink */
+static const size_t DEFAULT_JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Writes a JSON document a piece at a time in the compact format of UniValue::write(), so a large reply can be sent
+ * while it is produced instead of being built as one UniValue and one string first. Containers are opened and
+ * closed explicitly, anything small is written from a UniValue. The text is handed to the sink in chunks of about
+ * nChunkSize bytes, and whatever is left when Flush() is called.
+ */
+class CJSONStreamWriter
+{
+public:
+    typedef boost::function<void(const std::string &)> Sink;
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string buffer;
+    //! for every open container, whether nothing was written into it yet
+    std::vector<bool> vEmpty;
+    //! whether a key was written that still waits for its value
+    bool fKey;
+    size_t nFlushed;
+
+    void Separate();
+    void FlushIfFull();
+
+public:
+    CJSONStreamWriter(const Sink &sinkIn, size_t nChunkSizeIn = DEFAULT_JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    //! the key of the next value in the current object
+    void Key(const std::string &key);
+    void Value(const UniValue &value);
+    //! the keys and values of obj, which has to be an object, into the current object
+    void Fields(const UniValue &obj);
+    //! text that is not a JSON value, like the newline after the document
+    void Raw(const std::string &str);
+    //! hand everything written so far to the sink
+    void Flush();
+
+    //! the number of bytes handed to the sink so far
+    size_t GetFlushed() const { return nFlushed; }
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -20,26 +20,38 @@
 
 #include "amount.h"
 #include "args.h"
+#include "base58.h"
+#include "blockfilterindex.h"
 #include "chain/chain.h"
 #include "chain/checkpoints.h"
 #include "chain/tx.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "crypto/hash.h"
 #include "init.h"
 #include "main.h"
 #include "networks/netman.h"
 #include "networks/networktemplate.h"
 #include "policy/policy.h"
 #include "processblock.h"
+#include "random.h"
+#include "rpc/jsonstream.h"
 #include "rpcserver.h"
+#include "script/standard.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util/util.h"
 #include "util/utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "verifydb.h"
 
+#include <algorithm>
+#include <atomic>
 #include <stdint.h>
+#include <thread>
+#include <unordered_set>
 
 #include <univalue.h>
 
@@ -105,57 +117,81 @@ UniValue blockheaderToJSON(const CBlockIndex *blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock &block, const CBlockIndex *blockindex, bool txDetails = false)
+/** The fields of blockToJSON, but for the transactions, that come before and after them */
+static void blockFieldsToJSON(const CBlock &block, const CBlockIndex *blockindex, UniValue &before, UniValue &after)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
+    before.pushKVEnd("hash", block.GetHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (pnetMan->getChainActive()->chainActive.Contains(blockindex))
         confirmations = pnetMan->getChainActive()->chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    result.push_back(Pair("mint", ValueFromAmount(blockindex->nMint)));
-    UniValue txs(UniValue::VARR);
-    for (auto const &tx : block.vtx)
-    {
-        if (txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(*tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx->GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    before.pushKVEnd("confirmations", confirmations);
+    before.pushKVEnd("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    before.pushKVEnd("height", blockindex->nHeight);
+    before.pushKVEnd("version", block.nVersion);
+    before.pushKVEnd("merkleroot", block.hashMerkleRoot.GetHex());
+    before.pushKVEnd("mint", ValueFromAmount(blockindex->nMint));
+    after.pushKVEnd("time", block.GetBlockTime());
+    after.pushKVEnd("mediantime", (int64_t)blockindex->GetMedianTimePast());
+    after.pushKVEnd("nonce", (uint64_t)block.nNonce);
+    after.pushKVEnd("bits", strprintf("%08x", block.nBits));
+    after.pushKVEnd("difficulty", GetDifficulty(blockindex));
+    after.pushKVEnd("chainwork", blockindex->nChainWork.GetHex());
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        after.pushKVEnd("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     CBlockIndex *pnext = pnetMan->getChainActive()->chainActive.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
-    result.push_back(Pair("flags", strprintf("%s", blockindex->IsProofOfStake() ? "proof-of-stake" : "proof-of-work")));
-    result.push_back(Pair("nflags:", strprintf("%i", blockindex->nFlags)));
-    result.push_back(Pair("proofhash",
-        blockindex->IsProofOfStake() ? blockindex->hashProofOfStake.GetHex() : blockindex->GetBlockHash().GetHex()));
-    result.push_back(Pair("entropybit", (int)blockindex->GetStakeEntropyBit()));
-    result.push_back(Pair("block entropybit", (int)block.GetStakeEntropyBit()));
-    result.push_back(Pair("modifier", strprintf("%s", blockindex->nStakeModifier.GetHex())));
+        after.pushKVEnd("nextblockhash", pnext->GetBlockHash().GetHex());
+    after.pushKVEnd("flags", strprintf("%s", blockindex->IsProofOfStake() ? "proof-of-stake" : "proof-of-work"));
+    after.pushKVEnd("nflags:", strprintf("%i", blockindex->nFlags));
+    after.pushKVEnd("proofhash",
+        blockindex->IsProofOfStake() ? blockindex->hashProofOfStake.GetHex() : blockindex->GetBlockHash().GetHex());
+    after.pushKVEnd("entropybit", (int)blockindex->GetStakeEntropyBit());
+    after.pushKVEnd("block entropybit", (int)block.GetStakeEntropyBit());
+    after.pushKVEnd("modifier", strprintf("%s", blockindex->nStakeModifier.GetHex()));
+}
 
+static UniValue blockTxToJSON(const CTransaction &tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToJSON(tx, uint256(), objTx);
+    return objTx;
+}
 
+UniValue blockToJSON(const CBlock &block, const CBlockIndex *blockindex, bool txDetails = false)
+{
+    UniValue result(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, result, after);
+    UniValue txs(UniValue::VARR);
+    txs.reserve(block.vtx.size());
+    for (auto const &tx : block.vtx)
+        txs.push_back(blockTxToJSON(*tx, txDetails));
+    result.pushKVEnd("tx", std::move(txs));
+    result.pushKVs(after);
     return result;
 }
 
+/** blockToJSON written to a stream, one transaction at a time */
+void blockToJSON(CJSONStreamWriter &writer, const CBlock &block, const CBlockIndex *blockindex, bool txDetails)
+{
+    UniValue before(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, before, after);
+    writer.BeginObject();
+    writer.Fields(before);
+    writer.Key("tx");
+    writer.BeginArray();
+    for (auto const &tx : block.vtx)
+        writer.Value(blockTxToJSON(*tx, txDetails));
+    writer.EndArray();
+    writer.Fields(after);
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -166,8 +202,7 @@ UniValue getblockcount(const UniValue &params, bool fHelp)
                                  "\nExamples:\n" +
                                  HelpExampleCli("getblockcount", "") + HelpExampleRpc("getblockcount", ""));
 
-    LOCK(cs_main);
-    return pnetMan->getChainActive()->chainActive.Height();
+    return pnetMan->getChainActive()->GetPublishedTip()->nHeight;
 }
 
 UniValue getbestblockhash(const UniValue &params, bool fHelp)
@@ -180,8 +215,7 @@ UniValue getbestblockhash(const UniValue &params, bool fHelp)
                                  "\nExamples\n" +
                                  HelpExampleCli("getbestblockhash", "") + HelpExampleRpc("getbestblockhash", ""));
 
-    LOCK(cs_main);
-    return pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash().GetHex();
+    return pnetMan->getChainActive()->GetPublishedTip()->hash.GetHex();
 }
 
 UniValue getdifficulty(const UniValue &params, bool fHelp)
@@ -199,72 +233,108 @@ UniValue getdifficulty(const UniValue &params, bool fHelp)
     return GetDifficulty();
 }
 
-UniValue mempoolToJSON(bool fVerbose = false)
+/** The verbose getrawmempool entry of e, mempool.cs has to be held */
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry &e)
+{
+    UniValue info(UniValue::VOBJ);
+    info.pushKVEnd("size", (int)e.GetTxSize());
+    info.pushKVEnd("fee", ValueFromAmount(e.GetFee()));
+    info.pushKVEnd("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
+    info.pushKVEnd("time", e.GetTime());
+    info.pushKVEnd("height", (int)e.GetHeight());
+    info.pushKVEnd("startingpriority", e.GetPriority(e.GetHeight()));
+    info.pushKVEnd("currentpriority", e.GetPriority(pnetMan->getChainActive()->chainActive.Height()));
+    info.pushKVEnd("descendantcount", e.GetCountWithDescendants());
+    info.pushKVEnd("descendantsize", e.GetSizeWithDescendants());
+    info.pushKVEnd("descendantfees", e.GetModFeesWithDescendants());
+    info.pushKVEnd("ancestorcount", e.GetCountWithAncestors());
+    info.pushKVEnd("ancestorsize", e.GetSizeWithAncestors());
+    info.pushKVEnd("ancestorfees", e.GetModFeesWithAncestors());
+    const CTransaction &tx = e.GetTx();
+    std::set<std::string> setDepends;
+    for (auto const &txin : tx.vin)
+    {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    depends.reserve(setDepends.size());
+    for (auto const &dep : setDepends)
+    {
+        depends.push_back(dep);
+    }
+
+    info.pushKVEnd("depends", std::move(depends));
+    return info;
+}
+
+UniValue mempoolToJSON(bool fVerbose = false, bool fSequence = false)
 {
     if (fVerbose)
     {
         READLOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
+        o.reserve(mempool.mapTx.size());
+        // txids are unique, pushKV would compare every key with all the ones before it
         for (auto const &e : mempool.mapTx)
-        {
-            const uint256 &hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(pnetMan->getChainActive()->chainActive.Height())));
-            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-            const CTransaction &tx = e.GetTx();
-            std::set<std::string> setDepends;
-            for (auto const &txin : tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            for (auto const &dep : setDepends)
-            {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
-        }
+            o.pushKVEnd(e.GetTx().GetHash().ToString(), mempoolEntryToJSON(e));
         return o;
     }
     else
     {
         std::vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
+        uint64_t nSequence;
+        mempool.queryHashes(vtxid, nSequence);
 
         UniValue a(UniValue::VARR);
+        a.reserve(vtxid.size());
         for (auto const &hash : vtxid)
             a.push_back(hash.ToString());
 
-        return a;
+        if (!fSequence)
+            return a;
+        UniValue o(UniValue::VOBJ);
+        o.pushKVEnd("txids", std::move(a));
+        o.pushKVEnd("mempool_sequence", nSequence);
+        return o;
+    }
+}
+
+/** The verbose mempoolToJSON written to a stream, one entry at a time */
+void mempoolToJSON(CJSONStreamWriter &writer)
+{
+    READLOCK(mempool.cs);
+    writer.BeginObject();
+    for (auto const &e : mempool.mapTx)
+    {
+        writer.Key(e.GetTx().GetHash().ToString());
+        writer.Value(mempoolEntryToJSON(e));
     }
+    writer.EndObject();
 }
 
 UniValue getrawmempool(const UniValue &params, bool fHelp)
 {
-    if (fHelp || params.size() > 1)
+    if (fHelp || params.size() > 2)
         throw std::runtime_error(
-            "getrawmempool ( verbose )\n"
+            "getrawmempool ( verbose mempool_sequence )\n"
             "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
             "\nArguments:\n"
             "1. verbose           (boolean, optional, default=false) true for a json object, false for array of "
             "transaction ids\n"
+            "2. mempool_sequence  (boolean, optional, default=false) with verbose = false, an object with the "
+            "transaction ids and the mempool sequence they match, see the zmq sequence notifications\n"
             "\nResult: (for verbose = false):\n"
             "[                     (json array of string)\n"
             "  \"transactionid\"     (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult: (for verbose = false and mempool_sequence = true):\n"
+            "{                           (json object)\n"
+            "  \"txids\" : [ \"transactionid\", ... ],  (json array of string) The transaction ids\n"
+            "  \"mempool_sequence\" : n    (numeric) the sequence of the last mempool change they include\n"
+            "}\n"
             "\nResult: (for verbose = true):\n"
             "{                           (json object)\n"
             "  \"transactionid\" : {       (json object)\n"
@@ -283,6 +353,10 @@ UniValue getrawmempool(const UniValue &params, bool fHelp)
             "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
             "    \"descendantfees\" : n,   (numeric) modified fees (see above) of in-mempool descendants (including "
             "this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) modified fees (see above) of in-mempool ancestors (including "
+            "this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -296,8 +370,24 @@ UniValue getrawmempool(const UniValue &params, bool fHelp)
     bool fVerbose = false;
     if (params.size() > 0)
         fVerbose = params[0].get_bool();
+    bool fSequence = false;
+    if (params.size() > 1)
+        fSequence = params[1].get_bool();
+    if (fVerbose && fSequence)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+
+    return mempoolToJSON(fVerbose, fSequence);
+}
+
+bool getrawmempool_stream(const UniValue &params, CJSONStreamWriter &writer)
+{
+    // only the verbose form is worth streaming, getrawmempool handles the rest and any bad parameters
+    if (params.size() != 1 || !params[0].isBool() || !params[0].get_bool())
+        return false;
 
-    return mempoolToJSON(fVerbose);
+    LOCK(cs_main);
+    mempoolToJSON(writer);
+    return true;
 }
 
 UniValue getblockhash(const UniValue &params, bool fHelp)
@@ -381,6 +471,72 @@ UniValue getblockheader(const UniValue &params, bool fHelp)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nReturns the BIP158 filter of a block and its filter header, requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"       (string, required) The block hash\n"
+            "2. \"filtertype\"      (string, optional, default=\"basic\") The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) The hex encoded filter data\n"
+            "  \"header\" : \"hex\"    (string) The hex encoded filter header\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\""));
+
+    const uint256 hash = ParseHashV(params[0], "blockhash");
+    BlockFilterType filterType = BASIC_FILTER;
+    if (params.size() > 1 && !BlockFilterTypeByName(params[1].get_str(), filterType))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    if (!g_blockfilterindex || g_blockfilterindex->GetFilterType() != filterType)
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + BlockFilterTypeName(filterType));
+
+    const CBlockIndex *pblockindex = pnetMan->getChainActive()->LookupBlockIndex(hash);
+    if (!pblockindex)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    // a block the index has not reached yet is only waited for once it caught up, not during the initial sync
+    const bool fReady = g_blockfilterindex->IsSynced() && g_blockfilterindex->BlockUntilSyncedToCurrentChain();
+    BlockFilter filter;
+    uint256 header;
+    if (!g_blockfilterindex->LookupFilter(pblockindex, filter) ||
+        !g_blockfilterindex->LookupFilterHeader(pblockindex, header))
+    {
+        std::string strError = "Filter not found.";
+        if (!fReady)
+            strError += " Block filters are still in the process of being indexed.";
+        else
+            strError += " This block may not be in the active chain or the index may be corrupted.";
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    result.push_back(Pair("header", header.GetHex()));
+    return result;
+}
+
+/** Read the block with the hash in param, cs_main has to be held */
+static CBlockIndex *ReadBlockParam(const UniValue &param, CBlock &block)
+{
+    uint256 hash(uint256S(param.get_str()));
+    CBlockIndex *pblockindex = pnetMan->getChainActive()->LookupBlockIndex(hash);
+    if (!pblockindex)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if (!ReadBlockFromDisk(block, pblockindex, pnetMan->getActivePaymentNetwork()->GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -423,21 +579,12 @@ UniValue getblock(const UniValue &params, bool fHelp)
 
     LOCK(cs_main);
 
-    std::string strHash = params[0].get_str();
-    uint256 hash(uint256S(strHash));
-
     bool fVerbose = true;
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    CBlockIndex *pblockindex = pnetMan->getChainActive()->LookupBlockIndex(hash);
-    if (!pblockindex)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-
-    if (!ReadBlockFromDisk(block, pblockindex, pnetMan->getActivePaymentNetwork()->GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex *pblockindex = ReadBlockParam(params[0], block);
 
     if (!fVerbose)
     {
@@ -450,6 +597,21 @@ UniValue getblock(const UniValue &params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+bool getblock_stream(const UniValue &params, CJSONStreamWriter &writer)
+{
+    // only the verbose form is worth streaming, getblock handles the rest and any bad parameters
+    if (params.size() < 1 || params.size() > 2 || !params[0].isStr())
+        return false;
+    if (params.size() > 1 && (!params[1].isBool() || !params[1].get_bool()))
+        return false;
+
+    LOCK(cs_main);
+    CBlock block;
+    CBlockIndex *pblockindex = ReadBlockParam(params[0], block);
+    blockToJSON(writer, block, pblockindex, false);
+    return true;
+}
+
 static void ApplyStats(CCoinsStats &stats,
     CHashWriter &ss,
     const uint256 &hash,
@@ -522,25 +684,57 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 
 UniValue gettxoutsetinfo(const UniValue &params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
-        throw std::runtime_error("gettxoutsetinfo\n"
-                                 "\nReturns statistics about the unspent transaction output set.\n"
-                                 "Note this call may take some time.\n"
-                                 "\nResult:\n"
-                                 "{\n"
-                                 "  \"height\":n,     (numeric) The current block height (index)\n"
-                                 "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-                                 "  \"transactions\": n,      (numeric) The number of transactions\n"
-                                 "  \"txouts\": n,            (numeric) The number of output transactions\n"
-                                 "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-                                 "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-                                 "  \"total_amount\": x.xxx          (numeric) The total amount\n"
-                                 "}\n"
-                                 "\nExamples:\n" +
-                                 HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "gettxoutsetinfo ( \"hash_type\" )\n"
+            "\nReturns statistics about the unspent transaction output set.\n"
+            "Note this call may take some time, unless hash_type is muhash.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"   (string, optional, default=hash_serialized) hash_serialized counts the whole set\n"
+            "                  and hashes it in order, muhash returns the totals the node keeps as blocks connect\n"
+            "                  with a hash of the set that does not depend on order, without reading the set\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,     (numeric) The current block height (index)\n"
+            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, not with muhash\n"
+            "  \"txouts\": n,            (numeric) The number of output transactions\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size, not with muhash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, not with muhash\n"
+            "  \"muhash\": \"hash\",    (string) The hash of the set, only with muhash\n"
+            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "\"muhash\"") +
+            HelpExampleRpc("gettxoutsetinfo", ""));
 
+    const std::string strHashType = params.size() > 0 ? params[0].get_str() : "hash_serialized";
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType == "muhash")
+    {
+        CTxOutSetStats stats;
+        uint256 hashBlock;
+        int nHeight = 0;
+        {
+            LOCK(cs_main);
+            CCoinsViewCache *pcoinsTip = pnetMan->getChainActive()->pcoinsTip.get();
+            if (!pcoinsTip->GetTxOutSetStats(stats))
+                throw JSONRPCError(RPC_MISC_ERROR, "The totals of the unspent transaction outputs are not known");
+            hashBlock = pcoinsTip->GetBestBlock();
+            nHeight = pnetMan->getChainActive()->LookupBlockIndex(hashBlock)->nHeight;
+        }
+        // finalizing takes a while, blocks may connect meanwhile
+        ret.push_back(Pair("height", (int64_t)nHeight));
+        ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+        ret.push_back(Pair("muhash", stats.muhash.Finalize().GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        return ret;
+    }
+    if (strHashType != "hash_serialized")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview.get(), stats))
@@ -556,6 +750,440 @@ UniValue gettxoutsetinfo(const UniValue &params, bool fHelp)
     return ret;
 }
 
+UniValue dumptxoutset(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error("dumptxoutset \"path\"\n"
+                                 "\nWrites a snapshot of the unspent transaction output set, which -loadtxoutset can\n"
+                                 "start a node from once the network lists it.\n"
+                                 "Blocks are not connected while this runs, which may take some time.\n"
+                                 "\nArguments:\n"
+                                 "1. \"path\"    (string, required) The file to write, relative to the data directory\n"
+                                 "\nResult:\n"
+                                 "{\n"
+                                 "  \"coins_written\": n,        (numeric) The number of unspent outputs written\n"
+                                 "  \"base_hash\": \"hash\",     (string) The block the snapshot is of\n"
+                                 "  \"base_height\": n,          (numeric) The height of that block\n"
+                                 "  \"path\": \"path\",          (string) The absolute path of the snapshot\n"
+                                 "  \"snapshot_hash\": \"hash\"  (string) The hash the network lists the snapshot with\n"
+                                 "}\n"
+                                 "\nExamples:\n" +
+                                 HelpExampleCli("dumptxoutset", "\"utxo.dat\"") +
+                                 HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    fs::path path = fs::absolute(params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    int nHeight = 0;
+    CTxOutSetSnapshotData data;
+    std::string strError;
+    if (!DumpTxOutSet(path, pcoinsdbview.get(), nHeight, data, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", (int64_t)data.nCoins));
+    ret.push_back(Pair("base_hash", data.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", nHeight));
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("snapshot_hash", data.hashSnapshot.GetHex()));
+    return ret;
+}
+
+//! threads scantxoutset reads the chainstate with at most
+static const int MAX_SCAN_THREADS = 8;
+//! ranges of the chainstate scantxoutset hands to its threads, one per first byte of the txids
+static const unsigned int SCAN_RANGES = 256;
+
+//! set while a scantxoutset runs
+static std::atomic<bool> g_scan_in_progress(false);
+//! set by scantxoutset abort
+static std::atomic<bool> g_should_abort_scan(false);
+//! ranges of the running scan that are done
+static std::atomic<unsigned int> g_scan_ranges_done(0);
+
+/** Salted hash of the scripts scantxoutset looks for */
+class CScriptHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    CScriptHasher()
+        : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+    {
+    }
+    size_t operator()(const CScript &script) const
+    {
+        return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
+/** The match of a scan */
+struct CScanMatch
+{
+    COutPoint outpoint;
+    Coin coin;
+};
+
+/** Owns the one scan that may run at a time */
+class CScanReserver
+{
+private:
+    bool fReserved;
+
+public:
+    CScanReserver() : fReserved(false) {}
+    bool Reserve()
+    {
+        bool fExpected = false;
+        if (!g_scan_in_progress.compare_exchange_strong(fExpected, true))
+            return false;
+        fReserved = true;
+        return true;
+    }
+    ~CScanReserver()
+    {
+        if (fReserved)
+            g_scan_in_progress = false;
+    }
+};
+
+/** The scriptPubKey of a scan object, an address or a script in hex */
+static CScript ScanObjectToScript(const UniValue &obj)
+{
+    if (!obj.isStr())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Scan objects have to be strings");
+    const std::string &str = obj.get_str();
+    CBitcoinAddress address(str);
+    if (address.IsValid())
+        return GetScriptForDestination(address.Get());
+    if (!str.empty() && IsHex(str))
+    {
+        std::vector<unsigned char> data(ParseHex(str));
+        return CScript(data.begin(), data.end());
+    }
+    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script: " + str);
+}
+
+UniValue scantxoutset(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw std::runtime_error(
+            "scantxoutset \"action\" ( [scanobjects,...] )\n"
+            "\nLooks for the unspent outputs to the given addresses and scripts in the chainstate, without a wallet.\n"
+            "The chainstate is read with several threads as of the tip when the scan starts, blocks keep connecting.\n"
+            "\nArguments:\n"
+            "1. \"action\"       (string, required) \"start\" to scan, \"abort\" to stop the running scan,\n"
+            "                   \"status\" for how far it got\n"
+            "2. \"scanobjects\"  (json array, required for start) the addresses and scriptPubKeys in hex to look for\n"
+            "\nResult for start:\n"
+            "{\n"
+            "  \"success\": true|false,  (boolean) false if the scan was aborted\n"
+            "  \"txouts\": n,            (numeric) the unspent outputs scanned\n"
+            "  \"height\": n,            (numeric) the height of the block the chainstate was at\n"
+            "  \"bestblock\": \"hash\",    (string) that block\n"
+            "  \"unspents\": [\n"
+            "    {\n"
+            "      \"txid\": \"hash\", \"vout\": n, \"scriptPubKey\": \"hex\",\n"
+            "      \"amount\": x.xxx, \"height\": n  (numeric) the height of the block the output is in\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"total_amount\": x.xxx   (numeric) the sum of the amounts found\n"
+            "}\n"
+            "\nResult for abort: true if a scan was running. Result for status: {\"progress\": n} with the percentage\n"
+            "of the chainstate scanned, null if no scan runs.\n"
+            "\nExamples:\n" +
+            HelpExampleCli("scantxoutset", "start \"[\\\"<address>\\\"]\"") + HelpExampleCli("scantxoutset", "status") +
+            HelpExampleRpc("scantxoutset", "\"start\", [\"<address>\"]"));
+
+    const std::string strAction = params[0].get_str();
+    if (strAction == "status")
+    {
+        if (!g_scan_in_progress.load())
+            return NullUniValue;
+        UniValue ret(UniValue::VOBJ);
+        ret.push_back(Pair("progress", (int)(g_scan_ranges_done.load() * 100 / SCAN_RANGES)));
+        return ret;
+    }
+    if (strAction == "abort")
+    {
+        if (!g_scan_in_progress.load())
+            return false;
+        g_should_abort_scan = true;
+        return true;
+    }
+    if (strAction != "start")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid action " + strAction);
+    if (params.size() < 2)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "scanobjects argument is required for the start action");
+
+    std::unordered_set<CScript, CScriptHasher> setScripts;
+    for (const UniValue &obj : params[1].get_array().getValues())
+        setScripts.insert(ScanObjectToScript(obj));
+    if (setScripts.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No scan objects given");
+
+    CScanReserver reserver;
+    if (!reserver.Reserve())
+        throw JSONRPCError(RPC_MISC_ERROR, "Scan already in progress, use action \"abort\" or \"status\"");
+    g_should_abort_scan = false;
+    g_scan_ranges_done = 0;
+
+    std::unique_ptr<CDBSnapshot> snapshot;
+    uint256 hashBlock;
+    int nHeight = 0;
+    {
+        // everything of the tip is in the database at the snapshot
+        LOCK(cs_main);
+        FlushStateToDisk();
+        snapshot.reset(pcoinsdbview->NewSnapshot());
+        hashBlock = pcoinsdbview->GetBestBlock();
+        nHeight = pnetMan->getChainActive()->LookupBlockIndex(hashBlock)->nHeight;
+    }
+
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_SCAN_THREADS));
+    std::atomic<unsigned int> nNextRange(0);
+    std::atomic<uint64_t> nScanned(0);
+    std::atomic<bool> fFailed(false);
+    std::vector<std::vector<CScanMatch> > vMatches(nThreads);
+    auto scan = [&](std::vector<CScanMatch> &matches) {
+        uint64_t nCount = 0;
+        auto check = [&](const COutPoint &outpoint, const Coin &coin) {
+            if (g_should_abort_scan.load() || shutdown_threads.load())
+                return false;
+            nCount++;
+            if (setScripts.count(coin.out.scriptPubKey))
+                matches.push_back({outpoint, coin});
+            return true;
+        };
+        for (unsigned int nRange = nNextRange++; nRange < SCAN_RANGES; nRange = nNextRange++)
+        {
+            if (!pcoinsdbview->ScanCoins(*snapshot, nRange, nRange + 1, check))
+                fFailed = true;
+            if (fFailed.load() || g_should_abort_scan.load() || shutdown_threads.load())
+                break;
+            g_scan_ranges_done++;
+        }
+        nScanned += nCount;
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.emplace_back(scan, std::ref(vMatches[i]));
+    scan(vMatches[0]);
+    for (std::thread &thread : threads)
+        thread.join();
+    if (fFailed.load())
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the chainstate");
+
+    std::vector<CScanMatch> vFound;
+    for (std::vector<CScanMatch> &matches : vMatches)
+        std::move(matches.begin(), matches.end(), std::back_inserter(vFound));
+    std::sort(vFound.begin(), vFound.end(),
+        [](const CScanMatch &a, const CScanMatch &b) { return a.outpoint < b.outpoint; });
+
+    CAmount nTotal = 0;
+    UniValue unspents(UniValue::VARR);
+    for (const CScanMatch &match : vFound)
+    {
+        UniValue unspent(UniValue::VOBJ);
+        unspent.push_back(Pair("txid", match.outpoint.hash.GetHex()));
+        unspent.push_back(Pair("vout", (int64_t)match.outpoint.n));
+        unspent.push_back(Pair("scriptPubKey", HexStr(match.coin.out.scriptPubKey.begin(),
+                                                   match.coin.out.scriptPubKey.end())));
+        unspent.push_back(Pair("amount", ValueFromAmount(match.coin.out.nValue)));
+        unspent.push_back(Pair("height", (int64_t)match.coin.nHeight));
+        unspents.push_back(unspent);
+        nTotal += match.coin.out.nValue;
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("success", !g_should_abort_scan.load() && !shutdown_threads.load()));
+    ret.push_back(Pair("txouts", nScanned.load()));
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    ret.push_back(Pair("unspents", unspents));
+    ret.push_back(Pair("total_amount", ValueFromAmount(nTotal)));
+    return ret;
+}
+
+static UniValue DBStatsToJSON(const CDBStats &stats)
+{
+    UniValue options(UniValue::VOBJ);
+    options.push_back(Pair("block_size", (uint64_t)stats.options.nBlockSize));
+    options.push_back(Pair("compression", stats.options.fCompression));
+    options.push_back(Pair("max_open_files", stats.options.nMaxOpenFiles));
+    options.push_back(Pair("write_buffer_size", (uint64_t)stats.options.nWriteBufferSize));
+    options.push_back(Pair("block_cache_size", (uint64_t)stats.nBlockCacheSize));
+
+    UniValue levels(UniValue::VARR);
+    double dCompactionTime = 0;
+    for (size_t i = 0; i < stats.vLevels.size(); i++)
+    {
+        const CDBLevelStats &level = stats.vLevels[i];
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("level", (uint64_t)i));
+        obj.push_back(Pair("files", level.nFiles));
+        obj.push_back(Pair("bytes", level.nBytes));
+        obj.push_back(Pair("compaction_time", level.dCompactionTime));
+        obj.push_back(Pair("compaction_read_mb", level.dCompactionReadMB));
+        obj.push_back(Pair("compaction_write_mb", level.dCompactionWriteMB));
+        levels.push_back(obj);
+        dCompactionTime += level.dCompactionTime;
+    }
+
+    const uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("options", options));
+    ret.push_back(Pair("reads", stats.nReads));
+    ret.push_back(Pair("read_misses", stats.nReadMisses));
+    ret.push_back(Pair("read_bytes", stats.nReadBytes));
+    ret.push_back(Pair("batches", stats.nBatches));
+    ret.push_back(Pair("batch_bytes", stats.nBatchBytes));
+    ret.push_back(Pair("cache_hits", stats.nCacheHits));
+    ret.push_back(Pair("cache_misses", stats.nCacheMisses));
+    ret.push_back(Pair("cache_hit_rate", nLookups ? (double)stats.nCacheHits / nLookups : 0.0));
+    ret.push_back(Pair("cache_usage", (uint64_t)stats.nCacheUsage));
+    ret.push_back(Pair("memory_usage", (uint64_t)stats.nMemoryUsage));
+    ret.push_back(Pair("compaction_time", dCompactionTime));
+    ret.push_back(Pair("levels", levels));
+    return ret;
+}
+
+UniValue getdbstats(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getdbstats\n"
+            "\nReturns the settings of the chainstate and block index databases, what they did since the node\n"
+            "started and how LevelDB has laid out their files.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {           (json object) the chainstate database, blockindex has the same fields\n"
+            "    \"options\": {            (json object) the settings it was opened with, in bytes\n"
+            "      \"block_size\": n, \"compression\": true|false, \"max_open_files\": n,\n"
+            "      \"write_buffer_size\": n, \"block_cache_size\": n\n"
+            "    },\n"
+            "    \"reads\": n,             (numeric) reads of single entries\n"
+            "    \"read_misses\": n,       (numeric) reads of entries that do not exist\n"
+            "    \"read_bytes\": n,        (numeric) the size of the values read\n"
+            "    \"batches\": n,           (numeric) batches written\n"
+            "    \"batch_bytes\": n,       (numeric) the size of the batches written\n"
+            "    \"cache_hits\": n,        (numeric) blocks LevelDB found in its block cache\n"
+            "    \"cache_misses\": n,      (numeric) blocks it did not, it keeps none of the files it maps into memory\n"
+            "    \"cache_hit_rate\": x.xx, (numeric) the share of blocks found in the cache\n"
+            "    \"cache_usage\": n,       (numeric) the bytes in the block cache\n"
+            "    \"memory_usage\": n,      (numeric) the bytes in the block cache and the write buffers\n"
+            "    \"compaction_time\": n,   (numeric) the seconds spent compacting\n"
+            "    \"levels\": [             (json array) the levels of the database\n"
+            "      {\n"
+            "        \"level\": n, \"files\": n, \"bytes\": n,\n"
+            "        \"compaction_time\": n,  (numeric) the seconds spent compacting into this level\n"
+            "        \"compaction_read_mb\": n, \"compaction_write_mb\": n\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  },\n"
+            "  \"blockindex\": {...}\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") + HelpExampleRpc("getdbstats", ""));
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("chainstate", DBStatsToJSON(pcoinsdbview->GetDBStats())));
+    ret.push_back(Pair("blockindex", DBStatsToJSON(pnetMan->getChainActive()->pblocktree->GetStats())));
+    return ret;
+}
+
+UniValue getvalidationstats(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationstats\n"
+            "\nReturns how long the stages of connecting the blocks connected to the tip since the node started "
+            "took. check, forks, inputs, scripts, undo and index are the parts of connect.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": n,              (numeric) the blocks connected\n"
+            "  \"inputs\": n,              (numeric) the inputs of their transactions\n"
+            "  \"stages\": {\n"
+            "    \"read\": {               (json object) loading the block from disk, the other stages are connect,\n"
+            "                             check, forks, inputs, scripts, undo, index, flush, chainstate,\n"
+            "                             postconnect and total\n" +
+            HelpTimeHistogram("      ") +
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getvalidationstats", "") + HelpExampleRpc("getvalidationstats", ""));
+
+    const CBlockConnectStats stats = GetBlockConnectStats();
+    const CBlockConnectTimes times = GetBlockConnectTimes();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blocks", times.nBlocks));
+    ret.push_back(Pair("inputs", times.nInputs));
+    UniValue stages(UniValue::VOBJ);
+    for (int i = 0; i < BLOCKSTAGE_COUNT; i++)
+        stages.push_back(Pair(BlockConnectStageName(i), TimeHistogramToJSON(stats.vStages[i])));
+    ret.push_back(Pair("stages", stages));
+    return ret;
+}
+
+UniValue getblockstats(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "getblockstats ( count )\n"
+            "\nReturns how long the stages of connecting the blocks connected to the tip last took, newest "
+            "first. The node keeps the last " +
+            std::to_string(BLOCK_CONNECT_RECORDS) +
+            ".\n"
+            "\nArguments:\n"
+            "1. count      (numeric, optional, default=all kept) How many blocks to return\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"hash\": \"hash\",         (string) the block hash\n"
+            "    \"height\": n,            (numeric) the block height\n"
+            "    \"tx\": n,                (numeric) the transactions in the block\n"
+            "    \"inputs\": n,            (numeric) the inputs of the transactions\n"
+            "    \"time\": n,              (numeric) when it was connected, in seconds since the epoch\n"
+            "    \"stages\": {             (json object) the milliseconds of each stage, as getvalidationstats\n"
+            "      \"read\": x.xxx, ...\n"
+            "    }\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockstats", "") + HelpExampleCli("getblockstats", "10") +
+            HelpExampleRpc("getblockstats", "10"));
+
+    const CBlockConnectStats stats = GetBlockConnectStats();
+    size_t nCount = stats.vRecent.size();
+    if (params.size() > 0)
+    {
+        if (params[0].get_int() < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+        nCount = std::min(nCount, (size_t)params[0].get_int());
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < nCount; i++)
+    {
+        const CBlockConnectRecord &record = stats.vRecent[i];
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("hash", record.hash.GetHex()));
+        obj.push_back(Pair("height", record.nHeight));
+        obj.push_back(Pair("tx", (uint64_t)record.nTx));
+        obj.push_back(Pair("inputs", (uint64_t)record.nInputs));
+        obj.push_back(Pair("time", record.nTime));
+        UniValue stages(UniValue::VOBJ);
+        for (int j = 0; j < BLOCKSTAGE_COUNT; j++)
+            stages.push_back(Pair(BlockConnectStageName(j), record.vMicros[j] / 1000.0));
+        obj.push_back(Pair("stages", stages));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue gettxout(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -671,14 +1299,7 @@ static UniValue SoftForkMajorityDesc(int minVersion,
     int nRequired,
     const Consensus::Params &consensusParams)
 {
-    int nFound = 0;
-    CBlockIndex *pstart = pindex;
-    for (int i = 0; i < consensusParams.nMajorityWindow && pstart != NULL; i++)
-    {
-        if (pstart->nVersion >= minVersion)
-            ++nFound;
-        pstart = pstart->pprev;
-    }
+    const int nFound = CountBlockVersions(minVersion, pindex, consensusParams);
 
     UniValue rv(UniValue::VOBJ);
     rv.push_back(Pair("status", nFound >= nRequired));
@@ -747,7 +1368,15 @@ UniValue getblockchaininfo(const UniValue &params, bool fHelp)
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
-            "  \"pruneheight\": xxxxxx,    (numeric) heighest block available\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored, only present if pruning is "
+            "enabled\n"
+            "  \"verifydb\": {             (object) the -checkblocks verification of the block database\n"
+            "     \"running\": xx,          (boolean) if it is running, in the background with -checkbackground\n"
+            "     \"checklevel\": xx,       (numeric) the level it verifies at\n"
+            "     \"blocks\": xx,           (numeric) the blocks it verifies\n"
+            "     \"checked\": xx,          (numeric) the blocks read and checked at levels 0 to 2 so far\n"
+            "     \"verified\": xx          (boolean) if the last one that finished found no problems\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -788,6 +1417,24 @@ UniValue getblockchaininfo(const UniValue &params, bool fHelp)
         Checkpoints::GuessVerificationProgress(pnetMan->getActivePaymentNetwork()->Checkpoints(),
                            pnetMan->getChainActive()->chainActive.Tip())));
     obj.push_back(Pair("chainwork", pnetMan->getChainActive()->chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode)
+    {
+        CBlockIndex *block = pnetMan->getChainActive()->chainActive.Tip();
+        while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+            block = block->pprev;
+
+        obj.push_back(Pair("pruneheight", block->nHeight));
+    }
+
+    const CVerifyProgress verify = GetVerifyProgress();
+    UniValue verifydb(UniValue::VOBJ);
+    verifydb.push_back(Pair("running", verify.fRunning));
+    verifydb.push_back(Pair("checklevel", verify.nCheckLevel));
+    verifydb.push_back(Pair("blocks", verify.nBlocks));
+    verifydb.push_back(Pair("checked", verify.nChecked));
+    verifydb.push_back(Pair("verified", verify.fVerified));
+    obj.push_back(Pair("verifydb", verifydb));
 
     const Consensus::Params &consensusParams = pnetMan->getActivePaymentNetwork()->GetConsensus();
     CBlockIndex *tip = pnetMan->getChainActive()->chainActive.Tip();
@@ -834,12 +1481,12 @@ static std::set<CBlockIndex *, CompareBlocksByHeight> GetChainTips()
 
     AssertLockHeld(cs_main); // for chainActive
     READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
-    for (const std::pair<const uint256, CBlockIndex *> &item : pnetMan->getChainActive()->mapBlockIndex)
+    for (CBlockIndex *pindex : pnetMan->getChainActive()->mapBlockIndex)
     {
-        if (!pnetMan->getChainActive()->chainActive.Contains(item.second))
+        if (!pnetMan->getChainActive()->chainActive.Contains(pindex))
         {
-            setOrphans.insert(item.second);
-            setPrevs.insert(item.second->pprev);
+            setOrphans.insert(pindex);
+            setPrevs.insert(pindex->pprev);
         }
     }
 
@@ -877,7 +1524,8 @@ UniValue getchaintips(const UniValue &params, bool fHelp)
             "    \"hash\": \"xxxx\",\n"
             "    \"branchlen\": 1          (numeric) length of branch connecting the tip to the main chain\n"
             "    \"status\": \"xxxx\"        (string) status of the chain (active, valid-fork, valid-headers, "
-            "headers-only, invalid)\n"
+            "headers-only, invalid, pruned)\n"
+            "    \"pruned\": n            (numeric, pruned only) headers of the branch that were dropped\n"
             "  }\n"
             "]\n"
             "Possible values for status:\n"
@@ -887,6 +1535,8 @@ UniValue getchaintips(const UniValue &params, bool fHelp)
             "validated\n"
             "4.  \"valid-fork\"            This branch is not part of the active chain, but is fully validated\n"
             "5.  \"active\"                This is the tip of the active main chain, which is certainly valid\n"
+            "6.  \"pruned\"                The headers of this stale branch were dropped, see -prunestaleheaders, "
+            "only the most recent ones are listed\n"
             "\nExamples:\n" +
             HelpExampleCli("getchaintips", "") + HelpExampleRpc("getchaintips", ""));
 
@@ -944,6 +1594,17 @@ UniValue getchaintips(const UniValue &params, bool fHelp)
         res.push_back(obj);
     }
 
+    for (const CPrunedHeaderTip &tip : pnetMan->getChainActive()->headerPruneStats.dequeRecentTips)
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("height", tip.nHeight));
+        obj.push_back(Pair("hash", tip.hash.GetHex()));
+        obj.push_back(Pair("branchlen", tip.nBranchLen));
+        obj.push_back(Pair("status", "pruned"));
+        obj.push_back(Pair("pruned", (uint64_t)tip.nHeaders));
+        res.push_back(obj);
+    }
+
     return res;
 }
 
@@ -952,7 +1613,15 @@ UniValue mempoolInfoToJSON()
     UniValue ret(UniValue::VOBJ);
     ret.push_back(Pair("size", (int64_t)mempool.size()));
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
-    ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+    const MempoolMemoryUsage usage = mempool.GetMemoryUsage();
+    ret.push_back(Pair("usage", (int64_t)usage.Total()));
+    UniValue breakdown(UniValue::VOBJ);
+    breakdown.push_back(Pair("entries", (int64_t)usage.nEntries));
+    breakdown.push_back(Pair("transactions", (int64_t)usage.nTransactions));
+    breakdown.push_back(Pair("links", (int64_t)usage.nLinks));
+    breakdown.push_back(Pair("spends", (int64_t)usage.nNextTx));
+    breakdown.push_back(Pair("deltas", (int64_t)usage.nDeltas));
+    ret.push_back(Pair("usagebreakdown", breakdown));
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.push_back(Pair("maxmempool", (int64_t)maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
@@ -970,6 +1639,13 @@ UniValue getmempoolinfo(const UniValue &params, bool fHelp)
                                  "  \"size\": xxxxx,               (numeric) Current tx count\n"
                                  "  \"bytes\": xxxxx,              (numeric) Sum of all tx sizes\n"
                                  "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
+                                 "  \"usagebreakdown\": {           (json object) Memory usage by component\n"
+                                 "    \"entries\": xxxxx,           (numeric) Mempool entries and their index nodes\n"
+                                 "    \"transactions\": xxxxx,      (numeric) Transactions held by the entries\n"
+                                 "    \"links\": xxxxx,             (numeric) Parent and child links stored outside the entries\n"
+                                 "    \"spends\": xxxxx,            (numeric) Index of outpoints spent by mempool transactions\n"
+                                 "    \"deltas\": xxxxx             (numeric) Fee and priority deltas from prioritisetransaction\n"
+                                 "  },\n"
                                  "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
                                  "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
                                  "}\n"
@@ -979,6 +1655,36 @@ UniValue getmempoolinfo(const UniValue &params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue getmempoolrejects(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getmempoolrejects\n"
+            "\nReturns how many transactions each stage of mempool admission turned away since the node started, "
+            "by reject reason. The stages run cheapest first: check, pool, fee, inputs, scripts and commit.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"check\": {                (json object) the stage, with every reason it rejected for\n"
+            "    \"reason\": n,             (numeric) the transactions rejected for it\n"
+            "    ...\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmempoolrejects", "") + HelpExampleRpc("getmempoolrejects", ""));
+
+    const CMempoolRejectStats stats = GetMempoolRejectStats();
+    UniValue ret(UniValue::VOBJ);
+    for (int i = 0; i < MEMPOOLSTAGE_COUNT; i++)
+    {
+        UniValue reasons(UniValue::VOBJ);
+        for (const auto &reason : stats.vReasons[i])
+            reasons.push_back(Pair(reason.first, reason.second));
+        ret.push_back(Pair(MempoolAcceptStageName(i), reasons));
+    }
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -42,17 +42,23 @@ static const CRPCConvertParam vRPCConvertParams[] = {{"stop", 0}, {"setmocktime"
     {"listreceivedbyaddress", 0}, {"listreceivedbyaddress", 1}, {"listreceivedbyaddress", 2},
     {"listreceivedbyaccount", 0}, {"listreceivedbyaccount", 1}, {"listreceivedbyaccount", 2}, {"getbalance", 1},
     {"getbalance", 2}, {"getblockhash", 0}, {"move", 2}, {"move", 3}, {"sendfrom", 2}, {"sendfrom", 3},
-    {"listtransactions", 1}, {"listtransactions", 2}, {"listtransactions", 3}, {"listaccounts", 0}, {"listaccounts", 1},
-    {"walletpassphrase", 1}, {"walletpassphrase", 2}, {"getblocktemplate", 0}, {"listsinceblock", 1},
+    {"listtransactions", 1}, {"listtransactions", 2}, {"listtransactions", 3}, {"listtransactions", 4},
+    {"listaccounts", 0}, {"listaccounts", 1}, {"walletpassphrase", 1}, {"walletpassphrase", 2}, {"getblocktemplate", 0}, {"listsinceblock", 1},
     {"listsinceblock", 2}, {"sendmany", 1}, {"sendmany", 2}, {"sendmany", 4}, {"addmultisigaddress", 0},
     {"addmultisigaddress", 1}, {"createmultisig", 0}, {"createmultisig", 1}, {"listunspent", 0}, {"listunspent", 1},
     {"listunspent", 2}, {"getblock", 1}, {"getblockheader", 1}, {"gettransaction", 1}, {"getrawtransaction", 1},
     {"createrawtransaction", 0}, {"createrawtransaction", 1}, {"createrawtransaction", 2}, {"signrawtransaction", 1},
-    {"signrawtransaction", 2}, {"sendrawtransaction", 1}, {"fundrawtransaction", 1}, {"gettxout", 1}, {"gettxout", 2},
+    {"signrawtransaction", 2}, {"sendrawtransaction", 1}, {"sendrawtransactions", 0},
+    {"sendrawtransactions", 1}, {"fundrawtransaction", 1}, {"gettxout", 1}, {"gettxout", 2},
     {"gettxoutproof", 0}, {"lockunspent", 0}, {"lockunspent", 1}, {"importprivkey", 2}, {"importaddress", 2},
-    {"importaddress", 3}, {"importpubkey", 2}, {"verifychain", 0}, {"verifychain", 1}, {"keypoolrefill", 0},
-    {"getrawmempool", 0}, {"estimatefee", 0}, {"estimatesmartfee", 0}, {"prioritisetransaction", 1},
-    {"prioritisetransaction", 2}, {"setban", 2}, {"setban", 3}, {"generatetoaddress", 0}, {"generatetoaddress", 2}};
+    {"importaddress", 3}, {"importpubkey", 2}, {"importmulti", 0}, {"importmulti", 1}, {"verifychain", 0},
+    {"verifychain", 1}, {"keypoolrefill", 0}, {"scantxoutset", 1},
+    {"getrawmempool", 0}, {"getrawmempool", 1}, {"estimatefee", 0}, {"estimatesmartfee", 0}, {"prioritisetransaction", 1},
+    {"prioritisetransaction", 2}, {"setban", 2}, {"setban", 3}, {"generatetoaddress", 0}, {"generatetoaddress", 2},
+    {"getlockstats", 0}, {"getaddressbalance", 0}, {"getaddressutxos", 0}, {"getaddresstxids", 0},
+    {"getspentinfo", 0}, {"getblockstats", 0}, {"generatesyntheticchain", 0}, {"generatesyntheticchain", 1},
+    {"generatesyntheticchain", 2}, {"generatesyntheticchain", 3}, {"generatesyntheticchain", 4},
+    {"generatesyntheticchain", 5}};
 
 class CRPCConvertTable
 {
@@ -34,6 +34,7 @@
 #include <stdint.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/assign/list_of.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <univalue.h>
@@ -89,6 +90,20 @@ std::string DecodeDumpString(const std::string &str)
     return ret.str();
 }
 
+/** The genesis block of the active chain, where a rescan after an import starts */
+static CBlockIndex *GetGenesisForRescan()
+{
+    LOCK(cs_main);
+    return pnetMan->getChainActive()->chainActive.Genesis();
+}
+
+/** The imports rescan without cs_main and cs_wallet held, so only one of them can rescan at a time */
+static void EnsureWalletIsNotRescanning()
+{
+    if (pwalletMain->IsScanning())
+        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
+}
+
 UniValue importprivkey(const UniValue &params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -111,9 +126,7 @@ UniValue importprivkey(const UniValue &params, bool fHelp)
             HelpExampleRpc("importprivkey", "\"mykey\", \"testing\", false"));
 
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    EnsureWalletIsUnlocked();
+    EnsureWalletIsNotRescanning();
 
     std::string strSecret = params[0].get_str();
     std::string strLabel = "";
@@ -139,6 +152,10 @@ UniValue importprivkey(const UniValue &params, bool fHelp)
     assert(key.VerifyPubKey(pubkey));
     CKeyID vchAddress = pubkey.GetID();
     {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        EnsureWalletIsUnlocked();
+
         pwalletMain->MarkDirty();
         pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
 
@@ -153,11 +170,11 @@ UniValue importprivkey(const UniValue &params, bool fHelp)
 
         // whenever a key is imported, we need to scan the whole chain
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+    }
 
-        if (fRescan)
-        {
-            pwalletMain->ScanForWalletTransactions(pnetMan->getChainActive()->chainActive.Genesis(), true);
-        }
+    if (fRescan)
+    {
+        pwalletMain->ScanForWalletTransactions(GetGenesisForRescan(), true);
     }
 
     return NullUniValue;
@@ -229,29 +246,33 @@ UniValue importaddress(const UniValue &params, bool fHelp)
     if (params.size() > 3)
         fP2SH = params[3].get_bool();
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    CBitcoinAddress address(params[0].get_str());
-    if (address.IsValid())
-    {
-        if (fP2SH)
-            throw JSONRPCError(
-                RPC_INVALID_ADDRESS_OR_KEY, "Cannot use the p2sh flag with an address - use a script instead");
-        ImportAddress(address, strLabel);
-    }
-    else if (IsHex(params[0].get_str()))
+    EnsureWalletIsNotRescanning();
     {
-        std::vector<unsigned char> data(ParseHex(params[0].get_str()));
-        ImportScript(CScript(data.begin(), data.end()), strLabel, fP2SH);
-    }
-    else
-    {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Bitcoin address or script");
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        CBitcoinAddress address(params[0].get_str());
+        if (address.IsValid())
+        {
+            if (fP2SH)
+                throw JSONRPCError(
+                    RPC_INVALID_ADDRESS_OR_KEY, "Cannot use the p2sh flag with an address - use a script instead");
+            ImportAddress(address, strLabel);
+        }
+        else if (IsHex(params[0].get_str()))
+        {
+            std::vector<unsigned char> data(ParseHex(params[0].get_str()));
+            ImportScript(CScript(data.begin(), data.end()), strLabel, fP2SH);
+        }
+        else
+        {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Bitcoin address or script");
+        }
     }
 
     if (fRescan)
     {
-        pwalletMain->ScanForWalletTransactions(pnetMan->getChainActive()->chainActive.Genesis(), true);
+        pwalletMain->ScanForWalletTransactions(GetGenesisForRescan(), true);
+        LOCK2(cs_main, pwalletMain->cs_wallet);
         pwalletMain->ReacceptWalletTransactions();
     }
 
@@ -296,14 +317,18 @@ UniValue importpubkey(const UniValue &params, bool fHelp)
     if (!pubKey.IsFullyValid())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Pubkey is not a valid public key");
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    EnsureWalletIsNotRescanning();
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    ImportAddress(CBitcoinAddress(pubKey.GetID()), strLabel);
-    ImportScript(GetScriptForRawPubKey(pubKey), strLabel, false);
+        ImportAddress(CBitcoinAddress(pubKey.GetID()), strLabel);
+        ImportScript(GetScriptForRawPubKey(pubKey), strLabel, false);
+    }
 
     if (fRescan)
     {
-        pwalletMain->ScanForWalletTransactions(pnetMan->getChainActive()->chainActive.Genesis(), true);
+        pwalletMain->ScanForWalletTransactions(GetGenesisForRescan(), true);
+        LOCK2(cs_main, pwalletMain->cs_wallet);
         pwalletMain->ReacceptWalletTransactions();
     }
 
@@ -327,94 +352,357 @@ UniValue importwallet(const UniValue &params, bool fHelp)
                                  HelpExampleCli("importwallet", "\"test\"") + "\nImport using the json rpc call\n" +
                                  HelpExampleRpc("importwallet", "\"test\""));
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    EnsureWalletIsNotRescanning();
 
-    EnsureWalletIsUnlocked();
+    bool fGood = true;
+    CBlockIndex *pindex = nullptr;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        CWalletBatch batch(pwalletMain);
 
-    std::ifstream file;
-    file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
-    if (!file.is_open())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
+        EnsureWalletIsUnlocked();
 
-    int64_t nTimeBegin = pnetMan->getChainActive()->chainActive.Tip()->GetBlockTime();
+        std::ifstream file;
+        file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
+        if (!file.is_open())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
 
-    bool fGood = true;
+        int64_t nTimeBegin = pnetMan->getChainActive()->chainActive.Tip()->GetBlockTime();
 
-    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-    file.seekg(0, file.beg);
+        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+        file.seekg(0, file.beg);
 
-    pwalletMain->ShowProgress("Importing...", 0); // show progress dialog in GUI
-    while (file.good())
+        pwalletMain->ShowProgress("Importing...", 0); // show progress dialog in GUI
+        while (file.good())
+        {
+            pwalletMain->ShowProgress(
+                "", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+            std::string line;
+            std::getline(file, line);
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::vector<std::string> vstr;
+            boost::split(vstr, line, boost::is_any_of(" "));
+            if (vstr.size() < 2)
+                continue;
+            CBitcoinSecret vchSecret;
+            if (!vchSecret.SetString(vstr[0]))
+                continue;
+            CKey key = vchSecret.GetKey();
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID keyid = pubkey.GetID();
+            if (pwalletMain->HaveKey(keyid))
+            {
+                LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
+                continue;
+            }
+            int64_t nTime = DecodeDumpTime(vstr[1]);
+            std::string strLabel;
+            bool fLabel = true;
+            for (unsigned int nStr = 2; nStr < vstr.size(); nStr++)
+            {
+                if (boost::algorithm::starts_with(vstr[nStr], "#"))
+                    break;
+                if (vstr[nStr] == "change=1")
+                    fLabel = false;
+                if (vstr[nStr] == "reserve=1")
+                    fLabel = false;
+                if (boost::algorithm::starts_with(vstr[nStr], "label="))
+                {
+                    strLabel = DecodeDumpString(vstr[nStr].substr(6));
+                    fLabel = true;
+                }
+            }
+            LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
+            if (!pwalletMain->AddKeyPubKey(key, pubkey))
+            {
+                fGood = false;
+                continue;
+            }
+            pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
+            if (fLabel)
+                pwalletMain->SetAddressBook(keyid, strLabel, "receive");
+            nTimeBegin = std::min(nTimeBegin, nTime);
+        }
+        file.close();
+        pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
+
+        pindex = pnetMan->getChainActive()->chainActive.Tip();
+        while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
+            pindex = pindex->pprev;
+
+        if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
+            pwalletMain->nTimeFirstKey = nTimeBegin;
+
+        LogPrintf("Rescanning last %i blocks\n",
+            pnetMan->getChainActive()->chainActive.Height() - pindex->nHeight + 1);
+    }
+
+    pwalletMain->ScanForWalletTransactions(pindex);
     {
-        pwalletMain->ShowProgress(
-            "", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
-        std::string line;
-        std::getline(file, line);
-        if (line.empty() || line[0] == '#')
-            continue;
-
-        std::vector<std::string> vstr;
-        boost::split(vstr, line, boost::is_any_of(" "));
-        if (vstr.size() < 2)
-            continue;
-        CBitcoinSecret vchSecret;
-        if (!vchSecret.SetString(vstr[0]))
-            continue;
-        CKey key = vchSecret.GetKey();
-        CPubKey pubkey = key.GetPubKey();
-        assert(key.VerifyPubKey(pubkey));
-        CKeyID keyid = pubkey.GetID();
-        if (pwalletMain->HaveKey(keyid))
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        pwalletMain->MarkDirty();
+    }
+
+    if (!fGood)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error adding some keys to wallet");
+
+    return NullUniValue;
+}
+
+/** Import one request of importmulti, cs_main and cs_wallet have to be held. Throws a JSONRPCError if it is not
+ *  valid, the wallet is only changed once the whole request was checked.
+ */
+static void ProcessImport(const UniValue &data, int64_t nTimestamp)
+{
+    const UniValue &scriptPubKey = find_value(data, "scriptPubKey");
+    const UniValue &redeemScriptHex = find_value(data, "redeemscript");
+    const UniValue &keys = find_value(data, "keys");
+    const UniValue &label = find_value(data, "label");
+    const UniValue &watchonly = find_value(data, "watchonly");
+    const std::string strLabel = label.isNull() ? "" : label.get_str();
+    const bool fWatchOnly = watchonly.isNull() ? false : watchonly.get_bool();
+
+    // the script, from its hex or the address it pays to
+    CScript script;
+    CTxDestination dest;
+    if (scriptPubKey.isStr())
+    {
+        if (!IsHex(scriptPubKey.get_str()))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid scriptPubKey");
+        std::vector<unsigned char> vData(ParseHex(scriptPubKey.get_str()));
+        script = CScript(vData.begin(), vData.end());
+        ExtractDestination(script, dest);
+    }
+    else if (scriptPubKey.isObject())
+    {
+        CBitcoinAddress address(find_value(scriptPubKey, "address").get_str());
+        if (!address.IsValid())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        dest = address.Get();
+        script = GetScriptForDestination(dest);
+    }
+    else
+        throw JSONRPCError(RPC_TYPE_ERROR, "scriptPubKey must be a hex string or an object with an address");
+
+    CScript redeemScript;
+    if (!redeemScriptHex.isNull())
+    {
+        if (!IsHex(redeemScriptHex.get_str()))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid redeemscript");
+        std::vector<unsigned char> vData(ParseHex(redeemScriptHex.get_str()));
+        redeemScript = CScript(vData.begin(), vData.end());
+        const CScriptID *scriptID = boost::get<CScriptID>(&dest);
+        if (!scriptID || *scriptID != CScriptID(redeemScript))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "redeemscript does not match the P2SH scriptPubKey");
+    }
+    else if (boost::get<CScriptID>(&dest) && !fWatchOnly)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "A P2SH scriptPubKey needs its redeemscript unless watchonly is set");
+
+    // the keys have to be the ones of a P2PKH script, or belong to the redeem script
+    std::vector<CKey> vKeys;
+    if (!keys.isNull())
+    {
+        for (const UniValue &strSecret : keys.get_array().getValues())
         {
-            LogPrintf("Skipping import of %s (key already present)\n", CBitcoinAddress(keyid).ToString());
-            continue;
+            CBitcoinSecret vchSecret;
+            if (!vchSecret.SetString(strSecret.get_str()))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
+            CKey key = vchSecret.GetKey();
+            if (!key.IsValid())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Private key outside allowed range");
+            const CKeyID *keyID = boost::get<CKeyID>(&dest);
+            if (redeemScript.empty() && (!keyID || *keyID != key.GetPubKey().GetID()))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Key does not match the scriptPubKey");
+            vKeys.push_back(key);
         }
-        int64_t nTime = DecodeDumpTime(vstr[1]);
-        std::string strLabel;
-        bool fLabel = true;
-        for (unsigned int nStr = 2; nStr < vstr.size(); nStr++)
+    }
+    if (fWatchOnly && !vKeys.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "watchonly can not be set for a request with keys");
+    if (!fWatchOnly && vKeys.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "A request without keys has to set watchonly");
+    if (!vKeys.empty())
+        EnsureWalletIsUnlocked();
+
+    pwalletMain->MarkDirty();
+    if (fWatchOnly)
+    {
+        if (!redeemScript.empty())
+            ImportScript(redeemScript, strLabel, true);
+        else
+            ImportScript(script, strLabel, false);
+    }
+    else
+    {
+        if (!redeemScript.empty() && !pwalletMain->HaveCScript(redeemScript) &&
+            !pwalletMain->AddCScript(redeemScript))
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding p2sh redeemScript to wallet");
+        for (const CKey &key : vKeys)
         {
-            if (boost::algorithm::starts_with(vstr[nStr], "#"))
-                break;
-            if (vstr[nStr] == "change=1")
-                fLabel = false;
-            if (vstr[nStr] == "reserve=1")
-                fLabel = false;
-            if (boost::algorithm::starts_with(vstr[nStr], "label="))
+            CPubKey pubkey = key.GetPubKey();
+            CKeyID keyid = pubkey.GetID();
+            if (pwalletMain->HaveKey(keyid))
+                continue;
+            if (!pwalletMain->AddKeyPubKey(key, pubkey))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+            pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTimestamp;
+        }
+    }
+    if (!boost::get<CNoDestination>(&dest))
+        pwalletMain->SetAddressBook(dest, strLabel, "receive");
+}
+
+UniValue importmulti(const UniValue &params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw std::runtime_error(
+            "importmulti [{\"scriptPubKey\": \"script\" | {\"address\": \"address\"}, \"timestamp\": n | \"now\", "
+            "...}, ...] ( {\"rescan\": b} )\n"
+            "\nImports scripts, addresses and keys in one database transaction, then rescans once from the earliest "
+            "timestamp.\n"
+            "\nArguments:\n"
+            "1. requests     (array, required) The things to import\n"
+            "  [\n"
+            "    {\n"
+            "      \"scriptPubKey\": \"script\" | {\"address\": \"address\"},  (string or object, required) The hex "
+            "script, or the address it pays to\n"
+            "      \"timestamp\": n | \"now\",     (numeric or string, required) The creation time of the key or "
+            "script, the rescan starts at the earliest one. \"now\" for new ones that need no rescan.\n"
+            "      \"redeemscript\": \"script\",   (string, optional) The redeem script of a P2SH scriptPubKey\n"
+            "      \"keys\": [\"privkey\", ...],  (array, optional) Private keys of a P2PKH scriptPubKey, or of the "
+            "redeem script\n"
+            "      \"watchonly\": b,             (boolean, optional, default=false) Import as watch-only, required "
+            "without keys\n"
+            "      \"label\": \"label\"           (string, optional, default=\"\") The label of the address\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "2. options      (object, optional)\n"
+            "  {\n"
+            "    \"rescan\": b                  (boolean, optional, default=true) Rescan after the import\n"
+            "  }\n"
+            "\nResult:\n"
+            "[                          (array) One result per request, in order\n"
+            "  {\n"
+            "    \"success\": b,            (boolean) Whether the request was imported\n"
+            "    \"error\": {\"code\": n, \"message\": \"text\"}  (object) Why not, only if success is false\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nNote: This call can take minutes to complete if rescan is true.\n"
+            "\nExamples:\n" +
+            HelpExampleCli("importmulti", "'[{\"scriptPubKey\": {\"address\": \"myaddress\"}, \"timestamp\": "
+                                          "1455191478, \"watchonly\": true}]' '{\"rescan\": false}'") +
+            HelpExampleRpc("importmulti", "[{\"scriptPubKey\": {\"address\": \"myaddress\"}, \"timestamp\": "
+                                          "1455191478, \"watchonly\": true}]"));
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VOBJ));
+    const UniValue &requests = params[0];
+
+    bool fRescan = true;
+    if (params.size() > 1)
+    {
+        const UniValue &rescan = find_value(params[1], "rescan");
+        if (!rescan.isNull())
+            fRescan = rescan.get_bool();
+    }
+
+    EnsureWalletIsNotRescanning();
+
+    UniValue response(UniValue::VARR);
+    response.reserve(requests.size());
+    bool fAnySuccess = false;
+    CBlockIndex *pindex = nullptr;
+    int nRescanBlocks = 0;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        // all requests go to the database in one transaction
+        CWalletBatch batch(pwalletMain);
+
+        const int64_t nNow = pnetMan->getChainActive()->chainActive.Tip()->GetBlockTime();
+        int64_t nLowestTimestamp = nNow;
+        for (const UniValue &data : requests.getValues())
+        {
+            UniValue result(UniValue::VOBJ);
+            try
+            {
+                if (!data.isObject())
+                    throw JSONRPCError(RPC_TYPE_ERROR, "A request has to be an object");
+                const UniValue &timestamp = find_value(data, "timestamp");
+                int64_t nTimestamp;
+                if (timestamp.isNum())
+                    nTimestamp = timestamp.get_int64();
+                else if (timestamp.isStr() && timestamp.get_str() == "now")
+                    nTimestamp = nNow;
+                else
+                    throw JSONRPCError(RPC_TYPE_ERROR, "timestamp has to be a number or \"now\"");
+
+                ProcessImport(data, nTimestamp);
+                result.pushKVEnd("success", true);
+                fAnySuccess = true;
+                nLowestTimestamp = std::min(nLowestTimestamp, nTimestamp);
+            }
+            catch (const UniValue &error)
+            {
+                result.pushKVEnd("success", false);
+                result.pushKVEnd("error", error);
+            }
+            catch (const std::exception &e)
             {
-                strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                fLabel = true;
+                result.pushKVEnd("success", false);
+                result.pushKVEnd("error", JSONRPCError(RPC_MISC_ERROR, e.what()));
             }
+            response.push_back(std::move(result));
         }
-        LogPrintf("Importing %s...\n", CBitcoinAddress(keyid).ToString());
-        if (!pwalletMain->AddKeyPubKey(key, pubkey))
+
+        if (fAnySuccess)
         {
-            fGood = false;
-            continue;
+            if (!pwalletMain->nTimeFirstKey || nLowestTimestamp < pwalletMain->nTimeFirstKey)
+                pwalletMain->nTimeFirstKey = std::max<int64_t>(nLowestTimestamp, 1);
+            // blocks can be up to two hours older than the time their keys were made
+            pindex = pnetMan->getChainActive()->chainActive.Tip();
+            while (pindex && pindex->pprev && pindex->GetBlockTime() > nLowestTimestamp - 7200)
+                pindex = pindex->pprev;
+            nRescanBlocks = pnetMan->getChainActive()->chainActive.Height() - pindex->nHeight + 1;
         }
-        pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
-        if (fLabel)
-            pwalletMain->SetAddressBook(keyid, strLabel, "receive");
-        nTimeBegin = std::min(nTimeBegin, nTime);
     }
-    file.close();
-    pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
 
-    CBlockIndex *pindex = pnetMan->getChainActive()->chainActive.Tip();
-    while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
-        pindex = pindex->pprev;
-
-    if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
-        pwalletMain->nTimeFirstKey = nTimeBegin;
+    if (fAnySuccess && fRescan && pindex)
+    {
+        LogPrintf("Rescanning last %i blocks for importmulti\n", nRescanBlocks);
+        pwalletMain->ScanForWalletTransactions(pindex, true);
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        pwalletMain->ReacceptWalletTransactions();
+    }
 
-    LogPrintf("Rescanning last %i blocks\n", pnetMan->getChainActive()->chainActive.Height() - pindex->nHeight + 1);
-    pwalletMain->ScanForWalletTransactions(pindex);
-    pwalletMain->MarkDirty();
+    return response;
+}
 
-    if (!fGood)
-        throw JSONRPCError(RPC_WALLET_ERROR, "Error adding some keys to wallet");
+UniValue abortrescan(const UniValue &params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
 
-    return NullUniValue;
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error("abortrescan\n"
+                                 "\nStops the current wallet rescan triggered e.g. by an importprivkey call.\n"
+                                 "\nResult:\n"
+                                 "true|false      (boolean) whether a rescan was running and is stopping\n"
+                                 "\nExamples:\n"
+                                 "\nImport a private key\n" +
+                                 HelpExampleCli("importprivkey", "\"mykey\"") + "\nAbort the running wallet rescan\n" +
+                                 HelpExampleCli("abortrescan", "") + "\nAs a JSON-RPC call\n" +
+                                 HelpExampleRpc("abortrescan", ""));
+
+    if (!pwalletMain->IsScanning())
+        return false;
+    pwalletMain->AbortRescan();
+    return true;
 }
 
 UniValue dumpprivkey(const UniValue &params, bool fHelp)
@@ -22,6 +22,8 @@
 #include "args.h"
 #include "base58.h"
 #include "blockgeneration/blockgeneration.h"
+#include "blockgeneration/miner.h"
+#include "blockgeneration/syntheticchain.h"
 #include "chain/chain.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
@@ -40,6 +42,8 @@
 #include "util/utilstrencodings.h"
 #include "validationinterface.h"
 
+#include <atomic>
+#include <cstdlib>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -408,6 +412,82 @@ UniValue generatepostoaddress(const UniValue &params, bool fHelp)
     return generateBlocks(coinbaseScript, nGenerate, nMaxTries, true, true);
 }
 
+UniValue generatesyntheticchain(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 6)
+        throw std::runtime_error(
+            "generatesyntheticchain numblocks ( txsperblock inputspertx outputspertx chainlength seed )\n"
+            "\nMine numblocks blocks full of transactions on the tip for benchmarks, without the wallet or the "
+            "mempool.\n"
+            "The coinbases pay to a key derived from seed and the transactions spend what the chain paid to it, so "
+            "the same arguments on the same tip give the same blocks. The blocks are processed as any other, the "
+            "datadir then has block files that -reindex can start from and the chainstate that goes with them.\n"
+            "The coinbases mature after " +
+            std::to_string(COINBASE_MATURITY) +
+            " blocks, the blocks before that only have their coinbase. importprivkey with the returned key and "
+            "generatepos add proof-of-stake blocks on top.\n"
+            "\nNote: this function can only be used on the regtest network\n"
+            "\nArguments:\n"
+            "1. numblocks    (numeric, required) How many blocks to mine\n"
+            "2. txsperblock  (numeric, optional, default=100) Transactions per block, as far as there are outputs to "
+            "spend\n"
+            "3. inputspertx  (numeric, optional, default=2) Inputs of the first transaction of each chain\n"
+            "4. outputspertx (numeric, optional, default=2) Outputs of each transaction\n"
+            "5. chainlength  (numeric, optional, default=1) Transactions in a row in a block, each spending an output "
+            "of the one before\n"
+            "6. seed         (numeric, optional, default=0) Seed of the key the chain pays to\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": n,          (numeric) height of the tip\n"
+            "  \"bestblockhash\": \"hash\", (string) hash of the tip\n"
+            "  \"transactions\": n,    (numeric) transactions mined besides the coinbases\n"
+            "  \"inputs\": n,          (numeric) inputs of those\n"
+            "  \"outputs\": n,         (numeric) outputs of those\n"
+            "  \"spendable\": n,       (numeric) unspent outputs of the key, coinbases included\n"
+            "  \"privkey\": \"key\",     (string) the key the chain pays to\n"
+            "  \"seconds\": x.xxx      (numeric) how long it took\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("generatesyntheticchain", "1000 200 2 2 3") +
+            HelpExampleRpc("generatesyntheticchain", "1000, 200, 2, 2, 3"));
+
+    if (!pnetMan->getActivePaymentNetwork()->MineBlocksOnDemand())
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "This method can only be used on regtest");
+
+    CSyntheticChainParams chain;
+    chain.nBlocks = params[0].get_int();
+    if (params.size() > 1)
+        chain.nTxsPerBlock = params[1].get_int();
+    if (params.size() > 2)
+        chain.nInputsPerTx = params[2].get_int();
+    if (params.size() > 3)
+        chain.nOutputsPerTx = params[3].get_int();
+    if (params.size() > 4)
+        chain.nChainLength = params[4].get_int();
+    if (params.size() > 5)
+        chain.nSeed = params[5].get_int64();
+    if (chain.nBlocks < 0 || chain.nTxsPerBlock < 0 || chain.nInputsPerTx < 1 || chain.nOutputsPerTx < 1 ||
+        chain.nChainLength < 1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid shape, the counts must be positive");
+
+    const int64_t nStart = GetTimeMicros();
+    CSyntheticChainResult result;
+    std::string strError;
+    if (!GenerateSyntheticChain(chain, result, strError))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", result.nHeight));
+    ret.push_back(Pair("bestblockhash", result.hashTip.GetHex()));
+    ret.push_back(Pair("transactions", result.nTransactions));
+    ret.push_back(Pair("inputs", result.nInputs));
+    ret.push_back(Pair("outputs", result.nOutputs));
+    ret.push_back(Pair("spendable", result.nSpendable));
+    ret.push_back(Pair("privkey", CBitcoinSecret(result.key).ToString()));
+    ret.push_back(Pair("seconds", (GetTimeMicros() - nStart) * 0.000001));
+    return ret;
+}
+
 
 UniValue setgenerate(const UniValue &params, bool fHelp)
 {
@@ -470,6 +550,8 @@ UniValue getmininginfo(const UniValue &params, bool fHelp)
             "setgenerate calls)\n"
             "  \"generatepos\": true|false  (boolean) If the pos generation is on or off (see getgeneratepos or "
             "setgeneratepos calls)\n"
+            "  \"genproclimit\": n           (numeric) The number of proof-of-work miner threads (see -genproclimit)\n"
+            "  \"hashespersec\": n           (numeric) The hashes per second of the proof-of-work miner threads\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmininginfo", "") + HelpExampleRpc("getmininginfo", ""));
@@ -489,6 +571,8 @@ UniValue getmininginfo(const UniValue &params, bool fHelp)
     obj.push_back(Pair("chain", pnetMan->getActivePaymentNetwork()->NetworkIDString()));
     obj.push_back(Pair("generate", getgenerate(params, false)));
     obj.push_back(Pair("generatepos", getgeneratepos(params, false)));
+    obj.push_back(Pair("genproclimit", (int)gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS)));
+    obj.push_back(Pair("hashespersec", minerThreads != nullptr ? dHashesPerSec.load() : 0.0));
     return obj;
 }
 
@@ -545,6 +629,135 @@ static UniValue BIP22ValidationResult(const CValidationState &state)
     return "valid?";
 }
 
+//! seconds between looks at a changed mempool for a new getblocktemplate template
+static const int64_t GBT_REFRESH_INTERVAL = 5;
+//! a changed mempool always makes a new template once the current one is this many seconds old
+static const int64_t GBT_MAX_TEMPLATE_AGE = 60;
+//! a changed mempool makes a new template sooner if its fees differ by more than this percentage
+static const CAmount GBT_FEE_CHANGE_PERCENT = 1;
+
+/** The proof-of-work template served to every getblocktemplate caller, with its transactions
+ *  already encoded. Each new template gets the next version, which longpoll ids carry next
+ *  to the tip they were handed out for.
+ */
+struct CGBTTemplate
+{
+    std::shared_ptr<const CBlockTemplate> pblocktemplate;
+    UniValue transactions;
+    CBlockIndex *pindexPrev;
+    int64_t nStart;
+    CAmount nFees;
+    uint64_t nVersion;
+};
+
+static CCriticalSection cs_gbtTemplate;
+static std::shared_ptr<const CGBTTemplate> pgbtTemplate GUARDED_BY(cs_gbtTemplate);
+static unsigned int nGBTTransactionsUpdated GUARDED_BY(cs_gbtTemplate) = 0;
+static int64_t nGBTLastCheck GUARDED_BY(cs_gbtTemplate) = 0;
+static std::atomic<uint64_t> nGBTVersion(0);
+
+static UniValue EncodeTemplateTransactions(const CBlockTemplate &blocktemplate)
+{
+    UniValue transactions(UniValue::VARR);
+    std::map<uint256, int64_t> setTxIndex;
+    int i = 0;
+    for (auto const &ptx : blocktemplate.block.vtx)
+    {
+        const CTransaction &tx = *ptx;
+        uint256 txHash = tx.GetHash();
+        setTxIndex[txHash] = i++;
+
+        if (tx.IsCoinBase())
+            continue;
+
+        UniValue entry(UniValue::VOBJ);
+
+        entry.push_back(Pair("data", EncodeHexTx(tx)));
+
+        entry.push_back(Pair("hash", txHash.GetHex()));
+
+        UniValue deps(UniValue::VARR);
+        for (auto const &in : tx.vin)
+        {
+            if (setTxIndex.count(in.prevout.hash))
+                deps.push_back(setTxIndex[in.prevout.hash]);
+        }
+        entry.push_back(Pair("depends", deps));
+
+        int index_in_template = i - 1;
+        entry.push_back(Pair("fee", blocktemplate.vTxFees[index_in_template]));
+        entry.push_back(Pair("sigops", blocktemplate.vTxSigOps[index_in_template]));
+
+        transactions.push_back(entry);
+    }
+    return transactions;
+}
+
+/** Return the current getblocktemplate template, making a new one if the tip changed or the
+ *  mempool changed enough to be worth handing out new work for. Needs cs_main held.
+ */
+static std::shared_ptr<const CGBTTemplate> GetGBTTemplate()
+{
+    LOCK(cs_gbtTemplate);
+    CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+    const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    const int64_t nNow = GetTime();
+    if (pgbtTemplate && pgbtTemplate->pindexPrev == pindexTip &&
+        (nTransactionsUpdated == nGBTTransactionsUpdated || nNow - nGBTLastCheck <= GBT_REFRESH_INTERVAL))
+    {
+        return pgbtTemplate;
+    }
+
+    boost::shared_ptr<CReserveScript> coinbaseScript;
+    GetMainSignals().ScriptForMining(coinbaseScript);
+
+    // If the keypool is exhausted, no script is returned at all.  Catch this.
+    if (!coinbaseScript)
+        throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, "Error: Keypool ran out, please call keypoolrefill first");
+
+    // throw an error if no script was provided
+    if (coinbaseScript->reserveScript.empty())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "No coinbase script available (mining requires a wallet)");
+
+    std::shared_ptr<const CBlockTemplate> pblocktemplate =
+        CreateNewBlock(pwalletMain, coinbaseScript->reserveScript, false);
+    if (!pblocktemplate)
+    {
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+    }
+    nGBTTransactionsUpdated = nTransactionsUpdated;
+    nGBTLastCheck = nNow;
+
+    // the coinbase has no fee entry of its own
+    CAmount nFees = 0;
+    for (size_t i = 1; i < pblocktemplate->vTxFees.size(); i++)
+        nFees += pblocktemplate->vTxFees[i];
+
+    // miners restart their work for every new template, so only hand one out for the same tip
+    // when it pays noticeably different fees or the current one got old
+    if (pgbtTemplate && pgbtTemplate->pindexPrev == pindexTip && nNow - pgbtTemplate->nStart <= GBT_MAX_TEMPLATE_AGE &&
+        std::abs(nFees - pgbtTemplate->nFees) * 100 <= pgbtTemplate->nFees * GBT_FEE_CHANGE_PERCENT)
+    {
+        return pgbtTemplate;
+    }
+
+    std::shared_ptr<CGBTTemplate> gbtTemplate = std::make_shared<CGBTTemplate>();
+    gbtTemplate->transactions = EncodeTemplateTransactions(*pblocktemplate);
+    gbtTemplate->pblocktemplate = pblocktemplate;
+    gbtTemplate->pindexPrev = pindexTip;
+    gbtTemplate->nStart = nNow;
+    gbtTemplate->nFees = nFees;
+    gbtTemplate->nVersion = ++nGBTVersion;
+    pgbtTemplate = gbtTemplate;
+
+    // wake longpolls waiting on the previous version, under the lock they check it with so none misses it
+    {
+        boost::unique_lock<boost::mutex> lock(csBestBlock);
+        cvBlockChange.notify_all();
+    }
+    return pgbtTemplate;
+}
+
 UniValue getblocktemplate(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -703,28 +916,27 @@ UniValue getblocktemplate(const UniValue &params, bool fHelp)
     if (pnetMan->getChainActive()->IsInitialBlockDownload())
         throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Eccoind is downloading blocks...");
 
-    static unsigned int nTransactionsUpdatedLast;
-
     if (!lpval.isNull())
     {
-        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
+        // Wait to respond until either the best block changes, OR a minute has passed and the mempool changed
+        // enough for a new template
         uint256 hashWatchedChain;
         boost::system_time checktxtime;
-        unsigned int nTransactionsUpdatedLastLP;
+        uint64_t nVersionLP;
 
         if (lpval.isStr())
         {
-            // Format: <hashBestChain><nTransactionsUpdatedLast>
+            // Format: <hashBestChain><template version>
             std::string lpstr = lpval.get_str();
 
             hashWatchedChain.SetHex(lpstr.substr(0, 64));
-            nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+            nVersionLP = atoi64(lpstr.substr(64));
         }
         else
         {
             // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
             hashWatchedChain = pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            nVersionLP = nGBTVersion.load();
         }
 
         // Release the wallet and main lock while waiting
@@ -733,13 +945,24 @@ UniValue getblocktemplate(const UniValue &params, bool fHelp)
             checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
 
             boost::unique_lock<boost::mutex> lock(csBestBlock);
-            while (pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning())
+            while (pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash() == hashWatchedChain &&
+                   nGBTVersion.load() == nVersionLP && IsRPCRunning())
             {
                 if (!cvBlockChange.timed_wait(lock, checktxtime))
                 {
-                    // Timeout: Check transactions for update
-                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
-                        break;
+                    // Timeout: Check transactions for update, an error must not leave here without cs_main
+                    lock.unlock();
+                    try
+                    {
+                        LOCK(cs_main);
+                        GetGBTTemplate();
+                    }
+                    catch (...)
+                    {
+                        ENTER_CRITICAL_SECTION(cs_main);
+                        throw;
+                    }
+                    lock.lock();
                     checktxtime += boost::posix_time::seconds(10);
                 }
             }
@@ -753,49 +976,12 @@ UniValue getblocktemplate(const UniValue &params, bool fHelp)
     }
 
     // Update block
-    static CBlockIndex *pindexPrev;
-    static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != pnetMan->getChainActive()->chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = NULL;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex *pindexPrevNew = pnetMan->getChainActive()->chainActive.Tip();
-        nStart = GetTime();
-
-        // Create new block
-        if (pblocktemplate)
-        {
-            pblocktemplate.reset();
-            pblocktemplate = nullptr;
-        }
-
-        // Create new block
-        boost::shared_ptr<CReserveScript> coinbaseScript;
-        GetMainSignals().ScriptForMining(coinbaseScript);
-
-        // If the keypool is exhausted, no script is returned at all.  Catch this.
-        if (!coinbaseScript)
-            throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, "Error: Keypool ran out, please call keypoolrefill first");
-
-        // throw an error if no script was provided
-        if (coinbaseScript->reserveScript.empty())
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "No coinbase script available (mining requires a wallet)");
-
-        pblocktemplate.reset(CreateNewBlock(pwalletMain, coinbaseScript->reserveScript, false).get());
-        if (!pblocktemplate)
-        {
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-        }
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
-    CBlock *pblock = &pblocktemplate->block; // pointer for convenience
+    std::shared_ptr<const CGBTTemplate> gbtTemplate = GetGBTTemplate();
+    CBlockIndex *pindexPrev = gbtTemplate->pindexPrev;
+    // the template is shared by every caller, only this copy of the header gets the current time
+    const CBlock &block = gbtTemplate->pblocktemplate->block;
+    CBlockHeader header(block);
+    CBlockHeader *pblock = &header; // pointer for convenience
 
     // Update nTime
     UpdateTime(pblock, pnetMan->getActivePaymentNetwork()->GetConsensus(), pindexPrev);
@@ -804,39 +990,6 @@ UniValue getblocktemplate(const UniValue &params, bool fHelp)
     UniValue aCaps(UniValue::VARR);
     aCaps.push_back("proposal");
 
-    UniValue transactions(UniValue::VARR);
-    std::map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    for (auto const &ptx : pblock->vtx)
-    {
-        const CTransaction &tx = *ptx;
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
-
-        if (tx.IsCoinBase())
-            continue;
-
-        UniValue entry(UniValue::VOBJ);
-
-        entry.push_back(Pair("data", EncodeHexTx(tx)));
-
-        entry.push_back(Pair("hash", txHash.GetHex()));
-
-        UniValue deps(UniValue::VARR);
-        for (auto const &in : tx.vin)
-        {
-            if (setTxIndex.count(in.prevout.hash))
-                deps.push_back(setTxIndex[in.prevout.hash]);
-        }
-        entry.push_back(Pair("depends", deps));
-
-        int index_in_template = i - 1;
-        entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
-        entry.push_back(Pair("sigops", pblocktemplate->vTxSigOps[index_in_template]));
-
-        transactions.push_back(entry);
-    }
-
     UniValue aux(UniValue::VOBJ);
     aux.push_back(Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end())));
 
@@ -854,11 +1007,10 @@ UniValue getblocktemplate(const UniValue &params, bool fHelp)
     result.push_back(Pair("capabilities", aCaps));
     result.push_back(Pair("version", pblock->nVersion));
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
-    result.push_back(Pair("transactions", transactions));
+    result.push_back(Pair("transactions", gbtTemplate->transactions));
     result.push_back(Pair("coinbaseaux", aux));
-    result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue));
-    result.push_back(Pair("longpollid",
-        pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
+    result.push_back(Pair("coinbasevalue", (int64_t)block.vtx[0]->vout[0].nValue));
+    result.push_back(Pair("longpollid", pindexPrev->GetBlockHash().GetHex() + i64tostr(gbtTemplate->nVersion)));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast() + 1));
     result.push_back(Pair("mutable", aMutable));
@@ -1112,7 +1264,7 @@ UniValue getposblocktemplate(const UniValue &params, bool fHelp)
         if (coinbaseScript->reserveScript.empty())
             throw JSONRPCError(RPC_INTERNAL_ERROR, "No coinbase script available (mining requires a wallet)");
 
-        pblocktemplate.reset(CreateNewBlock(pwalletMain, coinbaseScript->reserveScript, true).get());
+        pblocktemplate = CreateNewBlock(pwalletMain, coinbaseScript->reserveScript, true);
         if (!pblocktemplate)
         {
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
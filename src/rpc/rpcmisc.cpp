@@ -18,22 +18,34 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "addressindex.h"
 #include "args.h"
 #include "base58.h"
 #include "blockgeneration/blockgeneration.h"
+#include "chain/chainman.h"
 #include "clientversion.h"
 #include "init.h"
 #include "main.h"
 #include "net/net.h"
 #include "net/netbase.h"
+#include "net/orphanpool.h"
+#include "net/recvbufferpool.h"
 #include "rpcserver.h"
+#include "script/sigcache.h"
+#include "support/pagelocker.h"
 #include "timedata.h"
+#include "txdb.h"
+#include "txmempool.h"
 #include "util/util.h"
 #include "util/utilstrencodings.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 
 #include <stdint.h>
+#include <stdio.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
 #include <boost/assign/list_of.hpp>
 #include <boost/program_options/detail/config_file.hpp>
@@ -402,3 +414,341 @@ UniValue setmocktime(const UniValue &params, bool fHelp)
 
     return NullUniValue;
 }
+
+/** Resident set size of the process, 0 where it can not be read */
+static size_t GetResidentMemory()
+{
+#ifdef __linux__
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    unsigned long nPagesTotal = 0, nPagesResident = 0;
+    const int nFields = fscanf(file, "%lu %lu", &nPagesTotal, &nPagesResident);
+    fclose(file);
+    if (nFields != 2)
+        return 0;
+    return nPagesResident * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+UniValue getmemoryinfo(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getmemoryinfo\n"
+            "\nReturns how many bytes of memory the parts of the node take. The figures are estimates of the "
+            "allocations the containers make, unaccounted is what the process has resident beyond them: code, "
+            "stacks, the allocator's overhead and free lists and whatever is not counted.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockindex\": n,        (numeric) the block index and the hash table over it\n"
+            "  \"coinscache\": n,        (numeric) the coins cache of the tip\n"
+            "  \"mempool\": n,           (numeric) the mempool\n"
+            "  \"sigcache\": n,          (numeric) the signature cache\n"
+            "  \"scriptcache\": n,       (numeric) the script execution cache\n"
+            "  \"addrman\": n,           (numeric) the address manager\n"
+            "  \"peersend\": n,          (numeric) the send queues of the peers, shared payloads once\n"
+            "  \"peerrecv\": n,          (numeric) messages of the peers received or being received\n"
+            "  \"recvbufferpool\": n,    (numeric) receive buffers pooled for reuse\n"
+            "  \"orphans\": n,           (numeric) the orphan transactions\n"
+            "  \"wallet\": n,            (numeric) the transactions, key pool and address book of the wallet\n"
+            "  \"chainstatedb\": n,      (numeric) the block cache and write buffers of the chainstate database\n"
+            "  \"blockindexdb\": n,      (numeric) the same for the block index database\n"
+            "  \"lockedpages\": n,       (numeric) memory locked against swapping, for keys\n"
+            "  \"total\": n,             (numeric) the sum of the above\n"
+            "  \"rss\": n,               (numeric) the resident set size of the process, 0 where unknown\n"
+            "  \"unaccounted\": n        (numeric) rss less total\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmemoryinfo", "") + HelpExampleRpc("getmemoryinfo", ""));
+
+    // every part is counted under its own lock, the figures are not of one instant
+    CChainManager *pchainman = pnetMan->getChainActive();
+    std::vector<std::pair<std::string, size_t> > vParts;
+    {
+        READLOCK(pchainman->cs_mapBlockIndex);
+        vParts.emplace_back("blockindex",
+            pchainman->mapBlockIndex.DynamicMemoryUsage() + pchainman->blockIndexArena.DynamicMemoryUsage());
+    }
+    size_t nCoinsCache = 0, nChainStateDB = 0, nBlockIndexDB = 0;
+    {
+        LOCK(cs_main);
+        if (pchainman->pcoinsTip)
+            nCoinsCache = pchainman->pcoinsTip->DynamicMemoryUsage();
+        if (pcoinsdbview)
+            nChainStateDB = pcoinsdbview->GetDBStats().nMemoryUsage;
+        if (pchainman->pblocktree)
+            nBlockIndexDB = pchainman->pblocktree->GetStats().nMemoryUsage;
+    }
+    vParts.emplace_back("coinscache", nCoinsCache);
+    vParts.emplace_back("mempool", mempool.DynamicMemoryUsage());
+    vParts.emplace_back("sigcache", GetSignatureCacheUsage());
+    vParts.emplace_back("scriptcache", GetScriptExecutionCacheUsage());
+    size_t nAddrMan = 0, nPeerSend = 0, nPeerRecv = 0;
+    if (g_connman)
+    {
+        nAddrMan = g_connman->GetAddrManUsage();
+        g_connman->GetNodeBufferUsage(nPeerSend, nPeerRecv);
+    }
+    vParts.emplace_back("addrman", nAddrMan);
+    vParts.emplace_back("peersend", nPeerSend);
+    vParts.emplace_back("peerrecv", nPeerRecv);
+    vParts.emplace_back("recvbufferpool", recvBufferPool.DynamicMemoryUsage());
+    vParts.emplace_back("orphans", orphanpool.DynamicMemoryUsage());
+    vParts.emplace_back("wallet", pwalletMain ? pwalletMain->DynamicMemoryUsage() : 0);
+    vParts.emplace_back("chainstatedb", nChainStateDB);
+    vParts.emplace_back("blockindexdb", nBlockIndexDB);
+    LockedPageManager &lockedPages = LockedPageManager::Instance();
+    vParts.emplace_back("lockedpages", lockedPages.GetLockedPageCount() * lockedPages.GetPageSize());
+
+    UniValue obj(UniValue::VOBJ);
+    uint64_t nTotal = 0;
+    for (const auto &part : vParts)
+    {
+        obj.push_back(Pair(part.first, (uint64_t)part.second));
+        nTotal += part.second;
+    }
+    const uint64_t nResident = GetResidentMemory();
+    obj.push_back(Pair("total", nTotal));
+    obj.push_back(Pair("rss", nResident));
+    obj.push_back(Pair("unaccounted", nResident > nTotal ? nResident - nTotal : 0));
+    return obj;
+}
+
+/** The addresses of an address index call, a single address or an object with an array of them */
+static std::vector<std::pair<uint8_t, uint160> > ParseIndexAddresses(const UniValue &param)
+{
+    std::vector<UniValue> values;
+    if (param.isStr())
+    {
+        values.push_back(param);
+    }
+    else if (param.isObject())
+    {
+        const UniValue &addresses = find_value(param.get_obj(), "addresses");
+        if (!addresses.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "addresses is expected to be an array");
+        values = addresses.getValues();
+    }
+    else
+    {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "an address or an object with addresses is expected");
+    }
+
+    std::vector<std::pair<uint8_t, uint160> > result;
+    for (const UniValue &value : values)
+    {
+        CBitcoinAddress address(value.get_str());
+        CTxDestination dest = address.Get();
+        if (const CKeyID *keyID = boost::get<CKeyID>(&dest))
+            result.emplace_back(ADDRESS_PUBKEYHASH, *keyID);
+        else if (const CScriptID *scriptID = boost::get<CScriptID>(&dest))
+            result.emplace_back(ADDRESS_SCRIPTHASH, *scriptID);
+        else
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + value.get_str());
+    }
+    return result;
+}
+
+static std::string IndexAddressToString(uint8_t nType, const uint160 &hash)
+{
+    if (nType == ADDRESS_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hash)).ToString();
+    return CBitcoinAddress(CKeyID(hash)).ToString();
+}
+
+UniValue getaddressbalance(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance \"address\"|{\"addresses\":[\"address\",...]}\n"
+            "\nReturns the balance of the addresses, requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"         (string or object, required) An address, or an object with an array of them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : n,      (numeric) The current balance in satoshis\n"
+            "  \"received\" : n      (numeric) The total amount received in satoshis, change included\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"EXyVjqmAaWeGvizD8fdpnmJdtbhKSMpMRy\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"EXyVjqmAaWeGvizD8fdpnmJdtbhKSMpMRy\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, start with -addressindex and -reindex");
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const auto &address : ParseIndexAddresses(params[0]))
+    {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+        if (!pnetMan->getChainActive()->pblocktree->ReadAddressIndex(address.first, address.second, vEntries))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+        for (const auto &entry : vEntries)
+        {
+            nBalance += entry.second;
+            if (entry.second > 0)
+                nReceived += entry.second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", nBalance));
+    result.push_back(Pair("received", nReceived));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos \"address\"|{\"addresses\":[\"address\",...]}\n"
+            "\nReturns the unspent outputs of the addresses, requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"         (string or object, required) An address, or an object with an array of them\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"address\",  (string) The address\n"
+            "    \"txid\" : \"hash\",        (string) The id of the transaction of the output\n"
+            "    \"outputIndex\" : n,      (numeric) The index of the output in it\n"
+            "    \"script\" : \"hex\",       (string) The scriptPubKey of the output\n"
+            "    \"satoshis\" : n,         (numeric) The value of the output in satoshis\n"
+            "    \"height\" : n            (numeric) The height of the block of the transaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"EXyVjqmAaWeGvizD8fdpnmJdtbhKSMpMRy\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"EXyVjqmAaWeGvizD8fdpnmJdtbhKSMpMRy\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, start with -addressindex and -reindex");
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (const auto &address : ParseIndexAddresses(params[0]))
+    {
+        if (!pnetMan->getChainActive()->pblocktree->ReadAddressUnspentIndex(address.first, address.second, vUnspent))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+    }
+    std::sort(vUnspent.begin(), vUnspent.end(),
+        [](const std::pair<CAddressUnspentKey, CAddressUnspentValue> &a,
+                  const std::pair<CAddressUnspentKey, CAddressUnspentValue> &b) {
+            return a.second.nBlockHeight < b.second.nBlockHeight;
+        });
+
+    UniValue result(UniValue::VARR);
+    for (const auto &unspent : vUnspent)
+    {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", IndexAddressToString(unspent.first.nType, unspent.first.hashBytes)));
+        output.push_back(Pair("txid", unspent.first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int64_t)unspent.first.nIndex));
+        output.push_back(Pair("script", HexStr(unspent.second.script.begin(), unspent.second.script.end())));
+        output.push_back(Pair("satoshis", unspent.second.nSatoshis));
+        output.push_back(Pair("height", unspent.second.nBlockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddresstxids \"address\"|{\"addresses\":[\"address\",...],\"start\":n,\"end\":n}\n"
+            "\nReturns the ids of the transactions paying to or spending from the addresses, in the order of the "
+            "chain, requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"         (string or object, required) An address, or an object with an array of them and\n"
+            "                     optionally the heights \"start\" and \"end\" of the blocks to look at\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"txid\"             (string) The id of a transaction\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"EXyVjqmAaWeGvizD8fdpnmJdtbhKSMpMRy\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"EXyVjqmAaWeGvizD8fdpnmJdtbhKSMpMRy\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, start with -addressindex and -reindex");
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (params[0].isObject())
+    {
+        const UniValue &start = find_value(params[0].get_obj(), "start");
+        const UniValue &end = find_value(params[0].get_obj(), "end");
+        if (!start.isNull() || !end.isNull())
+        {
+            if (!start.isNum() || !end.isNum())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "start and end are expected to be given together");
+            nStart = start.get_int();
+            nEnd = end.get_int();
+            if (nStart <= 0 || nEnd < nStart)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "start has to be above 0 and end at least start");
+        }
+    }
+
+    // by height and then by txid, so a transaction touching several addresses is listed once
+    std::set<std::pair<int, uint256> > setTxids;
+    for (const auto &address : ParseIndexAddresses(params[0]))
+    {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+        if (!pnetMan->getChainActive()->pblocktree->ReadAddressIndex(
+                address.first, address.second, vEntries, nStart, nEnd))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+        for (const auto &entry : vEntries)
+            setTxids.emplace(entry.first.nBlockHeight, entry.first.txhash);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const auto &txid : setTxids)
+        result.push_back(txid.second.GetHex());
+    return result;
+}
+
+UniValue getspentinfo(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw std::runtime_error(
+            "getspentinfo {\"txid\":\"hash\",\"index\":n}\n"
+            "\nReturns the input that spent an output, requires -spentindex.\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"txid\" : \"hash\",     (string, required) The id of the transaction of the output\n"
+            "  \"index\" : n          (numeric, required) The index of the output in it\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",     (string) The id of the spending transaction\n"
+            "  \"index\" : n,         (numeric) The index of the spending input in it\n"
+            "  \"height\" : n         (numeric) The height of the block of the spending transaction\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee"
+                                           "5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee"
+                                           "5a597c9\", \"index\": 0}"));
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled, start with -spentindex and -reindex");
+
+    const uint256 txid = ParseHashV(find_value(params[0].get_obj(), "txid"), "txid");
+    const UniValue &index = find_value(params[0].get_obj(), "index");
+    if (!index.isNum() || index.get_int() < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "index is expected to be a non negative number");
+
+    CSpentIndexValue value;
+    if (!pnetMan->getChainActive()->pblocktree->ReadSpentIndex(CSpentIndexKey(txid, index.get_int()), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int64_t)value.nInputIndex));
+    result.push_back(Pair("height", value.nBlockHeight));
+    return result;
+}
@@ -21,6 +21,7 @@
 #include "rpcserver.h"
 
 #include "clientversion.h"
+#include "crypto/sha256.h"
 #include "main.h"
 #include "net/messages.h"
 #include "net/net.h"
@@ -71,6 +72,19 @@ UniValue ping(const UniValue &params, bool fHelp)
     return NullUniValue;
 }
 
+static UniValue MsgCmdTimesToJSON(const mapMsgCmdTimes &mapTimes)
+{
+    UniValue obj(UniValue::VOBJ);
+    for (const auto &item : mapTimes)
+    {
+        UniValue times(UniValue::VOBJ);
+        times.push_back(Pair("queue", TimeHistogramToJSON(item.second.queue)));
+        times.push_back(Pair("process", TimeHistogramToJSON(item.second.process)));
+        obj.push_back(Pair(item.first, times));
+    }
+    return obj;
+}
+
 UniValue getpeerinfo(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -99,6 +113,7 @@ UniValue getpeerinfo(const UniValue &params, bool fHelp)
             "    \"version\": v,              (numeric) The peer version, such as 7001\n"
             "    \"subver\": \"/Satoshi:0.8.5/\",  (string) The std::string version\n"
             "    \"inbound\": true|false,     (boolean) Inbound (true) or Outbound (false)\n"
+            "    \"blockrelayonly\": true|false, (boolean) Whether this outbound connection only relays blocks\n"
             "    \"startingheight\": n,       (numeric) The starting height (block) of the peer\n"
             "    \"banscore\": n,             (numeric) The ban score\n"
             "    \"synced_headers\": n,       (numeric) The last header we have in common with this peer\n"
@@ -106,7 +121,19 @@ UniValue getpeerinfo(const UniValue &params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"blockquota\": n,           (numeric) How many blocks we ask this peer for at a time\n"
+            "    \"blocktime\": n,            (numeric) Average seconds this peer took per block, 0 if unknown\n"
+            "    \"blockstalls\": n,          (numeric) Blocks we asked another peer for as this one was too slow\n"
+            "    \"addr_processed\": n,       (numeric) Addresses from this peer that were processed\n"
+            "    \"addr_rate_limited\": n,    (numeric) Addresses from this peer dropped for its rate limit\n"
+            "    \"minfeefilter\": n,         (numeric) The feerate in " +
+            CURRENCY_UNIT + "/kB below which the peer asked us not to announce transactions\n"
+            "    \"msgtimes\": {              (json object) The message handler times of this peer per command, as\n"
+            "                               getnetmsgstats, for the commands it sent\n"
+            "      \"command\": {\"queue\": {...}, \"process\": {...}}, ...\n"
+            "    },\n"
+            "    \"sendmessages\": {...}      (json object) The times of sending to this peer, as getnetmsgstats\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -152,6 +179,7 @@ UniValue getpeerinfo(const UniValue &params, bool fHelp)
         // their ver message.
         obj.push_back(Pair("subver", stats.cleanSubVer));
         obj.push_back(Pair("inbound", stats.fInbound));
+        obj.push_back(Pair("blockrelayonly", stats.fBlockRelayOnly));
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         if (fStateStats)
         {
@@ -164,8 +192,16 @@ UniValue getpeerinfo(const UniValue &params, bool fHelp)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("blockquota", statestats.nBlockQuota));
+            obj.push_back(Pair("blocktime", statestats.nAvgBlockTime / 1e6));
+            obj.push_back(Pair("blockstalls", statestats.nBlockStalls));
         }
+        obj.push_back(Pair("addr_processed", stats.nAddrProcessed));
+        obj.push_back(Pair("addr_rate_limited", stats.nAddrRateLimited));
+        obj.push_back(Pair("minfeefilter", ValueFromAmount(stats.minFeeFilter)));
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("msgtimes", MsgCmdTimesToJSON(stats.mapMsgTimesPerCmd)));
+        obj.push_back(Pair("sendmessages", TimeHistogramToJSON(stats.sendMessagesTimes)));
 
         ret.push_back(obj);
     }
@@ -173,6 +209,96 @@ UniValue getpeerinfo(const UniValue &params, bool fHelp)
     return ret;
 }
 
+UniValue getnetmsgstats(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns how long the messages of each command waited after they were received and took to process, "
+            "and how long sending took, for all peers since the node started. The connected peers follow, those "
+            "that kept the message handler busy longest first.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"commands\": {\n"
+            "    \"command\": {            (json object) a command, the ones not in the protocol are *other*\n"
+            "      \"queue\": {            (json object) the time from receiving a message to processing it\n" +
+            HelpTimeHistogram("        ") +
+            "      },\n"
+            "      \"process\": {...}      (json object) the time processing it took\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"sendmessages\": {...},    (json object) the time each round of sending to a peer took\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,              (numeric) peer index\n"
+            "      \"addr\": \"host:port\",  (string) the address of the peer\n"
+            "      \"messages\": n,        (numeric) the messages processed\n"
+            "      \"queue\": x.xxx,       (numeric) milliseconds they waited in total\n"
+            "      \"process\": x.xxx,     (numeric) milliseconds processing them took in total\n"
+            "      \"sendmessages\": x.xxx (numeric) milliseconds sending took in total\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getnetmsgstats", "") + HelpExampleRpc("getnetmsgstats", ""));
+
+    if (!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    mapMsgCmdTimes mapTimes;
+    CTimeHistogram sendTimes;
+    g_connman->GetMessageTimes(mapTimes, sendTimes);
+    std::vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+
+    struct CPeerTotals
+    {
+        NodeId id;
+        std::string addr;
+        uint64_t nMessages = 0;
+        int64_t nQueueMicros = 0;
+        int64_t nProcessMicros = 0;
+        int64_t nSendMicros = 0;
+    };
+    std::vector<CPeerTotals> vPeers;
+    for (const CNodeStats &stats : vstats)
+    {
+        CPeerTotals peer;
+        peer.id = stats.nodeid;
+        peer.addr = stats.addrName;
+        for (const auto &item : stats.mapMsgTimesPerCmd)
+        {
+            peer.nMessages += item.second.process.nCount;
+            peer.nQueueMicros += item.second.queue.nTotalMicros;
+            peer.nProcessMicros += item.second.process.nTotalMicros;
+        }
+        peer.nSendMicros = stats.sendMessagesTimes.nTotalMicros;
+        vPeers.push_back(peer);
+    }
+    std::sort(vPeers.begin(), vPeers.end(), [](const CPeerTotals &a, const CPeerTotals &b) {
+        return a.nProcessMicros + a.nSendMicros > b.nProcessMicros + b.nSendMicros;
+    });
+
+    UniValue peers(UniValue::VARR);
+    for (const CPeerTotals &peer : vPeers)
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("id", peer.id));
+        obj.push_back(Pair("addr", peer.addr));
+        obj.push_back(Pair("messages", peer.nMessages));
+        obj.push_back(Pair("queue", peer.nQueueMicros / 1000.0));
+        obj.push_back(Pair("process", peer.nProcessMicros / 1000.0));
+        obj.push_back(Pair("sendmessages", peer.nSendMicros / 1000.0));
+        peers.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("commands", MsgCmdTimesToJSON(mapTimes)));
+    ret.push_back(Pair("sendmessages", TimeHistogramToJSON(sendTimes)));
+    ret.push_back(Pair("peers", peers));
+    return ret;
+}
+
 UniValue addnode(const UniValue &params, bool fHelp)
 {
     std::string strCommand;
@@ -367,6 +493,17 @@ UniValue getnettotals(const UniValue &params, bool fHelp)
                                  "left in current time cycle\n"
                                  "    \"time_left_in_cycle\": t                 (numeric) Seconds "
                                  "left in current time cycle\n"
+                                 "  },\n"
+                                 "  \"blockcache\":\n"
+                                 "  {\n"
+                                 "    \"hits\": n,                              (numeric) Block "
+                                 "requests served from memory\n"
+                                 "    \"misses\": n,                            (numeric) Block "
+                                 "requests read from disk\n"
+                                 "    \"blocks\": n,                            (numeric) Blocks "
+                                 "held in memory\n"
+                                 "    \"bytes\": n                              (numeric) Bytes "
+                                 "of the blocks and their serializations held in memory\n"
                                  "  }\n"
                                  "}\n"
                                  "\nExamples:\n" +
@@ -389,6 +526,16 @@ UniValue getnettotals(const UniValue &params, bool fHelp)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    uint64_t nHits, nMisses;
+    size_t nBlocks, nBytes;
+    GetServedBlockStats(nHits, nMisses, nBlocks, nBytes);
+    UniValue blockCache(UniValue::VOBJ);
+    blockCache.push_back(Pair("hits", nHits));
+    blockCache.push_back(Pair("misses", nMisses));
+    blockCache.push_back(Pair("blocks", (uint64_t)nBlocks));
+    blockCache.push_back(Pair("bytes", (uint64_t)nBytes));
+    obj.push_back(Pair("blockcache", blockCache));
     return obj;
 }
 
@@ -449,6 +596,7 @@ UniValue getnetworkinfo(const UniValue &params, bool fHelp)
             "  ,...\n"
             "  ]\n"
             "  \"warnings\": \"...\"                    (string) any network warnings (such as alert messages) \n"
+            "  \"sha256implementation\": \"...\"        (string) the SHA256 implementations in use, picked at startup\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getnetworkinfo", "") + HelpExampleRpc("getnetworkinfo", ""));
@@ -481,6 +629,7 @@ UniValue getnetworkinfo(const UniValue &params, bool fHelp)
     }
     obj.push_back(Pair("localaddresses", localAddresses));
     obj.push_back(Pair("warnings", GetWarnings("statusbar")));
+    obj.push_back(Pair("sha256implementation", SHA256Implementation()));
     return obj;
 }
 
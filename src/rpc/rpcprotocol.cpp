@@ -73,8 +73,15 @@ UniValue JSONRPCReplyObj(const UniValue &result, const UniValue &error, const Un
 
 std::string JSONRPCReply(const UniValue &result, const UniValue &error, const UniValue &id)
 {
-    UniValue reply = JSONRPCReplyObj(result, error, id);
-    return reply.write() + "\n";
+    // JSONRPCReplyObj written around result, instead of copying the whole result into a reply object first
+    std::string strReply = "{\"result\":";
+    (error.isNull() ? result : NullUniValue).writeTo(strReply);
+    strReply += ",\"error\":";
+    error.writeTo(strReply);
+    strReply += ",\"id\":";
+    id.writeTo(strReply);
+    strReply += "}\n";
+    return strReply;
 }
 
 UniValue JSONRPCError(int code, const std::string &message)
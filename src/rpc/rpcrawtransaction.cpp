@@ -40,7 +40,9 @@
 #include "util/utilstrencodings.h"
 #include "wallet/wallet.h"
 
+#include <atomic>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/assign/list_of.hpp>
 
@@ -54,79 +56,81 @@ void ScriptPubKeyToJSON(const CScript &scriptPubKey, UniValue &out, bool fInclud
     std::vector<CTxDestination> addresses;
     int nRequired;
 
-    out.push_back(Pair("asm", ScriptToAsmStr(scriptPubKey)));
+    out.pushKVEnd("asm", ScriptToAsmStr(scriptPubKey));
     if (fIncludeHex)
-        out.push_back(Pair("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end())));
+        out.pushKVEnd("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end()));
 
     if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired))
     {
-        out.push_back(Pair("type", GetTxnOutputType(type)));
+        out.pushKVEnd("type", GetTxnOutputType(type));
         return;
     }
 
-    out.push_back(Pair("reqSigs", nRequired));
-    out.push_back(Pair("type", GetTxnOutputType(type)));
+    out.pushKVEnd("reqSigs", nRequired);
+    out.pushKVEnd("type", GetTxnOutputType(type));
 
     UniValue a(UniValue::VARR);
+    a.reserve(addresses.size());
     for (auto const &addr : addresses)
         a.push_back(CBitcoinAddress(addr).ToString());
-    out.push_back(Pair("addresses", a));
+    out.pushKVEnd("addresses", std::move(a));
 }
 
 void TxToJSON(const CTransaction &tx, const uint256 hashBlock, UniValue &entry)
 {
-    entry.push_back(Pair("txid", tx.GetHash().GetHex()));
-    entry.push_back(Pair("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION)));
-    entry.push_back(Pair("version", tx.nVersion));
-    entry.push_back(Pair("locktime", (int64_t)tx.nLockTime));
+    entry.pushKVEnd("txid", tx.GetHash().GetHex());
+    entry.pushKVEnd("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+    entry.pushKVEnd("version", tx.nVersion);
+    entry.pushKVEnd("locktime", (int64_t)tx.nLockTime);
     UniValue vin(UniValue::VARR);
+    vin.reserve(tx.vin.size());
     for (auto const &txin : tx.vin)
     {
         UniValue in(UniValue::VOBJ);
         if (tx.IsCoinBase())
-            in.push_back(Pair("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
+            in.pushKVEnd("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
         else
         {
-            in.push_back(Pair("txid", txin.prevout.hash.GetHex()));
-            in.push_back(Pair("vout", (int64_t)txin.prevout.n));
+            in.pushKVEnd("txid", txin.prevout.hash.GetHex());
+            in.pushKVEnd("vout", (int64_t)txin.prevout.n);
             UniValue o(UniValue::VOBJ);
-            o.push_back(Pair("asm", ScriptToAsmStr(txin.scriptSig, true)));
-            o.push_back(Pair("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
-            in.push_back(Pair("scriptSig", o));
+            o.pushKVEnd("asm", ScriptToAsmStr(txin.scriptSig, true));
+            o.pushKVEnd("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
+            in.pushKVEnd("scriptSig", std::move(o));
         }
-        in.push_back(Pair("sequence", (int64_t)txin.nSequence));
-        vin.push_back(in);
+        in.pushKVEnd("sequence", (int64_t)txin.nSequence);
+        vin.push_back(std::move(in));
     }
-    entry.push_back(Pair("vin", vin));
+    entry.pushKVEnd("vin", std::move(vin));
     UniValue vout(UniValue::VARR);
+    vout.reserve(tx.vout.size());
     for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
         const CTxOut &txout = tx.vout[i];
         UniValue out(UniValue::VOBJ);
-        out.push_back(Pair("value", ValueFromAmount(txout.nValue)));
-        out.push_back(Pair("n", (int64_t)i));
+        out.pushKVEnd("value", ValueFromAmount(txout.nValue));
+        out.pushKVEnd("n", (int64_t)i);
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-        out.push_back(Pair("scriptPubKey", o));
-        vout.push_back(out);
+        out.pushKVEnd("scriptPubKey", std::move(o));
+        vout.push_back(std::move(out));
     }
-    entry.push_back(Pair("vout", vout));
+    entry.pushKVEnd("vout", std::move(vout));
 
     if (!hashBlock.IsNull())
     {
-        entry.push_back(Pair("blockhash", hashBlock.GetHex()));
+        entry.pushKVEnd("blockhash", hashBlock.GetHex());
         CBlockIndex *pindex = pnetMan->getChainActive()->LookupBlockIndex(hashBlock);
         if (pindex)
         {
             if (pnetMan->getChainActive()->chainActive.Contains(pindex))
             {
-                entry.push_back(
-                    Pair("confirmations", 1 + pnetMan->getChainActive()->chainActive.Height() - pindex->nHeight));
-                entry.push_back(Pair("time", pindex->GetBlockTime()));
-                entry.push_back(Pair("blocktime", pindex->GetBlockTime()));
+                entry.pushKVEnd("confirmations", 1 + pnetMan->getChainActive()->chainActive.Height() - pindex->nHeight);
+                entry.pushKVEnd("time", pindex->GetBlockTime());
+                entry.pushKVEnd("blocktime", pindex->GetBlockTime());
             }
             else
-                entry.push_back(Pair("confirmations", 0));
+                entry.pushKVEnd("confirmations", 0);
         }
     }
 }
@@ -266,11 +270,10 @@ UniValue gettxoutproof(const UniValue &params, bool fHelp)
     uint256 hashBlock;
     if (params.size() > 1)
     {
-        READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
         hashBlock = uint256S(params[1].get_str());
-        if (!pnetMan->getChainActive()->mapBlockIndex.count(hashBlock))
+        pblockindex = pnetMan->getChainActive()->LookupBlockIndex(hashBlock);
+        if (!pblockindex)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        pblockindex = pnetMan->getChainActive()->mapBlockIndex[hashBlock];
     }
     else
     {
@@ -287,13 +290,14 @@ UniValue gettxoutproof(const UniValue &params, bool fHelp)
         if (!GetTransaction(oneTxid, tx, pnetMan->getActivePaymentNetwork()->GetConsensus(), hashBlock, false) ||
             hashBlock.IsNull())
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not yet in block");
-        READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
-        if (!pnetMan->getChainActive()->mapBlockIndex.count(hashBlock))
+        pblockindex = pnetMan->getChainActive()->LookupBlockIndex(hashBlock);
+        if (!pblockindex)
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction index corrupt");
-        pblockindex = pnetMan->getChainActive()->mapBlockIndex[hashBlock];
     }
 
     CBlock block;
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
     if (!ReadBlockFromDisk(block, pblockindex, pnetMan->getActivePaymentNetwork()->GetConsensus()))
     {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
@@ -590,6 +594,9 @@ static void TxInErrorToJSON(const CTxIn &txin, UniValue &vErrorsRet, const std::
     vErrorsRet.push_back(entry);
 }
 
+/** Minimum number of inputs per verifying thread of signrawtransaction */
+static const size_t MIN_INPUTS_PER_VERIFY_THREAD = 8;
+
 UniValue signrawtransaction(const UniValue &params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 4)
@@ -796,37 +803,80 @@ UniValue signrawtransaction(const UniValue &params, bool fHelp)
 
     bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
 
+    // decrypt the wallet keys of all the inputs at once instead of one by one while signing
+    std::set<CKeyID> setSigningKeyIDs;
+    if (!fGivenKeys && pwalletMain)
+    {
+        for (const CTxIn &txin : mergedTx.vin)
+        {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (!coin.IsSpent())
+                GetSigningKeyIDs(keystore, coin.out.scriptPubKey, setSigningKeyIDs);
+        }
+    }
+    CDecryptedKeysScope decryptedKeys(fGivenKeys ? nullptr : pwalletMain, setSigningKeyIDs);
+
     // Script verification errors
     UniValue vErrors(UniValue::VARR);
 
-    // Sign what we can:
-    for (unsigned int i = 0; i < mergedTx.vin.size(); i++)
+    // Sign what we can, the inputs on all cores:
+    const size_t nInputs = mergedTx.vin.size();
+    std::vector<bool> vFound(nInputs, false);
+    std::vector<CScript> vPrevPubKeys(nInputs);
+    std::vector<CScript> vSignPubKeys(nInputs);
+    for (unsigned int i = 0; i < nInputs; i++)
     {
-        CTxIn &txin = mergedTx.vin[i];
-        const Coin &coin = view.AccessCoin(txin.prevout);
+        const Coin &coin = view.AccessCoin(mergedTx.vin[i].prevout);
         if (coin.IsSpent())
-        {
-            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
             continue;
-        }
-        const CScript &prevPubKey = coin.out.scriptPubKey;
+        vFound[i] = true;
+        vPrevPubKeys[i] = coin.out.scriptPubKey;
 
-        txin.scriptSig.clear();
+        mergedTx.vin[i].scriptSig.clear();
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mergedTx.vout.size()))
-            SignSignature(keystore, prevPubKey, mergedTx, i, nHashType);
+            vSignPubKeys[i] = coin.out.scriptPubKey;
+    }
+    SignSignatures(keystore, vSignPubKeys, mergedTx, nHashType);
 
-        // ... and merge in other signatures:
+    // ... and merge in other signatures:
+    for (unsigned int i = 0; i < nInputs; i++)
+    {
+        if (!vFound[i])
+            continue;
+        CTxIn &txin = mergedTx.vin[i];
         for (auto const &txv : txVariants)
         {
-            txin.scriptSig = CombineSignatures(prevPubKey, mergedTx, i, txin.scriptSig, txv.vin[i].scriptSig);
+            txin.scriptSig = CombineSignatures(vPrevPubKeys[i], mergedTx, i, txin.scriptSig, txv.vin[i].scriptSig);
         }
-        ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
-                MutableTransactionSignatureChecker(&mergedTx, i), &serror))
+    }
+
+    // the scriptSigs do not change anymore, so the inputs can be verified on all cores as well
+    std::vector<ScriptError> vScriptErrors(nInputs, SCRIPT_ERR_OK);
+    std::atomic<size_t> nNextInput(0);
+    auto verify = [&]() {
+        size_t i;
+        while ((i = nNextInput++) < nInputs)
         {
-            TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
+            if (vFound[i])
+                VerifyScript(mergedTx.vin[i].scriptSig, vPrevPubKeys[i], STANDARD_SCRIPT_VERIFY_FLAGS,
+                    MutableTransactionSignatureChecker(&mergedTx, i), &vScriptErrors[i]);
         }
+    };
+    size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), nInputs / MIN_INPUTS_PER_VERIFY_THREAD);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; i++)
+        vThreads.emplace_back(verify);
+    verify();
+    for (std::thread &thread : vThreads)
+        thread.join();
+
+    for (unsigned int i = 0; i < nInputs; i++)
+    {
+        if (!vFound[i])
+            TxInErrorToJSON(mergedTx.vin[i], vErrors, "Input not found or already spent");
+        else if (vScriptErrors[i] != SCRIPT_ERR_OK)
+            TxInErrorToJSON(mergedTx.vin[i], vErrors, ScriptErrorString(vScriptErrors[i]));
     }
     bool fComplete = vErrors.empty();
 
@@ -861,7 +911,6 @@ UniValue sendrawtransaction(const UniValue &params, bool fHelp)
             "\nSend the transaction (signed hex)\n" + HelpExampleCli("sendrawtransaction", "\"signedhex\"") +
             "\nAs a json rpc call\n" + HelpExampleRpc("sendrawtransaction", "\"signedhex\""));
 
-    LOCK(cs_main);
     RPCTypeCheck(params, boost::assign::list_of(UniValue::VSTR)(UniValue::VBOOL));
 
     // parse hex string from parameter
@@ -876,17 +925,21 @@ UniValue sendrawtransaction(const UniValue &params, bool fHelp)
     if (params.size() > 1)
         fOverrideFees = params[1].get_bool();
 
-    CCoinsViewCache &view = *pnetMan->getChainActive()->pcoinsTip;
     bool fHaveChain = false;
-    for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++)
     {
-        const Coin &existingCoin = view.AccessCoin(COutPoint(txid, o));
-        fHaveChain = !existingCoin.IsSpent();
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pnetMan->getChainActive()->pcoinsTip;
+        for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++)
+        {
+            const Coin &existingCoin = view.AccessCoin(COutPoint(txid, o));
+            fHaveChain = !existingCoin.IsSpent();
+        }
     }
     bool fHaveMempool = mempool.exists(txid);
     if (!fHaveMempool && !fHaveChain)
     {
-        // push to local node and sync with wallets
+        // push to local node and sync with wallets. Called without cs_main so that concurrent
+        // sendrawtransaction calls verify their scripts in parallel.
         CValidationState state;
         bool fMissingInputs;
         if (!AcceptToMemoryPool(mempool, state, std::move(tx), false, &fMissingInputs, false, !fOverrideFees))
@@ -918,3 +971,110 @@ UniValue sendrawtransaction(const UniValue &params, bool fHelp)
     RelayTransaction(ttx, *g_connman);
     return txid.GetHex();
 }
+
+UniValue sendrawtransactions(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits many raw transactions (serialized, hex-encoded) to local node and network at once.\n"
+            "Their signatures are checked together on all script verification threads. The transactions\n"
+            "may spend each other, in any order.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (json array) One object per transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\": \"hex\",   (string) The transaction hash, if the transaction could be decoded\n"
+            "    \"accepted\": true|false, (boolean) Whether the transaction is in the memory pool now\n"
+            "    \"error\": \"text\"  (string) Why the transaction was rejected, if it was\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n" + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]"));
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+
+    const UniValue &hexstrings = params[0].get_array();
+    bool fOverrideFees = false;
+    if (params.size() > 1)
+        fOverrideFees = params[1].get_bool();
+
+    // Decode everything first, and leave out what is known already
+    std::vector<UniValue> vResults(hexstrings.size(), UniValue(UniValue::VOBJ));
+    std::vector<CTransactionRef> vtx;
+    std::vector<size_t> vIndex;
+    std::vector<CTransactionRef> vRelay;
+    for (size_t i = 0; i < hexstrings.size(); i++)
+    {
+        CTransaction ttx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(ttx, hexstrings[i].get_str()))
+        {
+            vResults[i].push_back(Pair("accepted", false));
+            vResults[i].push_back(Pair("error", "TX decode failed"));
+            continue;
+        }
+        CTransactionRef tx(MakeTransactionRef(std::move(ttx)));
+        const uint256 &txid = tx->GetId();
+        vResults[i].push_back(Pair("txid", txid.GetHex()));
+
+        bool fHaveChain = false;
+        {
+            LOCK(cs_main);
+            CCoinsViewCache &view = *pnetMan->getChainActive()->pcoinsTip;
+            for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++)
+            {
+                const Coin &existingCoin = view.AccessCoin(COutPoint(txid, o));
+                fHaveChain = !existingCoin.IsSpent();
+            }
+        }
+        if (fHaveChain)
+        {
+            vResults[i].push_back(Pair("accepted", false));
+            vResults[i].push_back(Pair("error", "transaction already in block chain"));
+        }
+        else if (mempool.exists(txid))
+        {
+            vResults[i].push_back(Pair("accepted", true));
+            vRelay.push_back(tx);
+        }
+        else
+        {
+            vtx.push_back(tx);
+            vIndex.push_back(i);
+        }
+    }
+
+    std::vector<CValidationState> vState;
+    std::vector<bool> vAccepted, vMissingInputs;
+    AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, vMissingInputs, false, !fOverrideFees);
+    for (size_t n = 0; n < vtx.size(); n++)
+    {
+        UniValue &result = vResults[vIndex[n]];
+        result.push_back(Pair("accepted", (bool)vAccepted[n]));
+        if (vAccepted[n])
+            vRelay.push_back(vtx[n]);
+        else if (vState[n].IsInvalid())
+            result.push_back(
+                Pair("error", strprintf("%i: %s", vState[n].GetRejectCode(), vState[n].GetRejectReason())));
+        else if (vMissingInputs[n])
+            result.push_back(Pair("error", "Missing inputs"));
+        else
+            result.push_back(Pair("error", vState[n].GetRejectReason()));
+    }
+
+    if (!g_connman)
+    {
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+    }
+    for (const CTransactionRef &tx : vRelay)
+        RelayTransaction(*tx, *g_connman);
+
+    UniValue ret(UniValue::VARR);
+    for (const UniValue &result : vResults)
+        ret.push_back(result);
+    return ret;
+}
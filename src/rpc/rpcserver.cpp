@@ -24,10 +24,12 @@
 
 #include "args.h"
 #include "base58.h"
+#include "httpserver.h"
 #include "init.h"
 #include "random.h"
 #include "sync.h"
 
+#include "util/timehistogram.h"
 #include "util/util.h"
 #include "util/utilstrencodings.h"
 
@@ -39,6 +41,11 @@
 
 #include <boost/algorithm/string/case_conv.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <thread>
+
 static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT = 900;
 static const bool DEFAULT_NAMED = false;
@@ -181,6 +188,30 @@ UniValue ValueFromAmount(const CAmount &amount)
     return UniValue(UniValue::VNUM, strprintf("%s%d.%06d", sign ? "-" : "", quotient, remainder));
 }
 
+UniValue TimeHistogramToJSON(const CTimeHistogram &histogram)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", histogram.nCount));
+    obj.push_back(Pair("total", histogram.nTotalMicros / 1000.0));
+    obj.push_back(Pair("mean", histogram.nCount ? histogram.nTotalMicros / 1000.0 / histogram.nCount : 0));
+    obj.push_back(Pair("max", histogram.nMaxMicros / 1000.0));
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i < CTimeHistogram::BUCKETS; i++)
+        buckets.push_back(histogram.vBuckets[i]);
+    obj.push_back(Pair("histogram", buckets));
+    return obj;
+}
+
+std::string HelpTimeHistogram(const std::string &indent)
+{
+    return indent + "\"count\": n,            (numeric) Times counted\n" + indent +
+           "\"total\": x.xxx,         (numeric) Milliseconds in total\n" + indent +
+           "\"mean\": x.xxx,          (numeric) Mean in milliseconds\n" + indent +
+           "\"max\": x.xxx,           (numeric) Longest in milliseconds\n" + indent +
+           "\"histogram\": [n,...]    (array) Times below 1, 2, 4, ... microseconds, the last bucket holds the "
+           "rest\n";
+}
+
 uint256 ParseHashV(const UniValue &v, std::string strName)
 {
     std::string strHex;
@@ -297,6 +328,129 @@ UniValue stop(const UniValue &params, bool fHelp)
     return "Eccoind server stopping";
 }
 
+UniValue getrpcqueueinfo(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error("getrpcqueueinfo\n"
+                                 "\nReturns the state of the work queues of the HTTP server, one for every class of "
+                                 "requests.\n"
+                                 "\nResult:\n"
+                                 "[\n"
+                                 "  {\n"
+                                 "    \"queue\": \"name\",      (string) fast, normal or slow\n"
+                                 "    \"threads\": n,         (numeric) Worker threads of the queue\n"
+                                 "    \"depth\": n,           (numeric) Requests waiting in the queue\n"
+                                 "    \"maxdepth\": n,        (numeric) Requests the queue holds before it turns "
+                                 "them away\n"
+                                 "    \"processed\": n,       (numeric) Requests handled\n"
+                                 "    \"rejected\": n,        (numeric) Requests turned away because the queue was "
+                                 "full\n"
+                                 "    \"meanwait\": x.xxx,    (numeric) Mean time in milliseconds requests waited in "
+                                 "the queue\n"
+                                 "    \"maxwait\": x.xxx,     (numeric) Longest time in milliseconds a request "
+                                 "waited in the queue\n"
+                                 "    \"meanrun\": x.xxx      (numeric) Mean time in milliseconds requests took to "
+                                 "handle\n"
+                                 "  },\n"
+                                 "  ...\n"
+                                 "]\n"
+                                 "\nExamples:\n" +
+                                 HelpExampleCli("getrpcqueueinfo", "") + HelpExampleRpc("getrpcqueueinfo", ""));
+
+    UniValue ret(UniValue::VARR);
+    for (const HTTPWorkQueueStats &stats : GetHTTPWorkQueueStats())
+    {
+        // the mean wait counts the requests that wait no more but still run, near enough
+        const double nWaited = std::max<uint64_t>(stats.nProcessed, 1);
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("queue", stats.name));
+        obj.push_back(Pair("threads", stats.nThreads));
+        obj.push_back(Pair("depth", (uint64_t)stats.nDepth));
+        obj.push_back(Pair("maxdepth", (uint64_t)stats.nMaxDepth));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        obj.push_back(Pair("meanwait", stats.nWaitMicros / nWaited / 1000));
+        obj.push_back(Pair("maxwait", stats.nMaxWaitMicros / 1000.0));
+        obj.push_back(Pair("meanrun", stats.nRunMicros / nWaited / 1000));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getlockstats(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error("getlockstats ( reset )\n"
+                                 "\nReturns how often and how long every lock was waited for and held, per place "
+                                 "it is taken, the sites waited for longest first. Needs a build configured with "
+                                 "--enable-lockprofile.\n"
+                                 "\nArguments:\n"
+                                 "1. reset      (boolean, optional, default=false) Start the statistics over\n"
+                                 "\nResult:\n"
+                                 "[\n"
+                                 "  {\n"
+                                 "    \"name\": \"cs_main\",     (string) The lock\n"
+                                 "    \"file\": \"main.cpp\",    (string) Where it is taken\n"
+                                 "    \"line\": n,             (numeric) The line it is taken at\n"
+                                 "    \"shared\": true|false,  (boolean) Whether it is taken for shared ownership\n"
+                                 "    \"count\": n,            (numeric) Times it was taken\n"
+                                 "    \"contended\": n,        (numeric) Times it had to be waited for\n"
+                                 "    \"wait\": x.xxx,         (numeric) Milliseconds waited in total\n"
+                                 "    \"maxwait\": x.xxx,      (numeric) Longest wait in milliseconds\n"
+                                 "    \"hold\": x.xxx,         (numeric) Milliseconds held in total\n"
+                                 "    \"maxhold\": x.xxx,      (numeric) Longest hold in milliseconds\n"
+                                 "    \"waithistogram\": [n,...], (array) Waits below 1, 2, 4, ... microseconds, the "
+                                 "last bucket holds the rest\n"
+                                 "    \"holdhistogram\": [n,...]  (array) Holds the same way\n"
+                                 "  },\n"
+                                 "  ...\n"
+                                 "]\n"
+                                 "\nExamples:\n" +
+                                 HelpExampleCli("getlockstats", "") + HelpExampleCli("getlockstats", "true") +
+                                 HelpExampleRpc("getlockstats", ""));
+
+#ifdef DEBUG_LOCKPROFILE
+    const bool fReset = params.size() > 0 && params[0].get_bool();
+    std::vector<std::pair<CLockSite, CLockSiteStats> > vSites;
+    for (const auto &site : GetLockProfile(fReset))
+        vSites.push_back(site);
+    std::sort(vSites.begin(), vSites.end(),
+        [](const std::pair<CLockSite, CLockSiteStats> &a, const std::pair<CLockSite, CLockSiteStats> &b) {
+            return a.second.nWaitNanos > b.second.nWaitNanos;
+        });
+
+    UniValue ret(UniValue::VARR);
+    for (const auto &site : vSites)
+    {
+        const CLockSiteStats &stats = site.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", site.first.name));
+        obj.push_back(Pair("file", site.first.file));
+        obj.push_back(Pair("line", (uint64_t)site.first.line));
+        obj.push_back(Pair("shared", stats.fShared));
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("contended", stats.nContended));
+        obj.push_back(Pair("wait", stats.nWaitNanos / 1e6));
+        obj.push_back(Pair("maxwait", stats.nMaxWaitNanos / 1e6));
+        obj.push_back(Pair("hold", stats.nHoldNanos / 1e6));
+        obj.push_back(Pair("maxhold", stats.nMaxHoldNanos / 1e6));
+        UniValue waits(UniValue::VARR);
+        UniValue holds(UniValue::VARR);
+        for (int i = 0; i < LOCKPROFILE_BUCKETS; i++)
+        {
+            waits.push_back(stats.vWaitHistogram[i]);
+            holds.push_back(stats.vHoldHistogram[i]);
+        }
+        obj.push_back(Pair("waithistogram", waits));
+        obj.push_back(Pair("holdhistogram", holds));
+        ret.push_back(obj);
+    }
+    return ret;
+#else
+    throw JSONRPCError(RPC_MISC_ERROR, "Lock profiling is not compiled in, configure with --enable-lockprofile");
+#endif
+}
+
 /**
  * Call Table
  */
@@ -306,12 +460,16 @@ static const CRPCCommand vRPCCommands[] = {
     /* Overall control/query calls */
     {"control", "getinfo", &getinfo, true}, /* uses wallet if enabled */
     {"control", "help", &help, true}, {"control", "stop", &stop, true},
+    {"control", "getrpcqueueinfo", &getrpcqueueinfo, true},
+    {"control", "getlockstats", &getlockstats, true},
+    {"control", "getmemoryinfo", &getmemoryinfo, true},
 
     /* P2P networking */
     {"network", "getnetworkinfo", &getnetworkinfo, true}, {"network", "addnode", &addnode, true},
     {"network", "disconnectnode", &disconnectnode, true}, {"network", "getaddednodeinfo", &getaddednodeinfo, true},
     {"network", "getconnectioncount", &getconnectioncount, true}, {"network", "getnettotals", &getnettotals, true},
     {"network", "getpeerinfo", &getpeerinfo, true}, {"network", "ping", &ping, true},
+    {"network", "getnetmsgstats", &getnetmsgstats, true},
     {"network", "setban", &setban, true}, {"network", "listbanned", &listbanned, true},
     {"network", "clearbanned", &clearbanned, true},
 
@@ -324,6 +482,19 @@ static const CRPCCommand vRPCCommands[] = {
     {"blockchain", "getrawmempool", &getrawmempool, true}, {"blockchain", "gettxout", &gettxout, true},
     {"blockchain", "gettxoutproof", &gettxoutproof, true}, {"blockchain", "verifytxoutproof", &verifytxoutproof, true},
     {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true}, {"blockchain", "verifychain", &verifychain, true},
+    {"blockchain", "dumptxoutset", &dumptxoutset, true},
+    {"blockchain", "scantxoutset", &scantxoutset, true},
+    {"blockchain", "getdbstats", &getdbstats, true},
+    {"blockchain", "getmempoolrejects", &getmempoolrejects, true},
+    {"blockchain", "getvalidationstats", &getvalidationstats, true},
+    {"blockchain", "getblockstats", &getblockstats, true},
+    {"blockchain", "getblockfilter", &getblockfilter, true},
+
+    /* Address and spent indexes */
+    {"addressindex", "getaddressbalance", &getaddressbalance, true},
+    {"addressindex", "getaddressutxos", &getaddressutxos, true},
+    {"addressindex", "getaddresstxids", &getaddresstxids, true},
+    {"addressindex", "getspentinfo", &getspentinfo, true},
 
     /* Mining */
     {"mining", "getblocktemplate", &getblocktemplate, true}, {"mining", "getmininginfo", &getmininginfo, true},
@@ -343,6 +514,7 @@ static const CRPCCommand vRPCCommands[] = {
     {"rawtransactions", "decodescript", &decodescript, true},
     {"rawtransactions", "getrawtransaction", &getrawtransaction, true},
     {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false},
+    {"rawtransactions", "sendrawtransactions", &sendrawtransactions, false},
     {"rawtransactions", "signrawtransaction", &signrawtransaction, false}, /* uses wallet if enabled */
     {"rawtransactions", "fundrawtransaction", &fundrawtransaction, false},
 
@@ -355,9 +527,11 @@ static const CRPCCommand vRPCCommands[] = {
     /* Not shown in help */
     {"hidden", "invalidateblock", &invalidateblock, true}, {"hidden", "reconsiderblock", &reconsiderblock, true},
     {"hidden", "setmocktime", &setmocktime, true},
+    {"hidden", "generatesyntheticchain", &generatesyntheticchain, true},
     {"hidden", "resendwallettransactions", &resendwallettransactions, true},
 
     /* Wallet */
+    {"wallet", "abortrescan", &abortrescan, false},
     {"wallet", "addmultisigaddress", &addmultisigaddress, true}, {"wallet", "backupwallet", &backupwallet, true},
     {"wallet", "dumpprivkey", &dumpprivkey, true}, {"wallet", "dumpwallet", &dumpwallet, true},
     {"wallet", "listaddresses", &listaddresses, true}, {"wallet", "encryptwallet", &encryptwallet, true},
@@ -368,7 +542,8 @@ static const CRPCCommand vRPCCommands[] = {
     {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false},
     {"wallet", "getwalletinfo", &getwalletinfo, false}, {"wallet", "importprivkey", &importprivkey, true},
     {"wallet", "importwallet", &importwallet, true}, {"wallet", "importaddress", &importaddress, true},
-    {"wallet", "importpubkey", &importpubkey, true}, {"wallet", "keypoolrefill", &keypoolrefill, true},
+    {"wallet", "importpubkey", &importpubkey, true}, {"wallet", "importmulti", &importmulti, true},
+    {"wallet", "keypoolrefill", &keypoolrefill, true},
     {"wallet", "listaddressgroupings", &listaddressgroupings, false},
     {"wallet", "listlockunspent", &listlockunspent, false},
     {"wallet", "listreceivedbyaddress", &listreceivedbyaddress, false},
@@ -380,6 +555,13 @@ static const CRPCCommand vRPCCommands[] = {
     {"wallet", "walletpassphrase", &walletpassphrase, true},
 };
 
+/** Commands of vRPCCommands whose large results can be streamed */
+static const CRPCStreamCommand vRPCStreamCommands[] = {
+    //  name                      actor (function)
+    //  ------------------------  -----------------------
+    {"getblock", &getblock_stream}, {"getrawmempool", &getrawmempool_stream},
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -390,6 +572,11 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (const CRPCStreamCommand &cmd : vRPCStreamCommands)
+    {
+        assert(mapCommands.count(cmd.name));
+        mapStreamCommands[cmd.name] = &cmd;
+    }
 }
 
 const CRPCCommand *CRPCTable::operator[](const std::string &name) const
@@ -402,7 +589,7 @@ const CRPCCommand *CRPCTable::operator[](const std::string &name) const
 
 bool StartRPC()
 {
-    LogPrint("rpc", "Starting RPC\n");
+    LogPrint(Logging::RPC, "Starting RPC\n");
     fRPCRunning = true;
     g_rpcSignals.Started();
     return true;
@@ -410,14 +597,14 @@ bool StartRPC()
 
 void InterruptRPC()
 {
-    LogPrint("rpc", "Interrupting RPC\n");
+    LogPrint(Logging::RPC, "Interrupting RPC\n");
     // Interrupt e.g. running longpolls
     fRPCRunning = false;
 }
 
 void StopRPC()
 {
-    LogPrint("rpc", "Stopping RPC\n");
+    LogPrint(Logging::RPC, "Stopping RPC\n");
     deadlineTimers.clear();
     g_rpcSignals.Stopped();
 }
@@ -462,7 +649,7 @@ void JSONRequest::parse(const UniValue &valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Method must be a string");
     strMethod = valMethod.get_str();
     if (strMethod != "getblocktemplate")
-        LogPrint("rpc", "ThreadRPCServer method=%s\n", SanitizeString(strMethod));
+        LogPrint(Logging::RPC, "ThreadRPCServer method=%s\n", SanitizeString(strMethod));
 
     // Parse params
     UniValue valParams = find_value(request, "params");
@@ -498,13 +685,76 @@ static UniValue JSONRPCExecOne(const UniValue &req)
     return rpc_result;
 }
 
+/**
+ * Commands that only read the chain, the UTXO set or the mempool under their own locks and change nothing, so the
+ * elements of a batch calling them can be run at the same time.
+ */
+static const std::set<std::string> setParallelRPCCommands = {"getbestblockhash", "getblock", "getblockcount",
+    "getblockhash", "getblockheader", "getdifficulty", "getmempoolinfo", "getrawmempool", "getrawtransaction",
+    "gettxout", "gettxoutproof", "verifytxoutproof", "decoderawtransaction", "decodescript", "validateaddress",
+    "verifymessage"};
+
+static bool IsParallelRequest(const UniValue &req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue &valMethod = find_value(req.get_obj(), "method");
+    return valMethod.isStr() && setParallelRPCCommands.count(valMethod.get_str());
+}
+
+/** Run the requests [nBegin, nEnd) of vReq on up to nThreads threads, the calling one included */
+static void JSONRPCExecParallel(const UniValue &vReq,
+    size_t nBegin,
+    size_t nEnd,
+    size_t nThreads,
+    std::vector<UniValue> &vReplies)
+{
+    std::atomic<size_t> nNext(nBegin);
+    auto worker = [&]() {
+        size_t reqIdx;
+        while ((reqIdx = nNext++) < nEnd)
+            vReplies[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+    };
+
+    std::vector<std::thread> vThreads;
+    nThreads = std::min(nThreads, nEnd - nBegin);
+    for (size_t i = 1; i < nThreads; i++)
+        vThreads.emplace_back(worker);
+    worker();
+    for (std::thread &thread : vThreads)
+        thread.join();
+}
+
 std::string JSONRPCExecBatch(const UniValue &vReq)
 {
+    const size_t nThreads = std::max((int64_t)gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), (int64_t)1);
+    std::vector<UniValue> vReplies(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size())
+    {
+        size_t nEnd = reqIdx;
+        while (nThreads > 1 && nEnd < vReq.size() && IsParallelRequest(vReq[nEnd]))
+            nEnd++;
+        if (nEnd - reqIdx > 1)
+        {
+            JSONRPCExecParallel(vReq, reqIdx, nEnd, nThreads, vReplies);
+            reqIdx = nEnd;
+        }
+        else
+        {
+            vReplies[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+        }
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    ret.reserve(vReplies.size());
+    for (UniValue &reply : vReplies)
+        ret.push_back(std::move(reply));
 
-    return ret.write() + "\n";
+    std::string strReply = ret.write();
+    strReply += "\n";
+    return strReply;
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
@@ -537,6 +787,30 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+bool CRPCTable::executeStream(const std::string &strMethod, const UniValue &params, CJSONStreamWriter &writer) const
+{
+    std::map<std::string, const CRPCStreamCommand *>::const_iterator it = mapStreamCommands.find(strMethod);
+    if (it == mapStreamCommands.end())
+        return false;
+
+    {
+        LOCK(cs_rpcWarmup);
+        if (fRPCInWarmup)
+            throw JSONRPCError(RPC_IN_WARMUP, rpcWarmupStatus);
+    }
+
+    g_rpcSignals.PreCommand(*mapCommands.at(strMethod));
+
+    try
+    {
+        return it->second->actor(params, writer);
+    }
+    catch (const std::exception &e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
 std::string HelpExampleCli(const std::string &methodname, const std::string &args)
 {
     return "> eccoin-cli " + methodname + " " + args + "\n";
@@ -563,7 +837,7 @@ void RPCRunLater(const std::string &name, boost::function<void(void)> func, int6
         throw JSONRPCError(RPC_INTERNAL_ERROR, "No timer handler registered for RPC");
     deadlineTimers.erase(name);
     RPCTimerInterface *timerInterface = timerInterfaces.back();
-    LogPrint("rpc", "queue run of timer %s in %i seconds (using %s)\n", name, nSeconds, timerInterface->Name());
+    LogPrint(Logging::RPC, "queue run of timer %s in %i seconds (using %s)\n", name, nSeconds, timerInterface->Name());
     deadlineTimers.insert(
         std::make_pair(name, boost::shared_ptr<RPCTimerBase>(timerInterface->NewTimer(func, nSeconds * 1000))));
 }
@@ -45,6 +45,7 @@ void OnPostCommand(boost::function<void(const CRPCCommand &)> slot);
 }
 
 class CBlockIndex;
+class CJSONStreamWriter;
 class CNetAddr;
 
 class JSONRequest
@@ -126,6 +127,9 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface);
  */
 void RPCRunLater(const std::string &name, boost::function<void(void)> func, int64_t nSeconds);
 
+/** Default for -rpcbatchthreads, the number of elements of a JSON-RPC batch that are run at the same time */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+
 typedef UniValue (*rpcfn_type)(const UniValue &params, bool fHelp);
 
 class CRPCCommand
@@ -137,6 +141,20 @@ public:
     bool okSafeMode;
 };
 
+/**
+ * Writes the result of a command to a stream instead of returning it, for the commands whose results can be too
+ * large to build as one UniValue. Returns false, before writing anything, for the calls the plain actor of the
+ * command should handle instead.
+ */
+typedef bool (*rpcstreamfn_type)(const UniValue &params, CJSONStreamWriter &writer);
+
+class CRPCStreamCommand
+{
+public:
+    std::string name;
+    rpcstreamfn_type actor;
+};
+
 /**
  * Bitcoin RPC command dispatcher.
  */
@@ -144,6 +162,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand *> mapCommands;
+    std::map<std::string, const CRPCStreamCommand *> mapStreamCommands;
 
 public:
     CRPCTable();
@@ -158,6 +177,13 @@ public:
      * @throws an exception (UniValue) when an error happens.
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
+
+    /**
+     * Execute a method, writing its result to writer.
+     * @returns false if the method has no streaming form for these params, nothing is written then.
+     * @throws an exception (UniValue) when an error happens, which may be after part of the result was written.
+     */
+    bool executeStream(const std::string &method, const UniValue &params, CJSONStreamWriter &writer) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -175,6 +201,10 @@ extern int64_t nWalletUnlockTime;
 extern CAmount AmountFromValue(const UniValue &value);
 extern CAmount AmountFromValue_Original(const UniValue &value);
 extern UniValue ValueFromAmount(const CAmount &amount);
+class CTimeHistogram;
+/** count, total, mean and max in milliseconds and the buckets of a histogram, HelpTimeHistogram describes them */
+extern UniValue TimeHistogramToJSON(const CTimeHistogram &histogram);
+extern std::string HelpTimeHistogram(const std::string &indent);
 extern double GetDifficulty(const CBlockIndex *blockindex = NULL);
 extern std::string HelpRequiringPassphrase();
 extern std::string HelpExampleCli(const std::string &methodname, const std::string &args);
@@ -184,6 +214,7 @@ extern void EnsureWalletIsUnlocked();
 
 extern UniValue getconnectioncount(const UniValue &params, bool fHelp); // in rpcnet.cpp
 extern UniValue getpeerinfo(const UniValue &params, bool fHelp);
+extern UniValue getnetmsgstats(const UniValue &params, bool fHelp);
 extern UniValue ping(const UniValue &params, bool fHelp);
 extern UniValue addnode(const UniValue &params, bool fHelp);
 extern UniValue disconnectnode(const UniValue &params, bool fHelp);
@@ -197,9 +228,11 @@ extern UniValue dumpprivkey(const UniValue &params, bool fHelp); // in rpcdump.c
 extern UniValue importprivkey(const UniValue &params, bool fHelp);
 extern UniValue importaddress(const UniValue &params, bool fHelp);
 extern UniValue importpubkey(const UniValue &params, bool fHelp);
+extern UniValue importmulti(const UniValue &params, bool fHelp);
 extern UniValue dumpwallet(const UniValue &params, bool fHelp);
 extern UniValue listaddresses(const UniValue &params, bool fHelp);
 extern UniValue importwallet(const UniValue &params, bool fHelp);
+extern UniValue abortrescan(const UniValue &params, bool fHelp);
 
 extern UniValue getgenerate(const UniValue &params, bool fHelp); // in rpcmining.cpp
 extern UniValue setgenerate(const UniValue &params, bool fHelp);
@@ -209,6 +242,7 @@ extern UniValue generate(const UniValue &params, bool fHelp);
 extern UniValue generatepos(const UniValue &params, bool fHelp);
 extern UniValue generatetoaddress(const UniValue &params, bool fHelp);
 extern UniValue generatepostoaddress(const UniValue &params, bool fHelp);
+extern UniValue generatesyntheticchain(const UniValue &params, bool fHelp);
 extern UniValue getnetworkhashps(const UniValue &params, bool fHelp);
 extern UniValue getmininginfo(const UniValue &params, bool fHelp);
 extern UniValue prioritisetransaction(const UniValue &params, bool fHelp);
@@ -254,6 +288,11 @@ extern UniValue getwalletinfo(const UniValue &params, bool fHelp);
 extern UniValue getblockchaininfo(const UniValue &params, bool fHelp);
 extern UniValue getnetworkinfo(const UniValue &params, bool fHelp);
 extern UniValue setmocktime(const UniValue &params, bool fHelp);
+extern UniValue getmemoryinfo(const UniValue &params, bool fHelp);
+extern UniValue getaddressbalance(const UniValue &params, bool fHelp);
+extern UniValue getaddressutxos(const UniValue &params, bool fHelp);
+extern UniValue getaddresstxids(const UniValue &params, bool fHelp);
+extern UniValue getspentinfo(const UniValue &params, bool fHelp);
 extern UniValue resendwallettransactions(const UniValue &params, bool fHelp);
 
 extern UniValue getrawtransaction(const UniValue &params, bool fHelp); // in rcprawtransaction.cpp
@@ -266,6 +305,7 @@ extern UniValue decodescript(const UniValue &params, bool fHelp);
 extern UniValue fundrawtransaction(const UniValue &params, bool fHelp);
 extern UniValue signrawtransaction(const UniValue &params, bool fHelp);
 extern UniValue sendrawtransaction(const UniValue &params, bool fHelp);
+extern UniValue sendrawtransactions(const UniValue &params, bool fHelp);
 extern UniValue gettxoutproof(const UniValue &params, bool fHelp);
 extern UniValue verifytxoutproof(const UniValue &params, bool fHelp);
 
@@ -274,11 +314,20 @@ extern UniValue getbestblockhash(const UniValue &params, bool fHelp);
 extern UniValue getdifficulty(const UniValue &params, bool fHelp);
 extern UniValue settxfee(const UniValue &params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue &params, bool fHelp);
+extern UniValue getmempoolrejects(const UniValue &params, bool fHelp);
 extern UniValue getrawmempool(const UniValue &params, bool fHelp);
+extern bool getrawmempool_stream(const UniValue &params, CJSONStreamWriter &writer);
 extern UniValue getblockhash(const UniValue &params, bool fHelp);
 extern UniValue getblockheader(const UniValue &params, bool fHelp);
+extern UniValue getblockfilter(const UniValue &params, bool fHelp);
 extern UniValue getblock(const UniValue &params, bool fHelp);
+extern bool getblock_stream(const UniValue &params, CJSONStreamWriter &writer);
 extern UniValue gettxoutsetinfo(const UniValue &params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue &params, bool fHelp);
+extern UniValue scantxoutset(const UniValue &params, bool fHelp);
+extern UniValue getdbstats(const UniValue &params, bool fHelp);
+extern UniValue getvalidationstats(const UniValue &params, bool fHelp);
+extern UniValue getblockstats(const UniValue &params, bool fHelp);
 extern UniValue gettxout(const UniValue &params, bool fHelp);
 extern UniValue verifychain(const UniValue &params, bool fHelp);
 extern UniValue getchaintips(const UniValue &params, bool fHelp);
@@ -294,6 +343,11 @@ extern UniValue sendtoans(const UniValue &params, bool fHelp);
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
+/**
+ * Run the requests of a batch and return the array of their replies, in the order of the requests. Runs of
+ * requests for read only chain and mempool queries are run on up to -rpcbatchthreads threads at once, any other
+ * request waits for the ones before it and is waited for by the ones after it.
+ */
 std::string JSONRPCExecBatch(const UniValue &vReq);
 int CommandLineRPC(int argc, char *argv[]);
 
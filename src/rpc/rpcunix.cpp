@@ -0,0 +1,290 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rpc/rpcunix.h"
+
+#include "args.h"
+#include "compat.h"
+#include "crypto/common.h"
+#include "fs.h"
+#include "rpc/rpcprotocol.h"
+#include "rpc/rpcserver.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string.h>
+#include <thread>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <univalue.h>
+
+std::string ExecRPCUnixRequest(const std::string &strRequest)
+{
+    JSONRequest jreq;
+    try
+    {
+        UniValue valRequest;
+        if (!valRequest.read(strRequest))
+            throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+        if (valRequest.isArray())
+            return JSONRPCExecBatch(valRequest.get_array());
+        if (!valRequest.isObject())
+            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+        jreq.parse(valRequest);
+        UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
+        return JSONRPCReply(result, NullUniValue, jreq.id);
+    }
+    catch (const UniValue &objError)
+    {
+        return JSONRPCReply(NullUniValue, objError, jreq.id);
+    }
+    catch (const std::exception &e)
+    {
+        return JSONRPCReply(NullUniValue, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+    }
+}
+
+#ifndef WIN32
+
+/** How long a thread waits on its socket before it looks again whether the server stops, in milliseconds */
+static const int RPC_UNIX_POLL_INTERVAL = 200;
+
+struct CRPCUnixConnection
+{
+    const int fd;
+    std::thread thread;
+    //! set by the thread of the connection once it closed it
+    std::atomic<bool> fDone;
+
+    CRPCUnixConnection(int fdIn) : fd(fdIn), fDone(false) {}
+};
+
+static int nRPCUnixListen = -1;
+static fs::path pathRPCUnixSocket;
+static std::atomic<bool> fRPCUnixStop(false);
+static std::thread threadRPCUnixAccept;
+
+/** Wait until fd has one of events, false when the server stops first */
+static bool WaitRPCUnixSocket(int fd, short events)
+{
+    while (!fRPCUnixStop)
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        const int nReady = poll(&pfd, 1, RPC_UNIX_POLL_INTERVAL);
+        if (nReady < 0 && errno != EINTR)
+            return false;
+        // a closed or failed socket is found out by the recv or send that follows
+        if (nReady > 0)
+            return true;
+    }
+    return false;
+}
+
+static bool RecvRPCUnix(int fd, char *p, size_t nSize)
+{
+    while (nSize > 0)
+    {
+        if (!WaitRPCUnixSocket(fd, POLLIN))
+            return false;
+        const ssize_t nRead = recv(fd, p, nSize, 0);
+        if (nRead < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+        if (nRead <= 0)
+            return false;
+        p += nRead;
+        nSize -= nRead;
+    }
+    return true;
+}
+
+static bool SendRPCUnix(int fd, const char *p, size_t nSize)
+{
+    while (nSize > 0)
+    {
+        if (!WaitRPCUnixSocket(fd, POLLOUT))
+            return false;
+        const ssize_t nSent = send(fd, p, nSize, MSG_NOSIGNAL);
+        if (nSent < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+        if (nSent <= 0)
+            return false;
+        p += nSent;
+        nSize -= nSent;
+    }
+    return true;
+}
+
+static void ThreadRPCUnixConnection(CRPCUnixConnection *conn)
+{
+    RenameThread("bitcoin-rpcunix");
+    std::string strRequest;
+    while (!fRPCUnixStop)
+    {
+        unsigned char header[4];
+        if (!RecvRPCUnix(conn->fd, (char *)header, sizeof(header)))
+            break;
+        const uint32_t nSize = ReadLE32(header);
+        if (nSize > MAX_RPC_UNIX_REQUEST_SIZE)
+        {
+            LogPrint(Logging::RPC, "RPC Unix socket request of %u bytes is too large\n", nSize);
+            break;
+        }
+        strRequest.resize(nSize);
+        if (nSize > 0 && !RecvRPCUnix(conn->fd, &strRequest[0], nSize))
+            break;
+
+        // the size goes in front of the reply so both are sent at once
+        std::string strReply = ExecRPCUnixRequest(strRequest);
+        if (strReply.size() > UINT32_MAX)
+        {
+            LogPrintf("RPC Unix socket reply of %u bytes does not fit a frame\n", strReply.size());
+            break;
+        }
+        WriteLE32(header, strReply.size());
+        strReply.insert(0, (const char *)header, sizeof(header));
+        if (!SendRPCUnix(conn->fd, strReply.data(), strReply.size()))
+            break;
+    }
+    close(conn->fd);
+    conn->fDone = true;
+}
+
+static void ThreadRPCUnixAccept()
+{
+    RenameThread("bitcoin-rpcunix");
+    std::list<std::unique_ptr<CRPCUnixConnection> > listConnections;
+    while (WaitRPCUnixSocket(nRPCUnixListen, POLLIN))
+    {
+        for (auto it = listConnections.begin(); it != listConnections.end();)
+        {
+            if ((*it)->fDone)
+            {
+                (*it)->thread.join();
+                it = listConnections.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        const int fd = accept(nRPCUnixListen, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        if (listConnections.size() >= (size_t)MAX_RPC_UNIX_CONNECTIONS)
+        {
+            LogPrint(Logging::RPC, "RPC Unix socket connection refused, %d are open\n", listConnections.size());
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        listConnections.emplace_back(new CRPCUnixConnection(fd));
+        CRPCUnixConnection *conn = listConnections.back().get();
+        conn->thread = std::thread(&ThreadRPCUnixConnection, conn);
+    }
+    if (!fRPCUnixStop)
+        LogPrintf("RPC Unix socket stopped accepting connections: %s\n", strerror(errno));
+    for (auto &conn : listConnections)
+        conn->thread.join();
+}
+
+bool StartRPCUnixSocket()
+{
+    if (gArgs.GetArg("-rpcunixsocket", "").empty())
+        return true;
+    fs::path path(gArgs.GetArg("-rpcunixsocket", ""));
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    const std::string strPath = path.string();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strPath.size() >= sizeof(addr.sun_path))
+        return error("%s: the socket path %s is too long", __func__, strPath);
+    memcpy(addr.sun_path, strPath.data(), strPath.size());
+
+    // the socket of a node that did not shut down cleanly, the data directory lock keeps out a running one
+    struct stat st;
+    if (lstat(strPath.c_str(), &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+            return error("%s: %s exists and is not a socket", __func__, strPath);
+        unlink(strPath.c_str());
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return error("%s: cannot create a Unix socket: %s", __func__, strerror(errno));
+    // no connection is accepted before listen, so the mode is set before anyone can get in
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(strPath.c_str(), S_IRUSR | S_IWUSR) < 0 ||
+        listen(fd, SOMAXCONN) < 0)
+    {
+        const int nErr = errno;
+        close(fd);
+        unlink(strPath.c_str());
+        return error("%s: cannot listen on %s: %s", __func__, strPath, strerror(nErr));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    nRPCUnixListen = fd;
+    pathRPCUnixSocket = path;
+    fRPCUnixStop = false;
+    threadRPCUnixAccept = std::thread(&ThreadRPCUnixAccept);
+    LogPrintf("Listening for JSON-RPC on %s\n", strPath);
+    return true;
+}
+
+void StopRPCUnixSocket()
+{
+    if (nRPCUnixListen < 0)
+        return;
+    LogPrint(Logging::RPC, "Stopping RPC Unix socket server\n");
+    fRPCUnixStop = true;
+    if (threadRPCUnixAccept.joinable())
+        threadRPCUnixAccept.join();
+    close(nRPCUnixListen);
+    nRPCUnixListen = -1;
+    unlink(pathRPCUnixSocket.string().c_str());
+}
+
+#else
+
+bool StartRPCUnixSocket()
+{
+    if (gArgs.GetArg("-rpcunixsocket", "").empty())
+        return true;
+    return error("%s: -rpcunixsocket is not supported on Windows", __func__);
+}
+
+void StopRPCUnixSocket() {}
+
+#endif
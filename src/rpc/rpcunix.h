@@ -0,0 +1,47 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_RPC_RPCUNIX_H
+#define BITCOIN_RPC_RPCUNIX_H
+
+#include <stddef.h>
+#include <string>
+
+/** Local clients connected to the RPC Unix socket at the same time, more are closed right away */
+static const int MAX_RPC_UNIX_CONNECTIONS = 16;
+/** The largest request frame, a larger size closes the connection */
+static const size_t MAX_RPC_UNIX_REQUEST_SIZE = 32 * 1024 * 1024;
+
+/**
+ * JSON-RPC on the Unix domain socket of -rpcunixsocket, for clients on the same machine that make many calls.
+ *
+ * There is no HTTP and no password: whoever may open the socket file, which is created with mode 0600, may call
+ * every method. A connection stays open for any number of requests. Every request and every reply is one frame, its
+ * size as 4 bytes little endian followed by that many bytes of JSON, a request object or a batch array as the
+ * HTTP server takes them. Requests on one connection are run one after another on the thread of the connection.
+ */
+
+/** Listen on -rpcunixsocket if it is set, true if it is not. Precondition; RPC has been started. */
+bool StartRPCUnixSocket();
+/** Close the socket and every connection, waiting for requests that run to finish. */
+void StopRPCUnixSocket();
+
+/** The reply to a request frame, also with an error reply when it does not parse */
+std::string ExecRPCUnixRequest(const std::string &strRequest);
+
+#endif // BITCOIN_RPC_RPCUNIX_H
@@ -80,10 +80,10 @@ void WalletTxToJSON(const CWalletTx &wtx, UniValue &entry)
     }
     if (confirms > 0)
     {
-        READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
         entry.push_back(Pair("blockhash", wtx.hashBlock.GetHex()));
         entry.push_back(Pair("blockindex", wtx.nIndex));
-        entry.push_back(Pair("blocktime", pnetMan->getChainActive()->mapBlockIndex[wtx.hashBlock]->GetBlockTime()));
+        CBlockIndex *pindex = pnetMan->getChainActive()->LookupBlockIndex(wtx.hashBlock);
+        entry.push_back(Pair("blocktime", pindex ? pindex->GetBlockTime() : 0));
     }
     else
     {
@@ -100,6 +100,7 @@ void WalletTxToJSON(const CWalletTx &wtx, UniValue &entry)
     entry.push_back(Pair("time", wtx.GetTxTime()));
     entry.push_back(Pair("locktime", (int64_t)wtx.tx->nLockTime));
     entry.push_back(Pair("timereceived", (int64_t)wtx.nTimeReceived));
+    entry.push_back(Pair("orderpos", wtx.nOrderPos));
 
     for (auto const &item : wtx.mapValue)
     {
@@ -329,7 +330,7 @@ UniValue listaddressgroupings(const UniValue &params, bool fHelp)
         for (auto const &address : grouping)
         {
             UniValue addressInfo(UniValue::VARR);
-            addressInfo.push_back(CBitcoinAddress(address).ToString());
+            addressInfo.push_back(pwalletMain->EncodeAddress(address));
             addressInfo.push_back(ValueFromAmount(balances[address]));
             {
                 if (pwalletMain->mapAddressBook.find(CBitcoinAddress(address).Get()) !=
@@ -815,7 +816,7 @@ UniValue ListReceived(const UniValue &params, bool fByAccounts)
             UniValue obj(UniValue::VOBJ);
             if (fIsWatchonly)
                 obj.push_back(Pair("involvesWatchonly", true));
-            obj.push_back(Pair("address", address.ToString()));
+            obj.push_back(Pair("address", pwalletMain->EncodeAddress(address.Get())));
             obj.push_back(Pair("account", strAccount));
             obj.push_back(Pair("amount", ValueFromAmount(nAmount)));
             obj.push_back(Pair("confirmations", (nConf == std::numeric_limits<int>::max() ? 0 : nConf)));
@@ -899,9 +900,8 @@ UniValue listreceivedbyaddress(const UniValue &params, bool fHelp)
 
 static void MaybePushAddress(UniValue &entry, const CTxDestination &dest)
 {
-    CBitcoinAddress addr;
-    if (addr.Set(dest))
-        entry.push_back(Pair("address", addr.ToString()));
+    if (!boost::get<CNoDestination>(&dest))
+        entry.push_back(Pair("address", pwalletMain->EncodeAddress(dest)));
 }
 
 void ListTransactions(const CWalletTx &wtx, int nMinDepth, bool fLong, UniValue &ret, const isminefilter &filter)
@@ -999,9 +999,9 @@ UniValue listtransactions(const UniValue &params, bool fHelp)
     if (!EnsureWalletIsAvailable(fHelp))
         return NullUniValue;
 
-    if (fHelp || params.size() > 4)
+    if (fHelp || params.size() > 5)
         throw std::runtime_error(
-            "listtransactions ( \"account\" count from includeWatchonly)\n"
+            "listtransactions ( \"account\" count from includeWatchonly before )\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account "
             "'account'.\n"
             "\nArguments:\n"
@@ -1010,6 +1010,10 @@ UniValue listtransactions(const UniValue &params, bool fHelp)
             "3. from           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. includeWatchonly (bool, optional, default=false) Include transactions to watchonly addresses (see "
             "'importaddress')\n"
+            "5. before         (numeric, optional) Only list transactions with an orderpos below this one. Pass the "
+            "orderpos\n"
+            "                  of the oldest transaction of a page to get the page before it, new transactions do "
+            "not shift it\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1057,6 +1061,7 @@ UniValue listtransactions(const UniValue &params, bool fHelp)
             "    \"timereceived\": xxx,      (numeric) The time received in seconds since epoch (midnight Jan 1 1970 "
             "GMT). Available \n"
             "                                          for 'send' and 'receive' category of transactions.\n"
+            "    \"orderpos\": n,            (numeric) The position of the transaction in the wallet, for 'before'\n"
             "    \"comment\": \"...\",       (string) If a comment is associated with the transaction.\n"
             "    \"label\": \"label\"        (string) A comment for the address/transaction, if any\n"
             "    \"otheraccount\": \"accountname\",  (string) For the 'move' category of transactions, the account the "
@@ -1074,7 +1079,8 @@ UniValue listtransactions(const UniValue &params, bool fHelp)
             "\nExamples:\n"
             "\nList the most recent 10 transactions in the systems\n" +
             HelpExampleCli("listtransactions", "") + "\nList transactions 100 to 120\n" +
-            HelpExampleCli("listtransactions", "\"*\" 20 100") + "\nAs a json rpc call\n" +
+            HelpExampleCli("listtransactions", "\"*\" 20 100") + "\nThe 20 transactions before position 5000\n" +
+            HelpExampleCli("listtransactions", "\"*\" 20 0 false 5000") + "\nAs a json rpc call\n" +
             HelpExampleRpc("listtransactions", "\"*\", 20, 100"));
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
@@ -1093,6 +1099,10 @@ UniValue listtransactions(const UniValue &params, bool fHelp)
         if (params[3].get_bool())
             filter = filter | ISMINE_WATCH_ONLY;
 
+    int64_t nBefore = std::numeric_limits<int64_t>::max();
+    if (params.size() > 4 && !params[4].isNull())
+        nBefore = params[4].get_int64();
+
     if (nCount < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     if (nFrom < 0)
@@ -1102,8 +1112,8 @@ UniValue listtransactions(const UniValue &params, bool fHelp)
 
     const CWallet::TxItems &txOrdered = pwalletMain->wtxOrdered;
 
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    // iterate backwards from the cursor until we have nCount items to return:
+    for (CWallet::TxItems::const_reverse_iterator it(txOrdered.lower_bound(nBefore)); it != txOrdered.rend(); ++it)
     {
         CWalletTx *const pwtx = (*it).second;
         ListTransactions(*pwtx, 0, true, ret, filter);
@@ -1225,13 +1235,11 @@ UniValue listsinceblock(const UniValue &params, bool fHelp)
 
     UniValue transactions(UniValue::VARR);
 
-    for (std::map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end();
-         it++)
+    // only the heights after the block, and what no block of the active chain confirms
+    for (const CWalletTx *pwtx : pwalletMain->GetTransactionsSince(pindex ? pindex->nHeight : -1))
     {
-        CWalletTx tx = (*it).second;
-
-        if (depth == -1 || tx.GetDepthInMainChain() < depth)
-            ListTransactions(tx, 0, true, transactions, filter);
+        if (depth == -1 || pwtx->GetDepthInMainChain() < depth)
+            ListTransactions(*pwtx, 0, true, transactions, filter);
     }
 
     CBlockIndex *pblockLast =
@@ -1834,23 +1842,41 @@ UniValue getwalletinfo(const UniValue &params, bool fHelp)
                             "Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
                             "  \"paytxfee\": x.xxxx,         (numeric) the transaction fee configuration, set in " +
             CURRENCY_UNIT + "/kB\n"
+                            "  \"scanning\":                 (json object) current scanning details, or false if no "
+                            "scan is in progress\n"
+                            "    {\n"
+                            "      \"duration\" : xxxx      (numeric) elapsed seconds since scan start\n"
+                            "      \"progress\" : x.xxxx,   (numeric) scanning progress percentage [0.0, 1.0]\n"
+                            "    }\n"
                             "}\n"
                             "\nExamples:\n" +
             HelpExampleCli("getwalletinfo", "") + HelpExampleRpc("getwalletinfo", ""));
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
+    const CWalletBalances balances = pwalletMain->GetBalances();
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
-    obj.push_back(Pair("balance", ValueFromAmount(pwalletMain->GetBalance())));
-    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(pwalletMain->GetUnconfirmedBalance())));
-    obj.push_back(Pair("immature_balance", ValueFromAmount(pwalletMain->GetImmatureBalance())));
+    obj.push_back(Pair("balance", ValueFromAmount(balances.nTrusted)));
+    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(balances.nUnconfirmed)));
+    obj.push_back(Pair("immature_balance", ValueFromAmount(balances.nImmature)));
     obj.push_back(Pair("txcount", (int)pwalletMain->mapWallet.size()));
     obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
     obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
     obj.push_back(Pair("paytxfee", ValueFromAmount(payTxFee.GetFeePerK())));
+    if (pwalletMain->IsScanning())
+    {
+        UniValue scanning(UniValue::VOBJ);
+        scanning.push_back(Pair("duration", pwalletMain->GetScanDuration() / 1000));
+        scanning.push_back(Pair("progress", pwalletMain->GetScanProgress()));
+        obj.push_back(Pair("scanning", scanning));
+    }
+    else
+    {
+        obj.push_back(Pair("scanning", false));
+    }
     return obj;
 }
 
@@ -1979,7 +2005,7 @@ UniValue listunspent(const UniValue &params, bool fHelp)
         CTxDestination address;
         if (ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, address))
         {
-            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+            entry.push_back(Pair("address", pwalletMain->EncodeAddress(address)));
             if (pwalletMain->mapAddressBook.count(address))
                 entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
         }
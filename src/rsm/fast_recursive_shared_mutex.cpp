@@ -0,0 +1,347 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "fast_recursive_shared_mutex.h"
+
+thread_local std::vector<fast_recursive_shared_mutex::shared_count> fast_recursive_shared_mutex::_shared_counts;
+
+////////////////////////
+///
+/// Private Functions
+///
+
+fast_recursive_shared_mutex::shared_count *fast_recursive_shared_mutex::find_shared_count()
+{
+    for (auto it = _shared_counts.rbegin(); it != _shared_counts.rend(); ++it)
+    {
+        if (it->mutex == this)
+        {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+void fast_recursive_shared_mutex::add_shared_count(const uint64_t &count)
+{
+    shared_count *held = find_shared_count();
+    if (held)
+    {
+        held->count = held->count + count;
+    }
+    else
+    {
+        _shared_counts.push_back({this, count});
+    }
+}
+
+void fast_recursive_shared_mutex::erase_shared_count()
+{
+    for (auto it = _shared_counts.begin(); it != _shared_counts.end(); ++it)
+    {
+        if (it->mutex == this)
+        {
+            _shared_counts.erase(it);
+            return;
+        }
+    }
+}
+
+bool fast_recursive_shared_mutex::end_of_exclusive_ownership()
+{
+    return (_shared_while_exclusive_counter == 0 && _write_counter == 0);
+}
+
+void fast_recursive_shared_mutex::update_exclusive_bit()
+{
+    if (!end_of_exclusive_ownership() || _promotion_candidate_id != NON_THREAD_ID)
+    {
+        _state.fetch_or(EXCLUSIVE_BIT);
+    }
+    else
+    {
+        _state.fetch_and(~EXCLUSIVE_BIT);
+    }
+}
+
+bool fast_recursive_shared_mutex::try_add_reader()
+{
+    uint64_t state = _state.load();
+    while ((state & EXCLUSIVE_BIT) == 0)
+    {
+        if (_state.compare_exchange_weak(state, state + 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void fast_recursive_shared_mutex::remove_reader()
+{
+    const uint64_t state = _state.fetch_sub(1);
+    // nobody waits for the readers to leave as long as the exclusive bit is clear, a thread that sets it checks the
+    // number of readers under _mutex afterwards
+    if ((state & EXCLUSIVE_BIT) == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> _lock(_mutex);
+    const size_t readers = get_shared_owners_count();
+    if (_promotion_candidate_id != NON_THREAD_ID)
+    {
+        if (readers == 1)
+        {
+            _promotion_write_gate.notify_one();
+        }
+    }
+    else if (_write_counter != 0 && readers == 0)
+    {
+        _write_gate.notify_one();
+    }
+}
+
+////////////////////////
+///
+/// Public Functions
+///
+
+void fast_recursive_shared_mutex::lock()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    std::unique_lock<std::mutex> _lock(_mutex);
+    if (_write_owner_id == locking_thread_id)
+    {
+        _write_counter++;
+    }
+    else
+    {
+        // Wait until we can set the write-entered.
+        _read_gate.wait(_lock, [this] { return end_of_exclusive_ownership(); });
+
+        _write_counter++;
+        update_exclusive_bit();
+        // Then wait until there are no more readers.
+        _write_gate.wait(
+            _lock, [this] { return get_shared_owners_count() == 0 && _promotion_candidate_id == NON_THREAD_ID; });
+        _write_owner_id = locking_thread_id;
+    }
+}
+
+bool fast_recursive_shared_mutex::try_promotion()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    std::unique_lock<std::mutex> _lock(_mutex);
+
+    if (_write_owner_id == locking_thread_id)
+    {
+        _write_counter++;
+        return true;
+    }
+    else if (_promotion_candidate_id == NON_THREAD_ID)
+    {
+        _promotion_candidate_id = locking_thread_id;
+        update_exclusive_bit();
+        // Then wait until there are no more readers but this thread.
+        _promotion_write_gate.wait(
+            _lock, [this] { return get_shared_owners_count() == 1 && find_shared_count() != nullptr; });
+        _write_owner_id = locking_thread_id;
+        // it is possible that if we cut the line, another thread could have incremented the _write_counter
+        // already, so we should check this and decrement + save what they did
+        if (_write_counter != 0)
+        {
+            _write_counter_reserve = _write_counter;
+            _write_counter = 0;
+        }
+        // now increment the _write_counter for our own use
+        _write_counter++;
+        return true;
+    }
+    return false;
+}
+
+bool fast_recursive_shared_mutex::try_lock()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (_write_owner_id == locking_thread_id)
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        _write_counter++;
+        return true;
+    }
+    std::unique_lock<std::mutex> _lock(_mutex, std::try_to_lock);
+    if (_lock.owns_lock() && end_of_exclusive_ownership() && _promotion_candidate_id == NON_THREAD_ID)
+    {
+        // no readers and nobody else setting the exclusive bit, in one step so no reader gets in between
+        uint64_t state = 0;
+        if (_state.compare_exchange_strong(state, EXCLUSIVE_BIT))
+        {
+            _write_counter++;
+            _write_owner_id = locking_thread_id;
+            return true;
+        }
+    }
+    return false;
+}
+
+void fast_recursive_shared_mutex::unlock()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    std::lock_guard<std::mutex> _lock(_mutex);
+    // you cannot unlock if you are not the write owner so check that here
+    if (_write_counter == 0 || _write_owner_id != locking_thread_id)
+    {
+#ifdef DEBUG_ASSERTION
+        throw std::logic_error("unlock(standard logic) incorrectly called on a thread with no exclusive lock");
+#else
+        return;
+#endif
+    }
+    if (_promotion_candidate_id != NON_THREAD_ID && _write_owner_id != _promotion_candidate_id)
+    {
+#ifdef DEBUG_ASSERTION
+        throw std::logic_error("unlock(promotion logic) incorrectly called on a thread with no exclusive lock");
+#else
+        return;
+#endif
+    }
+    if (_promotion_candidate_id != NON_THREAD_ID)
+    {
+        _write_counter--;
+        if (_write_counter == 0)
+        {
+#ifdef DEBUG_ASSERTION
+            assert(_shared_while_exclusive_counter == 0);
+#endif
+            if (_shared_while_exclusive_counter > 0)
+            {
+                // the promoted thread keeps them as shared locks of its own
+                if (find_shared_count() == nullptr)
+                {
+                    _state.fetch_add(1);
+                }
+                add_shared_count(_shared_while_exclusive_counter);
+                _shared_while_exclusive_counter = 0;
+            }
+            // reset the write owner id back to a non thread id once we unlock all write locks
+            _write_owner_id = NON_THREAD_ID;
+            _promotion_candidate_id = NON_THREAD_ID;
+
+            // it is possible that if we cut the line, another thread could have incremented the _write_counter
+            // already, restore what they did
+            if (_write_counter_reserve != 0)
+            {
+                _write_counter = _write_counter_reserve;
+                _write_counter_reserve = 0;
+            }
+            update_exclusive_bit();
+
+            // call notify_all() while mutex is held so that another thread can't
+            // lock and unlock the mutex then destroy *this before we make the call.
+            _read_gate.notify_all();
+            _write_gate.notify_one();
+        }
+    }
+    else
+    {
+        _write_counter--;
+#ifdef DEBUG_ASSERTION
+        assert(_write_counter_reserve == 0);
+#endif
+        if (end_of_exclusive_ownership())
+        {
+            // reset the write owner id back to a non thread id once we unlock all write locks
+            _write_owner_id = NON_THREAD_ID;
+            update_exclusive_bit();
+            // call notify_all() while mutex is held so that another thread can't
+            // lock and unlock the mutex then destroy *this before we make the call.
+            _read_gate.notify_all();
+        }
+    }
+}
+
+void fast_recursive_shared_mutex::lock_shared()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (_write_owner_id == locking_thread_id)
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        _shared_while_exclusive_counter++;
+        return;
+    }
+    shared_count *held = find_shared_count();
+    if (held)
+    {
+        // a thread that already has shared ownership never waits for it
+        held->count++;
+        return;
+    }
+    if (!try_add_reader())
+    {
+        std::unique_lock<std::mutex> _lock(_mutex);
+        _read_gate.wait(_lock, [this] { return try_add_reader(); });
+    }
+    add_shared_count(1);
+}
+
+bool fast_recursive_shared_mutex::try_lock_shared()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (_write_owner_id == locking_thread_id)
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        _shared_while_exclusive_counter++;
+        return true;
+    }
+    shared_count *held = find_shared_count();
+    if (held)
+    {
+        held->count++;
+        return true;
+    }
+    if (try_add_reader())
+    {
+        add_shared_count(1);
+        return true;
+    }
+    return false;
+}
+
+void fast_recursive_shared_mutex::unlock_shared()
+{
+    const std::thread::id &locking_thread_id = std::this_thread::get_id();
+    if (_write_owner_id == locking_thread_id)
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        if (_shared_while_exclusive_counter > 0)
+        {
+            _shared_while_exclusive_counter--;
+            if (end_of_exclusive_ownership())
+            {
+                // the last lock of the exclusive owner was a shared one
+                _write_owner_id = NON_THREAD_ID;
+                update_exclusive_bit();
+                _read_gate.notify_all();
+            }
+            return;
+        }
+        // a promoted thread can still give up the shared ownership it had before the promotion
+    }
+    shared_count *held = find_shared_count();
+    if (held == nullptr)
+    {
+#ifdef DEBUG_ASSERTION
+        throw std::logic_error("unlock_shared incorrectly called on a thread with no shared lock");
+#else
+        return;
+#endif
+    }
+    held->count--;
+    if (held->count == 0)
+    {
+        erase_shared_count();
+        remove_reader();
+    }
+}
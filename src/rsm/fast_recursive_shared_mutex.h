@@ -0,0 +1,120 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _FAST_RECURSIVE_SHARED_MUTEX_H
+#define _FAST_RECURSIVE_SHARED_MUTEX_H
+
+#include "recursive_shared_mutex.h"
+
+#include <atomic>
+#include <vector>
+
+/**
+ * A recursive_shared_mutex with the same ownership rules, promotion and line cutting included, that does not take
+ * a mutex for shared ownership while nobody wants exclusive ownership.
+ *
+ * - Every thread counts its own shared locks of each mutex in thread local storage, so recursive shared locking
+ *   and unlocking only touches memory of that thread.
+ * - The number of threads with shared ownership and whether a thread holds or waits for exclusive ownership share
+ *   one atomic word. A thread that is not already a shared owner takes shared ownership with a single compare and
+ *   swap of it while the exclusive bit is clear, and gives it up with a single subtraction.
+ * - Everything else, and every wait, goes through _mutex and the condition variables like recursive_shared_mutex.
+ */
+class fast_recursive_shared_mutex
+{
+protected:
+    //! set while a thread has or waits for exclusive ownership or promotion, new shared owners have to wait then
+    static const uint64_t EXCLUSIVE_BIT = (uint64_t)1 << 63;
+    //! the rest of the word is the number of threads with shared ownership
+    static const uint64_t READERS_MASK = EXCLUSIVE_BIT - 1;
+
+    // written by every thread taking shared ownership, padded to a cache line so that does not slow down the
+    // fields below
+    std::atomic<uint64_t> _state;
+    char _state_padding[64 - sizeof(std::atomic<uint64_t>)];
+
+    // Only locked when changing exclusive ownership or waiting on condition variables.
+    std::mutex _mutex;
+
+    // the read_gate is locked (blocked) when threads have write ownership
+    std::condition_variable _read_gate;
+
+    // the write_gate is locked (blocked) when threads have read ownership or someone is waiting for promotion
+    std::condition_variable _write_gate;
+
+    // the promotion_write_gate is locked (blocked) when other threads have read ownership
+    std::condition_variable _promotion_write_gate;
+
+    // holds the number of shared locks the thread with exclusive ownership has
+    // this is used to allow the thread with exclusive ownership to lock_shared
+    uint64_t _shared_while_exclusive_counter;
+
+    // _write_counter tracks how many times exclusive ownership has been recursively locked
+    uint64_t _write_counter;
+    // _write_owner_id is the id of the thread with exclusive ownership, it is read without _mutex
+    std::atomic<std::thread::id> _write_owner_id;
+    // _promotion_candidate_id is the id of the thread waiting for a promotion
+    std::thread::id _promotion_candidate_id;
+
+    // used to keep track of normal thread exclusive line if a thread has promoted
+    uint64_t _write_counter_reserve;
+
+    size_t get_shared_owners_count() const { return _state.load() & READERS_MASK; }
+
+private:
+    /** The shared locks of one thread on one mutex */
+    struct shared_count
+    {
+        const fast_recursive_shared_mutex *mutex;
+        uint64_t count;
+    };
+
+    /**
+     * The mutexes this thread has shared ownership of. A thread rarely holds more than a few at once, so this is
+     * searched from the back, where the most recently locked one is.
+     */
+    static thread_local std::vector<shared_count> _shared_counts;
+
+    //! the shared locks this thread has of this mutex, nullptr if it has none
+    shared_count *find_shared_count();
+    void add_shared_count(const uint64_t &count);
+    void erase_shared_count();
+
+    bool end_of_exclusive_ownership();
+    //! set or clear EXCLUSIVE_BIT to match the state of exclusive ownership, _mutex has to be held
+    void update_exclusive_bit();
+    //! try to become a shared owner without waiting, returns false if the exclusive bit is set
+    bool try_add_reader();
+    //! the thread gave up shared ownership, wake who waits for that
+    void remove_reader();
+
+public:
+    fast_recursive_shared_mutex()
+        : _state(0), _shared_while_exclusive_counter(0), _write_counter(0), _write_owner_id(NON_THREAD_ID),
+          _promotion_candidate_id(NON_THREAD_ID), _write_counter_reserve(0)
+    {
+    }
+
+    ~fast_recursive_shared_mutex() {}
+    fast_recursive_shared_mutex(const fast_recursive_shared_mutex &) = delete;
+    fast_recursive_shared_mutex &operator=(const fast_recursive_shared_mutex &) = delete;
+
+    /** See recursive_shared_mutex::lock() */
+    void lock();
+    /** See recursive_shared_mutex::try_promotion() */
+    bool try_promotion();
+    /** See recursive_shared_mutex::try_lock() */
+    bool try_lock();
+    /** See recursive_shared_mutex::unlock() */
+    void unlock();
+    /** See recursive_shared_mutex::lock_shared(), the thread local count replaces _read_owner_ids */
+    void lock_shared();
+    /** See recursive_shared_mutex::try_lock_shared() */
+    bool try_lock_shared();
+    /** See recursive_shared_mutex::unlock_shared() */
+    void unlock_shared();
+};
+
+#endif // _FAST_RECURSIVE_SHARED_MUTEX_H
@@ -0,0 +1,180 @@
+// Copyright (c) 2019 Greg Griffith
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "fast_recursive_shared_mutex.h"
+#include "test_cxx_rsm.h"
+#include "util/utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rsm_fast_tests, TestSetup)
+
+namespace
+{
+class fast_rsm_watcher : public fast_recursive_shared_mutex
+{
+public:
+    using fast_recursive_shared_mutex::get_shared_owners_count;
+};
+
+fast_rsm_watcher frsm;
+std::vector<int> frsm_guarded_vector;
+
+void helper_fail() { BOOST_CHECK_EQUAL(frsm.try_lock(), false); }
+void helper_pass()
+{
+    BOOST_CHECK_EQUAL(frsm.try_lock(), true);
+    // unlock the try_lock
+    frsm.unlock();
+}
+void helper_shared_fail() { BOOST_CHECK_EQUAL(frsm.try_lock_shared(), false); }
+
+void shared_only()
+{
+    frsm.lock_shared();
+    // give time for the promoting thread to lock shared, the exclusive one to lock, and the promotion request
+    MilliSleep(2000);
+    frsm.unlock_shared();
+}
+
+void exclusive_only()
+{
+    frsm.lock();
+    frsm_guarded_vector.push_back(4);
+    frsm.unlock();
+}
+
+void promoting_thread()
+{
+    frsm.lock_shared();
+    // give time for the exclusive thread to get in line
+    MilliSleep(100);
+    bool promoted = frsm.try_promotion();
+    BOOST_CHECK_EQUAL(promoted, true);
+    frsm_guarded_vector.push_back(7);
+    frsm.unlock();
+    frsm.unlock_shared();
+}
+}
+
+// the same rules as for recursive_shared_mutex, see rsm_lock_shared_while_exclusive_owner
+BOOST_AUTO_TEST_CASE(frsm_lock_shared_while_exclusive_owner)
+{
+    frsm.lock();
+    frsm.lock();
+    frsm.lock_shared();
+    frsm.lock_shared();
+
+    // not enough unlocks of exclusive ownership
+    frsm.unlock();
+    frsm.unlock_shared();
+    frsm.unlock_shared();
+    std::thread one(helper_fail);
+    one.join();
+    std::thread two(helper_shared_fail);
+    two.join();
+
+    // not enough unlocks of shared ownership
+    frsm.lock();
+    frsm.lock_shared();
+    frsm.unlock();
+    frsm.unlock();
+    std::thread three(helper_fail);
+    three.join();
+
+    frsm.unlock_shared();
+    std::thread four(helper_pass);
+    four.join();
+}
+
+BOOST_AUTO_TEST_CASE(frsm_recursive_shared)
+{
+    frsm.lock_shared();
+    frsm.lock_shared();
+    BOOST_CHECK(frsm.try_lock_shared());
+    BOOST_CHECK_EQUAL(frsm.get_shared_owners_count(), 1);
+    std::thread one(helper_fail);
+    one.join();
+    frsm.unlock_shared();
+    frsm.unlock_shared();
+    BOOST_CHECK_EQUAL(frsm.get_shared_owners_count(), 1);
+    frsm.unlock_shared();
+    BOOST_CHECK_EQUAL(frsm.get_shared_owners_count(), 0);
+    std::thread two(helper_pass);
+    two.join();
+}
+
+// the promoted thread cuts the line and new shared owners wait, see rsm_test_starvation
+BOOST_AUTO_TEST_CASE(frsm_test_starvation)
+{
+    frsm_guarded_vector.clear();
+
+    std::thread one(shared_only);
+    std::thread two(shared_only);
+    MilliSleep(50);
+    std::thread three(promoting_thread);
+    MilliSleep(50);
+    std::thread four(exclusive_only);
+    MilliSleep(75);
+    BOOST_CHECK_EQUAL(frsm.get_shared_owners_count(), 3);
+    std::thread five(shared_only);
+    std::thread six(shared_only);
+    MilliSleep(50);
+    BOOST_CHECK_EQUAL(frsm.get_shared_owners_count(), 3);
+
+    one.join();
+    two.join();
+    three.join();
+    four.join();
+    five.join();
+    six.join();
+
+    frsm.lock_shared();
+    BOOST_CHECK_EQUAL(7, frsm_guarded_vector[0]);
+    BOOST_CHECK_EQUAL(4, frsm_guarded_vector[1]);
+    frsm.unlock_shared();
+    BOOST_CHECK_EQUAL(frsm.get_shared_owners_count(), 0);
+}
+
+// readers never see a writer half way through
+BOOST_AUTO_TEST_CASE(frsm_readers_and_writers)
+{
+    fast_recursive_shared_mutex mutex;
+    uint64_t a = 0, b = 0;
+    std::atomic<bool> fail(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++)
+    {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < 20000; j++)
+            {
+                mutex.lock_shared();
+                mutex.lock_shared();
+                if (a != b)
+                    fail = true;
+                mutex.unlock_shared();
+                mutex.unlock_shared();
+            }
+        });
+        threads.emplace_back([&]() {
+            for (int j = 0; j < 2000; j++)
+            {
+                mutex.lock();
+                a++;
+                mutex.lock_shared();
+                b++;
+                mutex.unlock_shared();
+                mutex.unlock();
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    BOOST_CHECK(!fail);
+    BOOST_CHECK_EQUAL(a, 8000);
+    BOOST_CHECK_EQUAL(b, 8000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
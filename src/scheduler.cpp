@@ -0,0 +1,111 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "scheduler.h"
+
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <exception>
+
+std::unique_ptr<CScheduler> g_scheduler;
+
+CScheduler::CScheduler() : fStop(false) {}
+CScheduler::~CScheduler() { Stop(); }
+
+void CScheduler::Start(int nThreads)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!threads.empty())
+        return;
+    fStop = false;
+    for (int i = 0; i < nThreads; i++)
+        threads.emplace_back(&CScheduler::ThreadService, this);
+}
+
+void CScheduler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+        taskQueue.clear();
+    }
+    condNewTask.notify_all();
+    for (std::thread &thread : threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+    std::lock_guard<std::mutex> lock(cs);
+    threads.clear();
+}
+
+void CScheduler::Schedule(Function f, TimePoint t)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fStop)
+            return;
+        taskQueue.emplace(t, std::move(f));
+    }
+    condNewTask.notify_one();
+}
+
+void CScheduler::ScheduleFromNow(Function f, int64_t nDeltaMillis)
+{
+    Schedule(std::move(f), std::chrono::steady_clock::now() + std::chrono::milliseconds(nDeltaMillis));
+}
+
+static void Repeat(CScheduler *scheduler, CScheduler::Function f, int64_t nDeltaMillis)
+{
+    f();
+    scheduler->ScheduleFromNow(std::bind(&Repeat, scheduler, f, nDeltaMillis), nDeltaMillis);
+}
+
+void CScheduler::ScheduleEvery(Function f, int64_t nDeltaMillis)
+{
+    ScheduleFromNow(std::bind(&Repeat, this, f, nDeltaMillis), nDeltaMillis);
+}
+
+size_t CScheduler::GetQueueInfo(TimePoint &first)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!taskQueue.empty())
+        first = taskQueue.begin()->first;
+    return taskQueue.size();
+}
+
+void CScheduler::ThreadService()
+{
+    RenameThread("bitcoin-scheduler");
+    std::unique_lock<std::mutex> lock(cs);
+    while (!fStop)
+    {
+        if (taskQueue.empty())
+        {
+            condNewTask.wait(lock);
+            continue;
+        }
+        // a task scheduled meanwhile may be due earlier, look again after every wake
+        const TimePoint tFirst = taskQueue.begin()->first;
+        if (std::chrono::steady_clock::now() < tFirst)
+        {
+            condNewTask.wait_until(lock, tFirst);
+            continue;
+        }
+        Function f = std::move(taskQueue.begin()->second);
+        taskQueue.erase(taskQueue.begin());
+
+        lock.unlock();
+        try
+        {
+            f();
+        }
+        catch (const std::exception &e)
+        {
+            LogPrintf("%s: scheduled task failed: %s\n", __func__, e.what());
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ECCOIN_SCHEDULER_H
+#define ECCOIN_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs the periodic jobs of the node (dumping peers.dat and banlist.dat, flushing the wallet, rebroadcasting
+ * wallet transactions, ...) on one small pool of threads instead of a thread with its own sleep loop each. Tasks
+ * run in the order they are due, the ones due at the same time in the order they were scheduled. A task should
+ * not block for long, it holds up the tasks due after it while all threads are busy.
+ */
+class CScheduler
+{
+public:
+    typedef std::function<void()> Function;
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+private:
+    std::mutex cs;
+    std::condition_variable condNewTask;
+    std::multimap<TimePoint, Function> taskQueue;
+    bool fStop;
+    std::vector<std::thread> threads;
+
+    void ThreadService();
+
+public:
+    CScheduler();
+    ~CScheduler();
+
+    void Start(int nThreads = 1);
+    /** Stop the threads once the tasks they run return, the tasks that are not due yet are dropped */
+    void Stop();
+
+    /** Run f at t, tasks are dropped once the scheduler stopped */
+    void Schedule(Function f, TimePoint t);
+    void ScheduleFromNow(Function f, int64_t nDeltaMillis);
+    /** Run f every nDeltaMillis, measured from the end of the last run, the first run is nDeltaMillis from now.
+     *  A run that throws ends the repetition. */
+    void ScheduleEvery(Function f, int64_t nDeltaMillis);
+
+    /** The number of tasks waiting and when the first one is due, if there is one */
+    size_t GetQueueInfo(TimePoint &first);
+};
+
+/** Set from AppInit2 until Shutdown */
+extern std::unique_ptr<CScheduler> g_scheduler;
+
+#endif // ECCOIN_SCHEDULER_H
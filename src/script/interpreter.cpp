@@ -51,7 +51,8 @@ inline bool set_error(ScriptError *ret, const ScriptError serror)
 
 } // anon namespace
 
-bool CastToBool(const valtype &vch)
+template <typename V>
+static bool CastToBoolImpl(const V &vch)
 {
     for (unsigned int i = 0; i < vch.size(); i++)
     {
@@ -66,19 +67,42 @@ bool CastToBool(const valtype &vch)
     return false;
 }
 
+bool CastToBool(const valtype &vch) { return CastToBoolImpl(vch); }
+bool CastToBool(const CStackValue &vch) { return CastToBoolImpl(vch); }
+
 /**
  * Script is a stack machine (like Forth) that evaluates a predicate
  * returning a bool indicating valid or not.  There are no loops.
  */
 #define stacktop(i) (stack.at(stack.size() + (i)))
 #define altstacktop(i) (altstack.at(altstack.size() + (i)))
-static inline void popstack(std::vector<valtype> &stack)
+template <typename V>
+static inline void popstack(std::vector<V> &stack)
 {
     if (stack.empty())
         throw std::runtime_error("popstack(): stack empty");
     stack.pop_back();
 }
 
+template <typename V>
+static inline void pushnum(std::vector<V> &stack, const CScriptNum &bn)
+{
+    stack.emplace_back();
+    bn.getvch(stack.back());
+}
+
+/** Stack elements as the signature checks take them. An element of a stack of std::vector is not copied, any
+ *  other is copied into buf, which the caller keeps per thread so that its capacity is reused.
+ */
+static inline const valtype &ToValType(const valtype &vch, valtype &) { return vch; }
+static inline const valtype &ToValType(const CStackValue &vch, valtype &buf)
+{
+    buf.assign(vch.begin(), vch.end());
+    return buf;
+}
+static thread_local valtype vchSigBuf;
+static thread_local valtype vchPubKeyBuf;
+
 bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey)
 {
     if (vchPubKey.size() < 33)
@@ -261,7 +285,8 @@ bool static CheckPubKeyEncoding(const valtype &vchSig, unsigned int flags, Scrip
     return true;
 }
 
-bool static CheckMinimalPush(const valtype &data, opcodetype opcode)
+template <typename V>
+bool static CheckMinimalPush(const V &data, opcodetype opcode)
 {
     if (data.size() == 0)
     {
@@ -296,7 +321,10 @@ bool static CheckMinimalPush(const valtype &data, opcodetype opcode)
     return true;
 }
 
-bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
+/** EvalScript on a stack of std::vector or of CStackValue, altstack is cleared and then used as the alt stack */
+template <typename V>
+static bool EvalScriptImpl(std::vector<V> &stack,
+    std::vector<V> &altstack,
     const CScript &script,
     unsigned int flags,
     const BaseSignatureChecker &checker,
@@ -306,17 +334,17 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
     static const CScriptNum bnOne(1);
     static const CScriptNum bnFalse(0);
     static const CScriptNum bnTrue(1);
-    static const valtype vchFalse(0);
-    static const valtype vchZero(0);
-    static const valtype vchTrue(1, 1);
+    static const unsigned char chTrue = 1;
+    static const V vchFalse;
+    static const V vchTrue(&chTrue, &chTrue + 1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
     CScript::const_iterator pbegincodehash = script.begin();
     opcodetype opcode;
-    valtype vchPushValue;
+    V vchPushValue;
     std::vector<bool> vfExec;
-    std::vector<valtype> altstack;
+    altstack.clear();
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > 10000)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -381,7 +409,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -500,7 +528,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     {
                         if (stack.size() < 1)
                             return set_error(serror, SCRIPT_ERR_UNBALANCED_CONDITIONAL);
-                        valtype &vch = stacktop(-1);
+                        V &vch = stacktop(-1);
                         fValue = CastToBool(vch);
                         if (opcode == OP_NOTIF)
                             fValue = !fValue;
@@ -583,8 +611,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 -- x1 x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-2);
-                    valtype vch2 = stacktop(-1);
+                    V vch1 = stacktop(-2);
+                    V vch2 = stacktop(-1);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                 }
@@ -595,9 +623,9 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-3);
-                    valtype vch2 = stacktop(-2);
-                    valtype vch3 = stacktop(-1);
+                    V vch1 = stacktop(-3);
+                    V vch2 = stacktop(-2);
+                    V vch3 = stacktop(-1);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                     stack.push_back(vch3);
@@ -609,8 +637,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-4);
-                    valtype vch2 = stacktop(-3);
+                    V vch1 = stacktop(-4);
+                    V vch2 = stacktop(-3);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
                 }
@@ -621,8 +649,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
+                    V vch1 = stacktop(-6);
+                    V vch2 = stacktop(-5);
                     stack.erase(stack.end() - 6, stack.end() - 4);
                     stack.push_back(vch1);
                     stack.push_back(vch2);
@@ -634,8 +662,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 x3 x4 -- x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-4), stacktop(-2));
-                    swap(stacktop(-3), stacktop(-1));
+                    std::swap(stacktop(-4), stacktop(-2));
+                    std::swap(stacktop(-3), stacktop(-1));
                 }
                 break;
 
@@ -644,7 +672,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
+                    V vch = stacktop(-1);
                     if (CastToBool(vch))
                         stack.push_back(vch);
                 }
@@ -654,7 +682,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -672,7 +700,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x -- x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
+                    V vch = stacktop(-1);
                     stack.push_back(vch);
                 }
                 break;
@@ -691,7 +719,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-2);
+                    V vch = stacktop(-2);
                     stack.push_back(vch);
                 }
                 break;
@@ -707,7 +735,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     popstack(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-n - 1);
+                    V vch = stacktop(-n - 1);
                     if (opcode == OP_ROLL)
                         stack.erase(stack.end() - n - 1);
                     stack.push_back(vch);
@@ -721,8 +749,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     //  x2 x3 x1  after second swap
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-3), stacktop(-2));
-                    swap(stacktop(-2), stacktop(-1));
+                    std::swap(stacktop(-3), stacktop(-2));
+                    std::swap(stacktop(-2), stacktop(-1));
                 }
                 break;
 
@@ -731,7 +759,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 -- x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-2), stacktop(-1));
+                    std::swap(stacktop(-2), stacktop(-1));
                 }
                 break;
 
@@ -740,7 +768,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (x1 x2 -- x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
+                    V vch = stacktop(-1);
                     stack.insert(stack.end() - 2, vch);
                 }
                 break;
@@ -752,7 +780,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -767,8 +795,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                         // (x1 x2 - bool)
                         if (stack.size() < 2)
                             return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                        valtype &vch1 = stacktop(-2);
-                        valtype &vch2 = stacktop(-1);
+                        V &vch1 = stacktop(-2);
+                        V &vch2 = stacktop(-1);
                         bool fEqual = (vch1 == vch2);
                         // OP_NOTEQUAL is disabled because it would be too easy to say
                         // something like n != 1 and have some wiseguy pass in 1 with extra
@@ -829,7 +857,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                         break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -902,7 +930,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -943,20 +971,22 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // (in -- hash)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype &vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    V &vch = stacktop(-1);
+                    unsigned char vchHash[32];
+                    const size_t nHashSize =
+                        (opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32;
                     if (opcode == OP_RIPEMD160)
-                        CRIPEMD160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CRIPEMD160().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA1)
-                        CSHA1().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA1().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA256)
-                        CSHA256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CSHA256().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH160)
-                        CHash160().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CHash160().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH256)
-                        CHash256().Write(begin_ptr(vch), vch.size()).Finalize(begin_ptr(vchHash));
+                        CHash256().Write(begin_ptr(vch), vch.size()).Finalize(vchHash);
                     popstack(stack);
-                    stack.push_back(vchHash);
+                    stack.emplace_back(vchHash, vchHash + nHashSize);
                 }
                 break;
 
@@ -974,8 +1004,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
 
-                    valtype &vchSig = stacktop(-2);
-                    valtype &vchPubKey = stacktop(-1);
+                    const valtype &vchSig = ToValType(stacktop(-2), vchSigBuf);
+                    const valtype &vchPubKey = ToValType(stacktop(-1), vchPubKeyBuf);
 
                     // Subset of script starting at the most recent codeseparator
                     CScript scriptCode(pbegincodehash, pend);
@@ -1050,15 +1080,14 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
                     // Drop the signatures, since there's no way for a signature to sign itself
                     for (int k = 0; k < nSigsCount; k++)
                     {
-                        valtype &vchSig = stacktop(-isig - k);
-                        scriptCode.FindAndDelete(CScript(vchSig));
+                        scriptCode.FindAndDelete(CScript(ToValType(stacktop(-isig - k), vchSigBuf)));
                     }
 
                     bool fSuccess = true;
                     while (fSuccess && nSigsCount > 0)
                     {
-                        valtype &vchSig = stacktop(-isig);
-                        valtype &vchPubKey = stacktop(-ikey);
+                        const valtype &vchSig = ToValType(stacktop(-isig), vchSigBuf);
+                        const valtype &vchPubKey = ToValType(stacktop(-ikey), vchPubKeyBuf);
 
                         // Note how this makes the exact order of pubkey/signature evaluation
                         // distinguishable by CHECKMULTISIG NOT if the STRICTENC flag is set.
@@ -1147,6 +1176,16 @@ bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
     return set_success(serror);
 }
 
+bool EvalScript(std::vector<std::vector<unsigned char> > &stack,
+    const CScript &script,
+    unsigned int flags,
+    const BaseSignatureChecker &checker,
+    ScriptError *serror)
+{
+    std::vector<valtype> altstack;
+    return EvalScriptImpl(stack, altstack, script, flags, checker, serror);
+}
+
 namespace
 {
 /**
@@ -1234,32 +1273,95 @@ public:
             ::Serialize(s, txTo.vout[nOutput]);
     }
 
-    /** Serialize txTo */
+    unsigned int GetInputCount() const { return fAnyoneCanPay ? 1 : txTo.vin.size(); }
+
+    /** Serialize what comes before the inputs: nVersion, nTime and the input count */
     template <typename S>
-    void Serialize(S &s) const
+    void SerializePrefix(S &s) const
     {
-        // Serialize nVersion
         ::Serialize(s, txTo.nVersion);
-        // Serialize nTime
         ::Serialize(s, txTo.nTime);
-        // Serialize vin
-        unsigned int nInputs = fAnyoneCanPay ? 1 : txTo.vin.size();
-        ::WriteCompactSize(s, nInputs);
-        for (unsigned int nInput = 0; nInput < nInputs; nInput++)
-            SerializeInput(s, nInput);
-        // Serialize vout
+        ::WriteCompactSize(s, GetInputCount());
+    }
+
+    /** Serialize what comes after the inputs: vout and nLockTime */
+    template <typename S>
+    void SerializeSuffix(S &s) const
+    {
         unsigned int nOutputs = fHashNone ? 0 : (fHashSingle ? nIn + 1 : txTo.vout.size());
         ::WriteCompactSize(s, nOutputs);
         for (unsigned int nOutput = 0; nOutput < nOutputs; nOutput++)
             SerializeOutput(s, nOutput);
-        // Serialize nLockTime
         ::Serialize(s, txTo.nLockTime);
     }
+
+    /** Serialize txTo */
+    template <typename S>
+    void Serialize(S &s) const
+    {
+        SerializePrefix(s);
+        const unsigned int nInputs = GetInputCount();
+        for (unsigned int nInput = 0; nInput < nInputs; nInput++)
+            SerializeInput(s, nInput);
+        SerializeSuffix(s);
+    }
+};
+
+/** Serializes into a SHA256, to continue from a state of PrecomputedTransactionData */
+class CSHA256Writer
+{
+private:
+    CSHA256 &sha;
+
+public:
+    explicit CSHA256Writer(CSHA256 &shaIn) : sha(shaIn) {}
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return 0; }
+    CSHA256Writer &write(const char *pch, size_t size)
+    {
+        sha.Write((const unsigned char *)pch, size);
+        return *this;
+    }
 };
 
 } // anon namespace
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction &txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction &txTo)
+{
+    // an input index past the last one makes every input serialize as one that is not signed
+    const CScript scriptEmpty;
+    const CTransactionSignatureSerializer txBlank(txTo, scriptEmpty, txTo.vin.size(), SIGHASH_ALL);
+    CVectorWriter inputs(SER_GETHASH, 0, vchBlankInputs, 0);
+    vBlankInputStart.reserve(txTo.vin.size() + 1);
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++)
+    {
+        vBlankInputStart.push_back(vchBlankInputs.size());
+        txBlank.SerializeInput(inputs, nInput);
+    }
+    vBlankInputStart.push_back(vchBlankInputs.size());
+    CVectorWriter outputs(SER_GETHASH, 0, vchOutputs, 0);
+    txBlank.SerializeSuffix(outputs);
+
+    CSHA256 sha;
+    CSHA256Writer writer(sha);
+    txBlank.SerializePrefix(writer);
+    vInputStates.reserve(txTo.vin.size());
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++)
+    {
+        vInputStates.push_back(sha);
+        sha.Write(&vchBlankInputs[vBlankInputStart[nInput]], vBlankInputStart[nInput + 1] - vBlankInputStart[nInput]);
+    }
+
+    CSHA256Writer writerAnyoneCanPay(anyoneCanPayState);
+    CTransactionSignatureSerializer(txTo, scriptEmpty, 0, SIGHASH_ALL | SIGHASH_ANYONECANPAY)
+        .SerializePrefix(writerAnyoneCanPay);
+}
+
+uint256 SignatureHash(const CScript &scriptCode,
+    const CTransaction &txTo,
+    unsigned int nIn,
+    int nHashType,
+    const PrecomputedTransactionData *txdata)
 {
     assert(nIn < txTo.vin.size());
 
@@ -1278,6 +1380,27 @@ uint256 SignatureHash(const CScript &scriptCode, const CTransaction &txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    const int nBaseType = nHashType & 0x1f;
+    if (txdata && nBaseType != SIGHASH_SINGLE && nBaseType != SIGHASH_NONE)
+    {
+        // Everything but the input signed is in txdata already, serialized or hashed
+        const bool fAnyoneCanPay = nHashType & SIGHASH_ANYONECANPAY;
+        CSHA256 sha(fAnyoneCanPay ? txdata->anyoneCanPayState : txdata->vInputStates[nIn]);
+        CSHA256Writer writer(sha);
+        txTmp.SerializeInput(writer, nIn);
+        if (!fAnyoneCanPay)
+        {
+            const size_t nAfter = txdata->vBlankInputStart[nIn + 1];
+            sha.Write(txdata->vchBlankInputs.data() + nAfter, txdata->vchBlankInputs.size() - nAfter);
+        }
+        sha.Write(txdata->vchOutputs.data(), txdata->vchOutputs.size());
+        ::Serialize(writer, nHashType);
+        uint256 hash;
+        sha.Finalize(hash.begin());
+        sha.Reset().Write(hash.begin(), CSHA256::OUTPUT_SIZE).Finalize(hash.begin());
+        return hash;
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1306,7 +1429,7 @@ bool TransactionSignatureChecker::CheckSig(const std::vector<unsigned char> &vch
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1395,6 +1518,19 @@ bool TransactionSignatureChecker::CheckSequence(const CScriptNum &nSequence) con
     return true;
 }
 
+namespace
+{
+/** The stacks VerifyScript evaluates on. Every thread has its own, which keep their memory from one script to the
+ *  next, so that the script check threads neither allocate the stacks nor most of their elements.
+ */
+struct CScriptStacks
+{
+    std::vector<CStackValue> stack;
+    std::vector<CStackValue> stackCopy;
+    std::vector<CStackValue> altstack;
+};
+}
+
 bool VerifyScript(const CScript &scriptSig,
     const CScript &scriptPubKey,
     unsigned int flags,
@@ -1408,13 +1544,17 @@ bool VerifyScript(const CScript &scriptSig,
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    std::vector<std::vector<unsigned char> > stack, stackCopy;
-    if (!EvalScript(stack, scriptSig, flags, checker, serror))
+    static thread_local CScriptStacks stacks;
+    std::vector<CStackValue> &stack = stacks.stack;
+    std::vector<CStackValue> &stackCopy = stacks.stackCopy;
+    std::vector<CStackValue> &altstack = stacks.altstack;
+    stack.clear();
+    if (!EvalScriptImpl(stack, altstack, scriptSig, flags, checker, serror))
         // serror is set
         return false;
     if (flags & SCRIPT_VERIFY_P2SH)
         stackCopy = stack;
-    if (!EvalScript(stack, scriptPubKey, flags, checker, serror))
+    if (!EvalScriptImpl(stack, altstack, scriptPubKey, flags, checker, serror))
         // serror is set
         return false;
     if (stack.empty())
@@ -1437,11 +1577,11 @@ bool VerifyScript(const CScript &scriptSig,
         // an empty stack and the EvalScript above would return false.
         assert(!stack.empty());
 
-        const valtype &pubKeySerialized = stack.back();
-        CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
+        const CStackValue &pubKeySerialized = stack.back();
+        CScript pubKey2(pubKeySerialized.data(), pubKeySerialized.data() + pubKeySerialized.size());
         popstack(stack);
 
-        if (!EvalScript(stack, pubKey2, flags, checker, serror))
+        if (!EvalScriptImpl(stack, altstack, pubKey2, flags, checker, serror))
             // serror is set
             return false;
         if (stack.empty())
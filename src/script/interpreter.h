@@ -22,6 +22,8 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "chain/tx.h"
+#include "crypto/sha256.h"
+#include "prevector.h"
 #include "script_error.h"
 
 #include <stdint.h>
@@ -34,6 +36,10 @@ class CTransaction;
 class uint256;
 
 typedef std::vector<unsigned char> valtype;
+/** An element of the stack VerifyScript evaluates on. Pushes this long or shorter, signatures and public keys
+ *  among them, are kept in place and do not allocate.
+ */
+typedef prevector<80, unsigned char> CStackValue;
 
 /** Signature hash types/flags */
 enum
@@ -111,7 +117,36 @@ enum
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError *serror);
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction &txTo, unsigned int nIn, int nHashType);
+/**
+ * The parts of the signature hashes of a transaction that are the same for every input, so that checking a
+ * SIGHASH_ALL signature on each input does not serialize the whole transaction once per input. Only the hash
+ * types that commit to all inputs and outputs, with or without SIGHASH_ANYONECANPAY, make use of it. Does not
+ * change once made, the script checks of the inputs share it across threads.
+ */
+struct PrecomputedTransactionData
+{
+    //! every input as the ones that are not signed serialize, without their script
+    std::vector<unsigned char> vchBlankInputs;
+    //! where each blank input starts in vchBlankInputs, and where the last one ends
+    std::vector<size_t> vBlankInputStart;
+    //! the output count, the outputs and nLockTime
+    std::vector<unsigned char> vchOutputs;
+    //! SHA256 of the version, the time, the input count and the blank inputs before input i
+    std::vector<CSHA256> vInputStates;
+    //! SHA256 of the version, the time and an input count of one, for SIGHASH_ANYONECANPAY
+    CSHA256 anyoneCanPayState;
+
+    explicit PrecomputedTransactionData(const CTransaction &txTo);
+};
+
+/** The hash a signature of input nIn of txTo signs. With txdata, made for txTo, the parts of txTo every input
+ *  shares are not serialized and hashed again, the hash is the same.
+ */
+uint256 SignatureHash(const CScript &scriptCode,
+    const CTransaction &txTo,
+    unsigned int nIn,
+    int nHashType,
+    const PrecomputedTransactionData *txdata = nullptr);
 
 class BaseSignatureChecker
 {
@@ -133,6 +168,7 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction *txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData *txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char> &vchSig,
@@ -140,7 +176,12 @@ protected:
         const uint256 &sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction *txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction *txToIn,
+        unsigned int nInIn,
+        const PrecomputedTransactionData *txdataIn = nullptr)
+        : txTo(txToIn), nIn(nInIn), txdata(txdataIn)
+    {
+    }
     bool CheckSig(const std::vector<unsigned char> &scriptSig,
         const std::vector<unsigned char> &vchPubKey,
         const CScript &scriptCode) const;
@@ -171,5 +212,6 @@ bool VerifyScript(const CScript &scriptSig,
     const BaseSignatureChecker &checker,
     ScriptError *error = NULL);
 bool CastToBool(const valtype &vch);
+bool CastToBool(const CStackValue &vch);
 
 #endif // BITCOIN_SCRIPT_INTERPRETER_H
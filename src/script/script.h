@@ -228,7 +228,9 @@ public:
     explicit CScriptNum(const int64_t &n) { m_value = n; }
     static const size_t nDefaultMaxNumSize = 4;
 
-    explicit CScriptNum(const std::vector<unsigned char> &vch,
+    //! vch is a std::vector or a prevector of unsigned char
+    template <typename V>
+    explicit CScriptNum(const V &vch,
         bool fRequireMinimal,
         const size_t nMaxNumSize = nDefaultMaxNumSize)
     {
@@ -325,12 +327,25 @@ public:
     }
 
     std::vector<unsigned char> getvch() const { return serialize(m_value); }
+    //! the same into vch, which may be a prevector
+    template <typename V>
+    void getvch(V &vch) const
+    {
+        serialize(m_value, vch);
+    }
     static std::vector<unsigned char> serialize(const int64_t &value)
     {
+        std::vector<unsigned char> result;
+        serialize(value, result);
+        return result;
+    }
+    template <typename V>
+    static void serialize(const int64_t &value, V &result)
+    {
+        result.clear();
         if (value == 0)
-            return std::vector<unsigned char>();
+            return;
 
-        std::vector<unsigned char> result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -354,12 +369,11 @@ public:
             result.push_back(neg ? 0x80 : 0);
         else if (neg)
             result.back() |= 0x80;
-
-        return result;
     }
 
 private:
-    static int64_t set_vch(const std::vector<unsigned char> &vch)
+    template <typename V>
+    static int64_t set_vch(const V &vch)
     {
         if (vch.empty())
             return 0;
@@ -510,7 +524,18 @@ public:
     }
 
     bool GetOp(const_iterator &pc, opcodetype &opcodeRet) const { return GetOp2(pc, opcodeRet, NULL); }
+    //! the same into a prevector, for the stack of the interpreter
+    template <unsigned int N>
+    bool GetOp(const_iterator &pc, opcodetype &opcodeRet, prevector<N, unsigned char> &vchRet) const
+    {
+        return GetScriptOp(pc, opcodeRet, &vchRet);
+    }
     bool GetOp2(const_iterator &pc, opcodetype &opcodeRet, std::vector<unsigned char> *pvchRet) const
+    {
+        return GetScriptOp(pc, opcodeRet, pvchRet);
+    }
+    template <typename V>
+    bool GetScriptOp(const_iterator &pc, opcodetype &opcodeRet, V *pvchRet) const
     {
         opcodeRet = OP_INVALIDOPCODE;
         if (pvchRet)
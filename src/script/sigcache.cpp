@@ -21,27 +21,23 @@
 #include "sigcache.h"
 
 #include "args.h"
-#include "memusage.h"
+#include "cuckoocache.h"
 #include "pubkey.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
+#include "util/logger.h"
 #include "util/util.h"
 
-#include <boost/thread.hpp>
-#include <boost/unordered_set.hpp>
+size_t GetSigCacheBytes()
+{
+    // Half for the signatures, half for the script execution cache in main.cpp
+    int64_t nMaxCacheSize = gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE);
+    return nMaxCacheSize > 0 ? ((size_t)nMaxCacheSize << 20) / 2 : 0;
+}
 
 namespace
 {
-/**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
- */
-class CSignatureCacheHasher
-{
-public:
-    size_t operator()(const uint256 &key) const { return key.GetCheapHash(); }
-};
-
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
@@ -52,13 +48,17 @@ class CSignatureCache
 private:
     //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef boost::unordered_set<uint256, CSignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
-
+    //! Entries are salted hashes already, so the cache can take its slots from their bits
+    CCuckooCache setValid;
 
 public:
-    CSignatureCache() { GetRandBytes(nonce.begin(), 32); }
+    CSignatureCache() : setValid(GetSigCacheBytes())
+    {
+        GetRandBytes(nonce.begin(), 32);
+        LogPrintf("Using %u MiB for the signature cache, room for %u entries\n", setValid.MemoryUsage() >> 20,
+            setValid.Capacity());
+    }
+
     void ComputeEntry(uint256 &entry,
         const uint256 &hash,
         const std::vector<unsigned char> &vchSig,
@@ -72,55 +72,66 @@ public:
             .Finalize(entry.begin());
     }
 
-    bool Get(const uint256 &entry)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.count(entry);
-    }
+    //! Lock free, with fErase the entry is marked for reuse as well
+    bool Get(const uint256 &entry, bool fErase) { return setValid.Contains(entry, fErase); }
+    void Set(const uint256 &entry) { setValid.Insert(entry); }
+    size_t MemoryUsage() const { return setValid.MemoryUsage(); }
+    void Dump(CAutoFile &file) { DumpSaltedCache(file, nonce, setValid); }
+    size_t Load(CAutoFile &file) { return LoadSaltedCache(file, nonce, setValid); }
+};
 
-    void Erase(const uint256 &entry)
+CSignatureCache &SignatureCache()
+{
+    static CSignatureCache signatureCache;
+    return signatureCache;
+}
+}
+
+size_t GetSignatureCacheUsage() { return SignatureCache().MemoryUsage(); }
+
+void DumpSaltedCache(CAutoFile &file, const uint256 &nonce, CCuckooCache &cache)
+{
+    const std::vector<uint256> vEntries = cache.GetEntries();
+    file << nonce;
+    file << (uint64_t)vEntries.size();
+    for (const uint256 &entry : vEntries)
+        file << entry;
+}
+
+size_t LoadSaltedCache(CAutoFile &file, uint256 &nonce, CCuckooCache &cache)
+{
+    file >> nonce;
+    uint64_t nEntries;
+    file >> nEntries;
+    // the oldest come first, skip those a smaller -maxsigcachesize has no room for
+    if (nEntries > cache.Capacity())
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.erase(entry);
+        file.ignore((nEntries - cache.Capacity()) * sizeof(uint256));
+        nEntries = cache.Capacity();
     }
-
-    void Set(const uint256 &entry)
+    for (uint64_t i = 0; i < nEntries; i++)
     {
-        size_t nMaxCacheSize = gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t)1 << 20);
-        if (nMaxCacheSize <= 0)
-            return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
-        {
-            map_type::size_type s = GetRand(setValid.bucket_count());
-            map_type::local_iterator it = setValid.begin(s);
-            if (it != setValid.end(s))
-            {
-                setValid.erase(*it);
-            }
-        }
-
-        setValid.insert(entry);
+        uint256 entry;
+        file >> entry;
+        cache.Insert(entry);
     }
-};
+    return nEntries;
 }
 
+void DumpSignatureCache(CAutoFile &file) { SignatureCache().Dump(file); }
+size_t LoadSignatureCache(CAutoFile &file) { return SignatureCache().Load(file); }
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char> &vchSig,
     const CPubKey &pubkey,
     const uint256 &sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache &signatureCache = SignatureCache();
 
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(entry))
+    if (signatureCache.Get(entry, !store))
     {
-        if (!store)
-        {
-            signatureCache.Erase(entry);
-        }
         return true;
     }
 
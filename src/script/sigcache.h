@@ -25,20 +25,42 @@
 
 #include <vector>
 
-// DoS prevention: limit cache size to less than 40MB (over 500000
-// entries on 64-bit systems).
+// DoS prevention: limit cache size to 40MB, split between the signature and
+// the script execution caches at 32 bytes per entry (about 650000 each).
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 40;
+/** Default for -persistsigcache, keep the signature and script execution caches in sigcache.dat across restarts */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
 
+class CAutoFile;
+class CCuckooCache;
 class CPubKey;
 
+/** Bytes of -maxsigcachesize given to each of the signature cache and the script execution cache */
+size_t GetSigCacheBytes();
+/** Bytes the signature cache takes */
+size_t GetSignatureCacheUsage();
+
+/** Write a salted cache, its nonce and then its entries oldest first */
+void DumpSaltedCache(CAutoFile &file, const uint256 &nonce, CCuckooCache &cache);
+/** Read what DumpSaltedCache wrote into a cache nothing was looked up in yet, which takes over the nonce. Only the
+ *  newest entries that fit the cache are kept, returns how many were read.
+ */
+size_t LoadSaltedCache(CAutoFile &file, uint256 &nonce, CCuckooCache &cache);
+/** Save and restore the signature cache, the load has to happen before any signature is checked */
+void DumpSignatureCache(CAutoFile &file);
+size_t LoadSignatureCache(CAutoFile &file);
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction *txToIn, unsigned int nInIn, bool storeIn = true)
-        : TransactionSignatureChecker(txToIn, nInIn), store(storeIn)
+    CachingTransactionSignatureChecker(const CTransaction *txToIn,
+        unsigned int nInIn,
+        bool storeIn = true,
+        const PrecomputedTransactionData *txdataIn = nullptr)
+        : TransactionSignatureChecker(txToIn, nInIn, txdataIn), store(storeIn)
     {
     }
 
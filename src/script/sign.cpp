@@ -26,6 +26,10 @@
 #include "policy/policy.h"
 #include "script/standard.h"
 #include "uint256.h"
+#include "util/util.h"
+
+#include <atomic>
+#include <thread>
 
 typedef std::vector<unsigned char> valtype;
 
@@ -128,6 +132,38 @@ static bool SignStep(const BaseSignatureCreator &creator,
     return false;
 }
 
+void GetSigningKeyIDs(const CKeyStore &keystore, const CScript &scriptPubKey, std::set<CKeyID> &setKeyIDs)
+{
+    txnouttype whichType;
+    std::vector<valtype> vSolutions;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return;
+
+    switch (whichType)
+    {
+    case TX_NONSTANDARD:
+    case TX_NULL_DATA:
+        break;
+    case TX_PUBKEY:
+        setKeyIDs.insert(CPubKey(vSolutions[0]).GetID());
+        break;
+    case TX_PUBKEYHASH:
+        setKeyIDs.insert(CKeyID(uint160(vSolutions[0])));
+        break;
+    case TX_SCRIPTHASH:
+    {
+        CScript subscript;
+        if (keystore.GetCScript(uint160(vSolutions[0]), subscript) && !subscript.IsPayToScriptHash())
+            GetSigningKeyIDs(keystore, subscript, setKeyIDs);
+        break;
+    }
+    case TX_MULTISIG:
+        for (unsigned int i = 1; i + 1 < vSolutions.size(); i++)
+            setKeyIDs.insert(CPubKey(vSolutions[i]).GetID());
+        break;
+    }
+}
+
 bool ProduceSignature(const BaseSignatureCreator &creator, const CScript &fromPubKey, CScript &scriptSig)
 {
     txnouttype whichType;
@@ -168,6 +204,41 @@ bool SignSignature(const CKeyStore &keystore,
     return ProduceSignature(creator, fromPubKey, txin.scriptSig);
 }
 
+/** Minimum number of inputs per signing thread, below this starting a thread costs more than it saves */
+static const size_t MIN_INPUTS_PER_SIGNING_THREAD = 8;
+
+bool SignSignatures(const CKeyStore &keystore,
+    const std::vector<CScript> &vFromPubKeys,
+    CTransaction &txTo,
+    int nHashType)
+{
+    assert(vFromPubKeys.size() == txTo.vin.size());
+    const CTransaction txToConst(txTo);
+    const size_t nInputs = txTo.vin.size();
+    std::atomic<size_t> nNextInput(0);
+    std::atomic<bool> fAllSigned(true);
+    auto sign = [&]() {
+        size_t i;
+        while ((i = nNextInput++) < nInputs)
+        {
+            if (vFromPubKeys[i].empty())
+                continue;
+            // every thread only writes the scriptSigs of its own inputs
+            TransactionSignatureCreator creator(&keystore, &txToConst, i, nHashType);
+            if (!ProduceSignature(creator, vFromPubKeys[i], txTo.vin[i].scriptSig))
+                fAllSigned = false;
+        }
+    };
+    size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), nInputs / MIN_INPUTS_PER_SIGNING_THREAD);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; i++)
+        vThreads.emplace_back(sign);
+    sign();
+    for (std::thread &thread : vThreads)
+        thread.join();
+    return fAllSigned;
+}
+
 bool SignSignature(const CKeyStore &keystore,
     const CTransaction &txFrom,
     CTransaction &txTo,
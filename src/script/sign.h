@@ -23,6 +23,8 @@
 
 #include "script/interpreter.h"
 
+#include <set>
+
 class CKeyID;
 class CKeyStore;
 class CScript;
@@ -74,6 +76,9 @@ public:
     bool CreateSig(std::vector<unsigned char> &vchSig, const CKeyID &keyid, const CScript &scriptCode) const;
 };
 
+/** Add the keys signing scriptPubKey can take to setKeyIDs, the redeem script of a P2SH one comes from keystore */
+void GetSigningKeyIDs(const CKeyStore &keystore, const CScript &scriptPubKey, std::set<CKeyID> &setKeyIDs);
+
 /** Produce a script signature using a generic signature creator. */
 bool ProduceSignature(const BaseSignatureCreator &creator, const CScript &scriptPubKey, CScript &scriptSig);
 
@@ -89,6 +94,16 @@ bool SignSignature(const CKeyStore &keystore,
     unsigned int nIn,
     int nHashType = SIGHASH_ALL);
 
+/**
+ * SignSignature() for every input of txTo that has a non empty script in vFromPubKeys, on all cores. The inputs are
+ * signed against a copy of txTo from before, which gives the same signature hashes because those leave out the
+ * scriptSigs of the other inputs. Returns whether all of them were signed.
+ */
+bool SignSignatures(const CKeyStore &keystore,
+    const std::vector<CScript> &vFromPubKeys,
+    CTransaction &txTo,
+    int nHashType = SIGHASH_ALL);
+
 /** Combine two script signatures using a generic signature checker, intelligently, possibly with OP_0 placeholders. */
 CScript CombineSignatures(const CScript &scriptPubKey,
     const BaseSignatureChecker &checker,
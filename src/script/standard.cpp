@@ -51,6 +51,63 @@ const char *GetTxnOutputType(txnouttype t)
     return NULL;
 }
 
+/** A push of a public key with its length as the opcode, the way CScript << writes one */
+static bool IsDirectPubKeyPush(unsigned char opcode) { return opcode >= 33 && opcode <= 65; }
+/**
+ * The template walker below finds the same for these, the fast paths only save it for the scripts that make up
+ * nearly every output: P2PKH, P2PK (which coinstakes and the outputs of blocks pay to) and bare multisig with the
+ * keys pushed directly. Anything they do not recognize is left to the walker.
+ */
+static bool MatchPayToPubKeyHash(const CScript &script, std::vector<valtype> &vSolutionsRet)
+{
+    if (script.size() != 25 || script[0] != OP_DUP || script[1] != OP_HASH160 || script[2] != 20 ||
+        script[23] != OP_EQUALVERIFY || script[24] != OP_CHECKSIG)
+        return false;
+    vSolutionsRet.emplace_back(script.begin() + 3, script.begin() + 23);
+    return true;
+}
+
+static bool MatchPayToPubKey(const CScript &script, std::vector<valtype> &vSolutionsRet)
+{
+    if (script.size() < 35 || !IsDirectPubKeyPush(script[0]) || script.size() != (size_t)script[0] + 2 ||
+        script.back() != OP_CHECKSIG)
+        return false;
+    vSolutionsRet.emplace_back(script.begin() + 1, script.end() - 1);
+    return true;
+}
+
+static bool MatchMultisig(const CScript &script, std::vector<valtype> &vSolutionsRet)
+{
+    if (script.size() < 3 || script.back() != OP_CHECKMULTISIG)
+        return false;
+    const unsigned char opRequired = script[0];
+    if (opRequired < OP_1 || opRequired > OP_16)
+        return false;
+    CScript::const_iterator pc = script.begin() + 1;
+    const CScript::const_iterator pend = script.end() - 2;
+    size_t nKeys = 0;
+    while (pc < pend && IsDirectPubKeyPush(*pc))
+    {
+        if (pend - pc < 1 + *pc)
+            return false;
+        pc += 1 + *pc;
+        nKeys++;
+    }
+    const unsigned char opKeys = *pend;
+    if (pc != pend || opKeys < OP_1 || opKeys > OP_16)
+        return false;
+    const unsigned char m = CScript::DecodeOP_N((opcodetype)opRequired);
+    const unsigned char n = CScript::DecodeOP_N((opcodetype)opKeys);
+    if (m > n || nKeys != n)
+        return false;
+
+    vSolutionsRet.push_back(valtype(1, m));
+    for (pc = script.begin() + 1; pc < pend; pc += 1 + *pc)
+        vSolutionsRet.emplace_back(pc + 1, pc + 1 + *pc);
+    vSolutionsRet.push_back(valtype(1, n));
+    return true;
+}
+
 /**
  * Return public keys or hashes from scriptPubKey, for 'standard' transaction types.
  */
@@ -84,6 +141,22 @@ bool Solver(const CScript &scriptPubKey, txnouttype &typeRet, std::vector<std::v
         return true;
     }
 
+    if (MatchPayToPubKeyHash(scriptPubKey, vSolutionsRet))
+    {
+        typeRet = TX_PUBKEYHASH;
+        return true;
+    }
+    if (MatchPayToPubKey(scriptPubKey, vSolutionsRet))
+    {
+        typeRet = TX_PUBKEY;
+        return true;
+    }
+    if (MatchMultisig(scriptPubKey, vSolutionsRet))
+    {
+        typeRet = TX_MULTISIG;
+        return true;
+    }
+
     // Provably prunable, data-carrying output
     //
     // So long as script passes the IsUnspendable() test and all but the first
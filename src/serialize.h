@@ -33,6 +33,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -75,6 +76,84 @@ inline T *NCONST_PTR(const T *val)
     return const_cast<T *>(val);
 }
 
+/**
+ * Types whose serialization is the sizeof(T) bytes of their memory image. Vectors and prevectors of them are read
+ * and written with one copy instead of element by element, and CSizeComputer counts them without visiting the
+ * elements. The wire format stays the same, a type opts in only where the two agree: byte arrays everywhere, the
+ * fixed width integers and flat structs of them only on little endian hosts. Bigger types opt in after their
+ * definition with SERIALIZE_AS_MEMORY_IMAGE.
+ */
+template <typename T>
+struct is_trivially_serializable : std::false_type
+{
+};
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static constexpr bool SER_LITTLE_ENDIAN_HOST = true;
+#else
+static constexpr bool SER_LITTLE_ENDIAN_HOST = false;
+#endif
+
+template <>
+struct is_trivially_serializable<uint8_t> : std::true_type
+{
+};
+template <>
+struct is_trivially_serializable<int8_t> : std::true_type
+{
+};
+template <>
+struct is_trivially_serializable<char> : std::true_type
+{
+};
+template <>
+struct is_trivially_serializable<uint16_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN_HOST>
+{
+};
+template <>
+struct is_trivially_serializable<int16_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN_HOST>
+{
+};
+template <>
+struct is_trivially_serializable<uint32_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN_HOST>
+{
+};
+template <>
+struct is_trivially_serializable<int32_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN_HOST>
+{
+};
+template <>
+struct is_trivially_serializable<uint64_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN_HOST>
+{
+};
+template <>
+struct is_trivially_serializable<int64_t> : std::integral_constant<bool, SER_LITTLE_ENDIAN_HOST>
+{
+};
+
+// byte arrays, the same in any byte order
+class uint160;
+class uint256;
+template <>
+struct is_trivially_serializable<uint160> : std::true_type
+{
+};
+template <>
+struct is_trivially_serializable<uint256> : std::true_type
+{
+};
+
+/**
+ * Declares that T, a struct of fixed width integers and byte arrays without padding, serializes as its memory
+ * image on little endian hosts. nSize is the size of its serialization, a layout with padding fails to compile.
+ */
+#define SERIALIZE_AS_MEMORY_IMAGE(T, nSize)                                                               \
+    static_assert(sizeof(T) == (nSize), #T " has padding, it does not serialize as its memory image");    \
+    template <>                                                                                           \
+    struct is_trivially_serializable<T> : std::integral_constant<bool, SER_LITTLE_ENDIAN_HOST>            \
+    {                                                                                                     \
+    }
+
 /*
  * Lowest-level serialization and conversion.
  * @note Sizes of these types are verified in the tests
@@ -97,6 +176,12 @@ inline void ser_writedata32(Stream &s, uint32_t obj)
     s.write((char *)&obj, 4);
 }
 template <typename Stream>
+inline void ser_writedata32be(Stream &s, uint32_t obj)
+{
+    obj = htobe32(obj);
+    s.write((char *)&obj, 4);
+}
+template <typename Stream>
 inline void ser_writedata64(Stream &s, uint64_t obj)
 {
     obj = htole64(obj);
@@ -124,6 +209,13 @@ inline uint32_t ser_readdata32(Stream &s)
     return le32toh(obj);
 }
 template <typename Stream>
+inline uint32_t ser_readdata32be(Stream &s)
+{
+    uint32_t obj;
+    s.read((char *)&obj, 4);
+    return be32toh(obj);
+}
+template <typename Stream>
 inline uint64_t ser_readdata64(Stream &s)
 {
     uint64_t obj;
@@ -651,37 +743,37 @@ void Unserialize(Stream &is, std::basic_string<C> &str);
 
 /**
  * prevector
- * prevectors of uint8_t are a special case and are intended to be serialized as
- * a single opaque blob.
+ * prevectors of trivially serializable types, uint8_t most of all, are a
+ * special case and are serialized as a single opaque blob.
  */
 template <typename Stream, unsigned int N, typename T>
-void Serialize_impl(Stream &os, const prevector<N, T> &v, const uint8_t &);
-template <typename Stream, unsigned int N, typename T, typename V>
-void Serialize_impl(Stream &os, const prevector<N, T> &v, const V &);
+void Serialize_impl(Stream &os, const prevector<N, T> &v, std::true_type);
+template <typename Stream, unsigned int N, typename T>
+void Serialize_impl(Stream &os, const prevector<N, T> &v, std::false_type);
 template <typename Stream, unsigned int N, typename T>
 inline void Serialize(Stream &os, const prevector<N, T> &v);
 template <typename Stream, unsigned int N, typename T>
-void Unserialize_impl(Stream &is, prevector<N, T> &v, const uint8_t &);
-template <typename Stream, unsigned int N, typename T, typename V>
-void Unserialize_impl(Stream &is, prevector<N, T> &v, const V &);
+void Unserialize_impl(Stream &is, prevector<N, T> &v, std::true_type);
+template <typename Stream, unsigned int N, typename T>
+void Unserialize_impl(Stream &is, prevector<N, T> &v, std::false_type);
 template <typename Stream, unsigned int N, typename T>
 inline void Unserialize(Stream &is, prevector<N, T> &v);
 
 /**
  * vector
- * vectors of uint8_t are a special case and are intended to be serialized as a
- * single opaque blob.
+ * vectors of trivially serializable types, uint8_t most of all, are a special
+ * case and are serialized as a single opaque blob.
  */
 template <typename Stream, typename T, typename A>
-void Serialize_impl(Stream &os, const std::vector<T, A> &v, const uint8_t &);
-template <typename Stream, typename T, typename A, typename V>
-void Serialize_impl(Stream &os, const std::vector<T, A> &v, const V &);
+void Serialize_impl(Stream &os, const std::vector<T, A> &v, std::true_type);
+template <typename Stream, typename T, typename A>
+void Serialize_impl(Stream &os, const std::vector<T, A> &v, std::false_type);
 template <typename Stream, typename T, typename A>
 inline void Serialize(Stream &os, const std::vector<T, A> &v);
 template <typename Stream, typename T, typename A>
-void Unserialize_impl(Stream &is, std::vector<T, A> &v, const uint8_t &);
-template <typename Stream, typename T, typename A, typename V>
-void Unserialize_impl(Stream &is, std::vector<T, A> &v, const V &);
+void Unserialize_impl(Stream &is, std::vector<T, A> &v, std::true_type);
+template <typename Stream, typename T, typename A>
+void Unserialize_impl(Stream &is, std::vector<T, A> &v, std::false_type);
 template <typename Stream, typename T, typename A>
 inline void Unserialize(Stream &is, std::vector<T, A> &v);
 
@@ -729,20 +821,46 @@ void Unserialize(Stream &os, std::unique_ptr<const T> &p);
 
 /**
  * If none of the specialized versions above matched, default to calling member
- * function.
+ * function, or to copying the memory image of trivially serializable types.
  */
 template <typename Stream, typename T>
-inline void Serialize(Stream &os, const T &a)
+inline void SerializeObject_impl(Stream &os, const T &a, std::true_type)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types serialize as memory");
+    os.write((const char *)&a, sizeof(T));
+}
+
+template <typename Stream, typename T>
+inline void SerializeObject_impl(Stream &os, const T &a, std::false_type)
 {
     a.Serialize(os);
 }
 
 template <typename Stream, typename T>
-inline void Unserialize(Stream &is, T &a)
+inline void Serialize(Stream &os, const T &a)
+{
+    SerializeObject_impl(os, a, is_trivially_serializable<T>());
+}
+
+template <typename Stream, typename T>
+inline void UnserializeObject_impl(Stream &is, T &a, std::true_type)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types serialize as memory");
+    is.read((char *)&a, sizeof(T));
+}
+
+template <typename Stream, typename T>
+inline void UnserializeObject_impl(Stream &is, T &a, std::false_type)
 {
     a.Unserialize(is);
 }
 
+template <typename Stream, typename T>
+inline void Unserialize(Stream &is, T &a)
+{
+    UnserializeObject_impl(is, a, is_trivially_serializable<T>());
+}
+
 /**
  * string
  */
@@ -767,15 +885,16 @@ void Unserialize(Stream &is, std::basic_string<C> &str)
  * prevector
  */
 template <typename Stream, unsigned int N, typename T>
-void Serialize_impl(Stream &os, const prevector<N, T> &v, const uint8_t &)
+void Serialize_impl(Stream &os, const prevector<N, T> &v, std::true_type)
 {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types serialize as memory");
     WriteCompactSize(os, v.size());
     if (!v.empty())
         os.write((char *)&v[0], v.size() * sizeof(T));
 }
 
-template <typename Stream, unsigned int N, typename T, typename V>
-void Serialize_impl(Stream &os, const prevector<N, T> &v, const V &)
+template <typename Stream, unsigned int N, typename T>
+void Serialize_impl(Stream &os, const prevector<N, T> &v, std::false_type)
 {
     WriteCompactSize(os, v.size());
     for (typename prevector<N, T>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
@@ -785,12 +904,13 @@ void Serialize_impl(Stream &os, const prevector<N, T> &v, const V &)
 template <typename Stream, unsigned int N, typename T>
 inline void Serialize(Stream &os, const prevector<N, T> &v)
 {
-    Serialize_impl(os, v, T());
+    Serialize_impl(os, v, is_trivially_serializable<T>());
 }
 
 template <typename Stream, unsigned int N, typename T>
-void Unserialize_impl(Stream &is, prevector<N, T> &v, const uint8_t &)
+void Unserialize_impl(Stream &is, prevector<N, T> &v, std::true_type)
 {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types serialize as memory");
     // Limit size per read so bogus size value won't cause out of memory
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
@@ -804,8 +924,8 @@ void Unserialize_impl(Stream &is, prevector<N, T> &v, const uint8_t &)
     }
 }
 
-template <typename Stream, unsigned int N, typename T, typename V>
-void Unserialize_impl(Stream &is, prevector<N, T> &v, const V &)
+template <typename Stream, unsigned int N, typename T>
+void Unserialize_impl(Stream &is, prevector<N, T> &v, std::false_type)
 {
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
@@ -825,22 +945,23 @@ void Unserialize_impl(Stream &is, prevector<N, T> &v, const V &)
 template <typename Stream, unsigned int N, typename T>
 inline void Unserialize(Stream &is, prevector<N, T> &v)
 {
-    Unserialize_impl(is, v, T());
+    Unserialize_impl(is, v, is_trivially_serializable<T>());
 }
 
 /**
  * vector
  */
 template <typename Stream, typename T, typename A>
-void Serialize_impl(Stream &os, const std::vector<T, A> &v, const uint8_t &)
+void Serialize_impl(Stream &os, const std::vector<T, A> &v, std::true_type)
 {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types serialize as memory");
     WriteCompactSize(os, v.size());
     if (!v.empty())
         os.write((char *)&v[0], v.size() * sizeof(T));
 }
 
-template <typename Stream, typename T, typename A, typename V>
-void Serialize_impl(Stream &os, const std::vector<T, A> &v, const V &)
+template <typename Stream, typename T, typename A>
+void Serialize_impl(Stream &os, const std::vector<T, A> &v, std::false_type)
 {
     WriteCompactSize(os, v.size());
     for (typename std::vector<T, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
@@ -850,12 +971,13 @@ void Serialize_impl(Stream &os, const std::vector<T, A> &v, const V &)
 template <typename Stream, typename T, typename A>
 inline void Serialize(Stream &os, const std::vector<T, A> &v)
 {
-    Serialize_impl(os, v, T());
+    Serialize_impl(os, v, is_trivially_serializable<T>());
 }
 
 template <typename Stream, typename T, typename A>
-void Unserialize_impl(Stream &is, std::vector<T, A> &v, const uint8_t &)
+void Unserialize_impl(Stream &is, std::vector<T, A> &v, std::true_type)
 {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types serialize as memory");
     // Limit size per read so bogus size value won't cause out of memory
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
@@ -869,8 +991,8 @@ void Unserialize_impl(Stream &is, std::vector<T, A> &v, const uint8_t &)
     }
 }
 
-template <typename Stream, typename T, typename A, typename V>
-void Unserialize_impl(Stream &is, std::vector<T, A> &v, const V &)
+template <typename Stream, typename T, typename A>
+void Unserialize_impl(Stream &is, std::vector<T, A> &v, std::false_type)
 {
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
@@ -890,7 +1012,7 @@ void Unserialize_impl(Stream &is, std::vector<T, A> &v, const V &)
 template <typename Stream, typename T, typename A>
 inline void Unserialize(Stream &is, std::vector<T, A> &v)
 {
-    Unserialize_impl(is, v, T());
+    Unserialize_impl(is, v, is_trivially_serializable<T>());
 }
 
 /**
@@ -145,6 +145,58 @@ private:
     size_t nPos;
 };
 
+/**
+ * Minimal stream for reading from a range of memory the stream does not own, like a memory
+ * mapped file. The memory must outlive the stream.
+ */
+class CMemoryReader
+{
+public:
+    /**
+     * @param[in]  nTypeIn Serialization Type
+     * @param[in]  nVersionIn Serialization Version (including any flags)
+     * @param[in]  pbeginIn, pendIn  The memory to read
+     */
+    CMemoryReader(int nTypeIn, int nVersionIn, const uint8_t *pbeginIn, const uint8_t *pendIn)
+        : nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pend(pendIn)
+    {
+    }
+    void read(char *pch, size_t nSize)
+    {
+        if (nSize > size())
+        {
+            throw std::ios_base::failure("CMemoryReader::read(): end of data");
+        }
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+    }
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+        {
+            throw std::ios_base::failure("CMemoryReader::ignore(): end of data");
+        }
+        pbegin += nSize;
+    }
+    template <typename T>
+    CMemoryReader &operator>>(T &obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const { return nVersion; }
+    int GetType() const { return nType; }
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+
+private:
+    const int nType;
+    const int nVersion;
+    const uint8_t *pbegin;
+    const uint8_t *pend;
+};
+
 /**
  * Double ended buffer combining vector and stream-like interfaces.
  *
@@ -152,10 +204,11 @@ private:
  * templates. Fills with data in linear time; some stringstream implementations
  * take N^2 time.
  */
-class CDataStream
+template <typename SerializeData>
+class CDataStreamBase
 {
 protected:
-    typedef CSerializeData vector_type;
+    typedef SerializeData vector_type;
     vector_type vch;
     unsigned int nReadPos;
 
@@ -163,44 +216,41 @@ protected:
     int nVersion;
 
 public:
-    typedef vector_type::allocator_type allocator_type;
-    typedef vector_type::size_type size_type;
-    typedef vector_type::difference_type difference_type;
-    typedef vector_type::reference reference;
-    typedef vector_type::const_reference const_reference;
-    typedef vector_type::value_type value_type;
-    typedef vector_type::iterator iterator;
-    typedef vector_type::const_iterator const_iterator;
-    typedef vector_type::reverse_iterator reverse_iterator;
-
-    explicit CDataStream(int nTypeIn, int nVersionIn) { Init(nTypeIn, nVersionIn); }
-    CDataStream(const_iterator pbegin, const_iterator pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
-    {
-        Init(nTypeIn, nVersionIn);
-    }
-
-    CDataStream(const char *pbegin, const char *pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
+    typedef typename vector_type::allocator_type allocator_type;
+    typedef typename vector_type::size_type size_type;
+    typedef typename vector_type::difference_type difference_type;
+    typedef typename vector_type::reference reference;
+    typedef typename vector_type::const_reference const_reference;
+    typedef typename vector_type::value_type value_type;
+    typedef typename vector_type::iterator iterator;
+    typedef typename vector_type::const_iterator const_iterator;
+    typedef typename vector_type::reverse_iterator reverse_iterator;
+
+    explicit CDataStreamBase(int nTypeIn, int nVersionIn) { Init(nTypeIn, nVersionIn); }
+    CDataStreamBase(const_iterator pbegin, const_iterator pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const vector_type &vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
+    CDataStreamBase(const char *pbegin, const char *pend, int nTypeIn, int nVersionIn) : vch(pbegin, pend)
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const std::vector<char> &vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
+    template <typename Alloc>
+    CDataStreamBase(const std::vector<char, Alloc> &vchIn, int nTypeIn, int nVersionIn)
+        : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const std::vector<uint8_t> &vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
+    CDataStreamBase(const std::vector<uint8_t> &vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
     }
 
     template <typename... Args>
-    CDataStream(int nTypeIn, int nVersionIn, Args &&... args)
+    CDataStreamBase(int nTypeIn, int nVersionIn, Args &&... args)
     {
         Init(nTypeIn, nVersionIn);
         ::SerializeMany(*this, std::forward<Args>(args)...);
@@ -213,15 +263,15 @@ public:
         nVersion = nVersionIn;
     }
 
-    CDataStream &operator+=(const CDataStream &b)
+    CDataStreamBase &operator+=(const CDataStreamBase &b)
     {
         vch.insert(vch.end(), b.begin(), b.end());
         return *this;
     }
 
-    friend CDataStream operator+(const CDataStream &a, const CDataStream &b)
+    friend CDataStreamBase operator+(const CDataStreamBase &a, const CDataStreamBase &b)
     {
-        CDataStream ret = a;
+        CDataStreamBase ret = a;
         ret += b;
         return (ret);
     }
@@ -238,6 +288,8 @@ public:
     bool empty() const { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c = 0) { vch.resize(n + nReadPos, c); }
     void reserve(size_type n) { vch.reserve(n + nReadPos); }
+    //! room the buffer has, what was read already included
+    size_type capacity() const { return vch.capacity(); }
     const_reference operator[](size_type pos) const { return vch[pos + nReadPos]; }
     reference operator[](size_type pos) { return vch[pos + nReadPos]; }
     void clear()
@@ -348,7 +400,7 @@ public:
     // Stream subset
     //
     bool eof() const { return size() == 0; }
-    CDataStream *rdbuf() { return this; }
+    CDataStreamBase *rdbuf() { return this; }
     int in_avail() { return size(); }
     void SetType(int n) { nType = n; }
     int GetType() const { return nType; }
@@ -412,7 +464,7 @@ public:
     }
 
     template <typename T>
-    CDataStream &operator<<(const T &obj)
+    CDataStreamBase &operator<<(const T &obj)
     {
         // Serialize to this stream
         ::Serialize(*this, obj);
@@ -420,14 +472,21 @@ public:
     }
 
     template <typename T>
-    CDataStream &operator>>(T &obj)
+    CDataStreamBase &operator>>(T &obj)
     {
         // Unserialize from this stream
         ::Unserialize(*this, obj);
         return (*this);
     }
 
-    void GetAndClear(CSerializeData &d)
+    /** Trade the underlying buffer with vchIn, capacity and all, and rewind */
+    void SwapBuffer(vector_type &vchIn)
+    {
+        vch.swap(vchIn);
+        nReadPos = 0;
+    }
+
+    void GetAndClear(vector_type &d)
     {
         d.insert(d.end(), begin(), end());
         clear();
@@ -445,9 +504,47 @@ public:
             return;
         }
 
-        for (size_type i = 0, j = 0; i != size(); i++)
+        char *p = vch.data();
+        const size_type nSize = size();
+        size_type i = 0;
+
+        // A key whose length divides 8, like the obfuscation keys of the databases, repeats within 8 byte words.
+        // Those are xored a word at a time, which compilers also turn into vector instructions, and keep the key
+        // aligned for the bytes left over.
+        if (8 % key.size() == 0)
         {
-            vch[i] ^= key[j++];
+            uint8_t pattern[8];
+            for (size_t k = 0; k < sizeof(pattern); k += key.size())
+                memcpy(pattern + k, key.data(), key.size());
+            uint64_t nKeyWord;
+            memcpy(&nKeyWord, pattern, sizeof(nKeyWord));
+            // the key of a database that is not obfuscated
+            if (nKeyWord == 0)
+                return;
+
+            for (; i + 32 <= nSize; i += 32)
+            {
+                uint64_t words[4];
+                memcpy(words, p + i, sizeof(words));
+                words[0] ^= nKeyWord;
+                words[1] ^= nKeyWord;
+                words[2] ^= nKeyWord;
+                words[3] ^= nKeyWord;
+                memcpy(p + i, words, sizeof(words));
+            }
+            for (; i + 8 <= nSize; i += 8)
+            {
+                uint64_t word;
+                memcpy(&word, p + i, sizeof(word));
+                word ^= nKeyWord;
+                memcpy(p + i, &word, sizeof(word));
+            }
+        }
+
+        // i is a multiple of the key length here
+        for (size_type j = 0; i != nSize; i++)
+        {
+            p[i] ^= key[j++];
 
             // This potentially acts on very many bytes of data, so it's
             // important that we calculate `j`, i.e. the `key` index in this way
@@ -459,6 +556,18 @@ public:
     }
 };
 
+/** The stream for anything that may hold keys or other secrets, its buffer is zeroed when it is freed */
+typedef CDataStreamBase<CSerializeData> CDataStream;
+
+/** Byte-vector for public data that is freed without clearing it first */
+typedef std::vector<char> CPublicSerializeData;
+
+/**
+ * The stream for data that is public anyway: network messages, the chainstate and block index records and
+ * hashing buffers. It saves the memset of every buffer on free that CDataStream does.
+ */
+typedef CDataStreamBase<CPublicSerializeData> CPublicDataStream;
+
 /**
  * Non-refcounted RAII wrapper for FILE*
  *
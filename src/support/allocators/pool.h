@@ -0,0 +1,207 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <cstddef>
+#include <list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * A memory resource for node based containers that allocate many small objects of the same few sizes, like the
+ * nodes of the coins cache map. Memory is taken from the system in large chunks and handed out in units of
+ * ELEM_ALIGN_BYTES. A freed block goes onto a free list for its size and is reused by the next allocation of that
+ * size, chunks are only given back when the resource is destroyed.
+ *
+ * Compared with one malloc per node this saves the malloc overhead of every node, keeps nodes together instead of
+ * scattered over the heap, and makes the memory used exactly known: it is the number of chunks times their size.
+ *
+ * Allocations larger than MAX_BLOCK_SIZE_BYTES, such as the bucket array of a hash map, go to operator new.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0, "ALIGN_BYTES must be nonzero");
+    static_assert((ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+
+    /** A free block, in the memory of the block itself */
+    struct ListNode
+    {
+        ListNode *m_next;
+
+        explicit ListNode(ListNode *next) : m_next(next) {}
+    };
+    static_assert(std::is_trivially_destructible<ListNode>::value, "ListNode is never destroyed");
+
+    //! every block is a multiple of this, and aligned to it
+    static constexpr std::size_t ELEM_ALIGN_BYTES = ALIGN_BYTES > alignof(ListNode) ? ALIGN_BYTES : alignof(ListNode);
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES, "a free block must be able to hold a ListNode");
+    static_assert((MAX_BLOCK_SIZE_BYTES & (ELEM_ALIGN_BYTES - 1)) == 0,
+        "MAX_BLOCK_SIZE_BYTES must be a multiple of the alignment");
+    // chunks come from plain operator new, which does not align beyond this
+    static_assert(ELEM_ALIGN_BYTES <= alignof(std::max_align_t), "over aligned pools are not supported");
+
+    const std::size_t m_chunk_size_bytes;
+    std::list<unsigned char *> m_allocated_chunks;
+    //! free blocks by their size in units of ELEM_ALIGN_BYTES
+    std::array<ListNode *, MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1> m_free_lists;
+    //! what is left of the newest chunk
+    unsigned char *m_available_memory_it;
+    unsigned char *m_available_memory_end;
+    //! bytes of the blocks on the free lists
+    std::size_t m_free_list_bytes;
+
+    static constexpr std::size_t NumElemAlignBytes(std::size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    static constexpr bool IsFreeListUsable(std::size_t bytes, std::size_t alignment)
+    {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PlacementAddToList(void *p, ListNode *&node) { node = new (p) ListNode(node); }
+
+    void AllocateChunk()
+    {
+        // whatever is left of the last chunk can still serve allocations of its size
+        const std::size_t nRemaining = m_available_memory_end - m_available_memory_it;
+        if (nRemaining != 0)
+        {
+            PlacementAddToList(m_available_memory_it, m_free_lists[nRemaining / ELEM_ALIGN_BYTES]);
+            m_free_list_bytes += nRemaining;
+        }
+
+        m_available_memory_it = static_cast<unsigned char *>(::operator new(m_chunk_size_bytes));
+        m_available_memory_end = m_available_memory_it + m_chunk_size_bytes;
+        m_allocated_chunks.push_back(m_available_memory_it);
+    }
+
+public:
+    /** chunk_size_bytes is rounded up to a multiple of the alignment, it must hold at least one largest block */
+    explicit PoolResource(std::size_t chunk_size_bytes)
+        : m_chunk_size_bytes(NumElemAlignBytes(chunk_size_bytes) * ELEM_ALIGN_BYTES), m_available_memory_it(nullptr),
+          m_available_memory_end(nullptr), m_free_list_bytes(0)
+    {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+        m_free_lists.fill(nullptr);
+        AllocateChunk();
+    }
+    PoolResource() : PoolResource(262144) {}
+    PoolResource(const PoolResource &) = delete;
+    PoolResource &operator=(const PoolResource &) = delete;
+
+    ~PoolResource()
+    {
+        for (unsigned char *chunk : m_allocated_chunks)
+            ::operator delete(chunk);
+    }
+
+    void *Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (IsFreeListUsable(bytes, alignment))
+        {
+            const std::size_t num_alignments = NumElemAlignBytes(bytes);
+            const std::size_t round_bytes = num_alignments * ELEM_ALIGN_BYTES;
+            if (m_free_lists[num_alignments] != nullptr)
+            {
+                m_free_list_bytes -= round_bytes;
+                return std::exchange(m_free_lists[num_alignments], m_free_lists[num_alignments]->m_next);
+            }
+
+            if (round_bytes > (std::size_t)(m_available_memory_end - m_available_memory_it))
+                AllocateChunk();
+            return std::exchange(m_available_memory_it, m_available_memory_it + round_bytes);
+        }
+        assert(alignment <= alignof(std::max_align_t));
+        return ::operator new(bytes);
+    }
+
+    void Deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (IsFreeListUsable(bytes, alignment))
+        {
+            PlacementAddToList(p, m_free_lists[NumElemAlignBytes(bytes)]);
+            m_free_list_bytes += NumElemAlignBytes(bytes) * ELEM_ALIGN_BYTES;
+        }
+        else
+            ::operator delete(p);
+    }
+
+    std::size_t NumAllocatedChunks() const { return m_allocated_chunks.size(); }
+    std::size_t ChunkSizeBytes() const { return m_chunk_size_bytes; }
+    //! Bytes of the chunks that are not handed out, what can be allocated before another chunk is needed
+    std::size_t NumFreeBytes() const { return m_free_list_bytes + (m_available_memory_end - m_available_memory_it); }
+};
+
+/** Allocator for standard containers that takes its memory from a PoolResource, which must outlive it */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+    PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> *m_resource;
+
+    template <typename U, std::size_t M, std::size_t A>
+    friend class PoolAllocator;
+
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    PoolAllocator(ResourceType *resource) noexcept : m_resource(resource) {}
+    PoolAllocator(const PoolAllocator &other) noexcept = default;
+    PoolAllocator &operator=(const PoolAllocator &other) noexcept = default;
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &other) noexcept
+        : m_resource(other.resource())
+    {
+    }
+
+    template <typename U>
+    struct rebind
+    {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    T *allocate(std::size_t n) { return static_cast<T *>(m_resource->Allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *p, std::size_t n) noexcept { m_resource->Deallocate(p, n * sizeof(T), alignof(T)); }
+    ResourceType *resource() const noexcept { return m_resource; }
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -105,6 +105,7 @@ public:
         boost::mutex::scoped_lock lock(mutex);
         return histogram.size();
     }
+    size_t GetPageSize() const { return page_size; }
 
 private:
     Locker locker;
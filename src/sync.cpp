@@ -24,6 +24,8 @@
 #include "util/util.h"
 #include "util/utilstrencodings.h"
 
+#include <algorithm>
+#include <set>
 #include <stdio.h>
 #include <thread>
 
@@ -35,6 +37,163 @@ void PrintLockContention(const char *pszName, const char *pszFile, unsigned int
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#ifdef DEBUG_LOCKPROFILE
+static int LockProfileBucket(uint64_t nNanos)
+{
+    uint64_t nMicros = nNanos / 1000;
+    int nBucket = 0;
+    while (nMicros > 0 && nBucket < LOCKPROFILE_BUCKETS - 1)
+    {
+        nMicros >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+void CLockSiteStats::Record(bool fContendedIn, uint64_t nWait, uint64_t nHold)
+{
+    nCount++;
+    if (fContendedIn)
+        nContended++;
+    nWaitNanos += nWait;
+    nMaxWaitNanos = std::max(nMaxWaitNanos, nWait);
+    nHoldNanos += nHold;
+    nMaxHoldNanos = std::max(nMaxHoldNanos, nHold);
+    vWaitHistogram[LockProfileBucket(nWait)]++;
+    vHoldHistogram[LockProfileBucket(nHold)]++;
+}
+
+void CLockSiteStats::Add(const CLockSiteStats &other)
+{
+    fShared = other.fShared;
+    nCount += other.nCount;
+    nContended += other.nContended;
+    nWaitNanos += other.nWaitNanos;
+    nMaxWaitNanos = std::max(nMaxWaitNanos, other.nMaxWaitNanos);
+    nHoldNanos += other.nHoldNanos;
+    nMaxHoldNanos = std::max(nMaxHoldNanos, other.nMaxHoldNanos);
+    for (int i = 0; i < LOCKPROFILE_BUCKETS; i++)
+    {
+        vWaitHistogram[i] += other.vWaitHistogram[i];
+        vHoldHistogram[i] += other.vHoldHistogram[i];
+    }
+}
+
+namespace
+{
+// the literals LOCK() passes, so sites are told apart by address
+typedef std::tuple<const char *, const char *, unsigned int> LockSiteKey;
+typedef std::map<LockSiteKey, CLockSiteStats> LockSiteMap;
+
+/** The statistics of one thread, only that thread writes them */
+struct LockProfileThread
+{
+    //! taken by the thread for every record and by GetLockProfile, so it is never contended for long
+    std::mutex cs;
+    LockSiteMap mapSites;
+};
+
+/** Every thread with statistics, and what the threads that ended left behind */
+struct LockProfileRegistry
+{
+    std::mutex cs;
+    std::set<LockProfileThread *> setThreads;
+    LockSiteMap mapEnded;
+};
+
+LockProfileRegistry &GetLockProfileRegistry()
+{
+    static LockProfileRegistry registry;
+    return registry;
+}
+
+void MergeLockSites(LockSiteMap &to, const LockSiteMap &from)
+{
+    for (const auto &site : from)
+        to[site.first].Add(site.second);
+}
+
+/** Hands the statistics of a thread to the registry when the thread ends */
+struct LockProfileThreadGuard
+{
+    LockProfileThread *pthread = nullptr;
+    ~LockProfileThreadGuard();
+};
+
+thread_local LockProfileThreadGuard lockProfileThread;
+// trivially destructible, so it can still be read after the guard is gone while the thread ends
+thread_local bool fLockProfileThreadEnded = false;
+
+LockProfileThreadGuard::~LockProfileThreadGuard()
+{
+    fLockProfileThreadEnded = true;
+    if (!pthread)
+        return;
+    LockProfileRegistry &registry = GetLockProfileRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.cs);
+        registry.setThreads.erase(pthread);
+        MergeLockSites(registry.mapEnded, pthread->mapSites);
+    }
+    delete pthread;
+    pthread = nullptr;
+}
+}
+
+void LockProfileRecord(const char *pszName,
+    const char *pszFile,
+    unsigned int nLine,
+    bool fShared,
+    bool fContended,
+    uint64_t nWaitNanos,
+    uint64_t nHoldNanos)
+{
+    if (fLockProfileThreadEnded)
+        return;
+    LockProfileThread *pthread = lockProfileThread.pthread;
+    if (!pthread)
+    {
+        pthread = new LockProfileThread();
+        LockProfileRegistry &registry = GetLockProfileRegistry();
+        std::lock_guard<std::mutex> lock(registry.cs);
+        registry.setThreads.insert(pthread);
+        lockProfileThread.pthread = pthread;
+    }
+    std::lock_guard<std::mutex> lock(pthread->cs);
+    CLockSiteStats &stats = pthread->mapSites[LockSiteKey(pszName, pszFile, nLine)];
+    stats.fShared = fShared;
+    stats.Record(fContended, nWaitNanos, nHoldNanos);
+}
+
+std::map<CLockSite, CLockSiteStats> GetLockProfile(bool fReset)
+{
+    LockSiteMap mapAll;
+    LockProfileRegistry &registry = GetLockProfileRegistry();
+    {
+        std::lock_guard<std::mutex> lock(registry.cs);
+        MergeLockSites(mapAll, registry.mapEnded);
+        if (fReset)
+            registry.mapEnded.clear();
+        for (LockProfileThread *pthread : registry.setThreads)
+        {
+            std::lock_guard<std::mutex> threadLock(pthread->cs);
+            MergeLockSites(mapAll, pthread->mapSites);
+            if (fReset)
+                pthread->mapSites.clear();
+        }
+    }
+
+    // the same text from different translation units is one site
+    std::map<CLockSite, CLockSiteStats> ret;
+    for (const auto &site : mapAll)
+    {
+        CLockSite key{std::get<0>(site.first), std::get<1>(site.first), std::get<2>(site.first)};
+        ret[key].Add(site.second);
+    }
+    return ret;
+}
+#endif /* DEBUG_LOCKPROFILE */
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
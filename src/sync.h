@@ -8,6 +8,7 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "util/trace.h"
 #include "util/util.h"
 #include "util/utiltime.h"
 
@@ -19,7 +20,11 @@
 #include <boost/thread/thread.hpp>
 #include <boost/thread/tss.hpp> // for boost::thread_specific_ptr
 
+#include <chrono>
+#include <map>
 #include <mutex>
+#include <string>
+#include <tuple>
 
 ////////////////////////////////////////////////
 //                                            //
@@ -257,6 +262,63 @@ static inline void DeleteLock(void *cs) {}
 void PrintLockContention(const char *pszName, const char *pszFile, unsigned int nLine);
 #endif
 
+#ifdef DEBUG_LOCKPROFILE
+/** Buckets of the wait and hold time histograms, bucket i counts the times below 2^i microseconds */
+static const int LOCKPROFILE_BUCKETS = 20;
+
+/** Where a lock is taken */
+struct CLockSite
+{
+    std::string name;
+    std::string file;
+    unsigned int line;
+    bool operator<(const CLockSite &other) const
+    {
+        return std::tie(name, file, line) < std::tie(other.name, other.file, other.line);
+    }
+};
+
+/** How often a lock was taken at one site, how long that waited for it and how long it was then held */
+struct CLockSiteStats
+{
+    bool fShared = false;
+    uint64_t nCount = 0;
+    //! the times the lock was not free right away
+    uint64_t nContended = 0;
+    uint64_t nWaitNanos = 0;
+    uint64_t nMaxWaitNanos = 0;
+    uint64_t nHoldNanos = 0;
+    uint64_t nMaxHoldNanos = 0;
+    uint64_t vWaitHistogram[LOCKPROFILE_BUCKETS] = {};
+    uint64_t vHoldHistogram[LOCKPROFILE_BUCKETS] = {};
+
+    void Record(bool fContendedIn, uint64_t nWait, uint64_t nHold);
+    void Add(const CLockSiteStats &other);
+};
+
+static inline uint64_t LockProfileNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * Count one acquisition of a lock in the statistics of this thread. The threads keep their statistics apart so
+ * the profiler does not add contention of its own.
+ */
+void LockProfileRecord(const char *pszName,
+    const char *pszFile,
+    unsigned int nLine,
+    bool fShared,
+    bool fContended,
+    uint64_t nWaitNanos,
+    uint64_t nHoldNanos);
+
+/** The statistics of all threads, those that ended included. fReset starts them over. */
+std::map<CLockSite, CLockSiteStats> GetLockProfile(bool fReset = false);
+#endif
+
 #define LOCK_WARN_TIME (500ULL * 1000ULL * 1000ULL)
 
 /** Wrapper around boost::unique_lock<Mutex> */
@@ -269,6 +331,11 @@ private:
 // turn the feature on and off at compile time.
 #ifdef DEBUG_LOCKTIME
     uint64_t lockedTime = 0;
+#endif
+#ifdef DEBUG_LOCKPROFILE
+    uint64_t nProfileLocked = 0;
+    uint64_t nProfileWait = 0;
+    bool fProfileContended = false;
 #endif
     const char *name = "unknown-name";
     const char *file = "unknown-file";
@@ -283,14 +350,32 @@ private:
         file = pszFile;
         line = nLine;
         EnterCritical(pszName, pszFile, nLine, (void *)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
+#if defined(DEBUG_LOCKCONTENTION) || defined(DEBUG_LOCKPROFILE) || defined(ENABLE_TRACING)
+#ifdef DEBUG_LOCKPROFILE
+        const uint64_t nProfileStart = LockProfileNanos();
+#endif
         if (!lock.try_lock())
         {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
+#endif
+#ifdef DEBUG_LOCKPROFILE
+            fProfileContended = true;
+#endif
+#ifdef ENABLE_TRACING
+            const auto traceStart = std::chrono::steady_clock::now();
 #endif
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            TRACE5(sync, lock_contended, pszName, pszFile, nLine, false,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceStart)
+                    .count());
         }
+#ifdef DEBUG_LOCKPROFILE
+        nProfileLocked = LockProfileNanos();
+        nProfileWait = nProfileLocked - nProfileStart;
+#endif
+#else
+        lock.lock();
 #endif
 
 #ifdef DEBUG_LOCKTIME
@@ -319,6 +404,9 @@ private:
 #ifdef DEBUG_LOCKTIME
         else
             lockedTime = GetStopwatch();
+#endif
+#ifdef DEBUG_LOCKPROFILE
+        nProfileLocked = LockProfileNanos();
 #endif
         return lock.owns_lock();
     }
@@ -352,6 +440,10 @@ public:
         if (lock.owns_lock())
         {
             LeaveCritical();
+#ifdef DEBUG_LOCKPROFILE
+            LockProfileRecord(
+                name, file, line, false, fProfileContended, nProfileWait, LockProfileNanos() - nProfileLocked);
+#endif
 #ifdef DEBUG_LOCKTIME
             uint64_t doneTime = GetStopwatch();
             if (doneTime - lockedTime > LOCK_WARN_TIME)
@@ -372,6 +464,11 @@ class SCOPED_LOCKABLE CMutexReadLock
 private:
     boost::shared_lock<Mutex> lock;
     uint64_t lockedTime = 0;
+#ifdef DEBUG_LOCKPROFILE
+    uint64_t nProfileLocked = 0;
+    uint64_t nProfileWait = 0;
+    bool fProfileContended = false;
+#endif
     const char *name = "unknown-name";
     const char *file = "unknown-file";
     unsigned int line = 0;
@@ -386,14 +483,32 @@ private:
         line = nLine;
         EnterCritical(pszName, pszFile, nLine, (void *)(lock.mutex()));
 // LOG(LCK,"try ReadLock %p %s by %d\n", lock.mutex(), name ? name : "", boost::this_thread::get_id());
-#ifdef DEBUG_LOCKCONTENTION
+#if defined(DEBUG_LOCKCONTENTION) || defined(DEBUG_LOCKPROFILE) || defined(ENABLE_TRACING)
+#ifdef DEBUG_LOCKPROFILE
+        const uint64_t nProfileStart = LockProfileNanos();
+#endif
         if (!lock.try_lock())
         {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
+#endif
+#ifdef DEBUG_LOCKPROFILE
+            fProfileContended = true;
+#endif
+#ifdef ENABLE_TRACING
+            const auto traceStart = std::chrono::steady_clock::now();
 #endif
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            TRACE5(sync, lock_contended, pszName, pszFile, nLine, true,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceStart)
+                    .count());
         }
+#ifdef DEBUG_LOCKPROFILE
+        nProfileLocked = LockProfileNanos();
+        nProfileWait = nProfileLocked - nProfileStart;
+#endif
+#else
+        lock.lock();
 #endif
 // LOG(LCK,"ReadLock %p %s taken by %d\n", lock.mutex(), name ? name : "", boost::this_thread::get_id());
 #ifdef DEBUG_LOCKTIME
@@ -421,6 +536,9 @@ private:
 #ifdef DEBUG_LOCKTIME
         else
             lockedTime = GetStopwatch();
+#endif
+#ifdef DEBUG_LOCKPROFILE
+        nProfileLocked = LockProfileNanos();
 #endif
         return lock.owns_lock();
     }
@@ -454,6 +572,10 @@ public:
         if (lock.owns_lock())
         {
             LeaveCritical();
+#ifdef DEBUG_LOCKPROFILE
+            LockProfileRecord(
+                name, file, line, true, fProfileContended, nProfileWait, LockProfileNanos() - nProfileLocked);
+#endif
 #ifdef DEBUG_LOCKTIME
             int64_t doneTime = GetStopwatch();
             if (doneTime - lockedTime > LOCK_WARN_TIME)
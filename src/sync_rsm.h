@@ -7,7 +7,7 @@
 #ifndef SYNC_RSM_H
 #define SYNC_RSM_H
 
-#include "rsm/recursive_shared_mutex.h"
+#include "rsm/fast_recursive_shared_mutex.h"
 #include "sync.h"
 #include "threadsafety.h"
 #include "util/util.h"
@@ -16,7 +16,7 @@
 #include <mutex>
 
 #ifndef DEBUG_LOCKORDER
-typedef recursive_shared_mutex CRecursiveSharedCriticalSection;
+typedef fast_recursive_shared_mutex CRecursiveSharedCriticalSection;
 /** Define a named, shared critical section that is named in debug builds.
     Named critical sections are useful in conjunction with a lock analyzer to discover bottlenecks. */
 #define RSCRITSEC(x) CRecursiveSharedCriticalSection x
@@ -35,7 +35,7 @@ public:
         LockInfoRecursive(const char *f, unsigned int l, uint32_t c) : file(f), line(l), count(c){}
     };
 
-    recursive_shared_mutex internal_lock;
+    fast_recursive_shared_mutex internal_lock;
     std::mutex setlock;
     std::map<uint64_t, LockInfoRecursive> sharedowners;
     const char *name;
@@ -0,0 +1,105 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "key.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_script_hashes)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    uint8_t nType;
+    uint160 hash;
+
+    // pay to pubkey and pay to pubkey hash are the same address
+    BOOST_CHECK(GetAddressIndexHash(GetScriptForDestination(pubkey.GetID()), nType, hash));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_PUBKEYHASH);
+    BOOST_CHECK(hash == pubkey.GetID());
+    BOOST_CHECK(GetAddressIndexHash(CScript() << ToByteVector(pubkey) << OP_CHECKSIG, nType, hash));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_PUBKEYHASH);
+    BOOST_CHECK(hash == pubkey.GetID());
+
+    const CScript redeemScript = GetScriptForDestination(pubkey.GetID());
+    BOOST_CHECK(GetAddressIndexHash(GetScriptForDestination(CScriptID(redeemScript)), nType, hash));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_SCRIPTHASH);
+    BOOST_CHECK(hash == CScriptID(redeemScript));
+
+    BOOST_CHECK(!GetAddressIndexHash(CScript() << OP_RETURN, nType, hash));
+    BOOST_CHECK(!GetAddressIndexHash(CScript(), nType, hash));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_read_and_erase)
+{
+    CBlockTreeDB blocktree(1 << 20, true);
+    uint160 hash;
+    hash.SetHex("1234");
+    uint160 other;
+    other.SetHex("1235");
+    uint256 txid;
+    txid.SetHex("abcd");
+
+    // heights on both sides of a byte boundary, stored big endian they are read back in order
+    CAddressIndexUpdate update;
+    update.vAddressIndex.emplace_back(CAddressIndexKey(ADDRESS_PUBKEYHASH, hash, 256, txid, 0, false), 50);
+    update.vAddressIndex.emplace_back(CAddressIndexKey(ADDRESS_PUBKEYHASH, hash, 255, txid, 1, false), 20);
+    update.vAddressIndex.emplace_back(CAddressIndexKey(ADDRESS_PUBKEYHASH, hash, 300, txid, 0, true), -20);
+    update.vAddressIndex.emplace_back(CAddressIndexKey(ADDRESS_PUBKEYHASH, other, 10, txid, 0, false), 7);
+    update.vAddressIndex.emplace_back(CAddressIndexKey(ADDRESS_SCRIPTHASH, hash, 10, txid, 0, false), 9);
+    update.vAddressUnspent.emplace_back(
+        CAddressUnspentKey(ADDRESS_PUBKEYHASH, hash, txid, 0), CAddressUnspentValue(50, CScript() << OP_1, 256));
+    update.vAddressUnspent.emplace_back(
+        CAddressUnspentKey(ADDRESS_PUBKEYHASH, hash, txid, 1), CAddressUnspentValue(20, CScript() << OP_1, 255));
+    update.vSpent.emplace_back(
+        CSpentIndexKey(txid, 1), CSpentIndexValue(txid, 0, 300, 20, ADDRESS_PUBKEYHASH, hash));
+    BOOST_REQUIRE(blocktree.UpdateAddressIndexes(update));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    BOOST_REQUIRE(blocktree.ReadAddressIndex(ADDRESS_PUBKEYHASH, hash, vEntries));
+    BOOST_REQUIRE_EQUAL(vEntries.size(), 3U);
+    BOOST_CHECK_EQUAL(vEntries[0].first.nBlockHeight, 255);
+    BOOST_CHECK_EQUAL(vEntries[1].first.nBlockHeight, 256);
+    BOOST_CHECK_EQUAL(vEntries[2].first.nBlockHeight, 300);
+    BOOST_CHECK(vEntries[2].first.fSpending);
+    BOOST_CHECK_EQUAL(vEntries[2].second, -20);
+
+    vEntries.clear();
+    BOOST_REQUIRE(blocktree.ReadAddressIndex(ADDRESS_PUBKEYHASH, hash, vEntries, 256, 299));
+    BOOST_REQUIRE_EQUAL(vEntries.size(), 1U);
+    BOOST_CHECK_EQUAL(vEntries[0].second, 50);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_REQUIRE(blocktree.ReadAddressUnspentIndex(ADDRESS_PUBKEYHASH, hash, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 2U);
+
+    CSpentIndexValue spent;
+    BOOST_REQUIRE(blocktree.ReadSpentIndex(CSpentIndexKey(txid, 1), spent));
+    BOOST_CHECK_EQUAL(spent.nBlockHeight, 300);
+    BOOST_CHECK(!blocktree.ReadSpentIndex(CSpentIndexKey(txid, 0), spent));
+
+    // undoing the spend, as disconnecting its block does
+    CAddressIndexUpdate undo;
+    undo.vAddressIndexErase.push_back(CAddressIndexKey(ADDRESS_PUBKEYHASH, hash, 300, txid, 0, true));
+    undo.vAddressUnspent.emplace_back(CAddressUnspentKey(ADDRESS_PUBKEYHASH, hash, txid, 0), CAddressUnspentValue());
+    undo.vSpent.emplace_back(CSpentIndexKey(txid, 1), CSpentIndexValue());
+    BOOST_REQUIRE(blocktree.UpdateAddressIndexes(undo));
+
+    vEntries.clear();
+    BOOST_REQUIRE(blocktree.ReadAddressIndex(ADDRESS_PUBKEYHASH, hash, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 2U);
+    vUnspent.clear();
+    BOOST_REQUIRE(blocktree.ReadAddressUnspentIndex(ADDRESS_PUBKEYHASH, hash, vUnspent));
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK_EQUAL(vUnspent[0].first.nIndex, 1U);
+    BOOST_CHECK(!blocktree.ReadSpentIndex(CSpentIndexKey(txid, 1), spent));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
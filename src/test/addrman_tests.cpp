@@ -199,6 +199,43 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     */
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_sparse)
+{
+    CAddrManTest addrman;
+
+    // Set addrman addr placement to be deterministic.
+    addrman.MakeDeterministic();
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    // Test 12a: an entry that was just tried and failed is unlikely, but still found in a table holding nothing else.
+    CService addr1 = ResolveService("250.1.1.1", 8333);
+    addrman.Add(CAddress(addr1), source);
+    addrman.Attempt(addr1, true);
+    for (int i = 0; i < 100; i++)
+        BOOST_CHECK(addrman.Select().ToString() == "250.1.1.1:8333");
+
+    // Test 12b: only the entries in the tables are selected, from both of them.
+    std::set<std::string> setAdded = {"250.1.1.1:8333"};
+    for (unsigned int i = 1; i < 20; i++)
+    {
+        CService addr = ResolveService("250.2." + std::to_string(i) + ".1", 8333);
+        addrman.Add(CAddress(addr), source);
+        if (i % 2 == 0)
+            addrman.Good(CAddress(addr));
+        setAdded.insert(addr.ToString());
+    }
+    std::set<std::string> setSelected;
+    for (int i = 0; i < 1000; i++)
+    {
+        const std::string strSelected = addrman.Select().ToString();
+        BOOST_CHECK(setAdded.count(strSelected));
+        setSelected.insert(strSelected);
+        BOOST_CHECK(setAdded.count(addrman.Select(true).ToString()));
+    }
+    BOOST_CHECK(setSelected.size() > 10);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
@@ -0,0 +1,129 @@
+// Copyright (c) 2018 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/banindex.h"
+#include "net/netbase.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(banindex_tests, BasicTestingSetup)
+
+static CNetAddr ResolveIP(const char *ip)
+{
+    CNetAddr addr;
+    LookupHost(ip, addr, false);
+    return addr;
+}
+
+static CSubNet ResolveSubNet(const char *subnet)
+{
+    CSubNet ret;
+    LookupSubNet(subnet, ret);
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(banindex_prefix_length)
+{
+    BOOST_CHECK_EQUAL(ResolveSubNet("1.2.3.4").GetPrefixLength(), 128);
+    BOOST_CHECK_EQUAL(ResolveSubNet("1.2.3.0/24").GetPrefixLength(), 96 + 24);
+    BOOST_CHECK_EQUAL(ResolveSubNet("1.2.0.0/255.255.0.0").GetPrefixLength(), 96 + 16);
+    BOOST_CHECK_EQUAL(ResolveSubNet("1::/16").GetPrefixLength(), 16);
+    BOOST_CHECK_EQUAL(ResolveSubNet("1.2.3.4/255.0.255.0").GetPrefixLength(), -1);
+}
+
+BOOST_AUTO_TEST_CASE(banindex_lookup)
+{
+    CBanIndex index;
+    index.Add(ResolveSubNet("1.2.3.0/24"), 100);
+    index.Add(ResolveSubNet("1.2.3.4"), 200);
+    index.Add(ResolveSubNet("10.0.0.0/8"), 100);
+    index.Add(ResolveSubNet("1:2::/32"), 100);
+    index.Add(ResolveSubNet("5.0.6.0/255.0.255.0"), 100);
+    BOOST_CHECK_EQUAL(index.size(), 5U);
+
+    BOOST_CHECK(index.IsBanned(ResolveIP("1.2.3.5"), 50));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1.2.4.5"), 50));
+    BOOST_CHECK(index.IsBanned(ResolveIP("10.255.1.1"), 50));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("11.0.0.1"), 50));
+    BOOST_CHECK(index.IsBanned(ResolveIP("1:2:3::4"), 50));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1:3::4"), 50));
+    BOOST_CHECK(index.IsBanned(ResolveIP("5.7.6.8"), 50));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("5.7.7.8"), 50));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("pg6mmjiyjmcrsslp.onion"), 50));
+
+    // the /24 ran out, the longer ban of the single address still holds
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1.2.3.5"), 150));
+    BOOST_CHECK(index.IsBanned(ResolveIP("1.2.3.4"), 150));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1.2.3.4"), 200));
+
+    // adding a subnet again replaces the time
+    index.Add(ResolveSubNet("10.0.0.0/8"), 300);
+    BOOST_CHECK_EQUAL(index.size(), 5U);
+    BOOST_CHECK(index.IsBanned(ResolveIP("10.1.1.1"), 250));
+}
+
+BOOST_AUTO_TEST_CASE(banindex_remove)
+{
+    CBanIndex index;
+    index.Add(ResolveSubNet("1.2.3.0/24"), 100);
+    index.Add(ResolveSubNet("1.2.3.4"), 100);
+    index.Add(ResolveSubNet("1.2.3.128/25"), 100);
+    index.Add(ResolveSubNet("pg6mmjiyjmcrsslp.onion"), 100);
+
+    BOOST_CHECK(!index.Remove(ResolveSubNet("1.2.0.0/16")));
+    BOOST_CHECK(index.Remove(ResolveSubNet("1.2.3.0/24")));
+    BOOST_CHECK(!index.Remove(ResolveSubNet("1.2.3.0/24")));
+    BOOST_CHECK_EQUAL(index.size(), 3U);
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1.2.3.5"), 50));
+    BOOST_CHECK(index.IsBanned(ResolveIP("1.2.3.4"), 50));
+    BOOST_CHECK(index.IsBanned(ResolveIP("1.2.3.200"), 50));
+    BOOST_CHECK(index.IsBanned(ResolveIP("pg6mmjiyjmcrsslp.onion"), 50));
+
+    BOOST_CHECK(index.Remove(ResolveSubNet("1.2.3.4")));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1.2.3.4"), 50));
+    BOOST_CHECK(index.IsBanned(ResolveIP("1.2.3.200"), 50));
+
+    index.Clear();
+    BOOST_CHECK_EQUAL(index.size(), 0U);
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1.2.3.200"), 50));
+}
+
+BOOST_AUTO_TEST_CASE(banindex_matches_linear_scan)
+{
+    // random subnets in a small part of the address space so they nest and overlap
+    std::map<CSubNet, int64_t> mapBanned;
+    CBanIndex index;
+    for (int i = 0; i < 500; i++)
+    {
+        CNetAddr addr(ResolveIP(strprintf("10.%d.%d.%d", GetRand(4), GetRand(256), GetRand(256)).c_str()));
+        CSubNet subNet(addr, 8 + GetRand(25));
+        int64_t nBanUntil = GetRand(100);
+        mapBanned[subNet] = nBanUntil;
+        index.Add(subNet, nBanUntil);
+        if (GetRand(4) == 0)
+        {
+            const CSubNet &subNetRemove = mapBanned.begin()->first;
+            BOOST_CHECK(index.Remove(subNetRemove));
+            mapBanned.erase(mapBanned.begin());
+        }
+    }
+    BOOST_CHECK_EQUAL(index.size(), mapBanned.size());
+
+    for (int i = 0; i < 2000; i++)
+    {
+        CNetAddr addr(ResolveIP(strprintf("10.%d.%d.%d", GetRand(4), GetRand(256), GetRand(256)).c_str()));
+        int64_t nNow = GetRand(100);
+        bool fBanned = false;
+        for (const auto &entry : mapBanned)
+        {
+            fBanned |= entry.first.Match(addr) && nNow < entry.second;
+        }
+        BOOST_CHECK_EQUAL(index.IsBanned(addr, nNow), fBanned);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
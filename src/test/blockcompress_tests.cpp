@@ -0,0 +1,106 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompress.h"
+#include "blockfilemap.h"
+#include "chain/block.h"
+#include "clientversion.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcompress_tests, TestingSetup)
+
+static void CheckRoundTrip(const std::vector<unsigned char> &data)
+{
+    std::vector<unsigned char> compressed;
+    LZ4CompressBlock(data.data(), data.size(), compressed);
+    std::vector<unsigned char> out(data.size());
+    BOOST_CHECK(LZ4DecompressBlock(compressed.data(), compressed.size(), out.data(), out.size()));
+    BOOST_CHECK(out == data);
+}
+
+BOOST_AUTO_TEST_CASE(lz4_roundtrip)
+{
+    CheckRoundTrip(std::vector<unsigned char>());
+    CheckRoundTrip(std::vector<unsigned char>(5, 'a'));
+    CheckRoundTrip(std::vector<unsigned char>(100000, 'a'));
+
+    std::vector<unsigned char> data;
+    for (int i = 0; i < 2000; i++)
+    {
+        const uint256 hash = GetRandHash();
+        data.insert(data.end(), hash.begin(), hash.begin() + (i % 32));
+        // runs and repeats farther back than a match can reach
+        data.insert(data.end(), i % 300, (unsigned char)i);
+        if (data.size() > 70000)
+            data.insert(data.end(), data.begin() + i, data.begin() + i + 40);
+    }
+    CheckRoundTrip(data);
+
+    // repetitive data gets smaller
+    std::vector<unsigned char> compressed;
+    LZ4CompressBlock(data.data(), data.size(), compressed);
+    BOOST_CHECK(compressed.size() < data.size());
+
+    // anything cut off or with a wrong size does not decompress
+    std::vector<unsigned char> out(data.size());
+    BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), compressed.size() - 1, out.data(), out.size()));
+    BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), compressed.size(), out.data(), out.size() - 1));
+    out.resize(data.size() + 1);
+    BOOST_CHECK(!LZ4DecompressBlock(compressed.data(), compressed.size(), out.data(), out.size()));
+}
+
+BOOST_AUTO_TEST_CASE(blockcompress_disk)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+    CBlock block(chainparams.GenesisBlock());
+    block.vchBlockSig.assign(5000, 0x42);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    std::vector<unsigned char> data;
+    uint32_t nSizeField;
+    StoreBlockData(block, false, data, nSizeField);
+    BOOST_CHECK_EQUAL(nSizeField, ss.size());
+    StoreBlockData(block, true, data, nSizeField);
+    BOOST_CHECK(nSizeField & BLOCK_COMPRESSED_FLAG);
+    BOOST_CHECK_EQUAL(nSizeField & ~BLOCK_COMPRESSED_FLAG, data.size());
+    BOOST_CHECK(data.size() < ss.size());
+
+    // a compressed block next to a plain one, both read back as they were serialized
+    CDiskBlockPos posCompressed(1, 0);
+    BOOST_CHECK(WriteBlockToDisk(data, nSizeField, posCompressed, chainparams.MessageStart()));
+    CDiskBlockPos posPlain(1, posCompressed.nPos + data.size());
+    BOOST_CHECK(WriteBlockToDisk(block, posPlain, chainparams.MessageStart()));
+
+    CBlockFileMapper mapper;
+    mapper.SetFirstOpenFile(2);
+    for (const CDiskBlockPos &pos : {posCompressed, posPlain})
+    {
+        CBlock blockRead;
+        BOOST_CHECK(ReadBlockFromDisk(blockRead, pos, chainparams.GetConsensus()));
+        BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+        BOOST_CHECK(blockRead.vchBlockSig == block.vchBlockSig);
+        std::string strRaw;
+        BOOST_CHECK(ReadRawBlockFromDisk(strRaw, pos));
+        BOOST_CHECK(strRaw == ss.str());
+
+        blockRead.SetNull();
+        BOOST_CHECK(mapper.ReadBlock(blockRead, pos));
+        BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+        strRaw.clear();
+        BOOST_CHECK(mapper.ReadRawBlock(strRaw, pos));
+        BOOST_CHECK(strRaw == ss.str());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,143 @@
+// Copyright (c) 2011-2016 The Bitcoin Core developers
+// Copyright (c) 2018 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/blockencodings.h"
+#include "consensus/merkle.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, TestingSetup)
+
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(3);
+    block.vtx[0] = std::make_shared<CTransaction>(tx);
+    block.nVersion = 42;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    block.vtx[1] = std::make_shared<CTransaction>(tx);
+
+    tx.vin.resize(10);
+    for (size_t i = 0; i < tx.vin.size(); i++)
+    {
+        tx.vin[i].prevout.hash = GetRandHash();
+        tx.vin[i].prevout.n = 0;
+    }
+    block.vtx[2] = std::make_shared<CTransaction>(tx);
+
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs &cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblockRead;
+    stream >> cmpctblockRead;
+    BOOST_CHECK(stream.empty());
+    return cmpctblockRead;
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_reconstruct_from_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    // the mempool has the last transaction of the block, the coinbase always comes along
+    pool.addUnchecked(block.vtx[2]->GetHash(), entry.FromTx(*block.vtx[2]));
+
+    CBlockHeaderAndShortTxIDs cmpctblock(RoundTrip(CBlockHeaderAndShortTxIDs(block)));
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+
+    // a wrong transaction for the gap shows up in the merkle root
+    CBlock blockWrong;
+    PartiallyDownloadedBlock partialBlockWrong(partialBlock);
+    BOOST_CHECK(partialBlockWrong.FillBlock(blockWrong, {block.vtx[0]}) == READ_STATUS_FAILED);
+
+    // too many or too few transactions for the gaps is the peer's fault
+    PartiallyDownloadedBlock partialBlockTooMany(partialBlock);
+    BOOST_CHECK(partialBlockTooMany.FillBlock(blockWrong, {block.vtx[1], block.vtx[1]}) == READ_STATUS_INVALID);
+    PartiallyDownloadedBlock partialBlockTooFew(partialBlock);
+    BOOST_CHECK(partialBlockTooFew.FillBlock(blockWrong, {}) == READ_STATUS_INVALID);
+
+    CBlock blockRebuilt;
+    BOOST_CHECK(partialBlock.FillBlock(blockRebuilt, {block.vtx[1]}) == READ_STATUS_OK);
+    BOOST_CHECK(blockRebuilt.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRebuilt.hashMerkleRoot == BlockMerkleRoot(blockRebuilt));
+    BOOST_CHECK(blockRebuilt.vtx[2]->GetHash() == block.vtx[2]->GetHash());
+
+    // the block can only be rebuilt once
+    BOOST_CHECK(partialBlock.FillBlock(blockRebuilt, {block.vtx[1]}) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_empty_mempool)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase());
+    block.vchBlockSig = {1, 2, 3};
+
+    CBlockHeaderAndShortTxIDs cmpctblock(RoundTrip(CBlockHeaderAndShortTxIDs(block)));
+    BOOST_CHECK(cmpctblock.vchBlockSig == block.vchBlockSig);
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(2));
+
+    CBlock blockRebuilt;
+    BOOST_CHECK(partialBlock.FillBlock(blockRebuilt, {block.vtx[1], block.vtx[2]}) == READ_STATUS_OK);
+    BOOST_CHECK(blockRebuilt.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRebuilt.vchBlockSig == block.vchBlockSig);
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_request_roundtrip)
+{
+    BlockTransactionsRequest req;
+    req.blockhash = GetRandHash();
+    req.indexes = {0, 1, 3, 4, 1000, 65535};
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    BlockTransactionsRequest reqRead;
+    stream >> reqRead;
+
+    BOOST_CHECK(reqRead.blockhash == req.blockhash);
+    BOOST_CHECK(reqRead.indexes == req.indexes);
+
+    // an index past 16 bits is refused
+    CDataStream streamBad(SER_NETWORK, PROTOCOL_VERSION);
+    streamBad << req.blockhash;
+    WriteCompactSize(streamBad, 2);
+    WriteCompactSize(streamBad, 65535);
+    WriteCompactSize(streamBad, 0);
+    BOOST_CHECK_THROW(streamBad >> reqRead, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "blockwriter.h"
+#include "chain/block.h"
+#include "clientversion.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "undo.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockfilemap_read)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+
+    // a few blocks in each of files 1 to 3, written straight to the files
+    std::vector<CBlock> vBlocks;
+    std::vector<CDiskBlockPos> vPos;
+    for (int nFile = 1; nFile <= 3; nFile++)
+    {
+        unsigned int nPos = 0;
+        for (int i = 0; i < 10; i++)
+        {
+            CBlock block(chainparams.GenesisBlock());
+            block.vchBlockSig.assign(nFile * 10 + i, (unsigned char)i);
+            CDiskBlockPos pos(nFile, nPos);
+            nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) + 8;
+            BOOST_CHECK(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+            vBlocks.push_back(block);
+            vPos.push_back(pos);
+        }
+    }
+
+    // room for one mapping only, reading files 1 and 2 in turn has it map them again and again
+    CBlockFileMapper mapper(1);
+    CBlock block;
+    BOOST_CHECK(!mapper.ReadBlock(block, vPos[0]));
+    mapper.SetFirstOpenFile(3);
+    for (int n = 0; n < 3; n++)
+    {
+        for (size_t i = 0; i < vBlocks.size(); i++)
+        {
+            const bool fMapped = mapper.ReadBlock(block, vPos[i]);
+            // file 3 is still being written to
+            BOOST_CHECK_EQUAL(fMapped, vPos[i].nFile < 3);
+            if (fMapped)
+            {
+                BOOST_CHECK(block.GetHash() == vBlocks[i].GetHash());
+                BOOST_CHECK(block.vchBlockSig == vBlocks[i].vchBlockSig);
+            }
+        }
+    }
+
+    CDiskBlockPos posPastEnd(1, 1 << 24);
+    BOOST_CHECK(!mapper.ReadBlock(block, posPastEnd));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_raw)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+
+    std::vector<CDiskBlockPos> vPos;
+    std::vector<std::string> vRaw;
+    for (int nFile = 1; nFile <= 2; nFile++)
+    {
+        CBlock block(chainparams.GenesisBlock());
+        block.vchBlockSig.assign(nFile * 10, (unsigned char)nFile);
+        CDiskBlockPos pos(nFile, 0);
+        BOOST_CHECK(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        vPos.push_back(pos);
+        vRaw.push_back(ss.str());
+    }
+
+    // the bytes are appended, from the mapping of the finished file and from the open one
+    CBlockFileMapper mapper;
+    mapper.SetFirstOpenFile(2);
+    std::string strRaw = "x";
+    BOOST_CHECK(mapper.ReadRawBlock(strRaw, vPos[0]));
+    BOOST_CHECK(strRaw == "x" + vRaw[0]);
+    BOOST_CHECK(!mapper.ReadRawBlock(strRaw, vPos[1]));
+    strRaw.clear();
+    for (const CDiskBlockPos &pos : vPos)
+        BOOST_CHECK(ReadRawBlockFromDisk(strRaw, pos));
+    BOOST_CHECK(strRaw == vRaw[0] + vRaw[1]);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_undo_grows)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+    const uint256 hashBlock = chainparams.GenesisBlock().GetHash();
+    CBlockFileMapper mapper;
+    mapper.SetFirstOpenFile(2);
+
+    CBlockWriter writer;
+    writer.Start();
+    CBlockUndo undo1;
+    undo1.vtxundo.resize(1);
+    CDiskBlockPos pos1(1, 0);
+    writer.WriteUndo(undo1, pos1, hashBlock, chainparams.MessageStart());
+    BOOST_CHECK(writer.Flush());
+
+    CBlockUndo undoRead;
+    BOOST_CHECK(mapper.ReadUndo(undoRead, pos1, hashBlock));
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), 1U);
+    BOOST_CHECK(!mapper.ReadUndo(undoRead, pos1, uint256()));
+
+    // undo data appended to the rev file after it was mapped
+    CBlockUndo undo2;
+    undo2.vtxundo.resize(2);
+    CDiskBlockPos pos2(1, pos1.nPos + ::GetSerializeSize(undo1, SER_DISK, CLIENT_VERSION) + 32);
+    writer.WriteUndo(undo2, pos2, hashBlock, chainparams.MessageStart());
+    BOOST_CHECK(writer.Flush());
+    writer.Stop();
+
+    BOOST_CHECK(mapper.ReadUndo(undoRead, pos2, hashBlock));
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), 2U);
+    BOOST_CHECK(mapper.ReadUndo(undoRead, pos1, hashBlock));
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
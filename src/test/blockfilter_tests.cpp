@@ -0,0 +1,159 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "blockfilterindex.h"
+#include "chain/block.h"
+#include "chain/tx.h"
+#include "coins.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "undo.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+static GCSFilter::Element RandomElement()
+{
+    const uint256 hash = GetRandHash();
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    GCSFilter::ElementSet included;
+    GCSFilter::ElementSet excluded;
+    for (int i = 0; i < 100; i++)
+    {
+        included.insert(RandomElement());
+        excluded.insert(RandomElement());
+    }
+
+    const GCSFilter::Params params(0, 0, 10, 1 << 10);
+    const GCSFilter filter(params, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    for (const GCSFilter::Element &element : included)
+    {
+        BOOST_CHECK(filter.Match(element));
+        GCSFilter::ElementSet query = excluded;
+        query.insert(element);
+        BOOST_CHECK(filter.MatchAny(query));
+    }
+
+    // the same filter from its encoding, anything after the last element is not accepted
+    const GCSFilter decoded(params, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    for (const GCSFilter::Element &element : included)
+        BOOST_CHECK(decoded.Match(element));
+    std::vector<unsigned char> vPadded = filter.GetEncoded();
+    vPadded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(params, vPadded), std::ios_base::failure);
+    std::vector<unsigned char> vTruncated(filter.GetEncoded().begin(), filter.GetEncoded().end() - 1);
+    BOOST_CHECK_THROW(GCSFilter(params, vTruncated), std::ios_base::failure);
+
+    const GCSFilter empty(params);
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.MatchAny(included));
+    BOOST_CHECK_EQUAL(GCSFilter(params, GCSFilter::ElementSet()).GetEncoded().size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic)
+{
+    const CScript included1 = CScript() << std::vector<unsigned char>(20, 1) << OP_CHECKSIG;
+    const CScript included2 = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY
+                                        << OP_CHECKSIG;
+    const CScript spent = CScript() << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUAL;
+    const CScript excludedReturn = CScript() << OP_RETURN << std::vector<unsigned char>(4, 4);
+    const CScript excludedUnrelated = CScript() << OP_HASH160 << std::vector<unsigned char>(20, 5) << OP_EQUAL;
+
+    CTransaction tx;
+    tx.vout.resize(4);
+    tx.vout[0].scriptPubKey = included1;
+    tx.vout[1].scriptPubKey = included2;
+    tx.vout[2].scriptPubKey = excludedReturn;
+    // an empty output, as the first one of a coinstake is
+    tx.vout[3].scriptPubKey = CScript();
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.emplace_back();
+    blockundo.vtxundo.back().vprevout.emplace_back(CTxOut(100, spent), 1, false, false, 0);
+
+    const BlockFilter filter(BASIC_FILTER, block, blockundo);
+    const GCSFilter &gcs = filter.GetFilter();
+    BOOST_CHECK_EQUAL(gcs.GetN(), 3U);
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(included1.begin(), included1.end())));
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(included2.begin(), included2.end())));
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(spent.begin(), spent.end())));
+    BOOST_CHECK(!gcs.Match(GCSFilter::Element(excludedReturn.begin(), excludedReturn.end())));
+    BOOST_CHECK(!gcs.Match(GCSFilter::Element(excludedUnrelated.begin(), excludedUnrelated.end())));
+
+    const BlockFilter decoded(BASIC_FILTER, block.GetHash(), filter.GetEncodedFilter());
+    BOOST_CHECK(decoded.GetHash() == filter.GetHash());
+    BOOST_CHECK(decoded.ComputeHeader(uint256()) == filter.ComputeHeader(uint256()));
+    BOOST_CHECK(filter.ComputeHeader(uint256()) != filter.ComputeHeader(filter.GetHash()));
+
+    // as it is sent in a cfilter message
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << filter;
+    BlockFilter received;
+    ss >> received;
+    BOOST_CHECK(received.GetBlockHash() == block.GetHash());
+    BOOST_CHECK(received.GetEncodedFilter() == filter.GetEncodedFilter());
+
+    BlockFilterType filterType;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filterType));
+    BOOST_CHECK_EQUAL(filterType, BASIC_FILTER);
+    BOOST_CHECK(!BlockFilterTypeByName("extended", filterType));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_sync, TestChain100Setup)
+{
+    CBlockFilterIndex index(BASIC_FILTER, 1 << 20, true);
+    index.Start();
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    const CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindexTip, pnetMan->getActivePaymentNetwork()->GetConsensus()));
+    CBlockUndo blockundo;
+    BOOST_REQUIRE(UndoReadFromDisk(blockundo, pindexTip->GetUndoPos(), pindexTip->pprev->GetBlockHash()));
+    const BlockFilter expected(BASIC_FILTER, block, blockundo);
+
+    BlockFilter filter;
+    BOOST_REQUIRE(index.LookupFilter(pindexTip, filter));
+    BOOST_CHECK(filter.GetEncodedFilter() == expected.GetEncodedFilter());
+    uint256 header;
+    uint256 prevHeader;
+    BOOST_REQUIRE(index.LookupFilterHeader(pindexTip, header));
+    BOOST_REQUIRE(index.LookupFilterHeader(pindexTip->pprev, prevHeader));
+    BOOST_CHECK(header == expected.ComputeHeader(prevHeader));
+
+    // a block connected after the index caught up is indexed as well
+    CreateAndProcessBlock(
+        std::vector<CTransactionRef>(), CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG);
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    const CBlockIndex *pindexNew = pnetMan->getChainActive()->chainActive.Tip();
+    BOOST_CHECK(pindexNew != pindexTip);
+    BOOST_CHECK(index.LookupFilter(pindexNew, filter));
+
+    std::vector<BlockFilter> vFilters;
+    BOOST_REQUIRE(index.LookupFilterRange(pindexNew->nHeight - 1, pindexNew, vFilters));
+    BOOST_REQUIRE_EQUAL(vFilters.size(), 2U);
+    BOOST_CHECK(vFilters[0].GetBlockHash() == pindexTip->GetBlockHash());
+    std::vector<uint256> vHashes;
+    BOOST_REQUIRE(index.LookupFilterHashRange(0, pindexNew, vHashes));
+    BOOST_CHECK_EQUAL(vHashes.size(), (size_t)pindexNew->nHeight + 1);
+    BOOST_CHECK(vHashes.back() == vFilters[1].GetHash());
+    BOOST_CHECK(!index.LookupFilterRange(pindexNew->nHeight + 1, pindexNew, vFilters));
+
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,99 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+#include "chain/block.h"
+#include "clientversion.h"
+#include "init.h"
+#include "networks/netman.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, TestingSetup)
+
+static void AppendRecord(CDataStream &ss, const CMessageHeader::MessageMagic &messageStart, const CBlock &block)
+{
+    ss << FLATDATA(messageStart) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) << block;
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_file_order)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+    const CMessageHeader::MessageMagic &messageStart = chainparams.MessageStart();
+
+    std::vector<CBlock> vBlocks;
+    std::vector<uint64_t> vPos;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    for (int i = 0; i < 200; i++)
+    {
+        CBlock block(chainparams.GenesisBlock());
+        block.vchBlockSig.assign(i, (unsigned char)i);
+        if (i % 50 == 10)
+        {
+            // a torn record: a header, a transaction count no block has, and then a whole record of its own
+            CDataStream ssTorn(SER_DISK, CLIENT_VERSION);
+            ssTorn << CBlockHeader(block);
+            for (int j = 0; j < 9; j++)
+                ssTorn << (unsigned char)0xff;
+            const size_t nTornHeader = ss.size() + CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+            vPos.push_back(nTornHeader + ssTorn.size() + CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int));
+            AppendRecord(ssTorn, messageStart, block);
+            ss << FLATDATA(messageStart) << (unsigned int)ssTorn.size();
+            ss.write(&ssTorn[0], ssTorn.size());
+        }
+        else
+        {
+            vPos.push_back(ss.size() + CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int));
+            AppendRecord(ss, messageStart, block);
+        }
+        vBlocks.push_back(block);
+        // bytes between records are skipped
+        if (i % 7 == 0)
+            ss << (unsigned char)i << (unsigned char)messageStart[0];
+    }
+
+    fs::path path = pathTemp / "import.dat";
+    FILE *file = fopen(path.string().c_str(), "wb");
+    BOOST_CHECK_EQUAL(fwrite(&ss[0], 1, ss.size(), file), ss.size());
+    fclose(file);
+
+    // small queues, so the reader and the deserializers have to wait for each other
+    CBlockImporter importer(fopen(path.string().c_str(), "rb"), messageStart, 3, 1024);
+    CImportedBlock imported;
+    size_t nFound = 0;
+    while (importer.Next(imported))
+    {
+        BOOST_REQUIRE(nFound < vBlocks.size());
+        BOOST_CHECK(imported.hash == vBlocks[nFound].GetHash());
+        BOOST_CHECK(imported.pblock->vchBlockSig == vBlocks[nFound].vchBlockSig);
+        BOOST_CHECK_EQUAL(imported.nPos, vPos[nFound]);
+        nFound++;
+    }
+    BOOST_CHECK_EQUAL(nFound, vBlocks.size());
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_stop)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    for (int i = 0; i < 100; i++)
+        AppendRecord(ss, chainparams.MessageStart(), chainparams.GenesisBlock());
+
+    fs::path path = pathTemp / "import.dat";
+    FILE *file = fopen(path.string().c_str(), "wb");
+    BOOST_CHECK_EQUAL(fwrite(&ss[0], 1, ss.size(), file), ss.size());
+    fclose(file);
+
+    CBlockImporter importer(fopen(path.string().c_str(), "rb"), chainparams.MessageStart(), 2, 1024);
+    CImportedBlock imported;
+    BOOST_CHECK(importer.Next(imported));
+    importer.Stop();
+    BOOST_CHECK(!importer.Next(imported));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,216 @@
+// Copyright (c) 2018 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain/blockmap.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockmap_insert_find)
+{
+    CBlockIndexArena arena;
+    CBlockMap map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(GetRandHash()) == map.end());
+
+    // enough entries to grow the table and the arena slabs a few times
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex *> vEntries;
+    for (int i = 0; i < 10000; i++)
+    {
+        vHashes.push_back(GetRandHash());
+        CBlockIndex *pindex = arena.Allocate(vHashes.back());
+        pindex->nHeight = i;
+        BOOST_CHECK(*pindex->phashBlock == vHashes.back());
+        BOOST_CHECK(map.insert(pindex).second);
+        vEntries.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(map.size(), vHashes.size());
+
+    for (size_t i = 0; i < vHashes.size(); i++)
+    {
+        CBlockMap::const_iterator it = map.find(vHashes[i]);
+        BOOST_CHECK(it != map.end());
+        BOOST_CHECK(*it == vEntries[i]);
+        BOOST_CHECK_EQUAL(map.count(vHashes[i]), 1);
+    }
+    BOOST_CHECK_EQUAL(map.count(GetRandHash()), 0);
+
+    // inserting an existing hash returns the stored entry
+    CBlockIndex *pduplicate = arena.Allocate(vHashes[42]);
+    std::pair<CBlockMap::const_iterator, bool> ret = map.insert(pduplicate);
+    BOOST_CHECK(!ret.second);
+    BOOST_CHECK(*ret.first == vEntries[42]);
+    BOOST_CHECK_EQUAL(map.size(), vHashes.size());
+
+    // iteration visits every entry exactly once
+    std::set<CBlockIndex *> setSeen;
+    for (CBlockIndex *pindex : map)
+        BOOST_CHECK(setSeen.insert(pindex).second);
+    BOOST_CHECK(setSeen == std::set<CBlockIndex *>(vEntries.begin(), vEntries.end()));
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(vHashes[0]) == map.end());
+    arena.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(blockmap_colliding_cheap_hash)
+{
+    // keys that share their cheap hash must still be told apart by the full hash
+    CBlockIndexArena arena;
+    CBlockMap map;
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 8; i++)
+    {
+        uint256 hash;
+        *hash.begin() = 7;
+        *(hash.end() - 1) = i;
+        BOOST_CHECK_EQUAL(hash.GetCheapHash(), 7);
+        vHashes.push_back(hash);
+        BOOST_CHECK(map.insert(arena.Allocate(hash)).second);
+    }
+    for (const uint256 &hash : vHashes)
+    {
+        CBlockMap::const_iterator it = map.find(hash);
+        BOOST_CHECK(it != map.end());
+        BOOST_CHECK(*(*it)->phashBlock == hash);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockmap_erase)
+{
+    CBlockIndexArena arena;
+    CBlockMap map;
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 1000; i++)
+    {
+        vHashes.push_back(GetRandHash());
+        map.insert(arena.Allocate(vHashes.back()));
+    }
+    for (size_t i = 0; i < vHashes.size(); i += 2)
+        BOOST_CHECK(map.erase(vHashes[i]));
+    BOOST_CHECK(!map.erase(vHashes[0]));
+    BOOST_CHECK(!map.erase(GetRandHash()));
+    BOOST_CHECK_EQUAL(map.size(), vHashes.size() / 2);
+    for (size_t i = 0; i < vHashes.size(); i++)
+        BOOST_CHECK_EQUAL(map.count(vHashes[i]), i % 2);
+    size_t nSeen = 0;
+    for (CBlockIndex *pindex : map)
+    {
+        BOOST_CHECK(map.Lookup(*pindex->phashBlock) == pindex);
+        nSeen++;
+    }
+    BOOST_CHECK_EQUAL(nSeen, map.size());
+
+    // a tombstone in the middle of a probe sequence does not hide the keys behind it
+    std::vector<uint256> vColliding;
+    for (int i = 0; i < 4; i++)
+    {
+        uint256 hash;
+        *hash.begin() = 9;
+        *(hash.end() - 1) = i;
+        vColliding.push_back(hash);
+        map.insert(arena.Allocate(hash));
+    }
+    BOOST_CHECK(map.erase(vColliding[1]));
+    BOOST_CHECK(map.Lookup(vColliding[1]) == nullptr);
+    BOOST_CHECK(map.Lookup(vColliding[2]) != nullptr);
+    BOOST_CHECK(map.Lookup(vColliding[3]) != nullptr);
+    BOOST_CHECK(map.insert(arena.Allocate(vColliding[1])).second);
+    BOOST_CHECK(map.Lookup(vColliding[1]) != nullptr);
+
+    // churn at a constant size rebuilds the table to drop the tombstones instead of growing it
+    const size_t nSize = map.size();
+    map.ReleaseReplacedTables();
+    map.ReleaseReplacedTables();
+    const size_t nUsage = map.DynamicMemoryUsage();
+    for (int i = 0; i < 20000; i++)
+    {
+        uint256 hash = GetRandHash();
+        map.insert(arena.Allocate(hash));
+        BOOST_CHECK(map.erase(hash));
+    }
+    BOOST_CHECK_EQUAL(map.size(), nSize);
+    BOOST_CHECK(map.DynamicMemoryUsage() > nUsage);
+    map.ReleaseReplacedTables();
+    map.ReleaseReplacedTables();
+    BOOST_CHECK(map.DynamicMemoryUsage() < 2 * nUsage);
+    for (size_t i = 1; i < vHashes.size(); i += 2)
+        BOOST_CHECK(map.Lookup(vHashes[i]) != nullptr);
+    map.clear();
+    arena.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(blockmap_arena_reuse)
+{
+    // a retired entry stays untouched until Reclaim(), and is then constructed again for the next hash
+    CBlockIndexArena arena;
+    const uint256 hash = GetRandHash();
+    CBlockIndex *pindex = arena.Allocate(hash);
+    pindex->nHeight = 5;
+    arena.Retire(pindex);
+    CBlockIndex *pindexOther = arena.Allocate(GetRandHash());
+    BOOST_CHECK(pindexOther != pindex);
+    BOOST_CHECK(*pindex->phashBlock == hash);
+    BOOST_CHECK_EQUAL(pindex->nHeight, 5);
+
+    arena.Reclaim();
+    const uint256 hashNew = GetRandHash();
+    BOOST_CHECK(arena.Allocate(hashNew) == pindex);
+    BOOST_CHECK(*pindex->phashBlock == hashNew);
+    BOOST_CHECK_EQUAL(pindex->nHeight, 0);
+    arena.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(blockmap_concurrent_lookup)
+{
+    // readers look up entries that have been inserted while the writer keeps growing the table
+    CBlockIndexArena arena;
+    CBlockMap map;
+    std::vector<uint256> vHashes(50000);
+    for (uint256 &hash : vHashes)
+        hash = GetRandHash();
+
+    std::atomic<size_t> nPublished(0);
+    std::atomic<bool> fFailed(false);
+    std::vector<std::thread> vReaders;
+    for (int t = 0; t < 3; t++)
+    {
+        vReaders.emplace_back([&, t]() {
+            size_t nCounter = t;
+            while (nPublished.load() < vHashes.size())
+            {
+                size_t nCount = nPublished.load();
+                if (nCount == 0)
+                    continue;
+                const uint256 &hash = vHashes[(nCounter++ * 7919) % nCount];
+                CBlockIndex *pindex = map.Lookup(hash);
+                if (pindex == nullptr || *pindex->phashBlock != hash)
+                    fFailed = true;
+            }
+        });
+    }
+    for (size_t i = 0; i < vHashes.size(); i++)
+    {
+        map.insert(arena.Allocate(vHashes[i]));
+        nPublished.store(i + 1);
+    }
+    for (std::thread &reader : vReaders)
+        reader.join();
+
+    BOOST_CHECK(!fFailed);
+    BOOST_CHECK_EQUAL(map.size(), vHashes.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,90 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain/blockview.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "version.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockview_tests, BasicTestingSetup)
+
+static CBlock RandomBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = insecure_rand();
+    block.nBits = insecure_rand();
+    for (int i = 0; i < 50; i++)
+    {
+        CTransaction tx;
+        // version 2 transactions carry a service reference hash
+        tx.nVersion = 1 + i % 2;
+        tx.serviceReferenceHash = GetRandHash();
+        for (int j = 0; j < i % 4; j++)
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), j), CScript() << std::vector<unsigned char>(i + j, 1)));
+        for (int j = 0; j < i % 3; j++)
+            tx.vout.push_back(CTxOut(i * j, CScript() << OP_RETURN << std::vector<unsigned char>(j, 2)));
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.vchBlockSig.assign(72, 3);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockview_matches_block)
+{
+    const CBlock block = RandomBlock();
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    const std::vector<uint8_t> vch(ss.begin(), ss.end());
+
+    const CBlockView view(vch.data(), vch.data() + vch.size());
+    BOOST_CHECK_EQUAL(view.GetSerializedSize(), vch.size());
+    BOOST_CHECK(view.GetHeader().hashPrevBlock == block.hashPrevBlock);
+    BOOST_CHECK_EQUAL(view.GetTxCount(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = *block.vtx[i];
+        BOOST_CHECK(view.GetTxHash(i) == tx.GetHash());
+        BOOST_CHECK_EQUAL(view.GetInputCount(i), tx.vin.size());
+        BOOST_CHECK_EQUAL(view.GetOutputCount(i), tx.vout.size());
+        for (size_t j = 0; j < tx.vin.size(); j++)
+            BOOST_CHECK(view.GetPrevout(i, j) == tx.vin[j].prevout);
+        for (size_t j = 0; j < tx.vout.size(); j++)
+            BOOST_CHECK(view.GetOutput(i, j) == tx.vout[j]);
+        const CTransactionRef ptx = view.GetTransaction(i);
+        BOOST_CHECK(ptx->GetId() == tx.GetHash());
+        BOOST_CHECK(ptx->GetHash() == tx.GetHash());
+    }
+
+    // known transactions are shared, the others are deserialized, either way the block serializes the same
+    std::vector<CTransactionRef> vtxKnown(block.vtx.begin(), block.vtx.begin() + 10);
+    vtxKnown[3].reset();
+    CBlock blockOut;
+    view.GetBlock(blockOut, vtxKnown);
+    BOOST_CHECK(blockOut.fTxHashesCached);
+    BOOST_CHECK(blockOut.vtx[2] == block.vtx[2]);
+    BOOST_CHECK(blockOut.vtx[3] != block.vtx[3]);
+    BOOST_CHECK(blockOut.vtx[20] != block.vtx[20]);
+    BOOST_CHECK(blockOut.vchBlockSig == block.vchBlockSig);
+    CDataStream ssOut(SER_NETWORK, PROTOCOL_VERSION);
+    ssOut << blockOut;
+    BOOST_CHECK(std::vector<uint8_t>(ssOut.begin(), ssOut.end()) == vch);
+}
+
+BOOST_AUTO_TEST_CASE(blockview_truncated)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << RandomBlock();
+    const std::vector<uint8_t> vch(ss.begin(), ss.end());
+    for (size_t nSize = 0; nSize < vch.size(); nSize += 1 + nSize / 8)
+        BOOST_CHECK_THROW(CBlockView(vch.data(), vch.data() + nSize), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
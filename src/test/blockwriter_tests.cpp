@@ -0,0 +1,70 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockwriter.h"
+#include "chain/block.h"
+#include "clientversion.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "test/test_bitcoin.h"
+#include "undo.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockwriter_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockwriter_write_read)
+{
+    const CNetworkTemplate &chainparams = pnetMan->getActivePaymentNetwork();
+    // a small queue so the producer has to wait for the writer now and then
+    g_blockwriter.reset(new CBlockWriter(4096));
+    g_blockwriter->Start();
+
+    std::vector<CBlock> vBlocks;
+    std::vector<CDiskBlockPos> vPos;
+    unsigned int nPos = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        CBlock block(chainparams.GenesisBlock());
+        // the signature is not part of the header, the proof of work still checks
+        block.vchBlockSig.assign(i, (unsigned char)i);
+        CDiskBlockPos pos(1, nPos);
+        nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) + 8;
+        BOOST_CHECK(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+        vBlocks.push_back(block);
+        vPos.push_back(pos);
+
+        // reading back a block that may still be queued waits for it
+        CBlock blockRead;
+        BOOST_CHECK(ReadBlockFromDisk(blockRead, vPos[i / 2], chainparams.GetConsensus()));
+        BOOST_CHECK(blockRead.vchBlockSig == vBlocks[i / 2].vchBlockSig);
+    }
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(3);
+    const uint256 hashBlock = chainparams.GenesisBlock().GetHash();
+    CDiskBlockPos posUndo(1, 0);
+    g_blockwriter->WriteUndo(blockundo, posUndo, hashBlock, chainparams.MessageStart());
+    BOOST_CHECK(g_blockwriter->Flush());
+
+    for (size_t i = 0; i < vBlocks.size(); i++)
+    {
+        CBlock blockRead;
+        BOOST_CHECK(ReadBlockFromDisk(blockRead, vPos[i], chainparams.GetConsensus()));
+        BOOST_CHECK(blockRead.vchBlockSig == vBlocks[i].vchBlockSig);
+    }
+    CBlockUndo undoRead;
+    BOOST_CHECK(UndoReadFromDisk(undoRead, posUndo, hashBlock));
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), blockundo.vtxundo.size());
+    // the checksum covers the block hash the undo data was written for
+    BOOST_CHECK(!UndoReadFromDisk(undoRead, posUndo, uint256()));
+
+    g_blockwriter->Stop();
+    g_blockwriter.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+// Copyright (c) 2012-2015 The Bitcoin Core developers
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bloom.h"
+
+#include "chain/tx.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "util/utilstrencodings.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(bloom_tests, BasicTestingSetup)
+
+static std::string SerializeFilter(const CBloomFilter &filter)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << filter;
+    return HexStr(stream.begin(), stream.end());
+}
+
+BOOST_AUTO_TEST_CASE(bloom_create_insert_serialize)
+{
+    // the BIP37 vectors, a peer sets the same bits for the same data
+    CBloomFilter filter(3, 0.01, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ParseHex("99108ad8ed9bb6274d3980bab5a85c048f0950c8"));
+    BOOST_CHECK(filter.contains(ParseHex("99108ad8ed9bb6274d3980bab5a85c048f0950c8")));
+    BOOST_CHECK(!filter.contains(ParseHex("19108ad8ed9bb6274d3980bab5a85c048f0950c8")));
+    filter.insert(ParseHex("b5a2c786d9ef4658287ced5914b37a1b4aa32eee"));
+    filter.insert(ParseHex("b9300670b4c5366e95b2699e8b18bc75e5f729c5"));
+    BOOST_CHECK(filter.contains(ParseHex("b9300670b4c5366e95b2699e8b18bc75e5f729c5")));
+    BOOST_CHECK_EQUAL(SerializeFilter(filter), "03614e9b050000000000000001");
+
+    CBloomFilter filterTweaked(3, 0.01, 2147483649UL, BLOOM_UPDATE_ALL);
+    filterTweaked.insert(ParseHex("99108ad8ed9bb6274d3980bab5a85c048f0950c8"));
+    filterTweaked.insert(ParseHex("b5a2c786d9ef4658287ced5914b37a1b4aa32eee"));
+    filterTweaked.insert(ParseHex("b9300670b4c5366e95b2699e8b18bc75e5f729c5"));
+    BOOST_CHECK_EQUAL(SerializeFilter(filterTweaked), "03ce4299050000000100008001");
+}
+
+BOOST_AUTO_TEST_CASE(bloom_outpoint_and_hash)
+{
+    // outpoints and hashes are matched as the bytes they serialize to
+    const COutPoint outpoint(GetRandHash(), 7);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << outpoint;
+    const std::vector<unsigned char> vOutPoint(stream.begin(), stream.end());
+    const uint256 hash = GetRandHash();
+
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_NONE);
+    filter.insert(outpoint);
+    filter.insert(hash);
+    BOOST_CHECK(filter.contains(vOutPoint));
+    BOOST_CHECK(filter.contains(std::vector<unsigned char>(hash.begin(), hash.end())));
+    BOOST_CHECK(!filter.contains(COutPoint(outpoint.hash, 8)));
+}
+
+BOOST_AUTO_TEST_CASE(bloom_match_transactions)
+{
+    CTransaction txFunding;
+    txFunding.vout.resize(1);
+    txFunding.vout[0].scriptPubKey = CScript() << ParseHex("0102030405060708090a0b0c0d0e0f10111213") << OP_CHECKSIG;
+    CTransaction txSpending;
+    txSpending.vin.resize(1);
+    txSpending.vin[0].prevout = COutPoint(txFunding.GetHash(), 0);
+    CTransaction txUnrelated;
+    txUnrelated.vin.resize(1);
+    txUnrelated.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    const std::vector<CTransactionRef> vtx = {
+        MakeTransactionRef(txFunding), MakeTransactionRef(txUnrelated), MakeTransactionRef(txSpending)};
+
+    // the output the first one matches on is added, so the one spending it matches too
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ParseHex("0102030405060708090a0b0c0d0e0f10111213"));
+    std::vector<bool> vMatch;
+    BOOST_CHECK_EQUAL(filter.IsRelevantAndUpdate(vtx, vMatch), 2U);
+    BOOST_REQUIRE_EQUAL(vMatch.size(), 3U);
+    BOOST_CHECK(vMatch[0] && !vMatch[1] && vMatch[2]);
+
+    CBloomFilter filterEmpty(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filterEmpty.clear();
+    BOOST_CHECK_EQUAL(filterEmpty.IsRelevantAndUpdate(vtx, vMatch), 0U);
+    BOOST_CHECK_EQUAL(vMatch.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(rolling_bloom)
+{
+    CRollingBloomFilter filter(100, 0.01);
+    std::vector<uint256> vInserted;
+    for (int i = 0; i < 199; i++)
+    {
+        vInserted.push_back(GetRandHash());
+        filter.insert(vInserted.back());
+    }
+    // at least the last 100 are always kept
+    for (size_t i = 99; i < vInserted.size(); i++)
+        BOOST_CHECK(filter.contains(vInserted[i]));
+
+    int nFalsePositives = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+        if (filter.contains(GetRandHash()))
+            nFalsePositives++;
+    }
+    // about 1% for the 100 to 200 items a half holds, with plenty of room
+    BOOST_CHECK(nFalsePositives < 300);
+
+    filter.reset();
+    BOOST_CHECK(!filter.contains(vInserted.back()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include "chain/block.h"
 #include "clientversion.h"
 #include "consensus/validation.h"
+#include "crypto/scrypt.h"
 #include "main.h" // For CheckBlock
 #include "test/test_bitcoin.h"
 #include "util/utiltime.h"
@@ -55,4 +56,30 @@ BOOST_AUTO_TEST_CASE(TestBlock)
     }
 }
 
+BOOST_AUTO_TEST_CASE(HeaderHashCache)
+{
+    CBlockHeader header;
+    header.nTime = 1400000000;
+    header.nBits = 0x1e0fffff;
+    header.nNonce = 42;
+
+    uint256 hash = header.GetHash();
+    BOOST_CHECK(hash == scrypt_blockhash(&header.nVersion));
+    BOOST_CHECK(header.hashCache != nullptr);
+    BOOST_CHECK(header.GetHash() == hash);
+
+    // mutating a field must not return the stale hash
+    header.nNonce++;
+    BOOST_CHECK(header.GetHash() != hash);
+    BOOST_CHECK(header.GetHash() == scrypt_blockhash(&header.nVersion));
+    header.nNonce--;
+    BOOST_CHECK(header.GetHash() == hash);
+
+    // copies share the cached hash
+    CBlock block(header);
+    BOOST_CHECK(block.hashCache == header.hashCache);
+    BOOST_CHECK(block.GetHash() == hash);
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == hash);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
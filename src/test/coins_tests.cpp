@@ -8,10 +8,14 @@
 #include "main.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -66,11 +70,12 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins,
         const uint256 &hashBlock,
         const uint64_t nBestCoinHeight,
+        const CTxOutSetStats *pstats,
         size_t &nChildCachedCoinsUsage)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
         {
-            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            if (it->second.GetFlags() & CCoinsCacheEntry::DIRTY)
             {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
                 map_[it->first] = it->second.coin;
@@ -442,7 +447,7 @@ size_t InsertCoinsMapEntry(CCoinsMap &map, CAmount value, char flags)
     }
     assert(flags != NO_ENTRY);
     CCoinsCacheEntry entry;
-    entry.flags = flags;
+    entry.SetFlags(flags);
     SetCoinsValue(value, entry.coin);
     auto inserted = map.emplace(OUTPOINT, std::move(entry));
     assert(inserted.second);
@@ -467,20 +472,21 @@ void GetCoinsMapEntry(const CCoinsMap &map, CAmount &value, char &flags)
         {
             value = it->second.coin.out.nValue;
         }
-        flags = it->second.flags;
+        flags = it->second.GetFlags();
         assert(flags != NO_ENTRY);
     }
 }
 
 void WriteCoinsViewEntry(CCoinsView &view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
     InsertCoinsMapEntry(map, value, flags);
     uint256 hash;
     hash.SetNull();
     size_t cacheusage = 0;
     uint64_t bestCoinHeight = 0;
-    view.BatchWrite(map, hash, bestCoinHeight, cacheusage);
+    view.BatchWrite(map, hash, bestCoinHeight, nullptr, cacheusage);
 }
 
 class SingleEntryCacheTest
@@ -774,5 +780,356 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_background_flush)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest parent(&base);
+    CCoinsViewCacheTest cache(&parent);
+
+    std::vector<COutPoint> vOld;
+    for (int i = 0; i < 50; i++)
+    {
+        vOld.emplace_back(GetRandHash(), 0);
+        cache.AddCoin(vOld.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false, 0), false);
+    }
+    BOOST_CHECK(cache.Flush());
+
+    // a spend of a coin the parent has, new coins, and one that came and went before the flush
+    for (const COutPoint &outpoint : vOld)
+        BOOST_CHECK(!cache.AccessCoin(outpoint).IsSpent());
+    cache.SpendCoin(vOld[0]);
+    std::vector<COutPoint> vNew;
+    for (int i = 0; i < 10; i++)
+    {
+        vNew.emplace_back(GetRandHash(), 0);
+        cache.AddCoin(vNew.back(), Coin(CTxOut(100 + i, CScript() << OP_TRUE), 2, false, false, 0), false);
+    }
+    COutPoint gone(GetRandHash(), 0);
+    cache.AddCoin(gone, Coin(CTxOut(1, CScript() << OP_TRUE), 2, false, false, 0), false);
+    cache.SpendCoin(gone);
+    uint256 hashBlock = GetRandHash();
+    cache.SetBestBlock(hashBlock);
+
+    BOOST_CHECK(cache.FlushInBackground());
+    BOOST_CHECK(cache.IsFlushingInBackground());
+    {
+        LOCK(cache.cs_utxo);
+        // everything stays cached and clean while it is written, the spent coin included
+        BOOST_CHECK(!cache.HaveCoinInCache(gone));
+        BOOST_CHECK_EQUAL(cache.map().size(), vOld.size() + vNew.size());
+        for (CCoinsMap::const_iterator it = cache.map().begin(); it != cache.map().end(); it++)
+            BOOST_CHECK_EQUAL(it->second.GetFlags(), 0);
+        BOOST_CHECK(cache.AccessCoin(vOld[0]).IsSpent());
+        cache.Uncache(vNew[0]);
+        BOOST_CHECK(cache.HaveCoinInCache(vNew[0]));
+        // and changes made meanwhile are left for the next flush
+        cache.SpendCoin(vOld[1]);
+        BOOST_CHECK(cache.FinishBackgroundFlush());
+    }
+    BOOST_CHECK(!cache.IsFlushingInBackground());
+
+    BOOST_CHECK(!cache.HaveCoinInCache(vOld[0]));
+    BOOST_CHECK(!parent.HaveCoin(vOld[0]));
+    BOOST_CHECK(parent.GetBestBlock() == hashBlock);
+    for (size_t i = 0; i < vNew.size(); i++)
+    {
+        BOOST_CHECK(cache.HaveCoinInCache(vNew[i]));
+        BOOST_CHECK_EQUAL(parent.AccessCoin(vNew[i]).out.nValue, (CAmount)(100 + i));
+    }
+    BOOST_CHECK(!parent.AccessCoin(vOld[1]).IsSpent());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(parent.AccessCoin(vOld[1]).IsSpent());
+    cache.SelfTest();
+    parent.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_background_flush_trim)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest parent(&base);
+    CCoinsViewCacheTest cache(&parent);
+
+    std::vector<COutPoint> vCoins;
+    for (int i = 0; i < 200; i++)
+    {
+        vCoins.emplace_back(GetRandHash(), 0);
+        cache.AddCoin(vCoins.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false, 0), false);
+    }
+    const size_t nFull = cache.UsedMemoryUsage();
+
+    // what the flush wrote is dropped down to the trim size once it is collected, not before
+    BOOST_CHECK(cache.FlushInBackground(nFull / 2));
+    COutPoint dirty(GetRandHash(), 0);
+    cache.AddCoin(dirty, Coin(CTxOut(1000, CScript() << OP_TRUE), 2, false, false, 0), false);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), vCoins.size() + 1);
+    BOOST_CHECK(cache.FinishBackgroundFlush());
+    BOOST_CHECK(cache.UsedMemoryUsage() <= nFull / 2);
+    BOOST_CHECK(cache.DynamicMemoryUsage() >= nFull);
+    BOOST_CHECK(cache.GetCacheSize() < vCoins.size());
+    // the coin added meanwhile has not been written, it stays
+    BOOST_CHECK(cache.HaveCoinInCache(dirty));
+    for (const COutPoint &outpoint : vCoins)
+        BOOST_CHECK(parent.HaveCoin(outpoint));
+
+    // without a trim size everything stays cached
+    BOOST_CHECK(cache.FlushInBackground());
+    BOOST_CHECK(cache.FinishBackgroundFlush());
+    BOOST_CHECK(cache.HaveCoinInCache(dirty));
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest parent(&base);
+    CCoinsViewCacheTest cache(&parent);
+
+    std::vector<COutPoint> vInBase;
+    for (int i = 0; i < 20; i++)
+    {
+        vInBase.emplace_back(GetRandHash(), i);
+        parent.AddCoin(vInBase.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false, 0), false);
+    }
+    // one the cache spent already, and one the base does not have
+    cache.SpendCoin(vInBase[0]);
+    COutPoint missing(GetRandHash(), 0);
+
+    std::vector<COutPoint> vOutpoints(vInBase);
+    vOutpoints.push_back(missing);
+    BOOST_CHECK_EQUAL(cache.Prefetch(vOutpoints), vInBase.size() - 1);
+    BOOST_CHECK_EQUAL(vOutpoints.size(), vInBase.size());
+    BOOST_CHECK(std::is_sorted(vOutpoints.begin(), vOutpoints.end()));
+    BOOST_CHECK(!cache.HaveCoinInCache(missing));
+    BOOST_CHECK(cache.AccessCoin(vInBase[0]).IsSpent());
+    for (size_t i = 1; i < vInBase.size(); i++)
+    {
+        BOOST_CHECK(cache.HaveCoinInCache(vInBase[i]));
+        BOOST_CHECK_EQUAL(cache.map().find(vInBase[i])->second.GetFlags(), 0);
+        BOOST_CHECK_EQUAL(cache.AccessCoin(vInBase[i]).out.nValue, (CAmount)(i + 1));
+    }
+    cache.SelfTest();
+
+    // nothing is read again for coins that are cached
+    vOutpoints = vInBase;
+    BOOST_CHECK_EQUAL(cache.Prefetch(vOutpoints), 0);
+    BOOST_CHECK(vOutpoints.empty());
+
+    // what is cached and unspent is what a warm-up after a restart would read again
+    cache.GetCachedOutpoints(vOutpoints);
+    std::sort(vOutpoints.begin(), vOutpoints.end());
+    std::vector<COutPoint> vUnspent(vInBase.begin() + 1, vInBase.end());
+    std::sort(vUnspent.begin(), vUnspent.end());
+    BOOST_CHECK(vOutpoints == vUnspent);
+}
+
+
+static CTxOutSetStats CountTxOutSet(const CCoinsView &view)
+{
+    CTxOutSetStats stats;
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        stats.Add(key, coin);
+    }
+    return stats;
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_txoutset_stats)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CTxOutSetStats stats;
+    BOOST_CHECK(db.GetTxOutSetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0U);
+
+    CCoinsViewCacheTest parent(&db);
+    std::vector<COutPoint> vOutpoints;
+    {
+        CCoinsViewCacheTest cache(&parent);
+        for (int i = 0; i < 30; i++)
+        {
+            vOutpoints.emplace_back(GetRandHash(), i % 3);
+            cache.AddCoin(vOutpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false, 0), false);
+        }
+        // unspendable outputs never are in the set
+        cache.AddCoin(COutPoint(GetRandHash(), 0), Coin(CTxOut(1000, CScript() << OP_RETURN), 1, false, false, 0),
+            false);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(parent.Flush());
+    BOOST_CHECK(db.GetTxOutSetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 30U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 465);
+
+    {
+        // spends, including of coins only the database has, and an overwrite of an unspent coin
+        CCoinsViewCacheTest cache(&parent);
+        for (int i = 0; i < 5; i++)
+            cache.SpendCoin(vOutpoints[i]);
+        cache.AddCoin(vOutpoints[10], Coin(CTxOut(500, CScript() << OP_TRUE), 2, true, false, 0), true);
+        cache.AddCoin(COutPoint(GetRandHash(), 0), Coin(CTxOut(7, CScript() << OP_TRUE), 2, false, false, 0), false);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(parent.GetTxOutSetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 26U);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 465 - 15 - 11 + 500 + 7);
+    BOOST_CHECK(parent.FlushInBackground());
+    {
+        LOCK(parent.cs_utxo);
+        BOOST_CHECK(parent.FinishBackgroundFlush());
+    }
+
+    // what the database keeps is what counting it gives
+    CTxOutSetStats stored;
+    BOOST_CHECK(db.GetTxOutSetStats(stored));
+    CTxOutSetStats counted = CountTxOutSet(db);
+    BOOST_CHECK_EQUAL(stored.nTransactionOutputs, counted.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stored.nTotalAmount, counted.nTotalAmount);
+    BOOST_CHECK(stored.muhash.Finalize() == counted.muhash.Finalize());
+    BOOST_CHECK(stored.muhash.Finalize() == stats.muhash.Finalize());
+
+    // a write that does not know the totals drops them
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+    CCoinsCacheEntry &entry = map[COutPoint(GetRandHash(), 0)];
+    entry.coin = Coin(CTxOut(1, CScript() << OP_TRUE), 3, false, false, 0);
+    entry.SetFlags(CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+    size_t nUsage = entry.coin.DynamicMemoryUsage();
+    BOOST_CHECK(db.BatchWrite(map, GetRandHash(), 3, nullptr, nUsage));
+    BOOST_CHECK(!db.GetTxOutSetStats(stats));
+
+    // and a view over a base without them has none either
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    cache.AddCoin(COutPoint(GetRandHash(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false, false, 0), false);
+    BOOST_CHECK(!cache.GetTxOutSetStats(stats));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_scan_coins)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::set<COutPoint> setOutpoints;
+    {
+        CCoinsViewCacheTest cache(&db);
+        for (int i = 0; i < 100; i++)
+        {
+            COutPoint outpoint(GetRandHash(), i % 3);
+            setOutpoints.insert(outpoint);
+            cache.AddCoin(outpoint, Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false, 0), false);
+        }
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    std::unique_ptr<CDBSnapshot> snapshot(db.NewSnapshot());
+
+    // what is written after the snapshot is not seen
+    {
+        CCoinsViewCacheTest cache(&db);
+        cache.AddCoin(COutPoint(GetRandHash(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false, false, 0), false);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // the ranges cover every coin once, each in key order
+    std::vector<COutPoint> vScanned;
+    for (unsigned int nBegin = 0; nBegin < 256; nBegin += 64)
+    {
+        const size_t nStart = vScanned.size();
+        BOOST_CHECK(db.ScanCoins(*snapshot, nBegin, nBegin + 64, [&](const COutPoint &outpoint, const Coin &coin) {
+            BOOST_CHECK(*outpoint.hash.begin() >= nBegin && *outpoint.hash.begin() < nBegin + 64);
+            BOOST_CHECK_EQUAL(coin.nHeight, 1U);
+            vScanned.push_back(outpoint);
+            return true;
+        }));
+        for (size_t i = nStart + 1; i < vScanned.size(); i++)
+            BOOST_CHECK(!(vScanned[i].hash < vScanned[i - 1].hash));
+    }
+    BOOST_CHECK_EQUAL(vScanned.size(), setOutpoints.size());
+    BOOST_CHECK(std::set<COutPoint>(vScanned.begin(), vScanned.end()) == setOutpoints);
+
+    // the callback stops the scan
+    size_t nCalls = 0;
+    BOOST_CHECK(db.ScanCoins(*snapshot, 0, 256, [&](const COutPoint &, const Coin &) { return ++nCalls < 5; }));
+    BOOST_CHECK_EQUAL(nCalls, 5U);
+}
+
+
+BOOST_AUTO_TEST_CASE(ccoins_get_coins)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::vector<COutPoint> vOutpoints;
+    {
+        CCoinsViewCacheTest cache(&db);
+        for (int i = 0; i < 50; i++)
+        {
+            vOutpoints.emplace_back(GetRandHash(), i);
+            cache.AddCoin(vOutpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false, 0), false);
+        }
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    const COutPoint missing(GetRandHash(), 0);
+    std::vector<COutPoint> vLookup(vOutpoints);
+    vLookup.push_back(missing);
+
+    // unsorted or not, what one GetCoins finds is what GetCoin finds
+    std::vector<std::pair<COutPoint, Coin> > vFound;
+    BOOST_CHECK_EQUAL(db.GetCoins(vLookup, vFound), vOutpoints.size());
+    BOOST_CHECK_EQUAL(vFound.size(), vOutpoints.size());
+    for (const std::pair<COutPoint, Coin> &found : vFound)
+    {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(found.first, coin));
+        BOOST_CHECK_EQUAL(coin.out.nValue, found.second.out.nValue);
+        BOOST_CHECK(found.first != missing);
+    }
+
+    // a cache reads what it misses with one GetCoins and keeps it
+    CCoinsViewCacheTest cache(&db);
+    vFound.clear();
+    BOOST_CHECK_EQUAL(cache.GetCoins(vLookup, vFound), vOutpoints.size());
+    for (size_t i = 0; i < vOutpoints.size(); i++)
+    {
+        BOOST_CHECK(cache.HaveCoinInCache(vOutpoints[i]));
+        BOOST_CHECK_EQUAL(cache.AccessCoin(vOutpoints[i]).out.nValue, (CAmount)(i + 1));
+    }
+    BOOST_CHECK(!cache.HaveCoinInCache(missing));
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_entry_flags)
+{
+    // the flags of a cache entry take no room of their own
+    BOOST_CHECK_EQUAL(sizeof(CCoinsCacheEntry), sizeof(Coin));
+
+    CCoinsCacheEntry entry(Coin(CTxOut(5, CScript() << OP_TRUE), MAX_COIN_HEIGHT, true, false, 0xffffffff));
+    entry.SetFlags(CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+    BOOST_CHECK_EQUAL(entry.coin.nHeight, MAX_COIN_HEIGHT);
+    BOOST_CHECK_EQUAL(entry.coin.nTime, 0xffffffffU);
+    BOOST_CHECK(entry.coin.IsCoinBase());
+
+    // a coin assigned to the entry takes its value and leaves the flags, copies of the coin start without them
+    entry.coin = Coin(CTxOut(7, CScript() << OP_FALSE), 10, false, true, 20);
+    BOOST_CHECK_EQUAL(entry.GetFlags(), CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+    BOOST_CHECK_EQUAL(entry.coin.nHeight, 10U);
+    BOOST_CHECK(!entry.coin.IsCoinBase() && entry.coin.IsCoinStake());
+    entry.coin.Clear();
+    BOOST_CHECK_EQUAL(entry.GetFlags(), CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+    Coin copy(entry.coin);
+    BOOST_CHECK_EQUAL(copy.nCacheFlags, 0U);
+
+    // copies of the entry keep them
+    CCoinsCacheEntry entryCopy(entry);
+    BOOST_CHECK_EQUAL(entryCopy.GetFlags(), CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+    CCoinsCacheEntry entryAssigned;
+    entryAssigned = entry;
+    BOOST_CHECK_EQUAL(entryAssigned.GetFlags(), CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+    entryAssigned.SetFlags(0);
+    BOOST_CHECK_EQUAL(entryAssigned.GetFlags(), 0);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "compressor.h"
+#include "key.h"
+#include "script/standard.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 #include "util/util.h"
 
@@ -65,4 +68,35 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+/** Serializes txout compressed, checks the size of the script encoding and that it reads back the same */
+bool static TestScript(const CScript &script, size_t nScriptSize)
+{
+    CTxOut txout(COIN, script);
+    CDataStream ss(SER_DISK, 0);
+    ss << CTxOutCompressor(txout);
+    // one byte for the compressed amount of a coin
+    if (ss.size() != 1 + nScriptSize)
+        return false;
+    CTxOut txoutRead(0, CScript() << OP_RETURN << OP_RETURN);
+    ss >> REF(CTxOutCompressor(txoutRead));
+    return ss.empty() && txoutRead == txout;
+}
+
+BOOST_AUTO_TEST_CASE(compress_scripts)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKey keyUncompressed;
+    keyUncompressed.MakeNewKey(false);
+
+    BOOST_CHECK(TestScript(GetScriptForDestination(key.GetPubKey().GetID()), 21));
+    BOOST_CHECK(TestScript(GetScriptForDestination(CScriptID(CScript() << OP_TRUE)), 21));
+    BOOST_CHECK(TestScript(CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG, 33));
+    BOOST_CHECK(TestScript(CScript() << ToByteVector(keyUncompressed.GetPubKey()) << OP_CHECKSIG, 33));
+    // anything else is its size and its bytes
+    const CScript scriptOther = CScript() << OP_RETURN << std::vector<uint8_t>(40, 0x01);
+    BOOST_CHECK(TestScript(scriptOther, 1 + scriptOther.size()));
+    BOOST_CHECK(TestScript(CScript(), 1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
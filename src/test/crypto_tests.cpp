@@ -4,13 +4,18 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypto/aes.h"
+#include "crypto/hash.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
+#include "crypto/scrypt_nway.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "random.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 #include "util/utilstrencodings.h"
 
@@ -456,4 +461,161 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors)
         "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_blockhash_batch_matches_single)
+{
+    // enough headers for full batches of every lane count plus a partial one
+    const size_t count = 2 * SCRYPT_MAX_LANES + 3;
+    std::vector<std::vector<unsigned char> > headers(count);
+    std::vector<const void *> inputs(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        headers[i].resize(80);
+        for (size_t j = 0; j < 80; j++)
+            headers[i][j] = insecure_rand() & 0xff;
+        inputs[i] = headers[i].data();
+    }
+
+    std::vector<uint256> hashes(count);
+    scrypt_blockhash_batch(inputs.data(), hashes.data(), count);
+    for (size_t i = 0; i < count; i++)
+    {
+        BOOST_CHECK(hashes[i] == scrypt_blockhash(inputs[i]));
+    }
+    BOOST_CHECK(scrypt_batch_lanes() >= 1);
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // every batch size from nothing through a full 8 way, a full 4 way and a single block leftover, twice over
+    for (size_t blocks = 0; blocks <= 32; blocks++)
+    {
+        std::vector<unsigned char> in(64 * blocks);
+        for (size_t i = 0; i < in.size(); i++)
+            in[i] = insecure_rand() & 0xff;
+        std::vector<unsigned char> out(32 * blocks);
+        SHA256D64(out.data(), in.data(), blocks);
+        for (size_t i = 0; i < blocks; i++)
+        {
+            unsigned char expected[32];
+            CHash256().Write(&in[64 * i], 64).Finalize(expected);
+            BOOST_CHECK(memcmp(&out[32 * i], expected, 32) == 0);
+        }
+        // merkle levels hash in place
+        SHA256D64(in.data(), in.data(), blocks);
+        BOOST_CHECK(memcmp(in.data(), out.data(), out.size()) == 0);
+    }
+    BOOST_CHECK(!SHA256Implementation().empty());
+}
+
+static Num3072 RandomNum3072()
+{
+    unsigned char data[Num3072::BYTE_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = insecure_rand() & 0xff;
+    return Num3072(data);
+}
+
+static bool IsOne(Num3072 n)
+{
+    unsigned char data[Num3072::BYTE_SIZE];
+    n.ToBytes(data);
+    if (data[0] != 1)
+        return false;
+    for (size_t i = 1; i < sizeof(data); i++)
+    {
+        if (data[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(num3072_arithmetic)
+{
+    // p - 1 is -1, its square is one
+    unsigned char data[Num3072::BYTE_SIZE];
+    memset(data, 0xff, sizeof(data));
+    data[0] = 0x9a;
+    data[1] = 0x28;
+    data[2] = 0xef;
+    Num3072 minusone(data);
+    minusone.Multiply(minusone);
+    BOOST_CHECK(IsOne(minusone));
+
+    for (int i = 0; i < 4; i++)
+    {
+        Num3072 a = RandomNum3072();
+        Num3072 b = RandomNum3072();
+        Num3072 ab = a;
+        ab.Multiply(b);
+        Num3072 ba = b;
+        ba.Multiply(a);
+        unsigned char x[Num3072::BYTE_SIZE], y[Num3072::BYTE_SIZE];
+        ab.ToBytes(x);
+        ba.ToBytes(y);
+        BOOST_CHECK(memcmp(x, y, sizeof(x)) == 0);
+
+        // dividing by a number undoes multiplying with it
+        ab.Divide(b);
+        ab.ToBytes(x);
+        a.Multiply(Num3072());
+        a.ToBytes(y);
+        BOOST_CHECK(memcmp(x, y, sizeof(x)) == 0);
+        b.Divide(b);
+        BOOST_CHECK(IsOne(b));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set_operations)
+{
+    std::vector<std::vector<unsigned char> > elements;
+    for (int i = 0; i < 8; i++)
+        elements.push_back(std::vector<unsigned char>(i + 1, (unsigned char)i));
+
+    // the order elements come in does not matter
+    MuHash3072 forward, backward;
+    for (size_t i = 0; i < elements.size(); i++)
+    {
+        forward.Insert(elements[i]);
+        backward.Insert(elements[elements.size() - 1 - i]);
+    }
+    BOOST_CHECK(forward.Finalize() == backward.Finalize());
+    BOOST_CHECK(forward.Finalize() != MuHash3072().Finalize());
+
+    // removing what was inserted leaves the hash of the smaller set
+    MuHash3072 removed = forward;
+    removed.Remove(elements[3]).Remove(elements[5]);
+    MuHash3072 subset;
+    for (size_t i = 0; i < elements.size(); i++)
+    {
+        if (i != 3 && i != 5)
+            subset.Insert(elements[i]);
+    }
+    BOOST_CHECK(removed.Finalize() == subset.Finalize());
+    removed.Insert(elements[5]).Insert(elements[3]);
+    BOOST_CHECK(removed.Finalize() == forward.Finalize());
+
+    // sets combine and split
+    MuHash3072 pair;
+    pair.Insert(elements[3]).Insert(elements[5]);
+    MuHash3072 combined = subset;
+    combined *= pair;
+    BOOST_CHECK(combined.Finalize() == forward.Finalize());
+    combined /= pair;
+    BOOST_CHECK(combined.Finalize() == subset.Finalize());
+
+    // an element removed before it is inserted still cancels out
+    MuHash3072 early;
+    early.Remove(elements[0]).Insert(elements[1]).Insert(elements[0]);
+    MuHash3072 one;
+    one.Insert(elements[1]);
+    BOOST_CHECK(early.Finalize() == one.Finalize());
+
+    // the state serializes with what is yet to be divided out
+    CDataStream ss(SER_DISK, 0);
+    ss << removed;
+    MuHash3072 read;
+    ss >> read;
+    BOOST_CHECK(read.Finalize() == forward.Finalize());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,158 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "clientversion.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+static std::vector<uint256> RandomEntries(size_t n)
+{
+    std::vector<uint256> entries(n);
+    for (uint256 &entry : entries)
+        entry = GetRandHash();
+    return entries;
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_size)
+{
+    // Memory is bounded by what was asked for, in whole entries
+    CCuckooCache cache(1000);
+    BOOST_CHECK_EQUAL(cache.Capacity(), 31U);
+    BOOST_CHECK_EQUAL(cache.MemoryUsage(), 992U);
+
+    // A cache smaller than one entry holds nothing
+    CCuckooCache empty(31);
+    uint256 entry = GetRandHash();
+    empty.Insert(entry);
+    BOOST_CHECK_EQUAL(empty.Capacity(), 0U);
+    BOOST_CHECK(!empty.Contains(entry));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_insert_erase)
+{
+    CCuckooCache cache(1 << 16);
+    std::vector<uint256> entries = RandomEntries(cache.Capacity() / 2);
+    for (const uint256 &entry : entries)
+        cache.Insert(entry);
+    for (const uint256 &entry : entries)
+        BOOST_CHECK(cache.Contains(entry));
+    for (const uint256 &entry : RandomEntries(100))
+        BOOST_CHECK(!cache.Contains(entry));
+
+    // Entries differing only in the byte that holds the generation are the same entry
+    uint256 other = entries[0];
+    *other.begin() ^= 0x01;
+    *(other.begin() + 24) ^= 0x01;
+    BOOST_CHECK(!cache.Contains(other));
+
+    // Erasing from a lookup and explicitly
+    BOOST_CHECK(cache.Contains(entries[0], true));
+    BOOST_CHECK(!cache.Contains(entries[0]));
+    cache.Erase(entries[1]);
+    BOOST_CHECK(!cache.Contains(entries[1]));
+    BOOST_CHECK(cache.Contains(entries[2]));
+
+    // and adding back again
+    cache.Insert(entries[0]);
+    BOOST_CHECK(cache.Contains(entries[0]));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_eviction)
+{
+    // Overfill the cache many times, the most recent entries should survive
+    CCuckooCache cache(1 << 16);
+    std::vector<uint256> entries = RandomEntries(cache.Capacity() * 8);
+    for (const uint256 &entry : entries)
+        cache.Insert(entry);
+    size_t nRecent = cache.Capacity() / 2;
+    size_t nHits = 0;
+    for (size_t i = entries.size() - nRecent; i < entries.size(); i++)
+        nHits += cache.Contains(entries[i]);
+    BOOST_CHECK(nHits > nRecent * 95 / 100);
+    BOOST_CHECK_EQUAL(cache.MemoryUsage(), cache.Capacity() * 32);
+}
+
+/** An entry as GetEntries() returns it, without the byte that holds the generation */
+static uint256 Stored(uint256 entry)
+{
+    *(entry.begin() + 24) = 0;
+    return entry;
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_persist)
+{
+    // Two generations worth of entries, dumped oldest first
+    CCuckooCache cache(1 << 16);
+    std::vector<uint256> entries = RandomEntries(cache.Capacity() * 3 / 4);
+    for (const uint256 &entry : entries)
+        cache.Insert(entry);
+    std::vector<uint256> dumped = cache.GetEntries();
+    BOOST_CHECK(dumped.size() > entries.size() * 95 / 100);
+    BOOST_CHECK(std::find(dumped.begin(), dumped.end(), Stored(entries.back())) >
+                std::find(dumped.begin(), dumped.end(), Stored(entries.front())));
+
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    const uint256 nonce = GetRandHash();
+    DumpSaltedCache(file, nonce, cache);
+    rewind(file.Get());
+
+    // a smaller cache takes the newest entries and the nonce they were made with
+    CCuckooCache smaller(1 << 15);
+    uint256 loadedNonce;
+    BOOST_CHECK_EQUAL(LoadSaltedCache(file, loadedNonce, smaller), smaller.Capacity());
+    BOOST_CHECK(loadedNonce == nonce);
+    size_t nRecent = smaller.Capacity() / 2;
+    size_t nHits = 0;
+    for (size_t i = entries.size() - nRecent; i < entries.size(); i++)
+        nHits += smaller.Contains(entries[i]);
+    BOOST_CHECK(nHits > nRecent * 95 / 100);
+
+    // erased entries are not dumped
+    cache.Erase(entries.back());
+    dumped = cache.GetEntries();
+    BOOST_CHECK(std::find(dumped.begin(), dumped.end(), Stored(entries.back())) == dumped.end());
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent)
+{
+    // Readers never find what was never inserted, and always find what nobody evicts, while a writer keeps
+    // inserting and displacing entries.
+    CCuckooCache cache(1 << 20);
+    std::vector<uint256> kept = RandomEntries(64);
+    for (const uint256 &entry : kept)
+        cache.Insert(entry);
+    std::vector<uint256> absent = RandomEntries(1000);
+    std::atomic<int> nFalseHits(0);
+    boost::thread_group readers;
+    for (int t = 0; t < 3; t++)
+    {
+        readers.create_thread([&] {
+            for (int round = 0; round < 20; round++)
+                for (const uint256 &entry : absent)
+                    if (cache.Contains(entry))
+                        nFalseHits++;
+        });
+    }
+    for (const uint256 &entry : RandomEntries(cache.Capacity() / 4))
+        cache.Insert(entry);
+    readers.join_all();
+    BOOST_CHECK_EQUAL(nFalseHits, 0);
+    for (const uint256 &entry : kept)
+        BOOST_CHECK(cache.Contains(entry));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
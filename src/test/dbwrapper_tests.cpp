@@ -131,6 +131,58 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_stats)
+{
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBOptions options;
+    options.nBlockSize = 1024;
+    options.nWriteBufferSize = 1 << 16;
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, options);
+
+    CDBStats before = dbw.GetStats();
+    BOOST_CHECK_EQUAL(before.options.nBlockSize, 1024U);
+    BOOST_CHECK_EQUAL(before.options.nWriteBufferSize, 1U << 16);
+    BOOST_CHECK_EQUAL(before.nBlockCacheSize, 1U << 19);
+    BOOST_CHECK(!before.vLevels.empty());
+
+    CDBBatch batch(dbw);
+    for (uint32_t i = 0; i < 1000; i++)
+        batch.Write(std::make_pair('k', i), GetRandHash());
+    size_t nBatchBytes = batch.SizeEstimate();
+    BOOST_CHECK(dbw.WriteBatch(batch));
+    dbw.Compact();
+
+    // read everything twice
+    uint256 res;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (uint32_t i = 0; i < 1000; i++)
+            BOOST_CHECK(dbw.Read(std::make_pair('k', i), res));
+    }
+    BOOST_CHECK(!dbw.Exists(std::make_pair('k', (uint32_t)1000)));
+
+    CDBStats stats = dbw.GetStats();
+    BOOST_CHECK_EQUAL(stats.nReads - before.nReads, 2001U);
+    BOOST_CHECK_EQUAL(stats.nReadMisses - before.nReadMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nReadBytes - before.nReadBytes, 2000U * 32);
+    BOOST_CHECK_EQUAL(stats.nBatches - before.nBatches, 1U);
+    BOOST_CHECK_EQUAL(stats.nBatchBytes - before.nBatchBytes, nBatchBytes);
+    // every read looked up a data block, LevelDB only keeps those of tables it does not map into memory
+    BOOST_CHECK(stats.nCacheHits + stats.nCacheMisses >= 2000);
+    BOOST_CHECK(stats.nMemoryUsage >= stats.nCacheUsage);
+
+    // compacted to files, which hold at least the values
+    int nFiles = 0;
+    uint64_t nBytes = 0;
+    for (const CDBLevelStats &level : stats.vLevels)
+    {
+        nFiles += level.nFiles;
+        nBytes += level.nBytes;
+    }
+    BOOST_CHECK(nFiles > 0);
+    BOOST_CHECK(nBytes > 1000U * 32);
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -0,0 +1,281 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flatblockindex.h"
+
+#include "chain/blockindex.h"
+#include "clientversion.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "util/util.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatblockindex_tests, TestingSetup)
+
+static CDiskBlockIndex MakeEntry(uint32_t n)
+{
+    CDiskBlockIndex entry;
+    entry.hashBlock = GetRandHash();
+    entry.hashPrev = GetRandHash();
+    entry.nHeight = n;
+    entry.nTime = n;
+    entry.nStatus = BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO;
+    entry.nFile = n / 1000;
+    entry.nDataPos = n * 1000;
+    entry.nUndoPos = n * 100;
+    entry.nHashChecksum = entry.ComputeHashChecksum();
+    return entry;
+}
+
+/** Load everything in idx, keyed by hash */
+static std::map<uint256, CDiskBlockIndex> LoadAll(CFlatBlockIndex &idx)
+{
+    std::map<uint256, CDiskBlockIndex> mapLoaded;
+    idx.StartLoad();
+    bool fEnd = false;
+    while (!fEnd)
+    {
+        std::vector<uint256> vKeys;
+        std::vector<CPublicDataStream> vValues;
+        BOOST_REQUIRE(idx.Load(100, vKeys, vValues, fEnd));
+        BOOST_REQUIRE_EQUAL(vKeys.size(), vValues.size());
+        for (size_t i = 0; i < vKeys.size(); i++)
+        {
+            CDiskBlockIndex entry;
+            vValues[i] >> entry;
+            BOOST_CHECK(entry.hashBlock == vKeys[i]);
+            mapLoaded[vKeys[i]] = entry;
+        }
+    }
+    return mapLoaded;
+}
+
+BOOST_AUTO_TEST_CASE(flatblockindex_write_load)
+{
+    const fs::path path = pathTemp / "index.flat";
+    std::vector<CDiskBlockIndex> entries;
+    for (uint32_t n = 0; n < 250; n++)
+        entries.push_back(MakeEntry(n));
+
+    // the largest entry there can be fits a record
+    CDiskBlockIndex largest = MakeEntry(0xffffffff);
+    largest.nHeight = 0x7fffffff;
+    largest.nStatus = 0xffffffff;
+    largest.nTx = 0xffffffff;
+    largest.nFile = 0x7fffffff;
+    largest.nFlags = CBlockIndex::BLOCK_PROOF_OF_STAKE;
+    largest.prevoutStake = COutPoint(GetRandHash(), 0xffffffff);
+    largest.hashProofOfStake = GetRandHash();
+    entries.push_back(largest);
+    {
+        CFlatBlockIndex idx(path, true);
+        BOOST_REQUIRE(idx.IsOpen());
+        BOOST_CHECK(idx.Write(entries));
+        BOOST_CHECK_EQUAL(idx.GetCount(), entries.size());
+    }
+    BOOST_CHECK_EQUAL(fs::file_size(path), (entries.size() + 1) * FLAT_BLOCK_INDEX_RECORD_SIZE);
+
+    CFlatBlockIndex idx(path, false);
+    BOOST_REQUIRE(idx.IsOpen());
+    std::map<uint256, CDiskBlockIndex> mapLoaded = LoadAll(idx);
+    BOOST_CHECK_EQUAL(mapLoaded.size(), entries.size());
+    for (const CDiskBlockIndex &entry : entries)
+    {
+        BOOST_REQUIRE(mapLoaded.count(entry.hashBlock));
+        const CDiskBlockIndex &loaded = mapLoaded[entry.hashBlock];
+        BOOST_CHECK(loaded.hashPrev == entry.hashPrev);
+        BOOST_CHECK_EQUAL(loaded.nHeight, entry.nHeight);
+        BOOST_CHECK_EQUAL(loaded.nDataPos, entry.nDataPos);
+        BOOST_CHECK(loaded.CheckHashChecksum());
+    }
+    BOOST_CHECK(mapLoaded[largest.hashBlock].prevoutStake == largest.prevoutStake);
+
+    // a changed entry moves to a new record and leaves the old one free, as does an erased one
+    entries[0].nUndoPos = 12345;
+    BOOST_CHECK(idx.Write({entries[0]}));
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), 1U);
+    BOOST_CHECK(idx.Erase(entries[1].hashBlock));
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), 2U);
+    const CDiskBlockIndex added = MakeEntry(1000);
+    BOOST_CHECK(idx.Write({added}));
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), 1U);
+    BOOST_CHECK_EQUAL(fs::file_size(path), (entries.size() + 2) * FLAT_BLOCK_INDEX_RECORD_SIZE);
+
+    mapLoaded = LoadAll(idx);
+    BOOST_CHECK_EQUAL(mapLoaded.size(), entries.size());
+    BOOST_CHECK_EQUAL(mapLoaded[entries[0].hashBlock].nUndoPos, 12345U);
+    BOOST_CHECK(!mapLoaded.count(entries[1].hashBlock));
+    BOOST_CHECK(mapLoaded.count(added.hashBlock));
+}
+
+BOOST_AUTO_TEST_CASE(flatblockindex_torn_and_corrupt)
+{
+    const fs::path path = pathTemp / "index.flat";
+    std::vector<CDiskBlockIndex> entries;
+    for (uint32_t n = 0; n < 10; n++)
+        entries.push_back(MakeEntry(n));
+    {
+        CFlatBlockIndex idx(path, true);
+        BOOST_REQUIRE(idx.Write(entries));
+    }
+
+    // a record cut short at the end is dropped and its space used by the next one
+    FILE *file = fsbridge::fopen(path, "ab");
+    const std::vector<char> partial(100, 1);
+    fwrite(partial.data(), 1, partial.size(), file);
+    fclose(file);
+    {
+        CFlatBlockIndex idx(path, false);
+        BOOST_CHECK_EQUAL(LoadAll(idx).size(), entries.size());
+        BOOST_CHECK(idx.Write({MakeEntry(10)}));
+        BOOST_CHECK_EQUAL(LoadAll(idx).size(), entries.size() + 1);
+    }
+    BOOST_CHECK_EQUAL(fs::file_size(path), (entries.size() + 2) * FLAT_BLOCK_INDEX_RECORD_SIZE);
+
+    // a changed byte inside a record fails its checksum, the record is left out and its slot reused
+    file = fsbridge::fopen(path, "r+b");
+    fseek(file, 3 * FLAT_BLOCK_INDEX_RECORD_SIZE + FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE + 2, SEEK_SET);
+    fputc(0x55, file);
+    fclose(file);
+    CFlatBlockIndex idx(path, false);
+    std::map<uint256, CDiskBlockIndex> mapLoaded = LoadAll(idx);
+    BOOST_CHECK_EQUAL(mapLoaded.size(), entries.size());
+    BOOST_CHECK(!mapLoaded.count(entries[2].hashBlock));
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), 1U);
+    BOOST_CHECK(idx.Write({entries[2]}));
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), 0U);
+    BOOST_CHECK_EQUAL(LoadAll(idx).size(), entries.size() + 1);
+}
+
+/** The bytes of record nSlot of the file at path */
+static std::vector<char> ReadRecord(const fs::path &path, uint32_t nSlot)
+{
+    std::vector<char> rec(FLAT_BLOCK_INDEX_RECORD_SIZE);
+    FILE *file = fsbridge::fopen(path, "rb");
+    fseek(file, (nSlot + 1) * FLAT_BLOCK_INDEX_RECORD_SIZE, SEEK_SET);
+    BOOST_CHECK_EQUAL(fread(rec.data(), 1, rec.size(), file), rec.size());
+    fclose(file);
+    return rec;
+}
+
+static void WriteRecord(const fs::path &path, uint32_t nSlot, const std::vector<char> &rec)
+{
+    FILE *file = fsbridge::fopen(path, "r+b");
+    fseek(file, (nSlot + 1) * FLAT_BLOCK_INDEX_RECORD_SIZE, SEEK_SET);
+    BOOST_CHECK_EQUAL(fwrite(rec.data(), 1, rec.size(), file), rec.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(flatblockindex_crash_while_replacing)
+{
+    const fs::path path = pathTemp / "index.flat";
+    std::vector<CDiskBlockIndex> entries;
+    for (uint32_t n = 0; n < 10; n++)
+        entries.push_back(MakeEntry(n));
+    {
+        CFlatBlockIndex idx(path, true);
+        BOOST_REQUIRE(idx.Write(entries));
+    }
+    const std::vector<char> recOld = ReadRecord(path, 0);
+    const uint32_t nUndoPosOld = entries[0].nUndoPos;
+
+    // a changed entry goes to a new record and its old one is freed after that one is synced
+    entries[0].nUndoPos = 999;
+    {
+        CFlatBlockIndex idx(path, false);
+        BOOST_CHECK_EQUAL(LoadAll(idx).size(), entries.size());
+        BOOST_CHECK(idx.Write({entries[0]}));
+        BOOST_CHECK_EQUAL(idx.GetFreeCount(), 1U);
+    }
+    BOOST_CHECK_EQUAL(fs::file_size(path), (entries.size() + 2) * FLAT_BLOCK_INDEX_RECORD_SIZE);
+    BOOST_CHECK(ReadRecord(path, 0) != recOld);
+
+    // torn while the new record was written, the old one was still there
+    std::vector<char> recNew = ReadRecord(path, entries.size());
+    std::vector<char> recTorn = recNew;
+    std::fill(recTorn.begin() + FLAT_BLOCK_INDEX_RECORD_HEADER_SIZE, recTorn.end(), 0);
+    WriteRecord(path, 0, recOld);
+    WriteRecord(path, entries.size(), recTorn);
+    {
+        CFlatBlockIndex idx(path, false);
+        std::map<uint256, CDiskBlockIndex> mapLoaded = LoadAll(idx);
+        BOOST_CHECK_EQUAL(mapLoaded.size(), entries.size());
+        BOOST_CHECK_EQUAL(mapLoaded[entries[0].hashBlock].nUndoPos, nUndoPosOld);
+        BOOST_CHECK_EQUAL(idx.GetFreeCount(), 1U);
+    }
+
+    // cut short before the old record was freed, both are there and the newer one wins
+    WriteRecord(path, entries.size(), recNew);
+    {
+        CFlatBlockIndex idx(path, false);
+        std::map<uint256, CDiskBlockIndex> mapLoaded = LoadAll(idx);
+        BOOST_CHECK_EQUAL(mapLoaded.size(), entries.size());
+        BOOST_CHECK_EQUAL(mapLoaded[entries[0].hashBlock].nUndoPos, 999U);
+        BOOST_CHECK_EQUAL(idx.GetFreeCount(), 1U);
+
+        // the older one does not come back once the entry is erased
+        BOOST_CHECK(idx.Erase(entries[0].hashBlock));
+        BOOST_CHECK_EQUAL(idx.GetFreeCount(), 2U);
+    }
+    CFlatBlockIndex idx(path, false);
+    std::map<uint256, CDiskBlockIndex> mapLoaded = LoadAll(idx);
+    BOOST_CHECK_EQUAL(mapLoaded.size(), entries.size() - 1);
+    BOOST_CHECK(!mapLoaded.count(entries[0].hashBlock));
+
+    // and new entries after a reload are newer than everything before it
+    entries[1].nUndoPos = 777;
+    BOOST_CHECK(idx.Write({entries[1]}));
+    mapLoaded = LoadAll(idx);
+    BOOST_CHECK_EQUAL(mapLoaded[entries[1].hashBlock].nUndoPos, 777U);
+}
+
+BOOST_AUTO_TEST_CASE(flatblockindex_compact)
+{
+    const fs::path path = pathTemp / "index.flat";
+    std::vector<CDiskBlockIndex> entries;
+    for (uint32_t n = 0; n < 4000; n++)
+        entries.push_back(MakeEntry(n));
+    std::set<uint256> setKept;
+    {
+        CFlatBlockIndex idx(path, true);
+        BOOST_REQUIRE(idx.Write(entries));
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (i % 3 == 0)
+                setKept.insert(entries[i].hashBlock);
+            else
+                BOOST_CHECK(idx.Erase(entries[i].hashBlock));
+        }
+    }
+
+    CFlatBlockIndex idx(path, false);
+    std::map<uint256, CDiskBlockIndex> mapLoaded = LoadAll(idx);
+    BOOST_CHECK_EQUAL(mapLoaded.size(), setKept.size());
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), entries.size() - setKept.size());
+    BOOST_CHECK(idx.CompactIfSparse());
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), 0U);
+    BOOST_CHECK_EQUAL(fs::file_size(path), (setKept.size() + 1) * FLAT_BLOCK_INDEX_RECORD_SIZE);
+
+    // still usable after the rewrite, and it loads the same
+    const CDiskBlockIndex added = MakeEntry(5000);
+    BOOST_CHECK(idx.Write({added}));
+    setKept.insert(added.hashBlock);
+    mapLoaded = LoadAll(idx);
+    BOOST_CHECK_EQUAL(mapLoaded.size(), setKept.size());
+    for (const uint256 &hash : setKept)
+        BOOST_CHECK(mapLoaded.count(hash));
+
+    // nothing to gain from a rewrite of a file with few free records
+    BOOST_CHECK(idx.Erase(added.hashBlock));
+    LoadAll(idx);
+    BOOST_CHECK(idx.CompactIfSparse());
+    BOOST_CHECK_EQUAL(idx.GetFreeCount(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
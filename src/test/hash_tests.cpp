@@ -149,4 +149,73 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+/** SipHash-c-d of len bytes, byte by byte the way the paper describes it */
+static uint64_t SipHashReference(int c, int d, uint64_t k0, uint64_t k1, const uint8_t *data, size_t len)
+{
+    uint64_t v[4] = {0x736f6d6570736575ULL ^ k0, 0x646f72616e646f6dULL ^ k1, 0x6c7967656e657261ULL ^ k0,
+        0x7465646279746573ULL ^ k1};
+    auto rotl = [](uint64_t x, int b) { return (x << b) | (x >> (64 - b)); };
+    auto round = [&]() {
+        v[0] += v[1];
+        v[1] = rotl(v[1], 13);
+        v[1] ^= v[0];
+        v[0] = rotl(v[0], 32);
+        v[2] += v[3];
+        v[3] = rotl(v[3], 16);
+        v[3] ^= v[2];
+        v[0] += v[3];
+        v[3] = rotl(v[3], 21);
+        v[3] ^= v[0];
+        v[2] += v[1];
+        v[1] = rotl(v[1], 17);
+        v[1] ^= v[2];
+        v[2] = rotl(v[2], 32);
+    };
+    auto compress = [&](uint64_t m) {
+        v[3] ^= m;
+        for (int i = 0; i < c; i++)
+            round();
+        v[0] ^= m;
+    };
+    uint64_t m = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        m |= uint64_t(data[i]) << (8 * (i % 8));
+        if (i % 8 == 7)
+        {
+            compress(m);
+            m = 0;
+        }
+    }
+    compress(m | (uint64_t(len) << 56));
+    v[2] ^= 0xFF;
+    for (int i = 0; i < d; i++)
+        round();
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+BOOST_AUTO_TEST_CASE(siphash13)
+{
+    FastRandomContext ctx;
+    for (int i = 0; i < 16; ++i)
+    {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        uint256 x = GetRandHash();
+        uint32_t n = ctx.rand32();
+        std::vector<uint8_t> data(x.begin(), x.end());
+        data.resize(36);
+        WriteLE32(&data[32], n);
+
+        // the reference is the SipHash-2-4 of CSipHasher with c = 2 and d = 4
+        CSipHasher sip288(k1, k2);
+        sip288.Write(data.data(), data.size());
+        BOOST_CHECK_EQUAL(SipHashReference(2, 4, k1, k2, data.data(), data.size()), sip288.Finalize());
+
+        BOOST_CHECK_EQUAL(SipHashReference(1, 3, k1, k2, data.data(), 32), SipHash13Uint256(k1, k2, x));
+        BOOST_CHECK_EQUAL(SipHashReference(1, 3, k1, k2, data.data(), 36), SipHash13Uint256Extra(k1, k2, x, n));
+        BOOST_CHECK(SipHash13Uint256(k1, k2, x) != SipHashUint256(k1, k2, x));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
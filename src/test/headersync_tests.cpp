@@ -0,0 +1,142 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/headersync.h"
+#include "main.h"
+#include "util/utiltime.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(headersync_tests, BasicTestingSetup)
+
+/** A chain of headers that only connect to each other, header n at height n */
+static std::vector<CBlockHeader> MakeChain(int nCount, uint32_t nNonceBase = 0)
+{
+    std::vector<CBlockHeader> headers(nCount);
+    for (int n = 0; n < nCount; n++)
+    {
+        headers[n].nVersion = 1;
+        headers[n].hashPrevBlock = n ? headers[n - 1].GetHash() : uint256();
+        headers[n].nTime = GetTime() - 2 * nCount + n;
+        headers[n].nBits = 0x1e0fffff;
+        headers[n].nNonce = nNonceBase + n;
+    }
+    return headers;
+}
+
+static std::vector<CBlockHeader> Range(const std::vector<CBlockHeader> &headers, int nFirst, int nEnd)
+{
+    return std::vector<CBlockHeader>(headers.begin() + nFirst, headers.begin() + nEnd);
+}
+
+BOOST_AUTO_TEST_CASE(headersync_segments)
+{
+    const std::vector<CBlockHeader> chain = MakeChain(5001);
+    MapCheckpoints checkpoints;
+    for (int nHeight : {0, 10, 3000, 5000})
+        checkpoints[nHeight] = chain[nHeight].GetHash();
+
+    // the checkpoint at 10 is too close to the one before it to start a segment of its own
+    CHeaderSegmentSync sync;
+    sync.Init(checkpoints, 0, 0);
+    BOOST_CHECK(sync.IsActive());
+    BOOST_CHECK_EQUAL(sync.GetSegmentCount(), 2U);
+
+    uint256 hashFrom;
+    uint256 hashStop;
+    BOOST_CHECK(!sync.GetRequest(1, 2999, 0, hashFrom, hashStop));
+    BOOST_CHECK(sync.GetRequest(1, 5000, 0, hashFrom, hashStop));
+    BOOST_CHECK(hashFrom == chain[0].GetHash());
+    BOOST_CHECK(hashStop == chain[3000].GetHash());
+    BOOST_CHECK(!sync.GetRequest(1, 5000, 0, hashFrom, hashStop));
+    BOOST_CHECK(sync.GetRequest(2, 5000, 0, hashFrom, hashStop));
+    BOOST_CHECK(hashFrom == chain[3000].GetHash());
+    BOOST_CHECK(hashStop == chain[5000].GetHash());
+    BOOST_CHECK(!sync.GetRequest(3, 5000, 0, hashFrom, hashStop));
+
+    // the upper segment completes first and waits for the one below it
+    int nDoS = 0;
+    BOOST_CHECK(sync.ReceivedHeaders(2, Range(chain, 3001, 5001), 1, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 0);
+    std::vector<CBlockHeader> vHeaders;
+    std::set<NodeId> setSuppliers;
+    sync.TakeConnectable(vHeaders, setSuppliers);
+    BOOST_CHECK(vHeaders.empty());
+    BOOST_CHECK_EQUAL(sync.GetBufferedCount(), 2000U);
+
+    // headers that do not continue the segment of the peer are not taken
+    BOOST_CHECK(!sync.ReceivedHeaders(1, Range(chain, 5, 10), 1, nDoS));
+    BOOST_CHECK(sync.ReceivedHeaders(1, Range(chain, 1, 1 + MAX_HEADERS_RESULTS), 1, nDoS));
+    BOOST_CHECK(sync.GetRequest(1, 5000, 1, hashFrom, hashStop));
+    BOOST_CHECK(hashFrom == chain[MAX_HEADERS_RESULTS].GetHash());
+    BOOST_CHECK(sync.ReceivedHeaders(1, Range(chain, 1 + MAX_HEADERS_RESULTS, 3001), 1, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 0);
+
+    sync.TakeConnectable(vHeaders, setSuppliers);
+    BOOST_REQUIRE_EQUAL(vHeaders.size(), 5000U);
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        BOOST_CHECK(vHeaders[i].GetHash() == chain[i + 1].GetHash());
+    BOOST_CHECK_EQUAL(setSuppliers.size(), 2U);
+    BOOST_CHECK(!sync.IsActive());
+}
+
+BOOST_AUTO_TEST_CASE(headersync_bad_and_slow_peers)
+{
+    const std::vector<CBlockHeader> chain = MakeChain(2501);
+    const std::vector<CBlockHeader> fork = MakeChain(2501, 100000);
+    MapCheckpoints checkpoints;
+    checkpoints[0] = chain[0].GetHash();
+    checkpoints[2500] = chain[2500].GetHash();
+    CHeaderSegmentSync sync;
+    sync.Init(checkpoints, 0, 0);
+
+    // a chain that connects to the start but ends somewhere else than the checkpoint is dropped as a whole
+    std::vector<CBlockHeader> vFork = Range(fork, 1, 2501);
+    vFork.front().hashPrevBlock = chain[0].GetHash();
+    for (size_t i = 1; i < vFork.size(); i++)
+        vFork[i].hashPrevBlock = vFork[i - 1].GetHash();
+    uint256 hashFrom;
+    uint256 hashStop;
+    int nDoS = 0;
+    BOOST_CHECK(sync.GetRequest(1, 2500, 0, hashFrom, hashStop));
+    BOOST_CHECK(sync.ReceivedHeaders(1, Range(vFork, 0, MAX_HEADERS_RESULTS), 0, nDoS));
+    BOOST_CHECK(sync.GetRequest(1, 2500, 0, hashFrom, hashStop));
+    BOOST_CHECK(sync.ReceivedHeaders(1, Range(vFork, MAX_HEADERS_RESULTS, 2500), 0, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 20);
+    BOOST_CHECK_EQUAL(sync.GetBufferedCount(), 0U);
+    // and its peer is not asked for the segment again
+    BOOST_CHECK(!sync.GetRequest(1, 2500, 0, hashFrom, hashStop));
+
+    // headers that do not connect to each other
+    BOOST_CHECK(sync.GetRequest(2, 2500, 0, hashFrom, hashStop));
+    BOOST_CHECK(hashFrom == chain[0].GetHash());
+    std::vector<CBlockHeader> vGap = Range(chain, 1, 10);
+    vGap.erase(vGap.begin() + 5);
+    BOOST_CHECK(sync.ReceivedHeaders(2, vGap, 0, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 20);
+
+    // a peer that sends part of the segment and then runs out leaves the rest to the next one
+    BOOST_CHECK(sync.GetRequest(3, 2500, 0, hashFrom, hashStop));
+    BOOST_CHECK(sync.ReceivedHeaders(3, Range(chain, 1, 101), 0, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 0);
+    BOOST_CHECK(!sync.GetRequest(3, 2500, 0, hashFrom, hashStop));
+
+    // one that does not answer in time neither
+    BOOST_CHECK(sync.GetRequest(4, 2500, 0, hashFrom, hashStop));
+    BOOST_CHECK(hashFrom == chain[100].GetHash());
+    BOOST_CHECK(!sync.GetRequest(5, 2500, HEADER_SEGMENT_TIMEOUT, hashFrom, hashStop));
+    BOOST_CHECK(sync.GetRequest(5, 2500, HEADER_SEGMENT_TIMEOUT + 1, hashFrom, hashStop));
+    BOOST_CHECK(hashFrom == chain[100].GetHash());
+    sync.DisconnectedPeer(5);
+    BOOST_CHECK(sync.GetRequest(6, 2500, HEADER_SEGMENT_TIMEOUT + 1, hashFrom, hashStop));
+
+    // without progress for long enough the segments are given up
+    BOOST_CHECK(sync.IsActive());
+    BOOST_CHECK(!sync.GetRequest(7, 2500, HEADER_SEGMENT_STALL_TIMEOUT + 1, hashFrom, hashStop));
+    BOOST_CHECK(!sync.IsActive());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,47 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "util/timehistogram.h"
+
+#include "test/test_bitcoin.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(histogram_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(histogram_buckets)
+{
+    BOOST_CHECK_EQUAL(CTimeHistogram::Bucket(0), 0);
+    BOOST_CHECK_EQUAL(CTimeHistogram::Bucket(1), 1);
+    BOOST_CHECK_EQUAL(CTimeHistogram::Bucket(3), 2);
+    BOOST_CHECK_EQUAL(CTimeHistogram::Bucket(4), 3);
+    BOOST_CHECK_EQUAL(CTimeHistogram::Bucket(std::numeric_limits<int64_t>::max()), CTimeHistogram::BUCKETS - 1);
+}
+
+BOOST_AUTO_TEST_CASE(histogram_add)
+{
+    CTimeHistogram a;
+    a.Add(3);
+    a.Add(-5);
+    a.Add(1000);
+    BOOST_CHECK_EQUAL(a.nCount, 3U);
+    BOOST_CHECK_EQUAL(a.nTotalMicros, 1003);
+    BOOST_CHECK_EQUAL(a.nMaxMicros, 1000);
+    BOOST_CHECK_EQUAL(a.vBuckets[0], 1U);
+    BOOST_CHECK_EQUAL(a.vBuckets[2], 1U);
+    BOOST_CHECK_EQUAL(a.vBuckets[10], 1U);
+
+    CTimeHistogram b;
+    b.Add(2000);
+    b.Add(a);
+    BOOST_CHECK_EQUAL(b.nCount, 4U);
+    BOOST_CHECK_EQUAL(b.nTotalMicros, 3003);
+    BOOST_CHECK_EQUAL(b.nMaxMicros, 2000);
+    BOOST_CHECK_EQUAL(b.vBuckets[10], 1U);
+    BOOST_CHECK_EQUAL(b.vBuckets[11], 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
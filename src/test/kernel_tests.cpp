@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "chain/chainman.h"
+#include "coins.h"
+#include "kernel.h"
+#include "keystore.h"
+#include "networks/netman.h"
+#include "random.h"
+#include "script/sign.h"
+#include "test/test_bitcoin.h"
+
+#include <algorithm>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+// the reduction as CheckStakeKernelHash computed it before GetStakeReduction
+static unsigned int StakeReductionFromHex(const arith_uint256 &reduction)
+{
+    std::string reductionHex = reduction.GetHex();
+    unsigned int n = std::count(reductionHex.begin(), reductionHex.end(), '0');
+    return 64 - n;
+}
+
+BOOST_AUTO_TEST_CASE(stake_reduction_matches_hex)
+{
+    BOOST_CHECK_EQUAL(GetStakeReduction(arith_uint256(0)), 0);
+    BOOST_CHECK_EQUAL(GetStakeReduction(arith_uint256(1)), 1);
+    BOOST_CHECK_EQUAL(GetStakeReduction(arith_uint256(0x1010)), 2);
+    BOOST_CHECK_EQUAL(GetStakeReduction(~arith_uint256(0)), 64);
+    BOOST_CHECK_EQUAL(GetStakeReduction(~arith_uint256(0)), StakeReductionFromHex(~arith_uint256(0)));
+
+    FastRandomContext rng(true);
+    for (int i = 0; i < 100000; i++)
+    {
+        // the values CheckStakeKernelHash sees, seconds of weight times satoshis staked
+        int64_t nTimeWeight = rng.randbits(32) >> rng.randrange(32);
+        int64_t nValueIn = (int64_t)(rng.rand64() >> (rng.randrange(64) + 1));
+        arith_uint256 reduction = arith_uint256(nTimeWeight) * arith_uint256(nValueIn);
+        BOOST_CHECK_EQUAL(GetStakeReduction(reduction), StakeReductionFromHex(reduction));
+
+        // and arbitrary 256 bit values, with some nibbles forced to zero
+        arith_uint256 value = UintToArith256(GetRandHash());
+        value &= UintToArith256(GetRandHash()) | UintToArith256(GetRandHash());
+        BOOST_CHECK_EQUAL(GetStakeReduction(value), StakeReductionFromHex(value));
+    }
+}
+
+/** A coinstake spending coin, at prevout, signed with the keys of keystore */
+static CTransaction MakeCoinStake(const CKeyStore &keystore,
+    const COutPoint &prevout,
+    const Coin &coin,
+    unsigned int nTime)
+{
+    CTransaction tx;
+    tx.nTime = nTime;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(2);
+    tx.vout[0].SetEmpty();
+    tx.vout[1] = coin.out;
+    BOOST_CHECK(SignSignature(keystore, coin.out.scriptPubKey, tx, 0));
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(check_proof_of_stake, TestChain100Setup)
+{
+    LOCK(cs_main);
+    CChainManager *pchainman = pnetMan->getChainActive();
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+
+    // the block being checked, on top of the tip, staking a coin from the first block
+    CBlockIndex index;
+    index.pprev = pchainman->chainActive.Tip();
+    index.nHeight = index.pprev->nHeight + 1;
+    const CBlockIndex *pindexFrom = pchainman->chainActive[1];
+    const Coin coin(CTxOut(50 * COIN, CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG), 1, false,
+        false, pindexFrom->nTime);
+    // one not in the tx index, which is hashed with a transaction offset of zero, below height 1505775 the offset
+    // counts the 80 bytes of the block header too
+    const COutPoint prevout(GetRandHash(), 0);
+    const unsigned int nTime = pindexFrom->nTime + 1000;
+
+    uint256 hashProofOfStake;
+    const CTransaction tx = MakeCoinStake(keystore, prevout, coin, nTime);
+    BOOST_CHECK(CheckProofOfStake(&index, tx, coin, hashProofOfStake));
+    uint256 hashExpected;
+    BOOST_CHECK(CheckStakeKernelHash(index.nHeight, pindexFrom->GetBlockHash(), pindexFrom->GetBlockTime(), 80,
+        coin.nTime, coin.out.nValue, prevout, nTime, GetStakeKernelTarget(index.nHeight), hashExpected));
+    BOOST_CHECK(hashProofOfStake == hashExpected);
+
+    // not a coinstake
+    CTransaction txNotStake = tx;
+    txNotStake.vout[0] = coin.out;
+    BOOST_CHECK(!CheckProofOfStake(&index, txNotStake, coin, hashProofOfStake));
+
+    // a coin that was spent already
+    BOOST_CHECK(!CheckProofOfStake(&index, tx, Coin(), hashProofOfStake));
+
+    // signed by another key
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystoreOther;
+    keystoreOther.AddKey(key);
+    const Coin coinOther(CTxOut(50 * COIN, CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG), 1, false,
+        false, pindexFrom->nTime);
+    BOOST_CHECK(!CheckProofOfStake(&index, MakeCoinStake(keystoreOther, prevout, coinOther, nTime), coin,
+        hashProofOfStake));
+
+    // staked before the coin was old enough, or even before it was there
+    BOOST_CHECK(!CheckProofOfStake(&index, MakeCoinStake(keystore, prevout, coin, coin.nTime), coin, hashProofOfStake));
+    BOOST_CHECK(
+        !CheckProofOfStake(&index, MakeCoinStake(keystore, prevout, coin, coin.nTime - 10), coin, hashProofOfStake));
+
+    // a coin from a block the one checked does not build on
+    Coin coinLater = coin;
+    coinLater.nHeight = index.nHeight;
+    BOOST_CHECK(!CheckProofOfStake(&index, tx, coinLater, hashProofOfStake));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
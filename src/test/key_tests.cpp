@@ -212,4 +212,27 @@ BOOST_AUTO_TEST_CASE(key_test1)
     */
 }
 
+BOOST_AUTO_TEST_CASE(verify_parsed_keys)
+{
+    // more keys than slots for parsed keys, in both encodings, each verified a few times and against the others
+    std::vector<CKey> vKeys(40);
+    for (size_t i = 0; i < vKeys.size(); i++)
+        vKeys[i].MakeNewKey(i % 2 == 0);
+    const std::string strMsg = "Very parsed message";
+    const uint256 hashMsg = Hash(strMsg.begin(), strMsg.end());
+    std::vector<std::vector<unsigned char> > vSigs(vKeys.size());
+    for (size_t i = 0; i < vKeys.size(); i++)
+        BOOST_CHECK(vKeys[i].Sign(hashMsg, vSigs[i]));
+    for (int nPass = 0; nPass < 3; nPass++)
+    {
+        for (size_t i = 0; i < vKeys.size(); i++)
+        {
+            const CPubKey pubkey = vKeys[i].GetPubKey();
+            BOOST_CHECK(pubkey.Verify(hashMsg, vSigs[i]));
+            BOOST_CHECK(!pubkey.Verify(hashMsg, vSigs[(i + 1) % vSigs.size()]));
+            BOOST_CHECK(!pubkey.Verify(Hash(strMsg.begin(), strMsg.end() - 1), vSigs[i]));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,115 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "util/logger.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "util/util.h"
+#include "util/utilstrencodings.h"
+
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(logger_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(logger_async)
+{
+    static const int THREADS = 4;
+    static const int LINES = 2000;
+    const std::string strMarker = strprintf("logger_tests %08x", GetRand(std::numeric_limits<uint32_t>::max()));
+
+    {
+        CLogger logger;
+        logger.fLogTimestamps = false;
+        logger.OpenDebugLog();
+        // small enough for the threads to fill it
+        logger.StartAsync(16);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++)
+        {
+            threads.emplace_back([&logger, &strMarker, t]() {
+                for (int i = 0; i < LINES; i++)
+                    logger.LogPrintStr(strprintf("%s %d %d\n", strMarker, t, i));
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        logger.StopAsync();
+
+        // back to writing on the logging thread
+        logger.LogPrintStr(strprintf("%s done\n", strMarker));
+    }
+
+    std::ifstream file((GetDataDir() / "debug.log").string());
+    BOOST_REQUIRE(file.is_open());
+    std::vector<int> vLast(THREADS, -1);
+    uint64_t nWritten = 0, nDropped = 0;
+    bool fSeen = false, fDone = false;
+    std::string strLine;
+    while (std::getline(file, strLine))
+    {
+        // the ring takes the first lines, so the report of any drop comes after one of them
+        unsigned int nLines;
+        if (fSeen && sscanf(strLine.c_str(), "%u log lines dropped", &nLines) == 1)
+            nDropped += nLines;
+        if (strLine.compare(0, strMarker.size(), strMarker) != 0)
+            continue;
+        fSeen = true;
+        BOOST_CHECK(!fDone);
+        if (strLine == strMarker + " done")
+        {
+            fDone = true;
+            continue;
+        }
+        int t, i;
+        BOOST_REQUIRE(sscanf(strLine.c_str() + strMarker.size(), " %d %d", &t, &i) == 2);
+        BOOST_REQUIRE(t >= 0 && t < THREADS);
+        // the lines of a thread keep their order
+        BOOST_CHECK(i > vLast[t]);
+        vLast[t] = i;
+        nWritten++;
+    }
+    BOOST_CHECK(fDone);
+    BOOST_CHECK_EQUAL(nWritten + nDropped, (uint64_t)THREADS * LINES);
+}
+
+static int nEvaluated = 0;
+static int Evaluate()
+{
+    nEvaluated++;
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE(logger_categories)
+{
+    CLogger logger;
+    BOOST_CHECK(!logger.LogAcceptCategory(Logging::NET));
+    BOOST_CHECK(logger.EnableCategory("net"));
+    BOOST_CHECK(logger.EnableCategory("CoinDB"));
+    BOOST_CHECK(!logger.EnableCategory("nosuchcategory"));
+    BOOST_CHECK(logger.LogAcceptCategory(Logging::NET));
+    BOOST_CHECK(logger.LogAcceptCategory(Logging::COINDB));
+    BOOST_CHECK(!logger.LogAcceptCategory(Logging::KERNEL));
+    logger.DisableCategory(Logging::NET);
+    BOOST_CHECK(!logger.LogAcceptCategory(Logging::NET));
+    BOOST_CHECK(logger.EnableCategory("1"));
+    BOOST_CHECK(logger.LogAcceptCategory(Logging::KERNEL));
+
+    // the arguments of a line that is not logged are not evaluated
+    g_logger->DisableCategory(Logging::ALL);
+    nEvaluated = 0;
+    LogPrint(Logging::KERNEL, "%d\n", Evaluate());
+    BOOST_CHECK_EQUAL(nEvaluated, 0);
+    g_logger->EnableCategory(Logging::KERNEL);
+    LogPrint(Logging::KERNEL, "%d\n", Evaluate());
+    BOOST_CHECK_EQUAL(nEvaluated, 1);
+    g_logger->DisableCategory(Logging::KERNEL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
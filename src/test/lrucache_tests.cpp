@@ -0,0 +1,132 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+
+#include "test/test_bitcoin.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(lrucache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(lrucache_test)
+{
+    // create a cache capped at 10 items
+    CLRUCache<int, int> cache(10);
+
+    // check that the max size is 10 and that it's empty
+    BOOST_CHECK(cache.MaxWeight() == 10);
+    BOOST_CHECK(cache.size() == 0);
+    BOOST_CHECK(cache.empty());
+
+    // put (-1, -1) and make sure that it is in the cache
+    cache.Put(-1, -1);
+    BOOST_CHECK(cache.size() == 1);
+    BOOST_CHECK(cache.Contains(-1));
+
+    // put 10 new items
+    for (int i = 0; i < 10; i++)
+    {
+        cache.Put(i, i + 1);
+    }
+
+    // make sure that the cache now contains 10 items and that the first item has been discarded
+    BOOST_CHECK(cache.size() == 10);
+    BOOST_CHECK(cache.Weight() == 10);
+    BOOST_CHECK(!cache.Contains(-1));
+
+    // iteration is most recently used first
+    int i = 9;
+    for (CLRUCache<int, int>::const_iterator it = cache.begin(); it != cache.end(); ++it, --i)
+    {
+        BOOST_CHECK(it->key == i);
+        BOOST_CHECK(it->value == i + 1);
+    }
+    BOOST_CHECK(i == -1);
+
+    // update and recheck, replacing a value does not add an item
+    for (i = 0; i < 10; i++)
+    {
+        BOOST_CHECK(*cache.Peek(i) == i + 1);
+        cache.Put(i, i + 2);
+        BOOST_CHECK(*cache.Peek(i) == i + 2);
+    }
+    BOOST_CHECK(cache.size() == 10);
+
+    // a lookup makes an item the most recently used, 0 is now the newest
+    BOOST_CHECK(*cache.Get(0) == 2);
+    BOOST_CHECK(cache.begin()->key == 0);
+    BOOST_CHECK(cache.Get(-1) == nullptr);
+    BOOST_CHECK(cache.Hits() == 1);
+    BOOST_CHECK(cache.Misses() == 1);
+
+    // resize the cache to 5 items, the least recently used 1 to 5 are discarded
+    cache.SetMaxWeight(5);
+    BOOST_CHECK(cache.MaxWeight() == 5);
+    BOOST_CHECK(cache.size() == 5);
+    for (i = 0; i < 10; i++)
+    {
+        BOOST_CHECK(cache.Contains(i) == (i == 0 || i > 5));
+    }
+
+    // erase some items not in the cache and check that the size is unaffected
+    for (i = 100; i < 1000; i += 100)
+    {
+        BOOST_CHECK(!cache.Erase(i));
+    }
+    BOOST_CHECK(cache.size() == 5);
+
+    // erase the remaining elements
+    BOOST_CHECK(cache.Erase(0));
+    for (i = 6; i < 10; i++)
+    {
+        BOOST_CHECK(cache.Erase(i));
+    }
+    BOOST_CHECK(cache.empty());
+    BOOST_CHECK(cache.Weight() == 0);
+}
+
+struct StringWeigher
+{
+    size_t operator()(int, const std::string &str) const { return str.size(); }
+};
+
+BOOST_AUTO_TEST_CASE(lrucache_weight)
+{
+    // capped at 10 bytes of strings
+    CLRUCache<int, std::string, std::hash<int>, StringWeigher> cache(10);
+    cache.Put(1, "aaaa");
+    cache.Put(2, "bbbb");
+    BOOST_CHECK(cache.Weight() == 8);
+
+    // 1 is used last, so 2 goes to make room
+    BOOST_CHECK(cache.Get(1) != nullptr);
+    cache.Put(3, "cccc");
+    BOOST_CHECK(cache.Weight() == 8);
+    BOOST_CHECK(cache.Contains(1));
+    BOOST_CHECK(!cache.Contains(2));
+    BOOST_CHECK(cache.Contains(3));
+
+    // a replaced value is weighed again
+    cache.Put(3, "c");
+    BOOST_CHECK(cache.Weight() == 5);
+
+    // an entry heavier than the bound stays on its own until the next one comes in
+    cache.Put(4, "dddddddddddddddd");
+    BOOST_CHECK(cache.size() == 1);
+    BOOST_CHECK(cache.Weight() == 16);
+    cache.Put(5, "e");
+    BOOST_CHECK(cache.size() == 1);
+    BOOST_CHECK(cache.Contains(5));
+
+    // the counts stay when the cache is cleared
+    cache.Clear();
+    BOOST_CHECK(cache.empty());
+    BOOST_CHECK(cache.Weight() == 0);
+    BOOST_CHECK(cache.Hits() == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
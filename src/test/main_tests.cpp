@@ -4,13 +4,17 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "main.h"
-
+#include "arith_uint256.h"
+#include "networks/netman.h"
+#include "random.h"
 
 #include "test/test_bitcoin.h"
 
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <thread>
+
 BOOST_FIXTURE_TEST_SUITE(main_tests, TestingSetup)
 
 bool ReturnFalse() { return false; }
@@ -28,4 +32,112 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(published_tip)
+{
+    CChainManager *chainman = pnetMan->getChainActive();
+    LOCK(cs_main);
+    CChainTipRef tip = chainman->GetPublishedTip();
+    BOOST_CHECK(tip->hash == chainman->chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(tip->nHeight, chainman->chainActive.Height());
+    BOOST_CHECK(tip->pindex == chainman->chainActive.Tip());
+    BOOST_CHECK_EQUAL(tip->nTime, chainman->chainActive.Tip()->GetBlockTime());
+    BOOST_CHECK_EQUAL(tip->nMedianTimePast, chainman->chainActive.Tip()->GetMedianTimePast());
+    BOOST_CHECK(tip->nChainWork == chainman->chainActive.Tip()->nChainWork);
+    BOOST_CHECK_EQUAL(tip->fInitialBlockDownload, chainman->IsInitialBlockDownload());
+
+    // a published snapshot stays as it was when the tip moves on
+    CBlockIndex *pindexTip = chainman->chainActive.Tip();
+    chainman->chainActive.SetTip(nullptr);
+    chainman->PublishTip();
+    BOOST_CHECK(tip->pindex == pindexTip);
+    BOOST_CHECK(chainman->GetPublishedTip()->pindex == nullptr);
+    BOOST_CHECK_EQUAL(chainman->GetPublishedTip()->nHeight, -1);
+    BOOST_CHECK(chainman->GetPublishedTip()->fInitialBlockDownload);
+    chainman->chainActive.SetTip(pindexTip);
+    chainman->PublishTip();
+
+    // readers do not wait for cs_main
+    int nHeight = -2;
+    std::thread reader([&]() { nHeight = chainman->GetPublishedTip()->nHeight; });
+    reader.join();
+    BOOST_CHECK_EQUAL(nHeight, chainman->chainActive.Height());
+}
+
+BOOST_AUTO_TEST_CASE(next_target_cached)
+{
+    // the same chain twice, connected blocks are cached and headers are computed every time
+    const int nLength = 300;
+    std::vector<uint256> vHashes(nLength);
+    std::vector<CBlockIndex> vHeaders(nLength);
+    std::vector<CBlockIndex> vConnected(nLength);
+    for (int i = 0; i < nLength; i++)
+    {
+        vHashes[i] = ArithToUint256(arith_uint256(i + 1));
+        for (std::vector<CBlockIndex> *pvIndex : {&vHeaders, &vConnected})
+        {
+            CBlockIndex &index = (*pvIndex)[i];
+            index.phashBlock = &vHashes[i];
+            index.nHeight = i;
+            index.pprev = (i == 0) ? NULL : &(*pvIndex)[i - 1];
+            index.BuildSkip();
+            index.nTime = 1500000000 + i * 45 + (i % 7) * 20;
+            index.nBits = 0x1d00ffff - i;
+            if (i % 5 != 0)
+                index.SetProofOfStake();
+        }
+        vConnected[i].BuildTypeLinks();
+    }
+    for (int nPass = 0; nPass < 2; nPass++)
+    {
+        for (int i = 0; i < nLength; i++)
+        {
+            for (bool fProofOfStake : {false, true})
+            {
+                const unsigned int nBits = GetNextTargetRequired(&vHeaders[i], fProofOfStake);
+                if (GetNextTargetRequired(&vConnected[i], fProofOfStake) != nBits)
+                    BOOST_CHECK_EQUAL(GetNextTargetRequired(&vConnected[i], fProofOfStake), nBits);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(version_counts)
+{
+    const Consensus::Params &params = pnetMan->getActivePaymentNetwork()->GetConsensus();
+    const int nLength = params.nMajorityWindow * 3;
+    std::vector<CBlockIndex> vCounted(nLength);
+    std::vector<CBlockIndex> vWalked(nLength);
+    for (int i = 0; i < nLength; i++)
+    {
+        // the versions go up over the chain, with old ones mixed in
+        const int nVersion = std::max(1, std::min(5, i * 5 / nLength + 1 - (int)(insecure_rand() % 3)));
+        for (std::vector<CBlockIndex> *pvIndex : {&vCounted, &vWalked})
+        {
+            CBlockIndex &index = (*pvIndex)[i];
+            index.nHeight = i;
+            index.pprev = (i == 0) ? NULL : &(*pvIndex)[i - 1];
+            index.BuildSkip();
+            index.nVersion = nVersion;
+        }
+        vCounted[i].BuildVersionCounts(params.nMajorityWindow);
+    }
+    BOOST_CHECK_EQUAL(vWalked[nLength - 1].GetVersionCount(2, params.nMajorityWindow), -1);
+
+    for (int i = 0; i < nLength; i++)
+    {
+        for (int minVersion = 1; minVersion <= 5; minVersion++)
+        {
+            const unsigned int nCounted = CountBlockVersions(minVersion, &vCounted[i], params);
+            if (nCounted != CountBlockVersions(minVersion, &vWalked[i], params))
+                BOOST_CHECK_EQUAL(nCounted, CountBlockVersions(minVersion, &vWalked[i], params));
+            for (int nRequired : {params.nMajorityEnforceBlockUpgrade, params.nMajorityRejectBlockOutdated})
+            {
+                BOOST_CHECK_EQUAL(IsSuperMajority(minVersion, &vCounted[i], nRequired, params),
+                    IsSuperMajority(minVersion, &vWalked[i], nRequired, params));
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
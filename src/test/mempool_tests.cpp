@@ -4,6 +4,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "txmempool.h"
+#include "coins.h"
+#include "init.h"
+#include "main.h"
+#include "random.h"
+#include "networks/netman.h"
 #include "util/util.h"
 
 #include "test/test_bitcoin.h"
@@ -127,6 +132,44 @@ void _CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder)
     }
 }
 
+BOOST_AUTO_TEST_CASE(MempoolPublishedSizeTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+    uint64_t nTxs, nBytes, nUsage;
+    pool.GetPublishedSize(nTxs, nBytes, nUsage);
+    BOOST_CHECK_EQUAL(nTxs, 0U);
+    BOOST_CHECK_EQUAL(nBytes, 0U);
+
+    CTransaction tx[2];
+    for (int i = 0; i < 2; i++)
+    {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.n = i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10000LL;
+        pool.addUnchecked(tx[i].GetHash(), entry.FromTx(tx[i]));
+    }
+    pool.GetPublishedSize(nTxs, nBytes, nUsage);
+    BOOST_CHECK_EQUAL(nTxs, pool.size());
+    BOOST_CHECK_EQUAL(nBytes, pool.GetTotalTxSize());
+    BOOST_CHECK_EQUAL(nUsage, pool.DynamicMemoryUsage());
+
+    std::list<CTransactionRef> removed;
+    pool.remove(tx[0], removed, true);
+    pool.GetPublishedSize(nTxs, nBytes, nUsage);
+    BOOST_CHECK_EQUAL(nTxs, 1U);
+    BOOST_CHECK_EQUAL(nBytes, pool.GetTotalTxSize());
+    BOOST_CHECK_EQUAL(nUsage, pool.DynamicMemoryUsage());
+
+    pool.clear();
+    pool.GetPublishedSize(nTxs, nBytes, nUsage);
+    BOOST_CHECK_EQUAL(nTxs, 0U);
+    BOOST_CHECK_EQUAL(nBytes, 0U);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 {
     CTxMemPool pool(CFeeRate(0));
@@ -346,6 +389,290 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     CheckSort<mining_score>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // all of the same size, spending a coin of the chain or of the one before
+    std::vector<CTransaction> vtx(4);
+    for (size_t i = 0; i < vtx.size(); i++)
+    {
+        vtx[i].vin.resize(1);
+        vtx[i].vin[0].scriptSig = CScript() << OP_11;
+        vtx[i].vin[0].prevout.hash = GetRandHash();
+        vtx[i].vin[0].prevout.n = 0;
+        vtx[i].vout.resize(1);
+        vtx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vtx[i].vout[0].nValue = 10 * COIN;
+    }
+    // tx2 pays for its parent tx1, tx3 pays nothing on top of tx0
+    vtx[2].vin[0].prevout.hash = vtx[1].GetHash();
+    vtx[3].vin[0].prevout.hash = vtx[0].GetHash();
+    pool.addUnchecked(vtx[0].GetHash(), entry.Fee(10000LL).FromTx(vtx[0]));
+    pool.addUnchecked(vtx[1].GetHash(), entry.Fee(2000LL).FromTx(vtx[1]));
+    pool.addUnchecked(vtx[2].GetHash(), entry.Fee(50000LL).FromTx(vtx[2]));
+    pool.addUnchecked(vtx[3].GetHash(), entry.Fee(0LL).FromTx(vtx[3]));
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.push_back(vtx[2].GetHash().ToString()); // 52000 for two
+    sortedOrder.push_back(vtx[0].GetHash().ToString()); // 10000
+    sortedOrder.push_back(vtx[1].GetHash().ToString()); // 2000
+    sortedOrder.push_back(vtx[3].GetHash().ToString()); // 0
+    CheckSort<ancestor_score>(pool, sortedOrder);
+
+    // once the parent is mined the child goes by its own feerate, the fee of tx0 follows its ancestors
+    std::list<CTransactionRef> removed;
+    pool.remove(vtx[1], removed, false);
+    pool.PrioritiseTransaction(vtx[3].GetHash(), vtx[3].GetHash().ToString(), 0, 100000LL);
+    sortedOrder.clear();
+    sortedOrder.push_back(vtx[3].GetHash().ToString()); // 110000 for two
+    sortedOrder.push_back(vtx[2].GetHash().ToString()); // 50000
+    sortedOrder.push_back(vtx[0].GetHash().ToString()); // 10000
+    CheckSort<ancestor_score>(pool, sortedOrder);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorStateTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // a chain of ten transactions, each spending the one before it
+    std::vector<CTransactionRef> vChain;
+    uint256 hashPrev = GetRandHash();
+    for (int i = 0; i < 10; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout.hash = hashPrev;
+        tx.vin[0].prevout.n = 0;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN - i * 1000LL;
+        pool.addUnchecked(tx.GetHash(), entry.Fee(1000LL).FromTx(tx));
+        vChain.push_back(MakeTransactionRef(tx));
+        hashPrev = tx.GetHash();
+    }
+
+    WRITELOCK(pool.cs);
+    uint64_t nSize = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        CTxMemPool::txiter it = pool.mapTx.find(vChain[i]->GetHash());
+        nSize += it->GetTxSize();
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), i + 1U);
+        BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), nSize);
+        BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), (i + 1) * 1000LL);
+    }
+
+    // a child of the tip has ten ancestors, the cached state of the tip turns it away
+    CTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = hashPrev;
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 1 * COIN;
+    CTxMemPoolEntry entryChild = entry.Fee(1000LL).FromTx(txChild);
+    CTxMemPool::setEntries setAncestors;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string errString;
+    BOOST_CHECK(!pool._CalculateMemPoolAncestors(entryChild, setAncestors, 10, nNoLimit, nNoLimit, nNoLimit, errString));
+    BOOST_CHECK(setAncestors.empty());
+    BOOST_CHECK(pool._CalculateMemPoolAncestors(entryChild, setAncestors, 11, nNoLimit, nNoLimit, nNoLimit, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 10U);
+    BOOST_CHECK(!pool._CalculateMemPoolAncestors(
+        entryChild, setAncestors, 11, nSize + entryChild.GetTxSize() - 1, nNoLimit, nNoLimit, errString));
+
+    // the first one is mined, the rest lose it as an ancestor
+    std::list<CTransactionRef> conflicts;
+    pool._remove(*vChain[0], conflicts, false);
+    for (int i = 1; i < 10; i++)
+    {
+        CTxMemPool::txiter it = pool.mapTx.find(vChain[i]->GetHash());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), (uint64_t)i);
+        BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), i * 1000LL);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockStateTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // a chain of five transactions, the first three of which are mined
+    std::vector<CTransactionRef> vChain;
+    uint256 hashPrev = GetRandHash();
+    for (int i = 0; i < 5; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vin[0].prevout.hash = hashPrev;
+        tx.vin[0].prevout.n = 0;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN - i * 1000LL;
+        pool.addUnchecked(tx.GetHash(), entry.Fee(1000LL * (i + 1)).FromTx(tx));
+        vChain.push_back(MakeTransactionRef(tx));
+        hashPrev = tx.GetHash();
+    }
+    std::vector<uint256> vRemoved;
+    pool.NotifyEntryRemoved.connect([&vRemoved](CTransactionRef ptx, MemPoolRemovalReason reason,
+                                        uint64_t nSequence) { vRemoved.push_back(ptx->GetHash()); });
+
+    std::vector<CTransactionRef> vBlock(vChain.begin(), vChain.begin() + 3);
+    std::list<CTransactionRef> conflicts;
+    pool.removeForBlock(vBlock, 1, conflicts);
+    BOOST_CHECK(conflicts.empty());
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    // in block order
+    BOOST_REQUIRE_EQUAL(vRemoved.size(), 3U);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(vRemoved[i] == vChain[i]->GetHash());
+
+    // the state of the two left is as if they had come in after the block
+    READLOCK(pool.cs);
+    CTxMemPool::txiter it3 = pool.mapTx.find(vChain[3]->GetHash());
+    CTxMemPool::txiter it4 = pool.mapTx.find(vChain[4]->GetHash());
+    BOOST_CHECK_EQUAL(it3->GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(it3->GetSizeWithAncestors(), it3->GetTxSize());
+    BOOST_CHECK_EQUAL(it3->GetModFeesWithAncestors(), 4000LL);
+    BOOST_CHECK_EQUAL(it3->GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(it3->GetModFeesWithDescendants(), 9000LL);
+    BOOST_CHECK_EQUAL(it4->GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(it4->GetSizeWithAncestors(), it3->GetTxSize() + it4->GetTxSize());
+    BOOST_CHECK_EQUAL(it4->GetModFeesWithAncestors(), 9000LL);
+    BOOST_CHECK(pool.GetMemPoolParents(it3).empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorStatePrioritiseTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+
+    CTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(2000LL).FromTx(txChild));
+
+    pool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0, 500LL);
+    {
+        READLOCK(pool.cs);
+        BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithAncestors(), 1500LL);
+        BOOST_CHECK_EQUAL(pool.mapTx.find(txChild.GetHash())->GetModFeesWithAncestors(), 3500LL);
+    }
+
+    pool.PrioritiseTransaction(txChild.GetHash(), txChild.GetHash().ToString(), 0, 100LL);
+    {
+        READLOCK(pool.cs);
+        BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithAncestors(), 1500LL);
+        BOOST_CHECK_EQUAL(pool.mapTx.find(txChild.GetHash())->GetModFeesWithAncestors(), 3600LL);
+        BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithDescendants(), 3600LL);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolLinksTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // a parent with five children, more than fit inline in its child links
+    CTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(5);
+    for (int i = 0; i < 5; i++)
+    {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+
+    std::vector<CTransaction> vChildren(5);
+    for (int i = 0; i < 5; i++)
+    {
+        vChildren[i].vin.resize(1);
+        vChildren[i].vin[0].scriptSig = CScript() << OP_11;
+        vChildren[i].vin[0].prevout.hash = txParent.GetHash();
+        vChildren[i].vin[0].prevout.n = i;
+        vChildren[i].vout.resize(1);
+        vChildren[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vChildren[i].vout[0].nValue = 11000LL;
+        pool.addUnchecked(vChildren[i].GetHash(), entry.Fee(1000LL).FromTx(vChildren[i]));
+    }
+
+    {
+        READLOCK(pool.cs);
+        CTxMemPool::txiter parentIt = pool.mapTx.find(txParent.GetHash());
+        BOOST_CHECK_EQUAL(pool.GetMemPoolParents(parentIt).size(), 0U);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(parentIt).size(), 5U);
+        for (const CTransaction &tx : vChildren)
+        {
+            CTxMemPool::txiter childIt = pool.mapTx.find(tx.GetHash());
+            BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(childIt).size(), 0U);
+            CTxMemPool::LinkRange parents = pool.GetMemPoolParents(childIt);
+            BOOST_CHECK_EQUAL(parents.size(), 1U);
+            BOOST_CHECK(*parents.begin() == parentIt);
+        }
+        CTxMemPool::setEntries setChildren;
+        for (CTxMemPool::txiter childIt : pool.GetMemPoolChildren(parentIt))
+            setChildren.insert(childIt);
+        BOOST_CHECK_EQUAL(setChildren.size(), 5U);
+    }
+
+    // only the parent's child links needed an allocation
+    MempoolMemoryUsage usage = pool.GetMemoryUsage();
+    BOOST_CHECK(usage.nLinks > 0);
+    BOOST_CHECK(usage.nTransactions > 0);
+    BOOST_CHECK_EQUAL(usage.Total(), pool.DynamicMemoryUsage());
+
+    // back down to two children, the links move back inline
+    std::list<CTransactionRef> removed;
+    for (int i = 0; i < 3; i++)
+        pool.remove(vChildren[i], removed, false);
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    BOOST_CHECK_EQUAL(pool.GetMemoryUsage().nLinks, 0U);
+    {
+        READLOCK(pool.cs);
+        CTxMemPool::txiter parentIt = pool.mapTx.find(txParent.GetHash());
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(parentIt).size(), 2U);
+        BOOST_CHECK_EQUAL(parentIt->GetCountWithDescendants(), 3U);
+    }
+
+    // the parent leaves as if mined, its children lose their parent link
+    pool.remove(txParent, removed, false);
+    {
+        READLOCK(pool.cs);
+        for (int i = 3; i < 5; i++)
+        {
+            CTxMemPool::txiter childIt = pool.mapTx.find(vChildren[i].GetHash());
+            BOOST_CHECK(pool.GetMemPoolParents(childIt).empty());
+            BOOST_CHECK_EQUAL(childIt->GetCountWithAncestors(), 1U);
+        }
+    }
+
+    pool.remove(vChildren[3], removed, false);
+    pool.remove(vChildren[4], removed, false);
+    usage = pool.GetMemoryUsage();
+    BOOST_CHECK_EQUAL(usage.nTransactions, 0U);
+    BOOST_CHECK_EQUAL(usage.nLinks, 0U);
+    BOOST_CHECK_EQUAL(usage.nNextTx, 0U);
+}
 
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
@@ -510,4 +837,139 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSequenceTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+    CTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<std::pair<uint256, uint64_t> > vAdded;
+    std::vector<std::pair<uint256, uint64_t> > vRemoved;
+    std::vector<MemPoolRemovalReason> vReasons;
+    pool.NotifyEntryAdded.connect(
+        [&vAdded](CTransactionRef ptx, uint64_t nSequence) { vAdded.emplace_back(ptx->GetHash(), nSequence); });
+    pool.NotifyEntryRemoved.connect(
+        [&vRemoved, &vReasons](CTransactionRef ptx, MemPoolRemovalReason reason, uint64_t nSequence) {
+            vRemoved.emplace_back(ptx->GetHash(), nSequence);
+            vReasons.push_back(reason);
+        });
+    BOOST_CHECK_EQUAL(pool.GetSequence(), 0);
+
+    pool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+    pool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild));
+    BOOST_REQUIRE_EQUAL(vAdded.size(), 2);
+    BOOST_CHECK(vAdded[0] == std::make_pair(txParent.GetHash(), (uint64_t)1));
+    BOOST_CHECK(vAdded[1] == std::make_pair(txChild.GetHash(), (uint64_t)2));
+
+    // the parent is confirmed, the child stays
+    std::list<CTransactionRef> conflicts;
+    pool.removeForBlock({MakeTransactionRef(txParent)}, 1, conflicts);
+    BOOST_REQUIRE_EQUAL(vRemoved.size(), 1);
+    BOOST_CHECK(vRemoved[0] == std::make_pair(txParent.GetHash(), (uint64_t)3));
+    BOOST_CHECK(vReasons[0] == MemPoolRemovalReason::BLOCK);
+
+    // a snapshot matches the number of the last change
+    std::vector<uint256> vtxid;
+    uint64_t nSequence = 0;
+    pool.queryHashes(vtxid, nSequence);
+    BOOST_CHECK_EQUAL(nSequence, 3);
+    BOOST_REQUIRE_EQUAL(vtxid.size(), 1);
+    BOOST_CHECK(vtxid[0] == txChild.GetHash());
+
+    std::list<CTransactionRef> removed;
+    pool.remove(txChild, removed, true, MemPoolRemovalReason::REORG);
+    BOOST_REQUIRE_EQUAL(vRemoved.size(), 2);
+    BOOST_CHECK(vRemoved[1] == std::make_pair(txChild.GetHash(), (uint64_t)4));
+    BOOST_CHECK(vReasons[1] == MemPoolRemovalReason::REORG);
+    BOOST_CHECK_EQUAL(pool.GetSequence(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolCheckTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    pool.setSanityCheck(1.0);
+    TestMemPoolEntryHelper entry;
+    CCoinsViewCache view(pnetMan->getChainActive()->pcoinsTip.get());
+
+    // a chain of three transactions on top of a coin of the chain, checked after every change
+    COutPoint prevout(GetRandHash(), 0);
+    view.AddCoin(prevout, Coin(CTxOut(10 * COIN, CScript() << OP_11 << OP_EQUAL), 1, false, false, 0), false);
+    std::vector<CTransaction> vChain(3);
+    for (int i = 0; i < 3; i++)
+    {
+        vChain[i].vin.resize(1);
+        vChain[i].vin[0].scriptSig = CScript() << OP_11;
+        vChain[i].vin[0].prevout = prevout;
+        vChain[i].vout.resize(1);
+        vChain[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vChain[i].vout[0].nValue = 10 * COIN - (i + 1) * 1000LL;
+        pool.addUnchecked(vChain[i].GetHash(), entry.Fee(1000LL).FromTx(vChain[i]));
+        pool.check(&view);
+        prevout = COutPoint(vChain[i].GetHash(), 0);
+    }
+
+    pool.PrioritiseTransaction(vChain[1].GetHash(), vChain[1].GetHash().ToString(), 0, 500LL);
+    pool.check(&view);
+
+    // the first one is mined, its output moves to the chain
+    std::list<CTransactionRef> removed;
+    view.SpendCoin(vChain[0].vin[0].prevout);
+    AddCoins(view, vChain[0], 2);
+    pool.remove(vChain[0], removed, false);
+    pool.check(&view);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+
+    pool.remove(vChain[1], removed, true);
+    pool.check(&view);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRejectStatsTest)
+{
+    const CMempoolRejectStats before = GetMempoolRejectStats();
+    auto count = [](const CMempoolRejectStats &stats, int nStage, const std::string &strReason) -> uint64_t {
+        auto it = stats.vReasons[nStage].find(strReason);
+        return it == stats.vReasons[nStage].end() ? 0 : it->second;
+    };
+
+    // a coinbase is turned away before any lock or coin
+    CTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_11 << OP_11;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1)
+                                              << OP_EQUALVERIFY << OP_CHECKSIG;
+    coinbase.vout[0].nValue = COIN;
+    CValidationState state;
+    bool fMissingInputs = false;
+    BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(coinbase), false, &fMissingInputs));
+
+    // a transaction spending coins nobody has gets as far as the coin fetch
+    CTransaction orphan = coinbase;
+    orphan.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    CValidationState stateOrphan;
+    BOOST_CHECK(!AcceptToMemoryPool(mempool, stateOrphan, MakeTransactionRef(orphan), false, &fMissingInputs));
+    BOOST_CHECK(fMissingInputs);
+
+    const CMempoolRejectStats after = GetMempoolRejectStats();
+    BOOST_CHECK_EQUAL(count(after, MEMPOOLSTAGE_CHECK, state.GetRejectReason()),
+        count(before, MEMPOOLSTAGE_CHECK, state.GetRejectReason()) + 1);
+    BOOST_CHECK_EQUAL(
+        count(after, MEMPOOLSTAGE_FEE, "missing-inputs"), count(before, MEMPOOLSTAGE_FEE, "missing-inputs") + 1);
+    BOOST_CHECK_EQUAL(std::string(MempoolAcceptStageName(MEMPOOLSTAGE_SCRIPTS)), "scripts");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
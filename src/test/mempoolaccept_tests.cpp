@@ -0,0 +1,159 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "consensus/validation.h"
+#include "keystore.h"
+#include "main.h"
+#include "script/sign.h"
+#include "test/test_bitcoin.h"
+#include "txmempool.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempoolaccept_tests, TestChain100Setup)
+
+/** A transaction splitting output nOut of txFrom into nOutputs outputs to the same script, less a fee */
+static CTransaction MakeSpend(const CKeyStore &keystore,
+    const CTransaction &txFrom,
+    unsigned int nOut,
+    unsigned int nOutputs)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFrom.GetHash(), nOut);
+    tx.vout.resize(nOutputs);
+    for (CTxOut &out : tx.vout)
+    {
+        out.nValue = (txFrom.vout[nOut].nValue - CENT) / nOutputs;
+        out.scriptPubKey = txFrom.vout[nOut].scriptPubKey;
+    }
+    BOOST_CHECK(SignSignature(keystore, txFrom, tx, 0));
+    tx.UpdateHash();
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(mempoolaccept_without_cs_main)
+{
+    mempool.clear();
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+
+    // the caller holds nothing, AcceptToMemoryPool takes cs_main itself
+    const CTransaction txSplit = MakeSpend(keystore, *coinbaseTxns[0], 0, 9);
+    CValidationState state;
+    bool fMissingInputs = false;
+    BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(txSplit), false, &fMissingInputs));
+
+    // threads admit spends of its outputs concurrently, and race each other with spends of the last one
+    std::vector<CTransactionRef> vSpends;
+    for (unsigned int n = 0; n < 8; n++)
+        vSpends.push_back(MakeTransactionRef(MakeSpend(keystore, txSplit, n, 1)));
+    std::vector<CTransactionRef> vConflicts;
+    for (unsigned int n = 0; n < 4; n++)
+        vConflicts.push_back(MakeTransactionRef(MakeSpend(keystore, txSplit, 8, n + 1)));
+    std::atomic<int> nAccepted(0);
+    std::atomic<int> nConflictsAccepted(0);
+    boost::thread_group threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.create_thread([&, t] {
+            for (int n = t; n < 8; n += 4)
+            {
+                CValidationState stateSpend;
+                bool fMissing = false;
+                if (AcceptToMemoryPool(mempool, stateSpend, vSpends[n], false, &fMissing))
+                    nAccepted++;
+            }
+            CValidationState stateConflict;
+            bool fMissing = false;
+            if (AcceptToMemoryPool(mempool, stateConflict, vConflicts[t], false, &fMissing))
+                nConflictsAccepted++;
+        });
+    }
+    threads.join_all();
+    BOOST_CHECK_EQUAL(nAccepted, 8);
+    BOOST_CHECK_EQUAL(nConflictsAccepted, 1);
+    BOOST_CHECK_EQUAL(mempool.size(), 10U);
+
+    // a signature that does not match is turned away by the script checks, that ran without cs_main
+    CTransaction txBad = MakeSpend(keystore, *coinbaseTxns[1], 0, 1);
+    txBad.vout[0].nValue -= 1;
+    txBad.UpdateHash();
+    CValidationState stateBad;
+    BOOST_CHECK(!AcceptToMemoryPool(mempool, stateBad, MakeTransactionRef(txBad), false, &fMissingInputs));
+    BOOST_CHECK(stateBad.IsInvalid());
+    BOOST_CHECK(!fMissingInputs);
+    BOOST_CHECK_EQUAL(mempool.size(), 10U);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(mempoolaccept_batch)
+{
+    mempool.clear();
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+
+    const CTransaction txParent = MakeSpend(keystore, *coinbaseTxns[0], 0, 2);
+    CTransaction txBad = MakeSpend(keystore, *coinbaseTxns[1], 0, 1);
+    txBad.vout[0].nValue -= 1;
+    txBad.UpdateHash();
+    // spends an output nobody has
+    CTransaction txUnknown;
+    txUnknown.vout.push_back(coinbaseTxns[2]->vout[0]);
+    txUnknown.UpdateHash();
+    const CTransaction txSpend = MakeSpend(keystore, *coinbaseTxns[2], 0, 1);
+
+    std::vector<CTransactionRef> vtx;
+    // a child ahead of its parent waits for the round after the parent's
+    vtx.push_back(MakeTransactionRef(MakeSpend(keystore, txParent, 0, 1)));
+    vtx.push_back(MakeTransactionRef(txParent));
+    vtx.push_back(MakeTransactionRef(txBad));
+    vtx.push_back(MakeTransactionRef(MakeSpend(keystore, txUnknown, 0, 1)));
+    // two spends of the same output of the parent, the first one gets in
+    vtx.push_back(MakeTransactionRef(MakeSpend(keystore, txParent, 1, 1)));
+    vtx.push_back(MakeTransactionRef(MakeSpend(keystore, txParent, 1, 2)));
+    // and the same transaction twice
+    vtx.push_back(MakeTransactionRef(txSpend));
+    vtx.push_back(MakeTransactionRef(txSpend));
+
+    std::vector<CValidationState> vState;
+    std::vector<bool> vAccepted, vMissingInputs;
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, vMissingInputs, false), 4U);
+    BOOST_REQUIRE_EQUAL(vState.size(), vtx.size());
+    BOOST_REQUIRE_EQUAL(vAccepted.size(), vtx.size());
+    BOOST_REQUIRE_EQUAL(vMissingInputs.size(), vtx.size());
+    const bool vExpected[] = {true, true, false, false, true, false, true, false};
+    for (size_t i = 0; i < vtx.size(); i++)
+    {
+        BOOST_CHECK_EQUAL((bool)vAccepted[i], vExpected[i]);
+        BOOST_CHECK_EQUAL(mempool.exists(vtx[i]->GetHash()), vExpected[i] || i == 7);
+        BOOST_CHECK_EQUAL((bool)vMissingInputs[i], i == 3);
+    }
+    BOOST_CHECK(vState[2].IsInvalid());
+    BOOST_CHECK_EQUAL(vState[5].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK_EQUAL(vState[7].GetRejectReason(), "txn-already-in-mempool");
+    BOOST_CHECK_EQUAL(mempool.size(), 4U);
+
+    // the transactions get the accept times they were loaded with
+    std::vector<CTransactionRef> vtxTimed(1, MakeTransactionRef(MakeSpend(keystore, *coinbaseTxns[3], 0, 1)));
+    const std::vector<int64_t> vAcceptTime(1, GetTime() - 1000);
+    BOOST_CHECK_EQUAL(
+        AcceptToMemoryPoolBatch(mempool, vtxTimed, vState, vAccepted, vMissingInputs, false, false, &vAcceptTime), 1U);
+    CTxMemPoolEntry entry;
+    BOOST_CHECK(mempool.lookup(vtxTimed[0]->GetHash(), entry));
+    BOOST_CHECK_EQUAL(entry.GetTime(), vAcceptTime[0]);
+
+    // an empty batch accepts nothing
+    BOOST_CHECK_EQUAL(
+        AcceptToMemoryPoolBatch(mempool, std::vector<CTransactionRef>(), vState, vAccepted, vMissingInputs, false),
+        0U);
+    BOOST_CHECK(vState.empty());
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
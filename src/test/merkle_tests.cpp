@@ -5,7 +5,9 @@
 
 #include "consensus/merkle.h"
 #include "random.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
+#include "version.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -155,4 +157,36 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_deserialized_block)
+{
+    // Enough transactions that the batch hashing after deserialization spreads over threads where it can
+    CBlock block;
+    for (int i = 0; i < 1000; i++)
+    {
+        CTransaction tx;
+        tx.nVersion = 1 + (i % 2);
+        tx.nLockTime = i;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i;
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    BOOST_CHECK(!block.fTxHashesCached);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    CBlock block2;
+    stream >> block2;
+    BOOST_CHECK(block2.fTxHashesCached);
+    BOOST_REQUIRE_EQUAL(block2.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block2.vtx.size(); i++)
+    {
+        BOOST_CHECK(block2.vtx[i]->GetId() == block2.vtx[i]->GetHash());
+        BOOST_CHECK(block2.vtx[i]->GetId() == block.vtx[i]->GetHash());
+    }
+    bool mutated = true;
+    BOOST_CHECK(BlockMerkleRoot(block2, &mutated) == block.hashMerkleRoot);
+    BOOST_CHECK(!mutated);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 #include "net/net.h"
 #include "crypto/hash.h"
 #include "net/addrman.h"
+#include "net/blockserver.h"
 #include "net/netbase.h"
 #include "serialize.h"
 #include "streams.h"
@@ -155,6 +156,33 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(cdnsseeddb_roundtrip, TestingSetup)
+{
+    // Test that what the DNS seeds answered is read back as it was written.
+    dnsseedcache_t mapWritten;
+    CDNSSeedCacheEntry &entry = mapWritten["x9.seed.example.org"];
+    entry.nResolveTime = 1550000000;
+    entry.nServices = NODE_NETWORK;
+    entry.vIPs.resize(2);
+    BOOST_REQUIRE(LookupHost("250.1.1.1", entry.vIPs[0], false));
+    BOOST_REQUIRE(LookupHost("250.1.1.2", entry.vIPs[1], false));
+    BOOST_REQUIRE(Lookup("250.2.2.2", entry.source, 0, false));
+    mapWritten["seed2.example.org"];
+
+    CDNSSeedDB seedDB;
+    BOOST_REQUIRE(seedDB.Write(mapWritten));
+    dnsseedcache_t mapRead;
+    BOOST_REQUIRE(seedDB.Read(mapRead));
+    BOOST_REQUIRE_EQUAL(mapRead.size(), 2U);
+    const CDNSSeedCacheEntry &entryRead = mapRead["x9.seed.example.org"];
+    BOOST_CHECK_EQUAL(entryRead.nResolveTime, 1550000000);
+    BOOST_CHECK_EQUAL(entryRead.nServices, (uint64_t)NODE_NETWORK);
+    BOOST_REQUIRE_EQUAL(entryRead.vIPs.size(), 2U);
+    BOOST_CHECK(entryRead.vIPs[1] == entry.vIPs[1]);
+    BOOST_CHECK(entryRead.source == entry.source);
+    BOOST_CHECK(mapRead["seed2.example.org"].vIPs.empty());
+}
+
 BOOST_AUTO_TEST_CASE(cnode_simple_test)
 {
     SOCKET hSocket = INVALID_SOCKET;
@@ -179,4 +207,83 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_block_relay_only)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", false, true));
+    BOOST_CHECK(pnode->fBlockRelayOnly);
+
+    // transactions and addresses are not queued for it, blocks are
+    FastRandomContext insecure_rand;
+    pnode->PushAddress(CAddress(CService(ipv4Addr, 7778), NODE_NETWORK), insecure_rand);
+    BOOST_CHECK(pnode->vAddrToSend.empty());
+    pnode->PushInventory(CInv(MSG_TX, GetRandHash()), 1000);
+    BOOST_CHECK(pnode->mapInventoryTxToSend.empty());
+    BOOST_CHECK(pnode->setInventoryTxByFeeRate.empty());
+    pnode->PushInventory(CInv(MSG_BLOCK, GetRandHash()));
+    BOOST_CHECK_EQUAL(pnode->vInventoryBlockToSend.size(), 1U);
+
+    CNodeStats stats;
+    pnode->copyStats(stats);
+    BOOST_CHECK(stats.fBlockRelayOnly);
+}
+
+BOOST_AUTO_TEST_CASE(cnode_message_times)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CConnman connman(0x1337, 0x1337);
+    std::unique_ptr<CNode> pnode1(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", false));
+    std::unique_ptr<CNode> pnode2(new CNode(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 1, 1, "", true));
+
+    connman.RecordMessageTimes(pnode1.get(), NetMsgType::PING, 10, 100);
+    connman.RecordMessageTimes(pnode1.get(), NetMsgType::PING, 20, 200);
+    connman.RecordMessageTimes(pnode2.get(), NetMsgType::PING, 30, 300);
+    // commands outside the protocol share one entry
+    connman.RecordMessageTimes(pnode2.get(), "bogus1", 1, 2);
+    connman.RecordMessageTimes(pnode2.get(), "bogus2", 1, 2);
+
+    CNodeStats stats;
+    pnode1->copyStats(stats);
+    BOOST_CHECK_EQUAL(stats.mapMsgTimesPerCmd.size(), 1U);
+    BOOST_CHECK_EQUAL(stats.mapMsgTimesPerCmd[NetMsgType::PING].queue.nTotalMicros, 30);
+    BOOST_CHECK_EQUAL(stats.mapMsgTimesPerCmd[NetMsgType::PING].process.nTotalMicros, 300);
+    BOOST_CHECK_EQUAL(stats.mapMsgTimesPerCmd[NetMsgType::PING].process.nMaxMicros, 200);
+
+    pnode2->copyStats(stats);
+    BOOST_CHECK_EQUAL(stats.mapMsgTimesPerCmd.size(), 2U);
+    BOOST_CHECK_EQUAL(stats.mapMsgTimesPerCmd["*other*"].process.nCount, 2U);
+
+    mapMsgCmdTimes mapTimes;
+    CTimeHistogram sendTimes;
+    connman.GetMessageTimes(mapTimes, sendTimes);
+    BOOST_CHECK_EQUAL(mapTimes.size(), 2U);
+    BOOST_CHECK_EQUAL(mapTimes[NetMsgType::PING].process.nCount, 3U);
+    BOOST_CHECK_EQUAL(mapTimes[NetMsgType::PING].queue.nTotalMicros, 60);
+    BOOST_CHECK_EQUAL(sendTimes.nCount, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(block_server_queue)
+{
+    CConnman connman(0x1337, 0x1337);
+    CBlockServeRequest req;
+    req.nodeid = 7;
+    req.hash = GetRandHash();
+    req.pos = CDiskBlockPos(0, 0);
+    req.nSendVersion = PROTOCOL_VERSION;
+    req.lane = SEND_LANE_HISTORY;
+
+    // the caller reads the block itself while the workers do not run
+    CBlockServer server(&connman, 1);
+    BOOST_CHECK(!server.Add(req));
+    server.Start();
+    // a block that cannot be read and a peer that is gone are dropped by the worker
+    BOOST_CHECK(server.Add(req));
+    server.Stop();
+    BOOST_CHECK(!server.Add(req));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
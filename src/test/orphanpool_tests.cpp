@@ -0,0 +1,171 @@
+// Copyright (c) 2018 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/orphanpool.h"
+#include "random.h"
+#include "util/utiltime.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(orphanpool_tests, BasicTestingSetup)
+
+static CTransactionRef MakeOrphan(const uint256 &hashPrev, unsigned int nInputs = 1)
+{
+    CTransaction tx;
+    tx.vin.resize(nInputs);
+    for (unsigned int i = 0; i < nInputs; i++)
+    {
+        tx.vin[i].prevout.hash = hashPrev;
+        tx.vin[i].prevout.n = i;
+        tx.vin[i].scriptSig << OP_1;
+    }
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * CENT;
+    tx.vout[0].scriptPubKey << OP_1;
+    return std::make_shared<CTransaction>(tx);
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_peers)
+{
+    COrphanPool pool;
+    for (int i = 0; i < 30; i++)
+    {
+        BOOST_CHECK(pool.AddTx(MakeOrphan(GetRandHash()), i % 3));
+    }
+    CTransactionRef tx = MakeOrphan(GetRandHash());
+    BOOST_CHECK(pool.AddTx(tx, 0));
+    BOOST_CHECK(!pool.AddTx(tx, 1));
+    BOOST_CHECK(pool.HaveTx(tx->GetHash()));
+    BOOST_CHECK_EQUAL(pool.Size(), 31U);
+
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(0), 11U);
+    BOOST_CHECK(!pool.HaveTx(tx->GetHash()));
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(0), 0U);
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(1), 10U);
+    BOOST_CHECK_EQUAL(pool.Size(), 10U);
+
+    // too large to keep
+    BOOST_CHECK(!pool.AddTx(MakeOrphan(GetRandHash(), 200), 4));
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_limits)
+{
+    COrphanPool pool;
+    for (int i = 0; i < 50; i++)
+    {
+        pool.AddTx(MakeOrphan(GetRandHash()), i);
+    }
+    uint64_t nBytes = pool.GetTotalBytes();
+    BOOST_CHECK_EQUAL(pool.LimitSize(50, nBytes), 0U);
+    BOOST_CHECK_EQUAL(pool.LimitSize(40, nBytes), 10U);
+    BOOST_CHECK_EQUAL(pool.Size(), 40U);
+    pool.LimitSize(40, nBytes / 5);
+    BOOST_CHECK(pool.GetTotalBytes() <= nBytes / 5);
+    pool.LimitSize(0, 0);
+    BOOST_CHECK_EQUAL(pool.Size(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetTotalBytes(), 0U);
+
+    // orphans expire
+    int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+    pool.AddTx(MakeOrphan(GetRandHash()), 1);
+    SetMockTime(nStartTime + ORPHAN_TX_EXPIRE_TIME + 1);
+    pool.AddTx(MakeOrphan(GetRandHash()), 1);
+    BOOST_CHECK_EQUAL(pool.LimitSize(10, nBytes), 1U);
+    BOOST_CHECK_EQUAL(pool.Size(), 1U);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_memory_usage)
+{
+    COrphanPool pool;
+    const size_t nEmpty = pool.DynamicMemoryUsage();
+    size_t nLast = nEmpty;
+    for (int i = 0; i < 20; i++)
+    {
+        pool.AddTx(MakeOrphan(GetRandHash(), 3), i % 4);
+        BOOST_CHECK(pool.DynamicMemoryUsage() > nLast);
+        nLast = pool.DynamicMemoryUsage();
+    }
+    // at least the transactions themselves
+    BOOST_CHECK(nLast - nEmpty >= pool.GetTotalBytes());
+    pool.Clear();
+    BOOST_CHECK(pool.DynamicMemoryUsage() < nLast);
+}
+
+BOOST_AUTO_TEST_CASE(orphanpool_children)
+{
+    COrphanPool pool;
+    CTransactionRef parent1 = MakeOrphan(GetRandHash());
+    CTransactionRef parent2 = MakeOrphan(GetRandHash());
+
+    CTransaction both;
+    both.vin.resize(2);
+    both.vin[0].prevout.hash = parent1->GetHash();
+    both.vin[1].prevout.hash = parent2->GetHash();
+    both.vout.resize(1);
+    CTransactionRef child1 = MakeOrphan(parent1->GetHash());
+    CTransactionRef childBoth = std::make_shared<CTransaction>(both);
+    CTransactionRef child2 = MakeOrphan(parent2->GetHash());
+    pool.AddTx(child1, 1);
+    pool.AddTx(childBoth, 2);
+    pool.AddTx(child2, 3);
+    pool.AddTx(MakeOrphan(GetRandHash()), 4);
+
+    // every child once, in the order they were added
+    std::vector<COrphanPool::COrphanTx> vChildren = pool.GetChildren({parent2, parent1});
+    BOOST_CHECK_EQUAL(vChildren.size(), 3U);
+    BOOST_CHECK(vChildren[0].tx->GetHash() == child1->GetHash());
+    BOOST_CHECK(vChildren[1].tx->GetHash() == childBoth->GetHash());
+    BOOST_CHECK_EQUAL(vChildren[1].fromPeer, 2);
+    BOOST_CHECK(vChildren[2].tx->GetHash() == child2->GetHash());
+
+    BOOST_CHECK(pool.EraseTx(childBoth->GetHash()));
+    BOOST_CHECK(!pool.EraseTx(childBoth->GetHash()));
+    BOOST_CHECK_EQUAL(pool.GetChildren({parent2}).size(), 1U);
+    BOOST_CHECK_EQUAL(pool.Size(), 3U);
+}
+
+// the pool takes its own lock, peers add and drop orphans concurrently without cs_main
+BOOST_AUTO_TEST_CASE(orphanpool_concurrent)
+{
+    COrphanPool pool;
+    std::vector<std::thread> threads;
+    for (int peer = 0; peer < 4; peer++)
+    {
+        threads.emplace_back([&pool, peer]() {
+            for (int i = 0; i < 200; i++)
+            {
+                CTransactionRef tx = MakeOrphan(GetRandHash());
+                pool.AddTx(tx, peer);
+                pool.HaveTx(tx->GetHash());
+                if (i % 10 == 0)
+                {
+                    pool.LimitSize(100, 1000000);
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    // the orphans added after the last limit of each thread are over it until the next one
+    BOOST_CHECK(pool.Size() >= 100U);
+    pool.LimitSize(100, 1000000);
+    BOOST_CHECK_EQUAL(pool.Size(), 100U);
+    unsigned int nErased = 0;
+    for (int peer = 0; peer < 4; peer++)
+    {
+        nErased += pool.EraseForPeer(peer);
+    }
+    BOOST_CHECK_EQUAL(nErased, 100U);
+    BOOST_CHECK_EQUAL(pool.GetTotalBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
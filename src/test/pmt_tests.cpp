@@ -118,6 +118,43 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(pmt_tree_levels)
+{
+    seed_insecure_rand(false);
+    static const unsigned int nTxCounts[] = {1, 2, 3, 7, 17, 100, 513, 1000};
+
+    for (unsigned int nTx : nTxCounts)
+    {
+        CBlock block;
+        std::vector<uint256> vTxid;
+        for (unsigned int j = 0; j < nTx; j++)
+        {
+            CTransaction tx;
+            tx.nLockTime = j;
+            block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+            vTxid.push_back(block.vtx.back()->GetHash());
+        }
+
+        // the top level is the merkle root
+        CMerkleTreeLevels levels(vTxid);
+        BOOST_CHECK_EQUAL(levels.vLevels.back().size(), 1U);
+        BOOST_CHECK(levels.vLevels.back()[0] == BlockMerkleRoot(block));
+
+        // a tree taken from the levels is the one computed from the txids
+        for (int att = 0; att < 8; att++)
+        {
+            std::vector<bool> vMatch(nTx, false);
+            for (unsigned int j = 0; j < nTx; j++)
+                vMatch[j] = (insecure_rand() & ((1 << att) - 1)) == 0;
+            CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION);
+            ss1 << CPartialMerkleTree(vTxid, vMatch);
+            CDataStream ss2(SER_NETWORK, PROTOCOL_VERSION);
+            ss2 << CPartialMerkleTree(levels, vMatch);
+            BOOST_CHECK(ss1.str() == ss2.str());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(pmt_malleability)
 {
     std::vector<uint256> vTxid = boost::assign::list_of(ArithToUint256(1))(ArithToUint256(2))(ArithToUint256(3))(
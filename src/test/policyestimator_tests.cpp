@@ -3,7 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "policy/fees.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util/util.h"
@@ -212,4 +214,84 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesBetweenBlocks)
+{
+    CTxMemPool mpool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    CAmount basefee(2000);
+    std::list<CTransactionRef> dummyConflicted;
+
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+
+    // Every block mines the 3 higher fees at once and the 2 lower ones after 2 blocks, 4 transactions of each fee
+    // get enough of them into the buckets for an estimate
+    std::vector<CTransactionRef> block;
+    std::vector<CTransactionRef> waiting;
+    std::vector<CTransactionRef> waitingLonger;
+    int blocknum = 0;
+    while (blocknum < 100)
+    {
+        for (int j = 0; j < 5; j++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                tx.vin[0].prevout.n = 100 * blocknum + 10 * j + k;
+                mpool.addUnchecked(tx.GetHash(), entry.Fee(basefee * (j + 1)).Height(blocknum).FromTx(tx, &mpool));
+                (j < 2 ? waiting : block).push_back(MakeTransactionRef(tx));
+            }
+        }
+        block.insert(block.end(), waitingLonger.begin(), waitingLonger.end());
+        waitingLonger.swap(waiting);
+        waiting.clear();
+        mpool.removeForBlock(block, ++blocknum, dummyConflicted);
+        block.clear();
+    }
+
+    std::vector<CAmount> vEstimates;
+    for (int i = 1; i <= 5; i++)
+        vEstimates.push_back(mpool.estimateFee(i).GetFeePerK());
+    BOOST_CHECK(vEstimates[0] > 0);
+
+    // Transactions entering the mempool at the best height do not count yet, the estimates stay what they were
+    for (int j = 0; j < 20; j++)
+    {
+        tx.vin[0].prevout.n = 1000000 + j;
+        mpool.addUnchecked(tx.GetHash(), entry.Fee(basefee).Height(blocknum).FromTx(tx, &mpool));
+        block.push_back(MakeTransactionRef(tx));
+    }
+    for (int i = 1; i <= 5; i++)
+        BOOST_CHECK_EQUAL(mpool.estimateFee(i).GetFeePerK(), vEstimates[i - 1]);
+
+    // Mine everything, so the mempool a copy of the estimates is read into does not lack any transactions
+    block.insert(block.end(), waitingLonger.begin(), waitingLonger.end());
+    mpool.removeForBlock(block, ++blocknum, dummyConflicted);
+    BOOST_CHECK_EQUAL(mpool.size(), 0U);
+    vEstimates.clear();
+    for (int i = 1; i <= 5; i++)
+        vEstimates.push_back(mpool.estimateFee(i).GetFeePerK());
+
+    // Written and read back, the decay that was not applied to the stored averages yet is part of what is written.
+    // Read into an estimator of its own, ReadFeeEstimates turns the file down since the version it requires,
+    // 0.10.99 as numbered upstream, is above the one of this client
+    {
+        FILE *file = tmpfile();
+        BOOST_REQUIRE(file);
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(mpool.WriteFeeEstimates(fileout));
+        rewind(fileout.Get());
+        int nVersionRequired, nVersionThatWrote;
+        fileout >> nVersionRequired >> nVersionThatWrote;
+        CBlockPolicyEstimator estimatorRead(CFeeRate(1000));
+        estimatorRead.Read(fileout);
+        for (int i = 1; i <= 5; i++)
+        {
+            BOOST_CHECK(estimatorRead.estimateFee(i).GetFeePerK() <= vEstimates[i - 1] + 1);
+            BOOST_CHECK(estimatorRead.estimateFee(i).GetFeePerK() >= vEstimates[i - 1] - 1);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,85 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "memusage.h"
+#include "support/allocators/pool.h"
+#include "test/test_bitcoin.h"
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_reuses_freed_blocks)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(resource.NumFreeBytes(), 1024U);
+
+    // a freed block is handed out again for the next allocation of its size
+    void *a = resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(resource.NumFreeBytes(), 1000U);
+    resource.Deallocate(a, 24, 8);
+    BOOST_CHECK_EQUAL(resource.NumFreeBytes(), 1024U);
+    BOOST_CHECK(resource.Allocate(24, 8) == a);
+    // sizes are rounded up to the alignment, 20 bytes use a 24 byte block
+    resource.Deallocate(a, 24, 8);
+    BOOST_CHECK(resource.Allocate(20, 8) == a);
+    // but other sizes do not get it
+    resource.Deallocate(a, 20, 8);
+    BOOST_CHECK(resource.Allocate(32, 8) != a);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // a chunk holds 16 blocks of 64 bytes, once it runs out the next is taken
+    std::vector<void *> vBlocks;
+    for (int i = 0; i < 32; i++)
+        vBlocks.push_back(resource.Allocate(64, 8));
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+    for (void *p : vBlocks)
+        resource.Deallocate(p, 64, 8);
+    const size_t nFree = resource.NumFreeBytes();
+    for (int i = 0; i < 32; i++)
+        resource.Allocate(64, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+    BOOST_CHECK_EQUAL(resource.NumFreeBytes(), nFree - 32 * 64);
+
+    // larger blocks are not pooled
+    void *big = resource.Allocate(1000, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+    resource.Deallocate(big, 1000, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocated_map)
+{
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+        PoolAllocator<std::pair<const uint64_t, uint64_t>, 64> >
+        Map;
+    Map::allocator_type::ResourceType resource(4096);
+    {
+        Map map(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), &resource);
+        for (uint64_t i = 0; i < 10000; i++)
+            map[i] = i * 2;
+        for (uint64_t i = 0; i < 10000; i += 2)
+            map.erase(i);
+        for (uint64_t i = 1; i < 10000; i += 2)
+            BOOST_CHECK_EQUAL(map[i], i * 2);
+
+        // the usage is that of the chunks, the erased nodes are still in them
+        const size_t nChunks = resource.NumAllocatedChunks();
+        BOOST_CHECK(nChunks > 1);
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(map),
+            memusage::MallocUsage(resource.ChunkSizeBytes()) * nChunks +
+                memusage::MallocUsage(sizeof(void *) * map.bucket_count()));
+
+        // and filling the map up again reuses them
+        for (uint64_t i = 0; i < 10000; i += 2)
+            map[i] = i;
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain/block.h"
+#include "chain/tx.h"
+#include "keystore.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "script/sign.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "util/util.h"
+
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(prune_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(prune_keeps_spendable_transactions)
+{
+    const Consensus::Params &consensusParams = pnetMan->getActivePaymentNetwork()->GetConsensus();
+    // everything the chain has is in the first block file
+    FlushStateToDisk();
+    CBlockIndex *pindex = pnetMan->getChainActive()->chainActive[1];
+    BOOST_CHECK(pindex->nStatus & BLOCK_HAVE_DATA);
+    BOOST_CHECK_EQUAL(pindex->nFile, 0);
+
+    BOOST_CHECK(PruneOneBlockFile(0));
+    std::set<int> setFilesToPrune;
+    setFilesToPrune.insert(0);
+    UnlinkPrunedFiles(setFilesToPrune);
+    fHavePruned = true;
+
+    BOOST_CHECK(!(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)));
+    BOOST_CHECK_EQUAL(pindex->nDataPos, 0U);
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(0, 0), "blk")));
+    CBlock block;
+    BOOST_CHECK(!ReadBlockFromDisk(block, pindex, consensusParams));
+
+    // the coinbase of the block is unspent, staking still finds it and the block it came from
+    CTransaction tx;
+    uint256 hashBlock;
+    BOOST_CHECK(GetTransaction(coinbaseTxns[0]->GetHash(), tx, consensusParams, hashBlock));
+    BOOST_CHECK(tx == *coinbaseTxns[0]);
+    BOOST_CHECK(hashBlock == pindex->GetBlockHash());
+
+    // the copy is set aside by the block spending its last output, and put back when that block is disconnected
+    CBlockTreeDB *pblocktree = pnetMan->getChainActive()->pblocktree.get();
+    BOOST_REQUIRE_EQUAL(coinbaseTxns[0]->vout.size(), 1U);
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+    CTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(coinbaseTxns[0]->GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = coinbaseTxns[0]->vout[0].nValue - CENT;
+    txSpend.vout[0].scriptPubKey = coinbaseTxns[0]->vout[0].scriptPubKey;
+    BOOST_CHECK(SignSignature(keystore, *coinbaseTxns[0], txSpend, 0));
+    txSpend.UpdateHash();
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CBlock blockSpend =
+        CreateAndProcessBlock(std::vector<CTransactionRef>(1, MakeTransactionRef(txSpend)), scriptPubKey);
+    BOOST_REQUIRE(pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash() == blockSpend.GetHash());
+    BOOST_CHECK(!pblocktree->ReadPrunedTx(coinbaseTxns[0]->GetHash(), hashBlock, tx));
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(DisconnectTip(state, consensusParams));
+    }
+    BOOST_CHECK(pblocktree->ReadPrunedTx(coinbaseTxns[0]->GetHash(), hashBlock, tx));
+    BOOST_CHECK(tx == *coinbaseTxns[0]);
+    BOOST_CHECK(hashBlock == pindex->GetBlockHash());
+    BOOST_CHECK(pblocktree->EstimatePrunedTxsSize() <= CalculateCurrentUsage());
+
+    fHavePruned = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
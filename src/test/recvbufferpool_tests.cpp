@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/recvbufferpool.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(recvbufferpool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(recvbufferpool_reuse)
+{
+    CRecvBufferPool pool;
+    uint64_t nHits, nMisses;
+
+    CPublicSerializeData vch;
+    pool.Get(vch, 100);
+    BOOST_CHECK(vch.empty());
+    BOOST_CHECK(vch.capacity() >= CRecvBufferPool::MIN_BUFFER_SIZE);
+    vch.insert(vch.end(), 100, 'x');
+    const char *pBuffer = vch.data();
+    pool.Release(vch);
+    BOOST_CHECK(vch.empty());
+
+    // the same buffer comes back for a message of the same class, emptied
+    pool.Get(vch, 1000);
+    BOOST_CHECK(vch.empty());
+    BOOST_CHECK(vch.data() == pBuffer);
+    pool.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 1U);
+
+    // but not for a larger one
+    CPublicSerializeData vchLarge;
+    pool.Get(vchLarge, 5000);
+    BOOST_CHECK(vchLarge.capacity() >= 5000);
+    pool.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nMisses, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(recvbufferpool_large)
+{
+    CRecvBufferPool pool;
+    uint64_t nHits, nMisses;
+
+    // nothing past the largest class is allocated up front
+    CPublicSerializeData vch;
+    pool.Get(vch, 32 * 1024 * 1024);
+    BOOST_CHECK(vch.capacity() >= CRecvBufferPool::MAX_BUFFER_SIZE);
+    BOOST_CHECK(vch.capacity() < 2 * CRecvBufferPool::MAX_BUFFER_SIZE);
+
+    // a buffer that grew past it is freed rather than kept
+    vch.resize(2 * CRecvBufferPool::MAX_BUFFER_SIZE);
+    pool.Release(vch);
+    pool.Get(vch, CRecvBufferPool::MAX_BUFFER_SIZE);
+    pool.GetStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nHits, 0U);
+    BOOST_CHECK_EQUAL(nMisses, 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,198 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "args.h"
+#include "chain/block.h"
+#include "chain/chainman.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** An in-memory chainstate that can be left the way a write interrupted after some of its batches leaves it */
+class CCoinsViewDBInterrupted : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBInterrupted() : CCoinsViewDB(1 << 20, true) {}
+    void Interrupt(const uint256 &hashNew, const uint256 &hashOld)
+    {
+        // the best block, head blocks and totals records of txdb.cpp
+        CDBBatch batch(db);
+        batch.Erase('B');
+        batch.Write('H', std::vector<uint256>{hashNew, hashOld});
+        batch.Erase('S');
+        BOOST_REQUIRE(db.WriteBatch(batch));
+    }
+};
+
+void CopyCoins(const CCoinsView &from, CCoinsView &to)
+{
+    CCoinsViewCache cache(&to);
+    std::unique_ptr<CCoinsViewCursor> pcursor(from.Cursor());
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        cache.AddCoin(key, std::move(coin), false);
+    }
+    cache.SetBestBlock(from.GetBestBlock());
+    BOOST_REQUIRE(cache.Flush());
+}
+
+CTxOutSetStats CountTxOutSet(const CCoinsView &view)
+{
+    CTxOutSetStats stats;
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        stats.Add(key, coin);
+    }
+    return stats;
+}
+
+void CheckTxOutSet(const CCoinsViewDB &view, const CTxOutSetStats &expected)
+{
+    CTxOutSetStats stats = CountTxOutSet(view);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+    BOOST_CHECK(stats.muhash.Finalize() == expected.muhash.Finalize());
+
+    // the totals that are kept agree
+    CTxOutSetStats statsKept;
+    BOOST_REQUIRE(view.GetTxOutSetStats(statsKept));
+    BOOST_CHECK_EQUAL(statsKept.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK(statsKept.muhash.Finalize() == expected.muhash.Finalize());
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(replayblocks_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(replayblocks_interrupted_write)
+{
+    const CNetworkTemplate &chainparams = *pnetMan->getActivePaymentNetwork();
+    FlushStateToDisk();
+    const CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+    const CBlockIndex *pindexOld = pindexTip->pprev->pprev;
+    const uint256 hashTip = pindexTip->GetBlockHash();
+    const uint256 hashOld = pindexOld->GetBlockHash();
+    BOOST_REQUIRE(pcoinsdbview->GetBestBlock() == hashTip);
+
+    // the chainstates of both blocks
+    CCoinsViewDBInterrupted dbTip;
+    CopyCoins(*pcoinsdbview, dbTip);
+    CCoinsViewDBInterrupted dbOld;
+    CopyCoins(*pcoinsdbview, dbOld);
+    {
+        CCoinsViewCache cache(&dbOld);
+        for (const CBlockIndex *pindex = pindexTip; pindex != pindexOld; pindex = pindex->pprev)
+        {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+            CValidationState state;
+            BOOST_REQUIRE(DisconnectBlock(block, state, pindex, cache));
+        }
+        BOOST_REQUIRE(cache.Flush());
+    }
+    BOOST_REQUIRE(dbOld.GetBestBlock() == hashOld);
+    const CTxOutSetStats statsTip = CountTxOutSet(dbTip);
+    const CTxOutSetStats statsOld = CountTxOutSet(dbOld);
+    BOOST_CHECK(statsTip.muhash.Finalize() != statsOld.muhash.Finalize());
+
+    // A write stopped before any of its coins or after all of them, to the tip or back from it. Writing and erasing
+    // coins can be repeated, so these are the cases any mix of them comes down to.
+    for (int nWritten = 0; nWritten < 2; nWritten++)
+    {
+        for (int nForward = 0; nForward < 2; nForward++)
+        {
+            const uint256 &hashFrom = nForward ? hashOld : hashTip;
+            const uint256 &hashTo = nForward ? hashTip : hashOld;
+            CCoinsViewDBInterrupted db;
+            CopyCoins(nWritten == nForward ? dbTip : dbOld, db);
+            db.Interrupt(hashTo, hashFrom);
+            BOOST_CHECK(db.GetBestBlock().IsNull());
+            BOOST_CHECK_EQUAL(db.GetHeadBlocks().size(), 2U);
+
+            // as at startup, the totals are counted before the blocks are replayed
+            BOOST_REQUIRE(db.Upgrade());
+            BOOST_REQUIRE(ReplayBlocks(chainparams, &db));
+            BOOST_CHECK(db.GetBestBlock() == hashTo);
+            BOOST_CHECK(db.GetHeadBlocks().empty());
+            CheckTxOutSet(db, nForward ? statsTip : statsOld);
+
+            // nothing is left to replay
+            BOOST_CHECK(ReplayBlocks(chainparams, &db));
+            BOOST_CHECK(db.GetBestBlock() == hashTo);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(replayblocks_batches_keep_heads)
+{
+    // a write in many batches ends with the best block and no head blocks
+    gArgs.ForceSetArg("-dbbatchsize", "1");
+    CCoinsViewDBInterrupted db;
+    CopyCoins(*pcoinsdbview, db);
+    gArgs.ForceSetArg("-dbbatchsize", std::to_string(nMaxDBBatchSize));
+    BOOST_CHECK(db.GetBestBlock() == pcoinsdbview->GetBestBlock());
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    BOOST_CHECK(CountTxOutSet(db).muhash.Finalize() == CountTxOutSet(*pcoinsdbview).muhash.Finalize());
+}
+
+BOOST_AUTO_TEST_CASE(disconnecttip_recent_blocks)
+{
+    const CNetworkTemplate &chainparams = *pnetMan->getActivePaymentNetwork();
+    LOCK(cs_main);
+    CChainManager *pchainman = pnetMan->getChainActive();
+    const CBlockIndex *pindexTip = pchainman->chainActive.Tip();
+    const CBlockIndex *pindexOld = pindexTip->pprev->pprev;
+
+    // the coins as disconnecting the blocks and the undo data read from disk leaves them
+    CCoinsViewCache cacheDisk(pchainman->pcoinsTip.get());
+    std::vector<COutPoint> vOutPoints;
+    for (const CBlockIndex *pindex = pindexTip; pindex != pindexOld; pindex = pindex->pprev)
+    {
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+        CValidationState state;
+        BOOST_REQUIRE(DisconnectBlock(block, state, pindex, cacheDisk));
+        for (const CTransactionRef &ptx : block.vtx)
+        {
+            for (unsigned int i = 0; i < ptx->vout.size(); i++)
+                vOutPoints.push_back(COutPoint(ptx->GetHash(), i));
+            if (!ptx->IsCoinBase())
+                for (const CTxIn &txin : ptx->vin)
+                    vOutPoints.push_back(txin.prevout);
+        }
+    }
+
+    // the fixture connected these blocks last, DisconnectTip takes them and their undo data from memory
+    for (int i = 0; i < 2; i++)
+    {
+        CValidationState state;
+        BOOST_REQUIRE(DisconnectTip(state, chainparams.GetConsensus()));
+    }
+    BOOST_CHECK(pchainman->chainActive.Tip() == pindexOld);
+    BOOST_CHECK(pchainman->pcoinsTip->GetBestBlock() == pindexOld->GetBlockHash());
+    for (const COutPoint &outpoint : vOutPoints)
+    {
+        BOOST_CHECK_EQUAL(pchainman->pcoinsTip->HaveCoin(outpoint), cacheDisk.HaveCoin(outpoint));
+        BOOST_CHECK(pchainman->pcoinsTip->AccessCoin(outpoint).out == cacheDisk.AccessCoin(outpoint).out);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,11 +2,20 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "rpc/jsonstream.h"
 #include "rpc/rpcclient.h"
 #include "rpc/rpcserver.h"
+#include "rpc/rpcunix.h"
 
+#include "args.h"
 #include "base58.h"
+#include "core_io.h"
+#include "crypto/common.h"
+#include "keystore.h"
+#include "main.h"
 #include "net/netbase.h"
+#include "networks/netman.h"
+#include "script/sign.h"
 
 #include "test/test_bitcoin.h"
 
@@ -15,6 +24,12 @@
 
 #include <univalue.h>
 
+#ifndef WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 UniValue CallRPC(std::string args)
 {
     std::vector<std::string> vArgs;
@@ -91,6 +106,47 @@ BOOST_AUTO_TEST_CASE(rpc_rawparams)
     BOOST_CHECK_THROW(CallRPC(std::string("sendrawtransaction ") + rawtx + " extra"), std::runtime_error);
 }
 
+BOOST_FIXTURE_TEST_CASE(rpc_sendrawtransactions, TestChain100Setup)
+{
+    mempool.clear();
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions not_array"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions [] not_bool"), std::runtime_error);
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallRPC("sendrawtransactions []"));
+    BOOST_CHECK(r.isArray() && r.empty());
+
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+    const CTransaction &txFrom = *coinbaseTxns[0];
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txFrom.vout[0].nValue - CENT;
+    tx.vout[0].scriptPubKey = txFrom.vout[0].scriptPubKey;
+    BOOST_REQUIRE(SignSignature(keystore, txFrom, tx, 0));
+    const std::string strHex = EncodeHexTx(tx);
+
+    // one result per hex string, in the order given
+    BOOST_CHECK_NO_THROW(r = CallRPC("sendrawtransactions [\"" + strHex + "\",\"zz\",\"" + strHex + "\"]"));
+    BOOST_REQUIRE_EQUAL(r.size(), 3U);
+    BOOST_CHECK_EQUAL(find_value(r[0], "txid").get_str(), tx.GetHash().GetHex());
+    BOOST_CHECK(find_value(r[0], "accepted").get_bool());
+    BOOST_CHECK(find_value(r[0], "error").isNull());
+    BOOST_CHECK(!find_value(r[1], "accepted").get_bool());
+    BOOST_CHECK_EQUAL(find_value(r[1], "error").get_str(), "TX decode failed");
+    BOOST_CHECK(!find_value(r[2], "accepted").get_bool());
+    BOOST_CHECK(find_value(r[2], "error").isStr());
+    BOOST_CHECK(mempool.exists(tx.GetHash()));
+
+    // one that is in the pool already is reported as accepted again, without another try
+    BOOST_CHECK_NO_THROW(r = CallRPC("sendrawtransactions [\"" + strHex + "\"]"));
+    BOOST_REQUIRE_EQUAL(r.size(), 1U);
+    BOOST_CHECK(find_value(r[0], "accepted").get_bool());
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_CASE(rpc_rawsign)
 {
     UniValue r;
@@ -428,4 +484,165 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    if (RPCIsInWarmup(nullptr))
+        SetRPCWarmupFinished();
+
+    // runs of read only requests around ones that are not, with replies that tell the requests apart
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 20; i++)
+    {
+        UniValue req(UniValue::VOBJ);
+        req.push_back(Pair("id", i));
+        if (i % 7 == 3)
+            req.push_back(Pair("method", "nosuchmethod"));
+        else if (i % 7 == 5)
+        {
+            UniValue params(UniValue::VARR);
+            params.push_back("decodescript");
+            req.push_back(Pair("method", "help"));
+            req.push_back(Pair("params", params));
+        }
+        else
+        {
+            UniValue params(UniValue::VARR);
+            params.push_back(i % 2 == 0 ? "6a" : "51");
+            req.push_back(Pair("method", "decodescript"));
+            req.push_back(Pair("params", params));
+        }
+        vReq.push_back(req);
+    }
+
+    gArgs.ForceSetArg("-rpcbatchthreads", "1");
+    std::string strSerial = JSONRPCExecBatch(vReq);
+    gArgs.ForceSetArg("-rpcbatchthreads", "4");
+    std::string strParallel = JSONRPCExecBatch(vReq);
+    BOOST_CHECK_EQUAL(strParallel, strSerial);
+
+    UniValue vReplies;
+    BOOST_REQUIRE(vReplies.read(strParallel));
+    BOOST_REQUIRE_EQUAL(vReplies.size(), vReq.size());
+    for (unsigned int i = 0; i < vReplies.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(find_value(vReplies[i], "id").get_int(), (int)i);
+        BOOST_CHECK_EQUAL(find_value(vReplies[i], "error").isNull(), i % 7 != 3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream)
+{
+    UniValue inner(UniValue::VARR);
+    inner.push_back(1);
+    inner.push_back("two \"quoted\"\n");
+    inner.push_back(UniValue(UniValue::VOBJ));
+    UniValue before(UniValue::VOBJ);
+    before.push_back(Pair("a", 1.5));
+    before.push_back(Pair("b", NullUniValue));
+    UniValue expected(UniValue::VOBJ);
+    expected.pushKVs(before);
+    expected.push_back(Pair("list", inner));
+    expected.push_back(Pair("empty", UniValue(UniValue::VARR)));
+    expected.push_back(Pair("last", true));
+
+    // chunks as small as one byte join up to what UniValue writes
+    std::vector<std::string> vChunks;
+    CJSONStreamWriter writer([&vChunks](const std::string &strChunk) { vChunks.push_back(strChunk); }, 1);
+    writer.BeginObject();
+    writer.Fields(before);
+    writer.Key("list");
+    writer.BeginArray();
+    for (const UniValue &value : inner.getValues())
+        writer.Value(value);
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Key("last");
+    writer.Value(true);
+    writer.EndObject();
+    writer.Flush();
+    BOOST_CHECK(vChunks.size() > 1);
+    BOOST_CHECK_EQUAL(boost::algorithm::join(vChunks, ""), expected.write());
+    BOOST_CHECK_EQUAL(writer.GetFlushed(), expected.write().size());
+
+    // the streamed getblock is the one getblock returns, and the plain form is left to it
+    if (RPCIsInWarmup(nullptr))
+        SetRPCWarmupFinished();
+    std::string strHash = pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash().GetHex();
+    std::string strStreamed;
+    CJSONStreamWriter blockWriter([&strStreamed](const std::string &strChunk) { strStreamed += strChunk; });
+    UniValue params(UniValue::VARR);
+    params.push_back(strHash);
+    UniValue paramsHex = params;
+    paramsHex.push_back(false);
+    BOOST_CHECK(!tableRPC.executeStream("getblock", paramsHex, blockWriter));
+    BOOST_CHECK(!tableRPC.executeStream("getblockcount", UniValue(UniValue::VARR), blockWriter));
+    BOOST_CHECK(tableRPC.executeStream("getblock", params, blockWriter));
+    blockWriter.Flush();
+    BOOST_CHECK_EQUAL(strStreamed, CallRPC("getblock " + strHash).write());
+}
+
+#ifndef WIN32
+/** Send a request frame on fd and read the reply frame, empty if the connection closed */
+static std::string RPCUnixCall(int fd, const std::string &strRequest)
+{
+    unsigned char header[4];
+    WriteLE32(header, strRequest.size());
+    std::string strFrame((const char *)header, sizeof(header));
+    strFrame += strRequest;
+    if (send(fd, strFrame.data(), strFrame.size(), 0) != (ssize_t)strFrame.size())
+        return "";
+    if (recv(fd, header, sizeof(header), MSG_WAITALL) != sizeof(header))
+        return "";
+    std::string strReply(ReadLE32(header), '\0');
+    if (recv(fd, &strReply[0], strReply.size(), MSG_WAITALL) != (ssize_t)strReply.size())
+        return "";
+    return strReply;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_unix_socket)
+{
+    if (RPCIsInWarmup(nullptr))
+        SetRPCWarmupFinished();
+    const fs::path path = pathTemp / "rpc.sock";
+    gArgs.ForceSetArg("-rpcunixsocket", path.string());
+    BOOST_REQUIRE(StartRPCUnixSocket());
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.string().c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    BOOST_REQUIRE(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+    // one connection for several requests, singles and batches get what the HTTP server would reply
+    UniValue reply;
+    const int nHeight = pnetMan->getChainActive()->chainActive.Height();
+    for (int i = 0; i < 3; i++)
+    {
+        BOOST_REQUIRE(reply.read(RPCUnixCall(fd, "{\"id\":7,\"method\":\"getblockcount\",\"params\":[]}")));
+        BOOST_CHECK_EQUAL(find_value(reply, "result").get_int(), nHeight);
+        BOOST_CHECK_EQUAL(find_value(reply, "id").get_int(), 7);
+    }
+    BOOST_REQUIRE(reply.read(RPCUnixCall(fd, "[{\"id\":1,\"method\":\"getblockcount\"},{\"id\":2,\"method\":\"x\"}]")));
+    BOOST_REQUIRE_EQUAL(reply.size(), 2U);
+    BOOST_CHECK(find_value(reply[0], "error").isNull());
+    BOOST_CHECK_EQUAL(find_value(find_value(reply[1], "error"), "code").get_int(), RPC_METHOD_NOT_FOUND);
+    BOOST_REQUIRE(reply.read(RPCUnixCall(fd, "not json")));
+    BOOST_CHECK_EQUAL(find_value(find_value(reply, "error"), "code").get_int(), RPC_PARSE_ERROR);
+
+    // a frame larger than a request may be closes the connection
+    unsigned char header[4];
+    WriteLE32(header, MAX_RPC_UNIX_REQUEST_SIZE + 1);
+    BOOST_CHECK_EQUAL(send(fd, header, sizeof(header), 0), (ssize_t)sizeof(header));
+    BOOST_CHECK_EQUAL(recv(fd, header, sizeof(header), MSG_WAITALL), 0);
+    close(fd);
+
+    StopRPCUnixSocket();
+    BOOST_CHECK(!fs::exists(path));
+    gArgs.ForceSetArg("-rpcunixsocket", "");
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
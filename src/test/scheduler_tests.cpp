@@ -0,0 +1,71 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "scheduler.h"
+
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(scheduler_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(scheduler_order)
+{
+    CScheduler scheduler;
+    std::mutex cs;
+    std::vector<int> vRun;
+    std::atomic<int> nDone(0);
+    auto task = [&](int n) {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            vRun.push_back(n);
+        }
+        nDone++;
+    };
+
+    // queued before the thread runs, they run by due time, the ones due at the same time as scheduled
+    const CScheduler::TimePoint now = std::chrono::steady_clock::now();
+    scheduler.Schedule(std::bind(task, 3), now + std::chrono::milliseconds(40));
+    scheduler.Schedule(std::bind(task, 1), now + std::chrono::milliseconds(20));
+    scheduler.Schedule(std::bind(task, 2), now + std::chrono::milliseconds(20));
+    scheduler.Schedule(std::bind(task, 0), now);
+    CScheduler::TimePoint first;
+    BOOST_CHECK_EQUAL(scheduler.GetQueueInfo(first), 4U);
+    BOOST_CHECK(first == now);
+
+    scheduler.Start();
+    while (nDone.load() < 4)
+        MilliSleep(1);
+    scheduler.Stop();
+
+    BOOST_CHECK_EQUAL(scheduler.GetQueueInfo(first), 0U);
+    const std::vector<int> vExpected = {0, 1, 2, 3};
+    BOOST_CHECK(vRun == vExpected);
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_every)
+{
+    CScheduler scheduler;
+    std::atomic<int> nRuns(0);
+    scheduler.Start(2);
+    scheduler.ScheduleEvery([&]() { nRuns++; }, 1);
+    while (nRuns.load() < 5)
+        MilliSleep(1);
+
+    // the repetition is dropped with the queue, nothing runs or is queued once stopped
+    scheduler.Stop();
+    const int nStopped = nRuns.load();
+    CScheduler::TimePoint first;
+    BOOST_CHECK_EQUAL(scheduler.GetQueueInfo(first), 0U);
+    scheduler.ScheduleFromNow([&]() { nRuns++; }, 0);
+    BOOST_CHECK_EQUAL(scheduler.GetQueueInfo(first), 0U);
+    MilliSleep(10);
+    BOOST_CHECK_EQUAL(nRuns.load(), nStopped);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
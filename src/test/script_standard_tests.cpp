@@ -0,0 +1,81 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+typedef std::vector<unsigned char> valtype;
+
+BOOST_FIXTURE_TEST_SUITE(script_standard_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(solver_standard)
+{
+    CKey key[2];
+    key[0].MakeNewKey(true);
+    key[1].MakeNewKey(false);
+    const valtype vchPubKey0 = ToByteVector(key[0].GetPubKey());
+    const valtype vchPubKey1 = ToByteVector(key[1].GetPubKey());
+    std::vector<valtype> solutions;
+    txnouttype whichType;
+
+    CScript s;
+    s << vchPubKey1 << OP_CHECKSIG;
+    BOOST_CHECK(Solver(s, whichType, solutions));
+    BOOST_CHECK(whichType == TX_PUBKEY);
+    BOOST_CHECK(solutions.size() == 1 && solutions[0] == vchPubKey1);
+
+    s = GetScriptForDestination(key[0].GetPubKey().GetID());
+    BOOST_CHECK(Solver(s, whichType, solutions));
+    BOOST_CHECK(whichType == TX_PUBKEYHASH);
+    BOOST_CHECK(solutions.size() == 1 && solutions[0] == ToByteVector(key[0].GetPubKey().GetID()));
+
+    s = GetScriptForDestination(CScriptID(s));
+    BOOST_CHECK(Solver(s, whichType, solutions));
+    BOOST_CHECK(whichType == TX_SCRIPTHASH);
+    BOOST_CHECK_EQUAL(solutions.size(), 1U);
+
+    s = CScript() << OP_1 << vchPubKey0 << vchPubKey1 << OP_2 << OP_CHECKMULTISIG;
+    BOOST_CHECK(Solver(s, whichType, solutions));
+    BOOST_CHECK(whichType == TX_MULTISIG);
+    BOOST_CHECK_EQUAL(solutions.size(), 4U);
+    BOOST_CHECK(solutions[0] == valtype(1, 1));
+    BOOST_CHECK(solutions[1] == vchPubKey0);
+    BOOST_CHECK(solutions[2] == vchPubKey1);
+    BOOST_CHECK(solutions[3] == valtype(1, 2));
+}
+
+BOOST_AUTO_TEST_CASE(solver_fallback)
+{
+    // scripts the fast paths of Solver do not take are still solved, or not, by the template walker
+    CKey key;
+    key.MakeNewKey(true);
+    const valtype vchPubKey = ToByteVector(key.GetPubKey());
+    std::vector<valtype> solutions;
+    txnouttype whichType;
+
+    CScript s;
+    s.push_back(OP_PUSHDATA1);
+    s.push_back(vchPubKey.size());
+    s.insert(s.end(), vchPubKey.begin(), vchPubKey.end());
+    s << OP_CHECKSIG;
+    BOOST_CHECK(Solver(s, whichType, solutions));
+    BOOST_CHECK(whichType == TX_PUBKEY);
+    BOOST_CHECK(solutions.size() == 1 && solutions[0] == vchPubKey);
+
+    s = CScript() << OP_1 << vchPubKey << vchPubKey << OP_1 << OP_CHECKMULTISIG;
+    BOOST_CHECK(!Solver(s, whichType, solutions));
+    s = CScript() << OP_2 << vchPubKey << OP_1 << OP_CHECKMULTISIG;
+    BOOST_CHECK(!Solver(s, whichType, solutions));
+    s = CScript() << OP_0 << vchPubKey << OP_1 << OP_CHECKMULTISIG;
+    BOOST_CHECK(!Solver(s, whichType, solutions));
+    s = CScript() << valtype(32, 2) << OP_CHECKSIG;
+    BOOST_CHECK(!Solver(s, whichType, solutions));
+    BOOST_CHECK(whichType == TX_NONSTANDARD);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "random.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "script/script_error.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+// the signature checks look at the chain tip, so it needs one
+BOOST_FIXTURE_TEST_SUITE(scripteval_tests, TestingSetup)
+
+/** VerifyScript as it was before it evaluated on stacks of CStackValue, on stacks of std::vector. Without the
+ *  P2SH and CLEANSTACK checks, the flags used here leave those out.
+ */
+static bool VerifyOnVectors(const CScript &scriptSig,
+    const CScript &scriptPubKey,
+    unsigned int flags,
+    const BaseSignatureChecker &checker,
+    ScriptError *serror)
+{
+    std::vector<std::vector<unsigned char> > stack;
+    if (!EvalScript(stack, scriptSig, flags, checker, serror))
+        return false;
+    if (!EvalScript(stack, scriptPubKey, flags, checker, serror))
+        return false;
+    if (stack.empty() || !CastToBool(stack.back()))
+    {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    }
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
+static const opcodetype vOps[] = {OP_0, OP_1NEGATE, OP_1, OP_2, OP_3, OP_16, OP_NOP, OP_IF, OP_NOTIF, OP_ELSE,
+    OP_ENDIF, OP_VERIFY, OP_RETURN, OP_TOALTSTACK, OP_FROMALTSTACK, OP_2DROP, OP_2DUP, OP_3DUP, OP_2OVER, OP_2ROT,
+    OP_2SWAP, OP_IFDUP, OP_DEPTH, OP_DROP, OP_DUP, OP_NIP, OP_OVER, OP_PICK, OP_ROLL, OP_ROT, OP_SWAP, OP_TUCK,
+    OP_CAT, OP_SIZE, OP_EQUAL, OP_EQUALVERIFY, OP_1ADD, OP_1SUB, OP_NEGATE, OP_ABS, OP_NOT, OP_0NOTEQUAL, OP_ADD,
+    OP_SUB, OP_BOOLAND, OP_BOOLOR, OP_NUMEQUAL, OP_NUMEQUALVERIFY, OP_NUMNOTEQUAL, OP_LESSTHAN, OP_GREATERTHAN,
+    OP_LESSTHANOREQUAL, OP_GREATERTHANOREQUAL, OP_MIN, OP_MAX, OP_WITHIN, OP_RIPEMD160, OP_SHA1, OP_SHA256,
+    OP_HASH160, OP_HASH256, OP_CODESEPARATOR, OP_CHECKSIG, OP_CHECKSIGVERIFY, OP_CHECKMULTISIG, OP_NOP1, OP_NOP10};
+
+/** A script of random opcodes and pushes. Most pushes fit in a CStackValue, some do not and a few are too large
+ *  for the stack altogether.
+ */
+static CScript RandomScript(FastRandomContext &rng)
+{
+    CScript script;
+    const int nOps = rng.randrange(24);
+    for (int i = 0; i < nOps; i++)
+    {
+        switch (rng.randrange(4))
+        {
+        case 0:
+        {
+            size_t nSize = rng.randrange(8) == 0 ? rng.randrange(600) : rng.randrange(82);
+            std::vector<unsigned char> vch(nSize);
+            for (unsigned char &ch : vch)
+                ch = rng.randrange(4) == 0 ? rng.randbits(8) : 0;
+            script << vch;
+            break;
+        }
+        case 1:
+            script << CScriptNum((int64_t)rng.randrange(64) - 32);
+            break;
+        default:
+            script << vOps[rng.randrange(sizeof(vOps) / sizeof(vOps[0]))];
+        }
+    }
+    return script;
+}
+
+BOOST_AUTO_TEST_CASE(scripteval_matches_vector_stacks)
+{
+    FastRandomContext rng(true);
+    const unsigned int vFlags[] = {SCRIPT_VERIFY_NONE, SCRIPT_VERIFY_MINIMALDATA,
+        SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S | SCRIPT_VERIFY_NULLDUMMY |
+            SCRIPT_VERIFY_MINIMALDATA | SCRIPT_VERIFY_NULLFAIL};
+    BaseSignatureChecker checker;
+    int nPassed = 0;
+    for (int i = 0; i < 300000; i++)
+    {
+        const CScript scriptSig = RandomScript(rng);
+        const CScript scriptPubKey = RandomScript(rng);
+        const unsigned int flags = vFlags[rng.randrange(3)];
+        ScriptError err;
+        ScriptError errVectors;
+        const bool fPassed = VerifyScript(scriptSig, scriptPubKey, flags, checker, &err);
+        BOOST_CHECK_EQUAL(fPassed, VerifyOnVectors(scriptSig, scriptPubKey, flags, checker, &errVectors));
+        BOOST_CHECK_EQUAL(err, errVectors);
+        nPassed += fPassed;
+    }
+    // not only errors were compared
+    BOOST_CHECK(nPassed > 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
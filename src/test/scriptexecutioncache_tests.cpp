@@ -0,0 +1,117 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+// the signature checks look at the chain tip, so it needs one
+BOOST_FIXTURE_TEST_SUITE(scriptexecutioncache_tests, TestingSetup)
+
+struct SpendSetup
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins;
+    CBasicKeyStore keystore;
+    CTransaction txFrom;
+    CTransaction txTo;
+
+    /** txTo spends an output of txFrom to a new key, both are new each time so the cache has never seen them */
+    SpendSetup() : coins(&coinsDummy)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+
+        txFrom.vout.resize(1);
+        txFrom.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        txFrom.vout[0].nValue = 1000;
+        AddCoins(coins, txFrom, 0);
+
+        txTo.vin.resize(1);
+        txTo.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+        txTo.vout.resize(1);
+        txTo.vout[0].scriptPubKey = txFrom.vout[0].scriptPubKey;
+        txTo.vout[0].nValue = 900;
+        BOOST_REQUIRE(SignSignature(keystore, txFrom, txTo, 0));
+    }
+
+    /** The checks CheckInputScripts queues for txTo against view, none when the cache has it */
+    size_t Queued(const CCoinsViewCache &view, unsigned int flags, bool cacheFullScriptStore)
+    {
+        CValidationState state;
+        std::vector<CScriptCheck> vChecks;
+        BOOST_CHECK(CheckInputScripts(txTo, state, view, flags, true, cacheFullScriptStore, &vChecks));
+        return vChecks.size();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(scriptexecutioncache_hit_skips_checks)
+{
+    LOCK(cs_main);
+    SpendSetup setup;
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, flags, false), 1U);
+
+    CValidationState state;
+    BOOST_CHECK(CheckInputScripts(setup.txTo, state, setup.coins, flags, true, true));
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, flags, false), 0U);
+
+    // what it spends is not looked at again either, against an output it can not spend it still passes
+    CCoinsView coinsDummy;
+    CCoinsViewCache coinsOther(&coinsDummy);
+    CTransaction txFrom = setup.txFrom;
+    txFrom.vout[0].scriptPubKey = CScript() << OP_FALSE;
+    AddCoins(coinsOther, txFrom, 0);
+    BOOST_CHECK(CheckInputScripts(setup.txTo, state, coinsOther, flags, true, false));
+    BOOST_CHECK(state.IsValid());
+}
+
+BOOST_AUTO_TEST_CASE(scriptexecutioncache_flags_miss)
+{
+    LOCK(cs_main);
+    SpendSetup setup;
+    CValidationState state;
+    BOOST_CHECK(CheckInputScripts(setup.txTo, state, setup.coins, SCRIPT_VERIFY_P2SH, true, true));
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, SCRIPT_VERIFY_P2SH, false), 0U);
+
+    // passing under some flags says nothing about others, even fewer ones
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG, false), 1U);
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, SCRIPT_VERIFY_NONE, false), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(scriptexecutioncache_queued_not_stored)
+{
+    LOCK(cs_main);
+    SpendSetup setup;
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+
+    // queued checks have not passed yet, asking for them to be stored does not store them
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, flags, true), 1U);
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, flags, true), 1U);
+
+    // nor is a transaction that fails
+    SpendSetup bad;
+    bad.txTo.vin[0].scriptSig = CScript() << OP_0;
+    CValidationState state;
+    BOOST_CHECK(!CheckInputScripts(bad.txTo, state, bad.coins, flags, true, true));
+    BOOST_CHECK(!CheckInputScripts(bad.txTo, state, bad.coins, flags, true, true));
+    BOOST_CHECK_EQUAL(bad.Queued(bad.coins, flags, false), 1U);
+
+    // the first check run right here is
+    CValidationState stateGood;
+    BOOST_CHECK(CheckInputScripts(setup.txTo, stateGood, setup.coins, flags, true, true));
+    BOOST_CHECK_EQUAL(setup.Queued(setup.coins, flags, true), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "script/interpreter.h"
 #include "script/script.h"
 #include "scriptnum10.h"
 #include "test/test_bitcoin.h"
@@ -41,6 +42,13 @@ static void CheckCreateVch(const int64_t &num)
     CScriptNum10 bignum3(scriptnum2.getvch(), false);
     CScriptNum scriptnum3(bignum2.getvch(), false);
     BOOST_CHECK(verify(bignum3, scriptnum3));
+
+    // the interpreter stack holds numbers in prevectors, encoded the same
+    CStackValue value;
+    scriptnum.getvch(value);
+    BOOST_CHECK(std::vector<unsigned char>(value.begin(), value.end()) == scriptnum.getvch());
+    CScriptNum scriptnum4(value, false);
+    BOOST_CHECK(verify(bignum, scriptnum4));
 }
 
 static void CheckCreateInt(const int64_t &num)
@@ -0,0 +1,151 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/protocol.h"
+#include "net/sendlanes.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sendlanes_tests, BasicTestingSetup)
+
+// A message of nSize bytes whose header is its first byte, tagged with its lane.
+static void PushTagged(CSendLanes &lanes, SendLane lane, size_t nSize)
+{
+    CSendLanes::Buffer header = std::make_shared<const std::vector<uint8_t> >(1, (uint8_t)lane);
+    CSendLanes::Buffer payload = std::make_shared<const std::vector<uint8_t> >(nSize - 1, 0);
+    lanes.Push(lane, std::move(header), std::move(payload), nSize);
+}
+
+// The lanes of the messages taken from the lanes, in the order they would be sent.
+static std::vector<int> Drain(CSendLanes &lanes, int64_t nNow, int64_t nHistoryRate)
+{
+    std::deque<CSendLanes::Buffer> vSendMsg;
+    while (lanes.Schedule(vSendMsg, nNow, nHistoryRate) > 0)
+    {
+    }
+    std::vector<int> vLanes;
+    for (size_t i = 0; i < vSendMsg.size(); i += 2)
+        vLanes.push_back(vSendMsg[i]->at(0));
+    return vLanes;
+}
+
+BOOST_AUTO_TEST_CASE(sendlanes_commands)
+{
+    BOOST_CHECK_EQUAL(GetSendLane(NetMsgType::PING), SEND_LANE_CONTROL);
+    BOOST_CHECK_EQUAL(GetSendLane(NetMsgType::GETDATA), SEND_LANE_CONTROL);
+    BOOST_CHECK_EQUAL(GetSendLane(NetMsgType::HEADERS), SEND_LANE_BLOCK);
+    BOOST_CHECK_EQUAL(GetSendLane(NetMsgType::CMPCTBLOCK), SEND_LANE_BLOCK);
+    BOOST_CHECK_EQUAL(GetSendLane(NetMsgType::TX), SEND_LANE_TX);
+    BOOST_CHECK_EQUAL(GetSendLane(NetMsgType::INV), SEND_LANE_TX);
+    BOOST_CHECK_EQUAL(GetSendLane(NetMsgType::CFILTER), SEND_LANE_HISTORY);
+}
+
+BOOST_AUTO_TEST_CASE(sendlanes_priority)
+{
+    CSendLanes lanes;
+    // a megabyte of transactions is queued before a block and a ping
+    for (int i = 0; i < 4000; i++)
+        PushTagged(lanes, SEND_LANE_TX, 250);
+    PushTagged(lanes, SEND_LANE_BLOCK, 1000000);
+    PushTagged(lanes, SEND_LANE_CONTROL, 32);
+    BOOST_CHECK_EQUAL(lanes.size(), 4000 * 250 + 1000000 + 32U);
+    BOOST_CHECK_EQUAL(lanes.LaneSize(SEND_LANE_TX), 4000 * 250U);
+
+    const std::vector<int> vOrder = Drain(lanes, 0, 0);
+    BOOST_CHECK_EQUAL(vOrder.size(), 4002U);
+    BOOST_CHECK(lanes.empty());
+    BOOST_CHECK_EQUAL(vOrder[0], SEND_LANE_CONTROL);
+    // the block goes once its lane saved up for it, after a quarter of the transactions at most
+    size_t nBlock = std::find(vOrder.begin(), vOrder.end(), SEND_LANE_BLOCK) - vOrder.begin();
+    BOOST_CHECK(nBlock < 4000 / 4);
+    // transactions still go while the block saves up
+    BOOST_CHECK(nBlock > 1);
+    // and all of the transactions went
+    BOOST_CHECK_EQUAL(std::count(vOrder.begin(), vOrder.end(), SEND_LANE_TX), 4000);
+}
+
+BOOST_AUTO_TEST_CASE(sendlanes_weights)
+{
+    CSendLanes lanes;
+    for (int i = 0; i < 1000; i++)
+    {
+        PushTagged(lanes, SEND_LANE_BLOCK, 1000);
+        PushTagged(lanes, SEND_LANE_TX, 1000);
+        PushTagged(lanes, SEND_LANE_HISTORY, 1000);
+    }
+    // while all lanes are busy blocks get 8 parts of the bytes, transactions 2 and history 1
+    std::vector<int> vOrder = Drain(lanes, 0, 0);
+    vOrder.resize(1100);
+    const int nBlocks = std::count(vOrder.begin(), vOrder.end(), SEND_LANE_BLOCK);
+    const int nTxs = std::count(vOrder.begin(), vOrder.end(), SEND_LANE_TX);
+    const int nHistory = std::count(vOrder.begin(), vOrder.end(), SEND_LANE_HISTORY);
+    BOOST_CHECK(nBlocks > 3 * nTxs);
+    BOOST_CHECK(nTxs > nHistory);
+    BOOST_CHECK(nHistory > 0);
+}
+
+BOOST_AUTO_TEST_CASE(sendlanes_history_rate)
+{
+    CSendLanes lanes;
+    const int64_t nRate = 100000;
+    for (int i = 0; i < 10; i++)
+        PushTagged(lanes, SEND_LANE_HISTORY, 50000);
+    PushTagged(lanes, SEND_LANE_TX, 500);
+
+    // a second worth of history goes, it may overdraw by one message
+    std::vector<int> vOrder = Drain(lanes, 1000000, nRate);
+    BOOST_CHECK_EQUAL(std::count(vOrder.begin(), vOrder.end(), SEND_LANE_TX), 1);
+    BOOST_CHECK_EQUAL(std::count(vOrder.begin(), vOrder.end(), SEND_LANE_HISTORY), 2);
+    BOOST_CHECK_EQUAL(lanes.LaneSize(SEND_LANE_HISTORY), 8 * 50000U);
+
+    // nothing more until the overdraft is paid back
+    BOOST_CHECK(Drain(lanes, 1000000, nRate).empty());
+    BOOST_CHECK_EQUAL(Drain(lanes, 1200000, nRate).size(), 1U);
+    BOOST_CHECK(Drain(lanes, 1400000, nRate).empty());
+    BOOST_CHECK_EQUAL(Drain(lanes, 1600000, nRate).size(), 1U);
+
+    // without a limit the rest goes at once
+    BOOST_CHECK_EQUAL(Drain(lanes, 1600000, 0).size(), 6U);
+    BOOST_CHECK(lanes.empty());
+}
+
+BOOST_AUTO_TEST_CASE(sendlanes_coalesce)
+{
+    CSendLanes lanes;
+    for (int i = 0; i < 100; i++)
+        PushTagged(lanes, SEND_LANE_TX, 61);
+    PushTagged(lanes, SEND_LANE_BLOCK, 100000);
+    PushTagged(lanes, SEND_LANE_TX, 61);
+
+    // the small messages share buffers, as many as fit, the block keeps its own
+    std::deque<CSendLanes::Buffer> vSendMsg;
+    while (lanes.Schedule(vSendMsg, 0, 0, true) > 0)
+    {
+    }
+    BOOST_CHECK(lanes.empty());
+    size_t nBytes = 0;
+    size_t nLarge = 0;
+    for (const CSendLanes::Buffer &buffer : vSendMsg)
+    {
+        BOOST_CHECK(buffer->size() <= SEND_COALESCE_BUFFER_SIZE || buffer->size() == 100000 - 1);
+        nBytes += buffer->size();
+        nLarge += buffer->size() > SEND_COALESCE_BUFFER_SIZE;
+    }
+    BOOST_CHECK_EQUAL(nBytes, 101 * 61 + 100000U);
+    BOOST_CHECK_EQUAL(nLarge, 1U);
+    // the two buffers of the block and the ones of the transactions before and after it
+    BOOST_CHECK(vSendMsg.size() <= 4U);
+    for (const CSendLanes::Buffer &buffer : vSendMsg)
+    {
+        if (buffer->size() % 61 != 0 || buffer->at(0) != SEND_LANE_TX)
+            continue;
+        // one message after the other
+        for (size_t i = 0; i < buffer->size(); i += 61)
+            BOOST_CHECK_EQUAL(buffer->at(i), SEND_LANE_TX);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
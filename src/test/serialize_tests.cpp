@@ -4,7 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "serialize.h"
+#include "chain/outpoint.h"
 #include "crypto/hash.h"
+#include "net/protocol.h"
 #include "streams.h"
 #include "test/test_bitcoin.h"
 
@@ -394,4 +396,46 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(memory_image)
+{
+    std::vector<COutPoint> vOutPoints;
+    std::vector<uint32_t> vInts;
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        vOutPoints.push_back(COutPoint(Hash(BEGIN(i), END(i)), i * 0x01020304));
+        vInts.push_back(i * 0x01020304);
+    }
+
+    // the memory image is the bytes the fields serialize to one by one
+    CDataStream ssFields(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ssFields, vOutPoints.size());
+    for (const COutPoint &outpoint : vOutPoints)
+        ssFields << outpoint.hash << outpoint.n;
+    WriteCompactSize(ssFields, vInts.size());
+    for (uint32_t n : vInts)
+        ser_writedata32(ssFields, n);
+    ssFields << CInv(MSG_BLOCK, vOutPoints[1].hash);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vOutPoints << vInts << CInv(MSG_BLOCK, vOutPoints[1].hash);
+    BOOST_CHECK(ss.str() == ssFields.str());
+    BOOST_CHECK_EQUAL(GetSerializeSize(vOutPoints, SER_NETWORK, PROTOCOL_VERSION), 1 + 100 * 36);
+    BOOST_CHECK_EQUAL(GetSerializeSize(vInts, SER_NETWORK, PROTOCOL_VERSION), 1 + 100 * 4);
+
+    std::vector<COutPoint> vOutPointsRead;
+    std::vector<uint32_t> vIntsRead;
+    CInv inv;
+    ss >> vOutPointsRead >> vIntsRead >> inv;
+    BOOST_CHECK(vOutPointsRead == vOutPoints);
+    BOOST_CHECK(vIntsRead == vInts);
+    BOOST_CHECK(inv.type == MSG_BLOCK && inv.hash == vOutPoints[1].hash);
+    BOOST_CHECK(ss.empty());
+
+    // a vector longer than the stream fails the same way as one read element by element
+    CDataStream ssShort(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ssShort, 3);
+    ssShort << vOutPoints[0];
+    BOOST_CHECK_THROW(ssShort >> vOutPointsRead, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -176,6 +176,29 @@ BOOST_AUTO_TEST_CASE(sighash_test)
 #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    seed_insecure_rand(false);
+
+    const int vHashTypes[] = {SIGHASH_ALL, SIGHASH_ALL | SIGHASH_ANYONECANPAY, SIGHASH_NONE, SIGHASH_SINGLE};
+    for (int i = 0; i < 2000; i++)
+    {
+        // the fixed hash types and ones with unknown base types, which hash like SIGHASH_ALL
+        int nHashType = i < 1000 ? vHashTypes[i % 4] : insecure_rand();
+
+        CTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        const PrecomputedTransactionData txdata(txTo);
+        for (unsigned int nIn = 0; nIn < txTo.vin.size(); nIn++)
+        {
+            BOOST_CHECK(SignatureHash(scriptCode, txTo, nIn, nHashType, &txdata) ==
+                        SignatureHashOld(scriptCode, txTo, nIn, nHashType));
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
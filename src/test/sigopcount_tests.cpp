@@ -3,7 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "coins.h"
 #include "key.h"
+#include "main.h"
 #include "pubkey.h"
 #include "script/script.h"
 #include "script/standard.h"
@@ -65,4 +67,46 @@ BOOST_AUTO_TEST_CASE(GetSigOpCount)
 }
 
 
+BOOST_AUTO_TEST_CASE(GetTxSigOpCount_cached)
+{
+    // the counts of a transaction are cached on it until UpdateHash()
+    CKey key[3];
+    std::vector<CPubKey> keys;
+    for (int i = 0; i < 3; i++)
+    {
+        key[i].MakeNewKey(true);
+        keys.push_back(key[i].GetPubKey());
+    }
+    const CScript redeemScript = GetScriptForMultisig(2, keys);
+
+    CTransaction txFrom;
+    txFrom.vin.resize(1);
+    txFrom.vout.push_back(CTxOut(COIN, GetScriptForDestination(CScriptID(redeemScript))));
+    txFrom.vout.push_back(CTxOut(COIN, CScript() << ToByteVector(keys[0]) << OP_CHECKSIG));
+    txFrom.UpdateHash();
+
+    CTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(txFrom.GetHash(), 0), CScript() << OP_0 << OP_0 << Serialize(redeemScript)));
+    tx.vout.push_back(CTxOut(COIN, CScript() << OP_CHECKSIG << OP_CHECKSIG));
+    tx.UpdateHash();
+
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    // without the inputs the P2SH count is not cached
+    BOOST_CHECK_EQUAL(GetP2SHSigOpCount(tx, coins), 0U);
+    BOOST_CHECK_EQUAL(tx.GetCachedP2SHSigOpCount(), -1);
+    AddCoins(coins, txFrom, 0);
+    BOOST_CHECK_EQUAL(GetP2SHSigOpCount(tx, coins), 3U);
+    BOOST_CHECK_EQUAL(tx.GetCachedP2SHSigOpCount(), 3);
+    BOOST_CHECK_EQUAL(GetLegacySigOpCount(tx), 2U);
+    BOOST_CHECK_EQUAL(tx.GetCachedLegacySigOpCount(), 2);
+
+    tx.vout.push_back(CTxOut(COIN, CScript() << OP_CHECKSIG));
+    tx.UpdateHash();
+    BOOST_CHECK_EQUAL(tx.GetCachedLegacySigOpCount(), -1);
+    BOOST_CHECK_EQUAL(tx.GetCachedP2SHSigOpCount(), -1);
+    BOOST_CHECK_EQUAL(GetLegacySigOpCount(tx), 3U);
+    BOOST_CHECK_EQUAL(GetP2SHSigOpCount(tx, coins), 3U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
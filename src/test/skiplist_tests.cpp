@@ -4,10 +4,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain/chain.h"
+#include "main.h"
+#include "net/messages.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
 #include "util/util.h"
 
+#include <algorithm>
+#include <set>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -98,6 +102,8 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
         int r = insecure_rand() % 150000;
         CBlockIndex *tip = (r < 100000) ? &vBlocksMain[r] : &vBlocksSide[r - 100000];
         CBlockLocator locator = chain.GetLocator(tip);
+        // asked for again it comes from the cache
+        BOOST_CHECK(chain.GetLocator(tip).vHave == locator.vHave);
 
         // The first result must be the block itself, the last one must be genesis.
         BOOST_CHECK(locator.vHave.front() == tip->GetBlockHash());
@@ -120,4 +126,124 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(lastblockindex_test)
+{
+    // mostly proof of stake with a few proof of work blocks, as the chain is now
+    const int nLength = 5000;
+    const int nConnected = 4000;
+    std::vector<CBlockIndex> vIndex(nLength);
+    for (int i = 0; i < nLength; i++)
+    {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+        if (i > 100 && insecure_rand() % 50 != 0)
+            vIndex[i].SetProofOfStake();
+        // the headers above the connected blocks have no links yet
+        if (i < nConnected)
+            vIndex[i].BuildTypeLinks();
+    }
+    BOOST_CHECK(vIndex[nConnected - 1].fTypeLinks && !vIndex[nConnected].fTypeLinks);
+
+    for (int i = 0; i < nLength; i++)
+    {
+        for (int nProofOfStake = 0; nProofOfStake < 2; nProofOfStake++)
+        {
+            const CBlockIndex *pindexWalk = &vIndex[i];
+            while (pindexWalk->pprev && pindexWalk->IsProofOfStake() != (nProofOfStake != 0))
+                pindexWalk = pindexWalk->pprev;
+            if (GetLastBlockIndex(&vIndex[i], nProofOfStake != 0) != pindexWalk)
+                BOOST_CHECK(GetLastBlockIndex(&vIndex[i], nProofOfStake != 0) == pindexWalk);
+        }
+    }
+    BOOST_CHECK(GetLastBlockIndex(NULL, true) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(mediantimepast_test)
+{
+    const int nLength = 1000;
+    std::vector<CBlockIndex> vIndex(nLength);
+    for (int i = 0; i < nLength; i++)
+    {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].nTime = 1500000000 + i * 45 + insecure_rand() % 600;
+        BOOST_CHECK_EQUAL(vIndex[i].nMedianTimePast, -1);
+        const int64_t nComputed = vIndex[i].GetMedianTimePast();
+        vIndex[i].BuildMedianTimePast();
+        BOOST_CHECK_EQUAL(vIndex[i].nMedianTimePast, nComputed);
+
+        std::vector<int64_t> vTimes;
+        for (int j = std::max(0, i - 10); j <= i; j++)
+            vTimes.push_back(vIndex[j].GetBlockTime());
+        std::sort(vTimes.begin(), vTimes.end());
+        BOOST_CHECK_EQUAL(vIndex[i].GetMedianTimePast(), vTimes[vTimes.size() / 2]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(descendants_test)
+{
+    // a tree where every entry has a random earlier entry as parent
+    const int nLength = 2000;
+    std::vector<CBlockIndex> vIndex(nLength);
+    for (int i = 0; i < nLength; i++)
+    {
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[insecure_rand() % i];
+        vIndex[i].nHeight = (i == 0) ? 0 : vIndex[i].pprev->nHeight + 1;
+        vIndex[i].BuildSkip();
+        vIndex[i].LinkToParent();
+    }
+
+    for (int n = 0; n < 100; n++)
+    {
+        CBlockIndex *pindex = &vIndex[insecure_rand() % nLength];
+        std::set<CBlockIndex *> setVisited;
+        ForEachDescendant(pindex, [&setVisited](CBlockIndex *pindexDescendant) {
+            BOOST_CHECK(setVisited.insert(pindexDescendant).second);
+        });
+        std::set<CBlockIndex *> setExpected;
+        for (CBlockIndex &index : vIndex)
+        {
+            if (&index != pindex && index.GetAncestor(pindex->nHeight) == pindex)
+                setExpected.insert(&index);
+        }
+        BOOST_CHECK(setVisited == setExpected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(findfork_test)
+{
+    // long branches off random earlier entries
+    const int nLength = 20000;
+    std::vector<CBlockIndex> vIndex(nLength);
+    for (int i = 0; i < nLength; i++)
+    {
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[(i % 1000 == 0) ? insecure_rand() % i : i - 1];
+        vIndex[i].nHeight = (i == 0) ? 0 : vIndex[i].pprev->nHeight + 1;
+        vIndex[i].BuildSkip();
+    }
+
+    for (int n = 0; n < 100; n++)
+    {
+        CChain chain;
+        chain.SetTip(&vIndex[insecure_rand() % nLength]);
+        const CBlockIndex *pa = &vIndex[insecure_rand() % nLength];
+        const CBlockIndex *pb = &vIndex[insecure_rand() % nLength];
+
+        const CBlockIndex *pindexFork = pa->GetAncestor(std::min(pa->nHeight, chain.Height()));
+        while (!chain.Contains(pindexFork))
+            pindexFork = pindexFork->pprev;
+        BOOST_CHECK(chain.FindFork(pa) == pindexFork);
+
+        const CBlockIndex *pindexCommon = pa->GetAncestor(std::min(pa->nHeight, pb->nHeight));
+        const CBlockIndex *pindexWalk = pb->GetAncestor(pindexCommon->nHeight);
+        while (pindexCommon != pindexWalk)
+        {
+            pindexCommon = pindexCommon->pprev;
+            pindexWalk = pindexWalk->pprev;
+        }
+        BOOST_CHECK(LastCommonAncestor(pa, pb) == pindexCommon);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,106 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockgeneration/stratum.h"
+#include "consensus/merkle.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "util/utilstrencodings.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stratum_tests, BasicTestingSetup)
+
+/** A template of nTxs transactions besides the coinbase, which need not be valid */
+static std::shared_ptr<const CBlockTemplate> MakeTemplate(int nTxs)
+{
+    std::shared_ptr<CBlockTemplate> pblocktemplate = std::make_shared<CBlockTemplate>();
+    CBlock &block = pblocktemplate->block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = 1500000000;
+    block.nBits = 0x1e0fffff;
+
+    CTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 0; i < nTxs; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return pblocktemplate;
+}
+
+BOOST_AUTO_TEST_CASE(stratum_job_shares)
+{
+    for (int nTxs = 0; nTxs < 6; nTxs++)
+    {
+        std::shared_ptr<const CBlockTemplate> pblocktemplate = MakeTemplate(nTxs);
+        CStratumJob job;
+        BOOST_REQUIRE(job.Init("1", pblocktemplate, 1000));
+
+        const std::vector<unsigned char> vExtraNonce2 = ParseHex("a1b2c3d4");
+        CBlockHeader header;
+        CTransactionRef pcoinbase;
+        BOOST_REQUIRE(job.GetShare(0x01020304, vExtraNonce2, 1500000100, 77, header, pcoinbase));
+        BOOST_CHECK(!job.GetShare(0x01020304, ParseHex("a1b2c3"), 1500000100, 77, header, pcoinbase));
+
+        // the coinbase gets the extranonces as one push after the height
+        const CScript scriptSig = (CScript() << 1000 << ParseHex("01020304a1b2c3d4")) + COINBASE_FLAGS;
+        BOOST_CHECK(pcoinbase->vin[0].scriptSig == scriptSig);
+        BOOST_CHECK(pcoinbase->vout == pblocktemplate->block.vtx[0]->vout);
+
+        const CBlock block = job.GetBlock(header, pcoinbase);
+        BOOST_CHECK(block.hashMerkleRoot == BlockMerkleRoot(block));
+        BOOST_CHECK(header.hashMerkleRoot == block.hashMerkleRoot);
+        BOOST_CHECK(block.GetHash() == header.GetHash());
+        BOOST_CHECK_EQUAL(block.nTime, 1500000100U);
+        BOOST_CHECK_EQUAL(block.nNonce, 77U);
+        BOOST_CHECK_EQUAL(block.vtx.size(), (size_t)nTxs + 1);
+
+        // what a miner puts together from mining.notify is the same coinbase
+        const UniValue params = job.GetNotifyParams(true);
+        BOOST_REQUIRE_EQUAL(params.size(), 9U);
+        const std::vector<unsigned char> vCoinbase =
+            ParseHex(params[2].get_str() + "01020304a1b2c3d4" + params[3].get_str());
+        CDataStream ss((const char *)vCoinbase.data(), (const char *)vCoinbase.data() + vCoinbase.size(), SER_NETWORK,
+            PROTOCOL_VERSION);
+        CTransaction coinbase;
+        ss >> coinbase;
+        BOOST_CHECK(coinbase.GetHash() == pcoinbase->GetHash());
+        BOOST_CHECK_EQUAL(params[4].size(), job.vMerkleBranch.size());
+        BOOST_CHECK_EQUAL(params[6].get_str(), "1e0fffff");
+        BOOST_CHECK(params[8].get_bool());
+
+        // and the previous block hash comes back from its words byte swapped
+        std::vector<unsigned char> vPrevHash = ParseHex(params[1].get_str());
+        BOOST_REQUIRE_EQUAL(vPrevHash.size(), 32U);
+        for (int i = 0; i < 8; i++)
+            WriteLE32(&vPrevHash[4 * i], ReadBE32(&vPrevHash[4 * i]));
+        BOOST_CHECK(uint256(vPrevHash) == pblocktemplate->block.hashPrevBlock);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stratum_share_target)
+{
+    arith_uint256 diff1;
+    diff1.SetCompact(0x1f00ffff);
+    BOOST_CHECK(GetStratumShareTarget(1) == diff1);
+    BOOST_CHECK(GetStratumShareTarget(2) == diff1 / 2);
+    BOOST_CHECK(GetStratumShareTarget(0.5) == diff1 * 2);
+    BOOST_CHECK(GetStratumShareTarget(65536) == diff1 / 65536);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -59,6 +59,33 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
     BOOST_CHECK_EQUAL(std::string(expected_xor.begin(), expected_xor.end()), std::string(ds.begin(), ds.end()));
 }
 
+BOOST_AUTO_TEST_CASE(streams_xor_word_at_a_time)
+{
+    // keys that are xored a word at a time and ones that are not, over lengths around the word size
+    std::vector<std::vector<uint8_t> > keys = {{0x5a}, {0x01, 0x80}, {0x01, 0x02, 0x03}, {0xde, 0xad, 0xbe, 0xef},
+        {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef}, {0, 0, 0, 0, 0, 0, 0, 0}, {1, 2, 3, 4, 5, 6, 7, 8, 9}};
+    for (const std::vector<uint8_t> &key : keys)
+    {
+        for (size_t nSize = 0; nSize < 80; nSize++)
+        {
+            CDataStream ds(SER_DISK, 0);
+            std::vector<char> expected;
+            for (size_t i = 0; i < nSize; i++)
+            {
+                ds << uint8_t(i * 37 + 11);
+                expected.push_back(char(uint8_t(i * 37 + 11) ^ key[i % key.size()]));
+            }
+            ds.Xor(key);
+            BOOST_CHECK_EQUAL(std::string(expected.begin(), expected.end()), std::string(ds.begin(), ds.end()));
+
+            // xoring again restores the data
+            ds.Xor(key);
+            for (size_t i = 0; i < nSize; i++)
+                BOOST_CHECK_EQUAL(uint8_t(ds[i]), uint8_t(i * 37 + 11));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(streams)
 {
     // Smallest possible example
@@ -66,4 +93,54 @@ BOOST_AUTO_TEST_CASE(streams)
     BOOST_CHECK_EQUAL(HexStr(ssx.begin(), ssx.end()), "");
 }
 
+BOOST_AUTO_TEST_CASE(streams_memory_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << uint32_t(1) << std::string("peers") << uint8_t(7);
+    std::vector<uint8_t> vch(ss.begin(), ss.end());
+
+    CMemoryReader reader(SER_DISK, CLIENT_VERSION, vch.data(), vch.data() + vch.size());
+    BOOST_CHECK_EQUAL(reader.size(), vch.size());
+    uint32_t a;
+    std::string str;
+    reader >> a >> str;
+    BOOST_CHECK_EQUAL(a, 1U);
+    BOOST_CHECK_EQUAL(str, "peers");
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+
+    // reading past the end throws and leaves the stream where it was
+    uint32_t b;
+    BOOST_CHECK_THROW(reader >> b, std::ios_base::failure);
+    uint8_t c;
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 7);
+    BOOST_CHECK(reader.empty());
+}
+
+BOOST_AUTO_TEST_CASE(streams_public_data_stream)
+{
+    // the stream without the zeroing allocator reads and writes the same bytes and converts from and to the other
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    CPublicDataStream ssPublic(SER_NETWORK, PROTOCOL_VERSION);
+    ss << uint64_t(42) << std::string("block") << std::vector<uint8_t>(300, 9);
+    ssPublic << uint64_t(42) << std::string("block") << std::vector<uint8_t>(300, 9);
+    BOOST_CHECK_EQUAL(ss.str(), ssPublic.str());
+
+    CPublicSerializeData vch(ss.begin(), ss.end());
+    CPublicDataStream ssCopy(vch, SER_NETWORK, PROTOCOL_VERSION);
+    CDataStream ssBack(CSerializeData(ssPublic.begin(), ssPublic.end()), SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t n;
+    std::string str;
+    ssCopy >> n >> str;
+    BOOST_CHECK_EQUAL(n, 42U);
+    BOOST_CHECK_EQUAL(str, "block");
+    BOOST_CHECK_EQUAL(ssCopy.size() + 14, ssBack.size());
+
+    // a buffer swapped in is read from the start
+    CPublicSerializeData vchSwap(ssPublic.begin(), ssPublic.end());
+    ssCopy.SwapBuffer(vchSwap);
+    ssCopy >> n;
+    BOOST_CHECK_EQUAL(n, 42U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockgeneration/syntheticchain.h"
+#include "chain/chainman.h"
+#include "coins.h"
+#include "consensus/consensus.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "processblock.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(syntheticchain_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(syntheticchain_key_follows_seed)
+{
+    BOOST_CHECK(SyntheticChainKey(7) == SyntheticChainKey(7));
+    BOOST_CHECK(!(SyntheticChainKey(7) == SyntheticChainKey(8)));
+}
+
+BOOST_AUTO_TEST_CASE(syntheticchain_connects_its_blocks)
+{
+    CChainManager *pchainman = pnetMan->getChainActive();
+    const int nStart = pchainman->chainActive.Height();
+
+    CSyntheticChainParams params;
+    params.nBlocks = COINBASE_MATURITY + 10;
+    params.nTxsPerBlock = 6;
+    params.nInputsPerTx = 1;
+    params.nOutputsPerTx = 3;
+    params.nChainLength = 2;
+    CSyntheticChainResult result;
+    std::string strError;
+    BOOST_REQUIRE_MESSAGE(GenerateSyntheticChain(params, result, strError), strError);
+
+    BOOST_CHECK_EQUAL(result.nHeight, nStart + params.nBlocks);
+    BOOST_CHECK_EQUAL(pchainman->chainActive.Height(), result.nHeight);
+    BOOST_CHECK(pchainman->chainActive.Tip()->GetBlockHash() == result.hashTip);
+    // the coinbases of the first blocks matured in the last ten and were spent there
+    BOOST_CHECK(result.nTransactions > 0);
+    BOOST_CHECK_EQUAL(result.nInputs, result.nTransactions);
+    BOOST_CHECK_EQUAL(result.nOutputs, 3 * result.nTransactions);
+
+    // what was spendable at the end is in the chainstate
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(
+        block, pchainman->chainActive.Tip(), pnetMan->getActivePaymentNetwork()->GetConsensus()));
+    BOOST_REQUIRE(block.vtx.size() > 1);
+    LOCK(cs_main);
+    BOOST_CHECK(pchainman->pcoinsTip->HaveCoin(COutPoint(block.vtx.back()->GetHash(), 0)));
+    BOOST_CHECK(!pchainman->pcoinsTip->HaveCoin(block.vtx[1]->vin[0].prevout));
+}
+
+BOOST_AUTO_TEST_CASE(syntheticchain_checks_changed_entries)
+{
+    // every block is checked against the entries that changed, the whole tree only once at the end
+    nCheckBlockIndexInterval = 60;
+    CSyntheticChainParams params;
+    params.nBlocks = 10;
+    CSyntheticChainResult result;
+    std::string strError;
+    const bool fGenerated = GenerateSyntheticChain(params, result, strError);
+    nCheckBlockIndexInterval = DEFAULT_CHECKBLOCKINDEX_INTERVAL;
+    BOOST_REQUIRE_MESSAGE(fGenerated, strError);
+    CheckBlockIndex(pnetMan->getActivePaymentNetwork()->GetConsensus());
+    BOOST_CHECK_EQUAL(pnetMan->getChainActive()->chainActive.Height(), result.nHeight);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
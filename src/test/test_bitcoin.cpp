@@ -14,6 +14,7 @@
 #include "crypto/sha256.h"
 #include "fs.h"
 #include "key.h"
+#include "keystore.h"
 #include "main.h"
 #include "net/messages.h"
 #include "processblock.h"
@@ -34,6 +35,7 @@ CWallet *pwallet = nullptr;
 
 BasicTestingSetup::BasicTestingSetup(const std::string &chainName)
 {
+    SHA256AutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
@@ -110,6 +112,10 @@ CBlock TestChain100Setup::CreateAndProcessBlock(const std::vector<CTransactionRe
 
     while (!CheckProofOfWork(pblock->GetHash(), pblock->nBits, pnetMan->getActivePaymentNetwork()->GetConsensus()))
         ++pblock->nNonce;
+    // proof of work blocks are signed by the key their coinbase pays to
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+    BOOST_CHECK(pblock->SignScryptBlock(keystore));
 
     CValidationState state;
     ProcessNewBlock(state, pnetMan->getActivePaymentNetwork(), NULL, pblock, true, NULL);
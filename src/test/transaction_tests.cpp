@@ -18,6 +18,8 @@
 #include "script/interpreter.h"
 #include "script/script.h"
 #include "script/script_error.h"
+#include "script/sign.h"
+#include "script/standard.h"
 #include "util/utilstrencodings.h"
 
 #include <map>
@@ -470,4 +472,50 @@ BOOST_AUTO_TEST_CASE(test_IsStandard)
     BOOST_CHECK(!IsStandardTx(t, reason));
 }
 
+BOOST_AUTO_TEST_CASE(test_SignSignatures)
+{
+    CBasicKeyStore keystore;
+    std::vector<CScript> vFromPubKeys;
+    CTransaction t;
+    t.vout.resize(1);
+    t.vout[0].nValue = 90 * CENT;
+    t.vout[0].scriptPubKey = CScript() << OP_1;
+    for (int i = 0; i < 60; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        keystore.AddKey(key);
+        // pay to pubkey and pay to pubkey hash
+        vFromPubKeys.push_back(i % 3 == 0 ? GetScriptForRawPubKey(key.GetPubKey()) :
+                                            GetScriptForDestination(key.GetPubKey().GetID()));
+        t.vin.push_back(CTxIn(COutPoint(GetRandHash(), i)));
+    }
+    // an input without a script is left alone
+    const CScript scriptUntouched = CScript() << OP_1;
+    vFromPubKeys[7] = CScript();
+    t.vin[7].scriptSig = scriptUntouched;
+
+    CTransaction tSerial(t);
+    for (unsigned int i = 0; i < t.vin.size(); i++)
+    {
+        if (i != 7)
+            BOOST_CHECK(SignSignature(keystore, vFromPubKeys[i], tSerial, i));
+    }
+    BOOST_CHECK(SignSignatures(keystore, vFromPubKeys, t));
+
+    // the signatures are deterministic, so both ways give the same transaction
+    BOOST_CHECK_EQUAL(EncodeHexTx(t), EncodeHexTx(tSerial));
+    BOOST_CHECK(t.vin[7].scriptSig == scriptUntouched);
+    for (unsigned int i = 0; i < t.vin.size(); i++)
+    {
+        if (i != 7)
+            BOOST_CHECK(VerifyScript(t.vin[i].scriptSig, vFromPubKeys[i], STANDARD_SCRIPT_VERIFY_FLAGS,
+                MutableTransactionSignatureChecker(&t, i)));
+    }
+
+    // an input it cannot sign is reported
+    vFromPubKeys[0] = CScript() << OP_1 << OP_EQUAL;
+    BOOST_CHECK(!SignSignatures(keystore, vFromPubKeys, t));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,201 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/txreconciliation.h"
+#include "net/txsketch.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(txsketch_decode)
+{
+    FastRandomContext rng(true);
+    for (size_t nCapacity : {1, 2, 10, 64})
+    {
+        for (size_t nDiff = 0; nDiff <= nCapacity + 2; nDiff++)
+        {
+            // the sets share 20 elements, what differs is split between them
+            CTxSketch a(nCapacity);
+            CTxSketch b(nCapacity);
+            std::set<uint32_t> setDiff;
+            for (int i = 0; i < 20; i++)
+            {
+                const uint32_t nElement = 1 + rng.rand32() % 0xfffffffe;
+                a.Add(nElement);
+                b.Add(nElement);
+            }
+            while (setDiff.size() < nDiff)
+            {
+                const uint32_t nElement = 1 + rng.rand32() % 0xfffffffe;
+                if (setDiff.insert(nElement).second)
+                    (setDiff.size() % 2 ? a : b).Add(nElement);
+            }
+
+            CTxSketch received;
+            BOOST_CHECK(received.Deserialize(b.Serialize()));
+            BOOST_CHECK(received == b);
+            a.Merge(received);
+            std::vector<uint32_t> vElements;
+            if (nDiff < nCapacity)
+            {
+                BOOST_CHECK(a.Decode(vElements));
+                BOOST_CHECK(std::set<uint32_t>(vElements.begin(), vElements.end()) == setDiff);
+                BOOST_CHECK_EQUAL(vElements.size(), nDiff);
+            }
+            else
+            {
+                BOOST_CHECK(!a.Decode(vElements));
+            }
+        }
+    }
+
+    CTxSketch sketch;
+    BOOST_CHECK(!sketch.Deserialize(std::vector<uint8_t>(7)));
+}
+
+/** Two trackers that see each other as peer 1 and reconcile, a made the connection */
+struct ReconPair
+{
+    CTxReconciliationTracker a;
+    CTxReconciliationTracker b;
+
+    ReconPair()
+    {
+        // the first outbound peers of a are flooded
+        for (NodeId peer = 10; peer < 10 + RECON_FLOOD_OUTBOUND; peer++)
+            BOOST_CHECK(a.Register(peer, false, TXRECONCILIATION_VERSION, a.PreRegister(peer)));
+        const uint64_t nSaltA = a.PreRegister(1);
+        const uint64_t nSaltB = b.PreRegister(1);
+        BOOST_CHECK(a.Register(1, false, TXRECONCILIATION_VERSION, nSaltB));
+        BOOST_CHECK(b.Register(1, true, TXRECONCILIATION_VERSION, nSaltA));
+    }
+};
+
+static std::vector<uint256> RandomTxids(size_t nCount)
+{
+    std::vector<uint256> vTxids;
+    for (size_t i = 0; i < nCount; i++)
+        vTxids.push_back(GetRandHash());
+    return vTxids;
+}
+
+static std::set<uint256> Sorted(const std::vector<uint256> &vTxids)
+{
+    return std::set<uint256>(vTxids.begin(), vTxids.end());
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_round)
+{
+    ReconPair pair;
+    BOOST_CHECK(pair.a.ShouldFlood(10));
+    BOOST_CHECK(!pair.a.ShouldFlood(1));
+    BOOST_CHECK(!pair.b.ShouldFlood(1));
+    BOOST_CHECK(pair.b.ShouldFlood(2));
+    BOOST_CHECK(!pair.b.Register(1, true, TXRECONCILIATION_VERSION, 0));
+
+    const std::vector<uint256> vCommon = RandomTxids(50);
+    const std::vector<uint256> vOnlyA = RandomTxids(5);
+    const std::vector<uint256> vOnlyB = RandomTxids(7);
+    for (const uint256 &txid : vCommon)
+    {
+        BOOST_CHECK(pair.a.AddToSet(1, txid));
+        BOOST_CHECK(pair.b.AddToSet(1, txid));
+    }
+    for (const uint256 &txid : vOnlyA)
+        BOOST_CHECK(pair.a.AddToSet(1, txid));
+    for (const uint256 &txid : vOnlyB)
+        BOOST_CHECK(pair.b.AddToSet(1, txid));
+
+    // only the side that made the connection asks
+    uint16_t nSetSize = 0;
+    uint16_t nQ = 0;
+    BOOST_CHECK(!pair.b.GetRequest(1, 0, nSetSize, nQ));
+    BOOST_CHECK(pair.a.GetRequest(1, 0, nSetSize, nQ));
+    BOOST_CHECK_EQUAL(nSetSize, 55);
+    BOOST_CHECK(!pair.a.GetRequest(1, RECON_REQUEST_INTERVAL, nSetSize, nQ));
+
+    std::vector<uint8_t> vSketch;
+    std::vector<uint256> vAnnounceB;
+    BOOST_CHECK(!pair.a.HandleRequest(1, nSetSize, nQ, 0, vSketch, vAnnounceB));
+    BOOST_CHECK(pair.b.HandleRequest(1, nSetSize, nQ, 0, vSketch, vAnnounceB));
+    BOOST_CHECK(vAnnounceB.empty());
+    BOOST_CHECK_EQUAL(vSketch.size(), 4 * CTxReconciliationTracker::ComputeCapacity(57, 55, nQ));
+    BOOST_CHECK_EQUAL(pair.b.GetSetSize(1), 0U);
+
+    std::vector<uint256> vAnnounceA;
+    std::vector<uint32_t> vAsk;
+    bool fSuccess = false;
+    BOOST_CHECK(pair.a.HandleSketch(1, vSketch, vAnnounceA, vAsk, fSuccess));
+    BOOST_CHECK(fSuccess);
+    BOOST_CHECK(Sorted(vAnnounceA) == Sorted(vOnlyA));
+    BOOST_CHECK_EQUAL(vAsk.size(), vOnlyB.size());
+    BOOST_CHECK_EQUAL(pair.a.GetSetSize(1), 0U);
+    // one sketch per request
+    BOOST_CHECK(!pair.a.HandleSketch(1, vSketch, vAnnounceA, vAsk, fSuccess));
+
+    BOOST_CHECK(pair.b.HandleDiff(1, fSuccess, vAsk, vAnnounceB));
+    BOOST_CHECK(Sorted(vAnnounceB) == Sorted(vOnlyB));
+    BOOST_CHECK(!pair.b.HandleDiff(1, fSuccess, vAsk, vAnnounceB));
+
+    // the next round once the interval passed
+    BOOST_CHECK(pair.a.GetRequest(1, RECON_REQUEST_INTERVAL, nSetSize, nQ));
+    BOOST_CHECK_EQUAL(nSetSize, 0);
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_fallback)
+{
+    ReconPair pair;
+
+    // a difference too large for the sketch, both sides announce their whole set
+    const std::vector<uint256> vOnlyA = RandomTxids(MAX_SKETCH_CAPACITY + 10);
+    const std::vector<uint256> vOnlyB = RandomTxids(3);
+    for (const uint256 &txid : vOnlyA)
+        BOOST_CHECK(pair.a.AddToSet(1, txid));
+    for (const uint256 &txid : vOnlyB)
+        BOOST_CHECK(pair.b.AddToSet(1, txid));
+    // an announced transaction does not have to be reconciled
+    pair.a.RemoveFromSet(1, vOnlyA.back());
+    BOOST_CHECK_EQUAL(pair.a.GetSetSize(1), vOnlyA.size() - 1);
+
+    uint16_t nSetSize = 0;
+    uint16_t nQ = 0;
+    std::vector<uint8_t> vSketch;
+    std::vector<uint256> vAnnounceA;
+    std::vector<uint256> vAnnounceB;
+    std::vector<uint32_t> vAsk;
+    bool fSuccess = true;
+    BOOST_CHECK(pair.a.GetRequest(1, 0, nSetSize, nQ));
+    BOOST_CHECK(pair.b.HandleRequest(1, nSetSize, nQ, 0, vSketch, vAnnounceB));
+    BOOST_CHECK_EQUAL(vSketch.size(), 4 * MAX_SKETCH_CAPACITY);
+    BOOST_CHECK(pair.a.HandleSketch(1, vSketch, vAnnounceA, vAsk, fSuccess));
+    BOOST_CHECK(!fSuccess);
+    BOOST_CHECK(vAsk.empty());
+    BOOST_CHECK_EQUAL(vAnnounceA.size(), vOnlyA.size() - 1);
+    BOOST_CHECK(pair.b.HandleDiff(1, fSuccess, vAsk, vAnnounceB));
+    BOOST_CHECK(Sorted(vAnnounceB) == Sorted(vOnlyB));
+
+    // a reconcildiff that never comes, the set goes out after the timeout
+    const uint256 txid = GetRandHash();
+    BOOST_CHECK(pair.b.AddToSet(1, txid));
+    vAnnounceB.clear();
+    BOOST_CHECK(pair.b.HandleRequest(1, 0, nQ, 0, vSketch, vAnnounceB));
+    pair.b.ExpireResponse(1, RECON_RESPONSE_TIMEOUT, vAnnounceB);
+    BOOST_CHECK(vAnnounceB.empty());
+    pair.b.ExpireResponse(1, RECON_RESPONSE_TIMEOUT + 1, vAnnounceB);
+    BOOST_REQUIRE_EQUAL(vAnnounceB.size(), 1U);
+    BOOST_CHECK(vAnnounceB[0] == txid);
+
+    pair.a.ForgetPeer(1);
+    BOOST_CHECK(!pair.a.IsRegistered(1));
+    BOOST_CHECK(pair.a.ShouldFlood(1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
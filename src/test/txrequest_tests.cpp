@@ -0,0 +1,104 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net/txrequest.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txrequest_tests, BasicTestingSetup)
+
+static bool Requestable(CTxRequestTracker &tracker, NodeId peer, const uint256 &txhash, int64_t nNow)
+{
+    const std::vector<uint256> vHashes = tracker.GetRequestable(peer, nNow);
+    return std::find(vHashes.begin(), vHashes.end(), txhash) != vHashes.end();
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_preferred_first)
+{
+    CTxRequestTracker tracker;
+    const uint256 txhash = GetRandHash();
+    // the inbound peer announces first, the outbound one is still asked first
+    tracker.ReceivedInv(1, txhash, false, 100);
+    tracker.ReceivedInv(2, txhash, true, 100);
+    BOOST_CHECK(!Requestable(tracker, 1, txhash, 99));
+    BOOST_CHECK(!Requestable(tracker, 1, txhash, 100));
+    BOOST_CHECK(Requestable(tracker, 2, txhash, 100));
+    tracker.RequestedTx(2, txhash, 200);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(2), 1U);
+    // only one peer is asked at a time
+    BOOST_CHECK(!Requestable(tracker, 1, txhash, 150));
+    BOOST_CHECK(!Requestable(tracker, 2, txhash, 150));
+
+    // it answers with notfound, the other one is asked
+    tracker.ReceivedResponse(2, txhash);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(2), 0U);
+    BOOST_CHECK(Requestable(tracker, 1, txhash, 150));
+    BOOST_CHECK(!Requestable(tracker, 2, txhash, 150));
+
+    // the transaction arrived, nothing is left
+    tracker.ForgetTxHash(txhash);
+    BOOST_CHECK(!Requestable(tracker, 1, txhash, 150));
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_timeout_and_disconnect)
+{
+    CTxRequestTracker tracker;
+    const uint256 txhash = GetRandHash();
+    tracker.ReceivedInv(1, txhash, true, 0);
+    tracker.ReceivedInv(2, txhash, true, 0);
+    tracker.ReceivedInv(3, txhash, false, 0);
+    BOOST_CHECK(Requestable(tracker, 1, txhash, 10));
+    tracker.RequestedTx(1, txhash, 50);
+
+    // the request times out and goes to the next announcer, the first is not asked again
+    BOOST_CHECK(!Requestable(tracker, 2, txhash, 49));
+    BOOST_CHECK(Requestable(tracker, 2, txhash, 50));
+    BOOST_CHECK(!Requestable(tracker, 1, txhash, 50));
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(1), 0U);
+    tracker.RequestedTx(2, txhash, 100);
+
+    // the peer that was asked disconnects, the last one is asked right away
+    tracker.DisconnectedPeer(2);
+    BOOST_CHECK_EQUAL(tracker.Count(2), 0U);
+    BOOST_CHECK(Requestable(tracker, 3, txhash, 60));
+    tracker.RequestedTx(3, txhash, 120);
+
+    // every announcer had its turn once the last one times out
+    BOOST_CHECK(!Requestable(tracker, 1, txhash, 120));
+    BOOST_CHECK(!Requestable(tracker, 3, txhash, 120));
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_order_and_bounds)
+{
+    CTxRequestTracker tracker;
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < MAX_PEER_TX_ANNOUNCEMENTS + 10; i++)
+    {
+        vHashes.push_back(GetRandHash());
+        tracker.ReceivedInv(1, vHashes.back(), true, 0);
+    }
+    // the announcements past the limit are ignored
+    BOOST_CHECK_EQUAL(tracker.Count(1), MAX_PEER_TX_ANNOUNCEMENTS);
+    BOOST_CHECK_EQUAL(tracker.Size(), MAX_PEER_TX_ANNOUNCEMENTS);
+
+    // the others come back in the order they were announced
+    const std::vector<uint256> vRequestable = tracker.GetRequestable(1, 0);
+    BOOST_CHECK(std::equal(vRequestable.begin(), vRequestable.end(), vHashes.begin()));
+    BOOST_CHECK_EQUAL(vRequestable.size(), MAX_PEER_TX_ANNOUNCEMENTS);
+
+    // announcing one again changes nothing
+    tracker.ReceivedInv(1, vHashes[0], true, 0);
+    BOOST_CHECK_EQUAL(tracker.Count(1), MAX_PEER_TX_ANNOUNCEMENTS);
+
+    tracker.DisconnectedPeer(1);
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK(tracker.GetRequestable(1, 0).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,9 +5,11 @@
 #include "uint256.h"
 #include "arith_uint256.h"
 #include "test/test_bitcoin.h"
+#include "util/utilstrencodings.h"
 #include "version.h"
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <cmath>
 #include <iomanip>
 #include <limits>
@@ -268,4 +270,44 @@ BOOST_AUTO_TEST_CASE(conversion)
     BOOST_CHECK(R2L.GetHex() == UintToArith256(R2L).GetHex());
 }
 
+BOOST_AUTO_TEST_CASE(hex_conversion) // HexStr ParseHex and the table that GetHex SetHex share with them
+{
+    std::vector<unsigned char> vch;
+    for (int i = 0; i < 256; i++)
+        vch.push_back(i);
+    const std::string strHex = HexStr(vch);
+    BOOST_CHECK_EQUAL(strHex.size(), 512U);
+    BOOST_CHECK_EQUAL(strHex.substr(0, 8), "00010203");
+    BOOST_CHECK_EQUAL(strHex.substr(504), "fcfdfeff");
+    BOOST_CHECK(ParseHex(strHex) == vch);
+    std::string strUpper = strHex;
+    std::transform(strUpper.begin(), strUpper.end(), strUpper.begin(), ::toupper);
+    BOOST_CHECK(ParseHex(strUpper) == vch);
+
+    BOOST_CHECK_EQUAL(HexStr(vch.begin(), vch.begin() + 3, true), "00 01 02");
+    BOOST_CHECK_EQUAL(HexStr(vch.begin(), vch.begin() + 1, true), "00");
+    BOOST_CHECK_EQUAL(HexStr(vch.begin(), vch.begin(), true), "");
+    BOOST_CHECK_EQUAL(HexStr(vch.rbegin(), vch.rbegin() + 2), "fffe");
+
+    // spaces between bytes are skipped, it stops at the first byte that is not two digits
+    BOOST_CHECK(ParseHex(" 00 01\t\n02  ") == std::vector<unsigned char>({0, 1, 2}));
+    BOOST_CHECK(ParseHex("0001 0") == std::vector<unsigned char>({0, 1}));
+    BOOST_CHECK(ParseHex("00 0 1") == std::vector<unsigned char>({0}));
+    BOOST_CHECK(ParseHex("0001zz02") == std::vector<unsigned char>({0, 1}));
+    BOOST_CHECK(ParseHex("").empty());
+
+    uint256 num;
+    num.SetHex("  0x" + R1L.GetHex());
+    BOOST_CHECK(num == R1L);
+    num.SetHex("0X" + R2L.GetHex() + " trailing");
+    BOOST_CHECK(num == R2L);
+    // short and odd length values fill the least significant bytes
+    num.SetHex("abc");
+    BOOST_CHECK_EQUAL(num.GetHex(), std::string(61, '0') + "abc");
+    // long values keep their least significant bytes
+    num.SetHex("ff" + R1L.GetHex());
+    BOOST_CHECK(num == R1L);
+    BOOST_CHECK_EQUAL(uint160S(R1S.GetHex()).GetHex(), R1S.GetHex());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
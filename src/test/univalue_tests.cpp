@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "test/test_bitcoin.h"
+#include <limits>
 #include <map>
 #include <stdint.h>
 #include <string>
@@ -331,4 +332,34 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("{} 42"));
 }
 
+BOOST_AUTO_TEST_CASE(univalue_build)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.reserve(4);
+    BOOST_CHECK(obj.pushKVEnd("a", 1));
+    BOOST_CHECK(obj.pushKVEnd("b", UniValue("x")));
+    // pushKVEnd does not look for the key, pushKV replaces it
+    BOOST_CHECK(obj.pushKVEnd("a", 2));
+    BOOST_CHECK_EQUAL(obj.size(), 3);
+    BOOST_CHECK(obj.pushKV("b", UniValue("y")));
+    BOOST_CHECK_EQUAL(obj.size(), 3);
+    BOOST_CHECK(obj.push_back(Pair("b", "z")));
+    BOOST_CHECK_EQUAL(obj.size(), 3);
+    BOOST_CHECK_EQUAL(obj.write(), "{\"a\":1,\"b\":\"z\",\"a\":2}");
+
+    UniValue arr(UniValue::VARR);
+    BOOST_CHECK(!arr.pushKVEnd("a", 1));
+    UniValue inner(UniValue::VARR);
+    inner.push_back(std::string("q\"uote"));
+    BOOST_CHECK(arr.push_back(std::move(inner)));
+    BOOST_CHECK(arr.push_back(UniValue(std::numeric_limits<int64_t>::min())));
+    BOOST_CHECK(arr.push_back(UniValue(std::numeric_limits<uint64_t>::max())));
+    BOOST_CHECK(!obj.push_back(UniValue(1)));
+
+    std::string s = "prefix ";
+    arr.writeTo(s);
+    BOOST_CHECK_EQUAL(s, "prefix [[\"q\\\"uote\"],-9223372036854775808,18446744073709551615]");
+    BOOST_CHECK_EQUAL(arr.write(1), "[\n [\n  \"q\\\"uote\"\n ],\n -9223372036854775808,\n 18446744073709551615\n]");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
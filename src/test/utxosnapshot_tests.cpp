@@ -0,0 +1,139 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain/tx.h"
+#include "coins.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "utxosnapshot.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_dump_and_load)
+{
+    const CNetworkTemplate &chainparams = *pnetMan->getActivePaymentNetwork();
+    const CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+    fs::path path = pathTemp / "utxo.dat";
+    int nHeight = 0;
+    CTxOutSetSnapshotData data;
+    std::string strError;
+    BOOST_REQUIRE_MESSAGE(DumpTxOutSet(path, pcoinsdbview, nHeight, data, strError), strError);
+    BOOST_CHECK_EQUAL(nHeight, pindexTip->nHeight);
+    BOOST_CHECK(data.hashBlock == pindexTip->GetBlockHash());
+    BOOST_CHECK(data.nCoins >= coinbaseTxns.size());
+    BOOST_CHECK(fs::exists(path));
+    BOOST_CHECK(!fs::exists(pathTemp / "utxo.dat.incomplete"));
+
+    CBlockTreeDB blocktree(1 << 20, true);
+    CCoinsViewDB coinsdb(1 << 20, true);
+    // a snapshot the network does not list is not loaded, nor is one that does not match what it lists
+    MapTxOutSetSnapshots mapSnapshots;
+    BOOST_CHECK(!LoadTxOutSet(path, chainparams, mapSnapshots, blocktree, coinsdb, strError));
+    mapSnapshots[nHeight] = data;
+    mapSnapshots[nHeight].nCoins++;
+    BOOST_CHECK(!LoadTxOutSet(path, chainparams, mapSnapshots, blocktree, coinsdb, strError));
+    BOOST_CHECK(coinsdb.GetBestBlock().IsNull());
+
+    mapSnapshots[nHeight] = data;
+    BOOST_REQUIRE_MESSAGE(LoadTxOutSet(path, chainparams, mapSnapshots, blocktree, coinsdb, strError), strError);
+    BOOST_CHECK(coinsdb.GetBestBlock() == data.hashBlock);
+    bool fValue = false;
+    BOOST_CHECK(blocktree.ReadFlag("prunedblockfiles", fValue) && fValue);
+
+    // the coins are there, and so are the transactions and positions staking needs
+    for (const CTransactionRef &tx : coinbaseTxns)
+    {
+        const uint256 txid = tx->GetHash();
+        Coin coin, coinLoaded;
+        BOOST_REQUIRE(pcoinsdbview->GetCoin(COutPoint(txid, 0), coin));
+        BOOST_REQUIRE(coinsdb.GetCoin(COutPoint(txid, 0), coinLoaded));
+        BOOST_CHECK(coinLoaded.out == coin.out);
+        BOOST_CHECK_EQUAL(coinLoaded.nHeight, coin.nHeight);
+
+        CTransaction txLoaded;
+        uint256 hashBlock;
+        BOOST_CHECK(blocktree.ReadPrunedTx(txid, hashBlock, txLoaded));
+        BOOST_CHECK(txLoaded == *tx);
+        BOOST_CHECK(hashBlock == pnetMan->getChainActive()->chainActive[coin.nHeight]->GetBlockHash());
+
+        CDiskTxPos pos, posLoaded;
+        BOOST_CHECK(pnetMan->getChainActive()->pblocktree->ReadTxIndex(txid, pos));
+        BOOST_CHECK(blocktree.ReadTxIndex(txid, posLoaded));
+        BOOST_CHECK_EQUAL(posLoaded.nTxOffset, pos.nTxOffset);
+    }
+
+    // a chainstate is never loaded over
+    BOOST_CHECK(!LoadTxOutSet(path, chainparams, mapSnapshots, blocktree, coinsdb, strError));
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_corrupt)
+{
+    const CNetworkTemplate &chainparams = *pnetMan->getActivePaymentNetwork();
+    fs::path path = pathTemp / "utxo.dat";
+    int nHeight = 0;
+    CTxOutSetSnapshotData data;
+    std::string strError;
+    BOOST_REQUIRE_MESSAGE(DumpTxOutSet(path, pcoinsdbview, nHeight, data, strError), strError);
+    MapTxOutSetSnapshots mapSnapshots;
+    mapSnapshots[nHeight] = data;
+
+    // change a byte in the last unspent output
+    FILE *file = fopen(path.string().c_str(), "rb+");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE(fseek(file, -2, SEEK_END) == 0);
+    int c = fgetc(file);
+    BOOST_REQUIRE(fseek(file, -2, SEEK_END) == 0);
+    fputc(c ^ 1, file);
+    fclose(file);
+
+    CBlockTreeDB blocktree(1 << 20, true);
+    CCoinsViewDB coinsdb(1 << 20, true);
+    BOOST_CHECK(!LoadTxOutSet(path, chainparams, mapSnapshots, blocktree, coinsdb, strError));
+    BOOST_CHECK(coinsdb.GetBestBlock().IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_listed_by_network)
+{
+    // the values dumptxoutset reports, as -txoutsetsnapshot takes them
+    CNetwork &network = *pnetMan->getActivePaymentNetwork();
+    fs::path path = pathTemp / "utxo.dat";
+    int nHeight = 0;
+    CTxOutSetSnapshotData data;
+    std::string strError;
+    BOOST_REQUIRE_MESSAGE(DumpTxOutSet(path, pcoinsdbview, nHeight, data, strError), strError);
+    const std::string strSnapshot =
+        strprintf("%d:%s:%u:%s", nHeight, data.hashBlock.GetHex(), data.nCoins, data.hashSnapshot.GetHex());
+
+    int nParsedHeight = 0;
+    CTxOutSetSnapshotData parsed;
+    BOOST_REQUIRE(ParseTxOutSetSnapshot(strSnapshot, nParsedHeight, parsed));
+    BOOST_CHECK_EQUAL(nParsedHeight, nHeight);
+    BOOST_CHECK(parsed.hashBlock == data.hashBlock);
+    BOOST_CHECK(parsed.hashSnapshot == data.hashSnapshot);
+    BOOST_CHECK_EQUAL(parsed.nCoins, data.nCoins);
+    BOOST_CHECK(!ParseTxOutSetSnapshot("", nParsedHeight, parsed));
+    BOOST_CHECK(!ParseTxOutSetSnapshot(strSnapshot + ":1", nParsedHeight, parsed));
+    BOOST_CHECK(!ParseTxOutSetSnapshot(strSnapshot.substr(0, strSnapshot.size() - 1), nParsedHeight, parsed));
+    BOOST_CHECK(!ParseTxOutSetSnapshot("-1" + strSnapshot.substr(strSnapshot.find(':')), nParsedHeight, parsed));
+
+    // nothing is listed for a regtest chain until it is added, as init does for -txoutsetsnapshot
+    CBlockTreeDB blocktree(1 << 20, true);
+    CCoinsViewDB coinsdb(1 << 20, true);
+    BOOST_CHECK(network.TxOutSetSnapshots().empty());
+    BOOST_CHECK(!LoadTxOutSet(path, network, network.TxOutSetSnapshots(), blocktree, coinsdb, strError));
+    network.mapTxOutSetSnapshots[nParsedHeight] = parsed;
+    BOOST_CHECK_MESSAGE(LoadTxOutSet(path, network, network.TxOutSetSnapshots(), blocktree, coinsdb, strError),
+        strError);
+    BOOST_CHECK(coinsdb.GetBestBlock() == data.hashBlock);
+    network.mapTxOutSetSnapshots.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validationinterface.h"
+
+#include "chain/block.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
+
+namespace
+{
+class CQueuedListener : public CValidationInterface
+{
+public:
+    std::thread::id idSignalled;
+    std::atomic<bool> fOtherThread;
+    std::vector<uint64_t> vSequences;
+    std::vector<int> vTxCounts;
+    std::vector<uint256> vBlockHashes;
+
+    CQueuedListener() : idSignalled(std::this_thread::get_id()), fOtherThread(true) {}
+
+protected:
+    void SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock) override
+    {
+        if (std::this_thread::get_id() == idSignalled)
+            fOtherThread = false;
+        vSequences.push_back(GetValidationInterfaceSequence());
+        vTxCounts.push_back(vtx.size());
+        vBlockHashes.push_back(pblock ? pblock->GetHash() : uint256());
+    }
+};
+}
+
+BOOST_AUTO_TEST_CASE(validationinterface_queue_order)
+{
+    static const int EVENTS = 2000;
+    CQueuedListener listener;
+    RegisterValidationInterface(&listener, true);
+    StartValidationInterfaceQueue();
+
+    const uint64_t nFirst = GetValidationInterfaceSequence() + 1;
+    std::vector<uint256> vExpected;
+    for (int i = 0; i < EVENTS; i++)
+    {
+        // the listener has to get a block of its own, this one is gone before it is delivered
+        CBlock block;
+        block.nNonce = i;
+        std::vector<CTransactionRef> vtx(i % 5, MakeTransactionRef());
+        SyncWithWallets(vtx, &block);
+        vExpected.push_back(block.GetHash());
+        if (i % 100 == 0)
+            LimitValidationInterfaceQueue();
+    }
+    const uint64_t nLast = GetValidationInterfaceSequence();
+    BOOST_CHECK_EQUAL(nLast, nFirst + EVENTS - 1);
+    SyncWithValidationInterfaceQueue(nLast);
+
+    BOOST_CHECK(listener.fOtherThread);
+    BOOST_REQUIRE_EQUAL(listener.vSequences.size(), EVENTS);
+    for (int i = 0; i < EVENTS; i++)
+    {
+        BOOST_CHECK_EQUAL(listener.vSequences[i], nFirst + i);
+        BOOST_CHECK_EQUAL(listener.vTxCounts[i], i % 5);
+        BOOST_CHECK(listener.vBlockHashes[i] == vExpected[i]);
+    }
+
+    // stopped, the events are delivered on the signalling thread again
+    StopValidationInterfaceQueue();
+    SyncWithWallets(std::vector<CTransactionRef>(), nullptr);
+    BOOST_CHECK(!listener.fOtherThread);
+    BOOST_CHECK_EQUAL(listener.vSequences.back(), nLast + 1);
+    BOOST_CHECK(listener.vBlockHashes.back().IsNull());
+
+    UnregisterValidationInterface(&listener);
+    SyncWithWallets(std::vector<CTransactionRef>(), nullptr);
+    BOOST_CHECK_EQUAL(listener.vSequences.size(), EVENTS + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,61 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "versionbits.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(versionbits_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(threshold_cache_branches)
+{
+    const int nPeriod = 10;
+    const int nLength = 100;
+    std::vector<CBlockIndex> vMain(nLength);
+    std::vector<CBlockIndex> vSide(nLength);
+    for (int i = 0; i < nLength; i++)
+    {
+        for (std::vector<CBlockIndex> *pvIndex : {&vMain, &vSide})
+        {
+            (*pvIndex)[i].nHeight = i;
+            (*pvIndex)[i].pprev = (i == 0) ? NULL : &(*pvIndex)[i - 1];
+        }
+    }
+
+    ThresholdConditionCache cache;
+    ThresholdState state = THRESHOLD_FAILED;
+    BOOST_CHECK(cache.Get(NULL, nPeriod, state) && state == THRESHOLD_DEFINED);
+    BOOST_CHECK(!cache.Get(&vMain[nPeriod - 1], nPeriod, state));
+
+    for (int i = nPeriod - 1; i < nLength; i += nPeriod)
+        cache.Set(&vMain[i], nPeriod, THRESHOLD_STARTED);
+    // the side branch takes the slots over, the main chain is kept aside
+    for (int i = nPeriod - 1; i < nLength; i += nPeriod)
+        cache.Set(&vSide[i], nPeriod, THRESHOLD_ACTIVE);
+    BOOST_CHECK_EQUAL(cache.SideSize(), (size_t)(nLength / nPeriod));
+    for (int i = nPeriod - 1; i < nLength; i += nPeriod)
+    {
+        BOOST_CHECK(cache.Get(&vMain[i], nPeriod, state) && state == THRESHOLD_STARTED);
+        BOOST_CHECK(cache.Get(&vSide[i], nPeriod, state) && state == THRESHOLD_ACTIVE);
+    }
+
+    // the entries of other branches are bounded
+    std::vector<CBlockIndex> vOther(ThresholdConditionCache::MAX_SIDE_STATES * 2);
+    for (size_t i = 0; i < vOther.size(); i++)
+    {
+        vOther[i].nHeight = nPeriod - 1;
+        cache.Set(&vOther[i], nPeriod, THRESHOLD_LOCKED_IN);
+        BOOST_CHECK(cache.SideSize() <= ThresholdConditionCache::MAX_SIDE_STATES);
+    }
+    BOOST_CHECK(cache.Get(&vOther.back(), nPeriod, state) && state == THRESHOLD_LOCKED_IN);
+
+    cache.clear();
+    BOOST_CHECK(!cache.Get(&vOther.back(), nPeriod, state));
+    BOOST_CHECK_EQUAL(cache.SideSize(), (size_t)0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
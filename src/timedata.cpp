@@ -59,8 +59,8 @@ void AddTimeData(const CNetAddr &ip, int64_t nOffsetSample)
     // Add data
     static CMedianFilter<int64_t> vTimeOffsets(BITCOIN_TIMEDATA_MAX_SAMPLES, 0);
     vTimeOffsets.input(nOffsetSample);
-    LogPrint("net", "added time data, samples %d, offset %+d (%+d minutes)\n", vTimeOffsets.size(), nOffsetSample,
-        nOffsetSample / 60);
+    LogPrint(Logging::NET, "added time data, samples %d, offset %+d (%+d minutes)\n", vTimeOffsets.size(),
+        nOffsetSample, nOffsetSample / 60);
 
     // There is a known issue here (see issue #4521):
     //
@@ -113,9 +113,9 @@ void AddTimeData(const CNetAddr &ip, int64_t nOffsetSample)
         }
 
         for (auto n : vSorted)
-            LogPrint("net", "%+d  ", n);
-        LogPrint("net", "|  ");
+            LogPrint(Logging::NET, "%+d  ", n);
+        LogPrint(Logging::NET, "|  ");
 
-        LogPrint("net", "nTimeOffset = %+d  (%+d minutes)\n", nTimeOffset, nTimeOffset / 60);
+        LogPrint(Logging::NET, "nTimeOffset = %+d  (%+d minutes)\n", nTimeOffset, nTimeOffset / 60);
     }
 }
@@ -181,7 +181,7 @@ void TorControlConnection::readcb(struct bufferevent *bev, void *ctx)
                 }
                 else
                 {
-                    LogPrint("tor", "tor: Received unexpected sync reply %i\n", self->message.code);
+                    LogPrint(Logging::TOR, "tor: Received unexpected sync reply %i\n", self->message.code);
                 }
             }
             self->message.Clear();
@@ -202,15 +202,15 @@ void TorControlConnection::eventcb(struct bufferevent *bev, short what, void *ct
     TorControlConnection *self = (TorControlConnection *)ctx;
     if (what & BEV_EVENT_CONNECTED)
     {
-        LogPrint("tor", "tor: Succesfully connected!\n");
+        LogPrint(Logging::TOR, "tor: Succesfully connected!\n");
         self->connected(*self);
     }
     else if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
     {
         if (what & BEV_EVENT_ERROR)
-            LogPrint("tor", "tor: Error connecting to Tor control socket\n");
+            LogPrint(Logging::TOR, "tor: Error connecting to Tor control socket\n");
         else
-            LogPrint("tor", "tor: End of stream\n");
+            LogPrint(Logging::TOR, "tor: End of stream\n");
         self->Disconnect();
         self->disconnected(*self);
     }
@@ -445,7 +445,7 @@ TorController::TorController(struct event_base *_base, const std::string &_targe
     std::pair<bool, std::string> pkf = ReadBinaryFile(GetPrivateKeyFile());
     if (pkf.first)
     {
-        LogPrint("tor", "tor: Reading cached private key from %s\n", GetPrivateKeyFile());
+        LogPrint(Logging::TOR, "tor: Reading cached private key from %s\n", GetPrivateKeyFile());
         private_key = pkf.second;
     }
 }
@@ -464,7 +464,7 @@ void TorController::add_onion_cb(TorControlConnection &_conn, const TorControlRe
 {
     if (reply.code == 250)
     {
-        LogPrint("tor", "tor: ADD_ONION successful\n");
+        LogPrint(Logging::TOR, "tor: ADD_ONION successful\n");
         for (const std::string &s : reply.lines)
         {
             std::map<std::string, std::string> m = ParseTorReplyMapping(s);
@@ -478,7 +478,7 @@ void TorController::add_onion_cb(TorControlConnection &_conn, const TorControlRe
         LogPrintf("tor: Got service ID %s, advertising service %s\n", service_id, service.ToString());
         if (WriteBinaryFile(GetPrivateKeyFile(), private_key))
         {
-            LogPrint("tor", "tor: Cached service private key to %s\n", GetPrivateKeyFile());
+            LogPrint(Logging::TOR, "tor: Cached service private key to %s\n", GetPrivateKeyFile());
         }
         else
         {
@@ -501,7 +501,7 @@ void TorController::auth_cb(TorControlConnection &_conn, const TorControlReply &
 {
     if (reply.code == 250)
     {
-        LogPrint("tor", "tor: Authentication succesful\n");
+        LogPrint(Logging::TOR, "tor: Authentication succesful\n");
 
         // Now that we know Tor is running setup the proxy for onion addresses
         // if -onion isn't set to something else.
@@ -562,15 +562,15 @@ void TorController::authchallenge_cb(TorControlConnection &_conn, const TorContr
 {
     if (reply.code == 250)
     {
-        LogPrint("tor", "tor: SAFECOOKIE authentication challenge succesful\n");
+        LogPrint(Logging::TOR, "tor: SAFECOOKIE authentication challenge succesful\n");
         std::pair<std::string, std::string> l = SplitTorReplyLine(reply.lines[0]);
         if (l.first == "AUTHCHALLENGE")
         {
             std::map<std::string, std::string> m = ParseTorReplyMapping(l.second);
             std::vector<uint8_t> serverHash = ParseHex(m["SERVERHASH"]);
             std::vector<uint8_t> serverNonce = ParseHex(m["SERVERNONCE"]);
-            LogPrint(
-                "tor", "tor: AUTHCHALLENGE ServerHash %s ServerNonce %s\n", HexStr(serverHash), HexStr(serverNonce));
+            LogPrint(Logging::TOR, "tor: AUTHCHALLENGE ServerHash %s ServerNonce %s\n", HexStr(serverHash),
+                HexStr(serverNonce));
             if (serverNonce.size() != 32)
             {
                 LogPrintf("tor: ServerNonce is not 32 bytes, as required by spec\n");
@@ -631,14 +631,14 @@ void TorController::protocolinfo_cb(TorControlConnection &_conn, const TorContro
                 std::map<std::string, std::string>::iterator i;
                 if ((i = m.find("Tor")) != m.end())
                 {
-                    LogPrint("tor", "tor: Connected to Tor version %s\n", i->second);
+                    LogPrint(Logging::TOR, "tor: Connected to Tor version %s\n", i->second);
                 }
             }
         }
 
         for (auto const &s : methods)
         {
-            LogPrint("tor", "tor: Supported authentication method: %s\n", s);
+            LogPrint(Logging::TOR, "tor: Supported authentication method: %s\n", s);
         }
 
         // Prefer NULL, otherwise SAFECOOKIE. If a password is provided, use HASHEDPASSWORD
@@ -649,14 +649,14 @@ void TorController::protocolinfo_cb(TorControlConnection &_conn, const TorContro
         std::string torpassword = gArgs.GetArg("-torpassword", "");
         if (methods.count("NULL"))
         {
-            LogPrint("tor", "tor: Using NULL authentication\n");
+            LogPrint(Logging::TOR, "tor: Using NULL authentication\n");
             _conn.Command("AUTHENTICATE", boost::bind(&TorController::auth_cb, this, _1, _2));
         }
         else if (methods.count("SAFECOOKIE"))
         {
             // Cookie: hexdump -e '32/1 "%02x""\n"'  ~/.tor/control_auth_cookie
-            LogPrint(
-                "tor", "tor: Using SAFECOOKIE authentication, reading cookie authentication from %s\n", cookiefile);
+            LogPrint(Logging::TOR, "tor: Using SAFECOOKIE authentication, reading cookie authentication from %s\n",
+                cookiefile);
             std::pair<bool, std::string> status_cookie = ReadBinaryFile(cookiefile, TOR_COOKIE_SIZE);
             if (status_cookie.first && status_cookie.second.size() == TOR_COOKIE_SIZE)
             {
@@ -685,7 +685,7 @@ void TorController::protocolinfo_cb(TorControlConnection &_conn, const TorContro
         {
             if (!torpassword.empty())
             {
-                LogPrint("tor", "tor: Using HASHEDPASSWORD authentication\n");
+                LogPrint(Logging::TOR, "tor: Using HASHEDPASSWORD authentication\n");
                 boost::replace_all(torpassword, "\"", "\\\"");
                 _conn.Command(
                     "AUTHENTICATE \"" + torpassword + "\"", boost::bind(&TorController::auth_cb, this, _1, _2));
@@ -723,7 +723,7 @@ void TorController::disconnected_cb(TorControlConnection &_conn)
     if (!reconnect)
         return;
 
-    LogPrint("tor", "tor: Not connected to Tor control port %s, trying to reconnect\n", target);
+    LogPrint(Logging::TOR, "tor: Not connected to Tor control port %s, trying to reconnect\n", target);
 
     // Single-shot timer for reconnect. Use exponential backoff.
     struct timeval time = MillisToTimeval(int64_t(reconnect_timeout * 1000.0));
@@ -32,6 +32,11 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <memory>
+
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
@@ -40,9 +45,16 @@ static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_PRUNED_TX = 'p';
+static const char DB_PRUNED_TX_SPENT = 'q';
+static const char DB_TXOUTSET_STATS = 'S';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 's';
 
 namespace
 {
@@ -70,12 +82,46 @@ struct CoinEntry
 }
 
 
+/** The LevelDB settings of the database called name, -<name>dbblocksize and the like change them */
+static CDBOptions GetDBOptions(const std::string &name)
+{
+    CDBOptions options;
+    options.nBlockSize = gArgs.GetArg("-" + name + "dbblocksize", DEFAULT_DB_BLOCK_SIZE);
+    options.fCompression = gArgs.GetBoolArg("-" + name + "dbcompression", DEFAULT_DB_COMPRESSION);
+    options.nMaxOpenFiles = gArgs.GetArg("-" + name + "dbmaxopenfiles", DEFAULT_DB_MAX_OPEN_FILES);
+    options.nWriteBufferSize = gArgs.GetArg("-" + name + "dbwritebuffer", 0) << 20;
+    return options;
+}
+
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe)
-    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
+    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, GetDBOptions("chainstate"))
 {
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const { return db.Read(CoinEntry(&outpoint), coin); }
+size_t CCoinsViewDB::GetCoins(const std::vector<COutPoint> &vOutpoints,
+    std::vector<std::pair<COutPoint, Coin> > &vFound) const
+{
+    // LevelDB has no multi get, reading the keys in its order with one iterator comes close
+    std::vector<COutPoint> vSorted;
+    const std::vector<COutPoint> *pOutpoints = &vOutpoints;
+    if (!std::is_sorted(vOutpoints.begin(), vOutpoints.end()))
+    {
+        vSorted = vOutpoints;
+        std::sort(vSorted.begin(), vSorted.end());
+        pOutpoints = &vSorted;
+    }
+    std::vector<CoinEntry> vKeys;
+    vKeys.reserve(pOutpoints->size());
+    for (const COutPoint &outpoint : *pOutpoints)
+        vKeys.emplace_back(&outpoint);
+    std::vector<std::pair<size_t, Coin> > vRead;
+    db.ReadMany(vKeys, vRead);
+    for (std::pair<size_t, Coin> &read : vRead)
+        vFound.emplace_back((*pOutpoints)[read.first], std::move(read.second));
+    return vRead.size();
+}
+
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const { return db.Exists(CoinEntry(&outpoint)); }
 uint256 CCoinsViewDB::GetBestBlock() const
 {
@@ -85,9 +131,32 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
+std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const
+{
+    std::vector<uint256> vhashHeadBlocks;
+    if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks))
+        return std::vector<uint256>();
+    return vhashHeadBlocks;
+}
+
+bool CCoinsViewDB::GetTxOutSetStats(CTxOutSetStats &stats) const
+{
+    if (db.Read(DB_TXOUTSET_STATS, stats))
+        return true;
+    // a database nothing was ever written to has an empty set
+    if (!GetBestBlock().IsNull())
+        return false;
+    std::unique_ptr<CCoinsViewCursor> pcursor(Cursor());
+    if (pcursor->Valid())
+        return false;
+    stats = CTxOutSetStats();
+    return true;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     const uint256 &hashBlock,
     const uint64_t nBestCoinHeight,
+    const CTxOutSetStats *pstats,
     size_t &nChildCachedCoinsUsage)
 {
     LOCK(cs_utxo);
@@ -95,11 +164,32 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     size_t count = 0;
     size_t changed = 0;
     size_t nBatchWrites = 0;
-    size_t batch_size = nMaxDBBatchSize;
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nMaxDBBatchSize);
+
+    // A write that moves the best block may take several batches. Until the last one is written the best block
+    // is replaced by the old and the new one, so that a node that stopped in between knows which blocks to replay.
+    if (!hashBlock.IsNull())
+    {
+        uint256 old_tip = GetBestBlock();
+        if (old_tip.IsNull())
+        {
+            // We may be in the middle of replaying.
+            std::vector<uint256> old_heads = GetHeadBlocks();
+            if (old_heads.size() == 2)
+            {
+                assert(old_heads[0] == hashBlock);
+                old_tip = old_heads[1];
+            }
+        }
+        batch.Erase(DB_BEST_BLOCK);
+        batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+        // the stored totals do not describe a set that is only partly written
+        batch.Erase(DB_TXOUTSET_STATS);
+    }
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();)
     {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+        if (it->second.GetFlags() & CCoinsCacheEntry::DIRTY)
         {
             CoinEntry entry(&it->first);
             size_t nUsage = it->second.coin.DynamicMemoryUsage();
@@ -113,7 +203,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
             else
             {
                 batch.Write(entry, it->second.coin);
-                it->second.flags = 0;
+                it->second.SetFlags(0);
                 it++;
             }
             changed++;
@@ -123,6 +213,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
             // leveldb are still realized but the memory spikes are not seen.
             if (batch.SizeEstimate() > batch_size)
             {
+                LogPrint(Logging::COINDB, "Writing partial batch of %.2f MiB\n",
+                    batch.SizeEstimate() * (1.0 / 1048576.0));
                 db.WriteBatch(batch);
                 batch.Clear();
                 nBatchWrites++;
@@ -133,17 +225,113 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
         count++;
     }
     if (!hashBlock.IsNull())
+    {
+        batch.Erase(DB_HEAD_BLOCKS);
         batch.Write(DB_BEST_BLOCK, hashBlock);
+    }
+    // the totals go with the coins, a write that does not know them makes the stored ones wrong
+    if (pstats)
+        batch.Write(DB_TXOUTSET_STATS, *pstats);
+    else if (changed)
+        batch.Erase(DB_TXOUTSET_STATS);
 
     bool ret = db.WriteBatch(batch);
-    LogPrint("COINDB", "Committing %u changed transactions (out of %u) to coin database with %u batch writes...\n",
+    LogPrint(Logging::COINDB,
+        "Committing %u changed transactions (out of %u) to coin database with %u batch writes...\n",
         (unsigned int)changed, (unsigned int)count, (unsigned int)nBatchWrites);
     return ret;
 }
 
+bool CCoinsViewDB::ScanCoins(const CDBSnapshot &snapshot,
+    unsigned int nBegin,
+    unsigned int nEnd,
+    const std::function<bool(const COutPoint &, const Coin &)> &f) const
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator(snapshot));
+    // a txid is serialized from its first byte, the keys of a range are contiguous
+    COutPoint key;
+    *key.hash.begin() = nBegin;
+    key.n = 0;
+    CoinEntry entry(&key);
+    Coin coin;
+    for (pcursor->Seek(entry); pcursor->Valid(); pcursor->Next())
+    {
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN || *key.hash.begin() >= nEnd)
+            break;
+        if (!pcursor->GetValue(coin))
+            return error("%s: unable to read value", __func__);
+        if (!f(key, coin))
+            break;
+    }
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor() const
+{
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper &>(db).NewIterator(), GetBestBlock());
+    /* It seems that there are no "const iterators" for LevelDB. Since we only need read operations on it, use a
+       const-cast to get around that restriction. */
+    i->pcursor->Seek(DB_COIN);
+    // Cache key of first record
+    if (i->pcursor->Valid())
+    {
+        CoinEntry entry(&i->keyTmp.second);
+        i->pcursor->GetKey(entry);
+        i->keyTmp.first = entry.key;
+    }
+    else
+    {
+        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+    }
+    return i;
+}
+
+bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
+{
+    // Return cached key
+    if (keyTmp.first == DB_COIN)
+    {
+        key = keyTmp.second;
+        return true;
+    }
+    return false;
+}
+
+bool CCoinsViewDBCursor::GetValue(Coin &coin) const { return pcursor->GetValue(coin); }
+unsigned int CCoinsViewDBCursor::GetValueSize() const { return pcursor->GetValueSize(); }
+bool CCoinsViewDBCursor::Valid() const { return keyTmp.first == DB_COIN; }
+void CCoinsViewDBCursor::Next()
+{
+    pcursor->Next();
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry))
+    {
+        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    }
+    else
+    {
+        keyTmp.first = entry.key;
+    }
+}
+
+static fs::path FlatBlockIndexPath() { return GetDataDir() / "blocks" / "index.flat"; }
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
-    : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+    : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, GetDBOptions("blockindex"))
 {
+    bool fFlat = false;
+    if (fWipe)
+    {
+        // only the database says which entries a flat index is for
+        fs::remove(FlatBlockIndexPath());
+    }
+    else if (ReadFlag("flatblockindex", fFlat) && fFlat)
+    {
+        pflatindex.reset(new CFlatBlockIndex(FlatBlockIndexPath(), false));
+        if (!pflatindex->IsOpen())
+        {
+            throw std::runtime_error("cannot open the flat block index");
+        }
+    }
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info)
@@ -177,6 +365,21 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
+    if (pflatindex)
+    {
+        // the file info goes first, losing the entries after it only leaves unused space in the block files
+        if (!WriteBatch(batch, true))
+        {
+            return false;
+        }
+        std::vector<CDiskBlockIndex> entries;
+        entries.reserve(blockinfo.size());
+        for (const CBlockIndex *pindex : blockinfo)
+        {
+            entries.emplace_back(pindex);
+        }
+        return pflatindex->Write(entries);
+    }
     for (std::vector<const CBlockIndex *>::const_iterator it = blockinfo.begin(); it != blockinfo.end(); it++)
     {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
@@ -186,11 +389,36 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
 
 bool CBlockTreeDB::EraseBlockIndex(uint256 hashToDelete)
 {
+    if (pflatindex)
+    {
+        return pflatindex->Erase(hashToDelete);
+    }
     CDBBatch batch(*this);
     batch.Erase(std::make_pair(DB_BLOCK_INDEX, hashToDelete));
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::EraseBlockIndexes(const std::vector<uint256> &vHashes)
+{
+    if (pflatindex)
+    {
+        for (const uint256 &hash : vHashes)
+        {
+            if (!pflatindex->Erase(hash))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    CDBBatch batch(*this);
+    for (const uint256 &hash : vHashes)
+    {
+        batch.Erase(std::make_pair(DB_BLOCK_INDEX, hash));
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos)
 {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
@@ -204,6 +432,151 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WritePrunedTxs(const std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > &vect)
+{
+    CDBBatch batch(*this);
+    for (const auto &item : vect)
+        batch.Write(std::make_pair(DB_PRUNED_TX, item.first), item.second);
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::WriteBlockIndexEntries(const std::vector<CDiskBlockIndex> &entries)
+{
+    if (pflatindex)
+    {
+        return pflatindex->Write(entries);
+    }
+    CDBBatch batch(*this);
+    for (const CDiskBlockIndex &entry : entries)
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, entry.hashBlock), entry);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadPrunedTx(const uint256 &txid, uint256 &hashBlock, CTransaction &tx)
+{
+    std::pair<uint256, CTransaction> item;
+    if (!Read(std::make_pair(DB_PRUNED_TX, txid), item))
+        return false;
+    hashBlock = item.first;
+    tx = item.second;
+    return true;
+}
+
+bool CBlockTreeDB::MovePrunedTxsSpentBy(const uint256 &hashSpentBy,
+    const std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > &vect)
+{
+    if (vect.empty())
+        return true;
+    std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > vSpent;
+    Read(std::make_pair(DB_PRUNED_TX_SPENT, hashSpentBy), vSpent);
+    CDBBatch batch(*this);
+    for (const auto &item : vect)
+    {
+        batch.Erase(std::make_pair(DB_PRUNED_TX, item.first));
+        vSpent.push_back(item);
+    }
+    batch.Write(std::make_pair(DB_PRUNED_TX_SPENT, hashSpentBy), vSpent);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::RestorePrunedTxsSpentBy(const uint256 &hashSpentBy)
+{
+    std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > vSpent;
+    if (!Read(std::make_pair(DB_PRUNED_TX_SPENT, hashSpentBy), vSpent))
+        return true;
+    CDBBatch batch(*this);
+    for (const auto &item : vSpent)
+        batch.Write(std::make_pair(DB_PRUNED_TX, item.first), item.second);
+    batch.Erase(std::make_pair(DB_PRUNED_TX_SPENT, hashSpentBy));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ErasePrunedTxsSpentBy(const uint256 &hashSpentBy)
+{
+    return Erase(std::make_pair(DB_PRUNED_TX_SPENT, hashSpentBy));
+}
+
+uint64_t CBlockTreeDB::EstimatePrunedTxsSize() const
+{
+    static_assert(DB_PRUNED_TX_SPENT == DB_PRUNED_TX + 1, "the pruned transaction keys are not one range");
+    return EstimateSize(
+        std::make_pair(DB_PRUNED_TX, uint256()), std::make_pair((char)(DB_PRUNED_TX_SPENT + 1), uint256()));
+}
+
+bool CBlockTreeDB::UpdateAddressIndexes(const CAddressIndexUpdate &update)
+{
+    CDBBatch batch(*this);
+    for (const auto &entry : update.vAddressIndex)
+        batch.Write(std::make_pair(DB_ADDRESSINDEX, entry.first), entry.second);
+    for (const CAddressIndexKey &key : update.vAddressIndexErase)
+        batch.Erase(std::make_pair(DB_ADDRESSINDEX, key));
+    for (const auto &entry : update.vAddressUnspent)
+    {
+        if (entry.second.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first), entry.second);
+    }
+    for (const auto &entry : update.vSpent)
+    {
+        if (entry.second.IsNull())
+            batch.Erase(std::make_pair(DB_SPENTINDEX, entry.first));
+        else
+            batch.Write(std::make_pair(DB_SPENTINDEX, entry.first), entry.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(uint8_t nType,
+    const uint160 &hash,
+    std::vector<std::pair<CAddressIndexKey, CAmount> > &vEntries,
+    int nStart,
+    int nEnd)
+{
+    const bool fRange = nStart > 0 && nEnd > 0;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(nType, hash, fRange ? nStart : 0)));
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.nType != nType ||
+            key.second.hashBytes != hash)
+            break;
+        if (fRange && key.second.nBlockHeight > nEnd)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to read address index value", __func__);
+        vEntries.emplace_back(key.second, nValue);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(uint8_t nType,
+    const uint160 &hash,
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentIteratorKey(nType, hash)));
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX || key.second.nType != nType ||
+            key.second.hashBytes != hash)
+            break;
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read address unspent index value", __func__);
+        vUnspent.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value)
+{
+    return Read(std::make_pair(DB_SPENTINDEX, key), value);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -218,59 +591,389 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue)
     return true;
 }
 
+namespace
+{
+/** A chunk of block index records, read from disk on the loading thread and
+ *  deserialized and verified on a worker thread.
+ */
+struct CBlockIndexRecords
+{
+    std::vector<uint256> vKeys;
+    std::vector<CPublicDataStream> vValues;
+    std::vector<CDiskBlockIndex> vEntries;
+    std::string strError;
+
+    void Decode()
+    {
+        vEntries.resize(vValues.size());
+        for (size_t i = 0; i < vValues.size(); i++)
+        {
+            CDiskBlockIndex &diskindex = vEntries[i];
+            try
+            {
+                vValues[i] >> diskindex;
+            }
+            catch (const std::exception &)
+            {
+                strError = "failed to read new value";
+                return;
+            }
+            // The stored hash is used as is, so make sure it still belongs to this entry. Entries
+            // with a checksum only need a sha256, older ones have to be hashed again.
+            if (diskindex.HasHashChecksum() ? !diskindex.CheckHashChecksum() :
+                                              diskindex.GetBlockHash() != diskindex.hashBlock)
+            {
+                strError = strprintf("block index entry %s is corrupt", vKeys[i].ToString());
+                return;
+            }
+            if (vKeys[i] != diskindex.hashBlock)
+            {
+                strError = strprintf("block index entry %s is stored under the wrong key", diskindex.hashBlock.ToString());
+                return;
+            }
+        }
+        vValues.clear();
+    }
+};
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
+    // Reading the cursor stays on this thread, deserializing and verifying the records is
+    // spread over worker threads, and this thread inserts every decoded chunk into
+    // mapBlockIndex while the following chunks are still being read and decoded.
+    const size_t nRecordsPerChunk = 16384;
+    const size_t nMaxChunksInFlight = std::max(2, GetNumCores());
+    std::deque<std::pair<std::unique_ptr<CBlockIndexRecords>, std::future<void> > > inflight;
+    CChainManager *pchainman = pnetMan->getChainActive();
+
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
-    // Load mapBlockIndex
-    while (pcursor->Valid())
+    if (pflatindex)
+    {
+        pflatindex->StartLoad();
+    }
+    bool fEnd = false;
+    while (!fEnd || !inflight.empty())
     {
         if (shutdown_threads.load())
         {
             LogPrintf("LoadBlockIndexGuts(): Shutdown requested. Exiting.\n");
+            for (auto &chunk : inflight)
+                chunk.second.wait();
             return false;
         }
+
+        if (!fEnd)
+        {
+            std::unique_ptr<CBlockIndexRecords> records(new CBlockIndexRecords());
+            records->vKeys.reserve(nRecordsPerChunk);
+            records->vValues.reserve(nRecordsPerChunk);
+            if (pflatindex && !pflatindex->Load(nRecordsPerChunk, records->vKeys, records->vValues, fEnd))
+            {
+                for (auto &chunk : inflight)
+                    chunk.second.wait();
+                return error("LoadBlockIndex() : cannot read the flat block index");
+            }
+            while (!pflatindex && records->vKeys.size() < nRecordsPerChunk)
+            {
+                std::pair<char, uint256> key;
+                if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+                {
+                    fEnd = true;
+                    break;
+                }
+                records->vKeys.push_back(key.second);
+                records->vValues.emplace_back(SER_DISK, CLIENT_VERSION);
+                pcursor->GetValueStream(records->vValues.back());
+                pcursor->Next();
+            }
+            if (!records->vKeys.empty())
+            {
+                CBlockIndexRecords *precords = records.get();
+                std::future<void> decoded = std::async(std::launch::async, [precords]() { precords->Decode(); });
+                inflight.emplace_back(std::move(records), std::move(decoded));
+            }
+        }
+
+        if (inflight.empty() || (!fEnd && inflight.size() < nMaxChunksInFlight))
+        {
+            continue;
+        }
+
+        // insert the oldest chunk, InsertBlockIndex is not safe to call from several threads
+        inflight.front().second.wait();
+        std::unique_ptr<CBlockIndexRecords> records = std::move(inflight.front().first);
+        inflight.pop_front();
+        if (!records->strError.empty())
+        {
+            for (auto &chunk : inflight)
+                chunk.second.wait();
+            return error("LoadBlockIndex() : %s", records->strError);
+        }
+
+        WRITELOCK(pchainman->cs_mapBlockIndex);
+        for (const CDiskBlockIndex &diskindex : records->vEntries)
+        {
+            // Construct block index object
+            CBlockIndex *pindexNew = pchainman->InsertBlockIndex(diskindex.hashBlock);
+            pindexNew->pprev = pchainman->InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+        }
+    }
+
+    if (pflatindex && !pflatindex->CompactIfSparse())
+    {
+        return error("LoadBlockIndex() : cannot compact the flat block index");
+    }
+    return true;
+}
+
+bool CBlockTreeDB::EraseDBBlockIndex()
+{
+    const size_t nEraseBatch = 16384;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+    CDBBatch batch(*this);
+    size_t nBatched = 0;
+    std::pair<char, uint256> key;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX)
+    {
+        batch.Erase(key);
+        if (++nBatched == nEraseBatch)
+        {
+            if (!WriteBatch(batch))
+            {
+                return false;
+            }
+            batch.Clear();
+            nBatched = 0;
+        }
+        pcursor->Next();
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::SetFlatIndex(bool fFlat)
+{
+    if (fFlat == (pflatindex != nullptr))
+    {
+        return true;
+    }
+    const size_t nMoveBatch = 16384;
+    size_t nMoved = 0;
+    if (fFlat)
+    {
+        LogPrintf("Moving the block index into %s...\n", FlatBlockIndexPath().string());
+        std::unique_ptr<CFlatBlockIndex> pflat(new CFlatBlockIndex(FlatBlockIndexPath(), true));
+        if (!pflat->IsOpen())
+        {
+            return false;
+        }
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+        std::vector<CDiskBlockIndex> entries;
+        entries.reserve(nMoveBatch);
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX)
+        while (true)
         {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex))
+            const bool fEnd = !pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX;
+            if (!fEnd)
             {
-                // Construct block index object
-                CBlockIndex *pindexNew = pnetMan->getChainActive()->InsertBlockIndex(diskindex.hashBlock);
-                pindexNew->pprev = pnetMan->getChainActive()->InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+                entries.emplace_back();
+                if (!pcursor->GetValue(entries.back()))
+                {
+                    return error("%s: cannot parse block index record", __func__);
+                }
                 pcursor->Next();
             }
-            else
+            if (entries.size() == nMoveBatch || (fEnd && !entries.empty()))
             {
-                return error("LoadBlockIndex() : failed to read new value");
+                if (!pflat->Write(entries))
+                {
+                    return false;
+                }
+                nMoved += entries.size();
+                entries.clear();
+            }
+            if (fEnd)
+            {
+                break;
             }
         }
-        else
+        // the entries left in the database after the flag is set are never read again
+        CDBBatch batch(*this);
+        batch.Write(std::make_pair(DB_FLAG, std::string("flatblockindex")), '1');
+        if (!WriteBatch(batch, true) || !EraseDBBlockIndex())
+        {
+            return false;
+        }
+        pflatindex = std::move(pflat);
+    }
+    else
+    {
+        LogPrintf("Moving the block index back into the database...\n");
+        // entries a move into the flat file did not get to erase would come back
+        if (!EraseDBBlockIndex())
+        {
+            return false;
+        }
+        pflatindex->StartLoad();
+        bool fEnd = false;
+        while (!fEnd)
+        {
+            std::vector<uint256> vKeys;
+            std::vector<CPublicDataStream> vValues;
+            if (!pflatindex->Load(nMoveBatch, vKeys, vValues, fEnd))
+            {
+                return false;
+            }
+            CDBBatch batch(*this);
+            for (size_t i = 0; i < vKeys.size(); i++)
+            {
+                CDiskBlockIndex entry;
+                try
+                {
+                    vValues[i] >> entry;
+                }
+                catch (const std::exception &)
+                {
+                    return error("%s: cannot parse block index record", __func__);
+                }
+                batch.Write(std::make_pair(DB_BLOCK_INDEX, vKeys[i]), entry);
+            }
+            if (!WriteBatch(batch))
+            {
+                return false;
+            }
+            nMoved += vKeys.size();
+        }
+        CDBBatch batch(*this);
+        batch.Write(std::make_pair(DB_FLAG, std::string("flatblockindex")), '0');
+        if (!WriteBatch(batch, true))
+        {
+            return false;
+        }
+        pflatindex.reset();
+        fs::remove(FlatBlockIndexPath());
+    }
+    LogPrintf("Moved %u block index entries\n", nMoved);
+    return true;
+}
+
+/** Upgrade the block index from older formats.
+ *
+ * Currently implemented: add the hash checksum to entries written before
+ * DISK_BLOCK_INDEX_CHECKSUM_VERSION. The stored hashes are verified once with the
+ * multi-buffer scrypt, after that loading the index no longer needs any scrypt.
+ */
+bool CBlockTreeDB::Upgrade()
+{
+    bool fUpgraded = false;
+    if (ReadFlag("blockindexchecksum", fUpgraded) && fUpgraded)
+    {
+        return true;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+
+    const size_t nHashBatch = 2000;
+    std::vector<CDiskBlockIndex> vEntries;
+    std::vector<CBlockHeader> vHeaders;
+    vEntries.reserve(nHashBatch);
+    vHeaders.reserve(nHashBatch);
+    size_t nUpgraded = 0;
+    bool fLogged = false;
+
+    std::pair<char, uint256> key;
+    while (true)
+    {
+        if (shutdown_threads.load())
+        {
+            LogPrintf("CBlockTreeDB::Upgrade(): Shutdown requested. Exiting.\n");
+            return false;
+        }
+
+        bool fEnd = !pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX;
+        if (!fEnd)
+        {
+            CDiskBlockIndex diskindex;
+            if (!pcursor->GetValue(diskindex))
+            {
+                return error("%s: cannot parse block index record", __func__);
+            }
+            if (!diskindex.HasHashChecksum())
+            {
+                if (!fLogged)
+                {
+                    LogPrintf("Upgrading block index database...this may take a while\n");
+                    fLogged = true;
+                }
+                CBlockHeader header;
+                header.nVersion = diskindex.nVersion;
+                header.hashPrevBlock = diskindex.hashPrev;
+                header.hashMerkleRoot = diskindex.hashMerkleRoot;
+                header.nTime = diskindex.nTime;
+                header.nBits = diskindex.nBits;
+                header.nNonce = diskindex.nNonce;
+                vHeaders.push_back(header);
+                vEntries.push_back(diskindex);
+            }
+            pcursor->Next();
+        }
+
+        if (vEntries.size() >= nHashBatch || (fEnd && !vEntries.empty()))
+        {
+            CBlockHeader::PrecomputeHashes(vHeaders.data(), vHeaders.size());
+            CDBBatch batch(*this);
+            for (size_t i = 0; i < vEntries.size(); i++)
+            {
+                CDiskBlockIndex &entry = vEntries[i];
+                if (vHeaders[i].GetHash() != entry.hashBlock)
+                {
+                    return error("%s: block index entry %s is corrupt", __func__, entry.hashBlock.ToString());
+                }
+                entry.nHashChecksum = entry.ComputeHashChecksum();
+                batch.Write(std::make_pair(DB_BLOCK_INDEX, entry.hashBlock), entry);
+            }
+            if (!WriteBatch(batch))
+            {
+                return error("%s: failed to write upgraded block index entries", __func__);
+            }
+            nUpgraded += vEntries.size();
+            vEntries.clear();
+            vHeaders.clear();
+        }
+
+        if (fEnd)
         {
             break;
         }
     }
 
-    return true;
+    if (nUpgraded > 0)
+    {
+        LogPrintf("Upgraded %u block index entries\n", nUpgraded);
+    }
+    return WriteFlag("blockindexchecksum", true);
 }
 
 namespace
@@ -366,7 +1069,7 @@ bool CCoinsViewDB::Upgrade()
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
     if (!pcursor->Valid())
     {
-        return true;
+        return UpgradeTxOutSetStats();
     }
 
     LogPrintf("Upgrading database...this may take a while\n");
@@ -420,5 +1123,38 @@ bool CCoinsViewDB::Upgrade()
     db.WriteBatch(batch);
     db.CompactRange({DB_COINS, uint256()}, key);
 
+    return UpgradeTxOutSetStats();
+}
+
+bool CCoinsViewDB::UpgradeTxOutSetStats()
+{
+    CTxOutSetStats stats;
+    if (GetTxOutSetStats(stats))
+        return true;
+
+    LogPrintf("Counting the unspent transaction outputs...this may take a while\n");
+    std::unique_ptr<CCoinsViewCursor> pcursor(Cursor());
+    while (pcursor->Valid())
+    {
+        if (shutdown_threads.load())
+        {
+            LogPrintf("CCoinsViewDB::UpgradeTxOutSetStats(): Shutdown requested. Exiting.\n");
+            return false;
+        }
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+        {
+            return error("%s: cannot parse coin record", __func__);
+        }
+        stats.Add(key, coin);
+        pcursor->Next();
+    }
+    // the coins can not change under this, it runs before any block is connected
+    if (!db.Write(DB_TXOUTSET_STATS, stats))
+    {
+        return error("%s: failed to write the totals of the unspent outputs", __func__);
+    }
+    LogPrintf("Counted %u unspent transaction outputs\n", stats.nTransactionOutputs);
     return true;
 }
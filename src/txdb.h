@@ -21,16 +21,21 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "coins.h"
 #include "dbwrapper.h"
+#include "flatblockindex.h"
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 class CBlockFileInfo;
 class CBlockIndex;
+class CDiskBlockIndex;
 struct CDiskTxPos;
 class uint256;
 
@@ -46,8 +51,8 @@ static const int64_t nDefaultPcntMemUnused = 10;
 static const int64_t nMaxCacheIncreaseSinceLastFlush = 512 * 1000 * 1000;
 //! the minimum system memory we always keep free when doing automatic dbcache sizing
 static const uint64_t nMinMemToKeepAvaialable = 300 * 1000 * 1000;
-//! the max size a batch can get before a write to the utxo is made
-static const size_t nMaxDBBatchSize = 16 << 20;
+//! -dbbatchsize default (bytes), the max size a batch can get before a write to the utxo is made
+static const int64_t nMaxDBBatchSize = 16 << 20;
 //! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
 static const int64_t nMaxBlockDBCache = 2;
 //! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
@@ -67,15 +72,60 @@ public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    size_t GetCoins(const std::vector<COutPoint> &vOutpoints,
+        std::vector<std::pair<COutPoint, Coin> > &vFound) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const;
+    std::vector<uint256> GetHeadBlocks() const override;
+    bool GetTxOutSetStats(CTxOutSetStats &stats) const override;
     bool BatchWrite(CCoinsMap &mapCoins,
         const uint256 &hashBlock,
         const uint64_t nBestCoinHeight,
+        const CTxOutSetStats *pstats,
         size_t &nChildCachedCoinsUsage) override;
+    CCoinsViewCursor *Cursor() const override;
+    CDBStats GetDBStats() const { return db.GetStats(); }
+
+    /** The database as of now for ScanCoins, take it under cs_main right after a flush for the coins of the tip */
+    CDBSnapshot *NewSnapshot() const { return db.NewSnapshot(); }
+    /**
+     * Call f on the coins of snapshot whose txid begins with a byte in [nBegin, nEnd), in key order, until it
+     * returns false. Threads may scan disjoint ranges of the same snapshot at once. False if a coin can not be read.
+     */
+    bool ScanCoins(const CDBSnapshot &snapshot,
+        unsigned int nBegin,
+        unsigned int nEnd,
+        const std::function<bool(const COutPoint &, const Coin &)> &f) const;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+
+private:
+    //! Count the totals of the unspent outputs of a database that was written without them
+    bool UpgradeTxOutSetStats();
+};
+
+/** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
+class CCoinsViewDBCursor : public CCoinsViewCursor
+{
+public:
+    ~CCoinsViewDBCursor() {}
+    bool GetKey(COutPoint &key) const override;
+    bool GetValue(Coin &coin) const override;
+    unsigned int GetValueSize() const override;
+
+    bool Valid() const override;
+    void Next() override;
+
+private:
+    CCoinsViewDBCursor(CDBIterator *pcursorIn, const uint256 &hashBlockIn)
+        : CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn)
+    {
+    }
+    std::unique_ptr<CDBIterator> pcursor;
+    std::pair<char, COutPoint> keyTmp;
+
+    friend class CCoinsViewDB;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -88,6 +138,11 @@ private:
     CBlockTreeDB(const CBlockTreeDB &);
     void operator=(const CBlockTreeDB &);
 
+    //! holds the block index entries instead of the database when set, the "flatblockindex" flag says whether it is
+    std::unique_ptr<CFlatBlockIndex> pflatindex;
+
+    bool EraseDBBlockIndex();
+
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo *> > &fileInfo,
         int nLastFile,
@@ -98,10 +153,45 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    /** Transactions of pruned blocks that can still be spent, with the hash of the block they were read from */
+    bool WritePrunedTxs(const std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > &list);
+    bool ReadPrunedTx(const uint256 &txid, uint256 &hashBlock, CTransaction &tx);
+    /** Set aside the copies of pruned transactions whose last unspent output block hashSpentBy spends */
+    bool MovePrunedTxsSpentBy(const uint256 &hashSpentBy,
+        const std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > &list);
+    /** Put back the copies block hashSpentBy set aside, when it is disconnected */
+    bool RestorePrunedTxsSpentBy(const uint256 &hashSpentBy);
+    /** Drop the copies block hashSpentBy set aside, once it is too deep to be disconnected */
+    bool ErasePrunedTxsSpentBy(const uint256 &hashSpentBy);
+    /** Approximate disk space of the copies of pruned transactions, set aside or not */
+    uint64_t EstimatePrunedTxsSize() const;
+    /** Block index entries as they are stored, for loading a UTXO snapshot before the index is */
+    bool WriteBlockIndexEntries(const std::vector<CDiskBlockIndex> &entries);
+    /** Write and erase what connecting or disconnecting a block changes in the address and spent indexes */
+    bool UpdateAddressIndexes(const CAddressIndexUpdate &update);
+    /** The entries of an address, only those from nStart to nEnd when both heights are set */
+    bool ReadAddressIndex(uint8_t nType,
+        const uint160 &hash,
+        std::vector<std::pair<CAddressIndexKey, CAmount> > &vEntries,
+        int nStart = 0,
+        int nEnd = 0);
+    bool ReadAddressUnspentIndex(uint8_t nType,
+        const uint160 &hash,
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent);
+    bool ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
     bool EraseBlockIndex(uint256 hashToDelete);
+    bool EraseBlockIndexes(const std::vector<uint256> &vHashes);
+
+    /** Move the block index entries into the flat file with fFlat, back into the database without. Returns whether
+     *  the entries are where fFlat asks for. */
+    bool SetFlatIndex(bool fFlat);
+    bool IsFlatIndex() const { return pflatindex != nullptr; }
+
+    //! Add hash checksums to block index entries written by older versions. Returns whether an error occurred.
+    bool Upgrade();
 };
 
 #endif // BITCOIN_TXDB_H
@@ -34,15 +34,28 @@
 
 using namespace std;
 CTxMemPoolEntry::CTxMemPoolEntry()
-    : tx(), nFee(), nTime(0), entryPriority(0), entryHeight(0), hadNoDependencies(0), inChainInputValue(0),
-      spendsCoinbase(false), sigOpCount(0), lockPoints()
 {
-    nTxSize = 0;
-    nModSize = 0;
-    nUsageSize = 0;
-    nCountWithDescendants = 0;
-    feeDelta = 0;
-    sighashType = 0;
+    hot.nFee = 0;
+    hot.feeDelta = 0;
+    hot.nTime = 0;
+    hot.nSizeWithDescendants = 0;
+    hot.nModFeesWithDescendants = 0;
+    hot.nSizeWithAncestors = 0;
+    hot.nModFeesWithAncestors = 0;
+    hot.nTxSize = 0;
+    hot.nUsageSize = 0;
+    hot.nCountWithDescendants = 0;
+    hot.nCountWithAncestors = 0;
+
+    cold.entryPriority = 0;
+    cold.inChainInputValue = 0;
+    cold.runtimeSighashBytes = 0;
+    cold.entryHeight = 0;
+    cold.nModSize = 0;
+    cold.sigOpCount = 0;
+    cold.runtimeSigOpCount = 0;
+    cold.hadNoDependencies = false;
+    cold.spendsCoinbase = false;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx,
@@ -55,28 +68,41 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx,
     bool _spendsCoinbase,
     unsigned int _sigOps,
     LockPoints lp)
-    : tx(_tx), nFee(_nFee), nTime(_nTime), entryPriority(_entryPriority), entryHeight(_entryHeight),
-      hadNoDependencies(poolHasNoInputsOf), inChainInputValue(_inChainInputValue), spendsCoinbase(_spendsCoinbase),
-      sigOpCount(_sigOps), lockPoints(lp)
 {
-    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-    nModSize = tx->CalculateModifiedSize(nTxSize);
-    nUsageSize = RecursiveDynamicUsage(tx);
-
-    nCountWithDescendants = 1;
-    nSizeWithDescendants = nTxSize;
-    nModFeesWithDescendants = nFee;
-    CAmount nValueIn = tx->GetValueOut() + nFee;
-    assert(inChainInputValue <= nValueIn);
-    sighashType = 0;
-    feeDelta = 0;
+    hot.tx = _tx;
+    hot.nFee = _nFee;
+    hot.feeDelta = 0;
+    hot.nTime = _nTime;
+    hot.nTxSize = ::GetSerializeSize(_tx, SER_NETWORK, PROTOCOL_VERSION);
+    hot.nUsageSize = RecursiveDynamicUsage(_tx);
+
+    hot.nCountWithDescendants = 1;
+    hot.nSizeWithDescendants = hot.nTxSize;
+    hot.nModFeesWithDescendants = hot.nFee;
+    hot.nCountWithAncestors = 1;
+    hot.nSizeWithAncestors = hot.nTxSize;
+    hot.nModFeesWithAncestors = hot.nFee;
+
+    cold.entryPriority = _entryPriority;
+    cold.inChainInputValue = _inChainInputValue;
+    cold.runtimeSighashBytes = 0;
+    cold.lockPoints = lp;
+    cold.entryHeight = _entryHeight;
+    cold.nModSize = _tx->CalculateModifiedSize(hot.nTxSize);
+    cold.sigOpCount = _sigOps;
+    cold.runtimeSigOpCount = 0;
+    cold.hadNoDependencies = poolHasNoInputsOf;
+    cold.spendsCoinbase = _spendsCoinbase;
+
+    CAmount nValueIn = _tx->GetValueOut() + hot.nFee;
+    assert(cold.inChainInputValue <= nValueIn);
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry &other) { *this = other; }
 double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 {
-    double deltaPriority = ((double)(currentHeight - entryHeight) * inChainInputValue) / nModSize;
-    double dResult = entryPriority + deltaPriority;
+    double deltaPriority = ((double)(currentHeight - cold.entryHeight) * cold.inChainInputValue) / cold.nModSize;
+    double dResult = cold.entryPriority + deltaPriority;
     if (dResult < 0) // This should only happen if it was called with a height below entry height
         dResult = 0;
     return dResult;
@@ -84,45 +110,35 @@ double CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
 
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 {
-    nModFeesWithDescendants += newFeeDelta - feeDelta;
-    feeDelta = newFeeDelta;
+    hot.nModFeesWithDescendants += newFeeDelta - hot.feeDelta;
+    hot.nModFeesWithAncestors += newFeeDelta - hot.feeDelta;
+    hot.feeDelta = newFeeDelta;
 }
 
-void CTxMemPoolEntry::UpdateLockPoints(const LockPoints &lp) { lockPoints = lp; }
+void CTxMemPoolEntry::UpdateLockPoints(const LockPoints &lp) { cold.lockPoints = lp; }
 void CTxMemPoolEntry::UpdateRuntimeSigOps(uint64_t _runtimeSigOpCount, uint64_t _runtimeSighashBytes)
 {
-    runtimeSigOpCount = _runtimeSigOpCount;
-    runtimeSighashBytes = _runtimeSighashBytes;
+    cold.runtimeSigOpCount = std::min<uint64_t>(_runtimeSigOpCount, std::numeric_limits<uint32_t>::max());
+    cold.runtimeSighashBytes = _runtimeSighashBytes;
 }
 
 // Update the given tx for any in-mempool descendants.
 // Assumes that setMemPoolChildren is correct for the given tx and all
 // descendants.
-bool CTxMemPool::UpdateForDescendants(txiter updateIt,
-    int maxDescendantsToVisit,
+void CTxMemPool::UpdateForDescendants(txiter updateIt,
     cacheMap &cachedDescendants,
     const std::set<uint256> &setExclude)
 {
     AssertLockHeld(cs);
-    // Track the number of entries (outside setExclude) that we'd need to visit
-    // (will bail out if it exceeds maxDescendantsToVisit)
-    int nChildrenToVisit = 0;
-
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const LinkRange updateChildren = GetMemPoolChildren(updateIt);
+    setEntries stageEntries(updateChildren.begin(), updateChildren.end()), setAllDescendants;
 
     while (!stageEntries.empty())
     {
         const txiter cit = *stageEntries.begin();
-        if (cit->IsDirty())
-        {
-            // Don't consider any more children if any descendant is dirty
-            return false;
-        }
         setAllDescendants.insert(cit);
-        stageEntries.erase(cit); // BU its ok to erase here because GetMemPoolChildren does not dereference cit
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        BOOST_FOREACH (const txiter childEntry, setChildren)
+        stageEntries.erase(cit); // BU its ok to erase here, cit itself stays in mapTx
+        for (const txiter childEntry : GetMemPoolChildren(cit))
         {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end())
@@ -131,26 +147,13 @@ bool CTxMemPool::UpdateForDescendants(txiter updateIt,
                 // but don't traverse again.
                 BOOST_FOREACH (const txiter cacheEntry, cacheIt->second)
                 {
-                    // update visit count only for new child transactions
-                    // (outside of setExclude and stageEntries)
-                    if (setAllDescendants.insert(cacheEntry).second &&
-                        !setExclude.count(cacheEntry->GetTx().GetHash()) && !stageEntries.count(cacheEntry))
-                    {
-                        nChildrenToVisit++;
-                    }
+                    setAllDescendants.insert(cacheEntry);
                 }
             }
             else if (!setAllDescendants.count(childEntry))
             {
-                // Schedule for later processing and update our visit count
-                if (stageEntries.insert(childEntry).second && !setExclude.count(childEntry->GetTx().GetHash()))
-                {
-                    nChildrenToVisit++;
-                }
-            }
-            if (nChildrenToVisit > maxDescendantsToVisit)
-            {
-                return false;
+                // Schedule for later processing
+                stageEntries.insert(childEntry);
             }
         }
     }
@@ -167,10 +170,13 @@ bool CTxMemPool::UpdateForDescendants(txiter updateIt,
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
             cachedDescendants[updateIt].insert(cit);
+            // updateIt is a new ancestor of this descendant
+            mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1));
+            _SetDirty(cit);
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
-    return true;
+    _SetDirty(updateIt);
 }
 
 // vHashesToUpdate is the set of transaction hashes from a disconnected block
@@ -220,11 +226,7 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 _UpdateParent(childIter, it, true);
             }
         }
-        if (!UpdateForDescendants(it, 100, mapMemPoolDescendantsToUpdate, setAlreadyIncluded))
-        {
-            // Mark as dirty if we can't do the calculation.
-            mapTx.modify(it, set_dirty());
-        }
+        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
 }
 
@@ -281,8 +283,34 @@ bool CTxMemPool::_CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        const LinkRange parents = GetMemPoolParents(it);
+        parentHashes.insert(parents.begin(), parents.end());
+    }
+
+    // Every ancestor of a parent is an ancestor of this tx too, so the ancestor state of each
+    // parent is a lower bound that turns away a tx extending a chain at the limit without
+    // walking it. The sum over the parents is an upper bound, within the limits the walk below
+    // only has the descendant limits to check.
+    uint64_t nMaxAncestorCount = 1;
+    uint64_t nMaxAncestorSize = entry.GetTxSize();
+    for (txiter piter : parentHashes)
+    {
+        if (piter->GetCountWithAncestors() + 1 > limitAncestorCount)
+        {
+            errString = strprintf("too many unconfirmed ancestors (%u+1) [limit: %u]", piter->GetCountWithAncestors(),
+                limitAncestorCount);
+            return false;
+        }
+        if (piter->GetSizeWithAncestors() + entry.GetTxSize() > limitAncestorSize)
+        {
+            errString = strprintf(" %u exceeds ancestor size limit [limit: %u]",
+                piter->GetSizeWithAncestors() + entry.GetTxSize(), limitAncestorSize);
+            return false;
+        }
+        nMaxAncestorCount += piter->GetCountWithAncestors();
+        nMaxAncestorSize += piter->GetSizeWithAncestors();
     }
+    const bool fCheckAncestorLimits = nMaxAncestorCount > limitAncestorCount || nMaxAncestorSize > limitAncestorSize;
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
@@ -306,15 +334,14 @@ bool CTxMemPool::_CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
                 limitDescendantCount);
             return false;
         }
-        else if (totalSizeWithAncestors > limitAncestorSize)
+        else if (fCheckAncestorLimits && totalSizeWithAncestors > limitAncestorSize)
         {
             errString =
                 strprintf(" %u exceeds ancestor size limit [limit: %u]", totalSizeWithAncestors, limitAncestorSize);
             return false;
         }
 
-        const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
-        BOOST_FOREACH (const txiter &phash, setMemPoolParents)
+        for (const txiter phash : GetMemPoolParents(stageit))
         {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0)
@@ -322,7 +349,7 @@ bool CTxMemPool::_CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
                 parentHashes.insert(phash);
             }
             // removed +1 from test below as per BU: Fix use after free bug
-            if (parentHashes.size() + setAncestors.size() > limitAncestorCount)
+            if (fCheckAncestorLimits && parentHashes.size() + setAncestors.size() > limitAncestorCount)
             {
                 errString = strprintf("too many unconfirmed ancestors (%u+%u) [limit: %u]", parentHashes.size(),
                     setAncestors.size(), limitAncestorCount);
@@ -394,8 +421,7 @@ bool CTxMemPool::ValidateMemPoolAncestors(const std::vector<CTxIn> &txIn,
             return false;
         }
 
-        const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
-        for (const txiter &phash : setMemPoolParents)
+        for (const txiter phash : GetMemPoolParents(stageit))
         {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0)
@@ -420,9 +446,8 @@ bool CTxMemPool::ValidateMemPoolAncestors(const std::vector<CTxIn> &txIn,
 void CTxMemPool::_UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
     AssertLockHeld(cs);
-    setEntries parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
-    BOOST_FOREACH (txiter piter, parentIters)
+    for (txiter piter : GetMemPoolParents(it))
     {
         _UpdateChild(piter, it, add);
     }
@@ -432,27 +457,106 @@ void CTxMemPool::_UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestor
     BOOST_FOREACH (txiter ancestorIt, setAncestors)
     {
         mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
+        _SetDirty(ancestorIt);
+    }
+}
+
+void CTxMemPool::_UpdateEntryForAncestors(txiter it, const setEntries &setAncestors)
+{
+    AssertLockHeld(cs);
+    int64_t updateCount = setAncestors.size();
+    int64_t updateSize = 0;
+    CAmount updateFee = 0;
+    for (txiter ancestorIt : setAncestors)
+    {
+        updateSize += ancestorIt->GetTxSize();
+        updateFee += ancestorIt->GetModifiedFee();
     }
+    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount));
+    _SetDirty(it);
 }
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
     AssertLockHeld(cs);
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-    BOOST_FOREACH (txiter updateIt, setMemPoolChildren)
+    // Removing a link changes only the child's parent links, not the
+    // children of it being walked here.
+    for (txiter updateIt : GetMemPoolChildren(it))
     {
         _UpdateParent(updateIt, it, false);
     }
 }
 
-void CTxMemPool::_UpdateForRemoveFromMempool(const setEntries &entriesToRemove)
+namespace
+{
+/** What an entry that stays loses of its ancestor or descendant state, summed over the entries removed */
+struct RemovedState
+{
+    int64_t nSize = 0;
+    CAmount nFee = 0;
+    int64_t nCount = 0;
+
+    void Add(const CTxMemPoolEntry &removed)
+    {
+        nSize -= removed.GetTxSize();
+        nFee -= removed.GetModifiedFee();
+        nCount--;
+    }
+};
+}
+
+void CTxMemPool::_UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
     AssertLockHeld(cs);
-    // For each entry, walk back all ancestors and decrement size associated with this
-    // transaction
+    // The entries that stay get one modify each, however many of their ancestors or descendants
+    // leave, every modify repositions the entry in all of the indexes of mapTx. The state of
+    // entries that are removed as well is not kept up to date.
     const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-    BOOST_FOREACH (txiter removeIt, entriesToRemove)
+    if (updateDescendants)
+    {
+        // updateDescendants should be true whenever we're not recursively
+        // removing a tx and all its descendants, eg when a transaction is
+        // confirmed in a block.
+        // Here we only update statistics and not the entry links (which
+        // we need to preserve until we're finished with all operations that
+        // need to traverse the mempool).
+        std::map<txiter, RemovedState, CompareIteratorByHash> mapDescendants;
+        for (txiter removeIt : entriesToRemove)
+        {
+            if (GetMemPoolChildren(removeIt).empty())
+                continue;
+            setEntries setDescendants;
+            _CalculateDescendants(removeIt, setDescendants);
+            for (txiter dit : setDescendants)
+            {
+                // also leaves out removeIt itself
+                if (!entriesToRemove.count(dit))
+                    mapDescendants[dit].Add(*removeIt);
+            }
+        }
+        for (const auto &item : mapDescendants)
+        {
+            const RemovedState &removed = item.second;
+            mapTx.modify(item.first, update_ancestor_state(removed.nSize, removed.nFee, removed.nCount));
+            _SetDirty(item.first);
+        }
+    }
+    std::map<txiter, RemovedState, CompareIteratorByHash> mapAncestors;
+    for (txiter removeIt : entriesToRemove)
     {
+        // Sever the child links that point to removeIt in the entries for its
+        // parents. This is fine since we don't need to use the mempool children
+        // of any entries to walk back over our ancestors (but we do need the
+        // mempool parents!)
+        bool fHasParents = false;
+        for (txiter piter : GetMemPoolParents(removeIt))
+        {
+            _UpdateChild(piter, removeIt, false);
+            fHasParents = true;
+        }
+        if (!fHasParents)
+            continue;
+
         setEntries setAncestors;
         const CTxMemPoolEntry &entry = *removeIt;
         std::string dummy;
@@ -462,24 +566,30 @@ void CTxMemPool::_UpdateForRemoveFromMempool(const setEntries &entriesToRemove)
         // should be a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of
+        // of ancestors reachable via the links will be the same as the set of
         // ancestors whose packages include this transaction, because when we
         // add a new transaction to the mempool in addUnchecked(), we assume it
         // has no children, and in the case of a reorg where that assumption is
         // false, the in-mempool children aren't linked to the in-block tx's
         // until UpdateTransactionsFromBlock() is called.
         // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
+        // UpdateTransactionsFromBlock() has been called, then the links will
         // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
+        // and it's important that we use the links' notion of ancestor
         // transactions as the set of things to update for removal.
         _CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-        // Note that UpdateAncestorsOf severs the child links that point to
-        // removeIt in the entries for the parents of removeIt.  This is
-        // fine since we don't need to use the mempool children of any entries
-        // to walk back over our ancestors (but we do need the mempool
-        // parents!)
-        _UpdateAncestorsOf(false, removeIt, setAncestors);
+        for (txiter ancestorIt : setAncestors)
+        {
+            // the ancestors of a block transaction are normally in the block as well
+            if (!entriesToRemove.count(ancestorIt))
+                mapAncestors[ancestorIt].Add(entry);
+        }
+    }
+    for (const auto &item : mapAncestors)
+    {
+        const RemovedState &removed = item.second;
+        mapTx.modify(item.first, update_descendant_state(removed.nSize, removed.nFee, removed.nCount));
+        _SetDirty(item.first);
     }
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update setMemPoolParents
@@ -490,26 +600,27 @@ void CTxMemPool::_UpdateForRemoveFromMempool(const setEntries &entriesToRemove)
     }
 }
 
-void CTxMemPoolEntry::SetDirty()
+void CTxMemPoolEntry::UpdateState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
 {
-    nCountWithDescendants = 0;
-    nSizeWithDescendants = nTxSize;
-    nModFeesWithDescendants = GetModifiedFee();
+    int64_t nNewCount = (int64_t)hot.nCountWithDescendants + modifyCount;
+    assert(nNewCount > 0 && nNewCount <= std::numeric_limits<uint32_t>::max());
+    hot.nSizeWithDescendants += modifySize;
+    assert(int64_t(hot.nSizeWithDescendants) > 0);
+    hot.nModFeesWithDescendants += modifyFee;
+    hot.nCountWithDescendants = nNewCount;
 }
 
-void CTxMemPoolEntry::UpdateState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
 {
-    if (!IsDirty())
-    {
-        nSizeWithDescendants += modifySize;
-        assert(int64_t(nSizeWithDescendants) > 0);
-        nModFeesWithDescendants += modifyFee;
-        nCountWithDescendants += modifyCount;
-        assert(int64_t(nCountWithDescendants) > 0);
-    }
+    int64_t nNewCount = (int64_t)hot.nCountWithAncestors + modifyCount;
+    assert(nNewCount > 0 && nNewCount <= std::numeric_limits<uint32_t>::max());
+    hot.nSizeWithAncestors += modifySize;
+    assert(int64_t(hot.nSizeWithAncestors) > 0);
+    hot.nModFeesWithAncestors += modifyFee;
+    hot.nCountWithAncestors = nNewCount;
 }
 
-CTxMemPool::CTxMemPool(const CFeeRate &_minReasonableRelayFee) : nTransactionsUpdated(0)
+CTxMemPool::CTxMemPool(const CFeeRate &_minReasonableRelayFee) : nTransactionsUpdated(0), nSequence(0)
 {
     _clear(); // lock free clear
 
@@ -556,7 +667,10 @@ bool CTxMemPool::addUnchecked(const uint256 &hash,
         return true;
     }
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    // The links of the given entry, if any, point at nothing in this pool
+    newit->parents.clear();
+    newit->children.clear();
+    _SetDirty(newit);
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -571,10 +685,10 @@ bool CTxMemPool::addUnchecked(const uint256 &hash,
         }
     }
 
-    // Update cachedInnerUsage to include contained transaction's usage.
-    // (When we update the entry for in-mempool parents, memory usage will be
-    // further updated.)
-    cachedInnerUsage += entry.DynamicMemoryUsage();
+    // Update cachedTxUsage to include contained transaction's usage.
+    // (When we update the entry for in-mempool parents, cachedLinksUsage will
+    // be updated.)
+    cachedTxUsage += entry.DynamicMemoryUsage();
 
     const CTransaction &tx = newit->GetTx();
     std::set<uint256> setParentTransactions;
@@ -600,10 +714,13 @@ bool CTxMemPool::addUnchecked(const uint256 &hash,
         }
     }
     _UpdateAncestorsOf(true, newit, setAncestors);
+    _UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
+    NotifyEntryAdded(entry.GetSharedTx(), ++nSequence);
+    _PublishSize();
 
     return true;
 }
@@ -611,18 +728,27 @@ bool CTxMemPool::addUnchecked(const uint256 &hash,
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     AssertLockHeld(cs);
-    NotifyEntryRemoved(it->GetSharedTx(), reason);
+    NotifyEntryRemoved(it->GetSharedTx(), reason, ++nSequence);
     const uint256 hash = it->GetTx().GetHash();
     BOOST_FOREACH (const CTxIn &txin, it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
     totalTxSize -= it->GetTxSize();
-    cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
+    cachedTxUsage -= it->DynamicMemoryUsage();
+    cachedLinksUsage -= it->parents.DynamicMemoryUsage() + it->children.DynamicMemoryUsage();
+    setDirty.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(hash);
+    _PublishSize();
+}
+
+void CTxMemPool::_PublishSize()
+{
+    AssertLockHeld(cs);
+    nPublishedTxs.store(mapTx.size(), std::memory_order_relaxed);
+    nPublishedBytes.store(totalTxSize, std::memory_order_relaxed);
+    nPublishedUsage.store(_GetMemoryUsage().Total(), std::memory_order_relaxed);
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and adds to
@@ -646,10 +772,9 @@ void CTxMemPool::_CalculateDescendants(txiter entryit, setEntries &setDescendant
     {
         txiter it = *stage.begin();
         setDescendants.insert(it);
-        stage.erase(it); // BU its ok to erase here because GetMemPoolChildren does not dereference it
+        stage.erase(it); // BU its ok to erase here, it itself stays in mapTx
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
-        BOOST_FOREACH (const txiter &childiter, setChildren)
+        for (const txiter childiter : GetMemPoolChildren(it))
         {
             if (!setDescendants.count(childiter))
             {
@@ -659,13 +784,19 @@ void CTxMemPool::_CalculateDescendants(txiter entryit, setEntries &setDescendant
     }
 }
 
-void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransactionRef> &removed, bool fRecursive)
+void CTxMemPool::remove(const CTransaction &origTx,
+    std::list<CTransactionRef> &removed,
+    bool fRecursive,
+    MemPoolRemovalReason reason)
 {
     WRITELOCK(cs);
-    _remove(origTx, removed, fRecursive);
+    _remove(origTx, removed, fRecursive, reason);
 }
 
-void CTxMemPool::_remove(const CTransaction &origTx, std::list<CTransactionRef> &removed, bool fRecursive)
+void CTxMemPool::_remove(const CTransaction &origTx,
+    std::list<CTransactionRef> &removed,
+    bool fRecursive,
+    MemPoolRemovalReason reason)
 {
     AssertLockHeld(cs);
     // Remove transaction from memory pool
@@ -707,7 +838,8 @@ void CTxMemPool::_remove(const CTransaction &origTx, std::list<CTransactionRef>
     {
         removed.push_back(it->GetSharedTx());
     }
-    _RemoveStaged(setAllRemoves);
+    // without fRecursive the descendants stay and lose these ancestors
+    _RemoveStaged(setAllRemoves, !fRecursive, reason);
 }
 
 void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags)
@@ -752,7 +884,7 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
     for (const CTransaction &tx : transactionsToRemove)
     {
         std::list<CTransactionRef> removed;
-        _remove(tx, removed, true);
+        _remove(tx, removed, true, MemPoolRemovalReason::REORG);
     }
 }
 
@@ -774,7 +906,7 @@ void CTxMemPool::_removeConflicts(const CTransaction &tx, std::list<CTransaction
             const CTransaction &txConflict = *it->second.ptx;
             if (txConflict != tx)
             {
-                _remove(txConflict, removed, true);
+                _remove(txConflict, removed, true, MemPoolRemovalReason::CONFLICT);
                 _ClearPrioritisation(txConflict.GetHash());
             }
         }
@@ -791,18 +923,30 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx,
 {
     WRITELOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
+    std::vector<txiter> vRemove;
+    setEntries stage;
     for (const auto &tx : vtx)
     {
         uint256 hash = tx->GetHash();
 
         indexed_transaction_set::iterator i = mapTx.find(hash);
         if (i != mapTx.end())
+        {
             entries.push_back(*i);
+            vRemove.push_back(i);
+            stage.insert(i);
+        }
     }
+    // The block leaves as one stage, the state of what stays is updated once for all of it. The
+    // entries are removed in block order, which is the order of their notifications.
+    _UpdateForRemoveFromMempool(stage, true);
+    for (txiter it : vRemove)
+    {
+        removeUnchecked(it, MemPoolRemovalReason::BLOCK);
+    }
+    // with the block transactions gone, what still spends their inputs conflicts with them
     for (const auto &tx : vtx)
     {
-        std::list<CTransactionRef> dummy;
-        _remove(*tx, dummy, false);
         _removeConflicts(*tx, conflicts);
         _ClearPrioritisation(tx->GetHash());
     }
@@ -814,11 +958,15 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx,
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    setDirty.clear();
     totalTxSize = 0;
-    cachedInnerUsage = 0;
+    cachedTxUsage = 0;
+    cachedLinksUsage = 0;
+    nPublishedTxs.store(0, std::memory_order_relaxed);
+    nPublishedBytes.store(0, std::memory_order_relaxed);
+    nPublishedUsage.store(0, std::memory_order_relaxed);
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
@@ -836,30 +984,33 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     if (nCheckFrequency == 0)
         return;
 
-    if (GetRand(std::numeric_limits<uint32_t>::max()) >= nCheckFrequency)
+    if (GetFastRand(std::numeric_limits<uint32_t>::max()) >= nCheckFrequency)
         return;
 
     uint64_t checkTotal = 0;
-    uint64_t innerUsage = 0;
+    uint64_t txUsage = 0;
+    uint64_t linksUsage = 0;
 
     READLOCK(cs);
-    // LogPrintf("MEMPOOL", "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(),
-    //    (unsigned int)mapNextTx.size());
+    LOCK(cs_check);
+    // LogPrintf("MEMPOOL", "Checking %u of %u mempool transactions\n", (unsigned int)setDirty.size(),
+    //    (unsigned int)mapTx.size());
 
-    CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache *>(pcoins));
-
-    list<const CTxMemPoolEntry *> waitingOnDependants;
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++)
     {
-        unsigned int i = 0;
         checkTotal += it->GetTxSize();
-        innerUsage += it->DynamicMemoryUsage();
+        txUsage += it->DynamicMemoryUsage();
+        linksUsage += it->parents.DynamicMemoryUsage() + it->children.DynamicMemoryUsage();
+    }
+
+    // Entries that did not change since the last check were verified then, everything that changes the state
+    // or links of an entry marks it dirty.
+    for (txiter it : setDirty)
+    {
+        unsigned int i = 0;
         const CTransaction &tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
-        bool fDependsWait = false;
+        // the coins of the chain and the outputs of the in-mempool parents
+        CCoinsViewCache viewInputs(const_cast<CCoinsViewCache *>(pcoins));
         setEntries setParentCheck;
         BOOST_FOREACH (const CTxIn &txin, tx.vin)
         {
@@ -869,8 +1020,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             {
                 const CTransaction &tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
-                fDependsWait = true;
-                setParentCheck.insert(it2);
+                if (setParentCheck.insert(it2).second)
+                    AddCoins(viewInputs, tx2, MEMPOOL_HEIGHT);
             }
             else
             {
@@ -883,7 +1034,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second.n == i);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        const LinkRange parents = GetMemPoolParents(it);
+        assert(setParentCheck == setEntries(parents.begin(), parents.end()));
+        assert(setParentCheck.size() == parents.size());
         // Check children against mapNextTx
         CTxMemPool::setEntries setChildrenCheck;
         std::map<COutPoint, CInPoint>::const_iterator iter = mapNextTx.lower_bound(COutPoint(it->GetTx().GetHash(), 0));
@@ -899,46 +1052,33 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 childModFee += childit->GetModifiedFee();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        const LinkRange children = GetMemPoolChildren(it);
+        assert(setChildrenCheck == setEntries(children.begin(), children.end()));
+        assert(setChildrenCheck.size() == children.size());
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
-        if (!it->IsDirty())
-        {
-            assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
-        }
-        else
-        {
-            assert(it->GetSizeWithDescendants() == it->GetTxSize());
-            assert(it->GetModFeesWithDescendants() == it->GetModifiedFee());
-        }
+        assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
 
-        if (fDependsWait)
-            waitingOnDependants.push_back(&(*it));
-        else
+        // Verify ancestor state is correct.
+        setEntries setAncestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        const_cast<CTxMemPool *>(this)->_CalculateMemPoolAncestors(
+            *it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+        uint64_t nCountCheck = setAncestors.size() + 1;
+        uint64_t nSizeCheck = it->GetTxSize();
+        CAmount nFeesCheck = it->GetModifiedFee();
+        for (txiter ancestorIt : setAncestors)
         {
-            CValidationState state;
-            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, NULL));
-            UpdateCoins(tx, state, mempoolDuplicate, 1000000);
+            nSizeCheck += ancestorIt->GetTxSize();
+            nFeesCheck += ancestorIt->GetModifiedFee();
         }
-    }
-    unsigned int stepsSinceLastRemove = 0;
-    while (!waitingOnDependants.empty())
-    {
-        const CTxMemPoolEntry *entry = waitingOnDependants.front();
-        waitingOnDependants.pop_front();
+        assert(it->GetCountWithAncestors() == nCountCheck);
+        assert(it->GetSizeWithAncestors() == nSizeCheck);
+        assert(it->GetModFeesWithAncestors() == nFeesCheck);
+
         CValidationState state;
-        if (!mempoolDuplicate.HaveInputs(entry->GetTx()))
-        {
-            waitingOnDependants.push_back(entry);
-            stepsSinceLastRemove++;
-            assert(stepsSinceLastRemove < waitingOnDependants.size());
-        }
-        else
-        {
-            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, NULL));
-            UpdateCoins(entry->GetTx(), state, mempoolDuplicate, 1000000);
-            stepsSinceLastRemove = 0;
-        }
+        assert(CheckInputs(tx, state, viewInputs, false, 0, false, NULL));
     }
     for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++)
     {
@@ -952,7 +1092,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     }
 
     assert(totalTxSize == checkTotal);
-    assert(innerUsage == cachedInnerUsage);
+    assert(txUsage == cachedTxUsage);
+    assert(linksUsage == cachedLinksUsage);
+    setDirty.clear();
 }
 
 void CTxMemPool::queryHashes(vector<uint256> &vtxid) const
@@ -960,6 +1102,19 @@ void CTxMemPool::queryHashes(vector<uint256> &vtxid) const
     READLOCK(mempool.cs);
     _queryHashes(vtxid);
 }
+void CTxMemPool::queryHashes(vector<uint256> &vtxid, uint64_t &nSequenceOut) const
+{
+    READLOCK(cs);
+    _queryHashes(vtxid);
+    nSequenceOut = nSequence;
+}
+
+uint64_t CTxMemPool::GetSequence() const
+{
+    READLOCK(cs);
+    return nSequence;
+}
+
 void CTxMemPool::_queryHashes(vector<uint256> &vtxid) const
 {
     vtxid.clear();
@@ -1081,6 +1236,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash,
         if (it != mapTx.end())
         {
             mapTx.modify(it, update_fee_delta(deltas.second));
+            _SetDirty(it);
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -1089,8 +1245,20 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash,
             BOOST_FOREACH (txiter ancestorIt, setAncestors)
             {
                 mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
+                _SetDirty(ancestorIt);
+            }
+            // and all descendants' modified fees with ancestors
+            setEntries setDescendants;
+            _CalculateDescendants(it, setDescendants);
+            setDescendants.erase(it);
+            for (txiter descendantIt : setDescendants)
+            {
+                mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0));
+                _SetDirty(descendantIt);
             }
         }
+        // block templates have to pick up the new priority
+        ++nTransactionsUpdated;
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -1152,6 +1320,27 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const
     return (base->GetCoin(outpoint, coin) && !coin.IsSpent());
 }
 
+size_t CCoinsViewMemPool::GetCoins(const std::vector<COutPoint> &vOutpoints,
+    std::vector<std::pair<COutPoint, Coin> > &vFound) const
+{
+    size_t nFound = 0;
+    std::vector<COutPoint> vBase;
+    for (const COutPoint &outpoint : vOutpoints)
+    {
+        CTransactionRef ptx = mempool._get(outpoint.hash);
+        if (!ptx)
+            vBase.push_back(outpoint);
+        else if (outpoint.n < ptx->vout.size())
+        {
+            vFound.emplace_back(outpoint, Coin(ptx->vout[outpoint.n], MEMPOOL_HEIGHT, false, false, ptx->nTime));
+            nFound++;
+        }
+    }
+    if (!vBase.empty())
+        nFound += base->GetCoins(vBase, vFound);
+    return nFound;
+}
+
 bool CCoinsViewMemPool::HaveCoin(const COutPoint &outpoint) const
 {
     return mempool.exists(outpoint) || base->HaveCoin(outpoint);
@@ -1168,20 +1357,36 @@ size_t CTxMemPool::DynamicMemoryUsage() const
 size_t CTxMemPool::_DynamicMemoryUsage() const
 {
     AssertLockHeld(cs);
+    return _GetMemoryUsage().Total();
+}
+
+MempoolMemoryUsage CTxMemPool::GetMemoryUsage() const
+{
+    READLOCK(cs);
+    return _GetMemoryUsage();
+}
+
+MempoolMemoryUsage CTxMemPool::_GetMemoryUsage() const
+{
+    AssertLockHeld(cs);
+    MempoolMemoryUsage usage;
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for
     // boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void *)) * mapTx.size() +
-           memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) +
-           cachedInnerUsage;
+    usage.nEntries = memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void *)) * mapTx.size();
+    usage.nTransactions = cachedTxUsage;
+    usage.nLinks = cachedLinksUsage;
+    usage.nNextTx = memusage::DynamicUsage(mapNextTx);
+    usage.nDeltas = memusage::DynamicUsage(mapDeltas);
+    return usage;
 }
 
-void CTxMemPool::_RemoveStaged(setEntries &stage)
+void CTxMemPool::_RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason)
 {
     AssertLockHeld(cs);
-    _UpdateForRemoveFromMempool(stage);
+    _UpdateForRemoveFromMempool(stage, updateDescendants);
     BOOST_FOREACH (const txiter &it, stage)
     {
-        removeUnchecked(it);
+        removeUnchecked(it, reason);
     }
 }
 
@@ -1202,13 +1407,12 @@ int CTxMemPool::Expire(int64_t time, std::vector<COutPoint> &vCoinsToUncache)
         for (const CTxIn &txin : iter->GetTx().vin)
             vCoinsToUncache.push_back(txin.prevout);
 
-    _RemoveStaged(stage);
+    _RemoveStaged(stage, false, MemPoolRemovalReason::EXPIRY);
     return stage.size();
 }
 
 bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate)
 {
-    NotifyEntryAdded(entry.GetSharedTx());
     WRITELOCK(cs);
     setEntries setAncestors;
     uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -1219,48 +1423,42 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
 
 void CTxMemPool::_UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
     AssertLockHeld(cs);
-    if (add && mapLinks[entry].children.insert(child).second)
-    {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    }
-    else if (!add && mapLinks[entry].children.erase(child))
-    {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
+    CTxMemPoolLinks &links = entry->children;
+    _SetDirty(entry);
+    cachedLinksUsage -= links.DynamicMemoryUsage();
+    if (add)
+        links.insert(&*child);
+    else
+        links.erase(&*child);
+    cachedLinksUsage += links.DynamicMemoryUsage();
 }
 
 void CTxMemPool::_UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
     AssertLockHeld(cs);
-    if (add && mapLinks[entry].parents.insert(parent).second)
-    {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    }
-    else if (!add && mapLinks[entry].parents.erase(parent))
-    {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
+    CTxMemPoolLinks &links = entry->parents;
+    _SetDirty(entry);
+    cachedLinksUsage -= links.DynamicMemoryUsage();
+    if (add)
+        links.insert(&*parent);
+    else
+        links.erase(&*parent);
+    cachedLinksUsage += links.DynamicMemoryUsage();
 }
 
-const CTxMemPool::setEntries &CTxMemPool::GetMemPoolParents(txiter entry) const
+CTxMemPool::LinkRange CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     AssertLockHeld(cs);
     assert(entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    return LinkRange(mapTx, entry->parents);
 }
 
-const CTxMemPool::setEntries &CTxMemPool::GetMemPoolChildren(txiter entry) const
+CTxMemPool::LinkRange CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     AssertLockHeld(cs);
     assert(entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    return LinkRange(mapTx, entry->children);
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
@@ -1336,7 +1534,7 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint> *pvNoSpends
             BOOST_FOREACH (txiter iter, stage)
                 txn.push_back(iter->GetTx());
         }
-        _RemoveStaged(stage);
+        _RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
         if (pvNoSpendsRemaining)
         {
             BOOST_FOREACH (const CTransaction &tx, txn)
@@ -1356,8 +1554,8 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint> *pvNoSpends
 
     if (maxFeeRateRemoved > CFeeRate(0))
     {
-        LogPrint(
-            "MEMPOOL", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+        LogPrint(Logging::MEMPOOL, "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved,
+            maxFeeRateRemoved.ToString());
     }
 }
 
@@ -1383,6 +1581,7 @@ void CTxMemPool::UpdateTransactionsPerSecond()
 }
 
 SaltedTxidHasher::SaltedTxidHasher()
-    : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+    : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())),
+      fSipHash24(fSipHash24Maps)
 {
 }
@@ -22,12 +22,16 @@
 #define BITCOIN_TXMEMPOOL_H
 
 
+#include <algorithm>
+#include <atomic>
 #include <list>
 #include <set>
 
 #include "amount.h"
 #include "chain/tx.h"
 #include "coins.h"
+#include "memusage.h"
+#include "prevector.h"
 #include "random.h"
 #include "sync.h"
 
@@ -48,8 +52,8 @@ inline bool AllowFree(double dPriority)
     return dPriority > AllowFreeThreshold();
 }
 
-/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
-static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
+/** Fake height value used in Coin to signify they are only in the memory pool, the largest one a coin can have */
+static const uint32_t MEMPOOL_HEIGHT = MAX_COIN_HEIGHT;
 
 struct LockPoints
 {
@@ -67,55 +71,132 @@ struct LockPoints
 };
 
 class CTxMemPool;
+class CTxMemPoolEntry;
+
+/** \class CTxMemPoolLinks
+ *
+ * The in-mempool parents (or children) of an entry, kept inside the entry
+ * itself instead of in a side map of std::sets. Most transactions have one or
+ * two in-mempool parents or children, which fit in the inline storage of the
+ * prevector, so a link usually costs no allocation at all. Sorted by address,
+ * which is stable for as long as the entry is in mapTx.
+ */
+class CTxMemPoolLinks
+{
+public:
+    typedef prevector<2, const CTxMemPoolEntry *> vector_type;
+    typedef vector_type::const_iterator const_iterator;
+
+    //! Returns true if the link was not present yet
+    bool insert(const CTxMemPoolEntry *entry)
+    {
+        vector_type::iterator it = std::lower_bound(links.begin(), links.end(), entry);
+        if (it != links.end() && *it == entry)
+            return false;
+        links.insert(it, entry);
+        return true;
+    }
+    //! Returns true if the link was present
+    bool erase(const CTxMemPoolEntry *entry)
+    {
+        vector_type::iterator it = std::lower_bound(links.begin(), links.end(), entry);
+        if (it == links.end() || *it != entry)
+            return false;
+        links.erase(it);
+        // Move back into the inline storage once there is room
+        if (links.size() <= 2)
+            links.shrink_to_fit();
+        return true;
+    }
+    void clear()
+    {
+        links.clear();
+        links.shrink_to_fit();
+    }
+
+    const_iterator begin() const { return links.begin(); }
+    const_iterator end() const { return links.end(); }
+    size_t size() const { return links.size(); }
+    bool empty() const { return links.empty(); }
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(links); }
+private:
+    vector_type links;
+};
 
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the correponding transaction, as well
  * as data about all in-mempool transactions that depend on the transaction
- * ("descendant" transactions).
+ * ("descendant" transactions) and all in-mempool transactions it depends on
+ * ("ancestor" transactions).
  *
  * When a new entry is added to the mempool, we update the descendant state
  * (nCountWithDescendants, nSizeWithDescendants, and nModFeesWithDescendants) for
- * all ancestors of the newly added transaction.
+ * all ancestors of the newly added transaction, and set its ancestor state
+ * (nCountWithAncestors, nSizeWithAncestors, and nModFeesWithAncestors) from them.
+ * The ancestor state of an in-mempool parent bounds the ancestors of a new child,
+ * which lets the ancestor limits reject a long chain without walking it.
  *
- * If updating the descendant state is skipped, we can mark the entry as
- * "dirty", and set nSizeWithDescendants/nModFeesWithDescendants to equal nTxSize/
- * nFee+feeDelta. (This can potentially happen during a reorg, where we limit the
- * amount of work we're willing to do to avoid consuming too much CPU.)
+ * The fields are split in two: the ones the mapTx indices and the package
+ * limits read on every comparison, and the ones only looked at when mining or
+ * on a reorg. Sizes, counts and heights are stored as 32 bits, which is plenty
+ * for anything the consensus and policy limits allow. The links to the
+ * in-mempool parents and children live in the entry, which saves a map node
+ * per entry and a set node per link.
  *
  */
 
 class CTxMemPoolEntry
 {
 private:
-    CTransactionRef tx;
-    CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
-    size_t nTxSize; //! ... and avoid recomputing tx size
-    size_t nModSize; //! ... and modified size for priority
-    size_t nUsageSize; //! ... and total memory usage
-    int64_t nTime; //! Local time when entering the mempool
-    double entryPriority; //! Priority when entering the mempool
-    unsigned int entryHeight; //! Chain height when entering the mempool
-    bool hadNoDependencies; //! Not dependent on any other txs when it entered the mempool
-    CAmount inChainInputValue; //! Sum of all txin values that are already in blockchain
-    bool spendsCoinbase; //! keep track of transactions that spend a coinbase
-    unsigned int sigOpCount; //! Legacy sig ops plus P2SH sig op count
-    uint64_t runtimeSigOpCount; //! Runtime signature operation count
-    uint64_t runtimeSighashBytes; //! Runtime bytes hashed for signature operations
-    int64_t feeDelta; //! Used for determining the priority of the transaction for mining in a block
-    LockPoints lockPoints; //! Track the height and time at which tx was final
-
-    // Information about descendants of this transaction that are in the
-    // mempool; if we remove this transaction we must remove all of these
-    // descendants as well.  if nCountWithDescendants is 0, treat this entry as
-    // dirty, and nSizeWithDescendants and nModFeesWithDescendants will not be
-    // correct.
-    uint64_t nCountWithDescendants; //! number of descendant transactions
-    uint64_t nSizeWithDescendants; //! ... and size
-    CAmount nModFeesWithDescendants; //! ... and total fees (all including us)
+    friend class CTxMemPool;
+
+    struct HotState
+    {
+        CTransactionRef tx;
+        CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
+        int64_t feeDelta; //! Used for determining the priority of the transaction for mining in a block
+        int64_t nTime; //! Local time when entering the mempool
+
+        // Information about descendants of this transaction that are in the
+        // mempool; if we remove this transaction we must remove all of these
+        // descendants as well.
+        uint64_t nSizeWithDescendants; //! size of descendant transactions
+        CAmount nModFeesWithDescendants; //! ... and total fees (all including us)
+
+        // Analogous statistics for ancestor transactions
+        uint64_t nSizeWithAncestors; //! size of ancestor transactions
+        CAmount nModFeesWithAncestors; //! ... and total fees (all including us)
+
+        uint32_t nTxSize; //! Cached to avoid recomputing tx size
+        uint32_t nUsageSize; //! ... and memory usage of the transaction
+        uint32_t nCountWithDescendants; //! number of descendant transactions (including us)
+        uint32_t nCountWithAncestors; //! number of ancestor transactions (including us)
+    };
+
+    struct ColdState
+    {
+        double entryPriority; //! Priority when entering the mempool
+        CAmount inChainInputValue; //! Sum of all txin values that are already in blockchain
+        uint64_t runtimeSighashBytes; //! Runtime bytes hashed for signature operations
+        LockPoints lockPoints; //! Track the height and time at which tx was final
+        uint32_t entryHeight; //! Chain height when entering the mempool
+        uint32_t nModSize; //! Modified size for priority
+        uint32_t sigOpCount; //! Legacy sig ops plus P2SH sig op count
+        uint32_t runtimeSigOpCount; //! Runtime signature operation count
+        bool hadNoDependencies; //! Not dependent on any other txs when it entered the mempool
+        bool spendsCoinbase; //! keep track of transactions that spend a coinbase
+    };
+
+    HotState hot;
+    ColdState cold;
+
+    // Direct in-mempool parents and children. Maintained by CTxMemPool, they do
+    // not take part in any mapTx ordering so they may change in place.
+    mutable CTxMemPoolLinks parents;
+    mutable CTxMemPoolLinks children;
 
 public:
-    unsigned char sighashType;
     CTxMemPoolEntry();
     CTxMemPoolEntry(const CTransactionRef &_tx,
         const CAmount &_nFee,
@@ -130,44 +211,43 @@ public:
 
     CTxMemPoolEntry(const CTxMemPoolEntry &other);
 
-    const CTransaction &GetTx() const { return *this->tx; }
-    CTransactionRef GetSharedTx() const { return this->tx; }
+    const CTransaction &GetTx() const { return *this->hot.tx; }
+    CTransactionRef GetSharedTx() const { return this->hot.tx; }
     /**
      * Fast calculation of lower bound of current priority as update
      * from entry priority. Only inputs that were originally in-chain will age.
      */
     double GetPriority(unsigned int currentHeight) const;
-    const CAmount &GetFee() const { return nFee; }
-    size_t GetTxSize() const { return nTxSize; }
-    int64_t GetTime() const { return nTime; }
-    unsigned int GetHeight() const { return entryHeight; }
-    bool WasClearAtEntry() const { return hadNoDependencies; }
-    unsigned int GetSigOpCount() const { return sigOpCount; }
-    uint64_t GetRuntimeSigOpCount() const { return runtimeSigOpCount; }
-    uint64_t GetRuntimeSighashBytes() const { return runtimeSighashBytes; }
-    int64_t GetModifiedFee() const { return nFee + feeDelta; }
-    size_t DynamicMemoryUsage() const { return nUsageSize; }
-    const LockPoints &GetLockPoints() const { return lockPoints; }
-    // Adjusts the descendant state, if this entry is not dirty.
+    const CAmount &GetFee() const { return hot.nFee; }
+    size_t GetTxSize() const { return hot.nTxSize; }
+    int64_t GetTime() const { return hot.nTime; }
+    unsigned int GetHeight() const { return cold.entryHeight; }
+    bool WasClearAtEntry() const { return cold.hadNoDependencies; }
+    unsigned int GetSigOpCount() const { return cold.sigOpCount; }
+    uint64_t GetRuntimeSigOpCount() const { return cold.runtimeSigOpCount; }
+    uint64_t GetRuntimeSighashBytes() const { return cold.runtimeSighashBytes; }
+    int64_t GetModifiedFee() const { return hot.nFee + hot.feeDelta; }
+    size_t DynamicMemoryUsage() const { return hot.nUsageSize; }
+    const LockPoints &GetLockPoints() const { return cold.lockPoints; }
+    // Adjusts the descendant state.
     void UpdateState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    // Adjusts the ancestor state.
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
     // Updates the fee delta used for mining priority score, and the
-    // modified fees with descendants.
+    // modified fees with descendants and ancestors.
     void UpdateFeeDelta(int64_t feeDelta);
     // Update the LockPoints after a reorg
     void UpdateLockPoints(const LockPoints &lp);
     // Update runtime validation resource usage
     void UpdateRuntimeSigOps(uint64_t _runtimeSigOpCount, uint64_t _runtimeSighashBytes);
 
-    /** We can set the entry to be dirty if doing the full calculation of in-
-     *  mempool descendants will be too expensive, which can potentially happen
-     *  when re-adding transactions from a block back to the mempool.
-     */
-    void SetDirty();
-    bool IsDirty() const { return nCountWithDescendants == 0; }
-    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
-    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
-    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
-    bool GetSpendsCoinbase() const { return spendsCoinbase; }
+    uint64_t GetCountWithDescendants() const { return hot.nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return hot.nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return hot.nModFeesWithDescendants; }
+    uint64_t GetCountWithAncestors() const { return hot.nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return hot.nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return hot.nModFeesWithAncestors; }
+    bool GetSpendsCoinbase() const { return cold.spendsCoinbase; }
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -185,9 +265,18 @@ private:
     int64_t modifyCount;
 };
 
-struct set_dirty
+struct update_ancestor_state
 {
-    void operator()(CTxMemPoolEntry &e) const { e.SetDirty(); }
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount)
+        : modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    {
+    }
+
+    void operator()(CTxMemPoolEntry &e) const { e.UpdateAncestorState(modifySize, modifyFee, modifyCount); }
+private:
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
 };
 
 struct update_fee_delta
@@ -270,6 +359,51 @@ public:
     }
 };
 
+/** \class CompareTxMemPoolEntryByAncestorFee
+ *
+ *  Sort by min(score/size of entry's tx, score/size with all ancestors) in descending order, the feerate a
+ *  transaction is mined at when its unconfirmed ancestors have to come with it. Also sorts the modified entries of
+ *  the block assembler, so it takes any type with the ancestor getters of CTxMemPoolEntry.
+ */
+class CompareTxMemPoolEntryByAncestorFee
+{
+public:
+    template <typename T>
+    bool operator()(const T &a, const T &b) const
+    {
+        double aModFee, aSize, bModFee, bSize;
+        GetModFeeAndSize(a, aModFee, aSize);
+        GetModFeeAndSize(b, bModFee, bSize);
+
+        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+        double f1 = aModFee * bSize;
+        double f2 = aSize * bModFee;
+        if (f1 == f2)
+        {
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
+        }
+        return f1 > f2;
+    }
+
+    // Return the fee and size of the lower of the feerates of the tx on its own and with its ancestors.
+    template <typename T>
+    void GetModFeeAndSize(const T &a, double &modFee, double &size) const
+    {
+        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithAncestors();
+        double f2 = (double)a.GetModFeesWithAncestors() * a.GetTxSize();
+        if (f1 > f2)
+        {
+            modFee = a.GetModFeesWithAncestors();
+            size = a.GetSizeWithAncestors();
+        }
+        else
+        {
+            modFee = a.GetModifiedFee();
+            size = a.GetTxSize();
+        }
+    }
+};
+
 class CompareTxMemPoolEntryByEntryTime
 {
 public:
@@ -286,6 +420,9 @@ struct entry_time
 struct mining_score
 {
 };
+struct ancestor_score
+{
+};
 
 class CBlockPolicyEstimator;
 
@@ -307,6 +444,30 @@ struct TxMempoolInfo
     int64_t feeDelta;
 };
 
+/**
+ * Dynamic memory usage of the mempool, by component
+ */
+struct MempoolMemoryUsage
+{
+    /** The mapTx nodes, holding the entries themselves */
+    size_t nEntries;
+
+    /** The transactions the entries point to */
+    size_t nTransactions;
+
+    /** Parent and child links that did not fit inline in their entry */
+    size_t nLinks;
+
+    /** mapNextTx, the spent outpoints */
+    size_t nNextTx;
+
+    /** mapDeltas, the prioritisation deltas */
+    size_t nDeltas;
+
+    MempoolMemoryUsage() : nEntries(0), nTransactions(0), nLinks(0), nNextTx(0), nDeltas(0) {}
+    size_t Total() const { return nEntries + nTransactions + nLinks + nNextTx + nDeltas; }
+};
+
 /** An inpoint - a combination of a transaction and an index n into its vin */
 class CInPoint
 {
@@ -361,11 +522,16 @@ class SaltedTxidHasher
 private:
     /** Salt */
     const uint64_t k0, k1;
+    //! fSipHash24Maps when constructed
+    const bool fSipHash24;
 
 public:
     SaltedTxidHasher();
 
-    size_t operator()(const uint256 &txid) const { return SipHashUint256(k0, k1, txid); }
+    size_t operator()(const uint256 &txid) const
+    {
+        return fSipHash24 ? SipHashUint256(k0, k1, txid) : SipHash13Uint256(k0, k1, txid);
+    }
 };
 
 /**
@@ -392,20 +558,24 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * the in-mempool direct parents and direct children in the links of each
+ * CTxMemPoolEntry.  Within each CTxMemPoolEntry, we also track the size and
+ * fees of all descendants and of all ancestors.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
  * addUnchecked(), we:
- * - update a new entry's setMemPoolParents to include all in-mempool parents
+ * - update a new entry's parent links to include all in-mempool parents
  * - update the new entry's direct parents to include the new tx as a child
  * - update all ancestors of the transaction to include the new tx's size/fee
+ * - set the new entry's ancestor state to the sum over its ancestors
  *
  * When a transaction is removed from the mempool, we must:
- * - update all in-mempool parents to not track the tx in setMemPoolChildren
+ * - update all in-mempool parents to not track the tx in their child links
  * - update all ancestors to not include the tx's size/fees in descendant state
  * - update all in-mempool children to not include it as a parent
+ * - if it leaves for a block, and so without its descendants, update all
+ *   descendants to not include the tx's size/fees in ancestor state
  *
  * These happen in UpdateForRemoveFromMempool().  (Note that when removing a
  * transaction along with its descendants, we must calculate that set of
@@ -425,7 +595,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent/child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -434,15 +604,14 @@ public:
  * Updating all in-mempool ancestors of a newly added transaction can be slow,
  * if no bound exists on how many in-mempool ancestors there may be.
  * CalculateMemPoolAncestors() takes configurable limits that are designed to
- * prevent these calculations from being too CPU intensive.
+ * prevent these calculations from being too CPU intensive.  It checks the
+ * ancestor limits against the cached ancestor state of the direct parents
+ * first, so a transaction extending a chain that is already at the limit is
+ * rejected without walking the chain.
  *
- * Adding transactions from a disconnected block can be very time consuming,
- * because we don't have a way to limit the number of in-mempool descendants.
- * To bound CPU processing, we limit the amount of work we're willing to do
- * to properly update the descendant information for a tx being added from
- * a disconnected block.  If we would exceed the limit, then we instead mark
- * the entry as "dirty", and set the feerate for sorting purposes to be equal
- * the feerate of the transaction without any descendants.
+ * Adding transactions from a disconnected block walks all of their in-mempool
+ * descendants once, so both the descendant state of the block transactions and
+ * the ancestor state of their descendants come out exact.
  *
  */
 class CTxMemPool
@@ -450,10 +619,13 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //! Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated;
+    //! the number of the last addition or removal, NotifyEntryAdded and NotifyEntryRemoved pass on the number
+    uint64_t nSequence;
     CBlockPolicyEstimator *minerPolicyEstimator;
 
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
-    uint64_t cachedInnerUsage; //! sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    uint64_t cachedTxUsage; //! sum of dynamic memory usage of the transactions in the entries
+    uint64_t cachedLinksUsage; //! sum of dynamic memory usage of the parent/child links of the entries
 
     CFeeRate minReasonableRelayFee;
 
@@ -485,7 +657,11 @@ public:
             // sorted by score (for mining prioritization)
             boost::multi_index::ordered_unique<boost::multi_index::tag<mining_score>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
-                CompareTxMemPoolEntryByScore> > >
+                CompareTxMemPoolEntryByScore>,
+            // sorted by fee rate with ancestors (for package selection)
+            boost::multi_index::ordered_non_unique<boost::multi_index::tag<ancestor_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByAncestorFee> > >
         indexed_transaction_set;
 
     mutable CSharedCriticalSection cs;
@@ -497,23 +673,72 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries &GetMemPoolParents(txiter entry) const;
-    const setEntries &GetMemPoolChildren(txiter entry) const;
+    /** The parent or child links of an entry, iterated as txiters. Only valid
+     *  while the entry is in the mempool and cs is held. */
+    class LinkRange
+    {
+    public:
+        class const_iterator
+        {
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef txiter value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const txiter *pointer;
+            typedef txiter reference;
+
+            const_iterator(const indexed_transaction_set *_pset, CTxMemPoolLinks::const_iterator _it)
+                : pset(_pset), it(_it)
+            {
+            }
+            txiter operator*() const { return pset->iterator_to(**it); }
+            const_iterator &operator++()
+            {
+                ++it;
+                return *this;
+            }
+            bool operator==(const const_iterator &other) const { return it == other.it; }
+            bool operator!=(const const_iterator &other) const { return it != other.it; }
+        private:
+            const indexed_transaction_set *pset;
+            CTxMemPoolLinks::const_iterator it;
+        };
+
+        LinkRange(const indexed_transaction_set &_set, const CTxMemPoolLinks &_links) : pset(&_set), links(&_links) {}
+        const_iterator begin() const { return const_iterator(pset, links->begin()); }
+        const_iterator end() const { return const_iterator(pset, links->end()); }
+        size_t size() const { return links->size(); }
+        bool empty() const { return links->empty(); }
+    private:
+        const indexed_transaction_set *pset;
+        const CTxMemPoolLinks *links;
+    };
+
+    LinkRange GetMemPoolParents(txiter entry) const;
+    LinkRange GetMemPoolChildren(txiter entry) const;
 
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks
-    {
-        setEntries parents;
-        setEntries children;
-    };
-
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    //! the entries changed since the last check, only kept while sanity checks are on
+    mutable setEntries setDirty;
+    //! held by check, concurrent checks share cs
+    mutable CCriticalSection cs_check;
 
     void _UpdateParent(txiter entry, txiter parent, bool add);
     void _UpdateChild(txiter entry, txiter child, bool add);
+    /** Have the next check verify the entry, called for every change to its state or links */
+    void _SetDirty(txiter entry)
+    {
+        if (nCheckFrequency != 0)
+            setDirty.insert(entry);
+    }
+
+    //! the size of the pool as of the last addition or removal, for readers that do not take cs
+    std::atomic<uint64_t> nPublishedTxs{0};
+    std::atomic<uint64_t> nPublishedBytes{0};
+    std::atomic<uint64_t> nPublishedUsage{0};
+    void _PublishSize();
 
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
@@ -532,6 +757,9 @@ public:
      * consistent (does not contain two transactions that spend the same inputs,
      * all inputs are in the mapNextTx array). If sanity-checking is turned off,
      * check does nothing.
+     *
+     * Only the inputs, links and ancestor state of the entries changed since the
+     * last check are verified, the totals and mapNextTx are checked for all of them.
      */
     void check(const CCoinsViewCache *pcoins) const;
     void setSanityCheck(double dFrequency = 1.0) { nCheckFrequency = dFrequency * 4294967295.0; }
@@ -545,11 +773,18 @@ public:
         setEntries &setAncestors,
         bool fCurrentEstimate = true);
 
-    void remove(const CTransaction &tx, std::list<CTransactionRef> &removed, bool fRecursive = false);
-    void _remove(const CTransaction &tx, std::list<CTransactionRef> &removed, bool fRecursive = false);
+    void remove(const CTransaction &tx,
+        std::list<CTransactionRef> &removed,
+        bool fRecursive = false,
+        MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
+    void _remove(const CTransaction &tx,
+        std::list<CTransactionRef> &removed,
+        bool fRecursive = false,
+        MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
     void removeConflicts(const CTransaction &tx, std::list<CTransactionRef> &removed);
     void _removeConflicts(const CTransaction &tx, std::list<CTransactionRef> &removed);
+    /** Remove the transactions of a connected block as one stage, then whatever conflicts with them */
     void removeForBlock(const std::vector<CTransactionRef> &vtx,
         unsigned int nBlockHeight,
         std::list<CTransactionRef> &conflicted,
@@ -558,6 +793,9 @@ public:
     void _clear(); // lock free
     void queryHashes(std::vector<uint256> &vtxid) const;
     void _queryHashes(std::vector<uint256> &vtxid) const;
+    /** The hashes together with the number of the last change they include, see NotifyEntryAdded */
+    void queryHashes(std::vector<uint256> &vtxid, uint64_t &nSequenceOut) const;
+    uint64_t GetSequence() const;
     bool isSpent(const COutPoint &outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -580,8 +818,13 @@ public:
 public:
     /** Remove a set of transactions from the mempool.
      *  If a transaction is in this set, then all in-mempool descendants must
-     *  also be in the set.*/
-    void _RemoveStaged(setEntries &stage);
+     *  also be in the set, unless this transaction is being removed for being
+     *  in a block.  Set updateDescendants to true when removing a tx that was
+     *  in a block, so that any in-mempool descendants have their ancestor
+     *  state updated.*/
+    void _RemoveStaged(setEntries &stage,
+        bool updateDescendants = false,
+        MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
 
     /** When adding transactions from a disconnected block back to the mempool,
      *  new mempool entries may have children in the mempool (which is generally
@@ -602,7 +845,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from the entry's links. Must be true for entries not in the mempool
      *
      *  If you actually want the ancestor set returned, you must LOCK(this->cs) for the duration of your
      *  use of the returned setEntries.  Therefore only the lockless version returns the ancestor set.
@@ -666,6 +909,14 @@ public:
         READLOCK(cs);
         return totalTxSize;
     }
+    /** The transactions, their bytes and the memory usage of the pool as of the last change to it. Takes no lock,
+     *  for monitoring that should not wait for or hold up the pool. */
+    void GetPublishedSize(uint64_t &nTxs, uint64_t &nBytes, uint64_t &nUsage) const
+    {
+        nTxs = nPublishedTxs.load(std::memory_order_relaxed);
+        nBytes = nPublishedBytes.load(std::memory_order_relaxed);
+        nUsage = nPublishedUsage.load(std::memory_order_relaxed);
+    }
 
     bool exists(uint256 hash) const
     {
@@ -709,11 +960,17 @@ public:
 
     size_t DynamicMemoryUsage() const;
     size_t _DynamicMemoryUsage() const; // no locks taken
+    /** DynamicMemoryUsage() split up by what the memory is used for */
+    MempoolMemoryUsage GetMemoryUsage() const;
+    MempoolMemoryUsage _GetMemoryUsage() const; // no locks taken
 
-    boost::signals2::signal<void(CTransactionRef)> NotifyEntryAdded;
-    boost::signals2::signal<void(CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    /**
+     * Called with cs held for every transaction that enters or leaves the pool, with the number of that change.
+     * The numbers count up by one for every change, so a mirror of the pool can tell whether it missed one.
+     */
+    boost::signals2::signal<void(CTransactionRef, uint64_t nSequence)> NotifyEntryAdded;
+    boost::signals2::signal<void(CTransactionRef, MemPoolRemovalReason, uint64_t nSequence)> NotifyEntryRemoved;
 
-protected:
     /** Populate setDescendants with all in-mempool descendants of hash.
  *  Assumes that setDescendants includes all in-mempool descendants of anything
  *  already in it.  */
@@ -729,28 +986,30 @@ private:
      *  updated and hence their state is already reflected in the parent
      *  state).
      *
-     *  If updating an entry requires looking at more than maxDescendantsToVisit
-     *  transactions, outside of the ones in setExclude, then give up.
+     *  Every descendant outside setExclude gains the transaction as an
+     *  ancestor, their ancestor state is updated too.
      *
      *  cachedDescendants will be updated with the descendants of the transaction
      *  being updated, so that future invocations don't need to walk the
      *  same transaction again, if encountered in another transaction chain.
      */
-    bool UpdateForDescendants(txiter updateIt,
-        int maxDescendantsToVisit,
-        cacheMap &cachedDescendants,
-        const std::set<uint256> &setExclude);
+    void UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
     void _UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
-    /** For each transaction being removed, update ancestors and any direct children. */
-    void _UpdateForRemoveFromMempool(const setEntries &entriesToRemove);
+    /** Set ancestor state for an entry */
+    void _UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
+    /** For each transaction being removed, update ancestors and any direct children.
+     *  If updateDescendants is true, the transactions leave without their descendants, as
+     *  when they are in a block, and the ancestor state of the descendants is updated.
+     */
+    void _UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants = false);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry);
 
     /** Before calling removeUnchecked for a given transaction,
      *  UpdateForRemoveFromMempool must be called on the entire (dependent) set
      *  of transactions being removed at the same time.  We use each
-     *  CTxMemPoolEntry's setMemPoolParents in order to walk ancestors of a
+     *  CTxMemPoolEntry's parent links in order to walk ancestors of a
      *  given transaction that is removed, so we can't remove intermediate
      *  transactions in a chain before we've updated all the state for the
      *  removal.
@@ -770,6 +1029,9 @@ protected:
 public:
     CCoinsViewMemPool(CCoinsView *baseIn, const CTxMemPool &mempoolIn);
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    //! the outpoints of transactions that are not in the mempool are read with one GetCoins of the base
+    size_t GetCoins(const std::vector<COutPoint> &vOutpoints,
+        std::vector<std::pair<COutPoint, Coin> > &vFound) const override;
     bool HaveCoin(const COutPoint &outpoint) const;
 };
 
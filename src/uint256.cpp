@@ -22,7 +22,6 @@
 
 #include "util/utilstrencodings.h"
 
-#include <stdio.h>
 #include <string.h>
 
 template <unsigned int BITS>
@@ -35,10 +34,15 @@ base_blob<BITS>::base_blob(const std::vector<unsigned char> &vch)
 template <unsigned int BITS>
 std::string base_blob<BITS>::GetHex() const
 {
-    char psz[sizeof(data) * 2 + 1];
+    // most significant byte first
+    std::string str(sizeof(data) * 2, '0');
     for (unsigned int i = 0; i < sizeof(data); i++)
-        sprintf(psz + i * 2, "%02x", data[sizeof(data) - i - 1]);
-    return std::string(psz, psz + sizeof(data) * 2);
+    {
+        const char *pair = p_util_hexpairs[data[sizeof(data) - i - 1]];
+        str[i * 2] = pair[0];
+        str[i * 2 + 1] = pair[1];
+    }
+    return str;
 }
 
 template <unsigned int BITS>
@@ -47,28 +51,27 @@ void base_blob<BITS>::SetHex(const char *psz)
     memset(data, 0, sizeof(data));
 
     // skip leading spaces
-    while (isspace(*psz))
+    while (IsSpace(*psz))
         psz++;
 
     // skip 0x
-    if (psz[0] == '0' && tolower(psz[1]) == 'x')
+    if (psz[0] == '0' && (psz[1] == 'x' || psz[1] == 'X'))
         psz += 2;
 
-    // hex string to uint
+    // hex string to uint, the last digits are the least significant byte
     const char *pbegin = psz;
     while (::HexDigit(*psz) != -1)
         psz++;
-    psz--;
     unsigned char *p1 = (unsigned char *)data;
     unsigned char *pend = p1 + WIDTH;
-    while (psz >= pbegin && p1 < pend)
+    while (psz > pbegin && p1 < pend)
     {
-        *p1 = ::HexDigit(*psz--);
-        if (psz >= pbegin)
+        unsigned char n = ::HexDigit(*--psz);
+        if (psz > pbegin)
         {
-            *p1 |= ((unsigned char)::HexDigit(*psz--) << 4);
-            p1++;
+            n |= (unsigned char)::HexDigit(*--psz) << 4;
         }
+        *p1++ = n;
     }
 }
 
@@ -47,6 +47,12 @@ public:
         std::string s(val_);
         setStr(s);
     }
+    // The destructor would suppress the implicit move operations, which
+    // std::vector needs to grow an array or object without deep copies.
+    UniValue(const UniValue&) = default;
+    UniValue(UniValue&&) noexcept = default;
+    UniValue& operator=(const UniValue&) = default;
+    UniValue& operator=(UniValue&&) noexcept = default;
     ~UniValue() {}
 
     void clear();
@@ -67,6 +73,9 @@ public:
     bool empty() const { return (values.size() == 0); }
 
     size_t size() const { return values.size(); }
+    // Room for n values (and keys, for an object) so building a large
+    // array or object does not reallocate it over and over.
+    void reserve(size_t n);
 
     bool getBool() const { return isTrue(); }
     void getObjMap(std::map<std::string,UniValue>& kv) const;
@@ -85,6 +94,7 @@ public:
     bool isObject() const { return (typ == VOBJ); }
 
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_back(const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return push_back(tmpVal);
@@ -112,7 +122,14 @@ public:
     bool push_backV(const std::vector<UniValue>& vec);
 
     void __pushKV(const std::string& key, const UniValue& val);
+    void __pushKV(const std::string& key, UniValue&& val);
+    // Append without looking for the key first, for callers that know
+    // it is not in the object yet. pushKV replaces an existing key, which
+    // makes building an object with n keys quadratic.
+    bool pushKVEnd(const std::string& key, const UniValue& val);
+    bool pushKVEnd(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return pushKV(key, tmpVal);
@@ -145,6 +162,9 @@ public:
 
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
+    // write() appended to s, without a string per value in between
+    void writeTo(std::string& s, unsigned int prettyIndent = 0,
+                 unsigned int indentLevel = 0) const;
 
     bool read(const char *raw, size_t len);
     bool read(const char *raw) { return read(raw, strlen(raw)); }
@@ -176,9 +196,7 @@ public:
     const UniValue& get_array() const;
 
     enum VType type() const { return getType(); }
-    bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
-    }
+    bool push_back(std::pair<std::string,UniValue> pear);
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 };
 
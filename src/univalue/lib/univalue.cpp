@@ -54,22 +54,22 @@ bool UniValue::setNumStr(const std::string& val_)
     return true;
 }
 
+// An integer is a valid number string by construction, it does not need
+// a stream to format it or the tokenizer to check it.
 bool UniValue::setInt(uint64_t val_)
 {
-    std::ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val = std::to_string(val_);
+    return true;
 }
 
 bool UniValue::setInt(int64_t val_)
 {
-    std::ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    val = std::to_string(val_);
+    return true;
 }
 
 bool UniValue::setFloat(double val_)
@@ -119,6 +119,20 @@ bool UniValue::push_back(const UniValue& val_)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val_)
+{
+#ifdef DEBUG
+    assert(typ == VARR);
+#else
+    if (typ != VARR)
+    {
+        return false;
+    }
+#endif
+    values.push_back(std::move(val_));
+    return true;
+}
+
 bool UniValue::push_backV(const std::vector<UniValue>& vec)
 {
 #ifdef DEBUG
@@ -134,12 +148,53 @@ bool UniValue::push_backV(const std::vector<UniValue>& vec)
     return true;
 }
 
+void UniValue::reserve(size_t n)
+{
+    if (typ == VOBJ)
+        keys.reserve(n);
+    values.reserve(n);
+}
+
 void UniValue::__pushKV(const std::string& key, const UniValue& val_)
 {
     keys.push_back(key);
     values.push_back(val_);
 }
 
+void UniValue::__pushKV(const std::string& key, UniValue&& val_)
+{
+    keys.push_back(key);
+    values.push_back(std::move(val_));
+}
+
+bool UniValue::pushKVEnd(const std::string& key, const UniValue& val_)
+{
+#ifdef DEBUG
+    assert(typ == VOBJ);
+#else
+    if (typ != VOBJ)
+    {
+        return false;
+    }
+#endif
+    __pushKV(key, val_);
+    return true;
+}
+
+bool UniValue::pushKVEnd(const std::string& key, UniValue&& val_)
+{
+#ifdef DEBUG
+    assert(typ == VOBJ);
+#else
+    if (typ != VOBJ)
+    {
+        return false;
+    }
+#endif
+    __pushKV(key, std::move(val_));
+    return true;
+}
+
 bool UniValue::pushKV(const std::string& key, const UniValue& val_)
 {
 #ifdef DEBUG
@@ -158,6 +213,44 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val_)
     return true;
 }
 
+bool UniValue::pushKV(const std::string& key, UniValue&& val_)
+{
+#ifdef DEBUG
+    assert(typ == VOBJ);
+#else
+    if (typ != VOBJ)
+    {
+        return false;
+    }
+#endif
+    size_t idx;
+    if (findKey(key, idx))
+        values[idx] = std::move(val_);
+    else
+        __pushKV(key, std::move(val_));
+    return true;
+}
+
+bool UniValue::push_back(std::pair<std::string,UniValue> pear)
+{
+#ifdef DEBUG
+    assert(typ == VOBJ);
+#else
+    if (typ != VOBJ)
+    {
+        return false;
+    }
+#endif
+    size_t idx;
+    if (findKey(pear.first, idx)) {
+        values[idx] = std::move(pear.second);
+    } else {
+        keys.push_back(std::move(pear.first));
+        values.push_back(std::move(pear.second));
+    }
+    return true;
+}
+
 bool UniValue::pushKVs(const UniValue& obj)
 {
 #ifdef DEBUG
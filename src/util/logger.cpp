@@ -5,9 +5,8 @@
 #include "serialize.h"
 #include "util.h"
 #include "utiltime.h"
-#include <set>
-
-#include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <ctype.h>
 
 CLogger* g_logger = nullptr;
 volatile bool fReopenDebugLog = false;
@@ -26,21 +25,27 @@ bool CLogger::DebugPrintInit()
 }
 
 /**
- * fStartedNewLine is a state variable held by the calling context that will
+ * pfStartedNewLine points to a state variable held by the calling context that will
  * suppress printing of the timestamp when multiple calls are made that don't
  * end in a newline. Initialize it to true, and hold it, in the calling context.
+ * mutexDebugLog or the writer thread guards the timestamp cache.
  */
-std::string CLogger::LogTimestampStr(const std::string &str, bool *fStartedNewLine)
+std::string CLogger::LogTimestampStr(const std::string &str, int64_t nTimeMicros, bool *pfStartedNewLine)
 {
     std::string strStamped;
 
     if (!fLogTimestamps)
         return str;
 
-    if (*fStartedNewLine)
+    if (*pfStartedNewLine)
     {
-        int64_t nTimeMicros = GetLogTimeMicros();
-        strStamped = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros / 1000000);
+        const int64_t nSecond = nTimeMicros / 1000000;
+        if (nSecond != timestampCache.nSecond)
+        {
+            timestampCache.nSecond = nSecond;
+            timestampCache.str = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nSecond);
+        }
+        strStamped = timestampCache.str;
         if (fLogTimeMicros)
             strStamped += strprintf(".%06d", nTimeMicros % 1000000);
         strStamped += ' ' + str;
@@ -49,9 +54,9 @@ std::string CLogger::LogTimestampStr(const std::string &str, bool *fStartedNewLi
         strStamped = str;
 
     if (!str.empty() && str[str.size() - 1] == '\n')
-        *fStartedNewLine = true;
+        *pfStartedNewLine = true;
     else
-        *fStartedNewLine = false;
+        *pfStartedNewLine = false;
 
     return strStamped;
 }
@@ -87,41 +92,70 @@ void CLogger::OpenDebugLog()
     vMsgsBeforeOpenLog = nullptr;
 }
 
-bool CLogger::LogAcceptCategory(const char *category)
+struct CLogCategoryDesc
 {
-    if (category != nullptr)
-    {
-        if (!fDebug)
-            return false;
+    uint32_t flag;
+    const char *name;
+};
+
+static const CLogCategoryDesc LogCategories[] = {
+    {Logging::NET, "net"},
+    {Logging::TOR, "tor"},
+    {Logging::MEMPOOL, "mempool"},
+    {Logging::HTTP, "http"},
+    {Logging::BENCH, "bench"},
+    {Logging::ZMQ, "zmq"},
+    {Logging::DB, "db"},
+    {Logging::RPC, "rpc"},
+    {Logging::ESTIMATEFEE, "estimatefee"},
+    {Logging::ADDRMAN, "addrman"},
+    {Logging::SELECTCOINS, "selectcoins"},
+    {Logging::REINDEX, "reindex"},
+    {Logging::CMPCTBLOCK, "cmpctblock"},
+    {Logging::RAND, "rand"},
+    {Logging::PRUNE, "prune"},
+    {Logging::LIBEVENT, "libevent"},
+    {Logging::COINDB, "coindb"},
+    {Logging::KERNEL, "kernel"},
+    {Logging::WALLET, "wallet"},
+    {Logging::EVICT, "evict"},
+};
 
-        // Give each thread quick access to -debug settings.
-        // This helps prevent issues debugging global destructors,
-        // where mapMultiArgs might be deleted before another
-        // global destructor calls LogPrint()
-        static boost::thread_specific_ptr<std::set<std::string> > ptrCategory;
-        if (ptrCategory.get() == NULL)
+bool CLogger::EnableCategory(const std::string &str)
+{
+    if (str == "" || str == "1")
+    {
+        EnableCategory(Logging::ALL);
+        return true;
+    }
+    std::string strLower(str);
+    std::transform(strLower.begin(), strLower.end(), strLower.begin(), ::tolower);
+    for (const CLogCategoryDesc &category : LogCategories)
+    {
+        if (strLower == category.name)
         {
-            const std::vector<std::string> &categories = gArgs.GetArgs("-debug");
-            ptrCategory.reset(new std::set<std::string>(categories.begin(), categories.end()));
-            // thread_specific_ptr automatically deletes the set when the thread ends.
+            EnableCategory(category.flag);
+            return true;
         }
-        const std::set<std::string> &setCategories = *ptrCategory.get();
-
-        // if not debugging everything and not debugging specific category, LogPrint does nothing.
-        if (setCategories.count(std::string("")) == 0 && setCategories.count(std::string("1")) == 0 &&
-            setCategories.count(std::string(category)) == 0)
-            return false;
     }
-    return true;
+    return false;
 }
 
-int CLogger::LogPrintStr(const std::string &str)
+std::string CLogger::ListCategories()
 {
-    int ret = 0; // Returns total number of characters written
-    static bool fStartedNewLine = true;
-
-    std::string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
+    std::string ret;
+    for (const CLogCategoryDesc &category : LogCategories)
+    {
+        if (!ret.empty())
+            ret += ", ";
+        ret += category.name;
+    }
+    return ret;
+}
 
+int CLogger::WriteStr(const std::string &strTimestamped)
+{
+    int ret = 0;
     if (fPrintToConsole)
     {
         // print to console
@@ -130,8 +164,6 @@ int CLogger::LogPrintStr(const std::string &str)
     }
     else if (fPrintToDebugLog)
     {
-        std::lock_guard<std::mutex> scoped_lock(*mutexDebugLog);
-
         // buffer if we haven't opened the log yet
         if (fileout == nullptr)
         {
@@ -156,6 +188,130 @@ int CLogger::LogPrintStr(const std::string &str)
     return ret;
 }
 
+int CLogger::LogPrintStr(const std::string &str)
+{
+    if (!fPrintToConsole && !fPrintToDebugLog)
+        return 0;
+
+    const int64_t nTimeMicros = GetLogTimeMicros();
+    if (fAsync)
+    {
+        if (!Enqueue(str, nTimeMicros))
+        {
+            nDropped++;
+            return 0;
+        }
+        return str.size();
+    }
+
+    std::lock_guard<std::mutex> scoped_lock(*mutexDebugLog);
+    return WriteStr(LogTimestampStr(str, nTimeMicros, &fStartedNewLine)); // Returns total number of characters written
+}
+
+bool CLogger::Enqueue(const std::string &str, int64_t nTimeMicros)
+{
+    CLogRecord *record;
+    size_t nPos = nEnqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        record = &vRing[nPos & nRingMask];
+        const size_t nSeq = record->nSeq.load(std::memory_order_acquire);
+        const intptr_t nDiff = (intptr_t)nSeq - (intptr_t)nPos;
+        if (nDiff == 0)
+        {
+            if (nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (nDiff < 0)
+            return false; // the writer has not taken the line of the previous round out yet
+        else
+            nPos = nEnqueuePos.load(std::memory_order_relaxed);
+    }
+    record->nTimeMicros = nTimeMicros;
+    record->str = str;
+    record->nSeq.store(nPos + 1, std::memory_order_release);
+    condWriter.notify_one();
+    return true;
+}
+
+bool CLogger::Drain()
+{
+    std::string strBatch;
+    for (;;)
+    {
+        CLogRecord &record = vRing[nDequeuePos & nRingMask];
+        if (record.nSeq.load(std::memory_order_acquire) != nDequeuePos + 1)
+            break;
+        strBatch += LogTimestampStr(record.str, record.nTimeMicros, &fStartedNewLine);
+        record.str.clear();
+        record.nSeq.store(nDequeuePos + nRingMask + 1, std::memory_order_release);
+        nDequeuePos++;
+    }
+    const uint64_t nDroppedNow = nDropped;
+    if (nDroppedNow != nDroppedReported)
+    {
+        strBatch += LogTimestampStr(strprintf("%u log lines dropped, the log buffer was full\n",
+                                        nDroppedNow - nDroppedReported),
+            GetLogTimeMicros(), &fStartedNewLine);
+        nDroppedReported = nDroppedNow;
+    }
+    if (strBatch.empty())
+        return false;
+    // one write for everything that piled up
+    WriteStr(strBatch);
+    return true;
+}
+
+void CLogger::ThreadWriter()
+{
+    RenameThread("eccoin-logger");
+    while (!fStopWriter)
+    {
+        bool fWrote;
+        {
+            std::lock_guard<std::mutex> scoped_lock(*mutexDebugLog);
+            fWrote = Drain();
+        }
+        if (!fWrote)
+        {
+            // a line logged between Drain and the wait is picked up at the next timeout at the latest
+            std::unique_lock<std::mutex> lock(mutexWriter);
+            condWriter.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+}
+
+void CLogger::StartAsync(size_t nBufferSize)
+{
+    if (fAsync)
+        return;
+    size_t nSize = 1;
+    while (nSize < std::max(nBufferSize, (size_t)2))
+        nSize <<= 1;
+    vRing.reset(new CLogRecord[nSize]);
+    for (size_t i = 0; i < nSize; i++)
+        vRing[i].nSeq = i;
+    nRingMask = nSize - 1;
+    nEnqueuePos = 0;
+    nDequeuePos = 0;
+    fStopWriter = false;
+    threadWriter = std::thread(&CLogger::ThreadWriter, this);
+    fAsync = true;
+}
+
+void CLogger::StopAsync()
+{
+    if (!fAsync)
+        return;
+    fAsync = false;
+    fStopWriter = true;
+    condWriter.notify_one();
+    threadWriter.join();
+    // what was logged while the writer stopped
+    std::lock_guard<std::mutex> scoped_lock(*mutexDebugLog);
+    Drain();
+}
+
 void CLogger::ShrinkDebugFile()
 {
     // Scroll debug.log if it's getting too big
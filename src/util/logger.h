@@ -5,28 +5,101 @@
 
 #include "tinyformat.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <list>
+#include <memory>
 #include <mutex>
-#include <mutex>
+#include <thread>
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+/** Whether log lines are written by a thread of their own instead of the threads logging them */
+static const bool DEFAULT_LOGASYNC = true;
+/** How many log lines can wait for that thread, lines logged while it is full are dropped and counted */
+static const unsigned int DEFAULT_LOGBUFFER = 8192;
 extern volatile bool fReopenDebugLog;
 
+/** The debug categories of LogPrint, -debug=<category> sets their bits */
+namespace Logging
+{
+enum LogFlags : uint32_t
+{
+    NONE = 0,
+    NET = (1 << 0),
+    TOR = (1 << 1),
+    MEMPOOL = (1 << 2),
+    HTTP = (1 << 3),
+    BENCH = (1 << 4),
+    ZMQ = (1 << 5),
+    DB = (1 << 6),
+    RPC = (1 << 7),
+    ESTIMATEFEE = (1 << 8),
+    ADDRMAN = (1 << 9),
+    SELECTCOINS = (1 << 10),
+    REINDEX = (1 << 11),
+    CMPCTBLOCK = (1 << 12),
+    RAND = (1 << 13),
+    PRUNE = (1 << 14),
+    LIBEVENT = (1 << 15),
+    COINDB = (1 << 16),
+    KERNEL = (1 << 17),
+    WALLET = (1 << 18),
+    EVICT = (1 << 19),
+    ALL = ~(uint32_t)0,
+};
+}
+
 class CLogger
 {
 private:
+    /** A line waiting in the ring, nSeq tells producers and the writer whose turn the slot is */
+    struct CLogRecord
+    {
+        std::atomic<size_t> nSeq;
+        int64_t nTimeMicros;
+        std::string str;
+    };
+
+    /** The formatted second of the last timestamp, lines logged in the same second reuse it */
+    struct CTimestampCache
+    {
+        int64_t nSecond;
+        std::string str;
+        CTimestampCache() : nSecond(-1) {}
+    };
+
     FILE *fileout;
     std::mutex *mutexDebugLog;
     std::list<std::string> *vMsgsBeforeOpenLog;
+    //! guarded by mutexDebugLog
+    bool fStartedNewLine;
+    CTimestampCache timestampCache;
+
+    /**
+     * Bounded ring of lines for the writer thread. Logging threads claim a slot with one compare and swap and
+     * never wait, the writer is the only one to take lines out.
+     */
+    std::unique_ptr<CLogRecord[]> vRing;
+    size_t nRingMask;
+    std::atomic<size_t> nEnqueuePos;
+    size_t nDequeuePos;
+    std::atomic<bool> fAsync;
+    std::atomic<bool> fStopWriter;
+    std::atomic<uint64_t> nDropped;
+    uint64_t nDroppedReported;
+    std::mutex mutexWriter;
+    std::condition_variable condWriter;
+    std::thread threadWriter;
+
+    std::atomic<uint32_t> nCategories;
 
 public:
     bool fLogTimestamps;
     bool fLogTimeMicros;
     bool fLogIPs;
 
-    bool fDebug;
     bool fPrintToConsole;
     bool fPrintToDebugLog;
 
@@ -37,29 +110,59 @@ private:
 
     bool DebugPrintInit();
 
-    std::string LogTimestampStr(const std::string &str, bool *fStartedNewLine);
+    std::string LogTimestampStr(const std::string &str, int64_t nTimeMicros, bool *pfStartedNewLine);
 
     int FileWriteStr(const std::string &str, FILE *fp);
 
+    /** Write timestamped text to the console or the debug log, mutexDebugLog has to be held */
+    int WriteStr(const std::string &strTimestamped);
+
+    bool Enqueue(const std::string &str, int64_t nTimeMicros);
+    /** Write the lines in the ring, returns false if there were none */
+    bool Drain();
+    void ThreadWriter();
+
 public:
-    CLogger()
+    CLogger() : nRingMask(0), nEnqueuePos(0), nDequeuePos(0), fAsync(false), fStopWriter(false), nDropped(0),
+          nCategories(Logging::NONE)
     {
         fileout = nullptr;
         mutexDebugLog = nullptr;
         vMsgsBeforeOpenLog = nullptr;
+        fStartedNewLine = true;
+        nDroppedReported = 0;
 
         fLogTimestamps = DEFAULT_LOGTIMESTAMPS;
         fLogTimeMicros = DEFAULT_LOGTIMEMICROS;
         fLogIPs = DEFAULT_LOGIPS;
-        fDebug = false;
         fPrintToConsole = false;
         fPrintToDebugLog = true;
         DebugPrintInit();
     }
+    ~CLogger() { StopAsync(); }
     void OpenDebugLog();
 
+    /**
+     * Have a thread of its own write the log from now on, through a ring of at least nBufferSize lines. The
+     * timestamp of a line is taken when it is logged.
+     */
+    void StartAsync(size_t nBufferSize = DEFAULT_LOGBUFFER);
+    /** Write what is still waiting and go back to writing lines on the threads that log them */
+    void StopAsync();
+    /** The number of lines dropped because the ring was full */
+    uint64_t GetDropped() const { return nDropped; }
+
     /** Return true if log accepts specified category */
-    bool LogAcceptCategory(const char *category);
+    bool LogAcceptCategory(uint32_t category) const
+    {
+        return (nCategories.load(std::memory_order_relaxed) & category) != 0;
+    }
+    /** Enable the category named str, "" and "1" are all of them. Returns false if there is no such category */
+    bool EnableCategory(const std::string &str);
+    void EnableCategory(uint32_t category) { nCategories |= category; }
+    void DisableCategory(uint32_t category) { nCategories &= ~category; }
+    /** The names of the categories, comma separated */
+    static std::string ListCategories();
 
     /** Send a string to the log output */
     int LogPrintStr(const std::string &str);
@@ -69,18 +172,11 @@ public:
 
 extern CLogger* g_logger;
 
-#define LogPrintf(...) LogPrint(NULL, __VA_ARGS__)
-
 /**
  * Zero-arg versions of logging and error, these are not covered by
  * TINYFORMAT_FOREACH_ARGNUM
  */
-static inline int LogPrint(const char *category, const char *format)
-{
-    if (!g_logger->LogAcceptCategory(category))
-        return 0;
-    return g_logger->LogPrintStr(format);
-}
+static inline int LogPrintf(const char *format) { return g_logger->LogPrintStr(format); }
 static inline bool error(const char *format)
 {
     g_logger->LogPrintStr(std::string("ERROR: ") + format + "\n");
@@ -95,24 +191,35 @@ void PrintExceptionContinue(const std::exception *pex, const char *pszThread);
  * When we switch to C++11, this can be switched to variadic templates instead
  * of this macro-based construction (see tinyformat.h).
  */
-#define MAKE_ERROR_AND_LOG_FUNC(n)                                                              \
-    /**   Print to debug.log if -debug=category switch is given OR category is NULL. */         \
-    template <TINYFORMAT_ARGTYPES(n)>                                                           \
-    static inline int LogPrint(const char *category, const char *format, TINYFORMAT_VARARGS(n)) \
-    {                                                                                           \
-        if (!g_logger->LogAcceptCategory(category))                                             \
-            return 0;                                                                           \
-        return g_logger->LogPrintStr(tfm::format(format, TINYFORMAT_PASSARGS(n)));              \
-    }                                                                                           \
-    /**   Log error and return false */                                                         \
-    template <TINYFORMAT_ARGTYPES(n)>                                                           \
-    static inline bool error(const char *format, TINYFORMAT_VARARGS(n))                         \
-    {                                                                                           \
-        g_logger->LogPrintStr("ERROR: " + tfm::format(format, TINYFORMAT_PASSARGS(n)) + "\n");  \
-        return false;                                                                           \
+#define MAKE_ERROR_AND_LOG_FUNC(n)                                                             \
+    /**   Print to debug.log */                                                                \
+    template <TINYFORMAT_ARGTYPES(n)>                                                          \
+    static inline int LogPrintf(const char *format, TINYFORMAT_VARARGS(n))                     \
+    {                                                                                          \
+        return g_logger->LogPrintStr(tfm::format(format, TINYFORMAT_PASSARGS(n)));             \
+    }                                                                                          \
+    /**   Log error and return false */                                                        \
+    template <TINYFORMAT_ARGTYPES(n)>                                                          \
+    static inline bool error(const char *format, TINYFORMAT_VARARGS(n))                        \
+    {                                                                                          \
+        g_logger->LogPrintStr("ERROR: " + tfm::format(format, TINYFORMAT_PASSARGS(n)) + "\n"); \
+        return false;                                                                          \
     }
 
 TINYFORMAT_FOREACH_ARGNUM(MAKE_ERROR_AND_LOG_FUNC)
 
+/**
+ * Print to debug.log if -debug=category switch is given. A macro and not a function, so the arguments are not
+ * evaluated at all when the category is off.
+ */
+#define LogPrint(category, ...)                        \
+    do                                                 \
+    {                                                  \
+        if (g_logger->LogAcceptCategory((category)))   \
+        {                                              \
+            LogPrintf(__VA_ARGS__);                    \
+        }                                              \
+    } while (0)
+
 
 #endif
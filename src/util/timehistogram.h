@@ -0,0 +1,55 @@
+// Copyright (c) 2019 The Eccoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_TIMEHISTOGRAM_H
+#define BITCOIN_UTIL_TIMEHISTOGRAM_H
+
+#include <algorithm>
+#include <stdint.h>
+
+/**
+ * Durations counted in buckets of powers of two microseconds, bucket i counts the ones below 2^i microseconds that
+ * the buckets before it do not and the last bucket holds the rest. 26 buckets reach about half a minute.
+ */
+class CTimeHistogram
+{
+public:
+    static const int BUCKETS = 26;
+
+    uint64_t nCount = 0;
+    int64_t nTotalMicros = 0;
+    int64_t nMaxMicros = 0;
+    uint64_t vBuckets[BUCKETS] = {};
+
+    static int Bucket(int64_t nMicros)
+    {
+        int nBucket = 0;
+        while (nMicros > 0 && nBucket < BUCKETS - 1)
+        {
+            nMicros >>= 1;
+            nBucket++;
+        }
+        return nBucket;
+    }
+
+    void Add(int64_t nMicros)
+    {
+        nMicros = std::max<int64_t>(nMicros, 0);
+        nCount++;
+        nTotalMicros += nMicros;
+        nMaxMicros = std::max(nMaxMicros, nMicros);
+        vBuckets[Bucket(nMicros)]++;
+    }
+
+    void Add(const CTimeHistogram &other)
+    {
+        nCount += other.nCount;
+        nTotalMicros += other.nTotalMicros;
+        nMaxMicros = std::max(nMaxMicros, other.nMaxMicros);
+        for (int i = 0; i < BUCKETS; i++)
+            vBuckets[i] += other.vBuckets[i];
+    }
+};
+
+#endif // BITCOIN_UTIL_TIMEHISTOGRAM_H
@@ -57,7 +57,14 @@ const signed char p_util_hexdigit[256] = {
     -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
 };
 
-signed char HexDigit(char c) { return p_util_hexdigit[(unsigned char)c]; }
+#define HEXPAIRS_ROW(h) \
+    {h, '0'}, {h, '1'}, {h, '2'}, {h, '3'}, {h, '4'}, {h, '5'}, {h, '6'}, {h, '7'}, {h, '8'}, {h, '9'}, {h, 'a'}, \
+        {h, 'b'}, {h, 'c'}, {h, 'd'}, {h, 'e'}, {h, 'f'}
+const char p_util_hexpairs[256][2] = {HEXPAIRS_ROW('0'), HEXPAIRS_ROW('1'), HEXPAIRS_ROW('2'), HEXPAIRS_ROW('3'),
+    HEXPAIRS_ROW('4'), HEXPAIRS_ROW('5'), HEXPAIRS_ROW('6'), HEXPAIRS_ROW('7'), HEXPAIRS_ROW('8'), HEXPAIRS_ROW('9'),
+    HEXPAIRS_ROW('a'), HEXPAIRS_ROW('b'), HEXPAIRS_ROW('c'), HEXPAIRS_ROW('d'), HEXPAIRS_ROW('e'), HEXPAIRS_ROW('f')};
+#undef HEXPAIRS_ROW
+
 bool IsHex(const std::string &str)
 {
     for (std::string::const_iterator it(str.begin()); it != str.end(); ++it)
@@ -70,21 +77,22 @@ bool IsHex(const std::string &str)
 
 std::vector<unsigned char> ParseHex(const char *psz)
 {
-    // convert hex dump to vector
+    // convert hex dump to vector, spaces are allowed between bytes
     std::vector<unsigned char> vch;
+    vch.reserve(strlen(psz) / 2);
     while (true)
     {
-        while (isspace(*psz))
-            psz++;
-        signed char c = HexDigit(*psz++);
-        if (c == (signed char)-1)
-            break;
-        unsigned char n = (c << 4);
-        c = HexDigit(*psz++);
-        if (c == (signed char)-1)
+        // a run of digit pairs without the checks for spaces, the second digit is only read after a first one
+        signed char c1, c2 = -1;
+        while ((c1 = HexDigit(psz[0])) >= 0 && (c2 = HexDigit(psz[1])) >= 0)
+        {
+            vch.push_back((unsigned char)((c1 << 4) | c2));
+            psz += 2;
+        }
+        if (c1 >= 0 || !IsSpace(*psz))
             break;
-        n |= c;
-        vch.push_back(n);
+        while (IsSpace(*psz))
+            psz++;
     }
     return vch;
 }
@@ -54,7 +54,18 @@ enum SafeChars
 std::string SanitizeString(const std::string &str, int rule = SAFE_CHARS_DEFAULT);
 std::vector<unsigned char> ParseHex(const char *psz);
 std::vector<unsigned char> ParseHex(const std::string &str);
-signed char HexDigit(char c);
+
+//! the value of every hex digit, -1 for every other character
+extern const signed char p_util_hexdigit[256];
+//! the two lower case hex digits of every byte
+extern const char p_util_hexpairs[256][2];
+
+inline signed char HexDigit(char c) { return p_util_hexdigit[(unsigned char)c]; }
+//! isspace in the C locale, without the locale lookup
+inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\f' || c == '\n' || c == '\r' || c == '\t' || c == '\v';
+}
 bool IsHex(const std::string &str);
 std::vector<unsigned char> DecodeBase64(const char *p, bool *pfInvalid = NULL);
 std::string DecodeBase64(const std::string &str);
@@ -99,18 +110,19 @@ bool ParseDouble(const std::string &str, double *out);
 template <typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces = false)
 {
-    std::string rv;
-    static const char hexmap[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
-    rv.reserve((itend - itbegin) * 3);
-    for (T it = itbegin; it < itend; ++it)
+    if (!(itbegin < itend))
+        return std::string();
+    // sized once, with the spaces in place already, then two digits from the table per byte
+    const size_t nBytes = itend - itbegin;
+    const size_t nStride = fSpaces ? 3 : 2;
+    std::string rv(nBytes * nStride - (fSpaces ? 1 : 0), ' ');
+    char *out = &rv[0];
+    for (T it = itbegin; it < itend; ++it, out += nStride)
     {
-        unsigned char val = (unsigned char)(*it);
-        if (fSpaces && it != itbegin)
-            rv.push_back(' ');
-        rv.push_back(hexmap[val >> 4]);
-        rv.push_back(hexmap[val & 15]);
+        const char *pair = p_util_hexpairs[(unsigned char)(*it)];
+        out[0] = pair[0];
+        out[1] = pair[1];
     }
-
     return rv;
 }
 
@@ -0,0 +1,501 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "utxosnapshot.h"
+
+#include "chain/blockindex.h"
+#include "chain/chainman.h"
+#include "chain/tx.h"
+#include "checkqueue.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "crypto/hash.h"
+#include "init.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util/logger.h"
+#include "util/util.h"
+#include "util/utilstrencodings.h"
+
+#include <algorithm>
+#include <memory>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/** Block index entries whose headers are hashed at once when a snapshot is checked */
+const size_t SNAPSHOT_HASH_BATCH = 2000;
+/** Transactions written to the databases at once when a snapshot is loaded */
+const size_t SNAPSHOT_WRITE_BATCH = 10000;
+
+/** The start of a snapshot file, it has a fixed size so the counts can be written once they are known */
+struct CSnapshotHeader
+{
+    CMessageHeader::MessageMagic messageStart;
+    uint32_t nVersion;
+    uint256 hashBlock;
+    int32_t nHeight;
+    uint64_t nBlocks;
+    uint64_t nTxs;
+    uint64_t nCoins;
+
+    CSnapshotHeader() : nVersion(TXOUTSET_SNAPSHOT_VERSION), nHeight(0), nBlocks(0), nTxs(0), nCoins(0)
+    {
+        memset(messageStart.data(), 0, messageStart.size());
+    }
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action)
+    {
+        READWRITE(FLATDATA(messageStart));
+        READWRITE(nVersion);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nBlocks);
+        READWRITE(nTxs);
+        READWRITE(nCoins);
+    }
+};
+
+/** A transaction with unspent outputs, where it is in the chain and those outputs */
+struct CSnapshotTx
+{
+    uint256 txid;
+    uint256 hashBlock;
+    unsigned int nTxOffset;
+    CTransaction tx;
+    std::vector<std::pair<uint32_t, Coin> > vCoins;
+
+    CSnapshotTx() : nTxOffset(0) {}
+
+    template <typename Stream>
+    void Serialize(Stream &s) const
+    {
+        s << txid << hashBlock << VARINT(nTxOffset) << tx;
+        unsigned int nCount = vCoins.size();
+        s << VARINT(nCount);
+        for (const std::pair<uint32_t, Coin> &coin : vCoins)
+        {
+            uint32_t n = coin.first;
+            s << VARINT(n) << coin.second;
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s)
+    {
+        s >> txid >> hashBlock >> VARINT(nTxOffset) >> tx;
+        unsigned int nCount = 0;
+        s >> VARINT(nCount);
+        if (nCount > tx.vout.size())
+            throw std::ios_base::failure("more unspent outputs than the transaction has");
+        vCoins.resize(nCount);
+        for (std::pair<uint32_t, Coin> &coin : vCoins)
+            s >> VARINT(coin.first) >> coin.second;
+    }
+};
+
+/** Writes records to a file and hashes them as they are written */
+class CSnapshotWriter
+{
+private:
+    CAutoFile &file;
+    CHashWriter hasher;
+    CPublicDataStream ss;
+
+public:
+    explicit CSnapshotWriter(CAutoFile &fileIn)
+        : file(fileIn), hasher(fileIn.GetType(), fileIn.GetVersion()), ss(fileIn.GetType(), fileIn.GetVersion())
+    {
+    }
+
+    template <typename T>
+    CSnapshotWriter &operator<<(const T &obj)
+    {
+        ss << obj;
+        hasher.write(ss.data(), ss.size());
+        file.write(ss.data(), ss.size());
+        ss.clear();
+        return *this;
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+bool SnapshotError(std::string &strError, const std::string &strMessage)
+{
+    strError = strMessage;
+    return false;
+}
+
+/**
+ * Read the snapshot at path. Without blocktree and coinsdb it is only checked, with them it is written to them, the
+ * best block of the chainstate and the totals of its outputs excepted, which are added up in stats. Either way
+ * header and hashSnapshot are what was read.
+ */
+bool ReadTxOutSetSnapshot(const fs::path &path,
+    const CNetworkTemplate &chainparams,
+    CBlockTreeDB *blocktree,
+    CCoinsViewDB *coinsdb,
+    CSnapshotHeader &header,
+    uint256 &hashSnapshot,
+    CTxOutSetStats &stats,
+    std::string &strError)
+{
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return SnapshotError(strError, strprintf("can not open %s", path.string()));
+    const bool fWrite = blocktree != nullptr;
+
+    try
+    {
+        filein >> header;
+        if (memcmp(header.messageStart.data(), chainparams.MessageStart().data(), header.messageStart.size()))
+            return SnapshotError(strError, "the snapshot is of another network");
+        if (header.nVersion != TXOUTSET_SNAPSHOT_VERSION)
+            return SnapshotError(strError, strprintf("the snapshot has unknown version %u", header.nVersion));
+        if (header.nHeight < 0 || header.nBlocks != (uint64_t)header.nHeight + 1)
+            return SnapshotError(strError, "the snapshot header is malformed");
+
+        CHashVerifier<CAutoFile> verifier(&filein);
+
+        // the chain up to the block of the snapshot
+        std::vector<uint256> vHashes;
+        std::vector<CDiskBlockIndex> vEntries;
+        std::vector<CBlockHeader> vHeaders;
+        vEntries.reserve(SNAPSHOT_HASH_BATCH);
+        vHeaders.reserve(SNAPSHOT_HASH_BATCH);
+        for (uint64_t i = 0; i < header.nBlocks; i++)
+        {
+            if (shutdown_threads.load())
+                return SnapshotError(strError, "shutdown requested");
+
+            CDiskBlockIndex entry;
+            verifier >> entry;
+            if (entry.nHeight != (int)i || entry.hashPrev != (i == 0 ? uint256() : vHashes.back()) ||
+                (entry.nStatus & ~BLOCK_VALID_MASK) || entry.nStatus < BLOCK_VALID_TRANSACTIONS || entry.nTx == 0)
+                return SnapshotError(strError, strprintf("block index entry %u of the snapshot is malformed", i));
+            vHashes.push_back(entry.hashBlock);
+            vEntries.push_back(entry);
+
+            if (vEntries.size() < SNAPSHOT_HASH_BATCH && i + 1 != header.nBlocks)
+                continue;
+            if (fWrite)
+            {
+                for (CDiskBlockIndex &entryWrite : vEntries)
+                    entryWrite.nHashChecksum = entryWrite.ComputeHashChecksum();
+                if (!blocktree->WriteBlockIndexEntries(vEntries))
+                    return SnapshotError(strError, "failed to write the block index");
+            }
+            else
+            {
+                for (const CDiskBlockIndex &entryCheck : vEntries)
+                {
+                    CBlockHeader block;
+                    block.nVersion = entryCheck.nVersion;
+                    block.hashPrevBlock = entryCheck.hashPrev;
+                    block.hashMerkleRoot = entryCheck.hashMerkleRoot;
+                    block.nTime = entryCheck.nTime;
+                    block.nBits = entryCheck.nBits;
+                    block.nNonce = entryCheck.nNonce;
+                    vHeaders.push_back(block);
+                }
+                CBlockHeader::PrecomputeHashes(vHeaders.data(), vHeaders.size());
+                for (size_t j = 0; j < vEntries.size(); j++)
+                {
+                    if (vHeaders[j].GetHash() != vEntries[j].hashBlock)
+                        return SnapshotError(strError,
+                            strprintf("the hash of block %d in the snapshot is wrong", vEntries[j].nHeight));
+                }
+                vHeaders.clear();
+            }
+            vEntries.clear();
+        }
+        if (vHashes.front() != chainparams.GetConsensus().hashGenesisBlock)
+            return SnapshotError(strError, "the snapshot does not start at the genesis block");
+        if (vHashes.back() != header.hashBlock)
+            return SnapshotError(strError, "the snapshot does not end at its block");
+
+        // the transactions with unspent outputs, the best block is not written here so the chainstate is only
+        // usable once they all are
+        CCoinsMapMemoryResource resource;
+        CCoinsMap mapCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+        size_t nCoinsUsage = 0;
+        std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+        std::vector<std::pair<uint256, std::pair<uint256, CTransaction> > > vTxs;
+        uint64_t nCoins = 0;
+        uint256 hashPrevTx;
+        for (uint64_t i = 0; i < header.nTxs; i++)
+        {
+            if (shutdown_threads.load())
+                return SnapshotError(strError, "shutdown requested");
+
+            CSnapshotTx stx;
+            verifier >> stx;
+            if (!fWrite)
+            {
+                if (stx.vCoins.empty() || (i > 0 && !(hashPrevTx < stx.txid)) || stx.tx.GetHash() != stx.txid)
+                    return SnapshotError(strError, strprintf("transaction %s of the snapshot is malformed",
+                                                       stx.txid.ToString()));
+                for (size_t j = 0; j < stx.vCoins.size(); j++)
+                {
+                    const uint32_t n = stx.vCoins[j].first;
+                    const Coin &coin = stx.vCoins[j].second;
+                    if ((j > 0 && n <= stx.vCoins[j - 1].first) || n >= stx.tx.vout.size() ||
+                        coin.out != stx.tx.vout[n] || coin.nHeight >= vHashes.size() ||
+                        vHashes[coin.nHeight] != stx.hashBlock)
+                        return SnapshotError(strError, strprintf("output %u of transaction %s of the snapshot is "
+                                                                 "malformed",
+                                                           n, stx.txid.ToString()));
+                }
+                hashPrevTx = stx.txid;
+            }
+            nCoins += stx.vCoins.size();
+            if (!fWrite)
+                continue;
+
+            for (std::pair<uint32_t, Coin> &coin : stx.vCoins)
+            {
+                stats.Add(COutPoint(stx.txid, coin.first), coin.second);
+                CCoinsCacheEntry &entry = mapCoins[COutPoint(stx.txid, coin.first)];
+                entry.coin = std::move(coin.second);
+                entry.SetFlags(CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH);
+                nCoinsUsage += entry.coin.DynamicMemoryUsage();
+            }
+            // the blocks are not there, just as if they were pruned
+            vPos.emplace_back(stx.txid, CDiskTxPos(CDiskBlockPos(0, 0), stx.nTxOffset));
+            vTxs.emplace_back(stx.txid, std::make_pair(stx.hashBlock, std::move(stx.tx)));
+            if (vTxs.size() >= SNAPSHOT_WRITE_BATCH || i + 1 == header.nTxs)
+            {
+                if (!coinsdb->BatchWrite(mapCoins, uint256(), 0, nullptr, nCoinsUsage) || !blocktree->WriteTxIndex(vPos) ||
+                    !blocktree->WritePrunedTxs(vTxs))
+                    return SnapshotError(strError, "failed to write the transactions");
+                mapCoins.clear();
+                nCoinsUsage = 0;
+                vPos.clear();
+                vTxs.clear();
+            }
+        }
+        if (nCoins != header.nCoins)
+            return SnapshotError(strError, "the snapshot does not have as many outputs as its header says");
+        hashSnapshot = verifier.GetHash();
+        if (fgetc(filein.Get()) != EOF)
+            return SnapshotError(strError, "the snapshot goes on past its end");
+    }
+    catch (const std::exception &e)
+    {
+        return SnapshotError(strError, strprintf("failed to read the snapshot: %s", e.what()));
+    }
+    return true;
+}
+}
+
+bool DumpTxOutSet(const fs::path &path,
+    CCoinsView *view,
+    int &nHeight,
+    CTxOutSetSnapshotData &data,
+    std::string &strError)
+{
+    LOCK(cs_main);
+    FlushStateToDisk();
+
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    if (!pcursor)
+        return SnapshotError(strError, "the chainstate can not be iterated");
+    CChainManager *pchainman = pnetMan->getChainActive();
+    const CBlockIndex *pindexBase = pchainman->LookupBlockIndex(pcursor->GetBestBlock());
+    if (!pindexBase)
+        return SnapshotError(strError, "the best block of the chainstate is not in the block index");
+    const Consensus::Params &consensus = pnetMan->getActivePaymentNetwork()->GetConsensus();
+
+    fs::path pathTemp = path;
+    pathTemp += ".incomplete";
+    CAutoFile fileout(fsbridge::fopen(pathTemp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return SnapshotError(strError, strprintf("can not open %s for writing", pathTemp.string()));
+
+    CSnapshotHeader header;
+    const CMessageHeader::MessageMagic &messageStart = pnetMan->getActivePaymentNetwork()->MessageStart();
+    std::copy(messageStart.begin(), messageStart.end(), header.messageStart.begin());
+    header.hashBlock = pindexBase->GetBlockHash();
+    header.nHeight = pindexBase->nHeight;
+    header.nBlocks = pindexBase->nHeight + 1;
+
+    bool fOk = false;
+    try
+    {
+        // rewritten with the counts at the end
+        fileout << header;
+        CSnapshotWriter writer(fileout);
+
+        std::vector<const CBlockIndex *> vChain(header.nBlocks);
+        for (const CBlockIndex *pindex = pindexBase; pindex; pindex = pindex->pprev)
+            vChain[pindex->nHeight] = pindex;
+        for (const CBlockIndex *pindex : vChain)
+        {
+            CDiskBlockIndex entry(pindex);
+            // the block and undo data are not part of the snapshot
+            entry.nStatus = pindex->nStatus & BLOCK_VALID_MASK;
+            entry.nFile = 0;
+            entry.nDataPos = 0;
+            entry.nUndoPos = 0;
+            writer << entry;
+        }
+
+        CSnapshotTx stx;
+        while (true)
+        {
+            if (shutdown_threads.load())
+                throw std::runtime_error("shutdown requested");
+
+            COutPoint key;
+            Coin coin;
+            const bool fEnd = !pcursor->Valid();
+            if (!fEnd && (!pcursor->GetKey(key) || !pcursor->GetValue(coin)))
+                throw std::runtime_error("unable to read the chainstate");
+            if (!stx.vCoins.empty() && (fEnd || key.hash != stx.txid))
+            {
+                std::sort(stx.vCoins.begin(), stx.vCoins.end(),
+                    [](const std::pair<uint32_t, Coin> &a, const std::pair<uint32_t, Coin> &b) {
+                        return a.first < b.first;
+                    });
+                writer << stx;
+                header.nTxs++;
+                stx.vCoins.clear();
+            }
+            if (fEnd)
+                break;
+
+            if (stx.vCoins.empty())
+            {
+                stx.txid = key.hash;
+                CDiskTxPos postx;
+                if (!GetTransaction(key.hash, stx.tx, consensus, stx.hashBlock) ||
+                    !pchainman->pblocktree->ReadTxIndex(key.hash, postx))
+                    throw std::runtime_error(
+                        strprintf("transaction %s is not in the transaction index", key.hash.ToString()));
+                stx.nTxOffset = postx.nTxOffset;
+            }
+            stx.vCoins.emplace_back(key.n, std::move(coin));
+            header.nCoins++;
+            pcursor->Next();
+        }
+        data.hashSnapshot = writer.GetHash();
+
+        if (fseek(fileout.Get(), 0, SEEK_SET))
+            throw std::runtime_error("can not seek in the snapshot");
+        fileout << header;
+        FileCommit(fileout.Get());
+        fOk = true;
+    }
+    catch (const std::exception &e)
+    {
+        strError = strprintf("failed to write the snapshot: %s", e.what());
+    }
+    fileout.fclose();
+    if (!fOk || !RenameOver(pathTemp, path))
+    {
+        fs::remove(pathTemp);
+        if (fOk)
+            strError = strprintf("can not rename %s", pathTemp.string());
+        return false;
+    }
+
+    nHeight = header.nHeight;
+    data.hashBlock = header.hashBlock;
+    data.nCoins = header.nCoins;
+    LogPrintf("Wrote UTXO snapshot of block %s at height %d with %u transactions and %u outputs to %s\n",
+        data.hashBlock.ToString(), nHeight, header.nTxs, header.nCoins, path.string());
+    return true;
+}
+
+bool LoadTxOutSet(const fs::path &path,
+    const CNetworkTemplate &chainparams,
+    const MapTxOutSetSnapshots &mapSnapshots,
+    CBlockTreeDB &blocktree,
+    CCoinsViewDB &coinsdb,
+    std::string &strError)
+{
+    if (!coinsdb.GetBestBlock().IsNull())
+        return SnapshotError(strError, "the chainstate is not empty");
+
+    LogPrintf("Checking UTXO snapshot %s...\n", path.string());
+    CSnapshotHeader header;
+    uint256 hashSnapshot;
+    CTxOutSetStats stats;
+    if (!ReadTxOutSetSnapshot(path, chainparams, nullptr, nullptr, header, hashSnapshot, stats, strError))
+        return false;
+    MapTxOutSetSnapshots::const_iterator it = mapSnapshots.find(header.nHeight);
+    if (it == mapSnapshots.end() || it->second.hashBlock != header.hashBlock)
+        return SnapshotError(strError, strprintf("a snapshot of block %s at height %d is not known for this network",
+                                           header.hashBlock.ToString(), header.nHeight));
+    if (it->second.hashSnapshot != hashSnapshot || it->second.nCoins != header.nCoins)
+        return SnapshotError(strError,
+            strprintf("the snapshot is not the one known for block %s", header.hashBlock.ToString()));
+
+    LogPrintf("Loading UTXO snapshot of block %s at height %d with %u transactions and %u outputs...\n",
+        header.hashBlock.ToString(), header.nHeight, header.nTxs, header.nCoins);
+    CSnapshotHeader headerWritten;
+    uint256 hashWritten;
+    if (!ReadTxOutSetSnapshot(path, chainparams, &blocktree, &coinsdb, headerWritten, hashWritten, stats, strError))
+        return false;
+    if (hashWritten != hashSnapshot || headerWritten.hashBlock != header.hashBlock ||
+        headerWritten.nTxs != header.nTxs || headerWritten.nCoins != header.nCoins)
+        return SnapshotError(strError, "the snapshot changed while it was loaded, remove the blocks and chainstate "
+                                       "directories and start again");
+
+    // what a pruned node would have, blocks are fetched from the one after the snapshot on
+    if (!blocktree.WriteFlag("txindex", true) || !blocktree.WriteFlag("prunedblockfiles", true))
+        return SnapshotError(strError, "failed to write the block index flags");
+    CCoinsMapMemoryResource resource;
+    CCoinsMap mapEmpty(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+    size_t nCoinsUsage = 0;
+    if (!coinsdb.BatchWrite(mapEmpty, header.hashBlock, header.nHeight, &stats, nCoinsUsage))
+        return SnapshotError(strError, "failed to write the best block of the chainstate");
+    LogPrintf("Loaded UTXO snapshot of block %s\n", header.hashBlock.ToString());
+    return true;
+}
+
+bool ParseTxOutSetSnapshot(const std::string &str, int &nHeight, CTxOutSetSnapshotData &data)
+{
+    std::vector<std::string> vParts;
+    size_t nStart = 0;
+    for (size_t nColon = str.find(':'); nColon != std::string::npos; nColon = str.find(':', nStart))
+    {
+        vParts.push_back(str.substr(nStart, nColon - nStart));
+        nStart = nColon + 1;
+    }
+    vParts.push_back(str.substr(nStart));
+    int32_t nParsedHeight;
+    int64_t nCoins;
+    if (vParts.size() != 4 || !ParseInt32(vParts[0], &nParsedHeight) || nParsedHeight < 0 ||
+        vParts[1].size() != 64 || !IsHex(vParts[1]) || !ParseInt64(vParts[2], &nCoins) || nCoins < 0 ||
+        vParts[3].size() != 64 || !IsHex(vParts[3]))
+        return false;
+    nHeight = nParsedHeight;
+    data.hashBlock = uint256S(vParts[1]);
+    data.nCoins = nCoins;
+    data.hashSnapshot = uint256S(vParts[3]);
+    return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the Eccoin project
+ * Copyright (c) 2019 The Eccoin developers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include "fs.h"
+#include "networks/networktemplate.h"
+
+#include <stdint.h>
+#include <string>
+
+class CBlockTreeDB;
+class CCoinsView;
+class CCoinsViewDB;
+
+/** Version of the UTXO snapshot file format */
+static const uint32_t TXOUTSET_SNAPSHOT_VERSION = 1;
+
+/**
+ * A UTXO snapshot holds everything a node needs to validate the chain on from the block it was taken at:
+ *
+ * - the block index entries of the chain up to that block, without the positions of block and undo data, so the
+ *   stake modifiers and proof of stake hashes of the history are there,
+ * - for every transaction with unspent outputs, the transaction itself, the block it is in and its offset there,
+ *   which the kernel of a stake of it needs, followed by its unspent outputs as the chainstate serializes them.
+ *
+ * A loaded snapshot leaves the node in the same state as pruning all block files up to that block would.
+ */
+
+/**
+ * Write the UTXO set of view, which has to be the chainstate database, and the rest of a snapshot to path. Blocks
+ * are not connected while it runs. On success nHeight and data describe the snapshot as the networks list them.
+ */
+bool DumpTxOutSet(const fs::path &path,
+    CCoinsView *view,
+    int &nHeight,
+    CTxOutSetSnapshotData &data,
+    std::string &strError);
+
+/**
+ * Load the snapshot at path into an empty block index and chainstate. It is read twice, once to check it against
+ * the one at its height in mapSnapshots and once to write it, the best block of the chainstate is written last.
+ */
+bool LoadTxOutSet(const fs::path &path,
+    const CNetworkTemplate &chainparams,
+    const MapTxOutSetSnapshots &mapSnapshots,
+    CBlockTreeDB &blocktree,
+    CCoinsViewDB &coinsdb,
+    std::string &strError);
+
+/**
+ * Parse a snapshot as -txoutsetsnapshot lists it, <height>:<block hash>:<outputs>:<snapshot hash> with the values
+ * dumptxoutset reports. Returns false, leaving nHeight and data as they were, if str is not of that form.
+ */
+bool ParseTxOutSetSnapshot(const std::string &str, int &nHeight, CTxOutSetSnapshotData &data);
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
@@ -20,46 +20,320 @@
 
 #include "validationinterface.h"
 
+#include "chain/block.h"
+#include "util/logger.h"
+#include "util/util.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 static CMainSignals g_signals;
+/** The signals of the listeners registered with fQueued, only ever called on the validation queue */
+static CMainSignals g_queuedSignals;
+
+namespace
+{
+/** The number of the event a queued callback of this thread is handling, 0 outside of one */
+thread_local uint64_t nDeliveringSequence = 0;
+
+/** Runs the events of the queued listeners one after the other, in the order they were signalled */
+class CValidationQueue
+{
+private:
+    std::mutex cs;
+    std::condition_variable condEvent;
+    std::condition_variable condDone;
+    std::deque<std::pair<uint64_t, std::function<void()> > > events;
+    //! the sequence numbers of the last event queued and the last one delivered
+    uint64_t nQueued;
+    uint64_t nDelivered;
+    bool fRunning;
+    bool fStop;
+    std::thread thread;
+
+    void Deliver(uint64_t nSequence, const std::function<void()> &fn)
+    {
+        nDeliveringSequence = nSequence;
+        try
+        {
+            fn();
+        }
+        catch (const std::exception &e)
+        {
+            PrintExceptionContinue(&e, "validation queue");
+        }
+        catch (...)
+        {
+            PrintExceptionContinue(nullptr, "validation queue");
+        }
+        nDeliveringSequence = 0;
+    }
+
+    void ThreadQueue()
+    {
+        RenameThread("eccoin-signals");
+        std::unique_lock<std::mutex> lock(cs);
+        while (true)
+        {
+            condEvent.wait(lock, [this] { return fStop || !events.empty(); });
+            if (events.empty())
+            {
+                // from here on Push delivers on the signalling thread, nothing is left behind in events
+                fRunning = false;
+                condDone.notify_all();
+                return;
+            }
+            std::pair<uint64_t, std::function<void()> > event = std::move(events.front());
+            events.pop_front();
+            lock.unlock();
+            Deliver(event.first, event.second);
+            lock.lock();
+            nDelivered = event.first;
+            condDone.notify_all();
+        }
+    }
+
+    //! whether a wait would be for this very thread
+    bool IsQueueThread() const { return std::this_thread::get_id() == thread.get_id(); }
+public:
+    CValidationQueue() : nQueued(0), nDelivered(0), fRunning(false), fStop(false) {}
+    ~CValidationQueue() { Stop(); }
+
+    void Start()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fRunning)
+            return;
+        if (thread.joinable())
+            thread.join();
+        fStop = false;
+        fRunning = true;
+        thread = std::thread(&CValidationQueue::ThreadQueue, this);
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (!fRunning)
+                return;
+            fStop = true;
+        }
+        condEvent.notify_one();
+        // the thread delivers what is left before it returns
+        thread.join();
+    }
+
+    void Push(std::function<void()> fn)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        const uint64_t nSequence = ++nQueued;
+        if (fRunning)
+        {
+            events.emplace_back(nSequence, std::move(fn));
+            condEvent.notify_one();
+            return;
+        }
+        lock.unlock();
+        Deliver(nSequence, fn);
+        lock.lock();
+        nDelivered = std::max(nDelivered, nSequence);
+    }
+
+    uint64_t GetSequence()
+    {
+        if (nDeliveringSequence != 0)
+            return nDeliveringSequence;
+        std::lock_guard<std::mutex> lock(cs);
+        return nQueued;
+    }
+
+    void Sync(uint64_t nSequence)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        if (nSequence == 0)
+            nSequence = nQueued;
+        if (IsQueueThread())
+            return;
+        condDone.wait(lock, [this, nSequence] { return !fRunning || nDelivered >= nSequence; });
+    }
+
+    void Limit()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        if (IsQueueThread())
+            return;
+        condDone.wait(lock, [this] { return !fRunning || events.size() <= MAX_VALIDATION_QUEUE_SIZE; });
+    }
+};
+
+CValidationQueue g_validationQueue;
+
+/** Whether the signals forward to g_queuedSignals, UnregisterAllValidationInterfaces disconnects that too */
+bool fQueueConnected = false;
+
+std::shared_ptr<const CBlock> CopyBlock(const CBlock *pblock)
+{
+    return pblock ? std::make_shared<const CBlock>(*pblock) : nullptr;
+}
+
+/** Hand every signal that has queued listeners over to the queue, with one copy of the block per event */
+void ConnectQueuedSignals()
+{
+    if (fQueueConnected)
+        return;
+    fQueueConnected = true;
+    g_signals.UpdatedBlockTip.connect([](const CBlockIndex *pindex) {
+        if (!g_queuedSignals.UpdatedBlockTip.empty())
+            g_validationQueue.Push([pindex] { g_queuedSignals.UpdatedBlockTip(pindex); });
+    });
+    g_signals.SyncTransaction.connect([](const CTransactionRef &ptx, const CBlock *pblock, int txIdx) {
+        if (g_queuedSignals.SyncTransaction.empty())
+            return;
+        std::shared_ptr<const CBlock> block = CopyBlock(pblock);
+        g_validationQueue.Push([ptx, block, txIdx] { g_queuedSignals.SyncTransaction(ptx, block.get(), txIdx); });
+    });
+    g_signals.SyncTransactions.connect([](const std::vector<CTransactionRef> &vtx, const CBlock *pblock) {
+        if (g_queuedSignals.SyncTransactions.empty())
+            return;
+        std::shared_ptr<const CBlock> block = CopyBlock(pblock);
+        g_validationQueue.Push([vtx, block] { g_queuedSignals.SyncTransactions(vtx, block.get()); });
+    });
+    g_signals.SetBestChain.connect([](const CBlockLocator &locator) {
+        if (!g_queuedSignals.SetBestChain.empty())
+            g_validationQueue.Push([locator] { g_queuedSignals.SetBestChain(locator); });
+    });
+    g_signals.Inventory.connect([](const uint256 &hash) {
+        if (!g_queuedSignals.Inventory.empty())
+            g_validationQueue.Push([hash] { g_queuedSignals.Inventory(hash); });
+    });
+    g_signals.BlockChecked.connect([](const CBlock &block, const CValidationState &state) {
+        if (g_queuedSignals.BlockChecked.empty())
+            return;
+        std::shared_ptr<const CBlock> pblock = CopyBlock(&block);
+        g_validationQueue.Push([pblock, state] { g_queuedSignals.BlockChecked(*pblock, state); });
+    });
+    g_signals.NewPoWValidBlock.connect([](const CBlockIndex *pindex, const CBlock *pblock) {
+        if (g_queuedSignals.NewPoWValidBlock.empty())
+            return;
+        std::shared_ptr<const CBlock> block = CopyBlock(pblock);
+        g_validationQueue.Push([pindex, block] { g_queuedSignals.NewPoWValidBlock(pindex, block.get()); });
+    });
+    g_signals.TransactionAddedToMempool.connect([](const CTransactionRef &ptx, uint64_t nMempoolSequence) {
+        if (!g_queuedSignals.TransactionAddedToMempool.empty())
+            g_validationQueue.Push([ptx, nMempoolSequence] {
+                g_queuedSignals.TransactionAddedToMempool(ptx, nMempoolSequence);
+            });
+    });
+    g_signals.TransactionRemovedFromMempool.connect(
+        [](const CTransactionRef &ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {
+            if (!g_queuedSignals.TransactionRemovedFromMempool.empty())
+                g_validationQueue.Push([ptx, reason, nMempoolSequence] {
+                    g_queuedSignals.TransactionRemovedFromMempool(ptx, reason, nMempoolSequence);
+                });
+        });
+    g_signals.BlockConnected.connect([](const CBlockIndex *pindex) {
+        if (!g_queuedSignals.BlockConnected.empty())
+            g_validationQueue.Push([pindex] { g_queuedSignals.BlockConnected(pindex); });
+    });
+    g_signals.BlockDisconnected.connect([](const CBlockIndex *pindex) {
+        if (!g_queuedSignals.BlockDisconnected.empty())
+            g_validationQueue.Push([pindex] { g_queuedSignals.BlockDisconnected(pindex); });
+    });
+}
+}
 
 CMainSignals &GetMainSignals() { return g_signals; }
-void RegisterValidationInterface(CValidationInterface *pwalletIn)
+void RegisterValidationInterface(CValidationInterface *pwalletIn, bool fQueued)
 {
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
-    g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+    CMainSignals &signals = fQueued ? g_queuedSignals : g_signals;
+    if (fQueued)
+    {
+        ConnectQueuedSignals();
+    }
+    signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
+    signals.SyncTransactions.connect(boost::bind(&CValidationInterface::SyncTransactions, pwalletIn, _1, _2));
+    signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+    signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+    signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
-    g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    signals.TransactionAddedToMempool.connect(
+        boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1, _2));
+    signals.TransactionRemovedFromMempool.connect(
+        boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1, _2, _3));
+    signals.BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1));
+    signals.BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
 }
 
 void UnregisterValidationInterface(CValidationInterface *pwalletIn)
 {
-    g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.ScriptForMining.disconnect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
-    g_signals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    g_signals.ScriptForMining.disconnect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
+    for (CMainSignals *signals : {&g_signals, &g_queuedSignals})
+    {
+        signals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+        signals->Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+        signals->SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+        signals->SyncTransaction.disconnect(
+            boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
+        signals->SyncTransactions.disconnect(
+            boost::bind(&CValidationInterface::SyncTransactions, pwalletIn, _1, _2));
+        signals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+        signals->NewPoWValidBlock.disconnect(
+            boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+        signals->TransactionAddedToMempool.disconnect(
+            boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1, _2));
+        signals->TransactionRemovedFromMempool.disconnect(
+            boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1, _2, _3));
+        signals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1));
+        signals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
+    }
+    // an event taken off the queue before the disconnect may still be calling it
+    g_validationQueue.Sync(0);
 }
 
 void UnregisterAllValidationInterfaces()
 {
-    g_signals.BlockChecked.disconnect_all_slots();
-    g_signals.ScriptForMining.disconnect_all_slots();
-    g_signals.Broadcast.disconnect_all_slots();
-    g_signals.Inventory.disconnect_all_slots();
-    g_signals.SetBestChain.disconnect_all_slots();
-    g_signals.SyncTransaction.disconnect_all_slots();
-    g_signals.UpdatedBlockTip.disconnect_all_slots();
-    g_signals.NewPoWValidBlock.disconnect_all_slots();
+    for (CMainSignals *signals : {&g_signals, &g_queuedSignals})
+    {
+        signals->BlockChecked.disconnect_all_slots();
+        signals->ScriptForMining.disconnect_all_slots();
+        signals->Broadcast.disconnect_all_slots();
+        signals->Inventory.disconnect_all_slots();
+        signals->SetBestChain.disconnect_all_slots();
+        signals->SyncTransaction.disconnect_all_slots();
+        signals->SyncTransactions.disconnect_all_slots();
+        signals->UpdatedBlockTip.disconnect_all_slots();
+        signals->NewPoWValidBlock.disconnect_all_slots();
+        signals->TransactionAddedToMempool.disconnect_all_slots();
+        signals->TransactionRemovedFromMempool.disconnect_all_slots();
+        signals->BlockConnected.disconnect_all_slots();
+        signals->BlockDisconnected.disconnect_all_slots();
+    }
+    fQueueConnected = false;
+    g_validationQueue.Sync(0);
 }
 
 void SyncWithWallets(const CTransactionRef &ptx, const CBlock *pblock, int txIdx)
 {
     g_signals.SyncTransaction(ptx, pblock, txIdx);
 }
+
+void SyncWithWallets(const std::vector<CTransactionRef> &vtx, const CBlock *pblock)
+{
+    g_signals.SyncTransactions(vtx, pblock);
+}
+
+void StartValidationInterfaceQueue() { g_validationQueue.Start(); }
+void StopValidationInterfaceQueue() { g_validationQueue.Stop(); }
+uint64_t GetValidationInterfaceSequence() { return g_validationQueue.GetSequence(); }
+void SyncWithValidationInterfaceQueue(uint64_t nSequence) { g_validationQueue.Sync(nSequence); }
+void LimitValidationInterfaceQueue() { g_validationQueue.Limit(); }
@@ -36,30 +36,74 @@ class CTransaction;
 class CValidationInterface;
 class CValidationState;
 class uint256;
+enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface *pwalletIn);
-/** Unregister a wallet from core */
+/** Above this many events waiting in the validation queue LimitValidationInterfaceQueue() waits */
+static const size_t MAX_VALIDATION_QUEUE_SIZE = 1000;
+
+/**
+ * Register a wallet to receive updates from core. With fQueued the callbacks run in order on the validation queue
+ * thread instead of on the thread that signals them, and blocks are handed over as a copy of their own; Broadcast
+ * and GetScriptForMining stay synchronous. A queued listener must not lock cs_main.
+ */
+void RegisterValidationInterface(CValidationInterface *pwalletIn, bool fQueued = false);
+/** Unregister a wallet from core, once this returns no queued callback of it runs any more */
 void UnregisterValidationInterface(CValidationInterface *pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
 /** Push an updated transaction to all registered wallets, pass NULL if block not known, pass -1 if txIdx not known */
 void SyncWithWallets(const CTransactionRef &ptx, const CBlock *pblock, int txIdx);
+/** Push the transactions of a block, or with a NULL block the ones it disconnected or conflicted, in one call */
+void SyncWithWallets(const std::vector<CTransactionRef> &vtx, const CBlock *pblock);
+
+/** Start the thread of the validation queue, until then queued listeners are called on the signalling thread */
+void StartValidationInterfaceQueue();
+/** Deliver the events still waiting and stop the thread of the validation queue */
+void StopValidationInterfaceQueue();
+/**
+ * The sequence number of the last event given to the queued listeners, numbers start at 1 and count every signal
+ * that had a queued listener. Called from a queued callback it is the number of the event being delivered.
+ */
+uint64_t GetValidationInterfaceSequence();
+/** Wait until the queued listeners got every event up to nSequence, by default every event signalled so far */
+void SyncWithValidationInterfaceQueue(uint64_t nSequence = 0);
+/**
+ * Wait while more than MAX_VALIDATION_QUEUE_SIZE events are waiting in the queue. Signalling never waits, so a
+ * producer calls this where it holds no locks, like between the steps of ActivateBestChain.
+ */
+void LimitValidationInterfaceQueue();
 
 class CValidationInterface
 {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransactionRef &ptx, const CBlock *pblock, int txIdx) {}
+    //! SyncTransaction() for each of them by default, with their index in pblock if it is not NULL
+    virtual void SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock)
+    {
+        for (size_t i = 0; i < vtx.size(); i++)
+        {
+            SyncTransaction(vtx[i], pblock, pblock ? (int)i : -1);
+        }
+    }
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void Inventory(const uint256 &hash) {}
     virtual void ResendWalletTransactions(int64_t nBestBlockTime, CConnman *connman) {}
     virtual void BlockChecked(const CBlock &, const CValidationState &) {}
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript> &){};
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const CBlock *block) {}
-    friend void ::RegisterValidationInterface(CValidationInterface *);
+    //! nMempoolSequence is the number of the change in the mempool, see CTxMemPool::NotifyEntryAdded
+    virtual void TransactionAddedToMempool(const CTransactionRef &ptx, uint64_t nMempoolSequence) {}
+    virtual void TransactionRemovedFromMempool(const CTransactionRef &ptx,
+        MemPoolRemovalReason reason,
+        uint64_t nMempoolSequence)
+    {
+    }
+    virtual void BlockConnected(const CBlockIndex *pindex) {}
+    virtual void BlockDisconnected(const CBlockIndex *pindex) {}
+    friend void ::RegisterValidationInterface(CValidationInterface *, bool);
     friend void ::UnregisterValidationInterface(CValidationInterface *);
     friend void ::UnregisterAllValidationInterfaces();
 };
@@ -70,6 +114,8 @@ struct CMainSignals
     boost::signals2::signal<void(const CBlockIndex *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void(const CTransactionRef &, const CBlock *, int txIndex)> SyncTransaction;
+    /** Notifies listeners of several updated transactions at once, see SyncWithWallets() */
+    boost::signals2::signal<void(const std::vector<CTransactionRef> &, const CBlock *)> SyncTransactions;
     /** Notifies listeners of a new active block chain. */
     boost::signals2::signal<void(const CBlockLocator &)> SetBestChain;
     /** Notifies listeners about an inventory item being seen on the network. */
@@ -86,6 +132,15 @@ struct CMainSignals
      * yet.
      */
     boost::signals2::signal<void(const CBlockIndex *, const CBlock *)> NewPoWValidBlock;
+    /** Notifies listeners of a transaction that entered the mempool of the node, with the mempool sequence */
+    boost::signals2::signal<void(const CTransactionRef &, uint64_t)> TransactionAddedToMempool;
+    /** Notifies listeners of a transaction that left the mempool of the node, for a block as well */
+    boost::signals2::signal<void(const CTransactionRef &, MemPoolRemovalReason, uint64_t)>
+        TransactionRemovedFromMempool;
+    /** Notifies listeners of a block connected to the active chain, after the mempool lost its transactions */
+    boost::signals2::signal<void(const CBlockIndex *)> BlockConnected;
+    /** Notifies listeners of a block disconnected from the active chain, before its transactions return */
+    boost::signals2::signal<void(const CBlockIndex *)> BlockDisconnected;
 };
 
 CMainSignals &GetMainSignals();
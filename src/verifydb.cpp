@@ -23,79 +23,219 @@
 #include "init.h"
 #include "main.h"
 #include "processblock.h"
+#include "undo.h"
+#include "util/util.h"
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+std::atomic<bool> fVerifyRunning{false};
+std::atomic<int> nVerifyCheckLevel{0};
+std::atomic<int> nVerifyBlocks{0};
+std::atomic<int> nVerifyChecked{0};
+std::atomic<bool> fVerifyVerified{false};
+
+/** Marks a VerifyDB as running for as long as it is in scope */
+class CVerifyRunning
+{
+public:
+    CVerifyRunning(int nCheckLevel)
+    {
+        nVerifyCheckLevel = nCheckLevel;
+        nVerifyBlocks = 0;
+        nVerifyChecked = 0;
+        fVerifyVerified = false;
+        fVerifyRunning = true;
+    }
+    ~CVerifyRunning() { fVerifyRunning = false; }
+};
+
+/** A block of the active chain for levels 0 to 2, copied out of its index under cs_main */
+struct CBlockToCheck
+{
+    uint256 hash;
+    uint256 hashPrev;
+    int nHeight;
+    CDiskBlockPos pos;
+    CDiskBlockPos posUndo;
+};
+
+/** Levels 0 to 2 of VerifyDB for one block, they need nothing but the block files */
+bool CheckBlockFromDisk(const CBlockToCheck &check,
+    int nCheckLevel,
+    const Consensus::Params &consensus,
+    std::string &strError)
+{
+    CBlock block;
+    // check level 0: read from disk
+    if (!ReadBlockFromDisk(block, check.pos, consensus) || block.GetHash() != check.hash)
+    {
+        strError = "ReadBlockFromDisk failed";
+        return false;
+    }
+    // check level 1: verify block validity
+    CValidationState state;
+    if (nCheckLevel >= 1 && !CheckBlock(block, state))
+    {
+        strError = "found bad block";
+        return false;
+    }
+    // check level 2: verify undo validity
+    if (nCheckLevel >= 2 && !check.posUndo.IsNull())
+    {
+        CBlockUndo undo;
+        if (!UndoReadFromDisk(undo, check.posUndo, check.hashPrev))
+        {
+            strError = "found bad undo data";
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+CVerifyProgress GetVerifyProgress()
+{
+    CVerifyProgress progress;
+    progress.fRunning = fVerifyRunning;
+    progress.nCheckLevel = nVerifyCheckLevel;
+    progress.nBlocks = nVerifyBlocks;
+    progress.nChecked = nVerifyChecked;
+    progress.fVerified = fVerifyVerified;
+    return progress;
+}
 
 CVerifyDB::CVerifyDB() {}
 CVerifyDB::~CVerifyDB() {}
 bool CVerifyDB::VerifyDB(const CNetworkTemplate &chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
 {
-    LOCK(cs_main);
-    if (pnetMan->getChainActive()->chainActive.Tip() == NULL ||
-        pnetMan->getChainActive()->chainActive.Tip()->pprev == NULL)
+    nCheckLevel = std::max(0, std::min(4, nCheckLevel));
+    CVerifyRunning running(nCheckLevel);
+
+    // the blocks to check, from the tip down
+    std::vector<CBlockToCheck> vChecks;
+    {
+        LOCK(cs_main);
+        CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+        if (pindexTip == NULL || pindexTip->pprev == NULL)
+        {
+            fVerifyVerified = true;
+            return true;
+        }
+
+        // Verify blocks in the best chain
+        if (nCheckDepth <= 0)
+            nCheckDepth = 1000000000; // suffices until the year 19000
+        if (nCheckDepth > pindexTip->nHeight)
+            nCheckDepth = pindexTip->nHeight;
+        LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+        for (CBlockIndex *pindex = pindexTip; pindex && pindex->pprev; pindex = pindex->pprev)
+        {
+            if (pindex->nHeight < pindexTip->nHeight - nCheckDepth)
+                break;
+            if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA))
+            {
+                // If pruning, only go back as far as we have data.
+                LogPrintf(
+                    "VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+                break;
+            }
+            vChecks.push_back({pindex->GetBlockHash(), pindex->pprev->GetBlockHash(), pindex->nHeight,
+                pindex->GetBlockPos(), pindex->GetUndoPos()});
+        }
+    }
+    nVerifyBlocks = vChecks.size();
+
+    // levels 0 to 2, the blocks are independent of each other and are checked side by side
+    std::atomic<size_t> nNext{0};
+    std::atomic<bool> fFailed{false};
+    std::mutex csFailure;
+    size_t nFailure = vChecks.size();
+    std::string strFailure;
+    const size_t nLogEvery = std::max<size_t>(1, vChecks.size() / 10);
+    auto checkBlocks = [&]() {
+        for (size_t i = nNext++; i < vChecks.size() && !fFailed && !shutdown_threads.load(); i = nNext++)
+        {
+            std::string strError;
+            if (!CheckBlockFromDisk(vChecks[i], nCheckLevel, chainparams.GetConsensus(), strError))
+            {
+                // every block above a failed one is checked before the workers stop, the failure closest to the
+                // tip is the one the serial check found
+                std::lock_guard<std::mutex> lock(csFailure);
+                if (i < nFailure)
+                {
+                    nFailure = i;
+                    strFailure = strError;
+                }
+                fFailed = true;
+            }
+            const size_t nChecked = ++nVerifyChecked;
+            if (nChecked % nLogEvery == 0)
+                LogPrintf("Verifying blocks... %d%%\n", nChecked * 100 / vChecks.size());
+        }
+    };
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nScriptCheckThreads; i++)
+        vThreads.emplace_back(checkBlocks);
+    checkBlocks();
+    for (std::thread &thread : vThreads)
+        thread.join();
+    if (shutdown_threads.load())
+    {
+        LogPrintf("VerifyDB(): Shutdown requested. Exiting.\n");
+        return false;
+    }
+    if (fFailed)
+        return error("VerifyDB(): *** %s at %d, hash=%s", strFailure, vChecks[nFailure].nHeight,
+            vChecks[nFailure].hash.ToString());
+    if (nCheckLevel < 3)
+    {
+        LogPrintf("No block database inconsistencies in last %i blocks\n", vChecks.size());
+        fVerifyVerified = true;
         return true;
+    }
 
-    // Verify blocks in the best chain
-    if (nCheckDepth <= 0)
-        nCheckDepth = 1000000000; // suffices until the year 19000
-    if (nCheckDepth > pnetMan->getChainActive()->chainActive.Height())
-        nCheckDepth = pnetMan->getChainActive()->chainActive.Height();
-    nCheckLevel = std::max(0, std::min(4, nCheckLevel));
-    LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    // levels 3 and 4 work on the coins of the tip, in a cache over them that is thrown away at the end
+    LOCK(cs_main);
+    CChainManager *pchainman = pnetMan->getChainActive();
     CCoinsViewCache coins(coinsview);
-    CBlockIndex *pindexState = pnetMan->getChainActive()->chainActive.Tip();
+    CBlockIndex *pindexState = pchainman->chainActive.Tip();
     CBlockIndex *pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
-    for (CBlockIndex *pindex = pnetMan->getChainActive()->chainActive.Tip(); pindex && pindex->pprev;
-         pindex = pindex->pprev)
+    // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+    for (CBlockIndex *pindex = pindexState; pindex && pindex->pprev; pindex = pindex->pprev)
     {
         if (shutdown_threads.load())
         {
             LogPrintf("VerifyDB(): Shutdown requested. Exiting.\n");
             return false;
         }
-        if (pindex->nHeight < pnetMan->getChainActive()->chainActive.Height() - nCheckDepth)
+        if (pindex->nHeight < pchainman->chainActive.Height() - nCheckDepth ||
+            (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)))
+            break;
+        if (coins.DynamicMemoryUsage() + pchainman->pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage)
             break;
         CBlock block;
-        // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight,
                 pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
-            return error(
-                "VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex)
+        bool fClean = true;
+        if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s",
+                pindex->nHeight, pindex->GetBlockHash().ToString());
+        pindexState = pindex->pprev;
+        if (!fClean)
         {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull())
-            {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight,
-                        pindex->GetBlockHash().ToString());
-            }
+            nGoodTransactions = 0;
+            pindexFailure = pindex;
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState &&
-            (coins.DynamicMemoryUsage() + pnetMan->getChainActive()->pcoinsTip->DynamicMemoryUsage()) <=
-                nCoinCacheUsage)
+        else
         {
-            bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s",
-                    pindex->nHeight, pindex->GetBlockHash().ToString());
-            pindexState = pindex->pprev;
-            if (!fClean)
-            {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            }
-            else
-            {
-                nGoodTransactions += block.vtx.size();
-            }
+            nGoodTransactions += block.vtx.size();
         }
         if (ShutdownRequested())
             return true;
@@ -103,20 +243,20 @@ bool CVerifyDB::VerifyDB(const CNetworkTemplate &chainparams, CCoinsView *coinsv
     if (pindexFailure)
         return error(
             "VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n",
-            pnetMan->getChainActive()->chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
+            pchainman->chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
 
     // check level 4: try reconnecting blocks
     if (nCheckLevel >= 4)
     {
         CBlockIndex *pindex = pindexState;
-        while (pindex != pnetMan->getChainActive()->chainActive.Tip())
+        while (pindex != pchainman->chainActive.Tip())
         {
             if (shutdown_threads.load())
             {
                 LogPrintf("VerifyDB(): [lower] Shutdown requested. Exiting.\n");
                 return false;
             }
-            pindex = pnetMan->getChainActive()->chainActive.Next(pindex);
+            pindex = pchainman->chainActive.Next(pindex);
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight,
@@ -128,7 +268,19 @@ bool CVerifyDB::VerifyDB(const CNetworkTemplate &chainparams, CCoinsView *coinsv
     }
 
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n",
-        pnetMan->getChainActive()->chainActive.Height() - pindexState->nHeight, nGoodTransactions);
-
+        pchainman->chainActive.Height() - pindexState->nHeight, nGoodTransactions);
+    fVerifyVerified = true;
     return true;
 }
+
+void ThreadVerifyDB(int nCheckLevel, int nCheckDepth)
+{
+    RenameThread("bitcoin-verifydb");
+    if (CVerifyDB().VerifyDB(pnetMan->getActivePaymentNetwork(), pnetMan->getChainActive()->pcoinsTip.get(),
+            nCheckLevel, nCheckDepth))
+        return;
+    if (shutdown_threads.load())
+        return;
+    strMiscWarning = "Warning: Corrupted block database detected, restart with -reindex";
+    LogPrintf("%s\n", strMiscWarning);
+}
@@ -24,13 +24,37 @@
 #include "coins.h"
 #include "networks/networktemplate.h"
 
-/** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
+/** Run the -checkblocks verification after startup instead of before it */
+static const bool DEFAULT_CHECKBACKGROUND = false;
+
+/** Where the running or the last VerifyDB is */
+struct CVerifyProgress
+{
+    bool fRunning = false;
+    int nCheckLevel = 0;
+    //! blocks the verification covers, and the ones read and checked at levels 0 to 2 so far
+    int nBlocks = 0;
+    int nChecked = 0;
+    //! the blocks are verified, only meaningful once it is no longer running
+    bool fVerified = false;
+};
+/** The progress of VerifyDB, needs no lock */
+CVerifyProgress GetVerifyProgress();
+
 class CVerifyDB
 {
 public:
     CVerifyDB();
     ~CVerifyDB();
+    /**
+     * Verifies the last nCheckDepth blocks of the active chain at nCheckLevel. Levels 0 to 2 read and check the
+     * blocks and their undo data on nScriptCheckThreads threads and without cs_main. Levels 3 and 4 disconnect and
+     * reconnect the blocks at the tip in a cache over coinsview, under cs_main.
+     */
     bool VerifyDB(const CNetworkTemplate &chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/** -checkbackground: runs VerifyDB over the coins tip once the node is up, and warns if the blocks are corrupted */
+void ThreadVerifyDB(int nCheckLevel, int nCheckDepth);
+
 #endif // VERIFYDB_H
@@ -26,7 +26,7 @@
  */
 
 
-static const int PROTOCOL_VERSION = 60039;
+static const int PROTOCOL_VERSION = 60041;
 
 // earlier versions not supported as of Feb 2012, and are disconnected
 static const int MIN_PROTO_VERSION = 60037;
@@ -40,6 +40,12 @@ static const int GETHEADERS_VERSION = 60035;
 //! "filter*" commands are disabled without NODE_BLOOM after and including this version
 static const int NO_BLOOM_VERSION = 60034;
 
+//! compact block relay, "sendcmpct", "cmpctblock", "getblocktxn" and "blocktxn", starts with this version
+static const int COMPACT_BLOCKS_VERSION = 60040;
+
+//! "feefilter" tells the peer not to announce transactions below a feerate, starts with this version
+static const int FEEFILTER_VERSION = 60041;
+
 /**
  * Versioning for network services
  */
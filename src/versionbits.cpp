@@ -19,6 +19,54 @@
 
 #include "versionbits.h"
 
+const size_t ThresholdConditionCache::MAX_SIDE_STATES;
+
+bool ThresholdConditionCache::Get(const CBlockIndex *pindexPrev, int nPeriod, ThresholdState &state) const
+{
+    // before the first period every block is defined
+    if (pindexPrev == NULL)
+    {
+        state = THRESHOLD_DEFINED;
+        return true;
+    }
+    const size_t nSlot = pindexPrev->nHeight / nPeriod;
+    if (nSlot < vPeriods.size() && vPeriods[nSlot].first == pindexPrev)
+    {
+        state = vPeriods[nSlot].second;
+        return true;
+    }
+    std::map<const CBlockIndex *, ThresholdState>::const_iterator it = mapSide.find(pindexPrev);
+    if (it == mapSide.end())
+        return false;
+    state = it->second;
+    return true;
+}
+
+void ThresholdConditionCache::Set(const CBlockIndex *pindexPrev, int nPeriod, ThresholdState state)
+{
+    if (pindexPrev == NULL)
+        return;
+    const size_t nSlot = pindexPrev->nHeight / nPeriod;
+    if (nSlot >= vPeriods.size())
+        vPeriods.resize(nSlot + 1, std::make_pair((const CBlockIndex *)NULL, THRESHOLD_DEFINED));
+    std::pair<const CBlockIndex *, ThresholdState> &slot = vPeriods[nSlot];
+    if (slot.first != NULL && slot.first != pindexPrev)
+    {
+        // the chain asked for last wins the slot, the other branch is kept aside for a while
+        if (mapSide.size() >= MAX_SIDE_STATES)
+            mapSide.clear();
+        mapSide[slot.first] = slot.second;
+    }
+    mapSide.erase(pindexPrev);
+    slot = std::make_pair(pindexPrev, state);
+}
+
+void ThresholdConditionCache::clear()
+{
+    vPeriods.clear();
+    mapSide.clear();
+}
+
 ThresholdState AbstractThresholdConditionChecker::GetStateFor(const CBlockIndex *pindexPrev,
     const Consensus::Params &params,
     ThresholdConditionCache &cache) const
@@ -36,29 +84,22 @@ ThresholdState AbstractThresholdConditionChecker::GetStateFor(const CBlockIndex
     }
 
     // Walk backwards in steps of nPeriod to find a pindexPrev whose information is known
+    // The genesis block is by definition defined, the cache knows that without an entry.
     std::vector<const CBlockIndex *> vToCompute;
-    while (cache.count(pindexPrev) == 0)
+    ThresholdState state;
+    while (!cache.Get(pindexPrev, nPeriod, state))
     {
-        if (pindexPrev == NULL)
-        {
-            // The genesis block is by definition defined.
-            cache[pindexPrev] = THRESHOLD_DEFINED;
-            break;
-        }
         if (pindexPrev->GetMedianTimePast() < nTimeStart)
         {
             // Optimizaton: don't recompute down further, as we know every earlier block will be before the start time
-            cache[pindexPrev] = THRESHOLD_DEFINED;
+            state = THRESHOLD_DEFINED;
+            cache.Set(pindexPrev, nPeriod, state);
             break;
         }
         vToCompute.push_back(pindexPrev);
         pindexPrev = pindexPrev->GetAncestor(pindexPrev->nHeight - nPeriod);
     }
 
-    // At this point, cache[pindexPrev] is known
-    assert(cache.count(pindexPrev));
-    ThresholdState state = cache[pindexPrev];
-
     // Now walk forward and compute the state of descendants of pindexPrev
     while (!vToCompute.empty())
     {
@@ -117,7 +158,8 @@ ThresholdState AbstractThresholdConditionChecker::GetStateFor(const CBlockIndex
             break;
         }
         }
-        cache[pindexPrev] = state = stateNext;
+        state = stateNext;
+        cache.Set(pindexPrev, nPeriod, state);
     }
 
     return state;
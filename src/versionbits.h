@@ -22,6 +22,8 @@
 
 #include "chain/chain.h"
 #include <map>
+#include <utility>
+#include <vector>
 
 /** What block version to use for new blocks (pre versionbits) */
 static const int32_t VERSIONBITS_LAST_OLD_BLOCK_VERSION = 4;
@@ -41,10 +43,27 @@ enum ThresholdState
     THRESHOLD_FAILED,
 };
 
-// A map that gives the state for blocks whose height is a multiple of Period().
-// The map is indexed by the block's parent, however, so all keys in the map
-// will either be NULL or a block with (height + 1) % Period() == 0.
-typedef std::map<const CBlockIndex *, ThresholdState> ThresholdConditionCache;
+/**
+ * The state for blocks whose height is a multiple of Period(), indexed by the block's parent, so all keys are
+ * either NULL or a block with (height + 1) % Period() == 0. The states of the last computed chain are kept in an
+ * array with a slot per period. The state a slot held before another branch took it over goes to a map, which is
+ * forgotten when it grows past MAX_SIDE_STATES.
+ */
+class ThresholdConditionCache
+{
+private:
+    std::vector<std::pair<const CBlockIndex *, ThresholdState> > vPeriods;
+    std::map<const CBlockIndex *, ThresholdState> mapSide;
+
+public:
+    static const size_t MAX_SIDE_STATES = 64;
+
+    //! The state after pindexPrev, the last block of a period of nPeriod blocks, if it is known
+    bool Get(const CBlockIndex *pindexPrev, int nPeriod, ThresholdState &state) const;
+    void Set(const CBlockIndex *pindexPrev, int nPeriod, ThresholdState state);
+    size_t SideSize() const { return mapSide.size(); }
+    void clear();
+};
 
 /**
  * Abstract class that implements BIP9-style threshold logic, and caches results.
@@ -28,7 +28,10 @@
 
 #include <openssl/aes.h>
 #include <openssl/evp.h>
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 
 bool CCrypter::SetKeyFromPassphrase(const SecureString &strKeyData,
@@ -141,6 +144,33 @@ static bool DecryptKey(const CKeyingMaterial &vMasterKey,
     return key.VerifyPubKey(vchPubKey);
 }
 
+/** Minimum number of keys per decrypting thread, below this starting a thread costs more than it saves */
+static const size_t MIN_DECRYPT_KEYS_PER_THREAD = 16;
+
+/** DecryptKey() for each of vCrypted on all cores, vOk tells which ones decrypted to their public key */
+static void DecryptKeys(const CKeyingMaterial &vMasterKey,
+    const std::vector<const std::pair<CPubKey, std::vector<unsigned char> > *> &vCrypted,
+    std::vector<CKey> &vKeys,
+    std::vector<char> &vOk)
+{
+    const size_t nKeys = vCrypted.size();
+    vKeys.resize(nKeys);
+    vOk.assign(nKeys, false);
+    std::atomic<size_t> nNextKey(0);
+    auto decrypt = [&]() {
+        size_t i;
+        while ((i = nNextKey++) < nKeys)
+            vOk[i] = DecryptKey(vMasterKey, vCrypted[i]->second, vCrypted[i]->first, vKeys[i]);
+    };
+    size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), nKeys / MIN_DECRYPT_KEYS_PER_THREAD);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; i++)
+        vThreads.emplace_back(decrypt);
+    decrypt();
+    for (std::thread &thread : vThreads)
+        thread.join();
+}
+
 bool CCryptoKeyStore::SetCrypted()
 {
     LOCK(cs_KeyStore);
@@ -160,6 +190,7 @@ bool CCryptoKeyStore::Lock()
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        mapDecryptedKeys.clear();
     }
 
     NotifyStatusChanged(this);
@@ -173,23 +204,19 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial &vMasterKeyIn)
         if (!SetCrypted())
             return false;
 
-        bool keyPass = false;
-        bool keyFail = false;
-        CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
-        for (; mi != mapCryptedKeys.end(); ++mi)
+        // the first unlock checks every key, on all cores, after that one is enough
+        std::vector<const std::pair<CPubKey, std::vector<unsigned char> > *> vCrypted;
+        for (const std::pair<const CKeyID, std::pair<CPubKey, std::vector<unsigned char> > > &item : mapCryptedKeys)
         {
-            const CPubKey &vchPubKey = (*mi).second.first;
-            const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-            CKey key;
-            if (!DecryptKey(vMasterKeyIn, vchCryptedSecret, vchPubKey, key))
-            {
-                keyFail = true;
-                break;
-            }
-            keyPass = true;
+            vCrypted.push_back(&item.second);
             if (fDecryptionThoroughlyChecked)
                 break;
         }
+        std::vector<CKey> vKeys;
+        std::vector<char> vOk;
+        DecryptKeys(vMasterKeyIn, vCrypted, vKeys, vOk);
+        bool keyPass = std::find(vOk.begin(), vOk.end(), true) != vOk.end();
+        bool keyFail = std::find(vOk.begin(), vOk.end(), false) != vOk.end();
         if (keyPass && keyFail)
         {
             LogPrintf("The wallet is probably corrupted: Some keys decrypt but not all.\n");
@@ -226,6 +253,23 @@ bool CCryptoKeyStore::AddKeyPubKey(const CKey &key, const CPubKey &pubkey)
 }
 
 
+CKeyingMaterial CCryptoKeyStore::GetMasterKey() const
+{
+    LOCK(cs_KeyStore);
+    return vMasterKey;
+}
+
+bool CCryptoKeyStore::EncryptNewKey(const CKeyingMaterial &vMasterKeyIn,
+    const CKey &key,
+    const CPubKey &pubkey,
+    std::vector<unsigned char> &vchCryptedSecret)
+{
+    if (vMasterKeyIn.empty())
+        return false;
+    CKeyingMaterial vchSecret(key.begin(), key.end());
+    return EncryptSecret(vMasterKeyIn, vchSecret, pubkey.GetHash(), vchCryptedSecret);
+}
+
 bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
     {
@@ -234,6 +278,7 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<
             return false;
 
         mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
+        prefilter.AddPubKey(vchPubKey);
     }
     return true;
 }
@@ -245,6 +290,13 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey &keyOut) const
         if (!IsCrypted())
             return CBasicKeyStore::GetKey(address, keyOut);
 
+        std::map<CKeyID, CKey>::const_iterator itDecrypted = mapDecryptedKeys.find(address);
+        if (itDecrypted != mapDecryptedKeys.end())
+        {
+            keyOut = itDecrypted->second;
+            return true;
+        }
+
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.find(address);
         if (mi != mapCryptedKeys.end())
         {
@@ -256,6 +308,45 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey &keyOut) const
     return false;
 }
 
+bool CCryptoKeyStore::DecryptKeysAhead(const std::set<CKeyID> &setAddress)
+{
+    LOCK(cs_KeyStore);
+    if (!IsCrypted() || IsLocked())
+        return false;
+
+    std::vector<CKeyID> vAddress;
+    std::vector<const std::pair<CPubKey, std::vector<unsigned char> > *> vCrypted;
+    for (const CKeyID &address : setAddress)
+    {
+        CryptedKeyMap::const_iterator mi = mapCryptedKeys.find(address);
+        if (mi != mapCryptedKeys.end() && !mapDecryptedKeys.count(address))
+        {
+            vAddress.push_back(address);
+            vCrypted.push_back(&mi->second);
+        }
+    }
+    std::vector<CKey> vKeys;
+    std::vector<char> vOk;
+    DecryptKeys(vMasterKey, vCrypted, vKeys, vOk);
+    // a key that does not decrypt is left to GetKey() to fail on
+    for (size_t i = 0; i < vAddress.size(); i++)
+    {
+        if (vOk[i])
+            mapDecryptedKeys.emplace(vAddress[i], vKeys[i]);
+    }
+    nDecryptedKeysUsers++;
+    return true;
+}
+
+void CCryptoKeyStore::ForgetDecryptedKeys()
+{
+    LOCK(cs_KeyStore);
+    if (nDecryptedKeysUsers > 0)
+        nDecryptedKeysUsers--;
+    if (nDecryptedKeysUsers == 0)
+        mapDecryptedKeys.clear();
+}
+
 bool CCryptoKeyStore::GetPubKey(const CKeyID &address, CPubKey &vchPubKeyOut) const
 {
     {
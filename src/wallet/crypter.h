@@ -146,6 +146,11 @@ private:
     //! keeps track of whether Unlock has run a thorough check before
     bool fDecryptionThoroughlyChecked;
 
+    //! keys DecryptKeysAhead() decrypted for GetKey(), each CKey keeps its secret in locked memory
+    std::map<CKeyID, CKey> mapDecryptedKeys;
+    //! the DecryptKeysAhead() calls ForgetDecryptedKeys() has not ended yet
+    unsigned int nDecryptedKeysUsers;
+
 protected:
     bool SetCrypted();
 
@@ -154,8 +159,16 @@ protected:
 
     bool Unlock(const CKeyingMaterial &vMasterKeyIn);
 
+    //! a copy of the master key for EncryptNewKey(), empty if the store is not crypted or is locked
+    CKeyingMaterial GetMasterKey() const;
+    //! encrypt a new key for AddCryptedKey(), it does not touch the store so any thread can do it
+    static bool EncryptNewKey(const CKeyingMaterial &vMasterKeyIn,
+        const CKey &key,
+        const CPubKey &pubkey,
+        std::vector<unsigned char> &vchCryptedSecret);
+
 public:
-    CCryptoKeyStore() : fUseCrypto(false), fDecryptionThoroughlyChecked(false) {}
+    CCryptoKeyStore() : fUseCrypto(false), fDecryptionThoroughlyChecked(false), nDecryptedKeysUsers(0) {}
     bool IsCrypted() const { return fUseCrypto; }
     bool IsLocked() const
     {
@@ -185,6 +198,15 @@ public:
     }
     bool GetKey(const CKeyID &address, CKey &keyOut) const;
     bool GetPubKey(const CKeyID &address, CPubKey &vchPubKeyOut) const;
+
+    /**
+     * Decrypt the keys of setAddress on all cores ahead of a large signing job, GetKey() hands them out until the
+     * matching ForgetDecryptedKeys() or Lock(). Returns false, and needs no ForgetDecryptedKeys(), if the store is not
+     * encrypted or is locked. See CDecryptedKeysScope.
+     */
+    bool DecryptKeysAhead(const std::set<CKeyID> &setAddress);
+    //! cleanse the keys of DecryptKeysAhead() once every caller of it is done
+    void ForgetDecryptedKeys();
     void GetKeys(std::set<CKeyID> &setAddress) const
     {
         if (!IsCrypted())
@@ -208,4 +230,24 @@ public:
     boost::signals2::signal<void(CCryptoKeyStore *wallet)> NotifyStatusChanged;
 };
 
+/** Keeps the keys of a signing job decrypted ahead, see CCryptoKeyStore::DecryptKeysAhead(), while it lives */
+class CDecryptedKeysScope
+{
+private:
+    CCryptoKeyStore *keystore;
+
+public:
+    CDecryptedKeysScope(CCryptoKeyStore *keystoreIn, const std::set<CKeyID> &setAddress)
+        : keystore(keystoreIn && keystoreIn->DecryptKeysAhead(setAddress) ? keystoreIn : nullptr)
+    {
+    }
+    ~CDecryptedKeysScope()
+    {
+        if (keystore)
+            keystore->ForgetDecryptedKeys();
+    }
+    CDecryptedKeysScope(const CDecryptedKeysScope &) = delete;
+    CDecryptedKeysScope &operator=(const CDecryptedKeysScope &) = delete;
+};
+
 #endif // BITCOIN_WALLET_CRYPTER_H
@@ -3,6 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "wallet/wallet.h"
+#include "main.h"
+#include "networks/netman.h"
+#include "script/standard.h"
 
 #include <set>
 #include <stdint.h>
@@ -57,6 +60,13 @@ static void empty_wallet(void)
     vCoins.clear();
 }
 
+class CCryptoKeyStoreTester : public CCryptoKeyStore
+{
+public:
+    using CCryptoKeyStore::EncryptKeys;
+    using CCryptoKeyStore::Unlock;
+};
+
 static bool equal_sets(CoinSet a, CoinSet b)
 {
     std::pair<CoinSet::iterator, CoinSet::iterator> ret = mismatch(a.begin(), a.end(), b.begin());
@@ -359,4 +369,327 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     BOOST_CHECK_EQUAL(setCoinsRet.size(), 101);
 }
 
+BOOST_AUTO_TEST_CASE(running_balances)
+{
+    CWallet balanceWallet;
+    CKey key;
+    key.MakeNewKey(true);
+    LOCK2(cs_main, balanceWallet.cs_wallet);
+    BOOST_CHECK(balanceWallet.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // confirmed in the tip
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 1 * COIN;
+    tx.vout[0].scriptPubKey = scriptMine;
+    tx.vout[1].nValue = 2 * COIN;
+    tx.vout[1].scriptPubKey = scriptMine;
+    CWalletTx wtx(&balanceWallet, MakeTransactionRef(tx));
+    wtx.hashBlock = pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash();
+    wtx.nIndex = 0;
+    BOOST_CHECK(balanceWallet.AddToWallet(wtx, true, nullptr));
+    BOOST_CHECK_EQUAL(balanceWallet.GetBalance(), 3 * COIN);
+    BOOST_CHECK_EQUAL(balanceWallet.GetUnconfirmedBalance(), 0);
+
+    // a spend takes the output out of the balance, it is neither confirmed nor in the mempool itself
+    CTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(tx.GetHash(), 1);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 2 * COIN;
+    spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    BOOST_CHECK(balanceWallet.AddToWallet(CWalletTx(&balanceWallet, MakeTransactionRef(spend)), true, nullptr));
+    BOOST_CHECK_EQUAL(balanceWallet.GetBalance(), 1 * COIN);
+
+    // the running balances agree with a full recount
+    balanceWallet.MarkDirty();
+    CWalletBalances balances = balanceWallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.nTrusted, 1 * COIN);
+    BOOST_CHECK_EQUAL(balances.nUnconfirmed, 0);
+    BOOST_CHECK_EQUAL(balances.nImmature, 0);
+    BOOST_CHECK_EQUAL(balances.nWatchTrusted, 0);
+}
+
+BOOST_AUTO_TEST_CASE(unspent_index)
+{
+    CWallet coinWallet;
+    CKey key;
+    key.MakeNewKey(true);
+    LOCK2(cs_main, coinWallet.cs_wallet);
+    BOOST_CHECK(coinWallet.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // outputs 0 and 2 are ours
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(3);
+    tx.vout[0].nValue = 1 * COIN;
+    tx.vout[0].scriptPubKey = scriptMine;
+    tx.vout[1].nValue = 2 * COIN;
+    tx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[2].nValue = 3 * COIN;
+    tx.vout[2].scriptPubKey = scriptMine;
+    CWalletTx wtx(&coinWallet, MakeTransactionRef(tx));
+    wtx.hashBlock = pnetMan->getChainActive()->chainActive.Tip()->GetBlockHash();
+    wtx.nIndex = 0;
+    BOOST_CHECK(coinWallet.AddToWallet(wtx, true, nullptr));
+
+    std::vector<COutput> vAvailable;
+    coinWallet.AvailableCoins(vAvailable, true);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 2U);
+
+    // a spend of output 2 drops it from the index
+    CTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(tx.GetHash(), 2);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 3 * COIN;
+    spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    BOOST_CHECK(coinWallet.AddToWallet(CWalletTx(&coinWallet, MakeTransactionRef(spend)), true, nullptr));
+    coinWallet.AvailableCoins(vAvailable, true);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 1U);
+    BOOST_CHECK_EQUAL(vAvailable[0].i, 0);
+    BOOST_CHECK_EQUAL(vAvailable[0].tx->tx->vout[vAvailable[0].i].nValue, 1 * COIN);
+
+    // only the given inputs
+    std::vector<CTxIn> vin{CTxIn(COutPoint(tx.GetHash(), 2))};
+    coinWallet.AvailableCoins(vAvailable, true, false, vin);
+    BOOST_CHECK(vAvailable.empty());
+
+    // a rebuild finds the same
+    coinWallet.MarkDirty();
+    coinWallet.AvailableCoins(vAvailable, true);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(transactions_since)
+{
+    CWallet txWallet;
+    LOCK2(cs_main, txWallet.cs_wallet);
+    CBlockIndex *pindexTip = pnetMan->getChainActive()->chainActive.Tip();
+
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    CWalletTx wtxConfirmed(&txWallet, MakeTransactionRef(tx));
+    wtxConfirmed.hashBlock = pindexTip->GetBlockHash();
+    wtxConfirmed.nIndex = 0;
+    wtxConfirmed.nOrderPos = 0;
+    BOOST_CHECK(txWallet.AddToWallet(wtxConfirmed, true, nullptr));
+
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    CWalletTx wtxUnconfirmed(&txWallet, MakeTransactionRef(tx));
+    wtxUnconfirmed.nOrderPos = 1;
+    BOOST_CHECK(txWallet.AddToWallet(wtxUnconfirmed, true, nullptr));
+    const uint256 hashUnconfirmed = tx.GetHash();
+
+    // the unconfirmed one goes last
+    std::vector<const CWalletTx *> vSince = txWallet.GetTransactionsSince(pindexTip->nHeight - 1);
+    BOOST_CHECK_EQUAL(vSince.size(), 2U);
+    BOOST_CHECK(vSince[0]->tx->GetHash() == wtxConfirmed.tx->GetHash());
+    BOOST_CHECK(vSince[1]->tx->GetHash() == hashUnconfirmed);
+    vSince = txWallet.GetTransactionsSince(pindexTip->nHeight);
+    BOOST_CHECK_EQUAL(vSince.size(), 1U);
+    BOOST_CHECK(vSince[0]->tx->GetHash() == hashUnconfirmed);
+
+    // a block that confirms the second one moves it
+    CWalletTx &wtxUpdate = txWallet.mapWallet[hashUnconfirmed];
+    wtxUpdate.hashBlock = pindexTip->GetBlockHash();
+    wtxUpdate.nIndex = 1;
+    wtxUpdate.MarkDirty();
+    BOOST_CHECK(txWallet.GetTransactionsSince(pindexTip->nHeight).empty());
+    BOOST_CHECK_EQUAL(txWallet.GetTransactionsSince(-1).size(), 2U);
+
+    // the order positions are what listtransactions pages with
+    BOOST_CHECK_EQUAL(txWallet.wtxOrdered.size(), 2U);
+    BOOST_CHECK(txWallet.wtxOrdered.lower_bound(1)->second->tx->GetHash() == hashUnconfirmed);
+}
+
+BOOST_AUTO_TEST_CASE(ismine_prefilter)
+{
+    CBasicKeyStore keystore;
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CScript scriptPubKeyHash = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptPubKey = GetScriptForRawPubKey(key.GetPubKey());
+    CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    CScript scriptWatch = CScript() << OP_TRUE << OP_DROP << OP_TRUE;
+    BOOST_CHECK(!keystore.MightBeMine(scriptPubKeyHash));
+
+    BOOST_CHECK(keystore.AddKey(key));
+    BOOST_CHECK(keystore.AddCScript(scriptOther));
+    BOOST_CHECK(keystore.AddWatchOnly(scriptWatch));
+    BOOST_CHECK(keystore.MightBeMine(scriptPubKeyHash));
+    BOOST_CHECK(keystore.MightBeMine(scriptPubKey));
+    BOOST_CHECK(keystore.MightBeMine(GetScriptForDestination(CScriptID(scriptOther))));
+    BOOST_CHECK(keystore.MightBeMine(scriptWatch));
+    BOOST_CHECK(!keystore.MightBeMine(scriptOther));
+    BOOST_CHECK(!keystore.MightBeMine(GetScriptForDestination(CScriptID(scriptPubKey))));
+    BOOST_CHECK(IsMine(keystore, scriptPubKeyHash) == ISMINE_SPENDABLE);
+    BOOST_CHECK(IsMine(keystore, scriptOther) == ISMINE_NO);
+
+    // the filter grows past its first capacity without losing anything
+    for (int i = 0; i < 1000; i++)
+    {
+        CKey keyMore;
+        keyMore.MakeNewKey(true);
+        BOOST_CHECK(keystore.AddKey(keyMore));
+    }
+    BOOST_CHECK(keystore.MightBeMine(scriptPubKeyHash));
+    BOOST_CHECK(keystore.MightBeMine(scriptWatch));
+    BOOST_CHECK(IsMine(keystore, scriptPubKey) == ISMINE_SPENDABLE);
+}
+
+BOOST_AUTO_TEST_CASE(decrypt_keys_ahead)
+{
+    CCryptoKeyStoreTester keystore;
+    std::vector<CKey> vKeys(40);
+    std::set<CKeyID> setKeyIDs;
+    for (CKey &key : vKeys)
+    {
+        key.MakeNewKey(true);
+        BOOST_CHECK(keystore.AddKey(key));
+        setKeyIDs.insert(key.GetPubKey().GetID());
+    }
+    CKeyingMaterial vMasterKey(WALLET_CRYPTO_KEY_SIZE);
+    GetRandBytes(&vMasterKey[0], WALLET_CRYPTO_KEY_SIZE);
+    BOOST_CHECK(keystore.EncryptKeys(vMasterKey));
+    BOOST_CHECK(!keystore.DecryptKeysAhead(setKeyIDs));
+
+    // the first unlock checks all the keys
+    CKeyingMaterial vWrongKey(vMasterKey);
+    vWrongKey[0] ^= 1;
+    BOOST_CHECK(!keystore.Unlock(vWrongKey));
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+
+    {
+        CDecryptedKeysScope decryptedKeys(&keystore, setKeyIDs);
+        for (const CKey &key : vKeys)
+        {
+            CKey keyOut;
+            BOOST_CHECK(keystore.GetKey(key.GetPubKey().GetID(), keyOut));
+            BOOST_CHECK(keyOut == key);
+        }
+        // locking drops them right away
+        BOOST_CHECK(keystore.Lock());
+        CKey keyOut;
+        BOOST_CHECK(!keystore.GetKey(vKeys[0].GetPubKey().GetID(), keyOut));
+    }
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+    CKey keyOut;
+    BOOST_CHECK(keystore.GetKey(vKeys[0].GetPubKey().GetID(), keyOut));
+    BOOST_CHECK(keyOut == vKeys[0]);
+}
+
+BOOST_AUTO_TEST_CASE(generate_new_keys)
+{
+    CWallet keyWallet;
+    LOCK(keyWallet.cs_wallet);
+    std::vector<CPubKey> vPubKeys = keyWallet.GenerateNewKeys(100);
+    BOOST_CHECK_EQUAL(vPubKeys.size(), 100U);
+    std::set<CKeyID> setKeyIDs;
+    for (const CPubKey &pubkey : vPubKeys)
+    {
+        BOOST_CHECK(pubkey.IsFullyValid());
+        BOOST_CHECK(keyWallet.HaveKey(pubkey.GetID()));
+        BOOST_CHECK(keyWallet.mapKeyMetadata.count(pubkey.GetID()));
+        setKeyIDs.insert(pubkey.GetID());
+    }
+    BOOST_CHECK_EQUAL(setKeyIDs.size(), 100U);
+
+    keyWallet.GenerateNewKey();
+    std::set<CKeyID> setAll;
+    keyWallet.GetKeys(setAll);
+    BOOST_CHECK_EQUAL(setAll.size(), 101U);
+}
+
+BOOST_AUTO_TEST_CASE(write_batch)
+{
+    bitdb.MakeMock();
+    {
+        CWalletDB("wallet_batch_test.dat", "cr+");
+        CWallet batchWallet("wallet_batch_test.dat");
+        LOCK(batchWallet.cs_wallet);
+        {
+            CWalletBatch batch(&batchWallet);
+            BOOST_CHECK(batchWallet.TopUpKeyPool(100));
+            // a nested batch joins the outer one
+            CWalletBatch inner(&batchWallet);
+            BOOST_CHECK(batchWallet.TopUpKeyPool(150));
+        }
+        BOOST_CHECK_EQUAL(batchWallet.GetKeyPoolSize(), 151U);
+
+        // committed, so visible through another handle
+        CKeyPool keypool;
+        BOOST_CHECK(CWalletDB("wallet_batch_test.dat").ReadPool(151, keypool));
+        BOOST_CHECK(batchWallet.HaveKey(keypool.vchPubKey.GetID()));
+    }
+    bitdb.Flush(true);
+    bitdb.Reset();
+}
+
+BOOST_AUTO_TEST_CASE(load_wallet_txs)
+{
+    bitdb.MakeMock();
+    {
+        CWalletDB walletdb("wallet_load_test.dat", "cr+");
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        for (int i = 0; i < 1000; i++)
+        {
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            CWalletTx wtx(nullptr, MakeTransactionRef(tx));
+            wtx.nOrderPos = i;
+            BOOST_CHECK(walletdb.WriteTx(tx.GetHash(), wtx));
+        }
+    }
+    {
+        // the records are decoded on several threads and added in the order they were read
+        CWallet loadWallet("wallet_load_test.dat");
+        bool fFirstRun = true;
+        BOOST_CHECK_EQUAL(loadWallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        LOCK(loadWallet.cs_wallet);
+        BOOST_CHECK_EQUAL(loadWallet.mapWallet.size(), 1000U);
+        BOOST_CHECK_EQUAL(loadWallet.wtxOrdered.size(), 1000U);
+        int64_t nOrderPos = 0;
+        for (const std::pair<const int64_t, CWalletTx *> &item : loadWallet.wtxOrdered)
+        {
+            BOOST_CHECK_EQUAL(item.first, nOrderPos++);
+            BOOST_CHECK(loadWallet.mapWallet.count(item.second->tx->GetHash()));
+        }
+    }
+    bitdb.Flush(true);
+    bitdb.Reset();
+}
+
+BOOST_AUTO_TEST_CASE(rescan_state)
+{
+    CWallet scanWallet;
+    CBlockIndex *pindexGenesis = nullptr;
+    {
+        LOCK(cs_main);
+        pindexGenesis = pnetMan->getChainActive()->chainActive.Genesis();
+    }
+    BOOST_CHECK(!scanWallet.IsScanning());
+    BOOST_CHECK_EQUAL(scanWallet.ScanForWalletTransactions(pindexGenesis, true), 0);
+    BOOST_CHECK(!scanWallet.IsScanning());
+    BOOST_CHECK_EQUAL(scanWallet.GetScanProgress(), 1.0);
+
+    // an abort requested before the scan does not stop the next one
+    scanWallet.AbortRescan();
+    BOOST_CHECK_EQUAL(scanWallet.ScanForWalletTransactions(pindexGenesis, true), 0);
+    BOOST_CHECK(!scanWallet.IsScanning());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
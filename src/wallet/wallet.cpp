@@ -25,14 +25,17 @@
 #include "chain/chain.h"
 #include "chain/checkpoints.h"
 #include "chain/tx.h"
+#include "checkqueue.h"
 #include "coins.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
 #include "init.h"
 #include "kernel.h"
 #include "key.h"
 #include "keystore.h"
 #include "main.h"
+#include "memusage.h"
 #include "net/net.h"
 #include "policy/policy.h"
 #include "script/script.h"
@@ -44,6 +47,8 @@
 #include "util/utilmoneystr.h"
 
 #include <assert.h>
+#include <atomic>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -110,31 +115,86 @@ CPubKey CWallet::GenerateNewKey()
     CKey secret;
     secret.MakeNewKey(fCompressed);
 
-    // Compressed public keys were introduced in version 0.6.0
-    if (fCompressed)
-        SetMinVersion(FEATURE_COMPRPUBKEY);
-
     CPubKey pubkey = secret.GetPubKey();
     assert(secret.VerifyPubKey(pubkey));
 
+    AddNewKey(secret, pubkey, nullptr);
+    return pubkey;
+}
+
+/** Minimum number of keys per generating thread, below this starting a thread costs more than it saves */
+static const size_t MIN_NEW_KEYS_PER_THREAD = 16;
+
+std::vector<CPubKey> CWallet::GenerateNewKeys(size_t nKeys)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY);
+    // the master key is only needed, and copied, once for all the keys
+    const CKeyingMaterial vMasterKeyCopy = IsCrypted() ? GetMasterKey() : CKeyingMaterial();
+    if (IsCrypted() && vMasterKeyCopy.empty())
+        throw std::runtime_error("CWallet::GenerateNewKeys(): wallet is locked");
+
+    std::vector<CKey> vSecrets(nKeys);
+    std::vector<CPubKey> vPubKeys(nKeys);
+    std::vector<std::vector<unsigned char> > vCryptedSecrets(IsCrypted() ? nKeys : 0);
+    std::atomic<size_t> nNextKey(0);
+    std::atomic<bool> fEncryptFailed(false);
+    auto generate = [&]() {
+        size_t i;
+        while ((i = nNextKey++) < nKeys)
+        {
+            vSecrets[i].MakeNewKey(fCompressed);
+            vPubKeys[i] = vSecrets[i].GetPubKey();
+            assert(vSecrets[i].VerifyPubKey(vPubKeys[i]));
+            if (!vCryptedSecrets.empty() &&
+                !EncryptNewKey(vMasterKeyCopy, vSecrets[i], vPubKeys[i], vCryptedSecrets[i]))
+                fEncryptFailed = true;
+        }
+    };
+    size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), nKeys / MIN_NEW_KEYS_PER_THREAD);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; i++)
+        vThreads.emplace_back(generate);
+    generate();
+    for (std::thread &thread : vThreads)
+        thread.join();
+    if (fEncryptFailed)
+        throw std::runtime_error("CWallet::GenerateNewKeys(): encrypting a key failed");
+
+    for (size_t i = 0; i < nKeys; i++)
+    {
+        AddNewKey(vSecrets[i], vPubKeys[i], vCryptedSecrets.empty() ? nullptr : &vCryptedSecrets[i]);
+    }
+    return vPubKeys;
+}
+
+void CWallet::AddNewKey(const CKey &secret, const CPubKey &pubkey, const std::vector<unsigned char> *pvchCryptedSecret)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    // Compressed public keys were introduced in version 0.6.0
+    if (pubkey.IsCompressed())
+        SetMinVersion(FEATURE_COMPRPUBKEY);
+
     // Create new metadata
     int64_t nCreationTime = GetTime();
     mapKeyMetadata[pubkey.GetID()] = CKeyMetadata(nCreationTime);
     if (!nTimeFirstKey || nCreationTime < nTimeFirstKey)
         nTimeFirstKey = nCreationTime;
 
-    if (!AddKeyPubKey(secret, pubkey))
-        throw std::runtime_error("CWallet::GenerateNewKey(): AddKey failed");
-    return pubkey;
+    if (pvchCryptedSecret)
+    {
+        if (!AddCryptedKey(pubkey, *pvchCryptedSecret))
+            throw std::runtime_error("CWallet::AddNewKey(): AddCryptedKey failed");
+        RemoveWatchOnlyOf(pubkey);
+    }
+    else if (!AddKeyPubKey(secret, pubkey))
+    {
+        throw std::runtime_error("CWallet::AddNewKey(): AddKey failed");
+    }
 }
 
-bool CWallet::AddKeyPubKey(const CKey &secret, const CPubKey &pubkey)
+void CWallet::RemoveWatchOnlyOf(const CPubKey &pubkey)
 {
-    AssertLockHeld(cs_wallet); // mapKeyMetadata
-    if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
-        return false;
-
-    // check if we need to remove from watch-only
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script))
@@ -142,12 +202,22 @@ bool CWallet::AddKeyPubKey(const CKey &secret, const CPubKey &pubkey)
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script))
         RemoveWatchOnly(script);
+}
+
+bool CWallet::AddKeyPubKey(const CKey &secret, const CPubKey &pubkey)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
+        return false;
+
+    // check if we need to remove from watch-only
+    RemoveWatchOnlyOf(pubkey);
 
     if (!fFileBacked)
         return true;
     if (!IsCrypted())
     {
-        return CWalletDB(strWalletFile).WriteKey(pubkey, secret.GetPrivKey(), mapKeyMetadata[pubkey.GetID()]);
+        return WalletDB()->WriteKey(pubkey, secret.GetPrivKey(), mapKeyMetadata[pubkey.GetID()]);
     }
     return true;
 }
@@ -163,8 +233,7 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned
         if (pwalletdbEncryption)
             return pwalletdbEncryption->WriteCryptedKey(vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
         else
-            return CWalletDB(strWalletFile)
-                .WriteCryptedKey(vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
+            return WalletDB()->WriteCryptedKey(vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
     }
     return false;
 }
@@ -190,7 +259,7 @@ bool CWallet::AddCScript(const CScript &redeemScript)
         return false;
     if (!fFileBacked)
         return true;
-    return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
+    return WalletDB()->WriteCScript(Hash160(redeemScript), redeemScript);
 }
 
 bool CWallet::LoadCScript(const CScript &redeemScript)
@@ -218,7 +287,7 @@ bool CWallet::AddWatchOnly(const CScript &dest)
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
         return true;
-    return CWalletDB(strWalletFile).WriteWatchOnly(dest);
+    return WalletDB()->WriteWatchOnly(dest);
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
@@ -229,7 +298,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
-        if (!CWalletDB(strWalletFile).EraseWatchOnly(dest))
+        if (!WalletDB()->EraseWatchOnly(dest))
             return false;
 
     return true;
@@ -302,7 +371,7 @@ bool CWallet::ChangeWalletPassphrase(const SecureString &strOldWalletPassphrase,
                     return false;
                 if (!crypter.Encrypt(_vMasterKey, pMasterKey.second.vchCryptedKey))
                     return false;
-                CWalletDB(strWalletFile).WriteMasterKey(pMasterKey.first, pMasterKey.second);
+                WalletDB()->WriteMasterKey(pMasterKey.first, pMasterKey.second);
                 if (fWasLocked)
                     Lock();
                 return true;
@@ -313,10 +382,60 @@ bool CWallet::ChangeWalletPassphrase(const SecureString &strOldWalletPassphrase,
     return false;
 }
 
-void CWallet::SetBestChain(const CBlockLocator &loc)
+CWalletDBHandle CWallet::WalletDB(bool fFlushOnClose) const
 {
-    CWalletDB walletdb(strWalletFile);
-    walletdb.WriteBestBlock(loc);
+    return CWalletDBHandle(
+        batchOwner.load() == std::this_thread::get_id() ? pwalletdbBatch : nullptr, strWalletFile, fFlushOnClose);
+}
+
+CWalletBatch::CWalletBatch(CWallet *pwalletIn) : pwallet(pwalletIn)
+{
+    if (!pwallet || !pwallet->fFileBacked)
+    {
+        pwallet = nullptr;
+        return;
+    }
+    AssertLockHeld(pwallet->cs_wallet);
+    if (pwallet->nBatchDepth++ > 0)
+        return;
+    // the handle does not flush on close, the flush thread checkpoints the log after the commit
+    CWalletDB *pwalletdb = new CWalletDB(pwallet->strWalletFile, "r+", false);
+    if (!pwalletdb->TxnBegin())
+    {
+        LogPrintf("%s: could not begin a database transaction, writing unbatched\n", __func__);
+        delete pwalletdb;
+        return;
+    }
+    pwallet->pwalletdbBatch = pwalletdb;
+    pwallet->batchOwner = std::this_thread::get_id();
+}
+
+CWalletBatch::~CWalletBatch()
+{
+    if (!pwallet || --pwallet->nBatchDepth > 0 || !pwallet->pwalletdbBatch)
+        return;
+    pwallet->batchOwner = std::thread::id();
+    if (!pwallet->pwalletdbBatch->TxnCommit())
+        LogPrintf("%s: committing the wallet database transaction failed\n", __func__);
+    delete pwallet->pwalletdbBatch;
+    pwallet->pwalletdbBatch = nullptr;
+    nWalletDBUpdated++;
+}
+
+void CWallet::SetBestChain(const CBlockLocator &loc) { WalletDB()->WriteBestBlock(loc); }
+
+size_t CWallet::DynamicMemoryUsage() const
+{
+    LOCK(cs_wallet);
+    size_t nUsage = memusage::DynamicUsage(mapWallet) + memusage::DynamicUsage(wtxOrdered) +
+                    memusage::DynamicUsage(mapTxSpends) + memusage::DynamicUsage(mapKeyMetadata) +
+                    memusage::DynamicUsage(mapAddressBook) + memusage::DynamicUsage(setKeyPool);
+    for (const auto &item : mapWallet)
+    {
+        nUsage += RecursiveDynamicUsage(item.second.tx) + memusage::DynamicUsage(item.second.mapValue) +
+                  memusage::DynamicUsage(item.second.vOrderForm);
+    }
+    return nUsage;
 }
 
 bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB *pwalletdbIn, bool fExplicit)
@@ -336,11 +455,13 @@ bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB *pwalletdbIn,
 
     if (fFileBacked)
     {
-        CWalletDB *pwalletdb = pwalletdbIn ? pwalletdbIn : new CWalletDB(strWalletFile);
         if (nWalletVersion > 40000)
-            pwalletdb->WriteMinVersion(nWalletVersion);
-        if (!pwalletdbIn)
-            delete pwalletdb;
+        {
+            if (pwalletdbIn)
+                pwalletdbIn->WriteMinVersion(nWalletVersion);
+            else
+                WalletDB()->WriteMinVersion(nWalletVersion);
+        }
     }
 
     return true;
@@ -500,6 +621,10 @@ bool CWallet::IsSpent(const uint256 &hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint &outpoint, const uint256 &wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
+    // the credit of the spent transaction changed
+    std::map<uint256, CWalletTx>::iterator itPrev = mapWallet.find(outpoint.hash);
+    if (itPrev != mapWallet.end())
+        itPrev->second.MarkDirty();
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -627,7 +752,7 @@ int64_t CWallet::IncOrderPosNext(CWalletDB *pwalletdb)
     }
     else
     {
-        CWalletDB(strWalletFile).WriteOrderPosNext(nOrderPosNext);
+        WalletDB()->WriteOrderPosNext(nOrderPosNext);
     }
     return nRet;
 }
@@ -636,6 +761,9 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
+        fBalancesRebuild = true;
+        fUnspentRebuild = true;
+        fTxHeightRebuild = true;
         for (std::pair<const uint256, CWalletTx> &item : mapWallet)
         {
             item.second.MarkDirty();
@@ -661,7 +789,7 @@ bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFromLoadWallet, CWalletD
                 CWalletTx &prevtx = mapWallet[txin.prevout.hash];
                 if (prevtx.nIndex == -1 && !prevtx.hashUnset())
                 {
-                    MarkConflicted(prevtx.hashBlock, wtx.tx->GetHash());
+                    vLoadConflicts.emplace_back(prevtx.hashBlock, wtx.tx->GetHash());
                 }
             }
         }
@@ -683,8 +811,8 @@ bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFromLoadWallet, CWalletD
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (!wtxIn.hashUnset())
             {
-                READLOCK(pnetMan->getChainActive()->cs_mapBlockIndex);
-                if (pnetMan->getChainActive()->mapBlockIndex.count(wtxIn.hashBlock))
+                CBlockIndex *pindexBlock = pnetMan->getChainActive()->LookupBlockIndex(wtxIn.hashBlock);
+                if (pindexBlock)
                 {
                     int64_t latestNow = wtx.nTimeReceived;
                     int64_t latestEntry = 0;
@@ -714,7 +842,7 @@ bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFromLoadWallet, CWalletD
                         }
                     }
 
-                    int64_t blocktime = pnetMan->getChainActive()->mapBlockIndex[wtxIn.hashBlock]->GetBlockTime();
+                    int64_t blocktime = pindexBlock->GetBlockTime();
                     wtx.nTimeSmart = std::max(latestEntry, std::min(blocktime, latestNow));
                 }
                 else
@@ -823,8 +951,8 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef &ptx, const CBlock
             // Do not flush the wallet here for performance reasons
             // this is safe, as in case of a crash, we rescan the necessary blocks on startup through our
             // SetBestChain-mechanism
-            CWalletDB walletdb(strWalletFile, "r+", false);
-            return AddToWallet(wtx, false, &walletdb);
+            CWalletDBHandle walletdb = WalletDB(false);
+            return AddToWallet(wtx, false, walletdb.get());
         }
     }
     return false;
@@ -835,7 +963,7 @@ bool CWallet::AbandonTransaction(const uint256 &hashTx)
     LOCK2(cs_main, cs_wallet);
 
     // Do not flush the wallet here for performance reasons
-    CWalletDB walletdb(strWalletFile, "r+", false);
+    CWalletDBHandle walletdb = WalletDB(false);
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -868,7 +996,7 @@ bool CWallet::AbandonTransaction(const uint256 &hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
-            wtx.WriteToDisk(&walletdb);
+            wtx.WriteToDisk(walletdb.get());
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(hashTx, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now)
@@ -913,7 +1041,7 @@ void CWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx)
         return;
 
     // Do not flush the wallet here for performance reasons
-    CWalletDB walletdb(strWalletFile, "r+", false);
+    CWalletDBHandle walletdb = WalletDB(false);
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -935,7 +1063,7 @@ void CWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
-            wtx.WriteToDisk(&walletdb);
+            wtx.WriteToDisk(walletdb.get());
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now)
@@ -960,22 +1088,61 @@ void CWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx)
 void CWallet::SyncTransaction(const CTransactionRef &ptx, const CBlock *pblock, int txIdx)
 {
     LOCK2(cs_main, cs_wallet);
+    SyncTransactionLocked(ptx, pblock);
+}
 
+void CWallet::SyncTransactionLocked(const CTransactionRef &ptx, const CBlock *pblock)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
     if (!AddToWalletIfInvolvingMe(ptx, pblock, true))
     {
         return; // Not one of ours
     }
 
+    // The tx may have moved to another block, and the coins it spends can no longer be
+    // staked, so drop their stake kernel sources. Unspent outputs get theirs back on the
+    // next staking attempt
+    mapStakeKernelSources.erase(ptx->GetHash());
+
     // If a transaction changes 'conflicted' state, that changes the balance
     // available of the outputs it spends. So force those to be
     // recomputed, also:
     for (const CTxIn &txin : ptx->vin)
     {
+        mapStakeKernelSources.erase(txin.prevout.hash);
         if (mapWallet.count(txin.prevout.hash))
             mapWallet[txin.prevout.hash].MarkDirty();
     }
 }
 
+bool CWallet::TouchesWallet(const CTransaction &tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (mapWallet.count(tx.GetHash()))
+        return true;
+    for (const CTxIn &txin : tx.vin)
+    {
+        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout))
+            return true;
+    }
+    return false;
+}
+
+void CWallet::SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock)
+{
+    LOCK2(cs_main, cs_wallet);
+    CWalletBatch batch(this);
+    for (size_t i = 0; i < vtx.size(); i++)
+    {
+        // in order, a transaction can spend from one added before it in the same block
+        if (TouchesWallet(*vtx[i]) || IsMine(*vtx[i]))
+        {
+            SyncTransactionLocked(vtx[i], pblock);
+        }
+    }
+}
+
 isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
@@ -1231,6 +1398,20 @@ void CWalletTx::GetAmounts(CAmount &nReceived, CAmount &nSent, CAmount &nFee, co
 
 
 bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb) { return pwalletdb->WriteTx(tx->GetHash(), *this); }
+/** Blocks a rescan reads ahead of the transactions it adds to the wallet */
+static const size_t RESCAN_BATCH_BLOCKS = 128;
+
+namespace
+{
+/** A block of a rescan and which of its transactions pay to the wallet */
+struct CRescanBlock
+{
+    CBlock block;
+    bool fRead = false;
+    std::vector<bool> vPaysToMe;
+};
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1238,9 +1419,23 @@ bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb) { return pwalletdb->WriteTx(tx
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart, bool fUpdate)
 {
+    bool fExpected = false;
+    if (!fScanningWallet.compare_exchange_strong(fExpected, true))
+    {
+        LogPrintf("%s: a rescan is already running\n", __func__);
+        return 0;
+    }
+    fAbortRescan = false;
+    nScanStartTime = GetTimeMillis();
+    dScanProgress = 0;
+
+    const CNetworkTemplate &chainparams = *pnetMan->getActivePaymentNetwork();
+    CChain &chainActive = pnetMan->getChainActive()->chainActive;
     int ret = 0;
     int64_t nNow = GetTime();
     CBlockIndex *pindex = pindexStart;
+    double dProgressStart = 0;
+    double dProgressTip = 0;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1248,46 +1443,112 @@ int CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart, bool fUpdate)
         // our wallet birthday (as adjusted for block time variability)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
         {
-            pindex = pnetMan->getChainActive()->chainActive.Next(pindex);
+            pindex = chainActive.Next(pindex);
+        }
+
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainparams.Checkpoints(), pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainparams.Checkpoints(), chainActive.Tip(), false);
+    }
+
+    // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    ShowProgress(("Rescanning..."), 0);
+    const size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), RESCAN_BATCH_BLOCKS);
+    std::vector<CBlockIndex *> vBatch;
+    while (pindex)
+    {
+        if (fAbortRescan.load() || shutdown_threads.load())
+        {
+            LogPrintf("Rescan aborted at block %d\n", pindex->nHeight);
+            break;
         }
 
-        // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        ShowProgress(("Rescanning..."), 0);
-        double dProgressStart =
-            Checkpoints::GuessVerificationProgress(pnetMan->getActivePaymentNetwork()->Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(
-            pnetMan->getActivePaymentNetwork()->Checkpoints(), pnetMan->getChainActive()->chainActive.Tip(), false);
-        while (pindex)
+        // the next blocks of the active chain, resume from the fork if a reorganization went past pindex
+        vBatch.clear();
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+            LOCK(cs_main);
+            if (!chainActive.Contains(pindex))
             {
-                ShowProgress(("Rescanning..."),
-                    std::max(1, std::min(
-                                    99, (int)((Checkpoints::GuessVerificationProgress(
-                                                   pnetMan->getActivePaymentNetwork()->Checkpoints(), pindex, false) -
-                                                  dProgressStart) /
-                                              (dProgressTip - dProgressStart) * 100))));
+                const CBlockIndex *pindexFork = chainActive.FindFork(pindex);
+                pindex = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
             }
+            while (pindex && vBatch.size() < RESCAN_BATCH_BLOCKS)
+            {
+                vBatch.push_back(pindex);
+                pindex = chainActive.Next(pindex);
+            }
+        }
+        if (vBatch.empty())
+            break;
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex, pnetMan->getActivePaymentNetwork()->GetConsensus());
-            for (auto &ptx : block.vtx)
+        // read the blocks and match their outputs against the keystore, which takes its own lock
+        std::vector<CRescanBlock> vBlocks(vBatch.size());
+        std::atomic<size_t> nNextBlock(0);
+        auto read = [&]() {
+            size_t i;
+            while ((i = nNextBlock++) < vBatch.size())
             {
-                if (AddToWalletIfInvolvingMe(ptx, &block, fUpdate))
+                CRescanBlock &scanned = vBlocks[i];
+                scanned.fRead = ReadBlockFromDisk(scanned.block, vBatch[i], chainparams.GetConsensus());
+                scanned.vPaysToMe.assign(scanned.block.vtx.size(), false);
+                for (size_t j = 0; j < scanned.block.vtx.size(); j++)
                 {
-                    ret++;
+                    for (const CTxOut &txout : scanned.block.vtx[j]->vout)
+                    {
+                        if (IsMine(txout) != ISMINE_NO)
+                        {
+                            scanned.vPaysToMe[j] = true;
+                            break;
+                        }
+                    }
                 }
             }
-            pindex = pnetMan->getChainActive()->chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60)
+        };
+        std::vector<std::thread> vThreads;
+        for (size_t i = 1; i < std::min(nThreads, vBatch.size()); i++)
+            vThreads.emplace_back(read);
+        read();
+        for (std::thread &thread : vThreads)
+            thread.join();
+
+        // add the matches in chain order. A transaction that pays nothing to us can still spend from or conflict
+        // with the wallet, which depends on what the earlier blocks added
+        {
+            LOCK2(cs_main, cs_wallet);
+            CWalletBatch batch(this);
+            for (size_t i = 0; i < vBatch.size(); i++)
             {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight,
-                    Checkpoints::GuessVerificationProgress(pnetMan->getActivePaymentNetwork()->Checkpoints(), pindex));
+                // a block disconnected meanwhile reached the wallet through SyncTransaction
+                if (!vBlocks[i].fRead || !chainActive.Contains(vBatch[i]))
+                    continue;
+                const CBlock &block = vBlocks[i].block;
+                for (size_t j = 0; j < block.vtx.size(); j++)
+                {
+                    const CTransactionRef &ptx = block.vtx[j];
+                    const bool fRelevant = vBlocks[i].vPaysToMe[j] || TouchesWallet(*ptx);
+                    if (fRelevant && AddToWalletIfInvolvingMe(ptx, &block, fUpdate))
+                    {
+                        ret++;
+                    }
+                }
             }
         }
-        ShowProgress(("Rescanning..."), 100); // hide progress dialog in GUI
+
+        CBlockIndex *pindexLast = vBatch.back();
+        double dProgress = Checkpoints::GuessVerificationProgress(chainparams.Checkpoints(), pindexLast, false);
+        if (dProgressTip - dProgressStart > 0.0)
+        {
+            dScanProgress = std::max(0.0, std::min(1.0, (dProgress - dProgressStart) / (dProgressTip - dProgressStart)));
+            ShowProgress(("Rescanning..."), std::max(1, std::min(99, (int)(dScanProgress * 100))));
+        }
+        if (GetTime() >= nNow + 60)
+        {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexLast->nHeight, dProgress);
+        }
     }
+    ShowProgress(("Rescanning..."), 100); // hide progress dialog in GUI
+    dScanProgress = 1;
+    fScanningWallet = false;
     return ret;
 }
 
@@ -1301,13 +1562,11 @@ void CWallet::ReacceptWalletTransactions()
 
     {
         LOCK2(cs_main, cs_wallet);
-        // Sort pending wallet transactions based on their initial wallet insertion order
-        for (auto const &item : mapWallet)
+        // Sort pending wallet transactions based on their initial wallet insertion order, only the ones no block of
+        // the active chain confirms can be pending
+        for (const CWalletTx *pwtx : GetTransactionsSince(pnetMan->getChainActive()->chainActive.Height()))
         {
-            const uint256 &wtxid = item.first;
-            CWalletTx wtx = item.second;
-            assert(wtx.tx->GetHash() == wtxid);
-
+            CWalletTx &wtx = mapWallet.at(pwtx->tx->GetHash());
             int nDepth = wtx.GetDepthInMainChain();
 
             if (!wtx.tx->IsCoinBase() && !wtx.tx->IsCoinStake() && (nDepth == 0 && !wtx.isAbandoned()))
@@ -1358,6 +1617,20 @@ std::set<uint256> CWalletTx::GetConflicts() const
     return result;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet && tx)
+        pwallet->MarkTxDirty(tx->GetHash());
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter &filter) const
 {
     if (tx->vin.empty())
@@ -1585,22 +1858,31 @@ std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime, CCon
 {
     std::vector<uint256> result;
 
-    std::multimap<unsigned int, CWalletTx> mapSorted;
+    LOCK2(cs_main, cs_wallet);
+    // only the transactions no block of the active chain confirms are relayed, mapTxByHeight has them under -1
+    UpdateTxHeights();
+    std::map<int, std::set<uint256> >::const_iterator it = mapTxByHeight.find(-1);
+    if (it == mapTxByHeight.end())
+        return result;
+
+    // Sort them in chronological order
+    std::vector<std::pair<unsigned int, CWalletTx *> > vSorted;
+    vSorted.reserve(it->second.size());
+    for (const uint256 &hash : it->second)
     {
-        LOCK(cs_wallet);
-        // Sort them in chronological order
-        for (auto &item : mapWallet)
-        {
-            CWalletTx &wtx = item.second;
-            // Don't rebroadcast if newer than nTime:
-            if (wtx.nTimeReceived > nTime)
-                continue;
-            mapSorted.insert(std::make_pair(wtx.nTimeReceived, wtx));
-        }
+        CWalletTx &wtx = mapWallet.at(hash);
+        // Don't rebroadcast if newer than nTime:
+        if (wtx.nTimeReceived > nTime)
+            continue;
+        vSorted.emplace_back(wtx.nTimeReceived, &wtx);
     }
-    for (auto &item : mapSorted)
+    std::stable_sort(vSorted.begin(), vSorted.end(),
+        [](const std::pair<unsigned int, CWalletTx *> &a, const std::pair<unsigned int, CWalletTx *> &b) {
+            return a.first < b.first;
+        });
+    for (const std::pair<unsigned int, CWalletTx *> &item : vSorted)
     {
-        CWalletTx &wtx = item.second;
+        CWalletTx &wtx = *item.second;
         if (wtx.RelayWalletTransaction(connman))
             result.push_back(wtx.tx->GetHash());
     }
@@ -1614,7 +1896,7 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman *connman
     if (GetTime() < nNextResend || !fBroadcastTransactions)
         return;
     bool fFirst = (nNextResend == 0);
-    nNextResend = GetTime() + GetRand(30 * 60);
+    nNextResend = GetTime() + GetFastRand(30 * 60);
     if (fFirst)
         return;
 
@@ -1639,94 +1921,267 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman *connman
  */
 
 
-CAmount CWallet::GetBalance() const
+CWalletBalances &CWalletBalances::operator+=(const CWalletBalances &other)
+{
+    nTrusted += other.nTrusted;
+    nUnconfirmed += other.nUnconfirmed;
+    nImmature += other.nImmature;
+    nWatchTrusted += other.nWatchTrusted;
+    nWatchUnconfirmed += other.nWatchUnconfirmed;
+    nWatchImmature += other.nWatchImmature;
+    nStake += other.nStake;
+    nNewMint += other.nNewMint;
+    return *this;
+}
+
+CWalletBalances &CWalletBalances::operator-=(const CWalletBalances &other)
+{
+    nTrusted -= other.nTrusted;
+    nUnconfirmed -= other.nUnconfirmed;
+    nImmature -= other.nImmature;
+    nWatchTrusted -= other.nWatchTrusted;
+    nWatchUnconfirmed -= other.nWatchUnconfirmed;
+    nWatchImmature -= other.nWatchImmature;
+    nStake -= other.nStake;
+    nNewMint -= other.nNewMint;
+    return *this;
+}
+
+bool CWalletBalances::IsNull() const
+{
+    return nTrusted == 0 && nUnconfirmed == 0 && nImmature == 0 && nWatchTrusted == 0 && nWatchUnconfirmed == 0 &&
+           nWatchImmature == 0 && nStake == 0 && nNewMint == 0;
+}
+
+void CWallet::MarkTxDirty(const uint256 &hash) const
+{
+    LOCK(cs_wallet);
+    if (!fBalancesRebuild)
+        setBalancesDirty.insert(hash);
+    if (!fUnspentRebuild)
+        setUnspentDirty.insert(hash);
+    if (!fTxHeightRebuild)
+        setTxHeightDirty.insert(hash);
+}
+
+CWalletBalances CWallet::GetBalancesOf(const CWalletTx &wtx, bool &fVolatile) const
 {
-    CAmount nTotal = 0;
+    CWalletBalances balances;
+    const int nDepth = wtx.GetDepthInMainChain();
+    if (wtx.IsTrusted())
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx *pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+        balances.nTrusted = wtx.GetAvailableCredit();
+        balances.nWatchTrusted = wtx.GetAvailableWatchOnlyCredit();
     }
-
-    return nTotal;
+    else if (nDepth == 0 && wtx.InMempool())
+    {
+        balances.nUnconfirmed = wtx.GetAvailableCredit();
+        balances.nWatchUnconfirmed = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = wtx.GetImmatureCredit();
+    balances.nWatchImmature = wtx.GetImmatureWatchOnlyCredit();
+    const int nBlocksToMaturity = wtx.GetBlocksToMaturity();
+    if (nBlocksToMaturity > 0 && nDepth > 0)
+    {
+        if (wtx.tx->IsCoinStake())
+            balances.nStake = CWallet::GetCredit(*(wtx.tx), ISMINE_ALL);
+        else if (wtx.tx->IsCoinBase())
+            balances.nNewMint = CWallet::GetCredit(*(wtx.tx), ISMINE_ALL);
+    }
+    // abandoned and conflicted transactions only change when the wallet or a reorganization touches them
+    fVolatile = (nDepth == 0 && !wtx.isAbandoned()) || (nDepth > 0 && nBlocksToMaturity > 0);
+    return balances;
 }
 
-CAmount CWallet::GetUnconfirmedBalance() const
+void CWallet::UpdateBalancesOf(const uint256 &hash) const
 {
-    CAmount nTotal = 0;
+    std::map<uint256, CWalletBalances>::iterator itStable = mapBalancesStable.find(hash);
+    if (itStable != mapBalancesStable.end())
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx *pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+        balancesStable -= itStable->second;
+        mapBalancesStable.erase(itStable);
+    }
+    setBalancesVolatile.erase(hash);
+
+    std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+    if (it == mapWallet.end())
+        return;
+    bool fVolatile = false;
+    CWalletBalances balances = GetBalancesOf(it->second, fVolatile);
+    if (fVolatile)
+    {
+        setBalancesVolatile.insert(hash);
+    }
+    else if (!balances.IsNull())
+    {
+        balancesStable += balances;
+        mapBalancesStable.emplace(hash, balances);
     }
-    return nTotal;
 }
 
-CAmount CWallet::GetImmatureBalance() const
+CWalletBalances CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
+    LOCK2(cs_main, cs_wallet);
+    // a transaction that is confirmed below the tip of the last call stays confirmed unless that tip was disconnected
+    const CChain &chainActive = pnetMan->getChainActive()->chainActive;
+    if (pindexBalances && !chainActive.Contains(pindexBalances))
+        fBalancesRebuild = true;
+    pindexBalances = chainActive.Tip();
+
+    if (fBalancesRebuild)
+    {
+        balancesStable = CWalletBalances();
+        mapBalancesStable.clear();
+        setBalancesVolatile.clear();
+        setBalancesDirty.clear();
+        fBalancesRebuild = false;
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet)
+            UpdateBalancesOf(item.first);
+    }
+    else
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx *pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
+        std::set<uint256> setDirty;
+        setDirty.swap(setBalancesDirty);
+        for (const uint256 &hash : setDirty)
+            UpdateBalancesOf(hash);
+    }
+
+    CWalletBalances balances = balancesStable;
+    std::vector<uint256> vSettled;
+    for (const uint256 &hash : setBalancesVolatile)
+    {
+        std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        bool fVolatile = false;
+        if (it != mapWallet.end())
+            balances += GetBalancesOf(it->second, fVolatile);
+        if (!fVolatile)
+            vSettled.push_back(hash);
     }
-    return nTotal;
+    // matured or confirmed deep enough, from now on they are part of balancesStable
+    for (const uint256 &hash : vSettled)
+        UpdateBalancesOf(hash);
+    return balances;
 }
 
-CAmount CWallet::GetWatchOnlyBalance() const
+CAmount CWallet::GetBalance() const { return GetBalances().nTrusted; }
+CAmount CWallet::GetUnconfirmedBalance() const { return GetBalances().nUnconfirmed; }
+CAmount CWallet::GetImmatureBalance() const { return GetBalances().nImmature; }
+CAmount CWallet::GetWatchOnlyBalance() const { return GetBalances().nWatchTrusted; }
+CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const { return GetBalances().nWatchUnconfirmed; }
+CAmount CWallet::GetImmatureWatchOnlyBalance() const { return GetBalances().nWatchImmature; }
+void CWallet::UpdateUnspentOf(const uint256 &hash) const
 {
-    CAmount nTotal = 0;
+    std::set<COutPoint>::iterator it = setUnspent.lower_bound(COutPoint(hash, 0));
+    while (it != setUnspent.end() && it->hash == hash)
+        it = setUnspent.erase(it);
+
+    std::map<uint256, CWalletTx>::const_iterator itTx = mapWallet.find(hash);
+    if (itTx == mapWallet.end())
+        return;
+    const CTransaction &tx = *(itTx->second.tx);
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx *pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
+        if (IsMine(tx.vout[i]) != ISMINE_NO && !IsSpent(hash, i))
+            it = setUnspent.emplace_hint(it, hash, i);
     }
+}
 
-    return nTotal;
+void CWallet::UpdateUnspent() const
+{
+    AssertLockHeld(cs_wallet);
+    // an output spent by a transaction that a reorganization conflicted is not spent anymore
+    const CChain &chainActive = pnetMan->getChainActive()->chainActive;
+    if (pindexUnspent && !chainActive.Contains(pindexUnspent))
+        fUnspentRebuild = true;
+    pindexUnspent = chainActive.Tip();
+
+    if (fUnspentRebuild)
+    {
+        setUnspent.clear();
+        setUnspentDirty.clear();
+        fUnspentRebuild = false;
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet)
+            UpdateUnspentOf(item.first);
+        return;
+    }
+    std::set<uint256> setDirty;
+    setDirty.swap(setUnspentDirty);
+    for (const uint256 &hash : setDirty)
+        UpdateUnspentOf(hash);
 }
 
-CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
+void CWallet::UpdateTxHeightOf(const uint256 &hash) const
 {
-    CAmount nTotal = 0;
+    std::map<uint256, int>::iterator itHeight = mapTxHeight.find(hash);
+    if (itHeight != mapTxHeight.end())
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx *pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
+        std::map<int, std::set<uint256> >::iterator itBucket = mapTxByHeight.find(itHeight->second);
+        itBucket->second.erase(hash);
+        if (itBucket->second.empty())
+            mapTxByHeight.erase(itBucket);
+        mapTxHeight.erase(itHeight);
     }
-    return nTotal;
+
+    std::map<uint256, CWalletTx>::const_iterator itTx = mapWallet.find(hash);
+    if (itTx == mapWallet.end())
+        return;
+    const CWalletTx &wtx = itTx->second;
+    int nHeight = -1;
+    if (!wtx.hashUnset() && wtx.nIndex != -1)
+    {
+        CBlockIndex *pindex = pnetMan->getChainActive()->LookupBlockIndex(wtx.hashBlock);
+        if (pindex && pnetMan->getChainActive()->chainActive.Contains(pindex))
+            nHeight = pindex->nHeight;
+    }
+    mapTxHeight.emplace(hash, nHeight);
+    mapTxByHeight[nHeight].insert(hash);
 }
 
-CAmount CWallet::GetImmatureWatchOnlyBalance() const
+void CWallet::UpdateTxHeights() const
 {
-    CAmount nTotal = 0;
+    AssertLockHeld(cs_wallet);
+    // a disconnected block does not tell the wallet about the transactions it confirmed
+    const CChain &chainActive = pnetMan->getChainActive()->chainActive;
+    if (pindexTxHeight && !chainActive.Contains(pindexTxHeight))
+        fTxHeightRebuild = true;
+    pindexTxHeight = chainActive.Tip();
+
+    if (fTxHeightRebuild)
+    {
+        mapTxByHeight.clear();
+        mapTxHeight.clear();
+        setTxHeightDirty.clear();
+        fTxHeightRebuild = false;
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet)
+            UpdateTxHeightOf(item.first);
+        return;
+    }
+    std::set<uint256> setDirty;
+    setDirty.swap(setTxHeightDirty);
+    for (const uint256 &hash : setDirty)
+        UpdateTxHeightOf(hash);
+}
+
+std::vector<const CWalletTx *> CWallet::GetTransactionsSince(int nHeight) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    UpdateTxHeights();
+
+    std::vector<const CWalletTx *> vResult;
+    std::map<int, std::set<uint256> >::const_iterator it = mapTxByHeight.upper_bound(std::max(nHeight, -1));
+    for (; it != mapTxByHeight.end(); ++it)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx *pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
+        for (const uint256 &hash : it->second)
+            vResult.push_back(&mapWallet.at(hash));
     }
-    return nTotal;
+    it = mapTxByHeight.find(-1);
+    if (it != mapTxByHeight.end())
+    {
+        for (const uint256 &hash : it->second)
+            vResult.push_back(&mapWallet.at(hash));
+    }
+    return vResult;
 }
 
 void CWallet::AvailableCoins(std::vector<COutput> &vCoins,
@@ -1738,10 +2193,23 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins,
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateUnspent();
+        std::set<COutPoint> setVin;
+        for (const CTxIn &txin : vin)
+            setVin.insert(txin.prevout);
+
+        // the unspent outputs are ordered by transaction, the transaction wide checks are done once for each
+        std::set<COutPoint>::const_iterator it = setUnspent.begin();
+        while (it != setUnspent.end())
         {
-            const uint256 &wtxid = it->first;
-            const CWalletTx *pcoin = &(*it).second;
+            const uint256 wtxid = it->hash;
+            std::set<COutPoint>::const_iterator itEnd = it;
+            while (itEnd != setUnspent.end() && itEnd->hash == wtxid)
+                ++itEnd;
+            std::set<COutPoint>::const_iterator itBegin = it;
+            it = itEnd;
+
+            const CWalletTx *pcoin = &mapWallet.at(wtxid);
 
             if (!CheckFinalTx(*(pcoin->tx)))
                 continue;
@@ -1761,36 +2229,15 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins,
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++)
+            for (std::set<COutPoint>::const_iterator itOut = itBegin; itOut != itEnd; ++itOut)
             {
-                if (vin.empty() == false)
-                {
-                    bool found = false;
-                    bool input = false;
-                    for (const auto &iter : vin)
-                    {
-                        if (iter.prevout.hash == pcoin->tx->GetHash())
-                        {
-                            if (i == iter.prevout.n)
-                            {
-                                input = true;
-                                break;
-                            }
-                            found = true;
-                        }
-                    }
-                    if (found == false && input == false)
-                    {
-                        break;
-                    }
-                    if (found == true && input == false)
-                    {
-                        continue;
-                    }
-                }
+                const unsigned int i = itOut->n;
+                // only the given inputs if there are any
+                if (!setVin.empty() && setVin.count(*itOut) == 0)
+                    continue;
 
                 isminetype mine = IsMine(pcoin->tx->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO && !IsLockedCoin((*it).first, i) &&
+                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO && !IsLockedCoin(wtxid, i) &&
                     (pcoin->tx->vout[i].nValue > 0 || fIncludeZeroValue))
                     vCoins.push_back(COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO));
             }
@@ -1859,31 +2306,8 @@ static void ApproximateBestSubset(std::vector<std::pair<CAmount, std::pair<const
     }
 }
 
-CAmount CWallet::GetStake() const
-{
-    CAmount nTotal = 0;
-    LOCK(cs_wallet);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx *pcoin = &(*it).second;
-        if (pcoin->tx->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*(pcoin->tx), ISMINE_ALL);
-    }
-    return nTotal;
-}
-
-CAmount CWallet::GetNewMint() const
-{
-    CAmount nTotal = 0;
-    LOCK(cs_wallet);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx *pcoin = &(*it).second;
-        if (pcoin->tx->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*(pcoin->tx), ISMINE_ALL);
-    }
-    return nTotal;
-}
+CAmount CWallet::GetStake() const { return GetBalances().nStake; }
+CAmount CWallet::GetNewMint() const { return GetBalances().nNewMint; }
 
 bool CWallet::SelectCoinsMinConf(const CAmount &nTargetValue,
     int nConfMine,
@@ -1982,11 +2406,11 @@ bool CWallet::SelectCoinsMinConf(const CAmount &nTargetValue,
                 nValueRet += vValue[i].first;
             }
 
-        LogPrint("selectcoins", "SelectCoins() best subset: ");
+        LogPrint(Logging::SELECTCOINS, "SelectCoins() best subset: ");
         for (unsigned int i = 0; i < vValue.size(); i++)
             if (vfBest[i])
-                LogPrint("selectcoins", "%s ", FormatMoney(vValue[i].first));
-        LogPrint("selectcoins", "total %s\n", FormatMoney(nBest));
+                LogPrint(Logging::SELECTCOINS, "%s ", FormatMoney(vValue[i].first));
+        LogPrint(Logging::SELECTCOINS, "total %s\n", FormatMoney(nBest));
     }
 
     return true;
@@ -2347,25 +2771,29 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
                 }
 
                 // Sign
-                int nIn = 0;
-                CTransaction txNewConst(txNew);
+                std::vector<CScript> vFromPubKeys;
                 for (auto const &coin : setCoins)
+                    vFromPubKeys.push_back(coin.first->tx->vout[coin.second].scriptPubKey);
+                bool signSuccess = true;
+                if (sign)
                 {
-                    bool signSuccess;
-                    const CScript &scriptPubKey = coin.first->tx->vout[coin.second].scriptPubKey;
-                    CScript &scriptSigRes = txNew.vin[nIn].scriptSig;
-                    if (sign)
-                        signSuccess = ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, SIGHASH_ALL),
-                            scriptPubKey, scriptSigRes);
-                    else
-                        signSuccess = ProduceSignature(DummySignatureCreator(this), scriptPubKey, scriptSigRes);
-
-                    if (!signSuccess)
-                    {
-                        strFailReason = ("Signing transaction failed");
-                        return false;
-                    }
-                    nIn++;
+                    // the inputs are signed on all cores, with their keys decrypted ahead
+                    std::set<CKeyID> setSigningKeyIDs;
+                    for (const CScript &scriptPubKey : vFromPubKeys)
+                        GetSigningKeyIDs(*this, scriptPubKey, setSigningKeyIDs);
+                    CDecryptedKeysScope decryptedKeys(this, setSigningKeyIDs);
+                    signSuccess = SignSignatures(*this, vFromPubKeys, txNew, SIGHASH_ALL);
+                }
+                else
+                {
+                    for (unsigned int nIn = 0; nIn < vFromPubKeys.size() && signSuccess; nIn++)
+                        signSuccess = ProduceSignature(
+                            DummySignatureCreator(this), vFromPubKeys[nIn], txNew.vin[nIn].scriptSig);
+                }
+                if (!signSuccess)
+                {
+                    strFailReason = ("Signing transaction failed");
+                    return false;
                 }
 
                 unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
@@ -2513,6 +2941,13 @@ DBErrors CWallet::LoadWallet(bool &fFirstRunRet)
         return DB_LOAD_OK;
     fFirstRunRet = false;
     DBErrors nLoadWalletRet = CWalletDB(strWalletFile, "cr+").LoadWallet(this);
+    std::vector<std::pair<uint256, uint256> > vConflicts;
+    {
+        LOCK(cs_wallet);
+        vConflicts.swap(vLoadConflicts);
+    }
+    for (const std::pair<uint256, uint256> &conflict : vConflicts)
+        MarkConflicted(conflict.first, conflict.second);
     if (nLoadWalletRet == DB_NEED_REWRITE)
     {
         if (CDB::Rewrite(strWalletFile, "\x04pool"))
@@ -2570,9 +3005,9 @@ bool CWallet::SetAddressBook(const CTxDestination &address, const std::string &s
     }
     if (!fFileBacked)
         return false;
-    if (!strPurpose.empty() && !CWalletDB(strWalletFile).WritePurpose(CBitcoinAddress(address).ToString(), strPurpose))
+    if (!strPurpose.empty() && !WalletDB()->WritePurpose(CBitcoinAddress(address).ToString(), strPurpose))
         return false;
-    return CWalletDB(strWalletFile).WriteName(CBitcoinAddress(address).ToString(), strName);
+    return WalletDB()->WriteName(CBitcoinAddress(address).ToString(), strName);
 }
 
 bool CWallet::AddressIsMine(const CTxDestination &address)
@@ -2592,7 +3027,7 @@ bool CWallet::DelAddressBook(const CTxDestination &address)
             std::string strAddress = CBitcoinAddress(address).ToString();
             for (auto const &item : mapAddressBook[address].destdata)
             {
-                CWalletDB(strWalletFile).EraseDestData(strAddress, item.first);
+                WalletDB()->EraseDestData(strAddress, item.first);
             }
         }
         mapAddressBook.erase(address);
@@ -2600,15 +3035,15 @@ bool CWallet::DelAddressBook(const CTxDestination &address)
 
     if (!fFileBacked)
         return false;
-    CWalletDB(strWalletFile).ErasePurpose(CBitcoinAddress(address).ToString());
-    return CWalletDB(strWalletFile).EraseName(CBitcoinAddress(address).ToString());
+    WalletDB()->ErasePurpose(CBitcoinAddress(address).ToString());
+    return WalletDB()->EraseName(CBitcoinAddress(address).ToString());
 }
 
 bool CWallet::SetDefaultKey(const CPubKey &vchPubKey)
 {
     if (fFileBacked)
     {
-        if (!CWalletDB(strWalletFile).WriteDefaultKey(vchPubKey))
+        if (!WalletDB()->WriteDefaultKey(vchPubKey))
             return false;
     }
     vchDefaultKey = vchPubKey;
@@ -2623,19 +3058,21 @@ bool CWallet::NewKeyPool()
 {
     {
         LOCK(cs_wallet);
-        CWalletDB walletdb(strWalletFile);
+        CWalletBatch batch(this);
+        CWalletDBHandle walletdb = WalletDB();
         for (auto nIndex : setKeyPool)
-            walletdb.ErasePool(nIndex);
+            walletdb->ErasePool(nIndex);
         setKeyPool.clear();
 
         if (IsLocked())
             return false;
 
         int64_t nKeys = std::max(gArgs.GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t)0);
-        for (int i = 0; i < nKeys; i++)
+        int64_t nIndex = 0;
+        for (const CPubKey &pubkey : GenerateNewKeys(nKeys))
         {
-            int64_t nIndex = i + 1;
-            walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey()));
+            nIndex++;
+            walletdb->WritePool(nIndex, CKeyPool(pubkey));
             setKeyPool.insert(nIndex);
         }
         LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
@@ -2651,25 +3088,29 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
-
         // Top up key pool
         unsigned int nTargetSize;
         if (kpSize > 0)
             nTargetSize = kpSize;
         else
             nTargetSize = std::max(gArgs.GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t)0);
+        if (setKeyPool.size() >= nTargetSize + 1)
+            return true;
 
-        while (setKeyPool.size() < (nTargetSize + 1))
+        // one database transaction for all the keys and their pool entries
+        CWalletBatch batch(this);
+        CWalletDBHandle walletdb = WalletDB();
+        for (const CPubKey &pubkey : GenerateNewKeys(nTargetSize + 1 - setKeyPool.size()))
         {
             int64_t nEnd = 1;
             if (!setKeyPool.empty())
                 nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
+            if (!walletdb->WritePool(nEnd, CKeyPool(pubkey)))
                 throw std::runtime_error("TopUpKeyPool(): writing generated key failed");
             setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
+            LogPrint(Logging::WALLET, "keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
         }
+        LogPrintf("keypool topped up, size=%u\n", setKeyPool.size());
     }
     return true;
 }
@@ -2688,16 +3129,16 @@ void CWallet::ReserveKeyFromKeyPool(int64_t &nIndex, CKeyPool &keypool)
         if (setKeyPool.empty())
             return;
 
-        CWalletDB walletdb(strWalletFile);
+        CWalletDBHandle walletdb = WalletDB();
 
         nIndex = *(setKeyPool.begin());
         setKeyPool.erase(setKeyPool.begin());
-        if (!walletdb.ReadPool(nIndex, keypool))
+        if (!walletdb->ReadPool(nIndex, keypool))
             throw std::runtime_error("ReserveKeyFromKeyPool(): read failed");
         if (!HaveKey(keypool.vchPubKey.GetID()))
             throw std::runtime_error("ReserveKeyFromKeyPool(): unknown key in key pool");
         assert(keypool.vchPubKey.IsValid());
-        LogPrint("wallet", "keypool reserve %d\n", nIndex);
+        LogPrint(Logging::WALLET, "keypool reserve %d\n", nIndex);
     }
 }
 
@@ -2706,8 +3147,7 @@ void CWallet::KeepKey(int64_t nIndex)
     // Remove from key pool
     if (fFileBacked)
     {
-        CWalletDB walletdb(strWalletFile);
-        walletdb.ErasePool(nIndex);
+        WalletDB()->ErasePool(nIndex);
     }
     LogPrintf("keypool keep %d\n", nIndex);
 }
@@ -2719,7 +3159,7 @@ void CWallet::ReturnKey(int64_t nIndex)
         LOCK(cs_wallet);
         setKeyPool.insert(nIndex);
     }
-    LogPrint("wallet", "keypool return %d\n", nIndex);
+    LogPrint(Logging::WALLET, "keypool return %d\n", nIndex);
 }
 
 bool CWallet::GetKeyFromPool(CPubKey &result)
@@ -2900,6 +3340,19 @@ std::set<CTxDestination> CWallet::GetAccountAddresses(const std::string &strAcco
     return result;
 }
 
+std::string CWallet::EncodeAddress(const CTxDestination &dest) const
+{
+    LOCK(cs_addressStrings);
+    auto it = mapAddressStrings.find(dest);
+    if (it != mapAddressStrings.end())
+        return it->second;
+    if (mapAddressStrings.size() >= MAX_ADDRESS_STRING_CACHE)
+        mapAddressStrings.clear();
+    std::string strAddress = CBitcoinAddress(dest).ToString();
+    mapAddressStrings.emplace(dest, strAddress);
+    return strAddress;
+}
+
 bool CReserveKey::GetReservedKey(CPubKey &pubkey)
 {
     if (nIndex == -1)
@@ -3112,7 +3565,7 @@ bool CWallet::AddDestData(const CTxDestination &dest, const std::string &key, co
     mapAddressBook[dest].destdata.insert(std::make_pair(key, value));
     if (!fFileBacked)
         return true;
-    return CWalletDB(strWalletFile).WriteDestData(CBitcoinAddress(dest).ToString(), key, value);
+    return WalletDB()->WriteDestData(CBitcoinAddress(dest).ToString(), key, value);
 }
 
 bool CWallet::EraseDestData(const CTxDestination &dest, const std::string &key)
@@ -3121,7 +3574,7 @@ bool CWallet::EraseDestData(const CTxDestination &dest, const std::string &key)
         return false;
     if (!fFileBacked)
         return true;
-    return CWalletDB(strWalletFile).EraseDestData(CBitcoinAddress(dest).ToString(), key);
+    return WalletDB()->EraseDestData(CBitcoinAddress(dest).ToString(), key);
 }
 
 bool CWallet::LoadDestData(const CTxDestination &dest, const std::string &key, const std::string &value)
@@ -3348,6 +3801,186 @@ bool CWallet::SelectCoins(CAmount nTargetValue,
             SelectCoinsMinConf(nTargetValue, nSpendTime, 0, 1, vCoins, setCoinsRet, nValueRet));
 }
 
+typedef std::pair<std::pair<const CWalletTx *, unsigned int>, CStakeKernelSource> CStakeCandidate;
+
+/** Candidates one check of a kernel search covers, fewer are not worth handing to another thread */
+static const size_t MIN_KERNEL_CANDIDATES_PER_THREAD = 32;
+
+namespace
+{
+/** A search for a stake kernel, shared by the checks it is split into */
+struct CStakeKernelSearch
+{
+    const std::vector<CStakeCandidate> &vCandidates;
+    const int nHeight;
+    const unsigned int nTimeTx;
+    const unsigned int nTargetBits;
+    const int64_t nStakeMinAge;
+    //! the first candidate found to have a valid kernel so far, vCandidates.size() while there is none
+    std::atomic<size_t> nKernel;
+
+    CStakeKernelSearch(const std::vector<CStakeCandidate> &vCandidatesIn,
+        int nHeightIn,
+        unsigned int nTimeTxIn,
+        unsigned int nTargetBitsIn)
+        : vCandidates(vCandidatesIn), nHeight(nHeightIn), nTimeTx(nTimeTxIn), nTargetBits(nTargetBitsIn),
+          nStakeMinAge(pnetMan->getActivePaymentNetwork()->getStakeMinAge()), nKernel(vCandidatesIn.size())
+    {
+    }
+
+    /** Check the candidates from nBegin up to nEnd in order, until one has a valid kernel */
+    void Search(size_t nBegin, size_t nEnd)
+    {
+        static const int nMaxStakeSearchInterval = 60;
+        for (size_t i = nBegin; i < nEnd; i++)
+        {
+            // candidates after one that was found can not win anymore
+            if (i >= nKernel.load())
+                return;
+            const std::pair<const CWalletTx *, unsigned int> &pcoin = vCandidates[i].first;
+            const CStakeKernelSource &source = vCandidates[i].second;
+            if ((int64_t)source.nTimeBlockFrom + nStakeMinAge > nTimeTx - nMaxStakeSearchInterval)
+                continue; // only count coins meeting min age requirement
+
+            uint256 hashProofOfStake;
+            COutPoint prevoutStake = COutPoint(pcoin.first->tx->GetHash(), pcoin.second);
+            if (CheckStakeKernelHash(nHeight, source.hashBlockFrom, source.nTimeBlockFrom, source.nTxOffset,
+                    *(pcoin.first->tx), prevoutStake, nTimeTx, nTargetBits, hashProofOfStake))
+            {
+                size_t nBest = nKernel.load();
+                while (i < nBest && !nKernel.compare_exchange_weak(nBest, i))
+                {
+                }
+                return;
+            }
+        }
+    }
+};
+
+/** A slice of the candidates of a kernel search, for stakekernelqueue */
+class CStakeKernelCheck
+{
+private:
+    CStakeKernelSearch *psearch;
+    size_t nBegin;
+    size_t nEnd;
+
+public:
+    CStakeKernelCheck() : psearch(nullptr), nBegin(0), nEnd(0) {}
+    CStakeKernelCheck(CStakeKernelSearch *psearchIn, size_t nBeginIn, size_t nEndIn)
+        : psearch(psearchIn), nBegin(nBeginIn), nEnd(nEndIn)
+    {
+    }
+
+    bool operator()()
+    {
+        psearch->Search(nBegin, nEnd);
+        return true;
+    }
+
+    void swap(CStakeKernelCheck &check)
+    {
+        std::swap(psearch, check.psearch);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+    }
+};
+} // anon namespace
+
+static CCheckQueue<CStakeKernelCheck> stakekernelqueue(1);
+// only one thread at a time may act as the master of stakekernelqueue
+static CCriticalSection cs_stakekernelmaster;
+
+void ThreadStakeKernelSearch()
+{
+    RenameThread("ecc-stakekernel");
+    stakekernelqueue.Thread();
+}
+
+void InterruptStakeKernelSearch() { stakekernelqueue.Stop(); }
+
+/**
+ * Look for a coin whose kernel meets the target at nTimeTx. The candidates are spread over the
+ * kernel search threads and the search stops as soon as a kernel is found, but the first matching
+ * candidate in vCandidates order always wins so the result does not depend on thread timing.
+ * Returns vCandidates.size() if no candidate has a valid kernel.
+ */
+static size_t FindStakeKernel(const std::vector<CStakeCandidate> &vCandidates,
+    int nHeight,
+    unsigned int nTimeTx,
+    unsigned int nTargetBits)
+{
+    CStakeKernelSearch search(vCandidates, nHeight, nTimeTx, nTargetBits);
+
+    TRY_LOCK(cs_stakekernelmaster, lockMaster);
+    if (!lockMaster || nScriptCheckThreads == 0 || vCandidates.size() < 2 * MIN_KERNEL_CANDIDATES_PER_THREAD)
+    {
+        search.Search(0, vCandidates.size());
+        return search.nKernel.load();
+    }
+
+    // the queue takes its checks from the back, the slices go in last first so the early candidates, the ones
+    // that win, are searched first
+    const size_t nChecks =
+        (vCandidates.size() + MIN_KERNEL_CANDIDATES_PER_THREAD - 1) / MIN_KERNEL_CANDIDATES_PER_THREAD;
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve(nChecks);
+    for (size_t n = nChecks; n > 0; n--)
+    {
+        const size_t nBegin = (n - 1) * MIN_KERNEL_CANDIDATES_PER_THREAD;
+        vChecks.push_back(CStakeKernelCheck(
+            &search, nBegin, std::min(vCandidates.size(), nBegin + MIN_KERNEL_CANDIDATES_PER_THREAD)));
+    }
+    CCheckQueueControl<CStakeKernelCheck> control(&stakekernelqueue);
+    control.Add(vChecks);
+    control.Wait();
+    return search.nKernel.load();
+}
+
+bool CWallet::GetStakeKernelSource(const CWalletTx &wtx, CStakeKernelSource &source)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    const uint256 &txid = wtx.tx->GetHash();
+    std::map<uint256, CStakeKernelSource>::const_iterator it = mapStakeKernelSources.find(txid);
+    if (it != mapStakeKernelSources.end() && it->second.hashBlock == wtx.hashBlock)
+    {
+        source = it->second;
+        return true;
+    }
+
+    CDiskTxPos txindex;
+    if (!pnetMan->getChainActive()->pblocktree->ReadTxIndex(txid, txindex))
+        return false;
+    source.hashBlock = wtx.hashBlock;
+    source.nTxOffset = txindex.nTxOffset;
+
+    // the kernel hashes the block the tx index points at, which is normally the wallet's
+    // block, whose header is already in memory
+    const CBlockIndex *pindex = pnetMan->getChainActive()->LookupBlockIndex(wtx.hashBlock);
+    if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nFile == txindex.nFile &&
+        pindex->nDataPos == txindex.nPos)
+    {
+        source.hashBlockFrom = pindex->GetBlockHash();
+        source.nTimeBlockFrom = pindex->GetBlockTime();
+    }
+    else
+    {
+        // otherwise the header goes by the block the transaction is read from, whose data may have been pruned
+        CTransaction txPrev;
+        uint256 hashBlockFrom;
+        if (!GetTransaction(txid, txPrev, pnetMan->getActivePaymentNetwork()->GetConsensus(), hashBlockFrom))
+            return false;
+        const CBlockIndex *pindexFrom = pnetMan->getChainActive()->LookupBlockIndex(hashBlockFrom);
+        if (!pindexFrom)
+            return false;
+        source.hashBlockFrom = pindexFrom->GetBlockHash();
+        source.nTimeBlockFrom = pindexFrom->GetBlockTime();
+    }
+    mapStakeKernelSources[txid] = source;
+    return true;
+}
+
 // ppcoin: create coin stake transaction
 bool CWallet::CreateCoinStake(const CKeyStore &keystore,
     unsigned int nBits,
@@ -3357,7 +3990,7 @@ bool CWallet::CreateCoinStake(const CKeyStore &keystore,
     // The following split & combine thresholds are important to security
     // Should not be adjusted if you don't understand the consequences
     static unsigned int nStakeSplitAge = (60 * 60 * 24 * 30);
-    const CBlockIndex *pIndex0 = GetLastBlockIndex(pnetMan->getChainActive()->chainActive.Tip(), false);
+    const CBlockIndex *pIndex0 = GetLastBlockIndex(pnetMan->getChainActive()->GetPublishedTip()->pindex, false);
     int64_t nCombineThreshold = 0;
     if (pIndex0->pprev)
         nCombineThreshold =
@@ -3392,87 +4025,73 @@ bool CWallet::CreateCoinStake(const CKeyStore &keystore,
     int64_t nCredit = 0;
     CScript scriptPubKeyKernel;
     bool fKernelFound = false;
-    for (auto pcoin : setCoins)
+    int nKernelHeight = 0;
+    unsigned int nKernelTargetBits = 0;
     {
-        CDiskTxPos txindex;
+        LOCK(cs_main);
+        nKernelHeight = pnetMan->getChainActive()->chainActive.Tip()->nHeight + 1;
+        nKernelTargetBits = GetStakeKernelTarget(nKernelHeight);
+    }
+    // Gather the kernel inputs of every coin up front, they come from the stake kernel
+    // source cache so this normally touches neither the tx index nor the block files
+    std::vector<CStakeCandidate> vCandidates;
+    vCandidates.reserve(setCoins.size());
+    {
+        LOCK2(cs_main, cs_wallet);
+        for (auto pcoin : setCoins)
         {
-            LOCK2(cs_main, cs_wallet);
-            if (!pnetMan->getChainActive()->pblocktree->ReadTxIndex(pcoin.first->tx->GetHash(), txindex))
-                continue;
+            CStakeKernelSource source;
+            if (GetStakeKernelSource(*pcoin.first, source))
+                vCandidates.emplace_back(pcoin, source);
         }
+    }
 
-        // Read block header
-        CBlock block;
+    const size_t nKernel = FindStakeKernel(vCandidates, nKernelHeight, txNew.nTime, nKernelTargetBits);
+    if (nKernel < vCandidates.size())
+    {
+        const std::pair<const CWalletTx *, unsigned int> &pcoin = vCandidates[nKernel].first;
+        const CStakeKernelSource &source = vCandidates[nKernel].second;
+
+        // Found a kernel
+        LogPrint(Logging::WALLET, "CreateCoinStake : kernel found\n");
+        std::vector<std::vector<unsigned char> > vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
         {
-            LOCK2(cs_main, cs_wallet);
-            CDiskBlockPos blockPos(txindex.nFile, txindex.nPos);
-            if (!ReadBlockFromDisk(block, blockPos, pnetMan->getActivePaymentNetwork()->GetConsensus()))
-                continue;
+            LogPrint(Logging::WALLET, "CreateCoinStake : failed to parse kernel\n");
+            return false;
         }
-
-        static int nMaxStakeSearchInterval = 60;
-
-        // LogPrintf(">> block.GetBlockTime() = %"PRI64d", nStakeMinAge = %d, txNew.nTime = %d\n", block.GetBlockTime(),
-        // nStakeMinAge,txNew.nTime);
-        if (block.GetBlockTime() + pnetMan->getActivePaymentNetwork()->getStakeMinAge() >
-            txNew.nTime - nMaxStakeSearchInterval)
-            continue; // only count coins meeting min age requirement
-
+        LogPrint(Logging::WALLET, "CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
         {
-            // LogPrintf(">> In.....\n");
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            uint256 hashProofOfStake;
-            hashProofOfStake.SetNull();
-            COutPoint prevoutStake = COutPoint(pcoin.first->tx->GetHash(), pcoin.second);
-            if (CheckStakeKernelHash(pnetMan->getChainActive()->chainActive.Tip()->nHeight + 1, block,
-                    txindex.nTxOffset, *(pcoin.first->tx), prevoutStake, txNew.nTime, hashProofOfStake))
+            LogPrint(Logging::WALLET, "CreateCoinStake : no support for kernel type=%d\n", whichType);
+            return false; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            // convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key))
             {
-                // Found a kernel
-                LogPrint("wallet", "CreateCoinStake : kernel found\n");
-                std::vector<std::vector<unsigned char> > vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    LogPrint("wallet", "CreateCoinStake : failed to parse kernel\n");
-                    break;
-                }
-                LogPrint("wallet", "CreateCoinStake : parsed kernel type=%d\n", whichType);
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
-                {
-                    LogPrint("wallet", "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break; // only support pay to public key and pay to address
-                }
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    // convert to pay to public key type
-                    CKey key;
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        LogPrint("wallet", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break; // unable to find corresponding public key
-                    }
-                    scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-                }
-                else
-                    scriptPubKeyOut = scriptPubKeyKernel;
-
-                txNew.vin.push_back(CTxIn(pcoin.first->tx->GetHash(), pcoin.second));
-                nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-                vwtxPrev.push_back(pcoin.first);
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-                if (block.GetBlockTime() + nStakeSplitAge > txNew.nTime)
-                    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); // split stake
-
-                LogPrint("wallet", "CreateCoinStake : added kernel type=%d\n", whichType);
-                fKernelFound = true;
-                break;
+                LogPrint(Logging::WALLET, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                return false; // unable to find corresponding public key
             }
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
         }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        else
+            scriptPubKeyOut = scriptPubKeyKernel;
+
+        txNew.vin.push_back(CTxIn(pcoin.first->tx->GetHash(), pcoin.second));
+        nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        if ((int64_t)source.nTimeBlockFrom + nStakeSplitAge > txNew.nTime)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); // split stake
+
+        LogPrint(Logging::WALLET, "CreateCoinStake : added kernel type=%d\n", whichType);
+        fKernelFound = true;
     }
     if (!fKernelFound)
     {
@@ -3670,6 +4289,19 @@ bool CWallet::InitLoadWallet()
     }
     if (pnetMan->getChainActive()->chainActive.Tip() && pnetMan->getChainActive()->chainActive.Tip() != pindexRescan)
     {
+        // We can't rescan beyond non-pruned blocks, stop and throw an error
+        if (fPruneMode)
+        {
+            CBlockIndex *block = pnetMan->getChainActive()->chainActive.Tip();
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 &&
+                   pindexRescan != block)
+                block = block->pprev;
+
+            if (pindexRescan != block)
+                return UIError(("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex "
+                                "(download the whole blockchain again in case of pruned node)"));
+        }
+
         LogPrintf("Rescanning last %i blocks (from block %i)...\n",
             pnetMan->getChainActive()->chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
         nStart = GetTimeMillis();
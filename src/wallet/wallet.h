@@ -35,11 +35,14 @@
 #include "wallet/walletdb.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -81,6 +84,8 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = COINBASE_MATURITY;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = MAX_STANDARD_TX_SIZE;
 static const bool DEFAULT_WALLETBROADCAST = true;
+//! Address strings CWallet::EncodeAddress keeps
+static const size_t MAX_ADDRESS_STRING_CACHE = 10000;
 
 extern const char *DEFAULT_WALLET_DAT;
 
@@ -369,18 +374,8 @@ public:
         mapValue.erase("timesmart");
     }
 
-    //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    //! make sure balances are recalculated, the wallet's running balances included
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -470,6 +465,64 @@ public:
 };
 
 
+/** Inputs to the stake kernel of a confirmed wallet transaction that would otherwise need a
+ *  tx index lookup and a read of its block from disk on every staking attempt
+ */
+struct CStakeKernelSource
+{
+    //! the wallet's hashBlock for the tx when this was computed, a different one means it's stale
+    uint256 hashBlock;
+    //! block the tx index points at, the kernel is hashed against it
+    uint256 hashBlockFrom;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTxOffset;
+};
+
+/** What GetBalance() and the other balance getters of CWallet return, see CWallet::GetBalances() */
+struct CWalletBalances
+{
+    CAmount nTrusted;
+    CAmount nUnconfirmed;
+    CAmount nImmature;
+    CAmount nWatchTrusted;
+    CAmount nWatchUnconfirmed;
+    CAmount nWatchImmature;
+    CAmount nStake;
+    CAmount nNewMint;
+
+    CWalletBalances()
+        : nTrusted(0), nUnconfirmed(0), nImmature(0), nWatchTrusted(0), nWatchUnconfirmed(0), nWatchImmature(0),
+          nStake(0), nNewMint(0)
+    {
+    }
+
+    CWalletBalances &operator+=(const CWalletBalances &other);
+    CWalletBalances &operator-=(const CWalletBalances &other);
+    bool IsNull() const;
+};
+
+/** The handle of the wallet write batch open on this thread, or a handle of its own when there is none */
+class CWalletDBHandle
+{
+private:
+    std::unique_ptr<CWalletDB> walletdbOwned;
+    CWalletDB *pwalletdb;
+
+public:
+    CWalletDBHandle(CWalletDB *pwalletdbBatch, const std::string &strFile, bool fFlushOnClose)
+        : pwalletdb(pwalletdbBatch)
+    {
+        if (!pwalletdb)
+        {
+            walletdbOwned.reset(new CWalletDB(strFile, "r+", fFlushOnClose));
+            pwalletdb = walletdbOwned.get();
+        }
+    }
+
+    CWalletDB *operator->() const { return pwalletdb; }
+    CWalletDB *get() const { return pwalletdb; }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -497,6 +550,24 @@ private:
 
     CWalletDB *pwalletdbEncryption;
 
+    //! the write batch of CWalletBatch, only used by the thread in batchOwner, which holds cs_wallet meanwhile
+    CWalletDB *pwalletdbBatch;
+    std::atomic<std::thread::id> batchOwner;
+    unsigned int nBatchDepth;
+    friend class CWalletBatch;
+
+    /**
+     * A handle for a database access. It is the one of the write batch if this thread has one open, an access
+     * with another handle would wait for the uncommitted writes of the batch.
+     */
+    CWalletDBHandle WalletDB(bool fFlushOnClose = true) const;
+
+    //! store a key made by GenerateNewKey() or GenerateNewKeys(), pvchCryptedSecret is its encrypted secret if the
+    //! wallet is crypted
+    void AddNewKey(const CKey &secret, const CPubKey &pubkey, const std::vector<unsigned char> *pvchCryptedSecret);
+    //! the key became spendable, forget its watch-only scripts
+    void RemoveWatchOnlyOf(const CPubKey &pubkey);
+
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
 
@@ -508,6 +579,13 @@ private:
     int64_t nLastResend;
     bool fBroadcastTransactions;
 
+    //! state of the running ScanForWalletTransactions(), read without cs_wallet
+    std::atomic<bool> fScanningWallet;
+    std::atomic<bool> fAbortRescan;
+    std::atomic<int64_t> nScanStartTime;
+    //! how far the running rescan got, between 0 and 1
+    std::atomic<double> dScanProgress;
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -520,8 +598,71 @@ private:
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx);
+    /** The MarkConflicted calls AddToWallet came across while loading. LoadWallet makes them once cs_wallet is
+     *  released, MarkConflicted takes cs_main first and init loads the wallet without holding it.
+     */
+    std::vector<std::pair<uint256, uint256> > vLoadConflicts;
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
+    //! SyncTransaction() with cs_main and cs_wallet held
+    void SyncTransactionLocked(const CTransactionRef &ptx, const CBlock *pblock);
+
+    /**
+     * Running balances, protected by cs_wallet. The part of a confirmed and mature transaction only changes through
+     * the wallet, those parts are summed up in balancesStable. The part of unconfirmed and immature transactions also
+     * changes with the mempool and the tip, they are evaluated on every GetBalances(). MarkDirty() on a transaction
+     * queues it to be sorted in again, a reorganization below pindexBalances rebuilds everything.
+     */
+    mutable CWalletBalances balancesStable;
+    //! the parts summed up in balancesStable, transactions that add nothing are left out
+    mutable std::map<uint256, CWalletBalances> mapBalancesStable;
+    mutable std::set<uint256> setBalancesVolatile;
+    mutable std::set<uint256> setBalancesDirty;
+    mutable bool fBalancesRebuild;
+    mutable const CBlockIndex *pindexBalances;
+
+    //! the part of wtx in the balances, fVolatile is set if it can change without the wallet noticing
+    CWalletBalances GetBalancesOf(const CWalletTx &wtx, bool &fVolatile) const;
+    //! take the transaction out of the running balances and sort it in again
+    void UpdateBalancesOf(const uint256 &hash) const;
+
+    /**
+     * The outputs that are ours and not spent, protected by cs_wallet. Kept up to date through MarkDirty() like the
+     * running balances, so AvailableCoins() only looks at transactions that have something left to spend.
+     */
+    mutable std::set<COutPoint> setUnspent;
+    mutable std::set<uint256> setUnspentDirty;
+    mutable bool fUnspentRebuild;
+    mutable const CBlockIndex *pindexUnspent;
+
+    //! replace the outputs of the transaction in setUnspent
+    void UpdateUnspentOf(const uint256 &hash) const;
+    //! catch up setUnspent with the dirty transactions and the tip, cs_main and cs_wallet have to be held
+    void UpdateUnspent() const;
+
+    /**
+     * The wallet transactions by the height of the active chain block that confirms them, -1 for the ones no such
+     * block confirms, protected by cs_wallet. Kept up to date like setUnspent, a block only changes which height a
+     * transaction is under when it confirms, conflicts or abandons it, or when a reorganization disconnects it.
+     */
+    mutable std::map<int, std::set<uint256> > mapTxByHeight;
+    mutable std::map<uint256, int> mapTxHeight;
+    mutable std::set<uint256> setTxHeightDirty;
+    mutable bool fTxHeightRebuild;
+    mutable const CBlockIndex *pindexTxHeight;
+
+    //! move the transaction to the height it is under now
+    void UpdateTxHeightOf(const uint256 &hash) const;
+    //! catch up mapTxByHeight with the dirty transactions and the tip, cs_main and cs_wallet have to be held
+    void UpdateTxHeights() const;
+
+    /**
+     * The address strings of destinations the RPC calls listed before. Encoding an address hashes it twice and
+     * converts it to base58, listing every output of a large wallet did that for the same few addresses over and
+     * over. Destinations never change their string, so the cache is only bounded, it starts over when full.
+     */
+    mutable CCriticalSection cs_addressStrings;
+    mutable std::map<CTxDestination, std::string> mapAddressStrings GUARDED_BY(cs_addressStrings);
 
 public:
     /*
@@ -570,6 +711,19 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        fBalancesRebuild = true;
+        pindexBalances = nullptr;
+        fUnspentRebuild = true;
+        pindexUnspent = nullptr;
+        fTxHeightRebuild = true;
+        pindexTxHeight = nullptr;
+        pwalletdbBatch = nullptr;
+        batchOwner = std::thread::id();
+        nBatchDepth = 0;
+        fScanningWallet = false;
+        fAbortRescan = false;
+        nScanStartTime = 0;
+        dScanProgress = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -586,10 +740,20 @@ public:
 
     std::set<COutPoint> setLockedCoins;
 
+    //! stake kernel sources by txid, filled lazily while staking
+    std::map<uint256, CStakeKernelSource> mapStakeKernelSources;
+
     int64_t nTimeFirstKey;
 
     const CWalletTx *GetWalletTx(const uint256 &hash) const;
 
+    /**
+     * The wallet transactions no block of the active chain up to nHeight confirms, by the height of the block that
+     * does and then txid, the unconfirmed and conflicted ones last. Costs only the transactions it returns.
+     * cs_main and cs_wallet have to be held.
+     */
+    std::vector<const CWalletTx *> GetTransactionsSince(int nHeight) const;
+
     //! check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf)
     {
@@ -638,6 +802,11 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey();
+    /**
+     * Generate nKeys keys like GenerateNewKey(), in this order. Making and checking the keys, and encrypting them,
+     * is spread over all cores, only adding them to the wallet is done one by one.
+     */
+    std::vector<CPubKey> GenerateNewKeys(size_t nKeys);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey &key, const CPubKey &pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
@@ -688,13 +857,37 @@ public:
     int64_t IncOrderPosNext(CWalletDB *pwalletdb = NULL);
 
     void MarkDirty();
+    //! the balances or the unspent outputs of the transaction changed, called by CWalletTx::MarkDirty()
+    void MarkTxDirty(const uint256 &hash) const;
     bool AddToWallet(const CWalletTx &wtxIn, bool fFromLoadWallet, CWalletDB *pwalletdb);
     void SyncTransaction(const CTransactionRef &ptx, const CBlock *pblock, int txIndex = -1);
+    /**
+     * SyncTransaction() for those of them that can involve the wallet, a connected block for example. The locks are
+     * taken once, the other transactions are skipped after a few lookups and the changes are written to the
+     * database in one batch.
+     */
+    void SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock);
+    //! whether tx is in the wallet, or spends from or conflicts with a transaction of it, cs_wallet has to be held
+    bool TouchesWallet(const CTransaction &tx) const;
     bool AddToWalletIfInvolvingMe(const CTransactionRef &ptx, const CBlock *pblock, bool fUpdate);
+    /**
+     * Scan the active chain from pindexStart for transactions of the wallet, returns how many were added or
+     * updated. Blocks are read and their outputs matched against the keys on worker threads, only the matches are
+     * added under cs_main and cs_wallet, which are not held across the whole scan. Callers must not hold them either.
+     * One scan runs at a time, AbortRescan() stops it at the next batch of blocks.
+     */
     int ScanForWalletTransactions(CBlockIndex *pindexStart, bool fUpdate = false);
+    bool IsScanning() const { return fScanningWallet; }
+    void AbortRescan() { fAbortRescan = true; }
+    int64_t GetScanDuration() const { return GetTimeMillis() - nScanStartTime; }
+    double GetScanProgress() const { return dScanProgress; }
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman *connman);
+    //! relay the transactions received before nTime that no block confirms, oldest first, only those are looked at
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman *connman);
+    /** All balances at once. Only the unconfirmed and immature transactions and those that changed since the last
+     *  call are looked at, not the whole wallet */
+    CWalletBalances GetBalances() const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -756,6 +949,8 @@ public:
     std::map<CTxDestination, CAmount> GetAddressBalances();
 
     std::set<CTxDestination> GetAccountAddresses(const std::string &strAccount) const;
+    //! CBitcoinAddress(dest).ToString() from a cache of the recent ones, does not need cs_wallet
+    std::string EncodeAddress(const CTxDestination &dest) const;
 
     isminetype IsMine(const CTxIn &txin) const;
     CAmount GetDebit(const CTxIn &txin, const isminefilter &filter) const;
@@ -804,6 +999,9 @@ public:
         return setKeyPool.size();
     }
 
+    //! Memory the transactions of the wallet, the indexes over them, the key pool and the address book take
+    size_t DynamicMemoryUsage() const;
+
     bool SetDefaultKey(const CPubKey &vchPubKey);
 
     //! signify that a particular wallet feature is now used. this may change nWalletVersion and nWalletMaxVersion if
@@ -843,6 +1041,8 @@ public:
     /* Mark a transaction (and it in-wallet descendants) as abandoned so its inputs may be respent. */
     bool AbandonTransaction(const uint256 &hashTx);
 
+    /** Get the stake kernel inputs of a confirmed wallet transaction, from the cache if they are still valid */
+    bool GetStakeKernelSource(const CWalletTx &wtx, CStakeKernelSource &source);
     bool CreateCoinStake(const CKeyStore &keystore, unsigned int nBits, int64_t nSearchInterval, CTransaction &txNew);
 
 
@@ -850,6 +1050,22 @@ public:
     static bool InitLoadWallet();
 };
 
+/**
+ * Groups the database writes of a wallet on this thread into one database transaction until it goes out of scope,
+ * a nested batch joins the outer one. The commit does not wait for the disk, MaybeFlushWalletDB flushes the log
+ * afterwards. cs_wallet has to be held for the whole life of the batch, and the wallet must go through
+ * CWallet::WalletDB() for its database accesses meanwhile.
+ */
+class CWalletBatch
+{
+private:
+    CWallet *pwallet;
+
+public:
+    explicit CWalletBatch(CWallet *pwalletIn);
+    ~CWalletBatch();
+};
+
 /** A key allocated from the key pool. */
 class CReserveKey : public CReserveScript
 {
@@ -872,4 +1088,8 @@ public:
     void KeepScript() { KeepKey(); }
 };
 
+/** A thread searching stake kernels for CreateCoinStake, started as often as the script check threads */
+void ThreadStakeKernelSearch();
+void InterruptStakeKernelSearch();
+
 #endif // BITCOIN_WALLET_WALLET_H
@@ -48,6 +48,9 @@ isminetype IsMine(const CKeyStore &keystore, const CTxDestination &dest)
 
 isminetype IsMine(const CKeyStore &keystore, const CScript &scriptPubKey)
 {
+    if (!keystore.MightBeMine(scriptPubKey))
+        return ISMINE_NO;
+
     std::vector<valtype> vSolutions;
     txnouttype whichType;
     if (!Solver(scriptPubKey, whichType, vSolutions))
@@ -32,6 +32,10 @@
 #include "wallet.h"
 #include "wallet/wallet.h"
 
+#include <atomic>
+#include <deque>
+#include <thread>
+
 #include <boost/filesystem.hpp>
 #include <boost/scoped_ptr.hpp>
 
@@ -236,6 +240,11 @@ DBErrors CWalletDB::ReorderTransactions(CWallet *pwallet)
     }
     WriteOrderPosNext(nOrderPosNext);
 
+    // wtxOrdered was filled with the positions from before
+    pwallet->wtxOrdered.clear();
+    for (TxItems::iterator it = txByTime.begin(); it != txByTime.end(); ++it)
+        pwallet->wtxOrdered.insert(std::make_pair(it->second->nOrderPos, it->second));
+
     return DB_LOAD_OK;
 }
 
@@ -249,6 +258,9 @@ public:
     bool fAnyUnordered;
     int nFileVersion;
     std::vector<uint256> vWalletUpgrade;
+    //! keep the transaction records in vTxRecords instead of decoding them, see LoadWalletTxs()
+    bool fDeferTxs;
+    std::deque<std::pair<uint256, CDataStream> > vTxRecords;
 
     CWalletScanState()
     {
@@ -256,9 +268,44 @@ public:
         fIsEncrypted = false;
         fAnyUnordered = false;
         nFileVersion = 0;
+        fDeferTxs = false;
     }
 };
 
+/** Decode and check a transaction record, fUpgraded and strErr are set if it had to be upgraded or repaired */
+static bool ReadWalletTx(const uint256 &hash,
+    CDataStream &ssValue,
+    CWalletTx &wtx,
+    bool &fUpgraded,
+    std::string &strErr)
+{
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(*(wtx.tx), state) && (wtx.tx->GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s", wtx.fTimeReceivedIsTxTime, fTmp,
+                wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
 bool ReadKeyValue(CWallet *pwallet,
     CDataStream &ssKey,
     CDataStream &ssValue,
@@ -288,32 +335,17 @@ bool ReadKeyValue(CWallet *pwallet,
         {
             uint256 hash;
             ssKey >> hash;
+            if (wss.fDeferTxs)
+            {
+                wss.vTxRecords.emplace_back(hash, std::move(ssValue));
+                return true;
+            }
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(*(wtx.tx), state) && (wtx.tx->GetHash() == hash) && state.IsValid()))
+            bool fUpgraded = false;
+            if (!ReadWalletTx(hash, ssValue, wtx, fUpgraded, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s", wtx.fTimeReceivedIsTxTime, fTmp,
-                        wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr =
-                        strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
+            if (fUpgraded)
                 wss.vWalletUpgrade.push_back(hash);
-            }
 
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
@@ -517,10 +549,73 @@ static bool IsKeyType(std::string strType)
     return (strType == "key" || strType == "wkey" || strType == "mkey" || strType == "ckey");
 }
 
+/** Minimum number of transaction records per decoding thread, below this starting a thread costs more than it saves */
+static const size_t MIN_TX_RECORDS_PER_THREAD = 256;
+
+/**
+ * Decode and check the transaction records LoadWallet() put aside on all cores, then add them to the wallet in the
+ * order they were read. Decoding a record does not depend on any other, adding it does.
+ */
+static void LoadWalletTxs(CWallet *pwallet, CWalletScanState &wss, bool &fNoncriticalErrors)
+{
+    AssertLockHeld(pwallet->cs_wallet);
+    const size_t nRecords = wss.vTxRecords.size();
+    std::vector<CWalletTx> vWtx(nRecords);
+    std::vector<std::string> vErr(nRecords);
+    // 0 if the record is bad, 1 if it is good and 2 if it also had to be upgraded
+    std::vector<char> vResult(nRecords, 0);
+    std::atomic<size_t> nNextRecord(0);
+    auto decode = [&]() {
+        size_t i;
+        while ((i = nNextRecord++) < nRecords)
+        {
+            try
+            {
+                bool fUpgraded = false;
+                if (ReadWalletTx(wss.vTxRecords[i].first, wss.vTxRecords[i].second, vWtx[i], fUpgraded, vErr[i]))
+                    vResult[i] = fUpgraded ? 2 : 1;
+            }
+            catch (...)
+            {
+                vErr[i] = strprintf("LoadWallet() cannot decode tx %s", wss.vTxRecords[i].first.ToString());
+            }
+            // the record is not needed anymore
+            wss.vTxRecords[i].second = CDataStream(SER_DISK, CLIENT_VERSION);
+        }
+    };
+    size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), nRecords / MIN_TX_RECORDS_PER_THREAD);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; i++)
+        vThreads.emplace_back(decode);
+    decode();
+    for (std::thread &thread : vThreads)
+        thread.join();
+
+    for (size_t i = 0; i < nRecords; i++)
+    {
+        if (!vErr[i].empty())
+            LogPrintf("%s\n", vErr[i]);
+        if (vResult[i] == 0)
+        {
+            // Rescan if there is a bad transaction record:
+            fNoncriticalErrors = true;
+            gArgs.SoftSetBoolArg("-rescan", true);
+            continue;
+        }
+        if (vResult[i] == 2)
+            wss.vWalletUpgrade.push_back(wss.vTxRecords[i].first);
+        if (vWtx[i].nOrderPos == -1)
+            wss.fAnyUnordered = true;
+        pwallet->AddToWallet(vWtx[i], true, NULL);
+    }
+    wss.vTxRecords.clear();
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet *pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
     CWalletScanState wss;
+    wss.fDeferTxs = true;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
 
@@ -585,6 +680,8 @@ DBErrors CWalletDB::LoadWallet(CWallet *pwallet)
             }
         }
         pcursor->close();
+
+        LoadWalletTxs(pwallet, wss, fNoncriticalErrors);
     }
     catch (const boost::thread_interrupted &)
     {
@@ -716,77 +813,56 @@ DBErrors CWalletDB::ZapWalletTx(CWallet *pwallet, std::vector<CWalletTx> &vWtx)
     return DB_LOAD_OK;
 }
 
-void ThreadFlushWalletDB(const std::string &strFile)
+void MaybeFlushWalletDB(const std::string &strFile)
 {
-    // Make this thread recognisable as the wallet flushing thread
-    RenameThread("bitcoin-wallet");
-
-    static bool fOneThread;
-    if (fOneThread)
-        return;
-    fOneThread = true;
-    if (!gArgs.GetBoolArg("-flushwallet", DEFAULT_FLUSHWALLET))
+    static std::atomic<bool> fOneThread(false);
+    if (fOneThread.exchange(true))
         return;
 
-    unsigned int nLastSeen = nWalletDBUpdated;
-    unsigned int nLastFlushed = nWalletDBUpdated;
-    int64_t nLastWalletUpdate = GetTime();
-    while (true)
+    static unsigned int nLastSeen = nWalletDBUpdated;
+    static unsigned int nLastFlushed = nWalletDBUpdated;
+    static int64_t nLastWalletUpdate = GetTime();
+
+    if (nLastSeen != nWalletDBUpdated)
     {
-        MilliSleep(500);
-        if (shutdown_threads.load())
-        {
-            return;
-        }
+        nLastSeen = nWalletDBUpdated;
+        nLastWalletUpdate = GetTime();
+    }
 
-        if (nLastSeen != nWalletDBUpdated)
+    if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
+    {
+        TRY_LOCK(bitdb.cs_db, lockDb);
+        if (lockDb)
         {
-            nLastSeen = nWalletDBUpdated;
-            nLastWalletUpdate = GetTime();
-        }
+            // Don't do this if any databases are in use
+            int nRefCount = 0;
+            std::map<std::string, int>::iterator mi = bitdb.mapFileUseCount.begin();
+            while (mi != bitdb.mapFileUseCount.end())
+            {
+                nRefCount += (*mi).second;
+                mi++;
+            }
 
-        if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
-        {
-            TRY_LOCK(bitdb.cs_db, lockDb);
-            if (lockDb)
+            if (nRefCount == 0 && !shutdown_threads.load())
             {
-                // Don't do this if any databases are in use
-                int nRefCount = 0;
-                std::map<std::string, int>::iterator mi = bitdb.mapFileUseCount.begin();
-                while (mi != bitdb.mapFileUseCount.end())
+                std::map<std::string, int>::iterator mi = bitdb.mapFileUseCount.find(strFile);
+                if (mi != bitdb.mapFileUseCount.end())
                 {
-                    nRefCount += (*mi).second;
-                    mi++;
-                }
+                    LogPrint(Logging::DB, "Flushing wallet.dat\n");
+                    nLastFlushed = nWalletDBUpdated;
+                    int64_t nStart = GetTimeMillis();
 
-                if (nRefCount == 0)
-                {
-                    if (shutdown_threads.load())
-                    {
-                        return;
-                    }
-                    std::map<std::string, int>::iterator mi = bitdb.mapFileUseCount.find(strFile);
-                    if (mi != bitdb.mapFileUseCount.end())
-                    {
-                        LogPrint("db", "Flushing wallet.dat\n");
-                        nLastFlushed = nWalletDBUpdated;
-                        int64_t nStart = GetTimeMillis();
-
-                        // Flush wallet.dat so it's self contained
-                        bitdb.CloseDb(strFile);
-                        bitdb.CheckpointLSN(strFile);
-
-                        bitdb.mapFileUseCount.erase(mi++);
-                        LogPrint("db", "Flushed wallet.dat %dms\n", GetTimeMillis() - nStart);
-                    }
+                    // Flush wallet.dat so it's self contained
+                    bitdb.CloseDb(strFile);
+                    bitdb.CheckpointLSN(strFile);
+
+                    bitdb.mapFileUseCount.erase(mi++);
+                    LogPrint(Logging::DB, "Flushed wallet.dat %dms\n", GetTimeMillis() - nStart);
                 }
             }
         }
-        if (shutdown_threads.load())
-        {
-            return;
-        }
     }
+    fOneThread.store(false);
 }
 
 bool BackupWallet(const CWallet &wallet, const std::string &strDest)
@@ -145,6 +145,8 @@ private:
 };
 
 bool BackupWallet(const CWallet &wallet, const std::string &strDest);
-void ThreadFlushWalletDB(const std::string &strFile);
+/** Flush strFile and checkpoint its log when it has not changed for two seconds and no database is in use, run
+ *  periodically by g_scheduler */
+void MaybeFlushWalletDB(const std::string &strFile);
 
 #endif // BITCOIN_WALLET_WALLETDB_H
@@ -8,5 +8,25 @@
 
 
 CZMQAbstractNotifier::~CZMQAbstractNotifier() { assert(!psocket); }
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/) { return true; }
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransactionRef & /*transaction*/) { return true; }
+bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/,
+    const CBlock * /*block*/,
+    CZMQRawData & /*raw*/)
+{
+    return true;
+}
+bool CZMQAbstractNotifier::NotifyTransaction(const CTransactionRef & /*transaction*/, CZMQRawData & /*raw*/)
+{
+    return true;
+}
+bool CZMQAbstractNotifier::NotifyTransactionAcceptance(const CTransactionRef & /*transaction*/,
+    uint64_t /*nMempoolSequence*/)
+{
+    return true;
+}
+bool CZMQAbstractNotifier::NotifyTransactionRemoval(const CTransactionRef & /*transaction*/,
+    uint64_t /*nMempoolSequence*/)
+{
+    return true;
+}
+bool CZMQAbstractNotifier::NotifyBlockConnect(const CBlockIndex * /*CBlockIndex*/) { return true; }
+bool CZMQAbstractNotifier::NotifyBlockDisconnect(const CBlockIndex * /*CBlockIndex*/) { return true; }
@@ -8,11 +8,39 @@
 
 #include "zmqconfig.h"
 
+#include "streams.h"
+#include "version.h"
+
+#include <memory>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier *(*CZMQNotifierFactory)();
 
+/**
+ * The bytes of the block or transaction of one notification. The first notifier that needs them serializes it, the
+ * others and zmq, which may still be sending them after the notification returned, share that buffer.
+ */
+class CZMQRawData
+{
+public:
+    template <typename T>
+    const std::shared_ptr<const CDataStream> &Get(const T &obj)
+    {
+        if (!data)
+        {
+            std::shared_ptr<CDataStream> ss = std::make_shared<CDataStream>(SER_NETWORK, PROTOCOL_VERSION);
+            *ss << obj;
+            data = ss;
+        }
+        return data;
+    }
+
+private:
+    std::shared_ptr<const CDataStream> data;
+};
+
 class CZMQAbstractNotifier
 {
 public:
@@ -32,8 +60,14 @@ public:
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransactionRef &ptx);
+    /** pblock is the block of pindex if it is still in memory, nullptr if it has to be read from disk */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock, CZMQRawData &raw);
+    virtual bool NotifyTransaction(const CTransactionRef &ptx, CZMQRawData &raw);
+    /** The mempool changes and the blocks connected and disconnected, in the order they happened */
+    virtual bool NotifyTransactionAcceptance(const CTransactionRef &ptx, uint64_t nMempoolSequence);
+    virtual bool NotifyTransactionRemoval(const CTransactionRef &ptx, uint64_t nMempoolSequence);
+    virtual bool NotifyBlockConnect(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnect(const CBlockIndex *pindex);
 
 protected:
     void *psocket;
@@ -11,7 +11,7 @@
 #include "util/util.h"
 #include "version.h"
 
-void zmqError(const char *str) { LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno)); }
+void zmqError(const char *str) { LogPrint(Logging::ZMQ, "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno)); }
 CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL) {}
 CZMQNotificationInterface::~CZMQNotificationInterface()
 {
@@ -34,6 +34,7 @@ CZMQNotificationInterface *CZMQNotificationInterface::CreateWithArguments(
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubsequence"] = CZMQAbstractNotifier::Create<CZMQPublishSequenceNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i = factories.begin(); i != factories.end(); ++i)
     {
@@ -67,7 +68,7 @@ CZMQNotificationInterface *CZMQNotificationInterface::CreateWithArguments(
 // Called at startup to conditionally set up ZMQ socket(s)
 bool CZMQNotificationInterface::Initialize()
 {
-    LogPrint("zmq", "zmq: Initialize notification interface\n");
+    LogPrint(Logging::ZMQ, "zmq: Initialize notification interface\n");
     assert(!pcontext);
 
     pcontext = zmq_init(1);
@@ -84,11 +85,12 @@ bool CZMQNotificationInterface::Initialize()
         CZMQAbstractNotifier *notifier = *i;
         if (notifier->Initialize(pcontext))
         {
-            LogPrint("zmq", "  Notifier %s ready (address = %s)\n", notifier->GetType(), notifier->GetAddress());
+            LogPrint(Logging::ZMQ, "  Notifier %s ready (address = %s)\n", notifier->GetType(), notifier->GetAddress());
         }
         else
         {
-            LogPrint("zmq", "  Notifier %s failed (address = %s)\n", notifier->GetType(), notifier->GetAddress());
+            LogPrint(Logging::ZMQ, "  Notifier %s failed (address = %s)\n", notifier->GetType(),
+                notifier->GetAddress());
             break;
         }
     }
@@ -105,13 +107,13 @@ bool CZMQNotificationInterface::Initialize()
 // Called during shutdown sequence
 void CZMQNotificationInterface::Shutdown()
 {
-    LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    LogPrint(Logging::ZMQ, "zmq: Shutdown notification interface\n");
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin(); i != notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
-            LogPrint("zmq", "   Shutdown notifier %s at %s\n", notifier->GetType(), notifier->GetAddress());
+            LogPrint(Logging::ZMQ, "   Shutdown notifier %s at %s\n", notifier->GetType(), notifier->GetAddress());
             notifier->Shutdown();
         }
         zmq_ctx_destroy(pcontext);
@@ -120,12 +122,12 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::NotifyAll(const std::function<bool(CZMQAbstractNotifier *)> &fn)
 {
     for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin(); i != notifiers.end();)
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
+        if (fn(notifier))
         {
             i++;
         }
@@ -137,19 +139,58 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
     }
 }
 
-void CZMQNotificationInterface::SyncTransaction(const CTransactionRef &ptx, const CBlock *pblock, int txIndex)
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
 {
-    for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin(); i != notifiers.end();)
+    const CBlock *pblock = nullptr;
+    if (pblockConnected && hashConnected == pindex->GetBlockHash())
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(ptx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+        pblock = pblockConnected.get();
+    }
+    CZMQRawData raw;
+    NotifyAll([pindex, pblock, &raw](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyBlock(pindex, pblock, raw);
+    });
+}
+
+void CZMQNotificationInterface::SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock)
+{
+    if (pblock)
+    {
+        // a copy shares the transactions, the tip of the chain is the last block connected before UpdatedBlockTip
+        pblockConnected = std::make_shared<const CBlock>(*pblock);
+        hashConnected = pblockConnected->GetHash();
     }
+    CValidationInterface::SyncTransactions(vtx, pblock);
+}
+
+void CZMQNotificationInterface::SyncTransaction(const CTransactionRef &ptx, const CBlock *pblock, int txIndex)
+{
+    CZMQRawData raw;
+    NotifyAll([&ptx, &raw](CZMQAbstractNotifier *notifier) { return notifier->NotifyTransaction(ptx, raw); });
+}
+
+void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef &ptx, uint64_t nMempoolSequence)
+{
+    NotifyAll([&ptx, nMempoolSequence](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyTransactionAcceptance(ptx, nMempoolSequence);
+    });
+}
+
+void CZMQNotificationInterface::TransactionRemovedFromMempool(const CTransactionRef &ptx,
+    MemPoolRemovalReason /*reason*/,
+    uint64_t nMempoolSequence)
+{
+    NotifyAll([&ptx, nMempoolSequence](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyTransactionRemoval(ptx, nMempoolSequence);
+    });
+}
+
+void CZMQNotificationInterface::BlockConnected(const CBlockIndex *pindex)
+{
+    NotifyAll([pindex](CZMQAbstractNotifier *notifier) { return notifier->NotifyBlockConnect(pindex); });
+}
+
+void CZMQNotificationInterface::BlockDisconnected(const CBlockIndex *pindex)
+{
+    NotifyAll([pindex](CZMQAbstractNotifier *notifier) { return notifier->NotifyBlockDisconnect(pindex); });
 }
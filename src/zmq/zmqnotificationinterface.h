@@ -7,7 +7,10 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
 #include <string>
 
 class CBlockIndex;
@@ -26,13 +29,26 @@ protected:
 
     // CValidationInterface
     void SyncTransaction(const CTransactionRef &ptx, const CBlock *pblock, int txIndex = -1);
+    void SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void TransactionAddedToMempool(const CTransactionRef &ptx, uint64_t nMempoolSequence);
+    void TransactionRemovedFromMempool(const CTransactionRef &ptx,
+        MemPoolRemovalReason reason,
+        uint64_t nMempoolSequence);
+    void BlockConnected(const CBlockIndex *pindex);
+    void BlockDisconnected(const CBlockIndex *pindex);
 
 private:
     CZMQNotificationInterface();
 
+    /** Call fn for every notifier, one that fails is shut down and dropped */
+    void NotifyAll(const std::function<bool(CZMQAbstractNotifier *)> &fn);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier *> notifiers;
+    //! the block connected last and its hash, the new tip is published from it instead of being read back from disk
+    std::shared_ptr<const CBlock> pblockConnected;
+    uint256 hashConnected;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
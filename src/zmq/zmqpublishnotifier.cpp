@@ -6,6 +6,7 @@
 #include "zmqpublishnotifier.h"
 //#include "blockstorage/blockstorage.h"
 //#include "chainparams.h"
+#include "crypto/common.h"
 #include "main.h"
 #include "util/util.h"
 
@@ -54,6 +55,43 @@ static int zmq_send_multipart(void *sock, const void *data, size_t size, ...)
     return 0;
 }
 
+static void zmq_release_shared(void * /*data*/, void *hint)
+{
+    delete static_cast<std::shared_ptr<const CDataStream> *>(hint);
+}
+
+// Send topic and data as a two part message, zmq holds a reference to data until it is sent instead of a copy
+static int zmq_send_shared(void *sock,
+    const char *topic,
+    size_t topicSize,
+    const std::shared_ptr<const CDataStream> &data)
+{
+    std::shared_ptr<const CDataStream> *hint = new std::shared_ptr<const CDataStream>(data);
+    zmq_msg_t msg;
+    int rc = zmq_msg_init_data(
+        &msg, const_cast<char *>(data->data()), data->size(), zmq_release_shared, static_cast<void *>(hint));
+    if (rc != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        delete hint;
+        return -1;
+    }
+
+    rc = zmq_send(sock, topic, topicSize, ZMQ_SNDMORE);
+    if (rc != -1)
+    {
+        rc = zmq_msg_send(&msg, sock, 0);
+    }
+    // releases hint once zmq is done with the bytes
+    zmq_msg_close(&msg);
+    if (rc == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        return -1;
+    }
+    return 0;
+}
+
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 {
     assert(!psocket);
@@ -83,7 +121,7 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
     }
     else
     {
-        LogPrint("zmq", "zmq: Reusing socket for address %s\n", address);
+        LogPrint(Logging::ZMQ, "zmq: Reusing socket for address %s\n", address);
 
         psocket = i->second->psocket;
         mapPublishNotifiers.insert(std::make_pair(address, this));
@@ -113,7 +151,7 @@ void CZMQAbstractPublishNotifier::Shutdown()
 
     if (count == 1)
     {
-        LogPrint("zmq", "Close socket at address %s\n", address);
+        LogPrint(Logging::ZMQ, "Close socket at address %s\n", address);
         int linger = 0;
         zmq_setsockopt(psocket, ZMQ_LINGER, &linger, sizeof(linger));
         zmq_close(psocket);
@@ -122,10 +160,12 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = 0;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex,
+    const CBlock * /*pblock*/,
+    CZMQRawData & /*raw*/)
 {
     uint256 hash = pindex->GetBlockHash();
-    LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
+    LogPrint(Logging::ZMQ, "zmq: Publish hashblock %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
         data[31 - i] = hash.begin()[i];
@@ -133,10 +173,10 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return rc == 0;
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx)
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx, CZMQRawData & /*raw*/)
 {
     uint256 hash = ptx->GetHash();
-    LogPrint("zmq", "zmq: Publish hashtx %s\n", hash.GetHex());
+    LogPrint(Logging::ZMQ, "zmq: Publish hashtx %s\n", hash.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
         data[31 - i] = hash.begin()[i];
@@ -144,34 +184,74 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransactionRef
     return rc == 0;
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock, CZMQRawData &raw)
 {
-    LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
+    LogPrint(Logging::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params &consensusParams = pnetMan->getActivePaymentNetwork()->GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    std::shared_ptr<const CDataStream> data;
+    if (pblock)
     {
-        LOCK(cs_main);
+        data = raw.Get(*pblock);
+    }
+    else
+    {
+        // Not holding cs_main, this runs on the validation queue. The position of a block with data does not
+        // change, a pruned file only makes the read fail.
+        const Consensus::Params &consensusParams = pnetMan->getActivePaymentNetwork()->GetConsensus();
         CBlock block;
         if (!ReadBlockFromDisk(block, pindex, consensusParams))
         {
             zmqError("Can't read block from disk");
             return false;
         }
-
-        ss << block;
+        data = raw.Get(block);
     }
 
-    int rc = zmq_send_multipart(psocket, "rawblock", 8, &(*ss.begin()), ss.size(), 0);
+    int rc = zmq_send_shared(psocket, "rawblock", 8, data);
     return rc == 0;
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx)
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx, CZMQRawData &raw)
 {
     uint256 hash = ptx->GetHash();
-    LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << *ptx;
-    int rc = zmq_send_multipart(psocket, "rawtx", 5, &(*ss.begin()), ss.size(), 0);
+    LogPrint(Logging::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
+    int rc = zmq_send_shared(psocket, "rawtx", 5, raw.Get(*ptx));
+    return rc == 0;
+}
+
+bool CZMQPublishSequenceNotifier::SendSequenceMsg(const uint256 &hash, char label, const uint64_t *pnMempoolSequence)
+{
+    LogPrint(Logging::ZMQ, "zmq: Publish sequence %c %s\n", label, hash.GetHex());
+    unsigned char data[32 + 1 + sizeof(uint64_t)];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = label;
+    size_t size = 33;
+    if (pnMempoolSequence)
+    {
+        WriteLE64(data + size, *pnMempoolSequence);
+        size += sizeof(uint64_t);
+    }
+    int rc = zmq_send_multipart(psocket, "sequence", 8, data, size, 0);
     return rc == 0;
 }
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransactionRef &ptx, uint64_t nMempoolSequence)
+{
+    return SendSequenceMsg(ptx->GetHash(), 'A', &nMempoolSequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransactionRef &ptx, uint64_t nMempoolSequence)
+{
+    return SendSequenceMsg(ptx->GetHash(), 'R', &nMempoolSequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const CBlockIndex *pindex)
+{
+    return SendSequenceMsg(pindex->GetBlockHash(), 'C', nullptr);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const CBlockIndex *pindex)
+{
+    return SendSequenceMsg(pindex->GetBlockHash(), 'D', nullptr);
+}
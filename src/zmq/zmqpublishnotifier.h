@@ -20,25 +20,41 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock, CZMQRawData &raw);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransactionRef &ptx);
+    bool NotifyTransaction(const CTransactionRef &ptx, CZMQRawData &raw);
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CBlock *pblock, CZMQRawData &raw);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransactionRef &ptx);
+    bool NotifyTransaction(const CTransactionRef &ptx, CZMQRawData &raw);
+};
+
+/**
+ * Publishes "sequence": the hash, a label and for the mempool labels the mempool sequence, 8 bytes little endian.
+ * C and D are blocks connected and disconnected, A and R transactions added to and removed from the mempool.
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTransactionAcceptance(const CTransactionRef &ptx, uint64_t nMempoolSequence);
+    bool NotifyTransactionRemoval(const CTransactionRef &ptx, uint64_t nMempoolSequence);
+    bool NotifyBlockConnect(const CBlockIndex *pindex);
+    bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+
+private:
+    bool SendSequenceMsg(const uint256 &hash, char label, const uint64_t *pnMempoolSequence);
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H